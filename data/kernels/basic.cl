@@ -663,6 +663,24 @@ interpolate_and_mask(read_only image2d_t input,
 }
 
 
+// bounding box of the pixels where the clipping mask is not zero, as { x_min, y_min, x_max, y_max }
+kernel void
+clipped_bounding_box(read_only image2d_t clipping_mask, const int width, const int height, global int *box)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  if(read_imagef(clipping_mask, sampleri, (int2)(x, y)).w > 0.f)
+  {
+    atomic_min(box + 0, x);
+    atomic_min(box + 1, y);
+    atomic_max(box + 2, x);
+    atomic_max(box + 3, y);
+  }
+}
+
 kernel void
 remosaic_and_replace(read_only image2d_t input,
                      read_only image2d_t interpolated,
@@ -774,7 +792,8 @@ guide_laplacians(read_only image2d_t HF, read_only image2d_t LF,
                  read_only image2d_t output_r, write_only image2d_t output_w,
                  const int width, const int height, const int mult,
                  const float noise_level, const int salt,
-                 const unsigned char scale, const float radius_sq)
+                 const unsigned char scale, const float radius_sq,
+                 const int x_offset, const int y_offset)
 {
   const int x = get_global_id(0);
   const int y = get_global_id(1);
@@ -922,8 +941,10 @@ guide_laplacians(read_only image2d_t HF, read_only image2d_t LF,
   // Last step of RGB reconstruct : add noise
   if((scale & LAST_SCALE) && salt && alpha > 0.f)
   {
-    // Init random number generator
-    unsigned int state[4] = { splitmix32(x + 1), splitmix32((x + 1) * (y + 3)), splitmix32(1337), splitmix32(666) };
+    // Init random number generator, seeded from the coordinates in the whole image
+    const int xs = x + x_offset;
+    const int ys = y + y_offset;
+    unsigned int state[4] = { splitmix32(xs + 1), splitmix32((xs + 1) * (ys + 3)), splitmix32(1337), splitmix32(666) };
     xoshiro128plus(state);
     xoshiro128plus(state);
     xoshiro128plus(state);
@@ -2371,8 +2392,6 @@ lens_vignette (read_only image2d_t in, write_only image2d_t out, const int width
   write_imagef (out, (int2)(x, y), pixel);
 }
 
-
-
 /* kernel for flip */
 __kernel void
 flip(read_only image2d_t in, write_only image2d_t out, const int width, const int height, const int orientation)
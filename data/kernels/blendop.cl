@@ -1320,6 +1320,20 @@ blendop_set_mask (__write_only image2d_t mask, const int width, const int height
 }
 
 
+__kernel void
+blendop_mask_multiply (__read_only image2d_t mask_in, __read_only image2d_t factor, __write_only image2d_t mask_out,
+                       const int width, const int height)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  const float value = read_imagef(mask_in, sampleri, (int2)(x, y)).x * read_imagef(factor, sampleri, (int2)(x, y)).x;
+  write_imagef(mask_out, (int2)(x, y), value);
+}
+
+
 __kernel void
 blendop_display_channel(__read_only image2d_t in_a, __read_only image2d_t in_b, __read_only image2d_t mask,
                         __write_only image2d_t out, const int width, const int height, const int2 offs,
@@ -0,0 +1,301 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+
+/* see src/iop/cacorrectrgb.c for the description of the approach.
+   The CPU version stores the higher and lower manifolds of 3 channels in one 6-channel buffer,
+   here they are two RGBA images. */
+
+#define DT_CACORRECTRGB_MAX_EV_DIFF 2.0f
+
+// the 2 channels guided by channel 'guide'
+#define GUIDED(kc, guide) (((kc) + (guide) + 1) % 3)
+
+kernel void
+cacorrectrgb_manifolds(read_only image2d_t in, read_only image2d_t blurred_in, write_only image2d_t manifold_higher,
+                       write_only image2d_t manifold_lower, const int width, const int height, const int guide)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  float4 blurred = read_imagef(blurred_in, sampleri, (int2)(x, y));
+  const float *const p = (const float *)&pixel;
+  const float *const b = (const float *)&blurred;
+
+  const float pixelg = fmax(p[guide], 1E-6f);
+  const float avg = b[guide];
+  float weighth = (pixelg >= avg) ? 1.0f : 0.0f;
+  float weightl = (pixelg <= avg) ? 1.0f : 0.0f;
+  float logdiffs[2];
+  for(int kc = 0; kc <= 1; kc++)
+    logdiffs[kc] = log2(fmax(p[GUIDED(kc, guide)], 1E-6f) / pixelg);
+
+  // regularization of logdiff to avoid too many problems with noise
+  const float maxlogdiff = fmax(fabs(logdiffs[0]), fabs(logdiffs[1]));
+  if(maxlogdiff > DT_CACORRECTRGB_MAX_EV_DIFF)
+  {
+    const float correction_weight = DT_CACORRECTRGB_MAX_EV_DIFF / maxlogdiff;
+    weightl *= correction_weight;
+    weighth *= correction_weight;
+  }
+
+  float4 high, low;
+  float *const h = (float *)&high;
+  float *const l = (float *)&low;
+  for(int kc = 0; kc <= 1; kc++)
+  {
+    h[GUIDED(kc, guide)] = logdiffs[kc] * weighth;
+    l[GUIDED(kc, guide)] = logdiffs[kc] * weightl;
+  }
+  h[guide] = pixelg * weighth;
+  l[guide] = pixelg * weightl;
+  h[3] = weighth;
+  l[3] = weightl;
+
+  write_imagef(manifold_higher, (int2)(x, y), high);
+  write_imagef(manifold_lower, (int2)(x, y), low);
+}
+
+static inline float4
+_normalize_manifold(float4 manifold, const float4 blurred, const int guide)
+{
+  float *const m = (float *)&manifold;
+  const float weight = fmax(m[3], 1E-2f);
+
+  // normalize guide
+  const float g = m[guide] / weight;
+  m[guide] = g;
+
+  // normalize and unlog other channels
+  for(int kc = 0; kc <= 1; kc++)
+  {
+    const int c = GUIDED(kc, guide);
+    m[c] = exp2(m[c] / weight) * g;
+  }
+
+  // replace by average if weight is too small, with a smooth transition
+  // between full manifold at weight = 0.05 to full average at weight = 0.01
+  if(weight < 0.05f)
+  {
+    const float w = (weight - 0.01f) / (0.05f - 0.01f);
+    const float4 mixed = w * manifold + (1.0f - w) * blurred;
+    manifold.xyz = mixed.xyz;
+  }
+  return manifold;
+}
+
+kernel void
+cacorrectrgb_normalize(read_only image2d_t blurred_in, read_only image2d_t blurred_manifold_higher,
+                       read_only image2d_t blurred_manifold_lower, write_only image2d_t manifold_higher,
+                       write_only image2d_t manifold_lower, const int width, const int height, const int guide)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  const float4 blurred = read_imagef(blurred_in, sampleri, (int2)(x, y));
+  const float4 high = read_imagef(blurred_manifold_higher, sampleri, (int2)(x, y));
+  const float4 low = read_imagef(blurred_manifold_lower, sampleri, (int2)(x, y));
+
+  write_imagef(manifold_higher, (int2)(x, y), _normalize_manifold(high, blurred, guide));
+  write_imagef(manifold_lower, (int2)(x, y), _normalize_manifold(low, blurred, guide));
+}
+
+// build the manifolds again, lowering the weights of the pixels likely to suffer from chromatic aberrations
+kernel void
+cacorrectrgb_refine(read_only image2d_t in, read_only image2d_t blurred_in, read_only image2d_t estimated_higher,
+                    read_only image2d_t estimated_lower, write_only image2d_t manifold_higher,
+                    write_only image2d_t manifold_lower, const int width, const int height, const int guide)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  float4 blurred = read_imagef(blurred_in, sampleri, (int2)(x, y));
+  float4 higher = read_imagef(estimated_higher, sampleri, (int2)(x, y));
+  float4 lower = read_imagef(estimated_lower, sampleri, (int2)(x, y));
+  const float *const p = (const float *)&pixel;
+  const float *const b = (const float *)&blurred;
+  const float *const eh = (const float *)&higher;
+  const float *const el = (const float *)&lower;
+
+  const float pixelg = log2(fmax(p[guide], 1E-6f));
+  const float highg = log2(fmax(eh[guide], 1E-6f));
+  const float lowg = log2(fmax(el[guide], 1E-6f));
+  const float avgg = log2(fmax(b[guide], 1E-6f));
+
+  float w = 1.0f;
+  for(int kc = 0; kc <= 1; kc++)
+  {
+    const int c = GUIDED(kc, guide);
+    const float pixelc = log2(fmax(p[c], 1E-6f));
+    const float highc = log2(fmax(eh[c], 1E-6f));
+    const float lowc = log2(fmax(el[c], 1E-6f));
+
+    // (lowc, lowg) and (highc, highg) are valid points
+    // (lowc, highg) and (highc, lowg) are chromatic aberrations
+    const float dist_to_ll = fabs(pixelg - lowg - pixelc + lowc);
+    const float dist_to_hh = fabs(pixelg - highg - pixelc + highc);
+    const float dist_to_lh = fabs((pixelg - pixelc) - (highg - lowc));
+    const float dist_to_hl = fabs((pixelg - pixelc) - (lowg - highc));
+
+    const int closer_to_low = fabs(pixelg - lowg) < fabs(pixelg - highg);
+    const float dist_to_good = closer_to_low ? dist_to_ll : dist_to_hh;
+    const float dist_to_bad = closer_to_low ? dist_to_hl : dist_to_lh;
+
+    // make w higher if close to good, and smaller if close to bad.
+    w *= 1.0f * (0.2f + 1.0f / fmax(dist_to_good, 0.1f)) / (0.2f + 1.0f / fmax(dist_to_bad, 0.1f));
+  }
+
+  float logdiffs[2];
+  for(int kc = 0; kc <= 1; kc++)
+    logdiffs[kc] = log2(fmax(p[GUIDED(kc, guide)], 1E-6f)) - pixelg;
+
+  // regularization of logdiff to avoid too many problems with noise
+  const float maxlogdiff = fmax(fabs(logdiffs[0]), fabs(logdiffs[1]));
+  if(maxlogdiff > DT_CACORRECTRGB_MAX_EV_DIFF) w *= DT_CACORRECTRGB_MAX_EV_DIFF / maxlogdiff;
+
+  float4 manifold;
+  float *const m = (float *)&manifold;
+  for(int kc = 0; kc <= 1; kc++) m[GUIDED(kc, guide)] = logdiffs[kc] * w;
+  m[guide] = fmax(p[guide], 0.0f) * w;
+  m[3] = w;
+
+  const float4 zero = (float4)(0.0f);
+  write_imagef(manifold_higher, (int2)(x, y), (pixelg > avgg) ? manifold : zero);
+  write_imagef(manifold_lower, (int2)(x, y), (pixelg > avgg) ? zero : manifold);
+}
+
+kernel void
+cacorrectrgb_apply(read_only image2d_t in, read_only image2d_t manifold_higher, read_only image2d_t manifold_lower,
+                   write_only image2d_t out, const int width, const int height, const int guide, const int mode)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  float4 higher = read_imagef(manifold_higher, sampleri, (int2)(x, y));
+  float4 lower = read_imagef(manifold_lower, sampleri, (int2)(x, y));
+  const float *const p = (const float *)&pixel;
+  const float *const h = (const float *)&higher;
+  const float *const l = (const float *)&lower;
+
+  const float high_guide = fmax(h[guide], 1E-6f);
+  const float low_guide = fmax(l[guide], 1E-6f);
+  const float log_high = log2(high_guide);
+  const float log_low = log2(low_guide);
+  const float dist_low_high = log_high - log_low;
+  const float pixelg = fmax(p[guide], 0.0f);
+  const float log_pixg = log2(fmin(fmax(pixelg, low_guide), high_guide));
+
+  // how close the pixel is from the low manifold compared to the high manifold
+  float weight_low = fabs(log_high - log_pixg) / fmax(dist_low_high, 1E-6f);
+  // if the manifolds are very close (under 0.25 EV), make the weight closer to 0.5
+  const float threshold_dist_low_high = 0.25f;
+  if(dist_low_high < threshold_dist_low_high)
+  {
+    const float weight = dist_low_high / threshold_dist_low_high;
+    weight_low = weight_low * weight + 0.5f * (1.0f - weight);
+  }
+  const float weight_high = fmax(1.0f - weight_low, 0.0f);
+
+  float4 result;
+  float *const o = (float *)&result;
+  for(int kc = 0; kc <= 1; kc++)
+  {
+    const int c = GUIDED(kc, guide);
+    const float pixelc = fmax(p[c], 0.0f);
+    const float ratio_high_manifolds = h[c] / high_guide;
+    const float ratio_low_manifolds = l[c] / low_guide;
+    // weighted geometric mean between the ratios.
+    const float ratio = pow(ratio_low_manifolds, weight_low) * pow(ratio_high_manifolds, weight_high);
+    const float outp = pixelg * ratio;
+
+    if(mode == 1) // darken only
+      o[c] = fmin(outp, pixelc);
+    else if(mode == 2) // brighten only
+      o[c] = fmax(outp, pixelc);
+    else
+      o[c] = outp;
+  }
+  o[guide] = pixelg;
+  o[3] = p[3];
+
+  write_imagef(out, (int2)(x, y), result);
+}
+
+// pack the 2 guided channels of in and out, to blur them all in one 4-channel gaussian blur
+kernel void
+cacorrectrgb_pack(read_only image2d_t in, read_only image2d_t corrected, write_only image2d_t in_out,
+                  const int width, const int height, const int guide)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  float4 result = read_imagef(corrected, sampleri, (int2)(x, y));
+  const float *const p = (const float *)&pixel;
+  const float *const o = (const float *)&result;
+  const int c0 = GUIDED(0, guide);
+  const int c1 = GUIDED(1, guide);
+
+  write_imagef(in_out, (int2)(x, y), (float4)(p[c0], o[c0], p[c1], o[c1]));
+}
+
+// keep more of the input where the local averages of input and output are very different
+kernel void
+cacorrectrgb_reduce_artifacts(read_only image2d_t in, read_only image2d_t corrected,
+                              read_only image2d_t blurred_in_out, write_only image2d_t out, const int width,
+                              const int height, const int guide, const float safety)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  const float4 blurred = read_imagef(blurred_in_out, sampleri, (int2)(x, y));
+  float w = 1.0f;
+  w *= exp(-fmax(fabs(log2(fmax(blurred.y, 1E-6f)) - log2(fmax(blurred.x, 1E-6f))), 0.01f) * safety);
+  w *= exp(-fmax(fabs(log2(fmax(blurred.w, 1E-6f)) - log2(fmax(blurred.z, 1E-6f))), 0.01f) * safety);
+
+  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  float4 result = read_imagef(corrected, sampleri, (int2)(x, y));
+  const float *const p = (const float *)&pixel;
+  float *const o = (float *)&result;
+  for(int kc = 0; kc <= 1; kc++)
+  {
+    const int c = GUIDED(kc, guide);
+    o[c] = fmax(1.0f - w, 0.0f) * fmax(p[c], 0.0f) + w * fmax(o[c], 0.0f);
+  }
+
+  write_imagef(out, (int2)(x, y), result);
+}
+
+#undef GUIDED
+#undef DT_CACORRECTRGB_MAX_EV_DIFF
@@ -0,0 +1,139 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "colorspace.h"
+
+// keep in sync with src/iop/clahe.c
+#define BINS 256
+
+kernel void
+clahe_bins(read_only image2d_t in, global int *bins, const int width, const int height)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  const float pmax = clamp(fmax(pixel.x, fmax(pixel.y, pixel.z)), 0.0f, 1.0f);
+  const float pmin = clamp(fmin(pixel.x, fmin(pixel.y, pixel.z)), 0.0f, 1.0f);
+  bins[mad24(y, width, x)] = (int)((pmax + pmin) / 2.0f * (float)BINS + 0.5f);
+}
+
+/* One work item per row, sliding the window histogram along it as the CPU version does.
+   The histograms of all the rows are interleaved, bin b of row j at b * height + j, so that
+   neighbouring work items access neighbouring addresses. */
+kernel void
+clahe_rows(global const int *bins, global float *dest, global int *hist, global int *clippedhist,
+           const int width, const int height, const int rad, const float slope)
+{
+  const int j = get_global_id(0);
+  if(j >= height) return;
+
+#define HIST(b) hist[(b) * height + j]
+#define CLIPPED(b) clippedhist[(b) * height + j]
+
+  const int yMin = max(0, j - rad);
+  const int yMax = min(height, j + rad + 1);
+  const int h = yMax - yMin;
+  const int xMax0 = min(width - 1, rad);
+
+  /* initially fill histogram */
+  for(int b = 0; b <= BINS; b++) HIST(b) = 0;
+  for(int yi = yMin; yi < yMax; ++yi)
+    for(int xi = 0; xi < xMax0; ++xi) HIST(bins[yi * width + xi])++;
+
+  for(int i = 0; i < width; i++)
+  {
+    const int v = bins[j * width + i];
+
+    const int xMin = max(0, i - rad);
+    const int xMax = i + rad + 1;
+    const int w = min(width, xMax) - xMin;
+    const int n = h * w;
+
+    const int limit = (int)(slope * n / BINS + 0.5f);
+
+    /* remove left behind values from histogram */
+    if(xMin > 0)
+      for(int yi = yMin; yi < yMax; ++yi) HIST(bins[yi * width + xMin - 1])--;
+
+    /* add newly included values to histogram */
+    if(xMax <= width)
+      for(int yi = yMin; yi < yMax; ++yi) HIST(bins[yi * width + xMax - 1])++;
+
+    /* clip histogram and redistribute clipped entries */
+    for(int b = 0; b <= BINS; b++) CLIPPED(b) = HIST(b);
+    int ce = 0, ceb = 0;
+    do
+    {
+      ceb = ce;
+      ce = 0;
+      for(int b = 0; b <= BINS; b++)
+      {
+        const int d = max(CLIPPED(b) - limit, 0);
+        ce += d;
+        CLIPPED(b) -= d;
+      }
+
+      const int d = (int)(ce / (float)(BINS + 1));
+      const int m = ce % (BINS + 1);
+      for(int b = 0; b <= BINS; b++) CLIPPED(b) += d;
+
+      if(m != 0)
+      {
+        const int s = (int)(BINS / (float)m);
+        for(int b = 0; b <= BINS; b += s) CLIPPED(b)++;
+      }
+    } while(ce != ceb);
+
+    /* build cdf of clipped histogram */
+    int hMin = BINS;
+    for(int b = 0; b < BINS; b++)
+      if(CLIPPED(b) != 0)
+      {
+        hMin = b;
+        break;
+      }
+
+    int cdf = 0;
+    for(int b = hMin; b <= v; b++) cdf += CLIPPED(b);
+
+    int cdfMax = cdf;
+    for(int b = v + 1; b <= BINS; b++) cdfMax += CLIPPED(b);
+
+    const int cdfMin = CLIPPED(hMin);
+
+    dest[j * width + i] = (cdf - cdfMin) / (float)(cdfMax - cdfMin);
+  }
+
+#undef HIST
+#undef CLIPPED
+}
+
+kernel void
+clahe_apply(read_only image2d_t in, write_only image2d_t out, global const float *dest,
+            const int width, const int height)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  float4 HSL = RGB_2_HSL(read_imagef(in, sampleri, (int2)(x, y)));
+  HSL.z = dest[mad24(y, width, x)];
+  write_imagef(out, (int2)(x, y), HSL_2_RGB(HSL));
+}
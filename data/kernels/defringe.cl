@@ -0,0 +1,162 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+
+// keep in sync with src/iop/defringe.c
+#define MAGIC_THRESHOLD_COEFF 33.0f
+
+// edge-detect on color channels: difference of original to gaussian blurred image
+kernel void
+defringe_edges(read_only image2d_t in, read_only image2d_t blurred, global float *edges,
+               const int width, const int height)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const float4 i = read_imagef(in, sampleri, (int2)(x, y));
+  const float4 b = read_imagef(blurred, sampleri, (int2)(x, y));
+  const float da = i.y - b.y;
+  const float db = i.z - b.z;
+  edges[mad24(y, width, x)] = da * da + db * db;
+}
+
+kernel void
+defringe_reduce_first(global const float *edges, const int width, const int height, global float *accu,
+                      local float *buffer)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  const int xlsz = get_local_size(0);
+  const int ylsz = get_local_size(1);
+  const int xlid = get_local_id(0);
+  const int ylid = get_local_id(1);
+
+  const int l = mad24(ylid, xlsz, xlid);
+
+  buffer[l] = (x < width && y < height) ? edges[mad24(y, width, x)] : 0.0f;
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  const int lsz = mul24(xlsz, ylsz);
+
+  for(int offset = lsz / 2; offset > 0; offset = offset / 2)
+  {
+    if(l < offset)
+    {
+      buffer[l] += buffer[l + offset];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  const int xgid = get_group_id(0);
+  const int ygid = get_group_id(1);
+  const int xgsz = get_num_groups(0);
+
+  const int m = mad24(ygid, xgsz, xgid);
+  accu[m] = buffer[0];
+}
+
+kernel void
+defringe_reduce_second(const global float *input, global float *result, const int length, local float *buffer)
+{
+  int x = get_global_id(0);
+  float sum = 0.0f;
+
+  while(x < length)
+  {
+    sum += input[x];
+    x += get_global_size(0);
+  }
+
+  const int lid = get_local_id(0);
+  buffer[lid] = sum;
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for(int offset = get_local_size(0) / 2; offset > 0; offset = offset / 2)
+  {
+    if(lid < offset)
+    {
+      buffer[lid] += buffer[lid + offset];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if(lid == 0) result[get_group_id(0)] = buffer[0];
+}
+
+static inline float
+_edge(global const float *edges, const int x, const int y, const int width, const int height)
+{
+  return edges[mad24(clamp(y, 0, height - 1), width, clamp(x, 0, width - 1))];
+}
+
+/* replace the chroma of the pixels over the threshold, or next to one, by the inverse edge chroma
+   weighted average of their neighbourhood, sampled along fibonacci lattices */
+kernel void
+defringe_apply(read_only image2d_t in, write_only image2d_t out, global const float *edges, const int width,
+               const int height, global const int2 *xy_avg, const int samples_avg, global const int2 *xy_small,
+               const int samples_small, const float thresh, const float avg_edge_chroma, const int local_average,
+               const float user_thresh, const int mask_display)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  const float edge = _edge(edges, x, y, width, height);
+
+  float local_thresh = thresh;
+  float avg_chroma = avg_edge_chroma;
+  if(local_average && edge > thresh)
+  {
+    float local_avg = 0.0f;
+    for(int u = 0; u < samples_avg; u++)
+      local_avg += _edge(edges, x + xy_avg[u].x, y + xy_avg[u].y, width, height);
+    avg_chroma = fmax(0.01f, local_avg / samples_avg);
+    local_thresh = fmax(0.1f, 4.0f * user_thresh * avg_chroma / MAGIC_THRESHOLD_COEFF);
+  }
+
+  // reduces artifacts ("region growing by 1 pixel")
+  int fringe = 0;
+  for(int j = -1; j <= 1; j++)
+    for(int i = -1; i <= 1; i++) fringe |= _edge(edges, x + i, y + j, width, height) > local_thresh;
+
+  if(fringe)
+  {
+    float atot = 0.0f, btot = 0.0f, norm = 0.0f;
+    for(int u = 0; u < samples_small; u++)
+    {
+      const int xx = clamp(x + xy_small[u].x, 0, width - 1);
+      const int yy = clamp(y + xy_small[u].y, 0, height - 1);
+      const float4 neighbour = read_imagef(in, sampleri, (int2)(xx, yy));
+      const float weight = 1.0f / (edges[mad24(yy, width, xx)] + avg_chroma);
+      atot += weight * neighbour.y;
+      btot += weight * neighbour.z;
+      norm += weight;
+    }
+    pixel.y = atot / norm;
+    pixel.z = btot / norm;
+  }
+
+  // as the CPU version, the edge chroma is left in the alpha channel unless the mask is displayed
+  if(!mask_display) pixel.w = edge;
+  write_imagef(out, (int2)(x, y), pixel);
+}
@@ -519,6 +519,26 @@ denoiseprofile_synthesize(read_only image2d_t coarse, read_only image2d_t detail
 }
 
 
+// adds the thresholded detail scale to the accumulator, which starts from 0 for the first scale
+kernel void
+denoiseprofile_accumulate(read_only image2d_t accu, read_only image2d_t detail, write_only image2d_t out,
+     const int width, const int height, const int first,
+     const float t0, const float t1, const float t2, const float t3)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  const float4 threshold = (float4)(t0, t1, t2, t3);
+  const float4 c = first ? (float4)(0.0f) : read_imagef(accu, sampleri, (int2)(x, y));
+  const float4 d = read_imagef(detail, sampleri, (int2)(x, y));
+  float4 sum = c + copysign(max((float4)(0.0f), fabs(d) - threshold), d);
+  sum.w = 0.0f;
+  write_imagef (out, (int2)(x, y), sum);
+}
+
+
 kernel void
 denoiseprofile_reduce_first(read_only image2d_t in, const int width, const int height,
                             global float4 *accu, local float4 *buffer)
@@ -296,6 +296,27 @@ diffuse_pde(read_only image2d_t HF, read_only image2d_t LF,
   write_imagef(output, (int2)(x, y), out);
 }
 
+// one work item per row: squared norms of the update and of the previous iteration along that row
+kernel void
+diffuse_update_norm(read_only image2d_t previous, read_only image2d_t current, global float *norms,
+                    const int width, const int height)
+{
+  const int y = get_global_id(0);
+  if(y >= height) return;
+
+  float update = 0.f;
+  float reference = 0.f;
+  for(int x = 0; x < width; x++)
+  {
+    const float4 prev = read_imagef(previous, samplerA, (int2)(x, y));
+    const float4 delta = read_imagef(current, samplerA, (int2)(x, y)) - prev;
+    update += delta.x * delta.x + delta.y * delta.y + delta.z * delta.z;
+    reference += prev.x * prev.x + prev.y * prev.y + prev.z * prev.z;
+  }
+  norms[2 * y] = update;
+  norms[2 * y + 1] = reference;
+}
+
 kernel void
 build_mask(read_only image2d_t in, write_only image2d_t mask,
            const float threshold, const int width, const int height)
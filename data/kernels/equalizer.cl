@@ -0,0 +1,106 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+
+/* Edge-avoiding wavelet transform of src/iop/equalizer_eaw.h. The CPU version lifts a whole row or
+   column at a time, but each predict step only reads the coarse samples and each update step only reads
+   the detail samples, so every sample of a step can be lifted in parallel. */
+
+// copy of the luma at the coarse samples of level l, the edge-avoiding weights are computed from it
+kernel void
+equalizer_weights(global const float4 *buf, global float *weights, const int width, const int l,
+                  const int wd, const int ht)
+{
+  const int i = get_global_id(0);
+  const int j = get_global_id(1);
+  if(i >= wd || j >= ht) return;
+
+  // zero out the right-most column and the bottom row
+  weights[mad24(j, wd, i)] = (i < wd - 1 && j < ht - 1) ? buf[(j << (l - 1)) * width + (i << (l - 1))].x : 0.0f;
+}
+
+static inline float
+_gweight(global const float *weights, const int wd, const int l, const int i, const int j, const int ii,
+         const int jj)
+{
+  return 1.0f / (fabs(weights[wd * (j >> (l - 1)) + (i >> (l - 1))] - weights[wd * (jj >> (l - 1)) + (ii >> (l - 1))])
+                 + 1.e-5f);
+}
+
+/* One lifting step of level l along the rows, or along the columns if vertical is set. The predict step
+   adds sign * the prediction to the detail samples, the update step adds sign * half of it to the coarse
+   samples: sign is -1 then 1 for the forward transform, 1 then -1 for the inverse. */
+kernel void
+equalizer_lift(global float4 *buf, global const float *weights, const int width, const int height,
+               const int l, const int wd, const int vertical, const int update, const float sign)
+{
+  const int k = vertical ? get_global_id(1) : get_global_id(0);
+  const int line = vertical ? get_global_id(0) : get_global_id(1);
+  const int n = vertical ? height : width;
+  if(line >= (vertical ? width : height)) return;
+
+  const int st = 1 << (l - 1);
+  const int pos = k * 2 * st + (update ? 0 : st);
+  if(pos >= n) return;
+
+#define INDEX(p) (vertical ? (p) * width + line : line * width + (p))
+#define GWEIGHT(p, q) (vertical ? _gweight(weights, wd, l, line, p, line, q) : _gweight(weights, wd, l, p, line, q, line))
+
+  const int index = INDEX(pos);
+  float4 value = buf[index];
+  const float alpha = value.w;
+
+  if(update && pos == 0)
+    value += sign * buf[INDEX(st)] * 0.5f;
+  else if(pos + st < n)
+  {
+    const float w0 = GWEIGHT(pos - st, pos);
+    const float w1 = GWEIGHT(pos, pos + st);
+    const float4 prediction = (w0 * buf[INDEX(pos - st)] + w1 * buf[INDEX(pos + st)]) / (w0 + w1);
+    value += sign * (update ? 0.5f : 1.0f) * prediction;
+  }
+  else
+    value += sign * (update ? 0.5f : 1.0f) * buf[INDEX(pos - st)];
+
+#undef INDEX
+#undef GWEIGHT
+
+  value.w = alpha;
+  buf[index] = value;
+}
+
+// scale the detail coefficients of level l, coeff.w is 1
+kernel void
+equalizer_scale(global float4 *buf, const int width, const int height, const int l, const float4 coeff)
+{
+  const int i = get_global_id(0);
+  const int j = get_global_id(1);
+  if(i >= width || j >= height) return;
+
+  const int step = 1 << l;
+  const int st = step / 2;
+  const int mi = i & (step - 1);
+  const int mj = j & (step - 1);
+
+  const size_t k = mad24(j, width, i);
+  if((mj == 0 && mi == st) || (mj == st && mi == 0))
+    buf[k] *= coeff;
+  else if(mj == st && mi == st)
+    buf[k] *= coeff * coeff;
+}
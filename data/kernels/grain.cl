@@ -0,0 +1,157 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+
+// keep in sync with src/iop/grain.c
+#define GRAIN_LIGHTNESS_STRENGTH_SCALE 0.15f
+#define GRAIN_LUT_SIZE 128
+
+constant int permutation[256] = {
+  151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140, 36, 103, 30,
+  69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148, 247, 120, 234, 75, 0, 26, 197, 62,
+  94, 252, 219, 203, 117, 35, 11, 32, 57, 177, 33, 88, 237, 149, 56, 87, 174, 20, 125, 136,
+  171, 168, 68, 175, 74, 165, 71, 134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229, 122,
+  60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54, 65, 25, 63, 161,
+  1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169, 200, 196, 135, 130, 116, 188, 159, 86,
+  164, 100, 109, 198, 173, 186, 3, 64, 52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126,
+  255, 82, 85, 212, 207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213,
+  119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172, 9, 129, 22, 39, 253,
+  19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104, 218, 246, 97, 228, 251, 34, 242, 193,
+  238, 210, 144, 12, 191, 179, 162, 241, 81, 51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31,
+  181, 199, 106, 157, 184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93,
+  222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180
+};
+
+constant float4 grad3[12] = { (float4)(1, 1, 0, 0),  (float4)(-1, 1, 0, 0),  (float4)(1, -1, 0, 0),
+                              (float4)(-1, -1, 0, 0), (float4)(1, 0, 1, 0),  (float4)(-1, 0, 1, 0),
+                              (float4)(1, 0, -1, 0),  (float4)(-1, 0, -1, 0), (float4)(0, 1, 1, 0),
+                              (float4)(0, -1, 1, 0),  (float4)(0, 1, -1, 0),  (float4)(0, -1, -1, 0) };
+
+// parametrization of octaves to match power spectrum of real grain scans
+constant float octave_f[3] = { 0.4910f, 0.9441f, 1.7280f };
+constant float octave_a[3] = { 0.2340f, 0.7850f, 1.2150f };
+
+#define PERM(i) permutation[(i) & 255]
+
+static inline float
+_corner(const int gi, const float4 p)
+{
+  float t = fmax(0.6f - dot(p, p), 0.0f);
+  t *= t;
+  return t * t * dot(grad3[gi], p);
+}
+
+// 3D simplex noise, same as the CPU version but in single precision
+static inline float
+_simplex_noise(const float xin, const float yin, const float zin)
+{
+  const float F3 = 1.0f / 3.0f;
+  const float G3 = 1.0f / 6.0f;
+  const float s = (xin + yin + zin) * F3;
+  const int i = (int)floor(xin + s);
+  const int j = (int)floor(yin + s);
+  const int k = (int)floor(zin + s);
+  const float t = (i + j + k) * G3;
+  const float4 p0 = (float4)(xin - (i - t), yin - (j - t), zin - (k - t), 0.0f);
+
+  // offsets of the second and third corners of the simplex we are in
+  const int xy = p0.x >= p0.y, yz = p0.y >= p0.z, xz = p0.x >= p0.z;
+  const int4 o1 = (int4)(xy & xz, !xy & yz, !yz & !(xy & xz), 0);
+  const int4 o2 = (int4)(xy | (yz & xz), !xy | yz, !yz | (!xy & !xz), 0);
+
+  float4 p1 = p0 - convert_float4(o1) + G3;
+  float4 p2 = p0 - convert_float4(o2) + 2.0f * G3;
+  float4 p3 = p0 - 1.0f + 3.0f * G3;
+  p1.w = p2.w = p3.w = 0.0f;
+
+  const int gi0 = PERM(i + PERM(j + PERM(k))) % 12;
+  const int gi1 = PERM(i + o1.x + PERM(j + o1.y + PERM(k + o1.z))) % 12;
+  const int gi2 = PERM(i + o2.x + PERM(j + o2.y + PERM(k + o2.z))) % 12;
+  const int gi3 = PERM(i + 1 + PERM(j + 1 + PERM(k + 1))) % 12;
+
+  return 32.0f * (_corner(gi0, p0) + _corner(gi1, p1) + _corner(gi2, p2) + _corner(gi3, p3));
+}
+
+/* The noise of octave o is periodic with a period of 768 along x: the host folds the large per-image
+   offset into that period for each octave, so that the coordinates stay small enough for floats. */
+static inline float
+_simplex_2d_noise(const float x, const float y, const float zoom, const float4 offset)
+{
+  return _simplex_noise(x * octave_f[0] / zoom + offset.x, y * octave_f[0] / zoom, 0.0f) * octave_a[0]
+       + _simplex_noise(x * octave_f[1] / zoom + offset.y, y * octave_f[1] / zoom, 1.0f) * octave_a[1]
+       + _simplex_noise(x * octave_f[2] / zoom + offset.z, y * octave_f[2] / zoom, 2.0f) * octave_a[2];
+}
+
+static inline float
+_lut_lookup_2d_1c(global const float *grain_lut, const float x, const float y)
+{
+  const float _x = clamp((x + 0.5f) * (GRAIN_LUT_SIZE - 1), 0.0f, (float)(GRAIN_LUT_SIZE - 1));
+  const float _y = clamp(y * (GRAIN_LUT_SIZE - 1), 0.0f, (float)(GRAIN_LUT_SIZE - 1));
+
+  const int _x0 = min((int)_x, GRAIN_LUT_SIZE - 2);
+  const int _y0 = min((int)_y, GRAIN_LUT_SIZE - 2);
+
+  const float x_diff = _x - _x0;
+  const float y_diff = _y - _y0;
+
+  const float l00 = grain_lut[_y0 * GRAIN_LUT_SIZE + _x0];
+  const float l01 = grain_lut[_y0 * GRAIN_LUT_SIZE + _x0 + 1];
+  const float l10 = grain_lut[(_y0 + 1) * GRAIN_LUT_SIZE + _x0];
+  const float l11 = grain_lut[(_y0 + 1) * GRAIN_LUT_SIZE + _x0 + 1];
+
+  const float xy0 = (1.0f - y_diff) * l00 + l10 * y_diff;
+  const float xy1 = (1.0f - y_diff) * l01 + l11 * y_diff;
+  return xy0 * (1.0f - x_diff) + xy1 * x_diff;
+}
+
+kernel void
+grain(read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+      const int roi_x, const int roi_y, const float roi_scale, const float wd, const float zoom,
+      const float strength, const int filter, const float filtermul, const float4 offset,
+      global const float *grain_lut)
+{
+  const int i = get_global_id(0);
+  const int j = get_global_id(1);
+  if(i >= width || j >= height) return;
+
+  float4 pixel = read_imagef(in, sampleri, (int2)(i, j));
+
+  // x, y: normalized to shorter side of image, so with pixel aspect = 1.
+  const float x = (roi_x + i) / roi_scale / wd;
+  const float y = (roi_y + j) / roi_scale / wd;
+
+  float noise = 0.0f;
+  if(filter)
+  {
+    // if zoomed out a lot, use rank-1 lattice downsampling
+    const float fib1 = 34.0f, fib2 = 21.0f;
+    for(int l = 0; l < 21; l++)
+    {
+      const float px = l / fib2;
+      float py = l * (fib1 / fib2);
+      py -= (int)py;
+      noise += (1.0f / fib2) * _simplex_2d_noise(x + px * filtermul, y + py * filtermul, zoom, offset);
+    }
+  }
+  else
+    noise = _simplex_2d_noise(x, y, zoom, offset);
+
+  pixel.x += _lut_lookup_2d_1c(grain_lut, noise * strength * GRAIN_LIGHTNESS_STRENGTH_SCALE, pixel.x / 100.0f);
+  write_imagef(out, (int2)(i, j), pixel);
+}
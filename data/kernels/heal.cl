@@ -0,0 +1,128 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* the multi-grid laplace solver of src/common/heal.c, on interleaved float4 buffers */
+
+kernel void
+heal_sub(global float4 *dest, global const float4 *src, const int width, const int height)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const int k = mad24(y, width, x);
+  dest[k] -= src[k];
+}
+
+kernel void
+heal_add(global float4 *dest, global const float4 *src, const int width, const int height)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const int k = mad24(y, width, x);
+  dest[k] += src[k];
+}
+
+// the known pixels of a coarse level: the mean of the known pixels below them
+kernel void
+heal_restrict(global const float4 *fine, global const float *fmask, const int fwidth, const int fheight,
+              global float4 *coarse, global const float *cmask, const int cwidth, const int cheight)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= cwidth || y >= cheight) return;
+
+  const int k = mad24(y, cwidth, x);
+  float4 sum = (float4)0.0f;
+  int count = 0;
+  if(cmask[k] == 0.0f)
+    for(int j = 2 * y; j < min(2 * y + 2, fheight); j++)
+      for(int i = 2 * x; i < min(2 * x + 2, fwidth); i++)
+      {
+        const int l = mad24(j, fwidth, i);
+        if(fmask[l] != 0.0f) continue;
+        sum += fine[l];
+        count++;
+      }
+  coarse[k] = count ? sum / (float)count : (float4)0.0f;
+}
+
+// bilinear interpolation of the coarse level into the unknown pixels of the finer one
+kernel void
+heal_prolong(global const float4 *coarse, const int cwidth, const int cheight,
+             global float4 *fine, global const float *fmask, const int fwidth, const int fheight)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= fwidth || y >= fheight) return;
+
+  const int k = mad24(y, fwidth, x);
+  if(fmask[k] == 0.0f) return;
+
+  const float cx = clamp(0.5f * x - 0.25f, 0.0f, (float)(cwidth - 1));
+  const float cy = clamp(0.5f * y - 0.25f, 0.0f, (float)(cheight - 1));
+  const int x0 = min((int)cx, max(cwidth - 2, 0));
+  const int y0 = min((int)cy, max(cheight - 2, 0));
+  const int x1 = min(x0 + 1, cwidth - 1);
+  const int y1 = min(y0 + 1, cheight - 1);
+  const float wx = cx - x0;
+  const float wy = cy - y0;
+
+  fine[k] = (1.0f - wy) * ((1.0f - wx) * coarse[mad24(y0, cwidth, x0)] + wx * coarse[mad24(y0, cwidth, x1)])
+            + wy * ((1.0f - wx) * coarse[mad24(y1, cwidth, x0)] + wx * coarse[mad24(y1, cwidth, x1)]);
+}
+
+// one color of a red/black Gauss-Seidel sweep with over-relaxation.
+// If err is set, the squared update of the pixels of that color goes there.
+kernel void
+heal_relax(global float4 *pixels, global const float *mask, const int width, const int height, const float w,
+           const int parity, global float *err, const int with_err)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height || ((x + y) & 1) != parity) return;
+
+  const int k = mad24(y, width, x);
+  float4 diff = (float4)0.0f;
+  if(mask[k] != 0.0f)
+  {
+    float4 sum = (float4)0.0f;
+    float a = 0.0f;
+    if(y > 0)          { sum += pixels[k - width]; a += 1.0f; }
+    if(y < height - 1) { sum += pixels[k + width]; a += 1.0f; }
+    if(x > 0)          { sum += pixels[k - 1]; a += 1.0f; }
+    if(x < width - 1)  { sum += pixels[k + 1]; a += 1.0f; }
+    diff = w * (a * pixels[k] - sum);
+    pixels[k] -= diff;
+  }
+  if(with_err) err[k] = diff.x * diff.x + diff.y * diff.y + diff.z * diff.z;
+}
+
+// sum of each row of err
+kernel void
+heal_row_sum(global const float *err, global float *sums, const int width, const int height)
+{
+  const int y = get_global_id(0);
+  if(y >= height) return;
+
+  float sum = 0.0f;
+  for(int x = 0; x < width; x++) sum += err[mad24(y, width, x)];
+  sums[y] = sum;
+}
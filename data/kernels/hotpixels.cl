@@ -0,0 +1,179 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+
+/* The CPU version fixes the hot pixels in a copy of the input, and marks them by writing their value
+   on the sites of the same color up to 10 pixels around them in the row, the last hot pixel of the row
+   winning. Here every pixel gathers its value instead, in the same order of precedence. */
+
+static inline float
+_read(read_only image2d_t in, const int x, const int y)
+{
+  return read_imagef(in, sampleri, (int2)(x, y)).x;
+}
+
+// offsets are the 4 nearest sites of the same color, as (x, y) pairs
+static inline int
+_is_hot(read_only image2d_t in, const int x, const int y, const int width, const int height,
+        const float threshold, const float multiplier, const int min_neighbours, const int4 dx, const int4 dy,
+        float *maxin)
+{
+  if(x < 2 || y < 2 || x >= width - 2 || y >= height - 2) return 0;
+
+  const float value = _read(in, x, y);
+  if(!(value > threshold)) return 0;
+
+  const float mid = value * multiplier;
+  const float other[4] = { _read(in, x + dx.x, y + dy.x), _read(in, x + dx.y, y + dy.y),
+                           _read(in, x + dx.z, y + dy.z), _read(in, x + dx.w, y + dy.w) };
+  int count = 0;
+  float m = 0.0f;
+  for(int n = 0; n < 4; n++)
+  {
+    if(mid > other[n])
+    {
+      count++;
+      if(other[n] > m) m = other[n];
+    }
+  }
+  *maxin = m;
+  return count >= min_neighbours;
+}
+
+kernel void
+hotpixels_bayer(read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+                const float threshold, const float multiplier, const int min_neighbours, const int markfixed,
+                global int *fixed)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  const int4 dx = (int4)(-2, 0, 2, 0);
+  const int4 dy = (int4)(0, -2, 0, 2);
+
+  float maxin = 0.0f;
+  float pixel = _read(in, x, y);
+  const int hot = _is_hot(in, x, y, width, height, threshold, multiplier, min_neighbours, dx, dy, &maxin);
+  if(hot) atomic_inc(fixed);
+
+  int marked = 0;
+  if(markfixed)
+  {
+    // the marks of hot pixels on the right are written last
+    for(int i = 10; i >= 2 && !marked; i -= 2)
+    {
+      float unused;
+      if(_is_hot(in, x + i, y, width, height, threshold, multiplier, min_neighbours, dx, dy, &unused))
+      {
+        pixel = _read(in, x + i, y);
+        marked = 1;
+      }
+    }
+  }
+
+  if(!marked && hot)
+    pixel = maxin;
+  else if(!marked && markfixed)
+  {
+    for(int i = 2; i <= 10 && !marked; i += 2)
+    {
+      float unused;
+      if(_is_hot(in, x - i, y, width, height, threshold, multiplier, min_neighbours, dx, dy, &unused))
+      {
+        pixel = _read(in, x - i, y);
+        marked = 1;
+      }
+    }
+  }
+
+  write_imagef(out, (int2)(x, y), (float4)(pixel, 0.0f, 0.0f, 0.0f));
+}
+
+static inline void
+_xtrans_offsets(global const int *offsets, const int x, const int y, int4 *dx, int4 *dy)
+{
+  global const int *o = offsets + ((y % 6) * 6 + (x % 6)) * 8;
+  *dx = (int4)(o[0], o[2], o[4], o[6]);
+  *dy = (int4)(o[1], o[3], o[5], o[7]);
+}
+
+static inline int
+_is_hot_xtrans(read_only image2d_t in, const int x, const int y, const int width, const int height,
+               const float threshold, const float multiplier, const int min_neighbours,
+               global const int *offsets, float *maxin)
+{
+  if(x < 2 || y < 2 || x >= width - 2 || y >= height - 2) return 0;
+  int4 dx, dy;
+  _xtrans_offsets(offsets, x, y, &dx, &dy);
+  return _is_hot(in, x, y, width, height, threshold, multiplier, min_neighbours, dx, dy, maxin);
+}
+
+// offsets: for each site of the 6x6 CFA block, the (x, y) offsets of its 4 nearest sites of the same color
+kernel void
+hotpixels_xtrans(read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+                 const float threshold, const float multiplier, const int min_neighbours, const int markfixed,
+                 global int *fixed, const int rx, const int ry, global const unsigned char (*const xtrans)[6],
+                 global const int *offsets)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  float maxin = 0.0f;
+  float pixel = _read(in, x, y);
+  const int hot = _is_hot_xtrans(in, x, y, width, height, threshold, multiplier, min_neighbours, offsets, &maxin);
+  if(hot) atomic_inc(fixed);
+
+  const int c = FCxtrans(y + ry, x + rx, xtrans);
+  int marked = 0;
+  if(markfixed)
+  {
+    for(int i = 10; i >= 2 && !marked; i--)
+    {
+      float unused;
+      if(x + i < width && FCxtrans(y + ry, x + i + rx, xtrans) == c
+         && _is_hot_xtrans(in, x + i, y, width, height, threshold, multiplier, min_neighbours, offsets, &unused))
+      {
+        pixel = _read(in, x + i, y);
+        marked = 1;
+      }
+    }
+  }
+
+  if(!marked && hot)
+    pixel = maxin;
+  else if(!marked && markfixed)
+  {
+    for(int i = 2; i <= 10 && !marked; i++)
+    {
+      float unused;
+      if(x - i >= 0 && FCxtrans(y + ry, x - i + rx, xtrans) == c
+         && _is_hot_xtrans(in, x - i, y, width, height, threshold, multiplier, min_neighbours, offsets, &unused))
+      {
+        pixel = _read(in, x - i, y);
+        marked = 1;
+      }
+    }
+  }
+
+  write_imagef(out, (int2)(x, y), (float4)(pixel, 0.0f, 0.0f, 0.0f));
+}
@@ -0,0 +1,53 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+
+// programs.conf builds this file again with -DLENS_MAP_CHANNELS for the usual maps:
+// 6 coordinates for the distortion, 4 channels for the vignetting. The loops are unrolled then.
+#ifndef LENS_MAP_CHANNELS
+#define LENS_MAP_CHANNELS channels
+#endif
+
+/* bilinear expansion of a lens correction map sampled every `step` pixels of the full image,
+   see _map_sample() in src/iop/lens.cc */
+kernel void
+lens_map_expand (global const float *map, global float *out, const int width, const int height,
+                 const int x0, const int y0, const int map_width, const int map_height, const int channels,
+                 const int step)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  const float fx = max(x0 + x, 0) / (float)step;
+  const float fy = max(y0 + y, 0) / (float)step;
+  const int i = min((int)fx, map_width - 2);
+  const int j = min((int)fy, map_height - 2);
+  const float wx = fx - i;
+  const float wy = fy - j;
+
+  global const float *n0 = map + (j * map_width + i) * LENS_MAP_CHANNELS;
+  global const float *n1 = n0 + map_width * LENS_MAP_CHANNELS;
+  global float *o = out + mad24(y, width, x) * LENS_MAP_CHANNELS;
+
+  for(int c = 0; c < LENS_MAP_CHANNELS; c++)
+    o[c] = (1.0f - wy) * ((1.0f - wx) * n0[c] + wx * n0[LENS_MAP_CHANNELS + c])
+           + wy * ((1.0f - wx) * n1[c] + wx * n1[LENS_MAP_CHANNELS + c]);
+}
@@ -64,10 +64,12 @@ float kmix (global const float *k,
  * @param out
  * @param roi_in
  * @param roi_out
- * @param map
- * @param map_extent
+ * @param map         The displacements of all the rectangles, one after the other.
+ * @param map_extents The rectangles of the warped area.
  * @param kdesc       Kernel description.
  * @param k           Discrete kernel.
+ * @param rect        The rectangle processed by this run.
+ * @param map_offset  Start of the displacements of that rectangle in map.
  */
 
 kernel void
@@ -76,17 +78,20 @@ warp_kernel (read_only image2d_t in,
 	     global dt_iop_roi_t *roi_in,
 	     global dt_iop_roi_t *roi_out,
 	     global float2 *map,
-	     global cairo_rectangle_int_t *map_extent,
+	     global cairo_rectangle_int_t *map_extents,
 	     global dt_liquify_kernel_descriptor_t *kdesc,
-	     global float *k)
+	     global float *k,
+	     const int rect,
+	     const int map_offset)
 {
   int2 pos = (int2) (get_global_id (0), get_global_id (1));
+  global const cairo_rectangle_int_t *map_extent = map_extents + rect;
 
   // stop surplus workers in the last workgroup
   if (pos.x >= map_extent->width || pos.y >= map_extent->height)
     return;
 
-  float2 warp = map[pos.y * map_extent->width + pos.x];
+  float2 warp = map[map_offset + pos.y * map_extent->width + pos.x];
 
   const int2 map_origin = (int2) (map_extent->x, map_extent->y);
   pos += map_origin;
@@ -315,3 +315,140 @@ write_back(
   pixel.x = 100.0f*read_imagef(processed, sampleri, (int2)(x+max_supp, y+max_supp)).x;
   write_imagef (output, (int2)(x, y), pixel);
 }
+
+// the fast variant, see local_laplacian_fast_internal() in src/common/locallaplacian.c
+
+#define NUM_GAMMA_FAST 4
+
+// Catmull-Rom kernel, at distance s from a sample
+static inline float
+cubic(const float s)
+{
+  const float a = fabs(s);
+  const float a2 = a * a;
+  const float a3 = a2 * a;
+  if(a < 1.0f) return 1.5f * a3 - 2.5f * a2 + 1.0f;
+  if(a < 2.0f) return -0.5f * a3 + 2.5f * a2 - 4.0f * a + 2.0f;
+  return 0.0f;
+}
+
+// weight of the gamma sample k at brightness v, the end samples are replicated outside
+static inline float
+gamma_weight(const float v, const int k)
+{
+  const float t = clamp(v * NUM_GAMMA_FAST - 0.5f, 0.0f, NUM_GAMMA_FAST - 1.0f);
+  float weight = cubic(t - k);
+  if(k == 0) weight += cubic(t + 1.0f);
+  if(k == NUM_GAMMA_FAST - 1) weight += cubic(t - NUM_GAMMA_FAST);
+  return weight;
+}
+
+// same as expand_gaussian(), one level of the output pyramid stored with a stride of cw
+static inline float
+expand_gaussian_buffer(
+    global const float *coarse,
+    const int i,
+    const int j,
+    const int cw)
+{
+  float c = 0.0f;
+  const float w[5] = {1.0f/16.0f, 4.0f/16.0f, 6.0f/16.0f, 4.0f/16.0f, 1.0f/16.0f};
+  const int cx = i/2;
+  const int cy = j/2;
+  switch((i&1) + 2*(j&1))
+  {
+    case 0: // both are even, 3x3 stencil
+      for(int ii=-1;ii<=1;ii++) for(int jj=-1;jj<=1;jj++)
+        c += coarse[(cy+jj)*cw+cx+ii]*w[2*jj+2]*w[2*ii+2];
+      break;
+    case 1: // i is odd, 2x3 stencil
+      for(int ii=0;ii<=1;ii++) for(int jj=-1;jj<=1;jj++)
+        c += coarse[(cy+jj)*cw+cx+ii]*w[2*jj+2]*w[2*ii+1];
+      break;
+    case 2: // j is odd, 3x2 stencil
+      for(int ii=-1;ii<=1;ii++) for(int jj=0;jj<=1;jj++)
+        c += coarse[(cy+jj)*cw+cx+ii]*w[2*jj+1]*w[2*ii+2];
+      break;
+    default: // case 3: // both are odd, 2x2 stencil
+      for(int ii=0;ii<=1;ii++) for(int jj=0;jj<=1;jj++)
+        c += coarse[(cy+jj)*cw+cx+ii]*w[2*jj+1]*w[2*ii+1];
+      break;
+  }
+  return 4.0f * c;
+}
+
+// add the weighted laplacian coefficients of the remapped image k to one level of the output pyramid
+kernel void
+laplacian_accumulate(
+    read_only  image2d_t input,      // original input buffer, gauss at current fine pyramid level
+    read_only  image2d_t fine,       // gauss of the remapped image at that level
+    read_only  image2d_t coarse,     // gauss of the remapped image one level coarser
+    global float *output,            // output pyramid
+    const int  offset,               // of the current level in output
+    const int  pw,                   // width and height of the fine buffers
+    const int  ph,
+    const int  k,                    // gamma sample of the remapped image
+    const int  first)                // overwrite instead of accumulating
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  int i = x, j = y;
+
+  if(x >= pw || y >= ph) return;
+  // fill boundary with 1 or 2 px:
+  if(pw & 1) { if(x > pw-2) i = pw-2; }
+  else       { if(x > pw-3) i = pw-3; }
+  if(ph & 1) { if(y > ph-2) j = ph-2; }
+  else       { if(y > ph-3) j = ph-3; }
+  if(x <= 0) i = 1;
+  if(y <= 0) j = 1;
+
+  const float v = read_imagef(input, sampleri, (int2)(x, y)).x;
+  const float l = gamma_weight(v, k) * laplacian(coarse, fine, x, y, i, j, pw, ph);
+  global float *out = output + offset + y * pw + x;
+  *out = first ? l : *out + l;
+}
+
+// add the upsampled coarse level of the output pyramid to the coefficients of the finer one
+kernel void
+laplacian_collapse(
+    global float *output,            // output pyramid
+    const int  coarse_offset,        // of the coarse level in output
+    const int  fine_offset,          // of the fine level in output, run kernel on this dimension
+    const int  pw,
+    const int  ph)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  int i = x, j = y;
+
+  if(x >= pw || y >= ph) return;
+  // fill boundary with 1 or 2 px:
+  if(pw & 1) { if(x > pw-2) i = pw-2; }
+  else       { if(x > pw-3) i = pw-3; }
+  if(ph & 1) { if(y > ph-2) j = ph-2; }
+  else       { if(y > ph-3) j = ph-3; }
+  if(x <= 0) i = 1;
+  if(y <= 0) j = 1;
+
+  output[fine_offset + y * pw + x] += expand_gaussian_buffer(output + coarse_offset, i, j, (pw-1)/2+1);
+}
+
+kernel void
+write_back_buffer(
+    read_only  image2d_t input,
+    global const float *processed,   // finest level of the output pyramid
+    write_only image2d_t output,
+    const int max_supp,
+    const int wd,
+    const int ht,
+    const int pw)                    // padded width
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= wd || y >= ht) return;
+
+  float4 pixel = read_imagef(input, sampleri, (int2)(x, y));
+  pixel.x = 100.0f*processed[(y+max_supp)*pw+x+max_supp];
+  write_imagef (output, (int2)(x, y), pixel);
+}
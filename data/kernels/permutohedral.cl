@@ -0,0 +1,329 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+
+/* The permutohedral lattice of src/iop/Permutohedral.h for the 5D (x, y, r, g, b) bilateral filter
+   of the surface blur module, with 4D values (r, g, b, 1):
+
+   - permutohedral_keys finds the D + 1 vertices of the simplex enclosing each pixel and their
+     barycentric weights, this is PermutohedralLattice::splat() minus the hash table,
+   - permutohedral_splat inserts all the vertices in an open addressing hash table and accumulates
+     the pixels there. The first vertex taking a free slot owns it: its key, written by the previous
+     kernel, is the key of the slot, so inserting needs no lock,
+   - permutohedral_blur blurs the lattice along one of the D + 1 axes,
+   - permutohedral_slice gathers back the pixels from their vertices.
+*/
+
+#define PL_D 5
+#define PL_VERTICES (PL_D + 1)
+
+static inline void
+_atomic_add_f(global float *val, const float delta)
+{
+  union
+  {
+    float f;
+    unsigned int i;
+  } old_val, new_val;
+
+  global volatile unsigned int *ival = (global volatile unsigned int *)val;
+
+  do
+  {
+    old_val.i = atomic_add(ival, 0);
+    new_val.f = old_val.f + delta;
+  }
+  while(atomic_cmpxchg(ival, old_val.i, new_val.i) != old_val.i);
+}
+
+// same as HashTablePermutohedral::Key::setHash()
+static inline unsigned int
+_hash(const short key[PL_D])
+{
+  unsigned int k = 0;
+  for(int i = 0; i < PL_D; i++)
+  {
+    k += key[i];
+    k *= 2531011u;
+  }
+  return k;
+}
+
+static inline int
+_same_key(global const short *keys, const int owner, const short key[PL_D])
+{
+  global const short *other = keys + (size_t)owner * PL_D;
+  for(int i = 0; i < PL_D; i++)
+    if(other[i] != key[i]) return 0;
+  return 1;
+}
+
+// slot of the key, or -1 if it is not in the lattice
+static inline int
+_lookup(global const short *keys, global const int *owners, const int capacity, const short key[PL_D])
+{
+  unsigned int h = _hash(key) & (capacity - 1);
+  for(int probe = 0; probe < capacity; probe++)
+  {
+    const int owner = owners[h];
+    if(owner < 0) return -1;
+    if(_same_key(keys, owner, key)) return h;
+    h = (h + 1) & (capacity - 1);
+  }
+  return -1;
+}
+
+kernel void
+permutohedral_clear(global int *owners, global float4 *values, const int capacity)
+{
+  const int k = get_global_id(0);
+  if(k >= capacity) return;
+  owners[k] = -1;
+  values[k] = (float4)0.0f;
+}
+
+kernel void
+permutohedral_keys(read_only image2d_t in, const int width, const int height,
+                   const float inv_sigma_x, const float inv_sigma_y, const float4 inv_sigma_rgb,
+                   global short *keys, global float *weights)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  const float position[PL_D] = { x * inv_sigma_x, y * inv_sigma_y, pixel.x * inv_sigma_rgb.x,
+                                 pixel.y * inv_sigma_rgb.y, pixel.z * inv_sigma_rgb.z };
+
+  float elevated[PL_D + 1];
+  int greedy[PL_D + 1];
+  int rank[PL_D + 1];
+  float barycentric[PL_D + 2];
+
+  // scale factors of the rotation into the hyperplane, see the PermutohedralLattice constructor
+  float scale_factor[PL_D];
+  for(int i = 0; i < PL_D; i++)
+    scale_factor[i] = (PL_D + 1) * sqrt(2.0f / 3.0f) / sqrt((float)(i + 1) * (i + 2));
+
+  // first rotate position into the (d+1)-dimensional hyperplane
+  elevated[PL_D] = -PL_D * position[PL_D - 1] * scale_factor[PL_D - 1];
+  for(int i = PL_D - 1; i > 0; i--)
+    elevated[i] = (elevated[i + 1] - i * position[i - 1] * scale_factor[i - 1]
+                   + (i + 2) * position[i] * scale_factor[i]);
+  elevated[0] = elevated[1] + 2 * position[0] * scale_factor[0];
+
+  const float scale = 1.0f / (PL_D + 1);
+
+  // greedily search for the closest zero-colored lattice point
+  int sum = 0;
+  for(int i = 0; i <= PL_D; i++)
+  {
+    const float v = elevated[i] * scale;
+    const float up = ceil(v) * (PL_D + 1);
+    const float down = floor(v) * (PL_D + 1);
+    greedy[i] = (up - elevated[i] < elevated[i] - down) ? up : down;
+    sum += greedy[i];
+  }
+  sum /= PL_D + 1;
+
+  // rank differential to find the permutation between this simplex and the canonical one
+  for(int i = 0; i <= PL_D; i++) rank[i] = 0;
+  for(int i = 0; i < PL_D; i++)
+    for(int j = i + 1; j <= PL_D; j++)
+      if(elevated[i] - greedy[i] < elevated[j] - greedy[j])
+        rank[i]++;
+      else
+        rank[j]++;
+
+  if(sum > 0)
+  {
+    // sum too large - bring down the ones with the smallest differential
+    for(int i = 0; i <= PL_D; i++)
+    {
+      if(rank[i] >= PL_D + 1 - sum)
+      {
+        greedy[i] -= PL_D + 1;
+        rank[i] += sum - (PL_D + 1);
+      }
+      else
+        rank[i] += sum;
+    }
+  }
+  else if(sum < 0)
+  {
+    // sum too small - bring up the ones with largest differential
+    for(int i = 0; i <= PL_D; i++)
+    {
+      if(rank[i] < -sum)
+      {
+        greedy[i] += PL_D + 1;
+        rank[i] += (PL_D + 1) + sum;
+      }
+      else
+        rank[i] += sum;
+    }
+  }
+
+  // barycentric coordinates
+  for(int i = 0; i < PL_D + 2; i++) barycentric[i] = 0.0f;
+  for(int i = 0; i <= PL_D; i++)
+  {
+    barycentric[PL_D - rank[i]] += (elevated[i] - greedy[i]) * scale;
+    barycentric[PL_D + 1 - rank[i]] -= (elevated[i] - greedy[i]) * scale;
+  }
+  barycentric[0] += 1.0f + barycentric[PL_D + 1];
+
+  const size_t first = ((size_t)y * width + x) * PL_VERTICES;
+  for(int remainder = 0; remainder <= PL_D; remainder++)
+  {
+    global short *key = keys + (first + remainder) * PL_D;
+    // the canonical simplex of the PermutohedralLattice constructor
+    for(int i = 0; i < PL_D; i++)
+      key[i] = greedy[i] + ((rank[i] <= PL_D - remainder) ? remainder : remainder - (PL_D + 1));
+    weights[first + remainder] = barycentric[remainder];
+  }
+}
+
+kernel void
+permutohedral_splat(read_only image2d_t in, const int width, const int height,
+                    global const short *keys, global const float *weights, global int *owners,
+                    global int *slots, global float *values, const int capacity, global int *counters)
+{
+  const int k = get_global_id(0);
+  if(k >= width * height * PL_VERTICES) return;
+
+  short key[PL_D];
+  for(int i = 0; i < PL_D; i++) key[i] = keys[(size_t)k * PL_D + i];
+
+  int slot = -1;
+  unsigned int h = _hash(key) & (capacity - 1);
+  for(int probe = 0; probe < capacity; probe++)
+  {
+    const int owner = atomic_cmpxchg(owners + h, -1, k);
+    if(owner == -1)
+    {
+      atomic_inc(counters);
+      slot = h;
+      break;
+    }
+    if(_same_key(keys, owner, key))
+    {
+      slot = h;
+      break;
+    }
+    h = (h + 1) & (capacity - 1);
+  }
+
+  slots[k] = slot;
+  if(slot < 0)
+  {
+    // the table is full, the host falls back to the CPU path
+    atomic_inc(counters + 1);
+    return;
+  }
+
+  const int pixel = k / PL_VERTICES;
+  const float4 value = read_imagef(in, sampleri, (int2)(pixel % width, pixel / width));
+  const float weight = weights[k];
+  global float *accumulator = values + (size_t)slot * 4;
+  _atomic_add_f(accumulator + 0, weight * value.x);
+  _atomic_add_f(accumulator + 1, weight * value.y);
+  _atomic_add_f(accumulator + 2, weight * value.z);
+  _atomic_add_f(accumulator + 3, weight);
+}
+
+kernel void
+permutohedral_blur(global const short *keys, global const int *owners, global const float4 *values_in,
+                   global float4 *values_out, const int capacity, const int axis)
+{
+  const int s = get_global_id(0);
+  if(s >= capacity) return;
+
+  const int owner = owners[s];
+  if(owner < 0) return;
+
+  // neighbours along the axis, see the neighbour constructor of HashTablePermutohedral::Key
+  short up[PL_D], down[PL_D];
+  for(int i = 0; i < PL_D; i++)
+  {
+    const short key = keys[(size_t)owner * PL_D + i];
+    up[i] = (i == axis) ? key - PL_D : key + 1;
+    down[i] = (i == axis) ? key + PL_D : key - 1;
+  }
+
+  const int s_up = _lookup(keys, owners, capacity, up);
+  const int s_down = _lookup(keys, owners, capacity, down);
+  const float4 v_up = (s_up < 0) ? (float4)0.0f : values_in[s_up];
+  const float4 v_down = (s_down < 0) ? (float4)0.0f : values_in[s_down];
+
+  values_out[s] = 0.25f * v_up + 0.5f * values_in[s] + 0.25f * v_down;
+}
+
+kernel void
+permutohedral_slice(read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+                    global const int *slots, global const float *weights, global const float4 *values)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const size_t first = ((size_t)y * width + x) * PL_VERTICES;
+  float4 accumulator = (float4)0.0f;
+  for(int remainder = 0; remainder <= PL_D; remainder++)
+    accumulator += weights[first + remainder] * values[slots[first + remainder]];
+
+  // alpha is passed through for the mask display
+  const float alpha = read_imagef(in, sampleri, (int2)(x, y)).w;
+  write_imagef(out, (int2)(x, y), (float4)(accumulator.xyz / accumulator.w, alpha));
+}
+
+/* the small radii of the surface blur module skip the lattice, this is the brute force
+   bilateral filter of its CPU path. Pixels closer than rad to the borders are left untouched. */
+kernel void
+bilateral_naive(read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+                const int rad, const float sigma_s, const float4 isig2col)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  if(x < rad || y < rad || x >= width - rad || y >= height - rad)
+  {
+    write_imagef(out, (int2)(x, y), pixel);
+    return;
+  }
+
+  // the normalization of the spatial gaussian cancels out with the one of the weights
+  const float isig2s = 1.0f / (2.0f * sigma_s * sigma_s);
+  float4 sum = (float4)0.0f;
+  float sumw = 0.0f;
+  for(int l = -rad; l <= rad; l++)
+    for(int k = -rad; k <= rad; k++)
+    {
+      const float4 neighbour = read_imagef(in, sampleri, (int2)(x + k, y + l));
+      const float4 d = pixel - neighbour;
+      const float w = exp(-(l * l + k * k) * isig2s
+                          - (d.x * d.x * isig2col.x + d.y * d.y * isig2col.y + d.z * d.z * isig2col.z));
+      sum += w * neighbour;
+      sumw += w;
+    }
+
+  write_imagef(out, (int2)(x, y), (float4)(sum.xyz / sumw, pixel.w));
+}
@@ -0,0 +1,96 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+
+/* Bayer raw denoise, see wavelet_denoise() in src/iop/rawdenoise.c and dwt_denoise() in src/common/dwt.c.
+   Each of the 4 CFA sites of the 2x2 pattern is denoised on its own half-resolution plane. */
+
+// collect one CFA site into a monochrome plane, applying sqrt() as a variance-stabilizing transform
+kernel void
+rawdenoise_extract(read_only image2d_t in, global float *plane, const int halfwidth, const int halfheight,
+                   const int c)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= halfwidth || y >= halfheight) return;
+
+  const int col = 2 * x + ((c & 2) >> 1);
+  const int row = 2 * y + (c & 1);
+  const float value = read_imagef(in, sampleri, (int2)(col, row)).x;
+  plane[mad24(y, halfwidth, x)] = sqrt(fmax(0.0f, value));
+}
+
+// average each row with the rows 'scale' above and below, reflecting at the edges
+kernel void
+rawdenoise_vert(global const float *img, global float *interm, const int width, const int height,
+                const int scale)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  const int above = clamp(abs(y - scale), 0, height - 1);
+  const int below = clamp((y + scale < height) ? (y + scale) : 2 * (height - 1) - (y + scale), 0, height - 1);
+
+  interm[mad24(y, width, x)] = 2.0f * img[mad24(y, width, x)] + img[mad24(above, width, x)]
+                               + img[mad24(below, width, x)];
+}
+
+/* average each column of the vertical pass with the columns 'scale' left and right, split the input
+   into coarse and details, and accumulate the part of the details above the noise threshold.
+   On the last scale, the accumulated details are added back to the residue. */
+kernel void
+rawdenoise_horiz(global const float *interm, global float *img, global float *accum, const int width,
+                 const int height, const int scale, const float threshold, const int first, const int last)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  const int left = clamp((x < scale) ? scale - x : x - scale, 0, width - 1);
+  const int right = clamp((x + scale < width) ? x + scale : 2 * width - 2 - (x + scale), 0, width - 1);
+  const int row = mul24(y, width);
+
+  const float hat = (2.0f * interm[row + x] + interm[row + left] + interm[row + right]) / 16.0f;
+  const float diff = img[row + x] - hat;
+  const float excess = fmax(diff - threshold, 0.0f) + fmin(diff + threshold, 0.0f);
+  const float details = first ? excess : accum[row + x] + excess;
+
+  accum[row + x] = details;
+  img[row + x] = last ? hat + details : hat;
+}
+
+// distribute the denoised plane back to its CFA site, squaring to undo the transform
+kernel void
+rawdenoise_insert(global const float *plane, write_only image2d_t out, const int halfwidth,
+                  const int halfheight, const int c)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= halfwidth || y >= halfheight) return;
+
+  const int col = 2 * x + ((c & 2) >> 1);
+  const int row = 2 * y + (c & 1);
+  const float d = plane[mad24(y, halfwidth, x)];
+  write_imagef(out, (int2)(col, row), (float4)(d * d, 0.0f, 0.0f, 0.0f));
+}
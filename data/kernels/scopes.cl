@@ -0,0 +1,87 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "color_conversion.h"
+
+// keep in sync with src/common/histogram.h
+#define SCOPES_BINS 256
+#define SCOPES_TONES 128
+
+kernel void
+scopes_clear(global uint *bins, const int size)
+{
+  const int k = get_global_id(0);
+  if(k >= size) return;
+  bins[k] = 0;
+}
+
+static inline void
+_bin_channel(global uint *histogram, global uint *waveform_h, global uint *waveform_v,
+             const float value, const int c, const int x, const int y, const int width)
+{
+  const int bin = clamp((int)(value * (SCOPES_BINS - 1)), 0, SCOPES_BINS - 1);
+  atomic_inc(histogram + 4 * bin + c);
+
+  const int tone = clamp((int)round(value * (SCOPES_TONES - 1)), 0, SCOPES_TONES - 1);
+  atomic_inc(waveform_h + ((SCOPES_TONES - 1 - tone) * width + x) * 4 + c);
+  atomic_inc(waveform_v + (y * SCOPES_TONES + tone) * 4 + c);
+}
+
+static inline float
+_Luv_to_coord(const float value, const float zoom)
+{
+  return (value + zoom) * (SCOPES_BINS - 1) / (2.f * zoom);
+}
+
+/* same binnings as the CPU scopes of src/libs/histogram.c, all in one pass over the image.
+   bins holds all the scopes one after the other, see dt_scopes_map() */
+kernel void
+scopes_bin(read_only image2d_t in, const int width, const int height, global uint *bins, const float zoom,
+           constant dt_colorspaces_iccprofile_info_cl_t *profile_info, read_only image2d_t lut)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  global uint *histogram = bins;
+  global uint *waveform_h = histogram + 4 * SCOPES_BINS;
+  global uint *waveform_v = waveform_h + 4 * SCOPES_TONES * width;
+  global uint *vectorscope = waveform_v + 4 * SCOPES_TONES * height;
+
+  const float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  _bin_channel(histogram, waveform_h, waveform_v, pixel.x, 0, x, y, width);
+  _bin_channel(histogram, waveform_h, waveform_v, pixel.y, 1, x, y, width);
+  _bin_channel(histogram, waveform_h, waveform_v, pixel.z, 2, x, y, width);
+
+  if(zoom <= 0.f) return; // no vectorscope
+
+  const float4 XYZ = rgb_matrix_to_xyz(pixel, profile_info, profile_info->matrix_in, lut);
+  const float4 uvY = dt_xyY_to_uvY(dt_XYZ_to_xyY(XYZ));
+
+  // Luv, assuming Yn == 1 and a D50 white
+  const float threshold = 216.f / 24389.f; // (6/29)^3
+  const float L = (uvY.z <= threshold) ? 24389.f / 27.f * uvY.z : 116.0f * cbrt(uvY.z) - 16.f;
+  const float u = 13.f * L * (uvY.x - 0.20915914598542354f);
+  const float v = 13.f * L * (uvY.y - 0.488075320769787f);
+
+  const int U = clamp((int)round(_Luv_to_coord(u, zoom)), 0, SCOPES_BINS - 1);
+  const int V = clamp((int)round(_Luv_to_coord(v, zoom)), 0, SCOPES_BINS - 1);
+
+  // V = 0 is at the bottom of the image
+  atomic_inc(vectorscope + (SCOPES_BINS - 1 - V) * SCOPES_BINS + U);
+}
@@ -781,6 +781,16 @@ static void dt_bauhaus_window_show(GtkWidget *w, gpointer user_data)
   gtk_grab_add(GTK_WIDGET(user_data));
 }
 
+static void _widget_cache_invalidate(struct dt_bauhaus_widget_t *w)
+{
+  if(w->cache) cairo_surface_destroy(w->cache);
+  if(w->label_cache) cairo_surface_destroy(w->label_cache);
+  g_free(w->cache_text);
+  w->cache = NULL;
+  w->label_cache = NULL;
+  w->cache_text = NULL;
+}
+
 static void dt_bh_init(DtBauhausWidget *class)
 {
   // not sure if we want to use this instead of our code in *_new()
@@ -816,6 +826,7 @@ static void _widget_finalize(GObject *widget)
   }
   gtk_border_free(w->margin);
   gtk_border_free(w->padding);
+  _widget_cache_invalidate(w);
 
   G_OBJECT_CLASS(dt_bh_parent_class)->finalize(widget);
 }
@@ -844,6 +855,7 @@ void dt_bauhaus_load_theme(dt_bauhaus_t *bauhaus)
 {
   bauhaus->line_height = 3;
   bauhaus->marker_size = 0.25f;
+  bauhaus->theme_generation++;
 
   GtkWidget *root_window = dt_ui_main_window(darktable.gui->ui);
   GtkStyleContext *ctx = gtk_style_context_new();
@@ -1011,6 +1023,10 @@ static void _bauhaus_widget_init(dt_bauhaus_t *bauhaus, dt_bauhaus_widget_t *w,
   w->show_label = TRUE;
   w->timeout = dt_conf_get_int("processing/timeout");
 
+  w->cache = NULL;
+  w->label_cache = NULL;
+  w->cache_text = NULL;
+
   gtk_widget_add_events(GTK_WIDGET(w), GDK_POINTER_MOTION_MASK
                                        | GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK
                                        | GDK_ENTER_NOTIFY_MASK | GDK_LEAVE_NOTIFY_MASK
@@ -1150,6 +1166,7 @@ void dt_bauhaus_widget_set_label(GtkWidget *widget, const char *label)
     g_strlcpy(w->label, _(label), sizeof(w->label));
     dt_capitalize_label(w->label);
   }
+  _widget_cache_invalidate(w);
 
   if(w->module)
   {
@@ -1190,6 +1207,7 @@ void dt_bauhaus_widget_set_quad_paint(GtkWidget *widget, dt_bauhaus_quad_paint_f
   w->quad_paint = f;
   w->quad_paint_flags = paint_flags;
   w->quad_paint_data = paint_data;
+  _widget_cache_invalidate(w);
 }
 
 void dt_bauhaus_widget_set_field(GtkWidget *widget, gpointer field, dt_introspection_type_t field_type)
@@ -1277,6 +1295,7 @@ static void _style_updated(GtkWidget *widget)
 {
   struct dt_bauhaus_widget_t *w = (struct dt_bauhaus_widget_t *)widget;
   _margins_retrieve(w);
+  _widget_cache_invalidate(w);
 
   // gtk_widget_set_size_request is the minimal preferred, size.
   // it NEEDS to be defined and will be contextually adapted, possibly overriden by CSS.
@@ -1690,6 +1709,7 @@ void dt_bauhaus_slider_clear_stops(GtkWidget *widget)
   if(w->type != DT_BAUHAUS_SLIDER) return;
   dt_bauhaus_slider_data_t *d = &w->data.slider;
   d->grad_cnt = 0;
+  _widget_cache_invalidate(w);
 }
 
 void dt_bauhaus_slider_set_stop(GtkWidget *widget, float stop, float r, float g, float b)
@@ -1697,6 +1717,7 @@ void dt_bauhaus_slider_set_stop(GtkWidget *widget, float stop, float r, float g,
   struct dt_bauhaus_widget_t *w = DT_BAUHAUS_WIDGET(widget);
   if(w->type != DT_BAUHAUS_SLIDER) return;
   dt_bauhaus_slider_data_t *d = &w->data.slider;
+  _widget_cache_invalidate(w);
 
   if(!d->grad_col)
   {
@@ -1795,15 +1816,14 @@ static void dt_bauhaus_draw_quad(struct dt_bauhaus_widget_t *w, cairo_t *cr, con
 }
 
 /**
- * @brief Draw the slider baseline, aka the backgronud bar.
+ * @brief Draw the background of the slider baseline, aka the backgronud bar, with its gradient if any.
  *
  * @param w Widget
  * @param cr Cairo object
  * @param width The width of the actual slider baseline (corrected for padding, margin and quad width if needed)
  */
-static void dt_bauhaus_draw_baseline(struct dt_bauhaus_widget_t *w, cairo_t *cr, float width)
+static void dt_bauhaus_draw_baseline_background(struct dt_bauhaus_widget_t *w, cairo_t *cr, float width)
 {
-  // draw line for orientation in slider
   cairo_save(cr);
   dt_bauhaus_slider_data_t *d = &w->data.slider;
   const float baseline_top = w->bauhaus->line_height + INNER_PADDING;
@@ -1830,6 +1850,23 @@ static void dt_bauhaus_draw_baseline(struct dt_bauhaus_widget_t *w, cairo_t *cr,
   }
   cairo_fill(cr);
   if(gradient) cairo_pattern_destroy(gradient);
+  cairo_restore(cr);
+}
+
+/**
+ * @brief Draw the parts of the slider baseline moving with the value, over its background.
+ *
+ * @param w Widget
+ * @param cr Cairo object
+ * @param width The width of the actual slider baseline (corrected for padding, margin and quad width if needed)
+ */
+static void dt_bauhaus_draw_baseline(struct dt_bauhaus_widget_t *w, cairo_t *cr, float width)
+{
+  // draw line for orientation in slider
+  cairo_save(cr);
+  dt_bauhaus_slider_data_t *d = &w->data.slider;
+  const float baseline_top = w->bauhaus->line_height + INNER_PADDING;
+  const float baseline_height = w->bauhaus->baseline_size;
 
   // get the reference of the slider aka the position of the 0 value
   const float origin = fmaxf(fminf((d->factor > 0 ? -d->min - d->offset/d->factor
@@ -2160,32 +2197,51 @@ static gboolean dt_bauhaus_popup_draw(GtkWidget *widget, cairo_t *crf, gpointer
   return TRUE;
 }
 
-static gboolean _widget_draw(GtkWidget *widget, cairo_t *crf)
+// everything the cached drawing depends on, besides the explicit invalidations of _widget_cache_invalidate()
+static dt_bauhaus_cache_key_t _widget_cache_key(const struct dt_bauhaus_widget_t *w, GtkWidget *widget,
+                                                const GtkAllocation *allocation)
 {
-  struct dt_bauhaus_widget_t *w = DT_BAUHAUS_WIDGET(widget);
-  GtkAllocation allocation;
-  gtk_widget_get_allocation(widget, &allocation);
-  cairo_surface_t *cst = dt_cairo_image_surface_create(CAIRO_FORMAT_ARGB32, allocation.width, allocation.height);
-  cairo_t *cr = cairo_create(cst);
-  GtkStyleContext *context = gtk_widget_get_style_context(widget);
+  dt_bauhaus_cache_key_t key;
+  memset(&key, 0, sizeof(key)); // compared with memcmp()
+  key.width = allocation->width;
+  key.height = allocation->height;
+  key.state = gtk_widget_get_state_flags(widget);
+  key.quad_paint_flags = w->quad_paint_flags;
+  key.show_quad = w->show_quad;
+  key.theme = w->bauhaus->theme_generation;
+  if(w->type == DT_BAUHAUS_SLIDER)
+  {
+    const dt_bauhaus_slider_data_t *d = &w->data.slider;
+    key.min = d->min;
+    key.max = d->max;
+    key.hard_min = d->hard_min;
+    key.hard_max = d->hard_max;
+  }
+  return key;
+}
 
-  GdkRGBA *bg_color = default_color_assign();
-  GdkRGBA *text_color = default_color_assign();
-  const GtkStateFlags state = gtk_widget_get_state_flags(widget);
-  gtk_style_context_get_color(context, state, text_color);
-  gtk_style_context_get(context, state, "background-color", &bg_color, NULL);
-  _margins_retrieve(w);
+static const gchar *_combobox_text(const struct dt_bauhaus_widget_t *w)
+{
+  const dt_bauhaus_combobox_data_t *d = &w->data.combobox;
+  if(d->active >= 0 && d->active < d->entries->len)
+  {
+    const dt_bauhaus_combobox_entry_t *entry = g_ptr_array_index(d->entries, d->active);
+    return entry->label;
+  }
+  return d->text;
+}
 
+// draw the parts of the widget that don't move with the value of a slider
+static void _widget_draw_static(struct dt_bauhaus_widget_t *w, GtkWidget *widget, cairo_t *cr,
+                                GtkStyleContext *context, const GtkAllocation *allocation,
+                                const GdkRGBA *text_color, const float available_width, const float inner_height)
+{
   // Paint background first
-  gtk_render_background(context, cr, allocation.x, allocation.y, allocation.width, allocation.height);
+  gtk_render_background(context, cr, allocation->x, allocation->y, allocation->width, allocation->height);
 
   // Translate Cairo coordinates to account for the widget spacing
-  const float available_width = _widget_get_main_width(w, NULL, NULL);
-  const float inner_height = _widget_get_main_height(w, NULL);
   cairo_translate(cr, w->margin->left + w->padding->left, w->margin->top + w->padding->top);
 
-  // draw type specific content:
-  cairo_save(cr);
   set_color(cr, *text_color);
   cairo_set_line_width(cr, 1.0);
   switch(w->type)
@@ -2198,12 +2254,7 @@ static gboolean _widget_draw(GtkWidget *widget, cairo_t *crf)
 
       dt_bauhaus_combobox_data_t *d = &w->data.combobox;
       const PangoEllipsizeMode combo_ellipsis = d->entries_ellipsis;
-      const gchar *text = d->text;
-      if(d->active >= 0 && d->active < d->entries->len)
-      {
-        const dt_bauhaus_combobox_entry_t *entry = g_ptr_array_index(d->entries, d->active);
-        text = entry->label;
-      }
+      const gchar *text = _combobox_text(w);
 
       gchar *label_text = _build_label(w);
       float label_width = 0.f;
@@ -2231,7 +2282,7 @@ static gboolean _widget_draw(GtkWidget *widget, cairo_t *crf)
     case DT_BAUHAUS_SLIDER:
     {
       // line for orientation
-      dt_bauhaus_draw_baseline(w, cr, available_width);
+      dt_bauhaus_draw_baseline_background(w, cr, available_width);
 
       // Paint the non-active quad icon with some transparency, because
       // icons are bolder than the neighbouring text and appear brighter.
@@ -2240,44 +2291,100 @@ static gboolean _widget_draw(GtkWidget *widget, cairo_t *crf)
         cairo_set_source_rgba(cr, text_color->red, text_color->green, text_color->blue, text_color->alpha * 0.7);
       dt_bauhaus_draw_quad(w, cr, available_width + 2. * INNER_PADDING, 0.);
       cairo_restore(cr);
+      break;
+    }
+    default:
+      break;
+  }
+}
 
-      float value_width = 0;
-      if(gtk_widget_is_sensitive(widget))
-      {
-        cairo_save(cr);
-        dt_bauhaus_draw_indicator(w, w->data.slider.pos, cr, available_width, *text_color, *bg_color);
-        cairo_restore(cr);
+static gboolean _widget_draw(GtkWidget *widget, cairo_t *cr)
+{
+  struct dt_bauhaus_widget_t *w = DT_BAUHAUS_WIDGET(widget);
+  GtkAllocation allocation;
+  gtk_widget_get_allocation(widget, &allocation);
+  GtkStyleContext *context = gtk_widget_get_style_context(widget);
 
-        char *text = dt_bauhaus_slider_get_text(widget, dt_bauhaus_slider_get(widget));
-        GdkRectangle bounding_value = { .x = 0.,
-                                        .y = 0.,
-                                        .width = available_width,
-                                        .height = w->bauhaus->line_height };
-        show_pango_text(w, context, cr, &bounding_value, text, BH_ALIGN_RIGHT, BH_ALIGN_MIDDLE,
-                        PANGO_ELLIPSIZE_NONE, NULL, &value_width, NULL, FALSE);
-        g_free(text);
-      }
+  GdkRGBA *bg_color = default_color_assign();
+  GdkRGBA *text_color = default_color_assign();
+  const GtkStateFlags state = gtk_widget_get_state_flags(widget);
+  gtk_style_context_get_color(context, state, text_color);
+  gtk_style_context_get(context, state, "background-color", &bg_color, NULL);
+  _margins_retrieve(w);
 
-      // label on top of marker:
+  const float available_width = _widget_get_main_width(w, NULL, NULL);
+  const float inner_height = _widget_get_main_height(w, NULL);
+
+  // Scrolling through a module redraws all its widgets with nothing changed:
+  // reuse the static parts as long as they are the same.
+  const dt_bauhaus_cache_key_t key = _widget_cache_key(w, widget, &allocation);
+  const gchar *text = (w->type == DT_BAUHAUS_COMBOBOX) ? _combobox_text(w) : NULL;
+  if(!w->cache || memcmp(&key, &w->cache_key, sizeof(key)) || g_strcmp0(text, w->cache_text))
+  {
+    _widget_cache_invalidate(w);
+    w->cache = dt_cairo_image_surface_create(CAIRO_FORMAT_ARGB32, allocation.width, allocation.height);
+    cairo_t *cc = cairo_create(w->cache);
+    _widget_draw_static(w, widget, cc, context, &allocation, text_color, available_width, inner_height);
+    cairo_destroy(cc);
+    w->cache_key = key;
+    w->cache_text = g_strdup(text);
+  }
+  cairo_set_source_surface(cr, w->cache, 0, 0);
+  cairo_paint(cr);
+
+  if(w->type == DT_BAUHAUS_SLIDER)
+  {
+    // Translate Cairo coordinates to account for the widget spacing
+    cairo_save(cr);
+    cairo_translate(cr, w->margin->left + w->padding->left, w->margin->top + w->padding->top);
+    set_color(cr, *text_color);
+    cairo_set_line_width(cr, 1.0);
+
+    // fill feedback and 0 reference over the cached baseline
+    dt_bauhaus_draw_baseline(w, cr, available_width);
+
+    float value_width = 0;
+    if(gtk_widget_is_sensitive(widget))
+    {
+      cairo_save(cr);
+      dt_bauhaus_draw_indicator(w, w->data.slider.pos, cr, available_width, *text_color, *bg_color);
+      cairo_restore(cr);
+
+      char *value = dt_bauhaus_slider_get_text(widget, dt_bauhaus_slider_get(widget));
+      GdkRectangle bounding_value = { .x = 0.,
+                                      .y = 0.,
+                                      .width = available_width,
+                                      .height = w->bauhaus->line_height };
+      show_pango_text(w, context, cr, &bounding_value, value, BH_ALIGN_RIGHT, BH_ALIGN_MIDDLE,
+                      PANGO_ELLIPSIZE_NONE, NULL, &value_width, NULL, FALSE);
+      g_free(value);
+    }
+    cairo_restore(cr);
+
+    // label on top of marker, ellipsized before the value:
+    // cached for the width left by the value, which rarely changes.
+    const float label_width = available_width - value_width - INNER_PADDING;
+    if(!w->label_cache || w->label_cache_width != (int)label_width)
+    {
+      if(w->label_cache) cairo_surface_destroy(w->label_cache);
+      w->label_cache = dt_cairo_image_surface_create(CAIRO_FORMAT_ARGB32, allocation.width, allocation.height);
+      w->label_cache_width = (int)label_width;
+      cairo_t *cc = cairo_create(w->label_cache);
+      cairo_translate(cc, w->margin->left + w->padding->left, w->margin->top + w->padding->top);
+      set_color(cc, *text_color);
       gchar *label_text = _build_label(w);
-      const float label_width = available_width - value_width - INNER_PADDING;
       GdkRectangle bounding_label = { .x = 0.,
                                       .y = 0.,
                                       .width = label_width,
                                       .height = w->bauhaus->line_height };
-      show_pango_text(w, context, cr, &bounding_label, label_text, BH_ALIGN_LEFT, BH_ALIGN_MIDDLE,
-                        PANGO_ELLIPSIZE_END, NULL, NULL, NULL, FALSE);
+      show_pango_text(w, context, cc, &bounding_label, label_text, BH_ALIGN_LEFT, BH_ALIGN_MIDDLE,
+                      PANGO_ELLIPSIZE_END, NULL, NULL, NULL, FALSE);
       g_free(label_text);
+      cairo_destroy(cc);
     }
-    break;
-    default:
-      break;
+    cairo_set_source_surface(cr, w->label_cache, 0, 0);
+    cairo_paint(cr);
   }
-  cairo_restore(cr);
-  cairo_destroy(cr);
-  cairo_set_source_surface(crf, cst, 0, 0);
-  cairo_paint(crf);
-  cairo_surface_destroy(cst);
 
   gdk_rgba_free(text_color);
   gdk_rgba_free(bg_color);
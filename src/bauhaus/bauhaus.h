@@ -131,6 +131,18 @@ typedef struct dt_bauhaus_widget_class_t DtBauhausWidgetClass;
 
 typedef void (*dt_bauhaus_quad_paint_f)(cairo_t *cr, gint x, gint y, gint w, gint h, gint flags, void *data);
 
+// what the cached drawing of a widget depends on, besides explicit invalidations
+typedef struct dt_bauhaus_cache_key_t
+{
+  int width, height;
+  GtkStateFlags state;
+  int quad_paint_flags;
+  gboolean show_quad;
+  int theme;                // dt_bauhaus_t::theme_generation
+  float min, max;           // slider range, the gradient stops are drawn relative to it
+  float hard_min, hard_max;
+} dt_bauhaus_cache_key_t;
+
 // our new widget and its private members, inheriting from drawing area:
 typedef struct dt_bauhaus_widget_t
 {
@@ -175,6 +187,14 @@ typedef struct dt_bauhaus_widget_t
   // or use custom implementation
   gboolean use_default_callback;
 
+  // parts of the drawing that don't move with the value: the background, the slider baseline
+  // and the quad, plus the slider label or the whole combobox. See _widget_draw().
+  cairo_surface_t *cache;
+  dt_bauhaus_cache_key_t cache_key;
+  cairo_surface_t *label_cache;
+  int label_cache_width;
+  gchar *cache_text;        // combobox text drawn in the cache
+
   // goes last, might extend past the end:
   dt_bauhaus_data_t data;
 
@@ -237,6 +257,9 @@ struct dt_bauhaus_t
   float quad_width;                      // width of the quad area to paint icons
   PangoFontDescription *pango_font_desc; // no need to recreate this for every string we want to print
 
+  // incremented on theme reloads to invalidate the widget caches
+  int theme_generation;
+
   // colors for sliders and comboboxes
   GdkRGBA color_fg, color_fg_insensitive, color_bg, color_border, indicator_border, color_fill;
 
@@ -39,9 +39,14 @@
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
 #include "common/points.h"
+#ifdef HAVE_HTTP_SERVER
+#include "common/http_server.h"
+#endif
 #include "control/conf.h"
+#include "control/jobs/control_jobs.h"
 #include "develop/imageop.h"
 
+#include <glib/gstdio.h>
 #include <inttypes.h>
 #include <libintl.h>
 #include <sys/time.h>
@@ -69,6 +74,8 @@ static void usage(const char *progname)
   fprintf(stderr, "   --height <max height> default: 0 = full resolution\n");
   fprintf(stderr, "   --bpp <bpp>, unsupported\n");
   fprintf(stderr, "   --export_masks <0|1|false|true>, default: false\n");
+  fprintf(stderr, "   --variants <WxH[:ext]>,... also export these sizes and formats, derived from the same\n");
+  fprintf(stderr, "                     pipeline output, as <output>_<W>x<H>.<ext>\n");
   fprintf(stderr, "   --style <style name>\n");
   fprintf(stderr, "   --apply-custom-presets <0|1|false|true>, default: true\n");
   fprintf(stderr, "                          disable for multiple instances\n");
@@ -81,11 +88,66 @@ static void usage(const char *progname)
   fprintf(stderr, "   --icc-file <file> specify icc filename, default to NONE\n");
   fprintf(stderr, "   --icc-intent <intent> specify icc intent, default to LAST\n");
   fprintf(stderr, "                     use --help icc-intent for list of supported intents\n");
+  fprintf(stderr, "   --batch <manifest file or -> process the images listed in the manifest, one per line:\n");
+  fprintf(stderr, "                     <input>\\t<xmp or empty>\\t<output>[\\t<max size WxH>[\\t<style>]]\n");
+  fprintf(stderr, "                     '-' reads the manifest from stdin. Timings are printed as JSON.\n");
+  fprintf(stderr, "   --jobs <N> number of images exported at a time in batch or server mode, default: 1\n");
+#ifdef HAVE_HTTP_SERVER
+  fprintf(stderr, "   --serve <port> render images requested on http://localhost:<port>/render\n");
+  fprintf(stderr, "                  ?imgid=<id> or ?path=<file>, &xmp=<file>, &width=, &height=,\n");
+  fprintf(stderr, "                  &format=<jpeg|png>, default: jpeg\n");
+#endif
   fprintf(stderr, "   --verbose\n");
   fprintf(stderr, "   --help,-h [option]\n");
   fprintf(stderr, "   --version\n");
 }
 
+// one more size and format exported from the pipe output of the main export
+typedef struct _cli_variant_t
+{
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_data_t *fdata;
+  dt_imageio_module_data_t *sdata;
+} _cli_variant_t;
+
+// format parameters for an export within width x height (0 = unbounded) and the limits of the modules
+static dt_imageio_module_data_t *_cli_format_params(dt_imageio_module_storage_t *storage,
+                                                    dt_imageio_module_data_t *sdata,
+                                                    dt_imageio_module_format_t *format, const int width,
+                                                    const int height, const char *style)
+{
+  dt_imageio_module_data_t *fdata = format->get_params(format);
+  if(fdata == NULL) return NULL;
+
+  uint32_t w, h, fw, fh, sw, sh;
+  fw = fh = sw = sh = 0;
+  storage->dimension(storage, sdata, &sw, &sh);
+  format->dimension(format, fdata, &fw, &fh);
+
+  if(sw == 0 || fw == 0)
+    w = sw > fw ? sw : fw;
+  else
+    w = sw < fw ? sw : fw;
+
+  if(sh == 0 || fh == 0)
+    h = sh > fh ? sh : fh;
+  else
+    h = sh < fh ? sh : fh;
+
+  fdata->max_width = width;
+  fdata->max_height = height;
+  fdata->max_width = (w != 0 && fdata->max_width > w) ? w : fdata->max_width;
+  fdata->max_height = (h != 0 && fdata->max_height > h) ? h : fdata->max_height;
+  fdata->style[0] = '\0';
+
+  if(style)
+  {
+    g_strlcpy((char *)fdata->style, style, DT_MAX_STYLE_NAME_LENGTH);
+    fdata->style[127] = '\0';
+  }
+  return fdata;
+}
+
 static void icc_types()
 {
   // TODO: Can this be automated to keep in sync with colorspaces.h?
@@ -173,6 +235,395 @@ static dt_iop_color_intent_t get_icc_intent(const char* option)
 }
 #undef ICC_INTENT_FROM_STR
 
+/*
+ * Batch mode: the library is initialized once, then the images of the manifest are imported
+ * as the lines are read, and exported by a pool of workers, each running its own pipe.
+ */
+
+typedef struct _batch_entry_t
+{
+  int line;
+  gchar *input;
+  gchar *output;
+  int width, height;
+  gchar *style;
+  int32_t imgid;
+  double import_time;
+} _batch_entry_t;
+
+typedef struct _batch_t
+{
+  GAsyncQueue *queue;
+  dt_pthread_mutex_t print_lock; // one JSON object per line, whatever the worker
+  gboolean export_masks;
+  dt_colorspaces_color_profile_type_t icc_type;
+  const gchar *icc_filename;
+  dt_iop_color_intent_t icc_intent;
+  int failures; // protected by print_lock
+} _batch_t;
+
+// pushed once per worker at the end of the manifest
+static _batch_entry_t _batch_end;
+
+static void _batch_entry_free(_batch_entry_t *e)
+{
+  g_free(e->input);
+  g_free(e->output);
+  g_free(e->style);
+  free(e);
+}
+
+static void _json_string(GString *json, const char *key, const char *value)
+{
+  g_string_append_printf(json, "\"%s\": \"", key);
+  for(const unsigned char *c = (const unsigned char *)(value ? value : ""); *c; c++)
+  {
+    if(*c == '"' || *c == '\\')
+      g_string_append_printf(json, "\\%c", *c);
+    else if(*c < 0x20)
+      g_string_append_printf(json, "\\u%04x", *c);
+    else
+      g_string_append_c(json, *c);
+  }
+  g_string_append(json, "\", ");
+}
+
+static void _batch_report(_batch_t *b, const _batch_entry_t *e, const char *error, const double export_time)
+{
+  GString *json = g_string_new("{");
+  g_string_append_printf(json, "\"line\": %d, ", e->line);
+  _json_string(json, "input", e->input);
+  _json_string(json, "output", e->output);
+  _json_string(json, "status", error ? "error" : "ok");
+  if(error) _json_string(json, "error", error);
+  g_string_append_printf(json, "\"import\": %.3f, \"export\": %.3f}", e->import_time, export_time);
+
+  dt_pthread_mutex_lock(&b->print_lock);
+  if(error) b->failures++;
+  printf("%s\n", json->str);
+  fflush(stdout);
+  dt_pthread_mutex_unlock(&b->print_lock);
+  g_string_free(json, TRUE);
+}
+
+// same setup as the single export of main(), with the parameters of one manifest line
+static const char *_batch_export(_batch_t *b, _batch_entry_t *e)
+{
+  gchar *output = g_strdup(e->output);
+  char *ext = strrchr(output, '.');
+  if(!ext || strlen(ext) <= 1 || strlen(ext) > DT_MAX_OUTPUT_EXT_LENGTH)
+  {
+    g_free(output);
+    return "invalid output file extension";
+  }
+  *ext = '\0';
+  ext++;
+  const char *format_name = !strcmp(ext, "jpg") ? "jpeg" : !strcmp(ext, "tif") ? "tiff" : ext;
+
+  dt_imageio_module_storage_t *storage = dt_imageio_get_storage_by_name("disk");
+  dt_imageio_module_format_t *format = dt_imageio_get_format_by_name(format_name);
+  if(!storage || !format)
+  {
+    g_free(output);
+    return storage ? "unknown output file extension" : "cannot find disk storage module";
+  }
+
+  dt_imageio_module_data_t *sdata = storage->get_params(storage);
+  dt_imageio_module_data_t *fdata = format->get_params(format);
+  if(!sdata || !fdata)
+  {
+    if(sdata) storage->free_params(storage, sdata);
+    if(fdata) format->free_params(format, fdata);
+    g_free(output);
+    return "failed to get export parameters";
+  }
+  g_strlcpy((char *)sdata, output, DT_MAX_PATH_FOR_PARAMS);
+  g_free(output);
+
+  uint32_t fw = 0, fh = 0, sw = 0, sh = 0;
+  storage->dimension(storage, sdata, &sw, &sh);
+  format->dimension(format, fdata, &fw, &fh);
+  const uint32_t w = (sw == 0 || fw == 0) ? MAX(sw, fw) : MIN(sw, fw);
+  const uint32_t h = (sh == 0 || fh == 0) ? MAX(sh, fh) : MIN(sh, fh);
+  fdata->max_width = (w != 0 && e->width > w) ? w : e->width;
+  fdata->max_height = (h != 0 && e->height > h) ? h : e->height;
+  fdata->style[0] = '\0';
+  if(e->style) g_strlcpy((char *)fdata->style, e->style, DT_MAX_STYLE_NAME_LENGTH);
+
+  dt_export_metadata_t metadata;
+  metadata.flags = dt_lib_export_metadata_default_flags();
+  metadata.list = NULL;
+  const int res = storage->store(storage, sdata, e->imgid, format, fdata, 1, 1, TRUE, b->export_masks, b->icc_type,
+                                 b->icc_filename, b->icc_intent, &metadata);
+
+  storage->free_params(storage, sdata);
+  format->free_params(format, fdata);
+  return res ? "export failed" : NULL;
+}
+
+static gpointer _batch_worker(gpointer data)
+{
+  _batch_t *b = (_batch_t *)data;
+  for(_batch_entry_t *e = g_async_queue_pop(b->queue); e != &_batch_end; e = g_async_queue_pop(b->queue))
+  {
+    const double start = dt_get_wtime();
+    const char *error = _batch_export(b, e);
+    _batch_report(b, e, error, dt_get_wtime() - start);
+    _batch_entry_free(e);
+  }
+  return NULL;
+}
+
+// parse and import one line of the manifest. the xmp is attached here, before any worker uses the image
+static _batch_entry_t *_batch_import(gchar *line, const int number, GHashTable *used, const char **error)
+{
+  g_strchomp(line);
+  if(!*line || line[0] == '#') return NULL;
+
+  gchar **fields = g_strsplit(line, "\t", 5);
+  const int count = g_strv_length(fields);
+  _batch_entry_t *e = (_batch_entry_t *)calloc(1, sizeof(_batch_entry_t));
+  e->line = number;
+  e->input = g_strdup(fields[0]);
+  e->output = g_strdup(count > 2 ? fields[2] : NULL);
+  const char *xmp = (count > 1 && *fields[1]) ? fields[1] : NULL;
+  if(count > 3 && *fields[3])
+  {
+    // WxH, or a single number for both
+    if(sscanf(fields[3], "%dx%d", &e->width, &e->height) == 1) e->height = e->width;
+    e->width = MAX(e->width, 0);
+    e->height = MAX(e->height, 0);
+  }
+  if(count > 4 && *fields[4]) e->style = g_strdup(fields[4]);
+
+  const double start = dt_get_wtime();
+  *error = NULL;
+  if(count < 3 || !*e->input || !*e->output)
+    *error = "expected input, xmp and output separated by tabs";
+  else
+  {
+    dt_film_t film;
+    gchar *directory = g_path_get_dirname(e->input);
+    const int filmid = dt_film_new(&film, directory);
+    g_free(directory);
+    e->imgid = dt_image_import(filmid, e->input, TRUE);
+    // the same file listed twice gets its own history
+    if(e->imgid > 0 && g_hash_table_contains(used, GINT_TO_POINTER(e->imgid)))
+      e->imgid = dt_image_duplicate(e->imgid);
+    if(e->imgid <= 0)
+      *error = "can't open input file";
+    else
+    {
+      g_hash_table_add(used, GINT_TO_POINTER(e->imgid));
+      if(xmp)
+      {
+        dt_image_t *image = dt_image_cache_get(darktable.image_cache, e->imgid, 'w');
+        if(dt_exif_xmp_read(image, xmp, 1) != 0) *error = "can't open xmp file";
+        // don't write new xmp:
+        dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+      }
+    }
+  }
+  e->import_time = dt_get_wtime() - start;
+  g_strfreev(fields);
+  return e;
+}
+
+static int _batch_run(const char *manifest, const int jobs, const gboolean export_masks,
+                      dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
+                      dt_iop_color_intent_t icc_intent)
+{
+  FILE *f = strcmp(manifest, "-") ? g_fopen(manifest, "r") : stdin;
+  if(!f)
+  {
+    fprintf(stderr, _("error: can't open manifest %s\n"), manifest);
+    return 1;
+  }
+
+  _batch_t b = { 0 };
+  b.queue = g_async_queue_new();
+  dt_pthread_mutex_init(&b.print_lock, NULL);
+  b.export_masks = export_masks;
+  b.icc_type = icc_type;
+  b.icc_filename = icc_filename;
+  b.icc_intent = icc_intent;
+
+  GThread **workers = (GThread **)calloc(jobs, sizeof(GThread *));
+  for(int k = 0; k < jobs; k++) workers[k] = g_thread_new("cli-batch", _batch_worker, &b);
+
+  GHashTable *used = g_hash_table_new(g_direct_hash, g_direct_equal);
+  char line[4 * PATH_MAX];
+  int number = 0;
+  // imports stay on this thread, workers start exporting as soon as the first line is read
+  while(fgets(line, sizeof(line), f))
+  {
+    number++;
+    const char *error = NULL;
+    _batch_entry_t *e = _batch_import(line, number, used, &error);
+    if(!e) continue;
+    if(error)
+    {
+      _batch_report(&b, e, error, 0.0);
+      _batch_entry_free(e);
+    }
+    else
+      g_async_queue_push(b.queue, e);
+  }
+  if(f != stdin) fclose(f);
+
+  for(int k = 0; k < jobs; k++) g_async_queue_push(b.queue, &_batch_end);
+  for(int k = 0; k < jobs; k++) g_thread_join(workers[k]);
+  free(workers);
+
+  g_hash_table_destroy(used);
+  g_async_queue_unref(b.queue);
+  dt_pthread_mutex_destroy(&b.print_lock);
+  return b.failures ? 1 : 0;
+}
+
+#ifdef HAVE_HTTP_SERVER
+/*
+ * Render server: the library is initialized once and the pipes of the worker pool share its caches.
+ * Requests are parsed and the images imported in the main loop, then the message is paused until
+ * a worker has its encoded image.
+ */
+
+typedef struct _render_t
+{
+  SoupServer *server;
+  SoupMessage *msg;
+  int32_t imgid;
+  gboolean temporary; // a duplicate carrying the xmp of the request, removed once rendered
+  int width, height;
+  gboolean png;
+  guint status;
+  gchar *data;
+  gsize length;
+} _render_t;
+
+static gboolean _render_reply(gpointer user_data)
+{
+  _render_t *r = (_render_t *)user_data;
+  soup_message_set_status(r->msg, r->status);
+  if(r->data)
+    soup_message_set_response(r->msg, r->png ? "image/png" : "image/jpeg", SOUP_MEMORY_TAKE, r->data, r->length);
+  soup_server_unpause_message(r->server, r->msg);
+  free(r);
+  return FALSE;
+}
+
+static void _render_worker(gpointer data, gpointer user_data)
+{
+  _render_t *r = (_render_t *)data;
+  r->status = SOUP_STATUS_INTERNAL_SERVER_ERROR;
+
+  dt_imageio_module_format_t *format = dt_imageio_get_format_by_name(r->png ? "png" : "jpeg");
+  dt_imageio_module_data_t *fdata = format ? format->get_params(format) : NULL;
+  gchar *filename = NULL;
+  const int fd = g_file_open_tmp("ansel-render-XXXXXX", &filename, NULL);
+  if(fdata && fd >= 0)
+  {
+    close(fd);
+    fdata->max_width = r->width;
+    fdata->max_height = r->height;
+    fdata->style[0] = '\0';
+    const double start = dt_get_wtime();
+    if(!dt_imageio_export(r->imgid, filename, format, fdata, TRUE, FALSE, FALSE, DT_COLORSPACE_NONE, NULL,
+                          DT_INTENT_LAST, NULL, NULL, 1, 1, NULL)
+       && g_file_get_contents(filename, &r->data, &r->length, NULL))
+      r->status = SOUP_STATUS_OK;
+    dt_print(DT_DEBUG_PERF, "[render server] image %d rendered in %.3f s\n", r->imgid, dt_get_wtime() - start);
+  }
+  if(filename) g_unlink(filename);
+  g_free(filename);
+  if(fdata) format->free_params(format, fdata);
+  if(r->temporary) dt_image_remove(r->imgid);
+
+  g_idle_add(_render_reply, r);
+}
+
+static void _render_request(SoupServer *server, SoupMessage *msg, const char *path, GHashTable *query,
+                            SoupClientContext *client, gpointer user_data)
+{
+  GThreadPool *pool = (GThreadPool *)user_data;
+  if(msg->method != SOUP_METHOD_GET)
+  {
+    soup_message_set_status(msg, SOUP_STATUS_NOT_IMPLEMENTED);
+    return;
+  }
+
+  const char *imgid = query ? g_hash_table_lookup(query, "imgid") : NULL;
+  const char *input = query ? g_hash_table_lookup(query, "path") : NULL;
+  const char *xmp = query ? g_hash_table_lookup(query, "xmp") : NULL;
+  const char *width = query ? g_hash_table_lookup(query, "width") : NULL;
+  const char *height = query ? g_hash_table_lookup(query, "height") : NULL;
+  const char *format = query ? g_hash_table_lookup(query, "format") : NULL;
+
+  int32_t id = imgid ? atoi(imgid) : 0;
+  if(!id && input)
+  {
+    dt_film_t film;
+    gchar *directory = g_path_get_dirname(input);
+    const int filmid = dt_film_new(&film, directory);
+    g_free(directory);
+    id = dt_image_import(filmid, input, TRUE);
+  }
+  if(id <= 0 || (format && strcmp(format, "jpeg") && strcmp(format, "jpg") && strcmp(format, "png")))
+  {
+    soup_message_set_status(msg, SOUP_STATUS_BAD_REQUEST);
+    return;
+  }
+
+  _render_t *r = (_render_t *)calloc(1, sizeof(_render_t));
+  r->server = server;
+  r->msg = msg;
+  r->imgid = id;
+  r->width = width ? MAX(atoi(width), 0) : 0;
+  r->height = height ? MAX(atoi(height), 0) : 0;
+  r->png = format && !strcmp(format, "png");
+
+  if(xmp)
+  {
+    // keep the history of the library image, requests may run concurrently on it
+    r->imgid = dt_image_duplicate(id);
+    r->temporary = TRUE;
+    dt_image_t *image = r->imgid > 0 ? dt_image_cache_get(darktable.image_cache, r->imgid, 'w') : NULL;
+    const gboolean failed = !image || dt_exif_xmp_read(image, xmp, 1) != 0;
+    if(image) dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+    if(failed)
+    {
+      if(r->imgid > 0) dt_image_remove(r->imgid);
+      free(r);
+      soup_message_set_status(msg, SOUP_STATUS_BAD_REQUEST);
+      return;
+    }
+  }
+
+  soup_server_pause_message(server, msg);
+  g_thread_pool_push(pool, r, NULL);
+}
+
+static int _serve(const int port, const int jobs)
+{
+  GThreadPool *pool = g_thread_pool_new(_render_worker, NULL, jobs, TRUE, NULL);
+  dt_http_server_t *server = dt_http_server_create_service(port, "/render", _render_request, pool);
+  if(!server)
+  {
+    g_thread_pool_free(pool, TRUE, FALSE);
+    return 1;
+  }
+  fprintf(stderr, _("rendering images requested on %s\n"), server->url);
+
+  GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+  g_main_loop_run(loop);
+  g_main_loop_unref(loop);
+
+  dt_http_server_kill(server);
+  g_thread_pool_free(pool, FALSE, TRUE);
+  return 0;
+}
+#endif
+
 int main(int argc, char *arg[])
 {
 #ifdef __APPLE__
@@ -203,6 +654,10 @@ int main(int argc, char *arg[])
   dt_colorspaces_color_profile_type_t icc_type = DT_COLORSPACE_NONE;
   gchar *icc_filename = NULL;
   dt_iop_color_intent_t icc_intent = DT_INTENT_LAST;
+  char *batch_manifest = NULL;
+  char *variants_arg = NULL;
+  int jobs = 1;
+  int serve_port = 0;
 
   int k;
   for(k = 1; k < argc; k++)
@@ -258,6 +713,11 @@ int main(int argc, char *arg[])
         }
         g_free(str);
       }
+      else if(!strcmp(arg[k], "--variants") && argc > k + 1)
+      {
+        k++;
+        variants_arg = arg[k];
+      }
       else if(!strcmp(arg[k], "--style") && argc > k + 1)
       {
         k++;
@@ -341,6 +801,23 @@ int main(int argc, char *arg[])
           exit(1);
         }
       }
+      else if(!strcmp(arg[k], "--batch") && argc > k + 1)
+      {
+        k++;
+        batch_manifest = arg[k];
+      }
+#ifdef HAVE_HTTP_SERVER
+      else if(!strcmp(arg[k], "--serve") && argc > k + 1)
+      {
+        k++;
+        serve_port = MAX(atoi(arg[k]), 0);
+      }
+#endif
+      else if(!strcmp(arg[k], "--jobs") && argc > k + 1)
+      {
+        k++;
+        jobs = MAX(atoi(arg[k]), 1);
+      }
       else if(!strcmp(arg[k], "-v") || !strcmp(arg[k], "--verbose"))
       {
         verbose = TRUE;
@@ -380,6 +857,30 @@ int main(int argc, char *arg[])
   for(; k < argc; k++) m_arg[m_argc++] = arg[k];
   m_arg[m_argc] = NULL;
 
+  if(batch_manifest || serve_port)
+  {
+    // everything else comes from the manifest or the requests
+    g_free(output_filename);
+    g_free(output_ext);
+    if(inputs) g_list_free_full(inputs, g_free);
+    if(dt_init(m_argc, m_arg, FALSE, custom_presets, NULL))
+    {
+      free(m_arg);
+      exit(1);
+    }
+    int res = 0;
+#ifdef HAVE_HTTP_SERVER
+    if(serve_port)
+      res = _serve(serve_port, jobs);
+    else
+#endif
+      res = _batch_run(batch_manifest, jobs, export_masks, icc_type, icc_filename, icc_intent);
+    g_free(icc_filename);
+    dt_cleanup();
+    free(m_arg);
+    exit(res);
+  }
+
   if( (inputs && file_counter < 1) || (!inputs && file_counter < 2) || file_counter > 3)
   {
     usage(arg[0]);
@@ -641,7 +1142,6 @@ int main(int argc, char *arg[])
   // any longer ...
   g_strlcpy((char *)sdata, output_filename, DT_MAX_PATH_FOR_PARAMS);
   // all is good now, the last line didn't happen.
-  g_free(output_filename);
 
   format = dt_imageio_get_format_by_name(output_ext);
   if(format == NULL)
@@ -649,45 +1149,49 @@ int main(int argc, char *arg[])
     fprintf(stderr, _("unknown extension '.%s'"), output_ext);
     fprintf(stderr, "\n");
     free(m_arg);
+    g_free(output_filename);
     g_free(output_ext);
     exit(1);
   }
 
-  fdata = format->get_params(format);
+  fdata = _cli_format_params(storage, sdata, format, width, height, style);
   if(fdata == NULL)
   {
     fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
     free(m_arg);
+    g_free(output_filename);
     g_free(output_ext);
     exit(1);
   }
 
-  uint32_t w, h, fw, fh, sw, sh;
-  fw = fh = sw = sh = 0;
-  storage->dimension(storage, sdata, &sw, &sh);
-  format->dimension(format, fdata, &fw, &fh);
-
-  if(sw == 0 || fw == 0)
-    w = sw > fw ? sw : fw;
-  else
-    w = sw < fw ? sw : fw;
-
-  if(sh == 0 || fh == 0)
-    h = sh > fh ? sh : fh;
-  else
-    h = sh < fh ? sh : fh;
-
-  fdata->max_width = width;
-  fdata->max_height = height;
-  fdata->max_width = (w != 0 && fdata->max_width > w) ? w : fdata->max_width;
-  fdata->max_height = (h != 0 && fdata->max_height > h) ? h : fdata->max_height;
-  fdata->style[0] = '\0';
-
-  if(style)
+  // the variants get their own format and their own file name pattern
+  GList *variants = dt_control_export_variants_from_string(variants_arg, dt_imageio_get_index_of_format(format));
+  const int n_variants = g_list_length(variants);
+  _cli_variant_t *variant = g_malloc0_n(MAX(n_variants, 1), sizeof(_cli_variant_t));
+  int session_width = fdata->max_width, session_height = fdata->max_height;
+  int v = 0;
+  for(GList *l = variants; l; l = g_list_next(l), v++)
   {
-    g_strlcpy((char *)fdata->style, style, DT_MAX_STYLE_NAME_LENGTH);
-    fdata->style[127] = '\0';
+    const dt_control_export_variant_t *spec = (dt_control_export_variant_t *)l->data;
+    variant[v].format = dt_imageio_get_format_by_index(spec->format_index);
+    variant[v].sdata = storage->get_params(storage);
+    if(variant[v].sdata)
+      g_snprintf((char *)variant[v].sdata, DT_MAX_PATH_FOR_PARAMS, "%s_%dx%d", output_filename, spec->max_width,
+                 spec->max_height);
+    variant[v].fdata = _cli_format_params(storage, variant[v].sdata ? variant[v].sdata : sdata, variant[v].format,
+                                          spec->max_width, spec->max_height, style);
+    if(!variant[v].fdata || !variant[v].sdata)
+    {
+      fprintf(stderr, _("failed to get export parameters for variant %dx%d, skipping\n"), spec->max_width,
+              spec->max_height);
+      continue;
+    }
+    session_width = (session_width == 0 || variant[v].fdata->max_width == 0)
+                        ? 0 : MAX(session_width, variant[v].fdata->max_width);
+    session_height = (session_height == 0 || variant[v].fdata->max_height == 0)
+                         ? 0 : MAX(session_height, variant[v].fdata->max_height);
   }
+  g_free(output_filename);
 
   if(storage->initialize_store)
   {
@@ -699,6 +1203,9 @@ int main(int argc, char *arg[])
 
   // TODO: add a callback to set the bpp without going through the config
 
+  // one pipe run per image for the main export and all its variants
+  if(n_variants) dt_imageio_export_session_begin(session_width, session_height);
+
   int num = 1, res = 0;
   for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
   {
@@ -710,12 +1217,29 @@ int main(int argc, char *arg[])
     if(storage->store(storage, sdata, id, format, fdata, num, total, TRUE, export_masks,
                       icc_type, icc_filename, icc_intent, &metadata) != 0)
       res = 1;
+
+    for(v = 0; v < n_variants; v++)
+    {
+      if(!variant[v].fdata || !variant[v].sdata) continue;
+      if(storage->store(storage, variant[v].sdata, id, variant[v].format, variant[v].fdata, num, total, TRUE,
+                        export_masks, icc_type, icc_filename, icc_intent, &metadata) != 0)
+        res = 1;
+    }
   }
 
+  if(n_variants) dt_imageio_export_session_end();
+
   // cleanup time
   if(storage->finalize_store) storage->finalize_store(storage, sdata);
   storage->free_params(storage, sdata);
   format->free_params(format, fdata);
+  for(v = 0; v < n_variants; v++)
+  {
+    if(variant[v].sdata) storage->free_params(storage, variant[v].sdata);
+    if(variant[v].fdata) variant[v].format->free_params(variant[v].format, variant[v].fdata);
+  }
+  g_free(variant);
+  g_list_free_full(variants, g_free);
   g_list_free(id_list);
 
   if(icc_filename)
@@ -40,6 +40,7 @@ inline int dt_atomic_sub_int(dt_atomic_int *var, int decr) { return std::atomic_
 inline int dt_atomic_exch_int(dt_atomic_int *var, int value) { return std::atomic_exchange(var,value); }
 inline int dt_atomic_CAS_int(dt_atomic_int *var, int *expected, int value)
 { return std::atomic_compare_exchange_strong(var,expected,value); }
+inline void dt_atomic_fence(void) { std::atomic_thread_fence(std::memory_order_seq_cst); }
 
 extern "C" { // restart C linkage block
 
@@ -55,6 +56,7 @@ inline int dt_atomic_sub_int(dt_atomic_int *var, int decr) { return atomic_fetch
 inline int dt_atomic_exch_int(dt_atomic_int *var, int value) { return atomic_exchange(var,value); }
 inline int dt_atomic_CAS_int(dt_atomic_int *var, int *expected, int value)
 { return atomic_compare_exchange_strong(var,expected,value); }
+inline void dt_atomic_fence(void) { atomic_thread_fence(memory_order_seq_cst); }
 
 #elif defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNU_MINOR__ >= 8))
 // we don't have or aren't supposed to use C11 atomics, but the compiler is a recent-enough version of GCC
@@ -71,6 +73,7 @@ inline int dt_atomic_exch_int(dt_atomic_int *var, int value)
 { int orig;  __atomic_exchange(var,&value,&orig,__ATOMIC_SEQ_CST); return orig; }
 inline int dt_atomic_CAS_int(dt_atomic_int *var, int *expected, int value)
 { return __atomic_compare_exchange(var,expected,&value,0,__ATOMIC_SEQ_CST,__ATOMIC_SEQ_CST); }
+inline void dt_atomic_fence(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
 
 #else
 // we don't have or aren't supposed to use C11 atomics, and don't have GNU intrinsics, so
@@ -137,6 +140,13 @@ inline int dt_atomic_CAS_int(dt_atomic_int *var, int *expected, int value)
   return success;
 }
 
+// taking and releasing the mutex is a full barrier
+inline void dt_atomic_fence(void)
+{
+  pthread_mutex_lock(&dt_atom_mutex);
+  pthread_mutex_unlock(&dt_atom_mutex);
+}
+
 #endif // __STDC_NO_ATOMICS__
 
 // clang-format off
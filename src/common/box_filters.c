@@ -1272,37 +1272,28 @@ void dt_box_mean_vertical(float *const buf, const size_t height, const size_t wi
     dt_unreachable_codepath();
 }
 
-static inline float window_max(const float *x, int n)
+// Moving maximum/minimum with the van Herk/Gil-Werman algorithm: the row or column, padded with w neutral
+// elements on each side, is cut into blocks of the window size k = 2*w+1. Any window then spans at most two
+// consecutive blocks, and its extremum is the extremum of the suffix of the first block (precomputed backwards
+// into 'h') and of the prefix of the second one (accumulated into 'g' while moving forward). This costs three
+// comparisons per element whatever the radius and the data, where rescanning the window when its extremum
+// leaves it degrades to O(w) per element on monotonic ramps.
+
+// number of floats of scratch space needed for the suffixes of a row/column of N elements
+static inline size_t _vhgw_size(const size_t N, const int w)
 {
-  float m = -(FLT_MAX);
-#ifdef _OPENMP
-#pragma omp simd reduction(max : m)
-#endif
-  for(int j = 0; j < n; j++)
-    m = MAX(m, x[j]);
-  return m;
+  const size_t k = 2 * (size_t)MIN((size_t)w, N - 1) + 1;
+  return (N + k - 1) / k * k;
 }
 
-// calculate the one-dimensional moving maximum over a window of size 2*w+1
-// input array x has stride 1, output array y has stride stride_y
-static inline void box_max_1d(int N, const float *const restrict x, float *const restrict y, size_t stride_y, int w)
+// copy 16 floats from a possibly-unaligned buffer into aligned temporary space
+static void load_16wide(float *const restrict out, const float *const restrict in)
 {
-  float m = window_max(x, MIN(w + 1, N));
-  for(int i = 0; i < N; i++)
-  {
-    // store maximum of current window at center position
-    y[i * stride_y] = m;
-    // if the earliest member of the current window is the max, we need to
-    // rescan the window to determine the new maximum
-    if(i - w >= 0 && x[i - w] == m)
-    {
-      const int start = i - w + 1;
-      m = window_max(x + start, MIN(i + w + 2, N) - start);
-    }
-    // if the window has not yet exceeded the end of the row/column, update the maximum value
-    if(i + w + 1 < N)
-      m = MAX(x[i + w + 1], m);
-  }
+#ifdef _OPENMP
+#pragma omp simd aligned(out : 64)
+#endif
+  for (size_t c = 0; c < 16; c++)
+    out[c] = in[c];
 }
 
 static void set_16wide(float *const restrict out, const float value)
@@ -1314,10 +1305,44 @@ static void set_16wide(float *const restrict out, const float value)
     out[c] = value;
 }
 
+// calculate the one-dimensional moving maximum over a window of size 2*w+1
+// input array x has stride stride_x, output array y has stride stride_y, they can be the same array.
+// h must hold _vhgw_size(N, w) floats
+static inline void box_max_1d(const int N, const float *const x, const size_t stride_x, float *const y,
+                              const size_t stride_y, int w, float *const restrict h)
+{
+  if(N <= 0) return;
+  // a window wider than the array always covers all of it on one side
+  w = MIN(w, N - 1);
+  const int k = 2 * w + 1;
+  const int L = (N + k - 1) / k * k;
+
+  // read everything before writing anything, so the filter can run in-place
+  for(int p = 0; p < L; p++)
+    h[p] = (p >= w && p - w < N) ? x[(p - w) * stride_x] : -(FLT_MAX);
+  for(int b = 0; b < L; b += k)
+    for(int p = b + k - 2; p >= b; p--)
+      h[p] = MAX(h[p], h[p + 1]);
+
+  // the prefix of the first block up to the end of the first window, the left padding is neutral
+  float g = -(FLT_MAX);
+  for(int j = 0; j < w; j++)
+    g = MAX(g, x[j * stride_x]);
+  int pos = k - 1; // position in its block of the last element of the current window
+  for(int i = 0; i < N; i++)
+  {
+    // the new element is always ahead of the ones already written
+    const float v = (i + w < N) ? x[(i + w) * stride_x] : -(FLT_MAX);
+    g = (pos == 0) ? v : MAX(g, v);
+    y[i * stride_y] = MAX(h[i], g);
+    if(++pos == k) pos = 0;
+  }
+}
+
 static inline void update_max_16wide(float m[16], const float *const restrict base)
 {
 #ifdef _OPENMP
-#pragma omp simd aligned(m, base : 64)
+#pragma omp simd aligned(m : 64)
 #endif
   for (size_t c = 0; c < 16; c++)
   {
@@ -1325,55 +1350,60 @@ static inline void update_max_16wide(float m[16], const float *const restrict ba
   }
 }
 
-static inline void load_update_max_16wide(float *const restrict out, float m[16], const float *const restrict base)
+static inline void store_max_16wide(float *const restrict out, const float *const restrict h,
+                                    const float *const restrict g)
 {
 #ifdef _OPENMP
-#pragma omp simd aligned(out, m : 64)
+#pragma omp simd aligned(h, g : 64)
 #endif
   for (size_t c = 0; c < 16; c++)
-  {
-    const float v = base[c];
-    out[c] = v;
-    m[c] = fmaxf(m[c], v);
-  }
+    out[c] = fmaxf(h[c], g[c]);
 }
 
-// calculate the one-dimensional moving maximum on four adjacent columns over a window of size 2*w+1
+// calculate the one-dimensional moving maximum on 16 adjacent columns over a window of size 2*w+1
 // input/output array 'buf' has stride 'stride' and we will write 16 consecutive elements every stride elements
-// (thus processing a cache line at a time)
-static inline void box_max_vert_16wide(const int N, float *const restrict scratch, float *const restrict buf,
-                                       const int stride, const int w, const size_t mask)
+// (thus processing a cache line at a time). h must hold 16 * _vhgw_size(N, w) floats
+static inline void box_max_vert_16wide(const int N, float *const restrict h, float *const restrict buf,
+                                       const int stride, int w)
 {
-  float DT_ALIGNED_ARRAY m[16] = { -(FLT_MAX), -(FLT_MAX), -(FLT_MAX), -(FLT_MAX),
-                                   -(FLT_MAX), -(FLT_MAX), -(FLT_MAX), -(FLT_MAX),
-                                   -(FLT_MAX), -(FLT_MAX), -(FLT_MAX), -(FLT_MAX),
-                                   -(FLT_MAX), -(FLT_MAX), -(FLT_MAX), -(FLT_MAX) };
-  for(size_t i = 0; i < MIN(w + 1, N); i++)
-  {
-    PREFETCH_NTA(buf + stride*(i+24));
-    load_update_max_16wide(scratch + 16 * (i&mask),m, buf + stride*i);
-  }
-  for(size_t i = 0; i < N; i++)
-  {
-    PREFETCH_NTA(buf + stride*(i+24));
-    // store maximum of current window at center position
-    store_16wide(buf + stride * i, m);
-    // If the earliest member of the current window is the max, we need to
-    // rescan the window to determine the new maximum
-    if (i >= w)
+  if(N <= 0) return;
+  w = MIN(w, N - 1);
+  const int k = 2 * w + 1;
+  const int L = (N + k - 1) / k * k;
+
+  for(int p = 0; p < L; p++)
+  {
+    if(p >= w && p - w < N)
     {
-      set_16wide(m, -(FLT_MAX));  // reset max values to lowest possible
-      for(int j = i - w + 1; j < MIN(i + w + 1, N); j++)
-      {
-        update_max_16wide(m,scratch + 16*(j&mask));
-      }
+      PREFETCH_NTA(buf + (size_t)stride * (p - w + 24));
+      load_16wide(h + 16 * p, buf + (size_t)stride * (p - w));
     }
-    // if the window has not yet exceeded the end of the row/column, update the maximum value
-    const size_t n = i + w + 1;
+    else
+      set_16wide(h + 16 * p, -(FLT_MAX));
+  }
+  for(int b = 0; b < L; b += k)
+    for(int p = b + k - 2; p >= b; p--)
+      update_max_16wide(h + 16 * p, h + 16 * (p + 1));
+
+  float DT_ALIGNED_ARRAY g[16];
+  set_16wide(g, -(FLT_MAX));
+  for(int j = 0; j < w; j++)
+    update_max_16wide(g, buf + (size_t)stride * j);
+  int pos = k - 1;
+  for(int i = 0; i < N; i++)
+  {
+    const size_t n = i + w;
     if(n < N)
     {
-      load_update_max_16wide(scratch + 16 * (n&mask), m, buf + stride * n);
+      if(pos == 0)
+        load_16wide(g, buf + stride * n);
+      else
+        update_max_16wide(g, buf + stride * n);
     }
+    else if(pos == 0)
+      set_16wide(g, -(FLT_MAX));
+    store_max_16wide(buf + (size_t)stride * i, h + 16 * i, g);
+    if(++pos == k) pos = 0;
   }
 }
 
@@ -1381,8 +1411,9 @@ static inline void box_max_vert_16wide(const int N, float *const restrict scratc
 // does the calculation in-place if input and output images are identical
 static void box_max_1ch(float *const buf, const size_t height, const size_t width, const unsigned w)
 {
-  const size_t eff_height = _compute_effective_height(height, w);
-  const size_t scratch_size = MAX(width,MAX(height,16*eff_height));
+  if(width == 0 || height == 0) return;
+  // one set of block suffixes per thread, shared by both passes
+  const size_t scratch_size = MAX(_vhgw_size(width, w), 16 * _vhgw_size(height, w));
   size_t allocsize;
   float *const restrict scratch_buffers = dt_alloc_perthread_float(scratch_size,&allocsize);
 #ifdef _OPENMP
@@ -1394,28 +1425,22 @@ static void box_max_1ch(float *const buf, const size_t height, const size_t widt
   for(size_t row = 0; row < height; row++)
   {
     float *const restrict scratch = dt_get_perthread(scratch_buffers,allocsize);
-    memcpy(scratch, buf + row * width, sizeof(float) * width);
-    box_max_1d(width, scratch, buf + row * width, 1, w);
+    box_max_1d(width, buf + row * width, 1, buf + row * width, 1, w, scratch);
   }
 #ifdef _OPENMP
 #pragma omp parallel for default(none)           \
-  dt_omp_firstprivate(w, width, height, buf, allocsize, eff_height) \
+  dt_omp_firstprivate(w, width, height, buf, allocsize) \
   dt_omp_sharedconst(scratch_buffers) \
   schedule(static)
 #endif
   for(int col = 0; col < (width & ~15); col += 16)
   {
     float *const restrict scratch = dt_get_perthread(scratch_buffers,allocsize);
-    box_max_vert_16wide(height, scratch, buf + col, width, w, eff_height-1);
+    box_max_vert_16wide(height, scratch, buf + col, width, w);
   }
   // handle the leftover 0..15 columns
   for (size_t col = width & ~15 ; col < width; col++)
-  {
-    float *const restrict scratch = scratch_buffers;
-    for(size_t row = 0; row < height; row++)
-      scratch[row] = buf[row * width + col];
-    box_max_1d(height, scratch, buf + col, width, w);
-  }
+    box_max_1d(height, buf + col, width, buf + col, width, w, scratch_buffers);
   dt_free_align(scratch_buffers);
 }
 
@@ -1430,40 +1455,38 @@ void dt_box_max(float *const buf, const size_t height, const size_t width, const
     dt_unreachable_codepath();
 }
 
-static inline float window_min(const float *x, int n)
+// calculate the one-dimensional moving minimum over a window of size 2*w+1, see box_max_1d()
+static inline void box_min_1d(const int N, const float *const x, const size_t stride_x, float *const y,
+                              const size_t stride_y, int w, float *const restrict h)
 {
-  float m = FLT_MAX;
-#ifdef _OPENMP
-#pragma omp simd reduction(min : m)
-#endif
-  for(int j = 0; j < n; j++)
-    m = MIN(m, x[j]);
-  return m;
-}
-
-// calculate the one-dimensional moving minimum over a window of size 2*w+1
-// input array x has stride 1, output array y has stride stride_y
-static inline void box_min_1d(int N, const float *x, float *y, size_t stride_y, int w)
-{
-  float m = window_min(x, MIN(w + 1, N));
+  if(N <= 0) return;
+  w = MIN(w, N - 1);
+  const int k = 2 * w + 1;
+  const int L = (N + k - 1) / k * k;
+
+  for(int p = 0; p < L; p++)
+    h[p] = (p >= w && p - w < N) ? x[(p - w) * stride_x] : FLT_MAX;
+  for(int b = 0; b < L; b += k)
+    for(int p = b + k - 2; p >= b; p--)
+      h[p] = MIN(h[p], h[p + 1]);
+
+  float g = FLT_MAX;
+  for(int j = 0; j < w; j++)
+    g = MIN(g, x[j * stride_x]);
+  int pos = k - 1;
   for(int i = 0; i < N; i++)
   {
-    y[i * stride_y] = m;
-    if(i - w >= 0 && x[i - w] == m)
-    {
-      const int start = (i - w + 1);
-      m = window_min(x + start, MIN((i + w + 2), N) - start);
-    }
-    // if the window has not yet exceeded the end of the row/column, update the minimum value
-    if(i + w + 1 < N)
-      m = MIN(x[i + w + 1], m);
+    const float v = (i + w < N) ? x[(i + w) * stride_x] : FLT_MAX;
+    g = (pos == 0) ? v : MIN(g, v);
+    y[i * stride_y] = MIN(h[i], g);
+    if(++pos == k) pos = 0;
   }
 }
 
 static inline void update_min_16wide(float m[16], const float *const restrict base)
 {
 #ifdef _OPENMP
-#pragma omp simd aligned(m, base : 64)
+#pragma omp simd aligned(m : 64)
 #endif
   for (size_t c = 0; c < 16; c++)
   {
@@ -1471,55 +1494,59 @@ static inline void update_min_16wide(float m[16], const float *const restrict ba
   }
 }
 
-static inline void load_update_min_16wide(float *const restrict out, float m[16], const float *const restrict base)
+static inline void store_min_16wide(float *const restrict out, const float *const restrict h,
+                                    const float *const restrict g)
 {
 #ifdef _OPENMP
-#pragma omp simd aligned(out, m : 64)
+#pragma omp simd aligned(h, g : 64)
 #endif
   for (size_t c = 0; c < 16; c++)
-  {
-    const float v = base[c];
-    out[c] = v;
-    m[c] = fminf(m[c], v);
-  }
+    out[c] = fminf(h[c], g[c]);
 }
 
-// calculate the one-dimensional moving minimum on four adjacent columns over a window of size 2*w+1
-// input/output array 'buf' has stride 'stride' and we will write 16 consecutive elements every stride elements
-// (thus processing a cache line at a time)
-static inline void box_min_vert_16wide(const int N, float *const restrict scratch, float *const restrict buf,
-                                       const int stride, const int w, const size_t mask)
+// calculate the one-dimensional moving minimum on 16 adjacent columns over a window of size 2*w+1,
+// see box_max_vert_16wide()
+static inline void box_min_vert_16wide(const int N, float *const restrict h, float *const restrict buf,
+                                       const int stride, int w)
 {
-  float DT_ALIGNED_ARRAY m[16] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX,
-                                   FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX,
-                                   FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX,
-                                   FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
-  for(size_t i = 0; i < MIN(w + 1, N); i++)
-  {
-    PREFETCH_NTA(buf + stride*(i+24));
-    load_update_min_16wide(scratch + 16*(i&mask), m, buf + stride*i);
-  }
-  for(size_t i = 0; i < N; i++)
-  {
-    PREFETCH_NTA(buf + stride*(i+24));
-    // store minimum of current window at center position
-    store_16wide(buf + i * stride, m);
-    // If the earliest member of the current window is the min, we need to
-    // rescan the window to determine the new minimum
-    if (i >= w)
+  if(N <= 0) return;
+  w = MIN(w, N - 1);
+  const int k = 2 * w + 1;
+  const int L = (N + k - 1) / k * k;
+
+  for(int p = 0; p < L; p++)
+  {
+    if(p >= w && p - w < N)
     {
-      set_16wide(m, FLT_MAX);  // reset min values to the highest possible
-      for(int j = i - w + 1; j < MIN(i + w + 1, N); j++)
-      {
-        update_min_16wide(m,scratch + 16*(j&mask));
-      }
+      PREFETCH_NTA(buf + (size_t)stride * (p - w + 24));
+      load_16wide(h + 16 * p, buf + (size_t)stride * (p - w));
     }
-    // if the window has not yet exceeded the end of the row/column, update the minimum value
-    const size_t n = i + w + 1;
+    else
+      set_16wide(h + 16 * p, FLT_MAX);
+  }
+  for(int b = 0; b < L; b += k)
+    for(int p = b + k - 2; p >= b; p--)
+      update_min_16wide(h + 16 * p, h + 16 * (p + 1));
+
+  float DT_ALIGNED_ARRAY g[16];
+  set_16wide(g, FLT_MAX);
+  for(int j = 0; j < w; j++)
+    update_min_16wide(g, buf + (size_t)stride * j);
+  int pos = k - 1;
+  for(int i = 0; i < N; i++)
+  {
+    const size_t n = i + w;
     if(n < N)
     {
-      load_update_min_16wide(scratch + 16 * (n&mask), m, buf + stride * n);
+      if(pos == 0)
+        load_16wide(g, buf + stride * n);
+      else
+        update_min_16wide(g, buf + stride * n);
     }
+    else if(pos == 0)
+      set_16wide(g, FLT_MAX);
+    store_min_16wide(buf + (size_t)stride * i, h + 16 * i, g);
+    if(++pos == k) pos = 0;
   }
 }
 
@@ -1528,8 +1555,8 @@ static inline void box_min_vert_16wide(const int N, float *const restrict scratc
 // does the calculation in-place if input and output images are identical
 static void box_min_1ch(float *const buf, const size_t height, const size_t width, const int w)
 {
-  const size_t eff_height = _compute_effective_height(height, w);
-  const size_t scratch_size = MAX(width,MAX(height,16*eff_height));
+  if(width == 0 || height == 0) return;
+  const size_t scratch_size = MAX(_vhgw_size(width, w), 16 * _vhgw_size(height, w));
   size_t allocsize;
   float *const restrict scratch_buffers = dt_alloc_perthread_float(scratch_size,&allocsize);
 #ifdef _OPENMP
@@ -1541,28 +1568,22 @@ static void box_min_1ch(float *const buf, const size_t height, const size_t widt
   for(size_t row = 0; row < height; row++)
   {
     float *const restrict scratch = dt_get_perthread(scratch_buffers,allocsize);
-    memcpy(scratch, buf + row * width, sizeof(float) * width);
-    box_min_1d(width, scratch, buf + row * width, 1, w);
+    box_min_1d(width, buf + row * width, 1, buf + row * width, 1, w, scratch);
   }
 #ifdef _OPENMP
 #pragma omp parallel for default(none)           \
-  dt_omp_firstprivate(w, width, height, buf,allocsize, eff_height) \
+  dt_omp_firstprivate(w, width, height, buf, allocsize) \
   dt_omp_sharedconst(scratch_buffers) \
   schedule(static)
 #endif
   for(size_t col = 0; col < (width & ~15); col += 16)
   {
     float *const restrict scratch = dt_get_perthread(scratch_buffers,allocsize);
-    box_min_vert_16wide(height, scratch, buf + col, width, w, eff_height-1);
+    box_min_vert_16wide(height, scratch, buf + col, width, w);
   }
   // handle the leftover 0..15 columns
   for (size_t col = width & ~15 ; col < width; col++)
-  {
-    float *const restrict scratch = scratch_buffers;
-    for(size_t row = 0; row < height; row++)
-      scratch[row] = buf[row * width + col];
-    box_min_1d(height, scratch, buf + col, width, w);
-  }
+    box_min_1d(height, buf + col, width, buf + col, width, w, scratch_buffers);
 
   dt_free_align(scratch_buffers);
 }
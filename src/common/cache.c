@@ -27,54 +27,109 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-// this implements a concurrent LRU cache
+// this implements a concurrent LRU cache, sharded by key
+
+static inline dt_cache_shard_t *_get_shard(dt_cache_t *cache, const uint32_t key)
+{
+  // keys are mostly consecutive image ids, eventually with the mip size in the high bits:
+  // use the high bits of a multiplicative hash so neighbours land in different shards.
+  return cache->shards + (((key * 2654435761u) >> 16) & cache->shard_mask);
+}
+
+static void _shard_gc(dt_cache_t *cache, dt_cache_shard_t *shard, const float fill_ratio);
 
 void dt_cache_init(
     dt_cache_t *cache,
     size_t entry_size,
-    size_t cost_quota)
+    size_t cost_quota,
+    int shards)
 {
-  cache->cost = 0;
-  cache->lru = 0;
+  int num_shards = 1;
+  while(num_shards * 2 <= MIN(shards, DT_CACHE_MAX_SHARDS)) num_shards *= 2;
+
+  cache->shards = dt_alloc_align(sizeof(dt_cache_shard_t) * num_shards);
+  cache->shard_mask = num_shards - 1;
   cache->entry_size = entry_size;
   cache->cost_quota = cost_quota;
-  dt_pthread_mutex_init(&cache->lock, 0);
   cache->allocate = 0;
   cache->allocate_data = 0;
   cache->cleanup = 0;
   cache->cleanup_data = 0;
-  cache->hashtable = g_hash_table_new(0, 0);
+
+  for(int k = 0; k < num_shards; k++)
+  {
+    dt_cache_shard_t *shard = cache->shards + k;
+    shard->cost = 0;
+    shard->cost_quota = cost_quota / num_shards;
+    shard->lru = 0;
+    shard->hashtable = g_hash_table_new(0, 0);
+    dt_pthread_mutex_init(&shard->lock, 0);
+  }
 }
 
 void dt_cache_cleanup(dt_cache_t *cache)
 {
-  g_hash_table_destroy(cache->hashtable);
-  for(GList *l = cache->lru; l; l = g_list_next(l))
+  for(uint32_t k = 0; k <= cache->shard_mask; k++)
   {
+    dt_cache_shard_t *shard = cache->shards + k;
+    g_hash_table_destroy(shard->hashtable);
+    for(GList *l = shard->lru; l; l = g_list_next(l))
+    {
     dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
 
-    if(cache->cleanup)
-    {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+      if(cache->cleanup)
+      {
+        assert(entry->data_size);
+        ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
 
-      cache->cleanup(cache->cleanup_data, entry);
+        cache->cleanup(cache->cleanup_data, entry);
+      }
+      else
+        dt_free_align(entry->data);
+
+      dt_pthread_rwlock_destroy(&entry->lock);
+      g_slice_free1(sizeof(*entry), entry);
     }
-    else
-      dt_free_align(entry->data);
+    g_list_free(shard->lru);
+    dt_pthread_mutex_destroy(&shard->lock);
+  }
+  dt_free_align(cache->shards);
+  cache->shards = NULL;
+}
 
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+size_t dt_cache_get_cost(dt_cache_t *cache)
+{
+  size_t cost = 0;
+  for(uint32_t k = 0; k <= cache->shard_mask; k++)
+  {
+    dt_cache_shard_t *shard = cache->shards + k;
+    dt_pthread_mutex_lock(&shard->lock);
+    cost += shard->cost;
+    dt_pthread_mutex_unlock(&shard->lock);
+  }
+  return cost;
+}
+
+void dt_cache_set_quota(dt_cache_t *cache, const size_t cost_quota)
+{
+  cache->cost_quota = cost_quota;
+  const size_t shard_quota = cost_quota / (cache->shard_mask + 1);
+  for(uint32_t k = 0; k <= cache->shard_mask; k++)
+  {
+    dt_cache_shard_t *shard = cache->shards + k;
+    dt_pthread_mutex_lock(&shard->lock);
+    shard->cost_quota = shard_quota;
+    if(shard->cost > shard_quota) _shard_gc(cache, shard, 1.0f);
+    dt_pthread_mutex_unlock(&shard->lock);
   }
-  g_list_free(cache->lru);
-  dt_pthread_mutex_destroy(&cache->lock);
 }
 
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  int32_t result = g_hash_table_contains(cache->hashtable, GINT_TO_POINTER(key));
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_cache_shard_t *shard = _get_shard(cache, key);
+  dt_pthread_mutex_lock(&shard->lock);
+  int32_t result = g_hash_table_contains(shard->hashtable, GINT_TO_POINTER(key));
+  dt_pthread_mutex_unlock(&shard->lock);
   return result;
 }
 
@@ -83,70 +138,94 @@ int dt_cache_for_all(
     int (*process)(const uint32_t key, const void *data, void *user_data),
     void *user_data)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  GHashTableIter iter;
-  gpointer key, value;
-
-  g_hash_table_iter_init (&iter, cache->hashtable);
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  for(uint32_t k = 0; k <= cache->shard_mask; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
-    const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
-    if(err)
+    dt_cache_shard_t *shard = cache->shards + k;
+    dt_pthread_mutex_lock(&shard->lock);
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init (&iter, shard->hashtable);
+    while (g_hash_table_iter_next (&iter, &key, &value))
     {
-      dt_pthread_mutex_unlock(&cache->lock);
-      return err;
+      dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
+      const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
+      if(err)
+      {
+        dt_pthread_mutex_unlock(&shard->lock);
+        return err;
+      }
     }
+    dt_pthread_mutex_unlock(&shard->lock);
   }
-  dt_pthread_mutex_unlock(&cache->lock);
   return 0;
 }
 
+// lookup of an entry that does not block on its rw lock, with the shard lock held
+static dt_cache_entry_t *_testget_locked(dt_cache_shard_t *shard, const uint32_t key, char mode)
+{
+  gpointer orig_key, value;
+  if(!g_hash_table_lookup_extended(shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value)) return NULL;
+
+  dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
+  // lock the cache entry
+  const int result
+      = (mode == 'w') ? dt_pthread_rwlock_trywrlock(&entry->lock) : dt_pthread_rwlock_tryrdlock(&entry->lock);
+  if(result) return NULL;
+
+  // bubble up in lru list:
+  shard->lru = g_list_remove_link(shard->lru, entry->link);
+  shard->lru = g_list_concat(shard->lru, entry->link);
+
+  if(mode == 'w')
+  {
+    assert(entry->data_size);
+    ASAN_POISON_MEMORY_REGION(entry->data, entry->data_size);
+  }
+
+  // WARNING: do *NOT* unpoison here. it must be done by the caller!
+
+  return entry;
+}
+
 // return read locked bucket, or NULL if it's not already there.
 // never attempt to allocate a new slot.
 dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char mode)
 {
-  gpointer orig_key, value;
-  gboolean res;
+  dt_cache_shard_t *shard = _get_shard(cache, key);
   double start = dt_get_wtime();
-  dt_pthread_mutex_lock(&cache->lock);
-  res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
-  if(res)
-  {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
-    // lock the cache entry
-    const int result
-        = (mode == 'w') ? dt_pthread_rwlock_trywrlock(&entry->lock) : dt_pthread_rwlock_tryrdlock(&entry->lock);
-    if(result)
-    { // need to give up mutex so other threads have a chance to get in between and
-      // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
-      return 0;
-    }
-    // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
-    double end = dt_get_wtime();
-    if(end - start > 0.1)
-      fprintf(stderr, "try+ wait time %.06fs mode %c \n", end - start, mode);
+  dt_pthread_mutex_lock(&shard->lock);
+  // if the entry is locked, giving up the mutex lets other threads get in between and free it
+  dt_cache_entry_t *entry = _testget_locked(shard, key, mode);
+  dt_pthread_mutex_unlock(&shard->lock);
+  double end = dt_get_wtime();
+  if(end - start > 0.1)
+    fprintf(stderr, "try%c wait time %.06fs mode %c \n", entry ? '+' : '-', end - start, mode);
+  return entry;
+}
 
-    if(mode == 'w')
+int dt_cache_testget_batch(dt_cache_t *cache, const uint32_t *keys, const int count, char mode,
+                           dt_cache_entry_t **entries)
+{
+  int found = 0;
+  gboolean *done = g_malloc0_n(count, sizeof(gboolean));
+  for(int i = 0; i < count; i++)
+  {
+    if(done[i]) continue;
+    // take each shard lock once, for all the keys that fall in it
+    dt_cache_shard_t *shard = _get_shard(cache, keys[i]);
+    dt_pthread_mutex_lock(&shard->lock);
+    for(int j = i; j < count; j++)
     {
-      assert(entry->data_size);
-      ASAN_POISON_MEMORY_REGION(entry->data, entry->data_size);
+      if(done[j] || _get_shard(cache, keys[j]) != shard) continue;
+      done[j] = TRUE;
+      entries[j] = _testget_locked(shard, keys[j], mode);
+      if(entries[j]) found++;
     }
-
-    // WARNING: do *NOT* unpoison here. it must be done by the caller!
-
-    return entry;
+    dt_pthread_mutex_unlock(&shard->lock);
   }
-  dt_pthread_mutex_unlock(&cache->lock);
-  double end = dt_get_wtime();
-  if(end - start > 0.1)
-    fprintf(stderr, "try- wait time %.06fs\n", end - start);
-  return 0;
+  g_free(done);
+  return found;
 }
 
 // if found, the data void* is returned. if not, it is set to be
@@ -157,11 +236,12 @@ dt_cache_entry_t *dt_cache_get_with_caller(dt_cache_t *cache, const uint32_t key
   gpointer orig_key, value;
   gboolean res;
   int result;
+  dt_cache_shard_t *shard = _get_shard(cache, key);
   double start = dt_get_wtime();
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_pthread_mutex_lock(&shard->lock);
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   if(res)
   { // yay, found. read lock and pass on.
     dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
@@ -170,14 +250,14 @@ restart:
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&shard->lock);
       g_usleep(5);
       goto restart;
     }
     // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    shard->lru = g_list_remove_link(shard->lru, entry->link);
+    shard->lru = g_list_concat(shard->lru, entry->link);
+    dt_pthread_mutex_unlock(&shard->lock);
 
 #ifdef _DEBUG
     const pthread_t writer = dt_pthread_rwlock_get_writer(&entry->lock);
@@ -206,10 +286,10 @@ restart:
 
   // first try to clean up.
   // also wait if we can't free more than the requested fill ratio.
-  if(cache->cost > 0.8f * cache->cost_quota)
+  if(shard->cost > 0.8f * shard->cost_quota)
   {
     // need to roll back all the way to get a consistent lock state:
-    dt_cache_gc(cache, 0.8f);
+    _shard_gc(cache, shard, 0.8f);
   }
 
   // here dies your 32-bit system:
@@ -223,7 +303,7 @@ restart:
   entry->key = key;
   entry->_lock_demoting = 0;
 
-  g_hash_table_insert(cache->hashtable, GINT_TO_POINTER(key), entry);
+  g_hash_table_insert(shard->hashtable, GINT_TO_POINTER(key), entry);
 
   assert(cache->allocate || entry->data_size);
 
@@ -242,12 +322,12 @@ restart:
   if(write) dt_pthread_rwlock_wrlock_with_caller(&entry->lock, file, line);
   else      dt_pthread_rwlock_rdlock_with_caller(&entry->lock, file, line);
 
-  cache->cost += entry->cost;
+  shard->cost += entry->cost;
 
   // put at end of lru list (most recently used):
-  cache->lru = g_list_concat(cache->lru, entry->link);
+  shard->lru = g_list_concat(shard->lru, entry->link);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   double end = dt_get_wtime();
   if(end - start > 0.1)
     fprintf(stderr, "wait time %.06fs\n", end - start);
@@ -263,22 +343,23 @@ int dt_cache_remove(dt_cache_t *cache, const uint32_t key)
   gboolean res;
   int result;
   dt_cache_entry_t *entry;
+  dt_cache_shard_t *shard = _get_shard(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_pthread_mutex_lock(&shard->lock);
 
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   entry = (dt_cache_entry_t *)value;
   if(!res)
   { // not found in cache, not deleting.
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     return 1;
   }
   // need write lock to be able to delete:
   result = dt_pthread_rwlock_trywrlock(&entry->lock);
   if(result)
   {
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
@@ -287,15 +368,15 @@ restart:
   {
     // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
     dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
 
-  gboolean removed = g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(key));
+  gboolean removed = g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(key));
   (void)removed; // make non-assert compile happy
   assert(removed);
-  cache->lru = g_list_delete_link(cache->lru, entry->link);
+  shard->lru = g_list_delete_link(shard->lru, entry->link);
 
   if(cache->cleanup)
   {
@@ -309,23 +390,24 @@ restart:
 
   dt_pthread_rwlock_unlock(&entry->lock);
   dt_pthread_rwlock_destroy(&entry->lock);
-  cache->cost -= entry->cost;
+  shard->cost -= entry->cost;
   g_slice_free1(sizeof(*entry), entry);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   return 0;
 }
 
 // best-effort garbage collection. never blocks, never fails. well, sometimes it just doesn't free anything.
-void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
+// to be called with shard->lock held.
+static void _shard_gc(dt_cache_t *cache, dt_cache_shard_t *shard, const float fill_ratio)
 {
-  GList *l = cache->lru;
+  GList *l = shard->lru;
   while(l)
   {
     dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
     assert(entry->link->data == entry);
     l = g_list_next(l); // we might remove this element, so walk to the next one while we still have the pointer..
-    if(cache->cost < cache->cost_quota * fill_ratio) break;
+    if(shard->cost < shard->cost_quota * fill_ratio) break;
 
     // if still locked by anyone else give up:
     if(dt_pthread_rwlock_trywrlock(&entry->lock)) continue;
@@ -338,9 +420,9 @@ void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
     }
 
     // delete!
-    g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(entry->key));
-    cache->lru = g_list_delete_link(cache->lru, entry->link);
-    cache->cost -= entry->cost;
+    g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(entry->key));
+    shard->lru = g_list_delete_link(shard->lru, entry->link);
+    shard->cost -= entry->cost;
 
     if(cache->cleanup)
     {
@@ -358,6 +440,17 @@ void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
   }
 }
 
+void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
+{
+  for(uint32_t k = 0; k <= cache->shard_mask; k++)
+  {
+    dt_cache_shard_t *shard = cache->shards + k;
+    dt_pthread_mutex_lock(&shard->lock);
+    _shard_gc(cache, shard, fill_ratio);
+    dt_pthread_mutex_unlock(&shard->lock);
+  }
+}
+
 void dt_cache_release_with_caller(dt_cache_t *cache, dt_cache_entry_t *entry, const char *file, int line)
 {
 #if((__has_feature(address_sanitizer) || defined(__SANITIZE_ADDRESS__)) && 1)
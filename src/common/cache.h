@@ -38,16 +38,29 @@ dt_cache_entry_t;
 typedef void((*dt_cache_allocate_t)(void *userdata, dt_cache_entry_t *entry));
 typedef void((*dt_cache_cleanup_t)(void *userdata, dt_cache_entry_t *entry));
 
-typedef struct dt_cache_t
+#define DT_CACHE_MAX_SHARDS 64
+
+// Keys are spread over independent shards, each with its own lock, hashtable, LRU and share of the quota,
+// so threads working on different images don't contend on a single lock.
+typedef struct dt_cache_shard_t
 {
-  dt_pthread_mutex_t lock; // big fat lock. we're only expecting a couple hand full of cpu threads to use this concurrently.
+  dt_pthread_mutex_t lock; // protects this shard only
 
-  size_t entry_size; // cache line allocation
-  size_t cost;       // user supplied cost per cache line (bytes?)
-  size_t cost_quota; // quota to try and meet. but don't use as hard limit.
+  size_t cost;           // user supplied cost per cache line (bytes?)
+  size_t cost_quota;     // quota to try and meet. but don't use as hard limit.
 
   GHashTable *hashtable; // stores (key, entry) pairs
   GList *lru;            // last element is most recently used, first is about to be kicked from cache.
+}
+__attribute__((aligned(64))) dt_cache_shard_t;
+
+typedef struct dt_cache_t
+{
+  dt_cache_shard_t *shards;
+  uint32_t shard_mask;   // number of shards - 1, the number of shards is a power of 2
+
+  size_t entry_size; // cache line allocation
+  size_t cost_quota; // sum of the quotas of all shards
 
   // callback functions for cache misses/garbage collection
   dt_cache_allocate_t allocate;
@@ -57,8 +70,10 @@ typedef struct dt_cache_t
 }
 dt_cache_t;
 
-// entry size is only used if alloc callback is 0
-void dt_cache_init(dt_cache_t *cache, size_t entry_size, size_t cost_quota);
+// entry size is only used if alloc callback is 0.
+// shards is rounded down to a power of 2, each one gets cost_quota / shards.
+// Use 1 for caches holding only a few large entries, where splitting the quota would starve them.
+void dt_cache_init(dt_cache_t *cache, size_t entry_size, size_t cost_quota, int shards);
 void dt_cache_cleanup(dt_cache_t *cache);
 
 static inline void dt_cache_set_allocate_callback(dt_cache_t *cache, dt_cache_allocate_t allocate_cb,
@@ -79,17 +94,28 @@ static inline void dt_cache_set_cleanup_callback(dt_cache_t *cache, dt_cache_cle
 dt_cache_entry_t *dt_cache_get_with_caller(dt_cache_t *cache, const uint32_t key, char mode, const char *file, int line);
 // same but returns 0 if not allocated yet (both will block and wait for entry rw locks to be released)
 dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char mode);
+// dt_cache_testget() for count keys at once, taking each shard lock only once.
+// entries[k] is set to the locked entry of keys[k] or 0, returns the number of entries found.
+int dt_cache_testget_batch(dt_cache_t *cache, const uint32_t *keys, const int count, char mode,
+                           dt_cache_entry_t **entries);
 // release a lock on a cache entry. the cache knows which one you mean (r or w).
 #define dt_cache_release(A, B) dt_cache_release_with_caller(A, B, __FILE__, __LINE__)
 void dt_cache_release_with_caller(dt_cache_t *cache, dt_cache_entry_t *entry, const char *file, int line);
 
+// total cost of the entries, summed over all shards
+size_t dt_cache_get_cost(dt_cache_t *cache);
+
+// change the quota, spread over the shards like in dt_cache_init().
+// shards above their new quota are garbage collected right away.
+void dt_cache_set_quota(dt_cache_t *cache, const size_t cost_quota);
+
 // 0: not contained
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key);
 // returns 0 on success, 1 if the key was not found.
 int32_t dt_cache_remove(dt_cache_t *cache, const uint32_t key);
-// removes from the tip of the lru list, until the fill ratio of the hashtable
+// removes from the tip of the lru list of each shard, until the fill ratio of the shard
 // goes below the given parameter, in terms of the user defined cost measure.
-// will never lock and never fail, but sometimes not free memory (in case all
+// will never block on entries and never fail, but sometimes not free memory (in case all
 // is locked)
 void dt_cache_gc(dt_cache_t *cache, const float fill_ratio);
 
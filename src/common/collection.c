@@ -42,6 +42,9 @@
 #endif
 
 
+// the query memory.collected_images has been filled from, NULL if its content is not that of a query
+static gchar *_memory_query = NULL;
+
 #define SELECT_QUERY "SELECT DISTINCT * FROM %s"
 #define LIMIT_QUERY "LIMIT ?1, ?2"
 
@@ -181,10 +184,100 @@ void dt_collection_memory_update()
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
 
-  g_free(query);
+  g_free(_memory_query);
+  _memory_query = query;
   g_free(ins_query);
 }
 
+// comma-separated imgids of the list, to be used inside IN sql query
+static gchar *_imgid_list_to_string(const GList *list)
+{
+  gchar *txt = NULL;
+  for(const GList *l = list; l; l = g_list_next(l))
+    txt = dt_util_dstrcat(txt, txt ? ",%d" : "%d", GPOINTER_TO_INT(l->data));
+  return txt;
+}
+
+// whether the order of the collection can change when this property of an image changes
+static gboolean _sort_depends_on(const dt_collection_sort_t sort, const dt_collection_properties_t property)
+{
+  switch(property)
+  {
+    case DT_COLLECTION_PROP_RATING:
+      return sort == DT_COLLECTION_SORT_RATING;
+    case DT_COLLECTION_PROP_COLORLABEL:
+      return sort == DT_COLLECTION_SORT_COLOR;
+    case DT_COLLECTION_PROP_TAG:
+      return sort == DT_COLLECTION_SORT_CUSTOM_ORDER;
+    case DT_COLLECTION_PROP_GROUPING:
+      return sort == DT_COLLECTION_SORT_GROUP;
+    case DT_COLLECTION_PROP_ASPECT_RATIO:
+      return sort == DT_COLLECTION_SORT_ASPECT_RATIO;
+    case DT_COLLECTION_PROP_GEOTAGGING:
+    case DT_COLLECTION_PROP_LOCAL_COPY:
+      return FALSE;
+    default:
+      if(property >= DT_COLLECTION_PROP_METADATA && property < DT_COLLECTION_PROP_METADATA + DT_METADATA_NUMBER)
+        return sort == DT_COLLECTION_SORT_TITLE || sort == DT_COLLECTION_SORT_DESCRIPTION;
+      // we don't know what changed
+      return TRUE;
+  }
+}
+
+/* Update memory.collected_images for a change of @a property on the images of @a list only.
+ * Images of the list which don't match the query anymore are removed, the others keep their place.
+ * Returns FALSE, without touching anything, when that's not enough and the whole table needs to be rebuilt:
+ * the order depends on that property, some image of the list enters the collection (we don't know where
+ * it goes), or the table doesn't hold the current query. */
+static gboolean _dt_collection_memory_update_list(const dt_collection_t *collection,
+                                                  const dt_collection_properties_t property, const GList *list)
+{
+  if(!list || collection != darktable.collection || !_memory_query) return FALSE;
+  if(_sort_depends_on(collection->params.sort, property)
+     || _sort_depends_on(collection->params.sort_second_order, property))
+    return FALSE;
+
+  const gchar *query = dt_collection_get_query(collection);
+  if(!query || strcmp(query, _memory_query)) return FALSE;
+
+  sqlite3_stmt *stmt = NULL;
+  gchar *txt = _imgid_list_to_string(list);
+
+  // images of the list still in the collection after the change, which weren't there before
+  // clang-format off
+  gchar *new_query = g_strdup_printf("SELECT COUNT(*)"
+                                     " FROM (%s) AS q"
+                                     " WHERE q.id IN (%s)"
+                                     "   AND q.id NOT IN (SELECT imgid FROM memory.collected_images)",
+                                     query, txt);
+  // clang-format on
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), new_query, -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
+  const int entering = (sqlite3_step(stmt) == SQLITE_ROW) ? sqlite3_column_int(stmt, 0) : 1;
+  sqlite3_finalize(stmt);
+  g_free(new_query);
+
+  if(entering == 0)
+  {
+    // clang-format off
+    gchar *del_query = g_strdup_printf("DELETE FROM memory.collected_images"
+                                       " WHERE imgid IN (%s)"
+                                       "   AND imgid NOT IN (SELECT q.id FROM (%s) AS q WHERE q.id IN (%s))",
+                                       txt, query, txt);
+    // clang-format on
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), del_query, -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    g_free(del_query);
+  }
+
+  g_free(txt);
+  return entering == 0;
+}
+
 static void _dt_collection_set_selq_pre_sort(const dt_collection_t *collection, char **selq_pre)
 {
   const uint32_t tagid = collection->tagid;
@@ -2294,17 +2387,7 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
       // we do this here
 
       // 1. create a string with all the imgids of the list to be used inside IN sql query
-      gchar *txt = NULL;
-      int i = 0;
-      for(GList *l = list; l; l = g_list_next(l))
-      {
-        const int id = GPOINTER_TO_INT(l->data);
-        if(i == 0)
-          txt = dt_util_dstrcat(txt, "%d", id);
-        else
-          txt = dt_util_dstrcat(txt, ",%d", id);
-        i++;
-      }
+      gchar *txt = _imgid_list_to_string(list);
       // 2. search the first imgid not in the list but AFTER the list (or in a gap inside the list)
       // we need to be carefull that some images in the list may not be present on screen (collapsed groups)
       // clang-format off
@@ -2430,7 +2513,10 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
   /* raise signal of collection change, only if this is an original */
   if(!collection->clone)
   {
-    dt_collection_memory_update();
+    // a change on a few images only needs to touch their rows
+    if(query_change != DT_COLLECTION_CHANGE_RELOAD
+       || !_dt_collection_memory_update_list(collection, changed_property, list))
+      dt_collection_memory_update();
     DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED, query_change, changed_property,
                                   list, next);
   }
@@ -2438,6 +2524,10 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
 
 void dt_pop_collection()
 {
+  // the table doesn't hold the result of a query anymore
+  g_free(_memory_query);
+  _memory_query = NULL;
+
   // Restore previous collection
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.collected_images", NULL, NULL, NULL);
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
@@ -2475,6 +2565,8 @@ void dt_selection_to_culling_mode()
 
   // Remove non-selected from collected images, aka culling mode
   dt_push_collection();
+  g_free(_memory_query);
+  _memory_query = NULL;
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
                         "DELETE FROM memory.collected_images"
                         "  WHERE imgid NOT IN "
@@ -23,6 +23,8 @@
 #include "common/debug.h"
 #include "common/image_cache.h"
 #include "common/file_location.h"
+#include "common/imagebuf.h"
+#include "common/lut3d.h"
 #include "common/math.h"
 #include "common/matrices.h"
 #include "common/srgb_tone_curve_values.h"
@@ -166,8 +168,232 @@ static const dt_colorspaces_color_profile_t *_get_profile(dt_colorspaces_t *self
                                                           const char *filename,
                                                           dt_colorspaces_profile_direction_t direction);
 
+/*
+ * Process-wide cache of what takes time to derive from profiles: lcms2 transforms, the matrices and
+ * tone curves of matrix-shaper profiles and the 3D LUTs sampled from transforms. Every pipe commits
+ * the same few profiles again and again: each thumbnail, each exported image, each parameter change.
+ *
+ * Entries are keyed by a checksum of the content of the profiles, not by their handles: profiles
+ * created from camera matrices are new objects on every commit. Referenced entries are kept,
+ * unreferenced ones stay around in LRU order up to DT_COLORSPACES_CACHE_UNUSED.
+ */
+#define DT_COLORSPACES_CACHE_UNUSED 24
+
+typedef struct dt_colorspaces_cached_t
+{
+  gchar *key;
+  gpointer data;
+  void (*destroy)(gpointer data);
+  int refs;
+  GList *unused; // link in _cache.unused while refs == 0
+} dt_colorspaces_cached_t;
+
+static struct
+{
+  GMutex lock;
+  GHashTable *by_key;  // key -> dt_colorspaces_cached_t
+  GHashTable *by_data; // data -> dt_colorspaces_cached_t
+  GQueue unused;       // oldest first
+} _cache = { 0 };
+
+static void _cached_free(dt_colorspaces_cached_t *entry)
+{
+  g_hash_table_remove(_cache.by_data, entry->data);
+  g_hash_table_remove(_cache.by_key, entry->key);
+  entry->destroy(entry->data);
+  g_free(entry->key);
+  free(entry);
+}
+
+// needs the lock. returns the data with one more reference or NULL
+static gpointer _cache_acquire(const gchar *key)
+{
+  if(!_cache.by_key)
+  {
+    _cache.by_key = g_hash_table_new(g_str_hash, g_str_equal);
+    _cache.by_data = g_hash_table_new(g_direct_hash, g_direct_equal);
+  }
+  dt_colorspaces_cached_t *entry = (dt_colorspaces_cached_t *)g_hash_table_lookup(_cache.by_key, key);
+  if(!entry) return NULL;
+  if(entry->unused)
+  {
+    g_queue_delete_link(&_cache.unused, entry->unused);
+    entry->unused = NULL;
+  }
+  entry->refs++;
+  return entry->data;
+}
+
+// needs the lock. takes the key, data is returned with one reference
+static gpointer _cache_insert(gchar *key, gpointer data, void (*destroy)(gpointer data))
+{
+  dt_colorspaces_cached_t *entry = (dt_colorspaces_cached_t *)calloc(1, sizeof(dt_colorspaces_cached_t));
+  entry->key = key;
+  entry->data = data;
+  entry->destroy = destroy;
+  entry->refs = 1;
+  g_hash_table_insert(_cache.by_key, entry->key, entry);
+  g_hash_table_insert(_cache.by_data, entry->data, entry);
+  return data;
+}
+
+// returns FALSE if data doesn't come from the cache
+static gboolean _cache_release(gpointer data)
+{
+  g_mutex_lock(&_cache.lock);
+  dt_colorspaces_cached_t *entry
+      = _cache.by_data ? (dt_colorspaces_cached_t *)g_hash_table_lookup(_cache.by_data, data) : NULL;
+  if(entry && --entry->refs == 0)
+  {
+    g_queue_push_tail(&_cache.unused, entry);
+    entry->unused = _cache.unused.tail;
+    while(_cache.unused.length > DT_COLORSPACES_CACHE_UNUSED)
+      _cached_free((dt_colorspaces_cached_t *)g_queue_pop_head(&_cache.unused));
+  }
+  g_mutex_unlock(&_cache.lock);
+  return entry != NULL;
+}
+
+static void _cache_cleanup(void)
+{
+  g_mutex_lock(&_cache.lock);
+  while(_cache.unused.length > 0) _cached_free((dt_colorspaces_cached_t *)g_queue_pop_head(&_cache.unused));
+  // what is still referenced stays, so late releases find it
+  if(_cache.by_key && g_hash_table_size(_cache.by_key) == 0)
+  {
+    g_hash_table_destroy(_cache.by_key);
+    g_hash_table_destroy(_cache.by_data);
+    _cache.by_key = _cache.by_data = NULL;
+  }
+  g_mutex_unlock(&_cache.lock);
+}
+
+// the content of a profile, without what changes between two identical profiles created at different times
+static void _checksum_profile(GChecksum *checksum, cmsHPROFILE profile)
+{
+  cmsUInt32Number size = 0;
+  if(!profile || !cmsSaveProfileToMem(profile, NULL, &size) || size < 128)
+  {
+    g_checksum_update(checksum, (const guchar *)"none", 4);
+    return;
+  }
+  guchar *data = g_malloc(size);
+  if(cmsSaveProfileToMem(profile, data, &size) && size >= 128)
+  {
+    memset(data + 24, 0, 12); // creation date
+    memset(data + 84, 0, 16); // profile ID, an MD5 including the date
+    g_checksum_update(checksum, data, size);
+  }
+  g_free(data);
+}
+
+static void _checksum_int(GChecksum *checksum, const int64_t value)
+{
+  g_checksum_update(checksum, (const guchar *)&value, sizeof(value));
+}
+
+static void _destroy_transform(gpointer data)
+{
+  cmsDeleteTransform((cmsHTRANSFORM)data);
+}
+
+cmsHTRANSFORM dt_colorspaces_get_transform(cmsHPROFILE input, const cmsUInt32Number input_format,
+                                           cmsHPROFILE output, const cmsUInt32Number output_format,
+                                           cmsHPROFILE proofing, const int intent, const int proofing_intent,
+                                           const cmsUInt32Number flags)
+{
+  GChecksum *checksum = g_checksum_new(G_CHECKSUM_MD5);
+  g_checksum_update(checksum, (const guchar *)"transform", 9);
+  _checksum_profile(checksum, input);
+  _checksum_profile(checksum, output);
+  _checksum_profile(checksum, proofing);
+  _checksum_int(checksum, input_format);
+  _checksum_int(checksum, output_format);
+  _checksum_int(checksum, intent);
+  _checksum_int(checksum, proofing ? proofing_intent : -1);
+  _checksum_int(checksum, flags);
+  gchar *key = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+
+  // created under the lock, so concurrent pipes don't build the same transform twice
+  g_mutex_lock(&_cache.lock);
+  cmsHTRANSFORM xform = (cmsHTRANSFORM)_cache_acquire(key);
+  if(xform)
+    g_free(key);
+  else
+  {
+    xform = proofing
+      ? cmsCreateProofingTransform(input, input_format, output, output_format, proofing, intent, proofing_intent, flags)
+      : cmsCreateTransform(input, input_format, output, output_format, intent, flags);
+    if(xform)
+      _cache_insert(key, xform, _destroy_transform);
+    else
+      g_free(key);
+  }
+  g_mutex_unlock(&_cache.lock);
+  return xform;
+}
+
+void dt_colorspaces_release_transform(cmsHTRANSFORM xform)
+{
+  if(!xform) return;
+  if(!_cache_release(xform)) cmsDeleteTransform(xform);
+}
+
+static int _get_matrix_from_profile(cmsHPROFILE prof, dt_colormatrix_t matrix, float *lutr, float *lutg,
+                                    float *lutb, const int lutsize, const int input);
+
+typedef struct dt_colorspaces_cached_matrix_t
+{
+  int ret;
+  dt_colormatrix_t matrix;
+  float lut[]; // 3 * lutsize
+} dt_colorspaces_cached_matrix_t;
+
 static int dt_colorspaces_get_matrix_from_profile(cmsHPROFILE prof, dt_colormatrix_t matrix, float *lutr, float *lutg,
                                                   float *lutb, const int lutsize, const int input)
+{
+  // the probes are cheap, only the tone curves sampled at full size are worth keeping
+  if(!prof || !matrix || !lutr || !lutg || !lutb || lutsize <= 1)
+    return _get_matrix_from_profile(prof, matrix, lutr, lutg, lutb, lutsize, input);
+
+  GChecksum *checksum = g_checksum_new(G_CHECKSUM_MD5);
+  g_checksum_update(checksum, (const guchar *)"matrix", 6);
+  _checksum_profile(checksum, prof);
+  _checksum_int(checksum, lutsize);
+  _checksum_int(checksum, input);
+  gchar *key = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+
+  g_mutex_lock(&_cache.lock);
+  dt_colorspaces_cached_matrix_t *cached = (dt_colorspaces_cached_matrix_t *)_cache_acquire(key);
+  if(cached)
+    g_free(key);
+  else
+  {
+    cached = (dt_colorspaces_cached_matrix_t *)g_malloc(sizeof(dt_colorspaces_cached_matrix_t)
+                                                         + sizeof(float) * 3 * lutsize);
+    cached->ret = _get_matrix_from_profile(prof, cached->matrix, cached->lut, cached->lut + lutsize,
+                                           cached->lut + 2 * lutsize, lutsize, input);
+    _cache_insert(key, cached, g_free);
+  }
+  g_mutex_unlock(&_cache.lock);
+
+  const int ret = cached->ret;
+  if(ret == 0)
+  {
+    memcpy(matrix, cached->matrix, sizeof(dt_colormatrix_t));
+    // linear curves only have their first value set
+    memcpy(lutr, cached->lut, sizeof(float) * (cached->lut[0] < 0.0f ? 1 : lutsize));
+    memcpy(lutg, cached->lut + lutsize, sizeof(float) * (cached->lut[lutsize] < 0.0f ? 1 : lutsize));
+    memcpy(lutb, cached->lut + 2 * lutsize, sizeof(float) * (cached->lut[2 * lutsize] < 0.0f ? 1 : lutsize));
+  }
+  _cache_release(cached);
+  return ret;
+}
+
+static int _get_matrix_from_profile(cmsHPROFILE prof, dt_colormatrix_t matrix, float *lutr, float *lutg,
+                                    float *lutb, const int lutsize, const int input)
 {
   // create an OpenCL processable matrix + tone curves from an cmsHPROFILE:
   // NOTE: may be invoked with matrix and LUT pointers set to null to find
@@ -1789,6 +2015,8 @@ void dt_colorspaces_cleanup(dt_colorspaces_t *self)
   if(self->transform_xyz_to_display) cmsDeleteTransform(self->transform_xyz_to_display);
   self->transform_xyz_to_display = NULL;
 
+  _cache_cleanup();
+
   for(GList *iter = self->profiles; iter; iter = g_list_next(iter))
   {
     dt_colorspaces_color_profile_t *p = (dt_colorspaces_color_profile_t *)iter->data;
@@ -2589,6 +2817,106 @@ void dt_colorspaces_rgb_to_cygm(float *out, int num, double RGB_to_CAM[4][3])
   }
 }
 
+float *dt_colorspaces_clut_from_transforms(const cmsHTRANSFORM *const xforms, const int count, const int level)
+{
+  const size_t nodes = (size_t)level * level * level;
+  float *const grid = dt_alloc_align_float(nodes * 4);
+  float *const clut = dt_alloc_align_float(nodes * 3);
+  if(grid == NULL || clut == NULL)
+  {
+    dt_free_align(grid);
+    dt_free_align(clut);
+    return NULL;
+  }
+
+  for(size_t k = 0; k < nodes; k++)
+  {
+    grid[4 * k + 0] = (float)(k % level) / (level - 1);
+    grid[4 * k + 1] = (float)((k / level) % level) / (level - 1);
+    grid[4 * k + 2] = (float)(k / ((size_t)level * level)) / (level - 1);
+    grid[4 * k + 3] = 1.0f;
+  }
+
+  const size_t rows = (size_t)level * level;
+  for(int i = 0; i < count; i++)
+  {
+    if(i > 0)
+      for(size_t k = 0; k < nodes; k++)
+        for(int c = 0; c < 3; c++) grid[4 * k + c] = CLAMP(grid[4 * k + c], 0.0f, 1.0f);
+
+    // one row of the LUT at a time
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(grid, xforms, i, level, rows) schedule(static)
+#endif
+    for(size_t row = 0; row < rows; row++)
+      cmsDoTransform(xforms[i], grid + 4 * row * level, grid + 4 * row * level, level);
+  }
+
+  for(size_t k = 0; k < nodes; k++)
+    for(int c = 0; c < 3; c++) clut[3 * k + c] = grid[4 * k + c];
+
+  dt_free_align(grid);
+  return clut;
+}
+
+float *dt_colorspaces_get_clut(const cmsHTRANSFORM *const xforms, const int count, const int level)
+{
+  // the LUT is known by the keys of the transforms it samples, if they all come from the cache
+  GChecksum *checksum = g_checksum_new(G_CHECKSUM_MD5);
+  g_checksum_update(checksum, (const guchar *)"clut", 4);
+  _checksum_int(checksum, level);
+  gboolean cached = TRUE;
+  g_mutex_lock(&_cache.lock);
+  for(int i = 0; i < count && cached; i++)
+  {
+    const dt_colorspaces_cached_t *entry
+        = _cache.by_data ? (dt_colorspaces_cached_t *)g_hash_table_lookup(_cache.by_data, xforms[i]) : NULL;
+    if(entry)
+      g_checksum_update(checksum, (const guchar *)entry->key, -1);
+    else
+      cached = FALSE;
+  }
+  g_mutex_unlock(&_cache.lock);
+  gchar *key = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+
+  if(!cached)
+  {
+    g_free(key);
+    return dt_colorspaces_clut_from_transforms(xforms, count, level);
+  }
+
+  g_mutex_lock(&_cache.lock);
+  float *clut = (float *)_cache_acquire(key);
+  if(clut)
+    g_free(key);
+  else
+  {
+    // sampled with the lock held: thumbnails of a batch all want the same one
+    clut = dt_colorspaces_clut_from_transforms(xforms, count, level);
+    if(clut)
+      _cache_insert(key, clut, dt_free_align_ptr);
+    else
+      g_free(key);
+  }
+  g_mutex_unlock(&_cache.lock);
+  return clut;
+}
+
+void dt_colorspaces_release_clut(float *clut)
+{
+  if(!clut) return;
+  if(!_cache_release(clut)) dt_free_align(clut);
+}
+
+void dt_colorspaces_clut_apply(const float *const clut, const int level, const float *const in, float *const out,
+                               const size_t npixels)
+{
+  // the interpolation clips its input in place
+  if(in != out) dt_iop_image_copy_by_size(out, in, npixels, 1, 4);
+  dt_lut3d_tetrahedral(out, out, npixels, clut, level);
+}
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -240,6 +240,17 @@ int dt_colorspaces_get_matrix_from_input_profile(cmsHPROFILE prof, dt_colormatri
 int dt_colorspaces_get_matrix_from_output_profile(cmsHPROFILE prof, dt_colormatrix_t matrix, float *lutr, float *lutg,
                                                   float *lutb, const int lutsize);
 
+/** get a lcms2 transform from a process-wide cache, keyed by the content of the profiles, the formats,
+ * the intents and the flags. proofing may be NULL for a plain transform. the transform can be used by
+ * several threads at once and must not be changed. release with dt_colorspaces_release_transform(). */
+cmsHTRANSFORM dt_colorspaces_get_transform(cmsHPROFILE input, const cmsUInt32Number input_format,
+                                           cmsHPROFILE output, const cmsUInt32Number output_format,
+                                           cmsHPROFILE proofing, const int intent, const int proofing_intent,
+                                           const cmsUInt32Number flags);
+
+/** give back a transform from dt_colorspaces_get_transform(). */
+void dt_colorspaces_release_transform(cmsHTRANSFORM xform);
+
 /** wrapper to get the name from a color profile. this tries to handle character encodings. */
 void dt_colorspaces_get_profile_name(cmsHPROFILE p, const char *language, const char *country, char *name,
                                      size_t len);
@@ -312,6 +323,30 @@ static inline dt_colorspaces_color_profile_type_t sanitize_colorspaces(dt_colors
  */
 dt_colorspaces_color_profile_type_t dt_image_find_best_color_profile(int32_t imgid, cmsHPROFILE *output, gboolean *new_profile);
 
+/** size per side of the 3D LUTs sampled from LittleCMS transforms */
+#define DT_COLORSPACES_CLUT_LEVEL 33
+
+/**
+ * @brief Sample a chain of LittleCMS transforms over [0; 1]^3 into a 3D LUT, to be applied with
+ * dt_colorspaces_clut_apply() instead of cmsDoTransform() for profiles that are not matrix-shaped.
+ * LittleCMS clips these to [0; 1] anyway. The transforms take and give 4 floats per pixel, RGB between them,
+ * which is clipped to [0; 1].
+ *
+ * @return a LUT of level^3 RGB entries, red varying fastest, to be freed with dt_free_align(), or NULL.
+ */
+float *dt_colorspaces_clut_from_transforms(const cmsHTRANSFORM *const xforms, const int count, const int level);
+
+/** same as dt_colorspaces_clut_from_transforms(), shared through the cache of transforms when all of them
+ * come from dt_colorspaces_get_transform(). read-only, release with dt_colorspaces_release_clut(). */
+float *dt_colorspaces_get_clut(const cmsHTRANSFORM *const xforms, const int count, const int level);
+
+/** give back a LUT from dt_colorspaces_get_clut(). */
+void dt_colorspaces_release_clut(float *clut);
+
+/** apply a LUT sampled by dt_colorspaces_clut_from_transforms() to RGBA pixels, multithreaded. Alpha is kept. */
+void dt_colorspaces_clut_apply(const float *const clut, const int level, const float *const in, float *const out,
+                               const size_t npixels);
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -243,6 +243,50 @@ static inline void dt_Lab_to_XYZ(const dt_aligned_pixel_t Lab, dt_aligned_pixel_
     XYZ[c] = d50[c] * lab_f_inv(f[c]);
 }
 
+/** Row conversions work on n interleaved RGBA pixels. Their loops run over pixels instead of channels, so the
+ *  compiler vectorizes the cube roots of lab_f() across several pixels at once. The 4th channel of out is
+ *  never written and in == out is allowed, so they can be used for in-place conversions preserving alpha.
+ */
+#ifdef _OPENMP
+#pragma omp declare simd uniform(Lab)
+#endif
+static inline void _dt_XYZ_to_Lab_store(const float X, const float Y, const float Z, float *const Lab)
+{
+  const float fx = lab_f(X / d50[0]);
+  const float fy = lab_f(Y / d50[1]);
+  const float fz = lab_f(Z / d50[2]);
+  Lab[0] = 116.0f * fy - 16.0f;
+  Lab[1] = 500.0f * (fx - fy);
+  Lab[2] = 200.0f * (fy - fz);
+}
+
+/** uses D50 white point. */
+static inline void dt_XYZ_to_Lab_row(const float *const in, float *const out, const size_t n)
+{
+#ifdef _OPENMP
+#pragma omp simd aligned(in, out: 16)
+#endif
+  for(size_t k = 0; k < 4 * n; k += 4)
+    _dt_XYZ_to_Lab_store(in[k], in[k + 1], in[k + 2], out + k);
+}
+
+/** uses D50 white point. */
+static inline void dt_Lab_to_XYZ_row(const float *const in, float *const out, const size_t n)
+{
+#ifdef _OPENMP
+#pragma omp simd aligned(in, out: 16)
+#endif
+  for(size_t k = 0; k < 4 * n; k += 4)
+  {
+    const float fy = (in[k] + 16.0f) / 116.0f;
+    const float fx = in[k + 1] / 500.0f + fy;
+    const float fz = fy - in[k + 2] / 200.0f;
+    out[k] = d50[0] * lab_f_inv(fx);
+    out[k + 1] = d50[1] * lab_f_inv(fy);
+    out[k + 2] = d50[2] * lab_f_inv(fz);
+  }
+}
+
 
 #ifdef _OPENMP
 #pragma omp declare simd aligned(xyY, XYZ:16)
@@ -472,6 +516,21 @@ static inline void dt_Rec709_to_XYZ_D50(const dt_aligned_pixel_t sRGB, dt_aligne
   dt_apply_transposed_color_matrix(sRGB, M, XYZ_D50);
 }
 
+/** linear Rec709 to Lab D50 in one pass, see dt_XYZ_to_Lab_row() */
+static inline void dt_Rec709_to_Lab_row(const float *const in, float *const out, const size_t n)
+{
+#ifdef _OPENMP
+#pragma omp simd aligned(in, out: 16)
+#endif
+  for(size_t k = 0; k < 4 * n; k += 4)
+  {
+    const float R = in[k], G = in[k + 1], B = in[k + 2];
+    _dt_XYZ_to_Lab_store(0.4360747f * R + 0.3850649f * G + 0.1430804f * B,
+                         0.2225045f * R + 0.7168786f * G + 0.0606169f * B,
+                         0.0139322f * R + 0.0971045f * G + 0.7141733f * B, out + k);
+  }
+}
+
 
 #ifdef _OPENMP
 #pragma omp declare simd aligned(sRGB, RGB)
@@ -730,6 +789,16 @@ static inline void dt_HSL_2_RGB(const dt_aligned_pixel_t HSL, dt_aligned_pixel_t
   _dt_Hue_2_RGB(RGB, HSL[0], 2.0f * C, m);
 }
 
+/** see dt_XYZ_to_Lab_row(), the pixels are handled by the simd clones of dt_RGB_2_HSL() */
+static inline void dt_RGB_2_HSL_row(const float *const in, float *const out, const size_t n)
+{
+#ifdef _OPENMP
+#pragma omp simd aligned(in, out: 16)
+#endif
+  for(size_t k = 0; k < 4 * n; k += 4)
+    dt_RGB_2_HSL(in + k, out + k);
+}
+
 
 #ifdef _OPENMP
 #pragma omp declare simd aligned(RGB, HSV: 16)
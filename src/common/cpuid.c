@@ -44,6 +44,8 @@ dt_cpu_flags_t dt_detect_cpu_features()
   g_mutex_lock(&lock);
   if(__get_cpuid(0x00000000,&ax,&bx,&cx,&dx))
   {
+    const guint32 max_leaf = ax;
+
     /* Request for standard features */
     if(__get_cpuid(0x00000001,&ax,&bx,&cx,&dx))
     {
@@ -60,6 +62,14 @@ dt_cpu_flags_t dt_detect_cpu_features()
       if(cx & 0x08000000) cpuflags |= CPU_FLAG_AVX;
     }
 
+    /* Request for structured extended features */
+    if(max_leaf >= 0x00000007)
+    {
+      __cpuid_count(0x00000007, 0, ax, bx, cx, dx);
+      if(bx & 0x00000020) cpuflags |= CPU_FLAG_AVX2;
+      if(bx & 0x00010000) cpuflags |= CPU_FLAG_AVX512F;
+    }
+
     /* Are there extensions? */
     if (__get_cpuid(0x80000000,&ax,&bx,&cx,&dx))
     {
@@ -20,11 +20,13 @@
 */
 
 #include "curve_tools.h"
+#include "common/darktable.h"
 
 #include <float.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define EPSILON 2 * FLT_MIN
 #define MAX_ITER 10
@@ -737,6 +739,114 @@ int CurveDataSample(CurveData *curve, CurveSample *sample)
   return CT_SUCCESS;
 }
 
+// a few curves per module instance, for a few instances and pipes
+#define CURVE_SAMPLE_CACHE_MAX 32
+
+typedef struct curve_sample_key_t
+{
+  int (*sampler)(CurveData *, CurveSample *);
+  unsigned int spline_type;
+  float box[4];
+  int num_anchors;
+  CurveAnchorPoint anchors[MAX_ANCHORS];
+  unsigned int sampling_res;
+  unsigned int output_res;
+} curve_sample_key_t;
+
+typedef struct curve_sample_entry_t
+{
+  uint64_t hash;
+  curve_sample_key_t key;
+  int result;
+  unsigned short int samples[];
+} curve_sample_entry_t;
+
+static struct
+{
+  GMutex lock;
+  GHashTable *entries; // hash -> curve_sample_entry_t
+  GQueue order;        // entries, oldest first
+} _sample_cache;
+
+static void _sample_key(curve_sample_key_t *key, const CurveData *curve, const CurveSample *sample,
+                        int (*sampler)(CurveData *, CurveSample *))
+{
+  // set field by field, the padding of the structs must not differ
+  memset(key, 0, sizeof(curve_sample_key_t));
+  key->sampler = sampler;
+  key->spline_type = curve->m_spline_type;
+  key->box[0] = curve->m_min_x;
+  key->box[1] = curve->m_max_x;
+  key->box[2] = curve->m_min_y;
+  key->box[3] = curve->m_max_y;
+  key->num_anchors = MIN(curve->m_numAnchors, MAX_ANCHORS);
+  for(int k = 0; k < key->num_anchors; k++) key->anchors[k] = curve->m_anchors[k];
+  key->sampling_res = sample->m_samplingRes;
+  key->output_res = sample->m_outputRes;
+}
+
+int CurveDataSampleCached(CurveData *curve, CurveSample *sample, int (*sampler)(CurveData *, CurveSample *))
+{
+  curve_sample_key_t key;
+  _sample_key(&key, curve, sample, sampler);
+  const uint64_t hash = dt_hash(5381, (const char *)&key, sizeof(curve_sample_key_t));
+  const size_t size = sizeof(unsigned short int) * sample->m_samplingRes;
+
+  g_mutex_lock(&_sample_cache.lock);
+  if(!_sample_cache.entries)
+  {
+    _sample_cache.entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, free);
+    g_queue_init(&_sample_cache.order);
+  }
+  curve_sample_entry_t *entry = g_hash_table_lookup(_sample_cache.entries, &hash);
+  if(entry && !memcmp(&entry->key, &key, sizeof(curve_sample_key_t)))
+  {
+    memcpy(sample->m_Samples, entry->samples, size);
+    const int result = entry->result;
+    // most recently used last
+    g_queue_remove(&_sample_cache.order, entry);
+    g_queue_push_tail(&_sample_cache.order, entry);
+    g_mutex_unlock(&_sample_cache.lock);
+    return result;
+  }
+  g_mutex_unlock(&_sample_cache.lock);
+
+  const int result = sampler(curve, sample);
+  if(result != CT_SUCCESS) return result;
+
+  entry = malloc(sizeof(curve_sample_entry_t) + size);
+  if(!entry) return result;
+  entry->hash = hash;
+  entry->key = key;
+  entry->result = result;
+  memcpy(entry->samples, sample->m_Samples, size);
+
+  g_mutex_lock(&_sample_cache.lock);
+  curve_sample_entry_t *old = g_hash_table_lookup(_sample_cache.entries, &hash);
+  if(old) g_queue_remove(&_sample_cache.order, old);
+  g_hash_table_replace(_sample_cache.entries, &entry->hash, entry);
+  g_queue_push_tail(&_sample_cache.order, entry);
+  while(g_queue_get_length(&_sample_cache.order) > CURVE_SAMPLE_CACHE_MAX)
+  {
+    curve_sample_entry_t *oldest = g_queue_pop_head(&_sample_cache.order);
+    g_hash_table_remove(_sample_cache.entries, &oldest->hash);
+  }
+  g_mutex_unlock(&_sample_cache.lock);
+  return result;
+}
+
+void CurveDataSampleCacheCleanup(void)
+{
+  g_mutex_lock(&_sample_cache.lock);
+  if(_sample_cache.entries)
+  {
+    g_queue_clear(&_sample_cache.order);
+    g_hash_table_destroy(_sample_cache.entries);
+    _sample_cache.entries = NULL;
+  }
+  g_mutex_unlock(&_sample_cache.lock);
+}
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -93,6 +93,21 @@ CurveDataSample:
 **********************************************/
 int CurveDataSample(CurveData *curve, CurveSample *sample);
 
+/*********************************************
+CurveDataSampleCached:
+    Same as sampler(curve, sample), but the samples of the
+    last curves sampled by the modules of all pipes and by the
+    GUI are kept: a curve with the same anchors, type, box
+    and resolutions is copied instead of being sampled again.
+
+    sampler - CurveDataSample, CurveDataSampleV2 or
+              CurveDataSampleV2Periodic.
+**********************************************/
+int CurveDataSampleCached(CurveData *curve, CurveSample *sample, int (*sampler)(CurveData *, CurveSample *));
+
+// free the samples kept by CurveDataSampleCached
+void CurveDataSampleCacheCleanup(void);
+
 /***************************************************************
  * interpolate_set:
  *
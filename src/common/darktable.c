@@ -30,6 +30,7 @@
 
 #include "common/collection.h"
 #include "common/colorspaces.h"
+#include "common/curve_tools.h"
 #include "common/darktable.h"
 #include "common/datetime.h"
 #include "common/exif.h"
@@ -47,11 +48,15 @@
 #include "common/imageio_module.h"
 #include "common/iop_order.h"
 #include "common/l10n.h"
+#include "common/memstat.h"
 #include "common/mipmap_cache.h"
 #include "common/noiseprofiles.h"
+#include "common/memgov.h"
+#include "common/numa.h"
 #include "common/opencl.h"
 #include "common/points.h"
 #include "common/resource_limits.h"
+#include "common/trace.h"
 #include "common/undo.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -61,6 +66,10 @@
 #include "control/signal.h"
 #include "develop/blend.h"
 #include "develop/imageop.h"
+#include "develop/masks.h"
+#include "develop/pixelpipe_cache.h"
+#include "develop/pixelpipe_stats.h"
+#include "develop/pixelpipe_disk_cache.h"
 
 #include "gui/gtk.h"
 #include "gui/guides.h"
@@ -124,9 +133,9 @@ static int usage(const char *argv0)
   printf("  --configdir <user config directory>\n");
   printf("  -d {all,act_on,cache,camctl,camsupport,control,demosaic,dev,history,imageio,\n");
   printf("      input,ioporder,lighttable,lua,masks,memory,nan,opencl,params,\n");
-  printf("      perf,pipe,print,pwstorage,signal,sql,tiling,undo,verbose}\n");
+  printf("      perf,pipe,print,pwstorage,signal,sql,sqlplan,tiling,undo,verbose}\n");
   printf("  --d-signal <signal> \n");
-  printf("  --d-signal-act <all,raise,connect,disconnect");
+  printf("  --d-signal-act <all,raise,connect,disconnect,profile");
   // clang-format on
 #ifdef DT_HAVE_SIGNAL_TRACE
   printf(",print-trace");
@@ -150,6 +159,7 @@ static int usage(const char *argv0)
   printf("  --noiseprofiles <noiseprofiles json file>\n");
   printf("  -t <num openmp threads>\n");
   printf("  --tmpdir <tmp directory>\n");
+  printf("  --trace <chrome trace json file>\n");
   printf("  --version\n");
 #ifdef _WIN32
   printf("\n");
@@ -313,9 +323,22 @@ static void dt_codepaths_init()
   }
 #endif
 
+#ifdef DT_HAVE_AVX2_CLONES
+  // the plain kernels are cloned for AVX2 and AVX-512 and the clone is picked when the library is loaded.
+  // They process 8 or 16 floats at once, so they beat the 4-wide SSE2 intrinsics.
+  {
+#ifdef HAVE_BUILTIN_CPU_SUPPORTS
+    darktable.codepath.AVX2 = __builtin_cpu_supports("avx2");
+#else
+    darktable.codepath.AVX2 = (dt_detect_cpu_features() & CPU_FLAG_AVX2) != 0;
+#endif
+  }
+#endif
+
   // second, apply overrides from conf
   // NOTE: all intrinsics sets can only be overridden to OFF
   if(!dt_conf_get_bool("codepaths/sse2")) darktable.codepath.SSE2 = 0;
+  if(!dt_conf_get_bool("codepaths/avx2")) darktable.codepath.AVX2 = 0;
 
   // last: do we have any intrinsics sets enabled?
   darktable.codepath._no_intrinsics = !(darktable.codepath.SSE2);
@@ -338,6 +361,9 @@ static void dt_codepaths_init()
     fprintf(stderr, "[dt_codepaths_init] SSE2-optimized codepath is disabled or unavailable.\n");
   }
 #endif
+
+  dt_print(DT_DEBUG_PERF, "[dt_codepaths_init] AVX2 kernels %s\n",
+           darktable.codepath.AVX2 ? "enabled" : "disabled or unavailable");
 }
 
 static inline size_t _get_total_memory()
@@ -396,6 +422,32 @@ static size_t _get_mipmap_size()
   return res->total_memory / 1024lu * fraction;
 }
 
+// Memory budget of the global pixelpipe cache, in bytes.
+// 0 in config means "automatic", taken from the available memory of the current resource level.
+static size_t _get_pixelpipe_cache_size()
+{
+  const size_t conf = (size_t)MAX(dt_conf_get_int("pixelpipe_cache_memory"), 0) * 1024lu * 1024lu;
+  if(conf > 0) return conf;
+
+  // a quarter of the available memory
+  dt_sys_resources_t *res = &darktable.dtresources;
+  const int level = res->level;
+  if(level < 0)
+    return res->refresource[4*(-level-1)] * 1024lu * 1024lu / 4;
+  const int fraction = res->fractions[4 * level];
+  return res->total_memory / 1024lu * fraction / 4;
+}
+
+static void _memgov_apply_thumbnails(void *data, const size_t budget)
+{
+  dt_cache_set_quota((dt_cache_t *)data, budget);
+}
+
+static void _memgov_apply_pixelpipe(void *data, const size_t budget)
+{
+  dt_dev_pixelpipe_cache_set_budget((dt_dev_pixelpipe_cache_t *)data, budget);
+}
+
 void check_resourcelevel(const char *key, int *fractions, const int level)
 {
   const int g = level * 4;
@@ -480,6 +532,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   char *configdir_from_command = NULL;
   char *cachedir_from_command = NULL;
   char *kerneldir_from_command = NULL;
+  char *trace_from_command = NULL;
 
 #ifdef HAVE_OPENCL
   gboolean exclude_opencl = FALSE;
@@ -592,6 +645,12 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
         argv[k-1] = NULL;
         argv[k] = NULL;
       }
+      else if(!strcmp(argv[k], "--trace") && argc > k + 1)
+      {
+        trace_from_command = argv[++k];
+        argv[k-1] = NULL;
+        argv[k] = NULL;
+      }
       else if(!strcmp(argv[k], "--datadir") && argc > k + 1)
       {
         datadir_from_command = argv[++k];
@@ -637,7 +696,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
       else if(argv[k][1] == 'd' && argc > k + 1)
       {
         if(!strcmp(argv[k + 1], "all"))
-          darktable.unmuted = 0xffffffff & ~DT_DEBUG_VERBOSE; // enable all debug information except verbose
+          // enable all debug information except verbose and query plans, which slow down the database
+          darktable.unmuted = 0xffffffff & ~(DT_DEBUG_VERBOSE | DT_DEBUG_SQL_PLAN);
         else if(!strcmp(argv[k + 1], "cache"))
           darktable.unmuted |= DT_DEBUG_CACHE; // enable debugging for lib/film/cache module
         else if(!strcmp(argv[k + 1], "control"))
@@ -656,6 +716,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
           darktable.unmuted |= DT_DEBUG_OPENCL; // gpu accel via opencl
         else if(!strcmp(argv[k + 1], "sql"))
           darktable.unmuted |= DT_DEBUG_SQL; // SQLite3 queries
+        else if(!strcmp(argv[k + 1], "sqlplan"))
+          darktable.unmuted |= DT_DEBUG_SQL_PLAN; // SQLite3 query plans and timings
         else if(!strcmp(argv[k + 1], "memory"))
           darktable.unmuted |= DT_DEBUG_MEMORY; // some stats on mem usage now and then.
         else if(!strcmp(argv[k + 1], "lighttable"))
@@ -708,6 +770,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
           darktable.unmuted_signal_dbg_acts |= DT_DEBUG_SIGNAL_ACT_CONNECT; // enable debugging for signal connection
         else if(!strcmp(argv[k + 1], "disconnect"))
           darktable.unmuted_signal_dbg_acts |= DT_DEBUG_SIGNAL_ACT_DISCONNECT; // enable debugging for signal disconnection
+        else if(!strcmp(argv[k + 1], "profile"))
+          darktable.unmuted_signal_dbg_acts |= DT_DEBUG_SIGNAL_ACT_PROFILE; // time the handlers of each signal
         else if(!strcmp(argv[k + 1], "print-trace"))
         {
 #ifdef DT_HAVE_SIGNAL_TRACE
@@ -864,6 +928,9 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     }
   }
 
+  // pipeline trace events, recorded for the whole session
+  if(trace_from_command) dt_trace_init(trace_from_command);
+
   // get valid directories
   dt_loc_init(datadir_from_command, moduledir_from_command, localedir_from_command, configdir_from_command, cachedir_from_command, tmpdir_from_command, kerneldir_from_command);
 
@@ -962,6 +1029,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.l10n = dt_l10n_init(init_gui);
 
   dt_confgen_init();
+  dt_numa_init();
+  dt_memgov_init();
   const int last_configure_version = dt_conf_get_int("performance_configuration_version_completed");
 
   // we need this REALLY early so that error messages can be shown, however after gtk_disable_setlocale
@@ -1042,15 +1111,6 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   // Initialize the signal system
   darktable.signals = dt_control_signal_init();
 
-  // Make sure that the database and xmp files are in sync
-  // We need conf and db to be up and running for that which is the case here.
-  // FIXME: is this also useful in non-gui mode?
-  GList *changed_xmp_files = NULL;
-  if(init_gui && dt_conf_get_bool("run_crawler_on_start"))
-  {
-    changed_xmp_files = dt_control_crawler_run();
-  }
-
   if(init_gui)
   {
     dt_control_init(darktable.control);
@@ -1150,15 +1210,42 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.points = (dt_points_t *)calloc(1, sizeof(dt_points_t));
   dt_points_init(darktable.points, darktable.num_openmp_threads);
 
-  darktable.noiseprofile_parser = dt_noiseprofile_init(noiseprofiles_from_command);
+  darktable.noiseprofiles = dt_noiseprofile_init(noiseprofiles_from_command);
 
   // must come before mipmap_cache, because that one will need to access
   // image dimensions stored in here:
   darktable.image_cache = (dt_image_cache_t *)calloc(1, sizeof(dt_image_cache_t));
   dt_image_cache_init(darktable.image_cache);
+  dt_image_sidecar_writer_init();
 
   darktable.mipmap_cache = (dt_mipmap_cache_t *)calloc(1, sizeof(dt_mipmap_cache_t));
   dt_mipmap_cache_init(darktable.mipmap_cache);
+  dt_memgov_register("thumbnail cache", darktable.mipmap_cache->mip_thumbs.cache.cost_quota,
+                     _memgov_apply_thumbnails, &darktable.mipmap_cache->mip_thumbs.cache);
+
+  // shared by all pixelpipes, must come before any pipe init
+  dt_dev_pixelpipe_stats_init();
+  darktable.pixelpipe_cache = (dt_dev_pixelpipe_cache_t *)calloc(1, sizeof(dt_dev_pixelpipe_cache_t));
+  dt_dev_pixelpipe_cache_init(darktable.pixelpipe_cache, _get_pixelpipe_cache_size());
+  dt_memgov_register("pixelpipe cache", darktable.pixelpipe_cache->max_memory, _memgov_apply_pixelpipe,
+                     darktable.pixelpipe_cache);
+  darktable.pixelpipe_cache->max_gpu_memory
+      = (size_t)MAX(dt_conf_get_int("pixelpipe_cache_gpu_memory"), 0) * 1024lu * 1024lu;
+  if(dt_conf_get_bool("pixelpipe_disk_cache"))
+  {
+    dt_dev_pixelpipe_disk_cache_t *disk = (dt_dev_pixelpipe_disk_cache_t *)calloc(1, sizeof(dt_dev_pixelpipe_disk_cache_t));
+    const size_t disk_size = (size_t)MAX(dt_conf_get_int("pixelpipe_disk_cache_size"), 0) * 1024lu * 1024lu;
+    if(disk && dt_dev_pixelpipe_disk_cache_init(disk, disk_size))
+      darktable.pixelpipe_cache->disk = disk;
+    else if(disk)
+    {
+      dt_dev_pixelpipe_disk_cache_cleanup(disk);
+      free(disk);
+    }
+  }
+
+  darktable.masks_cache
+      = dt_masks_cache_new((size_t)MAX(dt_conf_get_int("masks_cache_memory"), 0) * 1024lu * 1024lu);
 
   // The GUI must be initialized before the views, because the init()
   // functions of the views depend on darktable.control->accels_* to register
@@ -1298,11 +1385,12 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   }
   free(config_info);
 
-  // last but not least construct the popup that asks the user about images whose xmp files are newer than the
-  // db entry
-  if(init_gui && changed_xmp_files)
+  // last but not least make sure that the database and xmp files are in sync. the crawler runs in the background
+  // and pops up the images whose xmp files are newer than the db entry when it's done.
+  // FIXME: is this also useful in non-gui mode?
+  if(init_gui && dt_conf_get_bool("run_crawler_on_start"))
   {
-    dt_control_crawler_show_image_list(changed_xmp_files);
+    dt_control_crawler_run_job();
   }
 
   if(init_gui)
@@ -1417,6 +1505,11 @@ void dt_cleanup()
     free(darktable.gui);
   }
 
+  // stop resizing the caches before they go
+  dt_memgov_cleanup();
+
+  // the sidecars are written from the image cache
+  dt_image_sidecar_writer_cleanup();
   dt_image_cache_cleanup(darktable.image_cache);
   free(darktable.image_cache);
   dt_mipmap_cache_cleanup(darktable.mipmap_cache);
@@ -1427,7 +1520,21 @@ void dt_cleanup()
     free(darktable.control);
     dt_undo_cleanup(darktable.undo);
   }
+  // after the control: pending disk writes reference both caches until their jobs are disposed
+  if(darktable.pixelpipe_cache->disk)
+  {
+    dt_dev_pixelpipe_disk_cache_cleanup(darktable.pixelpipe_cache->disk);
+    free(darktable.pixelpipe_cache->disk);
+  }
+  dt_dev_pixelpipe_cache_cleanup(darktable.pixelpipe_cache);
+  free(darktable.pixelpipe_cache);
+  darktable.pixelpipe_cache = NULL;
+  dt_dev_pixelpipe_stats_cleanup();
+  CurveDataSampleCacheCleanup();
+  dt_masks_cache_free(darktable.masks_cache);
+  darktable.masks_cache = NULL;
   dt_colorspaces_cleanup(darktable.color_profiles);
+  dt_opencl_perf_save();
   dt_conf_cleanup(darktable.conf);
   free(darktable.conf);
   dt_points_cleanup(darktable.points);
@@ -1483,13 +1590,12 @@ void dt_cleanup()
     dt_bauhaus_cleanup(darktable.bauhaus);
   }
 
-  if (darktable.noiseprofile_parser)
-  {
-    g_object_unref(darktable.noiseprofile_parser);
-    darktable.noiseprofile_parser = NULL;
-  }
+  dt_noiseprofile_cleanup(darktable.noiseprofiles);
+  darktable.noiseprofiles = NULL;
 
   dt_capabilities_cleanup();
+  dt_trace_cleanup();
+  dt_memstat_cleanup();
 
   dt_pthread_mutex_destroy(&(darktable.plugin_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.capabilities_threadsafe));
@@ -1591,7 +1697,7 @@ size_t dt_get_available_mem()
     return res->refresource[4*(-level-1)] * 1024lu * 1024lu;
 
   const int fraction = res->fractions[darktable.dtresources.group];
-  return MAX(512lu * 1024lu * 1024lu, total_mem / 1024lu * fraction);
+  return MAX(512lu * 1024lu * 1024lu, dt_memgov_budget(total_mem / 1024lu * fraction));
 }
 
 size_t dt_get_singlebuffer_mem()
@@ -41,6 +41,7 @@
 #endif
 #include "common/database.h"
 #include "common/dtpthread.h"
+#include "common/threadbudget.h"
 #include "common/utility.h"
 #ifdef _WIN32
 #include "win/getrusage.h"
@@ -226,12 +227,18 @@ static inline int dt_get_thread_num()
 #endif
 }
 
+/* team size for the num_threads() clauses: the share of the calling pipe in the thread budget,
+ * never more than darktable.num_openmp_threads, see common/threadbudget.h */
+#define dt_omp_threads() dt_thread_budget_threads()
+
 /* Create cloned functions for various CPU SSE generations */
 /* See for instructions https://hannes.hauswedell.net/post/2017/12/09/fmv/ */
 /* TL;DR : use only on SIMD functions containing low-level paralellized/vectorized loops */
 #if __has_attribute(target_clones) && !defined(_WIN32) && !defined(__APPLE__) && !defined(NATIVE_ARCH)
   # if defined(__amd64__) || defined(__amd64) || defined(__x86_64__) || defined(__x86_64)
     #define __DT_CLONE_TARGETS__ __attribute__((target_clones("default", "sse2", "sse3", "sse4.1", "sse4.2", "popcnt", "avx", "avx2", "avx512f", "fma4")))
+    /* the clones include AVX2 and AVX-512 builds, see dt_codepath_t.AVX2 */
+    #define DT_HAVE_AVX2_CLONES
   # elif defined(__PPC64__)
     /* __PPC64__ is the only macro tested for in is_supported_platform.h, other macros would fail there anyway. */
     #define __DT_CLONE_TARGETS__ __attribute__((target_clones("default","cpu=power9")))
@@ -281,9 +288,9 @@ static inline size_t dt_round_size_sse(const size_t size)
   return dt_round_size(size, 64);
 }
 
-static inline void *dt_alloc_align(size_t size)
+// alignment must be a power of 2, at least sizeof(void *). Free with dt_free_align().
+static inline void *dt_alloc_aligned(size_t size, const size_t alignment)
 {
-  const size_t alignment = DT_CACHELINE_BYTES;
   const size_t aligned_size = dt_round_size(size, alignment);
 #if defined(__FreeBSD_version) && __FreeBSD_version < 700013
   return malloc(aligned_size);
@@ -304,6 +311,11 @@ static inline void *dt_alloc_align(size_t size)
 #endif
 }
 
+static inline void *dt_alloc_align(size_t size)
+{
+  return dt_alloc_aligned(size, DT_CACHELINE_BYTES);
+}
+
 
 #ifdef _WIN32
   static inline void dt_free_align(void *mem)
@@ -464,6 +476,7 @@ typedef enum dt_debug_thread_t
   DT_DEBUG_CACHE          = 1 <<  0,
   DT_DEBUG_CONTROL        = 1 <<  1,
   DT_DEBUG_DEV            = 1 <<  2,
+  DT_DEBUG_SQL_PLAN       = 1 <<  3,
   DT_DEBUG_PERF           = 1 <<  4,
   DT_DEBUG_CAMCTL         = 1 <<  5,
   DT_DEBUG_PWSTORAGE      = 1 <<  6,
@@ -494,6 +507,7 @@ typedef struct dt_codepath_t
 {
   unsigned int SSE2 : 1;
   unsigned int _no_intrinsics : 1;
+  unsigned int AVX2 : 1; // prefer the __DT_CLONE_TARGETS__ plain kernels over the SSE2 intrinsics
   unsigned int OPENMP_SIMD : 1; // always stays the last one
 } dt_codepath_t;
 
@@ -518,7 +532,7 @@ typedef struct darktable_t
   GList *iop_order_list;
   GList *iop_order_rules;
   GList *capabilities;
-  JsonParser *noiseprofile_parser;
+  struct dt_noiseprofile_db_t *noiseprofiles;
   struct dt_conf_t *conf;
   struct dt_develop_t *develop;
   struct dt_lib_t *lib;
@@ -528,6 +542,9 @@ typedef struct darktable_t
   struct dt_gui_gtk_t *gui;
   struct dt_mipmap_cache_t *mipmap_cache;
   struct dt_image_cache_t *image_cache;
+  struct dt_dev_pixelpipe_cache_t *pixelpipe_cache;
+  struct dt_masks_cache_t *masks_cache;
+  struct dt_trace_t *trace;
   struct dt_bauhaus_t *bauhaus;
   const struct dt_database_t *db;
   const struct dt_pwstorage_t *pwstorage;
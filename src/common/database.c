@@ -49,11 +49,9 @@
 
 // whenever _create_*_schema() gets changed you HAVE to bump this version and add an update path to
 // _upgrade_*_schema_step()!
-#define CURRENT_DATABASE_VERSION_LIBRARY 36
+#define CURRENT_DATABASE_VERSION_LIBRARY 38
 #define CURRENT_DATABASE_VERSION_DATA     9
 
-// #define USE_NESTED_TRANSACTIONS
-#define MAX_NESTED_TRANSACTIONS 0
 /* transaction id */
 static dt_atomic_int _trxid;
 
@@ -72,8 +70,47 @@ typedef struct dt_database_t
 
   gchar *error_message, *error_dbfilename;
   int error_other_pid;
+
+  /* prepared statements which are not in use, keyed by their sql text */
+  GHashTable *statements;
+  dt_pthread_mutex_t statements_lock;
+
+  /* WAL mode: one writer thread with its own connection, and idle read-only connections */
+  gboolean wal;
+  sqlite3 *writer;
+  pthread_t writer_thread;
+  gboolean writer_running;
+  GAsyncQueue *writes;
+  int pending_writes;
+  dt_pthread_mutex_t writes_lock;
+  pthread_cond_t writes_done;
+  GQueue *readers;
+  dt_pthread_mutex_t readers_lock;
 } dt_database_t;
 
+// statements kept by dt_database_release_statement(), more are finalized
+#define DT_DATABASE_MAX_STATEMENTS 256
+// idle read connections kept by dt_database_release_reader(), more are closed
+#define DT_DATABASE_MAX_READERS 4
+// writes committed in one transaction by the writer thread
+#define DT_DATABASE_MAX_BATCH 256
+// how long the writer waits for more writes before it commits, in microseconds
+#define DT_DATABASE_BATCH_WAIT 2000
+// how long a connection retries when another one holds the write lock, in milliseconds
+#define DT_DATABASE_BUSY_TIMEOUT 10000
+
+typedef struct _database_write_t
+{
+  dt_database_write_callback_t callback;
+  gpointer data;
+  GDestroyNotify destroy;
+} _database_write_t;
+
+static inline gboolean _is_mem_db(const struct dt_database_t *db)
+{
+  return !g_strcmp0(db->dbfilename_data, ":memory:") || !g_strcmp0(db->dbfilename_library, ":memory:");
+}
+
 
 /* migrates database from old place to new */
 static void _database_migrate_to_xdg_structure();
@@ -443,6 +480,64 @@ end:
 // redefine this where needed
 #define FINALIZE
 
+// number of images per film roll and per tag, kept up to date by triggers so the collect module
+// doesn't need to count them over the whole library. Rows may drop to 0, they are not removed.
+// clang-format off
+static const char *const _count_tables_schema[] = {
+  "CREATE TABLE main.film_counts (film_id INTEGER PRIMARY KEY, count INTEGER NOT NULL DEFAULT 0)",
+  "CREATE TABLE main.tag_counts (tagid INTEGER PRIMARY KEY, count INTEGER NOT NULL DEFAULT 0)",
+  "INSERT INTO main.film_counts (film_id, count) SELECT film_id, COUNT(*) FROM main.images GROUP BY film_id",
+  "INSERT INTO main.tag_counts (tagid, count) SELECT tagid, COUNT(*) FROM main.tagged_images GROUP BY tagid",
+  "CREATE TRIGGER main.film_counts_insert AFTER INSERT ON images"
+  " BEGIN"
+  "   INSERT OR IGNORE INTO film_counts (film_id) VALUES (new.film_id);"
+  "   UPDATE film_counts SET count = count + 1 WHERE film_id = new.film_id;"
+  " END",
+  "CREATE TRIGGER main.film_counts_delete AFTER DELETE ON images"
+  " BEGIN"
+  "   UPDATE film_counts SET count = count - 1 WHERE film_id = old.film_id;"
+  " END",
+  "CREATE TRIGGER main.film_counts_update AFTER UPDATE OF film_id ON images"
+  " WHEN old.film_id IS NOT new.film_id"
+  " BEGIN"
+  "   UPDATE film_counts SET count = count - 1 WHERE film_id = old.film_id;"
+  "   INSERT OR IGNORE INTO film_counts (film_id) VALUES (new.film_id);"
+  "   UPDATE film_counts SET count = count + 1 WHERE film_id = new.film_id;"
+  " END",
+  "CREATE TRIGGER main.tag_counts_insert AFTER INSERT ON tagged_images"
+  " BEGIN"
+  "   INSERT OR IGNORE INTO tag_counts (tagid) VALUES (new.tagid);"
+  "   UPDATE tag_counts SET count = count + 1 WHERE tagid = new.tagid;"
+  " END",
+  "CREATE TRIGGER main.tag_counts_delete AFTER DELETE ON tagged_images"
+  " BEGIN"
+  "   UPDATE tag_counts SET count = count - 1 WHERE tagid = old.tagid;"
+  " END",
+  "CREATE TRIGGER main.tag_counts_update AFTER UPDATE OF tagid ON tagged_images"
+  " WHEN old.tagid IS NOT new.tagid"
+  " BEGIN"
+  "   UPDATE tag_counts SET count = count - 1 WHERE tagid = old.tagid;"
+  "   INSERT OR IGNORE INTO tag_counts (tagid) VALUES (new.tagid);"
+  "   UPDATE tag_counts SET count = count + 1 WHERE tagid = new.tagid;"
+  " END",
+  NULL
+};
+// clang-format on
+
+static gboolean _create_count_tables(dt_database_t *db)
+{
+  for(int k = 0; _count_tables_schema[k]; k++)
+  {
+    if(sqlite3_exec(db->handle, _count_tables_schema[k], NULL, NULL, NULL) != SQLITE_OK)
+    {
+      fprintf(stderr, "[init] can't create the image count tables\n");
+      fprintf(stderr, "[init]   %s\n", sqlite3_errmsg(db->handle));
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
 /* do the real migration steps, returns the version the db was converted to */
 static int _upgrade_library_schema_step(dt_database_t *db, int version)
 {
@@ -2150,6 +2245,40 @@ static int _upgrade_library_schema_step(dt_database_t *db, int version)
     TRY_EXEC("DROP TABLE `images_new`", "[init] can't drop temp images table\n");
     new_version = 36;
   }
+  else if(version == 36)
+  {
+    sqlite3_exec(db->handle, "BEGIN TRANSACTION", NULL, NULL, NULL);
+
+    // covering indexes for the filters of the collection queries. The NOCASE index on datetime_taken
+    // can't serve the integer comparisons of the date filters.
+    TRY_EXEC("CREATE INDEX IF NOT EXISTS main.images_datetime_taken_index ON images (datetime_taken)",
+             "[init] can't create images_datetime_taken_index\n");
+    TRY_EXEC("CREATE INDEX IF NOT EXISTS main.tagged_images_tagid_imgid_index"
+             " ON tagged_images (tagid, imgid, position)",
+             "[init] can't create tagged_images_tagid_imgid_index\n");
+    TRY_EXEC("DROP INDEX IF EXISTS main.tagged_images_tagid_index",
+             "[init] can't drop tagged_images_tagid_index\n");
+    TRY_EXEC("CREATE INDEX IF NOT EXISTS main.color_labels_color_index ON color_labels (color, imgid)",
+             "[init] can't create color_labels_color_index\n");
+    TRY_EXEC("CREATE INDEX IF NOT EXISTS main.metadata_key_value_index ON meta_data (key, value, id)",
+             "[init] can't create metadata_key_value_index\n");
+    TRY_EXEC("DROP INDEX IF EXISTS main.metadata_index_key",
+             "[init] can't drop metadata_index_key\n");
+
+    sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
+    new_version = 37;
+  }
+  else if(version == 37)
+  {
+    sqlite3_exec(db->handle, "BEGIN TRANSACTION", NULL, NULL, NULL);
+    if(!_create_count_tables(db))
+    {
+      sqlite3_exec(db->handle, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+      return version;
+    }
+    sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
+    new_version = 38;
+  }
   else
     new_version = version; // should be the fallback so that calling code sees that we are in an infinite loop
 
@@ -2491,7 +2620,8 @@ static void _create_library_schema(dt_database_t *db)
   sqlite3_exec(db->handle, "CREATE TABLE main.tagged_images (imgid INTEGER, tagid INTEGER, position INTEGER, "
                            "PRIMARY KEY (imgid, tagid),"
                            "FOREIGN KEY(imgid) REFERENCES images(id) ON UPDATE CASCADE ON DELETE CASCADE)", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.tagged_images_tagid_imgid_index ON tagged_images (tagid, imgid, position)",
+               NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.tagged_images_position_index ON tagged_images (position)", NULL, NULL, NULL);
   ////////////////////////////// color_labels
   sqlite3_exec(db->handle, "CREATE TABLE main.color_labels (imgid INTEGER, color INTEGER)", NULL, NULL, NULL);
@@ -2501,7 +2631,8 @@ static void _create_library_schema(dt_database_t *db)
   sqlite3_exec(db->handle, "CREATE TABLE main.meta_data (id INTEGER, key INTEGER, value VARCHAR)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE UNIQUE INDEX main.metadata_index ON meta_data (id, key, value)", NULL, NULL, NULL);
 
-  sqlite3_exec(db->handle, "CREATE INDEX main.metadata_index_key ON meta_data (key)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.metadata_key_value_index ON meta_data (key, value, id)", NULL, NULL,
+               NULL);
   sqlite3_exec(db->handle, "CREATE TABLE main.module_order (imgid INTEGER PRIMARY KEY, version INTEGER, iop_list VARCHAR)",
                NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE main.history_hash (imgid INTEGER PRIMARY KEY, "
@@ -2512,8 +2643,14 @@ static void _create_library_schema(dt_database_t *db)
   // v34
   sqlite3_exec(db->handle, "CREATE INDEX main.images_datetime_taken_nc ON images (datetime_taken COLLATE NOCASE)",
                NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "CREATE INDEX main.metadata_index_key ON meta_data (key)", NULL, NULL, NULL);
+
+  // v37, images_datetime_taken_nc above is already a plain index on datetime_taken here
+  sqlite3_exec(db->handle, "CREATE INDEX main.color_labels_color_index ON color_labels (color, imgid)", NULL, NULL,
+               NULL);
   // clang-format on
+
+  // v38
+  _create_count_tables(db);
 }
 
 /* create the current database schema and set the version in db_info accordingly */
@@ -2589,7 +2726,15 @@ static void _create_memory_schema(dt_database_t *db)
                            "count INTEGER DEFAULT 0, count2 INTEGER DEFAULT 0)",
                NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.similar_tags (tagid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE TABLE memory.tag_images (rowid INTEGER PRIMARY KEY, imgid INTEGER UNIQUE)",
+               NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.darktable_tags (tagid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE TABLE memory.removed_images (imgid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE TABLE memory.compress_images (imgid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle,
+               "CREATE TABLE memory.compress_nums (imgid INTEGER, num INTEGER, new_num INTEGER,"
+               " PRIMARY KEY (imgid, num))",
+               NULL, NULL, NULL);
   sqlite3_exec(
       db->handle,
       "CREATE TABLE memory.history (imgid INTEGER, num INTEGER, module INTEGER, "
@@ -3043,6 +3188,252 @@ gchar* _get_pragma_string_val(sqlite3 *db, const char* pragma)
   return val;
 }
 
+static int _database_profile_callback(unsigned int type, void *data, void *p, void *x)
+{
+  if(type != SQLITE_TRACE_PROFILE) return 0;
+  sqlite3_stmt *stmt = (sqlite3_stmt *)p;
+  // ours, see dt_database_explain_query()
+  if(g_str_has_prefix(sqlite3_sql(stmt), "EXPLAIN QUERY PLAN")) return 0;
+  const sqlite3_int64 nanoseconds = *(const sqlite3_int64 *)x;
+  char *sql = sqlite3_expanded_sql(stmt);
+  dt_print(DT_DEBUG_SQL_PLAN, "[sql plan] %.3f ms: \"%s\"\n", nanoseconds * 1e-6, sql ? sql : sqlite3_sql(stmt));
+  sqlite3_free(sql);
+  return 0;
+}
+
+// another connection on library and data, for the writer thread and the readers of WAL mode.
+// it doesn't have the memory schema: reads and writes through it can't use the memory tables.
+static sqlite3 *_database_open_connection(const dt_database_t *db, const gboolean readonly)
+{
+  sqlite3 *handle = NULL;
+  const int flags = readonly ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE;
+  if(sqlite3_open_v2(db->dbfilename_library, &handle, flags, NULL) != SQLITE_OK)
+  {
+    fprintf(stderr, "[sql] can't open another connection on `%s': %s\n", db->dbfilename_library,
+            sqlite3_errmsg(handle));
+    sqlite3_close(handle);
+    return NULL;
+  }
+  if(darktable.unmuted & DT_DEBUG_SQL_PLAN)
+    sqlite3_trace_v2(handle, SQLITE_TRACE_PROFILE, _database_profile_callback, NULL);
+  sqlite3_busy_timeout(handle, DT_DATABASE_BUSY_TIMEOUT);
+
+  sqlite3_stmt *stmt;
+  int rc = sqlite3_prepare_v2(handle, "ATTACH DATABASE ?1 AS data", -1, &stmt, NULL);
+  sqlite3_bind_text(stmt, 1, db->dbfilename_data, -1, SQLITE_TRANSIENT);
+  if(rc != SQLITE_OK || sqlite3_step(stmt) != SQLITE_DONE)
+  {
+    fprintf(stderr, "[sql] can't attach `%s' to another connection: %s\n", db->dbfilename_data,
+            sqlite3_errmsg(handle));
+    sqlite3_finalize(stmt);
+    sqlite3_close(handle);
+    return NULL;
+  }
+  sqlite3_finalize(stmt);
+
+  if(!readonly)
+  {
+    sqlite3_exec(handle, "PRAGMA main.synchronous = NORMAL", NULL, NULL, NULL);
+    sqlite3_exec(handle, "PRAGMA data.synchronous = NORMAL", NULL, NULL, NULL);
+    sqlite3_exec(handle, "PRAGMA foreign_keys = ON", NULL, NULL, NULL);
+  }
+  return handle;
+}
+
+static void _database_write_run(_database_write_t *write, sqlite3 *handle)
+{
+  write->callback(handle, write->data);
+  if(write->destroy) write->destroy(write->data);
+  g_free(write);
+}
+
+// commits the queued writes in batches, until it pops a write without callback
+static void *_database_writer(void *data)
+{
+  dt_database_t *db = (dt_database_t *)data;
+  dt_pthread_setname("db_writer");
+
+  gboolean stop = FALSE;
+  while(!stop)
+  {
+    _database_write_t *write = g_async_queue_pop(db->writes);
+    if(!write->callback)
+    {
+      g_free(write);
+      break;
+    }
+
+    // one transaction for everything that comes in quick succession
+    sqlite3_exec(db->writer, "BEGIN TRANSACTION", NULL, NULL, NULL);
+    int count = 0;
+    while(write)
+    {
+      if(!write->callback)
+      {
+        g_free(write);
+        stop = TRUE;
+        break;
+      }
+      _database_write_run(write, db->writer);
+      count++;
+      write = count < DT_DATABASE_MAX_BATCH ? g_async_queue_timeout_pop(db->writes, DT_DATABASE_BATCH_WAIT) : NULL;
+    }
+    if(sqlite3_exec(db->writer, "COMMIT TRANSACTION", NULL, NULL, NULL) != SQLITE_OK)
+    {
+      fprintf(stderr, "[sql] the writer couldn't commit %d writes: %s\n", count, sqlite3_errmsg(db->writer));
+      sqlite3_exec(db->writer, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+    }
+    dt_print(DT_DEBUG_SQL, "[sql] the writer committed %d writes\n", count);
+
+    dt_pthread_mutex_lock(&db->writes_lock);
+    db->pending_writes -= count;
+    if(db->pending_writes == 0) pthread_cond_broadcast(&db->writes_done);
+    dt_pthread_mutex_unlock(&db->writes_lock);
+  }
+  return NULL;
+}
+
+static void _database_start_writer(dt_database_t *db)
+{
+  db->writer = _database_open_connection(db, FALSE);
+  if(!db->writer) return;
+
+  db->writes = g_async_queue_new();
+  db->readers = g_queue_new();
+  if(dt_pthread_create(&db->writer_thread, _database_writer, db))
+  {
+    fprintf(stderr, "[sql] can't start the writer thread, writing through the main connection\n");
+    sqlite3_close(db->writer);
+    db->writer = NULL;
+    return;
+  }
+  db->writer_running = TRUE;
+}
+
+// commits what is queued, joins the writer thread and closes the other connections
+static void _database_stop_writer(const dt_database_t *db)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  if(d->writer_running)
+  {
+    dt_pthread_mutex_lock(&d->writes_lock);
+    d->pending_writes++;
+    dt_pthread_mutex_unlock(&d->writes_lock);
+    g_async_queue_push(d->writes, g_malloc0(sizeof(_database_write_t)));
+    pthread_join(d->writer_thread, NULL);
+    d->writer_running = FALSE;
+    d->pending_writes = 0;
+    g_async_queue_unref(d->writes);
+    d->writes = NULL;
+    sqlite3_close(d->writer);
+    d->writer = NULL;
+  }
+
+  if(d->readers)
+  {
+    dt_pthread_mutex_lock(&d->readers_lock);
+    for(sqlite3 *handle = g_queue_pop_head(d->readers); handle; handle = g_queue_pop_head(d->readers))
+      sqlite3_close(handle);
+    g_queue_free(d->readers);
+    d->readers = NULL;
+    dt_pthread_mutex_unlock(&d->readers_lock);
+  }
+}
+
+void dt_database_write_async(const dt_database_t *db, dt_database_write_callback_t callback, gpointer data,
+                             GDestroyNotify destroy)
+{
+  _database_write_t *write = g_malloc(sizeof(_database_write_t));
+  write->callback = callback;
+  write->data = data;
+  write->destroy = destroy;
+
+  dt_database_t *d = (dt_database_t *)db;
+  if(!d->writer_running)
+  {
+    _database_write_run(write, d->handle);
+    return;
+  }
+
+  dt_pthread_mutex_lock(&d->writes_lock);
+  d->pending_writes++;
+  dt_pthread_mutex_unlock(&d->writes_lock);
+  g_async_queue_push(d->writes, write);
+}
+
+void dt_database_flush_writes(const dt_database_t *db)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  if(!d || !d->writer_running || pthread_equal(pthread_self(), d->writer_thread)) return;
+
+  dt_pthread_mutex_lock(&d->writes_lock);
+  while(d->pending_writes > 0) dt_pthread_cond_wait(&d->writes_done, &d->writes_lock);
+  dt_pthread_mutex_unlock(&d->writes_lock);
+}
+
+sqlite3 *dt_database_get_reader(const dt_database_t *db)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  // a reader wouldn't see what's not committed yet on the main connection
+  if(!d->readers || dt_atomic_get_int(&_trxid) > 0) return d->handle;
+
+  dt_pthread_mutex_lock(&d->readers_lock);
+  sqlite3 *handle = g_queue_pop_head(d->readers);
+  dt_pthread_mutex_unlock(&d->readers_lock);
+
+  if(!handle) handle = _database_open_connection(d, TRUE);
+  return handle ? handle : d->handle;
+}
+
+void dt_database_release_reader(const dt_database_t *db, sqlite3 *handle)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  if(!handle || handle == d->handle) return;
+
+  dt_pthread_mutex_lock(&d->readers_lock);
+  if(d->readers && g_queue_get_length(d->readers) < DT_DATABASE_MAX_READERS)
+  {
+    g_queue_push_head(d->readers, handle);
+    handle = NULL;
+  }
+  dt_pthread_mutex_unlock(&d->readers_lock);
+
+  if(handle) sqlite3_close(handle);
+}
+
+void dt_database_explain_query(struct sqlite3 *handle, const char *query, const char *file, const int line,
+                               const char *function)
+{
+  // not through DT_DEBUG_SQLITE3_PREPARE_V2, that would explain the explanation
+  gchar *explain = g_strdup_printf("EXPLAIN QUERY PLAN %s", query);
+  sqlite3_stmt *stmt = NULL;
+  if(sqlite3_prepare_v2(handle, explain, -1, &stmt, NULL) == SQLITE_OK)
+  {
+    dt_print(DT_DEBUG_SQL_PLAN, "[sql plan] %s:%d, function %s(): \"%s\"\n", file, line, function, query);
+
+    // rows come parents first, indent them by depth
+    int ids[64], depths[64];
+    int count = 0;
+    while(sqlite3_step(stmt) == SQLITE_ROW)
+    {
+      const int id = sqlite3_column_int(stmt, 0);
+      const int parent = sqlite3_column_int(stmt, 1);
+      int depth = 0;
+      for(int k = 0; k < count; k++)
+        if(ids[k] == parent) depth = depths[k] + 1;
+      if(count < 64)
+      {
+        ids[count] = id;
+        depths[count] = depth;
+        count++;
+      }
+      dt_print(DT_DEBUG_SQL_PLAN, "[sql plan]   %*s%s\n", 2 * depth, "", (const char *)sqlite3_column_text(stmt, 3));
+    }
+  }
+  sqlite3_finalize(stmt);
+  g_free(explain);
+}
+
 dt_database_t *dt_database_init(const char *alternative, const gboolean load_data, const gboolean has_gui)
 {
   /*  set the threading mode to Serialized */
@@ -3097,6 +3488,10 @@ start:
 
   /* create database */
   dt_database_t *db = (dt_database_t *)g_malloc0(sizeof(dt_database_t));
+  dt_pthread_mutex_init(&db->statements_lock, NULL);
+  dt_pthread_mutex_init(&db->writes_lock, NULL);
+  pthread_cond_init(&db->writes_done, NULL);
+  dt_pthread_mutex_init(&db->readers_lock, NULL);
   db->dbfilename_data = g_strdup(dbfilename_data);
   db->dbfilename_library = g_strdup(dbfilename_library);
 
@@ -3154,6 +3549,10 @@ start:
     return NULL;
   }
 
+  // log the run time of every statement
+  if(darktable.unmuted & DT_DEBUG_SQL_PLAN)
+    sqlite3_trace_v2(db->handle, SQLITE_TRACE_PROFILE, _database_profile_callback, NULL);
+
   /* attach a memory database to db connection for use with temporary tables
      used during instance life time, which is discarded on exit.
   */
@@ -3175,9 +3574,21 @@ start:
   sqlite3_finalize(stmt);
 
   // some sqlite3 config
-  sqlite3_exec(db->handle, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "PRAGMA page_size = 32768", NULL, NULL, NULL);
+  db->wal = dt_conf_get_bool("database/wal") && !_is_mem_db(db);
+  if(db->wal)
+  {
+    // durable on application crashes, and readers don't wait for the writer
+    sqlite3_exec(db->handle, "PRAGMA journal_mode = WAL", NULL, NULL, NULL);
+    sqlite3_exec(db->handle, "PRAGMA main.synchronous = NORMAL", NULL, NULL, NULL);
+    sqlite3_exec(db->handle, "PRAGMA data.synchronous = NORMAL", NULL, NULL, NULL);
+    sqlite3_busy_timeout(db->handle, DT_DATABASE_BUSY_TIMEOUT);
+  }
+  else
+  {
+    sqlite3_exec(db->handle, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
+    sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
+  }
 
   // WARNING: the foreign_keys pragma must not be used, the integrity of the
   // database rely on it.
@@ -3611,14 +4022,73 @@ start:
   }
 #endif
 
+  if(db->wal) _database_start_writer(db);
+
 error:
   g_free(dbname);
 
   return db;
 }
 
+sqlite3_stmt *dt_database_get_statement(const dt_database_t *db, const char *query)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  sqlite3_stmt *stmt = NULL;
+
+  dt_pthread_mutex_lock(&d->statements_lock);
+  if(d->statements)
+  {
+    stmt = g_hash_table_lookup(d->statements, query);
+    if(stmt) g_hash_table_remove(d->statements, query);
+  }
+  dt_pthread_mutex_unlock(&d->statements_lock);
+
+  if(!stmt) DT_DEBUG_SQLITE3_PREPARE_V2(d->handle, query, -1, &stmt, NULL);
+  return stmt;
+}
+
+void dt_database_release_statement(const dt_database_t *db, sqlite3_stmt *stmt)
+{
+  if(!stmt) return;
+  dt_database_t *d = (dt_database_t *)db;
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+
+  // the statement owns its sql text, which makes the key
+  const char *sql = sqlite3_sql(stmt);
+  dt_pthread_mutex_lock(&d->statements_lock);
+  if(!d->statements) d->statements = g_hash_table_new(g_str_hash, g_str_equal);
+  // another thread may have given back the same query in the meantime
+  if(g_hash_table_size(d->statements) < DT_DATABASE_MAX_STATEMENTS && !g_hash_table_contains(d->statements, sql))
+  {
+    g_hash_table_insert(d->statements, (gpointer)sql, stmt);
+    stmt = NULL;
+  }
+  dt_pthread_mutex_unlock(&d->statements_lock);
+
+  if(stmt) sqlite3_finalize(stmt);
+}
+
+static void _database_flush_statements(const dt_database_t *db)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  dt_pthread_mutex_lock(&d->statements_lock);
+  if(d->statements)
+  {
+    GHashTableIter iter;
+    gpointer stmt;
+    g_hash_table_iter_init(&iter, d->statements);
+    while(g_hash_table_iter_next(&iter, NULL, &stmt)) sqlite3_finalize((sqlite3_stmt *)stmt);
+    g_hash_table_destroy(d->statements);
+    d->statements = NULL;
+  }
+  dt_pthread_mutex_unlock(&d->statements_lock);
+}
+
 void dt_database_destroy(const dt_database_t *db)
 {
+  _database_stop_writer(db);
+  _database_flush_statements(db);
   sqlite3_close(db->handle);
   if (db->lockfile_data)
   {
@@ -3632,6 +4102,10 @@ void dt_database_destroy(const dt_database_t *db)
   }
   g_free(db->dbfilename_data);
   g_free(db->dbfilename_library);
+  dt_pthread_mutex_destroy(&((dt_database_t *)db)->statements_lock);
+  dt_pthread_mutex_destroy(&((dt_database_t *)db)->writes_lock);
+  pthread_cond_destroy(&((dt_database_t *)db)->writes_done);
+  dt_pthread_mutex_destroy(&((dt_database_t *)db)->readers_lock);
   g_free((dt_database_t *)db);
 
   sqlite3_shutdown();
@@ -3704,6 +4178,10 @@ gboolean dt_database_get_lock_acquired(const dt_database_t *db)
 
 void dt_database_cleanup_busy_statements(const struct dt_database_t *db)
 {
+  // the cached statements aren't leaks
+  _database_stop_writer(db);
+  _database_flush_statements(db);
+
   sqlite3_stmt *stmt = NULL;
   while( (stmt = sqlite3_next_stmt(db->handle, NULL)) != NULL)
   {
@@ -3817,11 +4295,6 @@ gboolean _ask_for_maintenance(const gboolean has_gui, const gboolean closing_tim
     return shall_perform_maintenance;
 }
 
-static inline gboolean _is_mem_db(const struct dt_database_t *db)
-{
-  return !g_strcmp0(db->dbfilename_data, ":memory:") || !g_strcmp0(db->dbfilename_library, ":memory:");
-}
-
 gboolean dt_database_maybe_maintenance(const struct dt_database_t *db, const gboolean has_gui, const gboolean closing_time)
 {
   if(_is_mem_db(db))
@@ -3901,6 +4374,8 @@ gboolean dt_database_maybe_maintenance(const struct dt_database_t *db, const gbo
 
 void dt_database_optimize(const struct dt_database_t *db)
 {
+  // last writes, and nothing may use the database behind the snapshot
+  _database_stop_writer(db);
   if(_is_mem_db(db))
     return;
   // optimize should in most cases be no-op and have no noticeable downsides
@@ -4604,24 +5079,22 @@ gchar *dt_database_get_most_recent_snap(const char* db_filename)
 
 // Nested transactions support
 //
-// NOTE: the nested support is actually not activated (see || TRUE below). This current
-//       implementation is just a refactoring of the previous code using:
-//          - dt_database_start_transaction()
-//          - dt_database_release_transaction()
-//          - dt_database_rollback_transaction()
-//
-//       With this refactoring we can count and check for nested transaction and unmatched
-//       transaction routines. And it has been done to help further implementation for
-//       proper threading and nested transaction support.
+// Transactions opened by different threads share the connection and are not nested: each
+// start is a BEGIN and each release a COMMIT, as before. A transaction opened while the same
+// thread already holds one is a savepoint of it instead, so that a batch of writes can be
+// grouped around functions which open their own transactions (see dt_styles_apply_to_list()).
+// The global count lets us check for unmatched transaction routines.
 //
+static __thread int _trx_depth = 0;
+
 void dt_database_start_transaction_debug(const struct dt_database_t *db)
 {
-  const int trxid = dt_atomic_add_int(&_trxid, 1);
+  // the writes queued before come first
+  dt_database_flush_writes(db);
 
-  // if top level a simple unamed transaction is used BEGIN / COMMIT / ROLLBACK
-  // otherwise we use a savepoint (named transaction).
+  dt_atomic_add_int(&_trxid, 1);
 
-  if(trxid == 0 || TRUE)
+  if(_trx_depth == 0)
   {
     // In theads application it may be safer to use an IMMEDIATE transaction:
     // "BEGIN IMMEDIATE TRANSACTION"
@@ -4629,59 +5102,55 @@ void dt_database_start_transaction_debug(const struct dt_database_t *db)
     // no write event is dispatched to DB until the first "COMMIT"
     DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), "BEGIN TRANSACTION", NULL, NULL, NULL);
   }
-#ifdef USE_NESTED_TRANSACTIONS
   else
   {
     char SQLTRX[32] = { 0 };
-    g_snprintf(SQLTRX, sizeof(SQLTRX), "SAVEPOINT trx%d", trxid);
+    g_snprintf(SQLTRX, sizeof(SQLTRX), "SAVEPOINT trx%d", _trx_depth);
     DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), SQLTRX, NULL, NULL, NULL);
   }
-#endif
-
-  if(trxid > MAX_NESTED_TRANSACTIONS)
-    fprintf(stderr, "[dt_database_start_transaction] more than %d nested transaction\n", MAX_NESTED_TRANSACTIONS);
+  _trx_depth++;
 }
 
 void dt_database_release_transaction_debug(const struct dt_database_t *db)
 {
   const int trxid = dt_atomic_sub_int(&_trxid, 1);
 
-  if(trxid <= 0)
+  if(trxid <= 0 || _trx_depth <= 0)
     fprintf(stderr, "[dt_database_release_transaction] COMMIT outside a transaction\n");
 
-  if(trxid == 1 || TRUE)
+  _trx_depth = MAX(_trx_depth - 1, 0);
+  if(_trx_depth == 0)
   {
     DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), "COMMIT TRANSACTION", NULL, NULL, NULL);
   }
-#ifdef USE_NESTED_TRANSACTIONS
   else
   {
     char SQLTRX[64] = { 0 };
-    g_snprintf(SQLTRX, sizeof(SQLTRX), "RELEASE SAVEPOINT trx%d", trxid - 1);
+    g_snprintf(SQLTRX, sizeof(SQLTRX), "RELEASE SAVEPOINT trx%d", _trx_depth);
     DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), SQLTRX, NULL, NULL, NULL);
   }
-#endif
 }
 
 void dt_database_rollback_transaction(const struct dt_database_t *db)
 {
   const int trxid = dt_atomic_sub_int(&_trxid, 1);
 
-  if(trxid <= 0)
+  if(trxid <= 0 || _trx_depth <= 0)
     fprintf(stderr, "[dt_database_rollback_transaction] ROLLBACK outside a transaction\n");
 
-  if(trxid == 1 || TRUE)
+  _trx_depth = MAX(_trx_depth - 1, 0);
+  if(_trx_depth == 0)
   {
     DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), "ROLLBACK TRANSACTION", NULL, NULL, NULL);
   }
-#ifdef USE_NESTED_TRANSACTIONS
   else
   {
-    char SQLTRX[64] = { 0 };
-    g_snprintf(SQLTRX, sizeof(SQLTRX), "ROLLBACK TRANSACTION TO SAVEPOINT trx%d", trxid - 1);
+    // undo the savepoint and forget it, the enclosing transaction goes on
+    char SQLTRX[96] = { 0 };
+    g_snprintf(SQLTRX, sizeof(SQLTRX), "ROLLBACK TRANSACTION TO SAVEPOINT trx%d; RELEASE SAVEPOINT trx%d",
+               _trx_depth, _trx_depth);
     DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), SQLTRX, NULL, NULL, NULL);
   }
-#endif
 }
 
 // clang-format off
@@ -45,6 +45,29 @@ void dt_database_cleanup_busy_statements(const struct dt_database_t *db);
 gboolean dt_database_snapshot(const struct dt_database_t *db);
 /** check if creating database snapshot is recommended */
 gboolean dt_database_maybe_snapshot(const struct dt_database_t *db);
+/** get a statement for query, reset and without bindings, prepared only the first time.
+ * query should be a single statement of constant text, with parameters bound after the fact.
+ * Give it back with dt_database_release_statement() instead of sqlite3_finalize(). */
+struct sqlite3_stmt *dt_database_get_statement(const struct dt_database_t *db, const char *query);
+/** hand back a statement of dt_database_get_statement() for reuse */
+void dt_database_release_statement(const struct dt_database_t *db, struct sqlite3_stmt *stmt);
+/** a write of dt_database_write_async(), on the connection it is given */
+typedef void (*dt_database_write_callback_t)(struct sqlite3 *handle, gpointer data);
+/** queue a write nobody waits for. In WAL mode the writer thread commits them in batches, on its own
+ * connection which has no memory schema. Otherwise callback runs right away on the main connection.
+ * destroy, if not NULL, frees data afterwards. */
+void dt_database_write_async(const struct dt_database_t *db, dt_database_write_callback_t callback, gpointer data,
+                             GDestroyNotify destroy);
+/** wait for the queued writes to be committed */
+void dt_database_flush_writes(const struct dt_database_t *db);
+/** get a read-only connection for queries on main and data, not memory. In WAL mode these don't wait for the
+ * main connection, otherwise and within transactions this is the main connection. */
+struct sqlite3 *dt_database_get_reader(const struct dt_database_t *db);
+/** hand back a connection of dt_database_get_reader(), after finalizing its statements */
+void dt_database_release_reader(const struct dt_database_t *db, struct sqlite3 *handle);
+/** print the plan of the query, with -d sqlplan */
+void dt_database_explain_query(struct sqlite3 *handle, const char *query, const char *file, const int line,
+                               const char *function);
 /** get list of snapshot files to remove after successful snapshot */
 char **dt_database_snaps_to_remove(const struct dt_database_t *db);
 /** get possibly the freshest snapshot to restore */
@@ -94,6 +94,7 @@
   do                                                                                                              \
   {                                                                                                               \
     dt_print(DT_DEBUG_SQL, "[sql] %s:%d, function %s(): prepare \"%s\"\n", __FILE__, __LINE__, __FUNCTION__, (b));\
+    if(darktable.unmuted & DT_DEBUG_SQL_PLAN) dt_database_explain_query(a, b, __FILE__, __LINE__, __FUNCTION__);   \
     __DT_DEBUG_ASSERT_WITH_QUERY__(sqlite3_prepare_v2(a, b, c, d, e), (b));                                       \
     __DT_DEBUG_SQL_QUERY__(b)                                                                                     \
   } while(0)
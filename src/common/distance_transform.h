@@ -49,6 +49,12 @@
       - use DT_DISTANCE_TRANSFORM_MASK, in this case data found in src is checked vs clip, dt_image_distance_transform
         will fill in the zeros / DT_DISTANCE_TRANSFORM_MAX
    The returned float of this function is the maximum calculated distance
+
+  float dt_image_distance_feather(const float *const restrict src, float *const restrict out, const size_t width,
+       const size_t height, const float clip, const float radius)
+    feathers the 1-ch mask at 'src' into 'out': pixels at or above clip are kept, the others get a linear falloff
+    from 1 to 0 over 'radius' pixels of euclidean distance to the nearest of them, or their own value if larger.
+    The cost does not depend on the radius. Returns the maximum calculated distance.
 */
 
 #include "common/imagebuf.h"
@@ -61,6 +67,9 @@ typedef enum dt_distance_transform_t
 
 #define DT_DISTANCE_TRANSFORM_MAX (1e20)
 
+// columns transformed together, so that gathering them reads whole cache lines of the image
+#define DT_DISTANCE_TRANSFORM_COLUMNS 16
+
 static void _image_distance_transform(const float *f, float *z, float *d, int *v, const int n)
 {
   int k = 0;
@@ -122,22 +131,26 @@ float dt_image_distance_transform(float *const restrict src, float *const restri
   dt_omp_sharedconst(maxdim, width, height)
 #endif
   {
-    float *f = dt_alloc_align_float(maxdim);
+    float *f = dt_alloc_align_float(DT_DISTANCE_TRANSFORM_COLUMNS * height);
     float *z = dt_alloc_align_float(maxdim + 1);
-    float *d = dt_alloc_align_float(maxdim);
+    float *d = dt_alloc_align_float(MAX(width, DT_DISTANCE_TRANSFORM_COLUMNS * height));
     int *v = dt_alloc_align(maxdim * sizeof(int));
 
-    // transform along columns
+    // transform along columns, by blocks of contiguous columns
 #ifdef _OPENMP
-  #pragma omp for schedule(simd:static)
+  #pragma omp for schedule(static)
 #endif
-    for(size_t x = 0; x < width; x++)
+    for(size_t x0 = 0; x0 < width; x0 += DT_DISTANCE_TRANSFORM_COLUMNS)
     {
+      const size_t columns = MIN(DT_DISTANCE_TRANSFORM_COLUMNS, width - x0);
       for(size_t y = 0; y < height; y++)
-        f[y] = out[y*width + x];
-      _image_distance_transform(f, z, d, v, height);
+        for(size_t c = 0; c < columns; c++)
+          f[c * height + y] = out[y*width + x0 + c];
+      for(size_t c = 0; c < columns; c++)
+        _image_distance_transform(f + c * height, z, d + c * height, v, height);
       for(size_t y = 0; y < height; y++)
-        out[y*width + x] = d[y];
+        for(size_t c = 0; c < columns; c++)
+          out[y*width + x0 + c] = d[c * height + y];
     }
     // implicit barrier :-)
     // transform along rows
@@ -162,6 +175,34 @@ float dt_image_distance_transform(float *const restrict src, float *const restri
   return max_distance;
 }
 
+float dt_image_distance_feather(const float *const restrict src, float *const restrict out, const size_t width,
+                                const size_t height, const float clip, const float radius)
+{
+  const size_t npixels = width * height;
+#ifdef _OPENMP
+  #pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(src, out) \
+  dt_omp_sharedconst(clip, npixels) \
+  schedule(static) aligned(src, out : 64)
+#endif
+  for(size_t i = 0; i < npixels; i++)
+    out[i] = (src[i] >= clip) ? 0.0f : DT_DISTANCE_TRANSFORM_MAX;
+
+  const float max_distance = dt_image_distance_transform(NULL, out, width, height, clip, DT_DISTANCE_TRANSFORM_NONE);
+
+  const float falloff = 1.0f / fmaxf(radius, 1e-6f);
+#ifdef _OPENMP
+  #pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(src, out) \
+  dt_omp_sharedconst(falloff, npixels) \
+  schedule(static) aligned(src, out : 64)
+#endif
+  for(size_t i = 0; i < npixels; i++)
+    out[i] = (out[i] == 0.0f) ? src[i] : fmaxf(src[i], fmaxf(1.0f - out[i] * falloff, 0.0f));
+
+  return max_distance;
+}
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -182,6 +182,11 @@ dt_dlopencl_t *dt_dlopencl_init(const char *name)
                                            (void (**)(void)) & ocl->symbols->dt_clGetKernelInfo);
     success = success && dt_gmodule_symbol(module, "clEnqueueBarrier",
                                            (void (**)(void)) & ocl->symbols->dt_clEnqueueBarrier);
+    success = success && dt_gmodule_symbol(module, "clEnqueueMarker",
+                                           (void (**)(void)) & ocl->symbols->dt_clEnqueueMarker);
+    success = success && dt_gmodule_symbol(module, "clEnqueueWaitForEvents",
+                                           (void (**)(void)) & ocl->symbols->dt_clEnqueueWaitForEvents);
+    success = success && dt_gmodule_symbol(module, "clFlush", (void (**)(void)) & ocl->symbols->dt_clFlush);
     success = success && dt_gmodule_symbol(module, "clGetKernelWorkGroupInfo",
                                            (void (**)(void)) & ocl->symbols->dt_clGetKernelWorkGroupInfo);
     success = success && dt_gmodule_symbol(module, "clEnqueueReadBuffer",
@@ -196,6 +201,8 @@ dt_dlopencl_t *dt_dlopencl_init(const char *name)
                                            (void (**)(void)) & ocl->symbols->dt_clEnqueueCopyBuffer);
     success = success && dt_gmodule_symbol(module, "clEnqueueMapBuffer",
                                            (void (**)(void)) & ocl->symbols->dt_clEnqueueMapBuffer);
+    success = success && dt_gmodule_symbol(module, "clEnqueueMapImage",
+                                           (void (**)(void)) & ocl->symbols->dt_clEnqueueMapImage);
     success = success && dt_gmodule_symbol(module, "clEnqueueUnmapMemObject",
                                            (void (**)(void)) & ocl->symbols->dt_clEnqueueUnmapMemObject);
     success = success && dt_gmodule_symbol(module, "clGetMemObjectInfo",
@@ -203,6 +210,11 @@ dt_dlopencl_t *dt_dlopencl_init(const char *name)
     success = success && dt_gmodule_symbol(module, "clGetImageInfo",
                                            ((void (**)(void)) & ocl->symbols->dt_clGetImageInfo));
 
+    // OpenCL 1.1, the event waits fall back to clWaitForEvents() without it
+    if(success && !dt_gmodule_symbol(module, "clSetEventCallback",
+                                     (void (**)(void)) & ocl->symbols->dt_clSetEventCallback))
+      ocl->symbols->dt_clSetEventCallback = NULL;
+
     ocl->have_opencl = success;
 
     if(!success)
@@ -112,15 +112,24 @@ static void dwt_get_image_layer(float *const layer, dwt_params_t *const p)
   if(p->image != layer) memcpy(p->image, layer, sizeof(float) * p->width * p->height * p->ch);
 }
 
-// first, "vertical" pass of wavelet decomposition
-static void dwt_decompose_vert(float *const restrict out, const float *const restrict in,
-                               const size_t height, const size_t width, const size_t lev)
+// one level of wavelet decomposition in a single pass over the image: the "vertical" sum of each row with the
+// rows 'scale' pixels above and below goes to a per-thread scratch row, which is then summed horizontally to
+// generate 'coarse', and 'details' is the difference between the input and 'coarse'. The input is only read,
+// so each row can be finished while it's still in cache instead of running a vertical and a horizontal pass
+// over the whole image.
+__DT_CLONE_TARGETS__
+static void dwt_decompose_layer(float *const restrict coarse, float *const restrict details,
+                                const float *const restrict in, float *const restrict temp, const int lev,
+                                const dwt_params_t *const p)
 {
+  const size_t height = p->height;
+  const size_t width = p->width;
   const size_t vscale = MIN(1 << lev, height-1);
+  const int hscale = MIN(1 << lev, width);  //(int because we need a signed difference below)
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, vscale) \
-  dt_omp_sharedconst(in, out) \
+  dt_omp_firstprivate(height, width, vscale, hscale) \
+  dt_omp_sharedconst(in, coarse, details, temp) \
   schedule(static)
 #endif
   for(int rowid = 0; rowid < height ; rowid++)
@@ -137,7 +146,7 @@ static void dwt_decompose_vert(float *const restrict out, const float *const res
     const float* const restrict center = in + rowstart;
     const float* const restrict above = in + 4 * above_row * width;
     const float* const restrict below = in + 4 * below_row * width;
-    float* const restrict temprow = out + rowstart;
+    float* const restrict temprow = temp + width * dt_get_thread_num() * 4;
     for (size_t col = 0; col < 4*width; col += 4)
     {
       for_each_channel(c,aligned(center, above, below, temprow : 16))
@@ -145,46 +154,23 @@ static void dwt_decompose_vert(float *const restrict out, const float *const res
         temprow[col + c] = 2.f * center[col+c] + above[col+c] + below[col+c];
       }
     }
-  }
-}
 
-// second, horizontal pass of wavelet decomposition; generates 'coarse' into the output buffer and overwrites
-//   the input buffer with 'details'
-static void dwt_decompose_horiz(float *const restrict out, float *const restrict in, float *const temp,
-                                const size_t height, const size_t width, const size_t lev)
-{
-  const int hscale = MIN(1 << lev, width);  //(int because we need a signed difference below)
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, hscale) \
-  dt_omp_sharedconst(in, out, temp) \
-  schedule(static)
-#endif
-  for(int row = 0; row < height ; row++)
-  {
     // perform a weighted sum of the current pixel with the ones 'scale' pixels to the left and right, using
     // reflection to get a value if either of those positions is out of bounds, i.e. we move as many columns
-    // in from the edge as we would have been beyond the edge to avoid an additional pass, we also rescale the
-    // final sum and split the original input into 'coarse' and 'details' by subtracting the scaled sum from
-    // the original input.
-    const size_t rowindex = (size_t)4 * (row * width);
-    float* const restrict temprow = temp + width * dt_get_thread_num() * 4;
-    float* const restrict details = in + rowindex;
-    float* const restrict coarse = out + rowindex;
-
+    // in from the edge as we would have been beyond the edge. We also rescale the final sum and split the
+    // original input into 'coarse' and 'details' by subtracting the scaled sum from the original input.
+    float* const restrict coarserow = coarse + rowstart;
+    float* const restrict detailsrow = details + rowstart;
     for (int col = 0; col < width - hscale; col++)
     {
       const size_t leftpos = (size_t)4*abs(col-hscale);	// the abs() handles reflection at the left edge
       const size_t rightpos = (size_t)4*(col+hscale);
-      for_each_channel(c,aligned(temprow, details, coarse : 16))
+      for_each_channel(c,aligned(temprow, center, coarserow, detailsrow : 16))
       {
-        const float left = coarse[leftpos+c];
-        const float right = coarse[rightpos+c];
         // add up left/center/right, and renormalize by dividing by the total weight of all numbers added together
-        const float hat = (2.f * coarse[4*col+c] + left + right) / 16.f;
-        // the normalized value is our 'coarse' result; 'details' is the difference between original input and 'coarse'
-        temprow[4*col+c] = hat;
-        details[4*col+c] -= hat;
+        const float hat = (2.f * temprow[4*col+c] + temprow[leftpos+c] + temprow[rightpos+c]) / 16.f;
+        coarserow[4*col+c] = hat;
+        detailsrow[4*col+c] = center[4*col+c] - hat;
       }
     }
     // handle reflection at right edge
@@ -192,32 +178,16 @@ static void dwt_decompose_horiz(float *const restrict out, float *const restrict
     {
       const size_t leftpos = (size_t)4 * abs(col-hscale); // still need to handle reflection, if hscale>=width/2
       const size_t rightpos = (size_t)4 * (2*width - 2 - (col+hscale));
-      for_each_channel(c,aligned(temprow, details, coarse : 16))
+      for_each_channel(c,aligned(temprow, center, coarserow, detailsrow : 16))
       {
-        const float left = coarse[leftpos+c];
-        const float right = coarse[rightpos+c];
-        // add up left/center/right, and renormalize by dividing by the total weight of all numbers added together
-        const float hat = (2.f * coarse[4*col+c] + left + right) / 16.f;
-        // the normalized value is our 'coarse' result; 'details' is the difference between original input and 'coarse'
-        temprow[4*col+c] = hat;
-        details[4*col+c] -= hat;
+        const float hat = (2.f * temprow[4*col+c] + temprow[leftpos+c] + temprow[rightpos+c]) / 16.f;
+        coarserow[4*col+c] = hat;
+        detailsrow[4*col+c] = center[4*col+c] - hat;
       }
     }
-    // now that we're done with the row of pixels, we can overwrite the intermediate result from the
-    // first pass with the final decomposition
-    memcpy(coarse, temprow, sizeof(float) * 4 * width);
   }
 }
 
-// split input into 'coarse' and 'details'; put 'details' back into the input buffer
-static void dwt_decompose_layer(float *const restrict out, float *const restrict in, float *const temp, const int lev,
-                                const dwt_params_t *const p)
-{
-  dwt_decompose_vert(out, in, p->height, p->width, lev);
-  dwt_decompose_horiz(out, in, temp, p->height, p->width, lev);
-  return;
-}
-
 /* actual decomposing algorithm */
 static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_func layer_func)
 {
@@ -225,6 +195,7 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
   float *layers = NULL;
   float *merged_layers = NULL;
   float *buffer[2] = { 0, 0 };
+  float *details = NULL;
   int bcontinue = 1;
   const size_t size = (size_t)p->width * p->height * p->ch;
 
@@ -238,17 +209,20 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
   buffer[0] = img;
   /* temporary storage */
   buffer[1] = dt_alloc_align_float(size);
-  // buffer to reconstruct the image
-  layers = dt_alloc_align_float((size_t)4 * p->width * p->height);
+  // detail scale of the current level, the input of the level is kept intact so the decomposition needs no
+  // separate vertical pass
+  details = dt_alloc_align_float(size);
+  // buffer to reconstruct the image, not needed when a single layer is returned
+  if(p->return_layer == 0) layers = dt_alloc_align_float((size_t)4 * p->width * p->height);
   // scratch buffer for decomposition
   temp = dt_alloc_align_float(darktable.num_openmp_threads * 4 * p->width);
 
-  if(buffer[1] == NULL || layers == NULL || temp == NULL)
+  if(buffer[1] == NULL || details == NULL || (p->return_layer == 0 && layers == NULL) || temp == NULL)
   {
     printf("not enough memory for wavelet decomposition");
     goto cleanup;
   }
-  dt_iop_image_fill(layers,0.0f,p->width,p->height,p->ch);
+  if(layers) dt_iop_image_fill(layers,0.0f,p->width,p->height,p->ch);
 
   if(p->merge_from_scale > 0)
   {
@@ -267,19 +241,19 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
   {
     unsigned int lpass = (1 - (lev & 1));
 
-    dwt_decompose_layer(buffer[lpass], buffer[hpass], temp, lev, p);
+    dwt_decompose_layer(buffer[lpass], details, buffer[hpass], temp, lev, p);
 
     // no merge scales or we didn't reach the merge scale from yet
     if(p->merge_from_scale == 0 || p->merge_from_scale > lev + 1)
     {
       // allow to process this detail scale
-      if(layer_func) layer_func(buffer[hpass], p, lev + 1);
+      if(layer_func) layer_func(details, p, lev + 1);
 
       // user wants to preview this detail scale
       if(p->return_layer == lev + 1)
       {
         // return this detail scale
-        dwt_get_image_layer(buffer[hpass], p);
+        dwt_get_image_layer(details, p);
 
         bcontinue = 0;
       }
@@ -287,14 +261,14 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
       else if(p->return_layer == 0)
       {
         // add this detail scale to the final image
-        dt_iop_image_add_image(layers, buffer[hpass], p->width, p->height, p->ch);
+        dt_iop_image_add_image(layers, details, p->width, p->height, p->ch);
       }
     }
     // we are on the merge scales range
     else
     {
       // add this detail scale to the merged ones
-      dt_iop_image_add_image(merged_layers, buffer[hpass], p->width, p->height, p->ch);
+      dt_iop_image_add_image(merged_layers, details, p->width, p->height, p->ch);
 
       // allow to process this merged scale
       if(layer_func) layer_func(merged_layers, p, lev + 1);
@@ -350,6 +324,7 @@ cleanup:
   if(layers) dt_free_align(layers);
   if(merged_layers) dt_free_align(merged_layers);
   if(buffer[1]) dt_free_align(buffer[1]);
+  if(details) dt_free_align(details);
 }
 
 /* this function prepares for decomposing, which is done in the function dwt_wavelet_decompose() */
@@ -382,15 +357,20 @@ void dwt_decompose(dwt_params_t *p, _dwt_layer_func layer_func)
   dwt_wavelet_decompose(p->image, p, layer_func);
 }
 
-// first, "vertical" pass of wavelet decomposition
-static void dwt_denoise_vert_1ch(float *const restrict out, const float *const restrict in,
-                                 const size_t height, const size_t width, const size_t lev)
+// one level of the wavelet decomposition of dwt_denoise(), in a single pass over the image like
+// dwt_decompose_layer(): 'coarse' goes to the output buffer, and the portion of the details which exceeds
+// the threshold is accumulated into 'accum' and added back to 'coarse' on the last level.
+__DT_CLONE_TARGETS__
+static void dwt_denoise_layer_1ch(float *const restrict out, const float *const restrict in,
+                                  float *const restrict accum, float *const restrict temp, const size_t height,
+                                  const size_t width, const size_t lev, const float thold, const int last)
 {
   const int vscale = MIN(1 << lev, height);
+  const int hscale = MIN(1 << lev, width);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, vscale) \
-  dt_omp_sharedconst(in, out) \
+  dt_omp_firstprivate(height, width, vscale, hscale, thold, last) \
+  dt_omp_sharedconst(in, out, accum, temp) \
   schedule(static)
 #endif
   for(int rowid = 0; rowid < height ; rowid++)
@@ -406,41 +386,20 @@ static void dwt_denoise_vert_1ch(float *const restrict out, const float *const r
     const float *const restrict center = in + rowstart;
     const float *const restrict above =  in + abs(row - vscale) * width;
     const float *const restrict below = in + below_row * width;
-    float* const restrict outrow = out + rowstart;
+    float *const restrict temprow = temp + width * dt_get_thread_num();
 #ifdef _OPENMP
 #pragma omp simd
 #endif
     for (int col= 0; col < width; col++)
     {
-      outrow[col] = 2.f * center[col] + above[col] + below[col];
+      temprow[col] = 2.f * center[col] + above[col] + below[col];
     }
-  }
-}
 
-// second, horizontal pass of wavelet decomposition; generates 'coarse' into the output buffer and overwrites
-//   the input buffer with 'details'
-static void dwt_denoise_horiz_1ch(float *const restrict out, float *const restrict in,
-                                  float *const restrict accum, const size_t height, const size_t width,
-                                  const size_t lev, const float thold, const int last)
-{
-  const int hscale = MIN(1 << lev, width);
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, hscale, thold, last) \
-  dt_omp_sharedconst(in, out, accum) \
-  schedule(static)
-#endif
-  for(int row = 0; row < height ; row++)
-  {
     // perform a weighted sum of the current pixel with the ones 'scale' pixels to the left and right, using
-    // reflection to get a value if either of those positions is out of bounds, i.e. we move as many columns
-    // in from the edge as we would have been beyond the edge to avoid an additional pass, we also rescale the
-    // final sum and split the original input into 'coarse' and 'details' by subtracting the scaled sum from
-    // the original input.
-    const size_t rowindex = (size_t)row * width;
-    float *const restrict details = in + rowindex;
-    float *const restrict coarse = out + rowindex;
-    float *const restrict accum_row = accum + rowindex;
+    // reflection to get a value if either of those positions is out of bounds, and split the original input
+    // into 'coarse' and the details.
+    float *const restrict coarse = out + rowstart;
+    float *const restrict accum_row = accum + rowstart;
     // handle reflection at left edge
 #ifdef _OPENMP
 #pragma omp simd
@@ -448,11 +407,11 @@ static void dwt_denoise_horiz_1ch(float *const restrict out, float *const restri
     for (int col = 0; col < hscale; col++)
     {
       // add up left/center/right, and renormalize by dividing by the total weight of all numbers added together
-      const float hat = (2.f * coarse[col] + coarse[hscale-col] + coarse[col+hscale]) / 16.f;
+      const float hat = (2.f * temprow[col] + temprow[hscale-col] + temprow[col+hscale]) / 16.f;
       // the normalized value is our 'coarse' result; 'diff' is the difference between original input and 'coarse'
       // (which would ordinarily be stored as the details scale, but we don't need it any further)
-      const float diff = details[col] - hat;
-      details[col] = hat;		// done with original input, so we can overwrite it with 'coarse'
+      const float diff = center[col] - hat;
+      coarse[col] = hat;
       // GCC8 won't vectorize if we use the following line, but it turns out that just adding the two conditional
       // alternatives produces exactly the same result, and *that* does get vectorized
       //const float excess = diff < 0.0 ? MIN(diff + thold, 0.0f) : MAX(diff - thold, 0.0f);
@@ -463,15 +422,9 @@ static void dwt_denoise_horiz_1ch(float *const restrict out, float *const restri
 #endif
     for (int col = hscale; col < width - hscale; col++)
     {
-      // add up left/center/right, and renormalize by dividing by the total weight of all numbers added together
-      const float hat = (2.f * coarse[col] + coarse[col-hscale] + coarse[col+hscale]) / 16.f;
-      // the normalized value is our 'coarse' result; 'diff' is the difference between original input and 'coarse'
-      // (which would ordinarily be stored as the details scale, but we don't need it any further)
-      const float diff = details[col] - hat;
-      details[col] = hat;		// done with original input, so we can overwrite it with 'coarse'
-      // GCC8 won't vectorize if we use the following line, but it turns out that just adding the two conditional
-      // alternatives produces exactly the same result, and *that* does get vectorized
-      //const float excess = diff < 0.0 ? MIN(diff + thold, 0.0f) : MAX(diff - thold, 0.0f);
+      const float hat = (2.f * temprow[col] + temprow[col-hscale] + temprow[col+hscale]) / 16.f;
+      const float diff = center[col] - hat;
+      coarse[col] = hat;
       accum_row[col] += MAX(diff - thold,0.0f) + MIN(diff + thold, 0.0f);
     }
     // handle reflection at right edge
@@ -480,13 +433,10 @@ static void dwt_denoise_horiz_1ch(float *const restrict out, float *const restri
 #endif
     for (int col = width - hscale; col < width; col++)
     {
-      const float right = coarse[2*width - 2 - (col+hscale)];
-      // add up left/center/right, and renormalize by dividing by the total weight of all numbers added together
-      const float hat = (2.f * coarse[col] + coarse[col-hscale] + right) / 16.f;
-      // the normalized value is our 'coarse' result; 'diff' is the difference between original input and 'coarse'
-      // (which would ordinarily be stored as the details scale, but we don't need it any further)
-      const float diff = details[col] - hat;
-      details[col] = hat;		// done with original input, so we can overwrite it with 'coarse'
+      const float right = temprow[2*width - 2 - (col+hscale)];
+      const float hat = (2.f * temprow[col] + temprow[col-hscale] + right) / 16.f;
+      const float diff = center[col] - hat;
+      coarse[col] = hat;
       accum_row[col] += MAX(diff - thold,0.0f) + MIN(diff + thold, 0.0f);
     }
     if (last)
@@ -494,7 +444,7 @@ static void dwt_denoise_horiz_1ch(float *const restrict out, float *const restri
       // add the details to the residue to create the final denoised result
       for (int col = 0; col < width; col++)
       {
-        details[col] += accum_row[col];
+        coarse[col] += accum_row[col];
       }
     }
   }
@@ -507,22 +457,26 @@ static void dwt_denoise_horiz_1ch(float *const restrict out, float *const restri
 void dwt_denoise(float *const img, const int width, const int height, const int bands, const float *const noise)
 {
   float *const details = dt_alloc_align_float((size_t)2 * width * height);
-  float *const interm = details + width * height;	// temporary storage for use during each pass
+  float *const interm = details + width * height;	// the other buffer of the ping-pong between levels
+  float *const temp = dt_alloc_align_float((size_t)darktable.num_openmp_threads * width);
 
   // zero the accumulator
   dt_iop_image_fill(details, 0.0f, width, height, 1);
 
+  const float *in = img;
   for(int lev = 0; lev < bands; lev++)
   {
     const int last = (lev+1) == bands;
+    float *const out = (in == img) ? interm : img;
 
-    // "vertical" pass, averages pixels with those 'scale' rows above and below and puts result in 'interm'
-    dwt_denoise_vert_1ch(interm, img, height, width, lev);
-    // horizontal filtering pass, averages pixels in 'interm' with those 'scale' rows to the left and right
-    // accumulates the portion of the detail scale that is above the noise threshold into 'details'; this
-    // will be added to the residue left in 'img' on the last iteration
-    dwt_denoise_horiz_1ch(interm, img, details, height, width, lev, noise[lev], last);
+    // averages pixels with those 'scale' rows above and below, then 'scale' columns to the left and right,
+    // puts the result in 'out' and accumulates the portion of the detail scale that is above the noise
+    // threshold into 'details'; this will be added to the residue on the last iteration
+    dwt_denoise_layer_1ch(out, in, details, temp, height, width, lev, noise[lev], last);
+    in = out;
   }
+  if(in != img) dt_iop_image_copy(img, in, (size_t)width * height);
+  dt_free_align(temp);
   dt_free_align(details);
 }
 
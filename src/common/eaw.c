@@ -128,6 +128,7 @@ static inline __m128 weight_sse2(const __m128 *c1, const __m128 *c2, const float
   pcoarse += 4;
 #endif
 
+__DT_CLONE_TARGETS__
 void eaw_decompose(float *const restrict out, const float *const restrict in, float *const restrict detail,
                    const int scale, const float sharpen, const int32_t width, const int32_t height)
 {
@@ -215,6 +216,12 @@ void eaw_decompose(float *const restrict out, const float *const restrict in, fl
 void eaw_decompose_sse2(float *const restrict out, const float *const restrict in, float *const restrict detail,
                         const int scale, const float sharpen, const int32_t width, const int32_t height)
 {
+  if(darktable.codepath.AVX2)
+  {
+    eaw_decompose(out, in, detail, scale, sharpen, width, height);
+    return;
+  }
+
   const int mult = 1 << scale;
   static const float filter[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
   const int boundary = 2 * mult;
@@ -297,6 +304,7 @@ void eaw_decompose_sse2(float *const restrict out, const float *const restrict i
 }
 #endif
 
+__DT_CLONE_TARGETS__
 void eaw_synthesize(float *const out, const float *const in, const float *const restrict detail,
                     const float *const restrict threshold, const float *const restrict boost,
                     const int32_t width, const int32_t height)
@@ -329,6 +337,12 @@ void eaw_synthesize_sse2(float *const out, const float *const in, const float *c
                          const float *const restrict thrsf, const float *const restrict boostf,
                          const int32_t width, const int32_t height)
 {
+  if(darktable.codepath.AVX2)
+  {
+    eaw_synthesize(out, in, detail, thrsf, boostf, width, height);
+    return;
+  }
+
   const __m128 threshold = _mm_load_ps(thrsf);
   const __m128 boost = _mm_load_ps(boostf);
   const __m128i maski = _mm_set1_epi32(0x80000000u);
@@ -460,6 +474,7 @@ static inline _aligned_pixel add_float4(_aligned_pixel acc, _aligned_pixel newva
   pcoarse += 4;
 #endif
 
+__DT_CLONE_TARGETS__
 void eaw_dn_decompose(float *const restrict out, const float *const restrict in, float *const restrict detail,
                       dt_aligned_pixel_t sum_squared, const int scale, const float inv_sigma2,
                       const int32_t width, const int32_t height)
@@ -561,6 +576,12 @@ void eaw_dn_decompose_sse(float *const restrict out, const float *const restrict
                           dt_aligned_pixel_t sum_squared, const int scale, const float inv_sigma2,
                                  const int32_t width, const int32_t height)
 {
+  if(darktable.codepath.AVX2)
+  {
+    eaw_dn_decompose(out, in, detail, sum_squared, scale, inv_sigma2, width, height);
+    return;
+  }
+
   const int mult = 1u << scale;
   static const float filter[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
   const int boundary = 2 * mult;
@@ -1688,6 +1688,189 @@ int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char
   }
 }
 
+// the decoding part of dt_exif_read(), whichever way the metadata was read
+static bool _exif_decode_read_data(dt_image_t *img, const char *path, Exiv2::ExifData &exifData,
+                                   Exiv2::IptcData &iptcData, Exiv2::XmpData &xmpData)
+{
+  bool res = true;
+
+  // EXIF metadata
+  if(!exifData.empty())
+  {
+    res = _exif_decode_exif_data(img, exifData);
+    if(dt_conf_get_bool("ui/detect_mono_exif"))
+    {
+      const int oldflags = dt_image_monochrome_flags(img) | (img->flags & DT_IMAGE_MONOCHROME_WORKFLOW);
+      if(dt_imageio_has_mono_preview(path))
+        img->flags |= (DT_IMAGE_MONOCHROME_PREVIEW | DT_IMAGE_MONOCHROME_WORKFLOW);
+      else
+        img->flags &= ~(DT_IMAGE_MONOCHROME_PREVIEW | DT_IMAGE_MONOCHROME_WORKFLOW);
+
+      if(oldflags != (dt_image_monochrome_flags(img) | (img->flags & DT_IMAGE_MONOCHROME_WORKFLOW)))
+        dt_imageio_update_monochrome_workflow_tag(img->id, dt_image_monochrome_flags(img));
+    }
+  }
+  else
+    img->exif_inited = 1;
+
+  // IPTC metadata.
+  if(!iptcData.empty()) res = _exif_decode_iptc_data(img, iptcData) && res;
+
+  // XMP metadata
+  if(!xmpData.empty())
+    res = _exif_decode_xmp_data(img, xmpData, -1, true) && res;
+
+  return res;
+}
+
+static inline uint16_t _read_be16(const uint8_t *p)
+{
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// size of the main image of a TIFF based file: the first IFD flagged as full resolution, like Exiv2 does
+static void _tiff_pixel_size(Exiv2::ExifData &exifData, int32_t *width, int32_t *height)
+{
+  static const char *groups[] = { "Image", "SubImage1", "SubImage2", "SubImage3", "SubImage4", "Image2", "Image3" };
+  const char *primary = "Image";
+  for(size_t k = 0; k < sizeof(groups) / sizeof(groups[0]); k++)
+  {
+    Exiv2::ExifData::const_iterator pos;
+    const string group = groups[k];
+    if(FIND_EXIF_TAG("Exif." + group + ".NewSubfileType") && pos->toLong() == 0)
+    {
+      primary = groups[k];
+      break;
+    }
+  }
+
+  Exiv2::ExifData::const_iterator pos;
+  const string group = primary;
+  if(FIND_EXIF_TAG("Exif." + group + ".ImageWidth")) *width = pos->toLong();
+  if(FIND_EXIF_TAG("Exif." + group + ".ImageLength")) *height = pos->toLong();
+}
+
+/* Fast path of dt_exif_read() for the most common containers: JPEG files and raws in a TIFF container
+ * (NEF, CR2, ARW, DNG, PEF...). The file is mapped and only the metadata is parsed, from memory and without
+ * the global Exiv2 lock when the library is thread safe, so imports and rescans can read files in parallel.
+ * For JPEG, parsing stops at the start of the image data.
+ * Returns false when the file needs the full Exiv2 path: other containers, IPTC data,
+ * XMP packets embedded in TIFF files or extended XMP. */
+static bool _exif_read_fast(dt_image_t *img, const char *path, int *res)
+{
+  GMappedFile *mf = g_mapped_file_new(path, FALSE, NULL);
+  if(!mf) return false;
+  const uint8_t *data = (const uint8_t *)g_mapped_file_get_contents(mf);
+  const size_t length = g_mapped_file_get_length(mf);
+
+  bool handled = false;
+  try
+  {
+    Exiv2::ExifData exifData;
+    Exiv2::IptcData iptcData;
+    Exiv2::XmpData xmpData;
+    int32_t width = 0, height = 0;
+
+    if(length >= 8 && ((data[0] == 'I' && data[1] == 'I' && data[2] == 42 && data[3] == 0)
+                       || (data[0] == 'M' && data[1] == 'M' && data[2] == 0 && data[3] == 42)))
+    {
+      {
+#if !EXIV2_TEST_VERSION(0,27,0)
+        Lock lock;
+#endif
+        Exiv2::ExifParser::decode(exifData, data, length);
+      }
+      Exiv2::ExifData::const_iterator pos;
+      handled = !FIND_EXIF_TAG("Exif.Image.XMLPacket") && !FIND_EXIF_TAG("Exif.Image.IPTCNAA");
+      if(handled) _tiff_pixel_size(exifData, &width, &height);
+    }
+    else if(length >= 4 && data[0] == 0xFF && data[1] == 0xD8)
+    {
+      static const char exif_id[] = "Exif\0\0";
+      static const char xmp_id[] = "http://ns.adobe.com/xap/1.0/";
+      static const char xmp_ext_id[] = "http://ns.adobe.com/xmp/extension/";
+      handled = true;
+      size_t p = 2;
+      while(handled && p + 4 <= length)
+      {
+        if(data[p] != 0xFF)
+        {
+          // lost in the stream
+          handled = false;
+          break;
+        }
+        const uint8_t marker = data[p + 1];
+        if(marker == 0xFF)
+        {
+          // fill byte
+          p++;
+          continue;
+        }
+        // standalone markers
+        if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+        {
+          p += 2;
+          continue;
+        }
+        // the image data starts, we have all the metadata
+        if(marker == 0xDA || marker == 0xD9) break;
+
+        const size_t seglen = _read_be16(data + p + 2);
+        if(seglen < 2 || p + 2 + seglen > length)
+        {
+          handled = false;
+          break;
+        }
+        const uint8_t *seg = data + p + 4;
+        const size_t n = seglen - 2;
+
+        if(marker == 0xE1 && n > sizeof(exif_id) - 1 && !memcmp(seg, exif_id, sizeof(exif_id) - 1)
+           && exifData.empty())
+        {
+#if !EXIV2_TEST_VERSION(0,27,0)
+          Lock lock;
+#endif
+          Exiv2::ExifParser::decode(exifData, seg + sizeof(exif_id) - 1, n - (sizeof(exif_id) - 1));
+        }
+        else if(marker == 0xE1 && n > sizeof(xmp_id) && !memcmp(seg, xmp_id, sizeof(xmp_id)))
+        {
+          // the toolkit behind the XMP parser is not reentrant
+          const std::string packet((const char *)seg + sizeof(xmp_id), n - sizeof(xmp_id));
+          Lock lock;
+          if(Exiv2::XmpParser::decode(xmpData, packet)) handled = false;
+        }
+        else if(marker == 0xE1 && n > sizeof(xmp_ext_id) && !memcmp(seg, xmp_ext_id, sizeof(xmp_ext_id)))
+          handled = false;
+        else if(marker == 0xED)
+          handled = false; // Photoshop resources, with IPTC data
+        else if(marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC && n >= 5)
+        {
+          height = _read_be16(seg + 1);
+          width = _read_be16(seg + 3);
+        }
+        p += 2 + seglen;
+      }
+    }
+
+    if(handled)
+    {
+      *res = _exif_decode_read_data(img, path, exifData, iptcData, xmpData) ? 0 : 1;
+      // Initialize size - don't wait for full raw to be loaded to get this information
+      img->height = height;
+      img->width = width;
+    }
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    // let Exiv2 have a go at it
+    dt_print(DT_DEBUG_IMAGEIO, "[exif] fast path failed for %s: %s\n", path, e.what());
+    handled = false;
+  }
+
+  g_mapped_file_unref(mf);
+  return handled;
+}
+
 /** read the metadata of an image.
  * XMP data trumps IPTC data trumps EXIF data
  */
@@ -1702,41 +1885,17 @@ int dt_exif_read(dt_image_t *img, const char *path)
     dt_datetime_unix_to_img(img, &statbuf.st_mtime);
   }
 
+  int fast_res = 1;
+  if(_exif_read_fast(img, path, &fast_res)) return fast_res;
+
   try
   {
     std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
     assert(image.get() != 0);
     read_metadata_threadsafe(image);
-    bool res = true;
-
-    // EXIF metadata
-    Exiv2::ExifData &exifData = image->exifData();
-    if(!exifData.empty())
-    {
-      res = _exif_decode_exif_data(img, exifData);
-      if(dt_conf_get_bool("ui/detect_mono_exif"))
-      {
-        const int oldflags = dt_image_monochrome_flags(img) | (img->flags & DT_IMAGE_MONOCHROME_WORKFLOW);
-        if(dt_imageio_has_mono_preview(path))
-          img->flags |= (DT_IMAGE_MONOCHROME_PREVIEW | DT_IMAGE_MONOCHROME_WORKFLOW);
-        else
-          img->flags &= ~(DT_IMAGE_MONOCHROME_PREVIEW | DT_IMAGE_MONOCHROME_WORKFLOW);
 
-        if(oldflags != (dt_image_monochrome_flags(img) | (img->flags & DT_IMAGE_MONOCHROME_WORKFLOW)))
-          dt_imageio_update_monochrome_workflow_tag(img->id, dt_image_monochrome_flags(img));
-      }
-    }
-    else
-      img->exif_inited = 1;
-
-    // IPTC metadata.
-    Exiv2::IptcData &iptcData = image->iptcData();
-    if(!iptcData.empty()) res = _exif_decode_iptc_data(img, iptcData) && res;
-
-    // XMP metadata
-    Exiv2::XmpData &xmpData = image->xmpData();
-    if(!xmpData.empty())
-      res = _exif_decode_xmp_data(img, xmpData, -1, true) && res;
+    const bool res
+        = _exif_decode_read_data(img, path, image->exifData(), image->iptcData(), image->xmpData());
 
     // Initialize size - don't wait for full raw to be loaded to get this
     // information. If use_embedded_thumbnail is set, it will take a
@@ -2180,33 +2339,102 @@ int dt_exif_read_blob(uint8_t **buf, const char *path, const int32_t imgid, cons
   }
 }
 
-// encode binary blob into text:
-char *dt_exif_xmp_encode(const unsigned char *input, const int len, int *output_len)
+typedef enum dt_exif_xmp_compress_t
 {
-#define COMPRESS_THRESHOLD 100
-
-  gboolean do_compress = FALSE;
+  DT_EXIF_XMP_COMPRESS_NEVER = 0,
+  DT_EXIF_XMP_COMPRESS_LARGE = 1,
+  DT_EXIF_XMP_COMPRESS_ALWAYS = 2
+} dt_exif_xmp_compress_t;
 
-  // if input data field exceeds a certain size we compress it and convert to base64;
-  // main reason for compression: make more xmp data fit into 64k segment within
-  // JPEG output files.
+static dt_exif_xmp_compress_t _xmp_compress_mode(void)
+{
+  dt_exif_xmp_compress_t mode = DT_EXIF_XMP_COMPRESS_NEVER;
   char *config = dt_conf_get_string("compress_xmp_tags");
   if(config)
   {
     if(!strcmp(config, "always"))
-      do_compress = TRUE;
-    else if((len > COMPRESS_THRESHOLD) && !strcmp(config, "only large entries"))
-      do_compress = TRUE;
-    else
-      do_compress = FALSE;
+      mode = DT_EXIF_XMP_COMPRESS_ALWAYS;
+    else if(!strcmp(config, "only large entries"))
+      mode = DT_EXIF_XMP_COMPRESS_LARGE;
     g_free(config);
   }
+  return mode;
+}
+
+static gboolean _xmp_do_compress(const dt_exif_xmp_compress_t mode, const int len)
+{
+#define COMPRESS_THRESHOLD 100
 
-  return dt_exif_xmp_encode_internal(input, len, output_len, do_compress);
+  // if input data field exceeds a certain size we compress it and convert to base64;
+  // main reason for compression: make more xmp data fit into 64k segment within
+  // JPEG output files.
+  return mode == DT_EXIF_XMP_COMPRESS_ALWAYS
+         || (mode == DT_EXIF_XMP_COMPRESS_LARGE && len > COMPRESS_THRESHOLD);
 
 #undef COMPRESS_THRESHOLD
 }
 
+// encode binary blob into text:
+char *dt_exif_xmp_encode(const unsigned char *input, const int len, int *output_len)
+{
+  return dt_exif_xmp_encode_internal(input, len, output_len, _xmp_do_compress(_xmp_compress_mode(), len));
+}
+
+/* Encoded history and mask blobs, keyed by the raw blob and the compression flag.
+   Rewriting a sidecar after a rating or tag change, or writing the sidecars of a batch
+   of images sharing the same history, then doesn't deflate and base64 every params blob
+   again. The cache is flushed as a whole when it outgrows DT_EXIF_XMP_CACHE_SIZE. */
+#define DT_EXIF_XMP_CACHE_SIZE (16 << 20)
+
+static GMutex _xmp_cache_lock;
+static GHashTable *_xmp_cache = NULL;
+static size_t _xmp_cache_size = 0;
+
+static char *_exif_xmp_encode_cached(const unsigned char *input, const int len, const dt_exif_xmp_compress_t mode)
+{
+  const gboolean do_compress = _xmp_do_compress(mode, len);
+  if(!input || len <= 0) return dt_exif_xmp_encode_internal(input, len, NULL, do_compress);
+
+  guint8 *data = (guint8 *)g_malloc(len + 1);
+  data[0] = do_compress;
+  memcpy(data + 1, input, len);
+  GBytes *key = g_bytes_new_take(data, len + 1);
+
+  g_mutex_lock(&_xmp_cache_lock);
+  if(!_xmp_cache)
+    _xmp_cache = g_hash_table_new_full(g_bytes_hash, g_bytes_equal, (GDestroyNotify)g_bytes_unref, free);
+  const char *cached = (const char *)g_hash_table_lookup(_xmp_cache, key);
+  char *output = cached ? strdup(cached) : NULL;
+  g_mutex_unlock(&_xmp_cache_lock);
+
+  if(output)
+  {
+    g_bytes_unref(key);
+    return output;
+  }
+
+  output = dt_exif_xmp_encode_internal(input, len, NULL, do_compress);
+  if(!output)
+  {
+    g_bytes_unref(key);
+    return NULL;
+  }
+
+  char *value = strdup(output);
+  const size_t size = len + 1 + strlen(value) + 1;
+  g_mutex_lock(&_xmp_cache_lock);
+  if(_xmp_cache_size + size > DT_EXIF_XMP_CACHE_SIZE)
+  {
+    g_hash_table_remove_all(_xmp_cache);
+    _xmp_cache_size = 0;
+  }
+  if(!g_hash_table_contains(_xmp_cache, key)) _xmp_cache_size += size;
+  g_hash_table_replace(_xmp_cache, key, value);
+  g_mutex_unlock(&_xmp_cache_lock);
+
+  return output;
+}
+
 char *dt_exif_xmp_encode_internal(const unsigned char *input, const int len, int *output_len, gboolean do_compress)
 {
   char *output = NULL;
@@ -3528,6 +3756,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
 static void dt_set_xmp_dt_history(Exiv2::XmpData &xmpData, const int32_t imgid, int history_end)
 {
   sqlite3_stmt *stmt;
+  const dt_exif_xmp_compress_t mode = _xmp_compress_mode();
 
   // masks:
   char key[1024];
@@ -3557,10 +3786,10 @@ static void dt_set_xmp_dt_history(Exiv2::XmpData &xmpData, const int32_t imgid,
     const char *mask_name = (const char *)sqlite3_column_text(stmt, 3);
     const int32_t mask_version = sqlite3_column_int(stmt, 4);
     int32_t len = sqlite3_column_bytes(stmt, 5);
-    char *mask_d = dt_exif_xmp_encode((const unsigned char *)sqlite3_column_blob(stmt, 5), len, NULL);
+    char *mask_d = _exif_xmp_encode_cached((const unsigned char *)sqlite3_column_blob(stmt, 5), len, mode);
     const int32_t mask_nb = sqlite3_column_int(stmt, 6);
     len = sqlite3_column_bytes(stmt, 7);
-    char *mask_src = dt_exif_xmp_encode((const unsigned char *)sqlite3_column_blob(stmt, 7), len, NULL);
+    char *mask_src = _exif_xmp_encode_cached((const unsigned char *)sqlite3_column_blob(stmt, 7), len, mode);
 
     snprintf(key, sizeof(key), "Xmp.darktable.masks_history[%d]/darktable:mask_num", num);
     xmpData[key] = mask_num;
@@ -3620,7 +3849,7 @@ static void dt_set_xmp_dt_history(Exiv2::XmpData &xmpData, const int32_t imgid,
 
     if(!operation) continue; // no op is fatal.
 
-    char *params = dt_exif_xmp_encode((const unsigned char *)params_blob, params_len, NULL);
+    char *params = _exif_xmp_encode_cached((const unsigned char *)params_blob, params_len, mode);
 
     snprintf(key, sizeof(key), "Xmp.darktable.history[%d]/darktable:num", num);
     xmpData[key] = hist_num;
@@ -3641,7 +3870,8 @@ static void dt_set_xmp_dt_history(Exiv2::XmpData &xmpData, const int32_t imgid,
     {
       // this shouldn't fail in general, but reading is robust enough to allow it,
       // and flipping images from LT will result in this being left out
-      char *blendop_params = dt_exif_xmp_encode((const unsigned char *)blendop_blob, blendop_params_len, NULL);
+      char *blendop_params
+          = _exif_xmp_encode_cached((const unsigned char *)blendop_blob, blendop_params_len, mode);
       snprintf(key, sizeof(key), "Xmp.darktable.history[%d]/darktable:blendop_version", num);
       xmpData[key] = blendop_version;
       snprintf(key, sizeof(key), "Xmp.darktable.history[%d]/darktable:blendop_params", num);
@@ -4671,6 +4901,12 @@ void dt_exif_init()
 
 void dt_exif_cleanup()
 {
+  g_mutex_lock(&_xmp_cache_lock);
+  if(_xmp_cache) g_hash_table_destroy(_xmp_cache);
+  _xmp_cache = NULL;
+  _xmp_cache_size = 0;
+  g_mutex_unlock(&_xmp_cache_lock);
+
   Exiv2::XmpParser::terminate();
 }
 
@@ -476,6 +476,7 @@ void dt_film_remove(const int id)
   }
 
   // query is needed a second time for mipmap and image cache
+  GList *imgs = NULL;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "SELECT id FROM main.images WHERE film_id = ?1", -1,
                               &stmt, NULL);
@@ -484,10 +485,12 @@ void dt_film_remove(const int id)
   {
     const int32_t imgid = sqlite3_column_int(stmt, 0);
     dt_image_local_copy_reset(imgid);
-    dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
     dt_image_cache_remove(darktable.image_cache, imgid);
+    imgs = g_list_prepend(imgs, GINT_TO_POINTER(imgid));
   }
   sqlite3_finalize(stmt);
+  // the thumbnails files go from a background job
+  dt_mipmap_cache_remove_list(darktable.mipmap_cache, imgs);
 
   // due to foreign keys, all images with references to the film roll are deleted,
   // and likewise all entries with references to those images
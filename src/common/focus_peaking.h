@@ -42,9 +42,12 @@ static inline uint8_t float_to_uint8(const float i)
   return (uint8_t)(i * 255.0f);
 }
 
-static inline void dt_focuspeaking(cairo_t *cr, int width, int height,
-                                   uint8_t *const restrict image,
-                                   const int buf_width, const int buf_height)
+/* Compute the focus-peaking overlay of an ARGB32 image, as an ARGB32 buffer of the same size
+ * to be freed with dt_free_align(). It only depends on the image, so callers redrawing the same
+ * image can keep it and only paint it again with dt_focuspeaking_paint().
+ **/
+static inline uint8_t *dt_focuspeaking_compute(uint8_t *const restrict image,
+                                               const int buf_width, const int buf_height)
 {
   float *const restrict luma = dt_alloc_align_float((size_t)buf_width * buf_height);
   uint8_t *const restrict focus_peaking = dt_alloc_align(sizeof(uint8_t) * buf_width * buf_height * 4);
@@ -245,6 +248,16 @@ schedule(static) collapse(2) aligned(focus_peaking, luma:64) reduction(+:sigma)
       }
     }
 
+  dt_free_align(luma);
+  dt_free_align(luma_ds);
+  return focus_peaking;
+}
+
+static inline void dt_focuspeaking_paint(cairo_t *cr, uint8_t *const restrict focus_peaking,
+                                         const int buf_width, const int buf_height)
+{
+  if(!focus_peaking) return;
+
   // draw the focus peaking overlay
   cairo_save(cr);
   cairo_rectangle(cr, 0, 0, buf_width, buf_height);
@@ -258,10 +271,15 @@ schedule(static) collapse(2) aligned(focus_peaking, luma:64) reduction(+:sigma)
   cairo_fill(cr);
   cairo_restore(cr);
 
-  // cleanup
   cairo_surface_destroy(surface);
-  dt_free_align(luma);
-  dt_free_align(luma_ds);
+}
+
+static inline void dt_focuspeaking(cairo_t *cr, int width, int height,
+                                   uint8_t *const restrict image,
+                                   const int buf_width, const int buf_height)
+{
+  uint8_t *const restrict focus_peaking = dt_focuspeaking_compute(image, buf_width, buf_height);
+  dt_focuspeaking_paint(cr, focus_peaking, buf_width, buf_height);
   dt_free_align(focus_peaking);
 }
 
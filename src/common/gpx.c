@@ -38,6 +38,11 @@ typedef struct dt_gpx_t
   GList *trkpts;
   GList *trksegs;
 
+  /* the same track points in an array, sorted by time, for the lookups by timestamp */
+  dt_gpx_track_point_t **points;
+  gint64 *times; // microseconds since the epoch
+  guint nb_points;
+
   /* currently parsed track point */
   dt_gpx_track_point_t *current_track_point;
   _gpx_parser_element_t current_parser_element;
@@ -66,6 +71,24 @@ static gint _sort_track(gconstpointer a, gconstpointer b)
   return g_date_time_compare(pa->time, pb->time);
 }
 
+static inline gint64 _gpx_time(GDateTime *time)
+{
+  return g_date_time_to_unix(time) * G_USEC_PER_SEC + g_date_time_get_microsecond(time);
+}
+
+static void _gpx_index_points(dt_gpx_t *gpx)
+{
+  gpx->nb_points = g_list_length(gpx->trkpts);
+  gpx->points = g_malloc_n(gpx->nb_points, sizeof(dt_gpx_track_point_t *));
+  gpx->times = g_malloc_n(gpx->nb_points, sizeof(gint64));
+  guint k = 0;
+  for(GList *item = gpx->trkpts; item; item = g_list_next(item), k++)
+  {
+    gpx->points[k] = (dt_gpx_track_point_t *)item->data;
+    gpx->times[k] = _gpx_time(gpx->points[k]->time);
+  }
+}
+
 static gint _sort_segment(gconstpointer a, gconstpointer b)
 {
   const dt_gpx_track_segment_t *pa = (const dt_gpx_track_segment_t *)a;
@@ -106,6 +129,7 @@ dt_gpx_t *dt_gpx_new(const gchar *filename)
 
   gpx->trkpts = g_list_sort(gpx->trkpts, _sort_track);
   gpx->trksegs = g_list_sort(gpx->trksegs, _sort_segment);
+  _gpx_index_points(gpx);
 
   return gpx;
 
@@ -143,6 +167,8 @@ void dt_gpx_destroy(struct dt_gpx_t *gpx)
 
   if(gpx->trkpts) g_list_free_full(gpx->trkpts, (GDestroyNotify)_track_pts_free);
   if(gpx->trksegs) g_list_free_full(gpx->trksegs, (GDestroyNotify)_track_seg_free);
+  g_free(gpx->points);
+  g_free(gpx->times);
 
   g_free(gpx);
 }
@@ -152,100 +178,104 @@ gboolean dt_gpx_get_location(struct dt_gpx_t *gpx, GDateTime *timestamp, dt_imag
   g_assert(gpx != NULL);
 
   /* verify that we got at least 2 trackpoints */
-  if(g_list_shorter_than(gpx->trkpts,2)) return FALSE;
+  if(gpx->nb_points < 2) return FALSE;
+
+  /* if timestamp is out of time range return false but fill
+     closest location value start or end point */
+  const gint64 time = _gpx_time(timestamp);
+  const dt_gpx_track_point_t *closest = NULL;
+  if(time <= gpx->times[0])
+    closest = gpx->points[0];
+  else if(time >= gpx->times[gpx->nb_points - 1])
+    closest = gpx->points[gpx->nb_points - 1];
+  if(closest)
+  {
+    geoloc->longitude = closest->longitude;
+    geoloc->latitude = closest->latitude;
+    geoloc->elevation = closest->elevation;
+    return FALSE;
+  }
+
+  /* find the trackpoints around timestamp: times[low] < time <= times[low + 1] */
+  guint low = 0, high = gpx->nb_points - 1;
+  while(high - low > 1)
+  {
+    const guint mid = low + (high - low) / 2;
+    if(gpx->times[mid] < time)
+      low = mid;
+    else
+      high = mid;
+  }
 
-  for(GList *item = gpx->trkpts; item; item = g_list_next(item))
+  const dt_gpx_track_point_t *tp = gpx->points[low];
+  const dt_gpx_track_point_t *tp_next = gpx->points[high];
+  const GTimeSpan seg_diff = gpx->times[high] - gpx->times[low];
+  const GTimeSpan diff = time - gpx->times[low];
+  if(seg_diff == 0 || diff == 0)
+  {
+    geoloc->longitude = tp->longitude;
+    geoloc->latitude = tp->latitude;
+    geoloc->elevation = tp->elevation;
+  }
+  else
   {
-    dt_gpx_track_point_t *tp = (dt_gpx_track_point_t *)item->data;
+    /* get the point by interpolation according to timestamp
+
+    We assume that the maximum difference in longitude is less or equal 180º:
+    since the bigger use case is that of an airplane, never an airplane flies more than 180º in longitude */
+
+    const double lat1 = tp->latitude;
+    const double lon1 = tp->longitude;
+    const double lat2 = tp_next->latitude;
+    const double lon2 = tp_next->longitude;
+
+    double lat, lon;
 
-    /* if timestamp is out of time range return false but fill
-       closest location value start or end point */
-    const gint cmp = g_date_time_compare(timestamp, tp->time);
-    if((!item->next && cmp >= 0) || (cmp <= 0))
+    const double f = (double)diff / (double)seg_diff; /* the fraction of the distance */
+
+    if(fabs(lat2 - lat1) < DT_MINIMUM_ANGULAR_DELTA_FOR_GEODESIC
+        && fabs(lon2 - lon1) < DT_MINIMUM_ANGULAR_DELTA_FOR_GEODESIC)
     {
-      geoloc->longitude = tp->longitude;
-      geoloc->latitude = tp->latitude;
-      geoloc->elevation = tp->elevation;
-      return FALSE;
+      /* short distance (< 10 km), no need for geodesic interpolation */
+      lon = lon1 + (lon2 - lon1) * f;
+      lat = lat1 + (lat2 - lat1) * f;
     }
-
-    dt_gpx_track_point_t *tp_next = (dt_gpx_track_point_t *)item->next->data;
-    /* check if timestamp is within current and next trackpoint */
-    const gint cmp_n = g_date_time_compare(timestamp, tp_next->time);
-    if(item->next && cmp_n <= 0)
+    else
     {
-      GTimeSpan seg_diff = g_date_time_difference(tp_next->time, tp->time);
-      GTimeSpan diff = g_date_time_difference(timestamp, tp->time);
-      if(seg_diff == 0 || diff == 0)
-      {
-        geoloc->longitude = tp->longitude;
-        geoloc->latitude = tp->latitude;
-        geoloc->elevation = tp->elevation;
-      }
-      else
-      {
-        /* get the point by interpolation according to timestamp
-
-        We assume that the maximum difference in longitude is less or equal 180º:
-        since the bigger use case is that of an airplane, never an airplane flies more than 180º in longitude */
-
-        const double lat1 = tp->latitude;
-        const double lon1 = tp->longitude;
-        const double lat2 = tp_next->latitude;
-        const double lon2 = tp_next->longitude;
-
-        double lat, lon;
-
-        const double f = (double)diff / (double)seg_diff; /* the fraction of the distance */
-
-        if(fabs(lat2 - lat1) < DT_MINIMUM_ANGULAR_DELTA_FOR_GEODESIC
-            && fabs(lon2 - lon1) < DT_MINIMUM_ANGULAR_DELTA_FOR_GEODESIC)
-        {
-          /* short distance (< 10 km), no need for geodesic interpolation */
-          lon = lon1 + (lon2 - lon1) * f;
-          lat = lat1 + (lat2 - lat1) * f;
-        }
-        else
-        {
-          /* interpolation on the earth surface
-             formulas from http://www.movable-type.co.uk/scripts/latlong.html
-
-             the formulas are correct even if the two point are across the day line, e.g [(0, -179), (0,179)]
-             TO DO: in this case the line which is drawn is incorrect, but this should be a osm_gps issue
-          */
-
-          /* first, calculate the distance on the earth surface */
-          double d, delta;
-          dt_gpx_geodesic_distance(lat1, lon1,
-                                   lat2, lon2,
-                                   &d, &delta);
-          /* d is the distance on the surface in metres,
-             delta is the angle defined by the two points*/
-
-          /* then, calculate the intermediate point */
-          dt_gpx_geodesic_intermediate_point(lat1, lon1,
-                                             lat2, lon2,
-                                             delta,
-                                             TRUE,
-                                             f,
-                                             &lat, &lon);
-        }
-
-        geoloc->latitude = lat;
-        geoloc->longitude = lon;
-
-        /* make a simple linear interpolation on elevation */
-        if(tp_next->elevation == NAN || tp->elevation == NAN)
-          geoloc->elevation = NAN;
-        else
-          geoloc->elevation = tp->elevation + (tp_next->elevation - tp->elevation) * f;
-      }
-      return TRUE;
+      /* interpolation on the earth surface
+         formulas from http://www.movable-type.co.uk/scripts/latlong.html
+
+         the formulas are correct even if the two point are across the day line, e.g [(0, -179), (0,179)]
+         TO DO: in this case the line which is drawn is incorrect, but this should be a osm_gps issue
+      */
+
+      /* first, calculate the distance on the earth surface */
+      double d, delta;
+      dt_gpx_geodesic_distance(lat1, lon1,
+                               lat2, lon2,
+                               &d, &delta);
+      /* d is the distance on the surface in metres,
+         delta is the angle defined by the two points*/
+
+      /* then, calculate the intermediate point */
+      dt_gpx_geodesic_intermediate_point(lat1, lon1,
+                                         lat2, lon2,
+                                         delta,
+                                         TRUE,
+                                         f,
+                                         &lat, &lon);
     }
-  }
 
-  /* should not reach this point */
-  return FALSE;
+    geoloc->latitude = lat;
+    geoloc->longitude = lon;
+
+    /* make a simple linear interpolation on elevation */
+    if(isnan(tp_next->elevation) || isnan(tp->elevation))
+      geoloc->elevation = NAN;
+    else
+      geoloc->elevation = tp->elevation + (tp_next->elevation - tp->elevation) * f;
+  }
+  return TRUE;
 }
 
 /*
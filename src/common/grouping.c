@@ -130,11 +130,10 @@ int dt_grouping_change_representative(const int32_t image_id)
 GList *dt_grouping_get_group_images(const int32_t imgid)
 {
   GList *imgs = NULL;
-  const dt_image_t *image = dt_image_cache_get(darktable.image_cache, imgid, 'r');
-  if(image)
+  dt_image_snapshot_t image;
+  if(!dt_image_cache_get_snapshot(darktable.image_cache, imgid, &image))
   {
-    const int img_group_id = image->group_id;
-    dt_image_cache_read_release(darktable.image_cache, image);
+    const int img_group_id = image.group_id;
     if(darktable.gui && darktable.gui->grouping && darktable.gui->expanded_group_id != img_group_id)
     {
       sqlite3_stmt *stmt;
@@ -161,11 +160,10 @@ void dt_grouping_add_grouped_images(GList **images)
   GList *gimgs = NULL;
   for(GList *imgs = *images; imgs; imgs = g_list_next(imgs))
   {
-    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, GPOINTER_TO_INT(imgs->data), 'r');
-    if(image)
+    dt_image_snapshot_t image;
+    if(!dt_image_cache_get_snapshot(darktable.image_cache, GPOINTER_TO_INT(imgs->data), &image))
     {
-      const int img_group_id = image->group_id;
-      dt_image_cache_read_release(darktable.image_cache, image);
+      const int img_group_id = image.group_id;
       if(darktable.gui && darktable.gui->grouping && darktable.gui->expanded_group_id != img_group_id
          && dt_selection_get_collection(darktable.selection))
       {
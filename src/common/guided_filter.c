@@ -90,23 +90,19 @@ static inline float *get_color_pixel(color_image img, size_t i)
 }
 
 
-// apply guided filter to single-component image img using the 3-components image imgg as a guide
+// the coefficients of a tile are computed over blocks of this many columns and rows (or more for wide
+// windows), each thread sweeping down its block with running box sums, see guided_filter_block()
+#define GF_STRIP_WIDTH 64
+#define GF_BAND_HEIGHT 128
+
 // the filtering applies a monochrome box filter to a total of 13 image channels:
 //    1 monochrome input image
 //    3 color guide image
 //    3 covariance (R, G, B)
 //    6 variance (R-R, R-G, R-B, G-G, G-B, B-B)
-// for computational efficiency, we'll pack them into a four-channel image and a 9-channel image
-// image instead of running 13 separate box filters: guide+input, R/G/B/R-R/R-G/R-B/G-G/G-B/B-B.
-static void guided_filter_tiling(color_image imgg, gray_image img, gray_image img_out, tile target, const int w,
-                                 const float eps, const float guide_weight, const float min, const float max)
-{
-  const tile source = { max_i(target.left - 2 * w, 0), min_i(target.right + 2 * w, imgg.width),
-                        max_i(target.lower - 2 * w, 0), min_i(target.upper + 2 * w, imgg.height) };
-  const int width = source.right - source.left;
-  const int height = source.upper - source.lower;
-  size_t size = (size_t)width * (size_t)height;
-// since we're packing multiple monochrome planes into a color image, define symbolic constants so that
+// we keep them packed per pixel, the four means first and the nine (co)variances next
+#define GF_CHANNELS 13
+// since we're packing multiple monochrome planes per pixel, define symbolic constants so that
 // we can keep track of which values we're actually using
 #define INP_MEAN 0
 #define GUIDE_MEAN_R 1
@@ -121,116 +117,230 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
 #define VAR_GG 6
 #define VAR_BB 8
 #define VAR_GB 7
-  color_image mean = new_color_image(width, height, 4);
-  color_image variance = new_color_image(width, height, 9);
-  const size_t img_dimen = mean.width;
-  size_t img_bak_sz;
-  float *img_bak = dt_alloc_perthread_float(9*img_dimen, &img_bak_sz);
-#ifdef _OPENMP
-#pragma omp parallel for schedule(static) default(none) shared(img, imgg, mean, variance, img_bak) \
-  dt_omp_firstprivate(img_bak_sz, img_dimen, w, guide_weight) dt_omp_sharedconst(source)
-#endif
-  for(int j_imgg = source.lower; j_imgg < source.upper; j_imgg++)
+// the coefficients a_? and b
+#define A_RED 0
+#define A_GREEN 1
+#define A_BLUE 2
+#define B 3
+
+// solve for the coefficients a_r, a_g, a_b, b of the local linear model from the box means of the packed channels
+static inline void guided_filter_solve(const float *const restrict meanpx, const float *const restrict varpx,
+                                       const float eps, float *const restrict ab)
+{
+  const float inp_mean = meanpx[INP_MEAN];
+  const float guide_r = meanpx[GUIDE_MEAN_R];
+  const float guide_g = meanpx[GUIDE_MEAN_G];
+  const float guide_b = meanpx[GUIDE_MEAN_B];
+  // solve linear system of equations of size 3x3 via Cramer's rule
+  // symmetric coefficient matrix
+  const float Sigma_0_0 = varpx[VAR_RR] - (guide_r * guide_r) + eps;
+  const float Sigma_0_1 = varpx[VAR_RG] - (guide_r * guide_g);
+  const float Sigma_0_2 = varpx[VAR_RB] - (guide_r * guide_b);
+  const float Sigma_1_1 = varpx[VAR_GG] - (guide_g * guide_g) + eps;
+  const float Sigma_1_2 = varpx[VAR_GB] - (guide_g * guide_b);
+  const float Sigma_2_2 = varpx[VAR_BB] - (guide_b * guide_b) + eps;
+  const float det0 = Sigma_0_0 * (Sigma_1_1 * Sigma_2_2 - Sigma_1_2 * Sigma_1_2)
+    - Sigma_0_1 * (Sigma_0_1 * Sigma_2_2 - Sigma_0_2 * Sigma_1_2)
+    + Sigma_0_2 * (Sigma_0_1 * Sigma_1_2 - Sigma_0_2 * Sigma_1_1);
+  float a_r_, a_g_, a_b_, b_;
+  if(fabsf(det0) > 4.f * FLT_EPSILON)
   {
-    int j = j_imgg - source.lower;
-    float *const restrict meanpx = mean.data + 4 * j * mean.width;
-    float *const restrict varpx = variance.data + 9 * j * variance.width;
-    for(int i_imgg = source.left; i_imgg < source.right; i_imgg++)
-    {
-      size_t i = i_imgg - source.left;
-      const float *pixel_ = get_color_pixel(imgg, i_imgg + (size_t)j_imgg * imgg.width);
-      dt_aligned_pixel_t pixel =
-        { pixel_[0] * guide_weight, pixel_[1] * guide_weight, pixel_[2] * guide_weight, pixel_[3] * guide_weight };
-      const float input = img.data[i_imgg + (size_t)j_imgg * img.width];
-      meanpx[4*i+INP_MEAN] = input;
-      meanpx[4*i+GUIDE_MEAN_R] = pixel[0];
-      meanpx[4*i+GUIDE_MEAN_G] = pixel[1];
-      meanpx[4*i+GUIDE_MEAN_B] = pixel[2];
-      varpx[9*i+COV_R] = pixel[0] * input;
-      varpx[9*i+COV_G] = pixel[1] * input;
-      varpx[9*i+COV_B] = pixel[2] * input;
-      varpx[9*i+VAR_RR] = pixel[0] * pixel[0];
-      varpx[9*i+VAR_RG] = pixel[0] * pixel[1];
-      varpx[9*i+VAR_RB] = pixel[0] * pixel[2];
-      varpx[9*i+VAR_GG] = pixel[1] * pixel[1];
-      varpx[9*i+VAR_GB] = pixel[1] * pixel[2];
-      varpx[9*i+VAR_BB] = pixel[2] * pixel[2];
-    }
-    // apply horizontal pass of box mean filter while the cache is still hot
-    float *const restrict scratch = dt_get_perthread(img_bak, img_bak_sz);
-    dt_box_mean_horizontal(meanpx, mean.width, 4|BOXFILTER_KAHAN_SUM, w, scratch);
-    dt_box_mean_horizontal(varpx, variance.width, 9|BOXFILTER_KAHAN_SUM, w, scratch);
+    const float cov_r = varpx[COV_R] - guide_r * inp_mean;
+    const float cov_g = varpx[COV_G] - guide_g * inp_mean;
+    const float cov_b = varpx[COV_B] - guide_b * inp_mean;
+    const float det1 = cov_r * (Sigma_1_1 * Sigma_2_2 - Sigma_1_2 * Sigma_1_2)
+      - Sigma_0_1 * (cov_g * Sigma_2_2 - cov_b * Sigma_1_2)
+      + Sigma_0_2 * (cov_g * Sigma_1_2 - cov_b * Sigma_1_1);
+    const float det2 = Sigma_0_0 * (cov_g * Sigma_2_2 - cov_b * Sigma_1_2)
+      - cov_r * (Sigma_0_1 * Sigma_2_2 - Sigma_0_2 * Sigma_1_2)
+      + Sigma_0_2 * (Sigma_0_1 * cov_b - Sigma_0_2 * cov_g);
+    const float det3 = Sigma_0_0 * (Sigma_1_1 * cov_b - Sigma_1_2 * cov_g)
+      - Sigma_0_1 * (Sigma_0_1 * cov_b - Sigma_0_2 * cov_g)
+      + cov_r * (Sigma_0_1 * Sigma_1_2 - Sigma_0_2 * Sigma_1_1);
+    a_r_ = det1 / det0;
+    a_g_ = det2 / det0;
+    a_b_ = det3 / det0;
+    b_ = inp_mean - a_r_ * guide_r - a_g_ * guide_g - a_b_ * guide_b;
   }
-  dt_free_align(img_bak);
-  dt_box_mean_vertical(mean.data, mean.height, mean.width, 4|BOXFILTER_KAHAN_SUM, w);
-  dt_box_mean_vertical(variance.data, variance.height, variance.width, 9|BOXFILTER_KAHAN_SUM, w);
-  // we will recycle memory of 'mean' for the new coefficient arrays a_? and b to reduce memory foot print
-  color_image a_b = mean;
-  #define A_RED 0
-  #define A_GREEN 1
-  #define A_BLUE 2
-  #define B 3
-#ifdef _OPENMP
-#pragma omp parallel for schedule(static) default(none) \
-  dt_omp_firstprivate(size, eps) shared(mean, variance, a_b)
-#endif
-  for(size_t i = 0; i < size; i++)
+  else
   {
-    const float *meanpx = get_color_pixel(mean, i);
-    const float inp_mean = meanpx[INP_MEAN];
-    const float guide_r = meanpx[GUIDE_MEAN_R];
-    const float guide_g = meanpx[GUIDE_MEAN_G];
-    const float guide_b = meanpx[GUIDE_MEAN_B];
-    float *const varpx = get_color_pixel(variance, i);
-    // solve linear system of equations of size 3x3 via Cramer's rule
-    // symmetric coefficient matrix
-    const float Sigma_0_0 = varpx[VAR_RR] - (guide_r * guide_r) + eps;
-    const float Sigma_0_1 = varpx[VAR_RG] - (guide_r * guide_g);
-    const float Sigma_0_2 = varpx[VAR_RB] - (guide_r * guide_b);
-    const float Sigma_1_1 = varpx[VAR_GG] - (guide_g * guide_g) + eps;;
-    const float Sigma_1_2 = varpx[VAR_GB] - (guide_g * guide_b);
-    const float Sigma_2_2 = varpx[VAR_BB] - (guide_b * guide_b) + eps;
-    const float det0 = Sigma_0_0 * (Sigma_1_1 * Sigma_2_2 - Sigma_1_2 * Sigma_1_2)
-      - Sigma_0_1 * (Sigma_0_1 * Sigma_2_2 - Sigma_0_2 * Sigma_1_2)
-      + Sigma_0_2 * (Sigma_0_1 * Sigma_1_2 - Sigma_0_2 * Sigma_1_1);
-    float a_r_, a_g_, a_b_, b_;
-    if(fabsf(det0) > 4.f * FLT_EPSILON)
+    // linear system is singular
+    a_r_ = 0.f;
+    a_g_ = 0.f;
+    a_b_ = 0.f;
+    b_ = inp_mean;
+  }
+  ab[A_RED] = a_r_;
+  ab[A_GREEN] = a_g_;
+  ab[A_BLUE] = a_b_;
+  ab[B] = b_;
+}
+
+// floats of scratch space needed per thread by guided_filter_block() for blocks up to strip x band pixels
+static inline size_t guided_filter_block_size(const int strip, const int band, const int w)
+{
+  const size_t ring_rows = min_i(2 * w + 1, band + 2 * w);
+  // running column sums (in double), products of one row, horizontal means of the rows in the window
+  return GF_CHANNELS * (2 * (size_t)strip + (strip + 2 * (size_t)w) + ring_rows * strip);
+}
+
+// box means of the 13 packed channels of row j (relative to the source tile) over the columns of the block
+static inline void guided_filter_block_row(const color_image imgg, const gray_image img, const tile source,
+                                           const tile block, const int j, const int w, const float guide_weight,
+                                           float *const restrict products, float *const restrict hmean)
+{
+  const int width = source.right - source.left;
+  const int x0 = max_i(block.left - w, 0);
+  const int x1 = min_i(block.right + w, width);
+  const int j_imgg = source.lower + j;
+  for(int i = x0; i < x1; i++)
+  {
+    const size_t k = source.left + i + (size_t)j_imgg * imgg.width;
+    const float *pixel_ = get_color_pixel(imgg, k);
+    const float r = pixel_[0] * guide_weight;
+    const float g = pixel_[1] * guide_weight;
+    const float b = pixel_[2] * guide_weight;
+    const float input = img.data[source.left + i + (size_t)j_imgg * img.width];
+    float *const restrict px = products + GF_CHANNELS * (i - x0);
+    float *const restrict varpx = px + 4;
+    px[INP_MEAN] = input;
+    px[GUIDE_MEAN_R] = r;
+    px[GUIDE_MEAN_G] = g;
+    px[GUIDE_MEAN_B] = b;
+    varpx[COV_R] = r * input;
+    varpx[COV_G] = g * input;
+    varpx[COV_B] = b * input;
+    varpx[VAR_RR] = r * r;
+    varpx[VAR_RG] = r * g;
+    varpx[VAR_RB] = r * b;
+    varpx[VAR_GG] = g * g;
+    varpx[VAR_GB] = g * b;
+    varpx[VAR_BB] = b * b;
+  }
+
+  // running horizontal sums, in double so that adding and removing values doesn't drift
+  double sum[GF_CHANNELS] = { 0.0 };
+  for(int i = x0; i <= min_i(block.left + w, width - 1); i++)
+    for(int c = 0; c < GF_CHANNELS; c++) sum[c] += products[GF_CHANNELS * (i - x0) + c];
+  for(int i = block.left; i < block.right; i++)
+  {
+    const int in = i + w;
+    const int out = i - w - 1;
+    if(i > block.left && in < width)
+      for(int c = 0; c < GF_CHANNELS; c++) sum[c] += products[GF_CHANNELS * (in - x0) + c];
+    if(i > block.left && out >= 0)
+      for(int c = 0; c < GF_CHANNELS; c++) sum[c] -= products[GF_CHANNELS * (out - x0) + c];
+    const double hits = min_i(i + w, width - 1) - max_i(i - w, 0) + 1;
+    float *const restrict mean = hmean + GF_CHANNELS * (i - block.left);
+    for(int c = 0; c < GF_CHANNELS; c++) mean[c] = sum[c] / hits;
+  }
+}
+
+// compute the coefficients a_r, a_g, a_b, b of the pixels of a block of the source tile in one sweep:
+// the products of the guide and input are box-filtered horizontally one row at a time, and vertically by
+// running column sums over a ring of the last 2*w+1 rows, so that nothing larger than a few rows of the
+// block ever leaves the cache before the coefficients are solved.
+static void guided_filter_block(const color_image imgg, const gray_image img, const tile source, const tile block,
+                                const int w, const float eps, const float guide_weight, color_image a_b,
+                                float *const restrict scratch)
+{
+  const int width = source.right - source.left;
+  const int height = source.upper - source.lower;
+  const int bw = block.right - block.left;
+  const int y0 = max_i(block.lower - w, 0);
+  const int y1 = min_i(block.upper + w, height);
+  // no more rows than that are ever in a window at the same time
+  const int ring_rows = min_i(2 * w + 1, y1 - y0);
+
+  double *const restrict colsum = (double *)scratch;
+  float *const restrict products = scratch + 2 * GF_CHANNELS * bw;
+  float *const restrict ring = products + GF_CHANNELS * (bw + 2 * w);
+  memset(colsum, 0, sizeof(double) * GF_CHANNELS * bw);
+
+  int first = y0; // oldest row in the column sums
+  int next = y0;  // next row to add to the column sums
+  for(int j = block.lower; j < block.upper; j++)
+  {
+    const int top = max_i(j - w, 0);
+    const int bottom = min_i(j + w, height - 1);
+    // drop the rows leaving the window before their slots of the ring are reused
+    for(; first < top; first++)
+    {
+      const float *const restrict row = ring + (size_t)GF_CHANNELS * bw * (first % ring_rows);
+      for(size_t k = 0; k < (size_t)GF_CHANNELS * bw; k++) colsum[k] -= row[k];
+    }
+    for(; next <= bottom; next++)
     {
-      const float cov_r = varpx[COV_R] - guide_r * inp_mean;
-      const float cov_g = varpx[COV_G] - guide_g * inp_mean;
-      const float cov_b = varpx[COV_B] - guide_b * inp_mean;
-      const float det1 = cov_r * (Sigma_1_1 * Sigma_2_2 - Sigma_1_2 * Sigma_1_2)
-        - Sigma_0_1 * (cov_g * Sigma_2_2 - cov_b * Sigma_1_2)
-        + Sigma_0_2 * (cov_g * Sigma_1_2 - cov_b * Sigma_1_1);
-      const float det2 = Sigma_0_0 * (cov_g * Sigma_2_2 - cov_b * Sigma_1_2)
-        - cov_r * (Sigma_0_1 * Sigma_2_2 - Sigma_0_2 * Sigma_1_2)
-        + Sigma_0_2 * (Sigma_0_1 * cov_b - Sigma_0_2 * cov_g);
-      const float det3 = Sigma_0_0 * (Sigma_1_1 * cov_b - Sigma_1_2 * cov_g)
-        - Sigma_0_1 * (Sigma_0_1 * cov_b - Sigma_0_2 * cov_g)
-        + cov_r * (Sigma_0_1 * Sigma_1_2 - Sigma_0_2 * Sigma_1_1);
-      a_r_ = det1 / det0;
-      a_g_ = det2 / det0;
-      a_b_ = det3 / det0;
-      b_ = inp_mean - a_r_ * guide_r - a_g_ * guide_g - a_b_ * guide_b;
+      float *const restrict row = ring + (size_t)GF_CHANNELS * bw * (next % ring_rows);
+      guided_filter_block_row(imgg, img, source, block, next, w, guide_weight, products, row);
+      for(size_t k = 0; k < (size_t)GF_CHANNELS * bw; k++) colsum[k] += row[k];
     }
-    else
+
+    const double hits = bottom - top + 1;
+    for(int i = 0; i < bw; i++)
     {
-      // linear system is singular
-      a_r_ = 0.f;
-      a_g_ = 0.f;
-      a_b_ = 0.f;
-      b_ = get_color_pixel(mean, i)[INP_MEAN];
+      float mean[GF_CHANNELS];
+      for(int c = 0; c < GF_CHANNELS; c++) mean[c] = colsum[GF_CHANNELS * i + c] / hits;
+      float *const ab = get_color_pixel(a_b, block.left + i + (size_t)j * width);
+      guided_filter_solve(mean, mean + 4, eps, ab);
     }
-    // now data of imgg_mean_? is no longer needed, we can safely overwrite aliasing arrays
-    a_b.data[4*i+A_RED] = a_r_;
-    a_b.data[4*i+A_GREEN] = a_g_;
-    a_b.data[4*i+A_BLUE] = a_b_;
-    a_b.data[4*i+B] = b_;
   }
-  free_color_image(&variance);
+}
+
+// apply guided filter to single-component image img using the 3-components image imgg as a guide
+// if ab_out is not NULL, the averaged coefficients a_r, a_g, a_b, b of the target are copied there
+// instead of the filtered image.
+static void guided_filter_tiling(color_image imgg, gray_image img, gray_image img_out, float *const ab_out,
+                                 tile target, const int w, const float eps, const float guide_weight,
+                                 const float min, const float max)
+{
+  const tile source = { max_i(target.left - 2 * w, 0), min_i(target.right + 2 * w, imgg.width),
+                        max_i(target.lower - 2 * w, 0), min_i(target.upper + 2 * w, imgg.height) };
+  const int width = source.right - source.left;
+  const int height = source.upper - source.lower;
+  color_image a_b = new_color_image(width, height, 4);
+
+  // wider blocks for wider windows so the overlap of the horizontal passes stays reasonable, but not so wide
+  // that the ring of rows overflows the cache
+  const int strip = CLAMP(2 * w, GF_STRIP_WIDTH, 4 * GF_STRIP_WIDTH);
+  const int band = max_i(4 * w, GF_BAND_HEIGHT);
+  const int strips = (width + strip - 1) / strip;
+  const int bands = (height + band - 1) / band;
+  size_t scratch_sz;
+  float *const scratch_buffers = dt_alloc_perthread_float(guided_filter_block_size(strip, band, w), &scratch_sz);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) default(none) shared(img, imgg, a_b) \
+  dt_omp_firstprivate(scratch_buffers, scratch_sz, strip, band, strips, bands, width, height, w, eps, \
+                      guide_weight) dt_omp_sharedconst(source)
+#endif
+  for(int k = 0; k < strips * bands; k++)
+  {
+    const int i = (k % strips) * strip;
+    const int j = (k / strips) * band;
+    const tile block = { i, min_i(i + strip, width), j, min_i(j + band, height) };
+    float *const restrict scratch = dt_get_perthread(scratch_buffers, scratch_sz);
+    guided_filter_block(imgg, img, source, block, w, eps, guide_weight, a_b, scratch);
+  }
+  dt_free_align(scratch_buffers);
 
   dt_box_mean(a_b.data, a_b.height, a_b.width, a_b.stride|BOXFILTER_KAHAN_SUM, w, 1);
 
+  if(ab_out)
+  {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) default(none) \
+  shared(target, imgg, a_b) dt_omp_sharedconst(source) dt_omp_firstprivate(ab_out, width)
+#endif
+    for(int j_imgg = target.lower; j_imgg < target.upper; j_imgg++)
+    {
+      const size_t k = (target.left - source.left) + (size_t)(j_imgg - source.lower) * width;
+      const size_t l = target.left + (size_t)j_imgg * imgg.width;
+      memcpy(ab_out + 4 * l, get_color_pixel(a_b, k), sizeof(float) * 4 * (target.right - target.left));
+    }
+    free_color_image(&a_b);
+    return;
+  }
+
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) \
   shared(target, imgg, a_b, img_out) dt_omp_sharedconst(source) dt_omp_firstprivate(min, max, width, guide_weight)
@@ -252,7 +362,7 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
       img_out.data[i_imgg + (size_t)j_imgg * imgg.width] = CLAMP(res, min, max);
     }
   }
-  free_color_image(&mean);
+  free_color_image(&a_b);
 }
 
 static int compute_tile_height(const int height, const int w)
@@ -327,7 +437,30 @@ void guided_filter(const float *const guide, const float *const in, float *const
     for(int i = 0; i < width; i += tile_width)
     {
       tile target = { i, min_i(i + tile_width, width), j, min_i(j + tile_height, height) };
-      guided_filter_tiling(img_guide, img_in, img_out, target, w, eps, guide_weight, min, max);
+      guided_filter_tiling(img_guide, img_in, img_out, NULL, target, w, eps, guide_weight, min, max);
+    }
+  }
+}
+
+void guided_filter_coefficients(const float *const guide, const float *const in, float *const ab,
+                                const int width, const int height, const int ch, const int w,
+                                const float sqrt_eps, const float guide_weight)
+{
+  assert(ch >= 3);
+  assert(w >= 1);
+
+  color_image img_guide = (color_image){ (float *)guide, width, height, ch };
+  gray_image img_in = (gray_image){ (float *)in, width, height };
+  const int tile_width = compute_tile_width(width, w);
+  const int tile_height = compute_tile_height(height, w);
+  const float eps = sqrt_eps * sqrt_eps;
+
+  for(int j = 0; j < height; j += tile_height)
+  {
+    for(int i = 0; i < width; i += tile_width)
+    {
+      tile target = { i, min_i(i + tile_width, width), j, min_i(j + tile_height, height) };
+      guided_filter_tiling(img_guide, img_in, img_in, ab, target, w, eps, guide_weight, -FLT_MAX, FLT_MAX);
     }
   }
 }
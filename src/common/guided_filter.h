@@ -83,6 +83,12 @@ static inline int max_i(int a, int b)
 void guided_filter(const float *guide, const float *in, float *out, int width, int height, int ch, int w,
                    float sqrt_eps, float guide_weight, float min, float max);
 
+// same as guided_filter() but returns the box-averaged coefficients of the local linear models instead of
+// the filtered image, as 4 floats a_r, a_g, a_b, b per pixel, such that out = guide_weight * a . guide + b.
+// Computed on downscaled images and upsampled, they make the fast guided filter of He & Sun, 2015.
+void guided_filter_coefficients(const float *guide, const float *in, float *ab, int width, int height, int ch,
+                                int w, float sqrt_eps, float guide_weight);
+
 #ifdef HAVE_OPENCL
 
 typedef struct dt_guided_filter_cl_global_t
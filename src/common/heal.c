@@ -35,8 +35,9 @@
  * corrected, I1 is the reference pattern. Then we solve DeltaI=0
  * (Laplace) with I2 Dirichlet conditions at the borders of the
  * mask. The solver is a red/black checker Gauss-Seidel with over-relaxation.
- * It could benefit from a multi-grid evaluation of an initial solution
- * before the main iteration loop.
+ * The initial solution comes from a multi-grid evaluation: the problem
+ * is halved down to a few pixels, solved there, and each level is
+ * interpolated and relaxed on the next finer one (see _heal_multigrid()).
  *
  * I reduced the convergence criteria to 0.1% (0.001) as we are
  * dealing here with RGB integer components, more is overkill.
@@ -45,18 +46,206 @@
  */
 
 
-// Subtract bottom from top and store in result as a float; separate 'red' and 'black' pixels into
-// two contiguous regions
-static void _heal_sub(const float *const top_buffer, const float *const bottom_buffer,
-                      float *const restrict red_buffer, float *const restrict black_buffer,
+#define HEAL_MG_LEVELS 12         // max number of levels of the multi-grid
+#define HEAL_MG_MIN_SIZE 8        // don't halve levels that are narrower than that
+#define HEAL_MG_COARSEST_ITER 64  // relaxation sweeps on the coarsest level
+#define HEAL_MG_SMOOTH_ITER 8     // relaxation sweeps on the other coarse levels
+
+// Subtract bottom from top in place
+static void _heal_sub(float *const restrict top_buffer, const float *const restrict bottom_buffer,
                       const size_t width, const size_t height)
+{
+  const size_t npixels = width * height;
+#ifdef _OPENMP
+#pragma omp parallel for simd aligned(top_buffer, bottom_buffer : 16) default(none) \
+  dt_omp_firstprivate(top_buffer, bottom_buffer, npixels) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < 4 * npixels; k++)
+    top_buffer[k] -= bottom_buffer[k];
+}
+
+// over-relaxation factor of a level with nmask unknowns.
+// Empirically optimal. (Benchmarked on round brushes, at least.
+// I don't know whether aspect ratio affects it.)
+static inline float _heal_omega(const size_t nmask)
+{
+  return (2.0f - 1.0f / (0.1575f * sqrtf(nmask) + 0.8f)) * .25f;
+}
+
+// the mask of a coarse level: unknown where all the pixels below it are unknown
+static size_t _heal_restrict_mask(const float *const restrict fine, const int fwidth, const int fheight,
+                                  float *const restrict coarse, const int cwidth, const int cheight)
+{
+  size_t nmask = 0;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(fine, fwidth, fheight, coarse, cwidth, cheight) \
+  reduction(+ : nmask) schedule(static)
+#endif
+  for(int y = 0; y < cheight; y++)
+    for(int x = 0; x < cwidth; x++)
+    {
+      int masked = 1;
+      for(int j = 2 * y; j < MIN(2 * y + 2, fheight); j++)
+        for(int i = 2 * x; i < MIN(2 * x + 2, fwidth); i++)
+          if(!fine[(size_t)j * fwidth + i]) masked = 0;
+      coarse[(size_t)y * cwidth + x] = masked;
+      nmask += masked;
+    }
+  return nmask;
+}
+
+// the known pixels of a coarse level: the mean of the known pixels below them
+static void _heal_restrict(const float *const restrict fine, const float *const restrict fmask, const int fwidth,
+                           const int fheight, float *const restrict coarse, const float *const restrict cmask,
+                           const int cwidth, const int cheight)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(fine, fmask, fwidth, fheight, coarse, cmask, cwidth, cheight) \
+  schedule(static)
+#endif
+  for(int y = 0; y < cheight; y++)
+    for(int x = 0; x < cwidth; x++)
+    {
+      const size_t k = (size_t)y * cwidth + x;
+      dt_aligned_pixel_t sum = { 0.0f };
+      int count = 0;
+      if(!cmask[k])
+        for(int j = 2 * y; j < MIN(2 * y + 2, fheight); j++)
+          for(int i = 2 * x; i < MIN(2 * x + 2, fwidth); i++)
+          {
+            const size_t l = (size_t)j * fwidth + i;
+            if(fmask[l]) continue;
+            for_each_channel(c) sum[c] += fine[4 * l + c];
+            count++;
+          }
+      const float norm = count ? 1.0f / count : 0.0f;
+      for_each_channel(c) coarse[4 * k + c] = sum[c] * norm;
+    }
+}
+
+// bilinear interpolation of the coarse level into the unknown pixels of the finer one
+static void _heal_prolong(const float *const restrict coarse, const int cwidth, const int cheight,
+                          float *const restrict fine, const float *const restrict fmask, const int fwidth,
+                          const int fheight)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(coarse, cwidth, cheight, fine, fmask, fwidth, fheight) \
+  schedule(static)
+#endif
+  for(int y = 0; y < fheight; y++)
+  {
+    const float cy = CLAMP(0.5f * y - 0.25f, 0.0f, cheight - 1);
+    const int y0 = MIN((int)cy, cheight - 2 < 0 ? 0 : cheight - 2);
+    const int y1 = MIN(y0 + 1, cheight - 1);
+    const float wy = cy - y0;
+    for(int x = 0; x < fwidth; x++)
+    {
+      const size_t k = (size_t)y * fwidth + x;
+      if(!fmask[k]) continue;
+      const float cx = CLAMP(0.5f * x - 0.25f, 0.0f, cwidth - 1);
+      const int x0 = MIN((int)cx, cwidth - 2 < 0 ? 0 : cwidth - 2);
+      const int x1 = MIN(x0 + 1, cwidth - 1);
+      const float wx = cx - x0;
+      const float *const p00 = coarse + 4 * ((size_t)y0 * cwidth + x0);
+      const float *const p01 = coarse + 4 * ((size_t)y0 * cwidth + x1);
+      const float *const p10 = coarse + 4 * ((size_t)y1 * cwidth + x0);
+      const float *const p11 = coarse + 4 * ((size_t)y1 * cwidth + x1);
+      for_each_channel(c)
+        fine[4 * k + c] = (1.0f - wy) * ((1.0f - wx) * p00[c] + wx * p01[c]) + wy * ((1.0f - wx) * p10[c] + wx * p11[c]);
+    }
+  }
+}
+
+// one red/black Gauss-Seidel sweep with over-relaxation of a coarse level, same update as
+// _heal_laplace_iteration() but on interleaved pixels
+static void _heal_relax(float *const restrict pixels, const float *const restrict mask, const int width,
+                        const int height, const float w)
+{
+  for(int parity = 0; parity < 2; parity++)
+  {
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(pixels, mask, width, height, w, parity) \
+  schedule(static)
+#endif
+    for(int y = 0; y < height; y++)
+      for(int x = (y + parity) & 1; x < width; x += 2)
+      {
+        const size_t k = (size_t)y * width + x;
+        if(!mask[k]) continue;
+        dt_aligned_pixel_t sum = { 0.0f };
+        float a = 0.0f;
+        if(y > 0)          { for_each_channel(c) sum[c] += pixels[4 * (k - width) + c]; a += 1.0f; }
+        if(y < height - 1) { for_each_channel(c) sum[c] += pixels[4 * (k + width) + c]; a += 1.0f; }
+        if(x > 0)          { for_each_channel(c) sum[c] += pixels[4 * (k - 1) + c]; a += 1.0f; }
+        if(x < width - 1)  { for_each_channel(c) sum[c] += pixels[4 * (k + 1) + c]; a += 1.0f; }
+        for_each_channel(c) pixels[4 * k + c] -= w * (a * pixels[4 * k + c] - sum[c]);
+      }
+  }
+}
+
+// Initial solution of the laplace equation in the unknown pixels of the interleaved buffer:
+// solve it on a pyramid of halved levels, from the coarsest one up.
+static void _heal_multigrid(float *const pixels, const float *const mask, const int width, const int height)
+{
+  float *lpixels[HEAL_MG_LEVELS] = { pixels };
+  float *lmask[HEAL_MG_LEVELS] = { (float *)mask };
+  int lwidth[HEAL_MG_LEVELS] = { width };
+  int lheight[HEAL_MG_LEVELS] = { height };
+  size_t lnmask[HEAL_MG_LEVELS] = { 0 };
+  int levels = 1;
+
+  while(levels < HEAL_MG_LEVELS && lwidth[levels - 1] >= 2 * HEAL_MG_MIN_SIZE
+        && lheight[levels - 1] >= 2 * HEAL_MG_MIN_SIZE)
+  {
+    const int l = levels;
+    lwidth[l] = (lwidth[l - 1] + 1) / 2;
+    lheight[l] = (lheight[l - 1] + 1) / 2;
+    lpixels[l] = dt_alloc_align_float((size_t)4 * lwidth[l] * lheight[l]);
+    lmask[l] = dt_alloc_align_float((size_t)lwidth[l] * lheight[l]);
+    if(!lpixels[l] || !lmask[l])
+    {
+      dt_free_align(lpixels[l]);
+      dt_free_align(lmask[l]);
+      break;
+    }
+    lnmask[l] = _heal_restrict_mask(lmask[l - 1], lwidth[l - 1], lheight[l - 1], lmask[l], lwidth[l], lheight[l]);
+    _heal_restrict(lpixels[l - 1], lmask[l - 1], lwidth[l - 1], lheight[l - 1], lpixels[l], lmask[l], lwidth[l],
+                   lheight[l]);
+    levels++;
+    // nothing left to solve below
+    if(lnmask[l] == 0) break;
+  }
+
+  for(int l = levels - 1; l > 0; l--)
+  {
+    const int iter = (l == levels - 1) ? HEAL_MG_COARSEST_ITER : HEAL_MG_SMOOTH_ITER;
+    if(lnmask[l])
+    {
+      const float w = _heal_omega(lnmask[l]);
+      for(int i = 0; i < iter; i++) _heal_relax(lpixels[l], lmask[l], lwidth[l], lheight[l], w);
+    }
+    _heal_prolong(lpixels[l], lwidth[l], lheight[l], lpixels[l - 1], lmask[l - 1], lwidth[l - 1], lheight[l - 1]);
+    dt_free_align(lpixels[l]);
+    dt_free_align(lmask[l]);
+  }
+}
+
+// separate 'red' and 'black' pixels into two contiguous regions
+static void _heal_split(const float *const top_buffer,
+                        float *const restrict red_buffer, float *const restrict black_buffer,
+                        const size_t width, const size_t height)
 {
   // how many red or black pixels per line?  For consistency, we need the larger of the two, so round up
   const size_t res_stride = 4 * ((width + 1) / 2);
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(top_buffer, bottom_buffer, red_buffer, black_buffer, height, width, res_stride) \
+  dt_omp_firstprivate(top_buffer, red_buffer, black_buffer, height, width, res_stride) \
   schedule(static)
 #endif
   for(size_t row = 0; row < height; row++)
@@ -71,8 +260,8 @@ static void _heal_sub(const float *const top_buffer, const float *const bottom_b
       const size_t idx = 4 * (row * width + 2*col);
       for_each_channel(c)
       {
-        buf1[4*col + c] = top_buffer[idx + c] - bottom_buffer[idx + c];
-        buf2[4*col + c] = top_buffer[idx+4 + c] - bottom_buffer[idx+4 + c];
+        buf1[4*col + c] = top_buffer[idx + c];
+        buf2[4*col + c] = top_buffer[idx+4 + c];
       }
     }
     if(width & 1)
@@ -83,7 +272,7 @@ static void _heal_sub(const float *const top_buffer, const float *const bottom_b
       const size_t idx = 4 * (row * width + (width-1));
       for_each_channel(c)
       {
-        buf1[4*res_idx + c] = top_buffer[idx + c] - bottom_buffer[idx + c];
+        buf1[4*res_idx + c] = top_buffer[idx + c];
         buf2[4*res_idx + c] = 0.0f;
       }
     }
@@ -352,11 +541,7 @@ static void _heal_laplace_loop(float *const restrict red_pixels, float *const re
   }
   const size_t nmask = nmask_red + nmask_black;
 
-  /* Empirically optimal over-relaxation factor. (Benchmarked on
-   * round brushes, at least. I don't know whether aspect ratio
-   * affects it.)
-   */
-  const float w = ((2.0f - 1.0f / (0.1575f * sqrtf(nmask) + 0.8f)) * .25f);
+  const float w = _heal_omega(nmask);
 
   const float epsilon = (0.1 / 255);
   const float err_exit = epsilon * epsilon * w * w;
@@ -399,8 +584,10 @@ void dt_heal(const float *const src_buffer, float *dest_buffer, const float *con
     goto cleanup;
   }
 
-  /* subtract pattern from image and store the result split by 'red' and 'black' positions  */
-  _heal_sub(dest_buffer, src_buffer, red_buffer, black_buffer, width, height);
+  /* subtract pattern from image, get an initial solution and store the result split by 'red' and 'black' positions  */
+  _heal_sub(dest_buffer, src_buffer, width, height);
+  _heal_multigrid(dest_buffer, mask_buffer, width, height);
+  _heal_split(dest_buffer, red_buffer, black_buffer, width, height);
 
   _heal_laplace_loop(red_buffer, black_buffer, width, height, mask_buffer, max_iter);
 
@@ -414,10 +601,19 @@ cleanup:
 
 #ifdef HAVE_OPENCL
 
+#define HEAL_CL_CHECK_ITER 16     // read the convergence error back only every that many iterations
+
 dt_heal_cl_global_t *dt_heal_init_cl_global()
 {
   dt_heal_cl_global_t *g = (dt_heal_cl_global_t *)malloc(sizeof(dt_heal_cl_global_t));
 
+  const int program = 37; // heal.cl, from programs.conf
+  g->kernel_heal_sub = dt_opencl_create_kernel(program, "heal_sub");
+  g->kernel_heal_add = dt_opencl_create_kernel(program, "heal_add");
+  g->kernel_heal_restrict = dt_opencl_create_kernel(program, "heal_restrict");
+  g->kernel_heal_prolong = dt_opencl_create_kernel(program, "heal_prolong");
+  g->kernel_heal_relax = dt_opencl_create_kernel(program, "heal_relax");
+  g->kernel_heal_row_sum = dt_opencl_create_kernel(program, "heal_row_sum");
   return g;
 }
 
@@ -425,6 +621,12 @@ void dt_heal_free_cl_global(dt_heal_cl_global_t *g)
 {
   if(!g) return;
 
+  dt_opencl_free_kernel(g->kernel_heal_sub);
+  dt_opencl_free_kernel(g->kernel_heal_add);
+  dt_opencl_free_kernel(g->kernel_heal_restrict);
+  dt_opencl_free_kernel(g->kernel_heal_prolong);
+  dt_opencl_free_kernel(g->kernel_heal_relax);
+  dt_opencl_free_kernel(g->kernel_heal_row_sum);
   free(g);
 }
 
@@ -450,58 +652,187 @@ void dt_heal_free_cl(heal_params_cl_t *p)
   free(p);
 }
 
+// dest = dest -/+ src
+static cl_int _heal_cl_combine(const int devid, const int kernel, cl_mem dev_dest, cl_mem dev_src, const int width,
+                               const int height)
+{
+  size_t sizes[] = { ROUNDUPDWD(width, devid), ROUNDUPDHT(height, devid), 1 };
+  dt_opencl_set_kernel_arg(devid, kernel, 0, sizeof(cl_mem), (void *)&dev_dest);
+  dt_opencl_set_kernel_arg(devid, kernel, 1, sizeof(cl_mem), (void *)&dev_src);
+  dt_opencl_set_kernel_arg(devid, kernel, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, kernel, 3, sizeof(int), (void *)&height);
+  return dt_opencl_enqueue_kernel_2d(devid, kernel, sizes);
+}
+
+// one red/black sweep, like _heal_relax()
+static cl_int _heal_cl_relax(const int devid, const int kernel, cl_mem dev_pixels, cl_mem dev_mask, const int width,
+                             const int height, const float w, cl_mem dev_err, const int with_err)
+{
+  size_t sizes[] = { ROUNDUPDWD(width, devid), ROUNDUPDHT(height, devid), 1 };
+  cl_int err = CL_SUCCESS;
+  for(int parity = 0; parity < 2 && err == CL_SUCCESS; parity++)
+  {
+    dt_opencl_set_kernel_arg(devid, kernel, 0, sizeof(cl_mem), (void *)&dev_pixels);
+    dt_opencl_set_kernel_arg(devid, kernel, 1, sizeof(cl_mem), (void *)&dev_mask);
+    dt_opencl_set_kernel_arg(devid, kernel, 2, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, kernel, 3, sizeof(int), (void *)&height);
+    dt_opencl_set_kernel_arg(devid, kernel, 4, sizeof(float), (void *)&w);
+    dt_opencl_set_kernel_arg(devid, kernel, 5, sizeof(int), (void *)&parity);
+    dt_opencl_set_kernel_arg(devid, kernel, 6, sizeof(cl_mem), (void *)&dev_err);
+    dt_opencl_set_kernel_arg(devid, kernel, 7, sizeof(int), (void *)&with_err);
+    err = dt_opencl_enqueue_kernel_2d(devid, kernel, sizes);
+  }
+  return err;
+}
+
+// same solver as dt_heal(), except that the finest level is relaxed on interleaved pixels too
 cl_int dt_heal_cl(heal_params_cl_t *p, cl_mem dev_src, cl_mem dev_dest, const float *const mask_buffer,
                   const int width, const int height, const int max_iter)
 {
+  const int devid = p->devid;
+  const dt_heal_cl_global_t *gd = p->global;
   cl_int err = CL_SUCCESS;
 
-  const int ch = 4;
+  // the masks of the levels are built on the host, their counts give the over-relaxation factors
+  float *lmask[HEAL_MG_LEVELS] = { (float *)mask_buffer };
+  cl_mem dev_pixels[HEAL_MG_LEVELS] = { dev_dest };
+  cl_mem dev_mask[HEAL_MG_LEVELS] = { NULL };
+  int lwidth[HEAL_MG_LEVELS] = { width };
+  int lheight[HEAL_MG_LEVELS] = { height };
+  size_t lnmask[HEAL_MG_LEVELS] = { 0 };
+  int levels = 1;
+
+  cl_mem dev_err = NULL;
+  cl_mem dev_sums = NULL;
+  float *sums = NULL;
 
-  float *src_buffer = NULL;
-  float *dest_buffer = NULL;
+  for(size_t k = 0; k < (size_t)width * height; k++) lnmask[0] += mask_buffer[k] != 0.0f;
+  if(lnmask[0] == 0) goto cleanup;
 
-  src_buffer = dt_alloc_align_float((size_t)ch * width * height);
-  if(src_buffer == NULL)
+  while(levels < HEAL_MG_LEVELS && lwidth[levels - 1] >= 2 * HEAL_MG_MIN_SIZE
+        && lheight[levels - 1] >= 2 * HEAL_MG_MIN_SIZE)
   {
-    fprintf(stderr, "dt_heal_cl: error allocating memory for healing\n");
-    err = DT_OPENCL_SYSMEM_ALLOCATION;
-    goto cleanup;
+    const int l = levels;
+    lwidth[l] = (lwidth[l - 1] + 1) / 2;
+    lheight[l] = (lheight[l - 1] + 1) / 2;
+    lmask[l] = dt_alloc_align_float((size_t)lwidth[l] * lheight[l]);
+    if(!lmask[l]) break;
+    lnmask[l] = _heal_restrict_mask(lmask[l - 1], lwidth[l - 1], lheight[l - 1], lmask[l], lwidth[l], lheight[l]);
+    levels++;
+    if(lnmask[l] == 0) break;
+  }
+
+  for(int l = 0; l < levels; l++)
+  {
+    const size_t npixels = (size_t)lwidth[l] * lheight[l];
+    dev_mask[l] = dt_opencl_alloc_device_buffer(devid, sizeof(float) * npixels);
+    if(l > 0) dev_pixels[l] = dt_opencl_alloc_device_buffer(devid, sizeof(float) * 4 * npixels);
+    if(dev_mask[l] == NULL || dev_pixels[l] == NULL)
+    {
+      err = CL_MEM_OBJECT_ALLOCATION_FAILURE;
+      goto cleanup;
+    }
+    err = dt_opencl_write_buffer_to_device(devid, lmask[l], dev_mask[l], 0, sizeof(float) * npixels, CL_TRUE);
+    if(err != CL_SUCCESS) goto cleanup;
   }
 
-  dest_buffer = dt_alloc_align_float((size_t)ch * width * height);
-  if(dest_buffer == NULL)
+  dev_err = dt_opencl_alloc_device_buffer(devid, sizeof(float) * width * height);
+  dev_sums = dt_opencl_alloc_device_buffer(devid, sizeof(float) * height);
+  sums = dt_alloc_align_float(height);
+  if(dev_err == NULL || dev_sums == NULL || sums == NULL)
   {
     fprintf(stderr, "dt_heal_cl: error allocating memory for healing\n");
-    err = DT_OPENCL_SYSMEM_ALLOCATION;
+    err = CL_MEM_OBJECT_ALLOCATION_FAILURE;
     goto cleanup;
   }
 
-  err = dt_opencl_read_buffer_from_device(p->devid, (void *)src_buffer, dev_src, 0,
-                                          (size_t)width * height * ch * sizeof(float), CL_TRUE);
-  if(err != CL_SUCCESS)
+  /* subtract pattern from image */
+  err = _heal_cl_combine(devid, gd->kernel_heal_sub, dev_dest, dev_src, width, height);
+  if(err != CL_SUCCESS) goto cleanup;
+
+  /* initial solution from the coarser levels */
+  for(int l = 1; l < levels; l++)
   {
-    goto cleanup;
+    size_t sizes[] = { ROUNDUPDWD(lwidth[l], devid), ROUNDUPDHT(lheight[l], devid), 1 };
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_restrict, 0, sizeof(cl_mem), (void *)&dev_pixels[l - 1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_restrict, 1, sizeof(cl_mem), (void *)&dev_mask[l - 1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_restrict, 2, sizeof(int), (void *)&lwidth[l - 1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_restrict, 3, sizeof(int), (void *)&lheight[l - 1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_restrict, 4, sizeof(cl_mem), (void *)&dev_pixels[l]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_restrict, 5, sizeof(cl_mem), (void *)&dev_mask[l]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_restrict, 6, sizeof(int), (void *)&lwidth[l]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_restrict, 7, sizeof(int), (void *)&lheight[l]);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_heal_restrict, sizes);
+    if(err != CL_SUCCESS) goto cleanup;
   }
 
-  err = dt_opencl_read_buffer_from_device(p->devid, (void *)dest_buffer, dev_dest, 0,
-                                          (size_t)width * height * ch * sizeof(float), CL_TRUE);
-  if(err != CL_SUCCESS)
+  for(int l = levels - 1; l > 0; l--)
   {
-    goto cleanup;
+    const int iter = (l == levels - 1) ? HEAL_MG_COARSEST_ITER : HEAL_MG_SMOOTH_ITER;
+    if(lnmask[l])
+    {
+      const float w = _heal_omega(lnmask[l]);
+      for(int i = 0; i < iter && err == CL_SUCCESS; i++)
+        err = _heal_cl_relax(devid, gd->kernel_heal_relax, dev_pixels[l], dev_mask[l], lwidth[l], lheight[l], w,
+                             dev_err, FALSE);
+      if(err != CL_SUCCESS) goto cleanup;
+    }
+
+    size_t sizes[] = { ROUNDUPDWD(lwidth[l - 1], devid), ROUNDUPDHT(lheight[l - 1], devid), 1 };
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_prolong, 0, sizeof(cl_mem), (void *)&dev_pixels[l]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_prolong, 1, sizeof(int), (void *)&lwidth[l]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_prolong, 2, sizeof(int), (void *)&lheight[l]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_prolong, 3, sizeof(cl_mem), (void *)&dev_pixels[l - 1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_prolong, 4, sizeof(cl_mem), (void *)&dev_mask[l - 1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_prolong, 5, sizeof(int), (void *)&lwidth[l - 1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_prolong, 6, sizeof(int), (void *)&lheight[l - 1]);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_heal_prolong, sizes);
+    if(err != CL_SUCCESS) goto cleanup;
   }
 
-  // I couldn't make it run fast on opencl (the reduction takes forever), so just call the cpu version
-  dt_heal(src_buffer, dest_buffer, mask_buffer, width, height, ch, max_iter);
+  /* Gauss-Seidel with successive over-relaxation, same exit criterion as _heal_laplace_loop() */
+  const float w = _heal_omega(lnmask[0]);
+  const float epsilon = (0.1 / 255);
+  const float err_exit = epsilon * epsilon * w * w;
 
-  err = dt_opencl_write_buffer_to_device(p->devid, dest_buffer, dev_dest, 0, sizeof(float) * width * height * ch, CL_TRUE);
-  if(err != CL_SUCCESS)
+  for(int iter = 0; iter < max_iter; iter++)
   {
-    goto cleanup;
+    const int check = (iter + 1) % HEAL_CL_CHECK_ITER == 0;
+    err = _heal_cl_relax(devid, gd->kernel_heal_relax, dev_dest, dev_mask[0], width, height, w, dev_err, check);
+    if(err != CL_SUCCESS) goto cleanup;
+    if(!check) continue;
+
+    size_t sizes[] = { ROUNDUPDWD(height, devid), 1, 1 };
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_row_sum, 0, sizeof(cl_mem), (void *)&dev_err);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_row_sum, 1, sizeof(cl_mem), (void *)&dev_sums);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_row_sum, 2, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_heal_row_sum, 3, sizeof(int), (void *)&height);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_heal_row_sum, sizes);
+    if(err != CL_SUCCESS) goto cleanup;
+    err = dt_opencl_read_buffer_from_device(devid, sums, dev_sums, 0, sizeof(float) * height, CL_TRUE);
+    if(err != CL_SUCCESS) goto cleanup;
+
+    float sum = 0.0f;
+    for(int y = 0; y < height; y++) sum += sums[y];
+    if(sum < err_exit) break;
   }
 
+  /* add solution to original image */
+  err = _heal_cl_combine(devid, gd->kernel_heal_add, dev_dest, dev_src, width, height);
+
 cleanup:
-  if(src_buffer) dt_free_align(src_buffer);
-  if(dest_buffer) dt_free_align(dest_buffer);
+  for(int l = 0; l < levels; l++)
+  {
+    dt_opencl_release_mem_object(dev_mask[l]);
+    if(l > 0)
+    {
+      dt_opencl_release_mem_object(dev_pixels[l]);
+      dt_free_align(lmask[l]);
+    }
+  }
+  dt_opencl_release_mem_object(dev_err);
+  dt_opencl_release_mem_object(dev_sums);
+  if(sums) dt_free_align(sums);
 
   return err;
 }
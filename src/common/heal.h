@@ -29,7 +29,12 @@ void dt_heal(const float *const src_buffer, float *dest_buffer, const float *con
 
 typedef struct dt_heal_cl_global_t
 {
-  int kernel_dummy;
+  int kernel_heal_sub;
+  int kernel_heal_add;
+  int kernel_heal_restrict;
+  int kernel_heal_prolong;
+  int kernel_heal_relax;
+  int kernel_heal_row_sum;
 } dt_heal_cl_global_t;
 
 typedef struct heal_params_cl_t
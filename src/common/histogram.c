@@ -48,8 +48,9 @@ inline static void histogram_helper_cs_RAW(const dt_dev_histogram_collection_par
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = MAX(histogram_params->step, 1);
   const float *input = (float *)pixel + roi->width * j + roi->crop_x;
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, input++)
+  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i += step, input += step)
   {
     histogram_helper_cs_RAW_helper_process_pixel_float(histogram_params, input, histogram);
   }
@@ -70,10 +71,11 @@ inline void dt_histogram_helper_cs_RAW_uint16(const dt_dev_histogram_collection_
                                               const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = MAX(histogram_params->step, 1);
   uint16_t *in = (uint16_t *)pixel + roi->width * j + roi->crop_x;
 
   // process pixels
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in++)
+  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i += step, in += step)
     histogram_helper_cs_RAW_helper_process_pixel_uint16(histogram_params, in, histogram);
 }
 
@@ -164,10 +166,11 @@ inline static void histogram_helper_cs_rgb(const dt_dev_histogram_collection_par
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = MAX(histogram_params->step, 1);
   float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
 
   // process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
+  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i += step, in += 4 * step)
   {
     if(darktable.codepath.OPENMP_SIMD)
       histogram_helper_cs_rgb_helper_process_pixel_float(histogram_params, in, histogram);
@@ -185,10 +188,11 @@ inline static void histogram_helper_cs_rgb_compensated(const dt_dev_histogram_co
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = MAX(histogram_params->step, 1);
   float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
 
   // process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
+  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i += step, in += 4 * step)
   {
     if(darktable.codepath.OPENMP_SIMD)
       histogram_helper_cs_rgb_helper_process_pixel_float_compensated(histogram_params, in, histogram, profile_info);
@@ -253,10 +257,11 @@ inline static void histogram_helper_cs_Lab(const dt_dev_histogram_collection_par
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = MAX(histogram_params->step, 1);
   float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
 
   // process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
+  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i += step, in += 4 * step)
   {
     if(darktable.codepath.OPENMP_SIMD)
       histogram_helper_cs_Lab_helper_process_pixel_float(histogram_params, in, histogram);
@@ -287,10 +292,11 @@ inline static void histogram_helper_cs_Lab_LCh(const dt_dev_histogram_collection
                                                const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = MAX(histogram_params->step, 1);
   float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
 
   // TODO: process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
+  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i += step, in += 4 * step)
   {
     //    if(darktable.codepath.OPENMP_SIMD)
     histogram_helper_cs_Lab_LCh_helper_process_pixel_float(histogram_params, in, histogram);
@@ -305,59 +311,78 @@ inline static void histogram_helper_cs_Lab_LCh(const dt_dev_histogram_collection
 
 //==============================================================================
 
+// Histograms are collected on every pipe run: each thread keeps its private bins between calls
+// instead of allocating them every time. They live as long as the thread, like the OpenMP pool.
+static __thread uint32_t *_thread_bins = NULL;
+static __thread size_t _thread_bins_count = 0;
+
+static uint32_t *_get_thread_bins(const size_t bins_total)
+{
+  if(_thread_bins_count < bins_total)
+  {
+    free(_thread_bins);
+    _thread_bins = malloc(bins_total * sizeof(uint32_t));
+    _thread_bins_count = _thread_bins ? bins_total : 0;
+  }
+  return _thread_bins;
+}
+
 void dt_histogram_worker(dt_dev_histogram_collection_params_t *const histogram_params,
                          dt_dev_histogram_stats_t *histogram_stats, const void *const pixel,
                          uint32_t **histogram, const dt_worker Worker,
                          const dt_iop_order_iccprofile_info_t *const profile_info)
 {
-  const int nthreads = omp_get_max_threads();
-
   const size_t bins_total = (size_t)4 * histogram_params->bins_count;
   const size_t buf_size = bins_total * sizeof(uint32_t);
-  void *partial_hists = calloc(nthreads, buf_size);
 
   if(histogram_params->mul == 0) histogram_params->mul = (double)(histogram_params->bins_count - 1);
 
   const dt_histogram_roi_t *const roi = histogram_params->roi;
+  const int width = roi->width - roi->crop_width - roi->crop_x;
+  const int height = roi->height - roi->crop_height - roi->crop_y;
+
+  // a displayed histogram doesn't need every pixel of large images, its shape is what matters
+  const size_t pixels = (size_t)MAX(width, 0) * MAX(height, 0);
+  histogram_params->step = 1;
+  if(histogram_params->for_display && pixels > DT_HISTOGRAM_DISPLAY_PIXELS)
+    histogram_params->step = ceilf(sqrtf((float)pixels / DT_HISTOGRAM_DISPLAY_PIXELS));
+  const int step = histogram_params->step;
+
+  // keep the output buffer if it already has the right size
+  if(*histogram == NULL || histogram_stats->bins_count != histogram_params->bins_count)
+    *histogram = realloc(*histogram, buf_size);
+  uint32_t *const hist = *histogram;
+  if(hist == NULL) return;
+  memset(hist, 0, buf_size);
 
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(histogram_params, pixel, Worker, profile_info, bins_total, roi) \
-  shared(partial_hists) \
-  schedule(static)
+#pragma omp parallel default(none) \
+  dt_omp_firstprivate(histogram_params, pixel, Worker, profile_info, bins_total, buf_size, roi, step, hist)
 #endif
-  for(int j = roi->crop_y; j < roi->height - roi->crop_height; j++)
   {
-    uint32_t *thread_hist = (uint32_t *)partial_hists + bins_total * omp_get_thread_num();
-    Worker(histogram_params, pixel, thread_hist, j, profile_info);
-  }
+    uint32_t *const bins = _get_thread_bins(bins_total);
+    if(bins) memset(bins, 0, buf_size);
 
 #ifdef _OPENMP
-  *histogram = realloc(*histogram, buf_size);
-  memset(*histogram, 0, buf_size);
-  uint32_t *hist = *histogram;
+#pragma omp for schedule(static) nowait
+#endif
+    for(int j = roi->crop_y; j < roi->height - roi->crop_height; j += step)
+    {
+      if(bins) Worker(histogram_params, pixel, bins, j, profile_info);
+    }
 
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(nthreads, bins_total) \
-  shared(hist, partial_hists) \
-  schedule(static)
-  for(size_t k = 0; k < bins_total; k++)
-  {
-    for(size_t n = 0; n < nthreads; n++)
+    // one thread at a time adds its bins to the output
+    if(bins)
     {
-      const uint32_t *thread_hist = (uint32_t *)partial_hists + bins_total * n;
-      hist[k] += thread_hist[k];
+#ifdef _OPENMP
+#pragma omp critical(dt_histogram_worker)
+#endif
+      for(size_t k = 0; k < bins_total; k++) hist[k] += bins[k];
     }
   }
-#else
-  *histogram = realloc(*histogram, buf_size);
-  memmove(*histogram, partial_hists, buf_size);
-#endif
-  free(partial_hists);
 
   histogram_stats->bins_count = histogram_params->bins_count;
-  histogram_stats->pixels = (roi->width - roi->crop_width - roi->crop_x)
-                            * (roi->height - roi->crop_height - roi->crop_y);
+  histogram_stats->pixels = (size_t)((MAX(width, 0) + step - 1) / step) * ((MAX(height, 0) + step - 1) / step);
 }
 
 //------------------------------------------------------------------------------
@@ -449,6 +474,72 @@ void dt_histogram_max_helper(const dt_dev_histogram_stats_t *const histogram_sta
   }
 }
 
+#ifdef HAVE_OPENCL
+dt_scopes_cl_global_t *dt_scopes_init_cl_global()
+{
+  dt_scopes_cl_global_t *g = malloc(sizeof(*g));
+  const int program = 36; // scopes.cl, from programs.conf
+  g->kernel_scopes_clear = dt_opencl_create_kernel(program, "scopes_clear");
+  g->kernel_scopes_bin = dt_opencl_create_kernel(program, "scopes_bin");
+  return g;
+}
+
+void dt_scopes_free_cl_global(dt_scopes_cl_global_t *g)
+{
+  if(!g) return;
+  dt_opencl_free_kernel(g->kernel_scopes_clear);
+  dt_opencl_free_kernel(g->kernel_scopes_bin);
+  free(g);
+}
+
+cl_int dt_scopes_process_cl(const int devid, cl_mem img, const int width, const int height,
+                            const dt_iop_order_iccprofile_info_t *const profile, const float zoom,
+                            uint32_t *bins)
+{
+  const dt_scopes_cl_global_t *const gd = darktable.opencl->scopes;
+  cl_int err = CL_MEM_OBJECT_ALLOCATION_FAILURE;
+
+  dt_colorspaces_iccprofile_info_cl_t *profile_info_cl = NULL;
+  cl_float *profile_lut_cl = NULL;
+  cl_mem dev_profile_info = NULL;
+  cl_mem dev_profile_lut = NULL;
+
+  const int size = dt_scopes_size(width, height);
+  cl_mem dev_bins = dt_opencl_alloc_device_buffer(devid, sizeof(uint32_t) * size);
+  if(dev_bins == NULL) goto error;
+
+  err = dt_ioppr_build_iccprofile_params_cl(profile, devid, &profile_info_cl, &profile_lut_cl,
+                                            &dev_profile_info, &dev_profile_lut);
+  if(err != CL_SUCCESS) goto error;
+
+  const size_t clear_sizes[] = { ROUNDUPDWD(size, devid), 1, 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_scopes_clear, 0, sizeof(cl_mem), &dev_bins);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_scopes_clear, 1, sizeof(int), &size);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_scopes_clear, clear_sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  const float vectorscope_zoom = profile ? zoom : 0.f;
+  const size_t sizes[] = { ROUNDUPDWD(width, devid), ROUNDUPDHT(height, devid), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_scopes_bin, 0, sizeof(cl_mem), &img);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_scopes_bin, 1, sizeof(int), &width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_scopes_bin, 2, sizeof(int), &height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_scopes_bin, 3, sizeof(cl_mem), &dev_bins);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_scopes_bin, 4, sizeof(float), &vectorscope_zoom);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_scopes_bin, 5, sizeof(cl_mem), &dev_profile_info);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_scopes_bin, 6, sizeof(cl_mem), &dev_profile_lut);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_scopes_bin, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  err = dt_opencl_read_buffer_from_device(devid, bins, dev_bins, 0, sizeof(uint32_t) * size, CL_TRUE);
+
+error:
+  if(err != CL_SUCCESS) dt_print(DT_DEBUG_OPENCL, "[opencl_scopes] couldn't enqueue kernel! %i\n", err);
+  dt_ioppr_free_iccprofile_params_cl(&profile_info_cl, &profile_lut_cl, &dev_profile_info, &dev_profile_lut);
+  dt_opencl_release_mem_object(dev_bins);
+  return err;
+}
+#endif
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -24,6 +24,9 @@
 #include "develop/pixelpipe.h"
 #include "common/iop_profile.h"
 
+// displayed histograms of larger regions are sampled to about that many pixels
+#define DT_HISTOGRAM_DISPLAY_PIXELS (1 << 20)
+
 /*
  * histogram region of interest
  *
@@ -58,6 +61,59 @@ void dt_histogram_max_helper(const dt_dev_histogram_stats_t *const histogram_sta
                              const dt_iop_colorspace_type_t cst, const dt_iop_colorspace_type_t cst_to,
                              uint32_t **histogram, uint32_t *histogram_max);
 
+/*
+ * scopes of the global histogram backbufs (see src/libs/histogram.c), when they are binned
+ * on the device. All the bins are stored one after the other in a single buffer:
+ *
+ * histogram   : 4 * DT_SCOPES_BINS, RGB
+ * waveform_h  : 4 * DT_SCOPES_TONES * width, one column of tones per image column
+ * waveform_v  : 4 * DT_SCOPES_TONES * height, one row of tones per image row
+ * vectorscope : DT_SCOPES_BINS * DT_SCOPES_BINS
+ */
+#define DT_SCOPES_BINS 256
+#define DT_SCOPES_TONES 128
+
+typedef struct dt_scopes_t
+{
+  uint32_t *histogram;
+  uint32_t *waveform_h;
+  uint32_t *waveform_v;
+  uint32_t *vectorscope;
+} dt_scopes_t;
+
+static inline size_t dt_scopes_size(const size_t width, const size_t height)
+{
+  return 4 * DT_SCOPES_BINS + 4 * DT_SCOPES_TONES * (width + height) + DT_SCOPES_BINS * DT_SCOPES_BINS;
+}
+
+static inline dt_scopes_t dt_scopes_map(uint32_t *const bins, const size_t width, const size_t height)
+{
+  dt_scopes_t scopes;
+  scopes.histogram = bins;
+  scopes.waveform_h = scopes.histogram + 4 * DT_SCOPES_BINS;
+  scopes.waveform_v = scopes.waveform_h + 4 * DT_SCOPES_TONES * width;
+  scopes.vectorscope = scopes.waveform_v + 4 * DT_SCOPES_TONES * height;
+  return scopes;
+}
+
+#ifdef HAVE_OPENCL
+typedef struct dt_scopes_cl_global_t
+{
+  int kernel_scopes_clear;
+  int kernel_scopes_bin;
+} dt_scopes_cl_global_t;
+
+dt_scopes_cl_global_t *dt_scopes_init_cl_global(void);
+void dt_scopes_free_cl_global(dt_scopes_cl_global_t *g);
+
+/** bin all the scopes of the RGBA float image at once, and copy back only the bins
+ *  (dt_scopes_size(width, height) values). The vectorscope is binned at zoom, in the
+ *  RGB space of profile, and skipped if profile is NULL. */
+cl_int dt_scopes_process_cl(const int devid, cl_mem img, const int width, const int height,
+                            const dt_iop_order_iccprofile_info_t *const profile, const float zoom,
+                            uint32_t *bins);
+#endif
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
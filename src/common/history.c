@@ -28,6 +28,7 @@
 #include "common/tags.h"
 #include "common/undo.h"
 #include "common/utility.h"
+#include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
 #include "develop/develop.h"
@@ -112,6 +113,7 @@ void dt_history_delete_on_image_ext(int32_t imgid, gboolean undo)
 
   /* make sure mipmaps are recomputed */
   dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+  dt_image_load_regenerate(imgid);
 
   /* remove darktable|style|* tags */
   dt_tag_detach_by_string("darktable|style|%", imgid, FALSE, FALSE);
@@ -168,7 +170,11 @@ int dt_history_load_and_apply(const int32_t imgid, gchar *filename, int history_
     dt_image_cache_write_release(darktable.image_cache, img,
     // ugly but if not history_only => called from crawler - do not write the xmp
                                  history_only ? DT_IMAGE_CACHE_SAFE : DT_IMAGE_CACHE_RELAXED);
-    dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+    if(dt_history_hash_mipmap_outdated(imgid))
+    {
+      dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+      dt_image_load_regenerate(imgid);
+    }
   }
   // signal that the mipmap need to be updated
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, imgid);
@@ -513,9 +519,139 @@ void dt_history_truncate_on_image(const int32_t imgid, const int32_t history_end
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, imgid);
 }
 
+// compress the history of one image whose history_end is at the top, and renumber it from 0
+static void _history_compress_and_renumber(const int32_t imgid)
+{
+  dt_history_compress_on_image(imgid);
+
+  // now the modules are in right order but need renumbering to remove leaks
+  int max=0;    // the maximum num in main_history for an image
+  int size=0;   // the number of items in main_history for an image
+  int done=0;   // used for renumbering index
+
+  sqlite3_stmt *stmt2;
+
+  // get highest num in history
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+    "SELECT MAX(num) FROM main.history WHERE imgid=?1", -1, &stmt2, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
+  if (sqlite3_step(stmt2) == SQLITE_ROW)
+    max = sqlite3_column_int(stmt2, 0);
+  sqlite3_finalize(stmt2);
+
+  // get number of items in main.history
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+    "SELECT COUNT(*) FROM main.history WHERE imgid = ?1", -1, &stmt2, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
+  if(sqlite3_step(stmt2) == SQLITE_ROW)
+    size = sqlite3_column_int(stmt2, 0);
+  sqlite3_finalize(stmt2);
+
+  if ((size>0) && (max>0))
+  {
+    for (int index=0;index<(max+1);index++)
+    {
+      sqlite3_stmt *stmt3;
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+        "SELECT num FROM main.history WHERE imgid=?1 AND num=?2", -1, &stmt3, NULL);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt3, 1, imgid);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt3, 2, index);
+      if (sqlite3_step(stmt3) == SQLITE_ROW)
+      {
+        sqlite3_stmt *stmt4;
+        // step by step set the correct num
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+          "UPDATE main.history SET num = ?3 WHERE imgid = ?1 AND num = ?2", -1, &stmt4, NULL);
+        DT_DEBUG_SQLITE3_BIND_INT(stmt4, 1, imgid);
+        DT_DEBUG_SQLITE3_BIND_INT(stmt4, 2, index);
+        DT_DEBUG_SQLITE3_BIND_INT(stmt4, 3, done);
+        sqlite3_step(stmt4);
+        sqlite3_finalize(stmt4);
+
+        done++;
+      }
+      sqlite3_finalize(stmt3);
+    }
+  }
+  // update history end
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+    "UPDATE main.images SET history_end = ?2 WHERE id = ?1", -1, &stmt2, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt2, 2, done);
+  sqlite3_step(stmt2);
+  sqlite3_finalize(stmt2);
+}
+
+#ifdef HAVE_SQLITE_324_OR_NEWER
+// Compress all the histories of memory.compress_images at once, whose history_end is at the top.
+// Same as _history_compress_and_renumber() for histories without masks: the latest item of each
+// (operation, multi_priority) before history_end is kept, and items are renumbered from 0.
+// Images with masks need their mask manager entry rebuilt, they are removed from the set and
+// returned, for the caller to compress them one by one.
+static GList *_history_compress_on_set(void)
+{
+  sqlite3 *db = dt_database_get(darktable.db);
+  GList *masked = NULL;
+  sqlite3_stmt *stmt;
+
+  // clang-format off
+  DT_DEBUG_SQLITE3_PREPARE_V2(db,
+                              "SELECT imgid FROM memory.compress_images"
+                              " WHERE imgid IN (SELECT imgid FROM main.masks_history)"
+                              "    OR imgid IN (SELECT imgid FROM main.history WHERE operation = 'mask_manager')",
+                              -1, &stmt, NULL);
+  // clang-format on
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    masked = g_list_prepend(masked, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+  sqlite3_finalize(stmt);
+
+  // clang-format off
+  sqlite3_exec(db, "DELETE FROM memory.compress_images"
+                   " WHERE imgid IN (SELECT imgid FROM main.masks_history)"
+                   "    OR imgid IN (SELECT imgid FROM main.history WHERE operation = 'mask_manager')",
+               NULL, NULL, NULL);
+
+  // keep disabled modules as documented
+  sqlite3_exec(db, "DELETE FROM main.history"
+                   " WHERE imgid IN (SELECT imgid FROM memory.compress_images)"
+                   "   AND rowid NOT IN"
+                   "   (SELECT id FROM"
+                   "     (SELECT h.rowid AS id,"
+                   "             ROW_NUMBER() OVER (PARTITION BY h.imgid, h.operation, h.multi_priority"
+                   "                                ORDER BY h.num DESC) AS rank"
+                   "      FROM main.history AS h, main.images AS i"
+                   "      WHERE h.imgid IN (SELECT imgid FROM memory.compress_images)"
+                   "        AND i.id = h.imgid AND h.num < i.history_end)"
+                   "    WHERE rank = 1)",
+               NULL, NULL, NULL);
+
+  // the new numbers are computed before any of them changes
+  sqlite3_exec(db, "DELETE FROM memory.compress_nums", NULL, NULL, NULL);
+  sqlite3_exec(db, "INSERT INTO memory.compress_nums (imgid, num, new_num)"
+                   " SELECT imgid, num, ROW_NUMBER() OVER (PARTITION BY imgid ORDER BY num) - 1"
+                   " FROM main.history"
+                   " WHERE imgid IN (SELECT imgid FROM memory.compress_images)",
+               NULL, NULL, NULL);
+  sqlite3_exec(db, "UPDATE main.history"
+                   " SET num = (SELECT new_num FROM memory.compress_nums AS n"
+                   "            WHERE n.imgid = main.history.imgid AND n.num = main.history.num)"
+                   " WHERE imgid IN (SELECT imgid FROM memory.compress_images)",
+               NULL, NULL, NULL);
+  sqlite3_exec(db, "UPDATE main.images"
+                   " SET history_end = (SELECT COUNT(*) FROM memory.compress_nums WHERE imgid = main.images.id)"
+                   " WHERE id IN (SELECT imgid FROM memory.compress_images)",
+               NULL, NULL, NULL);
+  // clang-format on
+  sqlite3_exec(db, "DELETE FROM memory.compress_nums", NULL, NULL, NULL);
+
+  return masked;
+}
+#endif
+
 int dt_history_compress_on_list(const GList *imgs)
 {
-  int uncompressed=0;
+  int uncompressed = 0;
+  GList *compressed = NULL;
 
   // Get the list of selected images
   for(const GList *l = imgs; l; l = g_list_next(l))
@@ -523,73 +659,51 @@ int dt_history_compress_on_list(const GList *imgs)
     const int32_t imgid = GPOINTER_TO_INT(l->data);
     const int test = dt_history_end_attop(imgid);
     if(test == 1) // we do a compression and we know for sure history_end is at the top!
-    {
-      dt_history_compress_on_image(imgid);
+      compressed = g_list_prepend(compressed, GINT_TO_POINTER(imgid));
+    if(test == 0) // no compression as history_end is right in the middle of history
+      uncompressed++;
+  }
+  compressed = g_list_reverse(compressed);
 
-      // now the modules are in right order but need renumbering to remove leaks
-      int max=0;    // the maximum num in main_history for an image
-      int size=0;   // the number of items in main_history for an image
-      int done=0;   // used for renumbering index
+  dt_database_start_transaction(darktable.db);
 
-      sqlite3_stmt *stmt2;
+#ifdef HAVE_SQLITE_324_OR_NEWER
+  // most histories have no masks: they are all compressed by a handful of statements
+  sqlite3 *db = dt_database_get(darktable.db);
+  sqlite3_exec(db, "DELETE FROM memory.compress_images", NULL, NULL, NULL);
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
+                                                 "INSERT OR IGNORE INTO memory.compress_images (imgid) VALUES (?1)");
+  for(const GList *l = compressed; l; l = g_list_next(l))
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, GPOINTER_TO_INT(l->data));
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  dt_database_release_statement(darktable.db, stmt);
 
-      // get highest num in history
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-        "SELECT MAX(num) FROM main.history WHERE imgid=?1", -1, &stmt2, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
-      if (sqlite3_step(stmt2) == SQLITE_ROW)
-        max = sqlite3_column_int(stmt2, 0);
-      sqlite3_finalize(stmt2);
+  GList *masked = _history_compress_on_set();
+  sqlite3_exec(db, "DELETE FROM memory.compress_images", NULL, NULL, NULL);
 
-      // get number of items in main.history
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-        "SELECT COUNT(*) FROM main.history WHERE imgid = ?1", -1, &stmt2, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
-      if(sqlite3_step(stmt2) == SQLITE_ROW)
-        size = sqlite3_column_int(stmt2, 0);
-      sqlite3_finalize(stmt2);
+  for(const GList *l = masked; l; l = g_list_next(l))
+    _history_compress_and_renumber(GPOINTER_TO_INT(l->data));
+  g_list_free(masked);
+#else
+  for(const GList *l = compressed; l; l = g_list_next(l))
+    _history_compress_and_renumber(GPOINTER_TO_INT(l->data));
+#endif
 
-      if ((size>0) && (max>0))
-      {
-        for (int index=0;index<(max+1);index++)
-        {
-          sqlite3_stmt *stmt3;
-          DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-            "SELECT num FROM main.history WHERE imgid=?1 AND num=?2", -1, &stmt3, NULL);
-          DT_DEBUG_SQLITE3_BIND_INT(stmt3, 1, imgid);
-          DT_DEBUG_SQLITE3_BIND_INT(stmt3, 2, index);
-          if (sqlite3_step(stmt3) == SQLITE_ROW)
-          {
-            sqlite3_stmt *stmt4;
-            // step by step set the correct num
-            DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-              "UPDATE main.history SET num = ?3 WHERE imgid = ?1 AND num = ?2", -1, &stmt4, NULL);
-            DT_DEBUG_SQLITE3_BIND_INT(stmt4, 1, imgid);
-            DT_DEBUG_SQLITE3_BIND_INT(stmt4, 2, index);
-            DT_DEBUG_SQLITE3_BIND_INT(stmt4, 3, done);
-            sqlite3_step(stmt4);
-            sqlite3_finalize(stmt4);
-
-            done++;
-          }
-          sqlite3_finalize(stmt3);
-        }
-      }
-      // update history end
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-        "UPDATE main.images SET history_end = ?2 WHERE id = ?1", -1, &stmt2, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt2, 2, done);
-      sqlite3_step(stmt2);
-      sqlite3_finalize(stmt2);
+  for(const GList *l = imgs; l; l = g_list_next(l))
+    dt_history_hash_write_from_history(GPOINTER_TO_INT(l->data), DT_HISTORY_HASH_CURRENT);
 
-      dt_control_save_xmp(imgid);
-    }
-    if(test == 0) // no compression as history_end is right in the middle of history
-      uncompressed++;
+  dt_database_release_transaction(darktable.db);
 
-    dt_history_hash_write_from_history(imgid, DT_HISTORY_HASH_CURRENT);
+  for(const GList *l = compressed; l; l = g_list_next(l))
+  {
+    const int32_t imgid = GPOINTER_TO_INT(l->data);
+    dt_control_save_xmp(imgid);
+    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, imgid);
   }
+  g_list_free(compressed);
 
   return uncompressed;
 }
@@ -830,20 +944,18 @@ void dt_history_hash_write(const int32_t imgid, dt_history_hash_values_t *hash)
 {
   if(hash->basic || hash->auto_apply || hash->current)
   {
-    sqlite3_stmt *stmt;
     // clang-format off
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "INSERT OR REPLACE INTO main.history_hash"
-                                " (imgid, basic_hash, auto_hash, current_hash)"
-                                " VALUES (?1, ?2, ?3, ?4)",
-                                -1, &stmt, NULL);
+    sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
+                                                   "INSERT OR REPLACE INTO main.history_hash"
+                                                   " (imgid, basic_hash, auto_hash, current_hash)"
+                                                   " VALUES (?1, ?2, ?3, ?4)");
     // clang-format on
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
     DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 2, hash->basic, hash->basic_len, SQLITE_TRANSIENT);
     DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 3, hash->auto_apply, hash->auto_apply_len, SQLITE_TRANSIENT);
     DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 4, hash->current, hash->current_len, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    dt_database_release_statement(darktable.db, stmt);
     g_free(hash->basic);
     g_free(hash->auto_apply);
     g_free(hash->current);
@@ -854,13 +966,11 @@ void dt_history_hash_read(const int32_t imgid, dt_history_hash_values_t *hash)
 {
   hash->basic = hash->auto_apply = hash->current = NULL;
   hash->basic_len = hash->auto_apply_len = hash->current_len = 0;
-  sqlite3_stmt *stmt;
   // clang-format off
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT basic_hash, auto_hash, current_hash"
-                              " FROM main.history_hash"
-                              " WHERE imgid = ?1",
-                              -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
+                                                 "SELECT basic_hash, auto_hash, current_hash"
+                                                 " FROM main.history_hash"
+                                                 " WHERE imgid = ?1");
   // clang-format on
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW)
@@ -887,75 +997,117 @@ void dt_history_hash_read(const int32_t imgid, dt_history_hash_values_t *hash)
       memcpy(hash->current, buf, hash->current_len);
     }
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
 }
 
 gboolean dt_history_hash_is_mipmap_synced(const int32_t imgid)
 {
   gboolean status = FALSE;
   if(imgid == -1) return status;
-  sqlite3_stmt *stmt;
   // clang-format off
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT CASE"
-                              "  WHEN mipmap_hash == current_hash THEN 1"
-                              "  ELSE 0 END AS status"
-                              " FROM main.history_hash"
-                              " WHERE imgid = ?1",
-                              -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
+                                                 "SELECT CASE"
+                                                 "  WHEN mipmap_hash == current_hash THEN 1"
+                                                 "  ELSE 0 END AS status"
+                                                 " FROM main.history_hash"
+                                                 " WHERE imgid = ?1");
   // clang-format on
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
     status = sqlite3_column_int(stmt, 0);
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
   return status;
 }
 
 void dt_history_hash_set_mipmap(const int32_t imgid)
 {
   if(imgid == -1) return;
-  sqlite3_stmt *stmt;
   // clang-format off
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "UPDATE main.history_hash"
-                              " SET mipmap_hash = current_hash"
-                              " WHERE imgid = ?1",
-                              -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
+                                                 "UPDATE main.history_hash"
+                                                 " SET mipmap_hash = current_hash"
+                                                 " WHERE imgid = ?1");
   // clang-format on
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
+}
+
+gboolean dt_history_hash_mipmap_outdated(const int32_t imgid)
+{
+  if(imgid == -1) return TRUE;
+  // edits in darkroom don't go through here, the thumbnails of its image are synced on leave
+  if(darktable.develop && dt_dev_is_current_image(darktable.develop, imgid)) return TRUE;
+
+  guint8 *hash = NULL;
+  const gsize hash_len = _history_hash_compute_from_db(imgid, &hash);
+  if(!hash_len) return TRUE;
+
+  gboolean outdated = TRUE;
+  // clang-format off
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
+                                                 "SELECT mipmap_hash"
+                                                 " FROM main.history_hash"
+                                                 " WHERE imgid = ?1");
+  // clang-format on
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  if(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const void *mipmap_hash = sqlite3_column_blob(stmt, 0);
+    outdated = !mipmap_hash || sqlite3_column_bytes(stmt, 0) != hash_len
+               || memcmp(mipmap_hash, hash, hash_len);
+  }
+  dt_database_release_statement(darktable.db, stmt);
+
+  if(outdated)
+  {
+    // the thumbnails rendered from now on follow this history
+    // clang-format off
+    stmt = dt_database_get_statement(darktable.db,
+                                     "UPDATE main.history_hash"
+                                     " SET mipmap_hash = ?2"
+                                     " WHERE imgid = ?1");
+    // clang-format on
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 2, hash, hash_len, SQLITE_TRANSIENT);
+    sqlite3_step(stmt);
+    dt_database_release_statement(darktable.db, stmt);
+  }
+  else
+    dt_print(DT_DEBUG_CACHE, "[history_hash] thumbnails of image %i are still valid\n", imgid);
+
+  g_free(hash);
+  return outdated;
 }
 
 dt_history_hash_t dt_history_hash_get_status(const int32_t imgid)
 {
   dt_history_hash_t status = 0;
   if(imgid == -1) return status;
-  sqlite3_stmt *stmt;
   // clang-format off
-  char *query = g_strdup_printf("SELECT CASE"
-                                "  WHEN basic_hash == current_hash THEN %d"
-                                "  WHEN auto_hash == current_hash THEN %d"
-                                "  WHEN (basic_hash IS NULL OR current_hash != basic_hash) AND"
-                                "       (auto_hash IS NULL OR current_hash != auto_hash) THEN %d"
-                                "  ELSE %d END AS status"
-                                " FROM main.history_hash"
-                                " WHERE imgid = %d",
-                                DT_HISTORY_HASH_BASIC, DT_HISTORY_HASH_AUTO,
-                                DT_HISTORY_HASH_CURRENT, DT_HISTORY_HASH_BASIC, imgid);
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
+                                                 "SELECT CASE"
+                                                 "  WHEN basic_hash == current_hash THEN ?2"
+                                                 "  WHEN auto_hash == current_hash THEN ?3"
+                                                 "  WHEN (basic_hash IS NULL OR current_hash != basic_hash) AND"
+                                                 "       (auto_hash IS NULL OR current_hash != auto_hash) THEN ?4"
+                                                 "  ELSE ?2 END AS status"
+                                                 " FROM main.history_hash"
+                                                 " WHERE imgid = ?1");
   // clang-format on
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              query, -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, DT_HISTORY_HASH_BASIC);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, DT_HISTORY_HASH_AUTO);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 4, DT_HISTORY_HASH_CURRENT);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
     status = sqlite3_column_int(stmt, 0);
   }
   // if no history_hash basic status
   else status = DT_HISTORY_HASH_BASIC;
-  sqlite3_finalize(stmt);
-  g_free(query);
+  dt_database_release_statement(darktable.db, stmt);
   return status;
 }
 
@@ -989,12 +1141,184 @@ gboolean dt_history_copy_parts(int32_t imgid)
     return FALSE;
 }
 
+/* the history of imgid is copied as-is on all the images of list, replacing theirs.
+   this works on whole sets of images at once in the database, without loading each one
+   in a develop object the way the merge of dt_history_copy_and_paste_on_image() does. */
+gboolean dt_history_copy_on_list(const int32_t imgid, const GList *list, gboolean undo)
+{
+  if(imgid <= 0 || !list) return FALSE;
+
+  GString *ids = g_string_new(NULL);
+  GList *targets = NULL;
+  for(const GList *l = g_list_first((GList *)list); l; l = g_list_next(l))
+  {
+    const int32_t dest = GPOINTER_TO_INT(l->data);
+    if(dest == imgid || dest <= 0) continue;
+    g_string_append_printf(ids, "%s%d", targets ? "," : "", dest);
+    targets = g_list_prepend(targets, GINT_TO_POINTER(dest));
+  }
+  targets = g_list_reverse(targets);
+
+  if(!targets)
+  {
+    g_string_free(ids, TRUE);
+    return FALSE;
+  }
+
+  GList *undo_items = NULL;
+  if(undo)
+  {
+    for(const GList *l = targets; l; l = g_list_next(l))
+    {
+      dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
+      hist->imgid = GPOINTER_TO_INT(l->data);
+      dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
+      undo_items = g_list_prepend(undo_items, hist);
+    }
+    undo_items = g_list_reverse(undo_items);
+  }
+
+  // the history is the same everywhere, so is its hash
+  guint8 *hash = NULL;
+  const gsize hash_len = _history_hash_compute_from_db(imgid, &hash);
+
+  // clang-format off
+  const char *queries[] =
+  {
+    "DELETE FROM main.history WHERE imgid IN (%s)",
+    "DELETE FROM main.masks_history WHERE imgid IN (%s)",
+    "DELETE FROM main.module_order WHERE imgid IN (%s)",
+    "INSERT INTO main.history"
+    "  (imgid, num, module, operation, op_params, enabled,"
+    "   blendop_params, blendop_version, multi_priority, multi_name)"
+    "  SELECT i.id, h.num, h.module, h.operation, h.op_params, h.enabled,"
+    "         h.blendop_params, h.blendop_version, h.multi_priority, h.multi_name"
+    "  FROM main.history AS h, main.images AS i"
+    "  WHERE h.imgid = ?1 AND i.id IN (%s)",
+    "INSERT INTO main.masks_history"
+    "  (imgid, num, formid, form, name, version, points, points_count, source)"
+    "  SELECT i.id, m.num, m.formid, m.form, m.name, m.version, m.points, m.points_count, m.source"
+    "  FROM main.masks_history AS m, main.images AS i"
+    "  WHERE m.imgid = ?1 AND i.id IN (%s)",
+    "INSERT INTO main.module_order (imgid, version, iop_list)"
+    "  SELECT i.id, o.version, o.iop_list"
+    "  FROM main.module_order AS o, main.images AS i"
+    "  WHERE o.imgid = ?1 AND i.id IN (%s)",
+    "UPDATE main.images"
+    "  SET history_end = (SELECT history_end FROM main.images WHERE id = ?1)"
+    "  WHERE id IN (%s)",
+    "INSERT OR IGNORE INTO main.history_hash (imgid)"
+    "  SELECT id FROM main.images WHERE id IN (%s)",
+    "UPDATE main.history_hash SET current_hash = ?2 WHERE imgid IN (%s)",
+  };
+  // clang-format on
+
+  gboolean all_ok = TRUE;
+  dt_database_start_transaction(darktable.db);
+
+  for(size_t k = 0; k < G_N_ELEMENTS(queries) && all_ok; k++)
+  {
+    sqlite3_stmt *stmt;
+    gchar *query = g_strdup_printf(queries[k], ids->str);
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+    // bind only the parameters the query actually has
+    if(sqlite3_bind_parameter_index(stmt, "?1"))
+    {
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    }
+    if(sqlite3_bind_parameter_index(stmt, "?2"))
+    {
+      // a source without history gets no hash, as in dt_history_hash_write_from_history()
+      if(hash_len)
+      {
+        DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 2, hash, hash_len, SQLITE_TRANSIENT);
+      }
+      else
+        sqlite3_bind_null(stmt, 2);
+    }
+    all_ok &= (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    g_free(query);
+  }
+
+  if(all_ok)
+    dt_database_release_transaction(darktable.db);
+  else
+  {
+    dt_database_rollback_transaction(darktable.db);
+    fprintf(stderr, "[dt_history_copy_on_list] fails to copy the history of %d on %s\n", imgid, ids->str);
+  }
+
+  g_free(hash);
+  g_string_free(ids, TRUE);
+
+  const dt_image_t *src = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  const gboolean auto_presets = src && (src->flags & DT_IMAGE_AUTO_PRESETS_APPLIED);
+  dt_image_cache_read_release(darktable.image_cache, src);
+
+  if(undo) dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
+
+  GList *u = undo_items;
+  for(const GList *l = targets; l; l = g_list_next(l))
+  {
+    const int32_t dest = GPOINTER_TO_INT(l->data);
+
+    if(all_ok)
+    {
+      // the copied history went through the auto-presets already, if the source did.
+      // don't let the darkroom apply them a second time on top of it.
+      dt_image_t *image = dt_image_cache_get(darktable.image_cache, dest, 'w');
+      if(auto_presets)
+        image->flags |= DT_IMAGE_AUTO_PRESETS_APPLIED;
+      else
+        image->flags &= ~DT_IMAGE_AUTO_PRESETS_APPLIED;
+      dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+    }
+
+    if(u)
+    {
+      dt_undo_lt_history_t *hist = (dt_undo_lt_history_t *)u->data;
+      dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
+      dt_undo_record(darktable.undo, NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
+                     dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
+      u = g_list_next(u);
+    }
+
+    if(!all_ok) continue;
+
+    dt_dev_append_changed_tag(dest);
+    dt_control_save_xmp(dest);
+
+    if(dt_history_hash_mipmap_outdated(dest))
+    {
+      dt_mipmap_cache_remove(darktable.mipmap_cache, dest);
+      dt_image_load_regenerate(dest);
+    }
+    dt_image_reset_aspect_ratio(dest, FALSE);
+
+    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, dest);
+  }
+
+  if(undo) dt_undo_end_group(darktable.undo);
+
+  g_list_free(undo_items);
+  g_list_free(targets);
+
+  return all_ok;
+}
+
 gboolean dt_history_paste_on_list(const GList *list, gboolean undo)
 {
   if(darktable.view_manager->copy_paste.copied_imageid <= 0) return FALSE;
   if(!list) // do we have any images to receive the pasted history?
     return FALSE;
 
+  // in overwrite mode, a full paste is a plain copy of the history done on all the images at once
+  if(darktable.view_manager->copy_paste.full_copy && darktable.view_manager->copy_paste.copy_iop_order
+     && !darktable.view_manager->copy_paste.selops
+     && dt_conf_get_bool("plugins/lighttable/copy_history/paste_overwrite"))
+    return dt_history_copy_on_list(darktable.view_manager->copy_paste.copied_imageid, list, undo);
+
   if(undo) dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
   for(GList *l = g_list_first((GList *)list); l; l = g_list_next(l))
   {
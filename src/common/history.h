@@ -69,6 +69,10 @@ gboolean dt_history_copy_parts(int32_t imgid);
 gboolean dt_history_paste_on_list(const GList *list, gboolean undo);
 gboolean dt_history_paste_parts_on_list(const GList *list, gboolean undo);
 
+/** replace the history of all the images of list by a copy of the history of imgid.
+    done in the database for the whole list at once, without any merge. */
+gboolean dt_history_copy_on_list(const int32_t imgid, const GList *list, gboolean undo);
+
 /** load a dt file and applies to selected images */
 int dt_history_load_and_apply_on_list(gchar *filename, const GList *list);
 
@@ -88,6 +92,9 @@ void dt_history_truncate_on_image(const int32_t imgid, const int32_t history_end
 /* duplicate an history list */
 GList *dt_history_duplicate(GList *hist);
 
+/* duplicate a single history item, with its params, blend params and forms */
+struct dt_dev_history_item_t *dt_history_duplicate_item(const struct dt_dev_history_item_t *old);
+
 
 
 typedef struct dt_history_item_t
@@ -125,6 +132,12 @@ gboolean dt_history_hash_is_mipmap_synced(const int32_t imgid);
 /** update mipmap hash to db (= current_hash) */
 void dt_history_hash_set_mipmap(const int32_t imgid);
 
+/** compare the hash of the effective history, computed from the db, to the one the thumbnails were
+ *  rendered from. Returns FALSE if the pixels can't have changed (metadata only, pixel-neutral
+ *  compress or copy), TRUE otherwise, in which case the new hash is recorded and the caller is
+ *  expected to drop the thumbnails. */
+gboolean dt_history_hash_mipmap_outdated(const int32_t imgid);
+
 /** write hash values to db */
 void dt_history_hash_write(const int32_t imgid, dt_history_hash_values_t *hash);
 
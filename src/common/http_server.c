@@ -211,6 +211,38 @@ dt_http_server_t *dt_http_server_create(const int *ports, const int n_ports, con
   return server;
 }
 
+dt_http_server_t *dt_http_server_create_service(const int port, const char *path, SoupServerCallback handler,
+                                                gpointer user_data)
+{
+#ifdef OLD_API
+  fprintf(stderr, "error: the http service needs libsoup 2.48 or newer\n");
+  return NULL;
+#else
+  SoupServer *httpserver = soup_server_new(SOUP_SERVER_SERVER_HEADER, "ansel internal server", NULL);
+  if(httpserver == NULL)
+  {
+    fprintf(stderr, "error: couldn't create libsoup httpserver\n");
+    return NULL;
+  }
+
+  // local connections only
+  if(!soup_server_listen_local(httpserver, port, 0, NULL))
+  {
+    fprintf(stderr, "error: can't bind to port %d\n", port);
+    g_object_unref(httpserver);
+    return NULL;
+  }
+
+  dt_http_server_t *server = (dt_http_server_t *)malloc(sizeof(dt_http_server_t));
+  server->server = httpserver;
+  server->url = g_strdup_printf("http://localhost:%d%s", port, path);
+  soup_server_add_handler(httpserver, path, handler, user_data, NULL);
+
+  dt_print(DT_DEBUG_CONTROL, "[http server] listening on %s\n", server->url);
+  return server;
+#endif
+}
+
 void dt_http_server_kill(dt_http_server_t *server)
 {
   if(server->server)
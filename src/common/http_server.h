@@ -35,6 +35,12 @@ typedef struct dt_http_server_t
 dt_http_server_t *dt_http_server_create(const int *ports, const int n_ports, const char *id,
                                         const dt_http_server_callback callback, gpointer user_data);
 
+/** create a server staying up on localhost:port, calling handler for every request under path.
+ *  the handler runs in the main loop and may pause the message to answer it later.
+ */
+dt_http_server_t *dt_http_server_create_service(const int port, const char *path, SoupServerCallback handler,
+                                                gpointer user_data);
+
 /** call this to kill a server manually. don't call this if the request was received.
  *  this also frees server.
  */
@@ -638,7 +638,9 @@ void dt_image_set_locations(const GList *imgs, const dt_image_geoloc_t *geoloc,
     GList *undo = NULL;
     if(undo_on) dt_undo_start_group(darktable.undo, DT_UNDO_GEOTAG);
 
+    dt_database_start_transaction(darktable.db);
     _image_set_location((GList *)imgs, geoloc, &undo, undo_on);
+    dt_database_release_transaction(darktable.db);
 
     if(undo_on)
     {
@@ -693,7 +695,10 @@ void dt_image_set_images_locations(const GList *imgs, const GArray *gloc, const
   GList *undo = NULL;
   if(undo_on) dt_undo_start_group(darktable.undo, DT_UNDO_GEOTAG);
 
+  // one write per image, all committed at once
+  dt_database_start_transaction(darktable.db);
   _image_set_images_locations(imgs, gloc, &undo, undo_on);
+  dt_database_release_transaction(darktable.db);
 
   if(undo_on)
   {
@@ -764,7 +769,7 @@ void dt_image_set_flip(const int32_t imgid, const dt_image_orientation_t orienta
 
   dt_history_hash_write_from_history(imgid, DT_HISTORY_HASH_CURRENT);
 
-  dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+  if(dt_history_hash_mipmap_outdated(imgid)) dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
   dt_control_save_xmp(imgid);
 }
 
@@ -1206,6 +1211,9 @@ int32_t dt_image_duplicate_with_version(const int32_t imgid, const int32_t newve
 
 void dt_image_remove(const int32_t imgid)
 {
+  // a late write would bring back the sidecar of a deleted image
+  dt_image_forget_sidecar_file(imgid);
+
   // if a local copy exists, remove it
 
   if(dt_image_local_copy_reset(imgid)) return;
@@ -1228,6 +1236,7 @@ void dt_image_remove(const int32_t imgid)
                               NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.meta_data WHERE id = ?1", -1, &stmt,
                               NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
@@ -1238,6 +1247,51 @@ void dt_image_remove(const int32_t imgid)
   dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
 }
 
+void dt_image_remove_list(const GList *imgs)
+{
+  sqlite3 *db = dt_database_get(darktable.db);
+  GList *removed = NULL;
+
+  dt_database_start_transaction(darktable.db);
+  sqlite3_exec(db, "DELETE FROM memory.removed_images", NULL, NULL, NULL);
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
+                                                 "INSERT OR IGNORE INTO memory.removed_images (imgid) VALUES (?1)");
+  for(const GList *l = imgs; l; l = g_list_next(l))
+  {
+    const int32_t imgid = GPOINTER_TO_INT(l->data);
+
+    // same as dt_image_remove(), but the rows go all at once below
+    dt_image_forget_sidecar_file(imgid);
+    if(dt_image_local_copy_reset(imgid)) continue;
+
+    const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+    if(!img) continue;
+    const int old_group_id = img->group_id;
+    dt_image_cache_read_release(darktable.image_cache, img);
+    dt_image_cache_remove(darktable.image_cache, imgid);
+
+    const int new_group_id = dt_grouping_remove_from_group(imgid);
+    if(darktable.gui && darktable.gui->expanded_group_id == old_group_id)
+      darktable.gui->expanded_group_id = new_group_id;
+
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    removed = g_list_prepend(removed, GINT_TO_POINTER(imgid));
+  }
+  dt_database_release_statement(darktable.db, stmt);
+
+  // due to foreign keys, the rows of all the tables referencing the images go as well
+  sqlite3_exec(db, "DELETE FROM main.images WHERE id IN (SELECT imgid FROM memory.removed_images)",
+               NULL, NULL, NULL);
+  sqlite3_exec(db, "DELETE FROM main.meta_data WHERE id IN (SELECT imgid FROM memory.removed_images)",
+               NULL, NULL, NULL);
+  sqlite3_exec(db, "DELETE FROM memory.removed_images", NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
+
+  dt_mipmap_cache_remove_list(darktable.mipmap_cache, removed);
+}
+
 gboolean dt_image_altered(const int32_t imgid)
 {
   dt_history_hash_t status = dt_history_hash_get_status(imgid);
@@ -2303,6 +2357,11 @@ int32_t dt_image_copy(const int32_t imgid, const int32_t filmid)
   return dt_image_copy_rename(imgid, filmid, NULL);
 }
 
+void dt_image_local_copy_path(const int32_t imgid, char *pathname, size_t pathname_len)
+{
+  _image_local_copy_full_path(imgid, pathname, pathname_len);
+}
+
 int dt_image_local_copy_set(const int32_t imgid)
 {
   gchar srcpath[PATH_MAX] = { 0 };
@@ -2458,6 +2517,18 @@ int dt_image_local_copy_reset(const int32_t imgid)
 // xmp stuff
 // *******************************************************
 
+static void _image_write_timestamp(sqlite3 *handle, gpointer data)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2
+    (handle,
+     "UPDATE main.images SET write_timestamp = STRFTIME('%s', 'now') WHERE id = ?1",
+     -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, GPOINTER_TO_INT(data));
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+}
+
 int dt_image_write_sidecar_file(const int32_t imgid)
 {
   // FIXME: [CRITICAL] should lock the image history at the app level
@@ -2487,15 +2558,8 @@ int dt_image_write_sidecar_file(const int32_t imgid)
     if(!dt_exif_xmp_write(imgid, filename))
     {
       // put the timestamp into db. this can't be done in exif.cc since that code gets called
-      // for the copy exporter, too
-      sqlite3_stmt *stmt;
-      DT_DEBUG_SQLITE3_PREPARE_V2
-        (dt_database_get(darktable.db),
-         "UPDATE main.images SET write_timestamp = STRFTIME('%s', 'now') WHERE id = ?1",
-         -1, &stmt, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-      sqlite3_step(stmt);
-      sqlite3_finalize(stmt);
+      // for the copy exporter, too. nobody reads it right away, so it goes with the next batch
+      dt_database_write_async(darktable.db, _image_write_timestamp, GINT_TO_POINTER(imgid), NULL);
       return 0;
     }
   }
@@ -2503,6 +2567,178 @@ int dt_image_write_sidecar_file(const int32_t imgid)
   return 1; // error : nothing written
 }
 
+// *******************************************************
+// deferred sidecar writes
+// *******************************************************
+
+// how long a change waits for others to the same image before its sidecar gets written
+#define DT_IMAGE_SIDECAR_DELAY (2 * G_TIME_SPAN_SECOND)
+
+typedef struct dt_image_sidecar_writer_t
+{
+  GMutex lock;
+  GCond cond;
+  GQueue *queue;     // imgids in the order they were queued, hence of their due time
+  GHashTable *due;   // imgid -> monotonic time its sidecar should be written at
+  int32_t writing;   // imgid the writer thread is busy with, 0 if none
+  gboolean stop;
+  GThread *thread;
+} dt_image_sidecar_writer_t;
+
+static dt_image_sidecar_writer_t *_sidecar_writer = NULL;
+
+static void _sidecar_write(const int32_t imgid)
+{
+  if(dt_image_write_sidecar_file(imgid))
+    fprintf(stdout, "cannot write XMP file for image %i. The target storage may be unavailable or read-only.\n", imgid);
+}
+
+// called with the lock held, returns with it held
+static gboolean _sidecar_writer_pop(dt_image_sidecar_writer_t *w, int32_t *imgid)
+{
+  if(g_queue_is_empty(w->queue)) return FALSE;
+  *imgid = GPOINTER_TO_INT(g_queue_pop_head(w->queue));
+  g_hash_table_remove(w->due, GINT_TO_POINTER(*imgid));
+  return TRUE;
+}
+
+static gpointer _sidecar_writer_run(gpointer data)
+{
+  dt_image_sidecar_writer_t *w = (dt_image_sidecar_writer_t *)data;
+
+  g_mutex_lock(&w->lock);
+  while(!w->stop)
+  {
+    if(g_queue_is_empty(w->queue))
+    {
+      g_cond_wait(&w->cond, &w->lock);
+      continue;
+    }
+
+    // wait for the oldest one to be due. anything queued meanwhile is due later.
+    const gint64 due = GPOINTER_TO_SIZE(g_hash_table_lookup(w->due, g_queue_peek_head(w->queue)));
+    if(g_get_monotonic_time() < due)
+    {
+      g_cond_wait_until(&w->cond, &w->lock, due);
+      continue;
+    }
+
+    int32_t imgid = 0;
+    _sidecar_writer_pop(w, &imgid);
+    w->writing = imgid;
+    g_mutex_unlock(&w->lock);
+
+    _sidecar_write(imgid);
+
+    g_mutex_lock(&w->lock);
+    w->writing = 0;
+    g_cond_broadcast(&w->cond);
+  }
+  g_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+void dt_image_sidecar_writer_init(void)
+{
+  dt_image_sidecar_writer_t *w = g_malloc0(sizeof(dt_image_sidecar_writer_t));
+  g_mutex_init(&w->lock);
+  g_cond_init(&w->cond);
+  w->queue = g_queue_new();
+  w->due = g_hash_table_new(NULL, NULL);
+  w->thread = g_thread_new("xmp_writer", _sidecar_writer_run, w);
+  _sidecar_writer = w;
+}
+
+void dt_image_sidecar_writer_cleanup(void)
+{
+  dt_image_sidecar_writer_t *w = _sidecar_writer;
+  if(!w) return;
+
+  g_mutex_lock(&w->lock);
+  w->stop = TRUE;
+  g_cond_broadcast(&w->cond);
+  g_mutex_unlock(&w->lock);
+  g_thread_join(w->thread);
+  _sidecar_writer = NULL;
+
+  // write what is left right away
+  int32_t imgid = 0;
+  while(_sidecar_writer_pop(w, &imgid)) _sidecar_write(imgid);
+
+  g_queue_free(w->queue);
+  g_hash_table_destroy(w->due);
+  g_cond_clear(&w->cond);
+  g_mutex_clear(&w->lock);
+  g_free(w);
+}
+
+void dt_image_queue_sidecar_file(const int32_t imgid)
+{
+  if(imgid <= 0 || dt_image_get_xmp_mode() == DT_WRITE_XMP_NEVER) return;
+
+  dt_image_sidecar_writer_t *w = _sidecar_writer;
+  if(!w)
+  {
+    dt_image_write_sidecar_file(imgid);
+    return;
+  }
+
+  g_mutex_lock(&w->lock);
+  // already queued: this change goes with the write to come
+  if(!g_hash_table_contains(w->due, GINT_TO_POINTER(imgid)))
+  {
+    const gint64 due = g_get_monotonic_time() + DT_IMAGE_SIDECAR_DELAY;
+    g_hash_table_insert(w->due, GINT_TO_POINTER(imgid), GSIZE_TO_POINTER(due));
+    g_queue_push_tail(w->queue, GINT_TO_POINTER(imgid));
+    g_cond_broadcast(&w->cond);
+  }
+  g_mutex_unlock(&w->lock);
+}
+
+// take imgid out of the queue, and wait for the writer if it is busy with it.
+// returns whether a write was pending.
+static gboolean _sidecar_writer_take(dt_image_sidecar_writer_t *w, const int32_t imgid)
+{
+  gboolean pending = FALSE;
+  g_mutex_lock(&w->lock);
+  if(g_hash_table_remove(w->due, GINT_TO_POINTER(imgid)))
+  {
+    g_queue_remove(w->queue, GINT_TO_POINTER(imgid));
+    pending = TRUE;
+  }
+  while(w->writing == imgid) g_cond_wait(&w->cond, &w->lock);
+  g_mutex_unlock(&w->lock);
+  return pending;
+}
+
+void dt_image_flush_sidecar_files(const int32_t imgid)
+{
+  dt_image_sidecar_writer_t *w = _sidecar_writer;
+  if(!w) return;
+
+  if(imgid > 0)
+  {
+    if(_sidecar_writer_take(w, imgid)) _sidecar_write(imgid);
+    return;
+  }
+
+  g_mutex_lock(&w->lock);
+  int32_t id = 0;
+  while(_sidecar_writer_pop(w, &id))
+  {
+    g_mutex_unlock(&w->lock);
+    _sidecar_write(id);
+    g_mutex_lock(&w->lock);
+  }
+  while(w->writing) g_cond_wait(&w->cond, &w->lock);
+  g_mutex_unlock(&w->lock);
+}
+
+void dt_image_forget_sidecar_file(const int32_t imgid)
+{
+  if(_sidecar_writer) _sidecar_writer_take(_sidecar_writer, imgid);
+}
+
 void dt_image_synch_xmps(const GList *img)
 {
   if(!img) return;
@@ -2510,7 +2746,7 @@ void dt_image_synch_xmps(const GList *img)
   {
     for(const GList *imgs = img; imgs; imgs = g_list_next(imgs))
     {
-      dt_image_write_sidecar_file(GPOINTER_TO_INT(imgs->data));
+      dt_image_queue_sidecar_file(GPOINTER_TO_INT(imgs->data));
     }
   }
 }
@@ -2519,7 +2755,7 @@ void dt_image_synch_xmp(const int selected)
 {
   if(selected > 0)
   {
-    dt_image_write_sidecar_file(selected);
+    dt_image_queue_sidecar_file(selected);
   }
   else
   {
@@ -327,6 +327,8 @@ int32_t dt_image_import(int32_t film_id, const char *filename, gboolean raise_si
 int32_t dt_image_import_lua(int32_t film_id, const char *filename);
 /** removes the given image from the database. */
 void dt_image_remove(const int32_t imgid);
+/** removes the given images from the database at once. */
+void dt_image_remove_list(const GList *imgs);
 /** duplicates the given image in the database with the duplicate getting the supplied version number. if that
     version already exists just return the imgid without producing new duplicate. called with newversion -1 a new
     duplicate is produced with the next free version number. */
@@ -412,6 +414,8 @@ int32_t dt_image_copy(const int32_t imgid, const int32_t filmid);
 int32_t dt_image_copy_rename(const int32_t imgid, const int32_t filmid, const gchar *newname);
 int dt_image_local_copy_set(const int32_t imgid);
 int dt_image_local_copy_reset(const int32_t imgid);
+/** path of the local copy of the image in the cache directory, whether it exists or not */
+void dt_image_local_copy_path(const int32_t imgid, char *pathname, size_t pathname_len);
 /* check whether it is safe to remove a file */
 gboolean dt_image_safe_remove(const int32_t imgid);
 /* try to sync .xmp for all local copies */
@@ -421,6 +425,17 @@ int dt_image_write_sidecar_file(const int32_t imgid);
 void dt_image_synch_xmp(const int selected);
 void dt_image_synch_xmps(const GList *img);
 void dt_image_synch_all_xmp(const gchar *pathname);
+/** start the thread writing the sidecars of dt_image_queue_sidecar_file() */
+void dt_image_sidecar_writer_init(void);
+/** write the queued sidecars and stop the thread */
+void dt_image_sidecar_writer_cleanup(void);
+/** write the sidecar of imgid in the background, a short while later. Changes to the same image in the
+ *  meantime are written at once. Without the writer thread, this writes right away. */
+void dt_image_queue_sidecar_file(const int32_t imgid);
+/** write the queued sidecar of imgid now, or all of them if imgid <= 0 */
+void dt_image_flush_sidecar_files(const int32_t imgid);
+/** drop the queued sidecar write of imgid, for images being removed */
+void dt_image_forget_sidecar_file(const int32_t imgid);
 /** get the mode xmp sidecars are written */
 dt_imageio_write_xmp_t dt_image_get_xmp_mode();
 
@@ -29,6 +29,67 @@
 #include <sqlite3.h>
 #include <inttypes.h>
 
+// number of snapshot slots, must be a power of 2.
+// Consecutive ids never collide, which covers what the lighttable shows at once.
+#define DT_IMAGE_CACHE_SLOTS 16384
+
+static inline dt_image_cache_slot_t *_get_slot(dt_image_cache_t *cache, const int32_t imgid)
+{
+  return cache->slots + ((uint32_t)imgid & cache->slots_mask);
+}
+
+// writers of ids sharing a slot serialize on the odd sequence number
+static int _slot_write_lock(dt_image_cache_slot_t *slot)
+{
+  int seq = dt_atomic_get_int(&slot->seq);
+  while((seq & 1) || !dt_atomic_CAS_int(&slot->seq, &seq, seq + 1))
+  {
+    if(seq & 1)
+    {
+      g_usleep(1);
+      seq = dt_atomic_get_int(&slot->seq);
+    }
+  }
+  return seq + 1;
+}
+
+static void _snapshot_fill(dt_image_snapshot_t *snap, const dt_image_t *img)
+{
+  snap->id = img->id;
+  snap->group_id = img->group_id;
+  snap->film_id = img->film_id;
+  snap->version = img->version;
+  snap->flags = img->flags;
+  snap->orientation = img->orientation;
+  snap->width = img->width;
+  snap->height = img->height;
+  snap->final_width = img->final_width;
+  snap->final_height = img->final_height;
+  snap->p_width = img->p_width;
+  snap->p_height = img->p_height;
+  snap->aspect_ratio = img->aspect_ratio;
+  snap->change_timestamp = img->change_timestamp;
+}
+
+static void _snapshot_publish(dt_image_cache_t *cache, const dt_image_t *img)
+{
+  if(img->id <= 0) return;
+  dt_image_cache_slot_t *slot = _get_slot(cache, img->id);
+  const int seq = _slot_write_lock(slot);
+  _snapshot_fill(&slot->snapshot, img);
+  dt_atomic_set_int(&slot->seq, seq + 1);
+}
+
+static void _snapshot_invalidate(dt_image_cache_t *cache, const int32_t imgid)
+{
+  if(imgid <= 0) return;
+  dt_image_cache_slot_t *slot = _get_slot(cache, imgid);
+  const int seq = _slot_write_lock(slot);
+  // the slot may have been taken by another id since
+  if(slot->snapshot.id == imgid) slot->snapshot.id = 0;
+  dt_atomic_set_int(&slot->seq, seq + 1);
+}
+
 void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
 {
   entry->cost = sizeof(dt_image_t);
@@ -36,11 +97,13 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
   dt_image_t *img = (dt_image_t *)g_malloc(sizeof(dt_image_t));
   dt_image_init(img);
   entry->data = img;
-  // load stuff from db and store in cache:
+  // load stuff from db and store in cache, this is called a lot while browsing:
+  // don't wait for the main connection
+  sqlite3 *handle = dt_database_get_reader(darktable.db);
   sqlite3_stmt *stmt;
   // clang-format off
   DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
+      handle,
       "SELECT id, group_id, film_id, width, height, filename, maker, model, lens, exposure,"
       "       aperture, iso, focal_length, datetime_taken, flags, crop, orientation,"
       "       focus_distance, raw_parameters, longitude, latitude, altitude, color_matrix,"
@@ -157,17 +220,20 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
   {
     img->id = -1;
     fprintf(stderr, "[image_cache_allocate] failed to open image %" PRIu32 " from database: %s\n", entry->key,
-            sqlite3_errmsg(dt_database_get(darktable.db)));
+            sqlite3_errmsg(handle));
   }
   sqlite3_finalize(stmt);
+  dt_database_release_reader(darktable.db, handle);
   img->cache_entry = entry; // init backref
   // could downgrade lock write->read on entry->lock if we were using concurrencykit..
   dt_image_refresh_makermodel(img);
+  _snapshot_publish((dt_image_cache_t *)data, img);
 }
 
 void dt_image_cache_deallocate(void *data, dt_cache_entry_t *entry)
 {
   dt_image_t *img = (dt_image_t *)entry->data;
+  _snapshot_invalidate((dt_image_cache_t *)data, img->id);
   g_free(img->profile);
   g_list_free_full(img->dng_gain_maps, g_free);
   g_free(img);
@@ -183,7 +249,11 @@ void dt_image_cache_init(dt_image_cache_t *cache)
   //       can we get away with a fixed size?
   const uint32_t max_mem = 50 * 1024 * 1024;
   const uint32_t num = (uint32_t)(1.5f * max_mem / sizeof(dt_image_t));
-  dt_cache_init(&cache->cache, sizeof(dt_image_t), max_mem);
+  cache->slots = dt_alloc_align(sizeof(dt_image_cache_slot_t) * DT_IMAGE_CACHE_SLOTS);
+  memset(cache->slots, 0, sizeof(dt_image_cache_slot_t) * DT_IMAGE_CACHE_SLOTS);
+  cache->slots_mask = DT_IMAGE_CACHE_SLOTS - 1;
+  // one shard per core: lighttable, thumbnail and import jobs hit this cache from all threads at once
+  dt_cache_init(&cache->cache, sizeof(dt_image_t), max_mem, darktable.num_openmp_threads);
   dt_cache_set_allocate_callback(&cache->cache, &dt_image_cache_allocate, cache);
   dt_cache_set_cleanup_callback(&cache->cache, &dt_image_cache_deallocate, cache);
 
@@ -193,13 +263,17 @@ void dt_image_cache_init(dt_image_cache_t *cache)
 void dt_image_cache_cleanup(dt_image_cache_t *cache)
 {
   dt_cache_cleanup(&cache->cache);
+  // after the cache: deallocating entries invalidates their slot
+  dt_free_align(cache->slots);
+  cache->slots = NULL;
 }
 
 void dt_image_cache_print(dt_image_cache_t *cache)
 {
-  printf("[image cache] fill %.2f/%.2f MB (%.2f%%)\n", cache->cache.cost / (1024.0 * 1024.0),
+  const size_t cost = dt_cache_get_cost(&cache->cache);
+  printf("[image cache] fill %.2f/%.2f MB (%.2f%%)\n", cost / (1024.0 * 1024.0),
          cache->cache.cost_quota / (1024.0 * 1024.0),
-         (float)cache->cache.cost / (float)cache->cache.cost_quota);
+         (float)cost / (float)cache->cache.cost_quota);
 }
 
 dt_image_t *dt_image_cache_get(dt_image_cache_t *cache, const int32_t imgid, char mode)
@@ -223,6 +297,32 @@ dt_image_t *dt_image_cache_testget(dt_image_cache_t *cache, const int32_t imgid,
   return img;
 }
 
+int dt_image_cache_get_snapshot(dt_image_cache_t *cache, const int32_t imgid, dt_image_snapshot_t *snapshot)
+{
+  if(imgid <= 0) return 1;
+  dt_image_cache_slot_t *slot = _get_slot(cache, imgid);
+
+  // seqlock read: a few retries if a writer is busy, then give up and take the locks
+  for(int tries = 0; tries < 8; tries++)
+  {
+    const int before = dt_atomic_get_int(&slot->seq);
+    if(before & 1) continue;
+    memcpy(snapshot, &slot->snapshot, sizeof(dt_image_snapshot_t));
+    dt_atomic_fence();
+    if(dt_atomic_get_int(&slot->seq) != before) continue;
+    if(snapshot->id == imgid) return 0;
+    break;
+  }
+
+  // not cached, or the slot is shared with another cached id
+  const dt_image_t *img = dt_image_cache_get(cache, imgid, 'r');
+  if(!img) return 1;
+  const int exists = (img->id == imgid);
+  if(exists) _snapshot_fill(snapshot, img);
+  dt_image_cache_read_release(cache, img);
+  return !exists;
+}
+
 // drops the read lock on an image struct
 void dt_image_cache_read_release(dt_image_cache_t *cache, const dt_image_t *img)
 {
@@ -309,6 +409,9 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
   if(rc != SQLITE_DONE) fprintf(stderr, "[image_cache_write_release] sqlite3 error %d\n", rc);
   sqlite3_finalize(stmt);
 
+  // lock-free readers see the new values from now on
+  _snapshot_publish(cache, img);
+
   // TODO: make this work in relaxed mode, too.
   // TODO: protect XMP saving from concurrent accesses to DB history
   if(mode == DT_IMAGE_CACHE_SAFE)
@@ -18,12 +18,38 @@
 
 #pragma once
 
+#include "common/atomic.h"
 #include "common/cache.h"
 #include "common/image.h"
 
+// Copy of the hot metadata of an image, which can be read without taking any lock.
+// See dt_image_cache_get_snapshot().
+typedef struct dt_image_snapshot_t
+{
+  int32_t id, group_id, film_id, version;
+  int32_t flags;
+  dt_image_orientation_t orientation;
+  int32_t width, height, final_width, final_height, p_width, p_height;
+  float aspect_ratio;
+  GTimeSpan change_timestamp;
+}
+dt_image_snapshot_t;
+
+// Seqlock-protected slot: the sequence is odd while a writer updates the snapshot.
+typedef struct dt_image_cache_slot_t
+{
+  dt_atomic_int seq;
+  dt_image_snapshot_t snapshot;
+}
+__attribute__((aligned(64))) dt_image_cache_slot_t;
+
 typedef struct dt_image_cache_t
 {
   dt_cache_t cache;
+
+  // direct-mapped by image id, only holds images currently in the cache
+  dt_image_cache_slot_t *slots;
+  uint32_t slots_mask;
 }
 dt_image_cache_t;
 
@@ -55,6 +81,12 @@ dt_image_t *dt_image_cache_get(dt_image_cache_t *cache, const int32_t imgid, cha
 // is currently unavailable.
 dt_image_t *dt_image_cache_testget(dt_image_cache_t *cache, const int32_t imgid, char mode);
 
+// copies the hot metadata of the image without taking any lock when the image is cached,
+// otherwise falls back to dt_image_cache_get(), which will cache it for the next time.
+// The copy is consistent but may be outdated as soon as it's returned: don't use it to
+// write back into the cache. returns 0 on success, 1 if the image doesn't exist.
+int dt_image_cache_get_snapshot(dt_image_cache_t *cache, const int32_t imgid, dt_image_snapshot_t *snapshot);
+
 // drops the read lock on an image struct
 void dt_image_cache_read_release(dt_image_cache_t *cache, const dt_image_t *img);
 
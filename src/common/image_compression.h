@@ -19,9 +19,13 @@
 #pragma once
 
 #include <inttypes.h>
+#include <stddef.h>
 
 /** K. Roimela, T. Aarnio and J. Itäranta. High Dynamic Range Texture Compression. Proceedings of SIGGRAPH
- * 2006. */
+ * 2006.
+ * Lossy coding of 4-channel float RGB images in 16 bytes per 4×4 block (alpha is dropped). Widths and
+ * heights need not be multiples of 4. */
+size_t dt_image_compressed_size(const int32_t width, const int32_t height);
 void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const int32_t height);
 void dt_image_uncompress(const uint8_t *in, float *out, const int32_t width, const int32_t height);
 
@@ -17,11 +17,18 @@
 */
 
 #include <stdarg.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 #include "common/imagebuf.h"
+#include "common/memstat.h"
+#include "control/conf.h"
 
 static size_t parallel_imgop_minimum = 500000;
 static size_t parallel_imgop_maxthreads = 4;
 
+static void *_scratch_alloc(const size_t size);
+
 // Allocate one or more buffers as detailed in the given parameters.  If any allocation fails, free all of them,
 // set the module's trouble flag, and return FALSE.
 gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
@@ -87,13 +94,15 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
     }
     if (size & DT_IMGSZ_PERTHREAD)
     {
-      *bufptr = dt_alloc_perthread_float(nfloats,paddedsize);
+      const size_t cache_lines = (nfloats * sizeof(float) + DT_CACHELINE_BYTES - 1) / DT_CACHELINE_BYTES;
+      *paddedsize = DT_CACHELINE_BYTES * cache_lines / sizeof(float);
+      *bufptr = _scratch_alloc(DT_CACHELINE_BYTES * cache_lines * darktable.num_openmp_threads);
       if ((size & DT_IMGSZ_CLEARBUF) && *bufptr)
         memset(*bufptr, 0, *paddedsize * darktable.num_openmp_threads * sizeof(float));
     }
     else
     {
-      *bufptr = dt_alloc_align_float(nfloats);
+      *bufptr = _scratch_alloc(nfloats * sizeof(float));
       if ((size & DT_IMGSZ_CLEARBUF) && *bufptr)
         memset(*bufptr, 0, nfloats * sizeof(float));
     }
@@ -102,6 +111,9 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
       success = FALSE;
       break;
     }
+    dt_memstat_alloc(DT_MEMSTAT_SCRATCH, sizeof(float) * ((size & DT_IMGSZ_PERTHREAD)
+                                                              ? *paddedsize * darktable.num_openmp_threads
+                                                              : nfloats));
   }
   va_end(args);
 
@@ -117,7 +129,7 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
         (void)va_arg(args,size_t*);  // skip the extra pointer for per-thread allocations
       if (size == 0 || !bufptr || !*bufptr)
         break;  // end of arg list or this attempted allocation failed
-      dt_free_align(*bufptr);
+      dt_iop_free_image_buffer(*bufptr);
       *bufptr = NULL;
     }
     va_end(args);
@@ -126,6 +138,141 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
   return success;
 }
 
+// *******************************************************
+// scratch pool
+// *******************************************************
+
+// a block below this size isn't worth keeping, malloc recycles those well
+#define DT_SCRATCH_MIN_BYTES (256 * 1024)
+#define DT_HUGEPAGE_BYTES (2 * 1024 * 1024)
+
+typedef struct dt_iop_scratch_block_t
+{
+  void *ptr;
+  size_t size;
+} dt_iop_scratch_block_t;
+
+typedef struct dt_iop_scratch_pool_t
+{
+  GList *idle;       // dt_iop_scratch_block_t left from the previous run, not used in this one yet
+  GList *reused;     // given back in this run
+  GHashTable *live;  // ptr -> dt_iop_scratch_block_t handed out in this run
+  gboolean hugepages;
+} dt_iop_scratch_pool_t;
+
+// pool of the pipe running on this thread
+static __thread dt_iop_scratch_pool_t *_pool = NULL;
+
+dt_iop_scratch_pool_t *dt_iop_scratch_pool_new(void)
+{
+  dt_iop_scratch_pool_t *pool = g_malloc0(sizeof(dt_iop_scratch_pool_t));
+  pool->live = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  pool->hugepages = dt_conf_get_bool("pixelpipe_scratch_hugepages");
+  return pool;
+}
+
+static void _block_free(gpointer data)
+{
+  dt_iop_scratch_block_t *block = (dt_iop_scratch_block_t *)data;
+  dt_free_align(block->ptr);
+  g_free(block);
+}
+
+void dt_iop_scratch_pool_destroy(dt_iop_scratch_pool_t *pool)
+{
+  if(!pool) return;
+  g_list_free_full(pool->idle, _block_free);
+  g_list_free_full(pool->reused, _block_free);
+  // blocks still out belong to whoever kept them
+  g_hash_table_destroy(pool->live);
+  g_free(pool);
+}
+
+void dt_iop_scratch_pool_begin(dt_iop_scratch_pool_t *pool)
+{
+  _pool = pool;
+}
+
+void dt_iop_scratch_pool_end(void)
+{
+  dt_iop_scratch_pool_t *pool = _pool;
+  _pool = NULL;
+  if(!pool) return;
+
+  // keep what this run needed, the next one will likely need the same
+  g_list_free_full(pool->idle, _block_free);
+  pool->idle = pool->reused;
+  pool->reused = NULL;
+  // blocks not given back outlive the run, from now on they are plain allocations
+  g_hash_table_remove_all(pool->live);
+}
+
+// best fit in list, not more than twice too large
+static GList *_best_fit(GList *list, const size_t size)
+{
+  GList *best = NULL;
+  for(GList *l = list; l; l = g_list_next(l))
+  {
+    const dt_iop_scratch_block_t *block = (dt_iop_scratch_block_t *)l->data;
+    if(block->size >= size && block->size <= 2 * size
+       && (!best || block->size < ((dt_iop_scratch_block_t *)best->data)->size))
+      best = l;
+  }
+  return best;
+}
+
+static void *_scratch_alloc(const size_t size)
+{
+  dt_iop_scratch_pool_t *pool = _pool;
+  if(!pool || size < DT_SCRATCH_MIN_BYTES) return dt_alloc_align(size);
+
+  dt_iop_scratch_block_t *block = NULL;
+  GList *best = NULL;
+  if((best = _best_fit(pool->reused, size)))
+  {
+    block = (dt_iop_scratch_block_t *)best->data;
+    pool->reused = g_list_delete_link(pool->reused, best);
+  }
+  else if((best = _best_fit(pool->idle, size)))
+  {
+    block = (dt_iop_scratch_block_t *)best->data;
+    pool->idle = g_list_delete_link(pool->idle, best);
+  }
+  else
+  {
+    void *ptr = dt_alloc_aligned(size, pool->hugepages && size >= DT_HUGEPAGE_BYTES ? DT_HUGEPAGE_BYTES : 64);
+    if(!ptr) return NULL;
+#if defined(MADV_HUGEPAGE)
+    if(pool->hugepages && size >= DT_HUGEPAGE_BYTES)
+    {
+      // the pages stay with the pool from run to run, transparent huge pages save on TLB misses and faults
+      const uintptr_t start = ((uintptr_t)ptr + DT_HUGEPAGE_BYTES - 1) & ~((uintptr_t)DT_HUGEPAGE_BYTES - 1);
+      const uintptr_t end = ((uintptr_t)ptr + size) & ~((uintptr_t)DT_HUGEPAGE_BYTES - 1);
+      if(end > start) madvise((void *)start, end - start, MADV_HUGEPAGE);
+    }
+#endif
+    block = g_malloc(sizeof(dt_iop_scratch_block_t));
+    block->ptr = ptr;
+    block->size = size;
+  }
+  g_hash_table_insert(pool->live, block->ptr, block);
+  return block->ptr;
+}
+
+void dt_iop_free_image_buffer(void *buf)
+{
+  if(!buf) return;
+  dt_iop_scratch_pool_t *pool = _pool;
+  dt_iop_scratch_block_t *block = pool ? g_hash_table_lookup(pool->live, buf) : NULL;
+  if(!block)
+  {
+    dt_free_align(buf);
+    return;
+  }
+  g_hash_table_steal(pool->live, buf);
+  pool->reused = g_list_prepend(pool->reused, block);
+}
+
 
 // Copy an image buffer, specifying the number of floats it contains.  Use of this function is to be preferred
 // over a bare memcpy both because it helps document the purpose of the code and because it gives us a single
@@ -138,7 +285,7 @@ void dt_iop_image_copy(float *const __restrict__ out, const float *const __restr
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
-    const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
+    const int nthreads = MIN(dt_omp_threads(),parallel_imgop_maxthreads);
 #pragma omp parallel for simd aligned(in, out : 16) default(none) \
     dt_omp_firstprivate(in, out, nfloats) schedule(simd:static) num_threads(nthreads)
     for(size_t k = 0; k < nfloats; k++)
@@ -192,7 +339,7 @@ void dt_iop_image_scaled_copy(float *const restrict buf, const float *const rest
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
-    const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
+    const int nthreads = MIN(dt_omp_threads(),parallel_imgop_maxthreads);
 #pragma omp parallel for simd aligned(buf, src : 16) default(none) \
   dt_omp_firstprivate(buf, src, scale, nfloats) schedule(simd:static) num_threads(nthreads)
     for(size_t k = 0; k < nfloats; k++)
@@ -215,7 +362,7 @@ void dt_iop_image_fill(float *const buf, const float fill_value, const size_t wi
 #ifdef _OPENMP
   if (nfloats > parallel_imgop_minimum)	// is the copy big enough to outweigh threading overhead?
   {
-    const size_t nthreads = MIN(16,darktable.num_openmp_threads);
+    const size_t nthreads = MIN(16,dt_omp_threads());
     // determine the number of 4-float vectors to be processed by each thread
     const size_t chunksize = (((nfloats + nthreads - 1) / nthreads) + 3) / 4;
 #pragma omp parallel for default(none) \
@@ -255,7 +402,7 @@ void dt_iop_image_add_const(float *const buf, const float add_value, const size_
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
-    const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
+    const int nthreads = MIN(dt_omp_threads(),parallel_imgop_maxthreads);
 #pragma omp parallel for simd aligned(buf:16) default(none) \
   dt_omp_firstprivate(buf, add_value, nfloats) schedule(simd:static) num_threads(nthreads)
     for(size_t k = 0; k < nfloats; k++)
@@ -281,7 +428,7 @@ void dt_iop_image_add_image(float *const buf, const float* const other_image,
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
-    const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
+    const int nthreads = MIN(dt_omp_threads(),parallel_imgop_maxthreads);
 #pragma omp parallel for simd aligned(buf, other_image : 16) default(none) \
   dt_omp_firstprivate(buf, other_image, nfloats) schedule(simd:static) num_threads(nthreads)
     for(size_t k = 0; k < nfloats; k++)
@@ -307,7 +454,7 @@ void dt_iop_image_sub_image(float *const buf, const float* const other_image,
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
-    const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
+    const int nthreads = MIN(dt_omp_threads(),parallel_imgop_maxthreads);
 #pragma omp parallel for simd aligned(buf, other_image : 16) default(none) \
   dt_omp_firstprivate(buf, other_image, nfloats) schedule(simd:static) num_threads(nthreads)
     for(size_t k = 0; k < nfloats; k++)
@@ -333,7 +480,7 @@ void dt_iop_image_invert(float *const buf, const float max_value, const size_t w
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
-    const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
+    const int nthreads = MIN(dt_omp_threads(),parallel_imgop_maxthreads);
 #pragma omp parallel for simd aligned(buf:16) default(none) \
   dt_omp_firstprivate(buf, max_value, nfloats) schedule(simd:static) num_threads(nthreads)
     for(size_t k = 0; k < nfloats; k++)
@@ -359,7 +506,7 @@ void dt_iop_image_mul_const(float *const buf, const float mul_value, const size_
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
-    const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
+    const int nthreads = MIN(dt_omp_threads(),parallel_imgop_maxthreads);
 #pragma omp parallel for simd aligned(buf:16) default(none) \
   dt_omp_firstprivate(buf, mul_value, nfloats) schedule(simd:static) num_threads(nthreads)
     for(size_t k = 0; k < nfloats; k++)
@@ -385,7 +532,7 @@ void dt_iop_image_div_const(float *const buf, const float div_value, const size_
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
-    const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
+    const int nthreads = MIN(dt_omp_threads(),parallel_imgop_maxthreads);
 #pragma omp parallel for simd aligned(buf:16) default(none) \
   dt_omp_firstprivate(buf, div_value, nfloats) schedule(simd:static) num_threads(nthreads)
     for(size_t k = 0; k < nfloats; k++)
@@ -413,7 +560,7 @@ void dt_iop_image_linear_blend(float *const restrict buf, const float lambda, co
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
-    const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
+    const int nthreads = MIN(dt_omp_threads(),parallel_imgop_maxthreads);
 #pragma omp parallel for simd aligned(buf:16) default(none) \
   dt_omp_firstprivate(buf, lambda, lambda_1,  nfloats) \
   dt_omp_sharedconst(other) schedule(simd:static) num_threads(nthreads)
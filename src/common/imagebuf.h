@@ -32,6 +32,8 @@ static inline float *__restrict__ dt_iop_image_alloc(const size_t width, const s
 
 // Allocate one or more buffers as detailed in the given parameters.  If any allocation fails, free all of them,
 // set the module's trouble flag, and return FALSE.
+//  The buffers should be released with dt_iop_free_image_buffer(), which hands them back to the scratch pool of
+//  the pipe for the next module.
 //  The variable arguments take the form  SIZE, PTR-to-floatPTR, SIZE, PTR-to-floatPTR, etc. except that if the SIZE
 //  indicates a per-thread allocation, a second pointer is passed: SIZE, PTR-to-floatPTR, PTR-to-size_t, SIZE, etc.
 //  SIZE is the number of floats per pixel, ORed with appropriate flags from the list following below
@@ -55,6 +57,19 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
 #define DT_IMGSZ_WIDTH      0x0020000  // buffer equal to one row of the image
 #define DT_IMGSZ_LONGEST    0x0030000  // buffer equal to larger of one row/one column
 
+// Release a buffer of dt_iop_alloc_image_buffers().  While a pipe runs, large ones go back to its scratch pool and
+// the next request of a similar size gets them, already mapped, instead of fresh memory.  Outside of a run, or
+// for buffers kept past the run, this is dt_free_align().
+void dt_iop_free_image_buffer(void *buf);
+
+// The scratch pool of a pipe.  It is opened on the thread of the pipe for a run, and keeps the blocks that run
+// used for the next one, dropping the others.
+struct dt_iop_scratch_pool_t;
+struct dt_iop_scratch_pool_t *dt_iop_scratch_pool_new(void);
+void dt_iop_scratch_pool_destroy(struct dt_iop_scratch_pool_t *pool);
+void dt_iop_scratch_pool_begin(struct dt_iop_scratch_pool_t *pool);
+void dt_iop_scratch_pool_end(void);
+
 
 __DT_CLONE_TARGETS__
 static inline void dt_simd_memcpy(const float *const __restrict__ in,
@@ -62,6 +62,7 @@
 #include "develop/blend.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
+#include "develop/imageop_math.h"
 
 #if defined(HAVE_GRAPHICSMAGICK)
 #include <magick/api.h>
@@ -71,6 +72,7 @@
 #endif
 
 #include <assert.h>
+#include <fcntl.h>
 #include <glib/gstdio.h>
 #include <inttypes.h>
 #include <math.h>
@@ -78,6 +80,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <unistd.h>
 
 #ifdef USE_LUA
 #include "lua/image.h"
@@ -126,6 +129,13 @@ dt_image_flags_t dt_imageio_get_type_from_extension(const char *extension)
 // load a full-res thumbnail:
 int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
                                dt_colorspaces_color_profile_type_t *color_space)
+{
+  return dt_imageio_large_thumbnail_scaled(filename, buffer, width, height, color_space, 0, 0);
+}
+
+int dt_imageio_large_thumbnail_scaled(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
+                                      dt_colorspaces_color_profile_type_t *color_space,
+                                      const int32_t box_width, const int32_t box_height)
 {
   int res = 1;
 
@@ -141,6 +151,7 @@ int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *
     // Decompress the JPG into our own memory format
     dt_imageio_jpeg_t jpg;
     if(dt_imageio_jpeg_decompress_header(buf, bufsize, &jpg)) goto error;
+    dt_imageio_jpeg_set_scale(&jpg, box_width, box_height);
     *buffer = (uint8_t *)dt_alloc_align(sizeof(uint8_t) * 4 * jpg.width * jpg.height);
     if(!*buffer) goto error;
 
@@ -274,6 +285,17 @@ error:
   return res;
 }
 
+void dt_imageio_readahead(const char *filename)
+{
+#ifdef POSIX_FADV_WILLNEED
+  const int fd = g_open(filename, O_RDONLY, 0);
+  if(fd < 0) return;
+  // the readahead goes on after the file is closed
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  close(fd);
+#endif
+}
+
 gboolean dt_imageio_has_mono_preview(const char *filename)
 {
   dt_colorspaces_color_profile_type_t color_space;
@@ -736,102 +758,109 @@ void _filter_pipeline(const char *filter, dt_dev_pixelpipe_t *pipe)
 }
 
 
-gboolean _get_export_size(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, const dt_imageio_module_data_t *format_params, const gboolean is_scaling, const float image_ratio,
-                          double *scale, float *origin, int width, int height, int *processed_width, int *processed_height)
+// size of the export within width x height (0 = unbounded) for a pipe output of pipe_width x pipe_height
+static void _export_size(const int pipe_width, const int pipe_height, const gboolean is_scaling,
+                         const double image_ratio, double *scale, int width, int height, int *processed_width,
+                         int *processed_height)
 {
-// Set to TRUE if width size is explicitly set by user
+  // Set to TRUE if width size is explicitly set by user
   gboolean force_width;
   // Set to TRUE if height size is explicitly set by user
   gboolean force_height;
 
-  if(dt_dev_distort_backtransform_plus(dev, pipe, 0.f, DT_DEV_TRANSFORM_DIR_ALL, origin, 1))
+  if(is_scaling)
+  {
+    double _num, _denum;
+    dt_imageio_resizing_factor_get_and_parsing(&_num, &_denum);
+    const double scale_factor = _num / _denum;
+    *scale = fmin(scale_factor, 1.);
+    *processed_height = pipe_height * (*scale);
+    *processed_width = pipe_width * (*scale);
+    force_width = TRUE;
+    force_height = TRUE;
+  }
+  else
   {
-    if(is_scaling)
+    double scalex = 1.;
+    double scaley = 1.;
+
+    if(width == 0)
     {
-      double _num, _denum;
-      dt_imageio_resizing_factor_get_and_parsing(&_num, &_denum);
-      const double scale_factor = _num / _denum;
-      *scale = fmin(scale_factor, 1.);
-      *processed_height = pipe->processed_height * (*scale);
-      *processed_width = pipe->processed_width * (*scale);
-      force_width = TRUE;
-      force_height = TRUE;
+      force_width = FALSE;
+      width = pipe_width;
     }
     else
     {
-      double scalex = 1.;
-      double scaley = 1.;
-
-      if(width == 0)
-      {
-        force_width = FALSE;
-        width = pipe->processed_width;
-      }
-      else
-      {
-        force_width = TRUE;
-        scalex = fmin((double)width / (double)pipe->processed_width, 1.);
-      }
-
-      if(height == 0)
-      {
-        force_height = FALSE;
-        height = pipe->processed_height;
-      }
-      else
-      {
-        force_height = TRUE;
-        scaley = fmin((double)height / (double)pipe->processed_height, 1.);
-      }
+      force_width = TRUE;
+      scalex = fmin((double)width / (double)pipe_width, 1.);
+    }
 
-      *scale = fmin(scalex, scaley);
+    if(height == 0)
+    {
+      force_height = FALSE;
+      height = pipe_height;
     }
-  }
-  else
-  {
-    // error reading pipeline pieces for distort transforms
-    fprintf(stderr, "[export_with_flags] could not get output size from pipeline\n");
-    return 1;
+    else
+    {
+      force_height = TRUE;
+      scaley = fmin((double)height / (double)pipe_height, 1.);
+    }
+
+    *scale = fmin(scalex, scaley);
   }
 
   if(force_height && force_width)
   {
     // width and height both specified by user in pixels
-    if(pipe->processed_width > pipe->processed_height)
+    if(pipe_width > pipe_height)
     {
-      *processed_width = MIN(round(*scale * pipe->processed_width), width);
+      *processed_width = MIN(round(*scale * pipe_width), width);
       *processed_height = round(*processed_width / image_ratio);
     }
-    else if(pipe->processed_width < pipe->processed_height)
+    else if(pipe_width < pipe_height)
     {
-      *processed_height = MIN(round(*scale * pipe->processed_height), height);
+      *processed_height = MIN(round(*scale * pipe_height), height);
       *processed_width = round(*processed_height * image_ratio);
     }
     else
     {
-      *processed_width = MIN(round(*scale * pipe->processed_width), width);
-      *processed_height = MIN(round(*scale * pipe->processed_height), height);
+      *processed_width = MIN(round(*scale * pipe_width), width);
+      *processed_height = MIN(round(*scale * pipe_height), height);
     }
   }
   else if(force_width)
   {
     // width only specified by user in pixels, fluid height
-    *processed_width = MIN(round(*scale * pipe->processed_width), width);
+    *processed_width = MIN(round(*scale * pipe_width), width);
     *processed_height = round(*processed_width / image_ratio);
   }
   else if(force_height)
   {
     // height only specified by user in pixels, fluid width
-    *processed_height = MIN(round(*scale * pipe->processed_height), height);
+    *processed_height = MIN(round(*scale * pipe_height), height);
     *processed_width = round(*processed_height * image_ratio);
   }
   else
   {
     // nothing specified by user aka full resolution given cropping, lens and perspective distortions
-    *processed_width = pipe->processed_width;
-    *processed_height = pipe->processed_height;
+    *processed_width = pipe_width;
+    *processed_height = pipe_height;
+  }
+}
+
+gboolean _get_export_size(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, const dt_imageio_module_data_t *format_params, const gboolean is_scaling, const float image_ratio,
+                          double *scale, float *origin, int width, int height, int *processed_width, int *processed_height)
+{
+  if(!dt_dev_distort_backtransform_plus(dev, pipe, 0.f, DT_DEV_TRANSFORM_DIR_ALL, origin, 1))
+  {
+    // error reading pipeline pieces for distort transforms
+    fprintf(stderr, "[export_with_flags] could not get output size from pipeline\n");
+    return 1;
   }
 
+  _export_size(pipe->processed_width, pipe->processed_height, is_scaling, image_ratio, scale, width, height,
+               processed_width, processed_height);
+
   dt_print(DT_DEBUG_IMAGEIO,"[dt_imageio_export] (direct) pipe %ix%i, range %ix%i --> size %ix%i / %ix%i - ratio %.5f\n",
             pipe->processed_width, pipe->processed_height, format_params->max_width, format_params->max_height,
             *processed_width, *processed_height, width, height, image_ratio);
@@ -857,124 +886,381 @@ void _export_disable_finalscale(dt_dev_pixelpipe_t *pipe)
 }
 
 
-void _swap_byteorder_uint8_to_uint8(uint8_t *outbuf, const size_t processed_width, const size_t processed_height)
+void _export_apply_lua_actions(const int32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                               dt_imageio_module_data_t *format_params, dt_imageio_module_storage_t *storage,
+                               dt_imageio_module_data_t *storage_params)
 {
-  uint8_t *const buf8 = outbuf;
+#ifdef USE_LUA
+    //Synchronous calling of lua intermediate-export-image events
+    dt_lua_lock();
 
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(processed_width, processed_height, buf8) \
-  schedule(static)
+    lua_State *L = darktable.lua_state.state;
+
+    luaA_push(L, dt_lua_image_t, &imgid);
+
+    lua_pushstring(L, filename);
+
+    luaA_push_type(L, format->parameter_lua_type, format_params);
+
+    if(storage)
+      luaA_push_type(L, storage->parameter_lua_type, storage_params);
+    else
+      lua_pushnil(L);
+
+    dt_lua_event_trigger(L, "intermediate-export-image", 4);
+
+    dt_lua_unlock();
 #endif
-  // just flip byte order
-  for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-  {
-    uint8_t tmp = buf8[4 * k + 0];
-    buf8[4 * k + 0] = buf8[4 * k + 2];
-    buf8[4 * k + 2] = tmp;
-  }
 }
 
-void _clamp_float_to_uint8(uint8_t *outbuf, const size_t processed_width, const size_t processed_height)
+
+/* Variant exports: between dt_imageio_export_session_begin() and _end(), the first export of an image
+   runs the pipe at the largest size of the session and keeps its float output. The next exports of the
+   same image, with the same processing, are resampled from it instead of running the pipe again.
+   Sessions belong to the thread, so the parallel export pipes each keep their own buffer. */
+typedef struct dt_imageio_export_session_t
+{
+  int max_width, max_height; // largest size requested in the session, 0 = unbounded
+
+  // the processing the master buffer was computed with
+  int32_t imgid;
+  dt_colorspaces_color_profile_type_t icc_request;
+  gchar *icc_filename;
+  dt_iop_color_intent_t icc_intent;
+  char style[128];
+  gboolean is_scaling;
+  int levels;               // only compared if the pipe dithers to the output depth
+  gboolean dithered;
+
+  // float RGBA output of the pipe in the export profile, at the largest size of the session
+  float *master;
+  int width, height;
+  int pipe_width, pipe_height; // full resolution output size of the pipe
+  dt_colorspaces_color_profile_type_t icc_type; // export profile, resolved
+} dt_imageio_export_session_t;
+
+static __thread dt_imageio_export_session_t *_export_session = NULL;
+
+static void _export_session_flush(dt_imageio_export_session_t *session)
+{
+  dt_free_align(session->master);
+  session->master = NULL;
+  g_free(session->icc_filename);
+  session->icc_filename = NULL;
+  session->imgid = UNKNOWN_IMAGE;
+}
+
+void dt_imageio_export_session_begin(const int max_width, const int max_height)
+{
+  if(_export_session) dt_imageio_export_session_end();
+  _export_session = g_malloc0(sizeof(dt_imageio_export_session_t));
+  _export_session->max_width = MAX(max_width, 0);
+  _export_session->max_height = MAX(max_height, 0);
+  _export_session->imgid = UNKNOWN_IMAGE;
+}
+
+void dt_imageio_export_session_end()
 {
-  const float *const inbuf = (float *)outbuf;
+  if(!_export_session) return;
+  _export_session_flush(_export_session);
+  g_free(_export_session);
+  _export_session = NULL;
+}
+
+gboolean dt_imageio_export_session_active()
+{
+  return _export_session != NULL;
+}
+
+// can this export use the session at all: the master buffer is float and has no mask layers
+static gboolean _export_session_usable(const dt_imageio_export_session_t *session, const gboolean high_quality,
+                                       const gboolean thumbnail_export, const char *filter,
+                                       const gboolean export_masks)
+{
+  return session && high_quality && !thumbnail_export && !filter && !export_masks;
+}
 
-  // That nasty. Read pixels as floats by packs of 32 bits, write them as uint8 by pack of 8 bits.
-  // So, while this is done inplace, it's not threadsafe and can't be parallelized.
-  // Also, memory accesses get worse as we progress into the array since the distance between
-  // reads and writes increases and cachelines become scattered.
-  for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+static gboolean _export_session_match(const dt_imageio_export_session_t *session, const int32_t imgid,
+                                      const dt_imageio_module_data_t *format_params, const int levels,
+                                      const gboolean is_scaling, dt_colorspaces_color_profile_type_t icc_type,
+                                      const gchar *icc_filename, dt_iop_color_intent_t icc_intent)
+{
+  return session->master && session->imgid == imgid && session->icc_request == icc_type
+         && !g_strcmp0(session->icc_filename, icc_filename) && session->icc_intent == icc_intent
+         && !strcmp(session->style, format_params->style) && session->is_scaling == is_scaling
+         && (!session->dithered || session->levels == levels);
+}
+
+static gboolean _pipe_has_dither(const dt_dev_pixelpipe_t *pipe)
+{
+  for(const GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
   {
-    // convert in place, this is unfortunately very serial..
-    const uint8_t r = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
-    const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
-    const uint8_t b = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
-    outbuf[4 * k + 0] = r;
-    outbuf[4 * k + 1] = g;
-    outbuf[4 * k + 2] = b;
+    const dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(piece->enabled && !strcmp(piece->module->op, "dither")) return TRUE;
   }
+  return FALSE;
 }
 
-void _swap_byteorder_float_to_uint8(uint8_t *outbuf, const size_t processed_width, const size_t processed_height)
+// float RGBA copy of the master buffer, resampled to the size of the variant
+static float *_export_session_derive(const dt_imageio_export_session_t *session, const gboolean is_scaling,
+                                     const int max_width, const int max_height, int *processed_width,
+                                     int *processed_height)
 {
-  const float *const inbuf = (float *)outbuf;
+  double scale = 1.;
+  const double image_ratio = (double)session->pipe_width / (double)session->pipe_height;
+  _export_size(session->pipe_width, session->pipe_height, is_scaling, image_ratio, &scale, max_width, max_height,
+               processed_width, processed_height);
+  *processed_width = MIN(*processed_width, session->width);
+  *processed_height = MIN(*processed_height, session->height);
 
-  // That nasty. Read pixels as floats by packs of 32 bits, write them as uint8 by pack of 8 bits.
-  // So, while this is done inplace, it's not threadsafe and can't be parallelized.
-  // Also, memory accesses get worse as we progress into the array since the distance between
-  // reads and writes increases and cachelines become scattered.
-  for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+  float *out = dt_alloc_align_float((size_t)4 * *processed_width * *processed_height);
+  if(!out) return NULL;
+
+  if(*processed_width == session->width && *processed_height == session->height)
   {
-    // convert in place, this is unfortunately very serial..
-    const uint8_t r = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
-    const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
-    const uint8_t b = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
-    outbuf[4 * k + 0] = r;
-    outbuf[4 * k + 1] = g;
-    outbuf[4 * k + 2] = b;
+    memcpy(out, session->master, sizeof(float) * 4 * session->width * session->height);
   }
+  else
+  {
+    const dt_iop_roi_t roi_in = { 0, 0, session->width, session->height, 1.0f };
+    const dt_iop_roi_t roi_out
+        = { 0, 0, *processed_width, *processed_height, (float)*processed_width / (float)session->width };
+    dt_iop_clip_and_zoom_roi(out, session->master, &roi_out, &roi_in, roi_out.width, roi_in.width);
+  }
+
+  dt_print(DT_DEBUG_IMAGEIO, "[dt_imageio_export] (variant) master %ix%i, range %ix%i --> size %ix%i\n",
+           session->width, session->height, max_width, max_height, *processed_width, *processed_height);
+  return out;
 }
 
+// exports at least that large are streamed to formats that support it, see _export_stream_image()
+#define DT_IMAGEIO_STREAM_MIN_PIXELS (32 * 1024 * 1024)
+// rows converted and passed to the encoder at once
+#define DT_IMAGEIO_STREAM_ROWS 256
 
-void _export_final_buffer_to_uint8(uint8_t *outbuf, const gboolean display_byteorder, const gboolean high_quality,
-                                   const size_t processed_width, const size_t processed_height)
+// reads the exif blob of the source image to embed in the export, returns its length
+static int _export_read_exif(const int32_t imgid, const gboolean ignore_exif,
+                             const dt_colorspaces_color_profile_type_t icc_type, const int processed_width,
+                             const int processed_height, uint8_t **exif_profile)
 {
+  *exif_profile = NULL;
+  if(ignore_exif) return 0;
+
+  // Exif data should be 65536 bytes max, but if original size is close to that,
+  // adding new tags could make it go over that... so let it be and see what
+  // happens when we write the image
+  gboolean from_cache = TRUE;
+  char pathname[PATH_MAX] = { 0 };
+  dt_image_full_path(imgid,  pathname,  sizeof(pathname),  &from_cache, __FUNCTION__);
+  // find output color profile for this image:
+  int sRGB = (icc_type == DT_COLORSPACE_SRGB);
+  // last param is dng mode, it's false here
+  return dt_exif_read_blob(exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
+}
 
-  if(display_byteorder)
+// converts a band of `count` pixels of the pipe output to the depth of the format, out of place
+static void _export_convert_band(uint8_t *const out, const uint8_t *const in, const size_t count, const int bpp,
+                                 const gboolean display_byteorder, const gboolean high_quality)
+{
+  if(bpp == 16)
   {
-    if(high_quality)
-      _swap_byteorder_float_to_uint8(outbuf, processed_width, processed_height);
-    // else processing output was 8-bit already, and no need to swap order, so no-op
+    const float *const inf = (const float *)in;
+    uint16_t *const out16 = (uint16_t *)out;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(inf, out16, count) schedule(static)
+#endif
+    for(size_t k = 0; k < count; k++)
+    {
+      for(int i = 0; i < 3; i++) out16[4 * k + i] = roundf(CLAMP(inf[4 * k + i] * 0xffff, 0, 0xffff));
+      out16[4 * k + 3] = 0;
+    }
   }
-  else // need to flip
+  else if(high_quality)
   {
-    if(high_quality) // ldr output: char
-      _clamp_float_to_uint8(outbuf, processed_width, processed_height);
-    else // need to swap:
-      _swap_byteorder_uint8_to_uint8(outbuf, processed_width, processed_height);
+    // float output to char, in display byte order or not
+    const float *const inf = (const float *)in;
+    const int r = display_byteorder ? 2 : 0;
+    const int b = display_byteorder ? 0 : 2;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(inf, out, count, r, b) schedule(static)
+#endif
+    for(size_t k = 0; k < count; k++)
+    {
+      out[4 * k + 0] = roundf(CLAMP(inf[4 * k + r] * 0xff, 0, 0xff));
+      out[4 * k + 1] = roundf(CLAMP(inf[4 * k + 1] * 0xff, 0, 0xff));
+      out[4 * k + 2] = roundf(CLAMP(inf[4 * k + b] * 0xff, 0, 0xff));
+      out[4 * k + 3] = 0;
+    }
+  }
+  else
+  {
+    // processing output was 8-bit already, in display byte order: flip it
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(in, out, count) schedule(static)
+#endif
+    for(size_t k = 0; k < count; k++)
+    {
+      out[4 * k + 0] = in[4 * k + 2];
+      out[4 * k + 1] = in[4 * k + 1];
+      out[4 * k + 2] = in[4 * k + 0];
+      out[4 * k + 3] = in[4 * k + 3];
+    }
   }
 }
 
-void _export_final_buffer_to_uint16(uint8_t *outbuf, const size_t processed_width, const size_t processed_height)
+// writes the pipe output band by band through the streaming functions of the format, straight from the
+// pixelpipe cache line: large exports don't need a private copy of the whole image.
+// returns -1 if the format can't stream this image, then it goes through _export_write_image().
+static int _export_stream_image(const int32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                                dt_imageio_module_data_t *format_params, const uint8_t *backbuf, const int bpp,
+                                const int processed_width, const int processed_height,
+                                const gboolean ignore_exif, const gboolean display_byteorder,
+                                const gboolean high_quality, dt_colorspaces_color_profile_type_t icc_type,
+                                const gchar *icc_filename)
 {
-  // uint16_t per color channel
-  float *buff = (float *)outbuf;
-  uint16_t *buf16 = (uint16_t *)outbuf;
-  for(int y = 0; y < processed_height; y++)
-    for(int x = 0; x < processed_width; x++)
+  if(!format->write_begin || !format->write_rows || !format->write_end) return -1;
+  if((size_t)processed_width * processed_height < DT_IMAGEIO_STREAM_MIN_PIXELS) return -1;
+
+  format_params->width = processed_width;
+  format_params->height = processed_height;
+
+  uint8_t *exif_profile = NULL;
+  const int length
+      = _export_read_exif(imgid, ignore_exif, icc_type, processed_width, processed_height, &exif_profile);
+  void *handle = format->write_begin(format_params, filename, icc_type, icc_filename, exif_profile, length, imgid);
+  if(exif_profile) free(exif_profile);
+  if(handle == NULL) return -1;
+
+  // float output goes to the encoder as it is, other depths are converted band by band
+  const size_t in_bpp = (bpp == 8 && !high_quality) ? 4 * sizeof(uint8_t) : 4 * sizeof(float);
+  const size_t out_bpp = (size_t)4 * bpp / 8;
+  const gboolean convert = (bpp != 32) && !(bpp == 8 && !high_quality && display_byteorder);
+  uint8_t *band = convert ? dt_alloc_align((size_t)processed_width * DT_IMAGEIO_STREAM_ROWS * out_bpp) : NULL;
+
+  int res = (convert && band == NULL);
+  for(int y = 0; y < processed_height && !res; y += DT_IMAGEIO_STREAM_ROWS)
+  {
+    const int rows = MIN(DT_IMAGEIO_STREAM_ROWS, processed_height - y);
+    const uint8_t *in = backbuf + (size_t)y * processed_width * in_bpp;
+    if(convert)
     {
-      const size_t k = (size_t)processed_width * y + x;
-      for(int i = 0; i < 3; i++) buf16[4 * k + i] = roundf(CLAMP(buff[4 * k + i] * 0xffff, 0, 0xffff));
+      _export_convert_band(band, in, (size_t)rows * processed_width, bpp, display_byteorder, high_quality);
+      in = band;
     }
+    res = format->write_rows(format_params, handle, in, y, rows);
+  }
+
+  dt_free_align(band);
+  res = format->write_end(format_params, handle, res) || res;
+  return res ? 1 : 0;
 }
 
-void _export_apply_lua_actions(const int32_t imgid, const char *filename, dt_imageio_module_format_t *format,
-                               dt_imageio_module_data_t *format_params, dt_imageio_module_storage_t *storage,
-                               dt_imageio_module_data_t *storage_params)
+// converts the whole pipe output to the depth of the format in place, band by band: each band is
+// converted into a scratch buffer in parallel, then copied to its final position, which never goes
+// past the part of the input already converted since output pixels are not larger than input ones.
+static int _export_convert_in_place(uint8_t *const buf, const int bpp, const gboolean display_byteorder,
+                                    const gboolean high_quality, const int processed_width,
+                                    const int processed_height)
 {
-#ifdef USE_LUA
-    //Synchronous calling of lua intermediate-export-image events
-    dt_lua_lock();
+  // float output, or 8-bit output already in the byte order of the format
+  if(bpp == 32 || (bpp == 8 && !high_quality && display_byteorder)) return 0;
 
-    lua_State *L = darktable.lua_state.state;
+  const size_t in_bpp = (bpp == 8 && !high_quality) ? 4 * sizeof(uint8_t) : 4 * sizeof(float);
+  const size_t out_bpp = (size_t)4 * bpp / 8;
+  uint8_t *band = dt_alloc_align((size_t)processed_width * DT_IMAGEIO_STREAM_ROWS * out_bpp);
+  if(band == NULL) return 1;
 
-    luaA_push(L, dt_lua_image_t, &imgid);
+  for(int y = 0; y < processed_height; y += DT_IMAGEIO_STREAM_ROWS)
+  {
+    const size_t count = (size_t)MIN(DT_IMAGEIO_STREAM_ROWS, processed_height - y) * processed_width;
+    _export_convert_band(band, buf + (size_t)y * processed_width * in_bpp, count, bpp, display_byteorder,
+                         high_quality);
+    memcpy(buf + (size_t)y * processed_width * out_bpp, band, count * out_bpp);
+  }
 
-    lua_pushstring(L, filename);
+  dt_free_align(band);
+  return 0;
+}
 
-    luaA_push_type(L, format->parameter_lua_type, format_params);
+// converts the pipe output to the depth of the format in place and writes the file, with its exif data
+static int _export_write_image(const int32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                               dt_imageio_module_data_t *format_params, uint8_t *outbuf, const int bpp,
+                               const int processed_width, const int processed_height, const gboolean ignore_exif,
+                               const gboolean display_byteorder, const gboolean high_quality,
+                               dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
+                               int num, int total, dt_dev_pixelpipe_t *pipe, const gboolean export_masks)
+{
+  // Inplace downconversion to low-precision formats:
+  if(_export_convert_in_place(outbuf, bpp, display_byteorder, high_quality, processed_width, processed_height))
+    return 1;
 
-    if(storage)
-      luaA_push_type(L, storage->parameter_lua_type, storage_params);
-    else
-      lua_pushnil(L);
+  format_params->width = processed_width;
+  format_params->height = processed_height;
 
-    dt_lua_event_trigger(L, "intermediate-export-image", 4);
+  uint8_t *exif_profile = NULL;
+  const int length
+      = _export_read_exif(imgid, ignore_exif, icc_type, processed_width, processed_height, &exif_profile);
 
-    dt_lua_unlock();
-#endif
+  // Finally: write image buffer to target container
+  const int res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, exif_profile,
+                                      length, imgid, num, total, pipe, export_masks);
+
+  if(exif_profile) free(exif_profile);
+  return res;
 }
 
+// xmp sidecar data and notifications of the written file
+static void _export_finish(const int32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                           dt_imageio_module_data_t *format_params, const gboolean thumbnail_export,
+                           const gboolean copy_metadata, dt_imageio_module_storage_t *storage,
+                           dt_imageio_module_data_t *storage_params, dt_export_metadata_t *metadata)
+{
+  /* now write xmp into that container, if possible */
+  if(copy_metadata && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
+  {
+    dt_exif_xmp_attach_export(imgid, filename, metadata);
+    // no need to cancel the export if this fails
+  }
+
+  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
+    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
+  {
+    _export_apply_lua_actions(imgid, filename, format, format_params, storage, storage_params);
+    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
+                            format_params, storage, storage_params);
+  }
+}
+
+// another size or format of the image the session holds, without running the pipe
+static int _export_from_session(dt_imageio_export_session_t *session, const int32_t imgid, const char *filename,
+                                dt_imageio_module_format_t *format, dt_imageio_module_data_t *format_params,
+                                const gboolean ignore_exif, const gboolean display_byteorder,
+                                const gboolean is_scaling, const gboolean copy_metadata,
+                                const gchar *icc_filename, dt_imageio_module_storage_t *storage,
+                                dt_imageio_module_data_t *storage_params, int num, int total,
+                                dt_export_metadata_t *metadata)
+{
+  int processed_width = 0;
+  int processed_height = 0;
+  float *outbuf = _export_session_derive(session, is_scaling, MAX(format_params->max_width, 0),
+                                         MAX(format_params->max_height, 0), &processed_width, &processed_height);
+  if(!outbuf)
+  {
+    dt_control_log(_("failed to allocate memory for %s, please lower the threads used for export or buy more memory."),
+                   C_("noun", "export"));
+    return 1;
+  }
+
+  const int res = _export_write_image(imgid, filename, format, format_params, (uint8_t *)outbuf,
+                                      format->bpp(format_params), processed_width, processed_height, ignore_exif,
+                                      display_byteorder, TRUE, session->icc_type, icc_filename, num, total, NULL,
+                                      FALSE);
+  dt_free_align(outbuf);
+  if(res) return 1;
+
+  _export_finish(imgid, filename, format, format_params, FALSE, copy_metadata, storage, storage_params, metadata);
+  return 0;
+}
 
 // internal function: to avoid exif blob reading + 8-bit byteorder flag + high-quality override
 int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
@@ -992,7 +1278,27 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
   // new, default, histories are inited in separate threads leading to concurrent writes
   // to main.history because that happens from here.
   // Pending an elegant fix for all this mess, do the reasonable thing.
+  // The lock is released once the pixels are computed: encoding and writing the file
+  // then overlap with the pipeline of the next image.
+  dt_imageio_export_session_t *session
+      = _export_session_usable(_export_session, high_quality, thumbnail_export, filter, export_masks)
+            ? _export_session
+            : NULL;
+  const int levels = format->levels(format_params);
+  if(session
+     && _export_session_match(session, imgid, format_params, levels, is_scaling, icc_type, icc_filename,
+                              icc_intent))
+    return _export_from_session(session, imgid, filename, format, format_params, ignore_exif, display_byteorder,
+                                is_scaling, copy_metadata, icc_filename, storage, storage_params, num, total,
+                                metadata);
+
+  // the request to remember for the session, before the profile gets resolved
+  const dt_colorspaces_color_profile_type_t icc_request = icc_type;
+
   dt_pthread_mutex_lock(&darktable.pipeline_threadsafe);
+  gboolean locked = TRUE;
+  gboolean pipe_alive = FALSE;
+  uint8_t *outbuf = NULL;
 
   dt_develop_t dev;
   dt_dev_init(&dev, 0);
@@ -1001,15 +1307,22 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
   dt_mipmap_buffer_t buf;
   dt_mipmap_cache_t *cache = darktable.mipmap_cache;
 
-  // The DT_MIPMAP_F is set to DT_MIPMAP_2 sizes in mipmap_cache.c,
-  // aka 720x450 px currently. Though it's a nice speed-up to generate small thumbnails,
+  // The DT_MIPMAP_F is sized for the darkroom preview by dt_mipmap_cache_set_f_size(),
+  // 720x450 px by default. Though it's a nice speed-up to generate small thumbnails,
   // we can't use it as input for larger thumbnails, for obvious reasons.
   // WARNING: if the editing pipeline applies cropping and the final requested image
-  // is less than 720x450 px, we will still produce an undersampled thumnbail.
-  if(thumbnail_export && format_params->max_width <= cache->max_width[DT_MIPMAP_F]
-     && format_params->max_height <= cache->max_height[DT_MIPMAP_F])
+  // is smaller than that, we will still produce an undersampled thumnbail.
+  const int32_t f_width = cache->max_width[DT_MIPMAP_F];
+  const int32_t f_height = cache->max_height[DT_MIPMAP_F];
+  gboolean from_f = FALSE;
+  if(thumbnail_export && format_params->max_width <= f_width && format_params->max_height <= f_height)
+  {
     dt_mipmap_cache_get(cache, &buf, imgid, DT_MIPMAP_F, DT_MIPMAP_BLOCKING, 'r');
-  else
+    // a buffer cached before a resize of DT_MIPMAP_F may be smaller
+    from_f = buf.buf && (buf.width >= format_params->max_width || buf.height >= format_params->max_height);
+    if(!from_f) dt_mipmap_cache_release(cache, &buf);
+  }
+  if(!from_f)
     dt_mipmap_cache_get(cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
 
   const dt_image_t *img = &dev.image_storage;
@@ -1028,7 +1341,8 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
   if(thumbnail_export)
     res = dt_dev_pixelpipe_init_thumbnail(&pipe, buf.width, buf.height);
   else
-    res = dt_dev_pixelpipe_init_export(&pipe, buf.width, buf.height, format->levels(format_params), export_masks);
+    res = dt_dev_pixelpipe_init_export(&pipe, buf.width, buf.height, levels, export_masks);
+  pipe_alive = TRUE;
 
   if(!res)
   {
@@ -1073,6 +1387,12 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
   int processed_width = 0;
   int processed_height = 0;
   float origin[] = { 0.0f, 0.0f };
+  if(session)
+  {
+    // run the pipe for the largest variant of the session, this one is derived from it below
+    width = (width == 0 || session->max_width == 0) ? 0 : MAX(width, session->max_width);
+    height = (height == 0 || session->max_height == 0) ? 0 : MAX(height, session->max_height);
+  }
   if(_get_export_size(&dev, &pipe, format_params, is_scaling, image_ratio, &scale, origin, width, height, &processed_width, &processed_height))
     goto error;
 
@@ -1106,73 +1426,108 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
   dt_show_times(&start, thumbnail_export ? "[dev_process_thumbnail] pixel pipeline processing"
                                          : "[dev_process_export] pixel pipeline processing");
 
-  uint8_t *outbuf = pipe.backbuf;
-  if(outbuf == NULL)
+  if(pipe.backbuf == NULL)
   {
     dt_print(DT_DEBUG_IMAGEIO, "[dt_imageio_export_with_flags] no valid output buffer\n");
     goto error;
   }
 
-  // Inplace downconversion to low-precision formats:
-  if(bpp == 8)
-    _export_final_buffer_to_uint8(outbuf, display_byteorder, high_quality, processed_width, processed_height);
-  else if(bpp == 16)
-    _export_final_buffer_to_uint16(outbuf, processed_width, processed_height);
-  // else output float, no further harm done to the pixels :)
-
-  format_params->width = processed_width;
-  format_params->height = processed_height;
+  // Large exports are streamed to the encoder right from the backbuf, holding the pipeline a bit longer
+  // but sparing the full-size copy below.
+  if(!export_masks && !session)
+  {
+    const int streamed = _export_stream_image(imgid, filename, format, format_params, pipe.backbuf, bpp,
+                                              processed_width, processed_height, ignore_exif, display_byteorder,
+                                              high_quality, icc_type, icc_filename);
+    if(streamed >= 0)
+    {
+      dt_dev_pixelpipe_cleanup(&pipe);
+      pipe_alive = FALSE;
+      dt_mipmap_cache_release(cache, &buf);
+      dt_pthread_mutex_unlock(&darktable.pipeline_threadsafe);
+      locked = FALSE;
+      if(streamed) goto error;
+
+      dt_dev_cleanup(&dev);
+      _export_finish(imgid, filename, format, format_params, thumbnail_export, copy_metadata, storage,
+                     storage_params, metadata);
+      return 0; // success
+    }
+  }
 
-  // Exif data should be 65536 bytes max, but if original size is close to that,
-  // adding new tags could make it go over that... so let it be and see what
-  // happens when we write the image
-  int length = 0;
-  uint8_t *exif_profile = NULL;
+  // The backbuf is a line of the shared pixelpipe cache: take a private copy for the encoder,
+  // so we can convert it in place and give the cache and the pipeline back right now.
+  // The pipe is still needed by formats writing the masks as layers.
+  const size_t out_bpp = (bpp == 8 && !high_quality) ? 4 * sizeof(uint8_t) : 4 * sizeof(float);
+  outbuf = dt_alloc_align((size_t)processed_width * processed_height * out_bpp);
+  if(outbuf == NULL)
+  {
+    dt_control_log(
+        _("failed to allocate memory for %s, please lower the threads used for export or buy more memory."),
+        thumbnail_export ? C_("noun", "thumbnail export") : C_("noun", "export"));
+    goto error;
+  }
+  memcpy(outbuf, pipe.backbuf, (size_t)processed_width * processed_height * out_bpp);
 
-  if(!ignore_exif)
+  if(session)
   {
-    gboolean from_cache = TRUE;
-    char pathname[PATH_MAX] = { 0 };
-    dt_image_full_path(imgid,  pathname,  sizeof(pathname),  &from_cache, __FUNCTION__);
-    // find output color profile for this image:
-    int sRGB = (icc_type == DT_COLORSPACE_SRGB);
-    // last param is dng mode, it's false here
-    length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
+    // keep the float output for the next variants of the image, and cut this one out of it
+    _export_session_flush(session);
+    session->imgid = imgid;
+    session->icc_request = icc_request;
+    session->icc_filename = g_strdup(icc_filename);
+    session->icc_intent = icc_intent;
+    g_strlcpy(session->style, format_params->style, sizeof(session->style));
+    session->is_scaling = is_scaling;
+    session->levels = levels;
+    session->dithered = _pipe_has_dither(&pipe);
+    session->master = (float *)outbuf;
+    session->width = processed_width;
+    session->height = processed_height;
+    session->pipe_width = pipe.processed_width;
+    session->pipe_height = pipe.processed_height;
+    session->icc_type = icc_type;
+
+    outbuf = (uint8_t *)_export_session_derive(session, is_scaling, MAX(format_params->max_width, 0),
+                                               MAX(format_params->max_height, 0), &processed_width,
+                                               &processed_height);
+    if(outbuf == NULL)
+    {
+      dt_control_log(
+          _("failed to allocate memory for %s, please lower the threads used for export or buy more memory."),
+          C_("noun", "export"));
+      goto error;
+    }
   }
 
-  // Finally: write image buffer to target container
-  res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, exif_profile, length, imgid,
-                            num, total, &pipe, export_masks);
+  if(!export_masks)
+  {
+    dt_dev_pixelpipe_cleanup(&pipe);
+    pipe_alive = FALSE;
+  }
+  dt_mipmap_cache_release(cache, &buf);
+  dt_pthread_mutex_unlock(&darktable.pipeline_threadsafe);
+  locked = FALSE;
 
-  if(exif_profile) free(exif_profile);
+  res = _export_write_image(imgid, filename, format, format_params, outbuf, bpp, processed_width,
+                            processed_height, ignore_exif, display_byteorder, high_quality, icc_type, icc_filename,
+                            num, total, pipe_alive ? &pipe : NULL, export_masks);
   if(res) goto error;
 
-  dt_mipmap_cache_release(cache, &buf);
-  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_free_align(outbuf);
+  if(pipe_alive) dt_dev_pixelpipe_cleanup(&pipe);
   dt_dev_cleanup(&dev);
 
-  /* now write xmp into that container, if possible */
-  if(copy_metadata && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
-  {
-    dt_exif_xmp_attach_export(imgid, filename, metadata);
-    // no need to cancel the export if this fails
-  }
-
-  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
-    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
-  {
-    _export_apply_lua_actions(imgid, filename, format, format_params, storage, storage_params);
-    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
-                            format_params, storage, storage_params);
-  }
+  _export_finish(imgid, filename, format, format_params, thumbnail_export, copy_metadata, storage,
+                 storage_params, metadata);
 
-  dt_pthread_mutex_unlock(&darktable.pipeline_threadsafe);
   return 0; // success
 
 error:
-  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_free_align(outbuf);
 error_early:
-  dt_pthread_mutex_unlock(&darktable.pipeline_threadsafe);
+  if(pipe_alive) dt_dev_pixelpipe_cleanup(&pipe);
+  if(locked) dt_pthread_mutex_unlock(&darktable.pipeline_threadsafe);
   dt_dev_cleanup(&dev);
   dt_mipmap_cache_release(cache, &buf);
   return 1;
@@ -66,6 +66,8 @@ void dt_imageio_update_monochrome_workflow_tag(int32_t id, int mask);
 dt_imageio_retval_t dt_imageio_open_hdr(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *buf);
 // opens file using imagemagick
 dt_imageio_retval_t dt_imageio_open_ldr(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *buf);
+// asks the system to start reading the file into the page cache, without waiting for it
+void dt_imageio_readahead(const char *filename);
 // try all the options in sequence
 dt_imageio_retval_t dt_imageio_open(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *buf);
 // tries to open the files not opened by the other routines using GraphicsMagick (if supported)
@@ -91,6 +93,15 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
                                  dt_imageio_module_storage_t *storage, dt_imageio_module_data_t *storage_params,
                                  int num, int total, dt_export_metadata_t *metadata);
 
+/* export several sizes and formats of the same images with one run of the pipe per image:
+   between begin and end, the exports of the calling thread run their pipe at max_width x max_height
+   (0 = unbounded) and the smaller ones are resampled from that output. Only high quality exports
+   without mask layers use it, the others run their own pipe as usual. */
+void dt_imageio_export_session_begin(const int max_width, const int max_height);
+void dt_imageio_export_session_end(void);
+// TRUE if the calling thread is within a session
+gboolean dt_imageio_export_session_active(void);
+
 size_t dt_imageio_write_pos(int i, int j, int wd, int ht, float fwd, float fht,
                             dt_image_orientation_t orientation);
 
@@ -108,6 +119,11 @@ void dt_imageio_flip_buffers_ui8_to_float(float *out, const uint8_t *in, const f
 // allocate buffer and return 0 on success along with largest jpg thumbnail from raw.
 int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
                                dt_colorspaces_color_profile_type_t *color_space);
+// same, but a jpg thumbnail is decoded at the smallest DCT scale that still fills box_width × box_height.
+// 0 × 0 decodes it at full size.
+int dt_imageio_large_thumbnail_scaled(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
+                                      dt_colorspaces_color_profile_type_t *color_space,
+                                      const int32_t box_width, const int32_t box_height);
 
 // lookup maker and model, dispatch lookup to rawspeed or libraw
 gboolean dt_imageio_lookup_makermodel(const char *maker, const char *model,
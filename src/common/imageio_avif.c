@@ -29,6 +29,7 @@
 #include <strings.h>
 
 #include "control/control.h"
+#include "common/darktable.h"
 #include "common/exif.h"
 #include "control/conf.h"
 #include "develop/develop.h"
@@ -56,6 +57,11 @@ dt_imageio_retval_t dt_imageio_open_avif(dt_image_t *img,
     goto out;
   }
 
+#if AVIF_VERSION >= 90000
+  // the AV1 codecs decode tiles in parallel
+  decoder->maxThreads = darktable.num_openmp_threads;
+#endif
+
   result = avifDecoderReadFile(decoder, &avif_image, filename);
   if(result != AVIF_RESULT_OK)
   {
@@ -69,6 +75,9 @@ dt_imageio_retval_t dt_imageio_open_avif(dt_image_t *img,
   avifRGBImageSetDefaults(&rgb, avif);
 
   rgb.format = AVIF_RGB_FORMAT_RGB;
+#if AVIF_VERSION >= 1000000
+  rgb.maxThreads = darktable.num_openmp_threads;
+#endif
 
   avifRGBImageAllocatePixels(&rgb);
 
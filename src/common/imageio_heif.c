@@ -51,7 +51,7 @@ dt_imageio_retval_t dt_imageio_open_heif(dt_image_t *img,
   struct heif_image_handle* handle = NULL;
   struct heif_image* heif_img = NULL;
 
-  struct heif_context* ctx = heif_context_alloc();
+  struct heif_context* ctx = _context_alloc();
   if(!ctx)
   {
     dt_print(DT_DEBUG_IMAGEIO,
@@ -213,6 +213,99 @@ out:
   return ret;
 }
 
+// same fit as dt_imageio_jpeg_set_scale(): the thumbnail covers the box in either orientation
+static inline gboolean _covers(const int width, const int height, const int box_width, const int box_height)
+{
+  return (width >= box_width || height >= box_height) && (width >= box_height || height >= box_width);
+}
+
+int dt_imageio_heif_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
+                              dt_colorspaces_color_profile_type_t *color_space,
+                              const int32_t box_width, const int32_t box_height)
+{
+  int res = 1;
+  struct heif_image_handle *handle = NULL;
+  struct heif_image_handle *thumb = NULL;
+  struct heif_image *heif_img = NULL;
+  struct heif_decoding_options *options = NULL;
+  heif_item_id *ids = NULL;
+
+  struct heif_context *ctx = _context_alloc();
+  if(!ctx) return 1;
+
+  if(heif_context_read_from_file(ctx, filename, NULL).code != heif_error_Ok) goto out;
+  if(heif_context_get_primary_image_handle(ctx, &handle).code != heif_error_Ok) goto out;
+
+  const int num_thumbnails = heif_image_handle_get_number_of_thumbnails(handle);
+  if(num_thumbnails <= 0) goto out;
+
+  ids = g_malloc_n(num_thumbnails, sizeof(heif_item_id));
+  heif_image_handle_get_list_of_thumbnail_IDs(handle, ids, num_thumbnails);
+
+  // the smallest thumbnail covering the box, or else the largest one
+  int best = -1, best_width = 0, best_height = 0;
+  for(int k = 0; k < num_thumbnails; k++)
+  {
+    struct heif_image_handle *candidate = NULL;
+    if(heif_image_handle_get_thumbnail(handle, ids[k], &candidate).code != heif_error_Ok) continue;
+    const int w = heif_image_handle_get_width(candidate);
+    const int h = heif_image_handle_get_height(candidate);
+    heif_image_handle_release(candidate);
+
+    const gboolean covers = _covers(w, h, box_width, box_height);
+    const gboolean best_covers = best >= 0 && _covers(best_width, best_height, box_width, box_height);
+    if(best < 0 || (covers && (!best_covers || w * h < best_width * best_height))
+       || (!covers && !best_covers && w * h > best_width * best_height))
+    {
+      best = k;
+      best_width = w;
+      best_height = h;
+    }
+  }
+  if(best < 0 || heif_image_handle_get_thumbnail(handle, ids[best], &thumb).code != heif_error_Ok) goto out;
+
+  options = heif_decoding_options_alloc();
+  options->convert_hdr_to_8bit = 1;
+  if(heif_decode_image(thumb, &heif_img, heif_colorspace_RGB, heif_chroma_interleaved_RGBA, options).code
+     != heif_error_Ok)
+    goto out;
+
+  int rowbytes = 0;
+  const uint8_t *data = heif_image_get_plane_readonly(heif_img, heif_channel_interleaved, &rowbytes);
+  const int w = heif_image_get_width(heif_img, heif_channel_interleaved);
+  const int h = heif_image_get_height(heif_img, heif_channel_interleaved);
+  if(!data || w <= 0 || h <= 0) goto out;
+
+  *buffer = (uint8_t *)dt_alloc_align(sizeof(uint8_t) * 4 * w * h);
+  if(!*buffer) goto out;
+  for(int y = 0; y < h; y++) memcpy(*buffer + (size_t)4 * w * y, data + (size_t)rowbytes * y, (size_t)4 * w);
+
+  *width = w;
+  *height = h;
+
+  // the thumbnail is tagged like the primary image. FIXME: ICC profiles are assumed to be sRGB
+  *color_space = DT_COLORSPACE_SRGB;
+  struct heif_color_profile_nclx *nclx = NULL;
+  if(heif_image_handle_get_nclx_color_profile(handle, &nclx).code == heif_error_Ok && nclx)
+  {
+    if(nclx->color_primaries == heif_color_primaries_SMPTE_EG_432_1) *color_space = DT_COLORSPACE_DISPLAY_P3;
+    heif_nclx_color_profile_free(nclx);
+  }
+
+  dt_print(DT_DEBUG_IMAGEIO, "[imageio_heif] using the %dx%d thumbnail of HEIF file [%s]\n", w, h, filename);
+  res = 0;
+
+out:
+  if(heif_img) heif_image_release(heif_img);
+  if(options) heif_decoding_options_free(options);
+  if(thumb) heif_image_handle_release(thumb);
+  if(handle) heif_image_handle_release(handle);
+  g_free(ids);
+  heif_context_free(ctx);
+
+  return res;
+}
+
 
 int dt_imageio_heif_read_profile(const char *filename,
                                 uint8_t **out,
@@ -231,7 +324,7 @@ int dt_imageio_heif_read_profile(const char *filename,
   size_t icc_size = 0;
   uint8_t *icc_data = NULL;
 
-  struct heif_context* ctx = heif_context_alloc();
+  struct heif_context* ctx = _context_alloc();
   if(!ctx)
   {
     dt_print(DT_DEBUG_IMAGEIO,
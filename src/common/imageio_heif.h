@@ -25,6 +25,11 @@
 dt_imageio_retval_t dt_imageio_open_heif(dt_image_t *img,
                                          const char *filename,
                                          dt_mipmap_buffer_t *buf);
+// decode the thumbnail item of the primary image, preferably the smallest one covering box_width x box_height,
+// into a newly allocated 8-bit RGBA buffer. returns 0 on success, 1 if the file has no usable thumbnail.
+int dt_imageio_heif_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
+                              dt_colorspaces_color_profile_type_t *color_space,
+                              const int32_t box_width, const int32_t box_height);
 int dt_imageio_heif_read_profile(const char *filename,
                                  uint8_t **out,
                                  dt_colorspaces_cicp_t *cicp);
@@ -22,9 +22,11 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#include "common/darktable.h"
 #include "common/exif.h"
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
+#include "common/imageio_jpeg_bands.h"
 #include "develop/imageop.h"         // for IOP_CS_RGB
 #include <setjmp.h>
 
@@ -156,11 +158,47 @@ int dt_imageio_jpeg_decompress_header(const void *in, size_t length, dt_imageio_
   return 0;
 }
 
+void dt_imageio_jpeg_set_scale(dt_imageio_jpeg_t *jpg, const int width, const int height)
+{
+  if(width <= 0 || height <= 0) return;
+
+  struct dt_imageio_jpeg_error_mgr jerr;
+  jpg->dinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  if(setjmp(jerr.setjmp_buffer))
+  {
+    // keep the full size
+    jpg->dinfo.scale_num = jpg->dinfo.scale_denom = 1;
+    return;
+  }
+
+  // libjpeg scales by 1/2, 1/4 and 1/8 for nearly free in the inverse DCT. The output has to fill
+  // the box in whichever orientation the image gets displayed.
+  for(unsigned int denom = 8; denom > 1; denom /= 2)
+  {
+    jpg->dinfo.scale_num = 1;
+    jpg->dinfo.scale_denom = denom;
+    jpeg_calc_output_dimensions(&(jpg->dinfo));
+    const int wd = jpg->dinfo.output_width;
+    const int ht = jpg->dinfo.output_height;
+    if((wd >= width || ht >= height) && (wd >= height || ht >= width))
+    {
+      jpg->width = wd;
+      jpg->height = ht;
+      return;
+    }
+  }
+
+  jpg->dinfo.scale_num = jpg->dinfo.scale_denom = 1;
+  jpg->width = jpg->dinfo.image_width;
+  jpg->height = jpg->dinfo.image_height;
+}
+
 #ifdef JCS_EXTENSIONS
 static int decompress_jsc(dt_imageio_jpeg_t *jpg, uint8_t *out)
 {
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), &tmp, 1) != 1)
     {
@@ -177,14 +215,14 @@ static int decompress_plain(dt_imageio_jpeg_t *jpg, uint8_t *out)
   JSAMPROW row_pointer[1];
   row_pointer[0] = (uint8_t *)dt_alloc_align((size_t)jpg->dinfo.output_width * jpg->dinfo.num_components);
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), row_pointer, 1) != 1)
     {
       dt_free_align(row_pointer[0]);
       return 1;
     }
-    for(unsigned int i = 0; i < jpg->dinfo.image_width; i++)
+    for(unsigned int i = 0; i < jpg->dinfo.output_width; i++)
     {
       for(int k = 0; k < 3; k++) tmp[4 * i + k] = row_pointer[0][3 * i + k];
     }
@@ -261,16 +299,45 @@ int dt_imageio_jpeg_decompress(dt_imageio_jpeg_t *jpg, uint8_t *out)
   return 0;
 }
 
+typedef struct dt_imageio_jpeg_quality_t
+{
+  int quality;
+} dt_imageio_jpeg_quality_t;
+
+static void _setup_quality(j_compress_ptr cinfo, void *user_data)
+{
+  const int quality = ((const dt_imageio_jpeg_quality_t *)user_data)->quality;
+  jpeg_set_quality(cinfo, quality, TRUE);
+  if(quality > 90) cinfo->comp_info[0].v_samp_factor = 1;
+  if(quality > 92) cinfo->comp_info[0].h_samp_factor = 1;
+}
+
 int dt_imageio_jpeg_compress(const uint8_t *in, uint8_t *out, const int width, const int height,
                              const int quality)
 {
+  const size_t out_size = sizeof(uint8_t) * 4 * width * height;
+  if((size_t)width * height >= DT_IMAGEIO_JPEG_BANDS_MIN_PIXELS && darktable.num_openmp_threads > 1)
+  {
+    dt_imageio_jpeg_quality_t q = { quality };
+    uint8_t *buf = NULL;
+    size_t length = 0;
+    if(!dt_imageio_jpeg_compress_bands(in, width, height, _setup_quality, NULL, &q, &buf, &length)
+       && length <= out_size)
+    {
+      memcpy(out, buf, length);
+      free(buf);
+      return length;
+    }
+    free(buf);
+  }
+
   struct dt_imageio_jpeg_error_mgr jerr;
   dt_imageio_jpeg_t jpg;
   jpg.dest.init_destination = dt_imageio_jpeg_init_destination;
   jpg.dest.empty_output_buffer = dt_imageio_jpeg_empty_output_buffer;
   jpg.dest.term_destination = dt_imageio_jpeg_term_destination;
   jpg.dest.next_output_byte = (JOCTET *)out;
-  jpg.dest.free_in_buffer = sizeof(uint8_t) * 4 * width * height;
+  jpg.dest.free_in_buffer = out_size;
 
   jpg.cinfo.err = jpeg_std_error(&jerr.pub);
   jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
@@ -305,7 +372,7 @@ int dt_imageio_jpeg_compress(const uint8_t *in, uint8_t *out, const int width, c
   jpeg_finish_compress(&(jpg.cinfo));
   dt_free_align(row);
   jpeg_destroy_compress(&(jpg.cinfo));
-  return sizeof(uint8_t) * 4 * width * height - jpg.dest.free_in_buffer;
+  return out_size - jpg.dest.free_in_buffer;
 }
 
 
@@ -600,7 +667,7 @@ int dt_imageio_jpeg_read_header(const char *filename, dt_imageio_jpeg_t *jpg)
 static int read_jsc(dt_imageio_jpeg_t *jpg, uint8_t *out)
 {
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), &tmp, 1) != 1)
     {
@@ -617,7 +684,7 @@ static int read_plain(dt_imageio_jpeg_t *jpg, uint8_t *out)
   JSAMPROW row_pointer[1];
   row_pointer[0] = (uint8_t *)dt_alloc_align((size_t)jpg->dinfo.output_width * jpg->dinfo.num_components);
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), row_pointer, 1) != 1)
     {
@@ -626,7 +693,7 @@ static int read_plain(dt_imageio_jpeg_t *jpg, uint8_t *out)
       fclose(jpg->f);
       return 1;
     }
-    for(unsigned int i = 0; i < jpg->dinfo.image_width; i++)
+    for(unsigned int i = 0; i < jpg->dinfo.output_width; i++)
       for(int k = 0; k < 3; k++) tmp[4 * i + k] = row_pointer[0][3 * i + k];
     tmp += 4 * jpg->width;
   }
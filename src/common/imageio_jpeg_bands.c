@@ -0,0 +1,275 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/imageio_jpeg_bands.h"
+#include "common/darktable.h"
+
+#include <jerror.h>
+#include <setjmp.h>
+#include <string.h>
+
+typedef struct dt_imageio_jpeg_bands_error_t
+{
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+} dt_imageio_jpeg_bands_error_t;
+
+static void _error_exit(j_common_ptr cinfo)
+{
+  dt_imageio_jpeg_bands_error_t *err = (dt_imageio_jpeg_bands_error_t *)cinfo->err;
+  (*cinfo->err->output_message)(cinfo);
+  longjmp(err->setjmp_buffer, 1);
+}
+
+// Banded encoding: horizontal bands of whole MCU rows are compressed in parallel, each as its own
+// JPEG with the standard Huffman tables, then their entropy-coded segments are joined by restart
+// markers into one baseline stream. A restart resets the DC predictions, like the start of a scan.
+
+typedef struct dt_imageio_jpeg_band_t
+{
+  struct jpeg_destination_mgr dest;
+  uint8_t *buf;
+  size_t size;   // allocated
+  size_t length; // written
+  size_t data;   // start of the entropy-coded data
+} dt_imageio_jpeg_band_t;
+
+static void _band_init_destination(j_compress_ptr cinfo)
+{
+}
+
+static boolean _band_empty_output_buffer(j_compress_ptr cinfo)
+{
+  // the whole buffer is full, grow it
+  dt_imageio_jpeg_band_t *band = (dt_imageio_jpeg_band_t *)cinfo->dest;
+  uint8_t *buf = realloc(band->buf, 2 * band->size);
+  if(!buf) ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+  band->dest.next_output_byte = buf + band->size;
+  band->dest.free_in_buffer = band->size;
+  band->buf = buf;
+  band->size *= 2;
+  return TRUE;
+}
+
+static void _band_term_destination(j_compress_ptr cinfo)
+{
+  dt_imageio_jpeg_band_t *band = (dt_imageio_jpeg_band_t *)cinfo->dest;
+  band->length = band->size - band->dest.free_in_buffer;
+}
+
+static void _jpeg_set_image(j_compress_ptr cinfo, const int width, const int height, dt_imageio_jpeg_setup_t setup,
+                            void *user_data)
+{
+  cinfo->image_width = width;
+  cinfo->image_height = height;
+  cinfo->input_components = 3;
+  cinfo->in_color_space = JCS_RGB;
+  jpeg_set_defaults(cinfo);
+  setup(cinfo, user_data);
+  // all the bands have to share the tables
+  cinfo->optimize_coding = FALSE;
+  cinfo->restart_interval = 0;
+  cinfo->restart_in_rows = 0;
+}
+
+static int _compress_band(dt_imageio_jpeg_band_t *band, const uint8_t *in, const int width, const int rows,
+                          dt_imageio_jpeg_setup_t setup, dt_imageio_jpeg_setup_t markers, void *user_data)
+{
+  dt_imageio_jpeg_bands_error_t jerr;
+  struct jpeg_compress_struct cinfo;
+  // freed after a longjmp()
+  uint8_t *volatile row = NULL;
+
+  band->size = MAX((size_t)3 * width * rows / 4, (size_t)4096);
+  band->buf = malloc(band->size);
+  if(!band->buf) return 1;
+  band->dest.init_destination = _band_init_destination;
+  band->dest.empty_output_buffer = _band_empty_output_buffer;
+  band->dest.term_destination = _band_term_destination;
+  band->dest.next_output_byte = band->buf;
+  band->dest.free_in_buffer = band->size;
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = _error_exit;
+  if(setjmp(jerr.setjmp_buffer))
+  {
+    jpeg_destroy_compress(&cinfo);
+    dt_free_align(row);
+    return 1;
+  }
+  jpeg_create_compress(&cinfo);
+  cinfo.dest = &band->dest;
+  _jpeg_set_image(&cinfo, width, rows, setup, user_data);
+  jpeg_start_compress(&cinfo, TRUE);
+  if(markers) markers(&cinfo, user_data);
+
+  row = dt_alloc_align(sizeof(uint8_t) * 3 * width);
+  while(cinfo.next_scanline < cinfo.image_height)
+  {
+    JSAMPROW tmp[1];
+    const uint8_t *buf = in + (size_t)cinfo.next_scanline * width * 4;
+    for(int i = 0; i < width; i++)
+      for(int k = 0; k < 3; k++) row[3 * i + k] = buf[4 * i + k];
+    tmp[0] = row;
+    jpeg_write_scanlines(&cinfo, tmp, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+  dt_free_align(row);
+  return 0;
+}
+
+// offsets of the SOF0 and SOS markers, and of the first byte of entropy-coded data
+static int _find_scan(const dt_imageio_jpeg_band_t *band, size_t *sof, size_t *sos, size_t *data)
+{
+  *sof = 0;
+  for(size_t pos = 2; pos + 4 <= band->length && band->buf[pos] == 0xFF;)
+  {
+    const uint8_t marker = band->buf[pos + 1];
+    const size_t len = (band->buf[pos + 2] << 8) | band->buf[pos + 3];
+    if(marker == 0xC0) *sof = pos;
+    if(marker == 0xDA)
+    {
+      *sos = pos;
+      *data = pos + 2 + len;
+      // the data ends with the EOI marker
+      return *sof == 0 || *data + 2 > band->length || band->buf[band->length - 2] != 0xFF
+             || band->buf[band->length - 1] != 0xD9;
+    }
+    pos += 2 + len;
+  }
+  return 1;
+}
+
+int dt_imageio_jpeg_compress_bands(const uint8_t *in, const int width, const int height,
+                                   dt_imageio_jpeg_setup_t setup, dt_imageio_jpeg_setup_t markers,
+                                   void *user_data, uint8_t **out, size_t *out_length)
+{
+  *out = NULL;
+  *out_length = 0;
+
+  // size of the MCU for these settings
+  dt_imageio_jpeg_bands_error_t jerr;
+  struct jpeg_compress_struct probe;
+  probe.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = _error_exit;
+  if(setjmp(jerr.setjmp_buffer))
+  {
+    jpeg_destroy_compress(&probe);
+    return 1;
+  }
+  jpeg_create_compress(&probe);
+  _jpeg_set_image(&probe, width, height, setup, user_data);
+  int h_samp = 1, v_samp = 1;
+  for(int c = 0; c < probe.num_components; c++)
+  {
+    h_samp = MAX(h_samp, probe.comp_info[c].h_samp_factor);
+    v_samp = MAX(v_samp, probe.comp_info[c].v_samp_factor);
+  }
+  const gboolean baseline = (probe.scan_info == NULL && !probe.arith_code);
+  jpeg_destroy_compress(&probe);
+  if(!baseline) return 1;
+
+  const int mcu_width = DCTSIZE * h_samp;
+  const int mcu_height = DCTSIZE * v_samp;
+  const size_t mcus_per_row = (width + mcu_width - 1) / mcu_width;
+  const int mcu_rows = (height + mcu_height - 1) / mcu_height;
+
+  // one band per thread, the restart interval counts MCUs on 16 bits
+  const int max_mcu_rows = MAX(65535 / mcus_per_row, 1);
+  int nbands = CLAMP(darktable.num_openmp_threads, 1, mcu_rows);
+  const int band_mcu_rows = MIN((mcu_rows + nbands - 1) / nbands, max_mcu_rows);
+  const int band_rows = band_mcu_rows * mcu_height;
+  nbands = (height + band_rows - 1) / band_rows;
+  if(nbands < 2) return 1;
+
+  dt_imageio_jpeg_band_t *bands = calloc(nbands, sizeof(dt_imageio_jpeg_band_t));
+  if(!bands) return 1;
+
+  int err = 0;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(bands, nbands, in, width, height, band_rows, setup, markers, user_data) \
+  reduction(|: err) \
+  schedule(dynamic)
+#endif
+  for(int k = 0; k < nbands; k++)
+  {
+    const int y = k * band_rows;
+    const int rows = MIN(band_rows, height - y);
+    // metadata markers go only in the headers of the first band, that we keep
+    err |= _compress_band(&bands[k], in + (size_t)4 * width * y, width, rows, setup, k == 0 ? markers : NULL,
+                          user_data);
+  }
+
+  // headers of the first band, with the full height and a restart interval of one band
+  size_t sof = 0, sos = 0;
+  size_t length = 6; // DRI
+  for(int k = 0; k < nbands && !err; k++)
+  {
+    size_t k_sof, k_sos;
+    err = _find_scan(&bands[k], &k_sof, &k_sos, &bands[k].data);
+    if(k == 0)
+    {
+      sof = k_sof;
+      sos = k_sos;
+      length += bands[0].data;
+    }
+    // data, then a RSTn or the EOI marker
+    length += bands[k].length - 2 - bands[k].data + 2;
+  }
+
+  uint8_t *buf = err ? NULL : malloc(length);
+  if(buf)
+  {
+    const unsigned int interval = band_mcu_rows * mcus_per_row;
+    size_t pos = 0;
+    memcpy(buf, bands[0].buf, sos);
+    buf[sof + 5] = (height >> 8) & 0xFF;
+    buf[sof + 6] = height & 0xFF;
+    pos = sos;
+    const uint8_t dri[6] = { 0xFF, 0xDD, 0x00, 0x04, (interval >> 8) & 0xFF, interval & 0xFF };
+    memcpy(buf + pos, dri, sizeof(dri));
+    pos += sizeof(dri);
+    memcpy(buf + pos, bands[0].buf + sos, bands[0].data - sos);
+    pos += bands[0].data - sos;
+
+    for(int k = 0; k < nbands; k++)
+    {
+      const size_t size = bands[k].length - 2 - bands[k].data;
+      memcpy(buf + pos, bands[k].buf + bands[k].data, size);
+      pos += size;
+      buf[pos++] = 0xFF;
+      buf[pos++] = (k == nbands - 1) ? 0xD9 : 0xD0 + (k % 8);
+    }
+    *out = buf;
+    *out_length = pos;
+  }
+  else
+    err = 1;
+
+  for(int k = 0; k < nbands; k++) free(bands[k].buf);
+  free(bands);
+  return err;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
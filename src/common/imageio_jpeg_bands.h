@@ -0,0 +1,51 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+// this fixes a rather annoying, long time bug in libjpeg :(
+#undef HAVE_STDLIB_H
+#undef HAVE_STDDEF_H
+#include <jpeglib.h>
+#undef HAVE_STDLIB_H
+#undef HAVE_STDDEF_H
+
+/** images of at least that many pixels are compressed in parallel bands */
+#define DT_IMAGEIO_JPEG_BANDS_MIN_PIXELS (4 * 1024 * 1024)
+
+/** sets the compression parameters after jpeg_set_defaults(), or writes the markers after
+ * jpeg_start_compress(). */
+typedef void (*dt_imageio_jpeg_setup_t)(struct jpeg_compress_struct *cinfo, void *user_data);
+
+/** compresses the 8-bit RGBA `in` to a baseline jpeg in a new buffer `out`, to be freed with free().
+ * Horizontal bands are encoded in parallel with the standard Huffman tables and joined with restart markers.
+ * `setup` sets the quality and sampling, `markers`, if not NULL, writes the metadata markers.
+ * returns 0 on success, 1 on failure or if the image or the settings don't allow bands. */
+int dt_imageio_jpeg_compress_bands(const uint8_t *in, const int width, const int height,
+                                   dt_imageio_jpeg_setup_t setup, dt_imageio_jpeg_setup_t markers,
+                                   void *user_data, uint8_t **out, size_t *out_length);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -42,9 +42,17 @@ extern "C" {
 #include "imageio.h"
 #include "common/tags.h"
 #include "develop/imageop.h"
+#include <glib/gstdio.h>
 #include <stdint.h>
 }
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 // define this function, it is only declared in rawspeed:
 int rawspeed_get_number_of_processor_cores()
 {
@@ -57,6 +65,48 @@ int rawspeed_get_number_of_processor_cores()
 
 using namespace rawspeed;
 
+// Read-only mapping of a raw file. The decoder then reads the pages as it needs them while the kernel
+// reads ahead, instead of waiting for a copy of the whole file before starting: on network storage,
+// decoding overlaps with the transfer. Falls back to FileReader when the file can't be mapped.
+struct dt_rawspeed_mapped_file_t
+{
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+
+  explicit dt_rawspeed_mapped_file_t(const char *filename)
+  {
+#ifndef _WIN32
+    const int fd = g_open(filename, O_RDONLY, 0);
+    if(fd < 0) return;
+    struct stat st;
+    // rawspeed buffers are addressed with 32 bits
+    if(fstat(fd, &st) == 0 && st.st_size > 0 && (uint64_t)st.st_size <= UINT32_MAX)
+    {
+      void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(map != MAP_FAILED)
+      {
+        // raw containers are mostly read front to back, start fetching all of it right away
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        madvise(map, st.st_size, MADV_WILLNEED);
+        data = (const uint8_t *)map;
+        size = st.st_size;
+      }
+    }
+    close(fd);
+#endif
+  }
+
+  ~dt_rawspeed_mapped_file_t()
+  {
+#ifndef _WIN32
+    if(data) munmap((void *)data, size);
+#endif
+  }
+
+  dt_rawspeed_mapped_file_t(const dt_rawspeed_mapped_file_t &) = delete;
+  dt_rawspeed_mapped_file_t &operator=(const dt_rawspeed_mapped_file_t &) = delete;
+};
+
 static dt_imageio_retval_t dt_imageio_open_rawspeed_sraw (dt_image_t *img,
                                                           const RawImage r,
                                                           dt_mipmap_buffer_t *buf);
@@ -151,9 +201,19 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
   {
     dt_rawspeed_load_meta();
 
-    dt_pthread_mutex_lock(&darktable.readFile_mutex);
-    auto [storage, storageBuf] = f.readFile();
-    dt_pthread_mutex_unlock(&darktable.readFile_mutex);
+    dt_rawspeed_mapped_file_t mapped(filen);
+    decltype(f.readFile().first) storage;
+    Buffer storageBuf;
+    if(mapped.data)
+      storageBuf = Buffer(mapped.data, (Buffer::size_type)mapped.size);
+    else
+    {
+      dt_pthread_mutex_lock(&darktable.readFile_mutex);
+      auto [fileStorage, fileBuf] = f.readFile();
+      dt_pthread_mutex_unlock(&darktable.readFile_mutex);
+      storage = std::move(fileStorage);
+      storageBuf = fileBuf;
+    }
 
     RawParser t(storageBuf);
     std::unique_ptr<RawDecoder> d = t.getDecoder(meta);
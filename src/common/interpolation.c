@@ -24,6 +24,7 @@
 #include <assert.h>
 #include <glib.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -993,6 +994,7 @@ static gboolean _prepare_resampling_plan(const struct dt_interpolation *itor,
   return FALSE;
 }
 
+__DT_CLONE_TARGETS__
 static void _interpolation_resample_plain(const struct dt_interpolation *itor,
                                           float *out,
                                           const dt_iop_roi_t *const roi_out,
@@ -1128,6 +1130,159 @@ exit:
   dt_free_align(vlength);
 }
 
+// Number of floats of an output line blended at once by the vertical pass of the separable resampler:
+// the accumulator and the current chunk of each contributing line stay in L1 cache.
+#define RESAMPLING_BLOCK_FLOATS 1024
+
+/* Separable version of the above. Each input line is resampled horizontally once into
+ * a small per-thread ring of lines, then the vertical pass blends whole chunks of the lines
+ * of the ring. The plain version redoes the horizontal convolution of an input line for each
+ * of the output lines it contributes to, and walks the kernels pixel by pixel.
+ * Output lines are processed in order by each thread and their input lines only move forward,
+ * so the ring needs as many lines as the widest vertical kernel.
+ * The sums are done in the same order, so the output is the same.
+ * Returns 1 if the buffers can't be allocated, so the caller can fall back. */
+__DT_CLONE_TARGETS__
+static int _interpolation_resample_separable(const struct dt_interpolation *itor,
+                                             float *out,
+                                             const dt_iop_roi_t *const roi_out,
+                                             const float *const in,
+                                             const dt_iop_roi_t *const roi_in)
+{
+  int *hindex = NULL;
+  int *hlength = NULL;
+  float *hkernel = NULL;
+  int *vindex = NULL;
+  int *vlength = NULL;
+  float *vkernel = NULL;
+  int *vmeta = NULL;
+  float *rings = NULL;
+  int *ring_lines = NULL;
+  int ret = 1;
+
+  const size_t in_stride_floats = (size_t)roi_in->width * 4;
+  const size_t out_stride_floats = (size_t)roi_out->width * 4;
+  const size_t height = roi_out->height;
+  const size_t width = roi_out->width;
+
+  // Prepare resampling plans once and for all
+  if(_prepare_resampling_plan(itor, roi_in->width, roi_in->x,
+                              roi_out->width, roi_out->x, roi_out->scale,
+                              &hlength, &hkernel, &hindex, NULL))
+    goto exit;
+
+  if(_prepare_resampling_plan(itor, roi_in->height, roi_in->y,
+                              roi_out->height, roi_out->y, roi_out->scale,
+                              &vlength, &vkernel, &vindex, &vmeta))
+    goto exit;
+
+  // The ring has to hold all the input lines of any output line
+  size_t ring_size = 1;
+  for(size_t oy = 0; oy < height; oy++)
+  {
+    const int *const vindex_row = vindex + vmeta[3 * oy + 2];
+    int ymin = INT_MAX;
+    int ymax = -1;
+    for(int iy = 0; iy < vlength[vmeta[3 * oy + 0]]; iy++)
+    {
+      ymin = MIN(ymin, vindex_row[iy]);
+      ymax = MAX(ymax, vindex_row[iy]);
+    }
+    if(ymax >= ymin) ring_size = MAX(ring_size, (size_t)(ymax - ymin + 1));
+  }
+
+  size_t rings_padded = 0;
+  size_t ring_lines_padded = 0;
+  rings = dt_alloc_perthread_float(ring_size * out_stride_floats, &rings_padded);
+  ring_lines = dt_alloc_perthread(ring_size, sizeof(int), &ring_lines_padded);
+  if(rings == NULL || ring_lines == NULL) goto exit;
+
+#ifdef _OPENMP
+#pragma omp parallel default(none) \
+  dt_omp_firstprivate(height, width, in, out, in_stride_floats, out_stride_floats, ring_size, rings, rings_padded, \
+                      ring_lines, ring_lines_padded, hlength, hkernel, hindex, vmeta, vlength, vkernel, vindex)
+#endif
+  {
+    float *const restrict ring = dt_get_perthread(rings, rings_padded);
+    int *const restrict ring_line = dt_get_perthread(ring_lines, ring_lines_padded);
+    for(size_t k = 0; k < ring_size; k++) ring_line[k] = -1;
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(size_t oy = 0; oy < height; oy++)
+    {
+      const int vl = vlength[vmeta[3 * oy + 0]];
+      const float *const restrict vtaps = vkernel + vmeta[3 * oy + 1];
+      const int *const restrict vindex_row = vindex + vmeta[3 * oy + 2];
+
+      // Horizontal pass: resample the input lines that are not in the ring yet
+      for(int iy = 0; iy < vl; iy++)
+      {
+        const int y = vindex_row[iy];
+        const size_t slot = y % ring_size;
+        if(ring_line[slot] == y) continue;
+
+        const float *const restrict inrow = in + (size_t)y * in_stride_floats;
+        float *const restrict line = ring + slot * out_stride_floats;
+        size_t hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
+
+        for(size_t ox = 0; ox < width; ox++)
+        {
+          const int hl = hlength[ox];
+          dt_aligned_pixel_t vhs = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+          for(int ix = 0; ix < hl; ix++, hkidx++)
+          {
+            const float htap = hkernel[hkidx];
+            const float *const restrict sample = inrow + (size_t)hindex[hkidx] * 4;
+            for_four_channels(c, aligned(vhs:16))
+              vhs[c] += sample[c] * htap;
+          }
+
+          copy_pixel(line + ox * 4, vhs);
+        }
+        ring_line[slot] = y;
+      }
+
+      // Vertical pass: blend the lines of the ring by blocks of floats
+      float *const restrict outrow = out + oy * out_stride_floats;
+      for(size_t x0 = 0; x0 < out_stride_floats; x0 += RESAMPLING_BLOCK_FLOATS)
+      {
+        const size_t block = MIN(RESAMPLING_BLOCK_FLOATS, out_stride_floats - x0);
+        float DT_ALIGNED_ARRAY vs[RESAMPLING_BLOCK_FLOATS] = { 0.0f };
+
+        for(int iy = 0; iy < vl; iy++)
+        {
+          const float vtap = vtaps[iy];
+          const float *const restrict line = ring + (vindex_row[iy] % ring_size) * out_stride_floats + x0;
+#ifdef _OPENMP
+#pragma omp simd aligned(vs:64)
+#endif
+          for(size_t k = 0; k < block; k++)
+            vs[k] += line[k] * vtap;
+        }
+
+        // Clip negative RGB that may be produced by Lanczos undershooting
+#ifdef _OPENMP
+#pragma omp simd aligned(vs:64)
+#endif
+        for(size_t k = 0; k < block; k++)
+          outrow[x0 + k] = MAX(vs[k], 0.f);
+      }
+    }
+  }
+
+  ret = 0;
+
+exit:
+  dt_free_align(rings);
+  dt_free_align(ring_lines);
+  dt_free_align(hlength);
+  dt_free_align(vlength);
+  return ret;
+}
+
 /** Applies resampling (re-scaling) on *full* input and output buffers.
  *  roi_in and roi_out define the part of the buffers that is affected.
  */
@@ -1143,6 +1298,9 @@ void dt_interpolation_resample(const struct dt_interpolation *itor,
     return;
   }
 
+  if(roi_out->scale != 1.f && !_interpolation_resample_separable(itor, out, roi_out, in, roi_in))
+    return;
+
   return _interpolation_resample_plain(itor, out, roi_out, in, roi_in);
 }
 
@@ -1399,6 +1557,7 @@ int dt_interpolation_resample_roi_cl(const struct dt_interpolation *itor,
 }
 #endif
 
+__DT_CLONE_TARGETS__
 static void _interpolation_resample_1c_plain(const struct dt_interpolation *itor,
                                              float *out,
                                              const dt_iop_roi_t *const roi_out,
@@ -363,6 +363,44 @@ static inline void dt_ioppr_rgb_matrix_to_lab(const dt_aligned_pixel_t rgb, dt_a
   dt_XYZ_to_Lab(xyz, lab);
 }
 
+/** n interleaved RGBA pixels to Lab with the matrix and TRC of the profile, see dt_XYZ_to_Lab_row() */
+static inline void dt_ioppr_rgb_matrix_to_lab_row(const float *const in, float *const out, const size_t n,
+                                                  const dt_iop_order_iccprofile_info_t *const profile)
+{
+  const float m00 = profile->matrix_in_transposed[0][0], m01 = profile->matrix_in_transposed[0][1],
+              m02 = profile->matrix_in_transposed[0][2];
+  const float m10 = profile->matrix_in_transposed[1][0], m11 = profile->matrix_in_transposed[1][1],
+              m12 = profile->matrix_in_transposed[1][2];
+  const float m20 = profile->matrix_in_transposed[2][0], m21 = profile->matrix_in_transposed[2][1],
+              m22 = profile->matrix_in_transposed[2][2];
+
+  if(profile->nonlinearlut)
+  {
+    // the TRC reads the LUT at random: linearize pixel by pixel, only the matrix and Lab are batched
+    for(size_t k = 0; k < 4 * n; k += 4)
+    {
+      dt_aligned_pixel_t rgb;
+      _apply_trc(in + k, rgb, profile->lut_in, profile->unbounded_coeffs_in, profile->lutsize);
+      _dt_XYZ_to_Lab_store(m00 * rgb[0] + m10 * rgb[1] + m20 * rgb[2],
+                           m01 * rgb[0] + m11 * rgb[1] + m21 * rgb[2],
+                           m02 * rgb[0] + m12 * rgb[1] + m22 * rgb[2], out + k);
+    }
+  }
+  else
+  {
+#ifdef _OPENMP
+#pragma omp simd aligned(in, out: 16)
+#endif
+    for(size_t k = 0; k < 4 * n; k += 4)
+    {
+      const float R = in[k], G = in[k + 1], B = in[k + 2];
+      _dt_XYZ_to_Lab_store(m00 * R + m10 * G + m20 * B,
+                           m01 * R + m11 * G + m21 * B,
+                           m02 * R + m12 * G + m22 * B, out + k);
+    }
+  }
+}
+
 static inline float dt_ioppr_get_profile_info_middle_grey(const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   return profile_info->grey;
@@ -33,6 +33,10 @@
 #define max_levels 30
 // the number of segments for the piecewise linear interpolation
 #define num_gamma 6
+// the number of samples of the fast variant, interpolated by a cubic spline
+#define num_gamma_fast 4
+// the fast variant shrinks the padding to fit its memory ceiling, down to that many pixels
+#define min_supp_fast 16
 
 //#define DEBUG_DUMP
 
@@ -269,8 +273,9 @@ static inline void gauss_reduce(
   ll_fill_boundary1(coarse, cw, ch);
 }
 
-// allocate output buffer with monochrome brightness channel from input, padded
-// up by max_supp on all four sides, dimensions written to wd2 ht2
+// fill output buffer with monochrome brightness channel from input, padded
+// up by max_supp on all four sides, dimensions written to wd2 ht2.
+// the buffer is allocated if buf is NULL.
 static inline float *ll_pad_input(
     const float *const input,
     const int wd,
@@ -278,12 +283,13 @@ static inline float *ll_pad_input(
     const int max_supp,
     int *wd2,
     int *ht2,
-    local_laplacian_boundary_t *b)
+    local_laplacian_boundary_t *b,
+    float *const buf)
 {
   const int stride = 4;
   *wd2 = 2*max_supp + wd;
   *ht2 = 2*max_supp + ht;
-  float *const out = dt_alloc_align_float((size_t) *wd2 * *ht2);
+  float *const out = buf ? buf : dt_alloc_align_float((size_t) *wd2 * *ht2);
 
   if(b && b->mode == 2)
   { // pad by preview buffer
@@ -560,6 +566,7 @@ void apply_curve(
   pad_by_replication(out, w, h, padding);
 }
 
+__DT_CLONE_TARGETS__
 void local_laplacian_internal(
     const float *const input,   // input buffer in some Labx or yuvx format
     float *const out,           // output buffer with colour
@@ -583,9 +590,9 @@ void local_laplacian_internal(
   int w, h;
   float *padded[max_levels] = {0};
   if(b && b->mode == 2)
-    padded[0] = ll_pad_input(input, wd, ht, max_supp, &w, &h, b);
+    padded[0] = ll_pad_input(input, wd, ht, max_supp, &w, &h, b, NULL);
   else
-    padded[0] = ll_pad_input(input, wd, ht, max_supp, &w, &h, 0);
+    padded[0] = ll_pad_input(input, wd, ht, max_supp, &w, &h, 0, NULL);
 
   // allocate pyramid pointers for padded input
   for(int l=1;l<=last_level;l++)
@@ -766,6 +773,224 @@ void local_laplacian_internal(
 }
 
 
+// Catmull-Rom kernel, at distance s from a sample
+#ifdef _OPENMP
+#pragma omp declare simd
+#endif
+static inline float ll_cubic(const float s)
+{
+  const float a = fabsf(s);
+  const float a2 = a * a;
+  const float a3 = a2 * a;
+  if(a < 1.0f) return 1.5f * a3 - 2.5f * a2 + 1.0f;
+  if(a < 2.0f) return -0.5f * a3 + 2.5f * a2 - 4.0f * a + 2.0f;
+  return 0.0f;
+}
+
+// weight of the gamma sample k in the spline through all samples, at brightness v.
+// samples are at (k+.5)/num_gamma_fast, the end ones are replicated outside like the clamped
+// linear interpolation of local_laplacian_internal() does
+#ifdef _OPENMP
+#pragma omp declare simd uniform(k)
+#endif
+static inline float ll_gamma_weight(const float v, const int k)
+{
+  const float t = CLAMPS(v * num_gamma_fast - 0.5f, 0.0f, num_gamma_fast - 1.0f);
+  float weight = ll_cubic(t - k);
+  if(k == 0) weight += ll_cubic(t + 1.0f);
+  if(k == num_gamma_fast - 1) weight += ll_cubic(t - num_gamma_fast);
+  return weight;
+}
+
+// all the buffers of the fast variant come out of a single allocation
+typedef struct ll_pool_t
+{
+  float *base;
+  size_t size; // in floats
+  size_t used;
+} ll_pool_t;
+
+// buffers of the pool start on 64 bytes boundaries
+static inline size_t ll_pool_floats(const size_t n)
+{
+  return (n + 15) & ~(size_t)15;
+}
+
+static inline float *ll_pool_alloc(ll_pool_t *pool, const size_t n)
+{
+  if(pool->used + ll_pool_floats(n) > pool->size) return NULL;
+  float *const buf = pool->base + pool->used;
+  pool->used += ll_pool_floats(n);
+  return buf;
+}
+
+// floats needed by local_laplacian_fast_internal(): the pyramids of the padded input and of the output,
+// the two finest levels of the pyramid of one remapped image at a time and an upsampling buffer
+static size_t ll_fast_pool_size(const int wd, const int ht, const int last_level, const int max_supp)
+{
+  const int w = wd + 2 * max_supp;
+  const int h = ht + 2 * max_supp;
+  size_t size = 2 * ll_pool_floats((size_t)w * h) + ll_pool_floats((size_t)dl(w, 1) * dl(h, 1));
+  for(int l = 0; l <= last_level; l++) size += 2 * ll_pool_floats((size_t)dl(w, l) * dl(h, l));
+  return size;
+}
+
+static inline int ll_fast_last_level(const int wd, const int ht)
+{
+  const int num_levels = MIN(max_levels, 31-__builtin_clz(MIN(wd,ht)));
+  return num_levels - 1;
+}
+
+// the padding that fits in max_memory. The full padding covers the support of the coarsest level,
+// which makes the padded buffers up to four times larger than the image. A thinner padding replicated
+// by the pyramid levels themselves only changes the coarse contrast along the borders.
+static int ll_fast_max_supp(const int wd, const int ht, const int last_level, const size_t max_memory)
+{
+  int max_supp = 1 << last_level;
+  while(max_supp > min_supp_fast && sizeof(float) * ll_fast_pool_size(wd, ht, last_level, max_supp) > max_memory)
+    max_supp /= 2;
+  return max_supp;
+}
+
+__DT_CLONE_TARGETS__
+void local_laplacian_fast_internal(
+    const float *const input,   // input buffer in some Labx or yuvx format
+    float *const out,           // output buffer with colour
+    const int wd,               // width and
+    const int ht,               // height of the input buffer
+    const float sigma,          // user param: separate shadows/mid-tones/highlights
+    const float shadows,        // user param: lift shadows
+    const float highlights,     // user param: compress highlights
+    const float clarity,        // user param: increase clarity/local contrast
+    const size_t max_memory,    // memory ceiling in bytes
+    const int use_sse2)         // flag whether to use SSE version
+{
+  if(wd <= 1 || ht <= 1) return;
+
+  const int last_level = ll_fast_last_level(wd, ht);
+  const int max_supp = ll_fast_max_supp(wd, ht, last_level, max_memory);
+  ll_pool_t pool = { NULL, 0, 0 };
+  pool.size = ll_fast_pool_size(wd, ht, last_level, max_supp);
+  pool.base = last_level >= 1 ? dt_alloc_align_float(pool.size) : NULL;
+  if(!pool.base)
+  {
+    // too small for a pyramid, or out of memory
+    if(last_level >= 1) fprintf(stderr, "[local laplacian] could not allocate temporary buffers\n");
+    memcpy(out, input, sizeof(float) * 4 * wd * ht);
+    return;
+  }
+
+  const int w = wd + 2 * max_supp;
+  const int h = ht + 2 * max_supp;
+  float *padded[max_levels] = { 0 };
+  float *output[max_levels] = { 0 };
+  for(int l = 0; l <= last_level; l++)
+  {
+    padded[l] = ll_pool_alloc(&pool, (size_t)dl(w, l) * dl(h, l));
+    output[l] = ll_pool_alloc(&pool, (size_t)dl(w, l) * dl(h, l));
+  }
+  // the remapped image is reduced level by level, one level is discarded once its coefficients are added
+  float *const remapped[2] = { ll_pool_alloc(&pool, (size_t)w * h),
+                               ll_pool_alloc(&pool, (size_t)dl(w, 1) * dl(h, 1)) };
+  float *const expanded = ll_pool_alloc(&pool, (size_t)w * h);
+
+  int w2, h2;
+  ll_pad_input(input, wd, ht, max_supp, &w2, &h2, 0, padded[0]);
+
+  // the gauss pyramid of the input gives the interpolation weights, its coarsest level
+  // is the coarsest level of the output
+  for(int l = 1; l <= last_level; l++)
+#if defined(__SSE2__)
+    if(use_sse2)
+      gauss_reduce_sse2(padded[l-1], padded[l], dl(w, l-1), dl(h, l-1));
+    else
+#endif
+      gauss_reduce(padded[l-1], padded[l], dl(w, l-1), dl(h, l-1));
+  memcpy(output[last_level], padded[last_level], sizeof(float) * dl(w, last_level) * dl(h, last_level));
+  for(int l = 0; l < last_level; l++) memset(output[l], 0, sizeof(float) * dl(w, l) * dl(h, l));
+
+  // Aubry et al. 2014: the output laplacian pyramid is the interpolation of the laplacian pyramids
+  // of the remapped images, which is a weighted sum we can accumulate one remapped image at a time
+  for(int k = 0; k < num_gamma_fast; k++)
+  {
+    const float g = (k + .5f) / (float)num_gamma_fast;
+#if defined(__SSE2__)
+    if(use_sse2)
+      apply_curve_sse2(remapped[0], padded[0], w, h, max_supp, g, sigma, shadows, highlights, clarity);
+    else // brackets in next line needed for silly gcc warning:
+#endif
+    {apply_curve(remapped[0], padded[0], w, h, max_supp, g, sigma, shadows, highlights, clarity);}
+
+    for(int l = 0; l < last_level; l++)
+    {
+      const int pw = dl(w, l), ph = dl(h, l);
+      const float *const fine = remapped[l & 1];
+      float *const coarse = remapped[(l + 1) & 1];
+#if defined(__SSE2__)
+      if(use_sse2)
+        gauss_reduce_sse2(fine, coarse, pw, ph);
+      else
+#endif
+        gauss_reduce(fine, coarse, pw, ph);
+
+      gauss_expand(coarse, expanded, pw, ph);
+
+      const float *const in = padded[l];
+      float *const acc = output[l];
+      const size_t size = (size_t)pw * ph;
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+      dt_omp_firstprivate(acc, expanded, fine, in, k, size) \
+      schedule(static) aligned(acc, expanded, fine, in:64)
+#endif
+      for(size_t p = 0; p < size; p++)
+        acc[p] += ll_gamma_weight(in[p], k) * (fine[p] - expanded[p]);
+    }
+  }
+
+  // collapse the output pyramid coarse to fine
+  for(int l = last_level - 1; l >= 0; l--)
+  {
+    const int pw = dl(w, l), ph = dl(h, l);
+    gauss_expand(output[l+1], expanded, pw, ph);
+    float *const acc = output[l];
+    const size_t size = (size_t)pw * ph;
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+    dt_omp_firstprivate(acc, expanded, size) \
+    schedule(static) aligned(acc, expanded:64)
+#endif
+    for(size_t k = 0; k < size; k++) acc[k] += expanded[k];
+  }
+
+  const float *const out0 = output[0];
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ht, input, max_supp, out, out0, w, wd) \
+  schedule(static) \
+  collapse(2)
+#endif
+  for(int j=0;j<ht;j++) for(int i=0;i<wd;i++)
+  {
+    out[4*(j*wd+i)+0] = 100.0f * out0[(j+max_supp)*w+max_supp+i]; // [0,1] -> L
+    out[4*(j*wd+i)+1] = input[4*(j*wd+i)+1]; // copy original colour channels
+    out[4*(j*wd+i)+2] = input[4*(j*wd+i)+2];
+  }
+
+  dt_free_align(pool.base);
+}
+
+size_t local_laplacian_fast_memory_use(const int width,         // width of input image
+                                       const int height,        // height of input image
+                                       const size_t max_memory) // memory ceiling in bytes
+{
+  if(width <= 1 || height <= 1) return 0;
+  const int last_level = ll_fast_last_level(width, height);
+  if(last_level < 1) return 0;
+  const int max_supp = ll_fast_max_supp(width, height, last_level, max_memory);
+  return sizeof(float) * ll_fast_pool_size(width, height, last_level, max_supp);
+}
+
 size_t local_laplacian_memory_use(const int width,     // width of input image
                                   const int height)    // height of input image
 {
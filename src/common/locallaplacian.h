@@ -75,6 +75,41 @@ void local_laplacian(
 size_t local_laplacian_memory_use(const int width,      // width of input image
                                   const int height);    // height of input image
 
+// fast variant after Aubry et al. 2014, "Fast local laplacian filters: theory and applications":
+// 4 samples of the curve interpolated by a cubic spline instead of 6 linear segments, and the
+// laplacian pyramid of one remapped image alive at a time. All buffers are taken from one
+// allocation of local_laplacian_fast_memory_use() bytes, kept under max_memory by thinning the
+// padding of the pyramid.
+void local_laplacian_fast_internal(
+    const float *const input,   // input buffer in some Labx or yuvx format
+    float *const out,           // output buffer with colour
+    const int wd,               // width and
+    const int ht,               // height of the input buffer
+    const float sigma,          // user param: separate shadows/mid-tones/highlights
+    const float shadows,        // user param: lift shadows
+    const float highlights,     // user param: compress highlights
+    const float clarity,        // user param: increase clarity/local contrast
+    const size_t max_memory,    // memory ceiling in bytes
+    const int use_sse2);        // switch on sse optimised version, if available
+
+void local_laplacian_fast(
+    const float *const input,   // input buffer in some Labx or yuvx format
+    float *const out,           // output buffer with colour
+    const int wd,               // width and
+    const int ht,               // height of the input buffer
+    const float sigma,          // user param: separate shadows/mid-tones/highlights
+    const float shadows,        // user param: lift shadows
+    const float highlights,     // user param: compress highlights
+    const float clarity,        // user param: increase clarity/local contrast
+    const size_t max_memory)    // memory ceiling in bytes
+{
+  local_laplacian_fast_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, max_memory, 0);
+}
+
+size_t local_laplacian_fast_memory_use(const int width,          // width of input image
+                                       const int height,         // height of input image
+                                       const size_t max_memory); // memory ceiling in bytes
+
 
 size_t local_laplacian_singlebuffer_size(const int width,       // width of input image
                                          const int height);     // height of input image
@@ -92,7 +127,23 @@ void local_laplacian_sse2(
     const float clarity,        // user param: increase clarity/local contrast
     local_laplacian_boundary_t *b) // can be 0
 {
-  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 1, b);
+  // the AVX2 clones of the plain code are faster than the SSE2 intrinsics
+  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, !darktable.codepath.AVX2, b);
+}
+
+void local_laplacian_fast_sse2(
+    const float *const input,   // input buffer in some Labx or yuvx format
+    float *const out,           // output buffer with colour
+    const int wd,               // width and
+    const int ht,               // height of the input buffer
+    const float sigma,          // user param: separate shadows/mid-tones/highlights
+    const float shadows,        // user param: lift shadows
+    const float highlights,     // user param: compress highlights
+    const float clarity,        // user param: increase clarity/local contrast
+    const size_t max_memory)    // memory ceiling in bytes
+{
+  local_laplacian_fast_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, max_memory,
+                                !darktable.codepath.AVX2);
 }
 #endif
 // clang-format off
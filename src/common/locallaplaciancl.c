@@ -22,6 +22,8 @@
 
 #define max_levels 30
 #define num_gamma 6
+// keep in sync with NUM_GAMMA_FAST in data/kernels/locallaplacian.cl
+#define num_gamma_fast 4
 
 // downsample width/height to given level
 static inline uint64_t dl(uint64_t size, const int level)
@@ -42,6 +44,9 @@ dt_local_laplacian_cl_global_t *dt_local_laplacian_init_cl_global()
   g->kernel_laplacian_assemble = dt_opencl_create_kernel(program, "laplacian_assemble");
   g->kernel_process_curve      = dt_opencl_create_kernel(program, "process_curve");
   g->kernel_write_back         = dt_opencl_create_kernel(program, "write_back");
+  g->kernel_laplacian_accumulate = dt_opencl_create_kernel(program, "laplacian_accumulate");
+  g->kernel_laplacian_collapse   = dt_opencl_create_kernel(program, "laplacian_collapse");
+  g->kernel_write_back_buffer    = dt_opencl_create_kernel(program, "write_back_buffer");
   return g;
 }
 
@@ -59,6 +64,9 @@ void dt_local_laplacian_free_cl(dt_local_laplacian_cl_t *g)
     for(int k=0;k<num_gamma;k++)
       dt_opencl_release_mem_object(g->dev_processed[k][l]);
   }
+  dt_opencl_release_mem_object(g->dev_remapped[0]);
+  dt_opencl_release_mem_object(g->dev_remapped[1]);
+  dt_opencl_release_mem_object(g->dev_pyramid);
   for(int k=0;k<num_gamma;k++) free(g->dev_processed[k]);
   free(g->dev_padded);
   free(g->dev_output);
@@ -77,7 +85,7 @@ dt_local_laplacian_cl_t *dt_local_laplacian_init_cl(
     const float highlights,     // user param: compress highlights
     const float clarity)        // user param: increase clarity/local contrast
 {
-  dt_local_laplacian_cl_t *g = malloc(sizeof(dt_local_laplacian_cl_t));
+  dt_local_laplacian_cl_t *g = calloc(1, sizeof(dt_local_laplacian_cl_t));
   if(!g) return NULL;
 
   g->global = darktable.opencl->local_laplacian;
@@ -121,6 +129,216 @@ error:
   return NULL;
 }
 
+// the fast variant shrinks the padding to fit in device memory, down to that many pixels
+#define min_supp_fast 16
+
+// floats of the output pyramid of the fast variant, and offsets of its levels
+static size_t _fast_pyramid_size(const size_t bwidth, const size_t bheight, const int num_levels, int *offset)
+{
+  size_t size = 0;
+  for(int l=0;l<num_levels;l++)
+  {
+    if(offset) offset[l] = size;
+    size += dl(bwidth, l) * dl(bheight, l);
+  }
+  return size;
+}
+
+// device memory of the fast variant: pyramids of padded input and output, two levels of remapped image
+static size_t _fast_memory_use(const int devid, const size_t bwidth, const size_t bheight, const int num_levels)
+{
+  size_t size = 0;
+  for(int l=0;l<num_levels;l++)
+    size += (size_t)ROUNDUPDWD(dl(bwidth, l), devid) * ROUNDUPDHT(dl(bheight, l), devid);
+  size += (size_t)ROUNDUPDWD(bwidth, devid) * ROUNDUPDHT(bheight, devid);
+  size += (size_t)ROUNDUPDWD(dl(bwidth, 1), devid) * ROUNDUPDHT(dl(bheight, 1), devid);
+  size += _fast_pyramid_size(bwidth, bheight, num_levels, NULL);
+  return sizeof(float) * size;
+}
+
+dt_local_laplacian_cl_t *dt_local_laplacian_fast_init_cl(
+    const int devid,
+    const int width,            // width of input image
+    const int height,           // height of input image
+    const float sigma,          // user param: separate shadows/mid-tones/highlights
+    const float shadows,        // user param: lift shadows
+    const float highlights,     // user param: compress highlights
+    const float clarity)        // user param: increase clarity/local contrast
+{
+  dt_local_laplacian_cl_t *g = calloc(1, sizeof(dt_local_laplacian_cl_t));
+  if(!g) return NULL;
+
+  g->global = darktable.opencl->local_laplacian;
+  g->devid = devid;
+  g->fast = 1;
+  g->width = width;
+  g->height = height;
+  g->sigma = sigma;
+  g->shadows = shadows;
+  g->highlights = highlights;
+  g->clarity = clarity;
+  g->dev_padded = calloc(max_levels, sizeof(cl_mem));
+  g->dev_output = calloc(max_levels, sizeof(cl_mem));
+  g->dev_processed = calloc(num_gamma, sizeof(cl_mem *));
+  for(int k=0;k<num_gamma;k++)
+    g->dev_processed[k] = calloc(max_levels, sizeof(cl_mem));
+
+  g->num_levels = MIN(max_levels, 31-__builtin_clz(MIN(width,height)));
+  if(g->num_levels < 2) goto error;
+
+  // thin the padding until we fit in the device
+  const size_t available = dt_opencl_get_device_available(devid);
+  const size_t memalloc = dt_opencl_get_device_memalloc(devid);
+  g->max_supp = 1<<(g->num_levels-1);
+  for(;;)
+  {
+    g->bwidth = ROUNDUPDWD(width  + 2*g->max_supp, devid);
+    g->bheight = ROUNDUPDHT(height + 2*g->max_supp, devid);
+    const size_t pyramid = sizeof(float) * _fast_pyramid_size(g->bwidth, g->bheight, g->num_levels, g->offset);
+    if(g->max_supp <= min_supp_fast
+       || (_fast_memory_use(devid, g->bwidth, g->bheight, g->num_levels) <= available && pyramid <= memalloc))
+      break;
+    g->max_supp /= 2;
+  }
+
+  for(int l=0;l<g->num_levels;l++)
+  {
+    g->dev_padded[l] = dt_opencl_alloc_device(devid, ROUNDUPDWD(dl(g->bwidth, l), devid), ROUNDUPDHT(dl(g->bheight, l), devid), sizeof(float));
+    if(!g->dev_padded[l]) goto error;
+  }
+  for(int l=0;l<2;l++)
+  {
+    g->dev_remapped[l] = dt_opencl_alloc_device(devid, ROUNDUPDWD(dl(g->bwidth, l), devid), ROUNDUPDHT(dl(g->bheight, l), devid), sizeof(float));
+    if(!g->dev_remapped[l]) goto error;
+  }
+  g->dev_pyramid = dt_opencl_alloc_device_buffer(devid, sizeof(float) * _fast_pyramid_size(g->bwidth, g->bheight, g->num_levels, NULL));
+  if(!g->dev_pyramid) goto error;
+
+  return g;
+
+error:
+  fprintf(stderr, "[local laplacian cl] could not allocate temporary buffers\n");
+  dt_local_laplacian_free_cl(g);
+  return NULL;
+}
+
+static cl_int _local_laplacian_fast_cl(
+    dt_local_laplacian_cl_t *b, // opencl context with temp buffers
+    cl_mem input,               // input buffer in some Labx or yuvx format
+    cl_mem output)              // output buffer with colour
+{
+  cl_int err = -666;
+  const int last_level = b->num_levels-1;
+
+  size_t sizes_pad[] = { ROUNDUPDWD(b->bwidth, b->devid), ROUNDUPDHT(b->bheight, b->devid), 1 };
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_pad_input, 0, sizeof(cl_mem), &input);
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_pad_input, 1, sizeof(cl_mem), &b->dev_padded[0]);
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_pad_input, 2, sizeof(int), &b->width);
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_pad_input, 3, sizeof(int), &b->height);
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_pad_input, 4, sizeof(int), &b->max_supp);
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_pad_input, 5, sizeof(int), &b->bwidth);
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_pad_input, 6, sizeof(int), &b->bheight);
+  err = dt_opencl_enqueue_kernel_2d(b->devid, b->global->kernel_pad_input, sizes_pad);
+  if(err != CL_SUCCESS) goto error;
+
+  // create gauss pyramid of padded input, its coarsest level is the coarsest level of the output
+  for(int l=1;l<b->num_levels;l++)
+  {
+    const int wd = dl(b->bwidth, l), ht = dl(b->bheight, l);
+    size_t sizes[] = { ROUNDUPDWD(wd, b->devid), ROUNDUPDHT(ht, b->devid), 1 };
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_gauss_reduce, 0, sizeof(cl_mem), &b->dev_padded[l-1]);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_gauss_reduce, 1, sizeof(cl_mem), &b->dev_padded[l]);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_gauss_reduce, 2, sizeof(int), &wd);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_gauss_reduce, 3, sizeof(int), &ht);
+    err = dt_opencl_enqueue_kernel_2d(b->devid, b->global->kernel_gauss_reduce, sizes);
+    if(err != CL_SUCCESS) goto error;
+  }
+  size_t origin[] = { 0, 0, 0 };
+  size_t region[] = { dl(b->bwidth, last_level), dl(b->bheight, last_level), 1 };
+  err = dt_opencl_enqueue_copy_image_to_buffer(b->devid, b->dev_padded[last_level], b->dev_pyramid, origin, region,
+                                               sizeof(float) * b->offset[last_level]);
+  if(err != CL_SUCCESS) goto error;
+
+  for(int k=0;k<num_gamma_fast;k++)
+  { // process images
+    const float g = (k+.5f)/(float)num_gamma_fast;
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_process_curve, 0, sizeof(cl_mem), &b->dev_padded[0]);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_process_curve, 1, sizeof(cl_mem), &b->dev_remapped[0]);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_process_curve, 2, sizeof(float), &g);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_process_curve, 3, sizeof(float), &b->sigma);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_process_curve, 4, sizeof(float), &b->shadows);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_process_curve, 5, sizeof(float), &b->highlights);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_process_curve, 6, sizeof(float), &b->clarity);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_process_curve, 7, sizeof(int), &b->bwidth);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_process_curve, 8, sizeof(int), &b->bheight);
+    err = dt_opencl_enqueue_kernel_2d(b->devid, b->global->kernel_process_curve, sizes_pad);
+    if(err != CL_SUCCESS) goto error;
+
+    // reduce the remapped image one level at a time, and add its laplacian coefficients to the output
+    const int first = (k == 0);
+    for(int l=0;l<last_level;l++)
+    {
+      cl_mem fine = b->dev_remapped[l & 1];
+      cl_mem coarse = b->dev_remapped[(l + 1) & 1];
+      const int pw = dl(b->bwidth, l), ph = dl(b->bheight, l);
+      const int cw = dl(b->bwidth, l+1), ch = dl(b->bheight, l+1);
+      size_t sizes_coarse[] = { ROUNDUPDWD(cw, b->devid), ROUNDUPDHT(ch, b->devid), 1 };
+      dt_opencl_set_kernel_arg(b->devid, b->global->kernel_gauss_reduce, 0, sizeof(cl_mem), &fine);
+      dt_opencl_set_kernel_arg(b->devid, b->global->kernel_gauss_reduce, 1, sizeof(cl_mem), &coarse);
+      dt_opencl_set_kernel_arg(b->devid, b->global->kernel_gauss_reduce, 2, sizeof(int), &cw);
+      dt_opencl_set_kernel_arg(b->devid, b->global->kernel_gauss_reduce, 3, sizeof(int), &ch);
+      err = dt_opencl_enqueue_kernel_2d(b->devid, b->global->kernel_gauss_reduce, sizes_coarse);
+      if(err != CL_SUCCESS) goto error;
+
+      size_t sizes[] = { ROUNDUPDWD(pw, b->devid), ROUNDUPDHT(ph, b->devid), 1 };
+      dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_accumulate, 0, sizeof(cl_mem), &b->dev_padded[l]);
+      dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_accumulate, 1, sizeof(cl_mem), &fine);
+      dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_accumulate, 2, sizeof(cl_mem), &coarse);
+      dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_accumulate, 3, sizeof(cl_mem), &b->dev_pyramid);
+      dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_accumulate, 4, sizeof(int), &b->offset[l]);
+      dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_accumulate, 5, sizeof(int), &pw);
+      dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_accumulate, 6, sizeof(int), &ph);
+      dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_accumulate, 7, sizeof(int), &k);
+      dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_accumulate, 8, sizeof(int), &first);
+      err = dt_opencl_enqueue_kernel_2d(b->devid, b->global->kernel_laplacian_accumulate, sizes);
+      if(err != CL_SUCCESS) goto error;
+    }
+  }
+
+  // collapse the output pyramid coarse to fine
+  for(int l=last_level-1;l >= 0; l--)
+  {
+    const int pw = dl(b->bwidth,l), ph = dl(b->bheight,l);
+    size_t sizes[] = { ROUNDUPDWD(pw, b->devid), ROUNDUPDHT(ph, b->devid), 1 };
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_collapse, 0, sizeof(cl_mem), &b->dev_pyramid);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_collapse, 1, sizeof(int), &b->offset[l+1]);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_collapse, 2, sizeof(int), &b->offset[l]);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_collapse, 3, sizeof(int), &pw);
+    dt_opencl_set_kernel_arg(b->devid, b->global->kernel_laplacian_collapse, 4, sizeof(int), &ph);
+    err = dt_opencl_enqueue_kernel_2d(b->devid, b->global->kernel_laplacian_collapse, sizes);
+    if(err != CL_SUCCESS) goto error;
+  }
+
+  // write processed L channel and copy colours:
+  const int pw = b->bwidth;
+  size_t sizes[] = { ROUNDUPDWD(b->width, b->devid), ROUNDUPDHT(b->height, b->devid), 1 };
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_write_back_buffer, 0, sizeof(cl_mem), &input);
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_write_back_buffer, 1, sizeof(cl_mem), &b->dev_pyramid);
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_write_back_buffer, 2, sizeof(cl_mem), &output);
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_write_back_buffer, 3, sizeof(int), &b->max_supp);
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_write_back_buffer, 4, sizeof(int), &b->width);
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_write_back_buffer, 5, sizeof(int), &b->height);
+  dt_opencl_set_kernel_arg(b->devid, b->global->kernel_write_back_buffer, 6, sizeof(int), &pw);
+  err = dt_opencl_enqueue_kernel_2d(b->devid, b->global->kernel_write_back_buffer, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  return CL_SUCCESS;
+
+error:
+  fprintf(stderr, "[local laplacian cl] failed: %d\n", err);
+  return err;
+}
+
 cl_int dt_local_laplacian_cl(
     dt_local_laplacian_cl_t *b, // opencl context with temp buffers
     cl_mem input,               // input buffer in some Labx or yuvx format
@@ -129,6 +347,7 @@ cl_int dt_local_laplacian_cl(
   cl_int err = -666;
 
   if(b->bwidth <= 1 || b->bheight <= 1) return err;
+  if(b->fast) return _local_laplacian_fast_cl(b, input, output);
 
   size_t sizes_pad[] = { ROUNDUPDWD(b->bwidth, b->devid), ROUNDUPDHT(b->bheight, b->devid), 1 };
   dt_opencl_set_kernel_arg(b->devid, b->global->kernel_pad_input, 0, sizeof(cl_mem), &input);
@@ -237,6 +456,8 @@ error:
 
 #undef max_levels
 #undef num_gamma
+#undef num_gamma_fast
+#undef min_supp_fast
 #endif
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
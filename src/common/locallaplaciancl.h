@@ -25,6 +25,9 @@ typedef struct dt_local_laplacian_cl_global_t
   int kernel_laplacian_assemble;
   int kernel_process_curve;
   int kernel_write_back;
+  int kernel_laplacian_accumulate;
+  int kernel_laplacian_collapse;
+  int kernel_write_back_buffer;
 }
 dt_local_laplacian_cl_global_t;
 
@@ -47,6 +50,14 @@ typedef struct dt_local_laplacian_cl_t
   // one pyramid of padded monochrome buffers for every value
   // of gamma (curve parameter) that we process:
   cl_mem **dev_processed;
+
+  // fast variant, see dt_local_laplacian_fast_init_cl()
+  int fast;
+  // the two finest levels of the pyramid of one remapped image at a time
+  cl_mem dev_remapped[2];
+  // all the levels of the output pyramid in one buffer, and where each starts, in floats
+  cl_mem dev_pyramid;
+  int offset[30];
 }
 dt_local_laplacian_cl_t;
 
@@ -59,6 +70,18 @@ dt_local_laplacian_cl_t *dt_local_laplacian_init_cl(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity);       // user param: increase clarity/local contrast
+// fast variant with the same parameters, like local_laplacian_fast_internal(): 4 samples of the curve
+// interpolated by a cubic spline, and the pyramid of one remapped image alive at a time. Needs about
+// half the device memory, which is kept under the available memory by thinning the padding.
+// dt_local_laplacian_cl() and dt_local_laplacian_free_cl() handle both.
+dt_local_laplacian_cl_t *dt_local_laplacian_fast_init_cl(
+    const int devid,
+    const int width,            // width of input image
+    const int height,           // height of input image
+    const float sigma,          // user param: separate shadows/mid-tones/highlights
+    const float shadows,        // user param: lift shadows
+    const float highlights,     // user param: compress highlights
+    const float clarity);       // user param: increase clarity/local contrast
 void dt_local_laplacian_free_cl(dt_local_laplacian_cl_t *g);
 cl_int dt_local_laplacian_cl(dt_local_laplacian_cl_t *g, cl_mem input, cl_mem output);
 #endif
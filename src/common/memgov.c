@@ -0,0 +1,207 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/memgov.h"
+#include "common/darktable.h"
+#include "control/conf.h"
+
+#include <glib/gstdio.h>
+
+#define DT_MEMGOV_PERIOD (2 * G_TIME_SPAN_SECOND)
+// scales are in permille of the nominal budgets
+#define DT_MEMGOV_SCALE_MAX 1000
+#define DT_MEMGOV_SCALE_MIN 125
+#define DT_MEMGOV_SCALE_STEP 50
+
+typedef struct dt_memgov_consumer_t
+{
+  const char *name;
+  size_t nominal;
+  dt_memgov_apply_t apply;
+  void *data;
+} dt_memgov_consumer_t;
+
+typedef struct dt_memgov_sample_t
+{
+  size_t total;     // bytes
+  size_t available; // bytes
+  float some;       // % of the time some tasks stalled on memory over the last 10 s
+  float full;       // % of the time all tasks stalled on memory over the last 10 s
+} dt_memgov_sample_t;
+
+typedef struct dt_memgov_t
+{
+  GMutex lock;     // protects everything below but scale
+  GCond cond;
+  GList *consumers;
+  GThread *thread;
+  gboolean stop;
+  gint scale;      // atomic
+} dt_memgov_t;
+
+static dt_memgov_t _memgov = { .scale = DT_MEMGOV_SCALE_MAX };
+
+#ifdef __linux__
+static gboolean _sample(dt_memgov_sample_t *s)
+{
+  memset(s, 0, sizeof(*s));
+
+  FILE *f = g_fopen("/proc/meminfo", "rb");
+  if(!f) return FALSE;
+  char line[256];
+  unsigned long value = 0;
+  while(fgets(line, sizeof(line), f))
+  {
+    if(sscanf(line, "MemTotal: %lu kB", &value) == 1)
+      s->total = (size_t)value * 1024lu;
+    else if(sscanf(line, "MemAvailable: %lu kB", &value) == 1)
+      s->available = (size_t)value * 1024lu;
+  }
+  fclose(f);
+
+  // pressure stall information, kernels >= 4.20 built with CONFIG_PSI
+  f = g_fopen("/proc/pressure/memory", "rb");
+  if(f)
+  {
+    while(fgets(line, sizeof(line), f))
+    {
+      float avg10 = 0.f;
+      if(sscanf(line, "some avg10=%f", &avg10) == 1)
+        s->some = avg10;
+      else if(sscanf(line, "full avg10=%f", &avg10) == 1)
+        s->full = avg10;
+    }
+    fclose(f);
+  }
+
+  return s->total > 0 && s->available > 0;
+}
+#else
+static gboolean _sample(dt_memgov_sample_t *s)
+{
+  return FALSE;
+}
+#endif
+
+// shrink fast, grow slowly, with some hysteresis between the two so flushing our own caches
+// doesn't make the scale oscillate
+static int _next_scale(const int scale, const dt_memgov_sample_t *s)
+{
+  const double free_ratio = (double)s->available / (double)s->total;
+  if(free_ratio < 0.05 || s->full > 5.f)
+    return MAX(scale / 2, DT_MEMGOV_SCALE_MIN);
+  if(free_ratio < 0.10 || s->some > 10.f)
+    return MAX(scale * 4 / 5, DT_MEMGOV_SCALE_MIN);
+  if(free_ratio > 0.25 && s->some < 1.f)
+    return MIN(scale + DT_MEMGOV_SCALE_STEP, DT_MEMGOV_SCALE_MAX);
+  return scale;
+}
+
+static inline size_t _scaled(const size_t nominal, const int scale)
+{
+  return nominal / DT_MEMGOV_SCALE_MAX * scale;
+}
+
+// called with the lock held
+static void _apply(const int scale)
+{
+  for(GList *l = _memgov.consumers; l; l = g_list_next(l))
+  {
+    dt_memgov_consumer_t *c = (dt_memgov_consumer_t *)l->data;
+    c->apply(c->data, _scaled(c->nominal, scale));
+  }
+}
+
+static gpointer _memgov_run(gpointer data)
+{
+  dt_memgov_t *g = (dt_memgov_t *)data;
+
+  g_mutex_lock(&g->lock);
+  while(!g->stop)
+  {
+    g_cond_wait_until(&g->cond, &g->lock, g_get_monotonic_time() + DT_MEMGOV_PERIOD);
+    if(g->stop) break;
+
+    dt_memgov_sample_t s;
+    if(!_sample(&s)) continue;
+
+    const int scale = g_atomic_int_get(&g->scale);
+    const int next = _next_scale(scale, &s);
+    if(next == scale) continue;
+
+    dt_print(DT_DEBUG_MEMORY, "[memgov] %zu MB available, pressure %.1f%% / %.1f%%: caches scaled to %.1f%%\n",
+             s.available >> 20, s.some, s.full, next / 10.f);
+    g_atomic_int_set(&g->scale, next);
+    _apply(next);
+  }
+  g_mutex_unlock(&g->lock);
+  return NULL;
+}
+
+void dt_memgov_init(void)
+{
+  g_mutex_init(&_memgov.lock);
+  g_cond_init(&_memgov.cond);
+
+  dt_memgov_sample_t s;
+  if(dt_conf_get_bool("memory_governor") && _sample(&s))
+    _memgov.thread = g_thread_new("memgov", _memgov_run, &_memgov);
+}
+
+void dt_memgov_cleanup(void)
+{
+  g_mutex_lock(&_memgov.lock);
+  _memgov.stop = TRUE;
+  g_cond_broadcast(&_memgov.cond);
+  g_mutex_unlock(&_memgov.lock);
+  if(_memgov.thread) g_thread_join(_memgov.thread);
+  _memgov.thread = NULL;
+
+  g_list_free_full(_memgov.consumers, g_free);
+  _memgov.consumers = NULL;
+  g_cond_clear(&_memgov.cond);
+  g_mutex_clear(&_memgov.lock);
+}
+
+void dt_memgov_register(const char *name, const size_t nominal, dt_memgov_apply_t apply, void *data)
+{
+  dt_memgov_consumer_t *c = g_malloc(sizeof(dt_memgov_consumer_t));
+  c->name = name;
+  c->nominal = nominal;
+  c->apply = apply;
+  c->data = data;
+
+  g_mutex_lock(&_memgov.lock);
+  _memgov.consumers = g_list_prepend(_memgov.consumers, c);
+  const int scale = g_atomic_int_get(&_memgov.scale);
+  if(scale != DT_MEMGOV_SCALE_MAX) apply(data, _scaled(nominal, scale));
+  g_mutex_unlock(&_memgov.lock);
+
+  dt_print(DT_DEBUG_MEMORY, "[memgov] %s: nominal budget %zu MB\n", name, nominal >> 20);
+}
+
+size_t dt_memgov_budget(const size_t nominal)
+{
+  return _scaled(nominal, g_atomic_int_get(&_memgov.scale));
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
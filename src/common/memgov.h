@@ -0,0 +1,57 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Memory governor.
+ *
+ * The mipmap cache, the pixelpipe cache and the tiling each size themselves once from the
+ * resource level, so under memory pressure from other applications nothing adapts until
+ * allocations fail. When the `memory_governor' config key is set, a background thread polls
+ * the memory available to the system and, on Linux, the pressure stall information, and
+ * derives a scale of the nominal budgets:
+ * - it shrinks quickly when available memory runs low or tasks stall on memory,
+ * - it grows back slowly once the pressure is gone, never above the nominal budgets.
+ *
+ * Caches register their nominal budget and get called back with the scaled one. The tiling
+ * and the number of parallel export pipes get it through dt_get_available_mem().
+ */
+
+typedef void (*dt_memgov_apply_t)(void *data, const size_t budget);
+
+/** read the config and start polling. call once after dt_conf_init(). */
+void dt_memgov_init(void);
+
+/** stop polling and forget the consumers. call before they are cleaned up. */
+void dt_memgov_cleanup(void);
+
+/** register a cache of nominal budget bytes. apply() is called from the governor thread with
+ *  the scaled budget each time the scale changes, it must not call back into the governor. */
+void dt_memgov_register(const char *name, const size_t nominal, dt_memgov_apply_t apply, void *data);
+
+/** nominal budget scaled to the current memory pressure, unchanged when the governor is off. */
+size_t dt_memgov_budget(const size_t nominal);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,163 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/memstat.h"
+
+#include <string.h>
+
+static __thread dt_memstat_scope_t *_scope = NULL;
+
+// session maxima, keyed by "pipe" for runs, "pipe/module" for modules
+static GMutex _records_lock;
+static GHashTable *_records = NULL;
+
+static inline void _merge(dt_memstat_t *to, const dt_memstat_t *from, const gboolean sum)
+{
+  for(int k = 0; k < DT_MEMSTAT_LAST; k++)
+    to->bytes[k] = sum ? to->bytes[k] + from->bytes[k] : MAX(to->bytes[k], from->bytes[k]);
+  to->host_peak = MAX(to->host_peak, from->host_peak);
+  to->device_peak = MAX(to->device_peak, from->device_peak);
+  to->device_added = MAX(to->device_added, from->device_added);
+}
+
+void dt_memstat_begin(dt_memstat_scope_t *scope)
+{
+  memset(scope, 0, sizeof(dt_memstat_scope_t));
+  _scope = scope;
+}
+
+void dt_memstat_end(void)
+{
+  _scope = NULL;
+}
+
+gboolean dt_memstat_active(void)
+{
+  return _scope != NULL;
+}
+
+void dt_memstat_module_begin(const size_t input_bytes)
+{
+  dt_memstat_scope_t *scope = _scope;
+  if(!scope) return;
+  memset(&scope->module, 0, sizeof(dt_memstat_t));
+  scope->host_in_use = input_bytes;
+  scope->module.host_peak = input_bytes;
+  scope->module.device_peak = MAX(scope->device_in_use, 0);
+  scope->device_base = scope->device_in_use;
+}
+
+const dt_memstat_t *dt_memstat_module_end(void)
+{
+  dt_memstat_scope_t *scope = _scope;
+  if(!scope) return NULL;
+  _merge(&scope->run, &scope->module, TRUE);
+  // the scratch buffers are gone, the rest belongs to the next module or to the cache
+  scope->host_in_use = 0;
+  return &scope->module;
+}
+
+void dt_memstat_alloc(const dt_memstat_kind_t kind, const size_t bytes)
+{
+  dt_memstat_scope_t *scope = _scope;
+  if(!scope) return;
+  scope->module.bytes[kind] += bytes;
+  if(kind == DT_MEMSTAT_DEVICE)
+  {
+    scope->device_in_use += bytes;
+    scope->module.device_peak = MAX(scope->module.device_peak, scope->device_in_use);
+    scope->module.device_added
+        = MAX((int64_t)scope->module.device_added, scope->device_in_use - scope->device_base);
+  }
+  else
+  {
+    scope->host_in_use += bytes;
+    scope->module.host_peak = MAX(scope->module.host_peak, scope->host_in_use);
+  }
+}
+
+void dt_memstat_free(const dt_memstat_kind_t kind, const size_t bytes)
+{
+  dt_memstat_scope_t *scope = _scope;
+  if(!scope) return;
+  // buffers may come from before the run
+  if(kind == DT_MEMSTAT_DEVICE)
+    scope->device_in_use = MAX(scope->device_in_use - (int64_t)bytes, 0);
+  else
+    scope->host_in_use = MAX(scope->host_in_use - (int64_t)bytes, 0);
+}
+
+void dt_memstat_record(const char *pipe, const char *module, const dt_memstat_t *stats)
+{
+  gchar *key = module ? g_strdup_printf("%s/%s", pipe, module) : g_strdup(pipe);
+
+  g_mutex_lock(&_records_lock);
+  if(!_records) _records = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  dt_memstat_t *record = g_hash_table_lookup(_records, key);
+  if(record)
+    g_free(key);
+  else
+  {
+    record = g_malloc0(sizeof(dt_memstat_t));
+    g_hash_table_insert(_records, key, record);
+  }
+  _merge(record, stats, FALSE);
+  g_mutex_unlock(&_records_lock);
+}
+
+void dt_memstat_foreach(dt_memstat_callback_t callback, void *user_data)
+{
+  g_mutex_lock(&_records_lock);
+  if(_records)
+  {
+    for(int pass = 0; pass < 2; pass++)
+    {
+      GHashTableIter iter;
+      gpointer key, value;
+      g_hash_table_iter_init(&iter, _records);
+      while(g_hash_table_iter_next(&iter, &key, &value))
+      {
+        const char *slash = strchr((const char *)key, '/');
+        if((pass == 0) != (slash == NULL)) continue;
+        if(slash)
+        {
+          gchar *pipe = g_strndup(key, slash - (const char *)key);
+          callback(pipe, slash + 1, value, user_data);
+          g_free(pipe);
+        }
+        else
+          callback(key, NULL, value, user_data);
+      }
+    }
+  }
+  g_mutex_unlock(&_records_lock);
+}
+
+void dt_memstat_cleanup(void)
+{
+  g_mutex_lock(&_records_lock);
+  if(_records) g_hash_table_destroy(_records);
+  _records = NULL;
+  g_mutex_unlock(&_records_lock);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
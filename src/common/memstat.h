@@ -0,0 +1,95 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Memory accounting of the pixelpipes, per run and per module.
+ *
+ * A pipe opens a scope on its thread for the duration of a run, allocations made from that thread while the
+ * scope is open are accounted to it and to the module being processed:
+ *  - cache: the cache line reserved for the output of the module,
+ *  - tiling: the host buffers of the tiles,
+ *  - scratch: the buffers of dt_iop_alloc_image_buffers(), released by the module before it returns,
+ *  - device: the OpenCL images and buffers.
+ * The host peak of a module is its working set: input, output, tiles and scratch. The device peak is the
+ * high-water mark of the device buffers the run allocated and didn't release yet, device_added the part of
+ * it the module allocated itself.
+ */
+
+typedef enum dt_memstat_kind_t
+{
+  DT_MEMSTAT_CACHE = 0,
+  DT_MEMSTAT_TILING,
+  DT_MEMSTAT_SCRATCH,
+  DT_MEMSTAT_DEVICE,
+  DT_MEMSTAT_LAST
+} dt_memstat_kind_t;
+
+typedef struct dt_memstat_t
+{
+  size_t bytes[DT_MEMSTAT_LAST]; // allocated, by kind
+  size_t host_peak;
+  size_t device_peak;
+  size_t device_added;
+} dt_memstat_t;
+
+typedef struct dt_memstat_scope_t
+{
+  dt_memstat_t run;    // whole run of the pipe
+  dt_memstat_t module; // module being processed
+  int64_t host_in_use;
+  int64_t device_in_use;
+  int64_t device_base; // in use when the module started
+} dt_memstat_scope_t;
+
+/** open the scope of a pipe run on this thread, until dt_memstat_end() */
+void dt_memstat_begin(dt_memstat_scope_t *scope);
+void dt_memstat_end(void);
+
+/** start accounting a module, whose input buffer is already in use */
+void dt_memstat_module_begin(const size_t input_bytes);
+/** add the module to the run, returns its accounting or NULL if no scope is open */
+const dt_memstat_t *dt_memstat_module_end(void);
+
+/** account an allocation to the scope open on this thread, no-op if none is */
+void dt_memstat_alloc(const dt_memstat_kind_t kind, const size_t bytes);
+void dt_memstat_free(const dt_memstat_kind_t kind, const size_t bytes);
+
+/** true if a scope is open on this thread, to skip the computation of sizes */
+gboolean dt_memstat_active(void);
+
+/** keep the highest values seen in this session, module is NULL for a whole run */
+void dt_memstat_record(const char *pipe, const char *module, const dt_memstat_t *stats);
+
+typedef void (*dt_memstat_callback_t)(const char *pipe, const char *module, const dt_memstat_t *stats,
+                                      void *user_data);
+
+/** call back for every record of the session, runs first, under a lock: don't call dt_memstat_record() */
+void dt_memstat_foreach(dt_memstat_callback_t callback, void *user_data);
+
+void dt_memstat_cleanup(void);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -25,7 +25,12 @@
 #include "common/image_cache.h"
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
+#ifdef HAVE_LIBHEIF
+#include "common/imageio_heif.h"
+#endif
 #include "common/imageio_module.h"
+#include "common/mipmap_pack.h"
+#include "common/mipmap_zcache.h"
 #include "control/conf.h"
 #include "control/jobs.h"
 #include "develop/imageop_math.h"
@@ -315,13 +320,41 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   struct dt_mipmap_buffer_dsc *dsc = entry->data;
   const dt_mipmap_size_t mip = get_size(entry->key);
 
+  // raw thumbnails of the pack are used in place: the entry points into the mapping
+  if(!dsc && mip < DT_MIPMAP_F && cache->pack)
+  {
+    size_t length = 0;
+    struct dt_mipmap_buffer_dsc *mapped = dt_mipmap_pack_borrow(cache->pack, mip, entry->key, &length);
+    if(mapped && length >= sizeof(*mapped) && mapped->size == length && mapped->flags == 0
+       && mapped->width <= cache->max_width[mip] && mapped->height <= cache->max_height[mip]
+       && length == sizeof(*mapped) + (size_t)mapped->width * mapped->height * 4)
+    {
+      dt_print(DT_DEBUG_CACHE, "[mipmap_cache] map mip %d for image %" PRIu32 " from pack\n", mip,
+               get_imgid(entry->key));
+      entry->data = mapped;
+      entry->data_size = length;
+      entry->cost = cache->buffer_size[mip];
+      return;
+    }
+    if(mapped)
+    {
+      dt_mipmap_pack_release(cache->pack, mip, mapped);
+      dt_mipmap_pack_remove(cache->pack, mip, entry->key);
+    }
+  }
+
   // alloc mere minimum for the header + broken image buffer:
   if(!dsc)
   {
+    int32_t max_width = 0, max_height = 0;
     if(mip <= DT_MIPMAP_F)
     {
-      // these are fixed-size:
-      entry->data_size = cache->buffer_size[mip];
+      // these are fixed-size, but for DT_MIPMAP_F which follows dt_mipmap_cache_set_f_size(): read it once
+      max_width = cache->max_width[mip];
+      max_height = cache->max_height[mip];
+      entry->data_size = (mip == DT_MIPMAP_F)
+                             ? sizeof(*dsc) + 4 * sizeof(float) * (size_t)max_width * max_height
+                             : cache->buffer_size[mip];
     }
     else
     {
@@ -341,8 +374,8 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
 
     if(mip <= DT_MIPMAP_F)
     {
-      dsc->width = cache->max_width[mip];
-      dsc->height = cache->max_height[mip];
+      dsc->width = max_width;
+      dsc->height = max_height;
       dsc->iscale = 1.0f;
       dsc->size = entry->data_size;
       dsc->color_space = DT_COLORSPACE_NONE;
@@ -360,7 +393,25 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   assert(dsc->size >= sizeof(*dsc));
 
   int loaded_from_disk = 0;
-  if(mip < DT_MIPMAP_F)
+  if(mip < DT_MIPMAP_F && cache->pack)
+  {
+    uint32_t width = 0, height = 0;
+    dt_colorspaces_color_profile_type_t color_space = DT_COLORSPACE_NONE;
+    if(!dt_mipmap_pack_read(cache->pack, mip, entry->key, (uint8_t *)entry->data + sizeof(*dsc),
+                            cache->max_width[mip], cache->max_height[mip], &width, &height, &color_space))
+    {
+      dt_print(DT_DEBUG_CACHE, "[mipmap_cache] grab mip %d for image %" PRIu32 " from pack\n", mip,
+               get_imgid(entry->key));
+      dsc->width = width;
+      dsc->height = height;
+      dsc->iscale = 1.0f;
+      dsc->color_space = color_space;
+      loaded_from_disk = 1;
+    }
+  }
+
+  // jpeg files are still read with the pack enabled, so existing thumbnails migrate to it on eviction
+  if(mip < DT_MIPMAP_F && !loaded_from_disk)
   {
     if(cache->cachedir[0] && (dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_F))
     {
@@ -434,6 +485,28 @@ static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data, int32_t imgid, d
     snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, imgid);
     g_unlink(filename);
   }
+  if(cache->pack) dt_mipmap_pack_remove(cache->pack, mip, get_key(imgid, mip));
+}
+
+// writes the 8-bit buffer following dsc to the pack, under key
+static void _pack_store(dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip, const uint32_t key,
+                        const struct dt_mipmap_buffer_dsc *dsc)
+{
+  if(mip >= cache->pack_raw_mip)
+  {
+    // store the buffer as we'll map it back
+    struct dt_mipmap_buffer_dsc header = *dsc;
+    header.size = sizeof(header) + (size_t)dsc->width * dsc->height * 4;
+    header.flags = DT_MIPMAP_BUFFER_DSC_FLAG_NONE;
+    dt_mipmap_pack_write_raw(cache->pack, mip, key, &header, sizeof(header), (const uint8_t *)(dsc + 1),
+                             dsc->width, dsc->height, dsc->color_space);
+  }
+  else
+  {
+    const int cache_quality = dt_conf_get_int("database_cache_quality");
+    dt_mipmap_pack_write(cache->pack, mip, key, (const uint8_t *)(dsc + 1), dsc->width, dsc->height,
+                         dsc->color_space, MIN(100, MAX(10, cache_quality)));
+  }
 }
 
 void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
@@ -450,6 +523,10 @@ void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
       {
         dt_mipmap_cache_unlink_ondisk_thumbnail(data, get_imgid(entry->key), mip);
       }
+      else if(cache->pack)
+      {
+        _pack_store(cache, mip, entry->key, dsc);
+      }
       else if(cache->cachedir[0] && (dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_F))
       {
         // serialize to disk
@@ -505,7 +582,16 @@ write_error:
       }
     }
   }
-  dt_free_align(entry->data);
+  else if(mip == DT_MIPMAP_FULL && cache->zcache && (void *)entry->data != (void *)dt_mipmap_cache_static_dead_image)
+  {
+    struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+    if(dsc->width > 0 && dsc->height > 0 && !(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE))
+      dt_mipmap_zcache_store(cache->zcache, get_imgid(entry->key), dsc + 1, dsc->size - sizeof(*dsc),
+                             dsc->color_space);
+  }
+  // mapped raw thumbnails are given back to the pack instead
+  if(!(mip < DT_MIPMAP_F && cache->pack && dt_mipmap_pack_release(cache->pack, mip, entry->data)))
+    dt_free_align(entry->data);
 }
 
 static uint32_t nearest_power_of_two(const uint32_t value)
@@ -518,6 +604,23 @@ static uint32_t nearest_power_of_two(const uint32_t value)
 void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
 {
   dt_mipmap_cache_get_filename(cache->cachedir, sizeof(cache->cachedir));
+
+  cache->pack = NULL;
+  cache->pack_raw_mip = CLAMPS(dt_conf_get_int("cache_disk_backend_pack_raw"), DT_MIPMAP_0, DT_MIPMAP_F);
+  if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend") && dt_conf_get_bool("cache_disk_backend_pack"))
+  {
+    char path[PATH_MAX] = { 0 };
+    snprintf(path, sizeof(path), "%s.pack", cache->cachedir);
+    cache->pack = calloc(1, sizeof(dt_mipmap_pack_t));
+    if(cache->pack && !dt_mipmap_pack_init(cache->pack, path))
+    {
+      // fall back to jpeg files
+      dt_mipmap_pack_cleanup(cache->pack);
+      free(cache->pack);
+      cache->pack = NULL;
+    }
+  }
+
   // make sure static memory is initialized
   struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)dt_mipmap_cache_static_dead_image;
   dead_image_f((dt_mipmap_buffer_t *)(dsc + 1));
@@ -536,8 +639,8 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
     { 4096, 2560 },           // mip6 - covers 4K and UHD
     { 5120, 3200 },           // mip7 - covers 5120x2880 panels
   };
-  // Set mipf to mip2 size as at most the user will be using an 8K screen and
-  // have a preview that's ~4x smaller
+  // Start mipf at mip2 size, the darkroom then fits it to the widgets showing the preview
+  // through dt_mipmap_cache_set_f_size()
   cache->max_width[DT_MIPMAP_F] = mipsizes[DT_MIPMAP_2][0];
   cache->max_height[DT_MIPMAP_F] = mipsizes[DT_MIPMAP_2][1];
   for(int k = DT_MIPMAP_F-1; k >= 0; k--)
@@ -567,7 +670,7 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->mip_full.stats_fetches = 0;
   cache->mip_full.stats_standin = 0;
 
-  dt_cache_init(&cache->mip_thumbs.cache, 0, max_mem);
+  dt_cache_init(&cache->mip_thumbs.cache, 0, max_mem, darktable.num_openmp_threads);
   dt_cache_set_allocate_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_allocate_dynamic, cache);
   dt_cache_set_cleanup_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_deallocate_dynamic, cache);
 
@@ -576,14 +679,18 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   const int full_entries = 2 * dt_worker_threads();
   const int32_t max_mem_bufs = nearest_power_of_two(full_entries);
 
-  // for this buffer, because it can be very busy during import
-  dt_cache_init(&cache->mip_full.cache, 0, max_mem_bufs);
+  // for this buffer, because it can be very busy during import.
+  // The quota counts slots, not bytes: don't shard, it would split a handful of slots.
+  dt_cache_init(&cache->mip_full.cache, 0, max_mem_bufs, 1);
+  const size_t zcache_budget = (size_t)MAX(dt_conf_get_int("cache_memory_compressed_full"), 0) << 20;
+  cache->zcache = zcache_budget ? calloc(1, sizeof(dt_mipmap_zcache_t)) : NULL;
+  if(cache->zcache) dt_mipmap_zcache_init(cache->zcache, zcache_budget);
   dt_cache_set_allocate_callback(&cache->mip_full.cache, dt_mipmap_cache_allocate_dynamic, cache);
   dt_cache_set_cleanup_callback(&cache->mip_full.cache, dt_mipmap_cache_deallocate_dynamic, cache);
   cache->buffer_size[DT_MIPMAP_FULL] = 0;
 
   // same for mipf:
-  dt_cache_init(&cache->mip_f.cache, 0, max_mem_bufs);
+  dt_cache_init(&cache->mip_f.cache, 0, max_mem_bufs, 1);
   dt_cache_set_allocate_callback(&cache->mip_f.cache, dt_mipmap_cache_allocate_dynamic, cache);
   dt_cache_set_cleanup_callback(&cache->mip_f.cache, dt_mipmap_cache_deallocate_dynamic, cache);
   cache->buffer_size[DT_MIPMAP_F] = sizeof(struct dt_mipmap_buffer_dsc)
@@ -591,25 +698,64 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
                                           * cache->max_height[DT_MIPMAP_F];
 }
 
+gboolean dt_mipmap_cache_set_f_size(dt_mipmap_cache_t *cache, const int32_t width, const int32_t height)
+{
+  // step through the thumbnail sizes, so the buffers are not regenerated for every pixel of resizing
+  const dt_mipmap_size_t mip = CLAMPS(dt_mipmap_cache_get_matching_size(cache, width, height), DT_MIPMAP_1,
+                                      DT_MIPMAP_5);
+  if(cache->max_width[DT_MIPMAP_F] == cache->max_width[mip]
+     && cache->max_height[DT_MIPMAP_F] == cache->max_height[mip])
+    return FALSE;
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_cache] preview buffers resized to %i×%i px for %i×%i px
+",
+           cache->max_width[mip], cache->max_height[mip], width, height);
+  cache->max_width[DT_MIPMAP_F] = cache->max_width[mip];
+  cache->max_height[DT_MIPMAP_F] = cache->max_height[mip];
+  cache->buffer_size[DT_MIPMAP_F] = sizeof(struct dt_mipmap_buffer_dsc)
+                                    + 4 * sizeof(float) * cache->max_width[DT_MIPMAP_F]
+                                      * cache->max_height[DT_MIPMAP_F];
+  return TRUE;
+}
+
 void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
 {
+  // nothing to keep the full buffers for anymore
+  if(cache->zcache)
+  {
+    dt_mipmap_zcache_cleanup(cache->zcache);
+    free(cache->zcache);
+    cache->zcache = NULL;
+  }
+
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+
+  // after the thumbnails cache, which flushes its content to the pack
+  if(cache->pack)
+  {
+    dt_mipmap_pack_cleanup(cache->pack);
+    free(cache->pack);
+    cache->pack = NULL;
+  }
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
 {
+  const size_t thumbs_cost = dt_cache_get_cost(&cache->mip_thumbs.cache);
+  const size_t f_cost = dt_cache_get_cost(&cache->mip_f.cache);
+  const size_t full_cost = dt_cache_get_cost(&cache->mip_full.cache);
   printf("[mipmap_cache] thumbs fill %.2f/%.2f MB (%.2f%%)\n",
-         cache->mip_thumbs.cache.cost / (1024.0 * 1024.0),
+         thumbs_cost / (1024.0 * 1024.0),
          cache->mip_thumbs.cache.cost_quota / (1024.0 * 1024.0),
-         100.0f * (float)cache->mip_thumbs.cache.cost / (float)cache->mip_thumbs.cache.cost_quota);
+         100.0f * (float)thumbs_cost / (float)cache->mip_thumbs.cache.cost_quota);
   printf("[mipmap_cache] float fill %"PRIu32"/%"PRIu32" slots (%.2f%%)\n",
-         (uint32_t)cache->mip_f.cache.cost, (uint32_t)cache->mip_f.cache.cost_quota,
-         100.0f * (float)cache->mip_f.cache.cost / (float)cache->mip_f.cache.cost_quota);
+         (uint32_t)f_cost, (uint32_t)cache->mip_f.cache.cost_quota,
+         100.0f * (float)f_cost / (float)cache->mip_f.cache.cost_quota);
   printf("[mipmap_cache] full  fill %"PRIu32"/%"PRIu32" slots (%.2f%%)\n",
-         (uint32_t)cache->mip_full.cache.cost, (uint32_t)cache->mip_full.cache.cost_quota,
-         100.0f * (float)cache->mip_full.cache.cost / (float)cache->mip_full.cache.cost_quota);
+         (uint32_t)full_cost, (uint32_t)cache->mip_full.cache.cost_quota,
+         100.0f * (float)full_cost / (float)cache->mip_full.cache.cost_quota);
 
   uint64_t sum = 0;
   uint64_t sum_fetches = 0;
@@ -664,6 +810,39 @@ static dt_mipmap_cache_one_t *_get_cache(dt_mipmap_cache_t *cache, const dt_mipm
   }
 }
 
+// fill buf from a cache entry locked without blocking, or set it to NULL if there is none
+static void _buffer_from_entry(dt_mipmap_buffer_t *buf, dt_cache_entry_t *entry, const int32_t imgid,
+                               const dt_mipmap_size_t mip)
+{
+  buf->cache_entry = entry;
+  if(entry)
+  {
+    ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
+    struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+    buf->width = dsc->width;
+    buf->height = dsc->height;
+    buf->iscale = dsc->iscale;
+    buf->color_space = dsc->color_space;
+    buf->imgid = imgid;
+    buf->size = mip;
+
+    // skip to next 8-byte alignment, for sse buffers.
+    buf->buf = (uint8_t *)(dsc + 1);
+
+    ASAN_UNPOISON_MEMORY_REGION(buf->buf, dsc->size - sizeof(struct dt_mipmap_buffer_dsc));
+  }
+  else
+  {
+    // set to NULL if failed.
+    buf->width = buf->height = 0;
+    buf->iscale = 0.0f;
+    buf->imgid = UNKNOWN_IMAGE;
+    buf->color_space = DT_COLORSPACE_NONE;
+    buf->size = DT_MIPMAP_NONE;
+    buf->buf = NULL;
+  }
+}
+
 void dt_mipmap_cache_get_with_caller(
     dt_mipmap_cache_t *cache,
     dt_mipmap_buffer_t *buf,
@@ -680,39 +859,12 @@ void dt_mipmap_cache_get_with_caller(
   if(flags == DT_MIPMAP_TESTLOCK)
   {
     // simple case: only get and lock if it's there.
-    dt_cache_entry_t *entry = dt_cache_testget(&_get_cache(cache, mip)->cache, key, mode);
-    buf->cache_entry = entry;
-    if(entry)
-    {
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
-      struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
-      buf->width = dsc->width;
-      buf->height = dsc->height;
-      buf->iscale = dsc->iscale;
-      buf->color_space = dsc->color_space;
-      buf->imgid = imgid;
-      buf->size = mip;
-
-      // skip to next 8-byte alignment, for sse buffers.
-      buf->buf = (uint8_t *)(dsc + 1);
-
-      ASAN_UNPOISON_MEMORY_REGION(buf->buf, dsc->size - sizeof(struct dt_mipmap_buffer_dsc));
-    }
-    else
-    {
-      // set to NULL if failed.
-      buf->width = buf->height = 0;
-      buf->iscale = 0.0f;
-      buf->imgid = UNKNOWN_IMAGE;
-      buf->color_space = DT_COLORSPACE_NONE;
-      buf->size = DT_MIPMAP_NONE;
-      buf->buf = NULL;
-    }
+    _buffer_from_entry(buf, dt_cache_testget(&_get_cache(cache, mip)->cache, key, mode), imgid, mip);
   }
   else if(flags == DT_MIPMAP_PREFETCH)
   {
     // and opposite: prefetch without locking
-    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
+    dt_image_load_request(imgid, mip);
   }
   else if(flags == DT_MIPMAP_PREFETCH_DISK)
   {
@@ -722,8 +874,8 @@ void dt_mipmap_cache_get_with_caller(
     // load from disk if file exists
     char filename[PATH_MAX] = {0};
     snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, (uint32_t)key);
-    if(g_file_test(filename, G_FILE_TEST_EXISTS))
-      dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
+    if((cache->pack && dt_mipmap_pack_contains(cache->pack, mip, key)) || g_file_test(filename, G_FILE_TEST_EXISTS))
+      dt_image_load_request(imgid, mip);
     else
       return;
   }
@@ -772,7 +924,11 @@ void dt_mipmap_cache_get_with_caller(
         buf->width = buf->height = 0;
         buf->iscale = 0.0f;
         buf->color_space = DT_COLORSPACE_NONE; // TODO: does the full buffer need to know this?
-        dt_imageio_retval_t ret = dt_imageio_open(&buffered_image, filename, buf); // TODO: color_space?
+        // evicted earlier and kept compressed: the image cache already knows what the decoder found
+        const gboolean restored
+            = cache->zcache && dt_mipmap_zcache_restore(cache->zcache, buf, &buffered_image, filename);
+        const dt_imageio_retval_t ret
+            = restored ? DT_IMAGEIO_OK : dt_imageio_open(&buffered_image, filename, buf); // TODO: color_space?
         // might have been reallocated:
         ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
         dsc = (struct dt_mipmap_buffer_dsc *)buf->cache_entry->data;
@@ -790,7 +946,7 @@ void dt_mipmap_cache_get_with_caller(
             dsc->color_space = DT_COLORSPACE_NONE;
           }
         }
-        else
+        else if(!restored)
         {
           // swap back new image data:
           dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'w');
@@ -914,7 +1070,8 @@ void dt_mipmap_cache_get_with_caller(
     {
       char filename[PATH_MAX] = {0};
       snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip, (uint32_t)key);
-      if(g_file_test(filename, G_FILE_TEST_EXISTS))
+      if((cache->pack && dt_mipmap_pack_contains(cache->pack, mip, key))
+         || g_file_test(filename, G_FILE_TEST_EXISTS))
       {
         dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
         return;
@@ -930,6 +1087,70 @@ void dt_mipmap_cache_get_with_caller(
   }
 }
 
+int dt_mipmap_cache_get_batch(dt_mipmap_cache_t *cache, dt_mipmap_buffer_t *bufs, const int32_t *imgids,
+                              const int count, const dt_mipmap_size_t mip)
+{
+  assert(mip < DT_MIPMAP_F && mip >= DT_MIPMAP_0);
+  if(count <= 0) return 0;
+
+  uint32_t *keys = g_malloc_n(count, sizeof(uint32_t));
+  int *index = g_malloc_n(count, sizeof(int));
+  dt_cache_entry_t **entries = g_malloc_n(count, sizeof(dt_cache_entry_t *));
+  int32_t *misses = g_malloc_n(count, sizeof(int32_t));
+
+  for(int i = 0; i < count; i++) _buffer_from_entry(&bufs[i], NULL, imgids[i], mip);
+
+  dt_mipmap_cache_one_t *one = _get_cache(cache, mip);
+  __sync_fetch_and_add(&one->stats_requests, count);
+
+  // same order as DT_MIPMAP_BEST_EFFORT: the requested size, larger ones, then smaller ones.
+  // Each size is looked up for all the images still missing at once.
+  int hits = 0, missing = 0, found = 0;
+  for(int step = 0; step < DT_MIPMAP_F && found < count; step++)
+  {
+    const int k = (step <= DT_MIPMAP_F - 1 - mip) ? mip + step : DT_MIPMAP_F - 1 - step;
+
+    int n = 0;
+    for(int i = 0; i < count; i++)
+      if(!bufs[i].cache_entry && imgids[i] > 0)
+      {
+        keys[n] = get_key(imgids[i], k);
+        index[n++] = i;
+      }
+    if(n == 0) break;
+
+    dt_cache_testget_batch(&_get_cache(cache, k)->cache, keys, n, 'r', entries);
+    for(int j = 0; j < n; j++)
+    {
+      dt_mipmap_buffer_t *buf = &bufs[index[j]];
+      _buffer_from_entry(buf, entries[j], imgids[index[j]], k);
+      if(!entries[j]) continue;
+      if(buf->buf && buf->width > 0 && buf->height > 0)
+      {
+        found++;
+        if(k == mip) hits++;
+        else __sync_fetch_and_add((k > mip) ? &one->stats_standin : &one->stats_near_match, 1);
+      }
+      else
+        dt_mipmap_cache_release(cache, buf);
+    }
+
+    if(k == mip)
+      for(int i = 0; i < count; i++)
+        if(!bufs[i].cache_entry && imgids[i] > 0) misses[missing++] = imgids[i];
+  }
+  __sync_fetch_and_add(&one->stats_misses, count - found);
+
+  // all the misses in a single job, instead of one per image
+  dt_image_load_batch_request(misses, missing, mip);
+
+  g_free(keys);
+  g_free(index);
+  g_free(entries);
+  g_free(misses);
+  return hits;
+}
+
 void dt_mipmap_cache_write_get_with_caller(dt_mipmap_cache_t *cache, dt_mipmap_buffer_t *buf, const int32_t imgid, const int mip, const char *file, int line)
 {
   dt_mipmap_cache_get_with_caller(cache, buf, imgid, mip, DT_MIPMAP_BLOCKING, 'w', file, line);
@@ -980,8 +1201,28 @@ dt_mipmap_size_t dt_mipmap_cache_get_min_mip_from_pref(const char *value)
   return DT_MIPMAP_NONE;
 }
 
+void dt_mipmap_cache_keep_full(dt_mipmap_cache_t *cache, const int32_t imgid)
+{
+  if(!cache->zcache) return;
+
+  char filename[PATH_MAX] = { 0 };
+  gboolean from_cache = TRUE;
+  dt_image_full_path(imgid, filename, sizeof(filename), &from_cache, __FUNCTION__);
+
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  if(!img) return;
+  dt_mipmap_zcache_note(cache->zcache, img, filename);
+  dt_image_cache_read_release(darktable.image_cache, img);
+}
+
 void dt_mipmap_cache_remove_at_size(dt_mipmap_cache_t *cache, const int32_t imgid, const dt_mipmap_size_t mip)
 {
+  if(mip == DT_MIPMAP_F)
+  {
+    // no thumbnail on disk for the float buffer, just drop it from RAM
+    dt_cache_remove(&cache->mip_f.cache, get_key(imgid, mip));
+    return;
+  }
   if(mip > DT_MIPMAP_7 || mip < DT_MIPMAP_0) return;
   // get rid of all ldr thumbnails:
   const uint32_t key = get_key(imgid, mip);
@@ -1012,6 +1253,34 @@ void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const int32_t imgid)
     dt_mipmap_cache_remove_at_size(cache, imgid, k);
   }
 }
+static int32_t _remove_list_job_run(dt_job_t *job)
+{
+  for(GList *img = dt_control_job_get_params(job); img; img = g_list_next(img))
+    dt_mipmap_cache_remove(darktable.mipmap_cache, GPOINTER_TO_INT(img->data));
+  return 0;
+}
+
+static void _remove_list_job_cleanup(void *data)
+{
+  g_list_free((GList *)data);
+}
+
+void dt_mipmap_cache_remove_list(dt_mipmap_cache_t *cache, GList *imgs)
+{
+  if(!imgs) return;
+  // ids are never reused (AUTOINCREMENT), so the thumbnails of removed images can go at any time
+  dt_job_t *job = dt_control_job_create(&_remove_list_job_run, "remove thumbnails");
+  if(!job)
+  {
+    for(GList *img = imgs; img; img = g_list_next(img))
+      dt_mipmap_cache_remove(cache, GPOINTER_TO_INT(img->data));
+    g_list_free(imgs);
+    return;
+  }
+  dt_control_job_set_params(job, imgs, _remove_list_job_cleanup);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
 void dt_mipmap_cache_evict_at_size(dt_mipmap_cache_t *cache, const int32_t imgid, const dt_mipmap_size_t mip)
 {
   const uint32_t key = get_key(imgid, mip);
@@ -1181,7 +1450,24 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
   const int incompatible = !strncmp(cimg->exif_maker, "Phase One", 9);
   dt_image_cache_read_release(darktable.image_cache, cimg);
 
-  if(!altered && !incompatible)
+  // a larger mip of the current history is already there: cheaper than decoding anything
+  for(dt_mipmap_size_t k = size + 1; k < DT_MIPMAP_F; k++)
+  {
+    dt_mipmap_buffer_t tmp;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &tmp, imgid, k, DT_MIPMAP_TESTLOCK, 'r');
+    if(!tmp.cache_entry) continue;
+    if(tmp.buf && tmp.width > 0 && tmp.height > 0)
+    {
+      dt_print(DT_DEBUG_CACHE, "[mipmap_cache] generate mip %d for image %d from level %d\n", size, imgid, k);
+      *color_space = tmp.color_space;
+      dt_iop_downsample_8(tmp.buf, tmp.width, tmp.height, buf, wd, ht, width, height);
+      res = 0;
+    }
+    dt_mipmap_cache_release(darktable.mipmap_cache, &tmp);
+    if(!res) break;
+  }
+
+  if(res && !altered && !incompatible)
   {
     const dt_image_orientation_t orientation = dt_image_get_orientation(imgid);
 
@@ -1198,6 +1484,8 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
       dt_imageio_jpeg_t jpg;
       if(!dt_imageio_jpeg_read_header(filename, &jpg))
       {
+        // no need to decode more pixels than the mip has
+        dt_imageio_jpeg_set_scale(&jpg, wd, ht);
         uint8_t *tmp = (uint8_t *)dt_alloc_align(sizeof(uint8_t) * jpg.width * jpg.height * 4);
         *color_space = dt_imageio_jpeg_read_color_space(&jpg);
         if(!dt_imageio_jpeg_read(&jpg, tmp))
@@ -1214,7 +1502,13 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     {
       uint8_t *tmp = 0;
       int32_t thumb_width, thumb_height;
-      res = dt_imageio_large_thumbnail(filename, &tmp, &thumb_width, &thumb_height, color_space);
+#ifdef HAVE_LIBHEIF
+      // HEIF thumbnails are image items of their own, exiv2 doesn't see them
+      if(!strcasecmp(c, ".heic") || !strcasecmp(c, ".heif") || !strcasecmp(c, ".hif"))
+        res = dt_imageio_heif_thumbnail(filename, &tmp, &thumb_width, &thumb_height, color_space, wd, ht);
+      else
+#endif
+      res = dt_imageio_large_thumbnail_scaled(filename, &tmp, &thumb_width, &thumb_height, color_space, wd, ht);
       if(!res)
       {
         // if the thumbnail is not large enough, we compute one
@@ -1229,7 +1523,7 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
         else
         {
           // scale to fit
-          dt_print(DT_DEBUG_CACHE, "[mipmap_cache] generate mip %d for image %d from embedded jpeg\n", size, imgid);
+          dt_print(DT_DEBUG_CACHE, "[mipmap_cache] generate mip %d for image %d from embedded thumbnail\n", size, imgid);
           dt_iop_flip_and_zoom_8(tmp, thumb_width, thumb_height, buf, wd, ht, orientation, width, height);
         }
         dt_free_align(tmp);
@@ -1237,26 +1531,6 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     }
   }
 
-  if(res)
-  {
-    //try to generate mip from larger mip
-    for(dt_mipmap_size_t k = size + 1; k < DT_MIPMAP_F; k++)
-    {
-      dt_mipmap_buffer_t tmp;
-      dt_mipmap_cache_get(darktable.mipmap_cache, &tmp, imgid, k, DT_MIPMAP_TESTLOCK, 'r');
-      if(tmp.buf == NULL)
-        continue;
-      dt_print(DT_DEBUG_CACHE, "[mipmap_cache] generate mip %d for image %d from level %d\n", size, imgid, k);
-      *color_space = tmp.color_space;
-      // downsample
-      dt_iop_flip_and_zoom_8(tmp.buf, tmp.width, tmp.height, buf, wd, ht, ORIENTATION_NONE, width, height);
-
-      dt_mipmap_cache_release(darktable.mipmap_cache, &tmp);
-      res = 0;
-      break;
-    }
-  }
-
   if(res)
   {
     // try the real thing: rawspeed + pixelpipe
@@ -1303,9 +1577,32 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
   // TODO: if output is cropped, don't use mipf!
 }
 
-void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid)
+void dt_mipmap_cache_copy_thumbnails(dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid)
 {
-  if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
+  if(cache->pack)
+  {
+    for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
+    {
+      // the mips in memory may not have reached the pack yet, and are the most recent anyway
+      gboolean stored = FALSE;
+      dt_mipmap_buffer_t buf;
+      dt_mipmap_cache_get(cache, &buf, src_imgid, mip, DT_MIPMAP_TESTLOCK, 'r');
+      if(buf.cache_entry)
+      {
+        const struct dt_mipmap_buffer_dsc *dsc = (const struct dt_mipmap_buffer_dsc *)buf.cache_entry->data;
+        // no skulls, and nothing being generated or invalidated
+        if(dsc->width > 8 && dsc->height > 8
+           && !(dsc->flags & (DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE | DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE)))
+        {
+          _pack_store(cache, mip, get_key(dst_imgid, mip), dsc);
+          stored = TRUE;
+        }
+        dt_mipmap_cache_release(cache, &buf);
+      }
+      if(!stored) dt_mipmap_pack_copy(cache->pack, mip, get_key(dst_imgid, mip), get_key(src_imgid, mip));
+    }
+  }
+  else if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
   {
     for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
     {
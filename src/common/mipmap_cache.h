@@ -98,6 +98,9 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+  struct dt_mipmap_pack_t *pack; // packed disk backend, NULL when thumbnails are stored as one jpeg per file
+  dt_mipmap_size_t pack_raw_mip; // thumbnails of this size and larger are packed uncompressed and mapped
+  struct dt_mipmap_zcache_t *zcache; // evicted full buffers kept compressed, NULL when disabled
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -109,6 +112,11 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache);
 void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache);
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache);
 
+// size DT_MIPMAP_F, the input of the darkroom preview pipe, to the thumbnail size covering width × height
+// pixels, between DT_MIPMAP_1 and DT_MIPMAP_5. Returns TRUE if it changed. The buffers already in cache keep
+// their former size until they are removed.
+gboolean dt_mipmap_cache_set_f_size(dt_mipmap_cache_t *cache, const int32_t width, const int32_t height);
+
 // get a buffer and lock according to mode ('r' or 'w').
 // see dt_mipmap_get_flags_t for explanation of the exact
 // behaviour. pass 0 as flags for the default (best effort)
@@ -123,6 +131,13 @@ void dt_mipmap_cache_get_with_caller(
     const char *file,
     int line);
 
+// best effort get of count images displayed together, for thumbnail tables: bufs[k] gets the mip of imgids[k]
+// at the requested size if it is in cache, else the nearest one as with DT_MIPMAP_BEST_EFFORT, read locked.
+// Each size is looked up for all the images at once, and the misses at the requested size are generated by a
+// single batch of jobs. Returns the number of buffers at the requested size, all of them need to be released.
+int dt_mipmap_cache_get_batch(dt_mipmap_cache_t *cache, dt_mipmap_buffer_t *bufs, const int32_t *imgids,
+                              const int count, const dt_mipmap_size_t mip);
+
 // convenience function with fewer params
 #define dt_mipmap_cache_write_get(A,B,C,D) dt_mipmap_cache_write_get_with_caller(A,B,C,D,__FILE__,__LINE__)
 void dt_mipmap_cache_write_get_with_caller(
@@ -138,9 +153,15 @@ void dt_mipmap_cache_write_get_with_caller(
 void dt_mipmap_cache_release_with_caller(dt_mipmap_cache_t *cache, dt_mipmap_buffer_t *buf, const char *file,
                                          int line);
 
+// keep the full buffer of this image compressed in memory when it gets evicted, to open it again
+// without decoding the file. To be called after the full buffer of the image was gotten.
+void dt_mipmap_cache_keep_full(dt_mipmap_cache_t *cache, const int32_t imgid);
+
 // remove thumbnails, so they will be regenerated:
 void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const int32_t imgid);
 void dt_mipmap_cache_remove_at_size(dt_mipmap_cache_t *cache, const int32_t imgid, const dt_mipmap_size_t mip);
+// same for images removed from the library, from a background job. takes ownership of imgs
+void dt_mipmap_cache_remove_list(dt_mipmap_cache_t *cache, GList *imgs);
 
 // evict thumbnails from cache. They will be written to disc if not existing
 void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const int32_t imgid);
@@ -157,9 +178,11 @@ dt_mipmap_size_t dt_mipmap_cache_get_matching_size(
     const int32_t width,
     const int32_t height);
 
-// copy over thumbnails. used by file operation that copies raw files, to speed up thumbnail generation.
-// only copies over the jpg backend on disk, doesn't directly affect the in-memory cache.
-void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
+// copy over thumbnails. used by file operation that copies raw files and by duplicates sharing the history
+// of their source, to speed up thumbnail generation. with the pack, the mips of the source still in memory
+// are written to the pack under the new id, otherwise only the jpg backend on disk is copied.
+// doesn't directly affect the in-memory cache: dst loads the copies on its first request.
+void dt_mipmap_cache_copy_thumbnails(dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
 
 // return the mipmap corresponding to text value saved in prefs
 dt_mipmap_size_t dt_mipmap_cache_get_min_mip_from_pref(const char *value);
@@ -0,0 +1,685 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/mipmap_pack.h"
+#include "common/darktable.h"
+#include "common/imageio_jpeg.h"
+
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#if !defined(_WIN32)
+#include <sys/statvfs.h>
+#else
+//statvfs does not exist in Windows, providing implementation
+#include "win/statvfs.h"
+#endif
+
+#define DT_MIPMAP_PACK_MAGIC 0xD7AC0002
+#define DT_MIPMAP_PACK_INDEX_MAGIC 0xD7AC1D01
+// bump when the layout of the records or of the index changes
+#define DT_MIPMAP_PACK_VERSION 2
+// records start on this boundary, so raw payloads are aligned like dt_alloc_align() buffers
+#define DT_MIPMAP_PACK_ALIGN 64
+// compact on exit when dead records are more than half of the pack and at least this big
+#define DT_MIPMAP_PACK_MIN_DEAD ((size_t)16 << 20)
+
+// packs can exceed 2 GB, which plain fseek() can't address on all platforms
+#if defined(_WIN32)
+#define _pack_seek(f, offset) _fseeki64(f, (__int64)(offset), SEEK_SET)
+#else
+#define _pack_seek(f, offset) fseeko(f, (off_t)(offset), SEEK_SET)
+#endif
+
+typedef struct dt_mipmap_pack_record_t
+{
+  uint32_t magic;
+  uint32_t key;
+  uint32_t width;
+  uint32_t height;
+  int32_t color_space;
+  uint32_t length;    // bytes of jpeg following the header, 0 when the thumbnail is removed
+  uint32_t checksum;  // crc32 of the header (with checksum = 0) and of the payload
+  uint32_t flags;     // dt_mipmap_pack_flags_t
+  uint32_t reserved[8];
+} dt_mipmap_pack_record_t;
+
+// bookkeeping of a mapping of the pack, which can't be released while mipmaps point into it
+typedef struct dt_mipmap_pack_map_t
+{
+  GMappedFile *map;
+  const uint8_t *data;
+  size_t length;
+  int borrowed;       // raw payloads handed out
+} dt_mipmap_pack_map_t;
+
+// also the layout of the entries of the index file
+typedef struct dt_mipmap_pack_entry_t
+{
+  uint32_t key;
+  uint32_t length;
+  uint64_t offset;    // of the record header in the pack
+} dt_mipmap_pack_entry_t;
+
+typedef struct dt_mipmap_pack_index_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t pack_size; // the pack was this long when the index was saved
+  uint64_t dead;
+  uint64_t count;
+} dt_mipmap_pack_index_header_t;
+
+
+// header, payload and zero padding up to the next record
+static inline size_t _record_size(const uint32_t length)
+{
+  return (sizeof(dt_mipmap_pack_record_t) + length + DT_MIPMAP_PACK_ALIGN - 1) & ~((size_t)DT_MIPMAP_PACK_ALIGN - 1);
+}
+
+// the payload can come in several parts, which are concatenated
+static uint32_t _checksum(const dt_mipmap_pack_record_t *rec, const void *const *parts, const size_t *sizes,
+                          const int n)
+{
+  dt_mipmap_pack_record_t header = *rec;
+  header.checksum = 0;
+  uLong crc = crc32(0L, Z_NULL, 0);
+  crc = crc32(crc, (const Bytef *)&header, sizeof(header));
+  for(int k = 0; k < n; k++)
+    if(sizes[k]) crc = crc32(crc, (const Bytef *)parts[k], sizes[k]);
+  return (uint32_t)crc;
+}
+
+static inline uint32_t _checksum_record(const uint8_t *record)
+{
+  const dt_mipmap_pack_record_t *rec = (const dt_mipmap_pack_record_t *)record;
+  const void *payload = record + sizeof(dt_mipmap_pack_record_t);
+  const size_t length = rec->length;
+  return _checksum(rec, &payload, &length, 1);
+}
+
+static void _index_path(const dt_mipmap_pack_file_t *file, char *filename, const size_t length)
+{
+  snprintf(filename, length, "%s.idx", file->path);
+}
+
+// caller holds the lock
+static void _index_set(dt_mipmap_pack_file_t *file, const uint32_t key, const uint64_t offset,
+                       const uint32_t length)
+{
+  dt_mipmap_pack_entry_t *old = g_hash_table_lookup(file->index, GUINT_TO_POINTER(key));
+  if(old) file->dead += _record_size(old->length);
+
+  if(length == 0)
+  {
+    // the removal record itself is dead weight too
+    file->dead += _record_size(0);
+    g_hash_table_remove(file->index, GUINT_TO_POINTER(key));
+    return;
+  }
+
+  dt_mipmap_pack_entry_t *entry = old ? old : malloc(sizeof(dt_mipmap_pack_entry_t));
+  if(!entry) return;
+  entry->key = key;
+  entry->length = length;
+  entry->offset = offset;
+  if(!old) g_hash_table_insert(file->index, GUINT_TO_POINTER(key), entry);
+}
+
+static void _map_free(dt_mipmap_pack_map_t *map)
+{
+  g_mapped_file_unref(map->map);
+  free(map);
+}
+
+// drop the current mapping, or keep it in the retired ones while payloads are borrowed.
+// caller holds the lock
+static void _map_retire(dt_mipmap_pack_file_t *file)
+{
+  if(!file->map) return;
+  if(file->map->borrowed > 0)
+    file->retired = g_list_prepend(file->retired, file->map);
+  else
+    _map_free(file->map);
+  file->map = NULL;
+}
+
+// make sure the mapping covers `needed` bytes. caller holds the lock
+static gboolean _map(dt_mipmap_pack_file_t *file, const size_t needed)
+{
+  if(file->map && file->map->length >= needed) return TRUE;
+
+  if(file->f) fflush(file->f);
+  _map_retire(file);
+
+  // writable gives a private copy-on-write mapping: mipmaps pointing into it can
+  // update their header in memory, the pack on disk never changes.
+  GMappedFile *map = g_mapped_file_new(file->path, TRUE, NULL);
+  if(!map) return FALSE;
+  file->map = calloc(1, sizeof(dt_mipmap_pack_map_t));
+  if(!file->map)
+  {
+    g_mapped_file_unref(map);
+    return FALSE;
+  }
+  file->map->map = map;
+  file->map->data = (const uint8_t *)g_mapped_file_get_contents(map);
+  file->map->length = g_mapped_file_get_length(map);
+  return file->map->length >= needed;
+}
+
+// index the records found after `from`, until the end of the file or the first invalid record.
+// caller holds the lock
+static void _scan(dt_mipmap_pack_file_t *file, size_t from)
+{
+  file->size = from;
+  if(!_map(file, 0)) return;
+
+  const uint8_t *data = file->map->data;
+  const size_t length = file->map->length;
+  while(data && from + sizeof(dt_mipmap_pack_record_t) <= length)
+  {
+    dt_mipmap_pack_record_t rec;
+    memcpy(&rec, data + from, sizeof(rec));
+    if(rec.magic != DT_MIPMAP_PACK_MAGIC || from + _record_size(rec.length) > length
+       || _checksum_record(data + from) != rec.checksum)
+      break; // truncated by a crash, next appends will overwrite it
+
+    _index_set(file, rec.key, from, rec.length);
+    from += _record_size(rec.length);
+  }
+  file->size = from;
+
+  if(from < length)
+    dt_print(DT_DEBUG_CACHE, "[mipmap_pack] ignoring %zu invalid bytes at the end of `%s'\n", length - from,
+             file->path);
+}
+
+// returns the size of the pack covered by the saved index, 0 if there is no usable index
+static size_t _index_load(dt_mipmap_pack_file_t *file, const size_t pack_size)
+{
+  char filename[PATH_MAX] = { 0 };
+  _index_path(file, filename, sizeof(filename));
+
+  gchar *contents = NULL;
+  gsize length = 0;
+  if(!g_file_get_contents(filename, &contents, &length, NULL)) return 0;
+
+  size_t covered = 0;
+  dt_mipmap_pack_index_header_t header;
+  if(length < sizeof(header)) goto end;
+  memcpy(&header, contents, sizeof(header));
+  if(header.magic != DT_MIPMAP_PACK_INDEX_MAGIC || header.version != DT_MIPMAP_PACK_VERSION
+     || header.pack_size > pack_size
+     || length != sizeof(header) + header.count * sizeof(dt_mipmap_pack_entry_t))
+    goto end;
+
+  const dt_mipmap_pack_entry_t *entries = (const dt_mipmap_pack_entry_t *)(contents + sizeof(header));
+  for(uint64_t k = 0; k < header.count; k++)
+  {
+    if(entries[k].offset + _record_size(entries[k].length) > header.pack_size) continue;
+    _index_set(file, entries[k].key, entries[k].offset, entries[k].length);
+  }
+  file->dead = header.dead;
+  covered = header.pack_size;
+
+end:
+  g_free(contents);
+  return covered;
+}
+
+static void _index_save(dt_mipmap_pack_file_t *file)
+{
+  char filename[PATH_MAX] = { 0 };
+  char tmpname[PATH_MAX] = { 0 };
+  _index_path(file, filename, sizeof(filename));
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+
+  FILE *f = g_fopen(tmpname, "wb");
+  if(!f) return;
+
+  dt_mipmap_pack_index_header_t header = { .magic = DT_MIPMAP_PACK_INDEX_MAGIC,
+                                           .version = DT_MIPMAP_PACK_VERSION,
+                                           .pack_size = file->size,
+                                           .dead = file->dead,
+                                           .count = g_hash_table_size(file->index) };
+  gboolean fail = fwrite(&header, sizeof(header), 1, f) != 1;
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, file->index);
+  while(!fail && g_hash_table_iter_next(&iter, &key, &value))
+    fail = fwrite(value, sizeof(dt_mipmap_pack_entry_t), 1, f) != 1;
+
+  if(fclose(f) || fail || g_rename(tmpname, filename))
+    g_unlink(tmpname);
+}
+
+static gint _sort_offset(gconstpointer a, gconstpointer b)
+{
+  const dt_mipmap_pack_entry_t *ea = (const dt_mipmap_pack_entry_t *)a;
+  const dt_mipmap_pack_entry_t *eb = (const dt_mipmap_pack_entry_t *)b;
+  return (ea->offset > eb->offset) - (ea->offset < eb->offset);
+}
+
+// rewrite the live records in a new pack, in their current order. caller holds the lock
+static void _compact(dt_mipmap_pack_file_t *file)
+{
+  if(file->dead < DT_MIPMAP_PACK_MIN_DEAD || file->dead < file->size / 2) return;
+  if(file->retired || (file->map && file->map->borrowed)) return;
+  if(!_map(file, file->size)) return;
+
+  char tmpname[PATH_MAX] = { 0 };
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", file->path);
+  FILE *f = g_fopen(tmpname, "wb");
+  if(!f) return;
+
+  GList *entries = g_list_sort(g_hash_table_get_values(file->index), _sort_offset);
+  const guint count = g_list_length(entries);
+  uint64_t *offsets = malloc(sizeof(uint64_t) * MAX(count, 1));
+  const uint8_t *data = file->map->data;
+
+  // all records have aligned sizes, so they stay aligned at their new offsets
+  gboolean fail = (offsets == NULL);
+  uint64_t size = 0;
+  guint k = 0;
+  for(GList *e = entries; e && !fail; e = g_list_next(e), k++)
+  {
+    const dt_mipmap_pack_entry_t *entry = (const dt_mipmap_pack_entry_t *)e->data;
+    const size_t length = _record_size(entry->length);
+    offsets[k] = size;
+    fail = fwrite(data + entry->offset, 1, length, f) != length;
+    size += length;
+  }
+
+  // the old pack must be closed before being replaced, at least on Windows
+  if(fclose(f) || fail) goto error;
+  fclose(file->f);
+  file->f = NULL;
+  _map_retire(file);
+  // offsets change: an old index surviving a crash right now would point to garbage
+  char filename[PATH_MAX] = { 0 };
+  _index_path(file, filename, sizeof(filename));
+  g_unlink(filename);
+  if(g_rename(tmpname, file->path)) goto error;
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_pack] compacted `%s' from %zu to %" PRIu64 " bytes\n", file->path, file->size,
+           size);
+  k = 0;
+  for(GList *e = entries; e; e = g_list_next(e), k++) ((dt_mipmap_pack_entry_t *)e->data)->offset = offsets[k];
+  file->size = size;
+  file->dead = 0;
+  goto end;
+
+error:
+  g_unlink(tmpname);
+end:
+  free(offsets);
+  g_list_free(entries);
+}
+
+// write a record at the end of the valid part of the pack, its payload being the concatenation
+// of the n parts. caller holds the lock
+static int _append_parts(dt_mipmap_pack_file_t *file, dt_mipmap_pack_record_t *rec, const void *const *parts,
+                         const size_t *sizes, const int n)
+{
+  if(!file->f) return 1;
+
+  rec->magic = DT_MIPMAP_PACK_MAGIC;
+  memset(rec->reserved, 0, sizeof(rec->reserved));
+  rec->length = 0;
+  for(int k = 0; k < n; k++) rec->length += sizes[k];
+  rec->checksum = _checksum(rec, parts, sizes, n);
+
+  // on failure, file->size doesn't move and the scan at next startup stops on the broken record
+  if(_pack_seek(file->f, file->size) || fwrite(rec, sizeof(*rec), 1, file->f) != 1) return 1;
+  for(int k = 0; k < n; k++)
+    if(sizes[k] && fwrite(parts[k], 1, sizes[k], file->f) != sizes[k]) return 1;
+  static const uint8_t zeros[DT_MIPMAP_PACK_ALIGN] = { 0 };
+  const size_t padding = _record_size(rec->length) - sizeof(*rec) - rec->length;
+  if((padding && fwrite(zeros, 1, padding, file->f) != padding) || fflush(file->f)) return 1;
+
+  _index_set(file, rec->key, file->size, rec->length);
+  file->size += _record_size(rec->length);
+  return 0;
+}
+
+static inline int _append(dt_mipmap_pack_file_t *file, dt_mipmap_pack_record_t *rec, const uint8_t *payload,
+                          const size_t length)
+{
+  const void *parts[1] = { payload };
+  return _append_parts(file, rec, parts, &length, 1);
+}
+
+static int _file_init(dt_mipmap_pack_file_t *file, const char *path, const int mip)
+{
+  dt_pthread_mutex_init(&file->lock, NULL);
+  file->index = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
+  snprintf(file->path, sizeof(file->path), "%s/mip%d.pack", path, mip);
+
+  if(!g_file_test(file->path, G_FILE_TEST_EXISTS))
+  {
+    FILE *f = g_fopen(file->path, "wb");
+    if(f) fclose(f);
+    // the index of a pack that doesn't exist anymore is meaningless
+    char filename[PATH_MAX] = { 0 };
+    _index_path(file, filename, sizeof(filename));
+    g_unlink(filename);
+  }
+
+  file->f = g_fopen(file->path, "r+b");
+  if(!file->f)
+  {
+    fprintf(stderr, "[mipmap_pack] can't open `%s'\n", file->path);
+    return 0;
+  }
+
+  GStatBuf statbuf;
+  const size_t pack_size = g_stat(file->path, &statbuf) ? 0 : (size_t)statbuf.st_size;
+  _scan(file, _index_load(file, pack_size));
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_pack] %u thumbnails in `%s', %zu of %zu bytes are dead\n",
+           g_hash_table_size(file->index), file->path, file->dead, file->size);
+  return 1;
+}
+
+int dt_mipmap_pack_init(dt_mipmap_pack_t *pack, const char *path)
+{
+  g_strlcpy(pack->path, path, sizeof(pack->path));
+  // on failure the packs still get initialized, they just can't be opened
+  int res = 1;
+  if(g_mkdir_with_parents(pack->path, 0750))
+  {
+    fprintf(stderr, "[mipmap_pack] can't create the directory `%s'\n", pack->path);
+    res = 0;
+  }
+
+  for(int mip = 0; mip < DT_MIPMAP_F; mip++)
+    res &= _file_init(&pack->levels[mip], pack->path, mip);
+  return res;
+}
+
+void dt_mipmap_pack_cleanup(dt_mipmap_pack_t *pack)
+{
+  for(int mip = 0; mip < DT_MIPMAP_F; mip++)
+  {
+    dt_mipmap_pack_file_t *file = &pack->levels[mip];
+    dt_pthread_mutex_lock(&file->lock);
+    if(file->f)
+    {
+      _compact(file);
+      _index_save(file);
+    }
+    if(file->f) fclose(file->f);
+    file->f = NULL;
+    // mipmaps are gone by now, nothing can be borrowed anymore
+    if(file->map) _map_free(file->map);
+    file->map = NULL;
+    g_list_free_full(file->retired, (GDestroyNotify)_map_free);
+    file->retired = NULL;
+    g_hash_table_destroy(file->index);
+    file->index = NULL;
+    dt_pthread_mutex_unlock(&file->lock);
+    dt_pthread_mutex_destroy(&file->lock);
+  }
+}
+
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t key)
+{
+  if(mip >= DT_MIPMAP_F) return FALSE;
+  dt_mipmap_pack_file_t *file = &pack->levels[mip];
+  dt_pthread_mutex_lock(&file->lock);
+  const gboolean found = g_hash_table_contains(file->index, GUINT_TO_POINTER(key));
+  dt_pthread_mutex_unlock(&file->lock);
+  return found;
+}
+
+int dt_mipmap_pack_read(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t key, uint8_t *out,
+                        const uint32_t max_width, const uint32_t max_height, uint32_t *width, uint32_t *height,
+                        dt_colorspaces_color_profile_type_t *color_space)
+{
+  if(mip >= DT_MIPMAP_F) return 1;
+  dt_mipmap_pack_file_t *file = &pack->levels[mip];
+
+  // take a reference on the current mapping, so we can decompress without holding the lock,
+  // even if another thread remaps the pack meanwhile.
+  dt_pthread_mutex_lock(&file->lock);
+  dt_mipmap_pack_entry_t *entry = g_hash_table_lookup(file->index, GUINT_TO_POINTER(key));
+  GMappedFile *map = NULL;
+  const uint8_t *data = NULL;
+  uint32_t length = 0;
+  if(entry && _map(file, entry->offset + _record_size(entry->length)))
+  {
+    map = g_mapped_file_ref(file->map->map);
+    data = file->map->data + entry->offset;
+    length = entry->length;
+  }
+  dt_pthread_mutex_unlock(&file->lock);
+  if(!map) return 1;
+
+  int res = 1;
+  dt_mipmap_pack_record_t rec;
+  memcpy(&rec, data, sizeof(rec));
+  const uint8_t *payload = data + sizeof(rec);
+
+  dt_imageio_jpeg_t jpg;
+  if(rec.flags & DT_MIPMAP_PACK_FLAG_RAW)
+  {
+    // not for us, see dt_mipmap_pack_borrow()
+    g_mapped_file_unref(map);
+    return 1;
+  }
+  else if(rec.magic != DT_MIPMAP_PACK_MAGIC || rec.key != key || rec.length != length
+          || _checksum_record(data) != rec.checksum)
+  {
+    fprintf(stderr, "[mipmap_pack] corrupted thumbnail %" PRIu32 " in `%s'\n", key, file->path);
+  }
+  else if(dt_imageio_jpeg_decompress_header(payload, length, &jpg)
+          || jpg.width > max_width || jpg.height > max_height
+          || dt_imageio_jpeg_decompress(&jpg, out))
+  {
+    fprintf(stderr, "[mipmap_pack] failed to decompress thumbnail %" PRIu32 " from `%s'\n", key, file->path);
+  }
+  else
+  {
+    *width = jpg.width;
+    *height = jpg.height;
+    *color_space = rec.color_space;
+    res = 0;
+  }
+  g_mapped_file_unref(map);
+
+  if(res) dt_mipmap_pack_remove(pack, mip, key);
+  return res;
+}
+
+static gboolean _enough_space(dt_mipmap_pack_t *pack, const uint32_t key)
+{
+  struct statvfs vfsbuf;
+  if(statvfs(pack->path, &vfsbuf) || ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20) < 100)
+  {
+    fprintf(stderr, "[mipmap_pack] not enough free space to write thumbnail %" PRIu32 " in `%s'\n", key,
+            pack->path);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+int dt_mipmap_pack_write(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t key, const uint8_t *in,
+                         const uint32_t width, const uint32_t height,
+                         const dt_colorspaces_color_profile_type_t color_space, const int quality)
+{
+  if(mip >= DT_MIPMAP_F) return 1;
+  if(dt_mipmap_pack_contains(pack, mip, key)) return 0;
+  if(!_enough_space(pack, key)) return 1;
+
+  dt_mipmap_pack_file_t *file = &pack->levels[mip];
+
+  // compress out of the lock, jpeg output can't be larger than the RGBA input
+  uint8_t *payload = dt_alloc_align(sizeof(uint8_t) * 4 * width * height);
+  if(!payload) return 1;
+  const int length = dt_imageio_jpeg_compress(in, payload, width, height, quality);
+  if(length <= 1) // 1 is the error code
+  {
+    dt_free_align(payload);
+    return 1;
+  }
+
+  dt_mipmap_pack_record_t rec = { .key = key,
+                                  .width = width,
+                                  .height = height,
+                                  .color_space = color_space };
+  int res = 0;
+  dt_pthread_mutex_lock(&file->lock);
+  if(!g_hash_table_contains(file->index, GUINT_TO_POINTER(key)))
+    res = _append(file, &rec, payload, length);
+  dt_pthread_mutex_unlock(&file->lock);
+
+  dt_free_align(payload);
+  return res;
+}
+
+int dt_mipmap_pack_write_raw(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t key,
+                             const void *header, const size_t header_size, const uint8_t *in,
+                             const uint32_t width, const uint32_t height,
+                             const dt_colorspaces_color_profile_type_t color_space)
+{
+  if(mip >= DT_MIPMAP_F) return 1;
+  if(dt_mipmap_pack_contains(pack, mip, key)) return 0;
+  if(!_enough_space(pack, key)) return 1;
+
+  dt_mipmap_pack_file_t *file = &pack->levels[mip];
+  const void *parts[2] = { header, in };
+  const size_t sizes[2] = { header_size, sizeof(uint8_t) * 4 * width * height };
+  dt_mipmap_pack_record_t rec = { .key = key,
+                                  .width = width,
+                                  .height = height,
+                                  .color_space = color_space,
+                                  .flags = DT_MIPMAP_PACK_FLAG_RAW };
+  int res = 0;
+  dt_pthread_mutex_lock(&file->lock);
+  if(!g_hash_table_contains(file->index, GUINT_TO_POINTER(key)))
+    res = _append_parts(file, &rec, parts, sizes, 2);
+  dt_pthread_mutex_unlock(&file->lock);
+  return res;
+}
+
+void *dt_mipmap_pack_borrow(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t key,
+                            size_t *length)
+{
+  if(mip >= DT_MIPMAP_F) return NULL;
+  dt_mipmap_pack_file_t *file = &pack->levels[mip];
+
+  void *payload = NULL;
+  dt_pthread_mutex_lock(&file->lock);
+  dt_mipmap_pack_entry_t *entry = g_hash_table_lookup(file->index, GUINT_TO_POINTER(key));
+  if(entry && _map(file, entry->offset + _record_size(entry->length)))
+  {
+    // the payload checksum was verified when the record was indexed by a scan, checking it
+    // again here would read the whole buffer, which is what we want to avoid.
+    const dt_mipmap_pack_record_t *rec = (const dt_mipmap_pack_record_t *)(file->map->data + entry->offset);
+    if(rec->magic == DT_MIPMAP_PACK_MAGIC && rec->key == key && rec->length == entry->length
+       && (rec->flags & DT_MIPMAP_PACK_FLAG_RAW))
+    {
+      payload = (void *)(rec + 1);
+      *length = rec->length;
+      file->map->borrowed++;
+    }
+  }
+  dt_pthread_mutex_unlock(&file->lock);
+  return payload;
+}
+
+gboolean dt_mipmap_pack_release(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const void *payload)
+{
+  if(mip >= DT_MIPMAP_F) return FALSE;
+  dt_mipmap_pack_file_t *file = &pack->levels[mip];
+  const uint8_t *p = (const uint8_t *)payload;
+
+  gboolean found = FALSE;
+  dt_pthread_mutex_lock(&file->lock);
+  if(file->map && p >= file->map->data && p < file->map->data + file->map->length)
+  {
+    file->map->borrowed--;
+    found = TRUE;
+  }
+  for(GList *l = file->retired; l && !found; l = g_list_next(l))
+  {
+    dt_mipmap_pack_map_t *map = (dt_mipmap_pack_map_t *)l->data;
+    if(p < map->data || p >= map->data + map->length) continue;
+    found = TRUE;
+    if(--map->borrowed == 0)
+    {
+      file->retired = g_list_delete_link(file->retired, l);
+      _map_free(map);
+    }
+  }
+  dt_pthread_mutex_unlock(&file->lock);
+  return found;
+}
+
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t key)
+{
+  if(mip >= DT_MIPMAP_F) return;
+  dt_mipmap_pack_file_t *file = &pack->levels[mip];
+  dt_pthread_mutex_lock(&file->lock);
+  if(g_hash_table_contains(file->index, GUINT_TO_POINTER(key)))
+  {
+    // borrowed payloads stay valid: the record is still there, only superseded
+    dt_mipmap_pack_record_t rec = { .key = key };
+    if(_append(file, &rec, NULL, 0))
+    {
+      // can't record the removal, at least forget it for this session
+      _index_set(file, key, 0, 0);
+    }
+  }
+  dt_pthread_mutex_unlock(&file->lock);
+}
+
+void dt_mipmap_pack_copy(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t dst_key,
+                         const uint32_t src_key)
+{
+  if(mip >= DT_MIPMAP_F) return;
+  dt_mipmap_pack_file_t *file = &pack->levels[mip];
+  dt_pthread_mutex_lock(&file->lock);
+  dt_mipmap_pack_entry_t *entry = g_hash_table_lookup(file->index, GUINT_TO_POINTER(src_key));
+  if(entry && _map(file, entry->offset + _record_size(entry->length)))
+  {
+    // the mapping may be replaced while appending, copy the payload first
+    const uint8_t *data = file->map->data + entry->offset;
+    dt_mipmap_pack_record_t rec;
+    memcpy(&rec, data, sizeof(rec));
+    uint8_t *payload = g_malloc(MAX(rec.length, 1));
+    memcpy(payload, data + sizeof(rec), rec.length);
+    if(rec.magic == DT_MIPMAP_PACK_MAGIC && _checksum_record(data) == rec.checksum)
+    {
+      rec.key = dst_key;
+      _append(file, &rec, payload, rec.length);
+    }
+    g_free(payload);
+  }
+  dt_pthread_mutex_unlock(&file->lock);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,118 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/colorspaces.h"
+#include "common/dtpthread.h"
+#include "common/mipmap_cache.h"
+#include <glib.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+
+/**
+ * Packed disk backend of the thumbnail cache.
+ *
+ * Instead of one jpeg file per image and per size, thumbnails of one mip level are appended
+ * to a single pack file, $cachedir.pack/mip<n>.pack. Each record is a small header
+ * (key, size, color space, crc32) followed by the jpeg payload. Reads go through a memory
+ * mapping of the pack and decompress straight into the mipmap buffer.
+ *
+ * The largest levels can be stored raw instead: the record then holds the mipmap buffer as it
+ * is in memory, and the mipmap cache entry points straight into the mapping, without copy nor decoding.
+ *
+ * Replacing or removing a thumbnail only appends a record, the old one becomes dead space.
+ * The index of the live records is saved next to the pack on exit, so startup only scans
+ * what was appended since. Packs with a large share of dead space are compacted on exit.
+ */
+
+typedef enum dt_mipmap_pack_flags_t
+{
+  DT_MIPMAP_PACK_FLAG_NONE = 0,
+  DT_MIPMAP_PACK_FLAG_RAW = 1 << 0, // uncompressed payload, see dt_mipmap_pack_borrow()
+} dt_mipmap_pack_flags_t;
+
+struct dt_mipmap_pack_map_t;
+
+typedef struct dt_mipmap_pack_file_t
+{
+  dt_pthread_mutex_t lock; // protects everything below
+
+  char path[PATH_MAX];     // the pack file
+  FILE *f;                 // opened for appending
+  struct dt_mipmap_pack_map_t *map; // copy-on-write mapping, recreated when records were appended past its end
+  GList *retired;          // older mappings, kept until nothing borrowed from them
+  GHashTable *index;       // (uint32_t key, dt_mipmap_pack_entry_t *) pairs
+  size_t size;             // end of the last valid record
+  size_t dead;             // bytes of replaced or removed records
+} dt_mipmap_pack_file_t;
+
+typedef struct dt_mipmap_pack_t
+{
+  char path[PATH_MAX];     // directory of the packs
+  dt_mipmap_pack_file_t levels[DT_MIPMAP_F]; // one pack per thumbnail size
+} dt_mipmap_pack_t;
+
+/** opens or creates the packs in the directory `path`. returns 0 on failure, call cleanup in any case. */
+int dt_mipmap_pack_init(dt_mipmap_pack_t *pack, const char *path);
+/** saves the indices, compacts the packs if needed and closes them. */
+void dt_mipmap_pack_cleanup(dt_mipmap_pack_t *pack);
+
+/** returns TRUE if the thumbnail of this key is in the pack of level `mip`. */
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t key);
+
+/** decompress the thumbnail into `out`, which should hold max_width * max_height RGBA pixels.
+ *  returns 0 on success. Corrupted records are dropped. */
+int dt_mipmap_pack_read(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t key, uint8_t *out,
+                        const uint32_t max_width, const uint32_t max_height, uint32_t *width, uint32_t *height,
+                        dt_colorspaces_color_profile_type_t *color_space);
+
+/** compress and append the RGBA thumbnail. Existing thumbnails are kept, as re-encoding a lossy jpeg
+ *  wouldn't improve them. returns 0 on success. */
+int dt_mipmap_pack_write(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t key, const uint8_t *in,
+                         const uint32_t width, const uint32_t height,
+                         const dt_colorspaces_color_profile_type_t color_space, const int quality);
+
+/** append the thumbnail uncompressed: header_size bytes of header, then the RGBA pixels.
+ *  returns 0 on success. */
+int dt_mipmap_pack_write_raw(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t key,
+                             const void *header, const size_t header_size, const uint8_t *in,
+                             const uint32_t width, const uint32_t height,
+                             const dt_colorspaces_color_profile_type_t color_space);
+
+/** returns a pointer to the payload of a raw record, aligned on 64 bytes, and its length in `length`,
+ *  or NULL if the thumbnail isn't stored raw. The memory is a private mapping: it can be written,
+ *  the changes don't reach the pack. It stays valid until dt_mipmap_pack_release(). */
+void *dt_mipmap_pack_borrow(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t key,
+                            size_t *length);
+
+/** give back a borrowed payload. returns FALSE if `payload` doesn't belong to the pack. */
+gboolean dt_mipmap_pack_release(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const void *payload);
+
+/** forget the thumbnail of this key. */
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t key);
+
+/** duplicate the record of src_key under dst_key, without decoding it. */
+void dt_mipmap_pack_copy(dt_mipmap_pack_t *pack, const dt_mipmap_size_t mip, const uint32_t dst_key, const uint32_t src_key);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,320 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/mipmap_zcache.h"
+#include "common/darktable.h"
+#include "develop/format.h"
+
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+// buffers are cut in chunks of this size, deflated and inflated in parallel
+#define DT_MIPMAP_ZCACHE_CHUNK ((size_t)1 << 20)
+
+typedef struct dt_mipmap_zcache_entry_t
+{
+  int32_t imgid;
+
+  // what the decoder gave
+  int32_t width, height;
+  dt_iop_buffer_dsc_t dsc;
+  size_t element; // bytes per sample, for the byte planes
+
+  // the file it was read from
+  gint64 file_size;
+  gint64 file_mtime;
+
+  // the compressed buffer, NULL until evicted
+  uint8_t *data;
+  size_t size;      // uncompressed
+  size_t length;    // compressed
+  size_t *offsets;  // of the chunks in data, one more than chunks
+  size_t chunks;
+  dt_colorspaces_color_profile_type_t color_space;
+  GList *link;      // in the lru
+} dt_mipmap_zcache_entry_t;
+
+static void _entry_free(gpointer data)
+{
+  dt_mipmap_zcache_entry_t *e = (dt_mipmap_zcache_entry_t *)data;
+  free(e->data);
+  free(e->offsets);
+  free(e);
+}
+
+static gboolean _file_stat(const char *filename, gint64 *size, gint64 *mtime)
+{
+  GStatBuf st;
+  if(!filename || g_stat(filename, &st)) return FALSE;
+  *size = st.st_size;
+  *mtime = st.st_mtime;
+  return TRUE;
+}
+
+static gboolean _same_layout(const dt_mipmap_zcache_entry_t *e, const dt_image_t *img)
+{
+  return e->width == img->width && e->height == img->height && e->dsc.channels == img->buf_dsc.channels
+         && e->dsc.datatype == img->buf_dsc.datatype && e->dsc.filters == img->buf_dsc.filters
+         && !memcmp(e->dsc.xtrans, img->buf_dsc.xtrans, sizeof(e->dsc.xtrans));
+}
+
+// forget the image, called with the lock held
+static void _entry_remove(dt_mipmap_zcache_t *zcache, const int32_t imgid)
+{
+  dt_mipmap_zcache_entry_t *e = g_hash_table_lookup(zcache->entries, GINT_TO_POINTER(imgid));
+  if(!e) return;
+  if(e->data)
+  {
+    zcache->size -= e->length;
+    g_queue_delete_link(&zcache->lru, e->link);
+  }
+  g_hash_table_remove(zcache->entries, GINT_TO_POINTER(imgid));
+}
+
+// the high bytes of neighbouring samples are alike, the low ones are mostly noise: store them apart
+static inline void _split_planes(uint8_t *const out, const uint8_t *const in, const size_t n, const size_t element)
+{
+  const size_t count = n / element;
+  for(size_t k = 0; k < count; k++)
+    for(size_t b = 0; b < element; b++) out[b * count + k] = in[k * element + b];
+  memcpy(out + count * element, in + count * element, n - count * element);
+}
+
+static inline void _merge_planes(uint8_t *const out, const uint8_t *const in, const size_t n, const size_t element)
+{
+  const size_t count = n / element;
+  for(size_t k = 0; k < count; k++)
+    for(size_t b = 0; b < element; b++) out[k * element + b] = in[b * count + k];
+  memcpy(out + count * element, in + count * element, n - count * element);
+}
+
+void dt_mipmap_zcache_init(dt_mipmap_zcache_t *zcache, const size_t budget)
+{
+  dt_pthread_mutex_init(&zcache->lock, NULL);
+  zcache->entries = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, _entry_free);
+  g_queue_init(&zcache->lru);
+  zcache->size = 0;
+  zcache->budget = budget;
+}
+
+void dt_mipmap_zcache_cleanup(dt_mipmap_zcache_t *zcache)
+{
+  g_queue_clear(&zcache->lru);
+  g_hash_table_destroy(zcache->entries);
+  dt_pthread_mutex_destroy(&zcache->lock);
+}
+
+void dt_mipmap_zcache_note(dt_mipmap_zcache_t *zcache, const dt_image_t *img, const char *filename)
+{
+  const size_t bpp = dt_iop_buffer_dsc_to_bpp(&img->buf_dsc);
+  gint64 file_size = 0, file_mtime = 0;
+  if(img->width <= 0 || img->height <= 0 || bpp == 0 || !_file_stat(filename, &file_size, &file_mtime)) return;
+
+  dt_pthread_mutex_lock(&zcache->lock);
+  dt_mipmap_zcache_entry_t *e = g_hash_table_lookup(zcache->entries, GINT_TO_POINTER(img->id));
+  if(e && !(_same_layout(e, img) && e->file_size == file_size && e->file_mtime == file_mtime))
+  {
+    // decoded again from another file or with another layout
+    _entry_remove(zcache, img->id);
+    e = NULL;
+  }
+  if(!e && (e = calloc(1, sizeof(dt_mipmap_zcache_entry_t))))
+  {
+    e->imgid = img->id;
+    e->width = img->width;
+    e->height = img->height;
+    e->dsc = img->buf_dsc;
+    e->element = MAX(bpp / MAX(img->buf_dsc.channels, 1), 1);
+    e->file_size = file_size;
+    e->file_mtime = file_mtime;
+    g_hash_table_insert(zcache->entries, GINT_TO_POINTER(img->id), e);
+  }
+  dt_pthread_mutex_unlock(&zcache->lock);
+}
+
+void dt_mipmap_zcache_store(dt_mipmap_zcache_t *zcache, const int32_t imgid, const void *payload,
+                            const size_t size, const dt_colorspaces_color_profile_type_t color_space)
+{
+  dt_pthread_mutex_lock(&zcache->lock);
+  dt_mipmap_zcache_entry_t *e = g_hash_table_lookup(zcache->entries, GINT_TO_POINTER(imgid));
+  // not noted, or the same buffer is already kept
+  const gboolean wanted = e && !e->data && size == (size_t)e->width * e->height * e->element * e->dsc.channels;
+  if(e && !wanted && !e->data) _entry_remove(zcache, imgid);
+  const size_t element = wanted ? e->element : 1;
+  dt_pthread_mutex_unlock(&zcache->lock);
+  if(!wanted || size > zcache->budget) return;
+
+  const size_t chunks = (size + DT_MIPMAP_ZCACHE_CHUNK - 1) / DT_MIPMAP_ZCACHE_CHUNK;
+  const size_t bound = compressBound(DT_MIPMAP_ZCACHE_CHUNK);
+  uint8_t *packed = malloc(chunks * bound);
+  uLongf *lengths = malloc(chunks * sizeof(uLongf));
+  if(!packed || !lengths)
+  {
+    free(packed);
+    free(lengths);
+    return;
+  }
+
+  const uint8_t *const in = (const uint8_t *)payload;
+  int failed = 0;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(in, packed, lengths, chunks, bound, size, element) \
+    reduction(|| : failed) schedule(dynamic)
+#endif
+  for(size_t k = 0; k < chunks; k++)
+  {
+    const size_t n = MIN(DT_MIPMAP_ZCACHE_CHUNK, size - k * DT_MIPMAP_ZCACHE_CHUNK);
+    uint8_t *planes = malloc(n);
+    lengths[k] = bound;
+    if(!planes)
+    {
+      failed = 1;
+      continue;
+    }
+    _split_planes(planes, in + k * DT_MIPMAP_ZCACHE_CHUNK, n, element);
+    if(compress2(packed + k * bound, &lengths[k], planes, n, Z_BEST_SPEED) != Z_OK) failed = 1;
+    free(planes);
+  }
+
+  // gather the chunks
+  size_t *offsets = failed ? NULL : malloc((chunks + 1) * sizeof(size_t));
+  uint8_t *data = NULL;
+  size_t length = 0;
+  if(offsets)
+  {
+    for(size_t k = 0; k < chunks; k++)
+    {
+      offsets[k] = length;
+      length += lengths[k];
+    }
+    offsets[chunks] = length;
+    data = malloc(length);
+    if(data)
+      for(size_t k = 0; k < chunks; k++) memcpy(data + offsets[k], packed + k * bound, lengths[k]);
+  }
+  free(packed);
+  free(lengths);
+
+  dt_pthread_mutex_lock(&zcache->lock);
+  e = g_hash_table_lookup(zcache->entries, GINT_TO_POINTER(imgid));
+  if(!data || !e || e->data || length > zcache->budget)
+  {
+    dt_pthread_mutex_unlock(&zcache->lock);
+    free(data);
+    free(offsets);
+    dt_print(DT_DEBUG_CACHE, "[mipmap_zcache] full buffer of image %d not kept\n", imgid);
+    return;
+  }
+
+  // make room, least recently used first
+  while(zcache->size + length > zcache->budget && !g_queue_is_empty(&zcache->lru))
+  {
+    dt_mipmap_zcache_entry_t *old = g_queue_peek_tail(&zcache->lru);
+    _entry_remove(zcache, old->imgid);
+  }
+  e->data = data;
+  e->offsets = offsets;
+  e->chunks = chunks;
+  e->size = size;
+  e->length = length;
+  e->color_space = color_space;
+  g_queue_push_head(&zcache->lru, e);
+  e->link = g_queue_peek_head_link(&zcache->lru);
+  zcache->size += length;
+  dt_pthread_mutex_unlock(&zcache->lock);
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_zcache] kept full buffer of image %d, %zu MiB to %zu MiB\n", imgid,
+           size >> 20, length >> 20);
+}
+
+gboolean dt_mipmap_zcache_restore(dt_mipmap_zcache_t *zcache, dt_mipmap_buffer_t *buf, const dt_image_t *img,
+                                  const char *filename)
+{
+  gint64 file_size = 0, file_mtime = 0;
+  if(!_file_stat(filename, &file_size, &file_mtime)) return FALSE;
+
+  dt_pthread_mutex_lock(&zcache->lock);
+  dt_mipmap_zcache_entry_t *e = g_hash_table_lookup(zcache->entries, GINT_TO_POINTER(img->id));
+  if(!e || !e->data)
+  {
+    dt_pthread_mutex_unlock(&zcache->lock);
+    return FALSE;
+  }
+  if(!_same_layout(e, img) || e->file_size != file_size || e->file_mtime != file_mtime)
+  {
+    // the image cache lost what the decoder told it, or the file changed
+    _entry_remove(zcache, img->id);
+    dt_pthread_mutex_unlock(&zcache->lock);
+    return FALSE;
+  }
+
+  // inflated under the lock, so the entry can't go away meanwhile
+  uint8_t *out = dt_mipmap_cache_alloc(buf, img);
+  int failed = (out == NULL);
+  const uint8_t *const data = e->data;
+  const size_t *const offsets = e->offsets;
+  const size_t chunks = e->chunks, size = e->size, element = e->element;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(out, data, offsets, chunks, size, element) \
+    reduction(|| : failed) schedule(dynamic)
+#endif
+  for(size_t k = 0; k < chunks; k++)
+  {
+    if(!out) continue;
+    const size_t n = MIN(DT_MIPMAP_ZCACHE_CHUNK, size - k * DT_MIPMAP_ZCACHE_CHUNK);
+    uint8_t *planes = malloc(n);
+    uLongf length = n;
+    if(!planes || uncompress(planes, &length, data + offsets[k], offsets[k + 1] - offsets[k]) != Z_OK
+       || length != n)
+      failed = 1;
+    else
+      _merge_planes(out + k * DT_MIPMAP_ZCACHE_CHUNK, planes, n, element);
+    free(planes);
+  }
+
+  if(failed)
+  {
+    _entry_remove(zcache, img->id);
+  }
+  else
+  {
+    buf->color_space = e->color_space;
+    g_queue_unlink(&zcache->lru, e->link);
+    g_queue_push_head_link(&zcache->lru, e->link);
+  }
+  dt_pthread_mutex_unlock(&zcache->lock);
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_zcache] full buffer of image %d %s\n", img->id,
+           failed ? "failed to inflate" : "restored");
+  return !failed;
+}
+
+void dt_mipmap_zcache_remove(dt_mipmap_zcache_t *zcache, const int32_t imgid)
+{
+  dt_pthread_mutex_lock(&zcache->lock);
+  _entry_remove(zcache, imgid);
+  dt_pthread_mutex_unlock(&zcache->lock);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
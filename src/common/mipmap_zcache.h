@@ -0,0 +1,73 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/colorspaces.h"
+#include "common/dtpthread.h"
+#include "common/image.h"
+#include "common/mipmap_cache.h"
+#include <glib.h>
+#include <inttypes.h>
+
+/**
+ * Compressed in-memory tier of the full resolution mipmaps.
+ *
+ * DT_MIPMAP_FULL buffers evicted from the mipmap cache are kept deflated in memory, within a budget,
+ * so opening the image again costs an inflate instead of reading and decoding the raw file again.
+ * Samples are split in byte planes before compression, which groups the slowly varying high bytes,
+ * and the buffer is cut in chunks deflated and inflated in parallel.
+ *
+ * A buffer can only be stored if its image was noted fresh from the decoder, with the layout the decoder
+ * gave it and the size and modification time of the file. It is restored only if the image cache and the
+ * file still agree with them, otherwise the image is decoded again.
+ */
+
+typedef struct dt_mipmap_zcache_t
+{
+  dt_pthread_mutex_t lock; // protects everything below
+  GHashTable *entries;     // (int32_t imgid, dt_mipmap_zcache_entry_t *) pairs
+  GQueue lru;              // entries holding a compressed buffer, most recently used first
+  size_t size;             // compressed bytes held
+  size_t budget;
+} dt_mipmap_zcache_t;
+
+/** budget in bytes */
+void dt_mipmap_zcache_init(dt_mipmap_zcache_t *zcache, const size_t budget);
+void dt_mipmap_zcache_cleanup(dt_mipmap_zcache_t *zcache);
+
+/** remember how the decoder left `img`, read from `filename`, so its buffer can be kept on eviction. */
+void dt_mipmap_zcache_note(dt_mipmap_zcache_t *zcache, const dt_image_t *img, const char *filename);
+
+/** compress the payload of an evicted full buffer, `size` bytes, if its image was noted. */
+void dt_mipmap_zcache_store(dt_mipmap_zcache_t *zcache, const int32_t imgid, const void *payload,
+                            const size_t size, const dt_colorspaces_color_profile_type_t color_space);
+
+/** fill the write-locked mipmap buffer `buf` of `img` from the compressed copy, allocating it through
+ *  dt_mipmap_cache_alloc(). returns TRUE on success, FALSE if there is no matching copy. */
+gboolean dt_mipmap_zcache_restore(dt_mipmap_zcache_t *zcache, dt_mipmap_buffer_t *buf, const dt_image_t *img,
+                                  const char *filename);
+
+/** forget the image. */
+void dt_mipmap_zcache_remove(dt_mipmap_zcache_t *zcache, const int32_t imgid);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
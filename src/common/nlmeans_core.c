@@ -57,6 +57,15 @@
 //#define CACHE_PIXDIFFS
 //#define CACHE_PIXDIFFS_SSE
 
+// what about processing several patches per sweep, one SIMD lane per patch, on the chunks where no patch
+// reaches the borders of the image?  The pixels being denoised are then loaded once for all the patches and
+// the output is written once per group, with the very same rounding as below.  Testing with groups of 4
+// patches, interleaved column sums, and with planar copies of the input to avoid gathers, shows no gain
+// over the per-patch loops: the sliding window is already O(1) per pixel and offset (the same as with an
+// integral image), and the loops below are bound by the loads of the shifted pixels, not by the arithmetic.
+// The per-thread scratch space stays one row of column sums per chunk, and the patches are the same as on
+// the OpenCL path since both get them from define_patches().
+
 // number of intermediate buffers used by OpenCL code path.  If you change this, you must also change
 //   the definition in src/iop/nlmeans.c and src/iop/denoiseprofile.c
 #define NUM_BUCKETS 4
@@ -417,7 +426,7 @@ void nlmeans_denoise(const float *const inbuf, float *const outbuf,
   const int chk_height = compute_slice_height(roi_out->height);
   const int chk_width = compute_slice_width(roi_out->width);
 #ifdef _OPENMP
-#pragma omp parallel for default(none) num_threads(darktable.num_openmp_threads) \
+#pragma omp parallel for default(none) num_threads(dt_omp_threads()) \
       dt_omp_firstprivate(patches, num_patches, scratch_buf, padded_scratch_size, chk_height, chk_width, radius) \
       dt_omp_sharedconst(params, roi_out, outbuf, inbuf, stride, center_norm, skip_blend, weight, invert) \
       schedule(static) \
@@ -614,6 +623,12 @@ void nlmeans_denoise_sse2(const float *const inbuf, float *const outbuf,
                           const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
                           const dt_nlmeans_param_t *const params)
 {
+  if(darktable.codepath.AVX2)
+  {
+    nlmeans_denoise(inbuf, outbuf, roi_in, roi_out, params);
+    return;
+  }
+
   // define the factors for applying blending between the original image and the denoised version
   // if running in RGB space, 'luma' should equal 'chroma'
   const __m128 weight = { params->luma, params->chroma, params->chroma, 1.0f };
@@ -641,7 +656,7 @@ void nlmeans_denoise_sse2(const float *const inbuf, float *const outbuf,
   const int chk_height = compute_slice_height(roi_out->height);
   const int chk_width = compute_slice_width(roi_out->width);
 #ifdef _OPENMP
-#pragma omp parallel for default(none) num_threads(darktable.num_openmp_threads) \
+#pragma omp parallel for default(none) num_threads(dt_omp_threads()) \
       dt_omp_firstprivate(patches, num_patches, scratch_buf, padded_scratch_size, chk_height, chk_width, radius) \
       dt_omp_sharedconst(params, roi_out, outbuf, inbuf, stride, center_norm, skip_blend, weight, invert) \
       schedule(static) \
@@ -997,7 +1012,7 @@ int nlmeans_denoise_cl(const dt_nlmeans_param_t *const params, const int devid,
     dt_opencl_finish_sync_pipe(devid, params->pipetype);
 
     // indirectly give gpu some air to breathe (and to do display related stuff)
-    dt_iop_nap(dt_opencl_micro_nap(devid));
+    dt_opencl_nap(devid);
   }
 
 error:
@@ -1092,7 +1107,7 @@ int nlmeans_denoiseprofile_cl(const dt_nlmeans_param_t *const params, const int
     dt_opencl_finish_sync_pipe(devid, params->pipetype);
 
     // indirectly give gpu some air to breathe (and to do display related stuff)
-    dt_iop_nap(dt_opencl_micro_nap(devid));
+    dt_opencl_nap(devid);
   }
 
 error:
@@ -20,14 +20,115 @@
 #include "common/file_location.h"
 #include "control/control.h"
 
+#include <stdint.h>
+
 // bump this when the noiseprofiles are getting a different layout or meaning (raw-raw data, ...)
 #define DT_NOISE_PROFILE_VERSION 0
 
+/*
+ * The JSON database is compiled on first use into a flat binary file in the user cache dir,
+ * keyed on the SHA1 of the JSON content, and later runs just mmap it:
+ *
+ *   header | buckets[n_buckets] | models[n_models] | profiles[n_profiles] | strings
+ *
+ * models are chained per bucket of the hash of their name, in file order, so the first
+ * maker/model pair that matches is the same one the JSON walk would find.
+ * Profiles marked `skip` are dropped at compile time.
+ */
+#define DT_NOISE_PROFILE_CACHE_MAGIC "dtnoise"
+// bump this when the layout of the binary cache changes
+#define DT_NOISE_PROFILE_CACHE_VERSION 1
+#define DT_NOISE_PROFILE_CACHE_END UINT32_MAX
+
+typedef struct dt_noiseprofile_cache_header_t
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t n_buckets;
+  uint32_t n_models;
+  uint32_t n_profiles;
+  uint32_t strings_size;
+  uint32_t padding;
+  char checksum[48]; // SHA1 of the JSON file, hex
+} dt_noiseprofile_cache_header_t;
+
+typedef struct dt_noiseprofile_cache_model_t
+{
+  uint32_t maker;   // offsets into the strings
+  uint32_t model;
+  uint32_t first;   // first profile
+  uint32_t count;
+  uint32_t next;    // next model in the same bucket
+} dt_noiseprofile_cache_model_t;
+
+typedef struct dt_noiseprofile_cache_profile_t
+{
+  uint32_t name;
+  int32_t iso;
+  float a[3];
+  float b[3];
+} dt_noiseprofile_cache_profile_t;
+
+typedef struct dt_noiseprofile_db_t
+{
+  GMappedFile *map;  // the cache file, or NULL when compiled in this run
+  gchar *data;       // owned when map == NULL
+  const dt_noiseprofile_cache_header_t *header;
+  const uint32_t *buckets;
+  const dt_noiseprofile_cache_model_t *models;
+  const dt_noiseprofile_cache_profile_t *profiles;
+  const char *strings;
+} dt_noiseprofile_db_t;
+
 const dt_noiseprofile_t dt_noiseprofile_generic = {N_("generic poissonian"), "", "", 0, {0.0001f, 0.0001f, 0.0001}, {0.0f, 0.0f, 0.0f}};
 
 static gboolean dt_noiseprofile_verify(JsonParser *parser);
+static gchar *_compile(JsonParser *parser, const gchar *checksum, size_t *size);
+
+static size_t _cache_size(const dt_noiseprofile_cache_header_t *h)
+{
+  return sizeof(dt_noiseprofile_cache_header_t) + sizeof(uint32_t) * h->n_buckets
+         + sizeof(dt_noiseprofile_cache_model_t) * h->n_models
+         + sizeof(dt_noiseprofile_cache_profile_t) * h->n_profiles + h->strings_size;
+}
+
+// check a binary db against the JSON it has been compiled from, and that nothing points out of it
+static gboolean _db_attach(dt_noiseprofile_db_t *db, gchar *data, const size_t size, const gchar *checksum)
+{
+  if(size < sizeof(dt_noiseprofile_cache_header_t)) return FALSE;
+  const dt_noiseprofile_cache_header_t *h = (const dt_noiseprofile_cache_header_t *)data;
+  if(memcmp(h->magic, DT_NOISE_PROFILE_CACHE_MAGIC, sizeof(h->magic))
+     || h->version != (DT_NOISE_PROFILE_CACHE_VERSION << 16 | DT_NOISE_PROFILE_VERSION)
+     || strncmp(h->checksum, checksum, sizeof(h->checksum))
+     || h->n_buckets == 0 || h->strings_size == 0
+     || h->n_models > size || h->n_profiles > size || h->n_buckets > size || h->strings_size > size
+     || _cache_size(h) != size)
+    return FALSE;
+
+  db->header = h;
+  db->buckets = (const uint32_t *)(data + sizeof(dt_noiseprofile_cache_header_t));
+  db->models = (const dt_noiseprofile_cache_model_t *)(db->buckets + h->n_buckets);
+  db->profiles = (const dt_noiseprofile_cache_profile_t *)(db->models + h->n_models);
+  db->strings = (const char *)(db->profiles + h->n_profiles);
+
+  if(db->strings[h->strings_size - 1] != '\0') return FALSE;
+  for(uint32_t k = 0; k < h->n_buckets; k++)
+    if(db->buckets[k] != DT_NOISE_PROFILE_CACHE_END && db->buckets[k] >= h->n_models) return FALSE;
+  for(uint32_t k = 0; k < h->n_models; k++)
+  {
+    const dt_noiseprofile_cache_model_t *m = db->models + k;
+    if(m->maker >= h->strings_size || m->model >= h->strings_size
+       || m->first > h->n_profiles || m->count > h->n_profiles - m->first
+       || (m->next != DT_NOISE_PROFILE_CACHE_END && m->next >= h->n_models))
+      return FALSE;
+  }
+  for(uint32_t k = 0; k < h->n_profiles; k++)
+    if(db->profiles[k].name >= h->strings_size) return FALSE;
+
+  return TRUE;
+}
 
-JsonParser *dt_noiseprofile_init(const char *alternative)
+struct dt_noiseprofile_db_t *dt_noiseprofile_init(const char *alternative)
 {
   GError *error = NULL;
   char filename[PATH_MAX] = { 0 };
@@ -51,14 +152,45 @@ JsonParser *dt_noiseprofile_init(const char *alternative)
   dt_print(DT_DEBUG_CONTROL, "[noiseprofile] loading noiseprofiles from `%s'\n", filename);
   if(!g_file_test(filename, G_FILE_TEST_EXISTS)) return NULL;
 
-  // TODO: shall we cache the content? for now this looks fast enough(TM)
+  GMappedFile *json = g_mapped_file_new(filename, FALSE, &error);
+  if(!json)
+  {
+    fprintf(stderr, "[noiseprofile] error: reading `%s' failed\n%s\n", filename, error->message);
+    g_error_free(error);
+    return NULL;
+  }
+  const gchar *contents = g_mapped_file_get_contents(json);
+  const gsize length = g_mapped_file_get_length(json);
+  gchar *checksum = g_compute_checksum_for_data(G_CHECKSUM_SHA1, (const guchar *)contents, length);
+
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  gchar *cachename = g_build_filename(cachedir, "noiseprofiles.bin", NULL);
+
+  dt_noiseprofile_db_t *db = (dt_noiseprofile_db_t *)calloc(1, sizeof(dt_noiseprofile_db_t));
+
+  // fast path: the compiled database of that exact file is there already
+  db->map = g_mapped_file_new(cachename, FALSE, NULL);
+  if(db->map)
+  {
+    if(_db_attach(db, g_mapped_file_get_contents(db->map), g_mapped_file_get_length(db->map), checksum))
+    {
+      dt_print(DT_DEBUG_CONTROL, "[noiseprofile] using compiled noiseprofiles from `%s'\n", cachename);
+      goto done;
+    }
+    g_mapped_file_unref(db->map);
+    db->map = NULL;
+  }
+
   JsonParser *parser = json_parser_new();
-  if(!json_parser_load_from_file(parser, filename, &error))
+  if(!json_parser_load_from_data(parser, contents, length, &error))
   {
     fprintf(stderr, "[noiseprofile] error: parsing json from `%s' failed\n%s\n", filename, error->message);
     g_error_free(error);
     g_object_unref(parser);
-    return NULL;
+    dt_noiseprofile_cleanup(db);
+    db = NULL;
+    goto done;
   }
 
   // run over the file once to verify that it is sane
@@ -67,10 +199,42 @@ JsonParser *dt_noiseprofile_init(const char *alternative)
     dt_control_log(_("noiseprofile file `%s' is not valid"), filename);
     fprintf(stderr, "[noiseprofile] error: `%s' is not a valid noiseprofile file. run with -d control for details\n", filename);
     g_object_unref(parser);
-    return NULL;
+    dt_noiseprofile_cleanup(db);
+    db = NULL;
+    goto done;
+  }
+
+  size_t size = 0;
+  db->data = _compile(parser, checksum, &size);
+  g_object_unref(parser);
+  if(!db->data || !_db_attach(db, db->data, size, checksum))
+  {
+    fprintf(stderr, "[noiseprofile] error: can't compile the noiseprofiles from `%s'\n", filename);
+    dt_noiseprofile_cleanup(db);
+    db = NULL;
+    goto done;
+  }
+
+  // not being able to write the cache only costs the parsing on the next run
+  if(!g_file_set_contents(cachename, db->data, size, &error))
+  {
+    dt_print(DT_DEBUG_CONTROL, "[noiseprofile] can't write `%s': %s\n", cachename, error->message);
+    g_error_free(error);
   }
 
-  return parser;
+done:
+  g_free(cachename);
+  g_free(checksum);
+  g_mapped_file_unref(json);
+  return db;
+}
+
+void dt_noiseprofile_cleanup(struct dt_noiseprofile_db_t *db)
+{
+  if(!db) return;
+  if(db->map) g_mapped_file_unref(db->map);
+  g_free(db->data);
+  free(db);
 }
 
 int is_member(gchar** names, char* name)
@@ -229,141 +393,193 @@ end:
 }
 #undef _ERROR
 
-GList *dt_noiseprofile_get_matching(const dt_image_t *cimg)
+static uint32_t _add_string(GByteArray *strings, const gchar *str)
 {
-  JsonParser *parser = darktable.noiseprofile_parser;
-  JsonReader *reader = NULL;
-  GList *result = NULL;
-
-  if(!parser) goto end;
-
-  dt_print(DT_DEBUG_CONTROL, "[noiseprofile] looking for maker `%s', model `%s'\n", cimg->camera_maker, cimg->camera_model);
-
-  JsonNode *root = json_parser_get_root(parser);
+  const uint32_t offset = strings->len;
+  if(!str) str = "";
+  g_byte_array_append(strings, (const guint8 *)str, strlen(str) + 1);
+  return offset;
+}
 
-  reader = json_reader_new(root);
+// flatten a verified JSON database, see the layout on top of the file
+static gchar *_compile(JsonParser *parser, const gchar *checksum, size_t *size)
+{
+  GArray *models = g_array_new(FALSE, FALSE, sizeof(dt_noiseprofile_cache_model_t));
+  GArray *profiles = g_array_new(FALSE, FALSE, sizeof(dt_noiseprofile_cache_profile_t));
+  GByteArray *strings = g_byte_array_new();
+  _add_string(strings, "");
 
+  JsonReader *reader = json_reader_new(json_parser_get_root(parser));
   json_reader_read_member(reader, "noiseprofiles");
 
-  // go through all makers
   const int n_makers = json_reader_count_elements(reader);
-  dt_print(DT_DEBUG_CONTROL, "[noiseprofile] found %d makers\n", n_makers);
   for(int i = 0; i < n_makers; i++)
   {
     json_reader_read_element(reader, i);
-
     json_reader_read_member(reader, "maker");
+    const uint32_t maker = _add_string(strings, json_reader_get_string_value(reader));
+    json_reader_end_member(reader);
 
-    if(g_strstr_len(cimg->camera_maker, -1, json_reader_get_string_value(reader)))
+    json_reader_read_member(reader, "models");
+    const int n_models = json_reader_count_elements(reader);
+    for(int j = 0; j < n_models; j++)
     {
-      dt_print(DT_DEBUG_CONTROL, "[noiseprofile] found `%s' as `%s'\n", cimg->camera_maker, json_reader_get_string_value(reader));
-      // go through all models and check those
-      json_reader_end_member(reader);
+      json_reader_read_element(reader, j);
 
-      json_reader_read_member(reader, "models");
+      dt_noiseprofile_cache_model_t model = { .maker = maker, .first = profiles->len,
+                                              .next = DT_NOISE_PROFILE_CACHE_END };
+      json_reader_read_member(reader, "model");
+      model.model = _add_string(strings, json_reader_get_string_value(reader));
+      json_reader_end_member(reader);
 
-      const int n_models = json_reader_count_elements(reader);
-      dt_print(DT_DEBUG_CONTROL, "[noiseprofile] found %d models\n", n_models);
-      for(int j = 0; j < n_models; j++)
+      json_reader_read_member(reader, "profiles");
+      const int n_profiles = json_reader_count_elements(reader);
+      for(int k = 0; k < n_profiles; k++)
       {
-        json_reader_read_element(reader, j);
-
-        json_reader_read_member(reader, "model");
+        json_reader_read_element(reader, k);
 
-        if(!g_strcmp0(cimg->camera_model, json_reader_get_string_value(reader)))
+        gchar** member_names = json_reader_list_members(reader);
+        gboolean skip = FALSE;
+        if(is_member(member_names, "skip"))
         {
-          dt_print(DT_DEBUG_CONTROL, "[noiseprofile] found %s\n", cimg->camera_model);
-          // we got a match, return at most bufsize elements
+          json_reader_read_member(reader, "skip");
+          skip = json_reader_get_boolean_value(reader);
           json_reader_end_member(reader);
+        }
+        g_strfreev(member_names);
+        if(skip)
+        {
+          json_reader_end_element(reader);
+          continue;
+        }
+
+        dt_noiseprofile_cache_profile_t profile = { 0 };
+
+        json_reader_read_member(reader, "name");
+        profile.name = _add_string(strings, json_reader_get_string_value(reader));
+        json_reader_end_member(reader);
+
+        json_reader_read_member(reader, "iso");
+        profile.iso = json_reader_get_double_value(reader);
+        json_reader_end_member(reader);
 
-          json_reader_read_member(reader, "profiles");
-
-          const int n_profiles = json_reader_count_elements(reader);
-          dt_print(DT_DEBUG_CONTROL, "[noiseprofile] found %d profiles\n", n_profiles);
-          for(int k = 0; k < n_profiles; k++)
-          {
-            dt_noiseprofile_t tmp_profile = { 0 };
-
-            json_reader_read_element(reader, k);
-
-            gchar** member_names = json_reader_list_members(reader);
-
-            // do we want to skip this entry?
-            if(is_member(member_names, "skip"))
-            {
-              json_reader_read_member(reader, "skip");
-              gboolean skip = json_reader_get_boolean_value(reader);
-              json_reader_end_member(reader);
-              if(skip)
-              {
-                json_reader_end_element(reader);
-                g_strfreev(member_names);
-                continue;
-              }
-            }
-
-            // maker
-            tmp_profile.maker = g_strdup(cimg->camera_maker);
-
-            // model
-            tmp_profile.model = g_strdup(cimg->camera_model);
-
-            // name
-            json_reader_read_member(reader, "name");
-            tmp_profile.name = g_strdup(json_reader_get_string_value(reader));
-            json_reader_end_member(reader);
-
-            // iso
-            json_reader_read_member(reader, "iso");
-            tmp_profile.iso = json_reader_get_double_value(reader);
-            json_reader_end_member(reader);
-
-            // a
-            json_reader_read_member(reader, "a");
-            for(int a = 0; a < 3; a++)
-            {
-              json_reader_read_element(reader, a);
-              tmp_profile.a[a] = json_reader_get_double_value(reader);
-              json_reader_end_element(reader);
-            }
-            json_reader_end_member(reader);
-
-            // b
-            json_reader_read_member(reader, "b");
-            for(int b = 0; b < 3; b++)
-            {
-              json_reader_read_element(reader, b);
-              tmp_profile.b[b] = json_reader_get_double_value(reader);
-              json_reader_end_element(reader);
-            }
-            json_reader_end_member(reader);
-
-            json_reader_end_element(reader);
-
-            // everything worked out, add tmp_profile to result
-            dt_noiseprofile_t *new_profile = (dt_noiseprofile_t *)malloc(sizeof(dt_noiseprofile_t));
-            *new_profile = tmp_profile;
-            result = g_list_prepend(result, new_profile);
-
-            g_strfreev(member_names);
-          } // profiles
-
-          goto end;
+        json_reader_read_member(reader, "a");
+        for(int a = 0; a < 3; a++)
+        {
+          json_reader_read_element(reader, a);
+          profile.a[a] = json_reader_get_double_value(reader);
+          json_reader_end_element(reader);
         }
+        json_reader_end_member(reader);
 
+        json_reader_read_member(reader, "b");
+        for(int b = 0; b < 3; b++)
+        {
+          json_reader_read_element(reader, b);
+          profile.b[b] = json_reader_get_double_value(reader);
+          json_reader_end_element(reader);
+        }
         json_reader_end_member(reader);
+
         json_reader_end_element(reader);
-      } // models
-    }
+        g_array_append_val(profiles, profile);
+      } // profiles
+      json_reader_end_member(reader);
 
+      model.count = profiles->len - model.first;
+      g_array_append_val(models, model);
+      json_reader_end_element(reader);
+    } // models
     json_reader_end_member(reader);
     json_reader_end_element(reader);
   } // makers
-
   json_reader_end_member(reader);
+  g_object_unref(reader);
+
+  // keep the strings blob a multiple of 4 so the whole file stays aligned if extended
+  while(strings->len % 4) g_byte_array_append(strings, (const guint8 *)"", 1);
+
+  dt_noiseprofile_cache_header_t header = { .magic = DT_NOISE_PROFILE_CACHE_MAGIC };
+  header.version = DT_NOISE_PROFILE_CACHE_VERSION << 16 | DT_NOISE_PROFILE_VERSION;
+  header.n_buckets = g_spaced_primes_closest(MAX(models->len, 1));
+  header.n_models = models->len;
+  header.n_profiles = profiles->len;
+  header.strings_size = strings->len;
+  g_strlcpy(header.checksum, checksum, sizeof(header.checksum));
+
+  *size = _cache_size(&header);
+  gchar *data = g_malloc0(*size);
+  memcpy(data, &header, sizeof(header));
+  uint32_t *buckets = (uint32_t *)(data + sizeof(header));
+  dt_noiseprofile_cache_model_t *out_models = (dt_noiseprofile_cache_model_t *)(buckets + header.n_buckets);
+  dt_noiseprofile_cache_profile_t *out_profiles = (dt_noiseprofile_cache_profile_t *)(out_models + header.n_models);
+  char *out_strings = (char *)(out_profiles + header.n_profiles);
+
+  memcpy(out_models, models->data, sizeof(dt_noiseprofile_cache_model_t) * header.n_models);
+  memcpy(out_profiles, profiles->data, sizeof(dt_noiseprofile_cache_profile_t) * header.n_profiles);
+  memcpy(out_strings, strings->data, header.strings_size);
+
+  // chain the models of each bucket in file order
+  uint32_t *tails = g_malloc(sizeof(uint32_t) * header.n_buckets);
+  for(uint32_t k = 0; k < header.n_buckets; k++) buckets[k] = tails[k] = DT_NOISE_PROFILE_CACHE_END;
+  for(uint32_t k = 0; k < header.n_models; k++)
+  {
+    const uint32_t bucket = g_str_hash(out_strings + out_models[k].model) % header.n_buckets;
+    if(tails[bucket] == DT_NOISE_PROFILE_CACHE_END)
+      buckets[bucket] = k;
+    else
+      out_models[tails[bucket]].next = k;
+    tails[bucket] = k;
+  }
+  g_free(tails);
+
+  dt_print(DT_DEBUG_CONTROL, "[noiseprofile] compiled %u models, %u profiles\n", header.n_models, header.n_profiles);
+
+  g_array_free(models, TRUE);
+  g_array_free(profiles, TRUE);
+  g_byte_array_free(strings, TRUE);
+  return data;
+}
+
+GList *dt_noiseprofile_get_matching(const dt_image_t *cimg)
+{
+  const dt_noiseprofile_db_t *db = darktable.noiseprofiles;
+  GList *result = NULL;
+
+  if(!db) return NULL;
+
+  dt_print(DT_DEBUG_CONTROL, "[noiseprofile] looking for maker `%s', model `%s'\n", cimg->camera_maker, cimg->camera_model);
+
+  const uint32_t bucket = g_str_hash(cimg->camera_model) % db->header->n_buckets;
+  for(uint32_t m = db->buckets[bucket]; m != DT_NOISE_PROFILE_CACHE_END; m = db->models[m].next)
+  {
+    const dt_noiseprofile_cache_model_t *model = db->models + m;
+    if(g_strcmp0(cimg->camera_model, db->strings + model->model)
+       || !g_strstr_len(cimg->camera_maker, -1, db->strings + model->maker))
+      continue;
+
+    dt_print(DT_DEBUG_CONTROL, "[noiseprofile] found `%s' as `%s', %u profiles\n", cimg->camera_maker,
+             db->strings + model->maker, model->count);
+
+    for(uint32_t k = 0; k < model->count; k++)
+    {
+      const dt_noiseprofile_cache_profile_t *profile = db->profiles + model->first + k;
+      dt_noiseprofile_t *new_profile = (dt_noiseprofile_t *)malloc(sizeof(dt_noiseprofile_t));
+      new_profile->name = g_strdup(db->strings + profile->name);
+      new_profile->maker = g_strdup(cimg->camera_maker);
+      new_profile->model = g_strdup(cimg->camera_model);
+      new_profile->iso = profile->iso;
+      for(int c = 0; c < 3; c++)
+      {
+        new_profile->a[c] = profile->a[c];
+        new_profile->b[c] = profile->b[c];
+      }
+      new_profile->a[3] = new_profile->b[3] = 0.0f;
+      result = g_list_prepend(result, new_profile);
+    }
+    break;
+  }
 
-end:
-  if(reader) g_object_unref(reader);
   if(result) result = g_list_sort(result, _sort_by_iso);
   return result;
 }
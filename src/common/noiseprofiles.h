@@ -35,8 +35,13 @@ dt_noiseprofile_t;
 
 extern const dt_noiseprofile_t dt_noiseprofile_generic;
 
-/** read the noiseprofile file once on startup (kind of)*/
-JsonParser *dt_noiseprofile_init(const char *alternative);
+struct dt_noiseprofile_db_t;
+
+/** read the noiseprofile file once on startup (kind of), through its compiled copy in the cache dir */
+struct dt_noiseprofile_db_t *dt_noiseprofile_init(const char *alternative);
+
+/** free what dt_noiseprofile_init() returned */
+void dt_noiseprofile_cleanup(struct dt_noiseprofile_db_t *db);
 
 /*
  * returns the noiseprofiles matching the image's exif data.
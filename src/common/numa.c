@@ -0,0 +1,177 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+
+#include "common/numa.h"
+#include "common/darktable.h"
+#include "control/conf.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#define DT_NUMA_MAX_NODES 16
+
+typedef struct dt_numa_t
+{
+  int nodes;                // nodes in use, 1 = NUMA mode off
+  gboolean pin;             // pin the threads of a pipe to its node
+  size_t page;
+  int threads[DT_NUMA_MAX_NODES];
+#ifdef __linux__
+  cpu_set_t all;            // affinity of the process on startup
+  cpu_set_t cpus[DT_NUMA_MAX_NODES];
+#endif
+} dt_numa_t;
+
+static dt_numa_t _numa = { .nodes = 1 };
+
+#ifdef __linux__
+// parse a sysfs list like "0-15,32-47"
+static void _parse_list(const char *list, cpu_set_t *set)
+{
+  CPU_ZERO(set);
+  const char *c = list;
+  while(*c)
+  {
+    char *end = NULL;
+    const long first = strtol(c, &end, 10);
+    if(end == c) break;
+    long last = first;
+    c = end;
+    if(*c == '-')
+    {
+      last = strtol(c + 1, &end, 10);
+      c = end;
+    }
+    for(long k = MAX(first, 0); k <= last && k < CPU_SETSIZE; k++) CPU_SET(k, set);
+    if(*c != ',') break;
+    c++;
+  }
+}
+
+static gboolean _read_list(const char *path, cpu_set_t *set)
+{
+  gchar *list = NULL;
+  if(!g_file_get_contents(path, &list, NULL, NULL)) return FALSE;
+  _parse_list(list, set);
+  g_free(list);
+  return TRUE;
+}
+
+// the calling thread, then the workers libgomp keeps for it. new workers inherit the mask.
+static void _set_affinity(const cpu_set_t *set)
+{
+  sched_setaffinity(0, sizeof(cpu_set_t), set);
+#ifdef _OPENMP
+#pragma omp parallel default(none) dt_omp_firstprivate(set)
+  sched_setaffinity(0, sizeof(cpu_set_t), set);
+#endif
+}
+#endif
+
+void dt_numa_init(void)
+{
+  _numa.nodes = 1;
+#ifdef __linux__
+  if(!dt_conf_get_bool("numa_mode")) return;
+
+  cpu_set_t online;
+  if(sched_getaffinity(0, sizeof(cpu_set_t), &_numa.all)
+     || !_read_list("/sys/devices/system/node/online", &online))
+  {
+    dt_print(DT_DEBUG_PERF, "[numa] can't read the topology, NUMA mode disabled\n");
+    return;
+  }
+
+  int nodes = 0;
+  for(int id = 0; id < CPU_SETSIZE && nodes < DT_NUMA_MAX_NODES; id++)
+  {
+    if(!CPU_ISSET(id, &online)) continue;
+    gchar *path = g_strdup_printf("/sys/devices/system/node/node%d/cpulist", id);
+    const gboolean found = _read_list(path, &_numa.cpus[nodes]);
+    g_free(path);
+    if(!found) continue;
+
+    // only the cores we are allowed to run on. nodes with memory and no core are skipped
+    CPU_AND(&_numa.cpus[nodes], &_numa.cpus[nodes], &_numa.all);
+    const int count = CPU_COUNT(&_numa.cpus[nodes]);
+    if(count == 0) continue;
+    _numa.threads[nodes] = MIN(count, darktable.num_openmp_threads);
+    dt_print(DT_DEBUG_PERF, "[numa] node %d: %d threads\n", id, _numa.threads[nodes]);
+    nodes++;
+  }
+
+  if(nodes < 2) return;
+  _numa.nodes = nodes;
+  _numa.pin = dt_conf_get_bool("numa_pin_threads");
+  _numa.page = MAX(sysconf(_SC_PAGESIZE), 512);
+  dt_print(DT_DEBUG_PERF, "[numa] using %d nodes%s\n", nodes, _numa.pin ? ", threads pinned" : "");
+#endif
+}
+
+int dt_numa_nodes(void)
+{
+  return _numa.nodes;
+}
+
+void dt_numa_bind_thread(const int node)
+{
+  if(_numa.nodes < 2) return;
+#ifdef __linux__
+  const int n = node % _numa.nodes;
+#ifdef _OPENMP
+  omp_set_num_threads(_numa.threads[n]);
+#endif
+  if(_numa.pin) _set_affinity(&_numa.cpus[n]);
+#endif
+}
+
+void dt_numa_unbind_thread(void)
+{
+  if(_numa.nodes < 2) return;
+#ifdef _OPENMP
+  omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+#ifdef __linux__
+  if(_numa.pin) _set_affinity(&_numa.all);
+#endif
+}
+
+void dt_numa_first_touch(void *buffer, const size_t size)
+{
+  if(_numa.nodes < 2 || !buffer) return;
+
+  // one write per page is enough for the kernel to place it on the node of the writer.
+  // modules split their rows in as many contiguous chunks as threads, so does this.
+  char *const buf = (char *)buffer;
+  const size_t page = _numa.page;
+  const size_t pages = (size + page - 1) / page;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(buf, page, pages) schedule(static)
+#endif
+  for(size_t k = 0; k < pages; k++) buf[k * page] = 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,54 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * NUMA mode, for machines with several memory nodes (multi-socket workstations, render nodes).
+ *
+ * When the `numa_mode' config key is set and more than one node is online:
+ * - each export pipe runs on one node, its OpenMP team limited to the cores of that node and
+ *   optionally pinned to them (`numa_pin_threads'),
+ * - new pixelpipe cache buffers are first touched by that team in the static schedule the
+ *   modules use, so the kernel places the pages of each thread's rows on its own node.
+ *
+ * Topology is read from sysfs, so this is Linux only. Everything is a no-op otherwise.
+ */
+
+/** read the topology and the config. call once after dt_conf_init(). */
+void dt_numa_init(void);
+
+/** number of nodes used, 1 when the NUMA mode is off. */
+int dt_numa_nodes(void);
+
+/** bind the calling thread and its OpenMP team to node % dt_numa_nodes(). */
+void dt_numa_bind_thread(const int node);
+
+/** give the calling thread and its OpenMP team all the cores back. */
+void dt_numa_unbind_thread(void);
+
+/** fault in a freshly allocated buffer from the current OpenMP team, page by page. */
+void dt_numa_first_touch(void *buffer, const size_t size);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -27,11 +27,13 @@
 #include "common/gaussian.h"
 #include "common/guided_filter.h"
 #include "common/heal.h"
+#include "common/histogram.h"
 #include "common/interpolation.h"
 #include "common/locallaplaciancl.h"
+#include "common/memstat.h"
 #include "common/nvidia_gpus.h"
 #include "common/opencl_drivers_blacklist.h"
-#include "common/tea.h"
+#include "common/trace.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
@@ -50,8 +52,6 @@
 #include <zlib.h>
 
 static const char *dt_opencl_get_vendor_by_id(unsigned int id);
-static float dt_opencl_benchmark_gpu(const int devid, const size_t width, const size_t height, const int count, const float sigma);
-static float dt_opencl_benchmark_cpu(const size_t width, const size_t height, const int count, const float sigma);
 static char *_ascii_str_canonical(const char *in, char *out, int maxlen);
 /** parse a single token of priority string and store priorities in priority_list */
 static void dt_opencl_priority_parse(dt_opencl_t *cl, char *configstr, int *priority_list, int *mandatory);
@@ -208,6 +208,203 @@ gboolean dt_opencl_use_pinned_memory(const int devid)
   return (cl->dev[devid].tuneactive & DT_OPENCL_TUNE_PINNED);
 }
 
+gboolean dt_opencl_use_host_memory(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0) return FALSE;
+  return cl->dev[devid].unified_memory && cl->zero_copy;
+}
+
+gboolean dt_opencl_use_overlapped_transfers(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0) return FALSE;
+  return cl->overlapped_tiling && cl->dev[devid].upload_queue && cl->dev[devid].download_queue;
+}
+
+static void _perf_model_init(dt_opencl_perf_model_t *model)
+{
+  dt_pthread_mutex_init(&model->lock, NULL);
+  model->modules = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+}
+
+static void _perf_model_cleanup(dt_opencl_perf_model_t *model)
+{
+  if(model->modules == NULL) return;
+  g_hash_table_destroy(model->modules);
+  model->modules = NULL;
+  dt_pthread_mutex_destroy(&model->lock);
+}
+
+// the config string is a space-separated list of "op:t0,t1,..." with one time per bucket
+static void _perf_model_read(dt_opencl_perf_model_t *model, const char *key)
+{
+  if(!dt_conf_key_not_empty(key)) return;
+
+  gchar **modules = g_strsplit(dt_conf_get_string_const(key), " ", -1);
+  dt_pthread_mutex_lock(&model->lock);
+  for(gchar **m = modules; *m; m++)
+  {
+    gchar **fields = g_strsplit(*m, ":", 2);
+    if(fields[0] && fields[0][0] && fields[1])
+    {
+      dt_opencl_perf_entry_t *entry = g_new0(dt_opencl_perf_entry_t, 1);
+      gchar **times = g_strsplit(fields[1], ",", DT_OPENCL_PERF_BUCKETS);
+      for(int b = 0; b < DT_OPENCL_PERF_BUCKETS && times[b]; b++)
+      {
+        const float t = g_ascii_strtod(times[b], NULL);
+        entry->time[b] = (isfinite(t) && t > 0.0f) ? t : 0.0f;
+      }
+      g_strfreev(times);
+      g_hash_table_replace(model->modules, g_strdup(fields[0]), entry);
+    }
+    g_strfreev(fields);
+  }
+  dt_pthread_mutex_unlock(&model->lock);
+  g_strfreev(modules);
+}
+
+static void _perf_model_write(dt_opencl_perf_model_t *model, const char *key)
+{
+  GString *dat = g_string_new(NULL);
+  dt_pthread_mutex_lock(&model->lock);
+  GHashTableIter iter;
+  gpointer op, value;
+  g_hash_table_iter_init(&iter, model->modules);
+  while(g_hash_table_iter_next(&iter, &op, &value))
+  {
+    const dt_opencl_perf_entry_t *entry = (const dt_opencl_perf_entry_t *)value;
+    g_string_append_printf(dat, "%s%s:", dat->len ? " " : "", (const char *)op);
+    for(int b = 0; b < DT_OPENCL_PERF_BUCKETS; b++)
+    {
+      char num[G_ASCII_DTOSTR_BUF_SIZE];
+      g_ascii_formatd(num, sizeof(num), "%.4g", entry->time[b]);
+      g_string_append_printf(dat, "%s%s", b ? "," : "", num);
+    }
+  }
+  dt_pthread_mutex_unlock(&model->lock);
+
+  if(dat->len) dt_conf_set_string(key, dat->str);
+  g_string_free(dat, TRUE);
+}
+
+// 0 below 256k pixels, then one bucket per doubling
+static int _perf_bucket(const size_t npixels)
+{
+  int b = 0;
+  for(size_t n = npixels >> 18; n && b < DT_OPENCL_PERF_BUCKETS - 1; n >>= 1) b++;
+  return b;
+}
+
+static dt_opencl_perf_entry_t *_perf_entry(dt_opencl_perf_model_t *model, const char *op, const gboolean create)
+{
+  dt_opencl_perf_entry_t *entry = g_hash_table_lookup(model->modules, op);
+  if(entry == NULL && create)
+  {
+    entry = g_new0(dt_opencl_perf_entry_t, 1);
+    g_hash_table_insert(model->modules, g_strdup(op), entry);
+  }
+  return entry;
+}
+
+// the device keeps the module unless the CPU was measured this much faster:
+// the CPU also runs the GUI, and switching adds transfers not accounted in the CPU times.
+#define DT_OPENCL_PERF_MARGIN 1.25f
+// the slower side is measured again every that many decisions
+#define DT_OPENCL_PERF_RETRY 64
+
+gboolean dt_opencl_perf_prefer_device(const int devid, const char *op, const size_t npixels,
+                                      const size_t device_bytes, const size_t cpu_bytes)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || !cl->perf_model || devid < 0 || devid >= cl->num_devs) return TRUE;
+
+  const int b = _perf_bucket(npixels);
+  const float mpix = npixels / 1e6f;
+
+  dt_pthread_mutex_lock(&cl->cpu_perf.lock);
+  const dt_opencl_perf_entry_t *cpu = _perf_entry(&cl->cpu_perf, op, FALSE);
+  const float tcpu = cpu ? cpu->time[b] : 0.0f;
+  dt_pthread_mutex_unlock(&cl->cpu_perf.lock);
+
+  dt_opencl_perf_model_t *model = &cl->dev[devid].perf;
+  dt_pthread_mutex_lock(&model->lock);
+  dt_opencl_perf_entry_t *entry = _perf_entry(model, op, TRUE);
+  const float tgpu = entry->time[b];
+  const float transfer = cl->dev[devid].transfer_time;
+
+  // unknown times favour the device, as before.
+  // Transfers are added to both sides, in seconds: a module the device runs faster may still be cheaper
+  // on the CPU when its neighbours run there too.
+  const float cost_gpu = tgpu * mpix + transfer * device_bytes / 1e6f;
+  const float cost_cpu = tcpu * mpix + transfer * cpu_bytes / 1e6f;
+  gboolean device = (tcpu <= 0.0f || tgpu <= 0.0f || cost_gpu < DT_OPENCL_PERF_MARGIN * cost_cpu);
+
+  // keep the model up to date, unless trying the other side could take long.
+  // The CPU side is unknown while all pipes got a device, only try it on small regions.
+  if(++entry->runs[b] >= DT_OPENCL_PERF_RETRY)
+  {
+    entry->runs[b] = 0;
+    const float other = device ? tcpu : tgpu;
+    if(other > 0.0f ? other * mpix < 0.5f : mpix < 1.0f) device = !device;
+  }
+  dt_pthread_mutex_unlock(&model->lock);
+
+  if(!device)
+    dt_print(DT_DEBUG_OPENCL | DT_DEBUG_PERF,
+             "[dt_opencl_perf_prefer_device] `%s' on CPU for %.2f Mpix: CPU %.3f s/Mpix, device %i %.3f s/Mpix, "
+             "transfers %.1f MB vs %.1f MB at %.4f s/MB\n",
+             op, mpix, tcpu, devid, tgpu, device_bytes / 1e6f, cpu_bytes / 1e6f, transfer);
+  return device;
+}
+
+void dt_opencl_perf_record(const int devid, const int pipetype, const char *op, const size_t npixels,
+                           const double seconds)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid >= cl->num_devs || npixels == 0 || !(seconds > 0.0)) return;
+
+  // without synchronization, the pipe only measured how long enqueuing took
+  if(devid >= 0 && !cl->event_sync && cl->dev[devid].asyncmode
+     && (pipetype & DT_DEV_PIXELPIPE_EXPORT) != DT_DEV_PIXELPIPE_EXPORT)
+    return;
+
+  dt_opencl_perf_model_t *model = (devid < 0) ? &cl->cpu_perf : &cl->dev[devid].perf;
+  const int b = _perf_bucket(npixels);
+  const float t = seconds * 1e6 / npixels;
+
+  dt_pthread_mutex_lock(&model->lock);
+  dt_opencl_perf_entry_t *entry = _perf_entry(model, op, TRUE);
+  entry->time[b] = (entry->time[b] > 0.0f) ? 0.8f * entry->time[b] + 0.2f * t : t;
+  dt_pthread_mutex_unlock(&model->lock);
+}
+
+// copies below that size are dominated by the latency of the call
+#define DT_OPENCL_PERF_MIN_TRANSFER (1 << 20)
+
+static void _perf_record_transfer(const int devid, const size_t bytes, const double seconds)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(devid < 0 || devid >= cl->num_devs || bytes < DT_OPENCL_PERF_MIN_TRANSFER || !(seconds > 0.0)) return;
+
+  dt_opencl_perf_model_t *model = &cl->dev[devid].perf;
+  const float t = seconds * 1e6 / bytes;
+  dt_pthread_mutex_lock(&model->lock);
+  float *const transfer = &cl->dev[devid].transfer_time;
+  *transfer = (*transfer > 0.0f) ? 0.8f * *transfer + 0.2f * t : t;
+  dt_pthread_mutex_unlock(&model->lock);
+}
+
+void dt_opencl_perf_save(void)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited) return;
+  gchar key[256] = { 0 };
+  g_snprintf(key, 254, "%scpu_perf", DT_CLDEVICE_HEAD);
+  _perf_model_write(&cl->cpu_perf, key);
+  for(int dev = 0; dev < cl->num_devs; dev++) dt_opencl_write_device_config(dev);
+}
+
 void dt_opencl_write_device_config(const int devid)
 {
   if(devid < 0) return;
@@ -215,7 +412,7 @@ void dt_opencl_write_device_config(const int devid)
   gchar key[256] = { 0 };
   gchar dat[512] = { 0 };
   g_snprintf(key, 254, "%s%s", DT_CLDEVICE_HEAD, cl->dev[devid].cname);
-  g_snprintf(dat, 510, "%i %i %i %i %i %i %i %i %f",
+  g_snprintf(dat, 510, "%i %i %i %i %i %i %i %i",
     cl->dev[devid].avoid_atomics,
     cl->dev[devid].micro_nap,
     cl->dev[devid].pinned_memory & (DT_OPENCL_PINNING_ON | DT_OPENCL_PINNING_DISABLED),
@@ -223,8 +420,7 @@ void dt_opencl_write_device_config(const int devid)
     cl->dev[devid].clroundup_ht,
     cl->dev[devid].event_handles,
     cl->dev[devid].asyncmode & 1,
-    cl->dev[devid].disabled & 1,
-    cl->dev[devid].benchmark);
+    cl->dev[devid].disabled & 1);
   dt_vprint(DT_DEBUG_OPENCL, "[dt_opencl_write_device_config] writing data '%s' for '%s'\n", dat, key);
   dt_conf_set_string(key, dat);
 
@@ -234,6 +430,9 @@ void dt_opencl_write_device_config(const int devid)
   g_snprintf(dat, 510, "%i", cl->dev[devid].forced_headroom);
   dt_vprint(DT_DEBUG_OPENCL, "[dt_opencl_write_device_config] writing data '%s' for '%s'\n", dat, key);
   dt_conf_set_string(key, dat);
+
+  g_snprintf(key, 254, "%s%s_perf", DT_CLDEVICE_HEAD, cl->dev[devid].cname);
+  _perf_model_write(&cl->dev[devid].perf, key);
 }
 
 gboolean dt_opencl_read_device_config(const int devid)
@@ -256,9 +455,9 @@ gboolean dt_opencl_read_device_config(const int devid)
     int event_handles;
     int asyncmode;
     int disabled;
-    float benchmark;
-    sscanf(dat, "%i %i %i %i %i %i %i %i %f",
-      &avoid_atomics, &micro_nap, &pinned_memory, &wd, &ht, &event_handles, &asyncmode, &disabled, &benchmark);
+    // older versions stored a benchmark result after these, it's ignored
+    sscanf(dat, "%i %i %i %i %i %i %i %i",
+      &avoid_atomics, &micro_nap, &pinned_memory, &wd, &ht, &event_handles, &asyncmode, &disabled);
 
     // some rudimentary safety checking if string seems to be ok
     safety_ok = (wd > 1) && (wd < 513) && (ht > 1) && (ht < 513);
@@ -273,7 +472,6 @@ gboolean dt_opencl_read_device_config(const int devid)
       cl->dev[devid].event_handles = event_handles;
       cl->dev[devid].asyncmode = asyncmode;
       cl->dev[devid].disabled = disabled;
-      cl->dev[devid].benchmark = benchmark;
     }
     else // if there is something wrong with the found conf key reset to defaults
     {
@@ -290,7 +488,6 @@ gboolean dt_opencl_read_device_config(const int devid)
     cl->dev[devid].clroundup_ht = 16;
   if(cl->dev[devid].event_handles < 0)
     cl->dev[devid].event_handles = 0x40000000;
-  cl->dev[devid].benchmark = fminf(1e6, fmaxf(0.0f, cl->dev[devid].benchmark));
 
   cl->dev[devid].use_events = (cl->dev[devid].event_handles != 0) ? 1 : 0;
   cl->dev[devid].asyncmode &= 1;
@@ -307,20 +504,212 @@ gboolean dt_opencl_read_device_config(const int devid)
   }
   else // this is used if updating to 4.0 or fresh installs; see commenting _opencl_get_unused_device_mem()
     cl->dev[devid].forced_headroom = 400;
+
+  g_snprintf(key, 254, "%s%s_perf", DT_CLDEVICE_HEAD, cl->dev[devid].cname);
+  _perf_model_read(&cl->dev[devid].perf, key);
+
   dt_opencl_write_device_config(devid);
   return !existing_device || !safety_ok;
 }
 
-static float dt_opencl_device_perfgain(const int devid)
+// returns 0 if all ok or an error if we failed to init this device
+typedef struct dt_opencl_pool_entry_t
+{
+  cl_mem mem;
+  uint64_t key;
+  size_t size;
+} dt_opencl_pool_entry_t;
+
+// images and buffers never share a key: the lowest bit tells them apart.
+static inline uint64_t _pool_image_key(const int width, const int height, const int bpp)
+{
+  return ((uint64_t)width << 40) | ((uint64_t)height << 16) | ((uint64_t)bpp << 1);
+}
+
+static inline uint64_t _pool_buffer_key(const size_t size)
+{
+  return ((uint64_t)size << 1) | 1;
+}
+
+static void _pool_init(dt_opencl_mem_pool_t *pool)
+{
+  dt_pthread_mutex_init(&pool->lock, NULL);
+  g_queue_init(&pool->idle);
+  pool->used = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
+  pool->idle_memory = pool->used_memory = pool->peak_memory = 0;
+  pool->hits = pool->misses = 0;
+}
+
+// destroy the idle buffers. returns TRUE if there was any. to be called with pool->lock held.
+static gboolean _pool_flush_locked(dt_opencl_mem_pool_t *pool)
+{
+  const gboolean any = (pool->idle.head != NULL);
+  dt_opencl_pool_entry_t *entry;
+  while((entry = (dt_opencl_pool_entry_t *)g_queue_pop_head(&pool->idle)))
+  {
+    (darktable.opencl->dlocl->symbols->dt_clReleaseMemObject)(entry->mem);
+    free(entry);
+  }
+  pool->idle_memory = 0;
+  return any;
+}
+
+static gboolean _pool_flush(const int devid)
+{
+  dt_opencl_mem_pool_t *pool = &darktable.opencl->dev[devid].pool;
+  dt_pthread_mutex_lock(&pool->lock);
+  const gboolean any = _pool_flush_locked(pool);
+  dt_pthread_mutex_unlock(&pool->lock);
+  return any;
+}
+
+static void _pool_cleanup(dt_opencl_t *cl, const int devid)
+{
+  dt_opencl_mem_pool_t *pool = &cl->dev[devid].pool;
+  if(!pool->used) return;
+  if(cl->dlocl) _pool_flush_locked(pool);
+  if(g_hash_table_size(pool->used))
+    dt_print_nts(DT_DEBUG_OPENCL, " [opencl_pool] device %d: %u buffers were never released\n", devid,
+                 g_hash_table_size(pool->used));
+  g_hash_table_destroy(pool->used);
+  pool->used = NULL;
+  dt_pthread_mutex_destroy(&pool->lock);
+}
+
+// take the most recently released idle buffer of this geometry, if any
+static cl_mem _pool_get(const int devid, const uint64_t key)
+{
+  dt_opencl_mem_pool_t *pool = &darktable.opencl->dev[devid].pool;
+  cl_mem mem = NULL;
+  dt_pthread_mutex_lock(&pool->lock);
+  for(GList *l = pool->idle.tail; l; l = g_list_previous(l))
+  {
+    dt_opencl_pool_entry_t *entry = (dt_opencl_pool_entry_t *)l->data;
+    if(entry->key != key) continue;
+    g_queue_delete_link(&pool->idle, l);
+    pool->idle_memory -= entry->size;
+    pool->used_memory += entry->size;
+    g_hash_table_insert(pool->used, entry->mem, entry);
+    mem = entry->mem;
+    break;
+  }
+  if(mem)
+    pool->hits++;
+  else
+    pool->misses++;
+  dt_pthread_mutex_unlock(&pool->lock);
+  return mem;
+}
+
+// hand out a newly created buffer through the pool, so it gets recycled when released
+static void _pool_track(const int devid, cl_mem mem, const uint64_t key, const size_t size)
+{
+  if(mem == NULL) return;
+  dt_opencl_pool_entry_t *entry = (dt_opencl_pool_entry_t *)malloc(sizeof(dt_opencl_pool_entry_t));
+  if(!entry) return; // it will just be destroyed when released
+  entry->mem = mem;
+  entry->key = key;
+  entry->size = size;
+
+  dt_opencl_mem_pool_t *pool = &darktable.opencl->dev[devid].pool;
+  dt_pthread_mutex_lock(&pool->lock);
+  g_hash_table_insert(pool->used, mem, entry);
+  pool->used_memory += size;
+  pool->peak_memory = MAX(pool->peak_memory, pool->used_memory + pool->idle_memory);
+  dt_pthread_mutex_unlock(&pool->lock);
+}
+
+// returns FALSE if the buffer doesn't come from the pool
+static gboolean _pool_put(cl_mem mem)
+{
+  const int devid = dt_opencl_get_mem_context_id(mem);
+  if(devid < 0) return FALSE;
+
+  dt_opencl_mem_pool_t *pool = &darktable.opencl->dev[devid].pool;
+  dt_pthread_mutex_lock(&pool->lock);
+  dt_opencl_pool_entry_t *entry = (dt_opencl_pool_entry_t *)g_hash_table_lookup(pool->used, mem);
+  if(!entry)
+  {
+    dt_pthread_mutex_unlock(&pool->lock);
+    return FALSE;
+  }
+  g_hash_table_steal(pool->used, mem);
+  pool->used_memory -= entry->size;
+  g_queue_push_tail(&pool->idle, entry);
+  pool->idle_memory += entry->size;
+
+  // don't sit on more than an eighth of the device memory, oldest buffers go first
+  const size_t limit = dt_opencl_get_device_available(devid) / 8;
+  while(pool->idle_memory > limit && pool->idle.head)
+  {
+    dt_opencl_pool_entry_t *old = (dt_opencl_pool_entry_t *)g_queue_pop_head(&pool->idle);
+    (darktable.opencl->dlocl->symbols->dt_clReleaseMemObject)(old->mem);
+    pool->idle_memory -= old->size;
+    free(old);
+  }
+  dt_pthread_mutex_unlock(&pool->lock);
+  return TRUE;
+}
+
+typedef struct dt_opencl_build_job_t
+{
+  int prog;
+  char md5sum[33];
+  char binname[PATH_MAX];
+  char cachedir[PATH_MAX];
+} dt_opencl_build_job_t;
+
+// create the kernels requested while the program was compiling
+static void _opencl_program_built(dt_opencl_t *cl, const int dev, const int prog)
+{
+  dt_pthread_mutex_lock(&cl->lock);
+  cl->dev[dev].program_built[prog] = 1;
+  for(int k = 0; k < DT_OPENCL_MAX_KERNELS; k++)
+  {
+    if(!cl->dev[dev].kernel_used[k] || cl->dev[dev].kernel[k] || cl->dev[dev].kernel_program[k] != prog)
+      continue;
+    cl_int err;
+    cl_kernel kernel = (cl->dlocl->symbols->dt_clCreateKernel)(cl->dev[dev].program[prog],
+                                                               cl->dev[dev].kernel_name[k], &err);
+    if(err == CL_SUCCESS)
+      cl->dev[dev].kernel[k] = kernel;
+    else
+      dt_print(DT_DEBUG_OPENCL, "[opencl_program_built] could not create kernel `%s' for device %d! (%s)\n",
+               cl->dev[dev].kernel_name[k], dev, cl_errstr(err));
+  }
+  dt_pthread_mutex_unlock(&cl->lock);
+}
+
+static void *_opencl_build_programs(void *arg)
 {
   dt_opencl_t *cl = darktable.opencl;
-  const float tcpu = cl->cpubenchmark;
-  const float tgpu = cl->dev[devid].benchmark;
-  if((tcpu < 1e-8) || (tgpu < 1e-8)) return 1.0f;
-  return (tcpu / tgpu);
+  const int dev = GPOINTER_TO_INT(arg);
+  dt_pthread_setname("opencl build");
+
+  const double start = dt_get_wtime();
+  for(GList *l = cl->dev[dev].build_jobs; l && !cl->dev[dev].build_quit; l = g_list_next(l))
+  {
+    const dt_opencl_build_job_t *job = (const dt_opencl_build_job_t *)l->data;
+    if(dt_opencl_build_program(dev, job->prog, job->binname, job->cachedir, (char *)job->md5sum, 0) == CL_SUCCESS)
+      _opencl_program_built(cl, dev, job->prog);
+    else
+      dt_print(DT_DEBUG_OPENCL, "[opencl_build_programs] failed to compile `%s' for device %d, its modules stay on CPU\n",
+               job->binname, dev);
+  }
+  dt_print(DT_DEBUG_OPENCL, "[opencl_build_programs] compiled %d programs for device %d in %.3f s\n",
+           g_list_length(cl->dev[dev].build_jobs), dev, dt_get_wtime() - start);
+  return NULL;
+}
+
+static void _opencl_start_build(dt_opencl_t *cl, const int dev)
+{
+  if(cl->dev[dev].build_jobs == NULL) return;
+  cl->dev[dev].build_running = !dt_pthread_create(&cl->dev[dev].build_thread, _opencl_build_programs,
+                                                  GINT_TO_POINTER(dev));
+  // no thread, wait for the compiler then
+  if(!cl->dev[dev].build_running) _opencl_build_programs(GINT_TO_POINTER(dev));
 }
 
-// returns 0 if all ok or an error if we failed to init this device
 static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *devices, const int k)
 {
   int res;
@@ -330,6 +719,12 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   memset(cl->dev[dev].program_used, 0x0, sizeof(int) * DT_OPENCL_MAX_PROGRAMS);
   memset(cl->dev[dev].kernel, 0x0, sizeof(cl_kernel) * DT_OPENCL_MAX_KERNELS);
   memset(cl->dev[dev].kernel_used, 0x0, sizeof(int) * DT_OPENCL_MAX_KERNELS);
+  memset(cl->dev[dev].program_built, 0x0, sizeof(int) * DT_OPENCL_MAX_PROGRAMS);
+  memset(cl->dev[dev].kernel_program, 0x0, sizeof(int) * DT_OPENCL_MAX_KERNELS);
+  memset(cl->dev[dev].kernel_name, 0x0, sizeof(char *) * DT_OPENCL_MAX_KERNELS);
+  cl->dev[dev].build_jobs = NULL;
+  cl->dev[dev].build_running = 0;
+  cl->dev[dev].build_quit = 0;
   cl->dev[dev].eventlist = NULL;
   cl->dev[dev].eventtags = NULL;
   cl->dev[dev].numevents = 0;
@@ -351,13 +746,18 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   cl->dev[dev].peak_memory = 0;
   cl->dev[dev].tuned_available = 0;
   cl->dev[dev].used_available = 0;
+  cl->dev[dev].sync_event = NULL;
+  cl->dev[dev].upload_queue = NULL;
+  cl->dev[dev].download_queue = NULL;
+  _pool_init(&cl->dev[dev].pool);
   // setting sane/conservative defaults at first
   cl->dev[dev].avoid_atomics = 0;
   cl->dev[dev].micro_nap = 250;
   cl->dev[dev].pinned_memory = DT_OPENCL_PINNING_OFF;
   cl->dev[dev].clroundup_wd = 16;
   cl->dev[dev].clroundup_ht = 16;
-  cl->dev[dev].benchmark = 0.0f;
+  _perf_model_init(&cl->dev[dev].perf);
+  cl->dev[dev].transfer_time = 0.0f;
   cl->dev[dev].use_events = 1;
   cl->dev[dev].event_handles = 128;
   cl->dev[dev].asyncmode = 0;
@@ -389,6 +789,7 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   cl_bool device_available = 0;
   cl_uint vendor_id = 0;
   cl_bool little_endian = 0;
+  cl_bool unified_memory = 0;
   cl_platform_id platform_id = 0;
 
   char *dtcache = calloc(PATH_MAX, sizeof(char));
@@ -494,6 +895,9 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   (cl->dlocl->symbols->dt_clGetDeviceInfo)(devid, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong),
                                            &(cl->dev[dev].max_mem_alloc), NULL);
   (cl->dlocl->symbols->dt_clGetDeviceInfo)(devid, CL_DEVICE_ENDIAN_LITTLE, sizeof(cl_bool), &little_endian, NULL);
+  // deprecated by OpenCL 2.0 but still answered, and we don't use SVM
+  (cl->dlocl->symbols->dt_clGetDeviceInfo)(devid, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &unified_memory, NULL);
+  cl->dev[dev].unified_memory = unified_memory ? 1 : 0;
 
   cl->dev[dev].cltype = (unsigned int)type;
 
@@ -615,9 +1019,9 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   dt_print_nts(DT_DEBUG_OPENCL, "   ROUNDUP WIDTH:            %i\n", cl->dev[dev].clroundup_wd);
   dt_print_nts(DT_DEBUG_OPENCL, "   ROUNDUP HEIGHT:           %i\n", cl->dev[dev].clroundup_ht);
   dt_print_nts(DT_DEBUG_OPENCL, "   CHECK EVENT HANDLES:      %i\n", cl->dev[dev].event_handles);
-  if(cl->dev[dev].benchmark > 0.0f)
-    dt_print_nts(DT_DEBUG_OPENCL, "   PERFORMANCE:              %f\n", dt_opencl_device_perfgain(dev));
+  dt_print_nts(DT_DEBUG_OPENCL, "   MEASURED MODULES:         %i\n", g_hash_table_size(cl->dev[dev].perf.modules));
   dt_print_nts(DT_DEBUG_OPENCL, "   DEFAULT DEVICE:           %s\n", (type & CL_DEVICE_TYPE_DEFAULT) ? "YES" : "NO");
+  dt_print_nts(DT_DEBUG_OPENCL, "   UNIFIED MEMORY:           %s\n", cl->dev[dev].unified_memory ? "YES" : "NO");
 
   if(cl->dev[dev].disabled)
   {
@@ -627,6 +1031,8 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   }
 
   dt_pthread_mutex_init(&cl->dev[dev].lock, NULL);
+  g_mutex_init(&cl->dev[dev].done_lock);
+  g_cond_init(&cl->dev[dev].done_cond);
 
   cl->dev[dev].context = (cl->dlocl->symbols->dt_clCreateContext)(0, 1, &devid, NULL, NULL, &err);
   if(err != CL_SUCCESS)
@@ -644,6 +1050,17 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
     res = -1;
     goto end;
   }
+  // tiles are moved on two more queues while the kernels run, they are not mandatory
+  const cl_command_queue_properties queue_properties
+      = (darktable.unmuted & DT_DEBUG_PERF) ? CL_QUEUE_PROFILING_ENABLE : 0;
+  cl->dev[dev].upload_queue = (cl->dlocl->symbols->dt_clCreateCommandQueue)(cl->dev[dev].context, devid,
+                                                                            queue_properties, &err);
+  if(err != CL_SUCCESS) cl->dev[dev].upload_queue = NULL;
+  cl->dev[dev].download_queue = (cl->dlocl->symbols->dt_clCreateCommandQueue)(cl->dev[dev].context, devid,
+                                                                              queue_properties, &err);
+  if(err != CL_SUCCESS) cl->dev[dev].download_queue = NULL;
+  if(cl->dev[dev].upload_queue == NULL || cl->dev[dev].download_queue == NULL)
+    dt_print_nts(DT_DEBUG_OPENCL, "   *** could not create transfer queues, tiles won't overlap ***\n");
 
   dt_loc_get_kerneldir(kerneldir, sizeof(kerneldir));
   dt_print_nts(DT_DEBUG_OPENCL, "   KERNEL SOURCE DIRECTORY:  %s\n", kerneldir);
@@ -730,8 +1147,10 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
     dt_conf_save(darktable.conf);
   }
 
-  // now load all darktable cl kernels.
-  // TODO: compile as a job?
+  // now load all darktable cl kernels. Cached binaries are built right away, it's quick.
+  // With a GUI, programs that need compiling from source are built in background once all devices are inited:
+  // their modules run on CPU meanwhile.
+  const gboolean background_build = (darktable.gui != NULL);
   tstart = dt_get_wtime();
   FILE *f = g_fopen(filename, "rb");
   if(f)
@@ -769,7 +1188,11 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
           programnumber = tokens[1]; // if the 0st wasn't NULL then we have at least the terminating NULL in [1]
       }
 
-      prog = programnumber ? strtol(programnumber, NULL, 10) : -1;
+      // anything after the number is added to the build options: the same file is built again
+      // with -D constants for a common configuration, its kernels then have constant loop bounds
+      char *variant = NULL;
+      prog = programnumber ? strtol(programnumber, &variant, 10) : -1;
+      if(variant) variant = g_strstrip(variant);
 
       if(!programname || programname[0] == '\0' || prog < 0)
       {
@@ -777,13 +1200,40 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
         continue;
       }
 
+      const gboolean is_variant = variant && variant[0] != '\0' && prog < DT_OPENCL_MAX_PROGRAMS;
+      if(is_variant)
+      {
+        g_free(cl->dev[dev].program_options[prog]);
+        cl->dev[dev].program_options[prog] = g_strdup_printf("%s %s", cl->dev[dev].options, variant);
+      }
+
       snprintf(filename, PATH_MAX * sizeof(char), "%s" G_DIR_SEPARATOR_S "%s", kerneldir, programname);
-      snprintf(binname, PATH_MAX * sizeof(char), "%s" G_DIR_SEPARATOR_S "%s.bin", cachedir, programname);
+      // variants of a file get their own cached binary
+      if(is_variant)
+        snprintf(binname, PATH_MAX * sizeof(char), "%s" G_DIR_SEPARATOR_S "%s.%d.bin", cachedir, programname, prog);
+      else
+        snprintf(binname, PATH_MAX * sizeof(char), "%s" G_DIR_SEPARATOR_S "%s.bin", cachedir, programname);
       dt_vprint(DT_DEBUG_OPENCL, "[dt_opencl_device_init] testing program `%s' ..\n", programname);
       int loaded_cached;
       char md5sum[33];
-      if(dt_opencl_load_program(dev, prog, filename, binname, cachedir, md5sum, includemd5, &loaded_cached)
-         && dt_opencl_build_program(dev, prog, binname, cachedir, md5sum, loaded_cached) != CL_SUCCESS)
+      if(!dt_opencl_load_program(dev, prog, filename, binname, cachedir, md5sum, includemd5, &loaded_cached))
+      {
+        g_strfreev(tokens);
+        continue;
+      }
+
+      if(!loaded_cached && background_build)
+      {
+        dt_opencl_build_job_t *job = malloc(sizeof(dt_opencl_build_job_t));
+        job->prog = prog;
+        g_strlcpy(job->md5sum, md5sum, sizeof(job->md5sum));
+        g_strlcpy(job->binname, binname, sizeof(job->binname));
+        g_strlcpy(job->cachedir, cachedir, sizeof(job->cachedir));
+        cl->dev[dev].build_jobs = g_list_append(cl->dev[dev].build_jobs, job);
+      }
+      else if(dt_opencl_build_program(dev, prog, binname, cachedir, md5sum, loaded_cached) == CL_SUCCESS)
+        cl->dev[dev].program_built[prog] = 1;
+      else
       {
         dt_print(DT_DEBUG_OPENCL, "[dt_opencl_device_init] failed to compile program `%s'!\n", programname);
         fclose(f);
@@ -813,6 +1263,12 @@ end:
   // we always write the device config to keep track of disabled devices
   dt_opencl_write_device_config(dev);
 
+  if(res != 0)
+  {
+    g_list_free_full(cl->dev[dev].build_jobs, free);
+    cl->dev[dev].build_jobs = NULL;
+  }
+
   free(infostr);
   free(cname);
   free(vendor);
@@ -833,74 +1289,10 @@ end:
   return res;
 }
 
-#define RES 5
-
-void dt_opencl_benchmark_array(dt_opencl_t *cl)
-{
-  cl->cpubenchmark = 0.f;
-
-  // We assume responsivity is a must in darkroom, not at export time because export
-  // can be launched in batch and without user supervision.
-  // So we benchmark for typical screen sizes.
-  int resolutions[RES][2]
-      = { { 1200, 800 }, { 1440, 900 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 }};
-
-  for(int k = 0; k < RES; k++)
-    cl->cpubenchmark += dt_opencl_benchmark_cpu(resolutions[k][0], resolutions[k][1], 5, 100.0f);
-  cl->cpubenchmark /= (float)RES;
-
-  fprintf(stdout, "[OpenCL benchmark]: CPU %f s\n", cl->cpubenchmark);
-  dt_conf_set_float("dt_cpubenchmark", cl->cpubenchmark);
-
-  // make sure all active cl devices have a benchmark result
-  int round_sizes[3] = { 16, 32, 64 };
-  int pin_modes[2] = { 0, 1 };
-  int async_modes[2] = { 0, 1 };
-  for(int n = 0; n < cl->num_devs; n++)
-  {
-    float results[2][2][3];
-
-    for(int i = 0; i < 2; i++)
-      for(int j = 0; j < 2; j++)
-        for(int l = 0; l < 3; l++)
-        {
-          cl->dev[n].pinned_memory = pin_modes[j];
-          cl->dev[n].asyncmode = async_modes[i];
-          cl->dev[n].clroundup_ht = round_sizes[l];
-          cl->dev[n].clroundup_wd = round_sizes[l];
-          results[i][j][l] = 0.f;
-
-          for(int _x = 0; _x < 5; _x++)
-            for(int k = 0; k < RES; k++)
-              results[i][j][l] += dt_opencl_benchmark_gpu(n, resolutions[k][0], resolutions[k][1], 5, 100.0f);
-
-          results[i][j][l] /= (float)RES * 5.f;
-
-          fprintf(stdout, "[OpenCL benchmark]: %s %f s for pinned %i, async %i, round %i\n", cl->dev[n].name, results[i][j][l], cl->dev[n].pinned_memory,
-                  cl->dev[n].asyncmode, cl->dev[n].clroundup_ht);
-        }
-
-    cl->dev[n].benchmark = FLT_MAX;
-    for(int i = 0; i < 2; i++)
-      for(int j = 0; j < 2; j++)
-        for(int l = 0; l < 3; l++)
-        {
-          if(results[i][j][l] < cl->dev[n].benchmark)
-          {
-            cl->dev[n].benchmark = results[i][j][l];
-            cl->dev[n].pinned_memory = pin_modes[j];
-            cl->dev[n].asyncmode = async_modes[i];
-            cl->dev[n].clroundup_ht = round_sizes[l];
-            cl->dev[n].clroundup_wd = round_sizes[l];
-          }
-        }
-    dt_opencl_write_device_config(n);
-  }
-}
-
 void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboolean print_statistics)
 {
   dt_pthread_mutex_init(&cl->lock, NULL);
+  _perf_model_init(&cl->cpu_perf);
   cl->inited = 0;
   cl->enabled = 0;
   cl->stopped = 0;
@@ -929,7 +1321,9 @@ void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboole
   char *platform_name = calloc(DT_OPENCL_CBUFFSIZE, sizeof(char));
   char *platform_vendor = calloc(DT_OPENCL_CBUFFSIZE, sizeof(char));
 
-  cl->cpubenchmark = dt_conf_get_float("dt_cpubenchmark");
+  gchar perf_key[256] = { 0 };
+  g_snprintf(perf_key, 254, "%scpu_perf", DT_CLDEVICE_HEAD);
+  _perf_model_read(&cl->cpu_perf, perf_key);
 
   dt_print_nts(DT_DEBUG_OPENCL, "[opencl_init] opencl related configuration options:\n");
   dt_print_nts(DT_DEBUG_OPENCL, "[opencl_init] opencl: %s\n", dt_conf_get_bool("opencl") ? "ON" : "OFF" );
@@ -1086,6 +1480,8 @@ void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboole
     dt_print_nts(DT_DEBUG_OPENCL, "[opencl_init] OpenCL successfully initialized.\n");
     dt_print_nts(DT_DEBUG_OPENCL, "[opencl_init] here are the internal numbers and names of OpenCL devices available to Ansel:\n");
     for(int i = 0; i < dev; i++) dt_print_nts(DT_DEBUG_OPENCL, "[opencl_init]\t\t%d\t'%s'\n", i, cl->dev[i].name);
+
+    for(int i = 0; i < dev; i++) _opencl_start_build(cl, i);
   }
   else
   {
@@ -1118,60 +1514,14 @@ finally:
     cl->heal = dt_heal_init_cl_global();
     cl->colorspaces = dt_colorspaces_init_cl_global();
     cl->guided_filter = dt_guided_filter_init_cl_global();
+    cl->scopes = dt_scopes_init_cl_global();
   }
 
   if(newcheck && !manually && cl->inited)
   {
-    dt_print_nts(DT_DEBUG_OPENCL, "[opencl_init] OpenCL devices changed, we will update the profiling configuration.\n");
+    // nothing to benchmark: the timings of the modules are measured on each device while processing
+    dt_print_nts(DT_DEBUG_OPENCL, "[opencl_init] OpenCL devices changed.\n");
     dt_conf_set_string("opencl_checksum", checksum);
-    dt_opencl_benchmark_array(cl);
-
-    // get minima and maxima of performance data of all active devices
-    const float tcpu = cl->cpubenchmark;
-    float tgpumin = INFINITY;
-    float tgpumax = -INFINITY;
-    int fastest_device = -1; // Device -1 is CPU
-    for(int n = 0; n < cl->num_devs; n++)
-    {
-      if((cl->dev[n].benchmark > 0.0f) && (cl->dev[n].benchmark < tgpumin))
-      {
-        tgpumin = cl->dev[n].benchmark;
-        fastest_device = n;
-      }
-      tgpumax = fmaxf(cl->dev[n].benchmark, tgpumax);
-    }
-
-    if(tcpu < tgpumin / 1.2f)
-    {
-      // de-activate opencl for darktable in case the cpu is faster than the fastest GPU.
-      // user can always manually overrule this later.
-      cl->enabled = FALSE;
-      dt_conf_set_bool("opencl", FALSE);
-      dt_print_nts(DT_DEBUG_OPENCL, "[opencl_init] due to a slow GPU the opencl flag has been set to OFF.\n");
-      dt_control_log(_("due to a slow GPU hardware acceleration via opencl has been de-activated"));
-    }
-
-    // apply config settings for scheduling profile: sets device priorities and pixelpipe synchronization timeout
-    if(tcpu / tgpumin > 2.0f)
-    {
-      // GPU is at least twice as fast as CPU: force GPU everywhere
-      gchar *device_str = g_strdup_printf("+%i", fastest_device);
-      dt_conf_set_string("opencl_devid_thumbnail", device_str);
-      dt_conf_set_string("opencl_devid_preview", device_str);
-      dt_conf_set_string("opencl_devid_export", device_str);
-      dt_conf_set_string("opencl_devid_darkroom", device_str);
-      g_free(device_str);
-    }
-    else
-    {
-      // GPU is only marginally faster than CPU: suggest using it everywhere
-      gchar *device_str = g_strdup_printf("%i", fastest_device);
-      dt_conf_set_string("opencl_devid_thumbnail", device_str);
-      dt_conf_set_string("opencl_devid_preview", device_str);
-      dt_conf_set_string("opencl_devid_export", device_str);
-      dt_conf_set_string("opencl_devid_darkroom", device_str);
-      g_free(device_str);
-    }
   }
 
   dt_opencl_apply_scheduling_profile();
@@ -1197,12 +1547,38 @@ finally:
 
 void dt_opencl_cleanup_device(dt_opencl_t *cl, int i)
 {
+  if(cl->dev[i].build_running)
+  {
+    // the program being compiled can't be interrupted, only the next ones
+    cl->dev[i].build_quit = 1;
+    pthread_join(cl->dev[i].build_thread, NULL);
+    cl->dev[i].build_running = 0;
+  }
+  g_list_free_full(cl->dev[i].build_jobs, free);
+  cl->dev[i].build_jobs = NULL;
+
   dt_pthread_mutex_destroy(&cl->dev[i].lock);
+  g_mutex_clear(&cl->dev[i].done_lock);
+  g_cond_clear(&cl->dev[i].done_cond);
+  if(cl->dev[i].sync_event) (cl->dlocl->symbols->dt_clReleaseEvent)(cl->dev[i].sync_event);
+  _pool_cleanup(cl, i);
+  _perf_model_cleanup(&cl->dev[i].perf);
   for(int k = 0; k < DT_OPENCL_MAX_KERNELS; k++)
-    if(cl->dev[i].kernel_used[k]) (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[i].kernel[k]);
+  {
+    if(cl->dev[i].kernel_used[k] && cl->dev[i].kernel[k])
+      (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[i].kernel[k]);
+    g_free(cl->dev[i].kernel_name[k]);
+    cl->dev[i].kernel_name[k] = NULL;
+  }
   for(int k = 0; k < DT_OPENCL_MAX_PROGRAMS; k++)
+  {
     if(cl->dev[i].program_used[k]) (cl->dlocl->symbols->dt_clReleaseProgram)(cl->dev[i].program[k]);
+    g_free(cl->dev[i].program_options[k]);
+    cl->dev[i].program_options[k] = NULL;
+  }
   (cl->dlocl->symbols->dt_clReleaseCommandQueue)(cl->dev[i].cmd_queue);
+  if(cl->dev[i].upload_queue) (cl->dlocl->symbols->dt_clReleaseCommandQueue)(cl->dev[i].upload_queue);
+  if(cl->dev[i].download_queue) (cl->dlocl->symbols->dt_clReleaseCommandQueue)(cl->dev[i].download_queue);
   (cl->dlocl->symbols->dt_clReleaseContext)(cl->dev[i].context);
 
   if(cl->print_statistics && (darktable.unmuted & DT_DEBUG_MEMORY))
@@ -1211,6 +1587,15 @@ void dt_opencl_cleanup_device(dt_opencl_t *cl, int i)
                 cl->dev[i].name, i, cl->dev[i].peak_memory, (float)cl->dev[i].peak_memory/(1024*1024));
   }
 
+  if(cl->print_statistics)
+  {
+    const dt_opencl_mem_pool_t *pool = &cl->dev[i].pool;
+    dt_print_nts(DT_DEBUG_OPENCL, " [opencl_summary_statistics] device '%s' (%d): %" PRIu64 " out of %" PRIu64
+                                  " allocations recycled, pool peak %.1f MB\n",
+                 cl->dev[i].name, i, pool->hits, pool->hits + pool->misses,
+                 (float)pool->peak_memory / (1024 * 1024));
+  }
+
   if(cl->print_statistics && cl->dev[i].use_events)
   {
     if(cl->dev[i].totalevents)
@@ -1253,6 +1638,7 @@ void dt_opencl_cleanup(dt_opencl_t *cl)
     dt_heal_free_cl_global(cl->heal);
     dt_colorspaces_free_cl_global(cl->colorspaces);
     dt_guided_filter_free_cl_global(cl->guided_filter);
+    dt_scopes_free_cl_global(cl->scopes);
 
     for(int i = 0; i < cl->num_devs; i++)
       dt_opencl_cleanup_device(cl, i);
@@ -1271,6 +1657,7 @@ void dt_opencl_cleanup(dt_opencl_t *cl)
   }
 
   free(cl->dev);
+  _perf_model_cleanup(&cl->cpu_perf);
   dt_pthread_mutex_destroy(&cl->lock);
 }
 
@@ -1296,164 +1683,127 @@ static const char *dt_opencl_get_vendor_by_id(unsigned int id)
   return vendor;
 }
 
-// FIXME this benchmark simply doesn't reflect the power of a cl device in a meaningful way resulting in
-// - the config setting for very-fast GPU often misses a proper setting
-// - at the moment we can't use a cpu vs gpu performance ratio to decide if tiled-gpu might be worse than untiled-cpu
-static float dt_opencl_benchmark_gpu(const int devid, const size_t width, const size_t height, const int count, const float sigma)
+static void _opencl_release_sync_event(const int devid)
 {
-  const int bpp = 4 * sizeof(float);
-  cl_int err = DT_OPENCL_DEFAULT_ERROR;
-  cl_mem dev_mem = NULL;
-  float *buf = NULL;
-  dt_gaussian_cl_t *g = NULL;
-
-  const float Labmax[] = { INFINITY, INFINITY, INFINITY, INFINITY };
-  const float Labmin[] = { -INFINITY, -INFINITY, -INFINITY, -INFINITY };
-
-  unsigned int *const tea_states = alloc_tea_states(darktable.num_openmp_threads);
-
-  buf = dt_alloc_align(width * height * bpp);
-  if(buf == NULL) goto error;
-
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, tea_states, width) \
-  shared(buf)
-#endif
-  for(size_t j = 0; j < height; j++)
-  {
-    unsigned int *tea_state = get_tea_state(tea_states,dt_get_thread_num());
-    tea_state[0] = j + dt_get_thread_num();
-    size_t index = j * 4 * width;
-    for(int i = 0; i < 4 * width; i++)
-    {
-      encrypt_tea(tea_state);
-      buf[index + i] = 100.0f * tpdf(tea_state[0]);
-    }
-  }
-
-  // start timer
-  double start = dt_get_wtime();
-
-  // allocate dev_mem buffer & copy fake data from RAM to vRAM
-  dev_mem = dt_opencl_copy_host_to_device(devid, buf, width, height, bpp);
-  if(dev_mem == NULL) goto error;
-
-  // prepare gaussian filter
-  g = dt_gaussian_init_cl(devid, width, height, 4, Labmax, Labmin, sigma, 0);
-  if(!g) goto error;
-
-  // gaussian blur
-  for(int n = 0; n < count; n++)
-  {
-    err = dt_gaussian_blur_cl(g, dev_mem, dev_mem);
-    if(err != CL_SUCCESS) goto error;
-
-    // copy back to host
-    err = dt_opencl_copy_device_to_host(devid, buf, dev_mem, width, height, bpp);
-    if(err != CL_SUCCESS) goto error;
-  }
-
-  // cleanup gaussian filter
-  dt_gaussian_free_cl(g);
-  g = NULL;
+  dt_opencl_t *cl = darktable.opencl;
+  if(cl->dev[devid].sync_event == NULL) return;
+  (cl->dlocl->symbols->dt_clReleaseEvent)(cl->dev[devid].sync_event);
+  cl->dev[devid].sync_event = NULL;
+}
 
-  // copy dev_mem -> buf
-  err = dt_opencl_copy_device_to_host(devid, buf, dev_mem, width, height, bpp);
-  if(err != CL_SUCCESS) goto error;
+gboolean dt_opencl_finish(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0) return FALSE;
 
-  // free dev_mem
-  dt_opencl_release_mem_object(dev_mem);
+  cl_int err = (cl->dlocl->symbols->dt_clFinish)(cl->dev[devid].cmd_queue);
+  // and the tile transfers waiting for it
+  if(err == CL_SUCCESS && cl->dev[devid].upload_queue)
+    err = (cl->dlocl->symbols->dt_clFinish)(cl->dev[devid].upload_queue);
+  if(err == CL_SUCCESS && cl->dev[devid].download_queue)
+    err = (cl->dlocl->symbols->dt_clFinish)(cl->dev[devid].download_queue);
 
-  // end timer
-  double end = dt_get_wtime();
+  // everything is done, including the last marker
+  _opencl_release_sync_event(devid);
 
-  dt_free_align(buf);
-  free_tea_states(tea_states);
-  return (end - start);
+  // take the opportunity to release some event handles, but without printing
+  // summary statistics
+  cl_int success = dt_opencl_events_flush(devid, 0);
 
-error:
-  dt_gaussian_free_cl(g);
-  dt_free_align(buf);
-  free_tea_states(tea_states);
-  dt_opencl_release_mem_object(dev_mem);
-  return INFINITY;
+  return (err == CL_SUCCESS && success == CL_COMPLETE);
 }
 
-static float dt_opencl_benchmark_cpu(const size_t width, const size_t height, const int count, const float sigma)
+// shared by the waiting host thread and the event callback, the last one to let go frees it
+typedef struct dt_opencl_wait_t
 {
-  const int bpp = 4 * sizeof(float);
-  float *buf = NULL;
-  dt_gaussian_t *g = NULL;
-
-  const float Labmax[] = { INFINITY, INFINITY, INFINITY, INFINITY };
-  const float Labmin[] = { -INFINITY, -INFINITY, -INFINITY, -INFINITY };
+  int devid;
+  gboolean done;
+  gint refs;
+} dt_opencl_wait_t;
 
-  unsigned int *const tea_states = alloc_tea_states(darktable.num_openmp_threads);
+static void _opencl_wait_unref(dt_opencl_wait_t *wait)
+{
+  if(g_atomic_int_dec_and_test(&wait->refs)) free(wait);
+}
 
-  buf = dt_alloc_align(width * height * bpp);
-  if(buf == NULL) goto error;
+static void CL_CALLBACK _opencl_event_done(cl_event event, cl_int status, void *data)
+{
+  dt_opencl_wait_t *wait = (dt_opencl_wait_t *)data;
+  dt_opencl_t *cl = darktable.opencl;
+  g_mutex_lock(&cl->dev[wait->devid].done_lock);
+  wait->done = TRUE;
+  g_cond_broadcast(&cl->dev[wait->devid].done_cond);
+  g_mutex_unlock(&cl->dev[wait->devid].done_lock);
+  _opencl_wait_unref(wait);
+}
 
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, tea_states) \
-  shared(buf)
-#endif
-  for(size_t j = 0; j < height; j++)
+// Block until the event of the command queue of devid completes. The driver calls us back then, so we
+// sleep on a condition instead of letting clWaitForEvents() spin or poll, as some drivers do.
+static cl_int _opencl_wait_for_event(const int devid, cl_event event)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  dt_opencl_wait_t *wait = NULL;
+  if(cl->dlocl->symbols->dt_clSetEventCallback) wait = malloc(sizeof(dt_opencl_wait_t));
+  if(!wait) return (cl->dlocl->symbols->dt_clWaitForEvents)(1, &event);
+
+  wait->devid = devid;
+  wait->done = FALSE;
+  wait->refs = 2;
+  // the callback may fire before we return from there, the event is not even queued to the device yet
+  cl_int err = (cl->dlocl->symbols->dt_clSetEventCallback)(event, CL_COMPLETE, _opencl_event_done, wait);
+  if(err != CL_SUCCESS)
   {
-    unsigned int *tea_state = get_tea_state(tea_states,dt_get_thread_num());
-    tea_state[0] = j + dt_get_thread_num();
-    size_t index = j * 4 * width;
-    for(int i = 0; i < 4 * width; i++)
-    {
-      encrypt_tea(tea_state);
-      buf[index + i] = 100.0f * tpdf(tea_state[0]);
-    }
+    free(wait);
+    return (cl->dlocl->symbols->dt_clWaitForEvents)(1, &event);
   }
+  (cl->dlocl->symbols->dt_clFlush)(cl->dev[devid].cmd_queue);
 
-  // start timer
-  double start = dt_get_wtime();
+  g_mutex_lock(&cl->dev[devid].done_lock);
+  while(!wait->done) g_cond_wait(&cl->dev[devid].done_cond, &cl->dev[devid].done_lock);
+  g_mutex_unlock(&cl->dev[devid].done_lock);
+  _opencl_wait_unref(wait);
+  return CL_SUCCESS;
+}
 
-  // prepare gaussian filter
-  g = dt_gaussian_init(width, height, 4, Labmax, Labmin, sigma, 0);
-  if(!g) goto error;
+// Event mode: mark the current end of the queue, then wait for the previous mark.
+// The host stays at most one step ahead of the device, so the device never starves while
+// we prepare the next module or tile, and errors are still caught one step later instead of
+// at the end of the pipe. The queue is in-order, so commands already depend on each other.
+static gboolean _opencl_sync_previous(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  cl_event marker = NULL;
+  cl_int err = (cl->dlocl->symbols->dt_clEnqueueMarker)(cl->dev[devid].cmd_queue, &marker);
+  if(err != CL_SUCCESS) return dt_opencl_finish(devid);
 
-  // gaussian blur
-  for(int n = 0; n < count; n++)
+  gboolean success = TRUE;
+  cl_event previous = cl->dev[devid].sync_event;
+  if(previous)
   {
-    dt_gaussian_blur(g, buf, buf);
+    cl_int status = CL_COMPLETE;
+    err = _opencl_wait_for_event(devid, previous);
+    if(err == CL_SUCCESS)
+      err = (cl->dlocl->symbols->dt_clGetEventInfo)(previous, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                                                    sizeof(cl_int), &status, NULL);
+    success = (err == CL_SUCCESS && status == CL_COMPLETE);
+    if(!success)
+      dt_print(DT_DEBUG_OPENCL, "[opencl_sync_previous] device %i reported an error: %s\n", devid,
+               cl_errstr(err != CL_SUCCESS ? err : status));
+    (cl->dlocl->symbols->dt_clReleaseEvent)(previous);
   }
-
-  // cleanup gaussian filter
-  dt_gaussian_free(g);
-  g = NULL;
-
-  // end timer
-  double end = dt_get_wtime();
-
-  dt_free_align(buf);
-  free_tea_states(tea_states);
-  return (end - start);
-
-error:
-  dt_gaussian_free(g);
-  dt_free_align(buf);
-  free_tea_states(tea_states);
-  return INFINITY;
+  // don't flush the event handles here, it would wait for the whole queue.
+  // dt_opencl_events_get_slot() does it when they run out, and dt_opencl_finish() at the end.
+  cl->dev[devid].sync_event = marker;
+  return success;
 }
 
-gboolean dt_opencl_finish(const int devid)
+void dt_opencl_nap(const int devid)
 {
   dt_opencl_t *cl = darktable.opencl;
-  if(!cl->inited || devid < 0) return FALSE;
-
-  cl_int err = (cl->dlocl->symbols->dt_clFinish)(cl->dev[devid].cmd_queue);
-
-  // take the opportunity to release some event handles, but without printing
-  // summary statistics
-  cl_int success = dt_opencl_events_flush(devid, 0);
+  if(!cl->inited || devid < 0) return;
 
-  return (err == CL_SUCCESS && success == CL_COMPLETE);
+  // errors are reported by the next synchronization of the pipe
+  _opencl_sync_previous(devid);
 }
 
 gboolean dt_opencl_finish_sync_pipe(const int devid, const int pipetype)
@@ -1461,6 +1811,8 @@ gboolean dt_opencl_finish_sync_pipe(const int devid, const int pipetype)
   dt_opencl_t *cl = darktable.opencl;
   if(!cl->inited || devid < 0) return FALSE;
 
+  if(cl->event_sync) return _opencl_sync_previous(devid);
+
   const gboolean exporting = (pipetype & DT_DEV_PIXELPIPE_EXPORT) == DT_DEV_PIXELPIPE_EXPORT;
   const gboolean asyncmode = cl->dev[devid].asyncmode;
 
@@ -1753,9 +2105,48 @@ void dt_opencl_unlock_device(const int dev)
   dt_opencl_t *cl = darktable.opencl;
   if(!cl->inited) return;
   if(dev < 0 || dev >= cl->num_devs) return;
+  _opencl_release_sync_event(dev);
   dt_pthread_mutex_BAD_unlock(&cl->dev[dev].lock);
 }
 
+int dt_opencl_lock_extra_devices(const int pipetype, const int dev, int *devices, const int max)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || max <= 0) return 0;
+
+  dt_pthread_mutex_lock(&cl->lock);
+
+  const int *list = NULL;
+  switch(pipetype & DT_DEV_PIXELPIPE_ANY)
+  {
+    case DT_DEV_PIXELPIPE_FULL:
+      list = cl->dev_priority_image;
+      break;
+    case DT_DEV_PIXELPIPE_PREVIEW:
+      list = cl->dev_priority_preview;
+      break;
+    case DT_DEV_PIXELPIPE_EXPORT:
+      list = cl->dev_priority_export;
+      break;
+    case DT_DEV_PIXELPIPE_THUMBNAIL:
+      list = cl->dev_priority_thumbnail;
+      break;
+    default:
+      break;
+  }
+
+  // only the devices allowed for this pipe type, and only those nobody uses right now: never wait
+  int count = 0;
+  for(const int *prio = list; prio && *prio != -1 && count < max; prio++)
+  {
+    if(*prio == dev || cl->dev[*prio].disabled) continue;
+    if(!dt_pthread_mutex_BAD_trylock(&cl->dev[*prio].lock)) devices[count++] = *prio;
+  }
+
+  dt_pthread_mutex_unlock(&cl->lock);
+  return count;
+}
+
 static FILE *fopen_stat(const char *filename, struct stat *st)
 {
   FILE *f = g_fopen(filename, "rb");
@@ -1828,6 +2219,12 @@ void dt_opencl_md5sum(const char **files, char **md5sums)
   }
 }
 
+static const char *_program_options(const int dev, const int prog)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  return cl->dev[dev].program_options[prog] ? cl->dev[dev].program_options[prog] : cl->dev[dev].options;
+}
+
 int dt_opencl_load_program(const int dev, const int prog, const char *filename, const char *binname,
                            const char *cachedir, char *md5sum, char **includemd5, int *loaded_cached)
 {
@@ -1880,7 +2277,8 @@ int dt_opencl_load_program(const int dev, const int prog, const char *filename,
   (cl->dlocl->symbols->dt_clGetPlatformInfo)(platform, CL_PLATFORM_VERSION, end - start, start, &len);
   start += len;
 
-  len = g_strlcpy(start, cl->dev[dev].options, end - start);
+  // variants differ by their options only, which also separates their cached binaries
+  len = g_strlcpy(start, _program_options(dev, prog), end - start);
   start += len;
 
   /* make sure that the md5sums of all the includes are applied as well */
@@ -2007,7 +2405,8 @@ int dt_opencl_build_program(const int dev, const int prog, const char *binname,
   if(prog < 0 || prog >= DT_OPENCL_MAX_PROGRAMS) return -1;
   dt_opencl_t *cl = darktable.opencl;
   cl_program program = cl->dev[dev].program[prog];
-  cl_int err = (cl->dlocl->symbols->dt_clBuildProgram)(program, 1, &(cl->dev[dev].devid), cl->dev[dev].options, 0, 0);
+  cl_int err = (cl->dlocl->symbols->dt_clBuildProgram)(program, 1, &(cl->dev[dev].devid),
+                                                      _program_options(dev, prog), 0, 0);
 
   if(err != CL_SUCCESS)
     dt_print(DT_DEBUG_OPENCL, "[opencl_build_program] could not build program: %s\n", cl_errstr(err));
@@ -2100,23 +2499,21 @@ int dt_opencl_build_program(const int dev, const int prog, const char *binname,
           if(bytes_written != binary_sizes[i]) goto ret;
           fclose(f);
 
-          // create link (e.g. basic.cl.bin -> f1430102c53867c162bb60af6c163328)
-          char cwd[PATH_MAX] = { 0 };
-          if(!getcwd(cwd, sizeof(cwd))) goto ret;
-          if(chdir(cachedir) != 0) goto ret;
+          // create link (e.g. basic.cl.bin -> f1430102c53867c162bb60af6c163328).
+          // binname is absolute and the target relative to its directory: no chdir(), as this may run
+          // in the background while other threads use the current directory.
+#if defined(_WIN32)
           char dup[PATH_MAX] = { 0 };
           g_strlcpy(dup, binname, sizeof(dup));
           char *bname = basename(dup);
-#if defined(_WIN32)
           //CreateSymbolicLink in Windows requires admin privileges, which we don't want/need
           //store has using a simple filerename
           char finalfilename[PATH_MAX] = { 0 };
           snprintf(finalfilename, sizeof(finalfilename), "%s" G_DIR_SEPARATOR_S "%s.%s", cachedir, bname, md5sum);
           rename(link_dest, finalfilename);
 #else
-          if(symlink(md5sum, bname) != 0) goto ret;
+          if(symlink(md5sum, binname) != 0) goto ret;
 #endif //!defined(_WIN32)
-          if(chdir(cwd) != 0) goto ret;
         }
 
     ret:
@@ -2143,12 +2540,22 @@ int dt_opencl_create_kernel(const int prog, const char *name)
       if(!cl->dev[dev].kernel_used[k])
       {
         cl->dev[dev].kernel_used[k] = 1;
+        cl->dev[dev].kernel_program[k] = prog;
+        cl->dev[dev].kernel_name[k] = g_strdup(name);
+        if(!cl->dev[dev].program_built[prog])
+        {
+          // still compiling, _opencl_program_built() creates the kernel
+          cl->dev[dev].kernel[k] = NULL;
+          break;
+        }
         cl->dev[dev].kernel[k]
             = (cl->dlocl->symbols->dt_clCreateKernel)(cl->dev[dev].program[prog], name, &err);
         if(err != CL_SUCCESS)
         {
           dt_print(DT_DEBUG_OPENCL, "[opencl_create_kernel] could not create kernel `%s'! (%s)\n", name, cl_errstr(err));
           cl->dev[dev].kernel_used[k] = 0;
+          g_free(cl->dev[dev].kernel_name[k]);
+          cl->dev[dev].kernel_name[k] = NULL;
           goto error;
         }
         else
@@ -2181,7 +2588,10 @@ void dt_opencl_free_kernel(const int kernel)
   for(int dev = 0; dev < cl->num_devs; dev++)
   {
     cl->dev[dev].kernel_used[kernel] = 0;
-    (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[dev].kernel[kernel]);
+    if(cl->dev[dev].kernel[kernel]) (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[dev].kernel[kernel]);
+    cl->dev[dev].kernel[kernel] = NULL;
+    g_free(cl->dev[dev].kernel_name[kernel]);
+    cl->dev[dev].kernel_name[kernel] = NULL;
   }
   dt_pthread_mutex_unlock(&cl->lock);
 }
@@ -2219,6 +2629,7 @@ int dt_opencl_get_kernel_work_group_size(const int dev, const int kernel, size_t
   dt_opencl_t *cl = darktable.opencl;
   if(!cl->inited || dev < 0) return -1;
   if(kernel < 0 || kernel >= DT_OPENCL_MAX_KERNELS) return -1;
+  if(cl->dev[dev].kernel[kernel] == NULL) return CL_INVALID_KERNEL; // program still compiling
 
   return (cl->dlocl->symbols->dt_clGetKernelWorkGroupInfo)(cl->dev[dev].kernel[kernel], cl->dev[dev].devid,
                                                            CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t),
@@ -2232,6 +2643,7 @@ int dt_opencl_set_kernel_arg(const int dev, const int kernel, const int num, con
   dt_opencl_t *cl = darktable.opencl;
   if(!cl->inited || dev < 0) return -1;
   if(kernel < 0 || kernel >= DT_OPENCL_MAX_KERNELS) return -1;
+  if(cl->dev[dev].kernel[kernel] == NULL) return CL_INVALID_KERNEL; // program still compiling
   return (cl->dlocl->symbols->dt_clSetKernelArg)(cl->dev[dev].kernel[kernel], num, size, arg);
 }
 
@@ -2247,6 +2659,7 @@ int dt_opencl_enqueue_kernel_2d_with_local(const int dev, const int kernel, cons
   dt_opencl_t *cl = darktable.opencl;
   if(!cl->inited || dev < 0) return -1;
   if(kernel < 0 || kernel >= DT_OPENCL_MAX_KERNELS) return -1;
+  if(cl->dev[dev].kernel[kernel] == NULL) return CL_INVALID_KERNEL; // program still compiling
 
   char buf[256];
   buf[0] = '\0';
@@ -2262,6 +2675,20 @@ int dt_opencl_enqueue_kernel_2d_with_local(const int dev, const int kernel, cons
   return err;
 }
 
+// host<->device traffic for the trace, non-blocking transfers only account for the time to enqueue them
+static inline double _trace_start(void)
+{
+  return dt_trace_enabled() ? dt_get_wtime() : 0.0;
+}
+
+static inline void _trace_transfer(const char *name, const int devid, const double start, const size_t bytes,
+                                   const int blocking)
+{
+  if(!dt_trace_enabled()) return;
+  dt_trace_complete("opencl", name, start, dt_get_wtime(), "\"devid\":%d,\"bytes\":%zu,\"blocking\":%s", devid,
+                    bytes, blocking ? "true" : "false");
+}
+
 int dt_opencl_copy_device_to_host(const int devid, void *host, void *device, const int width,
                                   const int height, const int bpp)
 {
@@ -2310,9 +2737,14 @@ int dt_opencl_read_host_from_device_raw(const int devid, void *host, void *devic
 
   cl_event *eventp = dt_opencl_events_get_slot(devid, "[Read Image (from device to host)]");
 
-  return (darktable.opencl->dlocl->symbols->dt_clEnqueueReadImage)(darktable.opencl->dev[devid].cmd_queue,
+  const double start = blocking ? dt_get_wtime() : _trace_start();
+  const cl_int err = (darktable.opencl->dlocl->symbols->dt_clEnqueueReadImage)(darktable.opencl->dev[devid].cmd_queue,
                                                                    device, blocking ? CL_TRUE : CL_FALSE, origin, region, rowpitch,
                                                                    0, host, 0, NULL, eventp);
+  _trace_transfer("device to host", devid, start, (size_t)rowpitch * region[1], blocking);
+  if(blocking && err == CL_SUCCESS)
+    _perf_record_transfer(devid, (size_t)rowpitch * region[1], dt_get_wtime() - start);
+  return err;
 }
 
 int dt_opencl_write_host_to_device(const int devid, void *host, void *device, const int width,
@@ -2355,9 +2787,71 @@ int dt_opencl_write_host_to_device_raw(const int devid, void *host, void *device
 
   cl_event *eventp = dt_opencl_events_get_slot(devid, "[Write Image (from host to device)]");
 
-  return (darktable.opencl->dlocl->symbols->dt_clEnqueueWriteImage)(darktable.opencl->dev[devid].cmd_queue,
+  const double start = blocking ? dt_get_wtime() : _trace_start();
+  const cl_int err = (darktable.opencl->dlocl->symbols->dt_clEnqueueWriteImage)(darktable.opencl->dev[devid].cmd_queue,
                                                                     device, blocking ? CL_TRUE : CL_FALSE, origin, region,
                                                                     rowpitch, 0, host, 0, NULL, eventp);
+  _trace_transfer("host to device", devid, start, (size_t)rowpitch * region[1], blocking);
+  if(blocking && err == CL_SUCCESS)
+    _perf_record_transfer(devid, (size_t)rowpitch * region[1], dt_get_wtime() - start);
+  return err;
+}
+
+int dt_opencl_write_host_to_device_overlapped(const int devid, void *host, void *device, const size_t *origin,
+                                              const size_t *region, const int rowpitch)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0) return -1;
+
+  cl_event done = NULL;
+  const double start = _trace_start();
+  cl_int err = (cl->dlocl->symbols->dt_clEnqueueWriteImage)(cl->dev[devid].upload_queue, device, CL_FALSE,
+                                                            origin, region, rowpitch, 0, host, 0, NULL, &done);
+  _trace_transfer("host to device", devid, start, (size_t)rowpitch * region[1], FALSE);
+  // other queues only wait for commands which were submitted
+  if(err == CL_SUCCESS) err = (cl->dlocl->symbols->dt_clFlush)(cl->dev[devid].upload_queue);
+  // the next kernels wait for the tile, the next upload doesn't wait for them
+  if(err == CL_SUCCESS)
+    err = (cl->dlocl->symbols->dt_clEnqueueWaitForEvents)(cl->dev[devid].cmd_queue, 1, &done);
+  if(done) (cl->dlocl->symbols->dt_clReleaseEvent)(done);
+  return err;
+}
+
+int dt_opencl_read_host_from_device_overlapped(const int devid, void *host, void *device, const size_t *origin,
+                                               const size_t *region, const int rowpitch, cl_event *done)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  *done = NULL;
+  if(!cl->inited || devid < 0) return -1;
+
+  // the download starts once the kernels already enqueued are done
+  cl_event ready = NULL;
+  cl_int err = (cl->dlocl->symbols->dt_clEnqueueMarker)(cl->dev[devid].cmd_queue, &ready);
+  if(err == CL_SUCCESS) err = (cl->dlocl->symbols->dt_clFlush)(cl->dev[devid].cmd_queue);
+  const double start = _trace_start();
+  if(err == CL_SUCCESS)
+    err = (cl->dlocl->symbols->dt_clEnqueueReadImage)(cl->dev[devid].download_queue, device, CL_FALSE, origin,
+                                                      region, rowpitch, 0, host, 1, &ready, done);
+  _trace_transfer("device to host", devid, start, (size_t)rowpitch * region[1], FALSE);
+  if(err == CL_SUCCESS) err = (cl->dlocl->symbols->dt_clFlush)(cl->dev[devid].download_queue);
+  if(ready) (cl->dlocl->symbols->dt_clReleaseEvent)(ready);
+  return err;
+}
+
+int dt_opencl_wait_transfer(cl_event *done)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(*done == NULL) return CL_SUCCESS;
+
+  cl_int status = CL_COMPLETE;
+  cl_int err = (cl->dlocl->symbols->dt_clWaitForEvents)(1, done);
+  if(err == CL_SUCCESS)
+    err = (cl->dlocl->symbols->dt_clGetEventInfo)(*done, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int),
+                                                  &status, NULL);
+  (cl->dlocl->symbols->dt_clReleaseEvent)(*done);
+  *done = NULL;
+  if(err != CL_SUCCESS) return err;
+  return (status < 0) ? status : CL_SUCCESS;
 }
 
 int dt_opencl_enqueue_copy_image(const int devid, cl_mem src, cl_mem dst, size_t *orig_src, size_t *orig_dst,
@@ -2415,8 +2909,11 @@ int dt_opencl_read_buffer_from_device(const int devid, void *host, void *device,
 
   cl_event *eventp = dt_opencl_events_get_slot(devid, "[Read Buffer (from device to host)]");
 
-  return (darktable.opencl->dlocl->symbols->dt_clEnqueueReadBuffer)(
+  const double start = _trace_start();
+  const cl_int err = (darktable.opencl->dlocl->symbols->dt_clEnqueueReadBuffer)(
       darktable.opencl->dev[devid].cmd_queue, device, blocking ? CL_TRUE : CL_FALSE, offset, size, host, 0, NULL, eventp);
+  _trace_transfer("device to host", devid, start, size, blocking);
+  return err;
 }
 
 int dt_opencl_write_buffer_to_device(const int devid, void *host, void *device, const size_t offset,
@@ -2426,8 +2923,11 @@ int dt_opencl_write_buffer_to_device(const int devid, void *host, void *device,
 
   cl_event *eventp = dt_opencl_events_get_slot(devid, "[Write Buffer (from host to device)]");
 
-  return (darktable.opencl->dlocl->symbols->dt_clEnqueueWriteBuffer)(
+  const double start = _trace_start();
+  const cl_int err = (darktable.opencl->dlocl->symbols->dt_clEnqueueWriteBuffer)(
       darktable.opencl->dev[devid].cmd_queue, device, blocking ? CL_TRUE : CL_FALSE, offset, size, host, 0, NULL, eventp);
+  _trace_transfer("host to device", devid, start, size, blocking);
+  return err;
 }
 
 
@@ -2435,8 +2935,10 @@ void *dt_opencl_copy_host_to_device_constant(const int devid, const size_t size,
 {
   if(!darktable.opencl->inited || devid < 0) return NULL;
   cl_int err;
+  const double start = _trace_start();
   cl_mem dev = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(
       darktable.opencl->dev[devid].context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, size, host, &err);
+  _trace_transfer("host to device", devid, start, size, TRUE);
   if(err != CL_SUCCESS)
     dt_print(DT_DEBUG_OPENCL,
              "[opencl copy_host_to_device_constant] could not alloc buffer on device %d: %s\n", devid, cl_errstr(err));
@@ -2469,9 +2971,11 @@ void *dt_opencl_copy_host_to_device_rowpitch(const int devid, void *host, const
     return NULL;
 
   // TODO: if fmt = uint16_t, blow up to 4xuint16_t and copy manually!
+  const double start = _trace_start();
   cl_mem dev = (darktable.opencl->dlocl->symbols->dt_clCreateImage2D)(
       darktable.opencl->dev[devid].context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, &fmt, width, height,
       rowpitch, host, &err);
+  _trace_transfer("host to device", devid, start, (size_t)(rowpitch ? rowpitch : width * bpp) * height, TRUE);
   if(err != CL_SUCCESS)
     dt_print(DT_DEBUG_OPENCL,
              "[opencl copy_host_to_device] could not alloc/copy img buffer on device %d: %s\n", devid, cl_errstr(err));
@@ -2482,6 +2986,28 @@ void *dt_opencl_copy_host_to_device_rowpitch(const int devid, void *host, const
 }
 
 
+void dt_opencl_prealloc_images(const int devid, const int width, const int height, const int bpp,
+                               const int count)
+{
+  if(!darktable.opencl->inited || devid < 0 || count <= 0) return;
+  cl_mem *mems = (cl_mem *)calloc(count, sizeof(cl_mem));
+  if(!mems) return;
+
+  int allocated = 0;
+  while(allocated < count)
+  {
+    mems[allocated] = dt_opencl_alloc_device(devid, width, height, bpp);
+    if(!mems[allocated]) break;
+    allocated++;
+  }
+  // released to the pool, where the next allocations of that geometry pick them up
+  for(int k = 0; k < allocated; k++) dt_opencl_release_mem_object(mems[k]);
+  free(mems);
+
+  dt_print(DT_DEBUG_OPENCL, "[opencl_prealloc_images] pooled %d images of %i×%i px on device %d\n", allocated,
+           width, height, devid);
+}
+
 void dt_opencl_release_mem_object(cl_mem mem)
 {
   if(!darktable.opencl->inited) return;
@@ -2492,6 +3018,9 @@ void dt_opencl_release_mem_object(cl_mem mem)
 
   dt_opencl_memory_statistics(-1, mem, OPENCL_MEMORY_SUB);
 
+  // images and buffers from the pool go back to it
+  if(_pool_put(mem)) return;
+
   (darktable.opencl->dlocl->symbols->dt_clReleaseMemObject)(mem);
 }
 
@@ -2508,6 +3037,26 @@ void *dt_opencl_map_buffer(const int devid, cl_mem buffer, const int blocking, c
   return ptr;
 }
 
+int dt_opencl_sync_host_image(const int devid, cl_mem image, const int width, const int height)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0) return -1;
+  const size_t origin[] = { 0, 0, 0 };
+  const size_t region[] = { width, height, 1 };
+  size_t pitch = 0;
+  cl_int err;
+  // mapping gives the host memory back for reading, nothing is copied on unified memory
+  cl_event *eventp = dt_opencl_events_get_slot(devid, "[Map Image]");
+  void *ptr = (cl->dlocl->symbols->dt_clEnqueueMapImage)(cl->dev[devid].cmd_queue, image, CL_TRUE, CL_MAP_READ,
+                                                         origin, region, &pitch, NULL, 0, NULL, eventp, &err);
+  if(err != CL_SUCCESS)
+  {
+    dt_print(DT_DEBUG_OPENCL, "[opencl sync host image] could not map image on device %d: %s\n", devid, cl_errstr(err));
+    return err;
+  }
+  return dt_opencl_unmap_mem_object(devid, image, ptr);
+}
+
 int dt_opencl_unmap_mem_object(const int devid, cl_mem mem_object, void *mapped_ptr)
 {
   if(!darktable.opencl->inited) return -1;
@@ -2536,11 +3085,28 @@ void *dt_opencl_alloc_device(const int devid, const int width, const int height,
   else
     return NULL;
 
-  cl_mem dev = (darktable.opencl->dlocl->symbols->dt_clCreateImage2D)(
+  // recycle a released image of the same geometry if we have one
+  const uint64_t key = _pool_image_key(width, height, bpp);
+  cl_mem dev = _pool_get(devid, key);
+  if(dev)
+  {
+    dt_opencl_memory_statistics(devid, dev, OPENCL_MEMORY_ADD);
+    return dev;
+  }
+
+  dev = (darktable.opencl->dlocl->symbols->dt_clCreateImage2D)(
       darktable.opencl->dev[devid].context, CL_MEM_READ_WRITE, &fmt, width, height, 0, NULL, &err);
+
+  // the idle buffers of the pool may be what we are missing
+  if(err != CL_SUCCESS && _pool_flush(devid))
+    dev = (darktable.opencl->dlocl->symbols->dt_clCreateImage2D)(
+        darktable.opencl->dev[devid].context, CL_MEM_READ_WRITE, &fmt, width, height, 0, NULL, &err);
+
   if(err != CL_SUCCESS)
     dt_print(DT_DEBUG_OPENCL, "[opencl alloc_device] could not alloc img buffer on device %d: %s\n", devid,
              cl_errstr(err));
+  else
+    _pool_track(devid, dev, key, (size_t)width * height * bpp);
 
   dt_opencl_memory_statistics(devid, dev, OPENCL_MEMORY_ADD);
 
@@ -2584,11 +3150,25 @@ void *dt_opencl_alloc_device_buffer(const int devid, const size_t size)
   if(!darktable.opencl->inited) return NULL;
   cl_int err;
 
-  cl_mem buf = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(darktable.opencl->dev[devid].context,
-                                                                     CL_MEM_READ_WRITE, size, NULL, &err);
+  const uint64_t key = _pool_buffer_key(size);
+  cl_mem buf = _pool_get(devid, key);
+  if(buf)
+  {
+    dt_opencl_memory_statistics(devid, buf, OPENCL_MEMORY_ADD);
+    return buf;
+  }
+
+  buf = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(darktable.opencl->dev[devid].context,
+                                                              CL_MEM_READ_WRITE, size, NULL, &err);
+  if(err != CL_SUCCESS && _pool_flush(devid))
+    buf = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(darktable.opencl->dev[devid].context,
+                                                                CL_MEM_READ_WRITE, size, NULL, &err);
+
   if(err != CL_SUCCESS)
     dt_print(DT_DEBUG_OPENCL, "[opencl alloc_device_buffer] could not alloc buffer on device %d: %s\n", devid,
              cl_errstr(err));
+  else
+    _pool_track(devid, buf, key, size);
 
   dt_opencl_memory_statistics(devid, buf, OPENCL_MEMORY_ADD);
 
@@ -2675,6 +3255,16 @@ int dt_opencl_get_image_element_size(cl_mem mem)
 
 void dt_opencl_memory_statistics(int devid, cl_mem mem, dt_opencl_memory_t action)
 {
+  // accounted to the pipe running on this thread, if any
+  if(mem && dt_memstat_active())
+  {
+    const size_t size = dt_opencl_get_mem_object_size(mem);
+    if(action == OPENCL_MEMORY_ADD)
+      dt_memstat_alloc(DT_MEMSTAT_DEVICE, size);
+    else
+      dt_memstat_free(DT_MEMSTAT_DEVICE, size);
+  }
+
   if(!((darktable.unmuted & DT_DEBUG_MEMORY) && (darktable.unmuted & DT_DEBUG_OPENCL)))
     return;
 
@@ -2709,6 +3299,9 @@ void _opencl_get_unused_device_mem(const int devid)
   dt_opencl_t *cl = darktable.opencl;
   if(cl->dev[devid].tuned_available) return;
 
+  // idle buffers of the pool would be counted as used
+  _pool_flush(devid);
+
   size_t available = 0;
   size_t x_buff = dt_opencl_get_device_memalloc(devid);
   const size_t allmem = cl->dev[devid].max_global_mem;
@@ -2938,6 +3531,11 @@ int dt_opencl_update_settings(void)
     dt_print(DT_DEBUG_OPENCL, "[opencl_update_enabled] enabled flag set to %s\n", prefs ? "ON" : "OFF");
   }
 
+  cl->event_sync = dt_conf_get_bool("opencl_event_sync");
+  cl->perf_model = dt_conf_get_bool("opencl_scheduling_model");
+  cl->zero_copy = dt_conf_get_bool("opencl_zero_copy");
+  cl->overlapped_tiling = dt_conf_get_bool("opencl_overlapped_tiling");
+
   return (cl->enabled && !cl->stopped);
 }
 
@@ -94,6 +94,45 @@ typedef enum dt_opencl_pinmode_t
   DT_OPENCL_PINNING_DISABLED = 2
 } dt_opencl_pinmode_t;
 
+/**
+ * device buffers released by the pipe are kept for the next allocation of the same
+ * geometry (width, height, bytes per pixel for images, size for buffers), instead of
+ * being destroyed and created again by the driver for each module.
+ */
+typedef struct dt_opencl_mem_pool_t
+{
+  dt_pthread_mutex_t lock;  // protects everything below
+  GQueue idle;              // released buffers, most recently released at the tail
+  GHashTable *used;         // (cl_mem, entry) pairs of the buffers handed out by the pool
+  size_t idle_memory;       // bytes of the idle buffers
+  size_t used_memory;       // bytes of the buffers handed out
+  size_t peak_memory;       // high-water mark of idle + used
+  uint64_t hits;
+  uint64_t misses;
+} dt_opencl_mem_pool_t;
+
+#define DT_OPENCL_PERF_BUCKETS 8
+
+/**
+ * measured processing times of a module, by size of the region of interest:
+ * bucket 0 holds regions below 256k pixels, then one bucket per doubling.
+ */
+typedef struct dt_opencl_perf_entry_t
+{
+  float time[DT_OPENCL_PERF_BUCKETS]; // seconds per megapixel, moving average, 0 if never measured
+  int runs[DT_OPENCL_PERF_BUCKETS];   // decisions since the slower side was last measured
+} dt_opencl_perf_entry_t;
+
+/**
+ * timing model of one device, or of the CPU, collected while processing pipes and
+ * saved in the device config. See dt_opencl_perf_prefer_device().
+ */
+typedef struct dt_opencl_perf_model_t
+{
+  dt_pthread_mutex_t lock;  // protects everything below
+  GHashTable *modules;      // (gchar *op, dt_opencl_perf_entry_t *) pairs
+} dt_opencl_perf_model_t;
+
 /**
  * to support multi-gpu and mixed systems with cpu support,
  * we encapsulate devices and use separate command queues.
@@ -104,6 +143,10 @@ typedef struct dt_opencl_device_t
   cl_device_id devid;
   cl_context context;
   cl_command_queue cmd_queue;
+  // tiles are uploaded and downloaded on these while the kernels run on cmd_queue.
+  // NULL if they couldn't be created, see dt_opencl_use_overlapped_transfers().
+  cl_command_queue upload_queue;
+  cl_command_queue download_queue;
   size_t max_image_width;
   size_t max_image_height;
   cl_ulong max_mem_alloc;
@@ -113,6 +156,17 @@ typedef struct dt_opencl_device_t
   cl_kernel kernel[DT_OPENCL_MAX_KERNELS];
   int program_used[DT_OPENCL_MAX_PROGRAMS];
   int kernel_used[DT_OPENCL_MAX_KERNELS];
+  // programs without a cached binary are compiled in background, until then their kernels are NULL.
+  // protected by dt_opencl_t.lock.
+  int program_built[DT_OPENCL_MAX_PROGRAMS];
+  // build options of the program variants declared with -D constants in programs.conf, NULL for `options'
+  char *program_options[DT_OPENCL_MAX_PROGRAMS];
+  int kernel_program[DT_OPENCL_MAX_KERNELS];
+  char *kernel_name[DT_OPENCL_MAX_KERNELS];
+  GList *build_jobs;
+  pthread_t build_thread;
+  int build_running;
+  int build_quit;
   cl_event *eventlist;
   dt_opencl_eventtag_t *eventtags;
   int numevents;
@@ -129,12 +183,17 @@ typedef struct dt_opencl_device_t
   const char *cname;
   const char *options;
   cl_int summary;
-  // the benchmark value must not be changed by the user
-  float benchmark;
+  // measured times of the modules run on this device
+  dt_opencl_perf_model_t perf;
+  // seconds per megabyte of blocking copies between host and device, moving average, 0 if never measured.
+  // Protected by perf.lock.
+  float transfer_time;
   size_t memory_in_use;
   size_t peak_memory;
   size_t tuned_available;
   size_t used_available;
+  // recycled images and buffers, see dt_opencl_alloc_device()
+  dt_opencl_mem_pool_t pool;
   // flags what tuning modes should be used
   int tuneactive;
   // flags detected errors
@@ -145,7 +204,8 @@ typedef struct dt_opencl_device_t
   // they are processed with a bad performance.
   int avoid_atomics;
 
-  // pause OpenCL processing for this number of microseconds from time to time
+  // legacy pause of OpenCL processing in microseconds. Still read and written with the device
+  // config, dt_opencl_nap() now waits for the device instead of sleeping.
   int micro_nap;
 
   // During tiling huge amounts of memory need to be transferred between host and device.
@@ -161,6 +221,10 @@ typedef struct dt_opencl_device_t
   // 2 -> disabled under all circumstances. This could/should be used if we give away / ship specific keys for buggy systems
   int pinned_memory;
 
+  // the device works in host memory (integrated GPUs, APUs): images created on the pixelpipe cache
+  // buffers with CL_MEM_USE_HOST_PTR don't need copies. See dt_opencl_use_host_memory().
+  int unified_memory;
+
   // in OpenCL processing round width/height of global work groups to a multiple of these values.
   // reasonable values are powers of 2. this parameter can have high impact on OpenCL performance.
   int clroundup_wd;
@@ -177,6 +241,13 @@ typedef struct dt_opencl_device_t
   // opencl_events enabled for the device, set internally via event_handles
   int use_events;
 
+  // marker enqueued by the last dt_opencl_finish_sync_pipe() in event mode or dt_opencl_nap(), or NULL
+  cl_event sync_event;
+
+  // signaled by the event callbacks when the host waits for the device, see _opencl_wait_for_event()
+  GMutex done_lock;
+  GCond done_cond;
+
   // async pixelpipe mode for device
   // if set to TRUE OpenCL pixelpipe will not be synchronized on a per-module basis. this can improve pixelpipe latency.
   // however, potential OpenCL errors would be detected late; in such a case the complete pixelpipe needs to be reprocessed
@@ -213,6 +284,14 @@ typedef struct dt_opencl_t
   int num_devs;
   int error_count;
   int opencl_synchronization_timeout;
+  // pipes and tiling synchronize on events instead of finishing the queue, see opencl_event_sync
+  int event_sync;
+  // modules run where they were measured faster, see opencl_scheduling_model
+  int perf_model;
+  // devices with unified memory work in the host buffers, see opencl_zero_copy
+  int zero_copy;
+  // tiles are transferred while the previous ones are processed, see opencl_overlapped_tiling
+  int overlapped_tiling;
   uint32_t crc;
   int mandatory[5];
   int *dev_priority_image;
@@ -222,8 +301,8 @@ typedef struct dt_opencl_t
   dt_opencl_device_t *dev;
   dt_dlopencl_t *dlocl;
 
-  // we want the cpu benchmark to be available
-  float cpubenchmark;
+  // measured times of the modules run on the CPU
+  dt_opencl_perf_model_t cpu_perf;
   // global kernels for blending operations.
   struct dt_blendop_cl_global_t *blendop;
 
@@ -250,6 +329,9 @@ typedef struct dt_opencl_t
 
   // global kernels for guided filter.
   struct dt_guided_filter_cl_global_t *guided_filter;
+
+  // global kernels for the scopes of the global histograms.
+  struct dt_scopes_cl_global_t *scopes;
 } dt_opencl_t;
 
 /** description of memory requirements of local buffer
@@ -286,7 +368,9 @@ const char *cl_errstr(cl_int error);
 /** both finish functions return TRUE in case of success */
 /** cleans up command queue. */
 int dt_opencl_finish(const int devid);
-/** cleans up command queue if in synchron mode or while exporting */
+/** cleans up command queue if in synchron mode or while exporting.
+ *  In event mode, only waits until the work enqueued before the previous call is done,
+ *  so the device always has the next module queued. */
 int dt_opencl_finish_sync_pipe(const int devid, const int pipetype);
 
 /** enqueues a synchronization point. */
@@ -298,6 +382,25 @@ int dt_opencl_lock_device(const int pipetype);
 /** done with your command queue. */
 void dt_opencl_unlock_device(const int dev);
 
+/** locks, in order of priority, up to `max` other devices allowed for this pipe type which are free right now,
+ *  in addition to `dev`. Their ids are written in `devices`, returns how many were locked. */
+int dt_opencl_lock_extra_devices(const int pipetype, const int dev, int *devices, const int max);
+
+/** returns TRUE if the module `op` should run on the device for a region of `npixels`, comparing the times
+ *  measured so far on the device and on the CPU. `device_bytes` and `cpu_bytes` are the copies between host
+ *  and device that each choice implies, costed at the measured transfer rate. Now and then, the slower side
+ *  is tried again. */
+gboolean dt_opencl_perf_prefer_device(const int devid, const char *op, const size_t npixels,
+                                      const size_t device_bytes, const size_t cpu_bytes);
+
+/** adds a measured processing time of the module `op` to the model of the device, or of the CPU
+ *  if devid < 0. Device times are only taken when the pipe synchronized the device. */
+void dt_opencl_perf_record(const int devid, const int pipetype, const char *op, const size_t npixels,
+                           const double seconds);
+
+/** saves the timing models in the config. */
+void dt_opencl_perf_save(void);
+
 /** calculates md5sums for a list of CL include files. */
 void dt_opencl_md5sum(const char **files, char **md5sums);
 
@@ -395,11 +498,29 @@ void *dt_opencl_copy_host_to_device_rowpitch(const int devid, void *host, const
 
 void *dt_opencl_copy_host_to_device_constant(const int devid, const size_t size, void *host);
 
+/** non-blocking write on the upload queue of the device. The kernels enqueued next wait for it,
+ *  the host memory must stay untouched until the commands enqueued before the next download are done. */
+int dt_opencl_write_host_to_device_overlapped(const int devid, void *host, void *device, const size_t *origin,
+                                              const size_t *region, const int rowpitch);
+
+/** non-blocking read on the download queue of the device, starting once the commands already enqueued
+ *  are done. `done` receives the event to give to dt_opencl_wait_transfer() before reading the host memory. */
+int dt_opencl_read_host_from_device_overlapped(const int devid, void *host, void *device, const size_t *origin,
+                                               const size_t *region, const int rowpitch, cl_event *done);
+
+/** wait for an overlapped read and release its event. returns CL_SUCCESS or the error of the transfer. */
+int dt_opencl_wait_transfer(cl_event *done);
+
 int dt_opencl_enqueue_copy_image(const int devid, cl_mem src, cl_mem dst, size_t *orig_src, size_t *orig_dst,
                                  size_t *region);
 
 void *dt_opencl_alloc_device(const int devid, const int width, const int height, const int bpp);
 
+/** allocate count images and release them to the pool of the device, to be recycled by the next
+ *  dt_opencl_alloc_device() of the same geometry. */
+void dt_opencl_prealloc_images(const int devid, const int width, const int height, const int bpp,
+                               const int count);
+
 void *dt_opencl_alloc_device_use_host_pointer(const int devid, const int width, const int height,
                                               const int bpp, const int rowpitch, void *host);
 
@@ -429,6 +550,9 @@ void *dt_opencl_map_buffer(const int devid, cl_mem buffer, const int blocking, c
 
 int dt_opencl_unmap_mem_object(const int devid, cl_mem mem_object, void *mapped_ptr);
 
+/** makes the host memory of an image created with CL_MEM_USE_HOST_PTR up to date, blocking. */
+int dt_opencl_sync_host_image(const int devid, cl_mem image, const int width, const int height);
+
 size_t dt_opencl_get_mem_object_size(cl_mem mem);
 
 int dt_opencl_get_image_width(cl_mem mem);
@@ -482,7 +606,14 @@ void dt_opencl_write_device_config(const int devid);
 gboolean dt_opencl_read_device_config(const int devid);
 int dt_opencl_avoid_atomics(const int devid);
 int dt_opencl_micro_nap(const int devid);
+/** indirectly give the device some air to breathe (and to do display related stuff): wait until it is
+    done with the commands enqueued up to the previous call, the host wakes up as soon as it is */
+void dt_opencl_nap(const int devid);
 gboolean dt_opencl_use_pinned_memory(const int devid);
+/** TRUE if the pipe should run kernels straight on host buffers, see opencl_zero_copy */
+gboolean dt_opencl_use_host_memory(const int devid);
+/** TRUE if tiles can be transferred while the kernels run, see opencl_overlapped_tiling */
+gboolean dt_opencl_use_overlapped_transfers(const int devid);
 
 #else
 #include "control/conf.h"
@@ -525,6 +656,26 @@ static inline int dt_opencl_lock_device(const int dev)
 static inline void dt_opencl_unlock_device(const int dev)
 {
 }
+static inline void dt_opencl_prealloc_images(const int devid, const int width, const int height, const int bpp,
+                                             const int count)
+{
+}
+static inline int dt_opencl_lock_extra_devices(const int pipetype, const int dev, int *devices, const int max)
+{
+  return 0;
+}
+static inline gboolean dt_opencl_perf_prefer_device(const int devid, const char *op, const size_t npixels,
+                                                    const size_t device_bytes, const size_t cpu_bytes)
+{
+  return FALSE;
+}
+static inline void dt_opencl_perf_record(const int devid, const int pipetype, const char *op,
+                                         const size_t npixels, const double seconds)
+{
+}
+static inline void dt_opencl_perf_save(void)
+{
+}
 static inline int dt_opencl_load_program(const int dev, const char *filename)
 {
   return -1;
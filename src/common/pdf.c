@@ -268,25 +268,101 @@ static size_t _pdf_stream_encoder_ASCIIHex(dt_pdf_t *pdf, const unsigned char *d
   return len * 2;
 }
 
-// using zlib we get quite small files, but it's slow
-static size_t _pdf_stream_encoder_Flate(dt_pdf_t *pdf, const unsigned char *data, size_t len)
+// the input of a flate stream is cut into blocks of that size, compressed on their own
+#define FLATE_BLOCK_SIZE ((size_t)1 << 20)
+
+// raw deflate of one block, ending on a byte boundary so that the blocks can be put one after the other
+static unsigned char *_pdf_deflate_block(const unsigned char *data, size_t len, const int last, size_t *out_len)
 {
-  int result;
-  uLongf destLen = compressBound(len);
-  unsigned char *buffer = (unsigned char *)malloc(destLen);
+  z_stream strm = { 0 };
+  if(deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return NULL;
+
+  // the sync flush adds a few bytes on top of the bound
+  const size_t size = deflateBound(&strm, len) + 16;
+  unsigned char *buffer = (unsigned char *)malloc(size);
+  if(!buffer)
+  {
+    deflateEnd(&strm);
+    return NULL;
+  }
 
-  result = compress(buffer, &destLen, data, len);
+  strm.next_in = (unsigned char *)data;
+  strm.avail_in = len;
+  strm.next_out = buffer;
+  strm.avail_out = size;
+  const int result = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+  *out_len = size - strm.avail_out;
+  deflateEnd(&strm);
 
-  if(result != Z_OK)
+  if(result != (last ? Z_STREAM_END : Z_OK) || strm.avail_in != 0)
   {
     free(buffer);
+    return NULL;
+  }
+  return buffer;
+}
+
+// using zlib we get quite small files, but it's slow. the blocks are compressed in parallel and written as
+// one zlib stream, with the adler32 checksums of the blocks combined.
+static size_t _pdf_stream_encoder_Flate(dt_pdf_t *pdf, const unsigned char *data, size_t len)
+{
+  const size_t n_blocks = MAX((len + FLATE_BLOCK_SIZE - 1) / FLATE_BLOCK_SIZE, 1);
+  unsigned char **blocks = calloc(n_blocks, sizeof(unsigned char *));
+  size_t *block_len = calloc(n_blocks, sizeof(size_t));
+  uLong *block_adler = calloc(n_blocks, sizeof(uLong));
+  if(!blocks || !block_len || !block_adler)
+  {
+    free(blocks);
+    free(block_len);
+    free(block_adler);
     return 0;
   }
 
-  fwrite(buffer, 1, destLen, pdf->fd);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) default(none) shared(data, len, n_blocks, blocks, block_len, block_adler)
+#endif
+  for(size_t k = 0; k < n_blocks; k++)
+  {
+    const size_t start = k * FLATE_BLOCK_SIZE;
+    const size_t size = MIN(FLATE_BLOCK_SIZE, len - start);
+    blocks[k] = _pdf_deflate_block(data + start, size, k == n_blocks - 1, &block_len[k]);
+    block_adler[k] = adler32(adler32(0L, Z_NULL, 0), data + start, size);
+  }
+
+  size_t stream_size = 0;
+  gboolean failed = FALSE;
+  for(size_t k = 0; k < n_blocks; k++) failed |= (blocks[k] == NULL);
+
+  if(!failed)
+  {
+    // zlib header: deflate with a 32k window, default compression
+    const unsigned char header[2] = { 0x78, 0x9c };
+    fwrite(header, 1, sizeof(header), pdf->fd);
+    stream_size += sizeof(header);
 
-  free(buffer);
-  return destLen;
+    uLong adler = block_adler[0];
+    for(size_t k = 0; k < n_blocks; k++)
+    {
+      if(k > 0)
+      {
+        const size_t size = MIN(FLATE_BLOCK_SIZE, len - k * FLATE_BLOCK_SIZE);
+        adler = adler32_combine(adler, block_adler[k], size);
+      }
+      fwrite(blocks[k], 1, block_len[k], pdf->fd);
+      stream_size += block_len[k];
+    }
+
+    const unsigned char trailer[4] = { adler >> 24, (adler >> 16) & 0xff, (adler >> 8) & 0xff, adler & 0xff };
+    fwrite(trailer, 1, sizeof(trailer), pdf->fd);
+    stream_size += sizeof(trailer);
+  }
+
+  for(size_t k = 0; k < n_blocks; k++) free(blocks[k]);
+  free(blocks);
+  free(block_len);
+  free(block_adler);
+  return stream_size;
 }
 
 static size_t _pdf_write_stream(dt_pdf_t *pdf, dt_pdf_stream_encoder_t encoder, const unsigned char *data, size_t len)
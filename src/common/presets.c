@@ -32,6 +32,7 @@
 #include <libxml/xpathInternals.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <inttypes.h>
 #include <sqlite3.h>
 
@@ -197,6 +198,88 @@ static int get_preset_element_float(xmlDocPtr doc, gchar *name)
   return result;
 }
 
+static gchar *_presets_stamp(GModule *so, const int version)
+{
+  // the file of the module, so that a rebuild with new built-in presets is seen
+  GStatBuf st = { 0 };
+  const gchar *filename = so ? g_module_name(so) : NULL;
+  if(filename) g_stat(filename, &st);
+  return g_strdup_printf("%d|%d|%" G_GINT64_FORMAT "|%" G_GINT64_FORMAT, version, dt_develop_blend_version(),
+                         (gint64)st.st_mtime, (gint64)st.st_size);
+}
+
+gboolean dt_presets_stamp_changed(const char *operation, GModule *so, const int version)
+{
+  gchar *key = g_strdup_printf("presets/%s", operation);
+  gchar *stamp = _presets_stamp(so, version);
+  gboolean changed = TRUE;
+
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db, "SELECT value FROM data.db_info WHERE key = ?1");
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, key, -1, SQLITE_TRANSIENT);
+  if(sqlite3_step(stmt) == SQLITE_ROW)
+    changed = g_strcmp0((const char *)sqlite3_column_text(stmt, 0), stamp) != 0;
+  dt_database_release_statement(darktable.db, stmt);
+
+  if(changed)
+  {
+    // the module creates them again
+    stmt = dt_database_get_statement(darktable.db,
+                                     "DELETE FROM data.presets WHERE writeprotect = 1 AND operation = ?1");
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, operation, -1, SQLITE_TRANSIENT);
+    sqlite3_step(stmt);
+    dt_database_release_statement(darktable.db, stmt);
+  }
+
+  g_free(stamp);
+  g_free(key);
+  return changed;
+}
+
+void dt_presets_stamp_set(const char *operation, GModule *so, const int version)
+{
+  gchar *key = g_strdup_printf("presets/%s", operation);
+  gchar *stamp = _presets_stamp(so, version);
+  sqlite3_stmt *stmt
+      = dt_database_get_statement(darktable.db, "INSERT OR REPLACE INTO data.db_info (key, value) VALUES (?1, ?2)");
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, key, -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, stamp, -1, SQLITE_TRANSIENT);
+  sqlite3_step(stmt);
+  dt_database_release_statement(darktable.db, stmt);
+  g_free(stamp);
+  g_free(key);
+}
+
+void dt_presets_stamp_reset_all()
+{
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "DELETE FROM data.db_info WHERE key LIKE 'presets/%' AND key <> 'presets/version'", NULL,
+                        NULL, NULL);
+}
+
+void dt_presets_stamp_init()
+{
+  gboolean same_version = FALSE;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT value FROM data.db_info WHERE key = 'presets/version'", -1, &stmt, NULL);
+  if(sqlite3_step(stmt) == SQLITE_ROW)
+    same_version = !g_strcmp0((const char *)sqlite3_column_text(stmt, 0), darktable_package_version);
+  sqlite3_finalize(stmt);
+  if(same_version) return;
+
+  // also drops the built-in presets of the modules that are gone
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM data.presets WHERE writeprotect = 1", NULL,
+                        NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM data.db_info WHERE key LIKE 'presets/%'",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT INTO data.db_info (key, value) VALUES ('presets/version', ?1)", -1, &stmt,
+                              NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, darktable_package_version, -1, SQLITE_STATIC);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+}
+
 int dt_presets_import_from_file(const char *preset_path)
 {
   xmlDocPtr doc = xmlParseFile(preset_path);
@@ -292,6 +375,9 @@ int dt_presets_import_from_file(const char *preset_path)
 
   sqlite3_finalize(stmt);
 
+  // the preset can be of an older version of the module, the startup updates it
+  if(result) dt_presets_stamp_reset_all();
+
   g_free(name);
   g_free(description);
   g_free(operation);
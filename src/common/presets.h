@@ -28,6 +28,17 @@ int dt_presets_import_from_file(const char *preset_path);
 
 // does the module support autoapplying presets ?
 gboolean dt_presets_module_can_autoapply(const gchar *operation);
+
+/* the built-in presets of a module are created again at startup only when its stamp changed: the module
+   binary, its version or the blend version. A new version of the application renews them all. */
+/** TRUE if the built-in presets of the module loaded from so must be created again, then stale ones are deleted */
+gboolean dt_presets_stamp_changed(const char *operation, GModule *so, const int version);
+/** record that the built-in presets of the module are up to date */
+void dt_presets_stamp_set(const char *operation, GModule *so, const int version);
+/** renew all the built-in presets on the next startup, for example after an import of older presets */
+void dt_presets_stamp_reset_all();
+/** to be called before the modules are loaded, drops all the stamps for a new version of the application */
+void dt_presets_stamp_init();
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -66,14 +66,13 @@ char *dt_ratings_get_name(const int rating)
 int dt_ratings_get(const int32_t imgid)
 {
   int stars = 0;
-  dt_image_t *image = dt_image_cache_get(darktable.image_cache, imgid, 'r');
-  if(image)
+  dt_image_snapshot_t image;
+  if(!dt_image_cache_get_snapshot(darktable.image_cache, imgid, &image))
   {
-    if(image->flags & DT_IMAGE_REJECTED)
+    if(image.flags & DT_IMAGE_REJECTED)
       stars = DT_VIEW_REJECT;
     else
-      stars = DT_VIEW_RATINGS_MASK & image->flags;
-    dt_image_cache_read_release(darktable.image_cache, image);
+      stars = DT_VIEW_RATINGS_MASK & image.flags;
   }
   return stars;
 }
@@ -120,11 +120,10 @@ static void _selection_select(dt_selection_t *selection, int32_t imgid)
 {
   if(imgid != -1)
   {
-    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, imgid, 'r');
-    if(image)
+    dt_image_snapshot_t image;
+    if(!dt_image_cache_get_snapshot(darktable.image_cache, imgid, &image))
     {
-      const uint32_t img_group_id = image->group_id;
-      dt_image_cache_read_release(darktable.image_cache, image);
+      const uint32_t img_group_id = image.group_id;
 
       gchar *query = NULL;
       if(!darktable.gui || !darktable.gui->grouping || darktable.gui->expanded_group_id == img_group_id
@@ -153,11 +152,10 @@ void _selection_deselect(dt_selection_t *selection, int32_t imgid)
 {
   if(imgid != -1)
   {
-    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, imgid, 'r');
-    if(image)
+    dt_image_snapshot_t image;
+    if(!dt_image_cache_get_snapshot(darktable.image_cache, imgid, &image))
     {
-      const uint32_t img_group_id = image->group_id;
-      dt_image_cache_read_release(darktable.image_cache, image);
+      const uint32_t img_group_id = image.group_id;
 
       gchar *query = NULL;
       if(!darktable.gui || !darktable.gui->grouping || darktable.gui->expanded_group_id == img_group_id)
@@ -548,48 +548,117 @@ gboolean dt_styles_create_from_image(const char *name, const char *description,
   return FALSE;
 }
 
-void dt_styles_apply_to_list(const char *name, const GList *list, gboolean duplicate)
+// images applied per database transaction, instead of one commit per history item
+#define DT_STYLES_APPLY_BATCH 32
+
+typedef struct dt_styles_apply_t
 {
-  gboolean selected = FALSE;
+  GList *styles; // names of the styles, in the order they are applied
+  GList *imgs;   // ids of the images
+  gboolean duplicate;
+} dt_styles_apply_t;
 
-  /* write current history changes so nothing gets lost,
-     do that only in the darkroom as there is nothing to be saved
-     when in the lighttable (and it would write over current history stack) */
-  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
-  if(cv->view(cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+static void _styles_apply_to_image(const char *name, const gboolean duplicate, const int32_t imgid,
+                                   const gboolean batch);
+
+static void _styles_apply_free(void *data)
+{
+  dt_styles_apply_t *d = (dt_styles_apply_t *)data;
+  g_list_free_full(d->styles, g_free);
+  g_list_free(d->imgs);
+  free(d);
+}
+
+static void _styles_apply(dt_styles_apply_t *d, dt_job_t *job)
+{
+  const guint total = g_list_length(d->imgs);
+  guint done = 0;
 
-  /* for each selected image apply style */
   dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
 
-  for(const GList *l = list; l; l = g_list_next(l))
+  for(const GList *l = d->imgs; l; l = g_list_next(l))
   {
+    if(job && dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED) break;
+
+    // the transactions opened on the way become savepoints of this one
+    if(done % DT_STYLES_APPLY_BATCH == 0) dt_database_start_transaction(darktable.db);
+
     const int32_t imgid = GPOINTER_TO_INT(l->data);
-    dt_styles_apply_to_image(name, duplicate, imgid);
-    selected = TRUE;
+    for(const GList *style = d->styles; style; style = g_list_next(style))
+      _styles_apply_to_image((const char *)style->data, d->duplicate, imgid, job != NULL);
+
+    done++;
+    if(done % DT_STYLES_APPLY_BATCH == 0) dt_database_release_transaction(darktable.db);
+    if(job) dt_control_job_set_progress(job, (double)done / total);
   }
+  if(done % DT_STYLES_APPLY_BATCH != 0) dt_database_release_transaction(darktable.db);
 
   dt_undo_end_group(darktable.undo);
 
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
 
-  if(!selected)
-  {
-    dt_control_log(_("no image selected!"));
-  }
+  if(done < total)
+    dt_control_log(ngettext("style applied to %d image out of %d", "style applied to %d images out of %d", done),
+                   done, total);
+  else if(d->styles && !d->styles->next)
+    dt_control_log(_("style %s successfully applied!"), (const char *)d->styles->data);
   else
-  {
-    dt_control_log(_("style %s successfully applied!"), name);
-  }
+    dt_control_log(ngettext("style successfully applied!", "styles successfully applied!",
+                            g_list_length(d->styles)));
 }
 
-void dt_multiple_styles_apply_to_list(GList *styles, const GList *list, gboolean duplicate)
+static int32_t _styles_apply_job_run(dt_job_t *job)
 {
+  _styles_apply((dt_styles_apply_t *)dt_control_job_get_params(job), job);
+  return 0;
+}
+
+// takes ownership of styles, copies imgs
+static void _styles_apply_to_list(GList *styles, const GList *imgs, const gboolean duplicate)
+{
+  dt_styles_apply_t *d = (dt_styles_apply_t *)malloc(sizeof(dt_styles_apply_t));
+  d->styles = styles;
+  d->imgs = g_list_copy((GList *)imgs);
+  d->duplicate = duplicate;
+
   /* write current history changes so nothing gets lost,
      do that only in the darkroom as there is nothing to be saved
-     when in the lighttable (and it would write over current history stack) */
+     when in the lighttable (and it would write over current history stack).
+     The darkroom may reload the history of the current image, which has to happen in the GUI thread:
+     apply right away there. Elsewhere, large selections would freeze the GUI, let a job do it. */
   const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
-  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM)
+  {
+    dt_dev_write_history(darktable.develop);
+    _styles_apply(d, NULL);
+    _styles_apply_free(d);
+    return;
+  }
 
+  dt_job_t *job = dt_control_job_create(&_styles_apply_job_run, "apply styles");
+  if(!job)
+  {
+    _styles_apply_free(d);
+    return;
+  }
+  dt_control_job_add_progress(job, _("apply styles"), TRUE);
+  dt_control_job_set_params(job, d, _styles_apply_free);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG, job);
+}
+
+void dt_styles_apply_to_list(const char *name, const GList *list, gboolean duplicate)
+{
+  if(!list)
+  {
+    dt_control_log(_("no image selected!"));
+    return;
+  }
+
+  _styles_apply_to_list(g_list_append(NULL, g_strdup(name)), list, duplicate);
+}
+
+void dt_multiple_styles_apply_to_list(GList *styles, const GList *list, gboolean duplicate)
+{
   if(!styles && !list)
   {
     dt_control_log(_("no images nor styles selected!"));
@@ -606,22 +675,7 @@ void dt_multiple_styles_apply_to_list(GList *styles, const GList *list, gboolean
     return;
   }
 
-  /* for each selected image apply style */
-  dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-  for(const GList *l = list; l; l = g_list_next(l))
-  {
-    const int32_t imgid = GPOINTER_TO_INT(l->data);
-    for (GList *style = styles; style; style = g_list_next(style))
-    {
-      dt_styles_apply_to_image((char*)style->data, duplicate, imgid);
-    }
-  }
-  dt_undo_end_group(darktable.undo);
-
-  DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
-
-  const guint styles_cnt = g_list_length(styles);
-  dt_control_log(ngettext("style successfully applied!", "styles successfully applied!", styles_cnt));
+  _styles_apply_to_list(g_list_copy_deep(styles, (GCopyFunc)g_strdup, NULL), list, duplicate);
 }
 
 void dt_styles_create_from_list(const GList *list)
@@ -742,6 +796,12 @@ void dt_styles_apply_style_item(dt_develop_t *dev, dt_style_item_t *style_item,
 }
 
 void dt_styles_apply_to_image(const char *name, const gboolean duplicate, const int32_t imgid)
+{
+  _styles_apply_to_image(name, duplicate, imgid, FALSE);
+}
+
+static void _styles_apply_to_image(const char *name, const gboolean duplicate, const int32_t imgid,
+                                   const gboolean batch)
 {
   int id = 0;
   sqlite3_stmt *stmt;
@@ -871,8 +931,9 @@ void dt_styles_apply_to_image(const char *name, const gboolean duplicate, const
     /* add tag */
     dt_dev_append_changed_tag(newimgid);
 
-    /* if current image in develop reload history */
-    if(dt_dev_is_current_image(darktable.develop, newimgid))
+    /* if current image in develop reload history.
+       Batches run outside of the darkroom, which reads the history again when entered. */
+    if(!batch && dt_dev_is_current_image(darktable.develop, newimgid))
     {
       dt_dev_reload_history_items(darktable.develop);
       dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
@@ -882,8 +943,13 @@ void dt_styles_apply_to_image(const char *name, const gboolean duplicate, const
     /* update xmp file */
     dt_control_save_xmp(newimgid);
 
-    /* remove old obsolete thumbnails */
-    dt_mipmap_cache_remove(darktable.mipmap_cache, newimgid);
+    /* remove old obsolete thumbnails. In batches, only the visible ones get regenerated,
+       when the signal below refreshes them. */
+    if(dt_history_hash_mipmap_outdated(newimgid))
+    {
+      dt_mipmap_cache_remove(darktable.mipmap_cache, newimgid);
+      if(!batch) dt_image_load_regenerate(newimgid);
+    }
 
     /* update the aspect ratio. recompute only if really needed for performance reasons */
     if(darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO)
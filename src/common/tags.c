@@ -36,100 +36,142 @@ typedef struct dt_undo_tags_t
   GList *after; // list of tagid after
 } dt_undo_tags_t;
 
-static gchar *_get_tb_removed_tag_string_values(GList *before, GList *after)
+// attachments or detachments of a bulk operation, only those which changed something
+typedef struct dt_undo_tags_bulk_t
 {
-  GList *a = after;
-  gchar *tag_list = NULL;
-  for(GList *b = before; b; b = g_list_next(b))
+  GArray *pairs; // imgid, tagid
+  gboolean attach;
+} dt_undo_tags_bulk_t;
+
+/* the tag dictionary kept in memory, so the keywords GUI can filter the hierarchy on each keystroke
+   without querying the database. it holds every tag and every node of the hierarchy which is not a
+   tag itself, sorted by name. it is built on first use and dropped on any change of tags. */
+typedef struct dt_tag_index_entry_t
+{
+  gchar *name;
+  gchar *key;     // lower case name and synonyms, what keywords are matched against
+  gchar *synonym;
+  guint id;       // 0 for the nodes of the hierarchy
+  guint count;
+  gint flags;
+} dt_tag_index_entry_t;
+
+static GMutex _tag_index_lock;
+static GPtrArray *_tag_index = NULL;
+
+static void _pop_undo_execute(const int32_t imgid, GList *before, GList *after)
+{
+  // this runs for every image of bulk operations, the statements are kept prepared
+  if(imgid > 0)
   {
-    if(!g_list_find(a, b->data))
+    sqlite3_stmt *stmt = dt_database_get_statement(darktable.db, "DELETE FROM main.tagged_images"
+                                                                 " WHERE imgid = ?1 AND tagid = ?2");
+    for(GList *b = before; b; b = g_list_next(b))
     {
-      tag_list = dt_util_dstrcat(tag_list, "%d,", GPOINTER_TO_INT(b->data));
+      if(!g_list_find(after, b->data))
+      {
+        DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+        DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, GPOINTER_TO_INT(b->data));
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+      }
     }
+    dt_database_release_statement(darktable.db, stmt);
   }
-  if(tag_list) tag_list[strlen(tag_list) - 1] = '\0';
-  return tag_list;
-}
 
-static gchar *_get_tb_added_tag_string_values(const int img, GList *before, GList *after)
-{
-  GList *b = before;
-  gchar *tag_list = NULL;
+  // clang-format off
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
+                                                 "INSERT INTO main.tagged_images (imgid, tagid, position)"
+                                                 " VALUES (?1, ?2,"
+                                                 "  (SELECT (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000) + (1 << 32)"
+                                                 "    FROM main.tagged_images))");
+  // clang-format on
   for(GList *a = after; a; a = g_list_next(a))
   {
-    if(!g_list_find(b, a->data))
+    if(!g_list_find(before, a->data))
     {
-      // clang-format off
-      tag_list = dt_util_dstrcat(tag_list,
-                                 "(%d,%d,"
-                                 "  (SELECT (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000) + (1 << 32)"
-                                 "    FROM main.tagged_images)"
-                                 "),",
-                                 GPOINTER_TO_INT(img),
-                                 GPOINTER_TO_INT(a->data));
-      // clang-format on
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, GPOINTER_TO_INT(a->data));
+      sqlite3_step(stmt);
+      sqlite3_reset(stmt);
     }
   }
-  if(tag_list) tag_list[strlen(tag_list) - 1] = '\0';
-  return tag_list;
+  dt_database_release_statement(darktable.db, stmt);
+
+  dt_tag_index_invalidate();
 }
 
-static void _bulk_remove_tags(const int img, const gchar *tag_list)
+static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t data, dt_undo_action_t action, GList **imgs)
 {
-  if(img > 0 && tag_list)
+  if(type == DT_UNDO_TAGS)
   {
-    sqlite3_stmt *stmt;
-    gchar *query = g_strdup_printf("DELETE FROM main.tagged_images WHERE imgid = %d AND tagid IN (%s)", img, tag_list);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    g_free(query);
+    for(GList *list = (GList *)data; list; list = g_list_next(list))
+    {
+      dt_undo_tags_t *undotags = (dt_undo_tags_t *)list->data;
+
+      GList *before = (action == DT_ACTION_UNDO) ? undotags->after : undotags->before;
+      GList *after = (action == DT_ACTION_UNDO) ? undotags->before : undotags->after;
+      _pop_undo_execute(undotags->imgid, before, after);
+      *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(undotags->imgid));
+    }
+
+    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
   }
 }
 
-static void _bulk_add_tags(const gchar *tag_list)
+static void _pop_undo_bulk_execute(const GArray *pairs, const gboolean attach)
 {
-  if(tag_list)
+  // clang-format off
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db, attach
+                                                 ? "INSERT OR IGNORE INTO main.tagged_images (imgid, tagid, position)"
+                                                   " VALUES (?1, ?2,"
+                                                   "  (SELECT (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000) + (1 << 32)"
+                                                   "    FROM main.tagged_images))"
+                                                 : "DELETE FROM main.tagged_images"
+                                                   " WHERE imgid = ?1 AND tagid = ?2");
+  // clang-format on
+  dt_database_start_transaction(darktable.db);
+  for(guint k = 0; k + 1 < pairs->len; k += 2)
   {
-    sqlite3_stmt *stmt;
-    gchar *query = g_strdup_printf("INSERT INTO main.tagged_images (imgid, tagid, position) VALUES %s", tag_list);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, g_array_index(pairs, int32_t, k));
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, g_array_index(pairs, int32_t, k + 1));
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    g_free(query);
+    sqlite3_reset(stmt);
   }
-}
+  dt_database_release_transaction(darktable.db);
+  dt_database_release_statement(darktable.db, stmt);
 
-static void _pop_undo_execute(const int32_t imgid, GList *before, GList *after)
-{
-  gchar *tobe_removed_list = _get_tb_removed_tag_string_values(before, after);
-  gchar *tobe_added_list = _get_tb_added_tag_string_values(imgid, before, after);
-
-  _bulk_remove_tags(imgid, tobe_removed_list);
-  _bulk_add_tags(tobe_added_list);
-
-  g_free(tobe_removed_list);
-  g_free(tobe_added_list);
+  dt_tag_index_invalidate();
 }
 
-static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t data, dt_undo_action_t action, GList **imgs)
+static void _pop_undo_bulk(gpointer user_data, dt_undo_type_t type, dt_undo_data_t data, dt_undo_action_t action,
+                           GList **imgs)
 {
   if(type == DT_UNDO_TAGS)
   {
-    for(GList *list = (GList *)data; list; list = g_list_next(list))
-    {
-      dt_undo_tags_t *undotags = (dt_undo_tags_t *)list->data;
+    const dt_undo_tags_bulk_t *undotags = (dt_undo_tags_bulk_t *)data;
+    _pop_undo_bulk_execute(undotags->pairs, (action == DT_ACTION_UNDO) != undotags->attach);
 
-      GList *before = (action == DT_ACTION_UNDO) ? undotags->after : undotags->before;
-      GList *after = (action == DT_ACTION_UNDO) ? undotags->before : undotags->after;
-      _pop_undo_execute(undotags->imgid, before, after);
-      *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(undotags->imgid));
+    GHashTable *seen = g_hash_table_new(NULL, NULL);
+    for(guint k = 0; k + 1 < undotags->pairs->len; k += 2)
+    {
+      const int32_t imgid = g_array_index(undotags->pairs, int32_t, k);
+      if(g_hash_table_add(seen, GINT_TO_POINTER(imgid)))
+        *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(imgid));
     }
+    g_hash_table_destroy(seen);
 
     DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
   }
 }
 
+static void _tags_undo_bulk_free(gpointer data)
+{
+  dt_undo_tags_bulk_t *undotags = (dt_undo_tags_bulk_t *)data;
+  g_array_free(undotags->pairs, TRUE);
+  g_free(undotags);
+}
+
 static void _undo_tags_free(gpointer data)
 {
   dt_undo_tags_t *undotags = (dt_undo_tags_t *)data;
@@ -190,6 +232,7 @@ gboolean dt_tag_new(const char *name, guint *tagid)
   if(tagid != NULL)
     *tagid = id;
 
+  dt_tag_index_invalidate();
   return TRUE;
 }
 
@@ -234,6 +277,8 @@ guint dt_tag_remove(const guint tagid, gboolean final)
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, tagid);
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
+
+    dt_tag_index_invalidate();
   }
 
   return count;
@@ -320,6 +365,7 @@ void dt_tag_rename(const guint tagid, const gchar *new_tagname)
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
 
+  dt_tag_index_invalidate();
 }
 
 gboolean dt_tag_exists(const char *name, guint *tagid)
@@ -343,30 +389,6 @@ gboolean dt_tag_exists(const char *name, guint *tagid)
   return FALSE;
 }
 
-static gboolean _tag_add_tags_to_list(GList **list, const GList *tags)
-{
-  gboolean res = FALSE;
-  for(const GList *t = tags; t; t = g_list_next(t))
-  {
-    if(!g_list_find(*list, t->data))
-    {
-      *list = g_list_prepend(*list, t->data);
-      res = TRUE;
-    }
-  }
-  return res;
-}
-
-static gboolean _tag_remove_tags_from_list(GList **list, const GList *tags)
-{
-  const int nb_ini = g_list_length(*list);
-  for(const GList *t = tags; t; t = g_list_next(t))
-  {
-    *list = g_list_remove(*list, t->data);
-  }
-  return (g_list_length(*list) != nb_ini);
-}
-
 typedef enum dt_tag_type_t
 {
   DT_TAG_TYPE_DT,
@@ -376,9 +398,7 @@ typedef enum dt_tag_type_t
 
 typedef enum dt_tag_actions_t
 {
-  DT_TA_ATTACH = 0,
-  DT_TA_DETACH,
-  DT_TA_SET,
+  DT_TA_SET = 0,
   DT_TA_SET_ALL,
 } dt_tag_actions_t;
 
@@ -396,14 +416,6 @@ static gboolean _tag_execute(const GList *tags, const GList *imgs, GList **undo,
     undotags->before = _tag_get_tags(image_id, DT_TAG_TYPE_ALL);
     switch(action)
     {
-      case DT_TA_ATTACH:
-        undotags->after = g_list_copy(undotags->before);
-        if(_tag_add_tags_to_list(&undotags->after, tags)) res = TRUE;
-        break;
-      case DT_TA_DETACH:
-        undotags->after = g_list_copy(undotags->before);
-        if(_tag_remove_tags_from_list(&undotags->after, tags)) res = TRUE;
-        break;
       case DT_TA_SET:
         undotags->after = g_list_copy((GList *)tags);
         // preserve dt tags
@@ -429,24 +441,88 @@ static gboolean _tag_execute(const GList *tags, const GList *imgs, GList **undo,
   return res;
 }
 
-gboolean dt_tag_attach_images(const guint tagid, const GList *img, const gboolean undo_on)
+/* attach or detach the tags to all the images with one statement per tag, going through
+   memory.tag_images. the undo record only keeps the pairs which have actually changed. */
+static gboolean _tag_execute_bulk(const GList *tags, const GList *imgs, const gboolean undo_on,
+                                  const gboolean attach)
 {
-  if(!img) return FALSE;
-  GList *undo = NULL;
-  GList *tags = NULL;
+  if(!tags || !imgs) return FALSE;
 
-  tags = g_list_prepend(tags, GINT_TO_POINTER(tagid));
-  if(undo_on) dt_undo_start_group(darktable.undo, DT_UNDO_TAGS);
+  dt_database_start_transaction(darktable.db);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.tag_images", NULL, NULL, NULL);
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
+                                                 "INSERT OR IGNORE INTO memory.tag_images (imgid) VALUES (?1)");
+  for(const GList *images = imgs; images; images = g_list_next(images))
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, GPOINTER_TO_INT(images->data));
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  dt_database_release_statement(darktable.db, stmt);
+
+  GArray *pairs = g_array_new(FALSE, FALSE, sizeof(int32_t));
+  sqlite3_stmt *changed = dt_database_get_statement(darktable.db, attach
+                                                    ? "SELECT imgid FROM memory.tag_images"
+                                                      " WHERE imgid NOT IN"
+                                                      "  (SELECT imgid FROM main.tagged_images WHERE tagid = ?1)"
+                                                    : "SELECT imgid FROM main.tagged_images"
+                                                      " WHERE tagid = ?1 AND imgid IN memory.tag_images");
+  // the new attachments come after all others, in the order of the images
+  // clang-format off
+  sqlite3_stmt *apply = dt_database_get_statement(darktable.db, attach
+                                                  ? "INSERT OR IGNORE INTO main.tagged_images (imgid, tagid, position)"
+                                                    "  SELECT imgid, ?1,"
+                                                    "   (SELECT IFNULL(MAX(position),0) & 0xFFFFFFFF00000000"
+                                                    "     FROM main.tagged_images) + (rowid << 32)"
+                                                    "  FROM memory.tag_images"
+                                                    "  ORDER BY rowid"
+                                                    : "DELETE FROM main.tagged_images"
+                                                    " WHERE tagid = ?1 AND imgid IN memory.tag_images");
+  // clang-format on
+  for(const GList *t = tags; t; t = g_list_next(t))
+  {
+    const int32_t tagid = GPOINTER_TO_INT(t->data);
+    DT_DEBUG_SQLITE3_BIND_INT(changed, 1, tagid);
+    while(sqlite3_step(changed) == SQLITE_ROW)
+    {
+      const int32_t pair[2] = { sqlite3_column_int(changed, 0), tagid };
+      g_array_append_vals(pairs, pair, 2);
+    }
+    sqlite3_reset(changed);
 
-  const gboolean res = _tag_execute(tags, img, &undo, undo_on, DT_TA_ATTACH);
+    DT_DEBUG_SQLITE3_BIND_INT(apply, 1, tagid);
+    sqlite3_step(apply);
+    sqlite3_reset(apply);
+  }
+  dt_database_release_statement(darktable.db, changed);
+  dt_database_release_statement(darktable.db, apply);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.tag_images", NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
 
-  g_list_free(tags);
-  if(undo_on)
+  dt_tag_index_invalidate();
+
+  const gboolean res = pairs->len > 0;
+  if(undo_on && res)
   {
-    dt_undo_record(darktable.undo, NULL, DT_UNDO_TAGS, undo, _pop_undo, _tags_undo_data_free);
+    dt_undo_tags_bulk_t *undotags = g_malloc(sizeof(dt_undo_tags_bulk_t));
+    undotags->pairs = pairs;
+    undotags->attach = attach;
+    dt_undo_start_group(darktable.undo, DT_UNDO_TAGS);
+    dt_undo_record(darktable.undo, NULL, DT_UNDO_TAGS, undotags, _pop_undo_bulk, _tags_undo_bulk_free);
     dt_undo_end_group(darktable.undo);
   }
+  else
+    g_array_free(pairs, TRUE);
+
+  return res;
+}
 
+gboolean dt_tag_attach_images(const guint tagid, const GList *img, const gboolean undo_on)
+{
+  if(!img) return FALSE;
+  GList *tags = g_list_prepend(NULL, GINT_TO_POINTER(tagid));
+  const gboolean res = _tag_execute_bulk(tags, img, undo_on, TRUE);
+  g_list_free(tags);
   return res;
 }
 
@@ -472,13 +548,14 @@ gboolean dt_tag_attach(const guint tagid, const int32_t imgid, const gboolean un
 gboolean dt_tag_set_tags(const GList *tags, const GList *img, const gboolean ignore_dt_tags,
                          const gboolean clear_on, const gboolean undo_on)
 {
-  if(img)
+  if(img && !clear_on)
+    return _tag_execute_bulk(tags, img, undo_on, TRUE);
+  else if(img)
   {
     GList *undo = NULL;
     if(undo_on) dt_undo_start_group(darktable.undo, DT_UNDO_TAGS);
 
-    const gboolean res = _tag_execute(tags, img, &undo, undo_on,
-                                      clear_on ? ignore_dt_tags ? DT_TA_SET : DT_TA_SET_ALL : DT_TA_ATTACH);
+    const gboolean res = _tag_execute(tags, img, &undo, undo_on, ignore_dt_tags ? DT_TA_SET : DT_TA_SET_ALL);
     if(undo_on)
     {
       dt_undo_record(darktable.undo, NULL, DT_UNDO_TAGS, undo, _pop_undo, _tags_undo_data_free);
@@ -513,19 +590,7 @@ gboolean dt_tag_attach_string_list(const gchar *tags, const GList *img, const gb
     }
 
     // attach newly created tags
-    if(img)
-    {
-      GList *undo = NULL;
-      if(undo_on) dt_undo_start_group(darktable.undo, DT_UNDO_TAGS);
-
-      res = _tag_execute(tagl, img, &undo, undo_on, DT_TA_ATTACH);
-
-      if(undo_on)
-      {
-        dt_undo_record(darktable.undo, NULL, DT_UNDO_TAGS, undo, _pop_undo, _tags_undo_data_free);
-        dt_undo_end_group(darktable.undo);
-      }
-    }
+    if(img) res = _tag_execute_bulk(tagl, img, undo_on, TRUE);
     g_list_free(tagl);
   }
   g_strfreev(tokens);
@@ -534,24 +599,11 @@ gboolean dt_tag_attach_string_list(const gchar *tags, const GList *img, const gb
 
 gboolean dt_tag_detach_images(const guint tagid, const GList *img, const gboolean undo_on)
 {
-  if(img)
-  {
-    GList *tags = NULL;
-    tags = g_list_prepend(tags, GINT_TO_POINTER(tagid));
-    GList *undo = NULL;
-    if(undo_on) dt_undo_start_group(darktable.undo, DT_UNDO_TAGS);
-
-    const gboolean res = _tag_execute(tags, img, &undo, undo_on, DT_TA_DETACH);
-
-    g_list_free(tags);
-    if(undo_on)
-    {
-      dt_undo_record(darktable.undo, NULL, DT_UNDO_TAGS, undo, _pop_undo, _tags_undo_data_free);
-      dt_undo_end_group(darktable.undo);
-    }
-    return res;
-  }
-  return FALSE;
+  if(!img) return FALSE;
+  GList *tags = g_list_prepend(NULL, GINT_TO_POINTER(tagid));
+  const gboolean res = _tag_execute_bulk(tags, img, undo_on, FALSE);
+  g_list_free(tags);
+  return res;
 }
 
 gboolean dt_tag_detach(const guint tagid, const int32_t imgid, const gboolean undo_on, const gboolean group_on)
@@ -593,6 +645,8 @@ void dt_set_darktable_tags()
   // clang-format on
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+
+  dt_tag_index_invalidate();
 }
 
 uint32_t dt_tag_get_attached(const int32_t imgid, GList **result, const gboolean ignore_dt_tags)
@@ -813,6 +867,34 @@ GList *dt_tag_get_hierarchical(int32_t imgid)
 static GList *_tag_get_tags(const int32_t imgid, const dt_tag_type_t type)
 {
   GList *tags = NULL;
+
+  if(imgid > 0)
+  {
+    // one image at a time in bulk operations, keep the statements prepared
+    // clang-format off
+    const char *query = type == DT_TAG_TYPE_ALL
+                          ? "SELECT DISTINCT T.id"
+                            "  FROM main.tagged_images AS I"
+                            "  JOIN data.tags T on T.id = I.tagid"
+                            "  WHERE I.imgid = ?1"
+                        : type == DT_TAG_TYPE_DT
+                          ? "SELECT DISTINCT T.id"
+                            "  FROM main.tagged_images AS I"
+                            "  JOIN data.tags T on T.id = I.tagid"
+                            "  WHERE I.imgid = ?1 AND T.id IN memory.darktable_tags"
+                          : "SELECT DISTINCT T.id"
+                            "  FROM main.tagged_images AS I"
+                            "  JOIN data.tags T on T.id = I.tagid"
+                            "  WHERE I.imgid = ?1 AND NOT T.id IN memory.darktable_tags";
+    // clang-format on
+    sqlite3_stmt *stmt = dt_database_get_statement(darktable.db, query);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    while(sqlite3_step(stmt) == SQLITE_ROW)
+      tags = g_list_prepend(tags, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+    dt_database_release_statement(darktable.db, stmt);
+    return tags;
+  }
+
   char *images = NULL;
   if(imgid > 0)
     images = g_strdup_printf("%d", imgid);
@@ -964,18 +1046,17 @@ GList *dt_tag_get_hierarchical_export(int32_t imgid, int32_t flags)
 
 gboolean dt_is_tag_attached(const guint tagid, const int32_t imgid)
 {
-  sqlite3_stmt *stmt;
   // clang-format off
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT imgid"
-                              " FROM main.tagged_images"
-                              " WHERE imgid = ?1 AND tagid = ?2", -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_get_statement(darktable.db,
+                                                 "SELECT imgid"
+                                                 " FROM main.tagged_images"
+                                                 " WHERE imgid = ?1 AND tagid = ?2");
   // clang-format on
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, tagid);
 
   const gboolean ret = (sqlite3_step(stmt) == SQLITE_ROW);
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
   return ret;
 }
 
@@ -1285,62 +1366,171 @@ uint32_t dt_tag_images_count(gint tagid)
   return nb_images;
 }
 
-uint32_t dt_tag_get_with_usage(GList **result)
+static void _tag_index_entry_free(gpointer data)
 {
-  sqlite3_stmt *stmt;
+  dt_tag_index_entry_t *e = (dt_tag_index_entry_t *)data;
+  g_free(e->name);
+  g_free(e->key);
+  g_free(e->synonym);
+  g_free(e);
+}
 
-  /* Select tags that are similar to the keyword and are actually used to tag images*/
+static gint _tag_index_entry_cmp(gconstpointer a, gconstpointer b)
+{
+  const dt_tag_index_entry_t *ea = *(const dt_tag_index_entry_t **)a;
+  const dt_tag_index_entry_t *eb = *(const dt_tag_index_entry_t **)b;
+  return g_strcmp0(ea->name, eb->name);
+}
+
+static void _tag_index_add(GPtrArray *index, GHashTable *names, gchar *name, const gchar *synonym,
+                           const guint id, const guint count, const gint flags)
+{
+  dt_tag_index_entry_t *e = g_malloc0(sizeof(dt_tag_index_entry_t));
+  e->name = name;
+  e->synonym = g_strdup(synonym);
+  e->id = id;
+  e->count = count;
+  e->flags = flags;
+  if(synonym && synonym[0])
+  {
+    gchar *haystack = g_strdup_printf("%s, %s", name, synonym);
+    e->key = g_utf8_strdown(haystack, -1);
+    g_free(haystack);
+  }
+  else
+    e->key = g_utf8_strdown(name, -1);
+  g_ptr_array_add(index, e);
+  g_hash_table_add(names, name);
+}
+
+// to be called with _tag_index_lock held
+static GPtrArray *_tag_index_get()
+{
+  if(_tag_index) return _tag_index;
+
+  GPtrArray *index = g_ptr_array_new_with_free_func(_tag_index_entry_free);
+  GHashTable *names = g_hash_table_new(g_str_hash, g_str_equal);
+
+  // the usage counts are maintained by the library
+  sqlite3_stmt *stmt;
   // clang-format off
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "INSERT INTO memory.taglist (id, count)"
-                              "  SELECT tagid, COUNT(*)"
-                              "  FROM main.tagged_images"
-                              "  GROUP BY tagid",
+                              "SELECT T.name, T.id, TC.count, T.flags, T.synonyms"
+                              "  FROM data.tags T"
+                              "  LEFT JOIN main.tag_counts TC ON TC.tagid = T.id"
+                              "  WHERE T.id NOT IN memory.darktable_tags"
+                              "  ORDER BY T.name",
                               -1, &stmt, NULL);
   // clang-format on
-  sqlite3_step(stmt);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const char *name = (const char *)sqlite3_column_text(stmt, 0);
+    if(!name) continue;
+
+    // the parents come first in name order, add those which are not tags
+    for(const char *sep = strchr(name, '|'); sep; sep = strchr(sep + 1, '|'))
+    {
+      gchar *node = g_strndup(name, sep - name);
+      if(!g_hash_table_contains(names, node))
+        _tag_index_add(index, names, node, NULL, 0, 0, 0);
+      else
+        g_free(node);
+    }
+
+    if(!g_hash_table_contains(names, name))
+      _tag_index_add(index, names, g_strdup(name), (const char *)sqlite3_column_text(stmt, 4),
+                     sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2), sqlite3_column_int(stmt, 3));
+  }
   sqlite3_finalize(stmt);
+  g_hash_table_destroy(names);
+
+  // a node added for its children can sort after a sibling, "a|b" after "a|b c"
+  g_ptr_array_sort(index, _tag_index_entry_cmp);
 
+  _tag_index = index;
+  return _tag_index;
+}
+
+void dt_tag_index_invalidate()
+{
+  g_mutex_lock(&_tag_index_lock);
+  if(_tag_index) g_ptr_array_free(_tag_index, TRUE);
+  _tag_index = NULL;
+  g_mutex_unlock(&_tag_index_lock);
+}
+
+GHashTable *dt_tag_index_match(const gchar *keyword)
+{
+  GHashTable *matches = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  if(!keyword || !keyword[0]) return matches;
+
+  gchar *needle = g_utf8_strdown(keyword, -1);
+  g_mutex_lock(&_tag_index_lock);
+  const GPtrArray *index = _tag_index_get();
+  for(guint k = 0; k < index->len; k++)
+  {
+    const dt_tag_index_entry_t *e = g_ptr_array_index(index, k);
+    if(strstr(e->key, needle))
+      g_hash_table_add(matches, g_strdup(e->name));
+  }
+  g_mutex_unlock(&_tag_index_lock);
+  g_free(needle);
+
+  return matches;
+}
+
+uint32_t dt_tag_get_with_usage(GList **result)
+{
   const uint32_t nb_selected = dt_selected_images_count();
 
-  /* Now put all the bits together */
-  // clang-format off
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT T.name, T.id, MT.count, CT.imgnb, T.flags, T.synonyms"
-                              "  FROM data.tags T "
-                              "  LEFT JOIN memory.taglist MT ON MT.id = T.id "
-                              "  LEFT JOIN (SELECT tagid, COUNT(DISTINCT imgid) AS imgnb"
-                              "             FROM main.tagged_images "
-                              "             WHERE imgid IN (SELECT imgid FROM main.selected_images) GROUP BY tagid) AS CT "
-                              "    ON CT.tagid = T.id"
-                              "  WHERE T.id NOT IN memory.darktable_tags "
-                              "  ORDER BY T.name ",
-                              -1, &stmt, NULL);
-  // clang-format on
+  // only how the tags are attached to the selected images comes from the database
+  GHashTable *selected = g_hash_table_new(NULL, NULL);
+  if(nb_selected)
+  {
+    sqlite3_stmt *stmt;
+    // clang-format off
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT tagid, COUNT(DISTINCT imgid)"
+                                "  FROM main.tagged_images"
+                                "  WHERE imgid IN (SELECT imgid FROM main.selected_images)"
+                                "  GROUP BY tagid",
+                                -1, &stmt, NULL);
+    // clang-format on
+    while(sqlite3_step(stmt) == SQLITE_ROW)
+      g_hash_table_insert(selected, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)),
+                          GINT_TO_POINTER(sqlite3_column_int(stmt, 1)));
+    sqlite3_finalize(stmt);
+  }
 
   /* ... and create the result list to send upwards */
+  GList *tags = NULL;
   uint32_t count = 0;
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  g_mutex_lock(&_tag_index_lock);
+  const GPtrArray *index = _tag_index_get();
+  for(guint k = 0; k < index->len; k++)
   {
+    const dt_tag_index_entry_t *e = g_ptr_array_index(index, k);
+    if(!e->id) continue;
+
     dt_tag_t *t = g_malloc0(sizeof(dt_tag_t));
-    t->tag = g_strdup((char *)sqlite3_column_text(stmt, 0));
+    t->tag = g_strdup(e->name);
     t->leave = g_strrstr(t->tag, "|");
     t->leave = t->leave ? t->leave + 1 : t->tag;
-    t->id = sqlite3_column_int(stmt, 1);
-    t->count = sqlite3_column_int(stmt, 2);
-    const uint32_t imgnb = sqlite3_column_int(stmt, 3);
+    t->id = e->id;
+    t->count = e->count;
+    const uint32_t imgnb = GPOINTER_TO_INT(g_hash_table_lookup(selected, GINT_TO_POINTER(e->id)));
     t->select = (nb_selected == 0) ? DT_TS_NO_IMAGE :
                 (imgnb == nb_selected) ? DT_TS_ALL_IMAGES :
                 (imgnb == 0) ? DT_TS_NO_IMAGE : DT_TS_SOME_IMAGES;
-    t->flags = sqlite3_column_int(stmt, 4);
-    t->synonym = g_strdup((char *)sqlite3_column_text(stmt, 5));
-    *result = g_list_append(*result, t);
+    t->flags = e->flags;
+    t->synonym = g_strdup(e->synonym);
+    tags = g_list_prepend(tags, t);
     count++;
   }
+  g_mutex_unlock(&_tag_index_lock);
+  g_hash_table_destroy(selected);
 
-  sqlite3_finalize(stmt);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.taglist", NULL, NULL, NULL);
-
+  *result = g_list_concat(*result, g_list_reverse(tags));
   return count;
 }
 
@@ -1404,6 +1594,7 @@ void dt_tag_set_synonyms(gint tagid, gchar *synonyms_entry)
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
   g_free(synonyms);
+  dt_tag_index_invalidate();
 }
 
 gint dt_tag_get_flags(gint tagid)
@@ -1435,6 +1626,7 @@ void dt_tag_set_flags(gint tagid, gint flags)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, flags);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_tag_index_invalidate();
 }
 
 void dt_tag_add_synonym(gint tagid, gchar *synonym)
@@ -1457,6 +1649,7 @@ void dt_tag_add_synonym(gint tagid, gchar *synonym)
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
   g_free(synonyms);
+  dt_tag_index_invalidate();
 }
 
 static void _free_result_item(gpointer data)
@@ -167,6 +167,14 @@ void dt_tag_get_tags_images(const gchar *keyword, GList **tag_list, GList **img_
  * conf value "xxx" */
 uint32_t dt_tag_get_with_usage(GList **result);
 
+/** drops the in-memory tag dictionary, it is rebuilt on next use. needed after changing tags or
+ * their attachment to images outside of this API. */
+void dt_tag_index_invalidate();
+
+/** returns the set of tags and nodes of the hierarchy whose name or synonyms contain keyword, case
+ * insensitive. free with g_hash_table_destroy() */
+GHashTable *dt_tag_index_match(const gchar *keyword);
+
 /** retrieves synonyms of the tag */
 gchar *dt_tag_get_synonyms(gint tagid);
 
@@ -0,0 +1,99 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/threadbudget.h"
+#include "common/darktable.h"
+
+// relative share of the cores: full > preview > thumbnails > background export
+static const int _weights[DT_THREAD_BUDGET_LAST] = { 1, 2, 4, 8 };
+
+// running pipes per priority, and a counter bumped on every change so threads know when to update
+static gint _running[DT_THREAD_BUDGET_LAST] = { 0 };
+static gint _generation = 0;
+
+typedef struct dt_thread_budget_local_t
+{
+  int depth;
+  dt_thread_budget_priority_t priority;
+  int base;        // team size of the thread before it joined the budget
+  int threads;     // current team size
+  gint generation; // of the _running counts threads is computed from
+} dt_thread_budget_local_t;
+
+static __thread dt_thread_budget_local_t _local = { 0 };
+
+static int _share(const dt_thread_budget_priority_t priority, const int base)
+{
+  int total = 0;
+  for(int k = 0; k < DT_THREAD_BUDGET_LAST; k++) total += g_atomic_int_get(&_running[k]) * _weights[k];
+  if(total <= 0) return base;
+  // rounded, at least one thread for everybody
+  const int threads = (base * _weights[priority] + total / 2) / total;
+  return CLAMP(threads, 1, base);
+}
+
+static void _update(void)
+{
+  const gint generation = g_atomic_int_get(&_generation);
+  if(generation == _local.generation) return;
+  _local.generation = generation;
+  const int threads = _share(_local.priority, _local.base);
+  if(threads == _local.threads) return;
+  _local.threads = threads;
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+}
+
+void dt_thread_budget_begin(const dt_thread_budget_priority_t priority)
+{
+  if(_local.depth++ > 0) return;
+
+  _local.priority = priority;
+  // NUMA mode or side tasks may have given this thread less than the whole machine
+  _local.base = MAX(omp_get_max_threads(), 1);
+  _local.threads = _local.base;
+  _local.generation = 0;
+  g_atomic_int_inc(&_running[priority]);
+  g_atomic_int_inc(&_generation);
+  _update();
+}
+
+void dt_thread_budget_end(void)
+{
+  if(_local.depth == 0 || --_local.depth > 0) return;
+
+  g_atomic_int_add(&_running[_local.priority], -1);
+  g_atomic_int_inc(&_generation);
+#ifdef _OPENMP
+  if(_local.threads != _local.base) omp_set_num_threads(_local.base);
+#endif
+}
+
+int dt_thread_budget_threads(void)
+{
+  if(_local.depth == 0) return omp_get_max_threads();
+  _update();
+  return _local.threads;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
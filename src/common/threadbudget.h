@@ -0,0 +1,54 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/*
+ * Thread budget shared by the pipes running at the same time.
+ *
+ * Each running pipe registers with its priority, and gets an OpenMP team size proportional to
+ * the weight of its priority among all the running pipes, so the darkroom, preview, thumbnail and
+ * export pipes don't oversubscribe the cores when they run together. A pipe alone gets all its threads.
+ *
+ * The team size is applied to the calling thread with omp_set_num_threads(), so plain
+ * `#pragma omp parallel` follow it. Explicit num_threads() clauses should use dt_omp_threads().
+ */
+
+typedef enum dt_thread_budget_priority_t
+{
+  DT_THREAD_BUDGET_EXPORT = 0,
+  DT_THREAD_BUDGET_THUMBNAIL,
+  DT_THREAD_BUDGET_PREVIEW,
+  DT_THREAD_BUDGET_FULL,
+  DT_THREAD_BUDGET_LAST
+} dt_thread_budget_priority_t;
+
+/** register the pipe running in the calling thread. calls nest, only the outermost one counts. */
+void dt_thread_budget_begin(const dt_thread_budget_priority_t priority);
+
+/** unregister it and give the thread its team size from before dt_thread_budget_begin() back. */
+void dt_thread_budget_end(void);
+
+/** team size of the calling thread, updated if other pipes started or ended meanwhile. */
+int dt_thread_budget_threads(void);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,142 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/trace.h"
+
+#include <glib/gstdio.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+// 1 MiB of stdio buffer, the file is only flushed once in a while
+#define DT_TRACE_BUFFER (1 << 20)
+
+// trace-event viewers want small integer thread ids, hand them out in order of appearance
+static __thread int _tid = -1;
+static int _next_tid = 0;
+
+static int _thread_id(void)
+{
+  if(_tid < 0) _tid = __sync_fetch_and_add(&_next_tid, 1);
+  return _tid;
+}
+
+// write a JSON string, module instance names are user input
+static void _write_string(FILE *f, const char *s)
+{
+  fputc('"', f);
+  for(const char *c = s; c && *c; c++)
+  {
+    if(*c == '"' || *c == '\\')
+      fprintf(f, "\\%c", *c);
+    else if((unsigned char)*c < 0x20)
+      fprintf(f, "\\u%04x", *c);
+    else
+      fputc(*c, f);
+  }
+  fputc('"', f);
+}
+
+static void _write_event(dt_trace_t *trace, const char *phase, const char *category, const char *name,
+                         const double start, const double end, const char *args, va_list ap)
+{
+  // format the arguments out of the lock
+  gchar *values = args ? g_strdup_vprintf(args, ap) : NULL;
+
+  dt_pthread_mutex_lock(&trace->lock);
+  FILE *f = trace->file;
+  if(trace->events++) fputs(",\n", f);
+  fputs("{\"name\":", f);
+  _write_string(f, name);
+  fprintf(f, ",\"cat\":\"%s\",\"ph\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.1f", category, phase, _thread_id(),
+          (start - trace->origin) * 1e6);
+  if(end >= start)
+    fprintf(f, ",\"dur\":%.1f", (end - start) * 1e6);
+  else
+    fputs(",\"s\":\"t\"", f); // instant events are scoped to their thread
+  if(values) fprintf(f, ",\"args\":{%s}", values);
+  fputs("}", f);
+  dt_pthread_mutex_unlock(&trace->lock);
+
+  g_free(values);
+}
+
+int dt_trace_init(const char *filename)
+{
+  FILE *f = g_fopen(filename, "wb");
+  if(!f)
+  {
+    fprintf(stderr, "[dt_trace_init] could not open `%s' for writing\n", filename);
+    return 1;
+  }
+  setvbuf(f, NULL, _IOFBF, DT_TRACE_BUFFER);
+
+  dt_trace_t *trace = (dt_trace_t *)calloc(1, sizeof(dt_trace_t));
+  trace->file = f;
+  trace->origin = dt_get_wtime();
+  dt_pthread_mutex_init(&trace->lock, NULL);
+  fputs("[\n", f);
+
+  darktable.trace = trace;
+  dt_print(DT_DEBUG_PERF, "[dt_trace_init] writing trace events to %s\n", filename);
+  return 0;
+}
+
+void dt_trace_cleanup(void)
+{
+  dt_trace_t *trace = darktable.trace;
+  if(!trace) return;
+
+  // called once all the pipes are stopped
+  darktable.trace = NULL;
+
+  dt_pthread_mutex_lock(&trace->lock);
+  fputs("\n]\n", trace->file);
+  fclose(trace->file);
+  dt_print(DT_DEBUG_PERF, "[dt_trace_cleanup] wrote %zu trace events\n", trace->events);
+  dt_pthread_mutex_unlock(&trace->lock);
+
+  dt_pthread_mutex_destroy(&trace->lock);
+  free(trace);
+}
+
+void dt_trace_complete(const char *category, const char *name, const double start, const double end,
+                       const char *args, ...)
+{
+  dt_trace_t *trace = darktable.trace;
+  if(!trace) return;
+  va_list ap;
+  va_start(ap, args);
+  _write_event(trace, "X", category, name, start, MAX(end, start), args, ap);
+  va_end(ap);
+}
+
+void dt_trace_instant(const char *category, const char *name, const char *args, ...)
+{
+  dt_trace_t *trace = darktable.trace;
+  if(!trace) return;
+  va_list ap;
+  va_start(ap, args);
+  _write_event(trace, "i", category, name, dt_get_wtime(), -1.0, args, ap);
+  va_end(ap);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,61 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/darktable.h"
+
+/* Trace recorder, started with `--trace <file>`.
+ * Events are written in the Chrome trace-event format (a JSON array), to be opened
+ * in chrome://tracing or https://ui.perfetto.dev. Timestamps are in microseconds since dt_trace_init().
+ * When no trace is running, every call below returns after checking darktable.trace.
+ */
+
+typedef struct dt_trace_t
+{
+  FILE *file;
+  double origin;  // dt_get_wtime() at init
+  size_t events;  // number of events written
+  dt_pthread_mutex_t lock;
+} dt_trace_t;
+
+/** open the trace file, sets darktable.trace. Returns 1 on failure. */
+int dt_trace_init(const char *filename);
+
+/** close the JSON array and the file */
+void dt_trace_cleanup(void);
+
+static inline gboolean dt_trace_enabled(void)
+{
+  return darktable.trace != NULL;
+}
+
+/** a duration event ("ph":"X") from start to end, both given by dt_get_wtime().
+ *  args, if not NULL, is the body of a JSON object, without the braces, in printf format. */
+void dt_trace_complete(const char *category, const char *name, const double start, const double end,
+                       const char *args, ...) __attribute__((format(printf, 5, 6)));
+
+/** an instant event ("ph":"i") at the current time, same args as dt_trace_complete() */
+void dt_trace_instant(const char *category, const char *name, const char *args, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -20,6 +20,7 @@
 #include "common/collection.h"
 #include "common/darktable.h"
 #include "common/image.h"
+#include "control/conf.h"
 #include "control/control.h"
 #include <glib.h>   // for GList, gpointer, g_list_prepend
 #include <stdlib.h> // for NULL, malloc, free
@@ -33,6 +34,7 @@ typedef struct dt_undo_item_t
   dt_undo_type_t type;
   dt_undo_data_t data;
   double ts;
+  size_t size;
   gboolean is_group;
   void (*undo)(gpointer user_data, dt_undo_type_t type, dt_undo_data_t data, dt_undo_action_t action, GList **imgs);
   void (*free_data)(gpointer data);
@@ -45,6 +47,7 @@ dt_undo_t *dt_undo_init(void)
   udata->redo_list = NULL;
   udata->disable_next = FALSE;
   udata->locked = FALSE;
+  udata->size = 0;
   dt_pthread_mutex_init(&udata->mutex, NULL);
   udata->group = DT_UNDO_NONE;
   udata->group_indent = 0;
@@ -77,8 +80,55 @@ static void _free_undo_data(void *p)
   free(item);
 }
 
+static void _undo_free_list(dt_undo_t *self, GList **list)
+{
+  for(GList *l = *list; l; l = g_list_next(l))
+    self->size -= ((dt_undo_item_t *)l->data)->size;
+  g_list_free_full(*list, _free_undo_data);
+  *list = NULL;
+}
+
+// drop the oldest undo steps until the records fit in the memory budget.
+// groups are dropped as a whole, open groups and the newest record are always kept.
+static void _undo_evict(dt_undo_t *self)
+{
+  const size_t budget = (size_t)MAX(dt_conf_get_int("undo/max_memory"), 1) * 1024 * 1024;
+
+  while(self->size > budget)
+  {
+    GList *oldest = g_list_last(self->undo_list);
+    if(!oldest || oldest == self->undo_list) break;
+
+    // find the newest item of the oldest step
+    GList *end = oldest;
+    if(((dt_undo_item_t *)oldest->data)->is_group)
+    {
+      end = g_list_previous(oldest);
+      while(end && !((dt_undo_item_t *)end->data)->is_group) end = g_list_previous(end);
+      if(!end || end == self->undo_list) break;
+    }
+
+    size_t freed = 0;
+    GList *l = oldest;
+    gboolean done = FALSE;
+    while(!done)
+    {
+      GList *prev = g_list_previous(l);
+      dt_undo_item_t *item = (dt_undo_item_t *)l->data;
+      done = (l == end);
+      freed += item->size;
+      self->size -= item->size;
+      self->undo_list = g_list_delete_link(self->undo_list, l);
+      _free_undo_data(item);
+      l = prev;
+    }
+
+    dt_print(DT_DEBUG_UNDO, "[undo] evicted oldest step (%zu bytes, %zu left)\n", freed, self->size);
+  }
+}
+
 static void _undo_record(dt_undo_t *self, gpointer user_data, dt_undo_type_t type, dt_undo_data_t data,
-                         gboolean is_group,
+                         gboolean is_group, size_t size,
                          void (*undo)(gpointer user_data, dt_undo_type_t type, dt_undo_data_t item, dt_undo_action_t action, GList **imgs),
                          void (*free_data)(gpointer data))
 {
@@ -106,13 +156,16 @@ static void _undo_record(dt_undo_t *self, gpointer user_data, dt_undo_type_t typ
       item->undo      = undo;
       item->free_data = free_data;
       item->ts        = dt_get_wtime();
+      item->size      = size;
       item->is_group  = is_group;
 
       self->undo_list = g_list_prepend(self->undo_list, (gpointer)item);
+      self->size += size;
 
       // recording an undo data invalidate all the redo
-      g_list_free_full(self->redo_list, _free_undo_data);
-      self->redo_list = NULL;
+      _undo_free_list(self, &self->redo_list);
+
+      if(size) _undo_evict(self);
 
       dt_print(DT_DEBUG_UNDO, "[undo] record for type %d (length %d)\n",
                type, g_list_length(self->undo_list));
@@ -131,7 +184,7 @@ void dt_undo_start_group(dt_undo_t *self, dt_undo_type_t type)
     dt_print(DT_DEBUG_UNDO, "[undo] start group for type %d\n", type);
     self->group = type;
     self->group_indent = 1;
-    _undo_record(self, NULL, type, NULL, TRUE, NULL, NULL);
+    _undo_record(self, NULL, type, NULL, TRUE, 0, NULL, NULL);
   }
   else
     self->group_indent++;
@@ -145,7 +198,7 @@ void dt_undo_end_group(dt_undo_t *self)
   self->group_indent--;
   if(self->group_indent == 0)
   {
-    _undo_record(self, NULL, self->group, NULL, TRUE, NULL, NULL);
+    _undo_record(self, NULL, self->group, NULL, TRUE, 0, NULL, NULL);
     dt_print(DT_DEBUG_UNDO, "[undo] end group for type %d\n", self->group);
     self->group = DT_UNDO_NONE;
   }
@@ -155,7 +208,14 @@ void dt_undo_record(dt_undo_t *self, gpointer user_data, dt_undo_type_t type, dt
                     void (*undo)(gpointer user_data, dt_undo_type_t type, dt_undo_data_t item, dt_undo_action_t action, GList **imgs),
                     void (*free_data)(gpointer data))
 {
-  _undo_record(self, user_data, type, data, FALSE, undo, free_data);
+  _undo_record(self, user_data, type, data, FALSE, 0, undo, free_data);
+}
+
+void dt_undo_record_ext(dt_undo_t *self, gpointer user_data, dt_undo_type_t type, dt_undo_data_t data, size_t size,
+                        void (*undo)(gpointer user_data, dt_undo_type_t type, dt_undo_data_t item, dt_undo_action_t action, GList **imgs),
+                        void (*free_data)(gpointer data))
+{
+  _undo_record(self, user_data, type, data, FALSE, size, undo, free_data);
 }
 
 gint _images_list_cmp(gconstpointer a, gconstpointer b)
@@ -306,7 +366,7 @@ gboolean dt_is_redo_list_populated(dt_undo_t *self, uint32_t filter)
   return _is_do_undo_list_populated(self, filter, DT_ACTION_REDO);
 }
 
-static void _undo_clear_list(GList **list, uint32_t filter)
+static void _undo_clear_list(dt_undo_t *self, GList **list, uint32_t filter)
 {
   // check for first item that is matching the given pattern
 
@@ -319,6 +379,7 @@ static void _undo_clear_list(GList **list, uint32_t filter)
     {
       //  remove this element
       *list = g_list_remove(*list, item);
+      self->size -= item->size;
       _free_undo_data((void *)item);
     }
   };
@@ -332,10 +393,11 @@ void dt_undo_clear(dt_undo_t *self, uint32_t filter)
   if(!self) return;
 
   LOCK;
-  _undo_clear_list(&self->undo_list, filter);
-  _undo_clear_list(&self->redo_list, filter);
+  _undo_clear_list(self, &self->undo_list, filter);
+  _undo_clear_list(self, &self->redo_list, filter);
   self->undo_list = NULL;
   self->redo_list = NULL;
+  self->size = 0;
   self->disable_next = FALSE;
   UNLOCK;
 }
@@ -62,6 +62,7 @@ typedef struct dt_undo_t
   dt_pthread_mutex_t mutex;
   gboolean locked;
   gboolean disable_next;
+  size_t size; // memory held by the data of the undo and redo lists, as declared by dt_undo_record_ext()
 } dt_undo_t;
 
 dt_undo_t *dt_undo_init(void);
@@ -76,6 +77,12 @@ void dt_undo_record(dt_undo_t *self, gpointer user_data, dt_undo_type_t type, dt
                     void (*undo)(gpointer user_data, dt_undo_type_t type, dt_undo_data_t item, dt_undo_action_t action, GList **imgs),
                     void (*free_data)(gpointer data));
 
+// as above, for data holding size bytes of memory. When the records go over the
+// "undo/max_memory" budget, the oldest undo steps are dropped.
+void dt_undo_record_ext(dt_undo_t *self, gpointer user_data, dt_undo_type_t type, dt_undo_data_t data, size_t size,
+                        void (*undo)(gpointer user_data, dt_undo_type_t type, dt_undo_data_t item, dt_undo_action_t action, GList **imgs),
+                        void (*free_data)(gpointer data));
+
 //  undo an element which correspond to filter. filter here is expected to be
 //  a set of dt_undo_type_t.
 void dt_undo_do_undo(dt_undo_t *self, uint32_t filter);
@@ -92,8 +92,20 @@ typedef struct dt_variables_data_t
 
   int flags;
 
+  // values of the image in main.meta_data, by dt_metadata_t
+  gchar *metadata[DT_METADATA_NUMBER];
+
 } dt_variables_data_t;
 
+// what the variables of a pattern need to be gathered before expansion
+typedef enum dt_variables_needs_t
+{
+  DT_VARIABLES_NEEDS_IMAGE    = 1 << 0, // fields of the image from the cache
+  DT_VARIABLES_NEEDS_FILE     = 1 << 1, // date of the file
+  DT_VARIABLES_NEEDS_FOLDERS  = 1 << 2, // home and pictures folders
+  DT_VARIABLES_NEEDS_METADATA = 1 << 3, // title, description...
+} dt_variables_needs_t;
+
 typedef enum _image_case
 {
   NONE,
@@ -122,26 +134,92 @@ gboolean dt_get_user_pictures_dir(const gchar *homedir, gchar *picdir, size_t pi
   return 0;
 }
 
-// gather some data that might be used for variable expansion
-static void _init_expansion(dt_variables_params_t *params, gboolean iterate)
+static gboolean _has_any_prefix(const char *str, const char *const *prefixes)
+{
+  for(const char *const *p = prefixes; *p; p++)
+    if(g_str_has_prefix(str, *p)) return TRUE;
+  return FALSE;
+}
+
+/* one pass over the pattern to find out what its variables need, so that exporting or importing
+   many images doesn't fetch what isn't used. the nested variables of the bash style operators have
+   their own "$(" and are found as well. anything not known to need less needs the image. */
+static uint32_t _get_needs(const char *source)
+{
+  static const char *const image_free[]
+      = { "YEAR", "SHORT_YEAR", "MONTH", "DAY", "HOUR", "MINUTE", "SECOND", "MSEC", "DATE",
+          "NL", "ID", "IMAGE.ID", "JOBCODE", "ROLL.", "ROLL_", "IMAGE.FILENAME", "IMAGE.BASENAME",
+          "FILE_", "SEQUENCE", "USERNAME", "DESKTOP", "FOLDER.DESKTOP", "OPENCL", "WIDTH.MAX", "MAX_WIDTH",
+          "HEIGHT.MAX", "MAX_HEIGHT", "DARKTABLE", NULL };
+  static const char *const file[] = { "FILE.", NULL };
+  static const char *const folders[] = { "FOLDER.HOME", "HOME", "FOLDER.PICTURES", "PICTURES_FOLDER", NULL };
+  static const char *const metadata[]
+      = { "TITLE", "DESCRIPTION", "CREATOR", "PUBLISHER", "RIGHTS", "Xmp.dc.", "VERSION.NAME", "VERSION_NAME", NULL };
+
+  uint32_t needs = 0;
+  for(const char *v = strstr(source, "$("); v; v = strstr(v + 2, "$("))
+  {
+    const char *name = v + 2;
+    if(_has_any_prefix(name, metadata))
+      needs |= DT_VARIABLES_NEEDS_METADATA;
+    else if(_has_any_prefix(name, folders))
+      needs |= DT_VARIABLES_NEEDS_FOLDERS;
+    else if(_has_any_prefix(name, file))
+      needs |= DT_VARIABLES_NEEDS_FILE;
+    else if(!_has_any_prefix(name, image_free))
+      needs |= DT_VARIABLES_NEEDS_IMAGE;
+  }
+  return needs;
+}
+
+// all the metadata of the image in one query
+static void _get_metadata(dt_variables_params_t *params)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT key, value FROM main.meta_data WHERE id = ?1 ORDER BY value DESC",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, params->imgid);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int keyid = sqlite3_column_int(stmt, 0);
+    if(keyid < 0 || keyid >= DT_METADATA_NUMBER) continue;
+    // keep the first value, as dt_metadata_get() gives them
+    g_free(params->data->metadata[keyid]);
+    params->data->metadata[keyid] = g_strdup((const char *)sqlite3_column_text(stmt, 1));
+  }
+  sqlite3_finalize(stmt);
+}
+
+// gather the data that the variables of source use for their expansion
+static void _init_expansion(dt_variables_params_t *params, const char *source, gboolean iterate)
 {
   if(iterate) params->data->sequence++;
 
-  params->data->homedir = dt_loc_get_home_dir(NULL);
+  const uint32_t needs = _get_needs(source);
 
-  gchar picture_folder[PATH_MAX] = { 0 };
-  dt_get_user_pictures_dir(params->data->homedir, picture_folder, sizeof(picture_folder));
-  params->data->pictures_folder = g_strdup(picture_folder);
+  if(needs & DT_VARIABLES_NEEDS_FOLDERS)
+  {
+    params->data->homedir = dt_loc_get_home_dir(NULL);
+
+    gchar picture_folder[PATH_MAX] = { 0 };
+    dt_get_user_pictures_dir(params->data->homedir, picture_folder, sizeof(picture_folder));
+    params->data->pictures_folder = g_strdup(picture_folder);
+  }
 
   if(params->filename)
   {
     params->data->file_ext = (g_strrstr(params->filename, ".") + 1);
     if(params->data->file_ext == (gchar *)1) params->data->file_ext = params->filename + strlen(params->filename);
-    params->data->file_datetime = dt_util_get_file_datetime(params->filename);
+    if(needs & DT_VARIABLES_NEEDS_FILE)
+      params->data->file_datetime = dt_util_get_file_datetime(params->filename);
   }
   else
     params->data->file_ext = NULL;
 
+  if((needs & DT_VARIABLES_NEEDS_METADATA) && params->imgid > -1)
+    _get_metadata(params);
+
   /* image exif time */
   params->data->have_exif_dt = FALSE;
   params->data->exif_iso = 100;
@@ -163,7 +241,11 @@ static void _init_expansion(dt_variables_params_t *params, gboolean iterate)
   dt_image_t *img = NULL;
   _image_case release = NONE;
 
-  if(params->img)
+  if(!(needs & DT_VARIABLES_NEEDS_IMAGE))
+  {
+    // nothing from the image, don't wait on the cache
+  }
+  else if(params->img)
   {
     img = (dt_image_t *)params->img;
   }
@@ -246,10 +328,26 @@ static void _cleanup_expansion(dt_variables_params_t *params)
     g_date_time_unref(params->data->datetime);
     params->data->datetime = NULL;
   }
+  if(params->data->file_datetime)
+  {
+    g_date_time_unref(params->data->file_datetime);
+    params->data->file_datetime = NULL;
+  }
   g_free(params->data->homedir);
   g_free(params->data->pictures_folder);
   g_free(params->data->camera_maker);
   g_free(params->data->camera_alias);
+  g_free(params->data->exif_lens);
+  params->data->homedir = NULL;
+  params->data->pictures_folder = NULL;
+  params->data->camera_maker = NULL;
+  params->data->camera_alias = NULL;
+  params->data->exif_lens = NULL;
+  for(int k = 0; k < DT_METADATA_NUMBER; k++)
+  {
+    g_free(params->data->metadata[k]);
+    params->data->metadata[k] = NULL;
+  }
 }
 
 static inline gboolean _has_prefix(char **str, const char *prefix)
@@ -425,12 +523,7 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
   }
   else if(_has_prefix(variable, "VERSION.NAME") || _has_prefix(variable, "VERSION_NAME"))
   {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.darktable.version_name", NULL);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
+    result = g_strdup(params->data->metadata[DT_METADATA_XMP_VERSION_NAME]);
   }
   else if(_has_prefix(variable, "VERSION.IF_MULTI") || _has_prefix(variable, "VERSION_IF_MULTI"))
   {
@@ -614,48 +707,23 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
   }
   else if(_has_prefix(variable, "TITLE") || _has_prefix(variable, "Xmp.dc.title"))
   {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.title", NULL);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
+    result = g_strdup(params->data->metadata[DT_METADATA_XMP_DC_TITLE]);
   }
   else if(_has_prefix(variable, "DESCRIPTION") || _has_prefix(variable, "Xmp.dc.description"))
   {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.description", NULL);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
+    result = g_strdup(params->data->metadata[DT_METADATA_XMP_DC_DESCRIPTION]);
   }
   else if(_has_prefix(variable, "CREATOR") || _has_prefix(variable, "Xmp.dc.creator"))
   {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.creator", NULL);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
+    result = g_strdup(params->data->metadata[DT_METADATA_XMP_DC_CREATOR]);
   }
   else if(_has_prefix(variable, "PUBLISHER") || _has_prefix(variable, "Xmp.dc.publisher"))
   {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.publisher", NULL);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
+    result = g_strdup(params->data->metadata[DT_METADATA_XMP_DC_PUBLISHER]);
   }
   else if(_has_prefix(variable, "RIGHTS") || _has_prefix(variable, "Xmp.dc.rights"))
   {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.rights", NULL);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
+    result = g_strdup(params->data->metadata[DT_METADATA_XMP_DC_RIGHTS]);
   }
   else if(_has_prefix(variable, "OPENCL.ACTIVATED") || _has_prefix(variable, "OPENCL_ACTIVATED"))
   {
@@ -1089,7 +1157,7 @@ static char *_expand_source(dt_variables_params_t *params, char **source, char e
 
 char *dt_variables_expand(dt_variables_params_t *params, gchar *source, gboolean iterate)
 {
-  _init_expansion(params, iterate);
+  _init_expansion(params, source, iterate);
 
   char *result = _expand_source(params, &source, '\0');
 
@@ -1113,7 +1181,7 @@ void dt_variables_params_destroy(dt_variables_params_t *params)
   if(params->data->time)
     g_date_time_unref(params->data->time);
 
-  if(params->data->time)
+  if(params->data->file_datetime)
     g_date_time_unref(params->data->file_datetime);
 
   g_free(params->data);
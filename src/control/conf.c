@@ -85,6 +85,13 @@ fin:
   return str;
 }
 
+/** invalidate the cached value of the key, if any. needs the conf mutex. */
+static inline void _key_touch(const char *name)
+{
+  dt_conf_key_t *key = (dt_conf_key_t *)g_hash_table_lookup(darktable.conf->keys, name);
+  if(key) g_atomic_int_inc(&key->version);
+}
+
 /* set the value only if it hasn't been overridden from commandline
  * return 1 if key/value is still the one passed on commandline. */
 static int dt_conf_set_if_not_overridden(const char *name, char *str)
@@ -96,6 +103,7 @@ static int dt_conf_set_if_not_overridden(const char *name, char *str)
   if(!is_overridden)
   {
     g_hash_table_insert(darktable.conf->table, g_strdup(name), str);
+    _key_touch(name);
   }
 
   dt_pthread_mutex_unlock(&darktable.conf->mutex);
@@ -336,6 +344,100 @@ gboolean dt_conf_key_not_empty(const char *name)
   return TRUE;
 }
 
+gboolean dt_conf_remove_key(const char *name)
+{
+  dt_pthread_mutex_lock(&darktable.conf->mutex);
+  const gboolean removed = g_hash_table_remove(darktable.conf->table, name);
+  if(removed) _key_touch(name);
+  dt_pthread_mutex_unlock(&darktable.conf->mutex);
+  return removed;
+}
+
+static void _key_free(gpointer data)
+{
+  dt_conf_key_t *key = (dt_conf_key_t *)data;
+  g_free(key->name);
+  g_free(key);
+}
+
+dt_conf_key_t *dt_conf_key_lookup(const char *name)
+{
+  dt_pthread_mutex_lock(&darktable.conf->mutex);
+  dt_conf_key_t *key = (dt_conf_key_t *)g_hash_table_lookup(darktable.conf->keys, name);
+  if(!key)
+  {
+    key = g_malloc0(sizeof(dt_conf_key_t));
+    key->name = g_strdup(name);
+    key->stamp = -1;
+    g_hash_table_insert(darktable.conf->keys, key->name, key);
+  }
+  dt_pthread_mutex_unlock(&darktable.conf->mutex);
+  return key;
+}
+
+/* the cached value is a seqlock: it's valid if the stamp matches the current version
+ * before and after reading it. */
+static inline gboolean _key_read(dt_conf_key_t *key, const dt_confgen_type_t type, dt_conf_key_value_t *value)
+{
+  const gint stamp = g_atomic_int_get(&key->stamp);
+  if(stamp != g_atomic_int_get(&key->version) || key->type != type) return FALSE;
+  *value = key->value;
+  return g_atomic_int_get(&key->stamp) == stamp;
+}
+
+/* the value has been computed outside of any lock, for the version read before computing it.
+ * if the key has been set meanwhile the stamp won't match and the next read computes it again. */
+static void _key_write(dt_conf_key_t *key, const dt_confgen_type_t type, const gint version,
+                       const dt_conf_key_value_t value)
+{
+  dt_pthread_mutex_lock(&darktable.conf->keys_mutex);
+  g_atomic_int_set(&key->stamp, -1);
+  key->type = type;
+  key->value = value;
+  g_atomic_int_set(&key->stamp, version);
+  dt_pthread_mutex_unlock(&darktable.conf->keys_mutex);
+}
+
+int dt_conf_key_get_int(dt_conf_key_t *key)
+{
+  dt_conf_key_value_t value;
+  if(_key_read(key, DT_INT, &value)) return value.i;
+  const gint version = g_atomic_int_get(&key->version);
+  value.i = dt_conf_get_int(key->name);
+  _key_write(key, DT_INT, version, value);
+  return value.i;
+}
+
+int64_t dt_conf_key_get_int64(dt_conf_key_t *key)
+{
+  dt_conf_key_value_t value;
+  if(_key_read(key, DT_INT64, &value)) return value.i64;
+  const gint version = g_atomic_int_get(&key->version);
+  value.i64 = dt_conf_get_int64(key->name);
+  _key_write(key, DT_INT64, version, value);
+  return value.i64;
+}
+
+float dt_conf_key_get_float(dt_conf_key_t *key)
+{
+  dt_conf_key_value_t value;
+  if(_key_read(key, DT_FLOAT, &value)) return value.f;
+  const gint version = g_atomic_int_get(&key->version);
+  value.f = dt_conf_get_float(key->name);
+  _key_write(key, DT_FLOAT, version, value);
+  return value.f;
+}
+
+int dt_conf_key_get_bool(dt_conf_key_t *key)
+{
+  dt_conf_key_value_t value;
+  if(_key_read(key, DT_BOOL, &value)) return value.b;
+  const gint version = g_atomic_int_get(&key->version);
+  value.b = dt_conf_get_bool(key->name);
+  _key_write(key, DT_BOOL, version, value);
+  return value.b;
+}
+
 gboolean dt_conf_get_folder_to_file_chooser(const char *name, GtkFileChooser *chooser)
 {
   const gchar *folder = dt_conf_get_string_const(name);
@@ -428,7 +530,9 @@ void dt_conf_init(dt_conf_t *cf, const char *filename, GSList *override_entries)
 
   cf->table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
   cf->override_entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  cf->keys = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _key_free);
   dt_pthread_mutex_init(&darktable.conf->mutex, NULL);
+  dt_pthread_mutex_init(&darktable.conf->keys_mutex, NULL);
 
   // init conf filename
   g_strlcpy(darktable.conf->filename, filename, sizeof(darktable.conf->filename));
@@ -835,6 +939,8 @@ void dt_conf_cleanup(dt_conf_t *cf)
   g_hash_table_unref(cf->table);
   g_hash_table_unref(cf->override_entries);
   g_hash_table_unref(cf->x_confgen);
+  g_hash_table_unref(cf->keys);
+  dt_pthread_mutex_destroy(&darktable.conf->keys_mutex);
   dt_pthread_mutex_destroy(&darktable.conf->mutex);
 }
 
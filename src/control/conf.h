@@ -57,8 +57,33 @@ typedef struct dt_conf_t
   GHashTable *table;
   GHashTable *x_confgen;
   GHashTable *override_entries;
+  GHashTable *keys;             // interned dt_conf_key_t, protected by mutex
+  dt_pthread_mutex_t keys_mutex; // serializes the writers of the cached values of the keys
 } dt_conf_t;
 
+/*
+ * interned configuration key, caching its last typed value.
+ * reading an up-to-date value takes no lock, only a few atomic loads,
+ * so use them in hot paths instead of dt_conf_get_*(const char *name).
+ * handles live until dt_conf_cleanup().
+ */
+typedef union dt_conf_key_value_t
+{
+  int i;
+  int64_t i64;
+  float f;
+  gboolean b;
+} dt_conf_key_value_t;
+
+typedef struct dt_conf_key_t
+{
+  char *name;
+  gint version;            // bumped every time the value of the key is set
+  gint stamp;              // version the cached value has been computed for, -1 while it is written
+  dt_confgen_type_t type;  // of the cached value
+  dt_conf_key_value_t value;
+} dt_conf_key_t;
+
 typedef struct dt_conf_string_entry_t
 {
   char *key;
@@ -103,6 +128,28 @@ int dt_conf_key_exists(const char *key);
 gboolean dt_conf_key_not_empty(const char *key);
 GSList *dt_conf_all_string_entries(const char *dir);
 void dt_conf_string_entry_free(gpointer data);
+// remove a key from the config, return TRUE if it was there
+gboolean dt_conf_remove_key(const char *name);
+
+// get the interned handle of a key
+dt_conf_key_t *dt_conf_key_lookup(const char *name);
+// same as dt_conf_get_int() etc. but lock-free when the value hasn't changed since the last call
+int dt_conf_key_get_int(dt_conf_key_t *key);
+int64_t dt_conf_key_get_int64(dt_conf_key_t *key);
+float dt_conf_key_get_float(dt_conf_key_t *key);
+int dt_conf_key_get_bool(dt_conf_key_t *key);
+
+// look the handle up once and keep it in *handle, meant for a static pointer at the call site:
+//   static dt_conf_key_t *key = NULL;
+//   if(dt_conf_key_get_bool(dt_conf_key_once(&key, "some/key"))) ...
+static inline dt_conf_key_t *dt_conf_key_once(dt_conf_key_t **handle, const char *name)
+{
+  dt_conf_key_t *key = (dt_conf_key_t *)g_atomic_pointer_get(handle);
+  if(key) return key;
+  key = dt_conf_key_lookup(name);
+  g_atomic_pointer_set(handle, key);
+  return key;
+}
 
 #define DT_CONF_SET_SANITIZED_INT(name, val, min, max) dt_conf_set_int(name, CLAMPS(val, min,max));
 #define DT_CONF_SET_SANITIZED_INT6464(name, val, min, max) dt_conf_set_int(name, CLAMPS(val, min,max));
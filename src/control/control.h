@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "common/atomic.h"
 #include "common/darktable.h"
 #include "common/dtpthread.h"
 
@@ -162,15 +163,15 @@ typedef struct dt_control_t
 
   // job management
   int32_t running;
-  gboolean export_scheduled;
-  dt_pthread_mutex_t queue_mutex, cond_mutex, run_mutex;
+  dt_atomic_int exports_running; // number of DT_JOB_QUEUE_USER_EXPORT jobs being executed
+  dt_pthread_mutex_t cond_mutex, run_mutex;
   pthread_cond_t cond;
   int32_t num_threads;
   pthread_t *thread, kick_on_workers_thread;
-  dt_job_t **job;
 
-  GList *queues[DT_JOB_QUEUE_MAX];
-  size_t queue_length[DT_JOB_QUEUE_MAX];
+  // one deque of jobs per worker thread, see jobs.c
+  struct dt_control_worker_queue_t *worker_queues;
+  dt_atomic_int next_queue;      // round-robin target for jobs added from outside the workers
 
   dt_pthread_mutex_t res_mutex;
   dt_job_t *job_res[DT_CTL_WORKER_RESERVED];
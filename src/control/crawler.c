@@ -103,21 +103,251 @@ static void _set_modification_time(char *filename,
   if(info) g_clear_object(&info);
 }
 
-GList *dt_control_crawler_run(void)
+// one image of the library, as read from the database, and what the crawler found on disk for it
+typedef struct dt_control_crawler_entry_t
+{
+  int id;
+  time_t timestamp;
+  int version;
+  int flags;
+  gchar *image_path;
+  int folder;           // index of the film roll directory in the listings
+  gboolean missing;     // the image file is gone
+  gchar *xmp_path;      // set when the xmp file exists, with timestamp_xmp
+  time_t timestamp_xmp;
+  int new_flags;
+} dt_control_crawler_entry_t;
+
+// names are compared the way the file system does
+static gchar *_crawler_name_key(const gchar *name)
+{
+#if defined(_WIN32) || defined(__APPLE__)
+  return g_utf8_casefold(name, -1);
+#else
+  return g_strdup(name);
+#endif
+}
+
+// the names in a film roll directory, read once: on network drives one listing is much cheaper than
+// probing every image, sidecar and attached file on its own. NULL if the directory can't be read.
+static GHashTable *_crawler_list_folder(const gchar *folder)
+{
+  GDir *dir = g_dir_open(folder, 0, NULL);
+  if(!dir) return NULL;
+
+  GHashTable *names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  const gchar *name;
+  while((name = g_dir_read_name(dir))) g_hash_table_add(names, _crawler_name_key(name));
+  g_dir_close(dir);
+  return names;
+}
+
+// look up the listing of the directory of path if there is one, or ask the file system
+static gboolean _crawler_file_exists(GHashTable *names, const gchar *path)
+{
+  if(!names) return g_file_test(path, G_FILE_TEST_EXISTS);
+
+  const gchar *name = strrchr(path, G_DIR_SEPARATOR);
+  gchar *key = _crawler_name_key(name ? name + 1 : path);
+  const gboolean exists = g_hash_table_contains(names, key);
+  g_free(key);
+  return exists;
+}
+
+// all the file system checks for one image. doesn't touch the database, so it can run in parallel.
+// names is the listing of the directory of the image, or NULL.
+static void _crawler_check_files(dt_control_crawler_entry_t *entry, GHashTable *names,
+                                 const gboolean look_for_xmp)
+{
+  const gchar *image_path = entry->image_path;
+  entry->new_flags = entry->flags;
+
+  // if the image is missing we ignore it.
+  if(!_crawler_file_exists(names, image_path))
+  {
+    entry->missing = TRUE;
+    return;
+  }
+
+  // no need to look for xmp files if none get written anyway.
+  if(look_for_xmp)
+  {
+    // construct the xmp filename for this image
+    gchar xmp_path[PATH_MAX] = { 0 };
+    g_strlcpy(xmp_path, image_path, sizeof(xmp_path));
+    dt_image_path_append_version_no_db(entry->version, xmp_path, sizeof(xmp_path));
+    size_t len = strlen(xmp_path);
+    if(len + 4 >= PATH_MAX) return;
+    xmp_path[len++] = '.';
+    xmp_path[len++] = 'x';
+    xmp_path[len++] = 'm';
+    xmp_path[len++] = 'p';
+    xmp_path[len] = '\0';
+
+    // only the time stamp of existing sidecars needs a stat()
+    if(!_crawler_file_exists(names, xmp_path)) return;
+
+    // on Windows the encoding might not be UTF8
+    gchar *xmp_path_locale = dt_util_normalize_path(xmp_path);
+    int stat_res = -1;
+#ifdef _WIN32
+    // UTF8 paths fail in this context, but converting to UTF16 works
+    struct _stati64 statbuf;
+    if(xmp_path_locale) // in Windows dt_util_normalize_path returns
+                        // NULL if file does not exist
+    {
+      wchar_t *wfilename = g_utf8_to_utf16(xmp_path_locale, -1, NULL, NULL, NULL);
+      stat_res = _wstati64(wfilename, &statbuf);
+      g_free(wfilename);
+    }
+ #else
+    struct stat statbuf;
+    stat_res = stat(xmp_path_locale, &statbuf);
+#endif
+    g_free(xmp_path_locale);
+    if(stat_res) return; // TODO: shall we report these?
+
+    entry->xmp_path = g_strdup(xmp_path);
+    entry->timestamp_xmp = statbuf.st_mtime;
+  }
+
+  // step 2: check if the image has associated files (.txt, .wav)
+  size_t len = strlen(image_path);
+  const char *c = image_path + len;
+  while((c > image_path) && (*c != '.')) c--;
+  len = c - image_path + 1;
+
+  char *extra_path = (char *)calloc(len + 3 + 1, sizeof(char));
+  g_strlcpy(extra_path, image_path, len + 1);
+
+  extra_path[len] = 't';
+  extra_path[len + 1] = 'x';
+  extra_path[len + 2] = 't';
+  gboolean has_txt = _crawler_file_exists(names, extra_path);
+
+  if(!has_txt)
+  {
+    extra_path[len] = 'T';
+    extra_path[len + 1] = 'X';
+    extra_path[len + 2] = 'T';
+    has_txt = _crawler_file_exists(names, extra_path);
+  }
+
+  extra_path[len] = 'w';
+  extra_path[len + 1] = 'a';
+  extra_path[len + 2] = 'v';
+  gboolean has_wav = _crawler_file_exists(names, extra_path);
+
+  if(!has_wav)
+  {
+    extra_path[len] = 'W';
+    extra_path[len + 1] = 'A';
+    extra_path[len + 2] = 'V';
+    has_wav = _crawler_file_exists(names, extra_path);
+  }
+
+  // TODO: decide if we want to remove the flag for images that lost
+  // their extra file. currently we do (the else cases)
+  if(has_txt)
+    entry->new_flags |= DT_IMAGE_HAS_TXT;
+  else
+    entry->new_flags &= ~DT_IMAGE_HAS_TXT;
+  if(has_wav)
+    entry->new_flags |= DT_IMAGE_HAS_WAV;
+  else
+    entry->new_flags &= ~DT_IMAGE_HAS_WAV;
+
+  free(extra_path);
+}
+
+// film roll directories handled between two progress updates
+#define DT_CRAWLER_FOLDERS_BATCH 32
+
+GList *dt_control_crawler_run(dt_job_t *job)
 {
   sqlite3_stmt *stmt, *inner_stmt;
   GList *result = NULL;
-  gboolean look_for_xmp = (dt_image_get_xmp_mode() != DT_WRITE_XMP_NEVER);
+  const gboolean look_for_xmp = (dt_image_get_xmp_mode() != DT_WRITE_XMP_NEVER);
 
   // clang-format off
   sqlite3_prepare_v2(dt_database_get(darktable.db),
                      "SELECT i.id, write_timestamp, version,"
-                     "       folder || '" G_DIR_SEPARATOR_S "' || filename, flags"
+                     "       folder || '" G_DIR_SEPARATOR_S "' || filename, flags, f.id, folder"
                      " FROM main.images i, main.film_rolls f"
                      " ON i.film_id = f.id"
                      " ORDER BY f.id, filename",
                      -1, &stmt, NULL);
   // clang-format on
+
+  // read the whole library first: the file system checks are what takes time on large libraries,
+  // and on network drives most of it is latency. they run in parallel below.
+  GArray *entries = g_array_new(FALSE, TRUE, sizeof(dt_control_crawler_entry_t));
+  // the film roll directories, and the index of their first image in entries (images are sorted by film roll)
+  GPtrArray *folders = g_ptr_array_new_with_free_func(g_free);
+  GArray *firsts = g_array_new(FALSE, FALSE, sizeof(int));
+  int film_id = -1;
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    if(sqlite3_column_int(stmt, 5) != film_id)
+    {
+      film_id = sqlite3_column_int(stmt, 5);
+      g_ptr_array_add(folders, g_strdup((const char *)sqlite3_column_text(stmt, 6)));
+      const int first = entries->len;
+      g_array_append_val(firsts, first);
+    }
+    dt_control_crawler_entry_t entry = { 0 };
+    entry.id = sqlite3_column_int(stmt, 0);
+    entry.timestamp = sqlite3_column_int(stmt, 1);
+    entry.version = sqlite3_column_int(stmt, 2);
+    entry.image_path = g_strdup((const char *)sqlite3_column_text(stmt, 3));
+    entry.flags = sqlite3_column_int(stmt, 4);
+    entry.folder = folders->len - 1;
+    g_array_append_val(entries, entry);
+  }
+  sqlite3_finalize(stmt);
+  const int total = entries->len;
+  g_array_append_val(firsts, total);
+
+  dt_control_crawler_entry_t *const list = (dt_control_crawler_entry_t *)entries->data;
+  const int num_folders = folders->len;
+  int count = 0;
+
+  GHashTable **listings = g_malloc0_n(MAX(num_folders, 1), sizeof(GHashTable *));
+  for(int first = 0; first < num_folders; first += DT_CRAWLER_FOLDERS_BATCH)
+  {
+    if(job && dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED) break;
+
+    // list the directories of the batch, then check their images. both are mostly waiting on the file system.
+    const int last = MIN(first + DT_CRAWLER_FOLDERS_BATCH, num_folders);
+    gchar **const paths = (gchar **)folders->pdata;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(listings, paths, first, last) \
+  schedule(dynamic)
+#endif
+    for(int k = first; k < last; k++)
+      listings[k] = _crawler_list_folder(paths[k]);
+
+    const int begin = g_array_index(firsts, int, first);
+    const int end = g_array_index(firsts, int, last);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(list, listings, begin, end, look_for_xmp) \
+  schedule(dynamic)
+#endif
+    for(int k = begin; k < end; k++)
+      _crawler_check_files(&list[k], listings[list[k].folder], look_for_xmp);
+
+    for(int k = first; k < last; k++)
+      if(listings[k]) g_hash_table_destroy(listings[k]);
+
+    count = end;
+    if(job) dt_control_job_set_progress(job, (double)last / num_folders);
+  }
+  g_free(listings);
+  g_ptr_array_free(folders, TRUE);
+  g_array_free(firsts, TRUE);
+
   sqlite3_prepare_v2(dt_database_get(darktable.db),
                      "UPDATE main.images SET flags = ?1 WHERE id = ?2", -1,
                      &inner_stmt, NULL);
@@ -125,139 +355,61 @@ GList *dt_control_crawler_run(void)
   // let's wrap this into a transaction, it might make it a little faster.
   dt_database_start_transaction(darktable.db);
 
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  for(int k = 0; k < count; k++)
   {
-    const int id = sqlite3_column_int(stmt, 0);
-    const time_t timestamp = sqlite3_column_int(stmt, 1);
-    const int version = sqlite3_column_int(stmt, 2);
-    const gchar *image_path = (char *)sqlite3_column_text(stmt, 3);
-    int flags = sqlite3_column_int(stmt, 4);
-
-    // if the image is missing we ignore it.
-    if(!g_file_test(image_path, G_FILE_TEST_EXISTS))
+    dt_control_crawler_entry_t *entry = &list[k];
+
+    if(entry->missing)
     {
-      dt_print(DT_DEBUG_CONTROL, "[crawler] `%s' (id: %d) is missing.\n", image_path, id);
+      dt_print(DT_DEBUG_CONTROL, "[crawler] `%s' (id: %d) is missing.\n", entry->image_path, entry->id);
       continue;
     }
 
-    // no need to look for xmp files if none get written anyway.
     if(look_for_xmp)
     {
-      // construct the xmp filename for this image
-      gchar xmp_path[PATH_MAX] = { 0 };
-      g_strlcpy(xmp_path, image_path, sizeof(xmp_path));
-      dt_image_path_append_version_no_db(version, xmp_path, sizeof(xmp_path));
-      size_t len = strlen(xmp_path);
-      if(len + 4 >= PATH_MAX) continue;
-      xmp_path[len++] = '.';
-      xmp_path[len++] = 'x';
-      xmp_path[len++] = 'm';
-      xmp_path[len++] = 'p';
-      xmp_path[len] = '\0';
-
-      // on Windows the encoding might not be UTF8
-      gchar *xmp_path_locale = dt_util_normalize_path(xmp_path);
-      int stat_res = -1;
-#ifdef _WIN32
-      // UTF8 paths fail in this context, but converting to UTF16 works
-      struct _stati64 statbuf;
-      if(xmp_path_locale) // in Windows dt_util_normalize_path returns
-                          // NULL if file does not exist
-      {
-        wchar_t *wfilename = g_utf8_to_utf16(xmp_path_locale, -1, NULL, NULL, NULL);
-        stat_res = _wstati64(wfilename, &statbuf);
-        g_free(wfilename);
-      }
- #else
-      struct stat statbuf;
-      stat_res = stat(xmp_path_locale, &statbuf);
-#endif
-      g_free(xmp_path_locale);
-      if(stat_res) continue; // TODO: shall we report these?
+      if(!entry->xmp_path) continue;
 
       // step 1: check if the xmp is newer than our db entry
       // FIXME: allow for a few seconds difference?
-      if(timestamp < statbuf.st_mtime)
+      if(entry->timestamp < entry->timestamp_xmp)
       {
         dt_control_crawler_result_t *item
             = (dt_control_crawler_result_t *)malloc(sizeof(dt_control_crawler_result_t));
-        item->id = id;
-        item->timestamp_xmp = statbuf.st_mtime;
-        item->timestamp_db = timestamp;
-        item->image_path = g_strdup(image_path);
-        item->xmp_path = g_strdup(xmp_path);
+        item->id = entry->id;
+        item->timestamp_xmp = entry->timestamp_xmp;
+        item->timestamp_db = entry->timestamp;
+        item->image_path = g_strdup(entry->image_path);
+        item->xmp_path = g_strdup(entry->xmp_path);
 
         result = g_list_prepend(result, item);
         dt_print(DT_DEBUG_CONTROL,
-                 "[crawler] `%s' (id: %d) is a newer XMP file.\n", xmp_path, id);
+                 "[crawler] `%s' (id: %d) is a newer XMP file.\n", entry->xmp_path, entry->id);
       }
       // older timestamps are the case for all images after the db
       // upgrade. better not report these
     }
 
-    // step 2: check if the image has associated files (.txt, .wav)
-    size_t len = strlen(image_path);
-    const char *c = image_path + len;
-    while((c > image_path) && (*c != '.')) c--;
-    len = c - image_path + 1;
-
-    char *extra_path = (char *)calloc(len + 3 + 1, sizeof(char));
-    g_strlcpy(extra_path, image_path, len + 1);
-
-    extra_path[len] = 't';
-    extra_path[len + 1] = 'x';
-    extra_path[len + 2] = 't';
-    gboolean has_txt = g_file_test(extra_path, G_FILE_TEST_EXISTS);
-
-    if(!has_txt)
+    if(entry->flags != entry->new_flags)
     {
-      extra_path[len] = 'T';
-      extra_path[len + 1] = 'X';
-      extra_path[len + 2] = 'T';
-      has_txt = g_file_test(extra_path, G_FILE_TEST_EXISTS);
-    }
-
-    extra_path[len] = 'w';
-    extra_path[len + 1] = 'a';
-    extra_path[len + 2] = 'v';
-    gboolean has_wav = g_file_test(extra_path, G_FILE_TEST_EXISTS);
-
-    if(!has_wav)
-    {
-      extra_path[len] = 'W';
-      extra_path[len + 1] = 'A';
-      extra_path[len + 2] = 'V';
-      has_wav = g_file_test(extra_path, G_FILE_TEST_EXISTS);
-    }
-
-    // TODO: decide if we want to remove the flag for images that lost
-    // their extra file. currently we do (the else cases)
-    int new_flags = flags;
-    if(has_txt)
-      new_flags |= DT_IMAGE_HAS_TXT;
-    else
-      new_flags &= ~DT_IMAGE_HAS_TXT;
-    if(has_wav)
-      new_flags |= DT_IMAGE_HAS_WAV;
-    else
-      new_flags &= ~DT_IMAGE_HAS_WAV;
-    if(flags != new_flags)
-    {
-      sqlite3_bind_int(inner_stmt, 1, new_flags);
-      sqlite3_bind_int(inner_stmt, 2, id);
+      sqlite3_bind_int(inner_stmt, 1, entry->new_flags);
+      sqlite3_bind_int(inner_stmt, 2, entry->id);
       sqlite3_step(inner_stmt);
       sqlite3_reset(inner_stmt);
       sqlite3_clear_bindings(inner_stmt);
     }
-
-    free(extra_path);
   }
 
   dt_database_release_transaction(darktable.db);
 
-  sqlite3_finalize(stmt);
   sqlite3_finalize(inner_stmt);
 
+  for(int k = 0; k < total; k++)
+  {
+    g_free(list[k].image_path);
+    g_free(list[k].xmp_path);
+  }
+  g_array_free(entries, TRUE);
+
   return g_list_reverse(result); // list was built in reverse order, so un-reverse it
 }
 
@@ -848,6 +1000,27 @@ void dt_control_crawler_show_image_list(GList *images)
                    G_CALLBACK(dt_control_crawler_response_callback), gui);
 }
 
+static gboolean _show_image_list_gui_thread(gpointer user_data)
+{
+  dt_control_crawler_show_image_list((GList *)user_data);
+  return G_SOURCE_REMOVE;
+}
+
+static int32_t _crawler_job_run(dt_job_t *job)
+{
+  GList *images = dt_control_crawler_run(job);
+  if(images) g_main_context_invoke(NULL, _show_image_list_gui_thread, images);
+  return 0;
+}
+
+void dt_control_crawler_run_job(void)
+{
+  dt_job_t *job = dt_control_job_create(&_crawler_job_run, "crawler");
+  if(!job) return;
+  dt_control_job_add_progress(job, _("looking for updated XMP files"), TRUE);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, job);
+}
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
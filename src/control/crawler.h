@@ -20,22 +20,26 @@
 
 #include <glib.h>
 
-/** this isn't a background job on purpose. it has to be really fast so it shouldn't
- *  require locking from image cache or anything like that.
- *  should we find out that we want to have a background job that crawls over all images
- *  we can maybe refactor this, but for now it's good the way it is.
+#include "control/jobs.h"
+
+/** the crawler doesn't need locking from image cache or anything like that, only the database.
+ *  each film roll directory is listed once, and the file system checks run in parallel.
  */
 
 // this function iterates over ALL images from the database and checks whether
 // - the XMP file on disk is newer than the timestamp from db
 // - there is a .txt or .wav file associated with the image and mark so in the db
 //   or if such a file no longer exists
-// it returns the list of images with a (supposedly) updated xmp file to let the user decide
-GList *dt_control_crawler_run();
+// it returns the list of images with a (supposedly) updated xmp file to let the user decide.
+// job, if not NULL, gets the progress and can cancel the crawl: the images not checked yet are left alone.
+GList *dt_control_crawler_run(dt_job_t *job);
 
 // show a popup with the images, let the user decide what to do and free the list afterwards
 void dt_control_crawler_show_image_list(GList *images);
 
+// run the crawler as a background job, and show the popup from the gui thread if anything was found
+void dt_control_crawler_run_job(void);
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -54,6 +54,18 @@ typedef struct _dt_job_t
   char description[DT_CONTROL_DESCRIPTION_LEN];
 } _dt_job_t;
 
+/* Each worker owns a deque of jobs, one list per dt_job_queue_t, behind its own lock.
+   Workers pop from their own deque and steal from the others when it's empty,
+   so adding and scheduling jobs don't serialize all threads on a single lock. */
+typedef struct dt_control_worker_queue_t
+{
+  dt_pthread_mutex_t lock;          // protects everything below
+  GQueue queues[DT_JOB_QUEUE_MAX];
+  _dt_job_t *running;               // job currently executed by the owner of this deque, for deduping
+} __attribute__((aligned(64))) dt_control_worker_queue_t;
+
+static __thread int threadid = -1;
+
 /** check if two jobs are to be considered equal. a simple memcmp won't work since the mutexes probably won't
    match
     we don't want to compare result, priority or state since these will change during the course of
@@ -224,7 +236,8 @@ static int32_t dt_control_run_job_res(dt_control_t *control, int32_t res)
   return 0;
 }
 
-static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
+// pick the next job of this deque. to be called with wq->lock held.
+static _dt_job_t *_worker_queue_pop(dt_control_t *control, dt_control_worker_queue_t *wq)
 {
   /*
    * job scheduling works like this:
@@ -236,53 +249,72 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
    *   * system background
    * - the jobs that didn't get picked this round get their priority incremented
    */
+  gboolean export_allowed = (dt_atomic_get_int(&control->exports_running) == 0);
 
-  dt_pthread_mutex_lock(&control->queue_mutex);
-
-  // find the job
-  _dt_job_t *job = NULL;
-  int winner_queue = DT_JOB_QUEUE_MAX;
-  int max_priority = -1;
-  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  while(TRUE)
   {
-    if(control->queues[i] == NULL) continue;
-    if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
-    _dt_job_t *_job = (_dt_job_t *)control->queues[i]->data;
-    if(_job->priority > max_priority)
+    int winner_queue = DT_JOB_QUEUE_MAX;
+    int max_priority = -1;
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
     {
-      max_priority = _job->priority;
-      job = _job;
-      winner_queue = i;
+      if(g_queue_is_empty(&wq->queues[i])) continue;
+      if(!export_allowed && i == DT_JOB_QUEUE_USER_EXPORT) continue;
+      _dt_job_t *_job = (_dt_job_t *)g_queue_peek_head(&wq->queues[i]);
+      if(_job->priority > max_priority)
+      {
+        max_priority = _job->priority;
+        winner_queue = i;
+      }
     }
-  }
 
-  if(!job)
-  {
-    dt_pthread_mutex_unlock(&control->queue_mutex);
-    return NULL;
-  }
+    if(winner_queue == DT_JOB_QUEUE_MAX) return NULL;
 
-  // the order of the queues in control->queues matches our priority, and we only update job when the priority
-  // is strictly bigger
-  // invariant -> job is the one we are looking for
+    // only one export may run at a time across all workers
+    if(winner_queue == DT_JOB_QUEUE_USER_EXPORT && dt_atomic_add_int(&control->exports_running, 1) > 0)
+    {
+      // another worker won the race
+      dt_atomic_sub_int(&control->exports_running, 1);
+      export_allowed = FALSE;
+      continue;
+    }
 
-  // remove the to be scheduled job from its queue
-  GList **queue = &control->queues[winner_queue];
-  *queue = g_list_delete_link(*queue, *queue);
-  control->queue_length[winner_queue]--;
-  if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = TRUE;
+    // the order of the queues matches our priority, and we only update winner_queue when the priority
+    // is strictly bigger. remove the to be scheduled job from its queue
+    _dt_job_t *job = (_dt_job_t *)g_queue_pop_head(&wq->queues[winner_queue]);
 
-  // and place it in scheduled job array (for job deduping)
-  control->job[dt_control_get_threadid()] = job;
+    // increment the priorities of the others
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+    {
+      if(i == winner_queue || g_queue_is_empty(&wq->queues[i])) continue;
+      ((_dt_job_t *)g_queue_peek_head(&wq->queues[i]))->priority++;
+    }
 
-  // increment the priorities of the others
-  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+    return job;
+  }
+}
+
+static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
+{
+  const int self = dt_control_get_threadid();
+  _dt_job_t *job = NULL;
+
+  // our own deque first, then steal from the others, starting with the next one so thieves spread out
+  for(int k = 0; k < control->num_threads && !job; k++)
   {
-    if(i == winner_queue || control->queues[i] == NULL) continue;
-    ((_dt_job_t *)control->queues[i]->data)->priority++;
+    dt_control_worker_queue_t *wq = &control->worker_queues[(self + k) % control->num_threads];
+    dt_pthread_mutex_lock(&wq->lock);
+    job = _worker_queue_pop(control, wq);
+    dt_pthread_mutex_unlock(&wq->lock);
   }
 
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+  if(job)
+  {
+    // place it in our scheduled job slot (for job deduping)
+    dt_control_worker_queue_t *own = &control->worker_queues[self];
+    dt_pthread_mutex_lock(&own->lock);
+    own->running = job;
+    dt_pthread_mutex_unlock(&own->lock);
+  }
 
   return job;
 }
@@ -320,11 +352,12 @@ static int32_t dt_control_run_job(dt_control_t *control)
 
   dt_pthread_mutex_unlock(&job->wait_mutex);
 
-  // remove the job from scheduled job array (for job deduping)
-  dt_pthread_mutex_lock(&control->queue_mutex);
-  control->job[dt_control_get_threadid()] = NULL;
-  if(job->queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = FALSE;
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+  // remove the job from scheduled job slot (for job deduping)
+  dt_control_worker_queue_t *own = &control->worker_queues[dt_control_get_threadid()];
+  dt_pthread_mutex_lock(&own->lock);
+  own->running = NULL;
+  dt_pthread_mutex_unlock(&own->lock);
+  if(job->queue == DT_JOB_QUEUE_USER_EXPORT) dt_atomic_sub_int(&control->exports_running, 1);
 
   // and free it
   dt_control_job_dispose(job);
@@ -367,6 +400,33 @@ int32_t dt_control_add_job_res(dt_control_t *control, _dt_job_t *job, int32_t re
   return 0;
 }
 
+// choose the deque receiving a new job
+static dt_control_worker_queue_t *_target_queue(dt_control_t *control, const _dt_job_t *job)
+{
+  if(job->queue == DT_JOB_QUEUE_SYSTEM_FG)
+  {
+    // hash what dt_control_job_equal() compares, so duplicates can be found in a single deque.
+    // jobs equal only by description but with params of different sizes are not deduped.
+    guint hash = g_direct_hash(job->execute) ^ g_direct_hash(job->state_changed_cb);
+    if(job->params_size)
+    {
+      const uint8_t *bytes = (const uint8_t *)job->params;
+      for(size_t k = 0; k < job->params_size; k++) hash = hash * 31 + bytes[k];
+    }
+    else
+      hash ^= g_str_hash(job->description);
+    return &control->worker_queues[hash % control->num_threads];
+  }
+
+  // a single FIFO keeps exports in the order they were requested. They can still be stolen.
+  if(job->queue == DT_JOB_QUEUE_USER_EXPORT) return &control->worker_queues[0];
+
+  // jobs spawned by a worker stay on its deque, others are spread round-robin
+  if(threadid > -1 && threadid < control->num_threads) return &control->worker_queues[threadid];
+  const unsigned int next = dt_atomic_add_int(&control->next_queue, 1);
+  return &control->worker_queues[next % control->num_threads];
+}
+
 int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t *job)
 {
   if(((unsigned int)queue_id) >= DT_JOB_QUEUE_MAX || !job)
@@ -388,16 +448,8 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
 
   job->queue = queue_id;
 
-  _dt_job_t *job_for_disposal = NULL;
-
-  dt_pthread_mutex_lock(&control->queue_mutex);
-
-  GList **queue = &control->queues[queue_id];
-  size_t length = control->queue_length[queue_id];
-
-  dt_print(DT_DEBUG_CONTROL, "[add_job] %zu | ", length);
-  dt_control_job_print(job);
-  dt_print(DT_DEBUG_CONTROL, "\n");
+  GList *jobs_for_disposal = NULL;
+  dt_control_worker_queue_t *wq = _target_queue(control, job);
 
   if(queue_id == DT_JOB_QUEUE_SYSTEM_FG)
   {
@@ -407,24 +459,35 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
     // check if we have already scheduled the job
     for(int k = 0; k < control->num_threads; k++)
     {
-      _dt_job_t *other_job = (_dt_job_t *)control->job[k];
-      if(dt_control_job_equal(job, other_job))
+      dt_control_worker_queue_t *other_wq = &control->worker_queues[k];
+      dt_pthread_mutex_lock(&other_wq->lock);
+      const int scheduled = dt_control_job_equal(job, other_wq->running);
+      if(scheduled)
       {
         dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in scheduled: ");
-        dt_control_job_print(other_job);
+        dt_control_job_print(other_wq->running);
         dt_print(DT_DEBUG_CONTROL, "\n");
+      }
+      dt_pthread_mutex_unlock(&other_wq->lock);
 
-        dt_pthread_mutex_unlock(&control->queue_mutex);
-
+      if(scheduled)
+      {
         dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
         dt_control_job_dispose(job);
-
         return 0; // there can't be any further copy
       }
     }
 
-    // if the job is already in the queue -> move it to the top
-    for(GList *iter = *queue; iter; iter = g_list_next(iter))
+    dt_pthread_mutex_lock(&wq->lock);
+    GQueue *queue = &wq->queues[queue_id];
+
+    dt_print(DT_DEBUG_CONTROL, "[add_job] %u | ", g_queue_get_length(queue));
+    dt_control_job_print(job);
+    dt_print(DT_DEBUG_CONTROL, "\n");
+
+    // if the job is already in the queue -> move it to the top.
+    // equal jobs always land in the same deque, see _target_queue()
+    for(GList *iter = queue->head; iter; iter = g_list_next(iter))
     {
       _dt_job_t *other_job = (_dt_job_t *)iter->data;
       if(dt_control_job_equal(job, other_job))
@@ -433,10 +496,8 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
         dt_control_job_print(other_job);
         dt_print(DT_DEBUG_CONTROL, "\n");
 
-        *queue = g_list_delete_link(*queue, iter);
-        length--;
-
-        job_for_disposal = job;
+        g_queue_delete_link(queue, iter);
+        jobs_for_disposal = g_list_prepend(jobs_for_disposal, job);
 
         job = other_job;
         break; // there can't be any further copy in the list
@@ -444,20 +505,11 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
     }
 
     // now we can add the new job to the list
-    *queue = g_list_prepend(*queue, job);
-    length++;
-
-    // and take care of the maximal queue size
-    if(length > DT_CONTROL_MAX_JOBS)
-    {
-      GList *last = g_list_last(*queue);
-      dt_control_job_set_state((_dt_job_t *)last->data, DT_JOB_STATE_DISCARDED);
-      dt_control_job_dispose((_dt_job_t *)last->data);
-      *queue = g_list_delete_link(*queue, last);
-      length--;
-    }
+    g_queue_push_head(queue, job);
 
-    control->queue_length[queue_id] = length;
+    // and take care of the maximal queue size, shared between all deques
+    while(g_queue_get_length(queue) > MAX(DT_CONTROL_MAX_JOBS / control->num_threads, 4))
+      jobs_for_disposal = g_list_prepend(jobs_for_disposal, g_queue_pop_tail(queue));
   }
   else
   {
@@ -468,26 +520,34 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
       job->priority = 0;
     else
       job->priority = DT_CONTROL_FG_PRIORITY;
-    *queue = g_list_append(*queue, job);
-    control->queue_length[queue_id]++;
+
+    dt_pthread_mutex_lock(&wq->lock);
+
+    dt_print(DT_DEBUG_CONTROL, "[add_job] %u | ", g_queue_get_length(&wq->queues[queue_id]));
+    dt_control_job_print(job);
+    dt_print(DT_DEBUG_CONTROL, "\n");
+
+    g_queue_push_tail(&wq->queues[queue_id], job);
   }
   dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+  dt_pthread_mutex_unlock(&wq->lock);
 
   // notify workers
   dt_pthread_mutex_lock(&control->cond_mutex);
   pthread_cond_broadcast(&control->cond);
   dt_pthread_mutex_unlock(&control->cond_mutex);
 
-  // dispose of dropped job, if any
-  dt_control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
-  dt_control_job_dispose(job_for_disposal);
+  // dispose of dropped jobs, if any
+  for(GList *l = jobs_for_disposal; l; l = g_list_next(l))
+  {
+    dt_control_job_set_state((_dt_job_t *)l->data, DT_JOB_STATE_DISCARDED);
+    dt_control_job_dispose((_dt_job_t *)l->data);
+  }
+  g_list_free(jobs_for_disposal);
 
   return 0;
 }
 
-static __thread int threadid = -1;
-
 int32_t dt_control_get_threadid()
 {
   if(threadid > -1) return threadid;
@@ -607,7 +667,16 @@ void dt_control_jobs_init(dt_control_t *control)
   // start threads
   control->num_threads = dt_worker_threads();
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
-  control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+  control->worker_queues = dt_alloc_align(control->num_threads * sizeof(dt_control_worker_queue_t));
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    dt_control_worker_queue_t *wq = &control->worker_queues[k];
+    dt_pthread_mutex_init(&wq->lock, NULL);
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++) g_queue_init(&wq->queues[i]);
+    wq->running = NULL;
+  }
+  dt_atomic_set_int(&control->exports_running, 0);
+  dt_atomic_set_int(&control->next_queue, 0);
   dt_pthread_mutex_lock(&control->run_mutex);
   control->running = 1;
   dt_pthread_mutex_unlock(&control->run_mutex);
@@ -638,16 +707,21 @@ void dt_control_jobs_init(dt_control_t *control)
 void dt_control_jobs_cleanup(dt_control_t *control)
 {
   // Cancel all non-user-export jobs remaining
-  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  for(int k = 0; k < control->num_threads; k++)
   {
-    if(control->queues[i] == NULL) continue;
-    if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
-    _dt_job_t *job = (_dt_job_t *)control->queues[i]->data;
-    dt_control_job_cancel(job);
+    dt_control_worker_queue_t *wq = &control->worker_queues[k];
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+    {
+      if(i == DT_JOB_QUEUE_USER_EXPORT) continue;
+      for(GList *l = wq->queues[i].head; l; l = g_list_next(l)) dt_control_job_cancel((_dt_job_t *)l->data);
+      g_queue_clear(&wq->queues[i]);
+    }
+    g_queue_clear(&wq->queues[DT_JOB_QUEUE_USER_EXPORT]);
+    dt_pthread_mutex_destroy(&wq->lock);
   }
 
-  free(control->job);
-  control->job = NULL;
+  dt_free_align(control->worker_queues);
+  control->worker_queues = NULL;
   free(control->thread);
   control->thread = NULL;
 }
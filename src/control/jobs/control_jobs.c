@@ -30,6 +30,7 @@
 #include "common/imageio_dng.h"
 #include "common/imageio_module.h"
 #include "common/mipmap_cache.h"
+#include "common/numa.h"
 #include "common/tags.h"
 #include "common/undo.h"
 #include "common/grouping.h"
@@ -88,6 +89,7 @@ typedef struct dt_control_export_t
   gchar *icc_filename;
   dt_iop_color_intent_t icc_intent;
   gchar *metadata_export;
+  GList *variants; // dt_control_export_variant_t
 } dt_control_export_t;
 
 
@@ -115,10 +117,103 @@ static void dt_control_image_enumerator_job_film_init(dt_control_image_enumerato
   sqlite3_finalize(stmt);
 }
 
+#define FILEOP_COPY_THREADS 4 // files copied at the same time, ahead of the library updates
+
+typedef struct _fileop_copy_t
+{
+  gchar *src;
+  gchar *dest;
+} _fileop_copy_t;
+
+typedef struct _fileop_copies_t
+{
+  dt_job_t *job;
+  dt_pthread_mutex_t mutex;
+  int done, total;
+} _fileop_copies_t;
+
+static void _fileop_copy_file(gpointer data, gpointer user_data)
+{
+  _fileop_copy_t *copy = (_fileop_copy_t *)data;
+  _fileop_copies_t *copies = (_fileop_copies_t *)user_data;
+
+  if(dt_control_job_get_state(copies->job) != DT_JOB_STATE_CANCELLED
+     && g_file_test(copy->src, G_FILE_TEST_IS_REGULAR) && !g_file_test(copy->dest, G_FILE_TEST_EXISTS))
+  {
+    // copy under a temporary name and rename it once complete: an interrupted copy must not
+    // be mistaken for the file by the library updates that follow
+    gchar *part = g_strconcat(copy->dest, ".part", NULL);
+    GFile *src = g_file_new_for_path(copy->src);
+    GFile *tmp = g_file_new_for_path(part);
+    GFile *dest = g_file_new_for_path(copy->dest);
+    if(!g_file_copy(src, tmp, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, NULL)
+       || !g_file_move(tmp, dest, G_FILE_COPY_NONE, NULL, NULL, NULL, NULL))
+      g_file_delete(tmp, NULL, NULL);
+    g_object_unref(dest);
+    g_object_unref(tmp);
+    g_object_unref(src);
+    g_free(part);
+  }
+
+  dt_pthread_mutex_lock(&copies->mutex);
+  copies->done++;
+  dt_control_job_set_progress(copies->job, 0.5 * copies->done / copies->total);
+  dt_pthread_mutex_unlock(&copies->mutex);
+
+  g_free(copy->src);
+  g_free(copy->dest);
+}
+
+// Copies the files of the images next to each other, to the folder dir or to their local copies if
+// dir is NULL. Copies are I/O bound, mostly on network storage, while the library updates that follow
+// are serialized on the database. dt_image_copy() and dt_image_local_copy_set() then find the files
+// in place and only update the library. Files already there are left untouched, as they do.
+static void _fileop_copy_files(dt_job_t *job, GList *imgs, const char *dir)
+{
+  const int total = g_list_length(imgs);
+  if(total == 0) return;
+
+  _fileop_copy_t *files = calloc(total, sizeof(_fileop_copy_t));
+  if(!files) return;
+
+  _fileop_copies_t copies = { .job = job, .done = 0, .total = total };
+  dt_pthread_mutex_init(&copies.mutex, NULL);
+
+  GThreadPool *pool = g_thread_pool_new(_fileop_copy_file, &copies, MIN(total, FILEOP_COPY_THREADS), FALSE, NULL);
+  int k = 0;
+  for(const GList *t = imgs; t && pool; t = g_list_next(t), k++)
+  {
+    const int32_t imgid = GPOINTER_TO_INT(t->data);
+    char srcpath[PATH_MAX] = { 0 };
+    gboolean from_cache = FALSE;
+    dt_image_full_path(imgid, srcpath, sizeof(srcpath), &from_cache, __FUNCTION__);
+
+    files[k].src = g_strdup(srcpath);
+    if(dir)
+    {
+      gchar *basename = g_path_get_basename(srcpath);
+      files[k].dest = g_build_filename(dir, basename, NULL);
+      g_free(basename);
+    }
+    else
+    {
+      char destpath[PATH_MAX] = { 0 };
+      dt_image_local_copy_path(imgid, destpath, sizeof(destpath));
+      files[k].dest = g_strdup(destpath);
+    }
+    g_thread_pool_push(pool, &files[k], NULL);
+  }
+  if(pool) g_thread_pool_free(pool, FALSE, TRUE);
+
+  dt_pthread_mutex_destroy(&copies.mutex);
+  free(files);
+}
+
 static int32_t _generic_dt_control_fileop_images_job_run(dt_job_t *job,
                                                          int32_t (*fileop_callback)(const int32_t,
                                                                                     const int32_t),
-                                                         const char *desc, const char *desc_pl)
+                                                         const char *desc, const char *desc_pl,
+                                                         const gboolean copy)
 {
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
   GList *t = params->index;
@@ -141,15 +236,26 @@ static int32_t _generic_dt_control_fileop_images_job_run(dt_job_t *job,
     return -1;
   }
 
+  // copies get their files copied in parallel first, and their updates of the library in one
+  // transaction. Moves stay one file at a time: the library has to follow each file that is moved.
+  if(copy)
+  {
+    _fileop_copy_files(job, t, new_film.dirname);
+    fraction = 0.5;
+    dt_database_start_transaction(darktable.db);
+  }
+
   gboolean completeSuccess = TRUE;
   while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
   {
     completeSuccess &= (fileop_callback(GPOINTER_TO_INT(t->data), film_id) != -1);
     t = g_list_next(t);
-    fraction += 1.0 / total;
+    fraction += (copy ? 0.5 : 1.0) / total;
     dt_control_job_set_progress(job, fraction);
   }
 
+  if(copy) dt_database_release_transaction(darktable.db);
+
   if(completeSuccess)
   {
     char collect[1024];
@@ -267,6 +373,8 @@ static int32_t dt_control_write_sidecar_files_job_run(dt_job_t *job)
   return 0;
 }
 
+#define MERGE_HDR_THREADS 3 // brackets developed at the same time, each keeps a copy of its raw until merged
+
 typedef struct dt_control_merge_hdr_t
 {
   uint32_t first_imgid;
@@ -287,12 +395,32 @@ typedef struct dt_control_merge_hdr_t
 
   // 0 - ok; 1 - errors, abort
   gboolean abort;
+
+  // the brackets are developed in parallel, but merged one after the other in their order,
+  // which the merge depends on. next is the num of the bracket to merge now.
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int next;
+  dt_job_t *job;
+  int total;
 } dt_control_merge_hdr_t;
 
+typedef struct dt_control_merge_hdr_frame_t
+{
+  int32_t imgid;
+  int num;
+  dt_control_merge_hdr_t *d;
+
+  // filled by dt_control_merge_hdr_process(), pixels stay NULL if the export failed
+  dt_image_t image;
+  float *pixels;
+  int wd, ht;
+} dt_control_merge_hdr_frame_t;
+
 typedef struct dt_control_merge_hdr_format_t
 {
   dt_imageio_module_data_t parent;
-  dt_control_merge_hdr_t *d;
+  dt_control_merge_hdr_frame_t *frame;
 } dt_control_merge_hdr_format_t;
 
 static int dt_control_merge_hdr_bpp(dt_imageio_module_data_t *data)
@@ -337,13 +465,27 @@ static int dt_control_merge_hdr_process(dt_imageio_module_data_t *datai, const c
                                         dt_dev_pixelpipe_t *pipe, const gboolean export_masks)
 {
   dt_control_merge_hdr_format_t *data = (dt_control_merge_hdr_format_t *)datai;
-  dt_control_merge_hdr_t *d = data->d;
+  dt_control_merge_hdr_frame_t *frame = data->frame;
 
   // just take a copy. also do it after blocking read, so filters will make sense.
   const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
-  const dt_image_t image = *img;
+  frame->image = *img;
   dt_image_cache_read_release(darktable.image_cache, img);
 
+  // ivoid belongs to the pipe: keep the raw until it is this bracket's turn to be merged
+  frame->wd = datai->width;
+  frame->ht = datai->height;
+  frame->pixels = dt_alloc_align_float((size_t)frame->wd * frame->ht);
+  if(!frame->pixels) return 1;
+  memcpy(frame->pixels, ivoid, sizeof(float) * frame->wd * frame->ht);
+  return 0;
+}
+
+static void _merge_hdr_accumulate(dt_control_merge_hdr_t *d, const dt_control_merge_hdr_frame_t *frame)
+{
+  const dt_image_t image = frame->image;
+  const int32_t imgid = frame->imgid;
+
   if(!d->pixels)
   {
     d->first_imgid = imgid;
@@ -358,10 +500,10 @@ static int dt_control_merge_hdr_process(dt_imageio_module_data_t *datai, const c
     roi.y = image.crop_y;
     for(int j=0;j<6;j++)
       for(int i = 0; i < 6; i++) d->first_xtrans[j][i] = FCxtrans(j, i, &roi, image.buf_dsc.xtrans);
-    d->pixels = calloc((size_t)datai->width * datai->height, sizeof(float));
-    d->weight = calloc((size_t)datai->width * datai->height, sizeof(float));
-    d->wd = datai->width;
-    d->ht = datai->height;
+    d->pixels = calloc((size_t)frame->wd * frame->ht, sizeof(float));
+    d->weight = calloc((size_t)frame->wd * frame->ht, sizeof(float));
+    d->wd = frame->wd;
+    d->ht = frame->ht;
     d->orientation = image.orientation;
     for(int i = 0; i < 3; i++)
       d->wb_coeffs[i] = image.wb_coeffs[i];
@@ -374,14 +516,19 @@ static int dt_control_merge_hdr_process(dt_imageio_module_data_t *datai, const c
   {
     dt_control_log(_("exposure bracketing only works on raw images."));
     d->abort = TRUE;
-    return 1;
+    return;
   }
-  else if(datai->width != d->wd || datai->height != d->ht || d->first_filter != image.buf_dsc.filters
+  else if(frame->wd != d->wd || frame->ht != d->ht || d->first_filter != image.buf_dsc.filters
           || d->orientation != image.orientation)
   {
     dt_control_log(_("images have to be of same size and orientation!"));
     d->abort = TRUE;
-    return 1;
+    return;
+  }
+  if(!d->pixels || !d->weight)
+  {
+    d->abort = TRUE;
+    return;
   }
 
   // if no valid exif data can be found, assume peleng fisheye at f/16, 8mm, with half of the light lost in
@@ -395,76 +542,123 @@ static int dt_control_merge_hdr_process(dt_imageio_module_data_t *datai, const c
   const float cal = 100.0f / (aperture * exp * iso);
   // about proportional to how many photons we can expect from this shot:
   const float photoncnt = 100.0f * aperture * exp / iso;
-  float saturation = 1.0f;
+  const float saturation = 1.0f;
   d->whitelevel = fmaxf(d->whitelevel, saturation * cal);
+
+  const float *const restrict raw = frame->pixels;
+  float *const restrict pixels = d->pixels;
+  float *const restrict weight = d->weight;
+  const int wd = d->wd;
+  const int ht = d->ht;
+  const float whitelevel = d->whitelevel;
+  const float epsw = d->epsw;
+  // need some safety margin due to upsampling and 16-bit quantization + dithering?
+  const float offset = 3000.0f / (float)UINT16_MAX;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ivoid, cal, photoncnt) \
-  shared(d, saturation) \
-  schedule(static) collapse(2)
+  dt_omp_firstprivate(raw, pixels, weight, wd, ht, whitelevel, epsw, offset, saturation, cal, photoncnt) \
+  schedule(static)
 #endif
-  for(int y = 0; y < d->ht; y++)
-    for(int x = 0; x < d->wd; x++)
+  for(int y = 0; y < ht; y++)
+    for(int x = 0; x < wd; x++)
     {
+      const size_t k = x + (size_t)wd * y;
       // read unclamped raw value with subtracted black and rescaled to 1.0 saturation.
       // this is the output of the rawprepare iop.
-      const float in = ((float *)ivoid)[x + d->wd * y];
+      const float in = raw[k];
       // weights based on siggraph 12 poster
       // zijian zhu, zhengguo li, susanto rahardja, pasi fraenti
       // 2d denoising factor for high dynamic range imaging
       float w = photoncnt;
 
-      // need some safety margin due to upsampling and 16-bit quantization + dithering?
-      float offset = 3000.0f / (float)UINT16_MAX;
-
       // cannot do an envelope based on single pixel values here, need to get
       // maximum value of all color channels. to find that, go through the
       // pattern block (we conservatively do a 3x3 for bayer or xtrans):
-      int xx = x & ~1, yy = y & ~1;
+      const int xx = x & ~1, yy = y & ~1;
       float M = 0.0f, m = FLT_MAX;
-      if(xx < d->wd - 2 && yy < d->ht - 2)
+      if(xx < wd - 2 && yy < ht - 2)
       {
-        for(int i = 0; i < 3; i++)
-          for(int j = 0; j < 3; j++)
+        for(int j = 0; j < 3; j++)
+          for(int i = 0; i < 3; i++)
           {
-            M = MAX(M, ((float *)ivoid)[xx + i + d->wd * (yy + j)]);
-            m = MIN(m, ((float *)ivoid)[xx + i + d->wd * (yy + j)]);
+            M = MAX(M, raw[xx + i + (size_t)wd * (yy + j)]);
+            m = MIN(m, raw[xx + i + (size_t)wd * (yy + j)]);
           }
         // move envelope a little to allow non-zero weight even for clipped regions.
         // this is because even if the 2x2 block is clipped somewhere, the other channels
         // might still prove useful. we'll check for individual channel saturation below.
-        w *= d->epsw + envelope((M + offset) / saturation);
+        w *= epsw + envelope((M + offset) / saturation);
       }
 
       if(M + offset >= saturation)
       {
-        if(d->weight[x + d->wd * y] <= 0.0f)
+        if(weight[k] <= 0.0f)
         { // only consider saturated pixels in case we have nothing better:
-          if(d->weight[x + d->wd * y] == 0 || m < -d->weight[x + d->wd * y])
+          if(weight[k] == 0 || m < -weight[k])
           {
             if(m + offset >= saturation)
-              d->pixels[x + d->wd * y] = 1.0f; // let's admit we were completely clipped, too
+              pixels[k] = 1.0f; // let's admit we were completely clipped, too
             else
-              d->pixels[x + d->wd * y] = in * cal / d->whitelevel;
-            d->weight[x + d->wd * y]
-                = -m; // could use -cal here, but m is per pixel and safer for varying illumination conditions
+              pixels[k] = in * cal / whitelevel;
+            weight[k] = -m; // could use -cal here, but m is per pixel and safer for varying illumination conditions
           }
         }
         // else silently ignore, others have filled in a better color here already
       }
       else
       {
-        if(d->weight[x + d->wd * y] <= 0.0)
+        if(weight[k] <= 0.0)
         { // cleanup potentially blown highlights from earlier images
-          d->pixels[x + d->wd * y] = 0.0f;
-          d->weight[x + d->wd * y] = 0.0f;
+          pixels[k] = 0.0f;
+          weight[k] = 0.0f;
         }
-        d->pixels[x + d->wd * y] += w * in * cal;
-        d->weight[x + d->wd * y] += w;
+        pixels[k] += w * in * cal;
+        weight[k] += w;
       }
     }
+}
 
-  return 0;
+static void _merge_hdr_develop(gpointer data, gpointer user_data)
+{
+  dt_control_merge_hdr_frame_t *frame = (dt_control_merge_hdr_frame_t *)data;
+  dt_control_merge_hdr_t *d = frame->d;
+
+  if(!d->abort)
+  {
+    dt_imageio_module_format_t buf = (dt_imageio_module_format_t){.mime = dt_control_merge_hdr_mime,
+                                                                  .levels = dt_control_merge_hdr_levels,
+                                                                  .bpp = dt_control_merge_hdr_bpp,
+                                                                  .write_image = dt_control_merge_hdr_process };
+    dt_control_merge_hdr_format_t dat = (dt_control_merge_hdr_format_t){.parent = { 0 }, .frame = frame };
+    const gboolean is_scaling = dt_conf_is_equal("plugins/lighttable/export/resizing", "scaling");
+
+    dt_imageio_export_with_flags(frame->imgid, "unused", &buf, (dt_imageio_module_data_t *)&dat, TRUE, FALSE,
+                                 FALSE, is_scaling, FALSE, "pre:rawprepare", FALSE, FALSE, DT_COLORSPACE_NONE,
+                                 NULL, DT_INTENT_LAST, NULL, NULL, frame->num, d->total, NULL);
+  }
+
+  // brackets are pushed in order to the pool, so the previous ones are already developing
+  dt_pthread_mutex_lock(&d->mutex);
+  while(d->next != frame->num) dt_pthread_cond_wait(&d->cond, &d->mutex);
+  dt_pthread_mutex_unlock(&d->mutex);
+
+  if(!d->abort)
+  {
+    if(frame->pixels)
+      _merge_hdr_accumulate(d, frame);
+    else
+      d->abort = TRUE;
+  }
+  dt_free_align(frame->pixels);
+  frame->pixels = NULL;
+
+  /* update the progress bar */
+  dt_control_job_set_progress(d->job, (double)frame->num / (d->total + 1));
+
+  dt_pthread_mutex_lock(&d->mutex);
+  d->next++;
+  pthread_cond_broadcast(&d->cond);
+  dt_pthread_mutex_unlock(&d->mutex);
 }
 
 static int32_t dt_control_merge_hdr_job_run(dt_job_t *job)
@@ -473,41 +667,37 @@ static int32_t dt_control_merge_hdr_job_run(dt_job_t *job)
   GList *t = params->index;
   const guint total = g_list_length(t);
   char message[512] = { 0 };
-  double fraction = 0;
   snprintf(message, sizeof(message), ngettext("merging %d image", "merging %d images", total), total);
 
   dt_control_job_set_progress_message(job, message);
 
-  dt_control_merge_hdr_t d = (dt_control_merge_hdr_t){.epsw = 1e-8f, .abort = FALSE };
+  dt_control_merge_hdr_t d = (dt_control_merge_hdr_t){.epsw = 1e-8f, .abort = FALSE, .next = 1, .job = job,
+                                                       .total = total };
+  dt_pthread_mutex_init(&d.mutex, NULL);
+  pthread_cond_init(&d.cond, NULL);
 
-  dt_imageio_module_format_t buf = (dt_imageio_module_format_t){.mime = dt_control_merge_hdr_mime,
-                                                                .levels = dt_control_merge_hdr_levels,
-                                                                .bpp = dt_control_merge_hdr_bpp,
-                                                                .write_image = dt_control_merge_hdr_process };
-
-  dt_control_merge_hdr_format_t dat = (dt_control_merge_hdr_format_t){.parent = { 0 }, .d = &d };
-
-  int num = 1;
-  while(t)
+  // the brackets only go through rawprepare: decoding the raws is what takes time, do it side by side
+  dt_control_merge_hdr_frame_t *frames = calloc(total, sizeof(dt_control_merge_hdr_frame_t));
+  GThreadPool *pool = frames ? g_thread_pool_new(_merge_hdr_develop, NULL, MAX(1, MIN(total, MERGE_HDR_THREADS)),
+                                                 FALSE, NULL)
+                             : NULL;
+  if(pool)
   {
-    if(d.abort) goto end;
-
-    const int32_t imgid = GPOINTER_TO_INT(t->data);
-
-    const gboolean is_scaling =
-      dt_conf_is_equal("plugins/lighttable/export/resizing", "scaling");
-
-    dt_imageio_export_with_flags(imgid, "unused", &buf, (dt_imageio_module_data_t *)&dat, TRUE, FALSE, FALSE, is_scaling,
-                                 FALSE, "pre:rawprepare", FALSE, FALSE, DT_COLORSPACE_NONE, NULL, DT_INTENT_LAST, NULL,
-                                 NULL, num, total, NULL);
-
-    t = g_list_next(t);
-
-    /* update the progress bar */
-    fraction += 1.0 / (total + 1);
-    dt_control_job_set_progress(job, fraction);
-    num++;
+    for(int num = 1; t; t = g_list_next(t), num++)
+    {
+      dt_control_merge_hdr_frame_t *frame = &frames[num - 1];
+      frame->imgid = GPOINTER_TO_INT(t->data);
+      frame->num = num;
+      frame->d = &d;
+      g_thread_pool_push(pool, frame, NULL);
+    }
+    g_thread_pool_free(pool, FALSE, TRUE);
   }
+  else
+    d.abort = TRUE;
+  free(frames);
+  pthread_cond_destroy(&d.cond);
+  dt_pthread_mutex_destroy(&d.mutex);
 
   if(d.abort) goto end;
 
@@ -591,7 +781,14 @@ static int32_t dt_control_duplicate_images_job_run(dt_job_t *job)
       if(GPOINTER_TO_INT(params->data))
         dt_history_delete_on_image(newimgid);
       else
-        dt_history_copy_and_paste_on_image(imgid, newimgid, NULL, TRUE, TRUE);
+      {
+        // the duplicate has no history yet, a plain copy is all it needs
+        GList *dest = g_list_prepend(NULL, GINT_TO_POINTER(newimgid));
+        dt_history_copy_on_list(imgid, dest, TRUE);
+        g_list_free(dest);
+        // same history, same thumbnails: don't run the pipe again to get them
+        dt_mipmap_cache_copy_thumbnails(darktable.mipmap_cache, newimgid, imgid);
+      }
 
       // a duplicate should keep the change time stamp of the original
       dt_image_cache_set_change_timestamp_from_image(darktable.image_cache, newimgid, imgid);
@@ -610,6 +807,36 @@ static int32_t dt_control_duplicate_images_job_run(dt_job_t *job)
   return 0;
 }
 
+// images compressed between two progress updates
+#define COMPRESS_HISTORY_BATCH 256
+
+static int32_t dt_control_compress_history_job_run(dt_job_t *job)
+{
+  dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
+  GList *t = params->index;
+  const guint total = g_list_length(t);
+  guint done = 0;
+  char message[512] = { 0 };
+  snprintf(message, sizeof(message), ngettext("compressing history of %d image", "compressing history of %d images",
+                                              total), total);
+  dt_control_job_set_progress_message(job, message);
+
+  // each batch is compressed by a few statements in one transaction
+  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+  {
+    GList *batch = NULL;
+    for(int k = 0; t && k < COMPRESS_HISTORY_BATCH; k++, t = g_list_next(t))
+      batch = g_list_prepend(batch, t->data);
+    batch = g_list_reverse(batch);
+    done += g_list_length(batch);
+    dt_history_compress_on_list(batch);
+    g_list_free(batch);
+    dt_control_job_set_progress(job, (double)done / total);
+  }
+  dt_control_queue_redraw_center();
+  return 0;
+}
+
 static int32_t dt_control_flip_images_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
@@ -771,28 +998,24 @@ static int32_t dt_control_remove_images_job_run(dt_job_t *job)
   // update remove status
   _set_remove_flag(imgs);
 
-  dt_collection_update(darktable.collection);
-
   // We need a list of files to regenerate .xmp files if there are duplicates
   GList *list = _get_full_pathname(imgs);
 
   free(imgs);
 
-  double fraction = 0.0f;
-  while(t)
-  {
-    int32_t imgid = GPOINTER_TO_INT(t->data);
-    dt_image_remove(imgid);
-    t = g_list_next(t);
-    fraction += 1.0 / total;
-    dt_control_job_set_progress(job, fraction);
-  }
+  // all the rows at once, the collection is refreshed once at the end
+  dt_image_remove_list(t);
+  dt_control_job_set_progress(job, 0.5);
 
+  double fraction = 0.5;
+  const guint nb_files = g_list_length(list);
   while(list)
   {
     char *imgname = (char *)list->data;
     dt_image_synch_all_xmp(imgname);
     list = g_list_delete_link(list, list);
+    fraction += 0.5 / nb_files;
+    dt_control_job_set_progress(job, fraction);
   }
   dt_film_remove_empty();
   dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF,
@@ -1200,13 +1423,13 @@ bail_out:
 static int32_t dt_control_move_images_job_run(dt_job_t *job)
 {
   return _generic_dt_control_fileop_images_job_run(job, &dt_image_move, _("moving %d image"),
-                                                   _("moving %d images"));
+                                                   _("moving %d images"), FALSE);
 }
 
 static int32_t dt_control_copy_images_job_run(dt_job_t *job)
 {
   return _generic_dt_control_fileop_images_job_run(job, &dt_image_copy, _("copying %d image"),
-                                                   _("copying %d images"));
+                                                   _("copying %d images"), TRUE);
 }
 
 static int32_t dt_control_local_copy_images_job_run(dt_job_t *job)
@@ -1231,6 +1454,13 @@ static int32_t dt_control_local_copy_images_job_run(dt_job_t *job)
 
   dt_tag_new("darktable|local-copy", &tagid);
 
+  if(is_copy)
+  {
+    _fileop_copy_files(job, t, NULL);
+    fraction = 0.5;
+  }
+
+  dt_database_start_transaction(darktable.db);
   gboolean tag_change = FALSE;
   while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
   {
@@ -1251,9 +1481,10 @@ static int32_t dt_control_local_copy_images_job_run(dt_job_t *job)
     }
     t = g_list_next(t);
 
-    fraction += 1.0 / total;
+    fraction += (is_copy ? 0.5 : 1.0) / total;
     dt_control_job_set_progress(job, fraction);
   }
+  dt_database_release_transaction(darktable.db);
 
   dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_LOCAL_COPY,
                              g_list_copy(params->index));
@@ -1313,34 +1544,46 @@ static int32_t dt_control_refresh_exif_run(dt_job_t *job)
 }
 
 
-static int32_t dt_control_export_job_run(dt_job_t *job)
+// rough memory needed by one export pipe: input, output and one intermediate RGBA float buffer
+#define DT_EXPORT_PIPE_BUFFERS 3
+// pixels assumed for exports at full resolution, when we can't know the size beforehand
+#define DT_EXPORT_DEFAULT_PIXELS (48 * 1000 * 1000)
+
+// shared state of the pipes of one export job
+typedef struct dt_control_export_pipes_t
 {
-  dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
-  dt_control_export_t *settings = (dt_control_export_t *)params->data;
-  GList *t = params->index;
-  dt_imageio_module_format_t *mformat = dt_imageio_get_format_by_index(settings->format_index);
-  g_assert(mformat);
-  dt_imageio_module_storage_t *mstorage = dt_imageio_get_storage_by_index(settings->storage_index);
-  g_assert(mstorage);
-  dt_imageio_module_data_t *sdata = settings->sdata;
+  dt_pthread_mutex_t lock; // protects everything below the constant part
 
-  gboolean tag_change = FALSE;
+  dt_job_t *job;
+  dt_control_export_t *settings;
+  dt_imageio_module_format_t *mformat;
+  dt_imageio_module_storage_t *mstorage;
+  dt_imageio_module_data_t *sdata;
+  dt_export_metadata_t *metadata;
+  guint tagid, etagid;
+  guint total;
 
-  // get a thread-safe fdata struct (one jpeg struct per thread etc):
-  dt_imageio_module_data_t *fdata = mformat->get_params(mformat);
+  GList *next;        // next image to export
+  guint started;      // number of images handed to a pipe
+  gboolean *done;     // done[i] is TRUE when image number i+1 is finished
+  guint reported;     // images finished in order, ie. done[0..reported-1] are all TRUE
+  gboolean tag_change;
+} dt_control_export_pipes_t;
 
-  if(mstorage->initialize_store)
-  {
-    if(mstorage->initialize_store(mstorage, sdata, &mformat, &fdata, &t, TRUE))
-    {
-      // bail out, something went wrong
-      goto end;
-    }
-    mformat->set_params(mformat, fdata, mformat->params_size(mformat));
-    mstorage->set_params(mstorage, sdata, mstorage->params_size(mstorage));
-  }
+typedef struct dt_control_export_pipe_t
+{
+  dt_control_export_pipes_t *pipes;
+  dt_imageio_module_data_t *fdata; // one format struct per pipe
+  dt_imageio_module_data_t **variants_fdata; // and one per variant, in the order of settings->variants
+  pthread_t thread;
+  int node; // NUMA node the pipe runs on, -1 for anywhere
+} dt_control_export_pipe_t;
 
-  // Get max dimensions...
+// max size of an export, from the settings and the limits of the storage and the format
+static void _export_max_size(dt_imageio_module_storage_t *mstorage, dt_imageio_module_data_t *sdata,
+                             dt_imageio_module_format_t *mformat, dt_imageio_module_data_t *fdata,
+                             const int max_width, const int max_height, int *width, int *height)
+{
   uint32_t w, h, fw, fh, sw, sh;
   fw = fh = sw = sh = 0;
   mstorage->dimension(mstorage, sdata, &sw, &sh);
@@ -1356,48 +1599,121 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   else
     h = sh < fh ? sh : fh;
 
-  const guint total = g_list_length(t);
-  if(total > 0)
-    dt_control_log(ngettext("exporting %d image..", "exporting %d images..", total), total);
-  else
-    dt_control_log(_("no image to export"));
+  *width = (max_width != 0 && w != 0) ? MIN(w, max_width) : MAX(w, max_width);
+  *height = (max_height != 0 && h != 0) ? MIN(h, max_height) : MAX(h, max_height);
+}
 
-  double fraction = 0;
+// the format structs of the variants for one pipe, with their sizes
+static dt_imageio_module_data_t **_export_variants_params(dt_control_export_pipes_t *p)
+{
+  const guint count = g_list_length(p->settings->variants);
+  if(count == 0) return NULL;
 
-  // set up the fdata struct
-  fdata->max_width = (settings->max_width != 0 && w != 0) ? MIN(w, settings->max_width) : MAX(w, settings->max_width);
-  fdata->max_height = (settings->max_height != 0 && h != 0) ? MIN(h, settings->max_height) : MAX(h, settings->max_height);
-  g_strlcpy(fdata->style, settings->style, sizeof(fdata->style));
-  // Invariant: the tagid for 'darktable|changed' will not change while this function runs. Is this a
-  // sensible assumption?
-  guint tagid = 0, etagid = 0;
-  dt_tag_new("darktable|exported", &etagid);
+  dt_imageio_module_data_t **fdata = g_malloc0_n(count, sizeof(dt_imageio_module_data_t *));
+  int k = 0;
+  for(const GList *l = p->settings->variants; l; l = g_list_next(l), k++)
+  {
+    const dt_control_export_variant_t *variant = (dt_control_export_variant_t *)l->data;
+    dt_imageio_module_format_t *mformat = dt_imageio_get_format_by_index(variant->format_index);
+    fdata[k] = mformat->get_params(mformat);
+    if(!fdata[k]) continue;
+    int width = 0, height = 0;
+    _export_max_size(p->mstorage, p->sdata, mformat, fdata[k], variant->max_width, variant->max_height, &width,
+                     &height);
+    fdata[k]->max_width = width;
+    fdata[k]->max_height = height;
+    g_strlcpy(fdata[k]->style, p->settings->style, sizeof(fdata[k]->style));
+  }
+  return fdata;
+}
 
-  dt_export_metadata_t metadata;
-  metadata.flags = 0;
-  metadata.list = dt_util_str_to_glist("\1", settings->metadata_export);
-  if(metadata.list)
+static void _export_variants_params_free(dt_control_export_pipes_t *p, dt_imageio_module_data_t **fdata)
+{
+  if(!fdata) return;
+  int k = 0;
+  for(const GList *l = p->settings->variants; l; l = g_list_next(l), k++)
   {
-    metadata.flags = strtol(metadata.list->data, NULL, 16);
-    metadata.list = g_list_remove(metadata.list, metadata.list->data);
+    const dt_control_export_variant_t *variant = (dt_control_export_variant_t *)l->data;
+    dt_imageio_module_format_t *mformat = dt_imageio_get_format_by_index(variant->format_index);
+    if(fdata[k]) mformat->free_params(mformat, fdata[k]);
   }
+  g_free(fdata);
+}
 
-  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+// the largest size of the main export and its variants, 0 = unbounded
+static void _export_session_size(const dt_control_export_pipe_t *pipe, int *width, int *height)
+{
+  *width = pipe->fdata->max_width;
+  *height = pipe->fdata->max_height;
+  const guint count = g_list_length(pipe->pipes->settings->variants);
+  for(guint k = 0; k < count; k++)
   {
-    const int32_t imgid = GPOINTER_TO_INT(t->data);
-    t = g_list_next(t);
-    const guint num = total - g_list_length(t);
+    const dt_imageio_module_data_t *fdata = pipe->variants_fdata[k];
+    if(!fdata) continue;
+    *width = (*width == 0 || fdata->max_width == 0) ? 0 : MAX(*width, fdata->max_width);
+    *height = (*height == 0 || fdata->max_height == 0) ? 0 : MAX(*height, fdata->max_height);
+  }
+}
+
+static int _export_pipes_number(dt_imageio_module_storage_t *mstorage, const uint32_t w, const uint32_t h,
+                                const guint total)
+{
+  if(total < 2 || !mstorage->parallel_store || !mstorage->parallel_store(mstorage)) return 1;
+
+  const int wanted = dt_conf_get_int("export_parallel_pipes");
+  if(wanted > 0) return MIN(wanted, total);
+
+  // each pipe already uses all cores in its modules, more pipes only fill the gaps of
+  // the single-threaded phases (raw loading, encoding, writing). Since the pixelpipe itself
+  // runs one image at a time, 2 pipes are enough to encode an image while the next one
+  // is processed. Keep the memory of the reserved threads (thumbnails, darkroom) out of the budget.
+  const size_t pixels = (w > 0 && h > 0) ? (size_t)w * h : DT_EXPORT_DEFAULT_PIXELS;
+  const size_t pipe_mem = MAX(pixels, 1) * 4 * sizeof(float) * DT_EXPORT_PIPE_BUFFERS;
+  const int mem_pipes = (int)(dt_get_available_mem() / pipe_mem) - DT_CTL_WORKER_RESERVED;
+  const int cpu_pipes = MAX(darktable.num_openmp_threads / 2, 2);
+  const int pipes = CLAMP(MIN(mem_pipes, cpu_pipes), 1, (int)total);
+
+  // in NUMA mode, the same number of pipes on each node
+  const int nodes = dt_numa_nodes();
+  if(nodes > 1 && pipes > nodes) return pipes - pipes % nodes;
+  return pipes;
+}
+
+static void *_export_pipe_run(void *data)
+{
+  dt_control_export_pipe_t *pipe = (dt_control_export_pipe_t *)data;
+  dt_control_export_pipes_t *p = pipe->pipes;
+  dt_control_export_t *settings = p->settings;
+  dt_imageio_module_storage_t *mstorage = p->mstorage;
+
+  if(pipe->node >= 0) dt_numa_bind_thread(pipe->node);
+
+  pipe->variants_fdata = _export_variants_params(p);
+  if(pipe->variants_fdata)
+  {
+    int width = 0, height = 0;
+    _export_session_size(pipe, &width, &height);
+    dt_imageio_export_session_begin(width, height);
+  }
 
-    // progress message
-    char message[512] = { 0 };
-    snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, total, mstorage->name(mstorage));
-    // update the message. initialize_store() might have changed the number of images
-    dt_control_job_set_progress_message(job, message);
+  while(dt_control_job_get_state(p->job) != DT_JOB_STATE_CANCELLED)
+  {
+    dt_pthread_mutex_lock(&p->lock);
+    if(!p->next)
+    {
+      dt_pthread_mutex_unlock(&p->lock);
+      break;
+    }
+    const int32_t imgid = GPOINTER_TO_INT(p->next->data);
+    p->next = g_list_next(p->next);
+    const guint num = ++p->started;
+    dt_pthread_mutex_unlock(&p->lock);
 
+    gboolean tag_change = FALSE;
     // remove 'changed' tag from image
-    if(dt_tag_detach(tagid, imgid, FALSE, FALSE)) tag_change = TRUE;
+    if(dt_tag_detach(p->tagid, imgid, FALSE, FALSE)) tag_change = TRUE;
     // make sure the 'exported' tag is set on the image
-    if(dt_tag_attach(etagid, imgid, FALSE, FALSE)) tag_change = TRUE;
+    if(dt_tag_attach(p->etagid, imgid, FALSE, FALSE)) tag_change = TRUE;
 
     /* register export timestamp in cache */
     dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
@@ -1419,17 +1735,162 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
       else
       {
         dt_image_cache_read_release(darktable.image_cache, image);
-        if(mstorage->store(mstorage, sdata, imgid, mformat, fdata, num, total, TRUE,
+        if(mstorage->store(mstorage, p->sdata, imgid, p->mformat, pipe->fdata, num, p->total, TRUE,
                            settings->export_masks, settings->icc_type, settings->icc_filename, settings->icc_intent,
-                           &metadata) != 0)
-          dt_control_job_cancel(job);
+                           p->metadata) != 0)
+          dt_control_job_cancel(p->job);
+
+        int k = 0;
+        for(const GList *l = settings->variants; l && dt_control_job_get_state(p->job) != DT_JOB_STATE_CANCELLED;
+            l = g_list_next(l), k++)
+        {
+          const dt_control_export_variant_t *variant = (dt_control_export_variant_t *)l->data;
+          if(!pipe->variants_fdata[k]) continue;
+          if(mstorage->store(mstorage, p->sdata, imgid, dt_imageio_get_format_by_index(variant->format_index),
+                             pipe->variants_fdata[k], num, p->total, TRUE, settings->export_masks,
+                             settings->icc_type, settings->icc_filename, settings->icc_intent, p->metadata) != 0)
+            dt_control_job_cancel(p->job);
+        }
       }
     }
 
-    fraction += 1.0 / total;
-    if(fraction > 1.0) fraction = 1.0;
-    dt_control_job_set_progress(job, fraction);
+    // report completion in order: the progress only moves when all images before this one are done
+    dt_pthread_mutex_lock(&p->lock);
+    p->tag_change |= tag_change;
+    p->done[num - 1] = TRUE;
+    const guint reported = p->reported;
+    while(p->reported < p->total && p->done[p->reported]) p->reported++;
+    if(p->reported != reported)
+    {
+      // progress message
+      char message[512] = { 0 };
+      snprintf(message, sizeof(message), _("exporting %d / %d to %s"), MIN(p->reported + 1, p->total), p->total,
+               mstorage->name(mstorage));
+      dt_control_job_set_progress_message(p->job, message);
+      dt_control_job_set_progress(p->job, (double)p->reported / p->total);
+    }
+    dt_pthread_mutex_unlock(&p->lock);
+  }
+
+  if(pipe->variants_fdata) dt_imageio_export_session_end();
+  _export_variants_params_free(p, pipe->variants_fdata);
+  pipe->variants_fdata = NULL;
+  // the first pipe runs in the job thread, which goes on with other jobs
+  if(pipe->node >= 0) dt_numa_unbind_thread();
+  return NULL;
+}
+
+static int32_t dt_control_export_job_run(dt_job_t *job)
+{
+  dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
+  dt_control_export_t *settings = (dt_control_export_t *)params->data;
+  GList *t = params->index;
+  dt_imageio_module_format_t *mformat = dt_imageio_get_format_by_index(settings->format_index);
+  g_assert(mformat);
+  dt_imageio_module_storage_t *mstorage = dt_imageio_get_storage_by_index(settings->storage_index);
+  g_assert(mstorage);
+  dt_imageio_module_data_t *sdata = settings->sdata;
+
+  gboolean tag_change = FALSE;
+
+  // exported files may come with a copy of the sidecars, they should be up to date
+  dt_image_flush_sidecar_files(-1);
+
+  // get a thread-safe fdata struct (one jpeg struct per thread etc):
+  dt_imageio_module_data_t *fdata = mformat->get_params(mformat);
+
+  if(mstorage->initialize_store)
+  {
+    if(mstorage->initialize_store(mstorage, sdata, &mformat, &fdata, &t, TRUE))
+    {
+      // bail out, something went wrong
+      goto end;
+    }
+    mformat->set_params(mformat, fdata, mformat->params_size(mformat));
+    mstorage->set_params(mstorage, sdata, mstorage->params_size(mstorage));
   }
+
+  const guint total = g_list_length(t);
+  if(total > 0)
+    dt_control_log(ngettext("exporting %d image..", "exporting %d images..", total), total);
+  else
+    dt_control_log(_("no image to export"));
+
+  // set up the fdata struct, with the max dimensions
+  _export_max_size(mstorage, sdata, mformat, fdata, settings->max_width, settings->max_height, &fdata->max_width,
+                   &fdata->max_height);
+  g_strlcpy(fdata->style, settings->style, sizeof(fdata->style));
+
+  dt_control_export_pipes_t pipes = { 0 };
+  dt_pthread_mutex_init(&pipes.lock, NULL);
+  pipes.job = job;
+  pipes.settings = settings;
+  pipes.mformat = mformat;
+  pipes.mstorage = mstorage;
+  pipes.sdata = sdata;
+  pipes.total = total;
+  pipes.next = t;
+  pipes.done = g_malloc0_n(MAX(total, 1), sizeof(gboolean));
+
+  // Invariant: the tagid for 'darktable|changed' will not change while this function runs. Is this a
+  // sensible assumption?
+  dt_tag_new("darktable|exported", &pipes.etagid);
+
+  dt_export_metadata_t metadata;
+  metadata.flags = 0;
+  metadata.list = dt_util_str_to_glist("\1", settings->metadata_export);
+  if(metadata.list)
+  {
+    metadata.flags = strtol(metadata.list->data, NULL, 16);
+    metadata.list = g_list_remove(metadata.list, metadata.list->data);
+  }
+  pipes.metadata = &metadata;
+
+  char message[512] = { 0 };
+  snprintf(message, sizeof(message), _("exporting %d / %d to %s"), MIN(1, total), total, mstorage->name(mstorage));
+  // update the message. initialize_store() might have changed the number of images
+  dt_control_job_set_progress_message(job, message);
+
+  const int nb_pipes = _export_pipes_number(mstorage, fdata->max_width, fdata->max_height, total);
+  dt_control_export_pipe_t *pipe = g_malloc0_n(nb_pipes, sizeof(dt_control_export_pipe_t));
+  dt_print(DT_DEBUG_CONTROL, "[export_job] exporting %d images with %d pipes\n", total, nb_pipes);
+
+  // one pipe per NUMA node in turn. a single pipe keeps the whole machine
+  const gboolean numa = nb_pipes > 1 && dt_numa_nodes() > 1;
+
+  // the first pipe runs in this thread with the main fdata, the others get their own copy
+  int started = 1;
+  pipe[0].pipes = &pipes;
+  pipe[0].fdata = fdata;
+  pipe[0].node = numa ? 0 : -1;
+  for(int k = 1; k < nb_pipes; k++)
+  {
+    pipe[k].pipes = &pipes;
+    pipe[k].node = numa ? k % dt_numa_nodes() : -1;
+    pipe[k].fdata = mformat->get_params(mformat);
+    pipe[k].fdata->max_width = fdata->max_width;
+    pipe[k].fdata->max_height = fdata->max_height;
+    g_strlcpy(pipe[k].fdata->style, fdata->style, sizeof(pipe[k].fdata->style));
+    if(dt_pthread_create(&pipe[k].thread, _export_pipe_run, &pipe[k]))
+    {
+      mformat->free_params(mformat, pipe[k].fdata);
+      break;
+    }
+    started++;
+  }
+
+  _export_pipe_run(&pipe[0]);
+
+  for(int k = 1; k < started; k++)
+  {
+    pthread_join(pipe[k].thread, NULL);
+    mformat->free_params(mformat, pipe[k].fdata);
+  }
+
+  tag_change = pipes.tag_change;
+  g_free(pipe);
+  g_free(pipes.done);
+  dt_pthread_mutex_destroy(&pipes.lock);
   g_list_free_full(metadata.list, g_free);
 
   if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
@@ -1500,20 +1961,10 @@ static dt_job_t *_control_gpx_apply_job_create(const gchar *filename, int32_t fi
   return job;
 }
 
-static int32_t dt_dev_save_xmp_job_run(dt_job_t *job)
-{
-  dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
-  const int32_t imgid = GPOINTER_TO_INT(params->data);
-  if(dt_image_write_sidecar_file(imgid))
-    fprintf(stdout, "cannot write XMP file for image %i. The target storage may be unavailable or read-only.\n", imgid);
-  return 0;
-}
-
 void dt_control_save_xmp(const int32_t imgid)
 {
-  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG,
-                     dt_control_generic_images_job_create(&dt_dev_save_xmp_job_run, N_("save history to XMP"), 0,
-                                                          GINT_TO_POINTER(imgid), PROGRESS_SIMPLE, FALSE));
+  // edits come in bursts, the sidecar writer coalesces them
+  dt_image_queue_sidecar_file(imgid);
 }
 
 void dt_control_merge_hdr()
@@ -1536,6 +1987,14 @@ void dt_control_duplicate_images(gboolean virgin)
                                                           N_("duplicate images"), 0, GINT_TO_POINTER(virgin), PROGRESS_SIMPLE, TRUE));
 }
 
+void dt_control_compress_history_images()
+{
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG,
+                     dt_control_generic_images_job_create(&dt_control_compress_history_job_run,
+                                                          N_("compress history"), 0, NULL, PROGRESS_CANCELLABLE,
+                                                          FALSE));
+}
+
 void dt_control_flip_images(const int32_t cw)
 {
   dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG,
@@ -1841,6 +2300,7 @@ static void dt_control_export_cleanup(void *p)
 
   g_free(settings->icc_filename);
   g_free(settings->metadata_export);
+  g_list_free_full(settings->variants, g_free);
   free(params->data);
 
   dt_control_image_enumerator_cleanup(params);
@@ -1849,13 +2309,18 @@ static void dt_control_export_cleanup(void *p)
 void dt_control_export(GList *imgid_list, int max_width, int max_height, int format_index, int storage_index,
                        gboolean high_quality, gboolean export_masks, char *style,
                        dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
-                       dt_iop_color_intent_t icc_intent, const gchar *metadata_export)
+                       dt_iop_color_intent_t icc_intent, const gchar *metadata_export, GList *variants)
 {
   dt_job_t *job = dt_control_job_create(&dt_control_export_job_run, "export");
-  if(!job) return;
+  if(!job)
+  {
+    g_list_free_full(variants, g_free);
+    return;
+  }
   dt_control_image_enumerator_t *params = dt_control_export_alloc();
   if(!params)
   {
+    g_list_free_full(variants, g_free);
     dt_control_job_dispose(job);
     return;
   }
@@ -1886,6 +2351,7 @@ void dt_control_export(GList *imgid_list, int max_width, int max_height, int for
   data->icc_filename = g_strdup(icc_filename);
   data->icc_intent = icc_intent;
   data->metadata_export = g_strdup(metadata_export);
+  data->variants = variants;
 
   dt_control_job_add_progress(job, _("export images"), TRUE);
   dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_EXPORT, job);
@@ -1894,6 +2360,51 @@ void dt_control_export(GList *imgid_list, int max_width, int max_height, int for
   mstorage->export_dispatched(mstorage);
 }
 
+GList *dt_control_export_variants_from_string(const char *variants, const int default_format_index)
+{
+  GList *list = NULL;
+  if(!variants) return list;
+
+  gchar **entries = g_strsplit(variants, ",", -1);
+  for(gchar **entry = entries; *entry; entry++)
+  {
+    gchar *spec = g_strstrip(*entry);
+    if(!*spec) continue;
+
+    int width = 0, height = 0;
+    char *colon = strchr(spec, ':');
+    if(colon) *colon = '\0';
+    const char *format_name = colon ? colon + 1 : NULL;
+    if(sscanf(spec, "%dx%d", &width, &height) != 2 || width < 0 || height < 0)
+    {
+      fprintf(stderr, "[dt_control_export_variants] invalid size `%s', expected <width>x<height>\n", spec);
+      continue;
+    }
+
+    int format_index = default_format_index;
+    if(format_name)
+    {
+      // same shorthands as the file extensions
+      if(!g_ascii_strcasecmp(format_name, "jpg")) format_name = "jpeg";
+      else if(!g_ascii_strcasecmp(format_name, "tif")) format_name = "tiff";
+      format_index = dt_imageio_get_index_of_format(dt_imageio_get_format_by_name(format_name));
+    }
+    if(format_index < 0 || !dt_imageio_get_format_by_index(format_index))
+    {
+      fprintf(stderr, "[dt_control_export_variants] unknown format `%s'\n", format_name ? format_name : "");
+      continue;
+    }
+
+    dt_control_export_variant_t *variant = g_malloc0(sizeof(dt_control_export_variant_t));
+    variant->max_width = width;
+    variant->max_height = height;
+    variant->format_index = format_index;
+    list = g_list_append(list, variant);
+  }
+  g_strfreev(entries);
+  return list;
+}
+
 static void _add_datetime_offset(const char *odt, const long int offset, char *ndt)
 {
   // get the datetime_taken and calculate the new time
@@ -2378,6 +2889,25 @@ void _refresh_progress_counter(dt_job_t *job, const int elements, const int inde
   g_usleep(100);
 }
 
+// files read ahead of the one being imported
+#define IMPORT_PREFETCH_FILES 16
+#define IMPORT_PREFETCH_THREADS 4
+// enough for the metadata and the embedded thumbnail of most raw files
+#define IMPORT_PREFETCH_SIZE (4 << 20)
+
+// only warms the page cache: the EXIF, XMP and copy steps of the import then don't wait for the drive
+static void _import_prefetch_file(gpointer data, gpointer user_data)
+{
+  FILE *f = g_fopen((const char *)data, "rb");
+  if(!f) return;
+  const size_t chunk = 1 << 16;
+  char *buf = g_malloc(chunk);
+  size_t total = 0, got = 0;
+  while(total < IMPORT_PREFETCH_SIZE && (got = fread(buf, 1, chunk, f)) > 0) total += got;
+  g_free(buf);
+  fclose(f);
+}
+
 static int32_t _control_import_job_run(dt_job_t *job)
 {
   fprintf(stdout,"\n:::Control_Job_run:::\n");
@@ -2386,10 +2916,20 @@ static int32_t _control_import_job_run(dt_job_t *job)
 
   int index = 0;
 
+  // the database work is sequential, but the next files can be read from the card or network
+  // drive in the meantime
+  GThreadPool *prefetch = g_thread_pool_new(_import_prefetch_file, NULL, IMPORT_PREFETCH_THREADS, FALSE, NULL);
+  GList *ahead = g_list_first(data->imgs);
+  int ahead_index = 0;
+
   for(GList *img = g_list_first(data->imgs); img; img = g_list_next(img))
   {
     fprintf(stdout, "\nIMG %i.\n", index + 1);
 
+    // skip the current file, it will be read right away
+    for(; prefetch && ahead && ahead_index <= index + IMPORT_PREFETCH_FILES; ahead = g_list_next(ahead), ahead_index++)
+      if(ahead_index > index) g_thread_pool_push(prefetch, ahead->data, NULL);
+
     _refresh_progress_counter(job, data->elements, index);
 
     if(_import_image(img, data, index, &data->discarded))
@@ -2404,6 +2944,9 @@ static int32_t _control_import_job_run(dt_job_t *job)
     fprintf(stdout, "BOTTOM LOOP.\n\n");
   }
 
+  // drop what wasn't read yet, the file names belong to the job
+  if(prefetch) g_thread_pool_free(prefetch, TRUE, TRUE);
+
   if(data->total_imported_elements == 0 && data->filmid == -1)
   {
     dt_control_log(_("No image imported!"));
@@ -56,6 +56,7 @@ void dt_control_write_sidecar_files();
 void dt_control_delete_images();
 void dt_control_delete_image(int32_t imgid);
 void dt_control_duplicate_images(gboolean virgin);
+void dt_control_compress_history_images();
 void dt_control_flip_images(const int32_t cw);
 void dt_control_monochrome_images(const int32_t mode);
 gboolean dt_control_remove_images();
@@ -63,11 +64,33 @@ void dt_control_move_images();
 void dt_control_copy_images();
 void dt_control_set_local_copy_images();
 void dt_control_reset_local_copy_images();
+/**
+ * @brief Another size and format exported along the main one, derived from the same pipe output.
+ */
+typedef struct dt_control_export_variant_t
+{
+  int max_width, max_height; // 0 = unbounded
+  int format_index;
+} dt_control_export_variant_t;
+
+/**
+ * @brief Parse a comma-separated list of variants, `<width>x<height>[:<format>]`,
+ * the format defaulting to default_format_index. Invalid entries are skipped with a warning.
+ *
+ * @return a list of dt_control_export_variant_t, to free with g_list_free_full(list, g_free)
+ */
+GList *dt_control_export_variants_from_string(const char *variants, const int default_format_index);
+
+/**
+ * @brief Export the images with the main size and format, and one more file per variant.
+ * The pipe runs once per image at the largest size, the variants are resampled from its output.
+ * Takes ownership of imgid_list and variants (a list of dt_control_export_variant_t, may be NULL).
+ */
 void dt_control_export(GList *imgid_list, int max_width, int max_height, int format_index, int storage_index,
                        gboolean high_quality, gboolean export_masks,
                        char *style,
                        dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
-                       dt_iop_color_intent_t icc_intent, const gchar *metadata_export);
+                       dt_iop_color_intent_t icc_intent, const gchar *metadata_export, GList *variants);
 void dt_control_merge_hdr();
 
 /**
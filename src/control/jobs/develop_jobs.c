@@ -17,7 +17,11 @@
 */
 
 #include "control/jobs/develop_jobs.h"
+#include "common/mipmap_cache.h"
+#include "common/opencl.h"
+#include "control/conf.h"
 #include "control/jobs/control_jobs.h"
+#include "develop/pixelpipe_hb.h"
 
 static int32_t dt_dev_process_preview_job_run(dt_job_t *job)
 {
@@ -49,6 +53,88 @@ dt_job_t *dt_dev_process_image_job_create(dt_develop_t *dev)
   return job;
 }
 
+typedef struct dt_dev_warmup_t
+{
+  int32_t imgid;
+  int width;  // expected size of the main view, in device pixels
+  int height;
+} dt_dev_warmup_t;
+
+// buffers pooled on the device of the main pipe for its first run: input, output and temporary images
+#define DT_DEV_WARMUP_BUFFERS 4
+// size of the throwaway render
+#define DT_DEV_WARMUP_SIZE 64
+
+static int32_t dt_dev_warmup_job_run(dt_job_t *job)
+{
+  const dt_dev_warmup_t *params = dt_control_job_get_params(job);
+
+  // another pipe running warms up the devices anyway
+  if(dt_pthread_mutex_trylock(&darktable.pipeline_threadsafe)) return 0;
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  dt_develop_t dev;
+  dt_dev_init(&dev, 0);
+  dt_dev_load_image(&dev, params->imgid);
+
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, params->imgid, DT_MIPMAP_F, DT_MIPMAP_BLOCKING, 'r');
+
+  dt_dev_pixelpipe_t pipe;
+  if(buf.buf && buf.width && buf.height && dt_dev_pixelpipe_init_dummy(&pipe, buf.width, buf.height))
+  {
+    // run on the device the main darkroom pipe will get, without leaving anything on disk
+    pipe.type = DT_DEV_PIXELPIPE_FULL;
+    pipe.warmup = TRUE;
+    dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
+    dt_dev_pixelpipe_create_nodes(&pipe, &dev);
+    dt_dev_pixelpipe_synch_all(&pipe, &dev);
+    dt_dev_pixelpipe_get_roi_out(&pipe, &dev, pipe.iwidth, pipe.iheight, &pipe.processed_width,
+                                 &pipe.processed_height);
+
+    const float scale = fminf(1.f, (float)DT_DEV_WARMUP_SIZE
+                                       / (float)MAX(MAX(pipe.processed_width, pipe.processed_height), 1));
+    const int width = MAX(pipe.processed_width * scale, 1);
+    const int height = MAX(pipe.processed_height * scale, 1);
+    dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, width, height, scale);
+    dt_dev_pixelpipe_cleanup(&pipe);
+  }
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  dt_dev_cleanup(&dev);
+  dt_pthread_mutex_unlock(&darktable.pipeline_threadsafe);
+
+  const int devid = dt_opencl_lock_device(DT_DEV_PIXELPIPE_FULL);
+  if(devid >= 0)
+  {
+    dt_opencl_prealloc_images(devid, params->width, params->height, 4 * sizeof(float), DT_DEV_WARMUP_BUFFERS);
+    dt_opencl_unlock_device(devid);
+  }
+
+  dt_show_times(&start, "[dev_warmup] pixel pipeline warm-up");
+  return 0;
+}
+
+dt_job_t *dt_dev_warmup_job_create(const int32_t imgid, const int width, const int height)
+{
+  if(!dt_opencl_is_enabled() || !dt_conf_get_bool("opencl_warmup")) return NULL;
+
+  dt_job_t *job = dt_control_job_create(&dt_dev_warmup_job_run, "develop warm-up");
+  if(!job) return NULL;
+  dt_dev_warmup_t *params = (dt_dev_warmup_t *)calloc(1, sizeof(dt_dev_warmup_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return NULL;
+  }
+  params->imgid = imgid;
+  params->width = width;
+  params->height = height;
+  dt_control_job_set_params_with_size(job, params, sizeof(dt_dev_warmup_t), free);
+  return job;
+}
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -29,6 +29,11 @@ dt_job_t *dt_dev_process_preview_job_create(dt_develop_t *dev);
 /** process image */
 dt_job_t *dt_dev_process_image_job_create(dt_develop_t *dev);
 
+/** run the module chain of the image once on a tiny ROI of its preview input, and pool device
+ *  buffers at the size of the main view, so the first render of the darkroom doesn't pay for the
+ *  kernel compilation by the driver and the first allocations. NULL if OpenCL is off. */
+dt_job_t *dt_dev_warmup_job_create(const int32_t imgid, const int width, const int height);
+
 dt_job_t *dt_dev_export_create();
 
 // clang-format off
@@ -19,25 +19,129 @@
 #include "control/jobs/image_jobs.h"
 #include "common/darktable.h"
 #include "common/image_cache.h"
+#include "common/imageio.h"
+#include "control/conf.h"
+#include "develop/format.h"
 
 typedef struct dt_image_load_t
 {
   int32_t imgid;
   dt_mipmap_size_t mip;
+  gboolean background;
 } dt_image_load_t;
 
-static int32_t dt_image_load_job_run(dt_job_t *job)
+/**
+ * Thumbnail regeneration scheduler.
+ *
+ * Visible thumbnails go to the DT_JOB_QUEUE_SYSTEM_FG stack, where the latest request is served first
+ * and duplicates are bumped instead of queued twice. Regenerations requested by batch edits wait in
+ * a FIFO of our own, whose jobs go to DT_JOB_QUEUE_SYSTEM_BG at most half of the workers at a time,
+ * so the visible ones always find a free worker. A background request for an image and mip already
+ * pending is dropped, a visible one takes it out of the FIFO.
+ **/
+
+typedef struct dt_image_load_pending_t
 {
-  dt_image_load_t *params = dt_control_job_get_params(job);
+  int jobs;         // jobs created and not disposed yet
+  gboolean waiting; // in the background FIFO, no job yet
+} dt_image_load_pending_t;
+
+static GMutex _load_lock;
+static GHashTable *_load_pending = NULL; // key -> dt_image_load_pending_t, protected by _load_lock
+static GQueue _load_fifo = G_QUEUE_INIT;  // keys waiting for a background job, protected by _load_lock
+static int _load_running = 0;             // background jobs dispatched, protected by _load_lock
+static dt_mipmap_size_t _load_visible_mip = DT_MIPMAP_NONE; // mip of the latest visible request
+
+static inline gpointer _load_key(const int32_t imgid, const dt_mipmap_size_t mip)
+{
+  return GUINT_TO_POINTER((((uint32_t)mip) << 28) | (uint32_t)imgid);
+}
+
+static dt_image_load_pending_t *_load_pending_get(const gpointer key)
+{
+  if(!_load_pending) _load_pending = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
+  dt_image_load_pending_t *pending = g_hash_table_lookup(_load_pending, key);
+  if(!pending)
+  {
+    pending = (dt_image_load_pending_t *)calloc(1, sizeof(dt_image_load_pending_t));
+    g_hash_table_insert(_load_pending, key, pending);
+  }
+  return pending;
+}
+
+static void _load_pending_drop(const gpointer key, dt_image_load_pending_t *pending)
+{
+  if(pending->jobs <= 0 && !pending->waiting) g_hash_table_remove(_load_pending, key);
+}
+
+static dt_job_t *_image_load_job_create(int32_t id, dt_mipmap_size_t mip, gboolean background);
 
+// move background requests from the FIFO to the job queue, within the parallelism budget
+static void _load_dispatch()
+{
+  const int max_running = MAX(darktable.control->num_threads / 2, 1);
+  GList *jobs = NULL;
+
+  g_mutex_lock(&_load_lock);
+  while(_load_running < max_running && !g_queue_is_empty(&_load_fifo))
+  {
+    const gpointer key = g_queue_pop_head(&_load_fifo);
+    dt_image_load_pending_t *pending = _load_pending_get(key);
+    pending->waiting = FALSE;
+    const uint32_t k = GPOINTER_TO_UINT(key);
+    dt_job_t *job = _image_load_job_create(k & 0xfffffff, k >> 28, TRUE);
+    if(!job)
+    {
+      _load_pending_drop(key, pending);
+      continue;
+    }
+    pending->jobs++;
+    _load_running++;
+    jobs = g_list_prepend(jobs, job);
+  }
+  g_mutex_unlock(&_load_lock);
+
+  // the control may run them synchronously, and their callbacks take the lock
+  for(GList *l = g_list_last(jobs); l; l = g_list_previous(l))
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, (dt_job_t *)l->data);
+  g_list_free(jobs);
+}
+
+static void _image_load_job_state(dt_job_t *job, dt_job_state_t state)
+{
+  // run, discarded or deduped by the control: each job gets disposed once
+  if(state != DT_JOB_STATE_DISPOSED) return;
+  const dt_image_load_t *params = dt_control_job_get_params(job);
+  if(!params) return;
+
+  const gpointer key = _load_key(params->imgid, params->mip);
+  g_mutex_lock(&_load_lock);
+  dt_image_load_pending_t *pending = _load_pending_get(key);
+  pending->jobs--;
+  _load_pending_drop(key, pending);
+  if(params->background) _load_running--;
+  g_mutex_unlock(&_load_lock);
+
+  if(params->background) _load_dispatch();
+}
+
+static void _image_load_generate(const int32_t imgid, const dt_mipmap_size_t mip)
+{
   // hook back into mipmap_cache:
   dt_mipmap_buffer_t buf;
-  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, params->imgid, params->mip, DT_MIPMAP_BLOCKING, 'r');
+
+  // a duplicate was served in the meantime, by another queue or another request
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, mip, DT_MIPMAP_TESTLOCK, 'r');
+  const gboolean cached = buf.buf && buf.width > 0 && buf.height > 0;
+  if(buf.cache_entry) dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  if(cached) return;
+
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, mip, DT_MIPMAP_BLOCKING, 'r');
 
   if (buf.buf && buf.height && buf.width)
   {
     const double aspect_ratio = (double)buf.width / (double)buf.height;
-    dt_image_set_aspect_ratio_if_different(params->imgid, aspect_ratio, FALSE);
+    dt_image_set_aspect_ratio_if_different(imgid, aspect_ratio, FALSE);
   }
 
   // drop read lock, as this is only speculative async loading.
@@ -45,11 +149,17 @@ static int32_t dt_image_load_job_run(dt_job_t *job)
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
   // Signal we need to reload the mipmap in thumbtable
-  DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, params->imgid);
+  DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, imgid);
+}
+
+static int32_t dt_image_load_job_run(dt_job_t *job)
+{
+  dt_image_load_t *params = dt_control_job_get_params(job);
+  _image_load_generate(params->imgid, params->mip);
   return 0;
 }
 
-dt_job_t *dt_image_load_job_create(int32_t id, dt_mipmap_size_t mip)
+static dt_job_t *_image_load_job_create(int32_t id, dt_mipmap_size_t mip, gboolean background)
 {
   dt_job_t *job = dt_control_job_create(&dt_image_load_job_run, "load image %d mip %d", id, mip);
   if(!job) return NULL;
@@ -60,11 +170,275 @@ dt_job_t *dt_image_load_job_create(int32_t id, dt_mipmap_size_t mip)
     return NULL;
   }
   dt_control_job_set_params_with_size(job, params, sizeof(dt_image_load_t), free);
+  dt_control_job_set_state_callback(job, _image_load_job_state);
   params->imgid = id;
   params->mip = mip;
+  params->background = background;
+  return job;
+}
+
+dt_job_t *dt_image_load_job_create(int32_t id, dt_mipmap_size_t mip)
+{
+  dt_job_t *job = _image_load_job_create(id, mip, FALSE);
+  if(!job) return NULL;
+
+  g_mutex_lock(&_load_lock);
+  _load_pending_get(_load_key(id, mip))->jobs++;
+  g_mutex_unlock(&_load_lock);
   return job;
 }
 
+void dt_image_load_request(int32_t imgid, dt_mipmap_size_t mip)
+{
+  if(imgid <= 0 || mip >= DT_MIPMAP_F) return;
+  const gpointer key = _load_key(imgid, mip);
+
+  g_mutex_lock(&_load_lock);
+  _load_visible_mip = mip;
+  dt_image_load_pending_t *pending = _load_pending_get(key);
+  if(pending->waiting)
+  {
+    // promoted out of the background FIFO
+    g_queue_remove(&_load_fifo, key);
+    pending->waiting = FALSE;
+  }
+  g_mutex_unlock(&_load_lock);
+
+  // always pushed: the stack moves a duplicate on top instead of adding it
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
+
+  g_mutex_lock(&_load_lock);
+  _load_pending_drop(key, _load_pending_get(key));
+  g_mutex_unlock(&_load_lock);
+}
+
+/**
+ * The misses of the thumbnails displayed at once share a single batch, pulled by a few jobs of the
+ * DT_JOB_QUEUE_SYSTEM_FG stack in the order of the table. A newer batch supersedes it: the images
+ * not started yet are dropped, those still visible are in the new one.
+ **/
+
+typedef struct dt_image_load_batch_t
+{
+  dt_atomic_int refs; // jobs sharing the batch
+  dt_atomic_int next; // index of the next image to generate
+  int generation;
+  dt_mipmap_size_t mip;
+  int count;
+  int32_t imgids[];
+} dt_image_load_batch_t;
+
+static dt_atomic_int _load_batch_generation;
+
+static void _load_batch_unref(void *data)
+{
+  dt_image_load_batch_t *batch = (dt_image_load_batch_t *)data;
+  if(dt_atomic_sub_int(&batch->refs, 1) == 1) free(batch);
+}
+
+static int32_t _image_load_batch_job_run(dt_job_t *job)
+{
+  dt_image_load_batch_t *batch = dt_control_job_get_params(job);
+  for(int k = dt_atomic_add_int(&batch->next, 1); k < batch->count; k = dt_atomic_add_int(&batch->next, 1))
+  {
+    if(batch->generation != dt_atomic_get_int(&_load_batch_generation)) break;
+    _image_load_generate(batch->imgids[k], batch->mip);
+  }
+  return 0;
+}
+
+void dt_image_load_batch_request(const int32_t *imgids, const int count, dt_mipmap_size_t mip)
+{
+  if(count <= 0 || mip >= DT_MIPMAP_F) return;
+
+  dt_image_load_batch_t *batch
+      = (dt_image_load_batch_t *)malloc(sizeof(dt_image_load_batch_t) + sizeof(int32_t) * count);
+  if(!batch) return;
+  batch->generation = dt_atomic_add_int(&_load_batch_generation, 1) + 1;
+  batch->mip = mip;
+  batch->count = 0;
+  dt_atomic_set_int(&batch->next, 0);
+
+  g_mutex_lock(&_load_lock);
+  _load_visible_mip = mip;
+  for(int k = 0; k < count; k++)
+  {
+    if(imgids[k] <= 0) continue;
+    batch->imgids[batch->count++] = imgids[k];
+
+    // promoted out of the background FIFO
+    const gpointer key = _load_key(imgids[k], mip);
+    dt_image_load_pending_t *pending = _load_pending ? g_hash_table_lookup(_load_pending, key) : NULL;
+    if(pending && pending->waiting)
+    {
+      g_queue_remove(&_load_fifo, key);
+      pending->waiting = FALSE;
+      _load_pending_drop(key, pending);
+    }
+  }
+  g_mutex_unlock(&_load_lock);
+
+  const int jobs = MIN(batch->count, MAX(darktable.control->num_threads, 1));
+  if(jobs <= 0)
+  {
+    free(batch);
+    return;
+  }
+  dt_atomic_set_int(&batch->refs, jobs);
+  for(int j = 0; j < jobs; j++)
+  {
+    dt_job_t *job = dt_control_job_create(&_image_load_batch_job_run, "load %d images mip %d", batch->count, mip);
+    if(!job)
+    {
+      _load_batch_unref(batch);
+      continue;
+    }
+    dt_control_job_set_params(job, batch, _load_batch_unref);
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+  }
+}
+
+void dt_image_load_regenerate(int32_t imgid)
+{
+  if(imgid <= 0) return;
+
+  g_mutex_lock(&_load_lock);
+  const dt_mipmap_size_t mip = _load_visible_mip;
+  if(mip >= DT_MIPMAP_F)
+  {
+    // nothing displayed thumbnails so far, they will be generated when they are
+    g_mutex_unlock(&_load_lock);
+    return;
+  }
+  const gpointer key = _load_key(imgid, mip);
+  dt_image_load_pending_t *pending = _load_pending_get(key);
+  if(pending->jobs > 0 || pending->waiting)
+  {
+    // coalesced with the pending one
+    g_mutex_unlock(&_load_lock);
+    return;
+  }
+  pending->waiting = TRUE;
+  g_queue_push_tail(&_load_fifo, key);
+  g_mutex_unlock(&_load_lock);
+
+  _load_dispatch();
+}
+
+static int32_t _image_readahead_job_run(dt_job_t *job)
+{
+  const int32_t *imgid = dt_control_job_get_params(job);
+  char pathname[PATH_MAX] = { 0 };
+  gboolean from_cache = FALSE;
+  dt_image_full_path(*imgid, pathname, sizeof(pathname), &from_cache, __FUNCTION__);
+  if(pathname[0]) dt_imageio_readahead(pathname);
+  return 0;
+}
+
+void dt_image_readahead_request(int32_t imgid)
+{
+  if(imgid <= 0) return;
+  dt_job_t *job = dt_control_job_create(&_image_readahead_job_run, "readahead image %d", imgid);
+  if(!job) return;
+  int32_t *params = (int32_t *)malloc(sizeof(int32_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return;
+  }
+  *params = imgid;
+  dt_control_job_set_params_with_size(job, params, sizeof(int32_t), free);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
+/**
+ * Darkroom neighbours prefetch.
+ *
+ * While an image is edited, the raws of the images around it in the collection are decoded into the
+ * DT_MIPMAP_FULL and DT_MIPMAP_F caches, so opening them next doesn't wait on the disk and the decoder.
+ * Requests belong to a generation: dt_image_prefetch_cancel() starts a new one and the jobs of the
+ * previous ones are dropped before they decode anything. A decode already running is not interrupted.
+ **/
+
+static gint _prefetch_generation = 0;
+
+typedef struct dt_image_prefetch_t
+{
+  int32_t imgid;
+  gint generation;
+} dt_image_prefetch_t;
+
+static int32_t _image_prefetch_job_run(dt_job_t *job)
+{
+  const dt_image_prefetch_t *params = dt_control_job_get_params(job);
+  const dt_mipmap_size_t mips[2] = { DT_MIPMAP_FULL, DT_MIPMAP_F };
+
+  for(int k = 0; k < 2; k++)
+  {
+    if(params->generation != g_atomic_int_get(&_prefetch_generation)) return 0;
+
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, params->imgid, mips[k], DT_MIPMAP_BLOCKING, 'r');
+    const gboolean valid = buf.buf != NULL;
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    if(valid && mips[k] == DT_MIPMAP_FULL) dt_mipmap_cache_keep_full(darktable.mipmap_cache, params->imgid);
+  }
+  return 0;
+}
+
+// estimated size of the full resolution input of an image, 0 if unknown yet
+static size_t _image_full_size(const int32_t imgid)
+{
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  if(!img) return 0;
+  // the buffer description is only known once the image was decoded, assume a raw otherwise
+  const size_t bpp = MAX(dt_iop_buffer_dsc_to_bpp(&img->buf_dsc), sizeof(uint16_t));
+  const size_t size = (size_t)img->width * img->height * bpp;
+  dt_image_cache_read_release(darktable.image_cache, img);
+  return size;
+}
+
+void dt_image_prefetch_request(const int32_t *imgids, const int count)
+{
+  const gint generation = g_atomic_int_get(&_prefetch_generation);
+  const gboolean decode = dt_conf_get_bool("darkroom/ui/prefetch_neighbours");
+  const size_t budget = (size_t)MAX(dt_conf_get_int("darkroom/ui/prefetch_memory"), 0) << 20;
+  size_t used = 0;
+
+  for(int k = 0; k < count; k++)
+  {
+    const int32_t imgid = imgids[k];
+    if(imgid <= 0) continue;
+
+    // over the memory budget, the file is only read ahead
+    const size_t size = decode ? _image_full_size(imgid) : 0;
+    if(size == 0 || used + size > budget)
+    {
+      dt_image_readahead_request(imgid);
+      continue;
+    }
+
+    dt_job_t *job = dt_control_job_create(&_image_prefetch_job_run, "prefetch image %d", imgid);
+    if(!job) continue;
+    dt_image_prefetch_t *params = (dt_image_prefetch_t *)calloc(1, sizeof(dt_image_prefetch_t));
+    if(!params)
+    {
+      dt_control_job_dispose(job);
+      continue;
+    }
+    params->imgid = imgid;
+    params->generation = generation;
+    dt_control_job_set_params_with_size(job, params, sizeof(dt_image_prefetch_t), free);
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+    used += size;
+  }
+}
+
+void dt_image_prefetch_cancel()
+{
+  g_atomic_int_inc(&_prefetch_generation);
+}
+
 typedef struct dt_image_import_t
 {
   uint32_t film_id;
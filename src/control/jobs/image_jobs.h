@@ -25,6 +25,23 @@
 
 dt_job_t *dt_image_load_job_create(int32_t imgid, dt_mipmap_size_t mip);
 
+/** generate the mip of a displayed image as soon as possible, coalesced with the pending requests */
+void dt_image_load_request(int32_t imgid, dt_mipmap_size_t mip);
+/** generate the mips of the images displayed at once, in that order, as a single batch that supersedes the
+ * previous one */
+void dt_image_load_batch_request(const int32_t *imgids, const int count, dt_mipmap_size_t mip);
+/** regenerate the thumbnail of an image after its history changed, in the background with bounded
+ * parallelism. Only the mip of the thumbnails displayed lately is generated, the others when requested. */
+void dt_image_load_regenerate(int32_t imgid);
+
+/** start reading the file of an image from the disk in the background, to open it faster later */
+void dt_image_readahead_request(int32_t imgid);
+/** decode the raws of images likely to be opened next into the mipmap cache, in the background, within the
+ * memory budget set in preferences. Images over the budget are only read ahead. */
+void dt_image_prefetch_request(const int32_t *imgids, const int count);
+/** drop the prefetch requests not started yet */
+void dt_image_prefetch_cancel(void);
+
 dt_job_t *dt_image_import_job_create(uint32_t filmid, const char *filename);
 
 // clang-format off
@@ -34,6 +34,16 @@ typedef struct dt_control_signal_t
                                                          GSignalFlags signal_flags,
                                                          ...);
    */
+/* how raises of an asynchronous signal are merged while one is already waiting to be emitted.
+   The coalesced signals are always emitted from an idle callback, even when raised from the gui thread,
+   so the raises of one frame end up in a single emission. */
+typedef enum dt_signal_coalesce_t
+{
+  DT_SIGNAL_COALESCE_NONE = 0, // every raise is emitted
+  DT_SIGNAL_COALESCE_DROP,     // no parameter: later raises are dropped
+  DT_SIGNAL_COALESCE_IMGS,     // a GList of imgids: later lists are merged into the waiting one
+} dt_signal_coalesce_t;
+
 typedef struct dt_signal_description
 {
   const char *name;
@@ -45,6 +55,7 @@ typedef struct dt_signal_description
   GType *param_types;
   GCallback destructor;
   gboolean synchronous;
+  dt_signal_coalesce_t coalesce;
 } dt_signal_description;
 
 
@@ -99,14 +110,14 @@ static void _image_geotag_destroy_callback(gpointer instance, gpointer imgs, con
 static dt_signal_description _signal_description[DT_SIGNAL_COUNT] = {
   /* Global signals */
   { "dt-global-mouse-over-image-change", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
-    FALSE }, // DT_SIGNAL_MOUSE_OVER_IMAGE_CHANGE
+    FALSE, DT_SIGNAL_COALESCE_DROP }, // DT_SIGNAL_MOUSE_OVER_IMAGE_CHANGE
   { "dt-global-active-images-change", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
-    FALSE }, // DT_SIGNAL_ACTIVE_IMAGES_CHANGE
+    FALSE, DT_SIGNAL_COALESCE_DROP }, // DT_SIGNAL_ACTIVE_IMAGES_CHANGE
 
   { "dt-control-redraw-all", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
-    FALSE }, // DT_SIGNAL_CONTROL_REDRAW_ALL
+    FALSE, DT_SIGNAL_COALESCE_DROP }, // DT_SIGNAL_CONTROL_REDRAW_ALL
   { "dt-control-redraw-center", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
-    FALSE }, // DT_SIGNAL_CONTROL_REDRAW_CENTER
+    FALSE, DT_SIGNAL_COALESCE_DROP }, // DT_SIGNAL_CONTROL_REDRAW_CENTER
 
   { "dt-viewmanager-view-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_generic, 2, pointer_2arg, NULL,
     FALSE }, // DT_SIGNAL_VIEWMANAGER_VIEW_CHANGED
@@ -118,21 +129,21 @@ static dt_signal_description _signal_description[DT_SIGNAL_COUNT] = {
   { "dt-collection-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_generic, 4, collection_args,
     G_CALLBACK(_collection_changed_destroy_callback), FALSE }, // DT_SIGNAL_COLLECTION_CHANGED
   { "dt-selection-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
-    FALSE }, // DT_SIGNAL_SELECTION_CHANGED
+    FALSE, DT_SIGNAL_COALESCE_DROP }, // DT_SIGNAL_SELECTION_CHANGED
   { "dt-tag-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
-    FALSE }, // DT_SIGNAL_TAG_CHANGED
+    FALSE, DT_SIGNAL_COALESCE_DROP }, // DT_SIGNAL_TAG_CHANGED
   { "dt-geotag-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_generic, 2, geotag_arg,
     G_CALLBACK(_image_geotag_destroy_callback), FALSE }, // DT_SIGNAL_GEOTAG_CHANGED
   { "dt-metadata-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__UINT, 1, uint_arg, NULL,
     FALSE }, // DT_SIGNAL_METADATA_CHANGED
   { "dt-image-info-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_generic, 1, pointer_arg,
-    G_CALLBACK(_image_info_changed_destroy_callback), FALSE }, // DT_SIGNAL_IMAGE_INFO_CHANGED
+    G_CALLBACK(_image_info_changed_destroy_callback), FALSE, DT_SIGNAL_COALESCE_IMGS }, // DT_SIGNAL_IMAGE_INFO_CHANGED
   { "dt-style-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
-    FALSE }, // DT_SIGNAL_STYLE_CHANGED
+    FALSE, DT_SIGNAL_COALESCE_DROP }, // DT_SIGNAL_STYLE_CHANGED
   { "dt-images-order-change", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_generic, 1, pointer_arg, NULL,
     FALSE }, // DT_SIGNAL_IMAGES_ORDER_CHANGE
   { "dt-filmrolls-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
-    FALSE }, // DT_SIGNAL_FILMROLLS_CHANGED
+    FALSE, DT_SIGNAL_COALESCE_DROP }, // DT_SIGNAL_FILMROLLS_CHANGED
   { "dt-filmrolls-imported", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__UINT, 1, uint_arg, NULL,
     FALSE }, // DT_SIGNAL_FILMROLLS_IMPORTED
   { "dt-filmrolls-removed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
@@ -176,19 +187,19 @@ static dt_signal_description _signal_description[DT_SIGNAL_COUNT] = {
 
 
   { "dt-control-navigation-redraw", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
-    FALSE }, // DT_SIGNAL_CONTROL_NAVIGATION_REDRAW
+    FALSE, DT_SIGNAL_COALESCE_DROP }, // DT_SIGNAL_CONTROL_NAVIGATION_REDRAW
 
   { "dt-control-log-redraw", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
-    FALSE }, // DT_SIGNAL_CONTROL_LOG_REDRAW
+    FALSE, DT_SIGNAL_COALESCE_DROP }, // DT_SIGNAL_CONTROL_LOG_REDRAW
 
   { "dt-control-toast-redraw", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
-    FALSE }, // DT_SIGNAL_CONTROL_TOAST_REDRAW
+    FALSE, DT_SIGNAL_COALESCE_DROP }, // DT_SIGNAL_CONTROL_TOAST_REDRAW
 
   { "dt-control-pickerdata-ready", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_generic, 2, pointer_2arg, NULL,
     FALSE }, // DT_SIGNAL_CONTROL_PICKERDATA_REAEDY
 
   { "dt-metadata-update", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0, NULL, NULL,
-    FALSE }, // DT_SIGNAL_METADATA_UPDATE
+    FALSE, DT_SIGNAL_COALESCE_DROP }, // DT_SIGNAL_METADATA_UPDATE
 
   { "dt-location-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_generic, 1, pointer_arg, NULL,
     TRUE }, // DT_SIGNAL_LOCATION_CHANGED
@@ -240,18 +251,106 @@ typedef struct _signal_param_t
   GValue *instance_and_params;
   guint signal_id;
   guint n_params;
+  dt_signal_t signal;
+  GHashTable *imgs; // imgids already in the list of a coalesced signal
 } _signal_param_t;
 
+// the coalesced signals waiting for their idle callback, by signal
+static _signal_param_t *_pending[DT_SIGNAL_COUNT] = { NULL };
+static GMutex _pending_lock;
+
+// emission statistics, see --d-signal-act profile
+typedef struct _signal_profile_t
+{
+  guint emitted;
+  guint coalesced;
+  double total;
+  double max;
+} _signal_profile_t;
+
+static _signal_profile_t _profile[DT_SIGNAL_COUNT];
+
 static gboolean _signal_raise(gpointer user_data)
 {
   _signal_param_t *params = (_signal_param_t *)user_data;
+  const gboolean profile = darktable.unmuted_signal_dbg_acts & DT_DEBUG_SIGNAL_ACT_PROFILE;
+  const double start = profile ? dt_get_wtime() : 0.0;
+
   g_signal_emitv(params->instance_and_params, params->signal_id, 0, NULL);
+
+  if(profile)
+  {
+    // the handlers all run in the gui thread
+    const double elapsed = dt_get_wtime() - start;
+    _signal_profile_t *p = &_profile[params->signal];
+    p->emitted++;
+    p->total += elapsed;
+    p->max = MAX(p->max, elapsed);
+    dt_print(DT_DEBUG_SIGNAL, "[signal] profile: %s handled in %.3f ms, %u emissions (%u raises coalesced), "
+                              "%.3f ms in total, %.3f ms at most\n",
+             _signal_description[params->signal].name, elapsed * 1000.0, p->emitted, p->coalesced,
+             p->total * 1000.0, p->max * 1000.0);
+  }
+
   for(int i = 0; i <= params->n_params; i++) g_value_unset(&params->instance_and_params[i]);
   free(params->instance_and_params);
   free(params);
   return FALSE;
 }
 
+static gboolean _signal_raise_coalesced(gpointer user_data)
+{
+  _signal_param_t *params = (_signal_param_t *)user_data;
+
+  // later raises start a new emission
+  g_mutex_lock(&_pending_lock);
+  _pending[params->signal] = NULL;
+  g_mutex_unlock(&_pending_lock);
+
+  if(params->imgs) g_hash_table_destroy(params->imgs);
+  params->imgs = NULL;
+  return _signal_raise(params);
+}
+
+// merge the raise into the emission waiting for the same signal, if any.
+// Returns FALSE if there is none, then params is the new waiting emission.
+static gboolean _signal_coalesce(_signal_param_t *params, const dt_signal_coalesce_t coalesce)
+{
+  g_mutex_lock(&_pending_lock);
+  _signal_param_t *pending = _pending[params->signal];
+
+  if(!pending)
+  {
+    if(coalesce == DT_SIGNAL_COALESCE_IMGS)
+    {
+      params->imgs = g_hash_table_new(NULL, NULL);
+      for(GList *l = g_value_get_pointer(&params->instance_and_params[1]); l; l = g_list_next(l))
+        g_hash_table_add(params->imgs, l->data);
+    }
+    _pending[params->signal] = params;
+    g_mutex_unlock(&_pending_lock);
+    return FALSE;
+  }
+
+  if(coalesce == DT_SIGNAL_COALESCE_IMGS)
+  {
+    GList *imgs = g_value_get_pointer(&pending->instance_and_params[1]);
+    GList *new_imgs = g_value_get_pointer(&params->instance_and_params[1]);
+    for(GList *l = new_imgs; l; l = g_list_next(l))
+      if(g_hash_table_add(pending->imgs, l->data)) imgs = g_list_prepend(imgs, l->data);
+    g_value_set_pointer(&pending->instance_and_params[1], imgs);
+    // the list is ours now that it won't be emitted
+    g_list_free(new_imgs);
+  }
+  _profile[params->signal].coalesced++;
+  g_mutex_unlock(&_pending_lock);
+
+  for(int i = 0; i <= params->n_params; i++) g_value_unset(&params->instance_and_params[i]);
+  free(params->instance_and_params);
+  free(params);
+  return TRUE;
+}
+
 typedef struct async_com_data
 {
   GCond end_cond;
@@ -353,8 +452,16 @@ void dt_control_signal_raise(const dt_control_signal_t *ctlsig, dt_signal_t sign
   params->instance_and_params = instance_and_params;
   params->signal_id = g_signal_lookup(_signal_description[signal].name, _signal_type);
   params->n_params = signal_description->n_params;
+  params->signal = signal;
+  params->imgs = NULL;
 
-  if(!signal_description->synchronous)
+  if(signal_description->coalesce != DT_SIGNAL_COALESCE_NONE)
+  {
+    // before the redraws of the frame, see gtk_widget_queue_draw()
+    if(!_signal_coalesce(params, signal_description->coalesce))
+      g_idle_add_full(G_PRIORITY_HIGH_IDLE, _signal_raise_coalesced, params, NULL);
+  }
+  else if(!signal_description->synchronous)
   {
     g_main_context_invoke(NULL, _signal_raise, params);
   }
@@ -665,12 +665,17 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
              piece->module->multi_name, piece->pipe->type);
 
     // Copy to global pipeline cache
-    if(!dt_dev_pixelpipe_cache_available(&(piece->pipe->cache), piece->global_mask_hash))
+    if(!dt_dev_pixelpipe_cache_available(piece->pipe->cache, piece->global_mask_hash))
     {
       dt_iop_buffer_dsc_t *out_format = &piece->dsc_mask;
-      float *cache_mask;
-      dt_dev_pixelpipe_cache_get(&(piece->pipe->cache), piece->global_mask_hash, buffsize * sizeof(float), (void **)&cache_mask, &out_format);
-      memcpy(cache_mask, _mask, buffsize * sizeof(float));
+      float *cache_mask = NULL;
+      if(dt_dev_pixelpipe_cache_get(piece->pipe->cache, &piece->pipe->cache_client, piece->global_mask_hash,
+                                    buffsize * sizeof(float), (void **)&cache_mask, &out_format)
+         && cache_mask)
+      {
+        memcpy(cache_mask, _mask, buffsize * sizeof(float));
+        dt_dev_pixelpipe_cache_ready(piece->pipe->cache, cache_mask);
+      }
     }
   }
   else
@@ -683,8 +688,18 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
 }
 
 #ifdef HAVE_OPENCL
-static void _refine_with_detail_mask_cl(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, float *mask, const struct dt_iop_roi_t *roi_in,
-                                const struct dt_iop_roi_t *roi_out, const float level, const int devid)
+static inline void _blend_process_cl_exchange(cl_mem *a, cl_mem *b)
+{
+  cl_mem tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+// multiplies the mask in dev_mask by the detail mask, dev_scratch is a mask-sized image the result may be
+// exchanged with. Only the detail mask goes through the host, to be distorted.
+static void _refine_with_detail_mask_cl(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                        cl_mem *dev_mask, cl_mem *dev_scratch, const struct dt_iop_roi_t *roi_in,
+                                        const struct dt_iop_roi_t *roi_out, const float level, const int devid)
 {
   if(level == 0.0f) return;
   const gboolean info = ((darktable.unmuted & DT_DEBUG_MASKS) && (piece->pipe->type == DT_DEV_PIXELPIPE_FULL));
@@ -795,17 +810,31 @@ static void _refine_with_detail_mask_cl(struct dt_iop_module_t *self, struct dt_
   dt_free_align(lum);
   lum = NULL;
 
-  const int msize = owidth * oheight;
-#ifdef _OPENMP
-  #pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(mask, warp_mask, msize) \
-  schedule(simd:static) aligned(mask, warp_mask : 64)
- #endif
-  for(int idx = 0; idx < msize; idx++)
+  tmp = dt_opencl_alloc_device(devid, owidth, oheight, sizeof(float));
+  if(tmp == NULL)
   {
-    mask[idx] = mask[idx] * warp_mask[idx];
+    dt_free_align(warp_mask);
+    goto error;
   }
-  dt_free_align(warp_mask);
+  {
+    const int err = dt_opencl_write_host_to_device(devid, warp_mask, tmp, owidth, oheight, sizeof(float));
+    dt_free_align(warp_mask);
+    if(err != CL_SUCCESS) goto error;
+  }
+
+  {
+    size_t sizes[3] = { ROUNDUPDWD(owidth, devid), ROUNDUPDHT(oheight, devid), 1 };
+    const int kernel = darktable.opencl->blendop->kernel_blendop_mask_multiply;
+    dt_opencl_set_kernel_arg(devid, kernel, 0, sizeof(cl_mem), dev_mask);
+    dt_opencl_set_kernel_arg(devid, kernel, 1, sizeof(cl_mem), &tmp);
+    dt_opencl_set_kernel_arg(devid, kernel, 2, sizeof(cl_mem), dev_scratch);
+    dt_opencl_set_kernel_arg(devid, kernel, 3, sizeof(int), &owidth);
+    dt_opencl_set_kernel_arg(devid, kernel, 4, sizeof(int), &oheight);
+    const int err = dt_opencl_enqueue_kernel_2d(devid, kernel, sizes);
+    if(err != CL_SUCCESS) goto error;
+  }
+  dt_opencl_release_mem_object(tmp);
+  _blend_process_cl_exchange(dev_mask, dev_scratch);
   return;
 
   error:
@@ -816,13 +845,6 @@ static void _refine_with_detail_mask_cl(struct dt_iop_module_t *self, struct dt_
   dt_opencl_release_mem_object(out);
 }
 
-static inline void _blend_process_cl_exchange(cl_mem *a, cl_mem *b)
-{
-  cl_mem tmp = *a;
-  *a = *b;
-  *b = tmp;
-}
-
 int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                 cl_mem dev_in, cl_mem dev_out, const struct dt_iop_roi_t *roi_in,
                                 const struct dt_iop_roi_t *roi_out)
@@ -1020,7 +1042,11 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
   {
     // we blend with a drawn and/or parametric mask
 
-    // get the drawn mask if there is one
+    dev_mask_2 = dt_opencl_alloc_device(devid, owidth, oheight, sizeof(float));
+    if(dev_mask_2 == NULL) goto error;
+
+    // get the drawn mask if there is one: only the rasterized shapes are computed on the host and uploaded,
+    // the rest of the mask pipeline stays on the device
     dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, d->mask_id);
 
     if(form && (!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
@@ -1032,27 +1058,26 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
         // if we have a mask and this flag is set -> invert the mask
         dt_iop_image_invert(mask, 1.0f, owidth, oheight, 1); //mask[k] = 1.0f - mask[k]
       }
-    }
-    else if((!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
-    {
-      // no form defined but drawn mask active
-      // we fill the buffer with 1.0f or 0.0f depending on mask_combine
-      const float fill = (d->mask_combine & DEVELOP_COMBINE_MASKS_POS) ? 0.0f : 1.0f;
-      dt_iop_image_fill(mask, fill, owidth, oheight, 1); //mask[k] = fill;
+
+      // write mask from host to device
+      err = dt_opencl_write_host_to_device(devid, mask, dev_mask_1, owidth, oheight, sizeof(float));
+      if(err != CL_SUCCESS) goto error;
     }
     else
     {
-      // we fill the buffer with 1.0f or 0.0f depending on mask_combine
-      const float fill = (d->mask_combine & DEVELOP_COMBINE_INCL) ? 0.0f : 1.0f;
-      dt_iop_image_fill(mask, fill, owidth, oheight, 1); //mask[k] = fill;
+      // no form defined but drawn mask active, or no drawn mask:
+      // we fill the mask with 1.0f or 0.0f depending on mask_combine
+      const float fill = ((!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
+                             ? ((d->mask_combine & DEVELOP_COMBINE_MASKS_POS) ? 0.0f : 1.0f)
+                             : ((d->mask_combine & DEVELOP_COMBINE_INCL) ? 0.0f : 1.0f);
+      dt_opencl_set_kernel_arg(devid, kernel_set_mask, 0, sizeof(cl_mem), (void *)&dev_mask_1);
+      dt_opencl_set_kernel_arg(devid, kernel_set_mask, 1, sizeof(int), (void *)&owidth);
+      dt_opencl_set_kernel_arg(devid, kernel_set_mask, 2, sizeof(int), (void *)&oheight);
+      dt_opencl_set_kernel_arg(devid, kernel_set_mask, 3, sizeof(float), (void *)&fill);
+      err = dt_opencl_enqueue_kernel_2d(devid, kernel_set_mask, sizes);
+      if(err != CL_SUCCESS) goto error;
     }
-    _refine_with_detail_mask_cl(self, piece, mask, roi_in, roi_out, d->details, devid);
-
-    // write mask from host to device
-    dev_mask_2 = dt_opencl_alloc_device(devid, owidth, oheight, sizeof(float));
-    if(dev_mask_2 == NULL) goto error;
-    err = dt_opencl_write_host_to_device(devid, mask, dev_mask_1, owidth, oheight, sizeof(float));
-    if(err != CL_SUCCESS) goto error;
+    _refine_with_detail_mask_cl(self, piece, &dev_mask_1, &dev_mask_2, roi_in, roi_out, d->details, devid);
 
     // The following call to clFinish() works around a bug in some OpenCL
     // drivers (namely AMD).
@@ -1254,12 +1279,17 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
     g_hash_table_replace(piece->raster_masks, GINT_TO_POINTER(0), _mask);
 
     // Copy to global pipeline cache
-    if(!dt_dev_pixelpipe_cache_available(&(piece->pipe->cache), piece->global_mask_hash))
+    if(!dt_dev_pixelpipe_cache_available(piece->pipe->cache, piece->global_mask_hash))
     {
       dt_iop_buffer_dsc_t *out_format = &piece->dsc_mask;
-      float *cache_mask;
-      dt_dev_pixelpipe_cache_get(&(piece->pipe->cache), piece->global_mask_hash, buffsize * sizeof(float), (void **)&cache_mask, &out_format);
-      memcpy(cache_mask, _mask, buffsize * sizeof(float));
+      float *cache_mask = NULL;
+      if(dt_dev_pixelpipe_cache_get(piece->pipe->cache, &piece->pipe->cache_client, piece->global_mask_hash,
+                                    buffsize * sizeof(float), (void **)&cache_mask, &out_format)
+         && cache_mask)
+      {
+        memcpy(cache_mask, _mask, buffsize * sizeof(float));
+        dt_dev_pixelpipe_cache_ready(piece->pipe->cache, cache_mask);
+      }
     }
   }
   else
@@ -1312,6 +1342,7 @@ dt_blendop_cl_global_t *dt_develop_blend_init_cl_global(void)
   b->kernel_blendop_rgb_jzczhz = dt_opencl_create_kernel(program, "blendop_rgb_jzczhz");
   b->kernel_blendop_mask_tone_curve = dt_opencl_create_kernel(program, "blendop_mask_tone_curve");
   b->kernel_blendop_set_mask = dt_opencl_create_kernel(program, "blendop_set_mask");
+  b->kernel_blendop_mask_multiply = dt_opencl_create_kernel(program, "blendop_mask_multiply");
   b->kernel_blendop_display_channel = dt_opencl_create_kernel(program, "blendop_display_channel");
 
   const int program_rcd = 31;
@@ -1345,6 +1376,7 @@ void dt_develop_blend_free_cl_global(dt_blendop_cl_global_t *b)
   dt_opencl_free_kernel(b->kernel_blendop_rgb_jzczhz);
   dt_opencl_free_kernel(b->kernel_blendop_mask_tone_curve);
   dt_opencl_free_kernel(b->kernel_blendop_set_mask);
+  dt_opencl_free_kernel(b->kernel_blendop_mask_multiply);
   dt_opencl_free_kernel(b->kernel_blendop_display_channel);
   dt_opencl_free_kernel(b->kernel_calc_Y0_mask);
   dt_opencl_free_kernel(b->kernel_calc_scharr_mask);
@@ -1454,38 +1454,18 @@ void dt_develop_blendif_lab_blend(struct dt_dev_pixelpipe_iop_t *piece,
     // the Lab color space. A conversion needs thus to be performed. As the pipe is using the work profile to
     // convert between Lab and the gamma module (which works in RGB), we need to use use that profile for the
     // conversion.
-    const size_t buffsize = (size_t)owidth * oheight * DT_BLENDIF_LAB_CH;
-    if(profile)
-    {
+    // the row conversions are in place and leave the 4th channel, holding the mask, alone
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) \
-  dt_omp_firstprivate(b, buffsize, profile)
+  dt_omp_firstprivate(b, oheight, owidth, profile)
 #endif
-      for(size_t j = 0; j < buffsize; j += DT_BLENDIF_LAB_CH)
-      {
-        dt_aligned_pixel_t pixel;
-        for_each_channel(c,aligned(b))
-          pixel[c] = b[j+c];
-        const float yellow_mask = b[j+3]; // preserve alpha for code which does in-place conversion
-        dt_ioppr_rgb_matrix_to_lab(pixel, b + j, profile->matrix_in_transposed, profile->lut_in,
-                                   profile->unbounded_coeffs_in, profile->lutsize, profile->nonlinearlut);
-        b[j+3] = yellow_mask;
-      }
-    }
-    else
+    for(size_t y = 0; y < oheight; y++)
     {
-#ifdef _OPENMP
-#pragma omp parallel for simd schedule(static) default(none) aligned(b:64) \
-  dt_omp_firstprivate(b, buffsize, profile)
-#endif
-      for(size_t j = 0; j < buffsize; j += DT_BLENDIF_LAB_CH)
-      {
-        dt_aligned_pixel_t XYZ;
-        const float yellow_mask = b[j+3]; // preserve alpha for code which does in-place conversion
-        dt_Rec709_to_XYZ_D50(b + j, XYZ);
-        dt_XYZ_to_Lab(XYZ, b + j);
-        b[j+3] = yellow_mask;
-      }
+      float *const row = b + y * owidth * DT_BLENDIF_LAB_CH;
+      if(profile)
+        dt_ioppr_rgb_matrix_to_lab_row(row, row, owidth, profile);
+      else
+        dt_Rec709_to_Lab_row(row, row, owidth);
     }
   }
   else
@@ -1495,36 +1475,41 @@ void dt_develop_blendif_lab_blend(struct dt_dev_pixelpipe_iop_t *piece,
     const dt_aligned_pixel_t min = { 0.0f, -1.0f, -1.0f, 0.0f };
     const dt_aligned_pixel_t max = { 1.0f, 1.0f, 1.0f, 1.0f };
 
-    float *tmp_buffer = dt_alloc_align_float((size_t)owidth * oheight * DT_BLENDIF_LAB_CH);
+    // the blend operators don't work in place, so each thread keeps a copy of the current row of b
+    size_t padded_row_size;
+    float *tmp_buffer = dt_alloc_perthread_float((size_t)owidth * DT_BLENDIF_LAB_CH, &padded_row_size);
     if (tmp_buffer != NULL)
     {
-      dt_iop_image_copy(tmp_buffer, b, (size_t)owidth * oheight * DT_BLENDIF_LAB_CH);
       if((d->blend_mode & DEVELOP_BLEND_REVERSE) == DEVELOP_BLEND_REVERSE)
       {
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) \
-  dt_omp_firstprivate(a, b, tmp_buffer, mask, blend, oheight, owidth, iwidth, xoffs, yoffs, min, max)
+  dt_omp_firstprivate(a, b, tmp_buffer, padded_row_size, mask, blend, oheight, owidth, iwidth, xoffs, yoffs, min, max)
 #endif
         for(size_t y = 0; y < oheight; y++)
         {
           const size_t a_start = ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_LAB_CH;
           const size_t b_start = y * owidth * DT_BLENDIF_LAB_CH;
           const size_t m_start = y * owidth;
-          blend(tmp_buffer + b_start, a + a_start, b + b_start, mask + m_start, owidth, min, max);
+          float *const tmp_row = dt_get_perthread(tmp_buffer, padded_row_size);
+          memcpy(tmp_row, b + b_start, sizeof(float) * owidth * DT_BLENDIF_LAB_CH);
+          blend(tmp_row, a + a_start, b + b_start, mask + m_start, owidth, min, max);
         }
       }
       else
       {
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) \
-  dt_omp_firstprivate(a, b, tmp_buffer, mask, blend, oheight, owidth, iwidth, xoffs, yoffs, min, max)
+  dt_omp_firstprivate(a, b, tmp_buffer, padded_row_size, mask, blend, oheight, owidth, iwidth, xoffs, yoffs, min, max)
 #endif
         for(size_t y = 0; y < oheight; y++)
         {
           const size_t a_start = ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_LAB_CH;
           const size_t b_start = y * owidth * DT_BLENDIF_LAB_CH;
           const size_t m_start = y * owidth;
-          blend(a + a_start, tmp_buffer + b_start, b + b_start, mask + m_start, owidth, min, max);
+          float *const tmp_row = dt_get_perthread(tmp_buffer, padded_row_size);
+          memcpy(tmp_row, b + b_start, sizeof(float) * owidth * DT_BLENDIF_LAB_CH);
+          blend(a + a_start, tmp_row, b + b_start, mask + m_start, owidth, min, max);
         }
       }
       dt_free_align(tmp_buffer);
@@ -31,6 +31,7 @@
 #include "develop/blend.h"
 #include "develop/imageop.h"
 #include "develop/openmp_maths.h"
+#include "develop/pixelpipe_aux.h"
 #include <math.h>
 
 #define DT_BLENDIF_RGB_CH 4
@@ -110,6 +111,17 @@ static inline void _blendif_gray(const float *const restrict pixels, float *cons
   }
 }
 
+#ifdef _OPENMP
+#pragma omp declare simd aligned(gray: 16) uniform(parameters, invert_mask, stride)
+#endif
+static inline void _blendif_gray_plane(const float *const restrict gray, float *const restrict mask,
+                                       const size_t stride, const float *const restrict parameters,
+                                       const unsigned int invert_mask)
+{
+  for(size_t x = 0; x < stride; x++)
+    mask[x] *= _blendif_compute_factor(gray[x], invert_mask, parameters);
+}
+
 #ifdef _OPENMP
 #pragma omp declare simd aligned(pixels: 16) uniform(parameters, invert_mask, stride)
 #endif
@@ -309,10 +321,22 @@ void dt_develop_blendif_rgb_hsl_make_mask(struct dt_dev_pixelpipe_iop_t *piece,
       return;
     }
 
+    // the luminance of the input only depends on the upstream pipe: take it from the auxiliary planes,
+    // so it is not recomputed while the params of the module or the other channels are edited
+    gboolean gray_cached = FALSE;
+    const float *const restrict gray_in
+        = (profile && (blendif & (1 << DEVELOP_BLENDIF_GRAY_in)))
+              ? dt_dev_pixelpipe_aux_norm_get(piece, a, roi_in, IOP_CS_RGB, DT_RGB_NORM_LUMINANCE, profile,
+                                              &gray_cached)
+              : NULL;
+    const unsigned int blendif_in = gray_in ? blendif & ~(1 << DEVELOP_BLENDIF_GRAY_in) : blendif;
+    const unsigned int gray_invert = (blendif >> 16) & (1 << DEVELOP_BLENDIF_GRAY_in);
+
 #ifdef _OPENMP
 #pragma omp parallel default(none) \
   dt_omp_firstprivate(temp_mask, mask, a, b, oheight, owidth, iwidth, yoffs, xoffs, buffsize, \
-                      blendif, profile, parameters, mask_inclusive, mask_inversed, global_opacity)
+                      blendif, blendif_in, gray_in, gray_invert, profile, parameters, mask_inclusive, \
+                      mask_inversed, global_opacity)
 #endif
     {
 #ifdef __SSE2__
@@ -333,8 +357,12 @@ void dt_develop_blendif_rgb_hsl_make_mask(struct dt_dev_pixelpipe_iop_t *piece,
 #endif
       for(size_t y = 0; y < oheight; y++)
       {
-        const size_t start = ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_RGB_CH;
-        _blendif_combine_channels(a + start, temp_mask + (y * owidth), owidth, blendif, parameters, profile);
+        const size_t start = (y + yoffs) * iwidth + xoffs;
+        _blendif_combine_channels(a + start * DT_BLENDIF_RGB_CH, temp_mask + (y * owidth), owidth, blendif_in,
+                                  parameters, profile);
+        if(gray_in)
+          _blendif_gray_plane(gray_in + start, temp_mask + (y * owidth), owidth,
+                              parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_GRAY_in, gray_invert);
       }
 #ifdef _OPENMP
 #pragma omp for schedule(static)
@@ -388,6 +416,7 @@ void dt_develop_blendif_rgb_hsl_make_mask(struct dt_dev_pixelpipe_iop_t *piece,
 #endif
     }
 
+    dt_dev_pixelpipe_aux_release((float *)gray_in, gray_cached);
     dt_free_align(temp_mask);
   }
 }
@@ -1125,6 +1154,19 @@ static inline float _rgb_luminance(const float *const restrict rgb,
   return value;
 }
 
+// the row is converted to HSL into b first, which also works when b is the source
+static inline void _display_hsl(const float *const in, float *const b, const float *const restrict mask,
+                                const size_t stride, const int channel)
+{
+  dt_RGB_2_HSL_row(in, b, stride);
+  for(size_t i = 0, j = 0; i < stride; i++, j += DT_BLENDIF_RGB_CH)
+  {
+    const float c = clamp_simd(b[j + channel]);
+    for(int k = 0; k < DT_BLENDIF_RGB_BCH; k++) b[j + k] = c;
+    b[j + DT_BLENDIF_RGB_BCH] = mask[i];
+  }
+}
+
 #ifdef _OPENMP
 #pragma omp declare simd aligned(a, b:16) uniform(channel, profile, stride)
 #endif
@@ -1225,69 +1267,27 @@ static void _display_channel(const float *const restrict a, float *const restric
     }
     case DT_DEV_PIXELPIPE_DISPLAY_HSL_H:
       // no boost factors for HSL
-      for(size_t i = 0, j = 0; i < stride; i++, j += DT_BLENDIF_RGB_CH)
-      {
-        dt_aligned_pixel_t HSL;
-        dt_RGB_2_HSL(a + j, HSL);
-        const float c = clamp_simd(HSL[0]);
-        for(int k = 0; k < DT_BLENDIF_RGB_BCH; k++) b[j + k] = c;
-        b[j + DT_BLENDIF_RGB_BCH] = mask[i];
-      }
+      _display_hsl(a, b, mask, stride, 0);
       break;
     case DT_DEV_PIXELPIPE_DISPLAY_HSL_H | DT_DEV_PIXELPIPE_DISPLAY_OUTPUT:
       // no boost factors for HSL
-      for(size_t i = 0, j = 0; i < stride; i++, j += DT_BLENDIF_RGB_CH)
-      {
-        dt_aligned_pixel_t HSL;
-        dt_RGB_2_HSL(b + j, HSL);
-        const float c = clamp_simd(HSL[0]);
-        for(int k = 0; k < DT_BLENDIF_RGB_BCH; k++) b[j + k] = c;
-        b[j + DT_BLENDIF_RGB_BCH] = mask[i];
-      }
+      _display_hsl(b, b, mask, stride, 0);
       break;
     case DT_DEV_PIXELPIPE_DISPLAY_HSL_S:
       // no boost factors for HSL
-      for(size_t i = 0, j = 0; i < stride; i++, j += DT_BLENDIF_RGB_CH)
-      {
-        dt_aligned_pixel_t HSL;
-        dt_RGB_2_HSL(a + j, HSL);
-        const float c = clamp_simd(HSL[1]);
-        for(int k = 0; k < DT_BLENDIF_RGB_BCH; k++) b[j + k] = c;
-        b[j + DT_BLENDIF_RGB_BCH] = mask[i];
-      }
+      _display_hsl(a, b, mask, stride, 1);
       break;
     case DT_DEV_PIXELPIPE_DISPLAY_HSL_S | DT_DEV_PIXELPIPE_DISPLAY_OUTPUT:
       // no boost factors for HSL
-      for(size_t i = 0, j = 0; i < stride; i++, j += DT_BLENDIF_RGB_CH)
-      {
-        dt_aligned_pixel_t HSL;
-        dt_RGB_2_HSL(b + j, HSL);
-        const float c = clamp_simd(HSL[1]);
-        for(int k = 0; k < DT_BLENDIF_RGB_BCH; k++) b[j + k] = c;
-        b[j + DT_BLENDIF_RGB_BCH] = mask[i];
-      }
+      _display_hsl(b, b, mask, stride, 1);
       break;
     case DT_DEV_PIXELPIPE_DISPLAY_HSL_l:
       // no boost factors for HSL
-      for(size_t i = 0, j = 0; i < stride; i++, j += DT_BLENDIF_RGB_CH)
-      {
-        dt_aligned_pixel_t HSL;
-        dt_RGB_2_HSL(a + j, HSL);
-        const float c = clamp_simd(HSL[2]);
-        for(int k = 0; k < DT_BLENDIF_RGB_BCH; k++) b[j + k] = c;
-        b[j + DT_BLENDIF_RGB_BCH] = mask[i];
-      }
+      _display_hsl(a, b, mask, stride, 2);
       break;
     case DT_DEV_PIXELPIPE_DISPLAY_HSL_l | DT_DEV_PIXELPIPE_DISPLAY_OUTPUT:
       // no boost factors for HSL
-      for(size_t i = 0, j = 0; i < stride; i++, j += DT_BLENDIF_RGB_CH)
-      {
-        dt_aligned_pixel_t HSL;
-        dt_RGB_2_HSL(b + j, HSL);
-        const float c = clamp_simd(HSL[2]);
-        for(int k = 0; k < DT_BLENDIF_RGB_BCH; k++) b[j + k] = c;
-        b[j + DT_BLENDIF_RGB_BCH] = mask[i];
-      }
+      _display_hsl(b, b, mask, stride, 2);
       break;
     default:
       for(size_t i = 0, j = 0; i < stride; i++, j += DT_BLENDIF_RGB_CH)
@@ -1357,36 +1357,41 @@ void dt_develop_blendif_rgb_hsl_blend(struct dt_dev_pixelpipe_iop_t *piece,
   {
     _blend_row_func *const blend = _choose_blend_func(d->blend_mode);
 
-    float *tmp_buffer = dt_alloc_align_float((size_t)owidth * oheight * DT_BLENDIF_RGB_CH);
+    // the blend operators don't work in place, so each thread keeps a copy of the current row of b
+    size_t padded_row_size;
+    float *tmp_buffer = dt_alloc_perthread_float((size_t)owidth * DT_BLENDIF_RGB_CH, &padded_row_size);
     if (tmp_buffer != NULL)
     {
-      dt_iop_image_copy(tmp_buffer, b, (size_t)owidth * oheight * DT_BLENDIF_RGB_CH);
       if((d->blend_mode & DEVELOP_BLEND_REVERSE) == DEVELOP_BLEND_REVERSE)
       {
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) \
-  dt_omp_firstprivate(a, b, tmp_buffer, mask, blend, oheight, owidth, iwidth, xoffs, yoffs)
+  dt_omp_firstprivate(a, b, tmp_buffer, padded_row_size, mask, blend, oheight, owidth, iwidth, xoffs, yoffs)
 #endif
         for(size_t y = 0; y < oheight; y++)
         {
           const size_t a_start = ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_RGB_CH;
           const size_t b_start = y * owidth * DT_BLENDIF_RGB_CH;
           const size_t m_start = y * owidth;
-          blend(tmp_buffer + b_start, a + a_start, b + b_start, mask + m_start, owidth);
+          float *const tmp_row = dt_get_perthread(tmp_buffer, padded_row_size);
+          memcpy(tmp_row, b + b_start, sizeof(float) * owidth * DT_BLENDIF_RGB_CH);
+          blend(tmp_row, a + a_start, b + b_start, mask + m_start, owidth);
         }
       }
       else
       {
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) \
-  dt_omp_firstprivate(a, b, tmp_buffer, mask, blend, oheight, owidth, iwidth, xoffs, yoffs)
+  dt_omp_firstprivate(a, b, tmp_buffer, padded_row_size, mask, blend, oheight, owidth, iwidth, xoffs, yoffs)
 #endif
         for(size_t y = 0; y < oheight; y++)
         {
           const size_t a_start = ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_RGB_CH;
           const size_t b_start = y * owidth * DT_BLENDIF_RGB_CH;
           const size_t m_start = y * owidth;
-          blend(a + a_start, tmp_buffer + b_start, b + b_start, mask + m_start, owidth);
+          float *const tmp_row = dt_get_perthread(tmp_buffer, padded_row_size);
+          memcpy(tmp_row, b + b_start, sizeof(float) * owidth * DT_BLENDIF_RGB_CH);
+          blend(a + a_start, tmp_row, b + b_start, mask + m_start, owidth);
         }
       }
       dt_free_align(tmp_buffer);
@@ -1009,36 +1009,41 @@ void dt_develop_blendif_rgb_jzczhz_blend(struct dt_dev_pixelpipe_iop_t *piece, c
     const float p = exp2f(d->blend_parameter);
     _blend_row_func *const blend = _choose_blend_func(d->blend_mode);
 
-    float *tmp_buffer = dt_alloc_align_float((size_t)owidth * oheight * DT_BLENDIF_RGB_CH);
+    // the blend operators don't work in place, so each thread keeps a copy of the current row of b
+    size_t padded_row_size;
+    float *tmp_buffer = dt_alloc_perthread_float((size_t)owidth * DT_BLENDIF_RGB_CH, &padded_row_size);
     if (tmp_buffer != NULL)
     {
-      dt_iop_image_copy(tmp_buffer, b, (size_t)owidth * oheight * DT_BLENDIF_RGB_CH);
       if((d->blend_mode & DEVELOP_BLEND_REVERSE) == DEVELOP_BLEND_REVERSE)
       {
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) \
-  dt_omp_firstprivate(a, b, tmp_buffer, mask, blend, oheight, owidth, iwidth, xoffs, yoffs, p)
+  dt_omp_firstprivate(a, b, tmp_buffer, padded_row_size, mask, blend, oheight, owidth, iwidth, xoffs, yoffs, p)
 #endif
         for(size_t y = 0; y < oheight; y++)
         {
           const size_t a_start = ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_RGB_CH;
           const size_t b_start = y * owidth * DT_BLENDIF_RGB_CH;
           const size_t m_start = y * owidth;
-          blend(tmp_buffer + b_start, a + a_start, p, b + b_start, mask + m_start, owidth);
+          float *const tmp_row = dt_get_perthread(tmp_buffer, padded_row_size);
+          memcpy(tmp_row, b + b_start, sizeof(float) * owidth * DT_BLENDIF_RGB_CH);
+          blend(tmp_row, a + a_start, p, b + b_start, mask + m_start, owidth);
         }
       }
       else
       {
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) \
-  dt_omp_firstprivate(a, b, tmp_buffer, mask, blend, oheight, owidth, iwidth, xoffs, yoffs, p)
+  dt_omp_firstprivate(a, b, tmp_buffer, padded_row_size, mask, blend, oheight, owidth, iwidth, xoffs, yoffs, p)
 #endif
         for(size_t y = 0; y < oheight; y++)
         {
           const size_t a_start = ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_RGB_CH;
           const size_t b_start = y * owidth * DT_BLENDIF_RGB_CH;
           const size_t m_start = y * owidth;
-          blend(a + a_start, tmp_buffer + b_start, p, b + b_start, mask + m_start, owidth);
+          float *const tmp_row = dt_get_perthread(tmp_buffer, padded_row_size);
+          memcpy(tmp_row, b + b_start, sizeof(float) * owidth * DT_BLENDIF_RGB_CH);
+          blend(a + a_start, tmp_row, p, b + b_start, mask + m_start, owidth);
         }
       }
       dt_free_align(tmp_buffer);
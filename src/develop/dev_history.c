@@ -396,7 +396,11 @@ gboolean dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t d
   /* update xmp file */
   dt_control_save_xmp(dest_imgid);
 
-  dt_mipmap_cache_remove(darktable.mipmap_cache, dest_imgid);
+  if(dt_history_hash_mipmap_outdated(dest_imgid))
+  {
+    dt_mipmap_cache_remove(darktable.mipmap_cache, dest_imgid);
+    dt_image_load_regenerate(dest_imgid);
+  }
 
   /* update the aspect ratio. recompute only if really needed for performance reasons */
   dt_image_reset_aspect_ratio(dest_imgid, FALSE);
@@ -407,50 +411,52 @@ gboolean dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t d
   return ret_val;
 }
 
-GList *dt_history_duplicate(GList *hist)
+dt_dev_history_item_t *dt_history_duplicate_item(const dt_dev_history_item_t *old)
 {
-  GList *result = NULL;
-
-  for(GList *h = g_list_first(hist); h; h = g_list_next(h))
-  {
-    const dt_dev_history_item_t *old = (dt_dev_history_item_t *)(h->data);
-
-    dt_dev_history_item_t *new = (dt_dev_history_item_t *)malloc(sizeof(dt_dev_history_item_t));
+  dt_dev_history_item_t *new = (dt_dev_history_item_t *)malloc(sizeof(dt_dev_history_item_t));
 
-    memcpy(new, old, sizeof(dt_dev_history_item_t));
+  memcpy(new, old, sizeof(dt_dev_history_item_t));
 
-    int32_t params_size = 0;
-    if(old->module)
+  int32_t params_size = 0;
+  if(old->module)
+  {
+    params_size = old->module->params_size;
+  }
+  else
+  {
+    dt_iop_module_t *base = dt_iop_get_module(old->op_name);
+    if(base)
     {
-      params_size = old->module->params_size;
+      params_size = base->params_size;
     }
     else
     {
-      dt_iop_module_t *base = dt_iop_get_module(old->op_name);
-      if(base)
-      {
-        params_size = base->params_size;
-      }
-      else
-      {
-        // nothing else to do
-        fprintf(stderr, "[_duplicate_history] can't find base module for %s\n", old->op_name);
-      }
+      // nothing else to do
+      fprintf(stderr, "[_duplicate_history] can't find base module for %s\n", old->op_name);
     }
+  }
 
-    if(params_size > 0)
-    {
-      new->params = malloc(params_size);
-      memcpy(new->params, old->params, params_size);
-    }
+  if(params_size > 0)
+  {
+    new->params = malloc(params_size);
+    memcpy(new->params, old->params, params_size);
+  }
 
-    new->blend_params = malloc(sizeof(dt_develop_blend_params_t));
-    memcpy(new->blend_params, old->blend_params, sizeof(dt_develop_blend_params_t));
+  new->blend_params = malloc(sizeof(dt_develop_blend_params_t));
+  memcpy(new->blend_params, old->blend_params, sizeof(dt_develop_blend_params_t));
 
-    if(old->forms) new->forms = dt_masks_dup_forms_deep(old->forms, NULL);
+  if(old->forms) new->forms = dt_masks_dup_forms_deep(old->forms, NULL);
+
+  return new;
+}
+
+GList *dt_history_duplicate(GList *hist)
+{
+  GList *result = NULL;
+
+  for(GList *h = g_list_first(hist); h; h = g_list_next(h))
+    result = g_list_prepend(result, dt_history_duplicate_item((dt_dev_history_item_t *)(h->data)));
 
-    result = g_list_prepend(result, new);
-  }
   return g_list_reverse(result);  // list was built in reverse order, so un-reverse it
 }
 
@@ -702,6 +708,9 @@ void dt_dev_add_history_item_real(dt_develop_t *dev, dt_iop_module_t *module, gb
   dt_dev_add_history_item_ext(dev, module, enable, FALSE, FALSE, FALSE);
   dt_pthread_mutex_unlock(&dev->history_mutex);
 
+  // a module switched on from elsewhere than its own gui needs one before processing
+  if(module && module->enabled && dev->gui_attached) dt_iop_gui_init_lazy(module);
+
   /* signal that history has changed */
   dt_dev_undo_end_record(dev);
 
@@ -725,8 +734,8 @@ void dt_dev_add_history_item_real(dt_develop_t *dev, dt_iop_module_t *module, gb
   {
     // We either don't have a module, meaning we have the mask manager, or
     // we have a module and it has masks. Both ways, masks can affect several modules anywhere.
-    // We need a full resync of all pipeline with history.
-    dt_dev_pixelpipe_resync_all(dev);
+    // We need to resync all pipeline nodes with history, but only those that changed will be recommitted.
+    dt_dev_pixelpipe_resync_history(dev);
   }
 
   dt_dev_masks_list_update(dev);
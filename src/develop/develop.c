@@ -40,6 +40,7 @@
 #include "develop/imageop.h"
 #include "develop/lightroom.h"
 #include "develop/masks.h"
+#include "develop/pixelpipe_tiles.h"
 #include "gui/gtk.h"
 #include "gui/presets.h"
 
@@ -96,6 +97,7 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
   dev->raw_histogram.width = 0;
   dev->raw_histogram.hash = -1;
   dev->raw_histogram.bpp = 0;
+  dev->raw_histogram.scopes = NULL;
 
   dev->output_histogram.buffer = NULL;
   dev->output_histogram.op = "colorout";
@@ -103,6 +105,7 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
   dev->output_histogram.height = 0;
   dev->output_histogram.hash = -1;
   dev->output_histogram.bpp = 0;
+  dev->output_histogram.scopes = NULL;
 
   dev->display_histogram.buffer = NULL;
   dev->display_histogram.op = "gamma";
@@ -110,6 +113,7 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
   dev->display_histogram.height = 0;
   dev->display_histogram.hash = -1;
   dev->display_histogram.bpp = 0;
+  dev->display_histogram.scopes = NULL;
 
   dev->auto_save_timeout = 0;
   dev->drawing_timeout = 0;
@@ -152,8 +156,11 @@ void dt_dev_cleanup(dt_develop_t *dev)
   // image_cache does not have to be unref'd, this is done outside develop module.
 
   if(dev->raw_histogram.buffer) dt_free_align(dev->raw_histogram.buffer);
+  if(dev->raw_histogram.scopes) dt_free_align(dev->raw_histogram.scopes);
   if(dev->output_histogram.buffer) dt_free_align(dev->output_histogram.buffer);
+  if(dev->output_histogram.scopes) dt_free_align(dev->output_histogram.scopes);
   if(dev->display_histogram.buffer) dt_free_align(dev->display_histogram.buffer);
+  if(dev->display_histogram.scopes) dt_free_align(dev->display_histogram.scopes);
 
   // On dev cleanup, it is expected to force an history save
   if(dev->auto_save_timeout) g_source_remove(dev->auto_save_timeout);
@@ -297,6 +304,32 @@ void dt_dev_pixelpipe_resync_all(dt_develop_t *dev)
   dt_dev_pixelpipe_resync_main(dev);
 }
 
+void dt_dev_pixelpipe_resync_history(dt_develop_t *dev)
+{
+  if(!dev || !dev->gui_attached || !dev->pipe || !dev->preview_pipe) return;
+
+  _dev_pixelpipe_set_dirty(dev->pipe);
+  _dev_pixelpipe_set_dirty(dev->preview_pipe);
+
+  dev->pipe->changed |= DT_DEV_PIPE_HISTORY;
+  dev->preview_pipe->changed |= DT_DEV_PIPE_HISTORY;
+
+  dt_atomic_set_int(&dev->pipe->shutdown, TRUE);
+  dt_atomic_set_int(&dev->preview_pipe->shutdown, TRUE);
+}
+
+void dt_dev_masks_preview(dt_develop_t *dev)
+{
+  if(!dev || !dev->gui_attached || !dev->preview_pipe) return;
+  dev->mask_preview = TRUE;
+
+  // Not killed if running: it starts over once done, to keep up with the mouse instead of
+  // restarting on every move.
+  _dev_pixelpipe_set_dirty(dev->preview_pipe);
+  dev->preview_pipe->changed |= DT_DEV_PIPE_HISTORY;
+  if(!dev->preview_pipe->processing) dt_dev_process_preview(dev);
+}
+
 void dt_dev_invalidate_real(dt_develop_t *dev)
 {
   if(!dev || !dev->gui_attached || !dev->pipe) return;
@@ -379,6 +412,15 @@ void dt_dev_process_preview_job(dt_develop_t *dev)
   dt_mipmap_buffer_t buf;
   dt_mipmap_cache_get(darktable.mipmap_cache, &buf, dev->image_storage.id, DT_MIPMAP_F, DT_MIPMAP_BLOCKING, 'r');
 
+  if(dev->preview_input_stale)
+  {
+    // DT_MIPMAP_F got resized since this buffer was computed, see dt_dev_request_preview_size()
+    dev->preview_input_stale = FALSE;
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    dt_mipmap_cache_remove_at_size(darktable.mipmap_cache, dev->image_storage.id, DT_MIPMAP_F);
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, dev->image_storage.id, DT_MIPMAP_F, DT_MIPMAP_BLOCKING, 'r');
+  }
+
   gboolean finish_on_error = (!buf.buf || !buf.width || !buf.height);
 
   if(!finish_on_error)
@@ -444,6 +486,116 @@ void dt_dev_process_preview_job(dt_develop_t *dev)
 }
 
 
+// processes the region of the center view shown at this zoom, scaled by `factor`
+// region of the processed image at scale * factor shown in the center view
+static void _view_roi(const dt_develop_t *dev, const dt_dev_pixelpipe_t *pipe, const float scale,
+                      const float factor, const float zoom_x, const float zoom_y, const int closeup,
+                      int *x, int *y, int *wd, int *ht)
+{
+  int window_width = dev->width * darktable.gui->ppd * factor;
+  int window_height = dev->height * darktable.gui->ppd * factor;
+  if(closeup)
+  {
+    window_width /= 1<<closeup;
+    window_height /= 1<<closeup;
+  }
+  const float pass_scale = scale * factor;
+  *wd = MIN(window_width, pipe->processed_width * pass_scale);
+  *ht = MIN(window_height, pipe->processed_height * pass_scale);
+  *x = MAX(0, pass_scale * pipe->processed_width  * (.5 + zoom_x) - *wd / 2);
+  *y = MAX(0, pass_scale * pipe->processed_height * (.5 + zoom_y) - *ht / 2);
+}
+
+static int _process_image_at(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, const float scale, const float factor,
+                             const float zoom_x, const float zoom_y, const int closeup)
+{
+  int x, y, wd, ht;
+  _view_roi(dev, pipe, scale, factor, zoom_x, zoom_y, closeup, &x, &y, &wd, &ht);
+  const float pass_scale = scale * factor;
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  const int ret = dt_dev_pixelpipe_process(pipe, dev, x, y, wd, ht, pass_scale);
+
+  dt_show_times(&start, pipe->draft ? "[dev_process_image] pixel pipeline processing, draft"
+                                    : "[dev_process_image] pixel pipeline processing");
+  return ret;
+}
+
+// Final pass when the image is larger than the view: render only the tiles of the view that are not in
+// pipe->tiles for the current parameters and scale, then assemble the view from the tiles. Panning then
+// only computes what gets exposed. Modules are expected to give the same pixels whatever the ROI,
+// which tiling already relies on.
+static int _process_image_tiled(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, const float scale,
+                                const float zoom_x, const float zoom_y, const int closeup)
+{
+  int x, y, wd, ht;
+  _view_roi(dev, pipe, scale, 1.f, zoom_x, zoom_y, closeup, &x, &y, &wd, &ht);
+  const int image_width = pipe->processed_width * scale;
+  const int image_height = pipe->processed_height * scale;
+
+  // nothing to pan when the whole image fits in the view
+  if(!pipe->tiles || (wd >= image_width && ht >= image_height)
+     || !dt_dev_pixelpipe_tiles_fit(pipe->tiles, wd, ht))
+    return _process_image_at(dev, pipe, scale, 1.f, zoom_x, zoom_y, closeup);
+
+  const uint64_t hash = dt_dev_pixelpipe_params_hash(pipe, dev);
+  int rx, ry, rw, rh;
+  if(dt_dev_pixelpipe_tiles_missing(pipe->tiles, hash, scale, x, y, wd, ht, image_width, image_height,
+                                    &rx, &ry, &rw, &rh))
+  {
+    dt_times_t start;
+    dt_get_times(&start);
+
+    pipe->tiles_hash = hash;
+    const int ret = dt_dev_pixelpipe_process(pipe, dev, rx, ry, rw, rh, scale);
+    pipe->tiles_hash = 0;
+
+    dt_print(DT_DEBUG_DEV, "[pixelpipe] rendered %i×%i px of tiles for a view of %i×%i px\n", rw, rh, wd, ht);
+    dt_show_times(&start, "[dev_process_image] pixel pipeline processing, tiles");
+    if(ret) return ret;
+  }
+
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  if(pipe->output_backbuf == NULL || pipe->output_backbuf_width != wd || pipe->output_backbuf_height != ht)
+  {
+    g_free(pipe->output_backbuf);
+    pipe->output_backbuf_width = wd;
+    pipe->output_backbuf_height = ht;
+    pipe->output_backbuf = g_malloc0(sizeof(uint8_t) * 4 * wd * ht);
+  }
+  const gboolean complete = pipe->output_backbuf
+                            && dt_dev_pixelpipe_tiles_get(pipe->tiles, hash, scale, pipe->output_backbuf,
+                                                          x, y, wd, ht);
+  if(complete)
+  {
+    // as dt_dev_pixelpipe_process() leaves it, tiles hits or not
+    pipe->backbuf = pipe->output_backbuf;
+    pipe->backbuf_width = wd;
+    pipe->backbuf_height = ht;
+    pipe->output_imgid = pipe->image.id;
+    const int view[4] = { x, y, wd, ht };
+    pipe->output_backbuf_hash = dt_hash(dt_hash(hash, (const char *)&scale, sizeof(scale)),
+                                        (const char *)view, sizeof(view));
+  }
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+
+  // tiles evicted in the meantime: don't bother, render the view at once
+  if(!complete) return _process_image_at(dev, pipe, scale, 1.f, zoom_x, zoom_y, closeup);
+  return 0;
+}
+
+// show something quickly after a change of parameters if the final render is slow,
+// then refine it. Zooming and panning already fall back to the preview pipe.
+static gboolean _want_draft(const dt_develop_t *dev, const dt_dev_pixelpipe_change_t pipe_changed)
+{
+  const int min_delay = dt_conf_get_int("darkroom/ui/progressive_rendering_delay");
+  return min_delay > 0 && dev->average_delay > min_delay
+         && (pipe_changed & (DT_DEV_PIPE_TOP_CHANGED | DT_DEV_PIPE_SYNCH | DT_DEV_PIPE_HISTORY))
+         && !(pipe_changed & DT_DEV_PIPE_ZOOMED);
+}
+
 void dt_dev_process_image_job(dt_develop_t *dev)
 {
   // -1×-1 px means the dimensions of the main preview in darkroom were not inited yet.
@@ -499,17 +651,6 @@ void dt_dev_process_image_job(dt_develop_t *dev)
     }
 
     scale = dt_dev_get_zoom_scale(dev, zoom, 1.0f, 0) * darktable.gui->ppd;
-    int window_width = dev->width * darktable.gui->ppd;
-    int window_height = dev->height * darktable.gui->ppd;
-    if(closeup)
-    {
-      window_width /= 1<<closeup;
-      window_height /= 1<<closeup;
-    }
-    const int wd = MIN(window_width, pipe->processed_width * scale);
-    const int ht = MIN(window_height, pipe->processed_height * scale);
-    int x = MAX(0, scale * pipe->processed_width  * (.5 + zoom_x) - wd / 2);
-    int y = MAX(0, scale * pipe->processed_height * (.5 + zoom_y) - ht / 2);
 
     dt_control_log_busy_enter();
     dt_control_toast_busy_enter();
@@ -522,12 +663,27 @@ void dt_dev_process_image_job(dt_develop_t *dev)
     // Processing pipelines in parallel triggers memory contention.
     dt_pthread_mutex_lock(&dev->pipe_mutex);
 
-    dt_times_t start;
-    dt_get_times(&start);
+    int ret = 0;
+    if(_want_draft(dev, pipe_changed))
+    {
+      // draft pass: lower scale and cheaper modules. The final pass below aborts as usual
+      // through the kill-switch if another change arrives meanwhile.
+      pipe->draft = TRUE;
+      ret = _process_image_at(dev, pipe, scale, DT_DEV_DRAFT_SCALE, zoom_x, zoom_y, closeup);
+      pipe->draft = FALSE;
 
-    int ret = dt_dev_pixelpipe_process(pipe, dev, x, y, wd, ht, scale);
+      if(!ret && pipe->backbuf && !dt_atomic_get_int(&pipe->shutdown))
+      {
+        pipe->backbuf_scale = scale * DT_DEV_DRAFT_SCALE;
+        pipe->backbuf_zoom_x = zoom_x;
+        pipe->backbuf_zoom_y = zoom_y;
+        pipe->backbuf_draft = TRUE;
+        dt_control_queue_redraw_center();
+      }
+    }
 
-    dt_show_times(&start, "[dev_process_image] pixel pipeline processing");
+    if(!ret && !dt_atomic_get_int(&pipe->shutdown))
+      ret = _process_image_tiled(dev, pipe, scale, zoom_x, zoom_y, closeup);
 
     dt_pthread_mutex_unlock(&dev->pipe_mutex);
 
@@ -545,6 +701,7 @@ void dt_dev_process_image_job(dt_develop_t *dev)
       pipe->backbuf_scale = scale;
       pipe->backbuf_zoom_x = zoom_x;
       pipe->backbuf_zoom_y = zoom_y;
+      pipe->backbuf_draft = FALSE;
       dev->image_invalid_cnt = 0;
     }
 
@@ -576,6 +733,8 @@ static inline int _dt_dev_load_raw(dt_develop_t *dev, const int32_t imgid)
   dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
   gboolean no_valid_image = buf.buf == NULL;
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  // likely to be opened again, don't decode it twice
+  if(!no_valid_image) dt_mipmap_cache_keep_full(darktable.mipmap_cache, imgid);
 
   dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_F, DT_MIPMAP_BLOCKING, 'r');
   gboolean no_valid_thumb = buf.buf == NULL;
@@ -648,6 +807,31 @@ int dt_dev_load_image(dt_develop_t *dev, const int32_t imgid)
   return 0;
 }
 
+void dt_dev_request_preview_size(dt_develop_t *dev, dt_dev_preview_client_t client, int width, int height)
+{
+  if(!dev || client < 0 || client >= DT_DEV_PREVIEW_CLIENT_LAST || !darktable.mipmap_cache) return;
+  dev->preview_requests[client][0] = width;
+  dev->preview_requests[client][1] = height;
+
+  int32_t wd = 0, ht = 0;
+  for(int k = 0; k < DT_DEV_PREVIEW_CLIENT_LAST; k++)
+  {
+    wd = MAX(wd, dev->preview_requests[k][0]);
+    ht = MAX(ht, dev->preview_requests[k][1]);
+  }
+  if(!dt_mipmap_cache_set_f_size(darktable.mipmap_cache, wd, ht)) return;
+
+  if(!dev->gui_attached || dev->image_storage.id <= 0 || !dev->preview_pipe) return;
+
+  // the current one was generated at the former size, the preview job will drop it.
+  // Doing it here would wait for the job to release it.
+  dev->preview_input_stale = TRUE;
+  _dev_pixelpipe_set_dirty(dev->preview_pipe);
+  dev->preview_pipe->changed |= DT_DEV_PIPE_SYNCH;
+  dt_atomic_set_int(&dev->preview_pipe->shutdown, TRUE);
+  dt_dev_refresh_ui_images(dev);
+}
+
 void dt_dev_configure_real(dt_develop_t *dev, int wd, int ht)
 {
   // Called only from Darkroom to init and update drawing size
@@ -659,6 +843,10 @@ void dt_dev_configure_real(dt_develop_t *dev, int wd, int ht)
     dev->width = wd;
     dev->height = ht;
 
+    // the preview stands for the main image while it's computed, at a lower resolution
+    dt_dev_request_preview_size(dev, DT_DEV_PREVIEW_CLIENT_CENTER, wd * darktable.gui->ppd / 2,
+                                ht * darktable.gui->ppd / 2);
+
     dt_print(DT_DEBUG_DEV, "[pixelpipe] Darkroom requested a %i×%i px main preview\n", wd, ht);
     dt_dev_invalidate_zoom(dev);
 
@@ -674,8 +862,7 @@ void dt_dev_configure_real(dt_develop_t *dev, int wd, int ht)
 void dt_dev_reprocess_all(dt_develop_t *dev)
 {
   if(darktable.gui->reset || !dev || !dev->gui_attached) return;
-  dt_dev_pixelpipe_cache_flush(&(dev->pipe->cache));
-  dt_dev_pixelpipe_cache_flush(&(dev->preview_pipe->cache));
+  dt_dev_pixelpipe_cache_flush(darktable.pixelpipe_cache);
   dt_dev_pixelpipe_rebuild(dev);
 }
 
@@ -865,13 +1052,6 @@ void dt_dev_masks_selection_change(dt_develop_t *dev, struct dt_iop_module_t *mo
     dev->proxy.masks.selection_change(dev->proxy.masks.module, module, selectid, throw_event);
 }
 
-void dt_dev_snapshot_request(dt_develop_t *dev, const char *filename)
-{
-  dev->proxy.snapshot.filename = filename;
-  dev->proxy.snapshot.request = TRUE;
-  dt_control_queue_redraw_center();
-}
-
 void dt_dev_average_delay_update(const dt_times_t *start, uint32_t *average_delay)
 {
   dt_times_t end;
@@ -1245,7 +1425,7 @@ int dt_dev_sync_pixelpipe_hash(dt_develop_t *dev, struct dt_dev_pixelpipe_t *pip
     return TRUE;
 
   // timed out. let's see if history stack has changed
-  if(pipe->changed & (DT_DEV_PIPE_TOP_CHANGED | DT_DEV_PIPE_REMOVE | DT_DEV_PIPE_SYNCH))
+  if(pipe->changed & (DT_DEV_PIPE_TOP_CHANGED | DT_DEV_PIPE_REMOVE | DT_DEV_PIPE_SYNCH | DT_DEV_PIPE_HISTORY))
   {
     dt_dev_invalidate(dev);
     // pretend that everything is fine
@@ -33,6 +33,9 @@
 
 struct dt_iop_module_t;
 
+// scale of the draft pass of a progressive render in darkroom, relative to the final one
+#define DT_DEV_DRAFT_SCALE 0.5f
+
 typedef enum dt_dev_overexposed_colorscheme_t
 {
   DT_DEV_OVEREXPOSED_BLACKWHITE = 0,
@@ -122,6 +125,15 @@ typedef struct dt_dev_proxy_exposure_t
   float (*get_black)(struct dt_iop_module_t *exp);
 } dt_dev_proxy_exposure_t;
 
+// widgets drawn from the preview pipe, which is sized for the largest of them
+typedef enum dt_dev_preview_client_t
+{
+  DT_DEV_PREVIEW_CLIENT_CENTER = 0,     // center view before the main pipe is ready, colour pickers
+  DT_DEV_PREVIEW_CLIENT_NAVIGATION = 1,
+  DT_DEV_PREVIEW_CLIENT_HISTOGRAM = 2,
+  DT_DEV_PREVIEW_CLIENT_LAST
+} dt_dev_preview_client_t;
+
 struct dt_dev_pixelpipe_t;
 
 typedef struct dt_backbuf_t
@@ -132,6 +144,9 @@ typedef struct dt_backbuf_t
   uint64_t hash;         // checksum/integrity hash, for example to connect to a cacheline
   const char *op;        // name of the backbuf
   size_t bpp;            // bits per pixels
+  uint32_t *scopes;      // bins of all the scopes, when they were computed on the device instead of copying
+                         // the image to buffer. See dt_scopes_map()
+  float scopes_zoom;     // zoom of the vectorscope in scopes
 } dt_backbuf_t;
 
 
@@ -148,6 +163,11 @@ typedef struct dt_develop_t
   // width, height: dimensions of window
   int32_t width, height;
 
+  // sizes in pixels wanted by the widgets drawn from the preview pipe, see dt_dev_request_preview_size()
+  int32_t preview_requests[DT_DEV_PREVIEW_CLIENT_LAST][2];
+  // the DT_MIPMAP_F buffer of the current image was computed at a former size
+  gboolean preview_input_stale;
+
   // image processing pipeline with caching
   struct dt_dev_pixelpipe_t *pipe, *preview_pipe;
   dt_pthread_mutex_t pipe_mutex;
@@ -239,15 +259,6 @@ typedef struct dt_develop_t
       gboolean (*basics_module_toggle)(struct dt_lib_module_t *self, GtkWidget *widget, gboolean doit);
     } modulegroups;
 
-    // snapshots plugin hooks
-    struct
-    {
-      // this flag is set by snapshot plugin to signal that expose of darkroom
-      // should store cairo surface as snapshot to disk using filename.
-      gboolean request;
-      const gchar *filename;
-    } snapshot;
-
     // masks plugin hooks
     struct
     {
@@ -319,6 +330,9 @@ typedef struct dt_develop_t
   gboolean darkroom_skip_mouse_events; // skip mouse events for masks
   gboolean mask_lock;
   gint drawing_timeout;
+  // drawn masks are being edited with the mouse: the center view shows the preview pipe,
+  // until the main one is done with the history committed on release
+  gboolean mask_preview;
 } dt_develop_t;
 
 void dt_dev_init(dt_develop_t *dev, int32_t gui_attached);
@@ -372,6 +386,14 @@ void dt_dev_pixelpipe_resync_all(dt_develop_t *dev);
 // Resync the whole history, which may be expensive.
 void dt_dev_pixelpipe_resync_main(dt_develop_t *dev);
 
+// Invalidate the main image and the thumbnail in darkroom after a history change that
+// may affect any module (drawn masks). Only the modules whose history changed are resynced.
+void dt_dev_pixelpipe_resync_history(dt_develop_t *dev);
+
+// Live feedback of drawn masks being edited, without writing history: only the preview pipe is
+// recomputed, from the cached output of the modules upstream of those using the masks.
+void dt_dev_masks_preview(dt_develop_t *dev);
+
 
 void dt_dev_set_histogram(dt_develop_t *dev);
 void dt_dev_set_histogram_pre(dt_develop_t *dev);
@@ -389,6 +411,10 @@ void dt_dev_get_pointer_zoom_pos(dt_develop_t *dev, const float px, const float
 void dt_dev_configure_real(dt_develop_t *dev, int wd, int ht);
 #define dt_dev_configure(dev, wd, ht) DT_DEBUG_TRACE_WRAPPER(DT_DEBUG_DEV, dt_dev_configure_real, (dev), (wd), (ht))
 
+// A widget drawn from the preview pipe got a size of width × height pixels. The input of the preview pipe,
+// DT_MIPMAP_F, is sized for the largest of them, and the preview recomputed if that changed its size.
+void dt_dev_request_preview_size(dt_develop_t *dev, dt_dev_preview_client_t client, int width, int height);
+
 /*
  * exposure plugin hook, set the exposure and the black level
  */
@@ -420,9 +446,6 @@ void dt_dev_reorder_gui_module_list(dt_develop_t *dev);
 /** test if the iop is visible in current groups layout **/
 gboolean dt_dev_modulegroups_is_visible(dt_develop_t *dev, gchar *module);
 
-/** request snapshot */
-void dt_dev_snapshot_request(dt_develop_t *dev, const char *filename);
-
 /** update gliding average for pixelpipe delay */
 void dt_dev_average_delay_update(const dt_times_t *start, uint32_t *average_delay);
 
@@ -28,6 +28,7 @@
 #include "common/interpolation.h"
 #include "common/module.h"
 #include "common/opencl.h"
+#include "common/presets.h"
 #include "common/usermanual_url.h"
 #include "control/control.h"
 #include "develop/blend.h"
@@ -310,6 +311,101 @@ int default_iop_focus(dt_gui_module_t *m, gboolean toggle)
   return 1;
 }
 
+static void _params_spans_add(GArray *spans, const size_t offset, const size_t size)
+{
+  if(!size) return;
+  if(spans->len)
+  {
+    // merge with the previous run when there is no padding in between
+    dt_iop_params_span_t *last = &g_array_index(spans, dt_iop_params_span_t, spans->len - 1);
+    if(last->offset + last->size == offset)
+    {
+      last->size += size;
+      return;
+    }
+  }
+  const dt_iop_params_span_t span = { offset, size };
+  g_array_append_val(spans, span);
+}
+
+// base is added to the offsets of the introspection, which are those of the first element within arrays
+static void _params_spans_collect(GArray *spans, const dt_introspection_field_t *field, const size_t base)
+{
+  switch(field->header.type)
+  {
+    case DT_INTROSPECTION_TYPE_STRUCT:
+      for(size_t i = 0; i < field->Struct.entries; i++)
+        _params_spans_collect(spans, field->Struct.fields[i], base);
+      break;
+    case DT_INTROSPECTION_TYPE_ARRAY:
+    {
+      const dt_introspection_field_t *element = field->Array.field;
+      const size_t element_size = element->header.size;
+      GArray *inner = g_array_new(FALSE, FALSE, sizeof(dt_iop_params_span_t));
+      _params_spans_collect(inner, element, 0);
+
+      const dt_iop_params_span_t *first = (const dt_iop_params_span_t *)inner->data;
+      if(inner->len == 1 && first->offset == element->header.offset && first->size == element_size)
+        _params_spans_add(spans, base + field->header.offset, field->header.size);
+      else
+      {
+        // padded elements, repeat their runs for each of them
+        for(size_t k = 0; k < field->Array.count; k++)
+          for(guint s = 0; s < inner->len; s++)
+            _params_spans_add(spans, base + k * element_size + first[s].offset, first[s].size);
+      }
+      g_array_free(inner, TRUE);
+      break;
+    }
+    default:
+      // plain fields, and unions and opaque blobs as a whole since we can't tell what they hold
+      _params_spans_add(spans, base + field->header.offset, field->header.size);
+      break;
+  }
+}
+
+static void _params_spans_init(dt_iop_module_so_t *module)
+{
+  module->params_spans = NULL;
+  module->params_spans_count = 0;
+  module->params_spans_size = 0;
+
+  dt_introspection_t *introspection = module->have_introspection ? module->get_introspection() : NULL;
+  if(!introspection || !introspection->field) return;
+
+  GArray *spans = g_array_new(FALSE, FALSE, sizeof(dt_iop_params_span_t));
+  _params_spans_collect(spans, introspection->field, 0);
+  module->params_spans_count = spans->len;
+  module->params_spans_size = introspection->size;
+  module->params_spans = (dt_iop_params_span_t *)g_array_free(spans, FALSE);
+
+  size_t used = 0;
+  for(int k = 0; k < module->params_spans_count; k++) used += module->params_spans[k].size;
+  dt_print(DT_DEBUG_PARAMS, "[iop_load_module] %s: params of %zu bytes, %zu in %d runs of fields\n",
+           module->op, module->params_spans_size, used, module->params_spans_count);
+}
+
+uint64_t dt_iop_params_hash(const dt_iop_module_so_t *so, uint64_t hash, const void *params, const size_t size)
+{
+  if(!so || !so->params_spans || size != so->params_spans_size) return dt_hash(hash, (const char *)params, size);
+
+  for(int k = 0; k < so->params_spans_count; k++)
+    hash = dt_hash(hash, (const char *)params + so->params_spans[k].offset, so->params_spans[k].size);
+  return hash;
+}
+
+gboolean dt_iop_params_equal(const dt_iop_module_so_t *so, const void *a, const void *b, const size_t size)
+{
+  if(!so || !so->params_spans || size != so->params_spans_size) return !memcmp(a, b, size);
+
+  for(int k = 0; k < so->params_spans_count; k++)
+  {
+    const size_t offset = so->params_spans[k].offset;
+    if(memcmp((const char *)a + offset, (const char *)b + offset, so->params_spans[k].size)) return FALSE;
+  }
+  return TRUE;
+}
+
 int dt_iop_load_module_so(void *m, const char *libname, const char *module_name)
 {
   dt_iop_module_so_t *module = (dt_iop_module_so_t *)m;
@@ -350,6 +446,7 @@ int dt_iop_load_module_so(void *m, const char *libname, const char *module_name)
     else
       fprintf(stderr, "[iop_load_module] failed to initialize introspection for operation `%s'\n", module_name);
   }
+  _params_spans_init(module);
 
   if(module->init_global) module->init_global(module);
   return 0;
@@ -497,7 +594,7 @@ static void _gui_delete_callback(GtkButton *button, dt_iop_module_t *module)
 
     dt_iop_gui_cleanup_module(module);
     gtk_widget_grab_focus(dt_ui_center(darktable.gui->ui));
-    gtk_widget_destroy(module->widget);
+    if(module->widget) gtk_widget_destroy(module->widget);
   }
 
   // we remove all references in the history stack and dev->iop
@@ -937,6 +1034,7 @@ static void _gui_off_callback(GtkToggleButton *togglebutton, gpointer user_data)
     if(gtk_toggle_button_get_active(togglebutton))
     {
       module->enabled = 1;
+      dt_iop_gui_init_lazy(module);
 
       darktable.gui->scroll_to[1] = module->expander;
 
@@ -1045,18 +1143,23 @@ void dt_iop_gui_set_enable_button(dt_iop_module_t *module)
   }
 }
 
-void dt_iop_gui_init(dt_iop_module_t *module)
+static void _iop_gui_init_focus_accel(dt_iop_module_t *module)
 {
-  ++darktable.gui->reset;
-  --darktable.bauhaus->skip_accel;
-
-  // Add the accelerators
   if(!dt_iop_is_hidden(module) && !(module->flags() & IOP_FLAGS_DEPRECATED))
   {
     gchar *clean_name = delete_underscore(module->name());
     dt_accels_new_darkroom_action(_iop_plugin_focus_accel, module, "Darkroom/Plugins", clean_name, 0, 0);
     g_free(clean_name);
   }
+}
+
+void dt_iop_gui_init(dt_iop_module_t *module)
+{
+  ++darktable.gui->reset;
+  --darktable.bauhaus->skip_accel;
+
+  // Add the accelerators
+  _iop_gui_init_focus_accel(module);
 
   if(module->gui_init) module->gui_init(module);
   ++darktable.bauhaus->skip_accel;
@@ -1100,6 +1203,9 @@ void dt_iop_cleanup_histogram(gpointer data, gpointer user_data)
 
 static void _init_presets(dt_iop_module_so_t *module_so)
 {
+  // nothing changed since the last startup, the presets are up to date
+  if(!dt_presets_stamp_changed(module_so->op, module_so->module, module_so->version())) return;
+
   if(module_so->init_presets) module_so->init_presets(module_so);
 
   // this seems like a reasonable place to check for and update legacy
@@ -1294,6 +1400,8 @@ static void _init_presets(dt_iop_module_so_t *module_so)
     }
   }
   sqlite3_finalize(stmt);
+
+  dt_presets_stamp_set(module_so->op, module_so->module, module_version);
 }
 
 
@@ -1342,8 +1450,11 @@ static void _init_module_so(void *m)
 
 void dt_iop_load_modules_so(void)
 {
+  // the presets of all the modules are written at once
+  dt_database_start_transaction(darktable.db);
   darktable.iop = dt_module_load_modules("/plugins", sizeof(dt_iop_module_so_t), dt_iop_load_module_so,
                                          _init_module_so, NULL);
+  dt_database_release_transaction(darktable.db);
 }
 
 int dt_iop_load_module(dt_iop_module_t *module, dt_iop_module_so_t *module_so, dt_develop_t *dev)
@@ -1425,6 +1536,7 @@ void dt_iop_unload_modules_so()
     dt_iop_module_so_t *module = (dt_iop_module_so_t *)darktable.iop->data;
     if(module->cleanup_global) module->cleanup_global(module);
     if(module->module) g_module_close(module->module);
+    g_free(module->params_spans);
     free(darktable.iop->data);
     darktable.iop = g_list_delete_link(darktable.iop, darktable.iop);
   }
@@ -1641,7 +1753,7 @@ void dt_iop_compute_module_hash(dt_iop_module_t *module)
   // WARNING: doesn't take into account parameters dynamically set at runtime.
 
   uint64_t hash = dt_hash(5381, (char *)module->op, sizeof(dt_dev_operation_t));
-  hash = dt_hash(hash, (char *)module->params, module->params_size);
+  hash = dt_iop_params_hash(module->so, hash, module->params, module->params_size);
   hash = dt_hash(hash, (char *)&module->instance, sizeof(int32_t));
   hash = dt_hash(hash, (char *)&module->multi_priority, sizeof(int));
   hash = dt_hash(hash, (char *)&module->iop_order, sizeof(int));
@@ -1728,6 +1840,9 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
 
 void dt_iop_gui_cleanup_module(dt_iop_module_t *module)
 {
+  // the gui was never built, see dt_iop_gui_init_lazy()
+  if(!module->widget) return;
+
   while(g_idle_remove_by_data(module->widget))
     ; // remove multiple delayed gtk_widget_queue_draw triggers
 
@@ -1744,6 +1859,9 @@ void dt_iop_gui_cleanup_module(dt_iop_module_t *module)
 
 void dt_iop_gui_update(dt_iop_module_t *module)
 {
+  // modules read their gui data while processing, so switched-on ones need it
+  if(module->enabled) dt_iop_gui_init_lazy(module);
+
   ++darktable.gui->reset;
   if(!dt_iop_is_hidden(module))
   {
@@ -1765,7 +1883,7 @@ void dt_iop_gui_update(dt_iop_module_t *module)
 void dt_iop_gui_reset(dt_iop_module_t *module)
 {
   ++darktable.gui->reset;
-  if(module->gui_reset && !dt_iop_is_hidden(module)) module->gui_reset(module);
+  if(module->gui_reset && module->widget && !dt_iop_is_hidden(module)) module->gui_reset(module);
   --darktable.gui->reset;
 }
 
@@ -1816,6 +1934,7 @@ void dt_iop_request_focus(dt_iop_module_t *module)
 
   if(darktable.gui->reset || (out_focus_module == module)) return;
 
+  dt_iop_gui_init_lazy(module);
   darktable.develop->gui_module = module;
 
   /* lets lose the focus of previous focus module*/
@@ -1889,6 +2008,8 @@ static void _gui_set_single_expanded(dt_iop_module_t *module, gboolean expanded)
   /* show / hide plugin widget */
   if(expanded)
   {
+    dt_iop_gui_init_lazy(module);
+
     /* set this module to receive focus / draw events*/
     dt_iop_request_focus(module);
 
@@ -1944,7 +2065,7 @@ void dt_iop_gui_set_expanded(dt_iop_module_t *module, gboolean expanded, gboolea
 
   _gui_set_single_expanded(module, expanded);
   _iop_dim_all_but((expanded) ? module : NULL, expanded);
-  gtk_widget_queue_draw(module->widget);
+  if(module->widget) gtk_widget_queue_draw(module->widget);
 }
 
 void dt_iop_gui_update_expanded(dt_iop_module_t *module)
@@ -2201,6 +2322,18 @@ gboolean _iop_tooltip_callback(GtkWidget *widget, gint x, gint y, gboolean keybo
   return TRUE;
 }
 
+static void _iop_gui_pack_widget(dt_iop_module_t *module, GtkWidget *iopw)
+{
+  /* add the blending ui if supported */
+  gtk_box_pack_start(GTK_BOX(iopw), module->widget, TRUE, TRUE, 0);
+  dt_iop_gui_init_blending(iopw, module);
+  dt_gui_add_class(module->widget, "dt_plugin_ui_main");
+  dt_gui_add_help_link(module->widget, dt_get_help_url(module->op));
+
+  gtk_widget_set_hexpand(module->widget, FALSE);
+  gtk_widget_set_vexpand(module->widget, FALSE);
+}
+
 void dt_iop_gui_set_expander(dt_iop_module_t *module)
 {
   GtkWidget *header = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
@@ -2321,11 +2454,11 @@ void dt_iop_gui_set_expander(dt_iop_module_t *module)
     gtk_widget_show(lb);
   }
 
-  /* add the blending ui if supported */
-  gtk_box_pack_start(GTK_BOX(iopw), module->widget, TRUE, TRUE, 0);
-  dt_iop_gui_init_blending(iopw, module);
-  dt_gui_add_class(module->widget, "dt_plugin_ui_main");
-  dt_gui_add_help_link(module->widget, dt_get_help_url(module->op));
+  // the module widget may come later, see dt_iop_gui_init_lazy()
+  if(module->widget)
+    _iop_gui_pack_widget(module, iopw);
+  else
+    _iop_gui_init_focus_accel(module);
   gtk_widget_hide(iopw);
 
   module->expander = expander;
@@ -2333,12 +2466,28 @@ void dt_iop_gui_set_expander(dt_iop_module_t *module)
   /* update header */
   dt_iop_gui_update_header(module);
 
-  gtk_widget_set_hexpand(module->widget, FALSE);
-  gtk_widget_set_vexpand(module->widget, FALSE);
-
   dt_ui_container_add_widget(darktable.gui->ui, DT_UI_CONTAINER_PANEL_RIGHT_CENTER, expander);
 }
 
+void dt_iop_gui_init_lazy(dt_iop_module_t *module)
+{
+  if(!module || module->widget || !module->expander || dt_iop_is_hidden(module)) return;
+
+  dt_iop_gui_init(module);
+  if(!module->widget) return;
+
+  GtkWidget *iopw = dt_iop_gui_get_widget(module);
+  _iop_gui_pack_widget(module, iopw);
+
+  // same as dt_ui_container_add_widget() did for the header, then let the module
+  // and the blending hide what they don't need
+  gtk_widget_show_all(iopw);
+  gtk_widget_set_visible(iopw, dtgtk_expander_get_expanded(DTGTK_EXPANDER(module->expander)));
+  dt_iop_gui_update(module);
+
+  dt_print(DT_DEBUG_DEV, "[dt_iop_gui_init_lazy] built the gui of %s\n", module->op);
+}
+
 GtkWidget *dt_iop_gui_get_widget(dt_iop_module_t *module)
 {
   return dtgtk_expander_get_body(DTGTK_EXPANDER(module->expander));
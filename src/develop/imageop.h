@@ -106,7 +106,9 @@ typedef enum dt_iop_flags_t
   IOP_FLAGS_FENCE = 1 << 10,             // No module can be moved pass this one
   IOP_FLAGS_UNSAFE_COPY = 1 << 11,       // Unsafe to copy as part of history
   IOP_FLAGS_GUIDES_SPECIAL_DRAW = 1 << 12, // handle the grid drawing directly
-  IOP_FLAGS_INTERNAL_MASKS = 1 << 13     // Module uses masks internally, outside of blendops. This advertises the need to commit them to history unconditionnaly.
+  IOP_FLAGS_INTERNAL_MASKS = 1 << 13,    // Module uses masks internally, outside of blendops. This advertises the need to commit them to history unconditionnaly.
+  IOP_FLAGS_POINTWISE = 1 << 14,         // Output pixels depend only on the input pixel at the same place, not on its position nor on the image
+  IOP_FLAGS_GLOBAL_STATS = 1 << 15       // Needs statistics over the whole input, taken from develop/pixelpipe_stats.h when the ROI is smaller
 } dt_iop_flags_t;
 
 typedef struct dt_iop_gui_data_t
@@ -138,6 +140,13 @@ typedef enum dt_iop_colorspace_type_t
   IOP_CS_JZCZHZ = 5,
 } dt_iop_colorspace_type_t;
 
+/** a run of bytes of the params holding fields, without the padding around them. */
+typedef struct dt_iop_params_span_t
+{
+  size_t offset;
+  size_t size;
+} dt_iop_params_span_t;
+
 /** part of the module which only contains the cached dlopen stuff. */
 typedef struct dt_iop_module_so_t
 {
@@ -164,6 +173,12 @@ typedef struct dt_iop_module_so_t
 
   // introspection related data
   gboolean have_introspection;
+
+  // the fields of the params as runs of bytes, built from the introspection, NULL without it.
+  // params_spans_size is the size of the params they describe.
+  dt_iop_params_span_t *params_spans;
+  int params_spans_count;
+  size_t params_spans_size;
 } dt_iop_module_so_t;
 
 typedef struct dt_iop_module_t
@@ -370,6 +385,9 @@ void dt_iop_default_init(dt_iop_module_t *module);
 void dt_iop_load_default_params(dt_iop_module_t *module);
 /** creates the module's gui widget */
 void dt_iop_gui_init(dt_iop_module_t *module);
+/** creates the module's gui widget and packs it into the expander, if that was deferred
+ * by darkroom to show only the header. Does nothing if the widget already exists. */
+void dt_iop_gui_init_lazy(dt_iop_module_t *module);
 /** reloads certain gui/param defaults when the image was switched. */
 void dt_iop_reload_defaults(dt_iop_module_t *module);
 
@@ -489,6 +507,13 @@ void dt_bauhaus_value_changed_default_callback(GtkWidget *widget);
 void dt_iop_compute_module_hash(dt_iop_module_t *module);
 void dt_iop_compute_blendop_hash(dt_iop_module_t *module);
 
+/** Hash and compare params blobs of size bytes over their fields only, as described by the introspection
+ * of so, so the padding between and after them doesn't make equal params differ.
+ * Blobs of another size than the params of so, or modules without introspection, use all of their bytes.
+*/
+uint64_t dt_iop_params_hash(const dt_iop_module_so_t *so, uint64_t hash, const void *params, const size_t size);
+gboolean dt_iop_params_equal(const dt_iop_module_so_t *so, const void *a, const void *b, const size_t size);
+
 // Use module fingerprints to determine if two instances are actually the same
 gboolean dt_iop_check_modules_equal(dt_iop_module_t *mod_1, dt_iop_module_t *mod_2);
 
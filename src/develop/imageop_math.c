@@ -90,6 +90,48 @@ void dt_iop_flip_and_zoom_8(const uint8_t *in, int32_t iw, int32_t ih, uint8_t *
   }
 }
 
+void dt_iop_downsample_8(const uint8_t *const in, const int32_t iw, const int32_t ih, uint8_t *const out,
+                         const int32_t ow, const int32_t oh, uint32_t *width, uint32_t *height)
+{
+  // DO NOT UPSCALE !!!
+  const float scale = fmaxf(1.0f, fmaxf(iw / (float)ow, ih / (float)oh));
+  const uint32_t wd = *width = MIN(ow, iw / scale);
+  const uint32_t ht = *height = MIN(oh, ih / scale);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, out, iw, ih, wd, ht, scale) \
+  schedule(static)
+#endif
+  for(uint32_t j = 0; j < ht; j++)
+  {
+    // the box of input pixels covered by the output one, partially on its edges
+    const float y0 = j * scale;
+    const float y1 = fminf((j + 1) * scale, ih);
+    for(uint32_t i = 0; i < wd; i++)
+    {
+      const float x0 = i * scale;
+      const float x1 = fminf((i + 1) * scale, iw);
+      float acc[4] = { 0.0f };
+      float weights = 0.0f;
+      for(int y = (int)y0; y < y1; y++)
+      {
+        const float wy = fminf(y + 1, y1) - fmaxf(y, y0);
+        const uint8_t *row = in + (size_t)4 * y * iw;
+        for(int x = (int)x0; x < x1; x++)
+        {
+          const float w = wy * (fminf(x + 1, x1) - fmaxf(x, x0));
+          for(int k = 0; k < 4; k++) acc[k] += w * row[4 * x + k];
+          weights += w;
+        }
+      }
+      uint8_t *const pixel = out + (size_t)4 * (j * wd + i);
+      for(int k = 0; k < 4; k++)
+        pixel[k] = (weights > 0.0f) ? CLAMP((int)(acc[k] / weights + 0.5f), 0, 255) : 0;
+    }
+  }
+}
+
 void dt_iop_clip_and_zoom_8(const uint8_t *i, int32_t ix, int32_t iy, int32_t iw, int32_t ih, int32_t ibw,
                             int32_t ibh, uint8_t *o, int32_t ox, int32_t oy, int32_t ow, int32_t oh,
                             int32_t obw, int32_t obh)
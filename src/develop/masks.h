@@ -347,6 +347,29 @@ static inline int dt_masks_get_mask_roi(const dt_iop_module_t *const module, con
   return form->functions ? form->functions->get_mask_roi(module, piece, form, roi, buffer) : 0;
 }
 
+/** cache of the rasterized shapes, shared by all pipes, see develop/masks/cache.c */
+typedef struct dt_masks_cache_t dt_masks_cache_t;
+dt_masks_cache_t *dt_masks_cache_new(const size_t max_memory);
+void dt_masks_cache_free(dt_masks_cache_t *cache);
+/** same as dt_masks_get_mask_roi(), on a zeroed buffer, but reuses what was rasterized for the same shape
+ *  and distortions at the same scale. Groups are not cached, only the shapes they hold. */
+int dt_masks_cache_get_mask_roi(dt_masks_cache_t *cache, const dt_iop_module_t *const module,
+                                const dt_dev_pixelpipe_iop_t *const piece, dt_masks_form_t *const form,
+                                const dt_iop_roi_t *const roi, float *const buffer);
+
+/** scanline rasterizers for paths and brushes, see develop/masks/rasterize.c. They return 0 on failure.
+ *  TRUE unless the old drawing was restored in the config, for comparison. */
+gboolean dt_masks_use_scanline_rasterizer(void);
+/** fill the closed polygon of `count` (x, y) points in buffer coordinates, with anti-aliased edges. */
+int dt_masks_rasterize_polygon(float *const buffer, const int width, const int height,
+                               const float *const points, const int count);
+/** draw the falloff between `count` pairs of inner and outer points: 1 on the inner line, 0 on the outer one.
+ *  payload holds (hardness, density) pairs, or is NULL for (0, 1). Consecutive pairs further apart than
+ *  max_gap are not joined. Buffer values are only increased. */
+int dt_masks_rasterize_falloff(float *const buffer, const int width, const int height,
+                               const float *const inner, const float *const outer, const float *const payload,
+                               const int count, const float max_gap);
+
 int dt_masks_group_render(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                           float **buffer, int *roi, float scale);
 int dt_masks_group_render_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
@@ -2828,6 +2828,22 @@ static int _brush_get_mask_roi(const dt_iop_module_t *const module, const dt_dev
     return 1;
   }
 
+  if(dt_masks_use_scanline_rasterizer())
+  {
+    // points are sampled about one pixel apart at full resolution
+    const int ok = dt_masks_rasterize_falloff(buffer, width, height, points + 2 * (nb_corner * 3),
+                                              border + 2 * (nb_corner * 3), payload + 2 * (nb_corner * 3),
+                                              border_count - nb_corner * 3, 4.0f * MAX(scale, 1.0f));
+    dt_free_align(points);
+    dt_free_align(border);
+    dt_free_align(payload);
+
+    if(darktable.unmuted & DT_DEBUG_PERF)
+      dt_print(DT_DEBUG_MASKS, "[masks %s] brush scanlines took %0.04f sec\n", form->name,
+               dt_get_wtime() - start);
+    return ok;
+  }
+
   // now we fill the falloff
 #ifdef _OPENMP
 #if !defined(__SUNOS__) && !defined(__NetBSD__)
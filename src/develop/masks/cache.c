@@ -0,0 +1,303 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/darktable.h"
+#include "common/debug.h"
+#include "common/dtpthread.h"
+#include "develop/masks.h"
+#include "develop/pixelpipe_hb.h"
+
+#include <limits.h>
+
+/**
+ * Cache of the rasterized shapes of drawn masks.
+ *
+ * Every pipe run used to rasterize all the shapes of a group again, though moving an unrelated
+ * slider doesn't change them. The rasterization of a shape only depends on its points, on the
+ * distortions of the pipe up to the module and on the scale: entries are found from a hash of
+ * these. Only the bounding box of the non-zero values of the mask is kept, the rest is known to be 0,
+ * so the many small strokes of a retouched image take little memory.
+ *
+ * An entry also remembers the region of interest it was rasterized for. When panning, the part
+ * of the new region already covered is copied and only the uncovered strips are rasterized.
+ */
+
+typedef struct dt_masks_cache_entry_t
+{
+  uint64_t hash;    // shape, distortions and scale
+  dt_iop_roi_t roi; // region that was rasterized
+  dt_iop_roi_t box; // bounding box of the non-zero values within roi, width is 0 if there are none
+  float *data;      // box.width * box.height values
+  size_t size;      // memory used by the entry, in bytes
+} dt_masks_cache_entry_t;
+
+struct dt_masks_cache_t
+{
+  dt_pthread_mutex_t lock; // protects everything below
+
+  GHashTable *entries;     // (uint64_t *hash, dt_masks_cache_entry_t *) pairs
+  GQueue lru;              // of dt_masks_cache_entry_t *, most recently used first
+  size_t memory;           // memory used by all the entries
+  size_t max_memory;
+};
+
+static void _entry_free(dt_masks_cache_entry_t *entry)
+{
+  dt_free_align(entry->data);
+  free(entry);
+}
+
+dt_masks_cache_t *dt_masks_cache_new(const size_t max_memory)
+{
+  dt_masks_cache_t *cache = (dt_masks_cache_t *)calloc(1, sizeof(dt_masks_cache_t));
+  if(!cache) return NULL;
+  dt_pthread_mutex_init(&cache->lock, NULL);
+  cache->entries = g_hash_table_new(g_int64_hash, g_int64_equal);
+  g_queue_init(&cache->lru);
+  cache->max_memory = max_memory;
+  return cache;
+}
+
+void dt_masks_cache_free(dt_masks_cache_t *cache)
+{
+  if(!cache) return;
+  g_hash_table_destroy(cache->entries);
+  g_queue_free_full(&cache->lru, (GDestroyNotify)_entry_free);
+  dt_pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+// everything the rasterization of a shape depends on
+static uint64_t _shape_hash(const dt_dev_pixelpipe_iop_t *const piece, const dt_masks_form_t *const form,
+                            const float scale)
+{
+  const dt_dev_pixelpipe_t *const pipe = piece->pipe;
+  uint64_t hash = dt_hash(5381, (const char *)&pipe->image.id, sizeof(int32_t));
+  hash = dt_hash(hash, (const char *)&pipe->iwidth, sizeof(int));
+  hash = dt_hash(hash, (const char *)&pipe->iheight, sizeof(int));
+  hash = dt_hash(hash, (const char *)&piece->distort_hash, sizeof(uint64_t));
+  hash = dt_hash(hash, (const char *)&scale, sizeof(float));
+
+  hash = dt_hash(hash, (const char *)&form->type, sizeof(dt_masks_type_t));
+  hash = dt_hash(hash, (const char *)&form->formid, sizeof(int));
+  hash = dt_hash(hash, (const char *)&form->version, sizeof(int));
+  hash = dt_hash(hash, (const char *)form->source, sizeof(form->source));
+  for(const GList *pts = form->points; pts; pts = g_list_next(pts))
+    hash = dt_hash(hash, (const char *)pts->data, form->functions->point_struct_size);
+  return hash;
+}
+
+static dt_iop_roi_t _intersect(const dt_iop_roi_t *const a, const dt_iop_roi_t *const b)
+{
+  const int x = MAX(a->x, b->x);
+  const int y = MAX(a->y, b->y);
+  const int width = MIN(a->x + a->width, b->x + b->width) - x;
+  const int height = MIN(a->y + a->height, b->y + b->height) - y;
+  return (dt_iop_roi_t){ x, y, MAX(width, 0), MAX(height, 0), a->scale };
+}
+
+// Find the parts of roi not covered by its intersection `in` with the cached region.
+// Returns how many strips need to be rasterized, or -1 if rasterizing the whole roi is cheaper.
+static int _uncovered_strips(const dt_iop_roi_t *const roi, const dt_iop_roi_t *const in, dt_iop_roi_t strips[4])
+{
+  if(in->width == 0 || in->height == 0) return -1;
+
+  int n = 0;
+  const float scale = roi->scale;
+  // above and below: full width of roi
+  if(in->y > roi->y)
+    strips[n++] = (dt_iop_roi_t){ roi->x, roi->y, roi->width, in->y - roi->y, scale };
+  if(in->y + in->height < roi->y + roi->height)
+    strips[n++] = (dt_iop_roi_t){ roi->x, in->y + in->height, roi->width,
+                                   roi->y + roi->height - in->y - in->height, scale };
+  // left and right: height of the intersection
+  if(in->x > roi->x)
+    strips[n++] = (dt_iop_roi_t){ roi->x, in->y, in->x - roi->x, in->height, scale };
+  if(in->x + in->width < roi->x + roi->width)
+    strips[n++] = (dt_iop_roi_t){ in->x + in->width, in->y, roi->x + roi->width - in->x - in->width,
+                                   in->height, scale };
+
+  // every strip computes the outline of the shape again
+  const size_t uncovered = (size_t)roi->width * roi->height - (size_t)in->width * in->height;
+  if(n > 2 || 2 * uncovered > (size_t)roi->width * roi->height) return -1;
+  return n;
+}
+
+// copy the rows of `region` (absolute coordinates) from src, laid out as src_roi, to dst, laid out as dst_roi
+static void _blit(float *const restrict dst, const dt_iop_roi_t *const dst_roi, const float *const restrict src,
+                  const dt_iop_roi_t *const src_roi, const dt_iop_roi_t *const region)
+{
+  for(int y = 0; y < region->height; y++)
+  {
+    const size_t d = (size_t)(region->y + y - dst_roi->y) * dst_roi->width + region->x - dst_roi->x;
+    const size_t s = (size_t)(region->y + y - src_roi->y) * src_roi->width + region->x - src_roi->x;
+    memcpy(dst + d, src + s, sizeof(float) * region->width);
+  }
+}
+
+// bounding box of the non-zero values of buffer, laid out as roi
+static dt_iop_roi_t _nonzero_box(const float *const restrict buffer, const dt_iop_roi_t *const roi)
+{
+  int xmin = INT_MAX, xmax = -1, ymin = INT_MAX, ymax = -1;
+  const int width = roi->width;
+  const int height = roi->height;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buffer, width, height) \
+  reduction(min : xmin, ymin) reduction(max : xmax, ymax) schedule(static)
+#endif
+  for(int y = 0; y < height; y++)
+  {
+    const float *const row = buffer + (size_t)y * width;
+    int first = -1, last = -1;
+    for(int x = 0; x < width; x++)
+      if(row[x] != 0.0f)
+      {
+        if(first < 0) first = x;
+        last = x;
+      }
+    if(first < 0) continue;
+    xmin = MIN(xmin, first);
+    xmax = MAX(xmax, last);
+    ymin = MIN(ymin, y);
+    ymax = MAX(ymax, y);
+  }
+
+  if(xmax < 0) return (dt_iop_roi_t){ roi->x, roi->y, 0, 0, roi->scale };
+  return (dt_iop_roi_t){ roi->x + xmin, roi->y + ymin, xmax - xmin + 1, ymax - ymin + 1, roi->scale };
+}
+
+static void _store(dt_masks_cache_t *cache, const uint64_t hash, const dt_iop_roi_t *const roi,
+                   const float *const buffer)
+{
+  dt_masks_cache_entry_t *entry = (dt_masks_cache_entry_t *)calloc(1, sizeof(dt_masks_cache_entry_t));
+  if(!entry) return;
+  entry->hash = hash;
+  entry->roi = *roi;
+  entry->box = _nonzero_box(buffer, roi);
+
+  const size_t values = (size_t)entry->box.width * entry->box.height;
+  entry->size = sizeof(dt_masks_cache_entry_t) + values * sizeof(float);
+  if(entry->size > cache->max_memory)
+  {
+    free(entry);
+    return;
+  }
+  if(values)
+  {
+    entry->data = dt_alloc_align_float(values);
+    if(!entry->data)
+    {
+      free(entry);
+      return;
+    }
+    _blit(entry->data, &entry->box, buffer, roi, &entry->box);
+  }
+
+  dt_pthread_mutex_lock(&cache->lock);
+
+  // replace the previous region of the same shape
+  dt_masks_cache_entry_t *old = (dt_masks_cache_entry_t *)g_hash_table_lookup(cache->entries, &hash);
+  if(old)
+  {
+    g_hash_table_remove(cache->entries, &old->hash);
+    g_queue_remove(&cache->lru, old);
+    cache->memory -= old->size;
+    _entry_free(old);
+  }
+
+  g_hash_table_insert(cache->entries, &entry->hash, entry);
+  g_queue_push_head(&cache->lru, entry);
+  cache->memory += entry->size;
+
+  while(cache->memory > cache->max_memory)
+  {
+    dt_masks_cache_entry_t *last = (dt_masks_cache_entry_t *)g_queue_pop_tail(&cache->lru);
+    g_hash_table_remove(cache->entries, &last->hash);
+    cache->memory -= last->size;
+    _entry_free(last);
+  }
+
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+int dt_masks_cache_get_mask_roi(dt_masks_cache_t *cache, const dt_iop_module_t *const module,
+                                const dt_dev_pixelpipe_iop_t *const piece, dt_masks_form_t *const form,
+                                const dt_iop_roi_t *const roi, float *const buffer)
+{
+  // groups are only as constant as the shapes they hold, which are cached themselves
+  if(!cache || !form->functions || (form->type & DT_MASKS_GROUP))
+    return dt_masks_get_mask_roi(module, piece, form, roi, buffer);
+
+  const double start = dt_get_wtime();
+  const uint64_t hash = _shape_hash(piece, form, roi->scale);
+
+  dt_iop_roi_t strips[4];
+  int nstrips = -1;
+
+  dt_pthread_mutex_lock(&cache->lock);
+  dt_masks_cache_entry_t *entry = (dt_masks_cache_entry_t *)g_hash_table_lookup(cache->entries, &hash);
+  if(entry)
+  {
+    const dt_iop_roi_t in = _intersect(roi, &entry->roi);
+    nstrips = _uncovered_strips(roi, &in, strips);
+    if(nstrips >= 0)
+    {
+      // only the non-zero part, buffer is zeroed
+      const dt_iop_roi_t copied = _intersect(&in, &entry->box);
+      if(copied.width && copied.height) _blit(buffer, roi, entry->data, &entry->box, &copied);
+      g_queue_remove(&cache->lru, entry);
+      g_queue_push_head(&cache->lru, entry);
+    }
+  }
+  dt_pthread_mutex_unlock(&cache->lock);
+
+  if(nstrips < 0)
+  {
+    if(!dt_masks_get_mask_roi(module, piece, form, roi, buffer)) return 0;
+  }
+  else
+  {
+    for(int k = 0; k < nstrips; k++)
+    {
+      float *const strip = dt_alloc_align_float((size_t)strips[k].width * strips[k].height);
+      if(!strip) return 0;
+      memset(strip, 0, sizeof(float) * strips[k].width * strips[k].height);
+      const int ok = dt_masks_get_mask_roi(module, piece, form, &strips[k], strip);
+      if(ok) _blit(buffer, roi, strip, &strips[k], &strips[k]);
+      dt_free_align(strip);
+      if(!ok) return 0;
+    }
+  }
+
+  // a region contained in the cached one adds nothing to it
+  if(nstrips != 0) _store(cache, hash, roi, buffer);
+
+  if(darktable.unmuted & DT_DEBUG_PERF)
+    dt_print(DT_DEBUG_MASKS, "[masks %s] %s took %0.04f sec\n", form->name,
+             nstrips < 0 ? "rasterization" : nstrips ? "partial rasterization" : "cached shape",
+             dt_get_wtime() - start);
+
+  return 1;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
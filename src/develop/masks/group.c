@@ -375,86 +375,36 @@ error:
   return 0;
 }
 
-static void _combine_masks_union(float *const restrict dest, float *const restrict newmask, const size_t npixels,
-                                 const float opacity, const int inverted)
+/* The shapes of a group are combined row by row. Within the bounding box of a shape, its mask is
+   opacity * newmask (or opacity * (1 - newmask) when inverted), that is a + b * newmask. Outside of it the
+   shape is zero and the mask is the constant a, so newmask is NULL for these parts of the rows. */
+typedef void(_combine_row_func)(float *const restrict dest, const float *const restrict newmask, const int n,
+                                const float a, const float b);
+
+static void _combine_row_union(float *const restrict dest, const float *const restrict newmask, const int n,
+                               const float a, const float b)
 {
-  if (inverted)
-  {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
-#endif
-    for(int index = 0; index < npixels; index++)
+  if(newmask)
+    for(int k = 0; k < n; k++)
     {
-      const float mask = opacity * (1.0f - newmask[index]);
-      dest[index] = MAX(dest[index], mask);
+      const float mask = a + b * newmask[k];
+      dest[k] = MAX(dest[k], mask);
     }
-  }
   else
-  {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
-#endif
-    for(int index = 0; index < npixels; index++)
-    {
-      const float mask = opacity * newmask[index];
-      dest[index] = MAX(dest[index], mask);
-    }
-  }
+    for(int k = 0; k < n; k++) dest[k] = MAX(dest[k], a);
 }
 
-static void _combine_masks_intersect(float *const restrict dest, float *const restrict newmask, const size_t npixels,
-                                     const float opacity, const int inverted)
+static void _combine_row_intersect(float *const restrict dest, const float *const restrict newmask, const int n,
+                                   const float a, const float b)
 {
-  if (inverted)
-  {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
-#endif
-    for(int index = 0; index < npixels; index++)
+  if(newmask)
+    for(int k = 0; k < n; k++)
     {
-      const float mask = opacity * (1.0f - newmask[index]);
-      dest[index] = MIN(MAX(dest[index], 0.0f), MAX(mask, 0.0f));
+      const float mask = a + b * newmask[k];
+      dest[k] = MIN(MAX(dest[k], 0.0f), MAX(mask, 0.0f));
     }
-  }
   else
-  {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
-#endif
-    for(int index = 0; index < npixels; index++)
-    {
-      const float mask = opacity * newmask[index];
-      dest[index] = MIN(MAX(dest[index], 0.0f), MAX(mask, 0.0f));
-    }
-  }
+    for(int k = 0; k < n; k++) dest[k] = MIN(MAX(dest[k], 0.0f), MAX(a, 0.0f));
 }
 
 #ifdef _OPENMP
@@ -466,94 +416,117 @@ static inline int both_positive(const float val1, const float val2)
   return (val1 > 0.0f) && (val2 > 0.0f);
 }
 
-static void _combine_masks_difference(float *const restrict dest, float *const restrict newmask, const size_t npixels,
-                                      const float opacity, const int inverted)
+static void _combine_row_difference(float *const restrict dest, const float *const restrict newmask, const int n,
+                                    const float a, const float b)
 {
-  if (inverted)
-  {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
-#endif
-    for(int index = 0; index < npixels; index++)
+  if(newmask)
+    for(int k = 0; k < n; k++)
     {
-      const float mask = opacity * (1.0f - newmask[index]);
-      dest[index] *= (1.0f - mask * both_positive(dest[index],mask));
+      const float mask = a + b * newmask[k];
+      dest[k] *= (1.0f - mask * both_positive(dest[k], mask));
     }
-  }
   else
-  {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
-#endif
-    for(int index = 0; index < npixels; index++)
-    {
-      const float mask = opacity * newmask[index];
-      dest[index] *= (1.0f - mask * both_positive(dest[index],mask));
-    }
-  }
+    for(int k = 0; k < n; k++) dest[k] *= (1.0f - a * both_positive(dest[k], a));
 }
 
-static void _combine_masks_exclusion(float *const restrict dest, float *const restrict newmask, const size_t npixels,
-                                     const float opacity, const int inverted)
+static inline float _exclusion(const float b1, const float mask)
 {
-  if (inverted)
-  {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
-#endif
-    for(int index = 0; index < npixels; index++)
-    {
-      const float mask = opacity * (1.0f - newmask[index]);
-      const float pos = both_positive(dest[index], mask);
-      const float neg = (1.0f - pos);
-      const float b1 = dest[index];
-      dest[index] = pos * MAX((1.0f - b1) * mask, b1 * (1.0f - mask)) + neg * MAX(b1, mask);
-    }
-  }
+  const float pos = both_positive(b1, mask);
+  const float neg = (1.0f - pos);
+  return pos * MAX((1.0f - b1) * mask, b1 * (1.0f - mask)) + neg * MAX(b1, mask);
+}
+
+static void _combine_row_exclusion(float *const restrict dest, const float *const restrict newmask, const int n,
+                                   const float a, const float b)
+{
+  if(newmask)
+    for(int k = 0; k < n; k++) dest[k] = _exclusion(dest[k], a + b * newmask[k]);
   else
-  {
+    for(int k = 0; k < n; k++) dest[k] = _exclusion(dest[k], a);
+}
+
+// no combination: copy the shape and null other parts
+static void _combine_row_copy(float *const restrict dest, const float *const restrict newmask, const int n,
+                              const float a, const float b)
+{
+  if(newmask)
+    for(int k = 0; k < n; k++) dest[k] = a + b * newmask[k];
+  else
+    for(int k = 0; k < n; k++) dest[k] = a;
+}
+
+// combine the shape held by newmask over box (in roi coordinates) into the width x height dest
+static void _combine_masks(float *const restrict dest, const float *const restrict newmask, const int width,
+                           const int height, const dt_iop_roi_t *const box, const int state, const float opacity,
+                           const int inverted)
+{
+  _combine_row_func *combine = _combine_row_copy;
+  if(state & DT_MASKS_STATE_UNION)
+    combine = _combine_row_union;
+  else if(state & DT_MASKS_STATE_INTERSECTION)
+    combine = _combine_row_intersect;
+  else if(state & DT_MASKS_STATE_DIFFERENCE)
+    combine = _combine_row_difference;
+  else if(state & DT_MASKS_STATE_EXCLUSION)
+    combine = _combine_row_exclusion;
+
+  const float a = inverted ? opacity : 0.0f;
+  const float b = inverted ? -opacity : opacity;
+
+  // adding or removing a null shape leaves dest alone, only the box needs work then
+  const gboolean outside = !(a == 0.0f && (combine == _combine_row_union || combine == _combine_row_difference));
+  const int y0 = outside ? 0 : box->y;
+  const int y1 = outside ? height : box->y + box->height;
+  const int x1 = box->x + box->width;
+
 #ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(dest, newmask, width, box, combine, a, b, outside, y0, y1, x1) \
+  schedule(static)
 #endif
-#endif
-    for(int index = 0; index < npixels; index++)
+  for(int y = y0; y < y1; y++)
+  {
+    float *const row = dest + (size_t)y * width;
+    if(y >= box->y && y < box->y + box->height && box->width > 0)
     {
-      const float mask = opacity * newmask[index];
-      const float pos = both_positive(dest[index], mask);
-      const float neg = (1.0f - pos);
-      const float b1 = dest[index];
-      dest[index] = pos * MAX((1.0f - b1) * mask, b1 * (1.0f - mask)) + neg * MAX(b1, mask);
+      if(outside)
+      {
+        combine(row, NULL, box->x, a, b);
+        combine(row + x1, NULL, width - x1, a, b);
+      }
+      combine(row + box->x, newmask + (size_t)(y - box->y) * box->width, box->width, a, b);
     }
+    else
+      combine(row, NULL, width, a, b);
   }
 }
 
+// the part of the roi where the shape can be non-zero, empty if the shape misses the roi entirely
+static dt_iop_roi_t _shape_box(const dt_iop_module_t *const module, const dt_dev_pixelpipe_iop_t *const piece,
+                               dt_masks_form_t *const form, const dt_iop_roi_t *const roi)
+{
+  dt_iop_roi_t box = { 0, 0, roi->width, roi->height, roi->scale };
+
+  // groups and failed transforms: the whole roi
+  int w = 0, h = 0, px = 0, py = 0;
+  if(!form->functions || !form->functions->get_area
+     || !form->functions->get_area(module, piece, form, &w, &h, &px, &py))
+    return box;
+
+  // the area is at full scale, keep a couple of pixels of reserve for the rounding of the shapes
+  const int x0 = CLAMP((int)floorf(px * roi->scale - roi->x) - 2, 0, roi->width);
+  const int y0 = CLAMP((int)floorf(py * roi->scale - roi->y) - 2, 0, roi->height);
+  const int x1 = CLAMP((int)ceilf((px + w) * roi->scale - roi->x) + 2, 0, roi->width);
+  const int y1 = CLAMP((int)ceilf((py + h) * roi->scale - roi->y) + 2, 0, roi->height);
+
+  box.x = x0;
+  box.y = y0;
+  box.width = MAX(x1 - x0, 0);
+  box.height = MAX(y1 - y0, 0);
+  if(box.width == 0 || box.height == 0) box.width = box.height = 0;
+  return box;
+}
+
 static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
                                const dt_dev_pixelpipe_iop_t *const restrict piece,
                                dt_masks_form_t *const form, const dt_iop_roi_t *const roi,
@@ -565,63 +538,64 @@ static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
 
   const int width = roi->width;
   const int height = roi->height;
-  const size_t npixels = (size_t)width * height;
 
-  // we need to allocate a zeroed temporary buffer for intermediate creation of individual shapes
-  float *const restrict bufs = dt_alloc_align_float(npixels);
-  if(bufs == NULL) return 0;
+  // the shapes are only rendered over their bounding box, the temporary buffer fits the largest one
+  const guint nb = g_list_length(form->points);
+  dt_masks_form_t **sels = calloc(nb, sizeof(dt_masks_form_t *));
+  dt_iop_roi_t *boxes = calloc(nb, sizeof(dt_iop_roi_t));
+  if(!sels || !boxes)
+  {
+    free(sels);
+    free(boxes);
+    return 0;
+  }
+
+  size_t max_size = 0;
+  int pos = 0;
+  for(GList *fpts = form->points; fpts; fpts = g_list_next(fpts), pos++)
+  {
+    dt_masks_point_group_t *fpt = (dt_masks_point_group_t *)fpts->data;
+    sels[pos] = dt_masks_get_from_id(module->dev, fpt->formid);
+    if(!sels[pos]) continue;
+    boxes[pos] = _shape_box(module, piece, sels[pos], roi);
+    max_size = MAX(max_size, (size_t)boxes[pos].width * boxes[pos].height);
+  }
+
+  // we need a temporary buffer for intermediate creation of individual shapes
+  float *const restrict bufs = max_size ? dt_alloc_align_float(max_size) : NULL;
+  if(max_size && bufs == NULL)
+  {
+    free(sels);
+    free(boxes);
+    return 0;
+  }
 
   // and we get all masks
-  for(GList *fpts = form->points; fpts; fpts = g_list_next(fpts))
+  pos = 0;
+  for(GList *fpts = form->points; fpts; fpts = g_list_next(fpts), pos++)
   {
     dt_masks_point_group_t *fpt = (dt_masks_point_group_t *)fpts->data;
-    dt_masks_form_t *sel = dt_masks_get_from_id(module->dev, fpt->formid);
+    dt_masks_form_t *sel = sels[pos];
 
     if(sel)
     {
-      // ensure that we start with a zeroed buffer regardless of what was previously written into 'bufs'
-      memset(bufs, 0, npixels*sizeof(float));
-      const int ok = dt_masks_get_mask_roi(module, piece, sel, roi, bufs);
-      const float op = fpt->opacity;
-      const int state = fpt->state;
+      const dt_iop_roi_t *const box = &boxes[pos];
+      int ok = 1;
+      if(box->width && box->height)
+      {
+        // the shape over its box only, the roi it is rendered for is offset accordingly
+        const dt_iop_roi_t shape_roi
+            = { roi->x + box->x, roi->y + box->y, box->width, box->height, roi->scale };
+        // ensure that we start with a zeroed buffer regardless of what was previously written into 'bufs'
+        memset(bufs, 0, (size_t)box->width * box->height * sizeof(float));
+        ok = dt_masks_cache_get_mask_roi(darktable.masks_cache, module, piece, sel, &shape_roi, bufs);
+      }
 
       if(ok)
       {
         // first see if we need to invert this shape
-        const int inverted = (state & DT_MASKS_STATE_INVERSE);
-
-        if(state & DT_MASKS_STATE_UNION)
-        {
-          _combine_masks_union(buffer, bufs, npixels, op, inverted);
-        }
-        else if(state & DT_MASKS_STATE_INTERSECTION)
-        {
-          _combine_masks_intersect(buffer, bufs, npixels, op, inverted);
-        }
-        else if(state & DT_MASKS_STATE_DIFFERENCE)
-        {
-          _combine_masks_difference(buffer, bufs, npixels, op, inverted);
-        }
-        else if(state & DT_MASKS_STATE_EXCLUSION)
-        {
-          _combine_masks_exclusion(buffer, bufs, npixels, op, inverted);
-        }
-        else // if we are here, this mean that we just have to copy the shape and null other parts
-        {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-          dt_omp_firstprivate(npixels, op, inverted) \
-          dt_omp_sharedconst(buffer, bufs) schedule(simd:static) aligned(buffer, bufs : 64)
-#else
-#pragma omp parallel for shared(bufs, buffer)
-#endif
-#endif
-          for(int index = 0; index < npixels; index++)
-          {
-            buffer[index] = op * (inverted ? (1.0f - bufs[index]) : bufs[index]);
-          }
-        }
+        const int inverted = (fpt->state & DT_MASKS_STATE_INVERSE);
+        _combine_masks(buffer, bufs, width, height, box, fpt->state, fpt->opacity, inverted);
 
         if(darktable.unmuted & DT_DEBUG_PERF)
           dt_print(DT_DEBUG_MASKS, "[masks %d] combine took %0.04f sec\n", nb_ok, dt_get_wtime() - start);
@@ -633,6 +607,8 @@ static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
   }
   // and we free the intermediate buffer
   dt_free_align(bufs);
+  free(sels);
+  free(boxes);
 
   return nb_ok != 0;
 }
@@ -2745,6 +2745,7 @@ static int _path_get_mask_roi(const dt_iop_module_t *const module, const dt_dev_
   const int width = roi->width;
   const int height = roi->height;
   const float scale = roi->scale;
+  const gboolean scanline = dt_masks_use_scanline_rasterizer();
 
   // we need to take care of four different cases:
   // 1) path and feather are outside of roi
@@ -2911,6 +2912,26 @@ static int _path_get_mask_roi(const dt_iop_module_t *const module, const dt_dev_
       // roi lies completely within path
       for(size_t k = 0; k < (size_t)width * height; k++) buffer[k] = 1.0f;
     }
+    else if(scanline)
+    {
+      // the whole path, clipping is done line by line
+      const int ok = dt_masks_rasterize_polygon(buffer, width, height, points + 2 * (nb_corner * 3),
+                                                points_count - nb_corner * 3);
+      if(!ok)
+      {
+        dt_free_align(cpoints);
+        dt_free_align(points);
+        dt_free_align(border);
+        return 0;
+      }
+
+      if(darktable.unmuted & DT_DEBUG_PERF)
+      {
+        dt_print(DT_DEBUG_MASKS, "[masks %s] path_fill scanlines took %0.04f sec\n", form->name,
+                 dt_get_wtime() - start2);
+        start2 = dt_get_wtime();
+      }
+    }
     else
     {
       // all other cases
@@ -2972,7 +2993,7 @@ static int _path_get_mask_roi(const dt_iop_module_t *const module, const dt_dev_
 #if !defined(__SUNOS__) && !defined(__NetBSD__)
 #pragma omp parallel for default(none) \
   dt_omp_firstprivate(xxmin, xxmax, yymin, yymax, width) \
-  shared(buffer) schedule(static) num_threads(MIN(8,darktable.num_openmp_threads))
+  shared(buffer) schedule(static) num_threads(MIN(8,dt_omp_threads()))
 #else
 #pragma omp parallel for shared(buffer)
 #endif
@@ -3000,7 +3021,63 @@ static int _path_get_mask_roi(const dt_iop_module_t *const module, const dt_dev_
   }
 
   // deal with feather if it does not lie outside of roi
-  if(!path_encircles_roi)
+  if(!path_encircles_roi && scanline)
+  {
+    float *inner = dt_alloc_align_float((size_t)2 * border_count);
+    float *outer = dt_alloc_align_float((size_t)2 * border_count);
+    if(inner == NULL || outer == NULL)
+    {
+      dt_free_align(inner);
+      dt_free_align(outer);
+      dt_free_align(points);
+      dt_free_align(border);
+      return 0;
+    }
+
+    // pair each point of the path with its border point, following the same skips as below
+    int nb = 0;
+    int next = 0;
+    for(int i = nb_corner * 3; i < border_count; i++)
+    {
+      const int k = next > 0 ? next : i;
+      float pf1[2] = { border[k * 2], border[k * 2 + 1] };
+
+      if(next == i) next = 0;
+      while(isnan(pf1[0]))
+      {
+        if(isnan(pf1[1]))
+          next = i - 1;
+        else
+          next = pf1[1];
+        pf1[0] = border[next * 2];
+        pf1[1] = border[next * 2 + 1];
+      }
+
+      inner[nb * 2] = points[i * 2];
+      inner[nb * 2 + 1] = points[i * 2 + 1];
+      outer[nb * 2] = pf1[0];
+      outer[nb * 2 + 1] = pf1[1];
+      nb++;
+    }
+
+    // points are sampled about one pixel apart at full resolution
+    const int ok = dt_masks_rasterize_falloff(buffer, width, height, inner, outer, NULL, nb, 4.0f * MAX(scale, 1.0f));
+    dt_free_align(inner);
+    dt_free_align(outer);
+    if(!ok)
+    {
+      dt_free_align(points);
+      dt_free_align(border);
+      return 0;
+    }
+
+    if(darktable.unmuted & DT_DEBUG_PERF)
+    {
+      dt_print(DT_DEBUG_MASKS, "[masks %s] path_fill falloff scanlines took %0.04f sec\n", form->name,
+               dt_get_wtime() - start2);
+    }
+  }
+  else if(!path_encircles_roi)
   {
     int *dpoints = dt_alloc_align(sizeof(int) * 4 * border_count);
     if(dpoints == NULL)
@@ -0,0 +1,419 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/darktable.h"
+#include "control/conf.h"
+#include "develop/masks.h"
+
+#include <float.h>
+
+/**
+ * Scanline rasterization of the outlines computed by paths and brushes.
+ *
+ * Pixel (x, y) is centered on integer coordinates, like in the shapes code.
+ * Edges and triangles are first bucketed by the rows they touch: each row then only visits its active
+ * edges, independently of the others, so rows are processed in parallel and write to their own pixels.
+ *
+ * Polygons get an exact horizontal coverage on SUBSCANLINES samples per row, which anti-aliases their
+ * outline. Falloffs are ribbons of quads between an inner and an outer line, split in two triangles
+ * over which the falloff parameters are interpolated linearly, so there are no gaps between the segments.
+ */
+
+#define SUBSCANLINES 4
+// tolerance on the inclusion of pixel centers in triangles, so that shared edges don't leave cracks
+#define TRIANGLE_EPS 1e-4f
+
+gboolean dt_masks_use_scanline_rasterizer(void)
+{
+  return dt_conf_get_bool("masks_scanline_rasterizer");
+}
+
+// Rows [first[i], last[i]] are touched by item i, first[i] > last[i] if none.
+// Fills start[height + 1] and returns the items indices of row r in items[start[r]] .. items[start[r + 1] - 1].
+static int *_bucket_rows(const int *const first, const int *const last, const int count, const int height,
+                         int *const start)
+{
+  memset(start, 0, sizeof(int) * (height + 1));
+  for(int i = 0; i < count; i++)
+    for(int r = first[i]; r <= last[i]; r++) start[r + 1]++;
+  for(int r = 0; r < height; r++) start[r + 1] += start[r];
+
+  int *const items = dt_alloc_align(sizeof(int) * MAX(start[height], 1));
+  int *const pos = dt_alloc_align(sizeof(int) * MAX(height, 1));
+  if(!items || !pos)
+  {
+    dt_free_align(items);
+    dt_free_align(pos);
+    return NULL;
+  }
+  memcpy(pos, start, sizeof(int) * height);
+  for(int i = 0; i < count; i++)
+    for(int r = first[i]; r <= last[i]; r++) items[pos[r]++] = i;
+  dt_free_align(pos);
+  return items;
+}
+
+typedef struct _edge_t
+{
+  float x0, y0, y1; // y0 < y1
+  float dxdy;
+} _edge_t;
+
+// add w * the length of [a, b[ covering each pixel, in pixel edge coordinates (pixel x is [x, x+1[)
+static inline void _add_span(float *const restrict cover, float *const restrict diff, float a, float b,
+                             const float lo, const float hi, const float w)
+{
+  a = CLAMP(a, lo, hi);
+  b = CLAMP(b, lo, hi);
+  if(b <= a) return;
+  const int ia = (int)a;
+  const int ib = (int)b;
+  if(ia == ib)
+  {
+    cover[ia] += (b - a) * w;
+    return;
+  }
+  cover[ia] += ((float)(ia + 1) - a) * w;
+  // the full pixels in between, accumulated at the end
+  diff[ia + 1] += w;
+  diff[ib] -= w;
+  cover[ib] += (b - (float)ib) * w;
+}
+
+int dt_masks_rasterize_polygon(float *const buffer, const int width, const int height,
+                               const float *const points, const int count)
+{
+  if(count < 3 || width <= 0 || height <= 0) return 1;
+
+  _edge_t *const edges = dt_alloc_align(sizeof(_edge_t) * count);
+  int *const first = dt_alloc_align(sizeof(int) * count);
+  int *const last = dt_alloc_align(sizeof(int) * count);
+  int *const start = dt_alloc_align(sizeof(int) * (height + 1));
+  if(!edges || !first || !last || !start)
+  {
+    dt_free_align(edges);
+    dt_free_align(first);
+    dt_free_align(last);
+    dt_free_align(start);
+    return 0;
+  }
+
+  float xmin = FLT_MAX, xmax = -FLT_MAX;
+  int nb_edges = 0;
+  for(int i = 0; i < count; i++)
+  {
+    const int j = (i + 1 < count) ? i + 1 : 0;
+    float xa = points[2 * i], ya = points[2 * i + 1];
+    float xb = points[2 * j], yb = points[2 * j + 1];
+    if(!isfinite(xa) || !isfinite(ya) || !isfinite(xb) || !isfinite(yb) || ya == yb) continue;
+    if(ya > yb)
+    {
+      float tmp;
+      tmp = xa, xa = xb, xb = tmp;
+      tmp = ya, ya = yb, yb = tmp;
+    }
+
+    // rows whose sub-scanlines, in ]r - 0.5, r + 0.5[, may cross the edge
+    first[nb_edges] = MAX((int)floorf(ya + 0.5f), 0);
+    last[nb_edges] = MIN((int)floorf(yb + 0.5f), height - 1);
+    if(first[nb_edges] > last[nb_edges]) continue;
+
+    edges[nb_edges] = (_edge_t){ xa, ya, yb, (xb - xa) / (yb - ya) };
+    xmin = MIN(xmin, MIN(xa, xb));
+    xmax = MAX(xmax, MAX(xa, xb));
+    nb_edges++;
+  }
+
+  int *const items = nb_edges ? _bucket_rows(first, last, nb_edges, height, start) : NULL;
+  dt_free_align(first);
+  dt_free_align(last);
+  if(!nb_edges)
+  {
+    dt_free_align(edges);
+    dt_free_align(start);
+    return 1;
+  }
+  if(!items)
+  {
+    dt_free_align(edges);
+    dt_free_align(start);
+    return 0;
+  }
+
+  // columns that can be covered, in pixel edge coordinates
+  const int cmin = CLAMP((int)floorf(xmin + 0.5f), 0, width - 1);
+  const int cmax = CLAMP((int)floorf(xmax + 0.5f), 0, width - 1);
+  const float lo = cmin;
+  const float hi = cmax + 1;
+
+  int max_active = 0;
+  for(int r = 0; r < height; r++) max_active = MAX(max_active, start[r + 1] - start[r]);
+
+  // per thread: crossings, then coverage and its difference array over the columns
+  size_t padded_size;
+  float *const scratch = dt_alloc_perthread_float(max_active + 2 * (size_t)(width + 2), &padded_size);
+  if(!scratch)
+  {
+    dt_free_align(edges);
+    dt_free_align(start);
+    dt_free_align(items);
+    return 0;
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buffer, width, height, edges, start, items, scratch, padded_size, max_active, cmin, cmax, lo, hi) \
+  schedule(dynamic, 16)
+#endif
+  for(int r = 0; r < height; r++)
+  {
+    const int nb_active = start[r + 1] - start[r];
+    if(nb_active < 2) continue;
+
+    float *const restrict xs = dt_get_perthread(scratch, padded_size);
+    float *const restrict cover = xs + max_active;
+    float *const restrict diff = cover + width + 2;
+    memset(cover + cmin, 0, sizeof(float) * (cmax - cmin + 2));
+    memset(diff + cmin, 0, sizeof(float) * (cmax - cmin + 2));
+
+    for(int s = 0; s < SUBSCANLINES; s++)
+    {
+      const float y = (float)r - 0.5f + ((float)s + 0.5f) / SUBSCANLINES;
+
+      int n = 0;
+      for(int k = start[r]; k < start[r + 1]; k++)
+      {
+        const _edge_t *const e = edges + items[k];
+        if(y < e->y0 || y >= e->y1) continue;
+        // insertion sort: there are only a few crossings per line
+        const float x = e->x0 + (y - e->y0) * e->dxdy + 0.5f;
+        int m = n++;
+        for(; m > 0 && xs[m - 1] > x; m--) xs[m] = xs[m - 1];
+        xs[m] = x;
+      }
+
+      // even-odd rule, like the edge-flag fill
+      for(int k = 0; k + 1 < n; k += 2)
+        _add_span(cover, diff, xs[k], xs[k + 1], lo, hi, 1.0f / SUBSCANLINES);
+    }
+
+    float *const restrict out = buffer + (size_t)r * width;
+    float full = 0.0f;
+    for(int x = cmin; x <= cmax; x++)
+    {
+      full += diff[x];
+      out[x] = MAX(out[x], CLAMP(cover[x] + full, 0.0f, 1.0f));
+    }
+  }
+
+  dt_free_align(scratch);
+  dt_free_align(edges);
+  dt_free_align(start);
+  dt_free_align(items);
+  return 1;
+}
+
+typedef struct _triangle_t
+{
+  float x[3], y[3];
+  // affine parameters f(x, y) = f0 + fx * x + fy * y:
+  // position across the ribbon (0 on the inner line, 1 on the outer line) and along it
+  float t0, tx, ty;
+  float s0, sx, sy;
+  // hardness and density at both ends of the quad
+  float hardness[2], density[2];
+} _triangle_t;
+
+// returns FALSE for flat triangles, that don't cover anything
+static gboolean _triangle_init(_triangle_t *const tri, const float *const p0, const float *const p1,
+                               const float *const p2, const float t[3], const float s[3],
+                               const float hardness[2], const float density[2], const int height,
+                               int *const first, int *const last)
+{
+  const float area2 = (p1[0] - p0[0]) * (p2[1] - p0[1]) - (p2[0] - p0[0]) * (p1[1] - p0[1]);
+  if(fabsf(area2) < 1e-6f) return FALSE;
+
+  const float *const p[3] = { p0, p1, p2 };
+  for(int k = 0; k < 3; k++)
+  {
+    tri->x[k] = p[k][0];
+    tri->y[k] = p[k][1];
+  }
+
+  const float dx1 = p1[0] - p0[0], dy1 = p1[1] - p0[1];
+  const float dx2 = p2[0] - p0[0], dy2 = p2[1] - p0[1];
+  tri->tx = ((t[1] - t[0]) * dy2 - (t[2] - t[0]) * dy1) / area2;
+  tri->ty = ((t[2] - t[0]) * dx1 - (t[1] - t[0]) * dx2) / area2;
+  tri->t0 = t[0] - tri->tx * p0[0] - tri->ty * p0[1];
+  tri->sx = ((s[1] - s[0]) * dy2 - (s[2] - s[0]) * dy1) / area2;
+  tri->sy = ((s[2] - s[0]) * dx1 - (s[1] - s[0]) * dx2) / area2;
+  tri->s0 = s[0] - tri->sx * p0[0] - tri->sy * p0[1];
+
+  for(int k = 0; k < 2; k++)
+  {
+    tri->hardness[k] = hardness[k];
+    tri->density[k] = density[k];
+  }
+
+  const float ymin = MIN(MIN(p0[1], p1[1]), p2[1]);
+  const float ymax = MAX(MAX(p0[1], p1[1]), p2[1]);
+  *first = MAX((int)ceilf(ymin - TRIANGLE_EPS), 0);
+  *last = MIN((int)floorf(ymax + TRIANGLE_EPS), height - 1);
+  return TRUE;
+}
+
+// horizontal extent of the triangle on line y
+static inline void _triangle_span(const _triangle_t *const tri, const float y, float *const xl, float *const xr)
+{
+  float l = FLT_MAX, r = -FLT_MAX;
+  for(int k = 0; k < 3; k++)
+  {
+    const int j = (k + 1) % 3;
+    const float ya = tri->y[k], yb = tri->y[j];
+    if(y < MIN(ya, yb) - TRIANGLE_EPS || y > MAX(ya, yb) + TRIANGLE_EPS) continue;
+    if(fabsf(yb - ya) < 1e-6f)
+    {
+      l = MIN(l, MIN(tri->x[k], tri->x[j]));
+      r = MAX(r, MAX(tri->x[k], tri->x[j]));
+      continue;
+    }
+    const float u = CLAMP((y - ya) / (yb - ya), 0.0f, 1.0f);
+    const float x = tri->x[k] + u * (tri->x[j] - tri->x[k]);
+    l = MIN(l, x);
+    r = MAX(r, x);
+  }
+  *xl = l;
+  *xr = r;
+}
+
+int dt_masks_rasterize_falloff(float *const buffer, const int width, const int height,
+                               const float *const inner, const float *const outer, const float *const payload,
+                               const int count, const float max_gap)
+{
+  if(count < 2 || width <= 0 || height <= 0) return 1;
+
+  const size_t max_triangles = 2 * (size_t)(count - 1);
+  _triangle_t *const triangles = dt_alloc_align(sizeof(_triangle_t) * max_triangles);
+  int *const first = dt_alloc_align(sizeof(int) * max_triangles);
+  int *const last = dt_alloc_align(sizeof(int) * max_triangles);
+  int *const start = dt_alloc_align(sizeof(int) * (height + 1));
+  if(!triangles || !first || !last || !start)
+  {
+    dt_free_align(triangles);
+    dt_free_align(first);
+    dt_free_align(last);
+    dt_free_align(start);
+    return 0;
+  }
+
+  const float max_gap2 = max_gap * max_gap;
+  int nb = 0;
+  for(int k = 0; k + 1 < count; k++)
+  {
+    const float *const c0 = inner + 2 * k;
+    const float *const c1 = inner + 2 * (k + 1);
+    const float *const b0 = outer + 2 * k;
+    const float *const b1 = outer + 2 * (k + 1);
+    if(!isfinite(c0[0] + c0[1] + c1[0] + c1[1] + b0[0] + b0[1] + b1[0] + b1[1])) continue;
+
+    // consecutive segments far apart don't belong to the same part of the outline
+    if(sqf(c1[0] - c0[0]) + sqf(c1[1] - c0[1]) > max_gap2
+       || sqf(b1[0] - b0[0]) + sqf(b1[1] - b0[1]) > max_gap2)
+      continue;
+
+    // nothing to draw outside of the buffer
+    const float ymin = MIN(MIN(c0[1], c1[1]), MIN(b0[1], b1[1]));
+    const float ymax = MAX(MAX(c0[1], c1[1]), MAX(b0[1], b1[1]));
+    const float xmin = MIN(MIN(c0[0], c1[0]), MIN(b0[0], b1[0]));
+    const float xmax = MAX(MAX(c0[0], c1[0]), MAX(b0[0], b1[0]));
+    if(ymax < -1.0f || ymin > height || xmax < -1.0f || xmin > width) continue;
+
+    const float hardness[2] = { payload ? payload[2 * k] : 0.0f, payload ? payload[2 * (k + 1)] : 0.0f };
+    const float density[2] = { payload ? payload[2 * k + 1] : 1.0f, payload ? payload[2 * (k + 1) + 1] : 1.0f };
+
+    // the quad (c0, c1, b1, b0), cut along its diagonal (c0, b1)
+    const float t_a[3] = { 0.0f, 0.0f, 1.0f }, s_a[3] = { 0.0f, 1.0f, 1.0f };
+    const float t_b[3] = { 0.0f, 1.0f, 1.0f }, s_b[3] = { 0.0f, 1.0f, 0.0f };
+    if(_triangle_init(triangles + nb, c0, c1, b1, t_a, s_a, hardness, density, height, first + nb, last + nb))
+      nb++;
+    if(_triangle_init(triangles + nb, c0, b1, b0, t_b, s_b, hardness, density, height, first + nb, last + nb))
+      nb++;
+  }
+
+  int *const items = nb ? _bucket_rows(first, last, nb, height, start) : NULL;
+  dt_free_align(first);
+  dt_free_align(last);
+  if(!nb || !items)
+  {
+    dt_free_align(triangles);
+    dt_free_align(start);
+    dt_free_align(items);
+    return nb ? 0 : 1;
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buffer, width, height, triangles, start, items) \
+  schedule(dynamic, 16)
+#endif
+  for(int r = 0; r < height; r++)
+  {
+    float *const restrict out = buffer + (size_t)r * width;
+    const float y = r;
+    for(int k = start[r]; k < start[r + 1]; k++)
+    {
+      const _triangle_t *const tri = triangles + items[k];
+      float xl, xr;
+      _triangle_span(tri, y, &xl, &xr);
+      const int x0 = MAX((int)ceilf(xl - TRIANGLE_EPS), 0);
+      const int x1 = MIN((int)floorf(xr + TRIANGLE_EPS), width - 1);
+
+      const float t_row = tri->t0 + tri->ty * y;
+      const float s_row = tri->s0 + tri->sy * y;
+      const float tx = tri->tx, sx = tri->sx;
+      const float h0 = tri->hardness[0], dh = tri->hardness[1] - tri->hardness[0];
+      const float d0 = tri->density[0], dd = tri->density[1] - tri->density[0];
+
+      // solid up to the hardness, then a linear falloff to 0 on the outer line
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int x = x0; x <= x1; x++)
+      {
+        const float t = CLAMP(t_row + tx * x, 0.0f, 1.0f);
+        const float s = CLAMP(s_row + sx * x, 0.0f, 1.0f);
+        const float hardness = h0 + dh * s;
+        const float density = d0 + dd * s;
+        const float falloff = (1.0f - t) / fmaxf(1.0f - hardness, 1e-6f);
+        const float op = density * fminf(falloff, 1.0f);
+        out[x] = fmaxf(out[x], op);
+      }
+    }
+  }
+
+  dt_free_align(triangles);
+  dt_free_align(start);
+  dt_free_align(items);
+  return 1;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
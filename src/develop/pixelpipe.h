@@ -53,6 +53,10 @@ typedef struct dt_dev_histogram_collection_params_t
   uint32_t bins_count;
   /** in most cases, bins_count-1. */
   float mul;
+  /** only used for drawing: large regions are sampled, see DT_HISTOGRAM_DISPLAY_PIXELS. */
+  gboolean for_display;
+  /** distance between the sampled rows and columns, set by dt_histogram_worker(). */
+  int step;
 } dt_dev_histogram_collection_params_t;
 
 // params used to collect histogram during last histogram capture
@@ -0,0 +1,146 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "develop/pixelpipe_aux.h"
+#include "common/darktable.h"
+#include "common/iop_profile.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe_cache.h"
+#include "develop/pixelpipe_hb.h"
+
+#include <string.h>
+
+uint64_t dt_dev_pixelpipe_input_hash(const dt_dev_pixelpipe_iop_t *piece)
+{
+  uint64_t hash = piece->global_hash;
+  for(const GList *node = g_list_first(piece->pipe->nodes); node && node->data != piece; node = g_list_next(node))
+  {
+    const dt_dev_pixelpipe_iop_t *const prev = (const dt_dev_pixelpipe_iop_t *)node->data;
+    if(prev->enabled) hash = prev->global_hash;
+  }
+  return hash;
+}
+
+float *dt_dev_pixelpipe_aux_plane_get(dt_dev_pixelpipe_iop_t *piece, const float *const input,
+                                      const dt_iop_roi_t *const roi_in, const int cst, const char *type,
+                                      const void *const params, const size_t params_size,
+                                      dt_dev_pixelpipe_aux_compute_t compute, const void *const data,
+                                      gboolean *cached)
+{
+  const size_t width = roi_in->width;
+  const size_t height = roi_in->height;
+  const size_t num_elem = width * height;
+  *cached = FALSE;
+
+  // the type string keeps the plane from colliding with the input line itself, which has the same upstream hash
+  uint64_t hash = dt_dev_pixelpipe_input_hash(piece);
+  hash = dt_hash(hash, type, strlen(type));
+  hash = dt_hash(hash, (const char *)roi_in, sizeof(dt_iop_roi_t));
+  hash = dt_hash(hash, (const char *)&cst, sizeof(int));
+  if(params_size) hash = dt_hash(hash, (const char *)params, params_size);
+
+  dt_iop_buffer_dsc_t dsc = piece->dsc_in;
+  dsc.channels = 1;
+  dsc.datatype = TYPE_FLOAT;
+  dt_iop_buffer_dsc_t *plane_dsc = &dsc;
+  void *cache_data = NULL;
+  const int missing = dt_dev_pixelpipe_cache_get(piece->pipe->cache, &piece->pipe->cache_client, hash,
+                                                 num_elem * sizeof(float), &cache_data, &plane_dsc);
+  float *plane = (float *)cache_data;
+
+  if(plane)
+  {
+    // the line stays pinned by the pipe while the module uses it
+    *cached = TRUE;
+    if(missing)
+    {
+      compute(input, plane, width, height, data);
+      dt_dev_pixelpipe_cache_ready(piece->pipe->cache, plane);
+    }
+    else
+      dt_print(DT_DEBUG_PIPE, "[pixelpipe_aux] reusing %s of the input of %s (%s) in pipe %i\n", type,
+               piece->module->op, piece->module->multi_name, piece->pipe->type);
+  }
+  else
+  {
+    // out of cache budget : compute in a private buffer
+    plane = dt_alloc_align_float(num_elem);
+    if(plane) compute(input, plane, width, height, data);
+  }
+
+  return plane;
+}
+
+typedef struct _norm_data_t
+{
+  dt_iop_rgb_norms_t norm;
+  const dt_iop_order_iccprofile_info_t *profile;
+} _norm_data_t;
+
+__DT_CLONE_TARGETS__
+static void _compute_norm(const float *const input, float *const plane, const size_t width, const size_t height,
+                          const void *const data)
+{
+  const _norm_data_t *const d = (const _norm_data_t *)data;
+  const dt_iop_rgb_norms_t norm = d->norm;
+  const dt_iop_order_iccprofile_info_t *const profile = d->profile;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(input, plane, width, height, norm, profile) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < width * height; k++) plane[k] = dt_rgb_norm(input + 4 * k, norm, profile);
+}
+
+float *dt_dev_pixelpipe_aux_norm_get(dt_dev_pixelpipe_iop_t *piece, const float *const input,
+                                     const dt_iop_roi_t *const roi_in, const int cst,
+                                     const dt_iop_rgb_norms_t norm,
+                                     const dt_iop_order_iccprofile_info_t *const profile, gboolean *cached)
+{
+  // only the luminance depends on the profile, and only on those members
+  struct
+  {
+    dt_iop_rgb_norms_t norm;
+    dt_colorspaces_color_profile_type_t type;
+    dt_iop_color_intent_t intent;
+    dt_colormatrix_t matrix_in;
+    char filename[DT_IOP_COLOR_ICC_LEN];
+  } params;
+  memset(&params, 0, sizeof(params));
+  params.norm = norm;
+  if(profile && norm == DT_RGB_NORM_LUMINANCE)
+  {
+    params.type = profile->type;
+    params.intent = profile->intent;
+    memcpy(params.matrix_in, profile->matrix_in, sizeof(dt_colormatrix_t));
+    g_strlcpy(params.filename, profile->filename, sizeof(params.filename));
+  }
+
+  const _norm_data_t data = { .norm = norm, .profile = profile };
+  return dt_dev_pixelpipe_aux_plane_get(piece, input, roi_in, cst, "rgb_norm", &params, sizeof(params),
+                                        _compute_norm, &data, cached);
+}
+
+void dt_dev_pixelpipe_aux_release(float *plane, const gboolean cached)
+{
+  if(plane && !cached) dt_free_align(plane);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
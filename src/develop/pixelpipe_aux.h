@@ -0,0 +1,79 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/rgb_norms.h"
+
+struct dt_dev_pixelpipe_iop_t;
+struct dt_iop_roi_t;
+
+/**
+ * Auxiliary planes of module inputs: per-pixel norms, luminance and other single-channel maps
+ * derived from the input buffer of a module only.
+ *
+ * They are kept in the pixelpipe cache, next to the images, keyed by the state of the upstream pipe
+ * (see dt_dev_pixelpipe_input_hash()), the ROI, the colorspace of the buffer and the type of the plane.
+ * So a plane survives the edits of the parameters of the module that requested it, is shared by all
+ * the pipes that feed the module with the same input, and between a module and its blending when they
+ * request the same type, instead of each of them recomputing it and spending the memory bandwidth.
+ *
+ * The type is a short string naming the plane, plus the bytes of the parameters it depends on.
+ * Planes of the same type and parameters must be computed the same way by all the requesters.
+ */
+
+/** signature of the functions filling a width x height plane from the 4-channel input */
+typedef void (*dt_dev_pixelpipe_aux_compute_t)(const float *const input, float *const plane, const size_t width,
+                                               const size_t height, const void *const data);
+
+/** hash of the input of the piece: the global hash of the last enabled module upstream, or its own if first. */
+uint64_t dt_dev_pixelpipe_input_hash(const struct dt_dev_pixelpipe_iop_t *piece);
+
+/**
+ * Get the plane of the given type computed from input, that covers roi_in and is in colorspace cst.
+ * The plane is computed by compute() with data if it is not cached yet.
+ * *cached is set to TRUE when the plane belongs to the pixelpipe cache: it stays pinned by the pipe while the
+ * module processes, and must not be written nor freed. Otherwise, the cache was out of budget and the plane was
+ * allocated for the caller. Always hand it back to dt_dev_pixelpipe_aux_release(). Returns NULL if out of memory.
+ */
+float *dt_dev_pixelpipe_aux_plane_get(struct dt_dev_pixelpipe_iop_t *piece, const float *const input,
+                                      const struct dt_iop_roi_t *const roi_in, const int cst, const char *type,
+                                      const void *const params, const size_t params_size,
+                                      dt_dev_pixelpipe_aux_compute_t compute, const void *const data,
+                                      gboolean *cached);
+
+/**
+ * Same as above for the dt_rgb_norm() of the input, using profile for DT_RGB_NORM_LUMINANCE.
+ * profile may be NULL to fall back to the camera RGB luminance.
+ */
+float *dt_dev_pixelpipe_aux_norm_get(struct dt_dev_pixelpipe_iop_t *piece, const float *const input,
+                                     const struct dt_iop_roi_t *const roi_in, const int cst,
+                                     const dt_iop_rgb_norms_t norm,
+                                     const dt_iop_order_iccprofile_info_t *const profile, gboolean *cached);
+
+/** release a plane obtained above */
+void dt_dev_pixelpipe_aux_release(float *plane, const gboolean cached);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
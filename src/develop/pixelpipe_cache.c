@@ -17,6 +17,8 @@
 */
 
 #include "develop/pixelpipe_cache.h"
+#include "common/numa.h"
+#include "common/opencl.h"
 #include "develop/format.h"
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
@@ -24,188 +26,628 @@
 #include <stdlib.h>
 
 
-// TODO: make cache global (needs to be thread safe then)
-// plan:
-// - look at mipmap_cache.c, for the full buffer allocs
-// - do that, but for `large' and `regular' buffers (full + export/dr mode), so 2 caches
-//   (in fact, maybe 3, one for preview pipes?)
-// - have at most 3 read locks all the time per pipe, get them at create time
-//   ping, pong, and priority buffer (focused plugin)
-// - drop read by the time another is requested (with priority, drop that, or alternating ping and pong?)
+typedef struct dt_dev_pixelpipe_cache_line_t
+{
+  uint64_t hash;            // integrity hash of the content, -1 if invalid
+  void *data;
+  size_t size;              // allocated size of data, in bytes
+  dt_iop_buffer_dsc_t dsc;
+  int64_t age;              // value of the cache clock when last used, shifted by the weight
+  int pins;                 // number of client slots pinning this line
+  gboolean pending;         // reserved by its owner, content not written yet
+  const dt_dev_pixelpipe_cache_client_t *owner; // client that wrote the content
+  void *cl_mem;             // device buffer holding the content instead of data, or NULL
+  int devid;                // device of cl_mem
+  int width, height;        // size of cl_mem, in pixels
+  size_t bpp;               // bytes per pixel of cl_mem
+  gboolean half_float;      // may be kept as half floats once evicted, see the client
+  uint16_t *packed;         // content as half floats instead of data, which is then NULL
+  GList link;               // our node in the LRU queue, data points to this line
+} dt_dev_pixelpipe_cache_line_t;
+
+
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, size_t max_memory)
+{
+  dt_pthread_mutex_init(&cache->lock, NULL);
+  cache->lines = g_hash_table_new(g_int64_hash, g_int64_equal);
+  cache->buffers = g_hash_table_new(g_direct_hash, g_direct_equal);
+  g_queue_init(&cache->lru);
+  cache->current_memory = 0;
+  cache->max_memory = max_memory;
+  cache->current_gpu_memory = 0;
+  cache->max_gpu_memory = 0;
+  cache->clock = 0;
+  cache->queries = cache->misses = 0;
+  return (cache->lines && cache->buffers);
+}
+
+static inline size_t _line_device_size(const dt_dev_pixelpipe_cache_line_t *line)
+{
+  return (size_t)line->width * line->height * line->bpp;
+}
+
+static void _line_release_device(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_line_t *line)
+{
+  if(!line->cl_mem) return;
+  dt_opencl_release_mem_object(line->cl_mem);
+  line->cl_mem = NULL;
+  cache->current_gpu_memory -= _line_device_size(line);
+}
+
+static inline size_t _packed_size(const dt_dev_pixelpipe_cache_line_t *line)
+{
+  return line->size / sizeof(float) * sizeof(uint16_t);
+}
+
+static void _line_free(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_line_t *line)
+{
+  _line_release_device(cache, line);
+  if(line->hash != (uint64_t)-1) g_hash_table_remove(cache->lines, &line->hash);
+  g_hash_table_remove(cache->buffers, line->data);
+  g_queue_unlink(&cache->lru, &line->link);
+  if(line->packed)
+  {
+    cache->current_memory -= _packed_size(line);
+    dt_free_align(line->packed);
+  }
+  else
+  {
+    cache->current_memory -= line->size;
+    ASAN_UNPOISON_MEMORY_REGION(line->data, line->size);
+    dt_free_align(line->data);
+  }
+  free(line);
+}
 
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size)
+void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
 {
-  cache->entries = entries;
-  cache->data = (void **)calloc(entries, sizeof(void *));
-  cache->size = (size_t *)calloc(entries, sizeof(size_t));
-  cache->dsc = (dt_iop_buffer_dsc_t *)calloc(entries, sizeof(dt_iop_buffer_dsc_t));
-#ifdef _DEBUG
-  memset(cache->dsc, 0x2c, sizeof(dt_iop_buffer_dsc_t) * entries);
+  // all clients should have been released by now
+  while(cache->lru.head)
+    _line_free(cache, (dt_dev_pixelpipe_cache_line_t *)cache->lru.head->data);
+
+  g_hash_table_destroy(cache->lines);
+  g_hash_table_destroy(cache->buffers);
+  cache->lines = cache->buffers = NULL;
+  dt_pthread_mutex_destroy(&cache->lock);
+}
+
+static inline void _line_invalidate(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_line_t *line)
+{
+  line->pending = FALSE;
+  _line_release_device(cache, line);
+  if(line->hash == (uint64_t)-1) return;
+  // the key is owned by the line, remove it from the index before changing it
+  g_hash_table_remove(cache->lines, &line->hash);
+  line->hash = -1;
+  // pinned lines may still be read by some pipe
+  if(!line->pins && line->data) ASAN_POISON_MEMORY_REGION(line->data, line->size);
+}
+
+static inline void _line_touch(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_line_t *line,
+                               const int weight)
+{
+  line->age = cache->clock - weight;
+  // bubble up in LRU queue
+  g_queue_unlink(&cache->lru, &line->link);
+  g_queue_push_tail_link(&cache->lru, &line->link);
+}
+
+static inline void _line_pin(dt_dev_pixelpipe_cache_client_t *client, dt_dev_pixelpipe_cache_line_t *line)
+{
+  // the oldest pin of the client gets replaced by this one
+  dt_dev_pixelpipe_cache_line_t *old = client->pinned[client->pos];
+  if(old) old->pins--;
+  client->pinned[client->pos] = line;
+  line->pins++;
+  client->pos = (client->pos + 1) % DT_PIXELPIPE_CACHE_PINS;
+}
+
+static inline gboolean _line_is_protected(const dt_dev_pixelpipe_cache_t *cache,
+                                          const dt_dev_pixelpipe_cache_line_t *line)
+{
+  // pinned lines may still be read or written by some pipe,
+  // reweighted lines are protected for a certain number of queries.
+  return line->pins > 0 || line->age > cache->clock;
+}
+
+// IEEE 754 binary16 conversions, rounding to nearest even. Out of range values saturate, NaN stays NaN.
+static inline uint16_t _float_to_half(const float f)
+{
+  union { float f; uint32_t u; } v = { .f = f };
+  const uint32_t sign = (v.u >> 16) & 0x8000;
+  const uint32_t bits = v.u & 0x7fffffff;
+
+  if(bits > 0x7f800000) return sign | 0x7e00;      // NaN
+  if(bits >= 0x477ff000) return sign | 0x7bff;     // rounds above 65504: saturate, inf included
+  if(bits < 0x38800000)
+  {
+    // subnormal half, or zero
+    if(bits < 0x33000000) return sign;
+    const uint32_t shift = 126 - (bits >> 23);
+    const uint32_t mant = (bits & 0x7fffff) | 0x800000;
+    const uint32_t half = mant >> shift;
+    const uint32_t rest = mant & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    return sign | (half + (rest > halfway || (rest == halfway && (half & 1))));
+  }
+  const uint32_t rounded = bits + 0xfff + ((bits >> 13) & 1);
+  return sign | ((rounded - 0x38000000) >> 13);
+}
+
+static inline float _half_to_float(const uint16_t h)
+{
+  const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  const uint32_t exp = (h >> 10) & 0x1f;
+  const uint32_t mant = h & 0x3ff;
+  union { float f; uint32_t u; } v;
+
+  if(exp == 0)
+  {
+    // subnormal half: mant * 2^-24, exact in float
+    v.f = mant * (1.0f / 16777216.0f);
+    v.u |= sign;
+  }
+  else if(exp == 31)
+    v.u = sign | 0x7f800000 | (mant << 13);
+  else
+    v.u = sign | ((exp + 112) << 23) | (mant << 13);
+  return v.f;
+}
+
+// lines of clients asking for it are kept as half floats when evicted, they take half the memory
+static inline gboolean _line_can_pack(const dt_dev_pixelpipe_cache_line_t *line)
+{
+  return line->half_float && !line->packed && !line->pending && !line->cl_mem && line->hash != (uint64_t)-1
+         && line->dsc.datatype == TYPE_FLOAT && line->dsc.channels == 4;
+}
+
+// to be called with cache->lock held, on a line nobody reads. returns FALSE if it couldn't be packed.
+static gboolean _line_pack(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_line_t *line)
+{
+  const size_t count = line->size / sizeof(float);
+  uint16_t *packed = dt_alloc_align(_packed_size(line));
+  if(!packed) return FALSE;
+
+  const float *const in = (const float *)line->data;
+  ASAN_UNPOISON_MEMORY_REGION(line->data, line->size);
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) dt_omp_firstprivate(in, packed, count) schedule(static)
 #endif
-  cache->hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
-  cache->used = (int32_t *)calloc(entries, sizeof(int32_t));
-  for(int k = 0; k < entries; k++)
-  {
-    cache->size[k] = size;
-    if(size)
-    { // allow 0 initial buffer size (yet unknown dimensions)
-      cache->data[k] = (void *)dt_alloc_align(size);
-      if(!cache->data[k]) goto alloc_memory_fail;
-#ifdef _DEBUG
-      memset(cache->data[k], 0x5d, size);
+  for(size_t k = 0; k < count; k++) packed[k] = _float_to_half(in[k]);
+
+  g_hash_table_remove(cache->buffers, line->data);
+  dt_free_align(line->data);
+  line->data = NULL;
+  line->packed = packed;
+  cache->current_memory -= line->size - _packed_size(line);
+  return TRUE;
+}
+
+// back to floats before anybody reads the line. to be called with cache->lock held,
+// returns FALSE if the line was lost.
+static gboolean _line_unpack(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_line_t *line)
+{
+  if(!line->packed) return TRUE;
+
+  const size_t count = line->size / sizeof(float);
+  float *out = dt_alloc_aligned(line->size, 4096);
+  if(!out)
+  {
+    _line_invalidate(cache, line);
+    return FALSE;
+  }
+
+  const uint16_t *const packed = line->packed;
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) dt_omp_firstprivate(out, packed, count) schedule(static)
 #endif
-      ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
+  for(size_t k = 0; k < count; k++) out[k] = _half_to_float(packed[k]);
+
+  dt_free_align(line->packed);
+  line->packed = NULL;
+  line->data = out;
+  g_hash_table_insert(cache->buffers, line->data, line);
+  cache->current_memory += line->size - _packed_size(line);
+  return TRUE;
+}
+
+// Find the least recently used line that we can recycle to store `size` bytes.
+// Invalid lines are preferred over valid ones.
+static dt_dev_pixelpipe_cache_line_t *_find_recyclable(dt_dev_pixelpipe_cache_t *cache, const size_t size)
+{
+  dt_dev_pixelpipe_cache_line_t *candidate = NULL;
+  for(GList *l = cache->lru.head; l; l = g_list_next(l))
+  {
+    dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)l->data;
+    // don't waste more than twice the memory when recycling, packed lines have no buffer to give
+    if(line->packed || line->size < size || line->size > 2 * size || _line_is_protected(cache, line)) continue;
+    if(line->hash == (uint64_t)-1) return line;
+    if(!candidate) candidate = line;
+  }
+
+  // Only recycle valid lines if we are out of budget. Otherwise, keep them.
+  if(candidate && cache->current_memory + size > cache->max_memory)
+    return candidate;
+
+  return NULL;
+}
+
+// Free least recently used lines until we have room for `size` more bytes.
+// Lines that can be packed to half floats are packed the first time instead, and freed the next.
+static void _evict(dt_dev_pixelpipe_cache_t *cache, const size_t size)
+{
+  for(int pass = 0; pass < 2; pass++)
+  {
+    GList *l = cache->lru.head;
+    while(l && cache->current_memory + size > cache->max_memory)
+    {
+      dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)l->data;
+      l = g_list_next(l); // we might remove this element, so walk to the next one while we still have the pointer..
+      if(_line_is_protected(cache, line)) continue;
+      if(pass == 0 && _line_can_pack(line) && _line_pack(cache, line)) continue;
+      _line_free(cache, line);
     }
-    else cache->data[k] = 0;
-    cache->hash[k] = -1;
-    cache->used[k] = 0;
   }
-  cache->queries = cache->misses = 0;
-  return 1;
+}
 
-alloc_memory_fail:
-  //  dt_dev_pixelpipe_cache_cleanup(cache);
-  // The above code seems to be not correct as failing to allocate the cache->data buffers
-  // should not cleanup the whole pixelpipe cache but only reset the buffers to null.
-  // A warning about low memory will appear but the pipeline still has valid data so dt won't crash
-  // but will only fail to generate thumbnails for example.
-  for(int k = 0; k < cache->entries; k++)
+// Get an invalid, unindexed line of at least `size` bytes, recycled or newly allocated.
+// `fresh` tells if its buffer has just been allocated.
+static dt_dev_pixelpipe_cache_line_t *_reserve(dt_dev_pixelpipe_cache_t *cache, const size_t size,
+                                               gboolean *fresh)
+{
+  *fresh = FALSE;
+  dt_dev_pixelpipe_cache_line_t *line = _find_recyclable(cache, size);
+  if(line)
   {
-    dt_free_align(cache->data[k]);
-    cache->size[k] = 0;
-    cache->data[k] = NULL;
+    _line_invalidate(cache, line);
+    return line;
   }
-  return 0;
+
+  _evict(cache, size);
+
+  line = (dt_dev_pixelpipe_cache_line_t *)calloc(1, sizeof(dt_dev_pixelpipe_cache_line_t));
+  // page-aligned, so OpenCL devices with unified memory can use it in place (see dt_opencl_use_host_memory())
+  void *buffer = line ? dt_alloc_aligned(size, 4096) : NULL;
+  if(!buffer)
+  {
+    fprintf(stderr, "[pixelpipe_cache] failed to allocate %zu bytes for a new cache line\n", size);
+    free(line);
+    return NULL;
+  }
+  *fresh = TRUE;
+  line->hash = -1;
+  line->data = buffer;
+  line->size = size;
+  line->link.data = line;
+  g_hash_table_insert(cache->buffers, line->data, line);
+  g_queue_push_tail_link(&cache->lru, &line->link);
+  cache->current_memory += size;
+  return line;
 }
 
-void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
+void dt_dev_pixelpipe_cache_client_init(dt_dev_pixelpipe_cache_client_t *client)
 {
-  for(int k = 0; k < cache->entries; k++) dt_free_align(cache->data[k]);
-  free(cache->data);
-  free(cache->dsc);
-  free(cache->hash);
-  free(cache->used);
-  free(cache->size);
+  memset(client, 0, sizeof(dt_dev_pixelpipe_cache_client_t));
+}
+
+void dt_dev_pixelpipe_cache_client_release(dt_dev_pixelpipe_cache_t *cache,
+                                           dt_dev_pixelpipe_cache_client_t *client)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  for(int k = 0; k < DT_PIXELPIPE_CACHE_PINS; k++)
+  {
+    if(client->pinned[k]) client->pinned[k]->pins--;
+    client->pinned[k] = NULL;
+  }
+  client->pos = 0;
+
+  for(GList *l = cache->lru.head; l; l = g_list_next(l))
+  {
+    dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)l->data;
+    if(line->owner != client) continue;
+    // nobody will ever complete this one
+    if(line->pending) _line_invalidate(cache, line);
+    line->owner = NULL;
+  }
+  dt_pthread_mutex_unlock(&cache->lock);
 }
 
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
 {
-  // search for hash in cache
-  for(int32_t k = 0; k < cache->entries; k++)
-    if(cache->hash[k] == hash) return 1;
-  return 0;
+  dt_pthread_mutex_lock(&cache->lock);
+  const dt_dev_pixelpipe_cache_line_t *line
+      = (dt_dev_pixelpipe_cache_line_t *)g_hash_table_lookup(cache->lines, &hash);
+  const int available = (line && !line->pending);
+  dt_pthread_mutex_unlock(&cache->lock);
+  return available;
 }
 
-int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache,const uint64_t hash,
-                               const size_t size, void **data, dt_iop_buffer_dsc_t **dsc)
+int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_client_t *client,
+                               const uint64_t hash, const size_t size, void **data, dt_iop_buffer_dsc_t **dsc)
 {
-  return dt_dev_pixelpipe_cache_get_weighted(cache, hash, size, data, dsc, 0);
+  return dt_dev_pixelpipe_cache_get_weighted(cache, client, hash, size, data, dsc, 0);
 }
 
-int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash,
-                                        const size_t size, void **data, dt_iop_buffer_dsc_t **dsc, int weight)
+// Write the content kept on the device to the host buffer, and free the device buffer.
+// This blocks the cache during the copy, but it only happens when a line computed on a GPU
+// is read by a CPU module, or by a pipe running on another device.
+// returns FALSE if the content is lost. to be called with cache->lock held
+static gboolean _line_to_host(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_line_t *line)
 {
-  cache->queries++;
-  *data = NULL;
-  int max_used = -1;
-  size_t index_max = 0;
-  size_t sz = 0;
-  for(int k = 0; k < cache->entries; k++)
+  if(!line->cl_mem) return TRUE;
+
+#ifdef HAVE_OPENCL
+  ASAN_UNPOISON_MEMORY_REGION(line->data, line->size);
+  const cl_int err = dt_opencl_copy_device_to_host(line->devid, line->data, line->cl_mem, line->width,
+                                                   line->height, line->bpp);
+  if(err == CL_SUCCESS)
   {
-    // search for hash in cache
-    if(cache->used[k] > max_used)
-    {
-      max_used = cache->used[k];
-      index_max = k;
-    }
+    _line_release_device(cache, line);
+    return TRUE;
+  }
+#endif
 
-    cache->used[k]++; // age all entries
+  dt_print(DT_DEBUG_OPENCL, "[pixelpipe_cache] couldn't copy a cache line back from device %i\n", line->devid);
+  _line_invalidate(cache, line);
+  return FALSE;
+}
 
-    if(cache->hash[k] == hash)
-    {
-      *data = cache->data[k];
-      *dsc = &cache->dsc[k];
-      sz = cache->size[k];
-      cache->used[k] = weight; // this is the MRU entry
+// to be called with cache->lock held. returns FALSE if the content of the line was lost.
+static gboolean _line_hit(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_client_t *client,
+                          dt_dev_pixelpipe_cache_line_t *line, const size_t size, void **data,
+                          dt_iop_buffer_dsc_t **dsc, const int weight)
+{
+  if(!_line_to_host(cache, line) || !_line_unpack(cache, line)) return FALSE;
 
-      ASAN_POISON_MEMORY_REGION(*data, sz);
-      ASAN_UNPOISON_MEMORY_REGION(*data, size);
-    }
+  // this is the MRU entry
+  _line_touch(cache, line, weight);
+  _line_pin(client, line);
+  *data = line->data;
+  *dsc = &line->dsc;
+
+  if(line->pins == 1) ASAN_POISON_MEMORY_REGION(line->data, line->size);
+  ASAN_UNPOISON_MEMORY_REGION(line->data, size);
+  return TRUE;
+}
+
+int dt_dev_pixelpipe_cache_get_existing(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_client_t *client,
+                                        const uint64_t hash, const size_t size, void **data,
+                                        dt_iop_buffer_dsc_t **dsc)
+{
+  return dt_dev_pixelpipe_cache_get_existing_device(cache, client, hash, size, data, dsc, -1, NULL);
+}
+
+int dt_dev_pixelpipe_cache_get_existing_device(dt_dev_pixelpipe_cache_t *cache,
+                                               dt_dev_pixelpipe_cache_client_t *client,
+                                               const uint64_t hash, const size_t size, void **data,
+                                               dt_iop_buffer_dsc_t **dsc, const int devid, void **cl_mem)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  cache->queries++;
+  cache->clock++;
+  if(cl_mem) *cl_mem = NULL;
+
+  dt_dev_pixelpipe_cache_line_t *line
+      = (dt_dev_pixelpipe_cache_line_t *)g_hash_table_lookup(cache->lines, &hash);
+  int found = (line && !line->pending && line->size >= size);
+  if(found && cl_mem && devid >= 0 && line->cl_mem && line->devid == devid)
+  {
+    // the caller takes the device buffer, the line is pending again until it gets it back
+    _line_touch(cache, line, 0);
+    _line_pin(client, line);
+    *data = line->data;
+    *dsc = &line->dsc;
+    *cl_mem = line->cl_mem;
+    line->cl_mem = NULL;
+    cache->current_gpu_memory -= _line_device_size(line);
+    line->pending = TRUE;
+    line->owner = client;
+    ASAN_UNPOISON_MEMORY_REGION(line->data, size);
   }
+  else if(found)
+    found = _line_hit(cache, client, line, size, data, dsc, 0);
+
+  if(!found) cache->misses++;
+
+  dt_pthread_mutex_unlock(&cache->lock);
+  return found;
+}
+
+int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_client_t *client,
+                                        const uint64_t hash, const size_t size, void **data,
+                                        dt_iop_buffer_dsc_t **dsc, int weight)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  cache->queries++;
+  cache->clock++;
+  *data = NULL;
+
+  dt_dev_pixelpipe_cache_line_t *line
+      = (dt_dev_pixelpipe_cache_line_t *)g_hash_table_lookup(cache->lines, &hash);
 
-  if(!*data || sz < size)
+  if(line && !line->pending && line->size >= size)
   {
-    // kill LRU entry
-    // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", index_max, cache->entries,
-    // weight);
-    if(cache->size[index_max] < size)
+    if(_line_hit(cache, client, line, size, data, dsc, weight))
     {
-      dt_free_align(cache->data[index_max]);
-      cache->data[index_max] = (void *)dt_alloc_align(size);
-      cache->size[index_max] = size;
+      dt_pthread_mutex_unlock(&cache->lock);
+      return 0;
     }
-    *data = cache->data[index_max];
-    sz = cache->size[index_max];
+    line = NULL; // lost with its device buffer, and not indexed anymore
+  }
 
-    ASAN_POISON_MEMORY_REGION(*data, sz);
-    ASAN_UNPOISON_MEMORY_REGION(*data, size);
+  const gboolean computed_elsewhere = (line && line->pending && line->owner != client);
 
-    // first, update our copy, then update the pointer to point at our copy
-    cache->dsc[index_max] = **dsc;
-    *dsc = &cache->dsc[index_max];
+  // found but too small for what we need, or left pending by an aborted run of ours: it is stale anyway
+  if(line && !computed_elsewhere) _line_invalidate(cache, line);
 
-    cache->hash[index_max] = hash;
-    cache->used[index_max] = weight;
+  gboolean fresh = FALSE;
+  line = _reserve(cache, size, &fresh);
+  if(!line)
+  {
     cache->misses++;
+    dt_pthread_mutex_unlock(&cache->lock);
     return 1;
   }
-  else
-    return 0;
+
+  ASAN_UNPOISON_MEMORY_REGION(line->data, size);
+
+  // first, update our copy, then update the pointer to point at our copy
+  line->dsc = **dsc;
+  *dsc = &line->dsc;
+  *data = line->data;
+  line->owner = client;
+  line->half_float = client->half_float;
+
+  // If another pipe is computing the same thing right now, don't wait for it:
+  // compute a private copy that will not be indexed.
+  if(!computed_elsewhere)
+  {
+    line->hash = hash;
+    line->pending = TRUE;
+    g_hash_table_insert(cache->lines, &line->hash, line);
+  }
+
+  _line_touch(cache, line, weight);
+  _line_pin(client, line);
+
+  cache->misses++;
+  dt_pthread_mutex_unlock(&cache->lock);
+
+  // the line is pinned by us, place the pages of a new one near the threads of this pipe out of the lock
+  if(fresh) dt_numa_first_touch(*data, size);
+  return 1;
 }
 
-void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
+static size_t _device_budget(const dt_dev_pixelpipe_cache_t *cache, const int devid)
+{
+  if(cache->max_gpu_memory) return cache->max_gpu_memory;
+  return dt_opencl_get_device_available(devid) / 4;
+}
+
+// Free least recently used device buffers until we have room for `size` more bytes.
+// Their lines are lost, since their content is nowhere else. Pins don't matter here:
+// the device buffer of a ready line is only used by the cache itself.
+static void _evict_device(dt_dev_pixelpipe_cache_t *cache, const size_t size, const size_t budget)
 {
-  for(int k = 0; k < cache->entries; k++)
+  for(GList *l = cache->lru.head; l && cache->current_gpu_memory + size > budget; l = g_list_next(l))
   {
-    cache->hash[k] = -1;
-    cache->used[k] = 0;
-    ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
+    dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)l->data;
+    if(line->cl_mem) _line_invalidate(cache, line);
   }
 }
 
-void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data)
+gboolean dt_dev_pixelpipe_cache_put_device(dt_dev_pixelpipe_cache_t *cache,
+                                           const dt_dev_pixelpipe_cache_client_t *client, void *data,
+                                           void *cl_mem, const int devid, const int width, const int height,
+                                           const size_t bpp, const int cst)
 {
-  for(int k = 0; k < cache->entries; k++)
+  if(!cl_mem || devid < 0) return FALSE;
+
+  dt_pthread_mutex_lock(&cache->lock);
+  dt_dev_pixelpipe_cache_line_t *line
+      = (dt_dev_pixelpipe_cache_line_t *)g_hash_table_lookup(cache->buffers, data);
+  const size_t size = (size_t)width * height * bpp;
+  gboolean taken = FALSE;
+
+  // only lines we are writing, and that will be shared, are worth it
+  if(line && line->pending && line->owner == client && line->hash != (uint64_t)-1 && !line->cl_mem
+     && line->size >= size)
   {
-    if(cache->data[k] == data)
+    const size_t budget = _device_budget(cache, devid);
+    _evict_device(cache, size, budget);
+    if(cache->current_gpu_memory + size <= budget)
     {
-      cache->used[k] = -cache->entries;
+      line->cl_mem = cl_mem;
+      line->devid = devid;
+      line->width = width;
+      line->height = height;
+      line->bpp = bpp;
+      line->dsc.cst = cst;
+      line->pending = FALSE;
+      cache->current_gpu_memory += size;
+      taken = TRUE;
     }
   }
+
+  dt_pthread_mutex_unlock(&cache->lock);
+  return taken;
 }
 
-void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data)
+void dt_dev_pixelpipe_cache_ready(dt_dev_pixelpipe_cache_t *cache, void *data)
 {
-  for(int k = 0; k < cache->entries; k++)
+  dt_pthread_mutex_lock(&cache->lock);
+  dt_dev_pixelpipe_cache_line_t *line
+      = (dt_dev_pixelpipe_cache_line_t *)g_hash_table_lookup(cache->buffers, data);
+  if(line) line->pending = FALSE;
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  for(GList *l = cache->lru.head; l; l = g_list_next(l))
+    _line_invalidate(cache, (dt_dev_pixelpipe_cache_line_t *)l->data);
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+void dt_dev_pixelpipe_cache_set_budget(dt_dev_pixelpipe_cache_t *cache, const size_t max_memory)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  cache->max_memory = max_memory;
+  _evict(cache, 0);
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+void dt_dev_pixelpipe_cache_flush_client(dt_dev_pixelpipe_cache_t *cache,
+                                         const dt_dev_pixelpipe_cache_client_t *client)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  for(GList *l = cache->lru.head; l; l = g_list_next(l))
   {
-    if(cache->data[k] == data)
-    {
-      cache->hash[k] = -1;
-      ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
-    }
+    dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)l->data;
+    if(line->owner == client) _line_invalidate(cache, line);
   }
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  dt_dev_pixelpipe_cache_line_t *line
+      = (dt_dev_pixelpipe_cache_line_t *)g_hash_table_lookup(cache->buffers, data);
+  if(line) _line_touch(cache, line, -(int)g_queue_get_length(&cache->lru));
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  dt_dev_pixelpipe_cache_line_t *line
+      = (dt_dev_pixelpipe_cache_line_t *)g_hash_table_lookup(cache->buffers, data);
+  if(line) _line_invalidate(cache, line);
+  dt_pthread_mutex_unlock(&cache->lock);
 }
 
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
 {
-  for(int k = 0; k < cache->entries; k++)
+  dt_pthread_mutex_lock(&cache->lock);
+  int k = 0;
+  for(GList *l = cache->lru.head; l; l = g_list_next(l), k++)
   {
-    if(cache->hash[k] == (uint64_t)-1)
-      dt_print(DT_DEBUG_CACHE, "pixelpipe cacheline %d unused\n", k);
+    const dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)l->data;
+    if(line->hash == (uint64_t)-1)
+      dt_print(DT_DEBUG_CACHE, "pixelpipe cacheline %d unused (%zu bytes)\n", k, line->size);
     else
-      dt_print(DT_DEBUG_CACHE, "pixelpipe cacheline %d used %d by %llu\n", k, cache->used[k], (long long unsigned int)cache->hash[k]);
+      dt_print(DT_DEBUG_CACHE, "pixelpipe cacheline %d age %" PRId64 " by %llu (%zu bytes, %i pins%s%s%s)\n", k,
+               cache->clock - line->age, (long long unsigned int)line->hash, line->size, line->pins,
+               line->pending ? ", pending" : "", line->cl_mem ? ", on device" : "",
+               line->packed ? ", half floats" : "");
   }
+  dt_print(DT_DEBUG_CACHE, "cache memory: %.2f/%.2f MB, %.2f MB on devices\n",
+           cache->current_memory / (1024.0 * 1024.0), cache->max_memory / (1024.0 * 1024.0),
+           cache->current_gpu_memory / (1024.0 * 1024.0));
   dt_print(DT_DEBUG_CACHE, "cache hit rate so far: %.3f\n", (cache->queries - cache->misses) / (float)cache->queries);
+  dt_pthread_mutex_unlock(&cache->lock);
 }
 
 // clang-format off
@@ -18,55 +18,149 @@
 
 #pragma once
 
+#include "common/dtpthread.h"
+#include <glib.h>
 #include <inttypes.h>
+#include <stddef.h>
 
 struct dt_dev_pixelpipe_t;
 struct dt_iop_buffer_dsc_t;
 struct dt_iop_roi_t;
+struct dt_dev_pixelpipe_cache_line_t;
 
 /**
- * implements a simple pixel cache suitable for caching float images
+ * implements a pixel cache suitable for caching float images
  * corresponding to history items and zoom/pan settings in the develop module.
- * it is optimized for very few entries (~5), so most operations are O(N).
+ *
+ * there is one process-wide cache, shared by all pipes (full, preview, thumbnail, export),
+ * so the output of a module computed by one pipe can be reused by another one
+ * for the same image, parameters and ROI. It has a single memory quota.
+ *
+ * cache lines are indexed by their integrity hash in a hash table and ordered
+ * by recency in a LRU queue, so lookups and LRU updates are O(1).
+ * the cache is bounded by memory (bytes) rather than by a number of entries:
+ * when a new line doesn't fit in the budget, least recently used lines are
+ * freed until it does.
+ *
+ * Each pipe accesses the cache as a client. The last few lines used by a client are
+ * pinned and can't be evicted, because the pipe may still be reading them
+ * (input of the current module, its output, its mask…). So the budget is a soft limit
+ * and may be exceeded by the working set of the running pipes.
+ *
+ * A line reserved on a cache miss is pending until its owner calls dt_dev_pixelpipe_cache_ready()
+ * once it has written its content. Other clients never read pending lines.
+ *
+ * With OpenCL, the content of a line can stay on the device that computed it instead of being
+ * copied to RAM, see dt_dev_pixelpipe_cache_put_device(). A pipe running on the same device gets
+ * that buffer back as is. Anybody else gets the host buffer, which is written back from the device
+ * the first time it is needed. Device memory is bounded by its own budget.
+ *
+ * Lines written by a client with half_float set (preview and thumbnail pipes, if enabled) are not freed
+ * the first time they are evicted: their RGBA content is converted to half floats, which takes half
+ * the memory, and converted back to floats when they are hit again. Modules always compute in floats.
  */
 
+// number of lines pinned by each client.
+#define DT_PIXELPIPE_CACHE_PINS 6
+
+typedef struct dt_dev_pixelpipe_cache_client_t
+{
+  struct dt_dev_pixelpipe_cache_line_t *pinned[DT_PIXELPIPE_CACHE_PINS];
+  int pos;
+  gboolean half_float; // the lines of this client may be kept as half floats, see above
+} dt_dev_pixelpipe_cache_client_t;
+
 typedef struct dt_dev_pixelpipe_cache_t
 {
-  int32_t entries;
-  void **data;
-  size_t *size;
-  struct dt_iop_buffer_dsc_t *dsc;
-  uint64_t *hash;
-  int32_t *used;
-#ifdef HAVE_OPENCL
-  void **gpu_mem;
-#endif
+  dt_pthread_mutex_t lock; // protects everything below, and the lines
+
+  GHashTable *lines;      // (uint64_t hash, dt_dev_pixelpipe_cache_line_t *) pairs of valid lines
+  GHashTable *buffers;    // (void *data, dt_dev_pixelpipe_cache_line_t *) pairs of all allocated lines
+  GQueue lru;             // head is least recently used, tail is most recently used
+
+  size_t current_memory;  // bytes currently allocated for cache lines
+  size_t max_memory;      // memory budget in bytes. soft limit, see above.
+  size_t current_gpu_memory; // bytes of device buffers held by cache lines
+  size_t max_gpu_memory;  // device memory budget in bytes, 0 for a quarter of the memory of each device
+  int64_t clock;          // incremented on each query, used to weight lines
+
+  // optional persistent tier for early-pipe outputs, NULL if disabled. Not owned by the cache.
+  struct dt_dev_pixelpipe_disk_cache_t *disk;
+
   // profiling:
   uint64_t queries;
   uint64_t misses;
 } dt_dev_pixelpipe_cache_t;
 
-/** constructs a new cache with given cache line count (entries) and float buffer entry size in bytes.
+/** constructs a new cache bounded by max_memory bytes. Buffers are allocated lazily.
   \param[out] returns 0 if fail to allocate mem cache.
 */
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size);
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, size_t max_memory);
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache);
 
+/** inits the bookkeeping of a client (pipe). */
+void dt_dev_pixelpipe_cache_client_init(dt_dev_pixelpipe_cache_client_t *client);
+
+/** unpins all lines used by the client and invalidates the lines it left pending. */
+void dt_dev_pixelpipe_cache_client_release(dt_dev_pixelpipe_cache_t *cache,
+                                           dt_dev_pixelpipe_cache_client_t *client);
+
 /** returns the float data buffer for the given hash from the cache. if the hash does not match any
-  * cache line, the least recently used cache line will be cleared and an empty buffer is returned
-  * together with a non-zero return value. */
-int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash,
-                               const size_t size, void **data, struct dt_iop_buffer_dsc_t **dsc);
+  * ready cache line, least recently used cache lines will be freed if needed to fit the memory budget
+  * and an empty buffer is returned together with a non-zero return value.
+  * In that case, the buffer is pending until it is marked ready. */
+int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_client_t *client,
+                               const uint64_t hash, const size_t size,
+                               void **data, struct dt_iop_buffer_dsc_t **dsc);
+
+/** same as above, but the line will be considered as if it had been used `weight` queries ago.
+ * negative weights protect it from eviction during -weight queries, even when not pinned. */
 int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache,
+                                        dt_dev_pixelpipe_cache_client_t *client,
                                         const uint64_t hash, const size_t size,
                                         void **data, struct dt_iop_buffer_dsc_t **dsc, int weight);
 
-/** test availability of a cache line without destroying another, if it is not found. */
+/** returns TRUE and the buffer if a ready line of at least `size` bytes exists for the hash.
+  * never allocates nor reserves a new line. */
+int dt_dev_pixelpipe_cache_get_existing(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_client_t *client,
+                                        const uint64_t hash, const size_t size,
+                                        void **data, struct dt_iop_buffer_dsc_t **dsc);
+
+/** same as above, but if the content of the line is kept on the device `devid`, the device buffer is
+  * handed over in `cl_mem` instead and the host buffer is left pending. The caller then owns the device
+  * buffer and either gives it back with dt_dev_pixelpipe_cache_put_device(), or writes it to the host
+  * buffer and marks it ready. `devid` is -1 without OpenCL. */
+int dt_dev_pixelpipe_cache_get_existing_device(dt_dev_pixelpipe_cache_t *cache,
+                                               dt_dev_pixelpipe_cache_client_t *client,
+                                               const uint64_t hash, const size_t size,
+                                               void **data, struct dt_iop_buffer_dsc_t **dsc,
+                                               const int devid, void **cl_mem);
+
+/** keep the content of the pending line `data`, owned by the client, in the device buffer `cl_mem`
+  * of `width` x `height` pixels of `bpp` bytes, in colorspace `cst`, instead of the host buffer.
+  * The line becomes ready. returns TRUE if the cache took the ownership of the device buffer,
+  * FALSE if the caller keeps it, for instance when the device memory budget is exhausted. */
+gboolean dt_dev_pixelpipe_cache_put_device(dt_dev_pixelpipe_cache_t *cache,
+                                           const dt_dev_pixelpipe_cache_client_t *client, void *data,
+                                           void *cl_mem, const int devid, const int width, const int height,
+                                           const size_t bpp, const int cst);
+
+/** test availability of a ready cache line without destroying another, if it is not found. */
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash);
 
-/** invalidates all cachelines. */
+/** the content of the given pending cache line is complete and can be shared. */
+void dt_dev_pixelpipe_cache_ready(dt_dev_pixelpipe_cache_t *cache, void *data);
+
+/** invalidates all cachelines. Buffers are kept for later reuse. */
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache);
 
+/** changes the memory budget, unused lines over it are packed or freed right away. */
+void dt_dev_pixelpipe_cache_set_budget(dt_dev_pixelpipe_cache_t *cache, const size_t max_memory);
+
+/** invalidates all cachelines written by a client. */
+void dt_dev_pixelpipe_cache_flush_client(dt_dev_pixelpipe_cache_t *cache,
+                                         const dt_dev_pixelpipe_cache_client_t *client);
+
 /** makes this buffer very important after it has been pulled from the cache. */
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data);
 
@@ -0,0 +1,542 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_disk_cache.h"
+#include "common/darktable.h"
+#include "common/file_location.h"
+#include "control/control.h"
+#include "control/jobs.h"
+#include "develop/format.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#if !defined(_WIN32)
+#include <sys/statvfs.h>
+#else
+//statvfs does not exist in Windows, providing implementation
+#include "win/statvfs.h"
+#endif
+
+#define DT_PIXELPIPE_DISK_CACHE_MAGIC 0xD7CAC4E
+// bump when the layout of the files or of dt_iop_buffer_dsc_t changes
+#define DT_PIXELPIPE_DISK_CACHE_VERSION 1
+#define DT_PIXELPIPE_DISK_CACHE_EXT ".dtpc"
+// uncompressed size of the independent blocks, which bounds the parallelism
+#define DT_PIXELPIPE_DISK_CACHE_BLOCK ((size_t)1 << 22)
+// don't keep more than this in RAM waiting to be written
+#define DT_PIXELPIPE_DISK_CACHE_MAX_QUEUED ((size_t)1 << 30)
+
+typedef struct dt_dev_pixelpipe_disk_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t dsc_size;  // sizeof(dt_iop_buffer_dsc_t) when written
+  uint32_t blocks;    // number of compressed blocks following the block table
+  uint64_t hash;
+  uint64_t size;      // uncompressed size of the buffer
+  dt_iop_buffer_dsc_t dsc;
+} dt_dev_pixelpipe_disk_header_t;
+
+typedef struct dt_dev_pixelpipe_disk_file_t
+{
+  uint64_t hash;
+  size_t size;        // uncompressed size, 0 if unknown (indexed at startup)
+  size_t disk_size;   // size of the file
+  gboolean writing;   // a job is writing it, not readable yet
+  GList link;         // embedded node of the LRU queue
+} dt_dev_pixelpipe_disk_file_t;
+
+typedef struct dt_dev_pixelpipe_disk_job_t
+{
+  dt_dev_pixelpipe_disk_cache_t *cache;
+  uint64_t hash;
+  size_t size;
+  dt_iop_buffer_dsc_t dsc;
+  void *data;
+} dt_dev_pixelpipe_disk_job_t;
+
+
+static void _file_path(const dt_dev_pixelpipe_disk_cache_t *cache, const uint64_t hash, const char *ext,
+                       char *filename, const size_t length)
+{
+  snprintf(filename, length, "%s/%016" PRIx64 "%s", cache->path, hash, ext);
+}
+
+static void _file_free(gpointer data)
+{
+  free(data);
+}
+
+static dt_dev_pixelpipe_disk_file_t *_file_new(dt_dev_pixelpipe_disk_cache_t *cache, const uint64_t hash)
+{
+  dt_dev_pixelpipe_disk_file_t *file = calloc(1, sizeof(dt_dev_pixelpipe_disk_file_t));
+  if(!file) return NULL;
+  file->hash = hash;
+  file->link.data = file;
+  g_hash_table_insert(cache->files, &file->hash, file);
+  g_queue_push_tail_link(&cache->lru, &file->link);
+  return file;
+}
+
+// caller holds the lock
+static void _file_remove(dt_dev_pixelpipe_disk_cache_t *cache, dt_dev_pixelpipe_disk_file_t *file,
+                         const gboolean unlink)
+{
+  if(unlink)
+  {
+    char filename[PATH_MAX] = { 0 };
+    _file_path(cache, file->hash, DT_PIXELPIPE_DISK_CACHE_EXT, filename, sizeof(filename));
+    g_unlink(filename);
+  }
+  cache->current_size -= MIN(cache->current_size, file->disk_size);
+  g_queue_unlink(&cache->lru, &file->link);
+  g_hash_table_remove(cache->files, &file->hash);
+}
+
+// caller holds the lock
+static void _evict(dt_dev_pixelpipe_disk_cache_t *cache)
+{
+  GList *link = cache->lru.head;
+  while(cache->current_size > cache->max_size && link)
+  {
+    GList *next = link->next;
+    dt_dev_pixelpipe_disk_file_t *file = (dt_dev_pixelpipe_disk_file_t *)link->data;
+    if(!file->writing) _file_remove(cache, file, TRUE);
+    link = next;
+  }
+}
+
+// Deflate compresses floats much better when bytes of the same significance are contiguous,
+// so split the 4-bytes words into 4 planes. Trailing bytes are copied as-is.
+static void _shuffle(const uint8_t *const restrict in, uint8_t *const restrict out, const size_t size)
+{
+  const size_t words = size / 4;
+  for(size_t k = 0; k < words; k++)
+    for(size_t b = 0; b < 4; b++) out[b * words + k] = in[4 * k + b];
+  memcpy(out + 4 * words, in + 4 * words, size - 4 * words);
+}
+
+static void _unshuffle(const uint8_t *const restrict in, uint8_t *const restrict out, const size_t size)
+{
+  const size_t words = size / 4;
+  for(size_t k = 0; k < words; k++)
+    for(size_t b = 0; b < 4; b++) out[4 * k + b] = in[b * words + k];
+  memcpy(out + 4 * words, in + 4 * words, size - 4 * words);
+}
+
+static int _date_compare(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  GHashTable *dates = (GHashTable *)user_data;
+  const gint64 da = *(gint64 *)g_hash_table_lookup(dates, a);
+  const gint64 db = *(gint64 *)g_hash_table_lookup(dates, b);
+  return (da > db) - (da < db);
+}
+
+int dt_dev_pixelpipe_disk_cache_init(dt_dev_pixelpipe_disk_cache_t *cache, const size_t max_size)
+{
+  memset(cache, 0, sizeof(dt_dev_pixelpipe_disk_cache_t));
+  dt_pthread_mutex_init(&cache->lock, NULL);
+  cache->max_size = max_size;
+  cache->files = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, _file_free);
+  g_queue_init(&cache->lru);
+
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  snprintf(cache->path, sizeof(cache->path), "%s/pixelpipe.d", cachedir);
+  if(g_mkdir_with_parents(cache->path, 0750))
+  {
+    fprintf(stderr, "[pixelpipe_disk_cache] can't create the cache directory %s\n", cache->path);
+    return 0;
+  }
+
+  GDir *dir = g_dir_open(cache->path, 0, NULL);
+  if(!dir) return 0;
+
+  // index the existing files, oldest access first, so eviction resumes where the last session left
+  GList *hashes = NULL;
+  GHashTable *dates = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free);
+  GHashTable *sizes = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, g_free);
+  const char *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    gchar *filename = g_build_filename(cache->path, name, NULL);
+    uint64_t hash = 0;
+    char ext[16] = { 0 };
+    GStatBuf st;
+    if(g_str_has_suffix(name, ".tmp"))
+    {
+      // leftover of an interrupted write
+      g_unlink(filename);
+    }
+    else if(sscanf(name, "%16" SCNx64 "%15s", &hash, ext) == 2 && !strcmp(ext, DT_PIXELPIPE_DISK_CACHE_EXT)
+            && !g_stat(filename, &st) && !g_hash_table_contains(dates, &hash))
+    {
+      uint64_t *key = g_malloc(sizeof(uint64_t));
+      gint64 *date = g_malloc(sizeof(gint64));
+      size_t *disk_size = g_malloc(sizeof(size_t));
+      *key = hash;
+      *date = st.st_mtime;
+      *disk_size = st.st_size;
+      g_hash_table_insert(dates, key, date);
+      g_hash_table_insert(sizes, key, disk_size);
+      hashes = g_list_prepend(hashes, key);
+    }
+    g_free(filename);
+  }
+  g_dir_close(dir);
+
+  hashes = g_list_sort_with_data(hashes, _date_compare, dates);
+  for(GList *h = hashes; h; h = g_list_next(h))
+  {
+    dt_dev_pixelpipe_disk_file_t *file = _file_new(cache, *(uint64_t *)h->data);
+    if(!file) continue;
+    file->disk_size = *(size_t *)g_hash_table_lookup(sizes, h->data);
+    cache->current_size += file->disk_size;
+  }
+  g_list_free(hashes);
+  g_hash_table_destroy(sizes);
+  g_hash_table_destroy(dates);
+
+  // the budget may have been lowered since last time
+  _evict(cache);
+
+  dt_print(DT_DEBUG_DEV, "[pixelpipe_disk_cache] %u files, %zu MB of %zu MB allowed\n",
+           g_hash_table_size(cache->files), cache->current_size >> 20, cache->max_size >> 20);
+  return 1;
+}
+
+void dt_dev_pixelpipe_disk_cache_cleanup(dt_dev_pixelpipe_disk_cache_t *cache)
+{
+  // files stay on disk for the next session
+  if(cache->files) g_hash_table_destroy(cache->files);
+  cache->files = NULL;
+  g_queue_init(&cache->lru);
+  dt_pthread_mutex_destroy(&cache->lock);
+}
+
+int dt_dev_pixelpipe_disk_cache_available(dt_dev_pixelpipe_disk_cache_t *cache, const uint64_t hash,
+                                          const size_t size)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  const dt_dev_pixelpipe_disk_file_t *file = g_hash_table_lookup(cache->files, &hash);
+  const int available = file && !file->writing && (file->size == 0 || file->size == size);
+  dt_pthread_mutex_unlock(&cache->lock);
+  return available;
+}
+
+int dt_dev_pixelpipe_disk_cache_read(dt_dev_pixelpipe_disk_cache_t *cache, const uint64_t hash, void *data,
+                                     const size_t size, struct dt_iop_buffer_dsc_t *dsc)
+{
+  char filename[PATH_MAX] = { 0 };
+  _file_path(cache, hash, DT_PIXELPIPE_DISK_CACHE_EXT, filename, sizeof(filename));
+
+  int err = 1;
+  uint64_t *table = NULL;
+  uint8_t *compressed = NULL;
+  dt_dev_pixelpipe_disk_header_t header;
+
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) goto error;
+
+  if(fread(&header, sizeof(header), 1, f) != 1
+     || header.magic != DT_PIXELPIPE_DISK_CACHE_MAGIC
+     || header.version != DT_PIXELPIPE_DISK_CACHE_VERSION
+     || header.dsc_size != sizeof(dt_iop_buffer_dsc_t)
+     || header.hash != hash
+     || header.size != size
+     || header.blocks != (size + DT_PIXELPIPE_DISK_CACHE_BLOCK - 1) / DT_PIXELPIPE_DISK_CACHE_BLOCK)
+    goto error;
+
+  const size_t blocks = header.blocks;
+  table = malloc(sizeof(uint64_t) * (blocks + 1));
+  if(!table || fread(table, sizeof(uint64_t), blocks, f) != blocks) goto error;
+
+  // turn the table of block sizes into a table of offsets
+  size_t total = 0;
+  for(size_t b = 0; b < blocks; b++)
+  {
+    const size_t block_size = table[b];
+    if(block_size > compressBound(DT_PIXELPIPE_DISK_CACHE_BLOCK)) goto error;
+    table[b] = total;
+    total += block_size;
+  }
+  table[blocks] = total;
+
+  compressed = dt_alloc_align(MAX(total, 1));
+  if(!compressed || fread(compressed, 1, total, f) != total) goto error;
+  fclose(f);
+  f = NULL;
+
+  int failed = 0;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(blocks, compressed, data, size, table) \
+  reduction(| : failed) \
+  schedule(dynamic)
+#endif
+  for(size_t b = 0; b < blocks; b++)
+  {
+    const size_t offset = b * DT_PIXELPIPE_DISK_CACHE_BLOCK;
+    const size_t length = MIN(DT_PIXELPIPE_DISK_CACHE_BLOCK, size - offset);
+    uint8_t *shuffled = dt_alloc_align(length);
+    uLongf out_length = length;
+    if(!shuffled
+       || uncompress(shuffled, &out_length, compressed + table[b], table[b + 1] - table[b]) != Z_OK
+       || out_length != length)
+      failed = 1;
+    else
+      _unshuffle(shuffled, (uint8_t *)data + offset, length);
+    if(shuffled) dt_free_align(shuffled);
+  }
+  if(failed) goto error;
+
+  if(dsc) memcpy(dsc, &header.dsc, sizeof(dt_iop_buffer_dsc_t));
+  err = 0;
+
+  // touch the file so the LRU order survives restarts
+  g_utime(filename, NULL);
+
+  dt_pthread_mutex_lock(&cache->lock);
+  dt_dev_pixelpipe_disk_file_t *file = g_hash_table_lookup(cache->files, &hash);
+  if(file)
+  {
+    file->size = size;
+    g_queue_unlink(&cache->lru, &file->link);
+    g_queue_push_tail_link(&cache->lru, &file->link);
+  }
+  dt_pthread_mutex_unlock(&cache->lock);
+
+error:
+  if(f) fclose(f);
+  if(compressed) dt_free_align(compressed);
+  free(table);
+
+  if(err)
+  {
+    // corrupted, truncated or outdated: don't try again
+    dt_print(DT_DEBUG_DEV, "[pixelpipe_disk_cache] discarding invalid file %s\n", filename);
+    dt_pthread_mutex_lock(&cache->lock);
+    dt_dev_pixelpipe_disk_file_t *file = g_hash_table_lookup(cache->files, &hash);
+    if(file && !file->writing) _file_remove(cache, file, TRUE);
+    dt_pthread_mutex_unlock(&cache->lock);
+  }
+  return err;
+}
+
+static int _write_file(dt_dev_pixelpipe_disk_job_t *params, size_t *disk_size)
+{
+  dt_dev_pixelpipe_disk_cache_t *cache = params->cache;
+  const size_t size = params->size;
+  const size_t blocks = (size + DT_PIXELPIPE_DISK_CACHE_BLOCK - 1) / DT_PIXELPIPE_DISK_CACHE_BLOCK;
+  const size_t bound = compressBound(DT_PIXELPIPE_DISK_CACHE_BLOCK);
+
+  char filename[PATH_MAX] = { 0 };
+  char tmpname[PATH_MAX] = { 0 };
+  _file_path(cache, params->hash, DT_PIXELPIPE_DISK_CACHE_EXT, filename, sizeof(filename));
+  _file_path(cache, params->hash, ".tmp", tmpname, sizeof(tmpname));
+
+  // first check the disk isn't full
+  struct statvfs vfsbuf;
+  if(statvfs(cache->path, &vfsbuf) || ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20) < 100 + (size >> 20))
+  {
+    dt_print(DT_DEBUG_DEV, "[pixelpipe_disk_cache] not enough free space to write %s\n", filename);
+    return 1;
+  }
+
+  uint64_t *table = calloc(blocks, sizeof(uint64_t));
+  uint8_t *compressed = dt_alloc_align(blocks * bound);
+  int failed = (table == NULL || compressed == NULL);
+
+  if(!failed)
+  {
+    const uint8_t *const data = (const uint8_t *)params->data;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(blocks, bound, compressed, data, size, table) \
+    reduction(| : failed) \
+    schedule(dynamic)
+#endif
+    for(size_t b = 0; b < blocks; b++)
+    {
+      const size_t offset = b * DT_PIXELPIPE_DISK_CACHE_BLOCK;
+      const size_t length = MIN(DT_PIXELPIPE_DISK_CACHE_BLOCK, size - offset);
+      uint8_t *shuffled = dt_alloc_align(length);
+      uLongf out_length = bound;
+      if(!shuffled)
+        failed = 1;
+      else
+      {
+        _shuffle(data + offset, shuffled, length);
+        if(compress2(compressed + b * bound, &out_length, shuffled, length, Z_BEST_SPEED) != Z_OK)
+          failed = 1;
+        else
+          table[b] = out_length;
+        dt_free_align(shuffled);
+      }
+    }
+  }
+
+  FILE *f = NULL;
+  if(!failed && (f = g_fopen(tmpname, "wb")))
+  {
+    dt_dev_pixelpipe_disk_header_t header = { .magic = DT_PIXELPIPE_DISK_CACHE_MAGIC,
+                                              .version = DT_PIXELPIPE_DISK_CACHE_VERSION,
+                                              .dsc_size = sizeof(dt_iop_buffer_dsc_t),
+                                              .blocks = blocks,
+                                              .hash = params->hash,
+                                              .size = size };
+    memcpy(&header.dsc, &params->dsc, sizeof(dt_iop_buffer_dsc_t));
+
+    *disk_size = sizeof(header) + blocks * sizeof(uint64_t);
+    failed |= (fwrite(&header, sizeof(header), 1, f) != 1);
+    failed |= (fwrite(table, sizeof(uint64_t), blocks, f) != blocks);
+    for(size_t b = 0; b < blocks && !failed; b++)
+    {
+      failed |= (fwrite(compressed + b * bound, 1, table[b], f) != table[b]);
+      *disk_size += table[b];
+    }
+    failed |= (fclose(f) != 0);
+
+    // readers only ever see complete files
+    if(failed || g_rename(tmpname, filename))
+    {
+      g_unlink(tmpname);
+      failed = 1;
+    }
+  }
+  else
+    failed = 1;
+
+  if(compressed) dt_free_align(compressed);
+  free(table);
+  return failed;
+}
+
+static int32_t _write_job_run(dt_job_t *job)
+{
+  dt_dev_pixelpipe_disk_job_t *params = dt_control_job_get_params(job);
+  dt_dev_pixelpipe_disk_cache_t *cache = params->cache;
+
+  size_t disk_size = 0;
+  const int failed = _write_file(params, &disk_size);
+
+  dt_pthread_mutex_lock(&cache->lock);
+  dt_dev_pixelpipe_disk_file_t *file = g_hash_table_lookup(cache->files, &params->hash);
+  if(file)
+  {
+    if(failed)
+      _file_remove(cache, file, FALSE);
+    else
+    {
+      file->writing = FALSE;
+      file->disk_size = disk_size;
+      cache->current_size += disk_size;
+      _evict(cache);
+    }
+  }
+  dt_pthread_mutex_unlock(&cache->lock);
+
+  return 0;
+}
+
+static void _write_job_cleanup(void *p)
+{
+  dt_dev_pixelpipe_disk_job_t *params = (dt_dev_pixelpipe_disk_job_t *)p;
+  dt_dev_pixelpipe_disk_cache_t *cache = params->cache;
+
+  dt_pthread_mutex_lock(&cache->lock);
+  cache->queued -= MIN(cache->queued, params->size);
+  // the job was discarded before running
+  dt_dev_pixelpipe_disk_file_t *file = g_hash_table_lookup(cache->files, &params->hash);
+  if(file && file->writing) _file_remove(cache, file, FALSE);
+  dt_pthread_mutex_unlock(&cache->lock);
+
+  dt_free_align(params->data);
+  free(params);
+}
+
+void dt_dev_pixelpipe_disk_cache_write(dt_dev_pixelpipe_disk_cache_t *cache, const uint64_t hash,
+                                       const void *data, const size_t size,
+                                       const struct dt_iop_buffer_dsc_t *dsc)
+{
+  if(!darktable.control || !data || size == 0 || size > cache->max_size) return;
+
+  dt_pthread_mutex_lock(&cache->lock);
+  if(g_hash_table_contains(cache->files, &hash) || cache->queued + size > DT_PIXELPIPE_DISK_CACHE_MAX_QUEUED)
+  {
+    // already on disk, or the disk can't keep up: skip rather than holding more memory
+    dt_pthread_mutex_unlock(&cache->lock);
+    return;
+  }
+  dt_dev_pixelpipe_disk_file_t *file = _file_new(cache, hash);
+  if(file)
+  {
+    file->size = size;
+    file->writing = TRUE;
+    cache->queued += size;
+  }
+  dt_pthread_mutex_unlock(&cache->lock);
+  if(!file) return;
+
+  dt_dev_pixelpipe_disk_job_t *params = calloc(1, sizeof(dt_dev_pixelpipe_disk_job_t));
+  void *copy = dt_alloc_align(size);
+  dt_job_t *job = (params && copy) ? dt_control_job_create(&_write_job_run, "write pixelpipe cache") : NULL;
+  if(!job)
+  {
+    dt_pthread_mutex_lock(&cache->lock);
+    cache->queued -= MIN(cache->queued, size);
+    _file_remove(cache, file, FALSE);
+    dt_pthread_mutex_unlock(&cache->lock);
+    if(copy) dt_free_align(copy);
+    free(params);
+    return;
+  }
+
+  memcpy(copy, data, size);
+  params->cache = cache;
+  params->hash = hash;
+  params->size = size;
+  params->data = copy;
+  memcpy(&params->dsc, dsc, sizeof(dt_iop_buffer_dsc_t));
+  dt_control_job_set_params(job, params, _write_job_cleanup);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
+void dt_dev_pixelpipe_disk_cache_flush(dt_dev_pixelpipe_disk_cache_t *cache)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  GList *link = cache->lru.head;
+  while(link)
+  {
+    GList *next = link->next;
+    dt_dev_pixelpipe_disk_file_t *file = (dt_dev_pixelpipe_disk_file_t *)link->data;
+    if(!file->writing) _file_remove(cache, file, TRUE);
+    link = next;
+  }
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,77 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/dtpthread.h"
+#include <glib.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stddef.h>
+
+struct dt_iop_buffer_dsc_t;
+
+/**
+ * Disk-backed second tier of the pixelpipe cache.
+ *
+ * It stores compressed module outputs in $cachedir/pixelpipe.d/, one file per cache line,
+ * named after the integrity hash of the line. It's meant for expensive and stable
+ * early-pipe outputs (demosaic, denoise…), so reopening an image doesn't need to recompute them.
+ *
+ * Files are byte-shuffled and deflated by independent blocks, in parallel.
+ * Writes happen in a background job on a private copy of the buffer, so the pipe doesn't wait.
+ * The total size on disk is bounded, least recently used files are deleted first.
+ */
+
+typedef struct dt_dev_pixelpipe_disk_cache_t
+{
+  dt_pthread_mutex_t lock; // protects everything below
+
+  char path[PATH_MAX];     // directory of the cache files
+  GHashTable *files;       // (uint64_t hash, dt_dev_pixelpipe_disk_file_t *) pairs
+  GQueue lru;              // head is least recently used, tail is most recently used
+  size_t current_size;     // bytes on disk
+  size_t max_size;         // bytes allowed on disk
+  size_t queued;           // bytes of pending writes kept in RAM
+} dt_dev_pixelpipe_disk_cache_t;
+
+/** inits the disk cache and indexes the files already present. returns 0 on failure. */
+int dt_dev_pixelpipe_disk_cache_init(dt_dev_pixelpipe_disk_cache_t *cache, size_t max_size);
+void dt_dev_pixelpipe_disk_cache_cleanup(dt_dev_pixelpipe_disk_cache_t *cache);
+
+/** returns TRUE if a file for this hash and uncompressed size exists. */
+int dt_dev_pixelpipe_disk_cache_available(dt_dev_pixelpipe_disk_cache_t *cache, const uint64_t hash,
+                                          const size_t size);
+
+/** uncompress the file for this hash into data, which should have `size` bytes. returns 0 on success. */
+int dt_dev_pixelpipe_disk_cache_read(dt_dev_pixelpipe_disk_cache_t *cache, const uint64_t hash, void *data,
+                                     const size_t size, struct dt_iop_buffer_dsc_t *dsc);
+
+/** schedule the writing of this buffer. data is copied, so the caller can reuse it straight away. */
+void dt_dev_pixelpipe_disk_cache_write(dt_dev_pixelpipe_disk_cache_t *cache, const uint64_t hash,
+                                       const void *data, const size_t size,
+                                       const struct dt_iop_buffer_dsc_t *dsc);
+
+/** remove all files. */
+void dt_dev_pixelpipe_disk_cache_flush(dt_dev_pixelpipe_disk_cache_t *cache);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
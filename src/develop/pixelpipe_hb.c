@@ -21,9 +21,12 @@
 #include "common/colorspaces.h"
 #include "common/darktable.h"
 #include "common/histogram.h"
+#include "common/imagebuf.h"
 #include "common/imageio.h"
 #include "common/opencl.h"
 #include "common/iop_order.h"
+#include "common/lut3d.h"
+#include "common/trace.h"
 #include "control/control.h"
 #include "control/conf.h"
 #include "control/signal.h"
@@ -31,6 +34,8 @@
 #include "develop/format.h"
 #include "develop/imageop_math.h"
 #include "develop/pixelpipe.h"
+#include "develop/pixelpipe_disk_cache.h"
+#include "develop/pixelpipe_tiles.h"
 #include "develop/tiling.h"
 #include "develop/masks.h"
 #include "gui/gtk.h"
@@ -69,6 +74,8 @@ typedef enum dt_pixelpipe_picker_source_t
 
 static void get_output_format(dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece,
                               dt_develop_t *dev, dt_iop_buffer_dsc_t *dsc);
+static struct dt_dev_pixelpipe_tasks_t *_side_tasks_new(void);
+static void _side_tasks_destroy(struct dt_dev_pixelpipe_tasks_t *tasks);
 
 static char *_pipe_type_to_str(int pipe_type)
 {
@@ -135,7 +142,7 @@ inline static void _uint8_to_float(const uint8_t *const input, float *const outp
 int dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height, int levels,
                                  gboolean store_masks)
 {
-  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height, 4);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height);
   pipe->type = DT_DEV_PIXELPIPE_EXPORT;
   pipe->levels = levels;
   pipe->store_all_raster_masks = store_masks;
@@ -144,14 +151,15 @@ int dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe, int32_t width, int32_
 
 int dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height)
 {
-  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height, 4);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height);
   pipe->type = DT_DEV_PIXELPIPE_THUMBNAIL;
+  pipe->cache_client.half_float = dt_conf_get_bool("pixelpipe_cache_half_float");
   return res;
 }
 
 int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height)
 {
-  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height, 0);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height);
   pipe->type = DT_DEV_PIXELPIPE_THUMBNAIL;
   return res;
 }
@@ -159,9 +167,9 @@ int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t
 int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 {
   // Init with the size of MIPMAP_F
-  int32_t cachelines = MAX(dt_conf_get_int("cachelines"), 8);
-  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * 720 * 450, cachelines);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * 720 * 450);
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW;
+  pipe->cache_client.half_float = dt_conf_get_bool("pixelpipe_cache_half_float");
 
   // Needed for caching
   pipe->store_all_raster_masks = TRUE;
@@ -171,7 +179,6 @@ int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
 {
   // Init with the max size of a screen.
-  int32_t cachelines = MAX(dt_conf_get_int("cachelines"), 8);
   gint width = 1920;
   gint height = 1080;
 
@@ -182,23 +189,32 @@ int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
     height *= darktable.gui->ppd;
   }
 
-  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height, cachelines);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height);
   pipe->type = DT_DEV_PIXELPIPE_FULL;
 
+  // Enough tiles for a couple of screens, to pan back and forth
+  pipe->tiles = dt_dev_pixelpipe_tiles_new(3 * (width / DT_DEV_PIXELPIPE_TILE_SIZE + 2)
+                                           * (height / DT_DEV_PIXELPIPE_TILE_SIZE + 2));
+
   // Needed for caching
   pipe->store_all_raster_masks = TRUE;
   return res;
 }
 
-int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries)
+int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size)
 {
   pipe->devid = -1;
   pipe->changed = DT_DEV_PIPE_UNCHANGED;
   pipe->processed_width = pipe->backbuf_width = pipe->iwidth = 0;
   pipe->processed_height = pipe->backbuf_height = pipe->iheight = 0;
   pipe->nodes = NULL;
+  pipe->scratch = NULL;
   pipe->backbuf_size = size;
-  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size)) return 0;
+  // All pipes share the global cache. Lines in use by the pipe are pinned,
+  // so it always gets at least its working set, even above the cache budget.
+  pipe->cache = darktable.pixelpipe_cache;
+  if(!pipe->cache) return 0;
+  dt_dev_pixelpipe_cache_client_init(&pipe->cache_client);
   pipe->backbuf = NULL;
   pipe->backbuf_scale = 0.0f;
   pipe->backbuf_zoom_x = 0.0f;
@@ -207,7 +223,10 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->output_backbuf = NULL;
   pipe->output_backbuf_width = 0;
   pipe->output_backbuf_height = 0;
+  pipe->output_backbuf_hash = 0;
   pipe->output_imgid = UNKNOWN_IMAGE;
+  pipe->tiles = NULL;
+  pipe->tiles_hash = 0;
 
   pipe->rawdetail_mask_data = NULL;
   pipe->want_detail_mask = DT_DEV_DETAIL_MASK_NONE;
@@ -215,12 +234,17 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->processing = 0;
   pipe->running = 0;
   dt_atomic_set_int(&pipe->shutdown, FALSE);
+  pipe->draft = FALSE;
+  pipe->warmup = FALSE;
+  pipe->backbuf_draft = FALSE;
   pipe->opencl_error = 0;
   pipe->tiling = 0;
   pipe->mask_display = DT_DEV_PIXELPIPE_DISPLAY_NONE;
   pipe->bypass_blendif = 0;
   pipe->input_timestamp = 0;
   pipe->levels = IMAGEIO_RGB | IMAGEIO_INT8;
+  memset(&pipe->perf, 0, sizeof(pipe->perf));
+  memset(&pipe->perf_last, 0, sizeof(pipe->perf_last));
   dt_pthread_mutex_init(&(pipe->backbuf_mutex), NULL);
   dt_pthread_mutex_init(&(pipe->busy_mutex), NULL);
   pipe->icc_type = DT_COLORSPACE_NONE;
@@ -236,6 +260,10 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
 
   pipe->status = DT_DEV_PIXELPIPE_DIRTY;
   pipe->last_history_hash = 0;
+  pipe->baked_lut = NULL;
+  pipe->baked_lut_hash = 0;
+  pipe->scratch = dt_iop_scratch_pool_new();
+  pipe->tasks = _side_tasks_new();
   return 1;
 }
 
@@ -265,8 +293,10 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   pipe->backbuf = NULL;
   // blocks while busy and sets shutdown bit:
   dt_dev_pixelpipe_cleanup_nodes(pipe);
-  // so now it's safe to clean up cache:
-  dt_dev_pixelpipe_cache_cleanup(&(pipe->cache));
+  _side_tasks_destroy(pipe->tasks);
+  pipe->tasks = NULL;
+  // so now it's safe to release our cache lines:
+  dt_dev_pixelpipe_cache_client_release(pipe->cache, &pipe->cache_client);
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
   dt_pthread_mutex_destroy(&(pipe->backbuf_mutex));
   dt_pthread_mutex_destroy(&(pipe->busy_mutex));
@@ -278,10 +308,19 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   pipe->output_backbuf = NULL;
   pipe->output_backbuf_width = 0;
   pipe->output_backbuf_height = 0;
+  pipe->output_backbuf_hash = 0;
   pipe->output_imgid = UNKNOWN_IMAGE;
+  dt_dev_pixelpipe_tiles_free(pipe->tiles);
+  pipe->tiles = NULL;
 
   dt_dev_clear_rawdetail_mask(pipe);
 
+  dt_free_align(pipe->baked_lut);
+  pipe->baked_lut = NULL;
+
+  dt_iop_scratch_pool_destroy(pipe->scratch);
+  pipe->scratch = NULL;
+
   if(pipe->forms)
   {
     g_list_free_full(pipe->forms, (void (*)(void *))dt_masks_free_form);
@@ -289,22 +328,33 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   }
 }
 
+static void _distorted_mask_free(gpointer data)
+{
+  dt_dev_pixelpipe_distorted_mask_t *entry = (dt_dev_pixelpipe_distorted_mask_t *)data;
+  dt_free_align(entry->data);
+  free(entry);
+}
+
+static void _cleanup_node(dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
+{
+  // printf("cleanup module `%s'\n", piece->module->name());
+  piece->module->cleanup_pipe(piece->module, pipe, piece);
+  free(piece->blendop_data);
+  piece->blendop_data = NULL;
+  free(piece->histogram);
+  piece->histogram = NULL;
+  g_hash_table_destroy(piece->raster_masks);
+  piece->raster_masks = NULL;
+  g_hash_table_destroy(piece->distorted_masks);
+  piece->distorted_masks = NULL;
+  free(piece);
+}
+
 void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe)
 {
   // destroy all nodes
   for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
-  {
-    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
-    // printf("cleanup module `%s'\n", piece->module->name());
-    piece->module->cleanup_pipe(piece->module, pipe, piece);
-    free(piece->blendop_data);
-    piece->blendop_data = NULL;
-    free(piece->histogram);
-    piece->histogram = NULL;
-    g_hash_table_destroy(piece->raster_masks);
-    piece->raster_masks = NULL;
-    free(piece);
-  }
+    _cleanup_node(pipe, (dt_dev_pixelpipe_iop_t *)nodes->data);
   g_list_free(pipe->nodes);
   pipe->nodes = NULL;
   // also cleanup iop here
@@ -318,6 +368,47 @@ void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe)
   pipe->iop_order_list = NULL;
 }
 
+static dt_dev_pixelpipe_iop_t *_create_node(dt_dev_pixelpipe_t *pipe, dt_iop_module_t *module)
+{
+  dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)calloc(1, sizeof(dt_dev_pixelpipe_iop_t));
+  piece->enabled = module->enabled;
+  piece->request_histogram = DT_REQUEST_ONLY_IN_GUI;
+  piece->histogram_params.roi = NULL;
+  piece->histogram_params.bins_count = 256;
+  piece->histogram_stats.bins_count = 0;
+  piece->histogram_stats.pixels = 0;
+  piece->colors
+      = ((module->default_colorspace(module, pipe, NULL) == IOP_CS_RAW) && (dt_image_is_raw(&pipe->image)))
+            ? 1
+            : 4;
+  piece->iscale = pipe->iscale;
+  piece->iwidth = pipe->iwidth;
+  piece->iheight = pipe->iheight;
+  piece->module = module;
+  piece->pipe = pipe;
+  piece->data = NULL;
+  piece->hash = 0;
+  piece->blendop_hash = 0;
+  piece->global_hash = 0;
+  piece->global_mask_hash = 0;
+  piece->bypass_cache = FALSE;
+  piece->process_cl_ready = 0;
+  piece->process_tiling_ready = 0;
+  piece->raster_masks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, dt_free_align_ptr);
+  piece->distorted_masks = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, _distorted_mask_free);
+  memset(&piece->processed_roi_in, 0, sizeof(piece->processed_roi_in));
+  memset(&piece->processed_roi_out, 0, sizeof(piece->processed_roi_out));
+
+  // dsc_mask is static, single channel float image
+  memset(&piece->dsc_mask, 0, sizeof(piece->dsc_mask));
+  piece->dsc_mask.channels = 1;
+  piece->dsc_mask.datatype = TYPE_FLOAT;
+  piece->dsc_mask.filters = 0;
+
+  dt_iop_init_pipe(piece->module, pipe, piece);
+  return piece;
+}
+
 void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
 {
   // check that the pipe was actually properly cleaned up after the last run
@@ -331,46 +422,83 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
   // currently, that loads 84 modules of which a solid third are not used anymore.
   // if(module->flags() & IOP_FLAGS_DEPRECATED && !(module->enabled)) continue;
   pipe->iop = g_list_copy(dev->iop);
-  for(GList *modules = pipe->iop; modules; modules = g_list_next(modules))
+  int position = 0;
+  for(GList *modules = pipe->iop; modules; modules = g_list_next(modules), position++)
   {
-    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
-    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)calloc(1, sizeof(dt_dev_pixelpipe_iop_t));
-    piece->enabled = module->enabled;
-    piece->request_histogram = DT_REQUEST_ONLY_IN_GUI;
-    piece->histogram_params.roi = NULL;
-    piece->histogram_params.bins_count = 256;
-    piece->histogram_stats.bins_count = 0;
-    piece->histogram_stats.pixels = 0;
-    piece->colors
-        = ((module->default_colorspace(module, pipe, NULL) == IOP_CS_RAW) && (dt_image_is_raw(&pipe->image)))
-              ? 1
-              : 4;
-    piece->iscale = pipe->iscale;
-    piece->iwidth = pipe->iwidth;
-    piece->iheight = pipe->iheight;
-    piece->module = module;
-    piece->pipe = pipe;
-    piece->data = NULL;
-    piece->hash = 0;
-    piece->blendop_hash = 0;
-    piece->global_hash = 0;
-    piece->global_mask_hash = 0;
-    piece->bypass_cache = FALSE;
-    piece->process_cl_ready = 0;
-    piece->process_tiling_ready = 0;
-    piece->raster_masks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, dt_free_align_ptr);
-    memset(&piece->processed_roi_in, 0, sizeof(piece->processed_roi_in));
-    memset(&piece->processed_roi_out, 0, sizeof(piece->processed_roi_out));
+    dt_dev_pixelpipe_iop_t *piece = _create_node(pipe, (dt_iop_module_t *)modules->data);
+    piece->position = position;
+    pipe->nodes = g_list_prepend(pipe->nodes, piece);
+  }
+  pipe->nodes = g_list_reverse(pipe->nodes);
+}
 
-    // dsc_mask is static, single channel float image
-    memset(&piece->dsc_mask, 0, sizeof(piece->dsc_mask));
-    piece->dsc_mask.channels = 1;
-    piece->dsc_mask.datatype = TYPE_FLOAT;
-    piece->dsc_mask.filters = 0;
+// Rebuild the nodes for the current modules of dev, at their current place. The nodes of modules
+// that are still there are kept along with the data of their module, so init_pipe() and cleanup_pipe()
+// only run for new and removed modules. From the first position where the sequence of modules differs,
+// the last commit of the nodes is forgotten so they get committed again.
+static void _rebuild_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
+{
+  GHashTable *previous = g_hash_table_new(g_direct_hash, g_direct_equal);
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    g_hash_table_insert(previous, piece->module, piece);
+  }
+  g_list_free(pipe->nodes);
+  pipe->nodes = NULL;
+  g_list_free(pipe->iop);
+  g_list_free_full(pipe->iop_order_list, free);
+  pipe->iop_order_list = dt_ioppr_iop_order_copy_deep(dev->iop_order_list);
 
-    dt_iop_init_pipe(piece->module, pipe, piece);
-    pipe->nodes = g_list_append(pipe->nodes, piece);
+  int reused = 0;
+  int position = 0;
+  gboolean moved = FALSE;
+  pipe->iop = g_list_copy(dev->iop);
+  for(GList *modules = pipe->iop; modules; modules = g_list_next(modules), position++)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)g_hash_table_lookup(previous, module);
+    if(piece)
+    {
+      g_hash_table_remove(previous, module);
+      // from the first node not at its former place, the upstream state seen by commit_params() may differ
+      moved |= (piece->position != position);
+      if(moved) piece->commit_hash = 0;
+      // what depends on the neighbours of the node is computed again for each run, but the raster masks
+      // may come from a module that is now elsewhere in the pipe
+      piece->colors
+          = ((module->default_colorspace(module, pipe, NULL) == IOP_CS_RAW) && (dt_image_is_raw(&pipe->image)))
+                ? 1
+                : 4;
+      piece->iscale = pipe->iscale;
+      piece->iwidth = pipe->iwidth;
+      piece->iheight = pipe->iheight;
+      piece->process_cl_ready = 0;
+      piece->process_tiling_ready = 0;
+      g_hash_table_remove_all(piece->raster_masks);
+      g_hash_table_remove_all(piece->distorted_masks);
+      memset(&piece->processed_roi_in, 0, sizeof(piece->processed_roi_in));
+      memset(&piece->processed_roi_out, 0, sizeof(piece->processed_roi_out));
+      reused++;
+    }
+    else
+    {
+      piece = _create_node(pipe, module);
+      moved = TRUE;
+    }
+    piece->position = position;
+    pipe->nodes = g_list_prepend(pipe->nodes, piece);
   }
+  pipe->nodes = g_list_reverse(pipe->nodes);
+
+  GHashTableIter iter;
+  gpointer piece;
+  g_hash_table_iter_init(&iter, previous);
+  while(g_hash_table_iter_next(&iter, NULL, &piece)) _cleanup_node(pipe, (dt_dev_pixelpipe_iop_t *)piece);
+  g_hash_table_destroy(previous);
+
+  dt_print(DT_DEBUG_DEV, "[pixelpipe] rebuilt pipe %i reusing %i of %i nodes\n", pipe->type, reused,
+           g_list_length(pipe->nodes));
 }
 
 static uint64_t _default_pipe_hash(dt_dev_pixelpipe_t *pipe)
@@ -379,6 +507,11 @@ static uint64_t _default_pipe_hash(dt_dev_pixelpipe_t *pipe)
   uint64_t hash = dt_hash(5381, (const char *)&pipe->image.id, sizeof(int32_t));
   hash = dt_hash(hash, (const char *)&pipe->image.version, sizeof(int32_t));
   hash = dt_hash(hash, (const char *)&pipe->image.film_id, sizeof(int32_t));
+  // The cache is shared between pipes that may be fed with different mipmaps of the same image
+  hash = dt_hash(hash, (const char *)&pipe->iwidth, sizeof(int));
+  hash = dt_hash(hash, (const char *)&pipe->iheight, sizeof(int));
+  // drafts are computed with cheaper settings, keep them apart from the final renders in cache
+  if(pipe->draft) hash = dt_hash(hash, "draft", 5);
   return hash;
 }
 
@@ -413,6 +546,11 @@ void dt_pixelpipe_get_global_hash(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
   uint64_t hash = _default_pipe_hash(pipe);
   uint64_t distort_hash = _default_pipe_hash(pipe);
   distort_hash = dt_hash(distort_hash, (const char *)&distort_hash, sizeof(uint64_t));
+  uint64_t shape_hash = _default_pipe_hash(pipe);
+
+  // Global statistics are shared between pipes of any size: only the image and the params matter
+  uint64_t stats_hash = dt_hash(5381, (const char *)&pipe->image.id, sizeof(int32_t));
+  stats_hash = dt_hash(stats_hash, (const char *)&pipe->image.version, sizeof(int32_t));
 
   // Bypassing cache contaminates downstream modules.
   gboolean bypass_cache = FALSE;
@@ -426,6 +564,16 @@ void dt_pixelpipe_get_global_hash(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
     bypass_cache |= piece->module->bypass_cache;
     piece->bypass_cache = bypass_cache;
 
+    // Statistics describe the input of the module, so only the upstream modules count, plus the instance
+    if(piece->module->flags() & IOP_FLAGS_GLOBAL_STATS)
+    {
+      piece->stats_hash = dt_hash(stats_hash, piece->module->op, strlen(piece->module->op));
+      piece->stats_hash = dt_hash(piece->stats_hash, (const char *)&piece->module->multi_priority, sizeof(int));
+    }
+    const gboolean skipped = dt_dev_pixelpipe_activemodule_disables_currentmodule(dev, piece->module);
+    stats_hash = dt_hash(stats_hash, (const char *)&skipped, sizeof(gboolean));
+    stats_hash = dt_hash(stats_hash, (const char *)&piece->hash, sizeof(uint64_t));
+
     // Combine with the previous modules hashes
     uint64_t local_hash = piece->hash;
 
@@ -458,9 +606,38 @@ void dt_pixelpipe_get_global_hash(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
       distort_hash = dt_hash(distort_hash, (const char *)&piece->hash, sizeof(uint64_t));
 
     piece->global_mask_hash = dt_hash(distort_hash, (const char *)&piece->blendop_hash, sizeof(uint64_t));
+
+    // Drawn shapes are distorted like raster masks, but they are rasterized for the current ROI anyway,
+    // so only the full buffers matter: that's what distort_transform() methods work with.
+    shape_hash = dt_hash(shape_hash, (const char *)&skipped, sizeof(gboolean));
+    shape_hash = dt_hash(shape_hash, (const char *)&piece->buf_in, sizeof(dt_iop_roi_t));
+    shape_hash = dt_hash(shape_hash, (const char *)&piece->buf_out, sizeof(dt_iop_roi_t));
+    if(!skipped && (piece->module->operation_tags() & IOP_TAG_DISTORT) == IOP_TAG_DISTORT)
+      shape_hash = dt_hash(shape_hash, (const char *)&piece->hash, sizeof(uint64_t));
+    piece->distort_hash = shape_hash;
   }
 }
 
+uint64_t dt_dev_pixelpipe_params_hash(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
+{
+  // Same inputs as dt_pixelpipe_get_global_hash() minus the planned ROI of each module
+  uint64_t hash = _default_pipe_hash(pipe);
+  hash = dt_hash(hash, (const char *)&pipe->processed_width, sizeof(int));
+  hash = dt_hash(hash, (const char *)&pipe->processed_height, sizeof(int));
+
+  for(GList *node = g_list_first(pipe->nodes); node; node = g_list_next(node))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)node->data;
+    if(!piece->enabled) continue;
+
+    const gboolean skipped = dt_dev_pixelpipe_activemodule_disables_currentmodule(dev, piece->module);
+    hash = dt_hash(hash, (const char *)&skipped, sizeof(gboolean));
+    hash = dt_hash(hash, (const char *)&piece->hash, sizeof(uint64_t));
+    hash = dt_hash(hash, (const char *)&piece->module->request_mask_display, sizeof(int));
+  }
+  return hash;
+}
+
 gboolean _commit_history_to_node(dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece, dt_dev_history_item_t *hist)
 {
   if(piece->module == hist->module)
@@ -493,49 +670,96 @@ void dt_dev_pixelpipe_synch(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, GList *
   {
     piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
     if(_commit_history_to_node(pipe, piece, hist))
+    {
+      // the committed item is not necessarily the latest one of its module in history,
+      // the next incremental synch will need to recommit it.
+      piece->commit_hash = 0;
       break;
+    }
   }
 }
 
-void dt_dev_pixelpipe_synch_all_real(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const char *caller_func)
+// Key of what _commit_history_to_node() or the default commit would write into the piece:
+// params, blendops, enabled state and the drawn masks referenced by blendops.
+// Drawn masks belong to dev->forms and not to history items, so they are hashed as they are now.
+static uint64_t _commit_key(dt_develop_t *dev, dt_dev_pixelpipe_iop_t *piece, const dt_dev_history_item_t *hist)
 {
-  dt_print(DT_DEBUG_DEV, "[pixelpipe] synch all modules with defaults_params for pipe %i called from %s\n", pipe->type, caller_func);
-  dt_print(DT_DEBUG_DEV, "[pixelpipe] synch all modules with history for pipe %i called from %s\n", pipe->type, caller_func);
+  dt_iop_module_t *module = piece->module;
+  const gboolean enabled = hist ? hist->enabled : module->default_enabled;
+  const dt_iop_params_t *params = hist ? hist->params : module->default_params;
+  const dt_develop_blend_params_t *bp = hist ? hist->blend_params : module->default_blendop_params;
+
+  uint64_t key = dt_hash(5381, (const char *)&enabled, sizeof(gboolean));
+  if(params) key = dt_iop_params_hash(module->so, key, params, module->params_size);
+  if(bp)
+  {
+    key = dt_hash(key, (const char *)bp, sizeof(dt_develop_blend_params_t));
+    if(bp->mask_id > 0) key = dt_masks_group_get_hash(key, dt_masks_get_from_id(dev, bp->mask_id));
+  }
+  // never 0, which means "never committed"
+  return key ? key : 1;
+}
+
+// incremental skips the nodes whose commit key didn't change. With downstream, it stops skipping after
+// the first committed node: the nodes after it get all committed, because commit_params() may read
+// the state of upstream modules.
+static void _synch_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, gboolean incremental,
+                         const gboolean downstream, const char *caller_func)
+{
+  dt_print(DT_DEBUG_DEV, "[pixelpipe] synch all modules with defaults_params for pipe %i called from %s (%s)\n",
+           pipe->type, caller_func, incremental ? "incremental" : "full");
 
   // go through all history items and adjust params
   // note that we don't necessarily process the whole history, history_end is an user param.
   const uint32_t history_end = dt_dev_get_history_end(dev);
 
+  // Since each history item is a full snapshot of parameters, the latest history entry matching a node
+  // is the one we want. Find them all in one backward pass instead of browsing history for each node.
+  GHashTable *latest = g_hash_table_new(g_direct_hash, g_direct_equal);
+  for(GList *history = g_list_nth(dev->history, history_end - 1); history; history = g_list_previous(history))
+  {
+    dt_dev_history_item_t *hist = (dt_dev_history_item_t *)history->data;
+    if(!g_hash_table_contains(latest, hist->module))
+      g_hash_table_insert(latest, hist->module, hist);
+  }
+
+  int committed = 0;
   for(GList *nodes = g_list_first(pipe->nodes); nodes; nodes = g_list_next(nodes))
   {
     dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
-    piece->hash = 0;
-    piece->global_hash = 0;
-    piece->enabled = piece->module->default_enabled;
-    gboolean found_history = FALSE;
+    dt_dev_history_item_t *hist = (dt_dev_history_item_t *)g_hash_table_lookup(latest, piece->module);
+    const uint64_t key = _commit_key(dev, piece, hist);
 
-    // now browse all history items from the end. Since each history item is a full snapshot of parameters,
-    // the latest history entry matching current node is the one we want, and we don't need to look for the previous.
-    for(GList *history = g_list_nth(dev->history, history_end - 1);
-        history;
-        history = g_list_previous(history))
+    if(incremental && piece->commit_hash == key)
     {
-      dt_dev_history_item_t *hist = (dt_dev_history_item_t *)history->data;
-      if(_commit_history_to_node(pipe, piece, hist))
-      {
-        found_history = TRUE;
-        break;
-      }
+      // Same state as last commit: params, data and hashes of the piece are still valid
+      if(piece->enabled && piece->blendop_data
+         && ((const dt_develop_blend_params_t *)piece->blendop_data)->details != 0.0f)
+        pipe->want_detail_mask |= DT_DEV_DETAIL_MASK_REQUIRED;
+      continue;
     }
 
-    // No history found, commit default params if module is enabled by default
-    if(!found_history && piece->enabled)
+    piece->hash = 0;
+    piece->global_hash = 0;
+    piece->enabled = piece->module->default_enabled;
+    piece->commit_hash = key;
+    committed++;
+    if(downstream) incremental = FALSE;
+
+    if(hist)
+      _commit_history_to_node(pipe, piece, hist);
+    else if(piece->enabled)
     {
+      // No history found, commit default params if module is enabled by default
       dt_iop_commit_params(piece->module, piece->module->default_params, piece->module->default_blendop_params,
                            pipe, piece);
       dt_print(DT_DEBUG_PIPE, "[pixelpipe] info: committed default params for %s (%s) in pipe %i \n", piece->module->op, piece->module->multi_name, pipe->type);
     }
   }
+  g_hash_table_destroy(latest);
+
+  dt_print(DT_DEBUG_DEV, "[pixelpipe] synch committed %i of %i nodes for pipe %i\n", committed,
+           g_list_length(pipe->nodes), pipe->type);
 
   // Keep track of the last history item to have been synced
   GList *last_item = g_list_nth(dev->history, history_end - 1);
@@ -546,6 +770,16 @@ void dt_dev_pixelpipe_synch_all_real(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev
   }
 }
 
+void dt_dev_pixelpipe_synch_all_real(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const char *caller_func)
+{
+  _synch_nodes(pipe, dev, FALSE, FALSE, caller_func);
+}
+
+void dt_dev_pixelpipe_synch_history(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
+{
+  _synch_nodes(pipe, dev, TRUE, FALSE, __FUNCTION__);
+}
+
 void dt_dev_pixelpipe_synch_top(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
 {
   // We can't be sure that there is only one history item to resync
@@ -623,16 +857,23 @@ void dt_dev_pixelpipe_change(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev)
   // case DT_DEV_PIPE_UNCHANGED: case DT_DEV_PIPE_ZOOMED:
   if(status & DT_DEV_PIPE_REMOVE)
   {
-    // modules have been added in between or removed. need to rebuild the whole pipeline.
-    dt_dev_pixelpipe_cleanup_nodes(pipe);
-    dt_dev_pixelpipe_create_nodes(pipe, dev);
-    dt_dev_pixelpipe_synch_all(pipe, dev);
+    // modules have been added in between, moved or removed. the nodes of the modules left are kept.
+    // nodes are committed again from the first one that moved or changed: commit_params() may depend
+    // on upstream modules (work profile), so everything downstream of it too.
+    _rebuild_nodes(pipe, dev);
+    _synch_nodes(pipe, dev, TRUE, TRUE, __FUNCTION__);
   }
   else if(status & DT_DEV_PIPE_SYNCH)
   {
     // pipeline topology remains intact, only change all params.
     dt_dev_pixelpipe_synch_all(pipe, dev);
   }
+  else if(status & DT_DEV_PIPE_HISTORY)
+  {
+    // history changed possibly anywhere (drawn masks), but the environment of the pipe didn't.
+    // only recommit the nodes whose history state differs from what they have.
+    dt_dev_pixelpipe_synch_history(pipe, dev);
+  }
   else if(status & DT_DEV_PIPE_TOP_CHANGED)
   {
     // only top history item changed.
@@ -673,6 +914,104 @@ static void get_output_format(dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe,
 }
 
 
+// Side computations of the pipe, like histograms, only read a buffer that the pipe goes on using.
+// They run on a helper thread, concurrently with the module processing that buffer or with the next ones,
+// and are joined by _side_tasks_wait() before anything may write into the buffer again: in-place
+// colorspace conversions, pickers and blending, and the end of the run.
+typedef struct dt_dev_pixelpipe_tasks_t
+{
+  GThreadPool *pool;
+  GMutex lock;
+  GCond done;
+  int pending;
+} dt_dev_pixelpipe_tasks_t;
+
+typedef struct dt_dev_pixelpipe_task_t
+{
+  dt_dev_pixelpipe_tasks_t *tasks;
+  void (*run)(void *data); // frees data
+  void *data;
+} dt_dev_pixelpipe_task_t;
+
+static void _side_task_run(gpointer data, gpointer user_data)
+{
+  dt_dev_pixelpipe_task_t *task = (dt_dev_pixelpipe_task_t *)data;
+  dt_dev_pixelpipe_tasks_t *tasks = task->tasks;
+
+#ifdef _OPENMP
+  // the pipe thread keeps most cores for the modules
+  omp_set_num_threads(MAX(1, darktable.num_openmp_threads / 4));
+#endif
+  task->run(task->data);
+  free(task);
+
+  g_mutex_lock(&tasks->lock);
+  tasks->pending--;
+  g_cond_broadcast(&tasks->done);
+  g_mutex_unlock(&tasks->lock);
+}
+
+static dt_dev_pixelpipe_tasks_t *_side_tasks_new(void)
+{
+  dt_dev_pixelpipe_tasks_t *tasks = calloc(1, sizeof(dt_dev_pixelpipe_tasks_t));
+  if(!tasks) return NULL;
+  g_mutex_init(&tasks->lock);
+  g_cond_init(&tasks->done);
+  // one thread per pipe: tasks of a run are few, and queued in pipe order.
+  // Exclusive, so its OpenMP setting doesn't leak to the threads of other pools.
+  tasks->pool = g_thread_pool_new(_side_task_run, NULL, 1, TRUE, NULL);
+  return tasks;
+}
+
+static void _side_tasks_wait(dt_dev_pixelpipe_t *pipe)
+{
+  dt_dev_pixelpipe_tasks_t *tasks = pipe->tasks;
+  if(!tasks) return;
+  g_mutex_lock(&tasks->lock);
+  while(tasks->pending > 0) g_cond_wait(&tasks->done, &tasks->lock);
+  g_mutex_unlock(&tasks->lock);
+}
+
+static void _side_tasks_destroy(dt_dev_pixelpipe_tasks_t *tasks)
+{
+  if(!tasks) return;
+  // runs what is still queued
+  if(tasks->pool) g_thread_pool_free(tasks->pool, FALSE, TRUE);
+  g_cond_clear(&tasks->done);
+  g_mutex_clear(&tasks->lock);
+  free(tasks);
+}
+
+// Runs run(data) on the side, or right away if there is no helper thread
+static void _side_task_push(dt_dev_pixelpipe_t *pipe, void (*run)(void *data), void *data)
+{
+  dt_dev_pixelpipe_tasks_t *tasks = pipe->tasks;
+  dt_dev_pixelpipe_task_t *task = (tasks && tasks->pool) ? malloc(sizeof(dt_dev_pixelpipe_task_t)) : NULL;
+  if(!task)
+  {
+    run(data);
+    return;
+  }
+
+  task->tasks = tasks;
+  task->run = run;
+  task->data = data;
+
+  g_mutex_lock(&tasks->lock);
+  tasks->pending++;
+  g_mutex_unlock(&tasks->lock);
+
+  if(!g_thread_pool_push(tasks->pool, task, NULL))
+  {
+    free(task);
+    run(data);
+    g_mutex_lock(&tasks->lock);
+    tasks->pending--;
+    g_mutex_unlock(&tasks->lock);
+  }
+}
+
+
 // helper to get per module histogram
 static void histogram_collect(dt_dev_pixelpipe_iop_t *piece, const void *pixel, const dt_iop_roi_t *roi,
                               uint32_t **histogram, uint32_t *histogram_max)
@@ -762,6 +1101,42 @@ dt_backbuf_t * _get_backuf(dt_develop_t *dev, const char *op)
     return NULL;
 }
 
+// We got 8 bits data, we need to convert it back to float32 for uniform handling
+static void _backbuf_to_float(dt_backbuf_t *backbuf)
+{
+  float *new_buffer = dt_alloc_align(backbuf->width * backbuf->height * 4 * sizeof(float));
+  if(new_buffer == NULL) return;
+
+  uint8_t *old_buffer = (uint8_t *)backbuf->buffer;
+  _uint8_to_float(old_buffer, new_buffer, backbuf->width, backbuf->height, 4);
+  backbuf->buffer = (void *)new_buffer;
+  dt_free_align(old_buffer);
+}
+
+typedef struct dt_pixelpipe_backbuf_task_t
+{
+  dt_backbuf_t *backbuf;
+  const void *output;
+  gboolean uint8;
+  dt_dev_operation_t op;
+} dt_pixelpipe_backbuf_task_t;
+
+static void _copy_backbuf_task(void *data)
+{
+  dt_pixelpipe_backbuf_task_t *task = (dt_pixelpipe_backbuf_task_t *)data;
+  dt_backbuf_t *backbuf = task->backbuf;
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  _copy_buffer(task->output, (char *)backbuf->buffer, backbuf->height, backbuf->width, backbuf->width, 0, 0,
+               backbuf->width * backbuf->bpp, backbuf->bpp);
+  if(task->uint8) _backbuf_to_float(backbuf);
+
+  dt_show_times_f(&start, "[dev_pixelpipe]", "copying global histogram for %s", task->op);
+  free(task);
+}
+
 static void pixelpipe_get_histogram_backbuf(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
                                             void *output, void *cl_mem_output,
                                             dt_iop_buffer_dsc_t *out_format, const dt_iop_roi_t *roi,
@@ -778,6 +1153,51 @@ static void pixelpipe_get_histogram_backbuf(dt_dev_pixelpipe_t *pipe, dt_develop
   if(backbuf == NULL) return; // This module is not wired to global histograms
   if(backbuf->hash == hash) return; // Hash didn't change, nothing to update.
 
+#ifdef HAVE_OPENCL
+  // When the output is on the device, bin the scopes there and copy back only the bins
+  if(cl_mem_output && bpp == 4 * sizeof(float))
+  {
+    dt_times_t start;
+    dt_get_times(&start);
+
+    if(backbuf->scopes == NULL || backbuf->width != roi->width || backbuf->height != roi->height)
+    {
+      if(backbuf->scopes) dt_free_align(backbuf->scopes);
+      backbuf->scopes = dt_alloc_align(dt_scopes_size(roi->width, roi->height) * sizeof(uint32_t));
+    }
+
+    // No vectorscope on raw data. The GUI resamples it if its zoom changes before the next run.
+    const dt_iop_order_iccprofile_info_t *const profile
+        = strcmp(module->op, "demosaic") ? pipe->output_profile_info : NULL;
+    static dt_conf_key_t *zoom_key = NULL;
+    const float zoom
+        = fminf(fmaxf(dt_conf_key_get_float(dt_conf_key_once(&zoom_key, "plugin/darkroom/histogram/zoom")), 32.f),
+                252.f);
+
+    if(backbuf->scopes
+       && dt_scopes_process_cl(pipe->devid, cl_mem_output, roi->width, roi->height, profile, zoom, backbuf->scopes)
+              == CL_SUCCESS)
+    {
+      if(backbuf->buffer) dt_free_align(backbuf->buffer);
+      backbuf->buffer = NULL;
+      backbuf->width = roi->width;
+      backbuf->height = roi->height;
+      backbuf->bpp = bpp;
+      backbuf->scopes_zoom = zoom;
+      backbuf->hash = hash;
+      dt_show_times_f(&start, "[dev_pixelpipe]", "binning global scopes for %s on the device", module->op);
+      return;
+    }
+  }
+#endif
+
+  // The image is copied, the scopes will be binned by the GUI
+  if(backbuf->scopes)
+  {
+    dt_free_align(backbuf->scopes);
+    backbuf->scopes = NULL;
+  }
+
   // Prepare the buffer if needed
   if(backbuf->buffer == NULL)
   {
@@ -809,46 +1229,45 @@ static void pixelpipe_get_histogram_backbuf(dt_dev_pixelpipe_t *pipe, dt_develop
   // Integrity hash, mixing interal module params state, and params states of previous modules in pipe.
   backbuf->hash = hash;
 
-  // Copy to histogram cache
-  dt_times_t start;
-  dt_get_times(&start);
+  // gamma outputs uint8, but its bpp count is still 16 like the modules outputting float32
+  const gboolean uint8 = !strcmp(module->op, "gamma") || bpp == 4 * sizeof(uint8_t);
 
-  // We force OpenCL to write output buffers to cache in RAM
-  // so there is no need for an additional copy from device to host here,
-  // *output should be available all the time
+  // When the output is on the device, *output may not be written yet
 #ifdef HAVE_OPENCL
-  if(cl_mem_output && module->process_cl && piece->process_cl_ready)
+  if(cl_mem_output)
   {
+    dt_times_t start;
+    dt_get_times(&start);
+
     cl_int err = dt_opencl_copy_device_to_host(pipe->devid, backbuf->buffer, cl_mem_output, roi->width, roi->height, bpp);
 
     // Notify the histogram that the backbuf is unusable
     if(err != CL_SUCCESS) backbuf->hash = -1;
+    else if(uint8) _backbuf_to_float(backbuf);
+
+    dt_show_times_f(&start, "[dev_pixelpipe]", "copying global histogram for %s", module->op);
+    return;
   }
-  else if(output)
-  {
-    _copy_buffer(output, (char *)backbuf->buffer, roi->height, roi->width, roi->width, 0, 0, roi->width * bpp, bpp);
-  }
-#else
-  if(output)
-    _copy_buffer(output, (char *)backbuf->buffer, roi->height, roi->width, roi->width, 0, 0, roi->width * bpp, bpp);
-  else
-    backbuf->hash = -1;
 #endif
 
-  // gamma outputs uint8, but its bpp count is still 16 like the modules outputting float32
-  if(!strcmp(module->op, "gamma") || bpp == 4 * sizeof(uint8_t))
+  if(output == NULL)
   {
-    // We got 8 bits data, we need to convert it back to float32 for uniform handling
-    float *new_buffer = dt_alloc_align(roi->width * roi->height * 4 * sizeof(float));
-    if(new_buffer == NULL) return;
-
-    uint8_t *old_buffer = (uint8_t *)backbuf->buffer;
-    _uint8_to_float(old_buffer, new_buffer, roi->width, roi->height, 4);
-    backbuf->buffer = (void *)new_buffer;
-    dt_free_align(old_buffer);
+    backbuf->hash = -1;
+    return;
   }
 
-  dt_show_times_f(&start, "[dev_pixelpipe]", "copying global histogram for %s", module->op);
+  // Copy to histogram cache on the side: the next modules only read the output until they convert it
+  dt_pixelpipe_backbuf_task_t *task = malloc(sizeof(dt_pixelpipe_backbuf_task_t));
+  if(!task)
+  {
+    backbuf->hash = -1;
+    return;
+  }
+  task->backbuf = backbuf;
+  task->output = output;
+  task->uint8 = uint8;
+  g_strlcpy(task->op, module->op, sizeof(task->op));
+  _side_task_push(pipe, _copy_backbuf_task, task);
 
   // That's all. From there, histogram catches the "preview pipeline finished recomputing" signal and redraws if needed.
   // We don't manage thread locks because there is only one writing point and one reading point, synchronized
@@ -857,6 +1276,7 @@ static void pixelpipe_get_histogram_backbuf(dt_dev_pixelpipe_t *pipe, dt_develop
   // Note that we don't compute the histogram here because, depending on the type of scope requested in GUI,
   // intermediate color conversions might be needed (vectorscope) or various pixel binnings required (waveform).
   // Color conversions and binning are deferred to the GUI thread, prior to drawing update.
+  // On the device, all of them are binned at once above because the image doesn't come back to the host.
 }
 
 
@@ -1039,40 +1459,132 @@ error:
 }
 #endif
 
+// Live samples are all taken from the same image: when their boxes cover enough of it,
+// the sum, min and max of each square tile are computed once, so each box only has to
+// read the pixels of its edges that don't fill a whole tile.
+#define PICKER_TILE 16
+
+typedef struct dt_pixelpipe_picker_tiles_t
+{
+  int width, height;                         // in tiles
+  lib_colorpicker_sample_statistics *stats;  // sum, min, max of each tile
+} dt_pixelpipe_picker_tiles_t;
+
+// running statistics over the inclusive rectangle [x0, x1] x [y0, y1] of pixels
+static void _pick_pixels(const float *const pixel, const int width, const int x0, const int y0, const int x1,
+                         const int y1, lib_colorpicker_sample_statistics picked_rgb)
+{
+  for(int j = y0; j <= y1; j++)
+    for(int i = x0; i <= x1; i++)
+    {
+      for_each_channel(ch, aligned(picked_rgb) aligned(pixel:64))
+      {
+        const float v = pixel[4 * ((size_t)width * j + i) + ch];
+        picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MIN][ch] = MIN(picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MIN][ch], v);
+        picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MAX][ch] = MAX(picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MAX][ch], v);
+        picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MEAN][ch] += v;
+      }
+    }
+}
+
+static void _pick_tiles_init(dt_pixelpipe_picker_tiles_t *tiles, const float *const pixel,
+                             const dt_iop_roi_t *roi_in)
+{
+  tiles->width = (roi_in->width + PICKER_TILE - 1) / PICKER_TILE;
+  tiles->height = (roi_in->height + PICKER_TILE - 1) / PICKER_TILE;
+  tiles->stats = dt_alloc_align(sizeof(lib_colorpicker_sample_statistics) * tiles->width * tiles->height);
+  if(tiles->stats == NULL) return;
+
+  const int width = roi_in->width;
+  const int height = roi_in->height;
+  lib_colorpicker_sample_statistics *const stats = tiles->stats;
+  const int tiles_width = tiles->width;
+  const int tiles_count = tiles->width * tiles->height;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(pixel, width, height, stats, tiles_width, tiles_count) \
+  schedule(static)
+#endif
+  for(int t = 0; t < tiles_count; t++)
+  {
+    const int x0 = (t % tiles_width) * PICKER_TILE;
+    const int y0 = (t / tiles_width) * PICKER_TILE;
+    for_each_channel(ch)
+    {
+      stats[t][DT_LIB_COLORPICKER_STATISTIC_MEAN][ch] = 0.0f;
+      stats[t][DT_LIB_COLORPICKER_STATISTIC_MIN][ch] = FLT_MAX;
+      stats[t][DT_LIB_COLORPICKER_STATISTIC_MAX][ch] = -FLT_MAX;
+    }
+    _pick_pixels(pixel, width, x0, y0, MIN(x0 + PICKER_TILE, width) - 1, MIN(y0 + PICKER_TILE, height) - 1,
+                 stats[t]);
+  }
+}
+
+// sum, min and max over the inclusive box, from the tiles it covers entirely when there are some
+static void _pick_box(const float *const pixel, const int width, const dt_pixelpipe_picker_tiles_t *const tiles,
+                      const int box[4], lib_colorpicker_sample_statistics picked_rgb)
+{
+  // range of the tiles that fit in the box
+  const int tx0 = (box[0] + PICKER_TILE - 1) / PICKER_TILE;
+  const int ty0 = (box[1] + PICKER_TILE - 1) / PICKER_TILE;
+  const int tx1 = (box[2] + 1) / PICKER_TILE - 1;
+  const int ty1 = (box[3] + 1) / PICKER_TILE - 1;
+
+  if(tiles == NULL || tiles->stats == NULL || tx0 > tx1 || ty0 > ty1)
+  {
+    _pick_pixels(pixel, width, box[0], box[1], box[2], box[3], picked_rgb);
+    return;
+  }
+
+  for(int ty = ty0; ty <= ty1; ty++)
+    for(int tx = tx0; tx <= tx1; tx++)
+    {
+      const lib_colorpicker_sample_statistics *const tile = tiles->stats + (size_t)ty * tiles->width + tx;
+      for_each_channel(ch)
+      {
+        picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MEAN][ch] += (*tile)[DT_LIB_COLORPICKER_STATISTIC_MEAN][ch];
+        picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MIN][ch]
+            = MIN(picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MIN][ch], (*tile)[DT_LIB_COLORPICKER_STATISTIC_MIN][ch]);
+        picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MAX][ch]
+            = MAX(picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MAX][ch], (*tile)[DT_LIB_COLORPICKER_STATISTIC_MAX][ch]);
+      }
+    }
+
+  // pixels around the tiles: full rows above and below, partial rows left and right
+  const int inner_x0 = tx0 * PICKER_TILE, inner_x1 = (tx1 + 1) * PICKER_TILE - 1;
+  const int inner_y0 = ty0 * PICKER_TILE, inner_y1 = (ty1 + 1) * PICKER_TILE - 1;
+  _pick_pixels(pixel, width, box[0], box[1], box[2], inner_y0 - 1, picked_rgb);
+  _pick_pixels(pixel, width, box[0], inner_y1 + 1, box[2], box[3], picked_rgb);
+  _pick_pixels(pixel, width, box[0], inner_y0, inner_x0 - 1, inner_y1, picked_rgb);
+  _pick_pixels(pixel, width, inner_x1 + 1, inner_y0, box[2], inner_y1, picked_rgb);
+}
+
+static void _pick_sample_box(const dt_colorpicker_sample_t *const sample, const dt_iop_roi_t *roi_in, int box[4])
+{
+  box[0] = MIN(roi_in->width - 1,  MAX(0, sample->box[0] * roi_in->width));
+  box[1] = MIN(roi_in->height - 1, MAX(0, sample->box[1] * roi_in->height));
+  box[2] = MIN(roi_in->width - 1,  MAX(0, sample->box[2] * roi_in->width));
+  box[3] = MIN(roi_in->height - 1, MAX(0, sample->box[3] * roi_in->height));
+}
+
 static void _pixelpipe_pick_from_image(dt_iop_module_t *module,
                                        const float *const pixel, const dt_iop_roi_t *roi_in,
                                        const dt_iop_order_iccprofile_info_t *const display_profile,
+                                       const dt_pixelpipe_picker_tiles_t *const tiles,
                                        dt_colorpicker_sample_t *const sample)
 {
   if(sample->size == DT_LIB_COLORPICKER_SIZE_BOX)
   {
-    const int box[4] = {
-      MIN(roi_in->width - 1,  MAX(0, sample->box[0] * roi_in->width)),
-      MIN(roi_in->height - 1, MAX(0, sample->box[1] * roi_in->height)),
-      MIN(roi_in->width - 1,  MAX(0, sample->box[2] * roi_in->width)),
-      MIN(roi_in->height - 1, MAX(0, sample->box[3] * roi_in->height))
-    };
+    int box[4];
+    _pick_sample_box(sample, roi_in, box);
     const int box_pixels = (box[3] - box[1] + 1) * (box[2] - box[0] + 1);
     lib_colorpicker_sample_statistics picked_rgb = { { 0.0f },
                                                      { FLT_MAX, FLT_MAX, FLT_MAX },
                                                      { FLT_MIN, FLT_MIN, FLT_MIN } };
-    dt_aligned_pixel_t acc = { 0.0f };
+    _pick_box(pixel, roi_in->width, tiles, box, picked_rgb);
 
-    for(int j = box[1]; j <= box[3]; j++)
-      for(int i = box[0]; i <= box[2]; i++)
-      {
-        for_each_channel(ch, aligned(picked_rgb, acc) aligned(pixel:64))
-        {
-          const float v = pixel[4 * (roi_in->width * j + i) + ch];
-          picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MIN][ch]
-              = MIN(picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MIN][ch], v);
-          picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MAX][ch]
-              = MAX(picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MAX][ch], v);
-          acc[ch] += v;
-        }
-      }
-    for_each_channel(ch, aligned(picked_rgb, acc:16))
-      picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MEAN][ch] = acc[ch] / box_pixels;
+    for_each_channel(ch, aligned(picked_rgb:16))
+      picked_rgb[DT_LIB_COLORPICKER_STATISTIC_MEAN][ch] /= box_pixels;
 
     // convenient to have pixels in display profile, which makes them easy to display
     memcpy(sample->display[0], picked_rgb[0], sizeof(lib_colorpicker_sample_statistics));
@@ -1121,18 +1633,34 @@ static void _pixelpipe_pick_samples(dt_develop_t *dev, dt_iop_module_t *module,
     = dt_ioppr_add_profile_info_to_list(dev, darktable.color_profiles->display_type,
                                         darktable.color_profiles->display_filename, INTENT_RELATIVE_COLORIMETRIC);
 
+  // Tiles pay off once the boxes cover a good part of the image
+  size_t area = 0;
+  for(GSList *samples = darktable.lib->proxy.colorpicker.live_samples; samples; samples = g_slist_next(samples))
+  {
+    const dt_colorpicker_sample_t *const sample = samples->data;
+    if(sample->locked || sample->size != DT_LIB_COLORPICKER_SIZE_BOX) continue;
+    int box[4];
+    _pick_sample_box(sample, roi_in, box);
+    area += (size_t)(box[3] - box[1] + 1) * (box[2] - box[0] + 1);
+  }
+
+  dt_pixelpipe_picker_tiles_t tiles = { 0 };
+  if(area > (size_t)roi_in->width * roi_in->height / 4) _pick_tiles_init(&tiles, input, roi_in);
+
   GSList *samples = darktable.lib->proxy.colorpicker.live_samples;
   while(samples)
   {
     dt_colorpicker_sample_t *sample = samples->data;
     if(!sample->locked)
-      _pixelpipe_pick_from_image(module, input, roi_in, display_profile, sample);
+      _pixelpipe_pick_from_image(module, input, roi_in, display_profile, &tiles, sample);
     samples = g_slist_next(samples);
   }
 
   if(darktable.lib->proxy.colorpicker.picker_proxy)
-    _pixelpipe_pick_from_image(module, input, roi_in, display_profile,
+    _pixelpipe_pick_from_image(module, input, roi_in, display_profile, &tiles,
                                darktable.lib->proxy.colorpicker.primary_sample);
+
+  dt_free_align(tiles.stats);
 }
 
 // returns 1 if blend process need the module default colorspace
@@ -1191,6 +1719,37 @@ static gboolean _request_color_pick(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
     && module->request_color_pick != DT_REQUEST_COLORPICK_OFF;
 }
 
+typedef struct dt_pixelpipe_histogram_task_t
+{
+  dt_dev_pixelpipe_iop_t *piece;
+  const float *input;
+  dt_iop_roi_t roi_in;
+} dt_pixelpipe_histogram_task_t;
+
+static void _collect_histogram_task(void *data)
+{
+  dt_pixelpipe_histogram_task_t *task = (dt_pixelpipe_histogram_task_t *)data;
+  dt_dev_pixelpipe_iop_t *piece = task->piece;
+  dt_iop_module_t *module = piece->module;
+
+  histogram_collect(piece, task->input, &task->roi_in, &(piece->histogram), piece->histogram_max);
+
+  if(piece->histogram && (module->request_histogram & DT_REQUEST_ON)
+     && (piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW)
+  {
+    const size_t buf_size = 4 * piece->histogram_stats.bins_count * sizeof(uint32_t);
+    module->histogram = realloc(module->histogram, buf_size);
+    memcpy(module->histogram, piece->histogram, buf_size);
+    module->histogram_stats = piece->histogram_stats;
+    memcpy(module->histogram_max, piece->histogram_max, sizeof(piece->histogram_max));
+    if(module->widget)
+      dt_control_queue_redraw_widget(module->widget);
+  }
+  free(task);
+}
+
+// The input is only read by the module until the pickers and the blending convert it:
+// the histogram is binned meanwhile, and joined with _side_tasks_wait().
 static void collect_histogram_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
                                      float *input, const dt_iop_roi_t *roi_in,
                                      dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
@@ -1200,21 +1759,15 @@ static void collect_histogram_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev
   if((dev->gui_attached || !(piece->request_histogram & DT_REQUEST_ONLY_IN_GUI))
      && (piece->request_histogram & DT_REQUEST_ON))
   {
-    histogram_collect(piece, input, roi_in, &(piece->histogram), piece->histogram_max);
     *pixelpipe_flow |= (PIXELPIPE_FLOW_HISTOGRAM_ON_CPU);
     *pixelpipe_flow &= ~(PIXELPIPE_FLOW_HISTOGRAM_NONE | PIXELPIPE_FLOW_HISTOGRAM_ON_GPU);
 
-    if(piece->histogram && (module->request_histogram & DT_REQUEST_ON)
-       && (pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW)
-    {
-      const size_t buf_size = 4 * piece->histogram_stats.bins_count * sizeof(uint32_t);
-      module->histogram = realloc(module->histogram, buf_size);
-      memcpy(module->histogram, piece->histogram, buf_size);
-      module->histogram_stats = piece->histogram_stats;
-      memcpy(module->histogram_max, piece->histogram_max, sizeof(piece->histogram_max));
-      if(module->widget)
-        dt_control_queue_redraw_widget(module->widget);
-    }
+    dt_pixelpipe_histogram_task_t *task = malloc(sizeof(dt_pixelpipe_histogram_task_t));
+    if(!task) return;
+    task->piece = piece;
+    task->input = input;
+    task->roi_in = *roi_in;
+    _side_task_push(pipe, _collect_histogram_task, task);
   }
   return;
 }
@@ -1233,12 +1786,12 @@ static void collect_histogram_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev
   }
 
 // Once we have a cache, stopping computation before full completion
-// has good chances of leaving it corrupted. So we invalidate it.
+// has good chances of leaving it corrupted. So we invalidate the output.
+// The input is complete, it stays in the cache for the next run.
 #define KILL_SWITCH_AND_FLUSH_CACHE                                                                               \
   if(dt_atomic_get_int(&pipe->shutdown))                                                                          \
   {                                                                                                               \
-    dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), input);                                                     \
-    dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);                                                   \
+    dt_dev_pixelpipe_cache_invalidate(pipe->cache, *output);                                                      \
     if(*cl_mem_output != NULL)                                                                                    \
     {                                                                                                             \
       dt_opencl_release_mem_object(*cl_mem_output);                                                               \
@@ -1249,6 +1802,44 @@ static void collect_histogram_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev
     return 1;                                                                                                     \
   }
 
+// The content of the pending cache line `data` is complete: publish it before aborting,
+// so the next run finds it by its hash and resumes from the first module that changed.
+// A buffer living only on the device is handed to the cache, or copied to the host
+// if the device cache has no room for it.
+static void _keep_complete_buffer(dt_dev_pixelpipe_t *pipe, void *data, void **cl_mem,
+                                  const dt_iop_roi_t *roi, const dt_iop_buffer_dsc_t *dsc)
+{
+  if(data == NULL) return;
+#ifdef HAVE_OPENCL
+  if(*cl_mem != NULL)
+  {
+    const size_t bpp = dt_iop_buffer_dsc_to_bpp(dsc);
+    if(!dt_dev_pixelpipe_cache_put_device(pipe->cache, &pipe->cache_client, data, *cl_mem, pipe->devid,
+                                          roi->width, roi->height, bpp, dsc->cst))
+    {
+      if(dt_opencl_copy_device_to_host(pipe->devid, data, *cl_mem, roi->width, roi->height, bpp) == CL_SUCCESS)
+        dt_dev_pixelpipe_cache_ready(pipe->cache, data);
+      else
+        dt_dev_pixelpipe_cache_invalidate(pipe->cache, data);
+      dt_opencl_release_mem_object(*cl_mem);
+    }
+    *cl_mem = NULL;
+    return;
+  }
+#endif
+  dt_dev_pixelpipe_cache_ready(pipe->cache, data);
+}
+
+// The buffer is complete: keep it in the cache and abort.
+#define KILL_SWITCH_AND_KEEP_CACHE(data, cl_mem, roi, dsc)                                                        \
+  if(dt_atomic_get_int(&pipe->shutdown))                                                                          \
+  {                                                                                                               \
+    _keep_complete_buffer(pipe, data, cl_mem, roi, dsc);                                                          \
+    dt_iop_nap(5000);                                                                                             \
+    pipe->status = DT_DEV_PIXELPIPE_DIRTY;                                                                        \
+    return 1;                                                                                                     \
+  }
+
 static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
                                     float *input, dt_iop_buffer_dsc_t *input_format, const dt_iop_roi_t *roi_in,
                                     void **output, dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
@@ -1261,10 +1852,16 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
   const dt_iop_order_iccprofile_info_t *const work_profile
       = (input_format->cst != IOP_CS_RAW) ? dt_ioppr_get_pipe_work_profile_info(pipe) : NULL;
 
-  // transform to module input colorspace
+  const double start = dt_get_wtime();
+
+  // pick up the changes of the thread budget since the previous module
+  dt_thread_budget_threads();
+
+  // transform to module input colorspace, once the side tasks of upstream modules are done reading it
+  const dt_iop_colorspace_type_t input_cst = module->input_colorspace(module, pipe, piece);
+  if(input_format->cst != input_cst) _side_tasks_wait(pipe);
   dt_ioppr_transform_image_colorspace(module, input, input, roi_in->width, roi_in->height, input_format->cst,
-                                      module->input_colorspace(module, pipe, piece), &input_format->cst,
-                                      work_profile);
+                                      input_cst, &input_format->cst, work_profile);
 
   //fprintf(stdout, "input color space for %s : %i\n", module->op, module->input_colorspace(module, pipe, piece));
 
@@ -1297,6 +1894,9 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
   // and save the output colorspace
   pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
 
+  // pickers and blending convert the input in place
+  _side_tasks_wait(pipe);
+
   // Lab color picking for module
   if(_request_color_pick(pipe, dev, module))
   {
@@ -1335,6 +1935,10 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
   *pixelpipe_flow |= (PIXELPIPE_FLOW_BLENDED_ON_CPU);
   *pixelpipe_flow &= ~(PIXELPIPE_FLOW_BLENDED_ON_GPU);
 
+  dt_opencl_perf_record(-1, pipe->type, module->op,
+                        (size_t)MAX(roi_in->width, roi_out->width) * MAX(roi_in->height, roi_out->height),
+                        dt_get_wtime() - start);
+
   return 0; //no errors
 }
 
@@ -1350,6 +1954,29 @@ static dt_dev_pixelpipe_iop_t *_last_node_in_pipe(dt_dev_pixelpipe_t *pipe)
 }
 
 #ifdef HAVE_OPENCL
+// module-specific pre-requisites of the OpenCL path, independent of the size of the buffers
+static gboolean _piece_may_use_cl(const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_iop_module_t *module = piece->module;
+  return module->process_cl && piece->process_cl_ready
+         && !(((pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW
+               || (pipe->type & DT_DEV_PIXELPIPE_PREVIEW2) == DT_DEV_PIXELPIPE_PREVIEW2)
+              && (module->flags() & IOP_FLAGS_PREVIEW_NON_OPENCL));
+}
+
+// TRUE if the output of the piece will be read back into host memory anyway:
+// the next enabled module runs on CPU only, or the piece is the last one.
+static gboolean _piece_output_goes_to_host(const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece)
+{
+  GList *node = g_list_find(pipe->nodes, (gpointer)piece);
+  for(node = node ? g_list_next(node) : NULL; node; node = g_list_next(node))
+  {
+    const dt_dev_pixelpipe_iop_t *next = (const dt_dev_pixelpipe_iop_t *)node->data;
+    if(next->enabled) return !_piece_may_use_cl(pipe, next);
+  }
+  return TRUE;
+}
+
 static int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
                                     float *input, void *cl_mem_input, dt_iop_buffer_dsc_t *input_format, const dt_iop_roi_t *roi_in,
                                     void **output, void **cl_mem_output, dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
@@ -1366,12 +1993,22 @@ static int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
   /* do we have opencl at all? did user tell us to use it? did we get a resource? */
   if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0)
   {
+    // images in host memory alias the input, which the device may convert in place
+    _side_tasks_wait(pipe);
+
     gboolean success_opencl = TRUE;
     dt_iop_colorspace_type_t input_cst_cl = input_format->cst;
+    const double start = dt_get_wtime();
+    const size_t npixels = (size_t)MAX(roi_in->width, roi_out->width) * MAX(roi_in->height, roi_out->height);
 
     /* if input is on gpu memory only, remember this fact to later take appropriate action */
     gboolean valid_input_on_gpu_only = (cl_mem_input != NULL);
 
+    /* on devices working in host memory, images are created on the cache buffers themselves */
+    const gboolean zero_copy = dt_opencl_use_host_memory(pipe->devid);
+    gboolean input_in_host_memory = FALSE;
+    gboolean output_in_host_memory = FALSE;
+
     const float required_factor_cl = fmaxf(1.0f, (valid_input_on_gpu_only) ? tiling->factor_cl - 1.0f : tiling->factor_cl);
     /* pre-check if there is enough space on device for non-tiled processing */
     const gboolean fits_on_device = dt_opencl_image_fits_device(pipe->devid, MAX(roi_in->width, roi_out->width),
@@ -1381,16 +2018,31 @@ static int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
     /* general remark: in case of opencl errors within modules or out-of-memory on GPU, we transparently
        fall back to the respective cpu module and continue in pixelpipe. If we encounter errors we set
        pipe->opencl_error=1, return this function with value 1, and leave appropriate action to the calling
-       function, which normally would restart pixelpipe without opencl.
+       function, which recomputes the lost input on cpu, see _recover_from_opencl_error().
        Late errors are sometimes detected when trying to get back data from device into host memory and
        are treated in the same manner. */
 
     /* test for a possible opencl path after checking some module specific pre-requisites */
-    gboolean possible_cl = (module->process_cl && piece->process_cl_ready
-       && !(((pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW
-             || (pipe->type & DT_DEV_PIXELPIPE_PREVIEW2) == DT_DEV_PIXELPIPE_PREVIEW2)
-            && (module->flags() & IOP_FLAGS_PREVIEW_NON_OPENCL))
-       && (fits_on_device || piece->process_tiling_ready));
+    gboolean possible_cl = _piece_may_use_cl(pipe, piece) && (fits_on_device || piece->process_tiling_ready);
+
+    if(possible_cl)
+    {
+      /* Look one module ahead to cost the copies between host and device each choice implies:
+         a module squeezed between CPU-only ones pays an upload and a download to run on the device,
+         so runs of CPU-only modules get merged into a single trip to host memory when the device
+         is not fast enough to pay for them. Devices working in host memory copy nothing. */
+      size_t device_bytes = 0, cpu_bytes = 0;
+      if(!zero_copy)
+      {
+        const size_t in_bytes = (size_t)roi_in->width * roi_in->height * in_bpp;
+        const size_t out_bytes = (size_t)roi_out->width * roi_out->height * bpp;
+        if(valid_input_on_gpu_only) cpu_bytes += in_bytes;
+        else device_bytes += in_bytes;
+        if(_piece_output_goes_to_host(pipe, piece)) device_bytes += out_bytes;
+        else cpu_bytes += out_bytes;
+      }
+      possible_cl = dt_opencl_perf_prefer_device(pipe->devid, module->op, npixels, device_bytes, cpu_bytes);
+    }
 
     if(possible_cl && !fits_on_device)
     {
@@ -1415,6 +2067,13 @@ static int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
       if(fits_on_device)
       {
         /* image is small enough -> try to directly process entire image with opencl */
+        if(cl_mem_input == NULL && zero_copy)
+        {
+          cl_mem_input = dt_opencl_alloc_device_use_host_pointer(pipe->devid, roi_in->width, roi_in->height,
+                                                                 in_bpp, roi_in->width * in_bpp, input);
+          input_in_host_memory = (cl_mem_input != NULL);
+        }
+
         /* input is not on gpu memory -> copy it there */
         if(cl_mem_input == NULL)
         {
@@ -1440,8 +2099,16 @@ static int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
           }
         }
 
-        /* try to allocate GPU memory for output */
-        if(success_opencl)
+        /* try to allocate GPU memory for output. The host output buffer is used as scratch
+           by the histogram and the pickers, it can't back the output image then. */
+        if(success_opencl && zero_copy && !_request_color_pick(pipe, dev, module)
+           && !(piece->request_histogram & DT_REQUEST_ON))
+        {
+          *cl_mem_output = dt_opencl_alloc_device_use_host_pointer(pipe->devid, roi_out->width, roi_out->height,
+                                                                   bpp, roi_out->width * bpp, *output);
+          output_in_host_memory = (*cl_mem_output != NULL);
+        }
+        if(success_opencl && *cl_mem_output == NULL)
         {
           *cl_mem_output = dt_opencl_alloc_device(pipe->devid, roi_out->width, roi_out->height, bpp);
           if(*cl_mem_output == NULL)
@@ -1456,7 +2123,7 @@ static int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
         // cl_mem_input, *cl_mem_output);
 
         // indirectly give gpu some air to breathe (and to do display related stuff)
-        dt_iop_nap(dt_opencl_micro_nap(pipe->devid));
+        dt_opencl_nap(pipe->devid);
 
         // transform to input colorspace
         if(success_opencl)
@@ -1557,6 +2224,31 @@ static int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
         if(success_opencl)
           success_opencl = dt_opencl_finish_sync_pipe(pipe->devid, pipe->type);
 
+        /* images in host memory: give the buffers back to the CPU, output is valid in RAM and the input
+           holds the colorspace transforms done in place */
+        if(success_opencl && output_in_host_memory)
+        {
+          success_opencl = (dt_opencl_sync_host_image(pipe->devid, *cl_mem_output, roi_out->width,
+                                                      roi_out->height) == CL_SUCCESS);
+          if(success_opencl)
+          {
+            dt_opencl_release_mem_object(*cl_mem_output);
+            *cl_mem_output = NULL;
+          }
+        }
+        if(success_opencl && input_in_host_memory)
+        {
+          success_opencl = (dt_opencl_sync_host_image(pipe->devid, cl_mem_input, roi_in->width,
+                                                      roi_in->height) == CL_SUCCESS);
+          if(success_opencl)
+          {
+            input_format->cst = input_cst_cl;
+            dt_opencl_release_mem_object(cl_mem_input);
+            cl_mem_input = NULL;
+            input_in_host_memory = FALSE;
+          }
+        }
+
       }
       else if(piece->process_tiling_ready)
       {
@@ -1588,7 +2280,7 @@ static int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
         }
 
         // indirectly give gpu some air to breathe (and to do display related stuff)
-        dt_iop_nap(dt_opencl_micro_nap(pipe->devid));
+        dt_opencl_nap(pipe->devid);
 
         // transform to module input colorspace
         if(success_opencl)
@@ -1616,6 +2308,9 @@ static int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
           pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
         }
 
+        // pickers and blending convert the input in place
+        _side_tasks_wait(pipe);
+
         // Lab color picking for module
         if(success_opencl && _request_color_pick(pipe, dev, module))
         {
@@ -1677,6 +2372,7 @@ static int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
       if(success_opencl)
       {
         /* Nice, everything went fine */
+        dt_opencl_perf_record(pipe->devid, pipe->type, module->op, npixels, dt_get_wtime() - start);
 
         /* OLD COMMENT:
            this is reasonable on slow GPUs only, where it's more expensive to reprocess the whole pixelpipe
@@ -1688,10 +2384,23 @@ static int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
            Also, since the cache actually works and can use a lot more memory, caching GPU output
            enables to bypass a serious number of modules, so the memory I/O cost is a good overall investment.
         */
-        /* write back input into cache for faster re-usal (not for export or thumbnails) */
-        if(cl_mem_input != NULL
+        /* keep input in cache for faster re-usal (not for export or thumbnails).
+           An input uploaded from the host is already there. An input that only exists on the GPU
+           stays there if the device cache has room for it, the cache will copy it to the host
+           only if a CPU module or another device needs it. */
+        const gboolean cache_input = cl_mem_input != NULL && valid_input_on_gpu_only
             && (pipe->type & DT_DEV_PIXELPIPE_EXPORT) != DT_DEV_PIXELPIPE_EXPORT
-            && (pipe->type & DT_DEV_PIXELPIPE_THUMBNAIL) != DT_DEV_PIXELPIPE_THUMBNAIL)
+            && (pipe->type & DT_DEV_PIXELPIPE_THUMBNAIL) != DT_DEV_PIXELPIPE_THUMBNAIL;
+        if(cache_input
+           && dt_dev_pixelpipe_cache_put_device(pipe->cache, &pipe->cache_client, input, cl_mem_input,
+                                                pipe->devid, roi_in->width, roi_in->height, in_bpp,
+                                                input_cst_cl))
+        {
+          /* the cache owns it now */
+          cl_mem_input = NULL;
+          valid_input_on_gpu_only = FALSE;
+        }
+        else if(cache_input)
         {
           /* copy input to host memory, so we can find it in cache */
           cl_int err = dt_opencl_copy_device_to_host(pipe->devid, input, cl_mem_input, roi_in->width,
@@ -1741,8 +2450,10 @@ static int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
           /* copy back to host memory, then clean no longer needed opencl buffer.
              important info: in order to make this possible, opencl modules must
              not spoil their input buffer, even in case of errors. */
-          cl_int err = dt_opencl_copy_device_to_host(pipe->devid, input, cl_mem_input, roi_in->width, roi_in->height,
-                                              in_bpp);
+          cl_int err = input_in_host_memory
+                           ? dt_opencl_sync_host_image(pipe->devid, cl_mem_input, roi_in->width, roi_in->height)
+                           : dt_opencl_copy_device_to_host(pipe->devid, input, cl_mem_input, roi_in->width,
+                                                           roi_in->height, in_bpp);
           if(err != CL_SUCCESS)
           {
             /* late opencl error */
@@ -1806,7 +2517,10 @@ static int pixelpipe_process_on_GPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
     }
 
     /* input is still only on GPU? Let's invalidate CPU input buffer then */
-    if(valid_input_on_gpu_only) dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), input);
+    if(valid_input_on_gpu_only)
+      dt_dev_pixelpipe_cache_invalidate(pipe->cache, input);
+    else
+      dt_dev_pixelpipe_cache_ready(pipe->cache, input);
   }
   else
   {
@@ -1850,6 +2564,79 @@ static void _print_perf_debug(dt_dev_pixelpipe_t *pipe, const dt_pixelpipe_flow_
 }
 
 
+// keep the slowest modules of the run for the darkroom performance overlay
+static void _perf_record_module(dt_dev_pixelpipe_t *pipe, const dt_pixelpipe_flow_t pixelpipe_flow,
+                                dt_iop_module_t *module, const double time)
+{
+  dt_dev_pixelpipe_perf_t *perf = &pipe->perf;
+  const gboolean gpu = (pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU) != 0;
+  const gboolean tiling = (pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING) != 0;
+  perf->cache_misses++;
+  perf->gpu += gpu;
+  perf->tiled += tiling;
+
+  int pos = perf->n_modules;
+  while(pos > 0 && perf->modules[pos - 1].time < time) pos--;
+  if(pos >= DT_DEV_PIXELPIPE_PERF_TOP) return;
+
+  const int last = MIN(perf->n_modules, DT_DEV_PIXELPIPE_PERF_TOP - 1);
+  memmove(&perf->modules[pos + 1], &perf->modules[pos], sizeof(dt_dev_pixelpipe_perf_module_t) * (last - pos));
+  perf->n_modules = last + 1;
+
+  dt_dev_pixelpipe_perf_module_t *entry = &perf->modules[pos];
+  gchar *label = dt_history_item_get_name(module);
+  g_strlcpy(entry->name, label, sizeof(entry->name));
+  g_free(label);
+  entry->time = time;
+  entry->gpu = gpu;
+  entry->tiling = tiling;
+}
+
+// memory accounting of the module for the session, and its trace event. Returns the accounting, if any.
+static const dt_memstat_t *_record_module(dt_dev_pixelpipe_t *pipe, const dt_pixelpipe_flow_t pixelpipe_flow,
+                                          dt_iop_module_t *module, const dt_iop_roi_t *roi_out,
+                                          dt_times_t *start)
+{
+  _perf_record_module(pipe, pixelpipe_flow, module, dt_get_wtime() - start->clock);
+
+  const dt_memstat_t *mem = dt_memstat_module_end();
+  gchar *label = NULL;
+  if(mem)
+  {
+    label = module->multi_name[0] ? g_strdup_printf("%s %s", module->op, module->multi_name)
+                                  : g_strdup(module->op);
+    dt_memstat_record(_pipe_type_to_str(pipe->type), label, mem);
+  }
+
+  if(!dt_trace_enabled() || !mem)
+  {
+    g_free(label);
+    return mem;
+  }
+
+  dt_trace_complete(
+      "pipe", label, start->clock, dt_get_wtime(),
+      "\"pipe\":\"%s\",\"device\":\"%s\",\"devid\":%d,\"tiling\":%s,\"blend\":\"%s\","
+      "\"width\":%d,\"height\":%d,\"cache\":\"miss\",\"host_peak\":%zu,\"device_peak\":%zu,"
+      "\"cache_bytes\":%zu,\"tiling_bytes\":%zu,\"scratch_bytes\":%zu,\"device_bytes\":%zu",
+      _pipe_type_to_str(pipe->type), pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU ? "GPU" : "CPU", pipe->devid,
+      pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING ? "true" : "false",
+      pixelpipe_flow & PIXELPIPE_FLOW_BLENDED_ON_GPU ? "GPU" : "CPU", roi_out->width, roi_out->height,
+      mem->host_peak, mem->device_peak, mem->bytes[DT_MEMSTAT_CACHE], mem->bytes[DT_MEMSTAT_TILING],
+      mem->bytes[DT_MEMSTAT_SCRATCH], mem->bytes[DT_MEMSTAT_DEVICE]);
+  g_free(label);
+  return mem;
+}
+
+static void _record_cache_hit(dt_dev_pixelpipe_t *pipe, dt_iop_module_t *module, const char *source)
+{
+  if(!module) return;
+  pipe->perf.cache_hits++;
+  if(!dt_trace_enabled()) return;
+  dt_trace_instant("cache", module->op, "\"pipe\":\"%s\",\"cache\":\"%s\"", _pipe_type_to_str(pipe->type),
+                   source);
+}
+
 static void _print_nan_debug(dt_dev_pixelpipe_t *pipe, void *cl_mem_output, void *output, const dt_iop_roi_t *roi_out, dt_iop_buffer_dsc_t *out_format, dt_iop_module_t *module, const size_t bpp)
 {
   if((darktable.unmuted & DT_DEBUG_NAN) && strcmp(module->op, "gamma") != 0)
@@ -1941,7 +2728,8 @@ static int _init_base_buffer(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
     *output = pipe->input;
     return 0;
   }
-  else if(bypass_cache || dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format))
+  else if(bypass_cache
+          || dt_dev_pixelpipe_cache_get(pipe->cache, &pipe->cache_client, hash, bufsize, output, out_format))
   {
     if(roi_in->scale == 1.0f)
     {
@@ -2024,6 +2812,381 @@ static int _process_masks_preview(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, d
 }
 
 
+// Outputs of the modules coming before the input color profile (demosaic, denoise…) are expensive
+// and don't change while editing the rest of the pipe, so they are worth saving on disk.
+// Only for darkroom pipes : thumbnails and exports are one-shot.
+static gboolean _use_disk_cache(const dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module)
+{
+  return pipe->cache->disk && module && !pipe->warmup
+         && (pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW))
+         && module->iop_order < dt_ioppr_get_iop_order(pipe->iop_order_list, "colorin", 0);
+}
+
+
+static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                        void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
+                                        const dt_iop_roi_t *roi_out, GList *modules, GList *pieces, int pos);
+
+// Fused tiling: on CPU exports, a run of pointwise modules of which one at least would need tiling
+// is processed band after band, the whole run at once, instead of each module tiling on its own and
+// writing a full size output. Only the input of the run and the output of its last module are full size.
+#define DT_PIXELPIPE_MAX_FUSED 16
+
+typedef struct _fused_step_t
+{
+  dt_dev_pixelpipe_iop_t *piece;
+  dt_develop_tiling_t tiling;
+  dt_iop_buffer_dsc_t dsc;  // pipe->dsc before the module processes the first band
+} _fused_step_t;
+
+// pointwise: same roi in and out, no overlap, a float RGBA output and nothing that needs the full image
+static gboolean _fusable_piece(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_dev_pixelpipe_iop_t *piece,
+                               const dt_iop_roi_t *roi, dt_develop_tiling_t *tiling)
+{
+  dt_iop_module_t *module = piece->module;
+  if(!piece->process_tiling_ready || module->process_tiling != default_process_tiling) return FALSE;
+  if(memcmp(&piece->planned_roi_in, roi, sizeof(dt_iop_roi_t))) return FALSE;
+  if(piece->blendop_data && ((dt_develop_blend_params_t *)piece->blendop_data)->mask_mode != DEVELOP_MASK_DISABLED)
+    return FALSE;
+  if((piece->request_histogram & DT_REQUEST_ON) || _request_color_pick(pipe, dev, module)) return FALSE;
+
+  dt_iop_buffer_dsc_t dsc = { .channels = 4, .datatype = TYPE_FLOAT };
+  module->output_format(module, pipe, piece, &dsc);
+  if(dsc.channels != 4 || dsc.datatype != TYPE_FLOAT) return FALSE;
+
+  *tiling = (dt_develop_tiling_t){ 0 };
+  module->tiling_callback(module, piece, roi, roi, tiling);
+  return tiling->overlap == 0;
+}
+
+// runs the modules of a fused run over `roi`, from `in` to `out`, `in` and `tmp` are overwritten.
+// The descriptors of the pieces are set on the `first` band only.
+static void _process_fused_band(dt_dev_pixelpipe_t *pipe, _fused_step_t *steps, const int count,
+                                const dt_iop_buffer_dsc_t *input_format, const dt_iop_roi_t *roi_out,
+                                const dt_iop_roi_t *roi, float *in, float *tmp, float *out, const gboolean first)
+{
+  const dt_iop_order_iccprofile_info_t *const work_profile = dt_ioppr_get_pipe_work_profile_info(pipe);
+  float *const bands[2] = { in, tmp };
+  dt_iop_colorspace_type_t cst = input_format->cst;
+
+  for(int k = count - 1; k >= 0; k--)
+  {
+    dt_dev_pixelpipe_iop_t *piece = steps[k].piece;
+    dt_iop_module_t *module = piece->module;
+
+    if(first)
+    {
+      piece->processed_roi_in = piece->processed_roi_out = *roi_out;
+      piece->dsc_out = piece->dsc_in = (k == count - 1) ? *input_format : pipe->dsc;
+      module->output_format(module, pipe, piece, &piece->dsc_out);
+      steps[k].dsc = piece->dsc_out;
+    }
+    pipe->dsc = steps[k].dsc;
+
+    dt_ioppr_transform_image_colorspace(module, in, in, roi->width, roi->height, cst,
+                                        module->input_colorspace(module, pipe, piece), &cst, work_profile);
+
+    float *o = (k == 0) ? out : (in == bands[0] ? bands[1] : bands[0]);
+    module->process(module, piece, in, o, roi, roi);
+
+    pipe->dsc.cst = cst = module->output_colorspace(module, pipe, piece);
+    if(first) piece->dsc_out = pipe->dsc;
+    in = o;
+  }
+}
+
+// returns -1 if the module at `modules` doesn't end a run worth fusing, otherwise like dt_dev_pixelpipe_process_rec()
+static int _process_fused(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output, void **cl_mem_output,
+                          dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out, GList *modules,
+                          GList *pieces, int pos, const uint64_t hash, const size_t bufsize,
+                          const gboolean reserved)
+{
+  static dt_conf_key_t *fused_tiling = NULL;
+  if(!(pipe->type & DT_DEV_PIXELPIPE_EXPORT) || (pipe->opencl_enabled && pipe->devid >= 0)
+     || !dt_conf_key_get_bool(dt_conf_key_once(&fused_tiling, "pixelpipe_fused_tiling")))
+    return -1;
+
+  const size_t width = roi_out->width;
+  const size_t height = roi_out->height;
+  const size_t bpp = 4 * sizeof(float);
+
+  // walk back over the run of fusable modules ending here, steps[0] is the last one
+  _fused_step_t steps[DT_PIXELPIPE_MAX_FUSED];
+  int count = 0;
+  gboolean needs_tiling = FALSE;
+  for(; modules && count < DT_PIXELPIPE_MAX_FUSED;
+      modules = g_list_previous(modules), pieces = g_list_previous(pieces), pos--)
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(!piece->enabled) continue;
+    if(!_fusable_piece(pipe, dev, piece, roi_out, &steps[count].tiling)) break;
+    needs_tiling |= !dt_tiling_piece_fits_host_memory(width, height, bpp, steps[count].tiling.factor,
+                                                      steps[count].tiling.overhead);
+    steps[count++].piece = piece;
+  }
+  if(count < 2 || !needs_tiling) return -1;
+
+  // get the input of the run, `modules` now is the module before it
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+  if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, roi_out, modules, pieces, pos))
+    return 1;
+
+  // the run is recomputed module by module from the cached input if it can't take it
+  if(cl_mem_input || input_format->channels != 4 || input_format->datatype != TYPE_FLOAT) return -1;
+
+  KILL_SWITCH_ABORT;
+
+  // the highest band every module of the run can process in memory, as a multiple of their alignments
+  size_t yalign = 1;
+  for(int k = 0; k < count; k++) yalign = MAX(yalign, (size_t)steps[k].tiling.yalign);
+  size_t band = height;
+  for(int k = 0; k < count; k++)
+    while(band > yalign
+          && !dt_tiling_piece_fits_host_memory(width, band, bpp, steps[k].tiling.factor, steps[k].tiling.overhead))
+      band /= 2;
+  band = MAX((band / yalign) * yalign, (size_t)1);
+
+  dt_print(DT_DEBUG_PIPE | DT_DEBUG_TILING, "[pixelpipe] fusing %i modules from %s to %s in bands of %zu rows\n",
+           count, steps[count - 1].piece->module->op, steps[0].piece->module->op, band);
+
+  if(!reserved || *output == NULL)
+    (void)dt_dev_pixelpipe_cache_get(pipe->cache, &pipe->cache_client, hash, bufsize, output, out_format);
+
+  float *bands[2] = { dt_alloc_align_float(width * band * 4), dt_alloc_align_float(width * band * 4) };
+  if(*output == NULL || bands[0] == NULL || bands[1] == NULL)
+  {
+    dt_free_align(bands[0]);
+    dt_free_align(bands[1]);
+    dt_dev_pixelpipe_cache_invalidate(pipe->cache, *output);
+    return 1;
+  }
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  for(size_t row = 0; row < height && !dt_atomic_get_int(&pipe->shutdown); row += band)
+  {
+    const size_t rows = MIN(band, height - row);
+    const dt_iop_roi_t roi = { roi_out->x, roi_out->y + (int)row, roi_out->width, (int)rows, roi_out->scale };
+
+    // the input line stays as it is in the cache
+    memcpy(bands[0], (float *)input + row * width * 4, rows * width * bpp);
+    _process_fused_band(pipe, steps, count, input_format, roi_out, &roi, bands[0], bands[1],
+                        (float *)*output + row * width * 4, row == 0);
+  }
+
+  dt_free_align(bands[0]);
+  dt_free_align(bands[1]);
+
+  KILL_SWITCH_AND_FLUSH_CACHE;
+
+  dt_show_times_f(&start, "[dev_pixelpipe]", "processed %i fused modules from %s to %s [%s]", count,
+                  steps[count - 1].piece->module->op, steps[0].piece->module->op, _pipe_type_to_str(pipe->type));
+  dt_trace_complete("pipe", "fused", start.clock, dt_get_wtime(),
+                    "\"pipe\":\"%s\",\"modules\":%d,\"from\":\"%s\",\"to\":\"%s\",\"width\":%d,\"height\":%d",
+                    _pipe_type_to_str(pipe->type), count, steps[count - 1].piece->module->op,
+                    steps[0].piece->module->op, roi_out->width, roi_out->height);
+
+  **out_format = steps[0].piece->dsc_out;
+  pixelpipe_get_histogram_backbuf(pipe, dev, *output, NULL, *out_format, roi_out, steps[0].piece->module,
+                                  steps[0].piece, hash, bpp);
+
+  if(steps[0].piece->bypass_cache)
+    dt_dev_pixelpipe_cache_invalidate(pipe->cache, *output);
+  dt_dev_pixelpipe_cache_ready(pipe->cache, *output);
+  return 0;
+}
+
+// Baked previews: on CPU, the preview pipe runs a run of pointwise modules once over the nodes of a 3D LUT,
+// then applies the LUT to the image with a tetrahedral interpolation, whatever the modules cost.
+// The input of the LUT is in log2 from DT_BAKED_LUT_MIN_EV to DT_BAKED_LUT_MAX_EV, what's outside is clipped.
+// The main darkroom view, thumbnails and exports still evaluate the modules on every pixel.
+#define DT_BAKED_LUT_MIN_EV -14.0f
+#define DT_BAKED_LUT_MAX_EV 6.0f
+
+static inline float _baked_lut_shape(const float x)
+{
+  const float ev = log2f(fmaxf(x, exp2f(DT_BAKED_LUT_MIN_EV)));
+  return (ev - DT_BAKED_LUT_MIN_EV) / (DT_BAKED_LUT_MAX_EV - DT_BAKED_LUT_MIN_EV);
+}
+
+static inline float _baked_lut_unshape(const float t)
+{
+  return exp2f(DT_BAKED_LUT_MIN_EV + t * (DT_BAKED_LUT_MAX_EV - DT_BAKED_LUT_MIN_EV));
+}
+
+// fusable, declared pointwise, and not the focused module: its GUI may analyse or display its output
+static gboolean _bakeable_piece(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_dev_pixelpipe_iop_t *piece,
+                                const dt_iop_roi_t *roi, dt_develop_tiling_t *tiling)
+{
+  return (piece->module->flags() & IOP_FLAGS_POINTWISE) && piece->module != dev->gui_module
+         && _fusable_piece(pipe, dev, piece, roi, tiling);
+}
+
+// returns -1 if the module at `modules` doesn't end a run worth baking, otherwise like dt_dev_pixelpipe_process_rec()
+static int _process_baked(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output, void **cl_mem_output,
+                          dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out, GList *modules,
+                          GList *pieces, int pos, const uint64_t hash, const size_t bufsize,
+                          const gboolean reserved)
+{
+  const int level = dt_conf_get_int("preview_lut_size");
+  if(!(pipe->type & DT_DEV_PIXELPIPE_PREVIEW) || level < 2 || (pipe->opencl_enabled && pipe->devid >= 0)
+     || pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE)
+    return -1;
+
+  // walk back over the run of bakeable modules ending here, steps[0] is the last one
+  _fused_step_t steps[DT_PIXELPIPE_MAX_FUSED];
+  int count = 0;
+  for(; modules && count < DT_PIXELPIPE_MAX_FUSED;
+      modules = g_list_previous(modules), pieces = g_list_previous(pieces), pos--)
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(!piece->enabled) continue;
+    if(!_bakeable_piece(pipe, dev, piece, roi_out, &steps[count].tiling)) break;
+    steps[count++].piece = piece;
+  }
+  if(count < 2) return -1;
+
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+  if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, roi_out, modules, pieces, pos))
+    return 1;
+
+  // the shaper is meant for scene-linear RGB
+  if(cl_mem_input || input_format->channels != 4 || input_format->datatype != TYPE_FLOAT
+     || input_format->cst != IOP_CS_RGB)
+    return -1;
+
+  KILL_SWITCH_ABORT;
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  const size_t nodes = (size_t)level * level * level;
+  const uint64_t lut_hash = dt_hash(steps[0].piece->global_hash, (const char *)&level, sizeof(int));
+  if(pipe->baked_lut == NULL || pipe->baked_lut_hash != lut_hash)
+  {
+    dt_free_align(pipe->baked_lut);
+    pipe->baked_lut = dt_alloc_align_float(nodes * 3);
+    pipe->baked_lut_hash = 0;
+
+    // the nodes, red varying fastest, as an image of level rows of level * level pixels
+    float *const grid = dt_alloc_align_float(nodes * 4);
+    float *const tmp = dt_alloc_align_float(nodes * 4);
+    float *const out = dt_alloc_align_float(nodes * 4);
+    if(pipe->baked_lut && grid && tmp && out)
+    {
+      for(size_t k = 0; k < nodes; k++)
+      {
+        grid[4 * k + 0] = _baked_lut_unshape((float)(k % level) / (level - 1));
+        grid[4 * k + 1] = _baked_lut_unshape((float)((k / level) % level) / (level - 1));
+        grid[4 * k + 2] = _baked_lut_unshape((float)(k / ((size_t)level * level)) / (level - 1));
+        grid[4 * k + 3] = 1.0f;
+      }
+
+      const dt_iop_roi_t roi = { roi_out->x, roi_out->y, level * level, level, roi_out->scale };
+      _process_fused_band(pipe, steps, count, input_format, roi_out, &roi, grid, tmp, out, TRUE);
+
+      for(size_t k = 0; k < nodes; k++)
+        for(int c = 0; c < 3; c++) pipe->baked_lut[3 * k + c] = out[4 * k + c];
+      pipe->baked_lut_hash = lut_hash;
+      pipe->baked_lut_dsc = steps[0].piece->dsc_out;
+
+      dt_print(DT_DEBUG_PIPE, "[pixelpipe] baked %i modules from %s to %s in a %i^3 LUT\n", count,
+               steps[count - 1].piece->module->op, steps[0].piece->module->op, level);
+    }
+    dt_free_align(grid);
+    dt_free_align(tmp);
+    dt_free_align(out);
+
+    // evaluate the modules one by one
+    if(pipe->baked_lut_hash != lut_hash) return -1;
+  }
+
+  if(!reserved || *output == NULL)
+    (void)dt_dev_pixelpipe_cache_get(pipe->cache, &pipe->cache_client, hash, bufsize, output, out_format);
+  if(*output == NULL) return 1;
+
+  const size_t npixels = (size_t)roi_out->width * roi_out->height;
+  const float *const restrict in = (const float *)input;
+  float *const restrict out = (float *)*output;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(in, out, npixels) schedule(static)
+#endif
+  for(size_t k = 0; k < npixels; k++)
+  {
+    for(int c = 0; c < 3; c++) out[4 * k + c] = _baked_lut_shape(in[4 * k + c]);
+    out[4 * k + 3] = in[4 * k + 3];
+  }
+  dt_lut3d_tetrahedral(out, out, npixels, pipe->baked_lut, level);
+  **out_format = pipe->baked_lut_dsc;
+  if(steps[0].piece->bypass_cache)
+    dt_dev_pixelpipe_cache_invalidate(pipe->cache, *output);
+
+  KILL_SWITCH_AND_KEEP_CACHE(*output, cl_mem_output, roi_out, *out_format);
+
+  dt_show_times_f(&start, "[dev_pixelpipe]", "processed %i baked modules from %s to %s [%s]", count,
+                  steps[count - 1].piece->module->op, steps[0].piece->module->op, _pipe_type_to_str(pipe->type));
+  dt_trace_complete("pipe", "baked", start.clock, dt_get_wtime(),
+                    "\"pipe\":\"%s\",\"modules\":%d,\"from\":\"%s\",\"to\":\"%s\",\"width\":%d,\"height\":%d",
+                    _pipe_type_to_str(pipe->type), count, steps[count - 1].piece->module->op,
+                    steps[0].piece->module->op, roi_out->width, roi_out->height);
+
+  **out_format = pipe->dsc = pipe->baked_lut_dsc;
+  pixelpipe_get_histogram_backbuf(pipe, dev, *output, NULL, *out_format, roi_out, steps[0].piece->module,
+                                  steps[0].piece, hash, 4 * sizeof(float));
+
+  dt_dev_pixelpipe_cache_ready(pipe->cache, *output);
+  return 0;
+}
+
+#ifdef HAVE_OPENCL
+/* A late OpenCL error lost the input of the module, it was only valid on the device. Instead of
+   restarting the whole pipe on CPU, compute that input again on CPU: the upstream outputs kept in
+   host memory are still valid, so usually only the previous module runs again. Then process the
+   module on CPU, the next modules go back to the device. */
+static int _recover_from_opencl_error(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **input,
+                                      dt_iop_buffer_dsc_t *input_format, const dt_iop_roi_t *roi_in,
+                                      void **output, dt_iop_buffer_dsc_t **out_format,
+                                      const dt_iop_roi_t *roi_out, GList *modules, GList *pieces, int pos,
+                                      dt_develop_tiling_t *tiling, dt_pixelpipe_flow_t *pixelpipe_flow)
+{
+  dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+  dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+  if(!pipe->opencl_error || pipe->devid < 0 || !pipe->opencl_enabled) return 1;
+
+  dt_print(DT_DEBUG_OPENCL, "[opencl_pixelpipe] late opencl error in module `%s', recomputing its input on cpu
+",
+           module->op);
+
+  // consume the failed events, they would make the whole pipe start over at the end of the run
+  dt_opencl_events_flush(pipe->devid, 1);
+  pipe->opencl_error = 0;
+
+  dt_dev_pixelpipe_cache_invalidate(pipe->cache, *input);
+  *input = NULL;
+
+  // the upstream modules leave their own format in pipe->dsc
+  const dt_iop_buffer_dsc_t dsc = pipe->dsc;
+  void *cl_mem_input = NULL;
+  pipe->opencl_enabled = 0;
+  int err = dt_dev_pixelpipe_process_rec(pipe, dev, input, &cl_mem_input, &input_format, roi_in,
+                                         g_list_previous(modules), g_list_previous(pieces), pos - 1);
+  pipe->dsc = dsc;
+  if(!err)
+    err = pixelpipe_process_on_CPU(pipe, dev, *input, input_format, roi_in, output, out_format, roi_out, module,
+                                   piece, tiling, pixelpipe_flow);
+  pipe->opencl_enabled = 1;
+  return err;
+}
+#endif
+
+
 // recursive helper for process:
 static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                         void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
@@ -2061,24 +3224,49 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   const size_t bufsize = (size_t)bpp * roi_out->width * roi_out->height;
 
   // 1) if cached buffer is still available, return data.
+  // If it was kept on the device we are running on, take the device buffer as is.
   uint64_t hash = _node_hash(pipe, piece, roi_out, pos);
   const gboolean bypass_cache = (module) ? piece->bypass_cache : FALSE;
-  if(!bypass_cache && dt_dev_pixelpipe_cache_available(&(pipe->cache), hash))
+  const int cache_devid = (dt_opencl_is_inited() && pipe->opencl_enabled) ? pipe->devid : -1;
+  if(!bypass_cache
+     && dt_dev_pixelpipe_cache_get_existing_device(pipe->cache, &pipe->cache_client, hash, bufsize, output,
+                                                   out_format, cache_devid, cl_mem_output))
   {
     if(module)
       dt_print(DT_DEBUG_PIPE, "[pixelpipe] cache available for pipe %i and module %s (%s) with hash %llu\n",
              pipe->type, module->op, module->multi_name, (long long unsigned int)hash);
-
-    (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+    _record_cache_hit(pipe, module, "memory");
 
     // Get the pipe-global histograms. We want float32 buffers, so we take all outputs
     // except for gamma which outputs uint8 so we need to deal with that internally
-    pixelpipe_get_histogram_backbuf(pipe, dev, *output, NULL, *out_format, roi_out, module, piece, hash, bpp);
+    pixelpipe_get_histogram_backbuf(pipe, dev, *output, *cl_mem_output, *out_format, roi_out, module, piece,
+                                    hash, bpp);
 
-    KILL_SWITCH_AND_FLUSH_CACHE;
+    KILL_SWITCH_AND_KEEP_CACHE(*output, cl_mem_output, roi_out, *out_format);
     return 0;
   }
 
+  // 1b) if it was saved on disk, maybe in a previous session, uncompress it into a new cache line.
+  const gboolean use_disk_cache = !bypass_cache && _use_disk_cache(pipe, module);
+  gboolean reserved = FALSE;
+  if(use_disk_cache && dt_dev_pixelpipe_disk_cache_available(pipe->cache->disk, hash, bufsize))
+  {
+    // a miss leaves the line reserved for us, reuse it to compute the output if reading fails
+    reserved = dt_dev_pixelpipe_cache_get(pipe->cache, &pipe->cache_client, hash, bufsize, output, out_format);
+    if(!reserved
+       || (*output && !dt_dev_pixelpipe_disk_cache_read(pipe->cache->disk, hash, *output, bufsize, *out_format)))
+    {
+      dt_print(DT_DEBUG_PIPE, "[pixelpipe] disk cache available for pipe %i and module %s (%s) with hash %llu\n",
+               pipe->type, module->op, module->multi_name, (long long unsigned int)hash);
+      _record_cache_hit(pipe, module, "disk");
+      dt_dev_pixelpipe_cache_ready(pipe->cache, *output);
+      pixelpipe_get_histogram_backbuf(pipe, dev, *output, NULL, *out_format, roi_out, module, piece, hash, bpp);
+
+      KILL_SWITCH_AND_KEEP_CACHE(*output, cl_mem_output, roi_out, *out_format);
+      return 0;
+    }
+  }
+
   // 2) if history changed or exit event, abort processing?
   KILL_SWITCH_ABORT;
 
@@ -2095,11 +3283,27 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
                       bpp))
       return 1;
 
+    // other pipes can now use it
+    dt_dev_pixelpipe_cache_ready(pipe->cache, *output);
+
     dt_show_times_f(&start, "[dev_pixelpipe]", "initing base buffer [%s]", _pipe_type_to_str(pipe->type));
+    dt_trace_complete("pipe", "input", start.clock, dt_get_wtime(),
+                      "\"pipe\":\"%s\",\"width\":%d,\"height\":%d", _pipe_type_to_str(pipe->type),
+                      roi_out->width, roi_out->height);
     return 0;
   }
 
-  // 3b) recurse and obtain output array in &input
+  // 3b) runs of pointwise modules needing tiling are processed at once, band by band
+  const int fused = _process_fused(pipe, dev, output, cl_mem_output, out_format, roi_out, modules, pieces, pos,
+                                   hash, bufsize, reserved);
+  if(fused >= 0) return fused;
+
+  // 3c) on CPU previews, runs of pointwise modules are baked into a 3D LUT
+  const int baked = _process_baked(pipe, dev, output, cl_mem_output, out_format, roi_out, modules, pieces, pos,
+                                   hash, bufsize, reserved);
+  if(baked >= 0) return baked;
+
+  // 3d) recurse and obtain output array in &input
   dt_print(DT_DEBUG_PIPE, "[pixelpipe] cache not available for pipe %i and module %s (%s) with hash %llu\n",
              pipe->type, module->op, module->multi_name, (long long unsigned int)hash);
 
@@ -2121,7 +3325,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
                                   g_list_previous(modules), g_list_previous(pieces), pos - 1))
     return 1;
 
-  KILL_SWITCH_ABORT;
+  // the input may live only on the device, don't lose it
+  KILL_SWITCH_AND_KEEP_CACHE(input, &cl_mem_input, &roi_in, input_format);
 
   const size_t in_bpp = dt_iop_buffer_dsc_to_bpp(input_format);
   piece->dsc_out = piece->dsc_in = *input_format;
@@ -2130,7 +3335,10 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   const size_t out_bpp = dt_iop_buffer_dsc_to_bpp(*out_format);
 
   // reserve new cache line: output
-  (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+  dt_memstat_module_begin(in_bpp * roi_in.width * roi_in.height);
+  if(!reserved || *output == NULL)
+    (void)dt_dev_pixelpipe_cache_get(pipe->cache, &pipe->cache_client, hash, bufsize, output, out_format);
+  dt_memstat_alloc(DT_MEMSTAT_CACHE, bufsize);
 
   dt_times_t start;
   dt_get_times(&start);
@@ -2169,13 +3377,20 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
      step is anyhow done on cpu. we assume that blending itself will never require tiling in cpu path,
      because memory requirements will still be low enough. */
 
+  // the factors measured on previous runs, when they are higher
+  dt_tiling_calibration_apply(module, pipe->devid, &tiling);
+
   assert(tiling.factor > 0.0f);
   assert(tiling.factor_cl > 0.0f);
 
+  const gboolean input_on_device = (cl_mem_input != NULL);
+
   // Actual pixel processing for this module
 #ifdef HAVE_OPENCL
   if (pixelpipe_process_on_GPU(pipe, dev, input, cl_mem_input, input_format, &roi_in, output, cl_mem_output, out_format, roi_out,
-                               module, piece, &tiling, &pixelpipe_flow, in_bpp, bpp))
+                               module, piece, &tiling, &pixelpipe_flow, in_bpp, bpp)
+      && _recover_from_opencl_error(pipe, dev, &input, input_format, &roi_in, output, out_format, roi_out, modules,
+                                    pieces, pos, &tiling, &pixelpipe_flow))
     return 1;
 #else
   if (pixelpipe_process_on_CPU(pipe, dev, input, input_format, &roi_in, output, out_format, roi_out,
@@ -2185,15 +3400,20 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
 
   // Get the pipe-global histograms. We want float32 buffers, so we take all outputs
   // except for gamma which outputs uint8 so we need to deal with that internally
-  // Note that GPU is forced to write its output to RAM cache, so we don't use the cl_mem_output anymore.
   pixelpipe_get_histogram_backbuf(pipe, dev, *output, *cl_mem_output, *out_format, roi_out, module, piece, hash, bpp);
 
   // Don't cache outputs if we requested to bypass the cache
-  if(bypass_cache) dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+  if(bypass_cache) dt_dev_pixelpipe_cache_invalidate(pipe->cache, *output);
 
-  KILL_SWITCH_AND_FLUSH_CACHE;
+  // from here, the output is complete, its format is in pipe->dsc
+  KILL_SWITCH_AND_KEEP_CACHE(*output, cl_mem_output, roi_out, &pipe->dsc);
 
   _print_perf_debug(pipe, pixelpipe_flow, piece, module, &start);
+  const dt_memstat_t *mem = _record_module(pipe, pixelpipe_flow, module, roi_out, &start);
+  if(!(pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING))
+    dt_tiling_calibration_record(module, pipe->devid, &tiling, MAX(roi_in.width, roi_out->width),
+                                 MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp), mem,
+                                 (pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU) != 0, input_on_device);
 
   // in case we get this buffer from the cache in the future, cache some stuff:
   **out_format = piece->dsc_out = pipe->dsc;
@@ -2210,7 +3430,21 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       _pixelpipe_pick_samples(dev, module, (const float *const )input, &roi_in);
   }
 
-  KILL_SWITCH_AND_FLUSH_CACHE;
+  KILL_SWITCH_AND_KEEP_CACHE(*output, cl_mem_output, roi_out, *out_format);
+
+  // If the output lives only on GPU, the RAM copy will be marked ready when
+  // the next module writes it back. Otherwise, other pipes can now use it.
+  if(*cl_mem_output == NULL)
+  {
+    dt_dev_pixelpipe_cache_ready(pipe->cache, *output);
+
+    // Save slow outputs for later. GPU-only outputs are skipped, fetching them would stall the pipe.
+    static dt_conf_key_t *min_time = NULL;
+    if(use_disk_cache
+       && (dt_get_wtime() - start.clock) * 1000.
+              > dt_conf_key_get_int(dt_conf_key_once(&min_time, "pixelpipe_disk_cache_min_time")))
+      dt_dev_pixelpipe_disk_cache_write(pipe->cache->disk, hash, *output, bufsize, *out_format);
+  }
   return 0;
 }
 
@@ -2296,6 +3530,8 @@ static int dt_dev_pixelpipe_process_rec_and_backcopy(dt_dev_pixelpipe_t *pipe, d
         pipe->opencl_error = 1;
         ret = 1;
       }
+      else
+        dt_dev_pixelpipe_cache_ready(pipe->cache, *output);
     }
   }
 #endif
@@ -2315,8 +3551,8 @@ static int dt_dev_pixelpipe_process_rec_and_backcopy(dt_dev_pixelpipe_t *pipe, d
     return 1;                                                                                                     \
   }
 
-int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
-                             float scale)
+static int _pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
+                              float scale)
 {
   KILL_SWITCH_PIPE
 
@@ -2338,7 +3574,7 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x,
 
   dt_iop_roi_t roi = (dt_iop_roi_t){ x, y, width, height, scale };
   // printf("pixelpipe homebrew process start\n");
-  if(darktable.unmuted & DT_DEBUG_DEV) dt_dev_pixelpipe_cache_print(&pipe->cache);
+  if(darktable.unmuted & DT_DEBUG_DEV) dt_dev_pixelpipe_cache_print(pipe->cache);
 
   // get a snapshot of mask list
   if(pipe->forms) g_list_free_full(pipe->forms, (void (*)(void *))dt_masks_free_form);
@@ -2369,13 +3605,32 @@ restart:;
   KILL_SWITCH_PIPE
 
   // run pixelpipe recursively and get error status
+  const double start = dt_get_wtime();
+  memset(&pipe->perf, 0, sizeof(pipe->perf));
+  dt_memstat_begin(&pipe->memstat);
+  dt_iop_scratch_pool_begin(pipe->scratch);
   const int err =
     dt_dev_pixelpipe_process_rec_and_backcopy(pipe, dev, &buf, &cl_mem_out, &out_format, &roi, modules,
                                               pieces, pos);
+  // histograms are complete before the GUI hears about the end of the run
+  _side_tasks_wait(pipe);
+  dt_iop_scratch_pool_end();
+  dt_memstat_end();
+  pipe->perf.runtime = dt_get_wtime() - start;
 
   // get status summary of opencl queue by checking the eventlist
   const int oclerr = (pipe->devid >= 0) ? (dt_opencl_events_flush(pipe->devid, 1) != 0) : 0;
 
+  const dt_memstat_t *mem = &pipe->memstat.run;
+  if(!err && !oclerr) dt_memstat_record(_pipe_type_to_str(pipe->type), NULL, mem);
+  dt_trace_complete("pipe", "pixelpipe", start, dt_get_wtime(),
+                    "\"pipe\":\"%s\",\"imgid\":%d,\"devid\":%d,\"width\":%d,\"height\":%d,\"error\":%d,"
+                    "\"host_peak\":%zu,\"device_peak\":%zu,\"cache_bytes\":%zu,\"tiling_bytes\":%zu,"
+                    "\"scratch_bytes\":%zu,\"device_bytes\":%zu",
+                    _pipe_type_to_str(pipe->type), pipe->image.id, pipe->devid, width, height, err || oclerr,
+                    mem->host_peak, mem->device_peak, mem->bytes[DT_MEMSTAT_CACHE], mem->bytes[DT_MEMSTAT_TILING],
+                    mem->bytes[DT_MEMSTAT_SCRATCH], mem->bytes[DT_MEMSTAT_DEVICE]);
+
   // Check if we had opencl errors ....
   // remark: opencl errors can come in two ways: pipe->opencl_error is TRUE (and err is TRUE) OR oclerr is
   // TRUE
@@ -2443,8 +3698,15 @@ restart:;
   pipe->backbuf = buf;
   pipe->backbuf_width = width;
   pipe->backbuf_height = height;
+  pipe->perf_last = pipe->perf;
 
-  if(dev->gui_attached)
+  if(dev->gui_attached && pipe->tiles && pipe->tiles_hash)
+  {
+    // the caller assembles output_backbuf from the tiles
+    dt_dev_pixelpipe_tiles_put(pipe->tiles, pipe->tiles_hash, scale, buf, x, y, width, height,
+                               pipe->processed_width * scale, pipe->processed_height * scale);
+  }
+  else if(dev->gui_attached)
   {
     if(pipe->output_backbuf == NULL || pipe->output_backbuf_width != pipe->backbuf_width || pipe->output_backbuf_height != pipe->backbuf_height)
     {
@@ -2457,15 +3719,36 @@ restart:;
     if(pipe->output_backbuf)
       memcpy(pipe->output_backbuf, pipe->backbuf, sizeof(uint8_t) * 4 * pipe->output_backbuf_width * pipe->output_backbuf_height);
 
+    pipe->output_backbuf_hash = pipe->backbuf_hash;
+
     pipe->output_imgid = pipe->image.id;
   }
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
   return 0;
 }
 
+static dt_thread_budget_priority_t _pipe_priority(const dt_dev_pixelpipe_type_t type)
+{
+  if(type & DT_DEV_PIXELPIPE_FULL) return DT_THREAD_BUDGET_FULL;
+  if(type & (DT_DEV_PIXELPIPE_PREVIEW | DT_DEV_PIXELPIPE_PREVIEW2)) return DT_THREAD_BUDGET_PREVIEW;
+  if(type & DT_DEV_PIXELPIPE_THUMBNAIL) return DT_THREAD_BUDGET_THUMBNAIL;
+  return DT_THREAD_BUDGET_EXPORT;
+}
+
+int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
+                             float scale)
+{
+  // share the cores with the other pipes running meanwhile
+  dt_thread_budget_begin(_pipe_priority(pipe->type));
+  const int ret = _pixelpipe_process(pipe, dev, x, y, width, height, scale);
+  dt_thread_budget_end();
+  return ret;
+}
+
 void dt_dev_pixelpipe_flush_caches(dt_dev_pixelpipe_t *pipe)
 {
-  dt_dev_pixelpipe_cache_flush(&pipe->cache);
+  // Only what this pipe computed, other pipes may not have the same problems.
+  dt_dev_pixelpipe_cache_flush_client(pipe->cache, &pipe->cache_client);
 }
 
 gboolean dt_dev_pixelpipe_activemodule_disables_currentmodule(struct dt_develop_t *dev, struct dt_iop_module_t *current_module)
@@ -2553,6 +3836,93 @@ void dt_dev_pixelpipe_get_roi_in(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *
   }
 }
 
+// the part of a width x height mask that isn't zero, in 16 bits
+static dt_dev_pixelpipe_distorted_mask_t *_distorted_mask_pack(const float *const mask, const int width,
+                                                               const int height)
+{
+  int x0 = width, x1 = 0, y0 = height, y1 = 0;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(mask, width, height) \
+  reduction(min : x0, y0) reduction(max : x1, y1) schedule(static)
+#endif
+  for(int y = 0; y < height; y++)
+  {
+    const float *const row = mask + (size_t)y * width;
+    int first = 0;
+    while(first < width && row[first] <= 0.0f) first++;
+    if(first == width) continue;
+    int last = width - 1;
+    while(row[last] <= 0.0f) last--;
+    x0 = MIN(x0, first);
+    x1 = MAX(x1, last + 1);
+    y0 = MIN(y0, y);
+    y1 = MAX(y1, y + 1);
+  }
+
+  dt_dev_pixelpipe_distorted_mask_t *entry = calloc(1, sizeof(dt_dev_pixelpipe_distorted_mask_t));
+  if(!entry) return NULL;
+  entry->width = width;
+  entry->height = height;
+  if(x1 <= x0 || y1 <= y0) return entry; // all zero
+
+  const dt_iop_roi_t box = { x0, y0, x1 - x0, y1 - y0, 1.0f };
+  entry->data = dt_alloc_align((size_t)box.width * box.height * sizeof(uint16_t));
+  if(!entry->data)
+  {
+    free(entry);
+    return NULL;
+  }
+  entry->box = box;
+
+  uint16_t *const data = entry->data;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(mask, data, width, box) schedule(static)
+#endif
+  for(int y = 0; y < box.height; y++)
+  {
+    const float *const in = mask + (size_t)(box.y + y) * width + box.x;
+    uint16_t *const out = data + (size_t)y * box.width;
+    for(int x = 0; x < box.width; x++) out[x] = (uint16_t)(CLAMP(in[x], 0.0f, 1.0f) * 65535.0f + 0.5f);
+  }
+  return entry;
+}
+
+static float *_distorted_mask_unpack(const dt_dev_pixelpipe_distorted_mask_t *const entry)
+{
+  float *const mask = dt_alloc_align_float((size_t)entry->width * entry->height);
+  if(!mask) return NULL;
+
+  const int width = entry->width;
+  const int height = entry->height;
+  const dt_iop_roi_t box = entry->box;
+  const uint16_t *const data = entry->data;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(mask, data, width, height, box) schedule(static)
+#endif
+  for(int y = 0; y < height; y++)
+  {
+    float *const out = mask + (size_t)y * width;
+    if(y < box.y || y >= box.y + box.height)
+    {
+      memset(out, 0, sizeof(float) * width);
+      continue;
+    }
+    const uint16_t *const in = data + (size_t)(y - box.y) * box.width;
+    memset(out, 0, sizeof(float) * box.x);
+    for(int x = 0; x < box.width; x++) out[box.x + x] = in[x] / 65535.0f;
+    memset(out + box.x + box.width, 0, sizeof(float) * (width - box.x - box.width));
+  }
+  return mask;
+}
+
+static gboolean _distorts_mask(const dt_dev_pixelpipe_iop_t *const piece)
+{
+  return piece->enabled && !dt_dev_pixelpipe_activemodule_disables_currentmodule(piece->module->dev, piece->module)
+         && piece->module->distort_mask
+         && !(!strcmp(piece->module->op, "finalscale") // hack against pipes not using finalscale
+              && piece->processed_roi_in.width == 0 && piece->processed_roi_in.height == 0);
+}
+
 float *dt_dev_get_raster_mask(dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *raster_mask_source,
                               const int raster_mask_id, const dt_iop_module_t *target_module,
                               gboolean *free_mask)
@@ -2595,15 +3965,51 @@ float *dt_dev_get_raster_mask(dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *r
     }
     else
     {
+      // the mask comes out distorted by the last distorting module before the target: modules reusing the
+      // same mask after it share the distorted copy that piece keeps
+      dt_dev_pixelpipe_iop_t *last_distort = NULL;
+      for(GList *iter = g_list_next(source_iter); iter; iter = g_list_next(iter))
+      {
+        dt_dev_pixelpipe_iop_t *module = (dt_dev_pixelpipe_iop_t *)iter->data;
+        if(_distorts_mask(module)) last_distort = module;
+        if(module->module == target_module) break;
+      }
+
+      uint64_t distorted_key = dt_hash(5381, (const char *)&source_piece->module, sizeof(dt_iop_module_t *));
+      distorted_key = dt_hash(distorted_key, (const char *)&raster_mask_id, sizeof(int));
+      uint64_t distorted_hash = 0;
+      if(last_distort && last_distort->global_hash && source_piece->global_hash)
+      {
+        distorted_hash = dt_hash(last_distort->global_hash, (const char *)&source_piece->global_hash, sizeof(uint64_t));
+        const dt_dev_pixelpipe_distorted_mask_t *entry
+            = g_hash_table_lookup(last_distort->distorted_masks, &distorted_key);
+        if(entry && entry->hash == distorted_hash && entry->width == last_distort->processed_roi_out.width
+           && entry->height == last_distort->processed_roi_out.height)
+        {
+          raster_mask = _distorted_mask_unpack(entry);
+          if(raster_mask)
+          {
+            dt_print(DT_DEBUG_MASKS,
+                     "[raster masks] reusing mask id %i from %s (%s) distorted by %s (%s) for module %s (%s) in pipe %i\n",
+                     raster_mask_id, source_piece->module->op, source_piece->module->multi_name,
+                     last_distort->module->op, last_distort->module->multi_name,
+                     target_module ? target_module->op : "export",
+                     target_module ? target_module->multi_name : "", pipe->type);
+            *free_mask = TRUE;
+            return raster_mask;
+          }
+        }
+      }
+
       const uint64_t raster_hash = source_piece->global_mask_hash;
       const size_t raster_size
           = source_piece->processed_roi_out.width * source_piece->processed_roi_out.height * sizeof(float);
       dt_iop_buffer_dsc_t *out_format = &source_piece->dsc_mask;
 
-      if(dt_dev_pixelpipe_cache_available(&(pipe->cache), raster_hash))
+      if(dt_dev_pixelpipe_cache_get_existing(pipe->cache, &pipe->cache_client, raster_hash, raster_size,
+                                             (void **)&raster_mask, &out_format))
       {
         // Try to get the mask from the global cache, in case the module flushed its reference
-        dt_dev_pixelpipe_cache_get(&(pipe->cache), raster_hash, raster_size, (void **)&raster_mask, &out_format);
         dt_print(DT_DEBUG_MASKS,
                  "[raster masks] found in cache mask id %i from %s (%s) for module %s (%s) in pipe %i\n",
                  raster_mask_id, source_piece->module->op, source_piece->module->multi_name, target_module->op,
@@ -2629,10 +4035,7 @@ float *dt_dev_get_raster_mask(dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *r
           if(module->enabled
              && !dt_dev_pixelpipe_activemodule_disables_currentmodule(module->module->dev, module->module))
           {
-            if(module->module->distort_mask
-              && !(!strcmp(module->module->op, "finalscale") // hack against pipes not using finalscale
-                    && module->processed_roi_in.width == 0
-                    && module->processed_roi_in.height == 0))
+            if(_distorts_mask(module))
             {
               float *transformed_mask = dt_alloc_align_float((size_t)module->processed_roi_out.width
                                                               * module->processed_roi_out.height);
@@ -2645,6 +4048,19 @@ float *dt_dev_get_raster_mask(dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *r
               if(*free_mask) dt_free_align(raster_mask);
               *free_mask = TRUE;
               raster_mask = transformed_mask;
+
+              if(module == last_distort && distorted_hash)
+              {
+                dt_dev_pixelpipe_distorted_mask_t *entry
+                    = _distorted_mask_pack(raster_mask, module->processed_roi_out.width,
+                                           module->processed_roi_out.height);
+                if(entry)
+                {
+                  entry->key = distorted_key;
+                  entry->hash = distorted_hash;
+                  g_hash_table_replace(module->distorted_masks, &entry->key, entry);
+                }
+              }
             }
             else if(!module->module->distort_mask &&
                     (module->processed_roi_in.width != module->processed_roi_out.width ||
@@ -22,6 +22,7 @@
 #include "common/image.h"
 #include "common/imageio.h"
 #include "common/iop_order.h"
+#include "common/memstat.h"
 #include "control/conf.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
@@ -42,6 +43,17 @@ typedef struct dt_dev_pixelpipe_raster_mask_t
   float *mask;
 } dt_dev_pixelpipe_raster_mask_t;
 
+// a raster mask of an upstream module, as distorted up to the output of a piece. Only the box where it
+// isn't zero is stored, in 16 bits.
+typedef struct dt_dev_pixelpipe_distorted_mask_t
+{
+  uint64_t key;          // source module and mask id
+  uint64_t hash;         // state of the pipe up to the piece when the mask was distorted
+  int width, height;     // size of the whole mask
+  dt_iop_roi_t box;      // part of the mask that isn't zero
+  uint16_t *data;        // box.width x box.height, 65535 is 1
+} dt_dev_pixelpipe_distorted_mask_t;
+
 typedef struct dt_dev_pixelpipe_iop_t
 {
   struct dt_iop_module_t *module;  // the module in the dev operation stack
@@ -81,6 +93,19 @@ typedef struct dt_dev_pixelpipe_iop_t
   // Same as global hash but for raster masks
   uint64_t global_mask_hash;
 
+  // Hash of the distortions applied to coordinates up to and including this module, for the full image.
+  // Unlike global_mask_hash, it doesn't change when panning: it keys the cache of rasterized drawn shapes.
+  uint64_t distort_hash;
+
+  // Hash of the image and of the params of this module instance and all the upstream modules, independent
+  // of the ROI and of the pipe resolution. Keys the global statistics of IOP_FLAGS_GLOBAL_STATS modules.
+  uint64_t stats_hash;
+
+  // key of the history state last committed to the piece by a synch of all nodes, 0 if unknown.
+  // Lets dt_dev_pixelpipe_synch_history() skip the nodes that didn't change.
+  uint64_t commit_hash;
+  int position;        // index of the node in the pipe when the nodes were last built
+
   int bpc;             // bits per channel, 32 means float
   int colors;          // how many colors per pixel
   dt_iop_roi_t buf_in,
@@ -97,6 +122,10 @@ typedef struct dt_dev_pixelpipe_iop_t
   gboolean bypass_cache;
 
   GHashTable *raster_masks; // GList* of dt_dev_pixelpipe_raster_mask_t
+
+  // raster masks of upstream modules distorted up to the output of this piece, for the modules after it
+  // that reuse them. dt_dev_pixelpipe_distorted_mask_t by key.
+  GHashTable *distorted_masks;
 } dt_dev_pixelpipe_iop_t;
 
 typedef enum dt_dev_pixelpipe_change_t
@@ -106,7 +135,8 @@ typedef enum dt_dev_pixelpipe_change_t
   DT_DEV_PIPE_REMOVE = 1 << 1,      // possibly elements of the pipe have to be removed
   DT_DEV_PIPE_SYNCH
   = 1 << 2, // all nodes up to end need to be synched, but no removal of module pieces is necessary
-  DT_DEV_PIPE_ZOOMED = 1 << 3 // zoom event, preview pipe does not need changes
+  DT_DEV_PIPE_ZOOMED = 1 << 3, // zoom event, preview pipe does not need changes
+  DT_DEV_PIPE_HISTORY = 1 << 4 // history changed anywhere, only nodes whose history changed need to be synched
 } dt_dev_pixelpipe_change_t;
 
 typedef enum dt_dev_pixelpipe_status_t
@@ -117,6 +147,32 @@ typedef enum dt_dev_pixelpipe_status_t
   DT_DEV_PIXELPIPE_INVALID = 3  // pixelpipe has finished; invalid result
 } dt_dev_pixelpipe_status_t;
 
+// number of slowest modules kept in dt_dev_pixelpipe_perf_t
+#define DT_DEV_PIXELPIPE_PERF_TOP 5
+
+typedef struct dt_dev_pixelpipe_perf_module_t
+{
+  char name[64];
+  double time;      // seconds
+  gboolean gpu;     // processed with OpenCL
+  gboolean tiling;  // processed with tiling
+} dt_dev_pixelpipe_perf_module_t;
+
+/**
+ * timings of one run of the pipe, same figures as the -d perf output.
+ * `modules` holds the slowest ones, slowest first.
+ */
+typedef struct dt_dev_pixelpipe_perf_t
+{
+  double runtime;      // seconds, whole run
+  int cache_hits;      // module outputs taken from the memory or disk cache
+  int cache_misses;    // module outputs computed
+  int gpu;             // modules processed with OpenCL
+  int tiled;           // modules processed with tiling
+  int n_modules;       // valid entries in modules
+  dt_dev_pixelpipe_perf_module_t modules[DT_DEV_PIXELPIPE_PERF_TOP];
+} dt_dev_pixelpipe_perf_t;
+
 /**
  * this encapsulates the pixelpipe.
  * a develop module will need several of these:
@@ -125,8 +181,10 @@ typedef enum dt_dev_pixelpipe_status_t
  */
 typedef struct dt_dev_pixelpipe_t
 {
-  // store history/zoom caches
-  dt_dev_pixelpipe_cache_t cache;
+  // store history/zoom caches. This is the global cache shared by all pipes.
+  dt_dev_pixelpipe_cache_t *cache;
+  // lines of the global cache currently used by this pipe
+  dt_dev_pixelpipe_cache_client_t cache_client;
   // input buffer
   float *input;
   // width and height of input buffer
@@ -159,11 +217,20 @@ typedef struct dt_dev_pixelpipe_t
   int backbuf_width, backbuf_height;
   float backbuf_scale;
   float backbuf_zoom_x, backbuf_zoom_y;
+  // the backbuffer comes from a draft pass, at a lower scale than the final one
+  gboolean backbuf_draft;
   uint64_t backbuf_hash;
   dt_pthread_mutex_t backbuf_mutex, busy_mutex;
   // output buffer (for display)
   uint8_t *output_backbuf;
   int output_backbuf_width, output_backbuf_height;
+  // identifies the content of output_backbuf, for what the GUI derives from it
+  uint64_t output_backbuf_hash;
+  // tiles of the output for the darkroom main pipe, NULL for the others.
+  // While tiles_hash is non-zero, dt_dev_pixelpipe_process() stores its output there
+  // instead of output_backbuf, and the caller assembles output_backbuf from the tiles.
+  struct dt_dev_pixelpipe_tiles_t *tiles;
+  uint64_t tiles_hash;
 
   // the data for the luminance mask are kept in a buffer written by demosaic or rawprepare
   // as we have to scale the mask later ke keep roi at that stage
@@ -178,6 +245,10 @@ typedef struct dt_dev_pixelpipe_t
   int running;
   // shutting down?
   dt_atomic_int shutdown;
+  // draft pass of a progressive render: modules may trade quality for speed
+  gboolean draft;
+  // throwaway run priming the OpenCL device, see dt_dev_warmup_job_create()
+  gboolean warmup;
   // opencl enabled for this pixelpipe?
   int opencl_enabled;
   // opencl error detected?
@@ -214,6 +285,24 @@ typedef struct dt_dev_pixelpipe_t
   // that's because the sync_top option can't assume only one history
   // item was added since the last synchronization.
   uint64_t last_history_hash;
+
+  // 3D LUT baked from the last run of pointwise modules, previews only
+  float *baked_lut;
+  uint64_t baked_lut_hash;
+  dt_iop_buffer_dsc_t baked_lut_dsc;
+
+  // host and device memory of the last run, see common/memstat.h
+  dt_memstat_scope_t memstat;
+
+  // scratch buffers of the modules, kept from run to run, see common/imagebuf.h
+  struct dt_iop_scratch_pool_t *scratch;
+
+  // helper thread for the side computations of the pipe (histograms), see pixelpipe_hb.c
+  struct dt_dev_pixelpipe_tasks_t *tasks;
+
+  // timings of the run in progress, and of the last complete one (protected by backbuf_mutex)
+  dt_dev_pixelpipe_perf_t perf;
+  dt_dev_pixelpipe_perf_t perf_last;
 } dt_dev_pixelpipe_t;
 
 struct dt_develop_t;
@@ -231,8 +320,8 @@ int dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe, int32_t width, int
 // inits all but the pixel caches, so you can't actually process an image (just get dimensions and
 // distortions)
 int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height);
-// inits the pixelpipe with given cacheline size and number of entries.
-int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries);
+// inits the pixelpipe with given backbuffer size, connected to the global pixelpipe cache.
+int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size);
 // constructs a new input buffer from given RGB float array.
 void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, float *input, int width,
                                 int height, float iscale);
@@ -272,6 +361,9 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, struct dt_develop_t
 // sync with develop_t history stack by just copying the top item params (same op, new params on top)
 void dt_dev_pixelpipe_synch_all_real(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, const char *caller_func);
 #define dt_dev_pixelpipe_synch_all(pipe, dev) dt_dev_pixelpipe_synch_all_real(pipe, dev, __FUNCTION__)
+// same as synch_all, but only recommit the nodes whose params, blendops or drawn masks changed since
+// the last synch. Environment-dependent commits (color profiles) need a full synch_all.
+void dt_dev_pixelpipe_synch_history(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
 // adjust output node according to history stack (history pop event)
 void dt_dev_pixelpipe_synch_top(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
 
@@ -311,6 +403,10 @@ float *dt_dev_distort_detail_mask(const dt_dev_pixelpipe_t *pipe, float *src, co
 // Need to run after dt_dev_pixelpipe_get_roi_in() has updated processed ROI in/out
 void dt_pixelpipe_get_global_hash(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
 
+// Hash of the parameters of the whole pipe, without the ROI: it identifies the full processed image
+// whatever part of it gets computed. Needs dt_dev_pixelpipe_change() to have run.
+uint64_t dt_dev_pixelpipe_params_hash(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -0,0 +1,171 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_stats.h"
+#include "common/atomic.h"
+#include "common/darktable.h"
+#include "common/opencl.h"
+#include "control/conf.h"
+#include "control/control.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe_hb.h"
+
+#include <string.h>
+
+// statistics are a few floats per module instance, keep the last ones for a bunch of images and instances
+#define DT_DEV_PIXELPIPE_STATS_MAX 256
+
+typedef struct dt_dev_pixelpipe_stats_entry_t
+{
+  uint64_t hash;
+  int width, height; // of the full-frame ROI the statistics were computed on
+  size_t size;
+  char data[];
+} dt_dev_pixelpipe_stats_entry_t;
+
+typedef struct dt_dev_pixelpipe_stats_t
+{
+  GMutex lock;
+  GCond changed;    // signaled on each new entry, for pipes waiting on the preview
+  GHashTable *entries; // stats_hash -> dt_dev_pixelpipe_stats_entry_t
+  GQueue order;     // entries, oldest first
+} dt_dev_pixelpipe_stats_t;
+
+static dt_dev_pixelpipe_stats_t _stats;
+
+void dt_dev_pixelpipe_stats_init(void)
+{
+  g_mutex_init(&_stats.lock);
+  g_cond_init(&_stats.changed);
+  _stats.entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, free);
+  g_queue_init(&_stats.order);
+}
+
+void dt_dev_pixelpipe_stats_cleanup(void)
+{
+  g_queue_clear(&_stats.order);
+  g_hash_table_destroy(_stats.entries);
+  _stats.entries = NULL;
+  g_cond_clear(&_stats.changed);
+  g_mutex_clear(&_stats.lock);
+}
+
+gboolean dt_dev_pixelpipe_stats_full_frame(const dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi_in)
+{
+  // size of the whole input of the module at the scale of roi_in, give or take rounding
+  const float scale = roi_in->scale / piece->iscale;
+  const int width = (int)(piece->buf_in.width * scale);
+  const int height = (int)(piece->buf_in.height * scale);
+  return roi_in->x <= 1 && roi_in->y <= 1 && roi_in->width + 2 >= width && roi_in->height + 2 >= height;
+}
+
+static int _stats_timeout(const dt_dev_pixelpipe_t *pipe)
+{
+#ifdef HAVE_OPENCL
+  if(pipe->devid >= 0) return darktable.opencl->opencl_synchronization_timeout;
+#endif
+  return dt_conf_get_int("pixelpipe_synchronization_timeout");
+}
+
+// roi is NULL to accept statistics computed at any resolution
+static gboolean _stats_lookup(const uint64_t hash, const dt_iop_roi_t *roi, void *stats, const size_t size)
+{
+  const dt_dev_pixelpipe_stats_entry_t *entry = g_hash_table_lookup(_stats.entries, &hash);
+  if(!entry || entry->size != size) return FALSE;
+  if(roi && (entry->width != roi->width || entry->height != roi->height)) return FALSE;
+  memcpy(stats, entry->data, size);
+  return TRUE;
+}
+
+gboolean dt_dev_pixelpipe_stats_get(const dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi_in, void *stats,
+                                    const size_t size)
+{
+  // exact values are cheaper to compute than to wait for, but the statistic hash does not depend on the
+  // parameters of the module itself: reuse the ones we computed on this very input before
+  if(dt_dev_pixelpipe_stats_full_frame(piece, roi_in))
+  {
+    g_mutex_lock(&_stats.lock);
+    const gboolean found = _stats_lookup(piece->stats_hash, roi_in, stats, size);
+    g_mutex_unlock(&_stats.lock);
+    return found;
+  }
+
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  const gboolean wait = piece->module->dev->gui_attached
+                        && (pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL;
+  const int nloop = wait ? _stats_timeout(pipe) : 0;
+  // same units as dt_dev_wait_hash(): 5 ms per loop
+  const gint64 end = g_get_monotonic_time() + (gint64)MAX(nloop, 0) * 5000;
+
+  g_mutex_lock(&_stats.lock);
+  gboolean found = _stats_lookup(piece->stats_hash, NULL, stats, size);
+  while(!found && g_get_monotonic_time() < end && !dt_atomic_get_int(&pipe->shutdown))
+  {
+    // wake up regularly to check for pipe shutdown
+    g_cond_wait_until(&_stats.changed, &_stats.lock, MIN(end, g_get_monotonic_time() + 5000));
+    found = _stats_lookup(piece->stats_hash, NULL, stats, size);
+  }
+  g_mutex_unlock(&_stats.lock);
+
+  if(!found)
+  {
+    dt_print(DT_DEBUG_PIPE, "[pixelpipe_stats] no global statistics for %s (%s) in pipe %i, using the ROI\n",
+             piece->module->op, piece->module->multi_name, pipe->type);
+    if(wait && nloop > 0 && !dt_atomic_get_int(&pipe->shutdown)) dt_control_log(_("inconsistent output"));
+  }
+
+  return found;
+}
+
+void dt_dev_pixelpipe_stats_put(const dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi_in,
+                                const void *stats, const size_t size)
+{
+  if(!dt_dev_pixelpipe_stats_full_frame(piece, roi_in)) return;
+
+  dt_dev_pixelpipe_stats_entry_t *entry = malloc(sizeof(dt_dev_pixelpipe_stats_entry_t) + size);
+  if(!entry) return;
+  entry->hash = piece->stats_hash;
+  entry->width = roi_in->width;
+  entry->height = roi_in->height;
+  entry->size = size;
+  memcpy(entry->data, stats, size);
+
+  g_mutex_lock(&_stats.lock);
+
+  dt_dev_pixelpipe_stats_entry_t *old = g_hash_table_lookup(_stats.entries, &entry->hash);
+  if(old) g_queue_remove(&_stats.order, old);
+  // the table owns the entries and frees the old one
+  g_hash_table_replace(_stats.entries, &entry->hash, entry);
+  g_queue_push_tail(&_stats.order, entry);
+
+  while(g_queue_get_length(&_stats.order) > DT_DEV_PIXELPIPE_STATS_MAX)
+  {
+    dt_dev_pixelpipe_stats_entry_t *oldest = g_queue_pop_head(&_stats.order);
+    g_hash_table_remove(_stats.entries, &oldest->hash);
+  }
+
+  g_cond_broadcast(&_stats.changed);
+  g_mutex_unlock(&_stats.lock);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
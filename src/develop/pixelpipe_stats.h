@@ -0,0 +1,67 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+
+struct dt_dev_pixelpipe_iop_t;
+struct dt_iop_roi_t;
+
+/**
+ * Global statistics of module inputs (most hazy region, maximum luminance...).
+ *
+ * Modules that need statistics over the whole image declare IOP_FLAGS_GLOBAL_STATS instead of requesting
+ * the full frame in modify_roi_in(): pipes that only see a region of the image, like the darkroom main
+ * pipe zoomed at 1:1, then reuse the values computed by a pipe that sees all of it, usually the low-resolution
+ * preview pipe. Upstream modules keep processing only the visible region.
+ *
+ * There is one process-wide store, separate from the pixel cache. Entries are keyed by
+ * dt_dev_pixelpipe_iop_t::stats_hash, which depends on the image, the module instance and the parameters
+ * of all modules upstream, but not on the parameters of the module itself, nor on the ROI or the pipe
+ * resolution. Statistics must therefore only describe the input of the module.
+ */
+
+void dt_dev_pixelpipe_stats_init(void);
+void dt_dev_pixelpipe_stats_cleanup(void);
+
+/** TRUE if roi_in covers the whole input image of the piece, so it can compute exact global statistics */
+gboolean dt_dev_pixelpipe_stats_full_frame(const struct dt_dev_pixelpipe_iop_t *piece,
+                                           const struct dt_iop_roi_t *roi_in);
+
+/**
+ * Copy the global statistics of the piece into stats if it should not compute them itself.
+ * When roi_in covers the full frame, only the statistics previously computed on a full frame of the same size
+ * are reused, so editing the module does not recompute them as long as nothing changes upstream.
+ * Returns FALSE when no matching statistics could be found: the module then computes them from its own input
+ * and hands them to dt_dev_pixelpipe_stats_put().
+ * The darkroom main pipe waits for the preview pipe up to pixelpipe_synchronization_timeout.
+ */
+gboolean dt_dev_pixelpipe_stats_get(const struct dt_dev_pixelpipe_iop_t *piece, const struct dt_iop_roi_t *roi_in,
+                                    void *stats, const size_t size);
+
+/** Publish statistics computed from roi_in. Ignored unless roi_in covers the full frame. */
+void dt_dev_pixelpipe_stats_put(const struct dt_dev_pixelpipe_iop_t *piece, const struct dt_iop_roi_t *roi_in,
+                                const void *stats, const size_t size);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,227 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_tiles.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TILE DT_DEV_PIXELPIPE_TILE_SIZE
+
+typedef struct dt_dev_pixelpipe_tile_key_t
+{
+  uint64_t hash;
+  float scale;
+  int x, y; // position on the grid
+} dt_dev_pixelpipe_tile_key_t;
+
+typedef struct dt_dev_pixelpipe_tile_t
+{
+  dt_dev_pixelpipe_tile_key_t key;
+  int width, height; // smaller than the grid on the right and bottom edges of the image
+  GList link;        // in the LRU queue
+  uint8_t data[];
+} dt_dev_pixelpipe_tile_t;
+
+struct dt_dev_pixelpipe_tiles_t
+{
+  GMutex lock;
+  GHashTable *tiles; // dt_dev_pixelpipe_tile_key_t -> dt_dev_pixelpipe_tile_t
+  GQueue lru;        // most recently used first
+  int max_tiles;
+};
+
+static guint _key_hash(gconstpointer key)
+{
+  const dt_dev_pixelpipe_tile_key_t *k = (const dt_dev_pixelpipe_tile_key_t *)key;
+  uint32_t scale;
+  memcpy(&scale, &k->scale, sizeof(scale));
+  return (guint)(k->hash ^ (k->hash >> 32)) ^ scale ^ (guint)k->x * 73856093u ^ (guint)k->y * 19349663u;
+}
+
+static gboolean _key_equal(gconstpointer a, gconstpointer b)
+{
+  const dt_dev_pixelpipe_tile_key_t *ka = (const dt_dev_pixelpipe_tile_key_t *)a;
+  const dt_dev_pixelpipe_tile_key_t *kb = (const dt_dev_pixelpipe_tile_key_t *)b;
+  return ka->hash == kb->hash && ka->scale == kb->scale && ka->x == kb->x && ka->y == kb->y;
+}
+
+static void _remove(dt_dev_pixelpipe_tiles_t *tiles, dt_dev_pixelpipe_tile_t *tile)
+{
+  g_hash_table_remove(tiles->tiles, &tile->key);
+  g_queue_unlink(&tiles->lru, &tile->link);
+  free(tile);
+}
+
+// lookup and mark as most recently used
+static dt_dev_pixelpipe_tile_t *_lookup(dt_dev_pixelpipe_tiles_t *tiles, const uint64_t hash, const float scale,
+                                        const int tx, const int ty)
+{
+  const dt_dev_pixelpipe_tile_key_t key = { .hash = hash, .scale = scale, .x = tx, .y = ty };
+  dt_dev_pixelpipe_tile_t *tile = g_hash_table_lookup(tiles->tiles, &key);
+  if(tile)
+  {
+    g_queue_unlink(&tiles->lru, &tile->link);
+    g_queue_push_head_link(&tiles->lru, &tile->link);
+  }
+  return tile;
+}
+
+dt_dev_pixelpipe_tiles_t *dt_dev_pixelpipe_tiles_new(const int max_tiles)
+{
+  dt_dev_pixelpipe_tiles_t *tiles = (dt_dev_pixelpipe_tiles_t *)calloc(1, sizeof(dt_dev_pixelpipe_tiles_t));
+  if(!tiles) return NULL;
+  g_mutex_init(&tiles->lock);
+  tiles->tiles = g_hash_table_new(_key_hash, _key_equal);
+  g_queue_init(&tiles->lru);
+  tiles->max_tiles = max_tiles;
+  return tiles;
+}
+
+void dt_dev_pixelpipe_tiles_free(dt_dev_pixelpipe_tiles_t *tiles)
+{
+  if(!tiles) return;
+  while(tiles->lru.head)
+    _remove(tiles, (dt_dev_pixelpipe_tile_t *)tiles->lru.head->data);
+  g_hash_table_destroy(tiles->tiles);
+  g_mutex_clear(&tiles->lock);
+  free(tiles);
+}
+
+gboolean dt_dev_pixelpipe_tiles_fit(const dt_dev_pixelpipe_tiles_t *tiles, const int width, const int height)
+{
+  // the region may straddle one more tile in each direction, and we want the previous view to survive a pan
+  const int count = (width / TILE + 2) * (height / TILE + 2);
+  return tiles && 2 * count <= tiles->max_tiles;
+}
+
+gboolean dt_dev_pixelpipe_tiles_missing(dt_dev_pixelpipe_tiles_t *tiles, const uint64_t hash, const float scale,
+                                        const int x, const int y, const int width, const int height,
+                                        const int image_width, const int image_height,
+                                        int *out_x, int *out_y, int *out_width, int *out_height)
+{
+  const int x_end = MIN(x + width, image_width);
+  const int y_end = MIN(y + height, image_height);
+  if(x < 0 || y < 0 || x_end <= x || y_end <= y) return FALSE;
+
+  int tx_min = INT_MAX, ty_min = INT_MAX, tx_max = -1, ty_max = -1;
+
+  g_mutex_lock(&tiles->lock);
+  for(int ty = y / TILE; ty <= (y_end - 1) / TILE; ty++)
+    for(int tx = x / TILE; tx <= (x_end - 1) / TILE; tx++)
+    {
+      if(_lookup(tiles, hash, scale, tx, ty)) continue;
+      tx_min = MIN(tx_min, tx);
+      tx_max = MAX(tx_max, tx);
+      ty_min = MIN(ty_min, ty);
+      ty_max = MAX(ty_max, ty);
+    }
+  g_mutex_unlock(&tiles->lock);
+
+  if(tx_max < 0) return FALSE;
+
+  *out_x = tx_min * TILE;
+  *out_y = ty_min * TILE;
+  *out_width = MIN((tx_max + 1) * TILE, image_width) - *out_x;
+  *out_height = MIN((ty_max + 1) * TILE, image_height) - *out_y;
+  return TRUE;
+}
+
+void dt_dev_pixelpipe_tiles_put(dt_dev_pixelpipe_tiles_t *tiles, const uint64_t hash, const float scale,
+                                const uint8_t *const buf, const int x, const int y, const int width,
+                                const int height, const int image_width, const int image_height)
+{
+  g_mutex_lock(&tiles->lock);
+  for(int ty = (y + TILE - 1) / TILE; ty * TILE < y + height; ty++)
+    for(int tx = (x + TILE - 1) / TILE; tx * TILE < x + width; tx++)
+    {
+      const int tile_width = MIN(TILE, image_width - tx * TILE);
+      const int tile_height = MIN(TILE, image_height - ty * TILE);
+      // only the tiles entirely rendered
+      if(tile_width <= 0 || tile_height <= 0 || tx * TILE + tile_width > x + width
+         || ty * TILE + tile_height > y + height)
+        continue;
+
+      dt_dev_pixelpipe_tile_t *old = _lookup(tiles, hash, scale, tx, ty);
+      if(old) _remove(tiles, old);
+
+      dt_dev_pixelpipe_tile_t *tile
+          = (dt_dev_pixelpipe_tile_t *)malloc(sizeof(dt_dev_pixelpipe_tile_t) + (size_t)4 * tile_width * tile_height);
+      if(!tile) continue;
+      tile->key = (dt_dev_pixelpipe_tile_key_t){ .hash = hash, .scale = scale, .x = tx, .y = ty };
+      tile->width = tile_width;
+      tile->height = tile_height;
+      tile->link = (GList){ .data = tile, .next = NULL, .prev = NULL };
+
+      const uint8_t *in = buf + 4 * ((size_t)(ty * TILE - y) * width + (tx * TILE - x));
+      for(int j = 0; j < tile_height; j++)
+        memcpy(tile->data + (size_t)4 * j * tile_width, in + (size_t)4 * j * width, (size_t)4 * tile_width);
+
+      g_hash_table_insert(tiles->tiles, &tile->key, tile);
+      g_queue_push_head_link(&tiles->lru, &tile->link);
+    }
+
+  while(tiles->lru.length > (guint)tiles->max_tiles)
+    _remove(tiles, (dt_dev_pixelpipe_tile_t *)tiles->lru.tail->data);
+  g_mutex_unlock(&tiles->lock);
+}
+
+gboolean dt_dev_pixelpipe_tiles_get(dt_dev_pixelpipe_tiles_t *tiles, const uint64_t hash, const float scale,
+                                    uint8_t *const out, const int x, const int y, const int width,
+                                    const int height)
+{
+  gboolean complete = width > 0 && height > 0;
+
+  g_mutex_lock(&tiles->lock);
+  for(int ty = y / TILE; complete && ty <= (y + height - 1) / TILE; ty++)
+    for(int tx = x / TILE; complete && tx <= (x + width - 1) / TILE; tx++)
+    {
+      const dt_dev_pixelpipe_tile_t *tile = _lookup(tiles, hash, scale, tx, ty);
+      if(!tile)
+      {
+        complete = FALSE;
+        break;
+      }
+
+      // intersection of the tile and the region, in image coordinates
+      const int x0 = MAX(x, tx * TILE), x1 = MIN(x + width, tx * TILE + tile->width);
+      const int y0 = MAX(y, ty * TILE), y1 = MIN(y + height, ty * TILE + tile->height);
+      if(x1 <= x0 || y1 <= y0)
+      {
+        // the region goes past the edge of the image
+        complete = FALSE;
+        break;
+      }
+
+      for(int j = y0; j < y1; j++)
+        memcpy(out + 4 * ((size_t)(j - y) * width + (x0 - x)),
+               tile->data + 4 * ((size_t)(j - ty * TILE) * tile->width + (x0 - tx * TILE)), (size_t)4 * (x1 - x0));
+    }
+  g_mutex_unlock(&tiles->lock);
+
+  return complete;
+}
+
+#undef TILE
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
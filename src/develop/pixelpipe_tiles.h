@@ -0,0 +1,70 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+
+/**
+ * Tiles of the final 8-bit output of the darkroom main pipe.
+ *
+ * The processed image at a given scale is cut along a fixed grid of DT_DEV_PIXELPIPE_TILE_SIZE pixels.
+ * Tiles are keyed by the hash of the parameters of the whole pipe, independent of the ROI (see
+ * dt_dev_pixelpipe_params_hash()), the scale and the tile coordinates. Panning then only renders the tiles
+ * newly exposed, and going back to a previous view or set of parameters costs nothing if its tiles are
+ * still there. Least recently used tiles are dropped first.
+ *
+ * Coordinates are those of the pipe output at that scale: (0, 0) is the top-left corner of the processed
+ * image and (width, height) its size, as passed to dt_dev_pixelpipe_process().
+ */
+
+#define DT_DEV_PIXELPIPE_TILE_SIZE 128
+
+typedef struct dt_dev_pixelpipe_tiles_t dt_dev_pixelpipe_tiles_t;
+
+dt_dev_pixelpipe_tiles_t *dt_dev_pixelpipe_tiles_new(const int max_tiles);
+void dt_dev_pixelpipe_tiles_free(dt_dev_pixelpipe_tiles_t *tiles);
+
+/** TRUE if the tiles of a region of width x height pixels can all be held at once */
+gboolean dt_dev_pixelpipe_tiles_fit(const dt_dev_pixelpipe_tiles_t *tiles, const int width, const int height);
+
+/**
+ * Find the smallest region aligned on the tile grid, clamped to the image, that holds all the tiles of the
+ * region (x, y, width, height) not yet rendered. Returns FALSE if there are none.
+ */
+gboolean dt_dev_pixelpipe_tiles_missing(dt_dev_pixelpipe_tiles_t *tiles, const uint64_t hash, const float scale,
+                                        const int x, const int y, const int width, const int height,
+                                        const int image_width, const int image_height,
+                                        int *out_x, int *out_y, int *out_width, int *out_height);
+
+/** Store the tiles entirely inside the region (x, y, width, height) rendered in the RGBA buffer buf */
+void dt_dev_pixelpipe_tiles_put(dt_dev_pixelpipe_tiles_t *tiles, const uint64_t hash, const float scale,
+                                const uint8_t *const buf, const int x, const int y, const int width,
+                                const int height, const int image_width, const int image_height);
+
+/** Assemble the region (x, y, width, height) into the RGBA buffer out. Returns FALSE if a tile is missing. */
+gboolean dt_dev_pixelpipe_tiles_get(dt_dev_pixelpipe_tiles_t *tiles, const uint64_t hash, const float scale,
+                                    uint8_t *const out, const int x, const int y, const int width,
+                                    const int height);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -18,7 +18,10 @@
 
 
 #include "develop/tiling.h"
+#include "common/memstat.h"
 #include "common/opencl.h"
+#include "common/trace.h"
+#include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
 #include "develop/pixelpipe.h"
@@ -108,6 +111,106 @@ static inline void _print_roi(const dt_iop_roi_t *roi, const char *label)
          roi->x, roi->y, roi->x + roi->width, roi->y + roi->height, roi->width, roi->height, roi->scale, label);
 }
 
+/*
+  tile size autotuning, see conf tiling_autotune.
+  The largest tile that fits in memory isn't always the fastest one, smaller tiles may stay in
+  the caches or balance better over the compute units. Candidate k has 1/2^k of the area of the
+  largest tile. Each candidate is measured on one tiled run of the module, per device and CPU,
+  then the fastest is used. Times in seconds per megapixel are kept in the config.
+*/
+#define TUNE_CANDIDATES 3
+
+typedef struct _tiling_tune_t
+{
+  char key[256];
+  int candidate;
+  gboolean measuring;
+  double start;
+} _tiling_tune_t;
+
+static void _tune_read(const char *key, float *times)
+{
+  for(int k = 0; k < TUNE_CANDIDATES; k++) times[k] = 0.0f;
+  if(!dt_conf_key_not_empty(key)) return;
+  gchar **fields = g_strsplit(dt_conf_get_string_const(key), " ", TUNE_CANDIDATES);
+  for(int k = 0; k < TUNE_CANDIDATES && fields[k]; k++)
+  {
+    const float t = g_ascii_strtod(fields[k], NULL);
+    times[k] = (isfinite(t) && t > 0.0f) ? t : 0.0f;
+  }
+  g_strfreev(fields);
+}
+
+/* returns the candidate tile size for this run of the module on devid, -1 for CPU */
+static int _tune_begin(_tiling_tune_t *tune, const char *op, const int devid)
+{
+  tune->candidate = 0;
+  tune->measuring = FALSE;
+  if(!dt_conf_get_bool("tiling_autotune")) return 0;
+
+#ifdef HAVE_OPENCL
+  if(devid >= 0 && dt_opencl_is_inited())
+    g_snprintf(tune->key, sizeof(tune->key), "plugins/tiling/%s/%s", darktable.opencl->dev[devid].cname, op);
+  else
+#endif
+    g_snprintf(tune->key, sizeof(tune->key), "plugins/tiling/cpu/%s", op);
+
+  float times[TUNE_CANDIDATES];
+  _tune_read(tune->key, times);
+
+  // the first candidate not measured yet, otherwise the fastest
+  for(int k = 0; k < TUNE_CANDIDATES; k++)
+  {
+    if(times[k] <= 0.0f)
+    {
+      tune->candidate = k;
+      tune->measuring = TRUE;
+      break;
+    }
+    if(times[k] < times[tune->candidate]) tune->candidate = k;
+  }
+
+  tune->start = dt_get_wtime();
+  return tune->candidate;
+}
+
+/* halve the longer side of the tile `candidate` times, while its good part stays large */
+static void _tune_tile_size(int *width, int *height, const int candidate, const int overlap, const int align)
+{
+  for(int k = 0; k < candidate; k++)
+  {
+    int *side = (*width >= *height) ? width : height;
+    const int halved = _align_down(*side / 2, align);
+    if(halved < _max(4 * overlap, 256)) break;
+    *side = halved;
+  }
+}
+
+static void _tune_end(_tiling_tune_t *tune, const dt_iop_roi_t *const roi_out)
+{
+  if(!tune->measuring) return;
+  const double mpix = (double)roi_out->width * roi_out->height / 1e6;
+  if(mpix <= 0.0) return;
+
+  float times[TUNE_CANDIDATES];
+  _tune_read(tune->key, times);
+  times[tune->candidate] = (dt_get_wtime() - tune->start) / mpix;
+
+  gchar *dat = g_strdup("");
+  for(int k = 0; k < TUNE_CANDIDATES; k++)
+  {
+    char num[G_ASCII_DTOSTR_BUF_SIZE];
+    g_ascii_formatd(num, sizeof(num), "%.4g", times[k]);
+    gchar *next = g_strconcat(dat, k ? " " : "", num, NULL);
+    g_free(dat);
+    dat = next;
+  }
+  dt_conf_set_string(tune->key, dat);
+  dt_print(DT_DEBUG_TILING, "[tiling autotune] `%s': candidate %d took %.3f s/Mpix\n", tune->key,
+           tune->candidate, times[tune->candidate]);
+  g_free(dat);
+}
+
 
 #if 0
 static void
@@ -587,6 +690,17 @@ static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_
 }
 
 
+// one event per tiled module, the processing time is in the event of the module itself
+static void _trace_tiles(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const char *variant,
+                         const int tiles_x, const int tiles_y, const int width, const int height)
+{
+  if(!dt_trace_enabled()) return;
+  dt_trace_instant("tiling", self->op,
+                   "\"variant\":\"%s\",\"tiles\":%d,\"tiles_x\":%d,\"tiles_y\":%d,\"tile_width\":%d,"
+                   "\"tile_height\":%d,\"devid\":%d",
+                   variant, tiles_x * tiles_y, tiles_x, tiles_y, width, height, piece->pipe->devid);
+}
+
 /* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations */
 static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                         const void *const ivoid, void *const ovoid,
@@ -669,6 +783,10 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
             width, height);
   }
 
+  /* smaller tiles if the autotuner wants them. alignment comes below */
+  _tiling_tune_t tune;
+  _tune_tile_size(&width, &height, _tune_begin(&tune, self->op, -1), tiling.overlap, 1);
+
   /* Alignment rules: we need to make sure that alignment requirements of module are fulfilled.
      Modules will report alignment requirements via xalign and yalign within tiling_callback().
      Typical use case is demosaic where Bayer pattern requires alignment to a multiple of 2 in x and y
@@ -706,6 +824,7 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
 
   dt_print(DT_DEBUG_TILING, "[default_process_tiling_ptp] (%dx%d) tiles with max dimensions %dx%d and overlap %d\n",
            tiles_x, tiles_y, width, height, overlap);
+  _trace_tiles(self, piece, "ptp", tiles_x, tiles_y, width, height);
 
   /* reserve input and output buffers for tiles */
   input = dt_alloc_align((size_t)width * height * in_bpp);
@@ -722,6 +841,8 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
              self->op);
     goto error;
   }
+  const size_t tile_bytes = (size_t)width * height * (in_bpp + out_bpp);
+  dt_memstat_alloc(DT_MEMSTAT_TILING, tile_bytes);
 
   /* store processed_maximum to be re-used and aggregated */
   dt_aligned_pixel_t processed_maximum_saved;
@@ -812,11 +933,14 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
     }
   }
 
+  _tune_end(&tune, roi_out);
+
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
 
   if(input != NULL) dt_free_align(input);
   if(output != NULL) dt_free_align(output);
+  dt_memstat_free(DT_MEMSTAT_TILING, tile_bytes);
   piece->pipe->tiling = 0;
   return;
 
@@ -941,6 +1065,10 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
             width, height);
   }
 
+  /* smaller tiles if the autotuner wants them */
+  _tiling_tune_t tune;
+  _tune_tile_size(&width, &height, _tune_begin(&tune, self->op, -1), tiling.overlap, xyalign);
+
   /* make sure that overlap follows alignment rules by making it wider when needed.
      overlap_in needs to be aligned, overlap_out is only here to calculate output buffer size */
   const int overlap_in = _align_up(tiling.overlap, xyalign);
@@ -985,6 +1113,7 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
 
   dt_print(DT_DEBUG_TILING, "[default_process_tiling_roi] (%dx%d) tiles with max dimensions %dx%d, good %dx%d, overlap %d->%d\n",
            tiles_x, tiles_y, width, height, tile_wd, tile_ht, overlap_in, overlap_out);
+  _trace_tiles(self, piece, "roi", tiles_x, tiles_y, width, height);
 
   /* store processed_maximum to be re-used and aggregated */
   dt_aligned_pixel_t processed_maximum_saved;
@@ -1099,6 +1228,9 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
                  self->op);
         goto error;
       }
+      const size_t tile_bytes = (size_t)iroi_full.width * iroi_full.height * in_bpp
+                                + (size_t)oroi_full.width * oroi_full.height * out_bpp;
+      dt_memstat_alloc(DT_MEMSTAT_TILING, tile_bytes);
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
@@ -1143,9 +1275,12 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
 
       dt_free_align(input);
       dt_free_align(output);
+      dt_memstat_free(DT_MEMSTAT_TILING, tile_bytes);
       input = output = NULL;
     }
 
+  _tune_end(&tune, roi_out);
+
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
 
@@ -1189,19 +1324,307 @@ void default_process_tiling(struct dt_iop_module_t *self, struct dt_dev_pixelpip
 
 
 #ifdef HAVE_OPENCL
+/* Split-frame processing of the tiles of one module over several OpenCL devices.
+   Every device gets its own shallow copy of the pipe and the piece, so process_cl() runs with its own
+   devid and processed_maximum. Devices pull the next tile from a shared counter until all are done. */
+typedef struct _tiling_cl_job_t
+{
+  struct dt_iop_module_t *self;
+  const void *ivoid;
+  void *ovoid;
+  const dt_iop_roi_t *roi_in;
+  const dt_iop_roi_t *roi_out;
+  int in_bpp, out_bpp;
+  int width, height;     // max tile dimensions, including overlap
+  int tile_wd, tile_ht;  // effective tile dimensions
+  int tiles_x, tiles_y;
+  int overlap;
+  dt_aligned_pixel_t processed_maximum;
+  dt_atomic_int next;    // next tile to process
+  dt_atomic_int failed;
+} _tiling_cl_job_t;
+
+typedef struct _tiling_cl_device_t
+{
+  _tiling_cl_job_t *job;
+  dt_dev_pixelpipe_t pipe;
+  dt_dev_pixelpipe_iop_t piece;
+  pthread_t thread;
+  int tiles;             // number of tiles processed by this device
+} _tiling_cl_device_t;
+
+static void *_tiling_cl_ptp_device(void *data)
+{
+  _tiling_cl_device_t *d = (_tiling_cl_device_t *)data;
+  _tiling_cl_job_t *job = d->job;
+  dt_iop_module_t *self = job->self;
+  const int devid = d->pipe.devid;
+  const int ipitch = job->roi_in->width * job->in_bpp;
+  const int opitch = job->roi_out->width * job->out_bpp;
+  cl_int err = CL_SUCCESS;
+
+  for(int tile = dt_atomic_add_int(&job->next, 1); tile < job->tiles_x * job->tiles_y;
+      tile = dt_atomic_add_int(&job->next, 1))
+  {
+    if(dt_atomic_get_int(&job->failed)) break;
+
+    // same order as the single device loop
+    const size_t tx = tile / job->tiles_y;
+    const size_t ty = tile % job->tiles_y;
+
+    const size_t wd = tx * job->tile_wd + job->width > job->roi_in->width ? job->roi_in->width - tx * job->tile_wd
+                                                                           : job->width;
+    const size_t ht = ty * job->tile_ht + job->height > job->roi_in->height
+                          ? job->roi_in->height - ty * job->tile_ht
+                          : job->height;
+
+    /* no need to process (end)tiles that are smaller than the total overlap area */
+    if((wd <= 2 * job->overlap && tx > 0) || (ht <= 2 * job->overlap && ty > 0)) continue;
+
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { wd, ht, 1 };
+    dt_iop_roi_t iroi = { job->roi_in->x + tx * job->tile_wd, job->roi_in->y + ty * job->tile_ht, wd, ht,
+                          job->roi_in->scale };
+    dt_iop_roi_t oroi = { job->roi_out->x + tx * job->tile_wd, job->roi_out->y + ty * job->tile_ht, wd, ht,
+                          job->roi_out->scale };
+    const size_t ioffs = (ty * job->tile_ht) * ipitch + (tx * job->tile_wd) * job->in_bpp;
+    size_t ooffs = (ty * job->tile_ht) * opitch + (tx * job->tile_wd) * job->out_bpp;
+
+    dt_print(DT_DEBUG_TILING, "[default_process_tiling_cl_ptp] tile (%zu,%zu) size %zux%zu at origin [%zu,%zu] on device %i\n",
+             tx, ty, wd, ht, tx * job->tile_wd, ty * job->tile_ht, devid);
+
+    cl_mem input = dt_opencl_alloc_device(devid, wd, ht, job->in_bpp);
+    cl_mem output = dt_opencl_alloc_device(devid, wd, ht, job->out_bpp);
+    gboolean success = (input != NULL && output != NULL);
+
+    if(success)
+    {
+      err = dt_opencl_write_host_to_device_raw(devid, (char *)job->ivoid + ioffs, input, origin, region, ipitch,
+                                               CL_TRUE);
+      success = (err == CL_SUCCESS);
+    }
+
+    if(success)
+    {
+      for_four_channels(k) d->pipe.dsc.processed_maximum[k] = job->processed_maximum[k];
+      success = self->process_cl(self, &d->piece, input, output, &iroi, &oroi);
+    }
+
+    if(success)
+    {
+      /* only copy back the "good" part of the tile */
+      if(tx > 0)
+      {
+        origin[0] += job->overlap;
+        region[0] -= job->overlap;
+        ooffs += (size_t)job->overlap * job->out_bpp;
+      }
+      if(ty > 0)
+      {
+        origin[1] += job->overlap;
+        region[1] -= job->overlap;
+        ooffs += (size_t)job->overlap * opitch;
+      }
+      err = dt_opencl_read_host_from_device_raw(devid, (char *)job->ovoid + ooffs, output, origin, region,
+                                                opitch, CL_TRUE);
+      success = (err == CL_SUCCESS);
+    }
+
+    dt_opencl_release_mem_object(input);
+    dt_opencl_release_mem_object(output);
+    dt_opencl_finish_sync_pipe(devid, d->pipe.type);
+
+    if(!success)
+    {
+      dt_print(DT_DEBUG_TILING | DT_DEBUG_OPENCL,
+               "[default_process_tiling_cl_ptp] couldn't run process_cl() for module '%s' on device %i: %s\n",
+               self->op, devid, cl_errstr(err));
+      dt_atomic_set_int(&job->failed, 1);
+      break;
+    }
+    d->tiles++;
+  }
+  return NULL;
+}
+
+// Run the tiles on the pipe device and on the other free devices allowed for exports, if any.
+// returns -1 if it's not worth it, so the caller processes the tiles alone, TRUE or FALSE otherwise.
+static int _process_tiling_cl_ptp_multi(_tiling_cl_job_t *job, struct dt_dev_pixelpipe_iop_t *piece,
+                                        const dt_develop_tiling_t *tiling)
+{
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  if((pipe->type & DT_DEV_PIXELPIPE_EXPORT) != DT_DEV_PIXELPIPE_EXPORT
+     || job->tiles_x * job->tiles_y < 2
+     || !dt_conf_get_bool("opencl_multi_device_tiling"))
+    return -1;
+
+  const int max = MIN(darktable.opencl->num_devs - 1, job->tiles_x * job->tiles_y - 1);
+  int *extra = (int *)malloc(sizeof(int) * MAX(max, 1));
+  const int locked = extra ? dt_opencl_lock_extra_devices(pipe->type, pipe->devid, extra, max) : 0;
+
+  // only keep the devices able to process tiles as big as the pipe device does
+  const int max_bpp = _max(job->in_bpp, job->out_bpp);
+  int count = 0;
+  for(int k = 0; k < locked; k++)
+  {
+    const int dev = extra[k];
+    if((size_t)job->width <= darktable.opencl->dev[dev].max_image_width
+       && (size_t)job->height <= darktable.opencl->dev[dev].max_image_height
+       && dt_opencl_image_fits_device(dev, job->width, job->height, max_bpp,
+                                      fmaxf(tiling->factor_cl, 1.0f), tiling->overhead))
+      extra[count++] = dev;
+    else
+      dt_opencl_unlock_device(dev);
+  }
+
+  if(count == 0)
+  {
+    free(extra);
+    return -1;
+  }
+
+  _tiling_cl_device_t *devices = (_tiling_cl_device_t *)calloc(count + 1, sizeof(_tiling_cl_device_t));
+  if(!devices)
+  {
+    for(int k = 0; k < count; k++) dt_opencl_unlock_device(extra[k]);
+    free(extra);
+    return -1;
+  }
+
+  dt_print(DT_DEBUG_TILING | DT_DEBUG_OPENCL, "[default_process_tiling_cl_ptp] module '%s' split over %d devices\n",
+           job->self->op, count + 1);
+
+  dt_atomic_set_int(&job->next, 0);
+  dt_atomic_set_int(&job->failed, 0);
+
+  for(int k = 0; k <= count; k++)
+  {
+    _tiling_cl_device_t *d = &devices[k];
+    d->job = job;
+    d->pipe = *pipe;
+    d->pipe.devid = (k == 0) ? pipe->devid : extra[k - 1];
+    d->pipe.tiling = 1;
+    d->piece = *piece;
+    d->piece.pipe = &d->pipe;
+  }
+
+  // the pipe device runs in our thread. If a thread can't start, the others take its tiles.
+  gboolean *started = (gboolean *)calloc(count + 1, sizeof(gboolean));
+  if(started)
+    for(int k = 1; k <= count; k++)
+      started[k] = !dt_pthread_create(&devices[k].thread, _tiling_cl_ptp_device, &devices[k]);
+  _tiling_cl_ptp_device(&devices[0]);
+
+  for(int k = 1; k <= count; k++)
+  {
+    if(started && started[k]) pthread_join(devices[k].thread, NULL);
+    dt_opencl_unlock_device(extra[k - 1]);
+  }
+
+  const gboolean success = !dt_atomic_get_int(&job->failed);
+
+  // all tiles give the same processed_maximum
+  for(int k = 0; k <= count; k++)
+  {
+    if(!devices[k].tiles) continue;
+    for_four_channels(c) pipe->dsc.processed_maximum[c] = devices[k].pipe.dsc.processed_maximum[c];
+    break;
+  }
+
+  if(!success)
+    for_four_channels(c) pipe->dsc.processed_maximum[c] = job->processed_maximum[c];
+
+  free(started);
+  free(devices);
+  free(extra);
+  return success;
+}
+
 /* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations */
+/* one tile on its way through the device. With overlapped transfers two slots take turns: while the tile
+   of one is processed, the previous tile is downloaded from the other and the next one is uploaded to it.
+   Without, only the first slot is used. */
+typedef struct _tiling_cl_slot_t
+{
+  cl_mem input, output;                // the device tiles
+  cl_mem pinned_input, pinned_output;  // pinned memory for host<->device transfers, if used
+  void *input_buffer, *output_buffer;  // their host mappings
+  cl_event done;                       // overlapped download of the tile, or NULL
+  gboolean staged;                     // the good part still has to be copied from output_buffer
+  size_t ooffs;                        // where the good part goes in the output image
+  size_t origin[3], region[3];         // where it is in output_buffer
+  size_t width;                        // width of the tile in output_buffer
+} _tiling_cl_slot_t;
+
+static gboolean _tiling_cl_slot_pin(const int devid, _tiling_cl_slot_t *slot, const size_t in_size,
+                                    const size_t out_size)
+{
+  slot->pinned_input = dt_opencl_alloc_device_buffer_with_flags(devid, in_size,
+                                                                CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR);
+  if(slot->pinned_input == NULL) return FALSE;
+  slot->input_buffer = dt_opencl_map_buffer(devid, slot->pinned_input, CL_TRUE, CL_MAP_WRITE, 0, in_size);
+  if(slot->input_buffer == NULL) return FALSE;
+  slot->pinned_output = dt_opencl_alloc_device_buffer_with_flags(devid, out_size,
+                                                                 CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR);
+  if(slot->pinned_output == NULL) return FALSE;
+  slot->output_buffer = dt_opencl_map_buffer(devid, slot->pinned_output, CL_TRUE, CL_MAP_READ, 0, out_size);
+  return slot->output_buffer != NULL;
+}
+
+/* remember where the good part of the downloaded tile goes */
+static void _tiling_cl_slot_stage(_tiling_cl_slot_t *slot, const size_t ooffs, const size_t *origin,
+                                  const size_t *region, const size_t width)
+{
+  slot->staged = TRUE;
+  slot->ooffs = ooffs;
+  for(int k = 0; k < 3; k++)
+  {
+    slot->origin[k] = origin[k];
+    slot->region[k] = region[k];
+  }
+  slot->width = width;
+}
+
+/* wait for the download of the tile in the slot, copy its good part into the output image if it went
+   through pinned memory, and release the device tiles */
+static cl_int _tiling_cl_slot_retire(_tiling_cl_slot_t *slot, void *const ovoid, const int opitch,
+                                     const int out_bpp)
+{
+  const cl_int err = dt_opencl_wait_transfer(&slot->done);
+  if(err == CL_SUCCESS && slot->staged)
+  {
+    for(size_t j = 0; j < slot->region[1]; j++)
+      memcpy((char *)ovoid + slot->ooffs + j * opitch,
+             (char *)slot->output_buffer + ((j + slot->origin[1]) * slot->width + slot->origin[0]) * out_bpp,
+             slot->region[0] * out_bpp);
+  }
+  slot->staged = FALSE;
+  dt_opencl_release_mem_object(slot->input);
+  slot->input = NULL;
+  dt_opencl_release_mem_object(slot->output);
+  slot->output = NULL;
+  return err;
+}
+
+/* free everything held by the slot, the device has to be done with it */
+static void _tiling_cl_slot_cleanup(const int devid, _tiling_cl_slot_t *slot)
+{
+  dt_opencl_wait_transfer(&slot->done);
+  if(slot->input_buffer != NULL) dt_opencl_unmap_mem_object(devid, slot->pinned_input, slot->input_buffer);
+  dt_opencl_release_mem_object(slot->pinned_input);
+  if(slot->output_buffer != NULL) dt_opencl_unmap_mem_object(devid, slot->pinned_output, slot->output_buffer);
+  dt_opencl_release_mem_object(slot->pinned_output);
+  dt_opencl_release_mem_object(slot->input);
+  dt_opencl_release_mem_object(slot->output);
+}
+
 static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                           const void *const ivoid, void *const ovoid,
                                           const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
                                           const int in_bpp)
 {
   cl_int err = -999;
-  cl_mem input = NULL;
-  cl_mem output = NULL;
-  cl_mem pinned_input = NULL;
-  cl_mem pinned_output = NULL;
-  void *input_buffer = NULL;
-  void *output_buffer = NULL;
+  _tiling_cl_slot_t slots[2] = { { 0 } };
 
   dt_print(DT_DEBUG_TILING, "[default_process_tiling_cl_ptp] **** tiling module '%s' for image with size %dx%d --> %dx%d\n",
            self->op, roi_in->width, roi_in->height, roi_out->width, roi_out->height);
@@ -1221,13 +1644,20 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
 
   /* shall we use pinned memory transfers? */
   gboolean use_pinned_memory = dt_opencl_use_pinned_memory(devid);
+  /* direct transfers of tiles don't need to block in event mode: the queue keeps them in order */
+  const int blocking = darktable.opencl->event_sync ? CL_FALSE : CL_TRUE;
+  /* shall the next tile be uploaded and the previous one downloaded while a tile is processed? */
+  const gboolean overlapped = dt_opencl_use_overlapped_transfers(devid);
+  const int nslots = overlapped ? 2 : 1;
   const int pinned_buffer_overhead = use_pinned_memory ? 2 : 0; // add two additional pinned memory buffers
                                                                 // which seemingly get allocated not only on
                                                                 // host but also on device (why???)
+  // the input and output of the tile in flight, and their pinned buffers
+  const int overlapped_overhead = overlapped ? 2 + pinned_buffer_overhead : 0;
   // avoid problems when pinned buffer size gets too close to max_mem_alloc size
   const float pinned_buffer_slack = use_pinned_memory ? 0.85f : 1.0f;
   const float available = (float)dt_opencl_get_device_available(devid);
-  const float factor = fmaxf(tiling.factor_cl + pinned_buffer_overhead, 1.0f);
+  const float factor = fmaxf(tiling.factor_cl + pinned_buffer_overhead + overlapped_overhead, 1.0f);
   const float singlebuffer = fminf(fmaxf((available - tiling.overhead) / factor, 0.0f),
                                   pinned_buffer_slack * (float)(dt_opencl_get_device_memalloc(devid)));
   const float maxbuf = fmaxf(tiling.maxbuf_cl, 1.0f);
@@ -1264,6 +1694,10 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
             width, height);
   }
 
+  /* smaller tiles if the autotuner wants them. alignment comes below */
+  _tiling_tune_t tune;
+  _tune_tile_size(&width, &height, _tune_begin(&tune, self->op, devid), tiling.overlap, 1);
+
   /* Alignment rules: we need to make sure that alignment requirements of module are fulfilled.
      Modules will report alignment requirements via xalign and yalign within tiling_callback().
      Typical use case is demosaic where Bayer pattern requires alignment to a multiple of 2 in x and y
@@ -1309,65 +1743,37 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
 
   dt_print(DT_DEBUG_TILING, "[default_process_tiling_cl_ptp] (%dx%d) tiles with max dimensions %dx%d, pinned=%s, good %dx%d and overlap %d\n",
            tiles_x, tiles_y, width, height, (use_pinned_memory) ? "ON" : "OFF", tile_wd, tile_ht, overlap);
+  _trace_tiles(self, piece, "cl_ptp", tiles_x, tiles_y, width, height);
 
   /* store processed_maximum to be re-used and aggregated */
   dt_aligned_pixel_t processed_maximum_saved;
   dt_aligned_pixel_t processed_maximum_new = { 1.0f };
   for_four_channels(k) processed_maximum_saved[k] = piece->pipe->dsc.processed_maximum[k];
 
-  /* reserve pinned input and output memory for host<->device data transfer */
-  if(use_pinned_memory)
-  {
-    pinned_input = dt_opencl_alloc_device_buffer_with_flags(devid, (size_t)width * height * in_bpp,
-                                                            CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR);
-    if(pinned_input == NULL)
-    {
-      dt_print(DT_DEBUG_OPENCL | DT_DEBUG_TILING,
-               "[default_process_tiling_cl_ptp] could not alloc pinned input buffer for module '%s'\n", self->op);
-      use_pinned_memory = FALSE;
-    }
-  }
-
-  if(use_pinned_memory)
-  {
-
-    input_buffer = dt_opencl_map_buffer(devid, pinned_input, CL_TRUE, CL_MAP_WRITE, 0,
-                                        (size_t)width * height * in_bpp);
-    if(input_buffer == NULL)
-    {
-      dt_print(DT_DEBUG_OPENCL | DT_DEBUG_TILING, "[default_process_tiling_cl_ptp] could not map pinned input buffer to host "
-                                "memory for module '%s'\n", self->op);
-      use_pinned_memory = FALSE;
-    }
-  }
+  /* share the tiles with the other free devices, if allowed */
+  _tiling_cl_job_t job = { .self = self, .ivoid = ivoid, .ovoid = ovoid, .roi_in = roi_in, .roi_out = roi_out,
+                           .in_bpp = in_bpp, .out_bpp = out_bpp, .width = width, .height = height,
+                           .tile_wd = tile_wd, .tile_ht = tile_ht, .tiles_x = tiles_x, .tiles_y = tiles_y,
+                           .overlap = overlap };
+  for_four_channels(k) job.processed_maximum[k] = processed_maximum_saved[k];
+  piece->pipe->tiling = 1;
+  const int multi = _process_tiling_cl_ptp_multi(&job, piece, &tiling);
+  piece->pipe->tiling = 0;
+  if(multi >= 0) return multi;
 
-  if(use_pinned_memory)
+  /* reserve pinned input and output memory for host<->device data transfer, for each tile in flight */
+  for(int s = 0; s < nslots && use_pinned_memory; s++)
   {
-
-    pinned_output = dt_opencl_alloc_device_buffer_with_flags(devid, (size_t)width * height * out_bpp,
-                                                             CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR);
-    if(pinned_output == NULL)
+    if(!_tiling_cl_slot_pin(devid, &slots[s], (size_t)width * height * in_bpp, (size_t)width * height * out_bpp))
     {
       dt_print(DT_DEBUG_OPENCL | DT_DEBUG_TILING,
-               "[default_process_tiling_cl_ptp] could not alloc pinned output buffer for module '%s'\n", self->op);
-      use_pinned_memory = FALSE;
-    }
-  }
-
-  if(use_pinned_memory)
-  {
-
-    output_buffer = dt_opencl_map_buffer(devid, pinned_output, CL_TRUE, CL_MAP_READ, 0,
-                                         (size_t)width * height * out_bpp);
-    if(output_buffer == NULL)
-    {
-      dt_print(DT_DEBUG_OPENCL | DT_DEBUG_TILING, "[default_process_tiling_cl_ptp] could not map pinned output buffer to host "
-                                "memory for module '%s'\n", self->op);
+               "[default_process_tiling_cl_ptp] could not alloc or map pinned buffers for module '%s'\n", self->op);
       use_pinned_memory = FALSE;
     }
   }
 
   /* iterate over tiles */
+  int tile = 0;
   for(size_t tx = 0; tx < tiles_x; tx++)
     for(size_t ty = 0; ty < tiles_y; ty++)
     {
@@ -1396,28 +1802,41 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
       dt_print(DT_DEBUG_TILING, "[default_process_tiling_cl_ptp] tile (%zu,%zu) size %zux%zu at origin [%zu,%zu]\n",
                tx, ty, wd, ht, tx * tile_wd, ty * tile_ht);
 
+      /* with two tiles in flight, finish the one which used this slot before */
+      _tiling_cl_slot_t *const slot = &slots[tile++ % nslots];
+      if(overlapped)
+      {
+        err = _tiling_cl_slot_retire(slot, ovoid, opitch, out_bpp);
+        if(err != CL_SUCCESS) goto error;
+      }
+
       /* get input and output buffers */
-      input = dt_opencl_alloc_device(devid, wd, ht, in_bpp);
-      if(input == NULL) goto error;
-      output = dt_opencl_alloc_device(devid, wd, ht, out_bpp);
-      if(output == NULL) goto error;
+      slot->input = dt_opencl_alloc_device(devid, wd, ht, in_bpp);
+      if(slot->input == NULL) goto error;
+      slot->output = dt_opencl_alloc_device(devid, wd, ht, out_bpp);
+      if(slot->output == NULL) goto error;
 
       if(use_pinned_memory)
       {
+        void *const input_buffer = slot->input_buffer;
 /* prepare pinned input tile buffer: copy part of input image */
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-        dt_omp_firstprivate(in_bpp, ipitch, ivoid) \
-        dt_omp_sharedconst(ioffs, wd, ht) shared(input_buffer, width) \
+        dt_omp_firstprivate(in_bpp, ipitch, ivoid, input_buffer) \
+        dt_omp_sharedconst(ioffs, wd, ht) shared(width) \
         schedule(static)
 #endif
         for(size_t j = 0; j < ht; j++)
           memcpy((char *)input_buffer + j * wd * in_bpp, (char *)ivoid + ioffs + j * ipitch,
                  (size_t)wd * in_bpp);
 
-        /* blocking memory transfer: pinned host input buffer -> opencl/device tile */
-        err = dt_opencl_write_host_to_device_raw(devid, (char *)input_buffer, input, origin, region,
-                                                 wd * in_bpp, CL_TRUE);
+        if(overlapped)
+          err = dt_opencl_write_host_to_device_overlapped(devid, input_buffer, slot->input, origin, region,
+                                                          wd * in_bpp);
+        else
+          /* blocking memory transfer: pinned host input buffer -> opencl/device tile */
+          err = dt_opencl_write_host_to_device_raw(devid, input_buffer, slot->input, origin, region,
+                                                   wd * in_bpp, CL_TRUE);
         if(err != CL_SUCCESS)
         {
           use_pinned_memory = FALSE;
@@ -1426,9 +1845,13 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
       }
       else
       {
-        /* blocking direct memory transfer: host input image -> opencl/device tile */
-        err = dt_opencl_write_host_to_device_raw(devid, (char *)ivoid + ioffs, input, origin, region, ipitch,
-                                                 CL_TRUE);
+        if(overlapped)
+          err = dt_opencl_write_host_to_device_overlapped(devid, (char *)ivoid + ioffs, slot->input, origin,
+                                                          region, ipitch);
+        else
+          /* blocking direct memory transfer: host input image -> opencl/device tile */
+          err = dt_opencl_write_host_to_device_raw(devid, (char *)ivoid + ioffs, slot->input, origin, region,
+                                                   ipitch, blocking);
         if(err != CL_SUCCESS) goto error;
       }
 
@@ -1436,7 +1859,7 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
       for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
 
       /* call process_cl of module */
-      if(!self->process_cl(self, piece, input, output, &iroi, &oroi)) goto error;
+      if(!self->process_cl(self, piece, slot->input, slot->output, &iroi, &oroi)) goto error;
 
       /* aggregate resulting processed_maximum */
       /* TODO: check if there really can be differences between tiles and take
@@ -1451,9 +1874,14 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
 
       if(use_pinned_memory)
       {
-        /* blocking memory transfer: complete opencl/device tile -> pinned host output buffer */
-        err = dt_opencl_read_host_from_device_raw(devid, (char *)output_buffer, output, origin, region,
-                                                  wd * out_bpp, CL_TRUE);
+        if(overlapped)
+          /* the good part is copied into the output image once the slot is needed again */
+          err = dt_opencl_read_host_from_device_overlapped(devid, slot->output_buffer, slot->output, origin,
+                                                           region, wd * out_bpp, &slot->done);
+        else
+          /* blocking memory transfer: complete opencl/device tile -> pinned host output buffer */
+          err = dt_opencl_read_host_from_device_raw(devid, slot->output_buffer, slot->output, origin, region,
+                                                    wd * out_bpp, CL_TRUE);
         if(err != CL_SUCCESS)
         {
           use_pinned_memory = FALSE;
@@ -1476,8 +1904,13 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
         ooffs += (size_t)overlap * opitch;
       }
 
-      if(use_pinned_memory)
+      if(use_pinned_memory && overlapped)
+      {
+        _tiling_cl_slot_stage(slot, ooffs, origin, region, wd);
+      }
+      else if(use_pinned_memory)
       {
+        const void *const output_buffer = slot->output_buffer;
 /* copy "good" part of tile from pinned output buffer to output image */
 #if 0 // def _OPENMP
 #pragma omp parallel for default(none) shared(ovoid, ooffs, output_buffer, width, origin, region,            \
@@ -1490,43 +1923,54 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
       }
       else
       {
-        /* blocking direct memory transfer: good part of opencl/device tile -> host output image */
-        err = dt_opencl_read_host_from_device_raw(devid, (char *)ovoid + ooffs, output, origin, region,
-                                                  opitch, CL_TRUE);
+        if(overlapped)
+          err = dt_opencl_read_host_from_device_overlapped(devid, (char *)ovoid + ooffs, slot->output, origin,
+                                                           region, opitch, &slot->done);
+        else
+          /* blocking direct memory transfer: good part of opencl/device tile -> host output image */
+          err = dt_opencl_read_host_from_device_raw(devid, (char *)ovoid + ooffs, slot->output, origin, region,
+                                                    opitch, blocking);
         if(err != CL_SUCCESS) goto error;
       }
 
+      /* with overlapped transfers, the device tiles are released once the download is done */
+      if(overlapped) continue;
+
       /* release input and output buffers */
-      dt_opencl_release_mem_object(input);
-      input = NULL;
-      dt_opencl_release_mem_object(output);
-      output = NULL;
+      dt_opencl_release_mem_object(slot->input);
+      slot->input = NULL;
+      dt_opencl_release_mem_object(slot->output);
+      slot->output = NULL;
 
       /* block until opencl queue has finished to free all used event handlers */
       dt_opencl_finish_sync_pipe(devid, piece->pipe->type);
     }
 
+  /* the last tiles are still in flight */
+  for(int s = 0; s < nslots && overlapped; s++)
+  {
+    err = _tiling_cl_slot_retire(&slots[(tile + s) % nslots], ovoid, opitch, out_bpp);
+    if(err != CL_SUCCESS) goto error;
+  }
+
+  /* in event mode, the transfers of the last tiles may still be running */
+  if((darktable.opencl->event_sync || overlapped) && !dt_opencl_finish(devid)) goto error;
+
+  _tune_end(&tune, roi_out);
+
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
 
-  if(input_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_input, input_buffer);
-  dt_opencl_release_mem_object(pinned_input);
-  if(output_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_output, output_buffer);
-  dt_opencl_release_mem_object(pinned_output);
-  dt_opencl_release_mem_object(input);
-  dt_opencl_release_mem_object(output);
+  for(int s = 0; s < 2; s++) _tiling_cl_slot_cleanup(devid, &slots[s]);
   piece->pipe->tiling = 0;
   return TRUE;
 
 error:
   /* copy back stored processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
-  if(input_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_input, input_buffer);
-  dt_opencl_release_mem_object(pinned_input);
-  if(output_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_output, output_buffer);
-  dt_opencl_release_mem_object(pinned_output);
-  dt_opencl_release_mem_object(input);
-  dt_opencl_release_mem_object(output);
+  /* nothing may write into the pinned buffers or the output image anymore */
+  if(overlapped) dt_opencl_finish(devid);
+  for(int s = 0; s < 2; s++) _tiling_cl_slot_cleanup(devid, &slots[s]);
   piece->pipe->tiling = 0;
   const gboolean pinning_error = (use_pinned_memory == FALSE) && dt_opencl_use_pinned_memory(devid);
   dt_print(DT_DEBUG_TILING | DT_DEBUG_OPENCL,
@@ -1545,12 +1989,7 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
                                           const int in_bpp)
 {
   cl_int err = -999;
-  cl_mem input = NULL;
-  cl_mem output = NULL;
-  cl_mem pinned_input = NULL;
-  cl_mem pinned_output = NULL;
-  void *input_buffer = NULL;
-  void *output_buffer = NULL;
+  _tiling_cl_slot_t slots[2] = { { 0 } };
 
   dt_print(DT_DEBUG_TILING,
       "[default_process_tiling_cl_roi] **** tiling module '%s' for image with input size %dx%d --> %dx%d\n",
@@ -1582,13 +2021,20 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
 
   /* shall we use pinned memory transfers? */
   gboolean use_pinned_memory = dt_opencl_use_pinned_memory(devid);
+  /* direct transfers of tiles don't need to block in event mode: the queue keeps them in order */
+  const int blocking = darktable.opencl->event_sync ? CL_FALSE : CL_TRUE;
+  /* shall the next tile be uploaded and the previous one downloaded while a tile is processed? */
+  const gboolean overlapped = dt_opencl_use_overlapped_transfers(devid);
+  const int nslots = overlapped ? 2 : 1;
   const int pinned_buffer_overhead = use_pinned_memory ? 2 : 0; // add two additional pinned memory buffers
                                                                 // which seemingly get allocated not only on
                                                                 // host but also on device (why???)
+  // the input and output of the tile in flight, and their pinned buffers
+  const int overlapped_overhead = overlapped ? 2 + pinned_buffer_overhead : 0;
   // avoid problems when pinned buffer size gets too close to max_mem_alloc size
   const float pinned_buffer_slack = use_pinned_memory ? 0.85f : 1.0f;
   const float available = (float)dt_opencl_get_device_available(devid);
-  const float factor = fmaxf(tiling.factor_cl + pinned_buffer_overhead, 1.0f);
+  const float factor = fmaxf(tiling.factor_cl + pinned_buffer_overhead + overlapped_overhead, 1.0f);
   const float singlebuffer = fminf(fmaxf((available - tiling.overhead) / factor, 0.0f),
                                   pinned_buffer_slack * (float)(dt_opencl_get_device_memalloc(devid)));
   const float maxbuf = fmaxf(tiling.maxbuf_cl, 1.0f);
@@ -1637,6 +2083,10 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
             width, height);
   }
 
+  /* smaller tiles if the autotuner wants them */
+  _tiling_tune_t tune;
+  _tune_tile_size(&width, &height, _tune_begin(&tune, self->op, devid), tiling.overlap, xyalign);
+
   /* make sure that overlap follows alignment rules by making it wider when needed.
      overlap_in needs to be aligned, overlap_out is only here to calculate output buffer size */
   const int overlap_in = _align_up(tiling.overlap, xyalign);
@@ -1682,6 +2132,7 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
   dt_print(DT_DEBUG_TILING,
            "[default_process_tiling_cl_roi] (%dx%d) tiles with max input dimensions %dx%d, pinned=%s, good %ix%i\n",
            tiles_x, tiles_y, width, height, (use_pinned_memory) ? "ON" : "OFF", tile_wd, tile_ht);
+  _trace_tiles(self, piece, "cl_roi", tiles_x, tiles_y, width, height);
 
 
   /* store processed_maximum to be re-used and aggregated */
@@ -1689,60 +2140,20 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
   dt_aligned_pixel_t processed_maximum_new = { 1.0f };
   for_four_channels(k) processed_maximum_saved[k] = piece->pipe->dsc.processed_maximum[k];
 
-  /* reserve pinned input and output memory for host<->device data transfer */
-  if(use_pinned_memory)
-  {
-    pinned_input = dt_opencl_alloc_device_buffer_with_flags(devid, (size_t)width * height * in_bpp,
-                                                            CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR);
-    if(pinned_input == NULL)
-    {
-      dt_print(DT_DEBUG_OPENCL | DT_DEBUG_TILING,
-               "[default_process_tiling_cl_roi] could not alloc pinned input buffer for module '%s'\n", self->op);
-      use_pinned_memory = FALSE;
-    }
-  }
-
-  if(use_pinned_memory)
-  {
-
-    input_buffer = dt_opencl_map_buffer(devid, pinned_input, CL_TRUE, CL_MAP_WRITE, 0,
-                                        (size_t)width * height * in_bpp);
-    if(input_buffer == NULL)
-    {
-      dt_print(DT_DEBUG_OPENCL | DT_DEBUG_TILING, "[default_process_tiling_cl_roi] could not map pinned input buffer to host "
-                                "memory for module '%s'\n", self->op);
-      use_pinned_memory = FALSE;
-    }
-  }
-
-  if(use_pinned_memory)
+  /* reserve pinned input and output memory for host<->device data transfer, for each tile in flight */
+  for(int s = 0; s < nslots && use_pinned_memory; s++)
   {
-
-    pinned_output = dt_opencl_alloc_device_buffer_with_flags(devid, (size_t)width * height * out_bpp,
-                                                             CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR);
-    if(pinned_output == NULL)
+    if(!_tiling_cl_slot_pin(devid, &slots[s], (size_t)width * height * in_bpp, (size_t)width * height * out_bpp))
     {
       dt_print(DT_DEBUG_OPENCL | DT_DEBUG_TILING,
-               "[default_process_tiling_cl_roi] could not alloc pinned output buffer for module '%s'\n", self->op);
-      use_pinned_memory = FALSE;
-    }
-  }
-
-  if(use_pinned_memory)
-  {
-
-    output_buffer = dt_opencl_map_buffer(devid, pinned_output, CL_TRUE, CL_MAP_READ, 0,
-                                         (size_t)width * height * out_bpp);
-    if(output_buffer == NULL)
-    {
-      dt_print(DT_DEBUG_OPENCL | DT_DEBUG_TILING, "[default_process_tiling_cl_roi] could not map pinned output buffer to host "
-                                "memory for module '%s'\n", self->op);
+               "[default_process_tiling_cl_roi] could not alloc or map pinned buffers for module '%s'\n", self->op);
       use_pinned_memory = FALSE;
     }
   }
 
 
   /* iterate over tiles */
+  int tile = 0;
   for(size_t tx = 0; tx < tiles_x; tx++)
     for(size_t ty = 0; ty < tiles_y; ty++)
     {
@@ -1852,28 +2263,41 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
       dt_vprint(DT_DEBUG_TILING, "[default_process_tiling_cl_roi]    dest [%lu,%lu] at [%lu,%lu], offsets [%i,%i] -> [%i,%i], delta=%i\n\n",
                oregion[0], oregion[1], oorigin[0], oorigin[1], in_dx, in_dy, out_dx, out_dy, delta);
 
+      /* with two tiles in flight, finish the one which used this slot before */
+      _tiling_cl_slot_t *const slot = &slots[tile++ % nslots];
+      if(overlapped)
+      {
+        err = _tiling_cl_slot_retire(slot, ovoid, opitch, out_bpp);
+        if(err != CL_SUCCESS) goto error;
+      }
+
       /* get opencl input and output buffers */
-      input = dt_opencl_alloc_device(devid, iroi_full.width, iroi_full.height, in_bpp);
-      if(input == NULL) goto error;
+      slot->input = dt_opencl_alloc_device(devid, iroi_full.width, iroi_full.height, in_bpp);
+      if(slot->input == NULL) goto error;
 
-      output = dt_opencl_alloc_device(devid, oroi_full.width, oroi_full.height, out_bpp);
-      if(output == NULL) goto error;
+      slot->output = dt_opencl_alloc_device(devid, oroi_full.width, oroi_full.height, out_bpp);
+      if(slot->output == NULL) goto error;
 
       if(use_pinned_memory)
       {
+        void *const input_buffer = slot->input_buffer;
 /* prepare pinned input tile buffer: copy part of input image */
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-        dt_omp_firstprivate(in_bpp, ipitch, ivoid) \
-        dt_omp_sharedconst(ioffs) shared(input_buffer, width, iroi_full) schedule(static)
+        dt_omp_firstprivate(in_bpp, ipitch, ivoid, input_buffer) \
+        dt_omp_sharedconst(ioffs) shared(width, iroi_full) schedule(static)
 #endif
         for(size_t j = 0; j < iroi_full.height; j++)
           memcpy((char *)input_buffer + j * iroi_full.width * in_bpp, (char *)ivoid + ioffs + j * ipitch,
                  (size_t)iroi_full.width * in_bpp);
 
-        /* blocking memory transfer: pinned host input buffer -> opencl/device tile */
-        err = dt_opencl_write_host_to_device_raw(devid, (char *)input_buffer, input, iorigin, iregion,
-                                                 (size_t)iroi_full.width * in_bpp, CL_TRUE);
+        if(overlapped)
+          err = dt_opencl_write_host_to_device_overlapped(devid, input_buffer, slot->input, iorigin, iregion,
+                                                          (size_t)iroi_full.width * in_bpp);
+        else
+          /* blocking memory transfer: pinned host input buffer -> opencl/device tile */
+          err = dt_opencl_write_host_to_device_raw(devid, input_buffer, slot->input, iorigin, iregion,
+                                                   (size_t)iroi_full.width * in_bpp, CL_TRUE);
         if(err != CL_SUCCESS)
         {
           use_pinned_memory = FALSE;
@@ -1882,9 +2306,13 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
       }
       else
       {
-        /* blocking direct memory transfer: host input image -> opencl/device tile */
-        err = dt_opencl_write_host_to_device_raw(devid, (char *)ivoid + ioffs, input, iorigin, iregion,
-                                                 ipitch, CL_TRUE);
+        if(overlapped)
+          err = dt_opencl_write_host_to_device_overlapped(devid, (char *)ivoid + ioffs, slot->input, iorigin,
+                                                          iregion, ipitch);
+        else
+          /* blocking direct memory transfer: host input image -> opencl/device tile */
+          err = dt_opencl_write_host_to_device_raw(devid, (char *)ivoid + ioffs, slot->input, iorigin, iregion,
+                                                   ipitch, blocking);
         if(err != CL_SUCCESS) goto error;
       }
 
@@ -1892,7 +2320,7 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
       for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
 
       /* call process_cl of module */
-      if(!self->process_cl(self, piece, input, output, &iroi_full, &oroi_full)) goto error;
+      if(!self->process_cl(self, piece, slot->input, slot->output, &iroi_full, &oroi_full)) goto error;
 
       /* aggregate resulting processed_maximum */
       /* TODO: check if there really can be differences between tiles and take
@@ -1906,10 +2334,24 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
         processed_maximum_new[k] = piece->pipe->dsc.processed_maximum[k];
       }
 
-      if(use_pinned_memory)
+      if(use_pinned_memory && overlapped)
+      {
+        /* the good part is copied into the output image once the slot is needed again */
+        err = dt_opencl_read_host_from_device_overlapped(devid, slot->output_buffer, slot->output, oforigin,
+                                                         ofregion, (size_t)oroi_full.width * out_bpp,
+                                                         &slot->done);
+        if(err != CL_SUCCESS)
+        {
+          use_pinned_memory = FALSE;
+          goto error;
+        }
+        _tiling_cl_slot_stage(slot, ooffs, oorigin, oregion, oroi_full.width);
+      }
+      else if(use_pinned_memory)
       {
+        const void *const output_buffer = slot->output_buffer;
         /* blocking memory transfer: complete opencl/device tile -> pinned host output buffer */
-        err = dt_opencl_read_host_from_device_raw(devid, (char *)output_buffer, output, oforigin, ofregion,
+        err = dt_opencl_read_host_from_device_raw(devid, slot->output_buffer, slot->output, oforigin, ofregion,
                                                   (size_t)oroi_full.width * out_bpp, CL_TRUE);
         if(err != CL_SUCCESS)
         {
@@ -1919,8 +2361,8 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
 /* copy "good" part of tile from pinned output buffer to output image */
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-        dt_omp_firstprivate(ipitch, opitch, ovoid, out_bpp) \
-        dt_omp_sharedconst(ooffs) shared(output_buffer, oroi_full, oorigin, oregion) \
+        dt_omp_firstprivate(ipitch, opitch, ovoid, out_bpp, output_buffer) \
+        dt_omp_sharedconst(ooffs) shared(oroi_full, oorigin, oregion) \
         schedule(static)
 #endif
         for(size_t j = 0; j < oregion[1]; j++)
@@ -1930,42 +2372,53 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
       }
       else
       {
-        /* blocking direct memory transfer: good part of opencl/device tile -> host output image */
-        err = dt_opencl_read_host_from_device_raw(devid, (char *)ovoid + ooffs, output, oorigin, oregion,
-                                                  opitch, CL_TRUE);
+        if(overlapped)
+          err = dt_opencl_read_host_from_device_overlapped(devid, (char *)ovoid + ooffs, slot->output, oorigin,
+                                                           oregion, opitch, &slot->done);
+        else
+          /* blocking direct memory transfer: good part of opencl/device tile -> host output image */
+          err = dt_opencl_read_host_from_device_raw(devid, (char *)ovoid + ooffs, slot->output, oorigin, oregion,
+                                                    opitch, blocking);
         if(err != CL_SUCCESS) goto error;
       }
 
+      /* with overlapped transfers, the device tiles are released once the download is done */
+      if(overlapped) continue;
+
       /* release input and output buffers */
-      dt_opencl_release_mem_object(input);
-      input = NULL;
-      dt_opencl_release_mem_object(output);
-      output = NULL;
+      dt_opencl_release_mem_object(slot->input);
+      slot->input = NULL;
+      dt_opencl_release_mem_object(slot->output);
+      slot->output = NULL;
 
       /* block until opencl queue has finished to free all used event handlers */
       dt_opencl_finish_sync_pipe(devid, piece->pipe->type);
     }
 
+  /* the last tiles are still in flight */
+  for(int s = 0; s < nslots && overlapped; s++)
+  {
+    err = _tiling_cl_slot_retire(&slots[(tile + s) % nslots], ovoid, opitch, out_bpp);
+    if(err != CL_SUCCESS) goto error;
+  }
+
+  /* in event mode, the transfers of the last tiles may still be running */
+  if((darktable.opencl->event_sync || overlapped) && !dt_opencl_finish(devid)) goto error;
+
+  _tune_end(&tune, roi_out);
+
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
-  if(input_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_input, input_buffer);
-  dt_opencl_release_mem_object(pinned_input);
-  if(output_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_output, output_buffer);
-  dt_opencl_release_mem_object(pinned_output);
-  dt_opencl_release_mem_object(input);
-  dt_opencl_release_mem_object(output);
+  for(int s = 0; s < 2; s++) _tiling_cl_slot_cleanup(devid, &slots[s]);
   piece->pipe->tiling = 0;
   return TRUE;
 
 error:
   /* copy back stored processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
-  if(input_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_input, input_buffer);
-  dt_opencl_release_mem_object(pinned_input);
-  if(output_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_output, output_buffer);
-  dt_opencl_release_mem_object(pinned_output);
-  dt_opencl_release_mem_object(input);
-  dt_opencl_release_mem_object(output);
+  /* nothing may write into the pinned buffers or the output image anymore */
+  if(overlapped) dt_opencl_finish(devid);
+  for(int s = 0; s < 2; s++) _tiling_cl_slot_cleanup(devid, &slots[s]);
   piece->pipe->tiling = 0;
   const gboolean pinning_error = (use_pinned_memory == FALSE) && dt_opencl_use_pinned_memory(devid);
   dt_print(DT_DEBUG_OPENCL | DT_DEBUG_TILING,
@@ -2058,6 +2511,92 @@ int dt_tiling_piece_fits_host_memory(const size_t width, const size_t height, co
     return FALSE;
 }
 
+/*
+  memory calibration, see conf tiling_calibration.
+  The tiling callbacks declare the memory needs of the modules by hand. Untiled runs of at least a
+  megapixel compare them with the peaks measured by memstat: a module needing more than declared gets
+  its measured factor, with some headroom, on the next runs, per device and CPU. The factors are kept in
+  the config. Modules measured well below what they declare are only reported: memstat doesn't see
+  the buffers a module allocates by itself, so the declared factor may be right there.
+*/
+#define CALIBRATION_MIN_PIXELS (1 << 20)
+#define CALIBRATION_HEADROOM 1.1f
+
+static void _calibration_key(char *key, const size_t size, const char *op, const int devid)
+{
+#ifdef HAVE_OPENCL
+  if(devid >= 0 && dt_opencl_is_inited())
+  {
+    g_snprintf(key, size, "plugins/tiling/calibration/%s/%s", darktable.opencl->dev[devid].cname, op);
+    return;
+  }
+#endif
+  g_snprintf(key, size, "plugins/tiling/calibration/cpu/%s", op);
+}
+
+static float _calibration_read(const char *op, const int devid)
+{
+  char key[256];
+  _calibration_key(key, sizeof(key), op, devid);
+  if(!dt_conf_key_not_empty(key)) return 0.0f;
+  const float factor = g_ascii_strtod(dt_conf_get_string_const(key), NULL);
+  return (isfinite(factor) && factor > 0.0f) ? factor : 0.0f;
+}
+
+void dt_tiling_calibration_apply(const dt_iop_module_t *module, const int devid, dt_develop_tiling_t *tiling)
+{
+  if(!dt_conf_get_bool("tiling_calibration")) return;
+  tiling->factor = fmaxf(tiling->factor, _calibration_read(module->op, -1));
+#ifdef HAVE_OPENCL
+  if(devid >= 0) tiling->factor_cl = fmaxf(tiling->factor_cl, _calibration_read(module->op, devid));
+#endif
+}
+
+static void _calibration_check(const dt_iop_module_t *module, const int devid, const float declared,
+                               const float measured)
+{
+  const char *device = devid >= 0 ? "GPU" : "CPU";
+  if(measured > declared)
+  {
+    dt_print(DT_DEBUG_TILING, "[tiling calibration] `%s' on %s needs %.2f times its buffers, declares %.2f\n",
+             module->op, device, measured, declared);
+    // keep the highest, only rewrite it when it grows noticeably
+    const float corrected = measured * CALIBRATION_HEADROOM;
+    if(corrected > 1.05f * _calibration_read(module->op, devid))
+    {
+      char key[256], num[G_ASCII_DTOSTR_BUF_SIZE];
+      _calibration_key(key, sizeof(key), module->op, devid);
+      g_ascii_formatd(num, sizeof(num), "%.3g", corrected);
+      dt_conf_set_string(key, num);
+    }
+  }
+  else if(measured < 0.5f * declared)
+    dt_print(DT_DEBUG_TILING, "[tiling calibration] `%s' on %s used %.2f times its buffers, declares %.2f\n",
+             module->op, device, measured, declared);
+}
+
+void dt_tiling_calibration_record(const dt_iop_module_t *module, const int devid,
+                                  const dt_develop_tiling_t *tiling, const size_t width, const size_t height,
+                                  const unsigned bpp, const dt_memstat_t *mem, const gboolean on_device,
+                                  const gboolean input_on_device)
+{
+  if(!mem || !dt_conf_get_bool("tiling_calibration")) return;
+  if(width * height < CALIBRATION_MIN_PIXELS) return;
+  const double buffer = (double)width * height * bpp;
+
+  if(on_device)
+  {
+    // the device needs one buffer less for an input it already holds, see pixelpipe_process_on_GPU()
+    const float measured = mem->device_added / buffer + (input_on_device ? 1.0f : 0.0f);
+    _calibration_check(module, devid, tiling->factor_cl, measured);
+  }
+  else
+  {
+    const float measured = MAX((double)mem->host_peak - tiling->overhead, 0.0) / buffer;
+    _calibration_check(module, -1, tiling->factor, measured);
+  }
+}
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
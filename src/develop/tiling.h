@@ -74,6 +74,18 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
 int dt_tiling_piece_fits_host_memory(const size_t width, const size_t height, const unsigned bpp,
                                      const float factor, const size_t overhead);
 
+struct dt_memstat_t;
+
+/** raise the declared factors of the module to the ones measured on the previous runs on devid (-1 for
+    CPU), see conf tiling_calibration */
+void dt_tiling_calibration_apply(const struct dt_iop_module_t *module, const int devid,
+                                 dt_develop_tiling_t *tiling);
+/** compare an untiled run of the module, on the device or the CPU, with its declared factors */
+void dt_tiling_calibration_record(const struct dt_iop_module_t *module, const int devid,
+                                  const dt_develop_tiling_t *tiling, const size_t width, const size_t height,
+                                  const unsigned bpp, const struct dt_memstat_t *mem, const gboolean on_device,
+                                  const gboolean input_on_device);
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -308,6 +308,34 @@ static void _thumb_set_image_area(dt_thumbnail_t *thumb, float zoom_ratio)
   gtk_widget_set_size_request(thumb->w_image, image_w, image_h);
 }
 
+static void _draw_focus(dt_thumbnail_t *thumb)
+{
+  // if needed we compute and draw here the big rectangle to show focused areas
+  if(!thumb->display_focus) return;
+
+  uint8_t *full_res_thumb = NULL;
+  int32_t full_res_thumb_wd, full_res_thumb_ht;
+  dt_colorspaces_color_profile_type_t color_space;
+  char path[PATH_MAX] = { 0 };
+  gboolean from_cache = TRUE;
+  dt_image_full_path(thumb->imgid,  path,  sizeof(path),  &from_cache, __FUNCTION__);
+  if(!dt_imageio_large_thumbnail(path, &full_res_thumb, &full_res_thumb_wd, &full_res_thumb_ht, &color_space))
+  {
+    // we look for focus areas
+    dt_focus_cluster_t full_res_focus[49];
+    const int frows = 5, fcols = 5;
+    dt_focus_create_clusters(full_res_focus, frows, fcols, full_res_thumb, full_res_thumb_wd,
+                             full_res_thumb_ht);
+    // and we draw them on the image
+    cairo_t *cri = cairo_create(thumb->img_surf);
+    dt_focus_draw_clusters(cri, cairo_image_surface_get_width(thumb->img_surf),
+                           cairo_image_surface_get_height(thumb->img_surf), thumb->imgid, full_res_thumb_wd,
+                           full_res_thumb_ht, full_res_focus, frows, fcols, 1.0, 0, 0);
+    cairo_destroy(cri);
+  }
+  dt_free_align(full_res_thumb);
+}
+
 static gboolean _get_image_buffer(GtkWidget *widget, cairo_t *cr, gpointer user_data)
 {
   dt_thumbnail_t *thumb = (dt_thumbnail_t *)user_data;
@@ -343,6 +371,7 @@ static gboolean _get_image_buffer(GtkWidget *widget, cairo_t *cr, gpointer user_
     thumb->img_width = cairo_image_surface_get_width(thumb->img_surf);
     thumb->img_height = cairo_image_surface_get_height(thumb->img_surf);
     thumb->busy = FALSE;
+    thumb->standin = FALSE;
     thumb->image_inited = TRUE;
   }
   else
@@ -358,31 +387,7 @@ static gboolean _get_image_buffer(GtkWidget *widget, cairo_t *cr, gpointer user_
     return FALSE;
   }
 
-  // if needed we compute and draw here the big rectangle to show focused areas
-  if(thumb->display_focus)
-  {
-    uint8_t *full_res_thumb = NULL;
-    int32_t full_res_thumb_wd, full_res_thumb_ht;
-    dt_colorspaces_color_profile_type_t color_space;
-    char path[PATH_MAX] = { 0 };
-    gboolean from_cache = TRUE;
-    dt_image_full_path(thumb->imgid,  path,  sizeof(path),  &from_cache, __FUNCTION__);
-    if(!dt_imageio_large_thumbnail(path, &full_res_thumb, &full_res_thumb_wd, &full_res_thumb_ht, &color_space))
-    {
-      // we look for focus areas
-      dt_focus_cluster_t full_res_focus[49];
-      const int frows = 5, fcols = 5;
-      dt_focus_create_clusters(full_res_focus, frows, fcols, full_res_thumb, full_res_thumb_wd,
-                                full_res_thumb_ht);
-      // and we draw them on the image
-      cairo_t *cri = cairo_create(thumb->img_surf);
-      dt_focus_draw_clusters(cri, cairo_image_surface_get_width(thumb->img_surf),
-                              cairo_image_surface_get_height(thumb->img_surf), thumb->imgid, full_res_thumb_wd,
-                              full_res_thumb_ht, full_res_focus, frows, fcols, 1.0, 0, 0);
-      cairo_destroy(cri);
-    }
-    dt_free_align(full_res_thumb);
-  }
+  _draw_focus(thumb);
 
   return TRUE;
 }
@@ -1140,6 +1145,7 @@ void dt_thumbnail_resize(dt_thumbnail_t *thumb, int width, int height, gboolean
 
   // Flush the image surface
   thumb->image_inited = FALSE;
+  thumb->standin = FALSE;
 
   // widget resizing
   thumb->width = width;
@@ -1233,9 +1239,45 @@ void dt_thumbnail_image_refresh(dt_thumbnail_t *thumb)
   thumb->is_altered = dt_image_altered(thumb->imgid);
   _thumb_update_icons(thumb);
   thumb->busy = FALSE;
+  if(thumb->standin)
+  {
+    // the mip at the right size is probably there now
+    thumb->image_inited = FALSE;
+    thumb->standin = FALSE;
+  }
   gtk_widget_queue_draw(thumb->w_image);
 }
 
+gboolean dt_thumbnail_set_mipmap(dt_thumbnail_t *thumb, const dt_mipmap_buffer_t *buf, const dt_mipmap_size_t mip)
+{
+  thumb_return_if_fails(thumb, FALSE);
+
+  if(thumb->img_surf && cairo_surface_get_reference_count(thumb->img_surf) > 0)
+    cairo_surface_destroy(thumb->img_surf);
+  thumb->img_surf = NULL;
+
+  int image_w = 0;
+  int image_h = 0;
+  gtk_widget_get_size_request(thumb->w_image, &image_w, &image_h);
+
+  const dt_view_surface_value_t res
+      = dt_view_image_surface_from_buffer(buf, mip, image_w, image_h, &thumb->img_surf);
+  if(!thumb->img_surf || res == DT_VIEW_SURFACE_KO)
+  {
+    thumb->image_inited = FALSE;
+    return FALSE;
+  }
+
+  thumb->img_width = cairo_image_surface_get_width(thumb->img_surf);
+  thumb->img_height = cairo_image_surface_get_height(thumb->img_surf);
+  thumb->busy = FALSE;
+  thumb->standin = (res == DT_VIEW_SURFACE_SMALLER);
+  thumb->image_inited = TRUE;
+  if(!thumb->standin) _draw_focus(thumb);
+  gtk_widget_queue_draw(thumb->w_image);
+  return TRUE;
+}
+
 
 // force the image to be redraw at the right position
 void dt_thumbnail_image_refresh_position(dt_thumbnail_t *thumb)
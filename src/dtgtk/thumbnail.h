@@ -20,6 +20,7 @@
 #ifndef THUMBNAIL_H
 #define THUMBNAIL_H
 
+#include "common/mipmap_cache.h"
 #include <glib.h>
 #include <gtk/gtk.h>
 
@@ -118,6 +119,8 @@ typedef struct
 
   // Set FALSE when the thumbnail size changed, set TRUE when we have a Cairo image surface for that size
   gboolean image_inited;
+  // the surface comes from a smaller mip, replaced on DT_SIGNAL_DEVELOP_MIPMAP_UPDATED
+  gboolean standin;
 
   gboolean alternative_mode;
   float iso;
@@ -164,6 +167,10 @@ void dt_thumbnail_update_selection(dt_thumbnail_t *thumb, gboolean selected);
 // force image recomputing
 void dt_thumbnail_image_refresh(dt_thumbnail_t *thumb);
 
+// set the image from a buffer fetched by the table for a mip of that size, a smaller one is a stand-in
+// until the image is refreshed. Returns FALSE if there is nothing to show.
+gboolean dt_thumbnail_set_mipmap(dt_thumbnail_t *thumb, const dt_mipmap_buffer_t *buf, const dt_mipmap_size_t mip);
+
 // force reloading image infos
 void dt_thumbnail_reload_infos(dt_thumbnail_t *thumb);
 
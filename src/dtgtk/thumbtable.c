@@ -24,6 +24,7 @@
 #include "common/debug.h"
 #include "common/history.h"
 #include "common/image_cache.h"
+#include "common/mipmap_cache.h"
 #include "common/ratings.h"
 #include "common/selection.h"
 #include "common/undo.h"
@@ -74,6 +75,10 @@
  * The dimensions of the full collection grid are only ever virtual, but we need to make them real for the scrollbars to behave properly
  * through dynamic loading and unloading of thumbnails.
  * So we set the grid area to what it would be if we loaded all thumbnails.
+ *
+ * With many thumbnails per row, creating and laying out the widgets dominates scrolling, and the overlays
+ * are too small to be used anyway. Then the table goes "dense": table->list stays empty, the grid draw callback
+ * paints the cached surfaces of the visible images, and the grid itself maps clicks and hovering to images.
  **/
 
 
@@ -145,6 +150,12 @@ void _mouse_over_image_callback(gpointer instance, gpointer user_data)
   if(!user_data) return;
   dt_thumbtable_t *table = (dt_thumbtable_t *)user_data;
 
+  if(table->dense)
+  {
+    gtk_widget_queue_draw(table->grid);
+    return;
+  }
+
   dt_pthread_mutex_lock(&table->lock);
   for(GList *l = table->list; l; l = g_list_next(l))
   {
@@ -302,6 +313,7 @@ void _update_row_ids(dt_thumbtable_t *table)
   _get_row_ids(table, &rowid_min, &rowid_max);
   if(rowid_min != table->min_row_id || rowid_max != table->max_row_id)
   {
+    if(rowid_min != table->min_row_id) table->scroll_direction = (rowid_min > table->min_row_id) ? 1 : -1;
     table->min_row_id = rowid_min;
     table->max_row_id = rowid_max;
     table->thumbs_inited = FALSE;
@@ -352,6 +364,15 @@ void _grid_configure(dt_thumbtable_t *table, int width, int height, int cols)
     table->thumb_width = height;
   }
 
+  const int dense_columns = dt_conf_get_int("plugins/lighttable/dense_columns");
+  const gboolean dense = table->mode == DT_THUMBTABLE_MODE_FILEMANAGER && dense_columns > 0
+                         && table->thumbs_per_row >= dense_columns;
+  // switching mode swaps widgets for painting, or the other way
+  if(dense != table->dense) table->reset_collection = TRUE;
+  table->dense = dense;
+  // the cached surfaces are at the previous size
+  _dense_flush(table, -1);
+
   table->configured = TRUE;
 
   dt_print(DT_DEBUG_LIGHTTABLE, "Configuring thumbtable w=%i h=%i thumbs/row=%i thumb_width=%i\n",
@@ -439,6 +460,55 @@ void _garbage_collection(dt_thumbtable_t *table, int *num_thumb)
   dt_pthread_mutex_unlock(&table->lock);
 }
 
+// Fetch the images of the visible thumbnails at once, with the table locked: those in the mipmap cache,
+// or a smaller stand-in, are set right away. The others are generated by a single batch, in the order of
+// the table, which supersedes the one of the previous call. Stand-ins are requested again for that reason.
+static void _fetch_thumbnails(dt_thumbtable_t *table)
+{
+  const size_t start = MAX(table->min_row_id, 0);
+  const size_t end = MIN(table->max_row_id, table->collection_count);
+  if(end <= start) return;
+
+  dt_thumbnail_t **thumbs = g_malloc_n(end - start, sizeof(dt_thumbnail_t *));
+  int32_t *imgids = g_malloc_n(end - start, sizeof(int32_t));
+  int count = 0;
+  for(size_t i = start; i < end; i++)
+  {
+    dt_thumbnail_t *thumb = table->lut[i].thumb;
+    if(!thumb || (thumb->image_inited && !thumb->standin)) continue;
+    thumbs[count] = thumb;
+    imgids[count] = thumb->imgid;
+    count++;
+  }
+
+  if(count > 0)
+  {
+    // all the thumbnails have the same size
+    int image_w = 0;
+    int image_h = 0;
+    gtk_widget_get_size_request(thumbs[0]->w_image, &image_w, &image_h);
+    const dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(
+        darktable.mipmap_cache, ceilf(image_w * darktable.gui->ppd), ceilf(image_h * darktable.gui->ppd));
+
+    dt_mipmap_buffer_t *bufs = g_malloc_n(count, sizeof(dt_mipmap_buffer_t));
+    dt_mipmap_cache_get_batch(darktable.mipmap_cache, bufs, imgids, count, mip);
+    for(int k = 0; k < count; k++)
+    {
+      dt_thumbnail_t *thumb = thumbs[k];
+      // a stand-in is only replaced by the right size
+      const gboolean useful = bufs[k].buf && (!thumb->standin || bufs[k].size == mip);
+      if(useful && !dt_thumbnail_set_mipmap(thumb, &bufs[k], mip)) thumb->busy = TRUE;
+      // requested: the drawing waits for DT_SIGNAL_DEVELOP_MIPMAP_UPDATED instead of asking again
+      else if(!useful && !thumb->image_inited) thumb->busy = TRUE;
+      dt_mipmap_cache_release(darktable.mipmap_cache, &bufs[k]);
+    }
+    g_free(bufs);
+  }
+
+  g_free(thumbs);
+  g_free(imgids);
+}
+
 // Add and/or resize thumbnails within visible viewort at current scroll level
 void _populate_thumbnails(dt_thumbtable_t *table, int *num_thumb)
 {
@@ -487,6 +557,116 @@ void _populate_thumbnails(dt_thumbtable_t *table, int *num_thumb)
 
     gtk_widget_queue_draw(thumb->widget);
   }
+  _fetch_thumbnails(table);
+  dt_pthread_mutex_unlock(&table->lock);
+}
+
+// the image within its cell in dense mode, leaving a gap between images
+static int _dense_margin()
+{
+  return DT_PIXEL_APPLY_DPI(2);
+}
+
+static void _dense_image_size(const dt_thumbtable_t *table, int *width, int *height)
+{
+  *width = MAX(table->thumb_width - 2 * _dense_margin(), 1);
+  *height = MAX(table->thumb_height - 2 * _dense_margin(), 1);
+}
+
+static void _dense_surface_destroy(gpointer data)
+{
+  if(data) cairo_surface_destroy((cairo_surface_t *)data);
+}
+
+// Drop the cached surface of one image, or all of them on imgid -1
+static void _dense_flush(dt_thumbtable_t *table, const int32_t imgid)
+{
+  dt_pthread_mutex_lock(&table->lock);
+  if(imgid < 0)
+    g_hash_table_remove_all(table->surfaces);
+  else
+    g_hash_table_remove(table->surfaces, GINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&table->lock);
+}
+
+// rows of thumbnails prepared ahead of the viewport, in the scrolling direction
+#define PREFETCH_ROWS 4
+
+typedef struct _thumbtable_prefetch_t
+{
+  int32_t imgid;
+  dt_mipmap_size_t mip;
+  int generation;
+} _thumbtable_prefetch_t;
+
+// bumped on each prefetch, the jobs of the ones before are obsolete
+static dt_atomic_int _prefetch_generation;
+
+static int32_t _prefetch_job_run(dt_job_t *job)
+{
+  const _thumbtable_prefetch_t *params = dt_control_job_get_params(job);
+
+  // the user scrolled away in the meantime
+  if(params->generation != dt_atomic_get_int(&_prefetch_generation)) return 0;
+
+  // same path as the visible thumbnails: disk cache, embedded JPEG or full processing, as configured.
+  // Nothing to redraw, the thumbnail will find it in cache once visible.
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, params->imgid, params->mip, DT_MIPMAP_BLOCKING, 'r');
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  return 0;
+}
+
+// Queue the thumbnails of the next rows out of the viewport, in the direction the user scrolls to
+void _prefetch_thumbnails(dt_thumbtable_t *table)
+{
+  if(table->scroll_direction == 0 || (!table->list && !table->dense)) return;
+
+  // the size of the thumbnails already drawn, so the mipmap matches theirs
+  int image_w = 0;
+  int image_h = 0;
+  dt_pthread_mutex_lock(&table->lock);
+  if(table->dense)
+    _dense_image_size(table, &image_w, &image_h);
+  else
+  {
+    const dt_thumbnail_t *first = (const dt_thumbnail_t *)table->list->data;
+    gtk_widget_get_size_request(first->w_image, &image_w, &image_h);
+  }
+  if(image_w <= 0 || image_h <= 0)
+  {
+    dt_pthread_mutex_unlock(&table->lock);
+    return;
+  }
+
+  const dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(
+      darktable.mipmap_cache, ceilf(image_w * darktable.gui->ppd), ceilf(image_h * darktable.gui->ppd));
+  const int generation = dt_atomic_add_int(&_prefetch_generation, 1) + 1;
+
+  const int count = PREFETCH_ROWS * table->thumbs_per_row;
+  const int start = (table->scroll_direction > 0) ? table->max_row_id : table->min_row_id - count;
+  const int first_row = MAX(start, 0);
+  const int last_row = MIN(start + count, table->collection_count);
+
+  // the system queue is a stack: push the farthest first, so the nearest come first
+  // and the visible ones, pushed while drawing, before them
+  for(int k = 0; k < last_row - first_row; k++)
+  {
+    const int i = (table->scroll_direction > 0) ? last_row - 1 - k : first_row + k;
+    dt_job_t *job = dt_control_job_create(&_prefetch_job_run, "prefetch thumbnail %d", table->lut[i].imgid);
+    if(!job) continue;
+    _thumbtable_prefetch_t *params = (_thumbtable_prefetch_t *)calloc(1, sizeof(_thumbtable_prefetch_t));
+    if(!params)
+    {
+      dt_control_job_dispose(job);
+      continue;
+    }
+    params->imgid = table->lut[i].imgid;
+    params->mip = mip;
+    params->generation = generation;
+    dt_control_job_set_params_with_size(job, params, sizeof(_thumbtable_prefetch_t), free);
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+  }
   dt_pthread_mutex_unlock(&table->lock);
 }
 
@@ -528,10 +708,11 @@ void dt_thumbtable_update(dt_thumbtable_t *table)
   const double start = dt_get_wtime();
   gboolean empty_list = (table->list == NULL);
 
-  _populate_thumbnails(table, &num_thumb);
+  // Dense mode has no widget to populate, the grid draw callback paints the visible range
+  if(!table->dense) _populate_thumbnails(table, &num_thumb);
 
   // Remove unneeded thumbnails: out of viewport or out of current collection
-  if(!empty_list && table->list)
+  if(!table->dense && !empty_list && table->list)
   {
     _garbage_collection(table, &num_thumb);
     _resize_thumbnails(table);
@@ -539,6 +720,8 @@ void dt_thumbtable_update(dt_thumbtable_t *table)
 
   gtk_widget_queue_draw(table->grid);
 
+  _prefetch_thumbnails(table);
+
   table->thumb_nb += num_thumb;
   table->thumbs_inited = TRUE;
 
@@ -551,6 +734,13 @@ static void _dt_profile_change_callback(gpointer instance, int type, gpointer us
   if(!user_data) return;
   dt_thumbtable_t *table = (dt_thumbtable_t *)user_data;
 
+  if(table->dense)
+  {
+    _dense_flush(table, -1);
+    gtk_widget_queue_draw(table->grid);
+    return;
+  }
+
   dt_pthread_mutex_lock(&table->lock);
   for(const GList *l = table->list; l; l = g_list_next(l))
   {
@@ -565,6 +755,12 @@ static void _dt_selection_changed_callback(gpointer instance, gpointer user_data
   if(!user_data) return;
   dt_thumbtable_t *table = (dt_thumbtable_t *)user_data;
 
+  if(table->dense)
+  {
+    gtk_widget_queue_draw(table->grid);
+    return;
+  }
+
   dt_pthread_mutex_lock(&table->lock);
   for(const GList *l = table->list; l; l = g_list_next(l))
   {
@@ -580,6 +776,13 @@ static void _dt_mipmaps_updated_callback(gpointer instance, int32_t imgid, gpoin
   if(!user_data) return;
   dt_thumbtable_t *table = (dt_thumbtable_t *)user_data;
 
+  if(table->dense)
+  {
+    _dense_flush(table, imgid);
+    gtk_widget_queue_draw(table->grid);
+    return;
+  }
+
   dt_pthread_mutex_lock(&table->lock);
   for(GList *l = table->list; l; l = g_list_next(l))
   {
@@ -1140,6 +1343,145 @@ gboolean dt_thumbtable_key_released_grid(GtkWidget *self, GdkEventKey *event, gp
 }
 
 
+static gboolean _dense_is_outside(gpointer key, gpointer value, gpointer user_data)
+{
+  return !g_hash_table_contains((GHashTable *)user_data, key);
+}
+
+// keep the surfaces of about 3 screens, the ones of the current one in priority
+static void _dense_evict(dt_thumbtable_t *table, const int first, const int last)
+{
+  const guint capacity = MAX(3 * (last - first), 256);
+  if(g_hash_table_size(table->surfaces) <= capacity) return;
+
+  GHashTable *visible = g_hash_table_new(g_direct_hash, g_direct_equal);
+  for(int i = first; i < last; i++) g_hash_table_add(visible, GINT_TO_POINTER(table->lut[i].imgid));
+  g_hash_table_foreach_remove(table->surfaces, _dense_is_outside, visible);
+  g_hash_table_destroy(visible);
+}
+
+static void _dense_draw(dt_thumbtable_t *table, GtkWidget *widget, cairo_t *cr)
+{
+  if(table->thumbs_per_row < 1 || table->thumb_height < 1) return;
+
+  double x1, y1, x2, y2;
+  cairo_clip_extents(cr, &x1, &y1, &x2, &y2);
+  const int first = MAX((int)(y1 / table->thumb_height) * table->thumbs_per_row, 0);
+  const int last = MIN(((int)(y2 / table->thumb_height) + 1) * table->thumbs_per_row, table->collection_count);
+
+  int image_w, image_h;
+  _dense_image_size(table, &image_w, &image_h);
+  const int margin = _dense_margin();
+  const double ppd = darktable.gui->ppd;
+
+  GtkStyleContext *context = gtk_widget_get_style_context(widget);
+  GdkRGBA bg = { 0.5, 0.5, 0.5, 1.0 }, selected = { 0.8, 0.8, 0.8, 1.0 }, hover = { 0.65, 0.65, 0.65, 1.0 };
+  gtk_style_context_lookup_color(context, "thumbnail_bg_color", &bg);
+  gtk_style_context_lookup_color(context, "thumbnail_selected_bg_color", &selected);
+  gtk_style_context_lookup_color(context, "thumbnail_hover_bg_color", &hover);
+  const int32_t mouse_over_id = dt_control_get_mouse_over_id();
+
+  dt_pthread_mutex_lock(&table->lock);
+  for(int i = first; i < last; i++)
+  {
+    const int32_t imgid = table->lut[i].imgid;
+    int x = 0, y = 0;
+    _rowid_to_position(table, i, &x, &y);
+
+    const GdkRGBA *cell = dt_selection_is_id_selected(darktable.selection, imgid) ? &selected
+                          : (imgid == mouse_over_id)                              ? &hover
+                                                                                  : &bg;
+    gdk_cairo_set_source_rgba(cr, cell);
+    cairo_rectangle(cr, x + margin / 2, y + margin / 2, table->thumb_width - margin, table->thumb_height - margin);
+    cairo_fill(cr);
+
+    gpointer cached = NULL;
+    if(!g_hash_table_lookup_extended(table->surfaces, GINT_TO_POINTER(imgid), NULL, &cached))
+    {
+      cairo_surface_t *surface = NULL;
+      if(dt_view_image_get_surface(imgid, image_w, image_h, &surface, FALSE) != DT_VIEW_SURFACE_OK && surface)
+      {
+        cairo_surface_destroy(surface);
+        surface = NULL;
+      }
+      // NULL until the mipmap updated signal tells us it's ready, don't ask again meanwhile
+      g_hash_table_insert(table->surfaces, GINT_TO_POINTER(imgid), surface);
+      cached = surface;
+    }
+
+    cairo_save(cr);
+    cairo_translate(cr, x + margin, y + margin);
+    if(cached)
+    {
+      cairo_surface_t *surface = (cairo_surface_t *)cached;
+      const double surface_w = cairo_image_surface_get_width(surface);
+      const double surface_h = cairo_image_surface_get_height(surface);
+      cairo_translate(cr, (image_w - surface_w / ppd) / 2., (image_h - surface_h / ppd) / 2.);
+      cairo_scale(cr, 1. / ppd, 1. / ppd);
+      cairo_set_source_surface(cr, surface, 0, 0);
+      cairo_paint(cr);
+    }
+    else
+      dt_control_draw_busy_msg(cr, image_w, image_h);
+    cairo_restore(cr);
+  }
+
+  _dense_evict(table, first, last);
+  dt_pthread_mutex_unlock(&table->lock);
+}
+
+static int32_t _dense_imgid_at(dt_thumbtable_t *table, const double x, const double y)
+{
+  if(!table->lut || table->thumb_width < 1 || table->thumb_height < 1 || x < 0 || y < 0) return -1;
+  const int col = x / table->thumb_width;
+  if(col >= table->thumbs_per_row) return -1;
+  const int rowid = (int)(y / table->thumb_height) * table->thumbs_per_row + col;
+  if(rowid >= table->collection_count) return -1;
+
+  dt_pthread_mutex_lock(&table->lock);
+  const int32_t imgid = table->lut[rowid].imgid;
+  dt_pthread_mutex_unlock(&table->lock);
+  return imgid;
+}
+
+// same as the thumbnails do on their main area
+static gboolean _dense_button_press(GtkWidget *widget, GdkEventButton *event, gpointer user_data)
+{
+  dt_thumbtable_t *table = (dt_thumbtable_t *)user_data;
+  if(!table->dense || event->button != 1) return FALSE;
+
+  const int32_t imgid = _dense_imgid_at(table, event->x, event->y);
+  if(imgid < 0) return FALSE;
+  dt_control_set_mouse_over_id(imgid);
+
+  if(event->type == GDK_BUTTON_PRESS)
+  {
+    if(dt_modifier_is(event->state, 0))
+      dt_selection_select_single(darktable.selection, imgid);
+    else if(dt_modifier_is(event->state, GDK_CONTROL_MASK))
+      dt_selection_toggle(darktable.selection, imgid);
+    else if(dt_modifier_is(event->state, GDK_SHIFT_MASK))
+      dt_selection_select_range(darktable.selection, imgid);
+  }
+  else if(event->type == GDK_2BUTTON_PRESS)
+  {
+    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_VIEWMANAGER_THUMBTABLE_ACTIVATE, imgid);
+    return TRUE;
+  }
+  // let the drag and drop start from here
+  return FALSE;
+}
+
+static gboolean _dense_motion_notify(GtkWidget *widget, GdkEventMotion *event, gpointer user_data)
+{
+  dt_thumbtable_t *table = (dt_thumbtable_t *)user_data;
+  if(!table->dense) return FALSE;
+
+  const int32_t imgid = _dense_imgid_at(table, event->x, event->y);
+  if(imgid != dt_control_get_mouse_over_id()) dt_control_set_mouse_over_id(imgid);
+  return FALSE;
+}
+
 static gboolean _draw_callback(GtkWidget *widget, cairo_t *cr, gpointer user_data)
 {
   if(!user_data) return TRUE;
@@ -1154,6 +1496,7 @@ static gboolean _draw_callback(GtkWidget *widget, cairo_t *cr, gpointer user_dat
 
   dt_thumbtable_configure(table);
   dt_thumbtable_update(table);
+  if(table->dense) _dense_draw(table, widget, cr);
   return FALSE;
 }
 
@@ -1192,6 +1535,12 @@ dt_thumbtable_t *dt_thumbtable_new()
   gtk_widget_add_events(table->grid, GDK_LEAVE_NOTIFY_MASK);
   g_signal_connect(G_OBJECT(table->grid), "leave-notify-event", G_CALLBACK(_event_main_leave), table);
 
+  // in dense mode, there is no thumbnail widget to catch the clicks and hovering
+  gtk_widget_set_has_window(table->grid, TRUE);
+  gtk_widget_add_events(table->grid, GDK_BUTTON_PRESS_MASK | GDK_POINTER_MOTION_MASK);
+  g_signal_connect(G_OBJECT(table->grid), "button-press-event", G_CALLBACK(_dense_button_press), table);
+  g_signal_connect(G_OBJECT(table->grid), "motion-notify-event", G_CALLBACK(_dense_motion_notify), table);
+
   // drag and drop : used for reordering, interactions with maps, exporting uri to external apps, importing images
   // in filmroll...
   gtk_drag_source_set(table->grid, GDK_BUTTON1_MASK, target_list_all, n_targets_all, GDK_ACTION_MOVE);
@@ -1222,6 +1571,8 @@ dt_thumbtable_t *dt_thumbtable_new()
   table->x_position = 0.;
   table->y_position = 0.;
   table->alternate_mode = FALSE;
+  table->dense = FALSE;
+  table->surfaces = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, _dense_surface_destroy);
 
   dt_pthread_mutex_init(&table->lock, NULL);
 
@@ -1296,6 +1647,7 @@ void dt_thumbtable_cleanup(dt_thumbtable_t *table)
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_dt_image_info_changed_callback), table);
 
   _dt_thumbtable_empty_list(table);
+  g_hash_table_destroy(table->surfaces);
 
   dt_pthread_mutex_destroy(&table->lock);
 
@@ -82,6 +82,16 @@ typedef struct dt_thumbtable_t
   int min_row_id;
   int max_row_id;
 
+  // 1 when the last scroll went toward the end of the collection, -1 toward its start, 0 if not scrolled yet.
+  // Thumbnails are prefetched in that direction.
+  int scroll_direction;
+
+  // Dense mode: from plugins/lighttable/dense_columns thumbnails per row, the file manager paints
+  // the images in the grid itself, without a dt_thumbnail_t widget per image and without overlays.
+  // Their cairo surfaces are kept by imgid, across scroll positions, NULL while the mipmap is generated.
+  gboolean dense;
+  GHashTable *surfaces;
+
   // Our LUT of collection, mapping rowid (index) to imgid (content)
   dt_thumbtable_cache_t *lut;
 
@@ -28,6 +28,9 @@
 #include <string.h>  // for strcmp
 #include <unistd.h>  // for access, R_OK
 
+#include <glib/gstdio.h> // for g_stat, g_unlink
+
+#include "common/atomic.h"       // for dt_atomic_int
 #include "common/darktable.h"    // for darktable, darktable_t, dt_cleanup, etc
 #include "common/database.h"     // for dt_database_get
 #include "common/debug.h"        // for DT_DEBUG_SQLITE3_PREPARE_V2
@@ -45,7 +48,91 @@
 #include "win/main_wrapper.h"
 #endif
 
-static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, const int32_t min_imgid, const int32_t max_imgid)
+// shared between the workers
+typedef struct _generate_t
+{
+  dt_mipmap_size_t min_mip, max_mip;
+  size_t count;
+  int32_t *imgids;
+  gchar **filenames;
+  dt_atomic_int next;      // index of the next image to pick
+  dt_atomic_int processed; // images done
+  dt_atomic_int running;   // workers not finished yet
+  gint *done;              // per image, set once its thumbnails are on disc
+  guint64 bytes;           // size of the thumbnails written, atomic
+} _generate_t;
+
+static void _generate_image(_generate_t *g, const size_t index)
+{
+  const int32_t imgid = g->imgids[index];
+  const int counter = dt_atomic_add_int(&g->processed, 1) + 1;
+  fprintf(stderr, "image %d/%zu (%.02f%%) (id:%d, file=%s)\n", counter, g->count,
+          100.0 * counter / (float)g->count, imgid, g->filenames[index]);
+
+  gboolean generated[DT_MIPMAP_F] = { FALSE };
+  for(int k = g->max_mip; k >= g->min_mip && k >= 0; k--)
+  {
+    char filename[PATH_MAX] = { 0 };
+    snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
+
+    // if a valid thumbnail file is already on disc - do nothing
+    if(dt_util_test_image_file(filename)) continue;
+
+    // else, generate thumbnail and store in mipmap cache.
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    generated[k] = TRUE;
+  }
+
+  // and immediately write thumbs to disc and remove from mipmap cache.
+  dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
+  // thumbnail in sync with image
+  dt_history_hash_set_mipmap(imgid);
+
+  for(int k = g->min_mip; k <= g->max_mip; k++)
+  {
+    if(!generated[k]) continue;
+    char filename[PATH_MAX] = { 0 };
+    snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
+    GStatBuf st;
+    // the packed backend has no file per thumbnail, it isn't counted
+    if(!g_stat(filename, &st)) __sync_fetch_and_add(&g->bytes, (guint64)st.st_size);
+  }
+}
+
+static gpointer _generate_worker(gpointer data)
+{
+  _generate_t *g = (_generate_t *)data;
+  // images are picked in order, so the ones before the first not done are all done
+  for(size_t i = dt_atomic_add_int(&g->next, 1); i < g->count; i = dt_atomic_add_int(&g->next, 1))
+  {
+    _generate_image(g, i);
+    g_atomic_int_set(&g->done[i], 1);
+  }
+  dt_atomic_sub_int(&g->running, 1);
+  return NULL;
+}
+
+static void _report(_generate_t *g, const double start)
+{
+  const double elapsed = MAX(dt_get_wtime() - start, 1e-3);
+  const int processed = dt_atomic_get_int(&g->processed);
+  const double mb = __sync_fetch_and_add(&g->bytes, 0) / (1024.0 * 1024.0);
+  fprintf(stderr, _("%d/%zu images in %.0f s: %.2f images/s, %.1f MB written (%.2f MB/s)\n"), processed, g->count,
+          elapsed, processed / elapsed, mb, mb / elapsed);
+}
+
+// the last imgid of the range up to which all thumbnails are written, for --resume
+static void _write_resume(const char *resume_file, const int32_t imgid)
+{
+  gchar *content = g_strdup_printf("%d\n", imgid);
+  g_file_set_contents(resume_file, content, -1, NULL);
+  g_free(content);
+}
+
+static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, int32_t min_imgid,
+                                    const int32_t max_imgid, const int jobs, const gboolean resume)
 {
   fprintf(stderr, _("creating cache directories\n"));
   for(dt_mipmap_size_t k = min_mip; k <= max_mip; k++)
@@ -61,9 +148,25 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
+  gchar *resume_file = g_strdup_printf("%s.d/generate-cache.resume", darktable.mipmap_cache->cachedir);
+  if(resume)
+  {
+    gchar *content = NULL;
+    if(g_file_get_contents(resume_file, &content, NULL, NULL))
+    {
+      const int32_t last = atoi(content);
+      if(last >= min_imgid)
+      {
+        fprintf(stderr, _("resuming after image id %d\n"), last);
+        min_imgid = last + 1;
+      }
+      g_free(content);
+    }
+  }
+
   // some progress counter
   sqlite3_stmt *stmt;
-  size_t image_count = 0, counter = 0;
+  size_t image_count = 0;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "SELECT COUNT(*) FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
@@ -75,6 +178,7 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
   }
   else
   {
+    g_free(resume_file);
     return 1;
   }
 
@@ -87,40 +191,66 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // go through all images:
+  _generate_t g = { 0 };
+  g.min_mip = min_mip;
+  g.max_mip = max_mip;
+  g.imgids = (int32_t *)calloc(image_count + 1, sizeof(int32_t));
+  g.filenames = (gchar **)calloc(image_count + 1, sizeof(gchar *));
+  g.done = (gint *)calloc(image_count + 1, sizeof(gint));
+
+  // list all images first, the workers share the database
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id, filename FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
+                              "SELECT id, filename FROM main.images WHERE id >= ?1 AND id <= ?2 ORDER BY id",
+                              -1, &stmt, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  while(sqlite3_step(stmt) == SQLITE_ROW && g.count < image_count)
   {
-    const int32_t imgid = sqlite3_column_int(stmt, 0);
-    const char *imgfilename = (const char*)sqlite3_column_text(stmt, 1);
-
-    counter++;
-    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d, file=%s)\n", counter, image_count, 100.0 * counter / (float)image_count, imgid, imgfilename);
+    g.imgids[g.count] = sqlite3_column_int(stmt, 0);
+    g.filenames[g.count] = g_strdup((const char *)sqlite3_column_text(stmt, 1));
+    g.count++;
+  }
+  sqlite3_finalize(stmt);
 
-    for(int k = max_mip; k >= min_mip && k >= 0; k--)
-    {
-      char filename[PATH_MAX] = { 0 };
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
+  // each worker runs its own thumbnail pipe through the mipmap cache
+  const int workers = CLAMP(jobs, 1, MAX((int)g.count, 1));
+  fprintf(stderr, _("generating thumbnails with %d jobs\n"), workers);
+  const double start = dt_get_wtime();
+  dt_atomic_set_int(&g.next, 0);
+  dt_atomic_set_int(&g.running, workers);
+  GThread **threads = (GThread **)calloc(workers, sizeof(GThread *));
+  for(int k = 0; k < workers; k++) threads[k] = g_thread_new("generate-cache", _generate_worker, &g);
+
+  size_t mark = 0;
+  double last_report = start;
+  while(dt_atomic_get_int(&g.running) > 0)
+  {
+    g_usleep(G_USEC_PER_SEC / 2);
 
-      // if a valid thumbnail file is already on disc - do nothing
-      if(dt_util_test_image_file(filename)) continue;
+    // always kept, so an interrupted run can be resumed even if it wasn't started with --resume
+    const size_t old_mark = mark;
+    while(mark < g.count && g_atomic_int_get(&g.done[mark])) mark++;
+    if(mark > old_mark) _write_resume(resume_file, g.imgids[mark - 1]);
 
-      // else, generate thumbnail and store in mipmap cache.
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
-      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    if(dt_get_wtime() - last_report >= 10.0)
+    {
+      _report(&g, start);
+      last_report = dt_get_wtime();
     }
-
-    // and immediately write thumbs to disc and remove from mipmap cache.
-    dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
-    // thumbnail in sync with image
-    dt_history_hash_set_mipmap(imgid);
   }
+  for(int k = 0; k < workers; k++) g_thread_join(threads[k]);
+  free(threads);
 
-  sqlite3_finalize(stmt);
+  _report(&g, start);
+
+  // the whole range is done, the next run starts over
+  g_unlink(resume_file);
+
+  for(size_t i = 0; i < g.count; i++) g_free(g.filenames[i]);
+  free(g.filenames);
+  free(g.imgids);
+  free(g.done);
+  g_free(resume_file);
   fprintf(stderr, "done\n");
 
   return 0;
@@ -132,13 +262,17 @@ static void usage(const char *progname)
           "usage: %s [-h, --help; --version]\n"
           "  [--min-mip <0-8> (default = 0)] [-m, --max-mip <0-8> (default = 2)]\n"
           "  [--min-imgid <N>] [--max-imgid <N>]\n"
+          "  [-j, --jobs <N> (default = 1)] [--resume]\n"
           "  [--core <darktable options>]\n"
           "\n"
           "When multiple mipmap sizes are requested, the biggest one is computed\n"
           "while the rest are quickly downsampled.\n"
           "\n"
           "The --min-imgid and --max-imgid specify the range of internal image ID\n"
-          "numbers to work on.\n",
+          "numbers to work on.\n"
+          "\n"
+          "--jobs generates the thumbnails of N images at a time, each with its own pipe.\n"
+          "--resume starts after the last image of a previous run that got interrupted.\n",
           progname);
 }
 
@@ -164,6 +298,8 @@ int main(int argc, char *arg[])
   dt_mipmap_size_t max_mip = DT_MIPMAP_2;
   int32_t min_imgid = UNKNOWN_IMAGE;
   int32_t max_imgid = INT32_MAX;
+  int jobs = 1;
+  gboolean resume = FALSE;
 
   int k;
   for(k = 1; k < argc; k++)
@@ -199,6 +335,15 @@ int main(int argc, char *arg[])
       k++;
       max_imgid = (int32_t)MIN(MAX(atoi(arg[k]), 0), INT32_MAX);
     }
+    else if((!strcmp(arg[k], "-j") || !strcmp(arg[k], "--jobs")) && argc > k + 1)
+    {
+      k++;
+      jobs = MAX(atoi(arg[k]), 1);
+    }
+    else if(!strcmp(arg[k], "--resume"))
+    {
+      resume = TRUE;
+    }
     else if(!strcmp(arg[k], "--core"))
     {
       // everything from here on should be passed to the core
@@ -241,7 +386,7 @@ int main(int argc, char *arg[])
 
   fprintf(stderr, _("creating complete lighttable thumbnail cache\n"));
 
-  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid))
+  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid, jobs, resume))
   {
     free(m_arg);
     exit(EXIT_FAILURE);
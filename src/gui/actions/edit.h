@@ -96,20 +96,22 @@ static void compress_history_callback()
 
   gboolean is_darkroom_image_in_list = is_image_in_dev(imgs);
 
-  if(is_darkroom_image_in_list)
+  if(!is_darkroom_image_in_list)
   {
-    dt_dev_undo_start_record(darktable.develop);
-    dt_dev_write_history(darktable.develop);
+    // nothing to reload once done: let it run in the background
+    g_list_free(imgs);
+    dt_control_compress_history_images();
+    return;
   }
 
+  dt_dev_undo_start_record(darktable.develop);
+  dt_dev_write_history(darktable.develop);
+
   dt_history_compress_on_list(imgs);
 
-  if(is_darkroom_image_in_list)
-  {
-    dt_dev_undo_end_record(darktable.develop);
-    dt_dev_reload_history_items(darktable.develop);
-    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_HISTORY_CHANGE);
-  }
+  dt_dev_undo_end_record(darktable.develop);
+  dt_dev_reload_history_items(darktable.develop);
+  DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_HISTORY_CHANGE);
 
   g_list_free(imgs);
   dt_control_queue_redraw_center();
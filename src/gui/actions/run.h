@@ -22,8 +22,7 @@ static void backup_database_callback(GtkWidget *widget)
 
 static void crawl_xmp_changes(GtkWidget *widget)
 {
-  GList *changed_xmp_files = dt_control_crawler_run();
-  dt_control_crawler_show_image_list(changed_xmp_files);
+  dt_control_crawler_run_job();
 }
 
 static int32_t preload_image_cache(dt_job_t *job)
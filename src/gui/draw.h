@@ -311,7 +311,7 @@ static inline void dt_draw_curve_calc_values(dt_draw_curve_t *c, const float min
 {
   c->csample.m_samplingRes = res;
   c->csample.m_outputRes = 0x10000;
-  CurveDataSample(&c->c, &c->csample);
+  CurveDataSampleCached(&c->c, &c->csample, CurveDataSample);
   dt_draw_curve_smaple_values(c, min, max, res, x, y);
 }
 
@@ -320,7 +320,7 @@ static inline void dt_draw_curve_calc_values_V2_nonperiodic(dt_draw_curve_t *c,
 {
   c->csample.m_samplingRes = res;
   c->csample.m_outputRes = 0x10000;
-  CurveDataSampleV2(&c->c, &c->csample);
+  CurveDataSampleCached(&c->c, &c->csample, CurveDataSampleV2);
   dt_draw_curve_smaple_values(c, min, max, res, x, y);
 }
 
@@ -329,7 +329,7 @@ static inline void dt_draw_curve_calc_values_V2_periodic(dt_draw_curve_t *c, con
 {
   c->csample.m_samplingRes = res;
   c->csample.m_outputRes = 0x10000;
-  CurveDataSampleV2Periodic(&c->c, &c->csample);
+  CurveDataSampleCached(&c->c, &c->csample, CurveDataSampleV2Periodic);
   dt_draw_curve_smaple_values(c, min, max, res, x, y);
 }
 
@@ -62,9 +62,9 @@ static const int _gui_presets_format_flag[5] = { FOR_LDR, FOR_RAW, FOR_HDR, FOR_
 // so beware, don't use any darktable.gui stuff here .. (or change this behaviour in darktable.c)
 void dt_gui_presets_init()
 {
-  // remove auto generated presets from plugins, not the user included ones.
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM data.presets WHERE writeprotect = 1", NULL,
-                        NULL, NULL);
+  // auto generated presets from plugins, not the user included ones, are removed by the modules
+  // that create them again, see dt_presets_stamp_changed()
+  dt_presets_stamp_init();
 }
 
 void dt_gui_presets_add_generic(const char *name, dt_dev_operation_t op, const int32_t version,
@@ -140,7 +140,7 @@ static gchar *_get_active_preset_name(dt_iop_module_t *module, int *writeprotect
     const int32_t bl_params_size = sqlite3_column_bytes(stmt, 2);
     const int enabled = sqlite3_column_int(stmt, 3);
 
-    if(!memcmp(module->params, op_params, MIN(op_params_size, module->params_size))
+    if(dt_iop_params_equal(module->so, module->params, op_params, MIN(op_params_size, module->params_size))
        && !memcmp(module->blend_params, blendop_params,
                   MIN(bl_params_size, sizeof(dt_develop_blend_params_t))) && module->enabled == enabled)
     {
@@ -883,7 +883,7 @@ void dt_gui_presets_apply_preset(const gchar* name, dt_iop_module_t *module)
   sqlite3_finalize(stmt);
   dt_iop_gui_update(module);
   dt_dev_add_history_item(darktable.develop, module, FALSE);
-  gtk_widget_queue_draw(module->widget);
+  if(module->widget) gtk_widget_queue_draw(module->widget);
 }
 
 static void _menuitem_pick_preset(GtkMenuItem *menuitem, dt_iop_module_t *module)
@@ -1093,8 +1093,8 @@ static void _gui_presets_popup_menu_show_internal(dt_dev_operation_t op, int32_t
       found = TRUE;
 
     if(module
-       && !memcmp(module->default_params, op_params,
-                  MIN(op_params_size, module->params_size))
+       && dt_iop_params_equal(module->so, module->default_params, op_params,
+                              MIN(op_params_size, module->params_size))
        && !memcmp(module->default_blendop_params, blendop_params,
                   MIN(bl_params_size, sizeof(dt_develop_blend_params_t))))
       isdefault = TRUE;
@@ -1109,7 +1109,7 @@ static void _gui_presets_popup_menu_show_internal(dt_dev_operation_t op, int32_t
     g_free(label);
 
     if(module
-       && !memcmp(params, op_params, MIN(op_params_size, params_size))
+       && dt_iop_params_equal(module->so, params, op_params, MIN(op_params_size, params_size))
        && !memcmp(bl_params, blendop_params, MIN(bl_params_size, sizeof(dt_develop_blend_params_t)))
        && module->enabled == enabled)
     {
@@ -28,6 +28,7 @@
 #include <OpenEXR/ImfStandardAttributes.h>
 #include <OpenEXR/ImfThreading.h>
 #include <OpenEXR/ImfOutputFile.h>
+#include <OpenEXR/ImfTiledOutputFile.h>
 
 extern "C" {
 #include "bauhaus/bauhaus.h"
@@ -87,8 +88,41 @@ typedef struct dt_imageio_exr_gui_t
 {
   GtkWidget *bpp;
   GtkWidget *compression;
+  GtkWidget *dwa_level;
+  GtkWidget *tiled;
 } dt_imageio_exr_gui_t;
 
+// tiles of tiled files, compressed independently by the threads of OpenEXR
+#define DT_EXR_TILE_SIZE 64
+
+// OpenEXR compresses blocks of scan lines or tiles on its global thread pool
+static int _write_exr(const char *filename, Imf::Header &header, const Imf::FrameBuffer &data, const int height,
+                      const gboolean tiled)
+{
+  try
+  {
+    if(tiled)
+    {
+      header.setTileDescription(Imf::TileDescription(DT_EXR_TILE_SIZE, DT_EXR_TILE_SIZE, Imf::ONE_LEVEL));
+      Imf::TiledOutputFile file(filename, header);
+      file.setFrameBuffer(data);
+      file.writeTiles(0, file.numXTiles() - 1, 0, file.numYTiles() - 1);
+    }
+    else
+    {
+      Imf::OutputFile file(filename, header);
+      file.setFrameBuffer(data);
+      file.writePixels(height);
+    }
+  }
+  catch(const std::exception &e)
+  {
+    fprintf(stderr, "[exr export] failed to write %s: %s\n", filename, e.what());
+    return 1;
+  }
+  return 0;
+}
+
 void init(dt_imageio_module_format_t *self)
 {
 #ifdef USE_LUA
@@ -138,6 +172,11 @@ int write_image(dt_imageio_module_data_t *tmp, const char *filename, const void
 
   header.insert("comment", Imf::StringAttribute(comment));
 
+  if(exr->compression == DWAA_COMPRESSION || exr->compression == DWAB_COMPRESSION)
+    Imf::addDwaCompressionLevel(header, dt_conf_get_float("plugins/imageio/format/exr/dwa_level"));
+
+  const gboolean tiled = dt_conf_get_bool("plugins/imageio/format/exr/tiled");
+
   if(exif && exif_len > 0)
   {
     Imf::Blob exif_blob(exif_len, (uint8_t *)exif);
@@ -223,10 +262,9 @@ icc_end:
   header.channels().insert("G", Imf::Channel(pixel_type, 1, 1, true));
   header.channels().insert("B", Imf::Channel(pixel_type, 1, 1, true));
 
-  Imf::OutputFile file(filename, header);
-
   Imf::FrameBuffer data;
   size_t stride;
+  int rc = 0;
 
   if(pixel_type == Imf::PixelType::FLOAT)
   {
@@ -242,8 +280,7 @@ icc_end:
     data.insert("B", Imf::Slice(pixel_type, (char *)(in + 2), stride,
                                 stride * exr->global.width));
 
-    file.setFrameBuffer(data);
-    file.writePixels(exr->global.height);
+    rc = _write_exr(filename, header, data, exr->global.height, tiled);
   }
   else
   {
@@ -282,13 +319,12 @@ icc_end:
     data.insert("B", Imf::Slice(pixel_type, (char *)(out + 2), stride,
                                 stride * exr->global.width));
 
-    file.setFrameBuffer(data);
-    file.writePixels(exr->global.height);
+    rc = _write_exr(filename, header, data, exr->global.height, tiled);
 
     free(out);
   }
 
-  return 0;
+  return rc;
 }
 
 size_t params_size(dt_imageio_module_format_t *self)
@@ -453,6 +489,18 @@ static void compression_combobox_changed(GtkWidget *widget, gpointer user_data)
 {
   const int compression = dt_bauhaus_combobox_get(widget);
   dt_conf_set_int("plugins/imageio/format/exr/compression", compression);
+  gtk_widget_set_sensitive(GTK_WIDGET(user_data),
+                           compression == DWAA_COMPRESSION || compression == DWAB_COMPRESSION);
+}
+
+static void dwa_level_changed(GtkWidget *slider, gpointer user_data)
+{
+  dt_conf_set_float("plugins/imageio/format/exr/dwa_level", dt_bauhaus_slider_get(slider));
+}
+
+static void tiled_combobox_changed(GtkWidget *widget, gpointer user_data)
+{
+  dt_conf_set_bool("plugins/imageio/format/exr/tiled", dt_bauhaus_combobox_get(widget) == 1);
 }
 
 void gui_init(dt_imageio_module_format_t *self)
@@ -492,7 +540,33 @@ void gui_init(dt_imageio_module_format_t *self)
   dt_bauhaus_combobox_add(gui->compression, _("DWAB"));
   dt_bauhaus_combobox_set(gui->compression, compression_last);
   gtk_box_pack_start(GTK_BOX(self->widget), gui->compression, TRUE, TRUE, 0);
-  g_signal_connect(G_OBJECT(gui->compression), "value-changed", G_CALLBACK(compression_combobox_changed), NULL);
+
+  // DWA compression level, lossy codecs only
+  gui->dwa_level = dt_bauhaus_slider_new_with_range(darktable.bauhaus, DT_GUI_MODULE(NULL),
+                                                    dt_confgen_get_float("plugins/imageio/format/exr/dwa_level", DT_MIN),
+                                                    dt_confgen_get_float("plugins/imageio/format/exr/dwa_level", DT_MAX),
+                                                    5,
+                                                    dt_confgen_get_float("plugins/imageio/format/exr/dwa_level", DT_DEFAULT),
+                                                    0);
+  dt_bauhaus_widget_set_label(gui->dwa_level, N_("DWA compression level"));
+  gtk_widget_set_tooltip_text(gui->dwa_level, _("higher values give smaller files and more visible losses"));
+  dt_bauhaus_slider_set(gui->dwa_level, dt_conf_get_float("plugins/imageio/format/exr/dwa_level"));
+  gtk_widget_set_sensitive(gui->dwa_level,
+                           compression_last == DWAA_COMPRESSION || compression_last == DWAB_COMPRESSION);
+  gtk_box_pack_start(GTK_BOX(self->widget), gui->dwa_level, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(gui->dwa_level), "value-changed", G_CALLBACK(dwa_level_changed), NULL);
+  g_signal_connect(G_OBJECT(gui->compression), "value-changed", G_CALLBACK(compression_combobox_changed),
+                   gui->dwa_level);
+
+  // Storage combo box
+  gui->tiled = dt_bauhaus_combobox_new(darktable.bauhaus, DT_GUI_MODULE(NULL));
+  dt_bauhaus_widget_set_label(gui->tiled, N_("storage"));
+  dt_bauhaus_combobox_add(gui->tiled, _("scan lines"));
+  dt_bauhaus_combobox_add(gui->tiled, _("tiles"));
+  gtk_widget_set_tooltip_text(gui->tiled, _("tiled files are faster to read by parts, in compositing software"));
+  dt_bauhaus_combobox_set(gui->tiled, dt_conf_get_bool("plugins/imageio/format/exr/tiled"));
+  gtk_box_pack_start(GTK_BOX(self->widget), gui->tiled, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(gui->tiled), "value-changed", G_CALLBACK(tiled_combobox_changed), NULL);
 }
 
 void gui_cleanup(dt_imageio_module_format_t *self)
@@ -506,6 +580,8 @@ void gui_reset(dt_imageio_module_format_t *self)
   const int bpp = dt_confgen_get_int("plugins/imageio/format/exr/bpp", DT_DEFAULT);
   dt_bauhaus_combobox_set(gui->bpp, (bpp >> 4) - EXR_PT_HALF);
   dt_bauhaus_combobox_set(gui->compression, dt_confgen_get_int("plugins/imageio/format/exr/compression", DT_DEFAULT));
+  dt_bauhaus_slider_set(gui->dwa_level, dt_confgen_get_float("plugins/imageio/format/exr/dwa_level", DT_DEFAULT));
+  dt_bauhaus_combobox_set(gui->tiled, dt_confgen_get_bool("plugins/imageio/format/exr/tiled", DT_DEFAULT));
 }
 
 
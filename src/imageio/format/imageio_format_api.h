@@ -80,6 +80,16 @@ REQUIRED(int, write_image, struct dt_imageio_module_data_t *data, const char *fi
                            dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                            void *exif, int exif_len, int32_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
                            const gboolean export_masks);
+/* streamed writing, for formats that can take the image in bands of rows.
+   write_begin returns a handle, or NULL when it can't stream with these settings and write_image
+   has to be used instead. rows come in order, from top to bottom, as 4 channels in the depth of bpp().
+   write_end always frees the handle, and removes the file when error is set. */
+OPTIONAL(void *, write_begin, struct dt_imageio_module_data_t *data, const char *filename,
+                              dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                              void *exif, int exif_len, int32_t imgid);
+OPTIONAL(int, write_rows, struct dt_imageio_module_data_t *data, void *handle, const void *in, const int y,
+                          const int rows);
+OPTIONAL(int, write_end, struct dt_imageio_module_data_t *data, void *handle, const gboolean error);
 /* flag that describes the available precision/levels of output format. mainly used for dithering. */
 OPTIONAL(int, levels, struct dt_imageio_module_data_t *data);
 
@@ -24,6 +24,7 @@
 #include "common/darktable.h"
 #include "common/exif.h"
 #include "common/imageio.h"
+#include "common/imageio_jpeg_bands.h"
 #include "common/imageio_module.h"
 #include "control/conf.h"
 #include "imageio/format/imageio_format_api.h"
@@ -301,6 +302,86 @@ read_icc_profile (j_decompress_ptr cinfo,
 #undef MAX_SEQ_NO
 
 
+static void _setup_compress(j_compress_ptr cinfo, const int quality)
+{
+  jpeg_set_quality(cinfo, quality, TRUE);
+  if(quality > 90) cinfo->comp_info[0].v_samp_factor = 1;
+  if(quality > 92) cinfo->comp_info[0].h_samp_factor = 1;
+  if(quality > 95) cinfo->dct_method = JDCT_FLOAT;
+  if(quality < 50) cinfo->dct_method = JDCT_IFAST;
+  if(quality < 80) cinfo->smoothing_factor = 20;
+  if(quality < 60) cinfo->smoothing_factor = 40;
+  if(quality < 40) cinfo->smoothing_factor = 60;
+  cinfo->optimize_coding = 1;
+
+  const int resolution = dt_conf_get_int("metadata/resolution");
+  cinfo->density_unit = 1;
+  cinfo->X_density = resolution;
+  cinfo->Y_density = resolution;
+}
+
+static void _write_profile(j_compress_ptr cinfo, cmsHPROFILE out_profile)
+{
+  uint32_t len = 0;
+  cmsSaveProfileToMem(out_profile, NULL, &len);
+  if(len > 0)
+  {
+    unsigned char *buf = malloc(sizeof(unsigned char) * len);
+    if(buf)
+    {
+      cmsSaveProfileToMem(out_profile, buf, &len);
+      write_icc_profile(cinfo, buf, len);
+      free(buf);
+    }
+  }
+}
+
+typedef struct dt_imageio_jpeg_bands_data_t
+{
+  int quality;
+  cmsHPROFILE profile;
+} dt_imageio_jpeg_bands_data_t;
+
+static void _bands_setup(j_compress_ptr cinfo, void *user_data)
+{
+  _setup_compress(cinfo, ((dt_imageio_jpeg_bands_data_t *)user_data)->quality);
+}
+
+static void _bands_markers(j_compress_ptr cinfo, void *user_data)
+{
+  _write_profile(cinfo, ((dt_imageio_jpeg_bands_data_t *)user_data)->profile);
+}
+
+// large images are encoded in parallel bands. They don't get optimized Huffman tables,
+// that costs a few percents of file size.
+static int _write_bands(const dt_imageio_jpeg_t *jpg, const char *filename, const uint8_t *in,
+                        cmsHPROFILE out_profile)
+{
+  if((size_t)jpg->global.width * jpg->global.height < DT_IMAGEIO_JPEG_BANDS_MIN_PIXELS
+     || darktable.num_openmp_threads < 2)
+    return 1;
+
+  dt_imageio_jpeg_bands_data_t data = { jpg->quality, out_profile };
+  uint8_t *buf = NULL;
+  size_t length = 0;
+  if(dt_imageio_jpeg_compress_bands(in, jpg->global.width, jpg->global.height, _bands_setup, _bands_markers,
+                                    &data, &buf, &length))
+  {
+    free(buf);
+    return 1;
+  }
+
+  int err = 1;
+  FILE *f = g_fopen(filename, "wb");
+  if(f)
+  {
+    err = (fwrite(buf, 1, length, f) != length);
+    err |= (fclose(f) != 0);
+  }
+  free(buf);
+  return err;
+}
+
 int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, int32_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
@@ -310,6 +391,13 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
   const uint8_t *in = (const uint8_t *)in_tmp;
   struct dt_imageio_jpeg_error_mgr jerr;
 
+  cmsHPROFILE out_profile = dt_colorspaces_get_output_profile(imgid, &over_type, over_filename)->profile;
+  if(!_write_bands(jpg, filename, in, out_profile))
+  {
+    dt_exif_write_blob(exif, exif_len, filename, 1);
+    return 0;
+  }
+
   jpg->cinfo.err = jpeg_std_error(&jerr.pub);
   jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
   if(setjmp(jerr.setjmp_buffer))
@@ -327,36 +415,10 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
   jpg->cinfo.input_components = 3;
   jpg->cinfo.in_color_space = JCS_RGB;
   jpeg_set_defaults(&(jpg->cinfo));
-  jpeg_set_quality(&(jpg->cinfo), jpg->quality, TRUE);
-  if(jpg->quality > 90) jpg->cinfo.comp_info[0].v_samp_factor = 1;
-  if(jpg->quality > 92) jpg->cinfo.comp_info[0].h_samp_factor = 1;
-  if(jpg->quality > 95) jpg->cinfo.dct_method = JDCT_FLOAT;
-  if(jpg->quality < 50) jpg->cinfo.dct_method = JDCT_IFAST;
-  if(jpg->quality < 80) jpg->cinfo.smoothing_factor = 20;
-  if(jpg->quality < 60) jpg->cinfo.smoothing_factor = 40;
-  if(jpg->quality < 40) jpg->cinfo.smoothing_factor = 60;
-  jpg->cinfo.optimize_coding = 1;
-
-  const int resolution = dt_conf_get_int("metadata/resolution");
-  jpg->cinfo.density_unit = 1;
-  jpg->cinfo.X_density = resolution;
-  jpg->cinfo.Y_density = resolution;
+  _setup_compress(&(jpg->cinfo), jpg->quality);
 
   jpeg_start_compress(&(jpg->cinfo), TRUE);
-
-  cmsHPROFILE out_profile = dt_colorspaces_get_output_profile(imgid, &over_type, over_filename)->profile;
-  uint32_t len = 0;
-  cmsSaveProfileToMem(out_profile, NULL, &len);
-  if(len > 0)
-  {
-    unsigned char *buf = malloc(sizeof(unsigned char) * len);
-    if(buf)
-    {
-      cmsSaveProfileToMem(out_profile, buf, &len);
-      write_icc_profile(&(jpg->cinfo), buf, len);
-      free(buf);
-    }
-  }
+  _write_profile(&(jpg->cinfo), out_profile);
 
   uint8_t *row = dt_alloc_align(sizeof(uint8_t) * 3 * jpg->global.width);
   const uint8_t *buf;
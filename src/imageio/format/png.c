@@ -20,6 +20,7 @@
 #include "config.h"
 #endif
 
+#include <glib/gstdio.h>
 #include <inttypes.h>
 #include <png.h>
 #include <stdio.h>
@@ -117,43 +118,11 @@ static void PNGwriteRawProfile(png_struct *ping, png_info *ping_info, char *prof
   png_free(ping, text);
 }
 
-int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int32_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+// compression, header, icc profile and exif, up to the pixels. libpng errors jump to the caller's setjmp.
+static void _write_header(png_structp png_ptr, png_infop info_ptr, const dt_imageio_png_t *p,
+                          dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                          void *exif, int exif_len, int32_t imgid)
 {
-  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
-  const int width = p->global.width, height = p->global.height;
-  FILE *f = g_fopen(filename, "wb");
-  if(!f) return 1;
-
-  png_structp png_ptr;
-  png_infop info_ptr;
-
-  png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-  if(!png_ptr)
-  {
-    fclose(f);
-    return 1;
-  }
-
-  info_ptr = png_create_info_struct(png_ptr);
-  if(!info_ptr)
-  {
-    fclose(f);
-    png_destroy_write_struct(&png_ptr, NULL);
-    return 1;
-  }
-
-  if(setjmp(png_jmpbuf(png_ptr)))
-  {
-    fclose(f);
-    png_destroy_write_struct(&png_ptr, &info_ptr);
-    return 1;
-  }
-
-  png_init_io(png_ptr, f);
-
   png_set_compression_level(png_ptr, p->compression);
   png_set_compression_mem_level(png_ptr, 8);
   png_set_compression_strategy(png_ptr, Z_DEFAULT_STRATEGY);
@@ -161,8 +130,8 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
   png_set_compression_method(png_ptr, 8);
   png_set_compression_buffer_size(png_ptr, 8192);
 
-  png_set_IHDR(png_ptr, info_ptr, width, height, p->bpp, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
-               PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_set_IHDR(png_ptr, info_ptr, p->global.width, p->global.height, p->bpp, PNG_COLOR_TYPE_RGB,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
   // metadata has to be written before the pixels
 
@@ -212,13 +181,255 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
    */
   png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
 
+  /* swap bytes of 16 bit files to most significant bit first */
+  if(p->bpp > 8) png_set_swap(png_ptr);
+}
+
+/* Parallel encoding: the rows are split in bands, each band is filtered and deflated on its own thread
+ * into a raw deflate stream ending on a Z_SYNC_FLUSH, so that the concatenation of all bands is a valid
+ * stream. The zlib header and the combined adler32 wrap them into the single zlib stream PNG expects,
+ * written as IDAT chunks. Bands don't share their dictionary, which costs a fraction of a percent. */
+
+// smallest band worth a thread of its own
+#define DT_PNG_BAND_ROWS 32
+
+// convert a row from RGBX, host order, to packed RGB, big endian
+static inline void _pack_row(uint8_t *out, const void *in, const int y, const int width, const int bpp)
+{
+  if(bpp > 8)
+  {
+    const uint16_t *row = (const uint16_t *)in + (size_t)4 * y * width;
+    for(int x = 0; x < width; x++)
+      for(int c = 0; c < 3; c++)
+      {
+        const uint16_t v = row[4 * x + c];
+        *out++ = v >> 8;
+        *out++ = v & 0xff;
+      }
+  }
+  else
+  {
+    const uint8_t *row = (const uint8_t *)in + (size_t)4 * y * width;
+    for(int x = 0; x < width; x++)
+      for(int c = 0; c < 3; c++) *out++ = row[4 * x + c];
+  }
+}
+
+static inline uint8_t _paeth(const int a, const int b, const int c)
+{
+  const int p = a + b - c;
+  const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if(pa <= pb && pa <= pc) return a;
+  return pb <= pc ? b : c;
+}
+
+/* filter one row with the filter minimizing the sum of absolute differences, the heuristic libpng uses
+ * for its adaptive filtering. out gets the filter type byte followed by the row. candidates holds
+ * 4 rows of scratch. */
+static void _filter_row(uint8_t *out, const uint8_t *cur, const uint8_t *prev, const size_t rowbytes,
+                        const int pixbytes, uint8_t *candidates)
+{
+  uint8_t *rows[5] = { (uint8_t *)cur, candidates, candidates + rowbytes, candidates + 2 * rowbytes,
+                       candidates + 3 * rowbytes };
+  uint64_t sums[5] = { 0 };
+
+  for(size_t i = 0; i < rowbytes; i++)
+  {
+    const int a = i >= (size_t)pixbytes ? cur[i - pixbytes] : 0;
+    const int b = prev ? prev[i] : 0;
+    const int c = (prev && i >= (size_t)pixbytes) ? prev[i - pixbytes] : 0;
+    const int x = cur[i];
+    rows[1][i] = x - a;
+    rows[2][i] = x - b;
+    rows[3][i] = x - ((a + b) >> 1);
+    rows[4][i] = x - _paeth(a, b, c);
+    for(int f = 0; f < 5; f++) sums[f] += abs((int8_t)rows[f][i]);
+  }
+
+  int best = 0;
+  for(int f = 1; f < 5; f++)
+    if(sums[f] < sums[best]) best = f;
+
+  out[0] = best;
+  memcpy(out + 1, rows[best], rowbytes);
+}
+
+typedef struct dt_imageio_png_band_t
+{
+  uint8_t *data;
+  size_t size;
+  uLong adler;
+  size_t length; // uncompressed
+  int error;
+} dt_imageio_png_band_t;
+
+static void _encode_band(dt_imageio_png_band_t *band, const void *in, const int width, const int bpp,
+                         const int y0, const int y1, const int level, const gboolean last)
+{
+  const int pixbytes = bpp > 8 ? 6 : 3;
+  const size_t rowbytes = (size_t)pixbytes * width;
+  const size_t length = (rowbytes + 1) * (y1 - y0);
+  uint8_t *filtered = dt_alloc_align(length);
+  uint8_t *scratch = dt_alloc_align(6 * rowbytes);
+  z_stream strm = { 0 };
+  band->error = 1;
+  if(!filtered || !scratch) goto out;
+
+  // the first row is filtered against the last of the previous band, as in a sequential encoder
+  uint8_t *prev = scratch, *cur = scratch + rowbytes, *candidates = scratch + 2 * rowbytes;
+  if(y0 > 0) _pack_row(prev, in, y0 - 1, width, bpp);
+  for(int y = y0; y < y1; y++)
+  {
+    _pack_row(cur, in, y, width, bpp);
+    _filter_row(filtered + (rowbytes + 1) * (y - y0), cur, y > 0 ? prev : NULL, rowbytes, pixbytes, candidates);
+    uint8_t *tmp = prev;
+    prev = cur;
+    cur = tmp;
+  }
+
+  band->length = length;
+  band->adler = adler32(adler32(0L, Z_NULL, 0), filtered, length);
+
+  if(deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) goto out;
+  // room for the sync flush marker on top of the worst case
+  const size_t bound = deflateBound(&strm, length) + 16;
+  band->data = malloc(bound);
+  if(!band->data)
+  {
+    deflateEnd(&strm);
+    goto out;
+  }
+  strm.next_in = filtered;
+  strm.avail_in = length;
+  strm.next_out = band->data;
+  strm.avail_out = bound;
+  const int ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+  band->size = bound - strm.avail_out;
+  deflateEnd(&strm);
+  if((last && ret == Z_STREAM_END) || (!last && ret == Z_OK && strm.avail_in == 0 && strm.avail_out > 0))
+    band->error = 0;
+
+out:
+  dt_free_align(filtered);
+  dt_free_align(scratch);
+}
+
+// libpng has no way to take compressed pixels, the chunks go right after what it wrote to f
+static int _write_chunk(FILE *f, const char *type, const uint8_t *data, const size_t size)
+{
+  // chunks are limited to 2^31 - 1 bytes, IDAT can be split anywhere
+  if(size > (1u << 30)) return _write_chunk(f, type, data, 1u << 30)
+                               || _write_chunk(f, type, data + (1u << 30), size - (1u << 30));
+
+  const uint8_t length[4] = { size >> 24, (size >> 16) & 0xff, (size >> 8) & 0xff, size & 0xff };
+  uLong crc = crc32(crc32(0L, Z_NULL, 0), (const Bytef *)type, 4);
+  if(size) crc = crc32(crc, data, size);
+  const uint8_t crc_be[4] = { crc >> 24, (crc >> 16) & 0xff, (crc >> 8) & 0xff, crc & 0xff };
+
+  return fwrite(length, 1, 4, f) != 4 || fwrite(type, 1, 4, f) != 4 || (size && fwrite(data, 1, size, f) != size)
+         || fwrite(crc_be, 1, 4, f) != 4;
+}
+
+// write the pixels as IDAT chunks, and the IEND chunk, after the header libpng wrote. returns 1 on error.
+static int _write_image_parallel(FILE *f, const dt_imageio_png_t *p, const void *in, const int nbands)
+{
+  const int width = p->global.width, height = p->global.height;
+  const int bpp = p->bpp, level = p->compression;
+  dt_imageio_png_band_t *bands = calloc(nbands, sizeof(dt_imageio_png_band_t));
+  if(!bands) return 1;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(bands, in, width, height, bpp, level, nbands) \
+  schedule(dynamic, 1)
+#endif
+  for(int b = 0; b < nbands; b++)
+  {
+    const int y0 = (int)((int64_t)height * b / nbands);
+    const int y1 = (int)((int64_t)height * (b + 1) / nbands);
+    _encode_band(&bands[b], in, width, bpp, y0, y1, level, b == nbands - 1);
+  }
+
+  int error = 0;
+  uLong adler = adler32(0L, Z_NULL, 0);
+  for(int b = 0; b < nbands; b++)
+  {
+    error |= bands[b].error;
+    if(!error) adler = adler32_combine(adler, bands[b].adler, bands[b].length);
+  }
+
+  if(!error)
+  {
+    // zlib header: deflate with a 32k window, and the compression level hint
+    const int flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    uint8_t header[2] = { 0x78, flevel << 6 };
+    header[1] += 31 - ((header[0] << 8) + header[1]) % 31;
+    error = _write_chunk(f, "IDAT", header, sizeof(header));
+
+    for(int b = 0; b < nbands && !error; b++)
+      if(bands[b].size) error = _write_chunk(f, "IDAT", bands[b].data, bands[b].size);
+
+    const uint8_t trailer[4] = { adler >> 24, (adler >> 16) & 0xff, (adler >> 8) & 0xff, adler & 0xff };
+    error = error || _write_chunk(f, "IDAT", trailer, sizeof(trailer)) || _write_chunk(f, "IEND", NULL, 0);
+  }
+
+  for(int b = 0; b < nbands; b++) free(bands[b].data);
+  free(bands);
+  return error;
+}
+
+int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int32_t imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  const int width = p->global.width, height = p->global.height;
+  FILE *f = g_fopen(filename, "wb");
+  if(!f) return 1;
+
+  png_structp png_ptr;
+  png_infop info_ptr;
+
+  png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if(!png_ptr)
+  {
+    fclose(f);
+    return 1;
+  }
+
+  info_ptr = png_create_info_struct(png_ptr);
+  if(!info_ptr)
+  {
+    fclose(f);
+    png_destroy_write_struct(&png_ptr, NULL);
+    return 1;
+  }
+
+  if(setjmp(png_jmpbuf(png_ptr)))
+  {
+    fclose(f);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    return 1;
+  }
+
+  png_init_io(png_ptr, f);
+  _write_header(png_ptr, info_ptr, p, over_type, over_filename, exif, exif_len, imgid);
+
+  const int nbands = MIN(darktable.num_openmp_threads * 4, height / DT_PNG_BAND_ROWS);
+  if(nbands > 1)
+  {
+    int error = _write_image_parallel(f, p, ivoid, nbands);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    error |= fclose(f) != 0;
+    if(error) g_unlink(filename);
+    return error;
+  }
+
   png_bytep *row_pointers = dt_alloc_align(sizeof(png_bytep) * height);
 
   if(p->bpp > 8)
   {
-    /* swap bytes of 16 bit files to most significant bit first */
-    png_set_swap(png_ptr);
-
     for(unsigned i = 0; i < height; i++) row_pointers[i] = (png_bytep)((uint16_t *)ivoid + (size_t)4 * i * width);
   }
   else
@@ -236,6 +447,85 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
   return 0;
 }
 
+// band-streaming writer
+typedef struct dt_imageio_png_stream_t
+{
+  FILE *f;
+  gchar *filename;
+  png_structp png_ptr;
+  png_infop info_ptr;
+} dt_imageio_png_stream_t;
+
+void *write_begin(dt_imageio_module_data_t *p_tmp, const char *filename,
+                  dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                  void *exif, int exif_len, int32_t imgid)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  dt_imageio_png_stream_t *s = g_malloc0(sizeof(dt_imageio_png_stream_t));
+  s->f = g_fopen(filename, "wb");
+  if(!s->f)
+  {
+    g_free(s);
+    return NULL;
+  }
+  s->filename = g_strdup(filename);
+
+  s->png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if(s->png_ptr) s->info_ptr = png_create_info_struct(s->png_ptr);
+  if(!s->png_ptr || !s->info_ptr)
+  {
+    write_end(p_tmp, s, TRUE);
+    return NULL;
+  }
+
+  if(setjmp(png_jmpbuf(s->png_ptr)))
+  {
+    write_end(p_tmp, s, TRUE);
+    return NULL;
+  }
+
+  png_init_io(s->png_ptr, s->f);
+  _write_header(s->png_ptr, s->info_ptr, p, over_type, over_filename, exif, exif_len, imgid);
+  return s;
+}
+
+int write_rows(dt_imageio_module_data_t *p_tmp, void *handle, const void *in, const int y, const int rows)
+{
+  const dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  dt_imageio_png_stream_t *s = (dt_imageio_png_stream_t *)handle;
+  const size_t rowsize = (size_t)4 * p->global.width * (p->bpp > 8 ? sizeof(uint16_t) : sizeof(uint8_t));
+
+  if(setjmp(png_jmpbuf(s->png_ptr))) return 1;
+
+  for(int r = 0; r < rows; r++) png_write_row(s->png_ptr, (png_const_bytep)in + r * rowsize);
+  return 0;
+}
+
+int write_end(dt_imageio_module_data_t *p_tmp, void *handle, const gboolean error)
+{
+  dt_imageio_png_stream_t *s = (dt_imageio_png_stream_t *)handle;
+  // volatile: read again after a longjmp
+  volatile int rc = error;
+
+  if(s->png_ptr)
+  {
+    if(!rc)
+    {
+      if(setjmp(png_jmpbuf(s->png_ptr)))
+        rc = 1;
+      else
+        png_write_end(s->png_ptr, s->info_ptr);
+    }
+    png_destroy_write_struct(&s->png_ptr, &s->info_ptr);
+  }
+  fclose(s->f);
+  if(rc) g_unlink(s->filename);
+
+  g_free(s->filename);
+  g_free(s);
+  return rc;
+}
+
 static int __attribute__((__unused__)) read_header(const char *filename, dt_imageio_module_data_t *p_tmp)
 {
   dt_imageio_png_t *png = (dt_imageio_png_t *)p_tmp;
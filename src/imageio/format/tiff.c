@@ -26,12 +26,14 @@
 #include "control/control.h"
 #include "imageio/format/imageio_format_api.h"
 #include "develop/pixelpipe_hb.h"
+#include <glib/gstdio.h>
 #include <inttypes.h>
 #include <memory.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <tiffio.h>
+#include <zlib.h>
 
 // it would be nice to save space by storing the masks as single channel float data,
 // but at least GIMP can't open TIFF files where not all layers have the same format.
@@ -57,6 +59,226 @@ typedef struct dt_imageio_tiff_gui_t
   GtkWidget *shortfiles;
 } dt_imageio_tiff_gui_t;
 
+// deflated exports are cut in strips of about this size, compressed in parallel then written in order
+#define DT_TIFF_STRIP_BYTES (1 << 20)
+
+// drop the 4th channel of the pipe output, `bps` bytes per sample
+static inline void _pack_row(uint8_t *const out, const void *const in_void, const size_t y, const size_t width,
+                             const uint16_t layers, const size_t bps)
+{
+  const uint8_t *const in = (const uint8_t *)in_void + 4 * bps * width * y;
+  for(size_t x = 0; x < width; x++) memcpy(out + x * layers * bps, in + x * 4 * bps, layers * bps);
+}
+
+// the encoders of libtiff's predictors, applied to one row as it is stored in the little endian file
+static inline void _predict_row(uint8_t *const row, uint8_t *const tmp, const size_t width, const uint16_t layers,
+                                const int bpp)
+{
+  const size_t samples = width * layers;
+  if(bpp == 32)
+  {
+    // PREDICTOR_FLOATINGPOINT: bytes of the samples gathered by significance, most significant first,
+    // then differenced along the row
+    const size_t rowsize = samples * sizeof(float);
+    memcpy(tmp, row, rowsize);
+    for(size_t k = 0; k < samples; k++)
+      for(size_t b = 0; b < sizeof(float); b++) row[(sizeof(float) - 1 - b) * samples + k] = tmp[sizeof(float) * k + b];
+    for(size_t k = rowsize - 1; k >= layers; k--) row[k] -= row[k - layers];
+  }
+  else if(bpp == 16)
+  {
+    // PREDICTOR_HORIZONTAL
+    uint16_t *const p = (uint16_t *)row;
+    for(size_t k = samples - 1; k >= layers; k--) p[k] -= p[k - layers];
+  }
+  else
+  {
+    for(size_t k = samples - 1; k >= layers; k--) row[k] -= row[k - layers];
+  }
+}
+
+// Deflated strips, compressed by batches in parallel then written in order.
+// TIFFWriteScanline() would run deflate on a single thread.
+typedef struct dt_imageio_tiff_strips_t
+{
+  TIFF *tif;
+  size_t width, height, bps, rowsize;
+  size_t rows_per_strip, stripsize, batch, bound;
+  uint16_t layers;
+  gboolean predictor;
+  int level, bpp;
+  uint8_t *raw;    // packed rows of the batch
+  uint8_t *tmp;    // a row per strip, for the floating point predictor
+  uint8_t *packed; // compressed strips of the batch
+  uLongf *sizes;
+  size_t first;    // first strip of the batch
+  size_t filled;   // rows of the batch received so far
+} dt_imageio_tiff_strips_t;
+
+static int _strips_init(dt_imageio_tiff_strips_t *s, TIFF *tif, const dt_imageio_tiff_t *d, const uint16_t layers)
+{
+  s->tif = tif;
+  s->width = d->global.width;
+  s->height = d->global.height;
+  s->bps = d->bpp / 8;
+  s->layers = layers;
+  s->rowsize = s->width * layers * s->bps;
+  s->rows_per_strip = CLAMP(DT_TIFF_STRIP_BYTES / s->rowsize, 1, s->height);
+  s->stripsize = s->rows_per_strip * s->rowsize;
+  const size_t nstrips = (s->height + s->rows_per_strip - 1) / s->rows_per_strip;
+  s->batch = MIN(nstrips, (size_t)2 * MAX(darktable.num_openmp_threads, 1));
+  s->bound = compressBound(s->stripsize);
+  s->predictor = (d->compress == 2);
+  s->level = d->compresslevel;
+  s->bpp = d->bpp;
+  s->first = 0;
+  s->filled = 0;
+
+  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, (uint32_t)s->rows_per_strip);
+
+  s->raw = dt_alloc_align(s->batch * s->stripsize);
+  s->tmp = dt_alloc_align(s->batch * s->rowsize);
+  s->packed = dt_alloc_align(s->batch * s->bound);
+  s->sizes = malloc(s->batch * sizeof(uLongf));
+  return (s->raw == NULL || s->tmp == NULL || s->packed == NULL || s->sizes == NULL);
+}
+
+static void _strips_cleanup(dt_imageio_tiff_strips_t *s)
+{
+  dt_free_align(s->raw);
+  dt_free_align(s->tmp);
+  dt_free_align(s->packed);
+  free(s->sizes);
+  s->raw = s->tmp = s->packed = NULL;
+  s->sizes = NULL;
+}
+
+// compress the strips of the batch in parallel and write them
+static int _strips_flush(dt_imageio_tiff_strips_t *s)
+{
+  const size_t count = (s->filled + s->rows_per_strip - 1) / s->rows_per_strip;
+  const size_t filled = s->filled;
+  uint8_t *const raw = s->raw;
+  uint8_t *const tmp = s->tmp;
+  uint8_t *const packed = s->packed;
+  uLongf *const sizes = s->sizes;
+  const size_t width = s->width, rowsize = s->rowsize, rows_per_strip = s->rows_per_strip;
+  const size_t stripsize = s->stripsize, bound = s->bound;
+  const uint16_t layers = s->layers;
+  const gboolean predictor = s->predictor;
+  const int level = s->level, bpp = s->bpp;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(raw, tmp, packed, sizes, count, filled, width, layers, rowsize, rows_per_strip, \
+                        stripsize, bound, predictor, level, bpp) \
+    schedule(dynamic)
+#endif
+  for(size_t k = 0; k < count; k++)
+  {
+    const size_t rows = MIN(rows_per_strip, filled - k * rows_per_strip);
+    uint8_t *const strip = raw + k * stripsize;
+    if(predictor)
+      for(size_t y = 0; y < rows; y++) _predict_row(strip + y * rowsize, tmp + k * rowsize, width, layers, bpp);
+    sizes[k] = bound;
+    if(compress2(packed + k * bound, &sizes[k], strip, rows * rowsize, level) != Z_OK) sizes[k] = 0;
+  }
+
+  int err = 0;
+  for(size_t k = 0; k < count && !err; k++)
+    if(sizes[k] == 0 || TIFFWriteRawStrip(s->tif, (uint32_t)(s->first + k), packed + k * bound, sizes[k]) == -1)
+      err = 1;
+
+  s->first += count;
+  s->filled = 0;
+  return err;
+}
+
+// pack `rows` rows of the pipe output starting at image row `y`, compressing full batches.
+// returns 0 on success.
+static int _strips_push(dt_imageio_tiff_strips_t *s, const void *in, const size_t y, const size_t rows)
+{
+  size_t done = 0;
+  while(done < rows)
+  {
+    const size_t n = MIN(rows - done, s->batch * s->rows_per_strip - s->filled);
+    uint8_t *const raw = s->raw + s->filled * s->rowsize;
+    const size_t width = s->width, rowsize = s->rowsize, bps = s->bps;
+    const uint16_t layers = s->layers;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(raw, in, done, n, width, rowsize, layers, bps) \
+    schedule(static)
+#endif
+    for(size_t r = 0; r < n; r++) _pack_row(raw + r * rowsize, in, done + r, width, layers, bps);
+
+    s->filled += n;
+    done += n;
+    if((s->filled == s->batch * s->rows_per_strip || y + done == s->height) && _strips_flush(s)) return 1;
+  }
+  return 0;
+}
+
+// http://partners.adobe.com/public/developer/en/tiff/TIFFphotoshop.pdf (dated 2002)
+// "A proprietary ZIP/Flate compression code (0x80b2) has been used by some"
+// "software vendors. This code should be considered obsolete. We recommend"
+// "that TIFF implementations recognize and read the obsolete code but only"
+// "write the official compression code (0x0008)."
+// http://www.awaresystems.be/imaging/tiff/tifftags/compression.html
+// http://www.awaresystems.be/imaging/tiff/tifftags/predictor.html
+static void _set_compression(TIFF *tif, const dt_imageio_tiff_t *d)
+{
+  if(d->compress == 1)
+  {
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_NONE);
+    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
+  }
+  else if(d->compress == 2)
+  {
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+    if(d->bpp == 32)
+      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
+    else
+      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
+  }
+}
+
+static void _set_image_tags(TIFF *tif, const dt_imageio_tiff_t *d, const uint16_t layers)
+{
+  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, layers);
+  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)d->bpp);
+  TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, (d->bpp == 32) ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT);
+  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32_t)d->global.width);
+  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)d->global.height);
+  if(layers == 3)
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+  else
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+
+  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+  TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
+
+  const int resolution = dt_conf_get_int("metadata/resolution");
+  TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
+  TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
+  TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
+}
+
+// the output profile as an ICC blob, or NULL
+static uint8_t *_get_profile(const int32_t imgid, dt_colorspaces_color_profile_type_t over_type,
+                             const char *over_filename, uint32_t *profile_len)
+{
+  *profile_len = 0;
+  if(imgid <= 0) return NULL;
+  cmsHPROFILE out_profile = dt_colorspaces_get_output_profile(imgid, &over_type, over_filename)->profile;
+  cmsSaveProfileToMem(out_profile, 0, profile_len);
+  if(*profile_len == 0) return NULL;
+  uint8_t *profile = malloc(*profile_len);
+  if(profile) cmsSaveProfileToMem(out_profile, profile, profile_len);
+  return profile;
+}
 
 int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
@@ -127,28 +349,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
 
   TIFFSetField(tif, TIFFTAG_DOCUMENTNAME, filename);
 
-  // http://partners.adobe.com/public/developer/en/tiff/TIFFphotoshop.pdf (dated 2002)
-  // "A proprietary ZIP/Flate compression code (0x80b2) has been used by some"
-  // "software vendors. This code should be considered obsolete. We recommend"
-  // "that TIFF implementations recognize and read the obsolete code but only"
-  // "write the official compression code (0x0008)."
-  // http://www.awaresystems.be/imaging/tiff/tifftags/compression.html
-  // http://www.awaresystems.be/imaging/tiff/tifftags/predictor.html
-  if(d->compress == 1)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-    TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_NONE);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-  }
-  else if(d->compress == 2)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-    if(d->bpp == 32)
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
-    else
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-  }
+  _set_compression(tif, d);
 
   if(profile != NULL)
   {
@@ -228,33 +429,27 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   if(layers == 1)
     dt_control_log(_("will export as a grayscale image"));
 
-  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, layers);
-  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)d->bpp);
-  TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, (d->bpp == 32) ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT);
-  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32_t)d->global.width);
-  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)d->global.height);
-  if(layers == 3)
-    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-  else
-    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-
-  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-  TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
-  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
-
-  const int resolution = dt_conf_get_int("metadata/resolution");
-  TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
-  TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
-  TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
+  _set_image_tags(tif, d, layers);
 
   const size_t rowsize = (d->global.width * layers) * d->bpp / 8;
-  if((rowdata = malloc(rowsize)) == NULL)
+  if(d->compress > 0 && G_BYTE_ORDER == G_LITTLE_ENDIAN)
+  {
+    // raw strips are stored as they are, in the byte order of the host
+    dt_imageio_tiff_strips_t strips;
+    const int err = _strips_init(&strips, tif, d, layers) || _strips_push(&strips, in_void, 0, d->global.height);
+    _strips_cleanup(&strips);
+    if(err)
+    {
+      rc = 1;
+      goto exit;
+    }
+  }
+  else if((rowdata = malloc(rowsize)) == NULL)
   {
     rc = 1;
     goto exit;
   }
-
-  if(d->bpp == 32)
+  else if(d->bpp == 32)
   {
     for(int y = 0; y < d->global.height; y++)
     {
@@ -541,6 +736,117 @@ exit:
   return rc;
 }
 
+// band-streaming writer, for exports without masks
+typedef struct dt_imageio_tiff_stream_t
+{
+  TIFF *tif;
+  gchar *filename;
+  uint8_t *exif;
+  int exif_len;
+  gboolean deflate;
+  dt_imageio_tiff_strips_t strips;
+  uint8_t *rowdata;
+} dt_imageio_tiff_stream_t;
+
+void *write_begin(dt_imageio_module_data_t *d_tmp, const char *filename,
+                  dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                  void *exif, int exif_len, int32_t imgid)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+
+  // finding grayscale images needs all the pixels
+  if(dt_conf_key_exists("plugins/imageio/format/tiff/shortfile")
+     && dt_conf_get_int("plugins/imageio/format/tiff/shortfile"))
+    return NULL;
+
+  dt_imageio_tiff_stream_t *s = g_malloc0(sizeof(dt_imageio_tiff_stream_t));
+#ifdef _WIN32
+  wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
+  s->tif = TIFFOpenW(wfilename, "wl");
+  g_free(wfilename);
+#else
+  s->tif = TIFFOpen(filename, "wl");
+#endif
+  if(!s->tif)
+  {
+    g_free(s);
+    return NULL;
+  }
+
+  s->filename = g_strdup(filename);
+  if(exif && exif_len > 0)
+  {
+    s->exif = g_memdup2(exif, exif_len);
+    s->exif_len = exif_len;
+  }
+
+  TIFFSetField(s->tif, TIFFTAG_SUBFILETYPE, 0);
+  TIFFSetField(s->tif, TIFFTAG_DOCUMENTNAME, filename);
+  _set_compression(s->tif, d);
+
+  uint32_t profile_len = 0;
+  uint8_t *profile = _get_profile(imgid, over_type, over_filename, &profile_len);
+  if(profile) TIFFSetField(s->tif, TIFFTAG_ICCPROFILE, profile_len, profile);
+  free(profile);
+
+  const uint16_t layers = 3;
+  _set_image_tags(s->tif, d, layers);
+
+  // raw strips are stored as they are, in the byte order of the host
+  s->deflate = (d->compress > 0 && G_BYTE_ORDER == G_LITTLE_ENDIAN);
+  int err = 0;
+  if(s->deflate)
+    err = _strips_init(&s->strips, s->tif, d, layers);
+  else
+    err = (s->rowdata = malloc((size_t)d->global.width * layers * d->bpp / 8)) == NULL;
+
+  if(err)
+  {
+    write_end(d_tmp, s, TRUE);
+    return NULL;
+  }
+  return s;
+}
+
+int write_rows(dt_imageio_module_data_t *d_tmp, void *handle, const void *in, const int y, const int rows)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  dt_imageio_tiff_stream_t *s = (dt_imageio_tiff_stream_t *)handle;
+  if(s->deflate) return _strips_push(&s->strips, in, y, rows);
+
+  const size_t bps = d->bpp / 8;
+  for(int r = 0; r < rows; r++)
+  {
+    _pack_row(s->rowdata, in, r, d->global.width, 3, bps);
+    if(TIFFWriteScanline(s->tif, s->rowdata, y + r, 0) == -1) return 1;
+  }
+  return 0;
+}
+
+int write_end(dt_imageio_module_data_t *d_tmp, void *handle, const gboolean error)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  dt_imageio_tiff_stream_t *s = (dt_imageio_tiff_stream_t *)handle;
+  int rc = error;
+
+  if(s->deflate) _strips_cleanup(&s->strips);
+  free(s->rowdata);
+
+  // close the file before adding exif data
+  TIFFClose(s->tif);
+  if(!rc && s->exif)
+  {
+    // Until we get symbolic error status codes, if rc is 1, return 0
+    rc = (dt_exif_write_blob(s->exif, s->exif_len, s->filename, d->compress > 0) == 1) ? 0 : 1;
+  }
+  if(error) g_unlink(s->filename);
+
+  g_free(s->exif);
+  g_free(s->filename);
+  g_free(s);
+  return rc;
+}
+
 #if 0
 int dt_imageio_tiff_read_header(const char *filename, dt_imageio_tiff_t *tiff)
 {
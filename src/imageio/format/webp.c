@@ -33,7 +33,7 @@
 #include <webp/encode.h>
 #include <webp/mux.h>
 
-DT_MODULE(2)
+DT_MODULE(3)
 
 typedef enum
 {
@@ -50,6 +50,17 @@ typedef enum
   hint_graphic
 } hint_t;
 
+// encoder effort, from the fastest to the smallest files
+typedef enum
+{
+  speed_fast,
+  speed_balanced,
+  speed_best
+} speed_t;
+
+// WebPConfig.method of each speed_t
+static const int _speed_method[] = { 2, 4, 6 };
+
 
 typedef struct dt_imageio_webp_t
 {
@@ -57,6 +68,7 @@ typedef struct dt_imageio_webp_t
   int comp_type;
   int quality;
   int hint;
+  int speed;
 } dt_imageio_webp_t;
 
 typedef struct dt_imageio_webp_gui_data_t
@@ -64,6 +76,7 @@ typedef struct dt_imageio_webp_gui_data_t
   GtkWidget *compression;
   GtkWidget *quality;
   GtkWidget *hint;
+  GtkWidget *speed;
 } dt_imageio_webp_gui_data_t;
 
 #define _stringify(a) #a
@@ -146,7 +159,9 @@ int write_image(dt_imageio_module_data_t *webp, const char *filename, const void
   // TODO(jinxos): expose more config options in the UI
   config.lossless = webp_data->comp_type;
   config.image_hint = webp_data->hint;
-  config.method = 6;
+  config.method = _speed_method[CLAMP(webp_data->speed, speed_fast, speed_best)];
+  // a second thread for the analysis and the entropy coding
+  config.thread_level = 1;
 
   // these are to allow for large image export.
   // TODO(jinxos): these values should be adjusted as needed and ideally determined at runtime.
@@ -261,7 +276,7 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
                     const size_t old_params_size, const int old_version, const int new_version,
                     size_t *new_size)
 {
-  if(old_version == 1 && new_version == 2)
+  if(old_version == 1 && new_version == 3)
   {
     typedef struct dt_imageio_webp_v1_t
     {
@@ -284,6 +299,25 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
     n->comp_type = o->comp_type;
     n->quality = o->quality;
     n->hint = o->hint;
+    n->speed = speed_best;
+    *new_size = self->params_size(self);
+    return n;
+  }
+  else if(old_version == 2 && new_version == 3)
+  {
+    typedef struct dt_imageio_webp_v2_t
+    {
+      dt_imageio_module_data_t global;
+      int comp_type;
+      int quality;
+      int hint;
+    } dt_imageio_webp_v2_t;
+
+    const dt_imageio_webp_v2_t *o = (dt_imageio_webp_v2_t *)old_params;
+    dt_imageio_webp_t *n = (dt_imageio_webp_t *)malloc(sizeof(dt_imageio_webp_t));
+    memcpy(n, o, sizeof(dt_imageio_webp_v2_t));
+    // what older versions always used
+    n->speed = speed_best;
     *new_size = self->params_size(self);
     return n;
   }
@@ -299,6 +333,7 @@ void *get_params(dt_imageio_module_format_t *self)
   else
     d->quality = 100;
   d->hint = dt_conf_get_int("plugins/imageio/format/webp/hint");
+  d->speed = dt_conf_get_int("plugins/imageio/format/webp/speed");
   return d;
 }
 
@@ -310,6 +345,7 @@ int set_params(dt_imageio_module_format_t *self, const void *params, const int s
   dt_bauhaus_combobox_set(g->compression, d->comp_type);
   dt_bauhaus_slider_set(g->quality, d->quality);
   dt_bauhaus_combobox_set(g->hint, d->hint);
+  dt_bauhaus_combobox_set(g->speed, d->speed);
   return 0;
 }
 
@@ -367,6 +403,12 @@ static void hint_combobox_changed(GtkWidget *widget, gpointer user_data)
   dt_conf_set_int("plugins/imageio/format/webp/hint", hint);
 }
 
+static void speed_combobox_changed(GtkWidget *widget, gpointer user_data)
+{
+  const int speed = dt_bauhaus_combobox_get(widget);
+  dt_conf_set_int("plugins/imageio/format/webp/speed", speed);
+}
+
 void gui_init(dt_imageio_module_format_t *self)
 {
   dt_imageio_webp_gui_data_t *gui = (dt_imageio_webp_gui_data_t *)malloc(sizeof(dt_imageio_webp_gui_data_t));
@@ -374,6 +416,7 @@ void gui_init(dt_imageio_module_format_t *self)
   const int comp_type = dt_conf_get_int("plugins/imageio/format/webp/comp_type");
   const int quality = dt_conf_get_int("plugins/imageio/format/webp/quality");
   const int hint = dt_conf_get_int("plugins/imageio/format/webp/hint");
+  const int speed = dt_conf_get_int("plugins/imageio/format/webp/speed");
 
   self->widget = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
 
@@ -417,6 +460,20 @@ void gui_init(dt_imageio_module_format_t *self)
   dt_bauhaus_combobox_set(gui->hint, hint);
   gtk_box_pack_start(GTK_BOX(self->widget), gui->hint, TRUE, TRUE, 0);
   g_signal_connect(G_OBJECT(gui->hint), "value-changed", G_CALLBACK(hint_combobox_changed), NULL);
+
+  gui->speed = dt_bauhaus_combobox_new(darktable.bauhaus, DT_GUI_MODULE(NULL));
+  dt_bauhaus_widget_set_label(gui->speed, N_("encoding speed"));
+  gtk_widget_set_tooltip_text(gui->speed,
+               _("trade-off between the encoding time and the file size.\n"
+               "fast     : quickest, larger files\n"
+               "balanced : the usual setting of the encoder\n"
+               "best     : slowest, smallest files"));
+  dt_bauhaus_combobox_add(gui->speed, _("fast"));
+  dt_bauhaus_combobox_add(gui->speed, _("balanced"));
+  dt_bauhaus_combobox_add(gui->speed, _("best"));
+  dt_bauhaus_combobox_set(gui->speed, speed);
+  gtk_box_pack_start(GTK_BOX(self->widget), gui->speed, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(gui->speed), "value-changed", G_CALLBACK(speed_combobox_changed), NULL);
 }
 
 void gui_cleanup(dt_imageio_module_format_t *self)
@@ -430,9 +487,11 @@ void gui_reset(dt_imageio_module_format_t *self)
   const int comp_type = dt_confgen_get_int("plugins/imageio/format/webp/comp_type", DT_DEFAULT);
   const int quality = dt_confgen_get_int("plugins/imageio/format/webp/quality", DT_DEFAULT);
   const int hint = dt_confgen_get_int("plugins/imageio/format/webp/hint", DT_DEFAULT);
+  const int speed = dt_confgen_get_int("plugins/imageio/format/webp/speed", DT_DEFAULT);
   dt_bauhaus_combobox_set(gui->compression, comp_type);
   dt_bauhaus_slider_set(gui->quality, quality);
   dt_bauhaus_combobox_set(gui->hint, hint);
+  dt_bauhaus_combobox_set(gui->speed, speed);
 }
 
 int flags(dt_imageio_module_data_t *data)
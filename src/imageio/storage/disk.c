@@ -336,6 +336,12 @@ try_again:
   return 0;
 }
 
+gboolean parallel_store(dt_imageio_module_storage_t *self)
+{
+  // file names are created under darktable.plugin_threadsafe, the rest only touches the image being exported
+  return TRUE;
+}
+
 size_t params_size(dt_imageio_module_storage_t *self)
 {
   return sizeof(dt_imageio_disk_t) - sizeof(void *);
@@ -55,16 +55,24 @@ typedef struct dt_imageio_gallery_t
   char title[1024];
   char cached_dirname[DT_MAX_PATH_FOR_PARAMS]; // expanded during first img store, not stored in param struct.
   dt_variables_params_t *vp;
-  GList *l;
+  GPtrArray *entries; // index entries of the exported images, by sequence number
 } dt_imageio_gallery_t;
 
-// sorted list of all images
-typedef struct pair_t
+// what the index needs of one image
+typedef struct gallery_entry_t
 {
-  char line[4096];
-  char item[4096];
-  int pos;
-} pair_t;
+  gchar *line; // thumbnail in the page
+  gchar *item; // photoswipe slide
+} gallery_entry_t;
+
+static void _entry_free(gpointer data)
+{
+  gallery_entry_t *entry = (gallery_entry_t *)data;
+  if(!entry) return;
+  g_free(entry->line);
+  g_free(entry->item);
+  g_free(entry);
+}
 
 
 const char *name(const struct dt_imageio_module_storage_t *self)
@@ -204,11 +212,6 @@ void gui_reset(dt_imageio_module_storage_t *self)
   dt_conf_set_string("plugins/imageio/storage/gallery/title", gtk_entry_get_text(d->title_entry));
 }
 
-static gint sort_pos(pair_t *a, pair_t *b)
-{
-  return a->pos - b->pos;
-}
-
 int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, const int32_t imgid,
           dt_imageio_module_format_t *format, dt_imageio_module_data_t *fdata, const int num, const int total,
           const gboolean high_quality, const gboolean export_masks,
@@ -224,6 +227,9 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
 
   char tmp_dir[PATH_MAX] = { 0 };
 
+  // we're potentially called in parallel: the pattern, the variables and the index are shared
+  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
+
   // set variable values to expand them afterwards in darktable variables
   dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
 
@@ -265,6 +271,7 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   if(*c == '/') *c = '\0';
   if(g_mkdir_with_parents(dirname, 0755))
   {
+    dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
     fprintf(stderr, "[imageio_storage_gallery] could not create directory: `%s'!\n", dirname);
     dt_control_log(_("could not create directory `%s'!"), dirname);
     return 1;
@@ -272,6 +279,7 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
 
   // store away dir.
   g_strlcpy(d->cached_dirname, dirname, sizeof(d->cached_dirname));
+  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
 
   c = filename + strlen(filename);
   for(; c > filename && *c != '.' && *c != '/'; c--)
@@ -280,9 +288,6 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
 
   sprintf(c, ".%s", ext);
 
-  // save image to list, in order:
-  pair_t *pair = malloc(sizeof(pair_t));
-
   char *title = NULL, *description = NULL;
   GList *res_title = NULL, *res_desc = NULL;
 
@@ -315,58 +320,53 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   if(c <= relthumbfilename) c = relthumbfilename + strlen(relthumbfilename);
   sprintf(c, "-thumb.%s", ext);
 
-  char subfilename[PATH_MAX] = { 0 }, relsubfilename[PATH_MAX] = { 0 };
-  g_strlcpy(subfilename, d->cached_dirname, sizeof(subfilename));
-  char *sc = subfilename + strlen(subfilename);
-  sprintf(sc, "/img_%d.html", num);
-  snprintf(relsubfilename, sizeof(relsubfilename), "img_%d.html", num);
-
   // escape special character and especially " which is used in <img> and below in src and msrc
 
   gchar *esc_relfilename = g_strescape(relfilename, NULL);
   gchar *esc_relthumbfilename = g_strescape(relthumbfilename, NULL);
 
-  snprintf(pair->line, sizeof(pair->line),
-           "\n"
-           "      <div><div class=\"dia\">\n"
-           "      <img src=\"%s\" alt=\"img%d\" class=\"img\" onclick=\"openSwipe(%d)\"/></div>\n"
-           "      <h1>%s</h1>\n"
-           "      %s</div>\n",
-           esc_relthumbfilename,
-           num, num-1, title ? title : "&nbsp;", description ? description : "&nbsp;");
+  gallery_entry_t *entry = g_malloc0(sizeof(gallery_entry_t));
+  entry->line = g_strdup_printf("\n"
+                                "      <div><div class=\"dia\">\n"
+                                "      <img src=\"%s\" alt=\"img%d\" class=\"img\" onclick=\"openSwipe(%d)\"/></div>\n"
+                                "      <h1>%s</h1>\n"
+                                "      %s</div>\n",
+                                esc_relthumbfilename,
+                                num, num-1, title ? title : "&nbsp;", description ? description : "&nbsp;");
 
   if(res_title) g_list_free_full(res_title, &g_free);
   if(res_desc) g_list_free_full(res_desc, &g_free);
 
+  // the thumbnail is resampled from the output of that export, unless the export job already
+  // derives several sizes of each image from a single pipe run
+  const gboolean own_session = !dt_imageio_export_session_active();
+  if(own_session) dt_imageio_export_session_begin(fdata->max_width, fdata->max_height);
+
   // export image to file. need this to be able to access meaningful
   // fdata->width and height below.
   if(dt_imageio_export(imgid, filename, format, fdata, TRUE, TRUE, export_masks, icc_type,
                        icc_filename, icc_intent, self, sdata, num, total, metadata) != 0)
   {
+    if(own_session) dt_imageio_export_session_end();
     fprintf(stderr, "[imageio_storage_gallery] could not export to file: `%s'!\n", filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
-    free(pair);
+    _entry_free(entry);
     g_free(esc_relfilename);
     g_free(esc_relthumbfilename);
     return 1;
   }
 
-  snprintf(pair->item, sizeof(pair->item),
-           "{\n"
-           "src: \"%s\",\n"
-           "w: %d,\n"
-           "h: %d,\n"
-           "msrc: \"%s\",\n"
-           "},\n",
-           esc_relfilename, fdata->width, fdata->height, esc_relthumbfilename);
+  entry->item = g_strdup_printf("{\n"
+                                "src: \"%s\",\n"
+                                "w: %d,\n"
+                                "h: %d,\n"
+                                "msrc: \"%s\",\n"
+                                "},\n",
+                                esc_relfilename, fdata->width, fdata->height, esc_relthumbfilename);
 
   g_free(esc_relfilename);
   g_free(esc_relthumbfilename);
 
-  pair->pos = num;
-  d->l = g_list_insert_sorted(d->l, pair, (GCompareFunc)sort_pos);
-  free(pair);
-
   /* also export thumbnail: */
   // write with reduced resolution:
   const int save_max_width = fdata->max_width;
@@ -380,16 +380,28 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   if(c <= filename || *c == '/') c = filename + strlen(filename);
   ext = format->extension(fdata);
   sprintf(c, "-thumb.%s", ext);
-  if(dt_imageio_export(imgid, filename, format, fdata, FALSE, FALSE, export_masks, icc_type, icc_filename,
-                       icc_intent, self, sdata, num, total, NULL) != 0)
+  const int thumb_res = dt_imageio_export(imgid, filename, format, fdata, TRUE, FALSE, FALSE, icc_type,
+                                          icc_filename, icc_intent, self, sdata, num, total, NULL);
+  // restore for next image:
+  fdata->max_width = save_max_width;
+  fdata->max_height = save_max_height;
+  if(own_session) dt_imageio_export_session_end();
+
+  if(thumb_res != 0)
   {
     fprintf(stderr, "[imageio_storage_gallery] could not export to file: `%s'!\n", filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
+    _entry_free(entry);
     return 1;
   }
-  // restore for next image:
-  fdata->max_width = save_max_width;
-  fdata->max_height = save_max_height;
+
+  // the index gets its entries in sequence order, whatever order the images are done in
+  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
+  if(!d->entries) d->entries = g_ptr_array_new_with_free_func(_entry_free);
+  if(d->entries->len < (guint)num) g_ptr_array_set_size(d->entries, MAX(num, total));
+  _entry_free(g_ptr_array_index(d->entries, num - 1));
+  g_ptr_array_index(d->entries, num - 1) = entry;
+  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
 
   printf("[export_job] exported to `%s'\n", filename);
   dt_control_log(ngettext("%d/%d exported to `%s'", "%d/%d exported to `%s'", num),
@@ -397,6 +409,12 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   return 0;
 }
 
+gboolean parallel_store(dt_imageio_module_storage_t *self)
+{
+  // file names and the index are handled under darktable.plugin_threadsafe
+  return TRUE;
+}
+
 void finalize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *dd)
 {
   dt_imageio_gallery_t *d = (dt_imageio_gallery_t *)dd;
@@ -460,10 +478,11 @@ void finalize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t
           title, title);
 
   size_t count = 0;
-  for(GList *tmp = d->l; tmp; tmp = g_list_next(tmp))
+  for(guint k = 0; d->entries && k < d->entries->len; k++)
   {
-    pair_t *p = (pair_t *)tmp->data;
-    fprintf(f, "%s", p->line);
+    const gallery_entry_t *entry = (gallery_entry_t *)g_ptr_array_index(d->entries, k);
+    if(!entry) continue;
+    fprintf(f, "%s", entry->line);
     count++;
   }
 
@@ -517,12 +536,10 @@ void finalize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t
              "var items = [\n",
           count,
           darktable_package_string);
-  while(d->l)
+  for(guint k = 0; d->entries && k < d->entries->len; k++)
   {
-    pair_t *p = (pair_t *)d->l->data;
-    fprintf(f, "%s", p->item);
-    free(p);
-    d->l = g_list_delete_link(d->l, d->l);
+    const gallery_entry_t *entry = (gallery_entry_t *)g_ptr_array_index(d->entries, k);
+    if(entry) fprintf(f, "%s", entry->item);
   }
   fprintf(f, "];\n"
              "function openSwipe(img)\n"
@@ -538,6 +555,8 @@ void finalize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t
              "</script>\n"
              "</html>\n");
   fclose(f);
+  if(d->entries) g_ptr_array_free(d->entries, TRUE);
+  d->entries = NULL;
 }
 
 size_t params_size(dt_imageio_module_storage_t *self)
@@ -558,7 +577,7 @@ void *get_params(dt_imageio_module_storage_t *self)
 {
   dt_imageio_gallery_t *d = (dt_imageio_gallery_t *)calloc(1, sizeof(dt_imageio_gallery_t));
   d->vp = NULL;
-  d->l = NULL;
+  d->entries = NULL;
   dt_variables_params_init(&d->vp);
 
   const char *text = dt_conf_get_string_const("plugins/imageio/storage/gallery/file_directory");
@@ -575,6 +594,7 @@ void free_params(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *pa
   if(!params) return;
   dt_imageio_gallery_t *d = (dt_imageio_gallery_t *)params;
   dt_variables_params_destroy(d->vp);
+  if(d->entries) g_ptr_array_free(d->entries, TRUE);
   free(params);
 }
 
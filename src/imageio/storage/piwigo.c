@@ -45,6 +45,12 @@ DT_MODULE(1)
 
 #define MAX_ALBUM_NAME_SIZE 100
 
+// uploads sent at once while the next images are exported
+#define PIWIGO_UPLOADS_IN_FLIGHT 3
+// attempts per image before giving up, waiting a bit longer after each failure
+#define PIWIGO_UPLOAD_ATTEMPTS 4
+#define PIWIGO_UPLOAD_RETRY_DELAY G_USEC_PER_SEC
+
 typedef struct _piwigo_api_context_t
 {
   /// curl context
@@ -100,9 +106,37 @@ typedef struct _curl_args_t
   char value[512];
 } _curl_args_t;
 
+typedef struct _piwigo_upload_t
+{
+  CURL *curl;
+  curl_mime *form;
+  GString *response;
+  GList *args;      // _curl_args_t
+  gchar *filename;  // temporary export, removed once sent
+  int num, total;   // position in the export, for the user feedback
+  int attempts;
+  gint64 due;       // monotonic time of the next attempt after a failure
+} _piwigo_upload_t;
+
+/* Sends the exported files in a thread of its own, several at once through a curl multi handle,
+ * while the export job renders the next images. */
+typedef struct _piwigo_uploader_t
+{
+  GAsyncQueue *queue; // _piwigo_upload_t to send, the uploader itself being the end marker
+  GThread *thread;
+  gchar *url;
+  gchar *cookie_file;
+
+  // owned by the upload thread until it is joined
+  int sent, failed;
+  curl_off_t bytes;
+  double start;
+} _piwigo_uploader_t;
+
 typedef struct dt_storage_piwigo_params_t
 {
   _piwigo_api_context_t *api;
+  _piwigo_uploader_t *uploader;
   int64_t album_id;
   int64_t parent_album_id;
   char *album;
@@ -273,6 +307,27 @@ static void _piwigo_set_status(dt_storage_piwigo_gui_data_t *ui, gchar *message,
   gtk_widget_set_tooltip_markup(GTK_WIDGET(ui->status_label), mup);
 }
 
+static curl_mime *_piwigo_mime_form(CURL *curl, GList *args, const char *filename)
+{
+  curl_mimepart *field = NULL;
+
+  curl_mime *form = curl_mime_init(curl);
+
+  for(const GList *a = args; a; a = g_list_next(a))
+  {
+    _curl_args_t *ca = (_curl_args_t *)a->data;
+    field = curl_mime_addpart(form);
+    curl_mime_name(field, ca->name);
+    curl_mime_data(field, ca->value, CURL_ZERO_TERMINATED);
+  }
+
+  field = curl_mime_addpart(form);
+  curl_mime_name(field, "image");
+  curl_mime_filedata(field, filename);
+
+  return form;
+}
+
 static int _piwigo_api_post_internal(_piwigo_api_context_t *ctx, GList *args, char *filename, gboolean isauth)
 {
   curl_mime *form = NULL;
@@ -309,22 +364,7 @@ static int _piwigo_api_post_internal(_piwigo_api_context_t *ctx, GList *args, ch
 
   if(filename)
   {
-    curl_mimepart *field = NULL;
-
-    form = curl_mime_init(ctx->curl_ctx);
-
-    for(const GList *a = args; a; a = g_list_next(a))
-    {
-      _curl_args_t *ca = (_curl_args_t *)a->data;
-      field = curl_mime_addpart(form);
-      curl_mime_name(field, ca->name);
-      curl_mime_data(field, ca->value, CURL_ZERO_TERMINATED);
-    }
-
-    field = curl_mime_addpart(form);
-    curl_mime_name(field, "image");
-    curl_mime_filedata(field, filename);
-
+    form = _piwigo_mime_form(ctx->curl_ctx, args, filename);
     curl_easy_setopt(ctx->curl_ctx, CURLOPT_MIMEPOST, form);
   }
   else
@@ -705,15 +745,13 @@ static gboolean _piwigo_api_create_new_album(dt_storage_piwigo_params_t *p)
   return TRUE;
 }
 
-static gboolean _piwigo_api_upload_photo(dt_storage_piwigo_params_t *p, gchar *fname,
-                                         gchar *author, gchar *caption, gchar *description)
+static GList *_piwigo_upload_args(dt_storage_piwigo_params_t *p, gchar *fname,
+                                  gchar *author, gchar *caption, gchar *description)
 {
   GList *args = NULL;
   char cat[10];
   char privacy[10];
 
-  // upload picture
-
   snprintf(cat, sizeof(cat), "%"PRId64, p->album_id);
   snprintf(privacy, sizeof(privacy), "%d", p->privacy);
 
@@ -734,11 +772,180 @@ static gboolean _piwigo_api_upload_photo(dt_storage_piwigo_params_t *p, gchar *f
   if(p->tags && strlen(p->tags)>0)
     args = _piwigo_query_add_arguments(args, "tags", p->tags);
 
-  _piwigo_api_post(p->api, args, fname, FALSE);
+  return args;
+}
 
-  g_list_free(args);
+static void _piwigo_upload_free(_piwigo_upload_t *up)
+{
+  g_unlink(up->filename);
+  g_free(up->filename);
+  g_list_free_full(up->args, free);
+  if(up->form) curl_mime_free(up->form);
+  if(up->curl) curl_easy_cleanup(up->curl);
+  if(up->response) g_string_free(up->response, TRUE);
+  free(up);
+}
+
+static void _piwigo_upload_start(_piwigo_uploader_t *u, CURLM *multi, _piwigo_upload_t *up)
+{
+  if(!up->curl) up->curl = curl_easy_init();
+  if(!up->response) up->response = g_string_new("");
+  g_string_truncate(up->response, 0);
+
+  dt_curl_init(up->curl, piwigo_EXTRA_VERBOSE);
+  curl_easy_setopt(up->curl, CURLOPT_URL, u->url);
+  curl_easy_setopt(up->curl, CURLOPT_POST, 1);
+  curl_easy_setopt(up->curl, CURLOPT_WRITEFUNCTION, curl_write_data_cb);
+  curl_easy_setopt(up->curl, CURLOPT_WRITEDATA, up->response);
+  curl_easy_setopt(up->curl, CURLOPT_COOKIEFILE, u->cookie_file);
+  curl_easy_setopt(up->curl, CURLOPT_PRIVATE, up);
+
+  // the form reads the file as it goes, so a new attempt needs a new one
+  if(up->form) curl_mime_free(up->form);
+  up->form = _piwigo_mime_form(up->curl, up->args, up->filename);
+  curl_easy_setopt(up->curl, CURLOPT_MIMEPOST, up->form);
+
+  curl_multi_add_handle(multi, up->curl);
+}
+
+static gboolean _piwigo_upload_succeeded(_piwigo_upload_t *up, const CURLcode res, JsonParser *parser)
+{
+  if(res != CURLE_OK)
+  {
+    fprintf(stderr, "[imageio_storage_piwigo] upload of `%s' failed: %s\n", up->filename, curl_easy_strerror(res));
+    return FALSE;
+  }
+
+  if(!json_parser_load_from_data(parser, up->response->str, up->response->len, NULL)) return FALSE;
+  JsonNode *root = json_parser_get_root(parser);
+  if(json_node_get_node_type(root) != JSON_NODE_OBJECT) return FALSE;
+  const char *status = json_object_get_string_member(json_node_get_object(root), "stat");
+  return status && strcmp(status, "fail") != 0;
+}
+
+static gpointer _piwigo_uploader_run(gpointer data)
+{
+  _piwigo_uploader_t *u = (_piwigo_uploader_t *)data;
+  CURLM *multi = curl_multi_init();
+  JsonParser *parser = json_parser_new();
+  GQueue waiting = G_QUEUE_INIT; // failed uploads, by due time of their next attempt
+  int in_flight = 0;
+  gboolean done = FALSE;
+
+  while(!done || in_flight || !g_queue_is_empty(&waiting))
+  {
+    const gint64 now = g_get_monotonic_time();
+
+    while(!g_queue_is_empty(&waiting) && in_flight < PIWIGO_UPLOADS_IN_FLIGHT
+          && ((_piwigo_upload_t *)g_queue_peek_head(&waiting))->due <= now)
+    {
+      _piwigo_upload_start(u, multi, g_queue_pop_head(&waiting));
+      in_flight++;
+    }
+
+    // block for the next file only when there is nothing else to do
+    while(!done && in_flight < PIWIGO_UPLOADS_IN_FLIGHT)
+    {
+      gpointer item = (in_flight || !g_queue_is_empty(&waiting)) ? g_async_queue_try_pop(u->queue)
+                                                                 : g_async_queue_pop(u->queue);
+      if(!item) break;
+      if(item == u)
+      {
+        done = TRUE;
+        break;
+      }
+      _piwigo_upload_start(u, multi, (_piwigo_upload_t *)item);
+      in_flight++;
+    }
+
+    int running = 0;
+    curl_multi_perform(multi, &running);
+
+    CURLMsg *msg = NULL;
+    int left = 0;
+    while((msg = curl_multi_info_read(multi, &left)))
+    {
+      if(msg->msg != CURLMSG_DONE) continue;
+
+      _piwigo_upload_t *up = NULL;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&up);
+      const CURLcode res = msg->data.result;
+      curl_multi_remove_handle(multi, msg->easy_handle);
+      in_flight--;
+
+      if(_piwigo_upload_succeeded(up, res, parser))
+      {
+        curl_off_t size = 0;
+        curl_easy_getinfo(up->curl, CURLINFO_SIZE_UPLOAD_T, &size);
+        u->bytes += size;
+        u->sent++;
+        dt_control_log(ngettext("%d/%d exported to piwigo webalbum", "%d/%d exported to piwigo webalbum", up->num),
+                       up->num, up->total);
+        _piwigo_upload_free(up);
+      }
+      else if(++up->attempts < PIWIGO_UPLOAD_ATTEMPTS)
+      {
+        up->due = g_get_monotonic_time() + up->attempts * PIWIGO_UPLOAD_RETRY_DELAY;
+        g_queue_push_tail(&waiting, up);
+      }
+      else
+      {
+        fprintf(stderr, "[imageio_storage_piwigo] could not upload `%s' to piwigo!\n", up->filename);
+        dt_control_log(_("could not upload to piwigo!"));
+        u->failed++;
+        _piwigo_upload_free(up);
+      }
+    }
 
-  return !p->api->error_occured;
+    if(in_flight)
+      curl_multi_wait(multi, NULL, 0, 100, NULL);
+    else if(!g_queue_is_empty(&waiting))
+      g_usleep(G_USEC_PER_SEC / 20);
+  }
+
+  g_object_unref(parser);
+  curl_multi_cleanup(multi);
+  return NULL;
+}
+
+static _piwigo_uploader_t *_piwigo_uploader_new(_piwigo_api_context_t *ctx)
+{
+  // the upload handles read the session cookie from the file, write it now
+  dt_curl_init(ctx->curl_ctx, piwigo_EXTRA_VERBOSE);
+  curl_easy_setopt(ctx->curl_ctx, CURLOPT_COOKIEJAR, ctx->cookie_file);
+  curl_easy_setopt(ctx->curl_ctx, CURLOPT_COOKIELIST, "FLUSH");
+
+  _piwigo_uploader_t *u = g_malloc0(sizeof(_piwigo_uploader_t));
+  u->url = g_strdup(ctx->url);
+  u->cookie_file = g_strdup(ctx->cookie_file);
+  u->queue = g_async_queue_new();
+  u->start = dt_get_wtime();
+  u->thread = g_thread_new("piwigo_upload", _piwigo_uploader_run, u);
+  return u;
+}
+
+// waits for the pending uploads to be done
+static void _piwigo_uploader_finish(_piwigo_uploader_t **uploader)
+{
+  _piwigo_uploader_t *u = *uploader;
+  if(!u) return;
+
+  g_async_queue_push(u->queue, u);
+  g_thread_join(u->thread);
+
+  const double seconds = dt_get_wtime() - u->start;
+  if(u->sent && seconds > 0.0)
+    dt_control_log(ngettext("%d image uploaded to piwigo at %.1f MB/s", "%d images uploaded to piwigo at %.1f MB/s",
+                            u->sent),
+                   u->sent, (double)u->bytes / seconds / 1e6);
+  dt_print(DT_DEBUG_CONTROL, "[imageio_storage_piwigo] %d uploaded, %d failed, %" CURL_FORMAT_CURL_OFF_T
+           " bytes in %.2f s\n", u->sent, u->failed, u->bytes, seconds);
+
+  g_async_queue_unref(u->queue);
+  g_free(u->url);
+  g_free(u->cookie_file);
+  g_free(u);
+  *uploader = NULL;
 }
 
 // Login button pressed...
@@ -948,6 +1155,9 @@ static gboolean _finalize_store(gpointer user_data)
 
 void finalize_store(struct dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data)
 {
+  dt_storage_piwigo_params_t *p = (dt_storage_piwigo_params_t *)data;
+  if(p) _piwigo_uploader_finish(&p->uploader);
+
   g_main_context_invoke(NULL, _finalize_store, self->gui_data);
 }
 
@@ -960,6 +1170,7 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   dt_storage_piwigo_gui_data_t *ui = self->gui_data;
 
   gint result = 0;
+  gboolean queued = FALSE;
 
   const char *ext = format->extension(fdata);
 
@@ -1044,20 +1255,25 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
 
     if(status)
     {
-      status = _piwigo_api_upload_photo(p, fname, author, caption, description);
-      if(!status)
-      {
-        fprintf(stderr, "[imageio_storage_piwigo] could not upload to piwigo!\n");
-        dt_control_log(_("could not upload to piwigo!"));
-        result = 1;
-      }
-      else if(p->new_album)
+      if(p->new_album)
       {
         // we do not want to create more albums when multiple upload
         p->new_album = FALSE;
         _piwigo_refresh_albums(ui, p->album);
       }
+
+      // the upload thread owns the file from now on
+      if(!p->uploader) p->uploader = _piwigo_uploader_new(p->api);
+      _piwigo_upload_t *up = calloc(1, sizeof(_piwigo_upload_t));
+      up->args = _piwigo_upload_args(p, fname, author, caption, description);
+      up->filename = g_strdup(fname);
+      up->num = num;
+      up->total = total;
+      g_async_queue_push(p->uploader->queue, up);
+      queued = TRUE;
     }
+    else
+      result = 1;
     if(p->tags)
     {
       g_free(p->tags);
@@ -1069,17 +1285,11 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
 cleanup:
 
   // And remove from filesystem..
-  g_unlink(fname);
+  if(!queued) g_unlink(fname);
   g_free(caption);
   g_free(description);
   g_free(author);
 
-  if(!result)
-  {
-    // this makes sense only if the export was successful
-    dt_control_log(ngettext("%d/%d exported to piwigo webalbum", "%d/%d exported to piwigo webalbum", num),
-                   num, total);
-  }
   return result;
 }
 
@@ -1221,6 +1431,7 @@ void free_params(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *pa
 
   if(p)
   {
+    _piwigo_uploader_finish(&p->uploader);
     g_free(p->album);
     g_free(p->tags);
     _piwigo_ctx_destroy(&p->api);
@@ -62,7 +62,8 @@ public:
     Key(const Key &origin, int dim, int direction) // construct neighbor in dimension 'dim'
     {
       for(int i = 0; i < KD; i++) key[i] = origin.key[i] + direction;
-      key[dim] = origin.key[dim] - direction * KD;
+      // the last coordinate is implicit, see PermutohedralLattice::splat()
+      if(dim < KD) key[dim] = origin.key[dim] - direction * KD;
       setHash();
     }
 
@@ -233,28 +234,28 @@ public:
    */
   int lookupOffset(const Key &key, bool create = true)
   {
+    // Double hash table size if necessary, before probing so the slot found stays valid
+    if(create && filled >= maxFill()) grow();
+
     size_t h = key.hash & capacity_bits;
     // Find the entry with the given key
     while(1)
     {
-      Entry e = entries[h];
+      const Entry e = entries[h];
       // check if the cell is empty
       if(e.keyIdx == -1)
       {
         if(!create) return -1; // Return not found.
-        // Double hash table size if necessary
-        if(filled >= maxFill())
-        {
-          grow();
-        }
         // need to create an entry. Store the given key.
         keys[filled] = key;
         entries[h].keyIdx = filled;
+        entries[h].hash = key.hash;
         return filled++;
       }
 
-      // check if the cell has a matching key
-      if(keys[e.keyIdx] == key) return e.keyIdx;
+      // check if the cell has a matching key. The hash is stored in the cell so
+      // the probing only reads the keys array on a likely match.
+      if(e.hash == key.hash && keys[e.keyIdx] == key) return e.keyIdx;
 
       // increment the bucket with wraparound
       h = (h + 1) & capacity_bits;
@@ -299,7 +300,7 @@ public:
     for(size_t i = 0; i < oldCapacity; i++)
     {
       if(entries[i].keyIdx == -1) continue;
-      size_t h = keys[entries[i].keyIdx].hash & capacity_bits;
+      size_t h = entries[i].hash & capacity_bits;
       while(newEntries[h].keyIdx != -1)
       {
         h = (h + 1) & capacity_bits;
@@ -311,10 +312,11 @@ public:
   }
 
 private:
-  // Private struct for the hash table entries.
+  // Private struct for the hash table entries: 8 bytes, so a cache line holds 8 probes.
   struct Entry
   {
     int keyIdx{ -1 };
+    unsigned hash{ 0 };
   };
 
   Key *keys;
@@ -387,6 +389,7 @@ public:
     scaleFactor = scaleFactorTmp;
 
     hashTables = new HashTable[nThreads];
+    caches = new SplatCache[nThreads];
   }
 
   PermutohedralLattice(const PermutohedralLattice &) = delete;
@@ -397,6 +400,7 @@ public:
     delete[] replay;
     delete[] canonical;
     delete[] hashTables;
+    delete[] caches;
   }
 
   PermutohedralLattice &operator=(const PermutohedralLattice &) = delete;
@@ -489,6 +493,7 @@ public:
 
     // Splat the value into each vertex of the simplex, with barycentric weights.
     replay[replay_index].table = thread_index;
+    SplatCache &cache = caches[thread_index];
     for(int remainder = 0; remainder <= D; remainder++)
     {
       // Compute the location of the lattice point explicitly (all but the last coordinate - it's redundant
@@ -496,14 +501,21 @@ public:
       for(int i = 0; i < D; i++) key.key[i] = greedy[i] + canonical[remainder * (D + 1) + rank[i]];
       key.setHash();
 
-      // Retrieve pointer to the value at this vertex.
-      Value *val = hashTables[thread_index].lookup(key, true);
+      // Retrieve the offset of the value at this vertex. Neighbouring pixels mostly fall in the
+      // same simplex, so check the last one splatted by this thread before hashing.
+      int offset = cache.offset[remainder];
+      if(offset < 0 || !(cache.key[remainder] == key))
+      {
+        offset = hashTables[thread_index].lookupOffset(key, true);
+        cache.key[remainder] = key;
+        cache.offset[remainder] = offset;
+      }
 
       // Accumulate values with barycentric weight.
-      val->add(value, barycentric[remainder]);
+      hashTables[thread_index].getValues()[offset].add(value, barycentric[remainder]);
 
       // Record this interaction to use later when slicing
-      replay[replay_index].offset[remainder] = val - hashTables[thread_index].getValues();
+      replay[replay_index].offset[remainder] = offset;
       replay[replay_index].weight[remainder] = barycentric[remainder];
     }
   }
@@ -544,12 +556,19 @@ public:
     }
 
     /* Rewrite the offsets in the replay structure from the above generated table. */
-    for(int i = 0; i < nData; i++)
+    ReplayEntry *const entries = replay;
+    const int n = nData;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(offset_remap, entries, n) \
+    schedule(static)
+#endif
+    for(int i = 0; i < n; i++)
     {
-      if(replay[i].table > 0)
+      if(entries[i].table > 0)
       {
         for(int dim = 0; dim <= D; dim++)
-          replay[i].offset[dim] = offset_remap[replay[i].table][replay[i].offset[dim]];
+          entries[i].offset[dim] = offset_remap[entries[i].table][entries[i].offset[dim]];
       }
     }
 
@@ -575,52 +594,60 @@ public:
   /* Performs a Gaussian blur along each projected axis in the hyperplane. */
   void blur() const
   {
-    // Prepare arrays
-    Value *newValue = new Value[hashTables[0].size()];
-    Value *oldValue = hashTables[0].getValues();
-    const Value *hashTableBase = oldValue;
+    const int size = hashTables[0].size();
+
+    // Prepare arrays. The extra value past the end stands for the missing neighbours.
+    Value *newValue = new Value[size + 1];
+    Value *oldValue = new Value[size + 1];
+    std::copy(hashTables[0].getValues(), hashTables[0].getValues() + size, oldValue);
+    oldValue[size] = Value{ 0 };
+    newValue[size] = Value{ 0 };
     const Key *keyBase = hashTables[0].getKeys();
-    const Value zero{ 0 };
+    const Value *hashTableBase = hashTables[0].getValues();
+    HashTable *table = hashTables;
+
+    int *neighbours1 = new int[size];
+    int *neighbours2 = new int[size];
 
     // For each of d+1 axes,
     for(int j = 0; j <= D; j++)
     {
+      // find the neighbours of each vertex along the axis. This is the part doing the random
+      // accesses, keep it away from the arithmetic below.
 #ifdef _OPENMP
-#pragma omp parallel for shared(j, oldValue, newValue)
+#pragma omp parallel for default(none) \
+      dt_omp_firstprivate(size, keyBase, hashTableBase, table, neighbours1, neighbours2, j) \
+      schedule(static)
 #endif
-      // For each vertex in the lattice,
-      for(int i = 0; i < hashTables[0].size(); i++) // blur point i in dimension j
+      for(int i = 0; i < size; i++)
       {
         const Key &key = keyBase[i]; // keys to current vertex
         // construct keys to the neighbors along the given axis.
-        Key neighbor1(key, j, +1);
-        Key neighbor2(key, j, -1);
-
-        const Value *oldVal = oldValue + i;
-
-        const Value *vm1 = hashTables[0].lookup(neighbor1, false); // look up first neighbor
-        vm1 = vm1 ? vm1 - hashTableBase + oldValue : &zero;
+        const Value *vm1 = table->lookup(Key(key, j, +1), false);
+        const Value *vp1 = table->lookup(Key(key, j, -1), false);
+        neighbours1[i] = vm1 ? vm1 - hashTableBase : size;
+        neighbours2[i] = vp1 ? vp1 - hashTableBase : size;
+      }
 
-        const Value *vp1 = hashTables[0].lookup(neighbor2, false); // look up second neighbor
-        vp1 = vp1 ? vp1 - hashTableBase + oldValue : &zero;
+      // Mix values of the three vertices, one whole value vector at a time
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+      dt_omp_firstprivate(size, oldValue, newValue, neighbours1, neighbours2) \
+      schedule(static)
+#endif
+      for(int i = 0; i < size; i++)
+        newValue[i].mix(oldValue + neighbours1[i], oldValue + i, oldValue + neighbours2[i]);
 
-        // Mix values of the three vertices
-        newValue[i].mix(vm1, oldVal, vp1);
-      }
       std::swap(newValue, oldValue);
       // the freshest data is now in oldValue, and newValue is ready to be written over
     }
 
-    // depending where we ended up, we may have to copy data
-    if(oldValue != hashTableBase)
-    {
-      std::copy(oldValue, oldValue + hashTables[0].size(), hashTables[0].getValues());
-      delete[] oldValue;
-    }
-    else
-    {
-      delete[] newValue;
-    }
+    std::copy(oldValue, oldValue + size, hashTables[0].getValues());
+
+    delete[] neighbours1;
+    delete[] neighbours2;
+    delete[] oldValue;
+    delete[] newValue;
   }
 
 private:
@@ -640,6 +667,18 @@ private:
   } * replay;
 
   HashTable *hashTables;
+
+  // the vertices of the last simplex splatted by each thread, on their own cache line
+  struct alignas(64) SplatCache
+  {
+    Key key[D + 1];
+    int offset[D + 1];
+
+    SplatCache()
+    {
+      for(int i = 0; i <= D; i++) offset[i] = -1;
+    }
+  } * caches;
 };
 
 // clang-format off
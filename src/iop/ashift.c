@@ -72,6 +72,9 @@
 #define LSD_DENSITY_TH 0.7                  // LSD: minimal density of region points in rectangle
 #define LSD_N_BINS 1024                     // LSD: number of bins in pseudo-ordering of gradient modulus
 #define LSD_GAMMA 0.45                      // gamma correction to apply on raw images prior to line detection
+#define LSD_PYRAMID_PIXELS 2000000          // LSD: halve the image until it has less pixels, then refine the lines found
+#define LSD_REFINE_SAMPLES 32               // LSD: points sampled along a coarse line to refine it
+#define LSD_REFINE_RADIUS 9                 // LSD: max distance in pixels searched across a coarse line
 #define RANSAC_RUNS 400                     // how many iterations to run in ransac
 #define RANSAC_EPSILON 2                    // starting value for ransac epsilon (in -log10 units)
 #define RANSAC_EPSILON_STEP 1               // step size of epsilon optimization (log10 units)
@@ -83,6 +86,8 @@
 #define NMS_EPSILON 1e-3                    // break criterion for Nelder-Mead simplex
 #define NMS_SCALE 1.0                       // scaling factor for Nelder-Mead simplex
 #define NMS_ITERATIONS 400                  // number of iterations for Nelder-Mead simplex
+#define NMS_MAX_STARTS 16                   // max number of starting points of the Nelder-Mead simplex, run in parallel
+#define NMS_START_SPREAD 1.0                // distance of the other starting points, in logit units
 #define NMS_CROP_EPSILON 100.0              // break criterion for Nelder-Mead simplex on crop fitting
 #define NMS_CROP_SCALE 0.5                  // scaling factor for Nelder-Mead simplex on crop fitting
 #define NMS_CROP_ITERATIONS 100             // number of iterations for Nelder-Mead simplex on crop fitting
@@ -242,6 +247,13 @@ typedef enum dt_iop_ashift_nmsresult_t
   NMS_INSANE = 3
 } dt_iop_ashift_nmsresult_t;
 
+typedef enum dt_iop_ashift_fit_job_state_t
+{
+  ASHIFT_FIT_JOB_NONE = 0,    // no fit job
+  ASHIFT_FIT_JOB_RUNNING = 1, // a fit job is queued or running, it owns the structural data
+  ASHIFT_FIT_JOB_DONE = 2     // the fit job left its results for the gui thread
+} dt_iop_ashift_fit_job_state_t;
+
 typedef enum dt_iop_ashift_enhance_t
 {
   ASHIFT_ENHANCE_NONE       = 0,
@@ -486,6 +498,14 @@ typedef struct dt_iop_ashift_gui_data_t
   dt_iop_ashift_jobcode_t jobcode;
   int jobparams;
 
+  // the background fit, see do_fit()
+  dt_iop_ashift_fit_job_state_t fit_job_state;
+  dt_job_t *fit_job;          // only valid while fit_job_state is ASHIFT_FIT_JOB_RUNNING
+  gboolean fit_job_structure; // new structural data were collected
+  gboolean fit_job_failed;    // no structural data, the reason is logged already
+  dt_iop_ashift_nmsresult_t fit_job_result;
+  dt_iop_ashift_params_t fit_job_params;
+
   dt_iop_ashift_method_t current_structure_method;
   int draw_near_point;
   gboolean draw_point_move;
@@ -1427,6 +1447,174 @@ static void gamma_correct(const float *const in, float *const out, const int wid
   }
 }
 
+// 2x2 box downsampling of the greyscale image, for the coarse levels of line detection
+static double *_grey_downsample(const double *const in, const int width, const int height, int *const dwidth,
+                                int *const dheight)
+{
+  const int w = width / 2;
+  const int h = height / 2;
+  double *const out = malloc(sizeof(double) * w * h);
+  if(out == NULL) return NULL;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(h, w, width) \
+  dt_omp_sharedconst(in, out) \
+  schedule(static)
+#endif
+  for(int j = 0; j < h; j++)
+    for(int i = 0; i < w; i++)
+    {
+      const double *const p = in + (size_t)2 * j * width + 2 * i;
+      out[(size_t)j * w + i] = 0.25 * (p[0] + p[1] + p[width] + p[width + 1]);
+    }
+
+  *dwidth = w;
+  *dheight = h;
+  return out;
+}
+
+// move a line found on a coarser level of the pyramid onto the strongest gradient across it in the
+// full resolution greyscale image: sample the edge at a few points along the line and fit a line
+// through them. The end points are projected onto the fitted line.
+// Returns FALSE if there isn't enough support for the line, and leaves it untouched then.
+static int _refine_line(const double *const grey, const int width, const int height, const int radius,
+                        double *const line)
+{
+  const double x1 = line[0], y1 = line[1], x2 = line[2], y2 = line[3];
+  const double length = sqrt(SQR(x2 - x1) + SQR(y2 - y1));
+  if(length < 1.0) return FALSE;
+
+  // unit vectors along and across the line
+  const double dx = (x2 - x1) / length, dy = (y2 - y1) / length;
+  const double nx = -dy, ny = dx;
+
+  double px[LSD_REFINE_SAMPLES], py[LSD_REFINE_SAMPLES];
+  int samples = 0;
+
+  for(int k = 0; k < LSD_REFINE_SAMPLES; k++)
+  {
+    const double t = (k + 0.5) / LSD_REFINE_SAMPLES;
+    const double cx = x1 + t * (x2 - x1), cy = y1 + t * (y2 - y1);
+
+    // gradient across the line, at whole pixel steps
+    double grad[2 * LSD_REFINE_RADIUS + 1];
+    int inside = TRUE;
+    for(int o = -radius; o <= radius; o++)
+    {
+      const int x = (int)lround(cx + o * nx), y = (int)lround(cy + o * ny);
+      if(x < 1 || y < 1 || x >= width - 1 || y >= height - 1)
+      {
+        inside = FALSE;
+        break;
+      }
+      const double *const p = grey + (size_t)y * width + x;
+      grad[o + radius] = fabs((p[1] - p[-1]) * nx + (p[width] - p[-width]) * ny);
+    }
+    if(!inside) continue;
+
+    // the maximum needs to lie inside the search window to be an edge
+    int m = 1;
+    for(int o = 2; o < 2 * radius; o++)
+      if(grad[o] > grad[m]) m = o;
+    if(grad[m] <= grad[m - 1] || grad[m] <= grad[m + 1]) continue;
+
+    // parabolic interpolation of the position of the maximum
+    const double offset = m - radius + 0.5 * (grad[m - 1] - grad[m + 1]) / (grad[m - 1] - 2.0 * grad[m] + grad[m + 1]);
+    px[samples] = cx + offset * nx;
+    py[samples] = cy + offset * ny;
+    samples++;
+  }
+
+  if(samples < LSD_REFINE_SAMPLES / 2) return FALSE;
+
+  // orthogonal least squares line through the samples
+  double mx = 0.0, my = 0.0;
+  for(int k = 0; k < samples; k++)
+  {
+    mx += px[k];
+    my += py[k];
+  }
+  mx /= samples;
+  my /= samples;
+
+  double sxx = 0.0, syy = 0.0, sxy = 0.0;
+  for(int k = 0; k < samples; k++)
+  {
+    sxx += SQR(px[k] - mx);
+    syy += SQR(py[k] - my);
+    sxy += (px[k] - mx) * (py[k] - my);
+  }
+  const double theta = 0.5 * atan2(2.0 * sxy, sxx - syy);
+  double ux = cos(theta), uy = sin(theta);
+
+  // the fit may not turn the line by more than the search window allows
+  if(fabs(ux * nx + uy * ny) > 2.0 * radius / length) return FALSE;
+  if(ux * dx + uy * dy < 0.0)
+  {
+    ux = -ux;
+    uy = -uy;
+  }
+
+  const double t1 = (x1 - mx) * ux + (y1 - my) * uy;
+  const double t2 = (x2 - mx) * ux + (y2 - my) * uy;
+  line[0] = mx + t1 * ux;
+  line[1] = my + t1 * uy;
+  line[2] = mx + t2 * ux;
+  line[3] = my + t2 * uy;
+  return TRUE;
+}
+
+// run LSD on the smallest level of a pyramid of the greyscale image that has less than LSD_PYRAMID_PIXELS,
+// then bring the lines found back to full resolution and refine them there.
+// Same output as LineSegmentDetection().
+static double *_line_segment_detection_multiscale(int *lines_count, const double *const greyscale,
+                                                  const int width, const int height)
+{
+  const double *coarse = greyscale;
+  double *level = NULL;
+  int cwidth = width, cheight = height;
+  int factor = 1;
+
+  while((size_t)cwidth * cheight > LSD_PYRAMID_PIXELS && cwidth > 1 && cheight > 1)
+  {
+    double *const next = _grey_downsample(coarse, cwidth, cheight, &cwidth, &cheight);
+    free(level);
+    if(next == NULL) return NULL;
+    coarse = level = next;
+    factor *= 2;
+  }
+
+  double *const lines = LineSegmentDetection(lines_count, (double *)coarse, cwidth, cheight,
+                                             LSD_SCALE, LSD_SIGMA_SCALE, LSD_QUANT,
+                                             LSD_ANG_TH, LSD_LOG_EPS, LSD_DENSITY_TH,
+                                             LSD_N_BINS, NULL, NULL, NULL);
+  free(level);
+
+  if(factor == 1 || lines == NULL) return lines;
+
+  // pixel centers of the coarse level fall in the middle of factor x factor blocks
+  const double shift = 0.5 * (factor - 1);
+  const int radius = MIN(factor + 1, LSD_REFINE_RADIUS);
+  const int count = *lines_count;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(count, factor, height, radius, shift, width) \
+  dt_omp_sharedconst(greyscale, lines) \
+  schedule(dynamic)
+#endif
+  for(int n = 0; n < count; n++)
+  {
+    double *const line = lines + 7 * n;
+    for(int k = 0; k < 4; k++) line[k] = factor * line[k] + shift;
+    line[4] *= factor;
+    (void)_refine_line(greyscale, width, height, radius, line);
+  }
+
+  return lines;
+}
+
 // do actual line_detection based on LSD algorithm and return results according
 // to this module's conventions
 static int line_detect(float *in, const int width, const int height, const int x_off, const int y_off,
@@ -1472,10 +1660,8 @@ static int line_detect(float *in, const int width, const int height, const int x
   // it returns structural details as vector 'double lines[7 * lines_count]'
   int lines_count;
 
-  lsd_lines = LineSegmentDetection(&lines_count, greyscale, width, height,
-                                   LSD_SCALE, LSD_SIGMA_SCALE, LSD_QUANT,
-                                   LSD_ANG_TH, LSD_LOG_EPS, LSD_DENSITY_TH,
-                                   LSD_N_BINS, NULL, NULL, NULL);
+  lsd_lines = _line_segment_detection_multiscale(&lines_count, greyscale, width, height);
+  if(lsd_lines == NULL) goto error;
 
   // we count the lines that we really want to use
   int lct = 0;
@@ -2275,19 +2461,45 @@ static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_p
     return NMS_NOT_ENOUGH_LINES;
   }
 
-  // start the simplex fit
-  int iter = simplex(model_fitness, params, fit.params_count, NMS_EPSILON, NMS_SCALE, NMS_ITERATIONS, NULL, (void*)&fit);
+  // start the simplex fits: from the current parameters, and from points around them to
+  // get a chance to escape a local minimum. The best converged one wins, the first one on a tie,
+  // so the result doesn't depend on the number of threads.
+  const int starts = CLAMP(dt_conf_get_int("plugins/darkroom/ashift/fit_starts"), 1, NMS_MAX_STARTS);
+  double results[NMS_MAX_STARTS][4];
+  double fitness[NMS_MAX_STARTS];
+  int iters[NMS_MAX_STARTS];
+  const int params_count = fit.params_count;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(params_count, starts) \
+  shared(fit, fitness, iters, params, results) \
+  schedule(dynamic) if(starts > 1)
+#endif
+  for(int s = 0; s < starts; s++)
+  {
+    for(int k = 0; k < params_count; k++)
+      results[s][k] = params[k] + (((s + k) & 1) ? 1.0 : -1.0) * NMS_START_SPREAD * ((s + 1) / 2);
+    iters[s] = simplex(model_fitness, results[s], params_count, NMS_EPSILON, NMS_SCALE, NMS_ITERATIONS, NULL,
+                       (void *)&fit);
+    fitness[s] = model_fitness(results[s], (void *)&fit);
+  }
+
+  int best = -1;
+  for(int s = 0; s < starts; s++)
+    if(iters[s] < NMS_ITERATIONS && (best < 0 || fitness[s] < fitness[best])) best = s;
 
   // error case: the fit did not converge
-  if(iter >= NMS_ITERATIONS)
+  if(best < 0)
   {
 #ifdef ASHIFT_DEBUG
-    printf("optimization not successful: maximum number of iterations reached (%d)\n", iter);
+    printf("optimization not successful: maximum number of iterations reached (%d)\n", iters[0]);
 #endif
     return NMS_DID_NOT_CONVERGE;
   }
 
   // fit was successful: now consolidate the results (order matters!!!)
+  for(int k = 0; k < params_count; k++) params[k] = results[best][k];
   pcount = 0;
   fit.rotation = isnan(fit.rotation) ? ilogit(params[pcount++], -fit.rotation_range, fit.rotation_range) : fit.rotation;
   fit.lensshift_v = isnan(fit.lensshift_v) ? ilogit(params[pcount++], -fit.lensshift_v_range, fit.lensshift_v_range) : fit.lensshift_v;
@@ -2295,7 +2507,7 @@ static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_p
   fit.shear = isnan(fit.shear) ? ilogit(params[pcount++], -fit.shear_range, fit.shear_range) : fit.shear;
 #ifdef ASHIFT_DEBUG
   printf("params after optimization (%d iterations): rotation %f, lensshift_v %f, lensshift_h %f, shear %f\n",
-         iter, fit.rotation, fit.lensshift_v, fit.lensshift_h, fit.shear);
+         iters[best], fit.rotation, fit.lensshift_v, fit.lensshift_h, fit.shear);
 #endif
 
   // sanity check: in case of extreme values the image gets distorted so strongly that it spans an insanely huge area. we check that
@@ -3042,23 +3254,91 @@ static void _do_get_structure_quad(dt_iop_module_t *self)
 }
 
 // helper function to start parameter fit and report about errors
-static void do_fit(dt_iop_module_t *module, dt_iop_ashift_params_t *p, dt_iop_ashift_fitaxis_t dir)
+typedef struct dt_iop_ashift_fit_job_t
 {
-  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)module->gui_data;
+  dt_iop_module_t *self;
+  dt_iop_ashift_params_t p;
+  dt_iop_ashift_fitaxis_t dir;
+} dt_iop_ashift_fit_job_t;
 
-  if(g->fitting) return;
+static gboolean _fit_job_cancelled(dt_job_t *job)
+{
+  return dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED;
+}
+
+// runs in a worker thread, and leaves its results in g->fit_job_* for _fit_job_collect().
+// The gui thread keeps off the structural data while g->fitting is set.
+static int32_t _fit_job_run(dt_job_t *job)
+{
+  dt_iop_ashift_fit_job_t *params = (dt_iop_ashift_fit_job_t *)dt_control_job_get_params(job);
+  dt_iop_module_t *self = params->self;
+  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)self->gui_data;
+
+  gboolean structure = FALSE;
+  gboolean failed = FALSE;
+  dt_iop_ashift_nmsresult_t res = NMS_NOT_ENOUGH_LINES;
 
   // if no structure available get it
   if(g->lines == NULL)
-    if(!_do_get_structure_auto(module, p, ASHIFT_ENHANCE_NONE)) return;
+  {
+    structure = TRUE;
+    if(!_get_structure(self, ASHIFT_ENHANCE_NONE))
+    {
+      if(!_fit_job_cancelled(job)) dt_control_log(_("could not detect structural data in image"));
+      failed = TRUE;
+    }
+    else if(!_remove_outliers(self))
+    {
+      if(!_fit_job_cancelled(job)) dt_control_log(_("could not run outlier removal"));
+      failed = TRUE;
+    }
+  }
 
-  g->fitting = 1;
+  if(!failed && !_fit_job_cancelled(job))
+    res = nmsfit(self, &params->p, params->dir);
 
-  dt_iop_ashift_nmsresult_t res = nmsfit(module, p, dir);
+  dt_iop_gui_enter_critical_section(self);
+  g->fit_job_structure = structure && !failed;
+  g->fit_job_failed = failed || _fit_job_cancelled(job);
+  g->fit_job_result = res;
+  g->fit_job_params = params->p;
+  dt_iop_gui_leave_critical_section(self);
+
+  dt_control_queue_redraw_center();
+  return 0;
+}
+
+// the job is disposed of, whether it ran or got cancelled in the queue: the last time it touches g
+static void _fit_job_cleanup(void *data)
+{
+  dt_iop_ashift_fit_job_t *params = (dt_iop_ashift_fit_job_t *)data;
+  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)params->self->gui_data;
+
+  dt_iop_gui_enter_critical_section(params->self);
+  g->fit_job_state = ASHIFT_FIT_JOB_DONE;
+  g->fit_job = NULL;
+  dt_iop_gui_leave_critical_section(params->self);
+
+  free(params);
+}
+
+// apply the results of the fit job, in the gui thread
+static void _fit_job_collect(dt_iop_module_t *module)
+{
+  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)module->gui_data;
+
+  dt_iop_gui_enter_critical_section(module);
+  const gboolean done = g->fit_job_state == ASHIFT_FIT_JOB_DONE;
+  if(done) g->fit_job_state = ASHIFT_FIT_JOB_NONE;
+  dt_iop_gui_leave_critical_section(module);
+
+  if(!done) return;
 
   g->fitting = 0;
+  if(g->fit_job_structure) _gui_update_structure_states(module, TRUE);
+  if(g->fit_job_failed) return;
 
-  switch(res)
+  switch(g->fit_job_result)
   {
     case NMS_NOT_ENOUGH_LINES:
       dt_control_log(
@@ -3074,6 +3354,12 @@ static void do_fit(dt_iop_module_t *module, dt_iop_ashift_params_t *p, dt_iop_as
       break;
   }
 
+  dt_iop_ashift_params_t *p = _get_ashift_params(module);
+  p->rotation = g->fit_job_params.rotation;
+  p->lensshift_v = g->fit_job_params.lensshift_v;
+  p->lensshift_h = g->fit_job_params.lensshift_h;
+  p->shear = g->fit_job_params.shear;
+
   // finally apply cropping
   do_crop(module, p);
 
@@ -3085,6 +3371,50 @@ static void do_fit(dt_iop_module_t *module, dt_iop_ashift_params_t *p, dt_iop_as
   --darktable.gui->reset;
 }
 
+// line detection and fitting take seconds on large images: run them in a background job,
+// _fit_job_collect() applies the results from gui_post_expose() once it's done
+static void do_fit(dt_iop_module_t *module, dt_iop_ashift_params_t *p, dt_iop_ashift_fitaxis_t dir)
+{
+  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)module->gui_data;
+
+  if(g->fitting) return;
+
+  if(g->lines == NULL)
+  {
+    dt_iop_gui_enter_critical_section(module);
+    float *b = g->buf;
+    dt_iop_gui_leave_critical_section(module);
+
+    if(b == NULL)
+    {
+      dt_control_log(_("data pending - please repeat"));
+      dt_dev_invalidate_preview(module->dev);
+      dt_dev_refresh_ui_images(module->dev);
+      return;
+    }
+  }
+
+  dt_job_t *job = dt_control_job_create(&_fit_job_run, "ashift fit");
+  if(!job) return;
+
+  dt_iop_ashift_fit_job_t *params = (dt_iop_ashift_fit_job_t *)malloc(sizeof(dt_iop_ashift_fit_job_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return;
+  }
+  params->self = module;
+  params->p = *p;
+  params->dir = dir;
+
+  g->fitting = 1;
+  g->fit_job = job;
+  g->fit_job_state = ASHIFT_FIT_JOB_RUNNING;
+  dt_control_job_set_params(job, params, _fit_job_cleanup);
+  dt_control_job_add_progress(job, _("fitting perspective"), TRUE);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, job);
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -3675,6 +4005,8 @@ void gui_post_expose(struct dt_iop_module_t *self, cairo_t *cr, int32_t width, i
   dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)self->gui_data;
   dt_iop_ashift_params_t *p = _get_ashift_params(self);
 
+  _fit_job_collect(self);
+
   // the usual rescaling stuff
   const float wd = dev->preview_pipe->backbuf_width;
   const float ht = dev->preview_pipe->backbuf_height;
@@ -4097,6 +4429,9 @@ int mouse_moved(struct dt_iop_module_t *self, double x, double y, double pressur
     return TRUE;
   }
 
+  // the fit job owns the lines
+  if(g->fitting) return FALSE;
+
   gboolean handled = FALSE;
 
   const float wd = self->dev->preview_pipe->backbuf_width;
@@ -4316,6 +4651,9 @@ int button_pressed(struct dt_iop_module_t *self, double x, double y, double pres
   if(type == GDK_2BUTTON_PRESS && which == 1)
     return TRUE;
 
+  // the fit job owns the lines
+  if(g->fitting) return FALSE;
+
   float pzx = 0.0f, pzy = 0.0f;
   dt_dev_get_pointer_zoom_pos(self->dev, x, y, &pzx, &pzy);
   pzx += 0.5f;
@@ -4684,7 +5022,7 @@ int scrolled(struct dt_iop_module_t *self, double x, double y, int up, uint32_t
   dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)self->gui_data;
 
   // do nothing if visibility of lines is switched off or no lines available
-  if(!g->lines) return FALSE;
+  if(g->fitting || !g->lines) return FALSE;
 
   if(g->near_delta > 0 && (g->isdeselecting || g->isselecting))
   {
@@ -5491,6 +5829,8 @@ void gui_init(struct dt_iop_module_t *self)
 
   g->jobcode = ASHIFT_JOBCODE_NONE;
   g->jobparams = 0;
+  g->fit_job_state = ASHIFT_FIT_JOB_NONE;
+  g->fit_job = NULL;
   g->lastx = g->lasty = -1.0f;
   g->crop_cx = g->crop_cy = 1.0f;
 
@@ -5671,6 +6011,18 @@ void gui_cleanup(struct dt_iop_module_t *self)
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_event_process_after_preview_callback), self);
 
   dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)self->gui_data;
+
+  // a fit job still holds on to g until it's disposed of
+  dt_iop_gui_enter_critical_section(self);
+  if(g->fit_job_state == ASHIFT_FIT_JOB_RUNNING) dt_control_job_cancel(g->fit_job);
+  while(g->fit_job_state == ASHIFT_FIT_JOB_RUNNING)
+  {
+    dt_iop_gui_leave_critical_section(self);
+    g_usleep(10000);
+    dt_iop_gui_enter_critical_section(self);
+  }
+  dt_iop_gui_leave_critical_section(self);
+
   if(g->lines) free(g->lines);
   if(g->buf) free(g->buf);
   if(g->points) free(g->points);
@@ -322,9 +322,9 @@ static void process_wavelets(struct dt_iop_module_t *self, struct dt_dev_pixelpi
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK)
     dt_iop_alpha_copy(i, o, width, height);
 
-  dt_free_align(detail);
-  dt_free_align(tmp);
-  dt_free_align(tmp2);
+  dt_iop_free_image_buffer(detail);
+  dt_iop_free_image_buffer(tmp);
+  dt_iop_free_image_buffer(tmp2);
   return;
 }
 
@@ -425,7 +425,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     if(err != CL_SUCCESS) goto error;
 
     // indirectly give gpu some air to breathe (and to do display related stuff)
-    dt_iop_nap(darktable.opencl->micro_nap);
+    dt_opencl_nap(devid);
 
     // now immediately run the synthesis for the current scale, accumulating the details into dev_out
     dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 0, sizeof(cl_mem), (void *)&dev_out);
@@ -446,7 +446,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     if(err != CL_SUCCESS) goto error;
 
     // indirectly give gpu some air to breathe (and to do display related stuff)
-    dt_iop_nap(darktable.opencl->micro_nap);
+    dt_opencl_nap(devid);
 
     // swap scratch buffers
     if (scale == 0) dev_buf1 = dev_tmp2;
@@ -566,7 +566,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     if(err != CL_SUCCESS) goto error;
 
     // indirectly give gpu some air to breathe (and to do display related stuff)
-    dt_iop_nap(dt_opencl_micro_nap(devid));
+    dt_opencl_nap(devid);
   }
 
   /* now synthesize again */
@@ -599,7 +599,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     if(err != CL_SUCCESS) goto error;
 
     // indirectly give gpu some air to breathe (and to do display related stuff)
-    dt_iop_nap(dt_opencl_micro_nap(devid));
+    dt_opencl_nap(devid);
   }
 
   dt_opencl_finish_sync_pipe(devid, piece->pipe->type);
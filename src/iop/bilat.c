@@ -44,12 +44,13 @@ typedef enum dt_iop_bilat_mode_t
 {
   s_mode_bilateral = 0,       // $DESCRIPTION: "bilateral grid"
   s_mode_local_laplacian = 1, // $DESCRIPTION: "local laplacian filter"
+  s_mode_local_laplacian_fast = 2, // $DESCRIPTION: "fast local laplacian filter"
 }
 dt_iop_bilat_mode_t;
 
 typedef struct dt_iop_bilat_params_t
 {
-  dt_iop_bilat_mode_t mode; // $DEFAULT: 1
+  dt_iop_bilat_mode_t mode; // $DEFAULT: 2
   float sigma_r; // $MIN: 0.0 $MAX: 100.0 $DEFAULT: 0.5 highlights 100 & range
   float sigma_s; // $MIN: 0.0 $MAX: 100.0 $DEFAULT: 0.5 shadows 100 & spatial 1 100 50
   float detail;  // $MIN: -1.0 $MAX: 4.0 $DEFAULT: 0.25
@@ -154,7 +155,7 @@ void init_presets(dt_iop_module_so_t *self)
   dt_iop_bilat_params_t p;
   memset(&p, 0, sizeof(p));
 
-  p.mode = s_mode_local_laplacian;
+  p.mode = s_mode_local_laplacian_fast;
   p.sigma_r = 0.f;
   p.sigma_s = 0.f;
   p.detail = 0.33f;
@@ -163,7 +164,7 @@ void init_presets(dt_iop_module_so_t *self)
   dt_gui_presets_add_generic(_("clarity"), self->op,
                              self->version(), &p, sizeof(p), 1, DEVELOP_BLEND_CS_RGB_SCENE);
 
-  p.mode = s_mode_local_laplacian;
+  p.mode = s_mode_local_laplacian_fast;
   p.sigma_r = 0.f;
   p.sigma_s = 0.f;
   p.detail = 1.f;
@@ -174,6 +175,14 @@ void init_presets(dt_iop_module_so_t *self)
 }
 
 
+// memory the fast local laplacian can take next to the input and output buffers
+static size_t _fast_memory_ceiling(const dt_iop_roi_t *const roi_in, const int channels)
+{
+  const size_t buffers = 2 * sizeof(float) * channels * roi_in->width * roi_in->height;
+  const size_t available = dt_get_available_mem();
+  return available > buffers ? available - buffers : 0;
+}
+
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -205,10 +214,13 @@ error:
     dt_print(DT_DEBUG_OPENCL, "[opencl_bilateral] couldn't enqueue kernel! %d\n", err);
     return FALSE;
   }
-  else // mode == s_mode_local_laplacian
+  else // mode == s_mode_local_laplacian(_fast)
   {
-    dt_local_laplacian_cl_t *b = dt_local_laplacian_init_cl(piece->pipe->devid, roi_in->width, roi_in->height,
-        d->midtone, d->sigma_s, d->sigma_r, d->detail);
+    dt_local_laplacian_cl_t *b = (d->mode == s_mode_local_laplacian_fast)
+      ? dt_local_laplacian_fast_init_cl(piece->pipe->devid, roi_in->width, roi_in->height,
+                                        d->midtone, d->sigma_s, d->sigma_r, d->detail)
+      : dt_local_laplacian_init_cl(piece->pipe->devid, roi_in->width, roi_in->height,
+                                   d->midtone, d->sigma_s, d->sigma_r, d->detail);
     if(!b) goto error_ll;
     if(dt_local_laplacian_cl(b, dev_in, dev_out) != CL_SUCCESS) goto error_ll;
     dt_local_laplacian_free_cl(b);
@@ -250,7 +262,7 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
     tiling->xalign = 1;
     tiling->yalign = 1;
   }
-  else  // mode == s_mode_local_laplacian
+  else  // mode == s_mode_local_laplacian(_fast)
   {
     const int width = roi_in->width;
     const int height = roi_in->height;
@@ -259,9 +271,19 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
     const size_t basebuffer = sizeof(float) * channels * width * height;
     const int rad = MIN(roi_in->width, ceilf(256 * roi_in->scale / piece->iscale));
 
-    tiling->factor = 2.0f + (float)local_laplacian_memory_use(width, height) / basebuffer;
-    tiling->maxbuf
-        = fmax(1.0f, (float)local_laplacian_singlebuffer_size(width, height) / basebuffer);
+    if(d->mode == s_mode_local_laplacian_fast)
+    {
+      // a single pool that stays under the memory ceiling
+      const size_t ceiling = _fast_memory_ceiling(roi_in, channels);
+      tiling->factor = 2.0f + (float)local_laplacian_fast_memory_use(width, height, ceiling) / basebuffer;
+      tiling->maxbuf = tiling->factor - 2.0f;
+    }
+    else
+    {
+      tiling->factor = 2.0f + (float)local_laplacian_memory_use(width, height) / basebuffer;
+      tiling->maxbuf
+          = fmax(1.0f, (float)local_laplacian_singlebuffer_size(width, height) / basebuffer);
+    }
     tiling->overhead = 0;
     tiling->overlap = rad;
     tiling->xalign = 1;
@@ -280,7 +302,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   if(d->mode == s_mode_bilateral)
     piece->process_cl_ready = (piece->process_cl_ready && !dt_opencl_avoid_atomics(pipe->devid));
 #endif
-  if(d->mode == s_mode_local_laplacian)
+  if(d->mode != s_mode_bilateral)
     piece->process_tiling_ready = 0; // can't deal with tiles, sorry.
 }
 
@@ -321,6 +343,11 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
     dt_bilateral_slice(b, (float *)i, (float *)o, d->detail);
     dt_bilateral_free(b);
   }
+  else if(d->mode == s_mode_local_laplacian_fast)
+  {
+    local_laplacian_fast_sse2(i, o, roi_in->width, roi_in->height, d->midtone, d->sigma_s, d->sigma_r, d->detail,
+                              _fast_memory_ceiling(roi_in, piece->colors));
+  }
   else // s_mode_local_laplacian
   {
     local_laplacian_sse2(i, o, roi_in->width, roi_in->height, d->midtone, d->sigma_s, d->sigma_r, d->detail, 0);
@@ -351,6 +378,11 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     dt_bilateral_slice(b, (float *)i, (float *)o, d->detail);
     dt_bilateral_free(b);
   }
+  else if(d->mode == s_mode_local_laplacian_fast)
+  {
+    local_laplacian_fast(i, o, roi_in->width, roi_in->height, d->midtone, d->sigma_s, d->sigma_r, d->detail,
+                         _fast_memory_ceiling(roi_in, piece->colors));
+  }
   else // s_mode_local_laplacian
   {
     local_laplacian(i, o, roi_in->width, roi_in->height, d->midtone, d->sigma_s, d->sigma_r, d->detail, 0);
@@ -365,7 +397,7 @@ void gui_changed(dt_iop_module_t *self, GtkWidget *w, void *previous)
   dt_iop_bilat_params_t *p = (dt_iop_bilat_params_t *)self->params;
   if(w == g->highlights || w == g->shadows || w == g->midtone)
   {
-    dt_bauhaus_combobox_set(g->mode, s_mode_local_laplacian);
+    if(p->mode == s_mode_bilateral) dt_bauhaus_combobox_set(g->mode, s_mode_local_laplacian_fast);
   }
   else if(w == g->range || w == g->spatial)
   {
@@ -373,7 +405,7 @@ void gui_changed(dt_iop_module_t *self, GtkWidget *w, void *previous)
   }
   else if(w == g->mode)
   {
-    if(p->mode == s_mode_local_laplacian)
+    if(p->mode != s_mode_bilateral)
     {
       p->sigma_r = dt_bauhaus_slider_get(g->highlights);
       p->sigma_s = dt_bauhaus_slider_get(g->shadows);
@@ -387,11 +419,11 @@ void gui_changed(dt_iop_module_t *self, GtkWidget *w, void *previous)
 
   if(!w || w == g->mode)
   {
-    gtk_widget_set_visible(g->highlights, p->mode == s_mode_local_laplacian);
-    gtk_widget_set_visible(g->shadows, p->mode == s_mode_local_laplacian);
-    gtk_widget_set_visible(g->midtone, p->mode == s_mode_local_laplacian);
-    gtk_widget_set_visible(g->range, p->mode != s_mode_local_laplacian);
-    gtk_widget_set_visible(g->spatial, p->mode != s_mode_local_laplacian);
+    gtk_widget_set_visible(g->highlights, p->mode != s_mode_bilateral);
+    gtk_widget_set_visible(g->shadows, p->mode != s_mode_bilateral);
+    gtk_widget_set_visible(g->midtone, p->mode != s_mode_bilateral);
+    gtk_widget_set_visible(g->range, p->mode == s_mode_bilateral);
+    gtk_widget_set_visible(g->spatial, p->mode == s_mode_bilateral);
   }
 }
 
@@ -400,7 +432,7 @@ void gui_update(dt_iop_module_t *self)
   dt_iop_bilat_gui_data_t *g = (dt_iop_bilat_gui_data_t *)self->gui_data;
   dt_iop_bilat_params_t *p = (dt_iop_bilat_params_t *)self->params;
 
-  if(p->mode == s_mode_local_laplacian)
+  if(p->mode != s_mode_bilateral)
   {
     dt_bauhaus_slider_set(g->highlights, p->sigma_r);
     dt_bauhaus_slider_set(g->shadows, p->sigma_s);
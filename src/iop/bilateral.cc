@@ -24,6 +24,7 @@ extern "C" {
 #endif
 #include "bauhaus/bauhaus.h"
 #include "common/imagebuf.h"
+#include "common/opencl.h"
 #include "control/control.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
@@ -68,6 +69,16 @@ typedef struct dt_iop_bilateral_data_t
   float sigma[5];
 } dt_iop_bilateral_data_t;
 
+typedef struct dt_iop_bilateral_global_data_t
+{
+  int kernel_permutohedral_keys;
+  int kernel_permutohedral_clear;
+  int kernel_permutohedral_splat;
+  int kernel_permutohedral_blur;
+  int kernel_permutohedral_slice;
+  int kernel_bilateral_naive;
+} dt_iop_bilateral_global_data_t;
+
 const char *name()
 {
   return _("surface blur");
@@ -254,6 +265,180 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   if(piece->pipe->mask_display) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
 }
 
+#ifdef HAVE_OPENCL
+int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_bilateral_data_t *data = (dt_iop_bilateral_data_t *)piece->data;
+  dt_iop_bilateral_global_data_t *gd = (dt_iop_bilateral_global_data_t *)self->global_data;
+
+  const int devid = piece->pipe->devid;
+  const int width = roi_in->width;
+  const int height = roi_in->height;
+  const int vertices = 5 + 1; // of the simplices of the 5D lattice
+  const int nkeys = width * height * vertices;
+
+  // the open addressing hash table of the lattice can't grow on the GPU, size it for
+  // half a lattice point per vertex, see tiling_callback()
+  int capacity = 1 << 15;
+  while(capacity < 2 * width * height) capacity <<= 1;
+
+  cl_mem dev_keys = NULL;
+  cl_mem dev_weights = NULL;
+  cl_mem dev_slots = NULL;
+  cl_mem dev_owners = NULL;
+  cl_mem dev_values = NULL;
+  cl_mem dev_blurred = NULL;
+  cl_mem dev_counters = NULL;
+  int counters[2] = { 0, 0 }; // lattice points, vertices that didn't fit in the table
+  cl_int err = -999;
+
+  size_t origin[] = { 0, 0, 0 };
+  size_t region[] = { (size_t)width, (size_t)height, 1 };
+  size_t sizes[] = { (size_t)ROUNDUPDWD(width, devid), (size_t)ROUNDUPDHT(height, devid), 1 };
+  size_t key_sizes[] = { (size_t)ROUNDUPDWD(nkeys, devid), 1, 1 };
+  size_t table_sizes[] = { (size_t)ROUNDUPDWD(capacity, devid), 1, 1 };
+
+  float sigma[5];
+  sigma[0] = data->sigma[0] * roi_in->scale / piece->iscale;
+  sigma[1] = data->sigma[1] * roi_in->scale / piece->iscale;
+  sigma[2] = data->sigma[2];
+  sigma[3] = data->sigma[3];
+  sigma[4] = data->sigma[4];
+  const int rad = (int)(3.0 * fmaxf(sigma[0], sigma[1]) + 1.0);
+
+  if(fmaxf(sigma[0], sigma[1]) < .1
+     || (rad <= 6 && ((piece->pipe->type & DT_DEV_PIXELPIPE_THUMBNAIL) == DT_DEV_PIXELPIPE_THUMBNAIL)))
+  {
+    // same as the CPU path, no use denoising the thumbnail
+    err = dt_opencl_enqueue_copy_image(devid, dev_in, dev_out, origin, origin, region);
+    if(err != CL_SUCCESS) goto error;
+    return TRUE;
+  }
+
+  if(rad <= 6)
+  {
+    const float isig2col[4] = { 1.f / (2.0f * sigma[2] * sigma[2]), 1.f / (2.0f * sigma[3] * sigma[3]),
+                                1.f / (2.0f * sigma[4] * sigma[4]), 0.0f };
+    dt_opencl_set_kernel_arg(devid, gd->kernel_bilateral_naive, 0, sizeof(cl_mem), (void *)&dev_in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_bilateral_naive, 1, sizeof(cl_mem), (void *)&dev_out);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_bilateral_naive, 2, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_bilateral_naive, 3, sizeof(int), (void *)&height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_bilateral_naive, 4, sizeof(int), (void *)&rad);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_bilateral_naive, 5, sizeof(float), (void *)&sigma[0]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_bilateral_naive, 6, 4 * sizeof(float), (void *)isig2col);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_bilateral_naive, sizes);
+    if(err != CL_SUCCESS) goto error;
+    return TRUE;
+  }
+
+  for(int k = 0; k < 5; k++) sigma[k] = 1.0f / sigma[k];
+  const float inv_sigma_rgb[4] = { sigma[2], sigma[3], sigma[4], 0.0f };
+
+  dev_keys = (cl_mem)dt_opencl_alloc_device_buffer(devid, sizeof(short) * 5 * nkeys);
+  dev_weights = (cl_mem)dt_opencl_alloc_device_buffer(devid, sizeof(float) * nkeys);
+  dev_slots = (cl_mem)dt_opencl_alloc_device_buffer(devid, sizeof(int) * nkeys);
+  dev_owners = (cl_mem)dt_opencl_alloc_device_buffer(devid, sizeof(int) * capacity);
+  dev_values = (cl_mem)dt_opencl_alloc_device_buffer(devid, sizeof(float) * 4 * capacity);
+  dev_blurred = (cl_mem)dt_opencl_alloc_device_buffer(devid, sizeof(float) * 4 * capacity);
+  dev_counters = (cl_mem)dt_opencl_alloc_device_buffer(devid, sizeof(counters));
+  if(dev_keys == NULL || dev_weights == NULL || dev_slots == NULL || dev_owners == NULL || dev_values == NULL
+     || dev_blurred == NULL || dev_counters == NULL)
+    goto error;
+
+  err = dt_opencl_write_buffer_to_device(devid, counters, dev_counters, 0, sizeof(counters), CL_TRUE);
+  if(err != CL_SUCCESS) goto error;
+
+  // the simplices enclosing the pixels
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_keys, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_keys, 1, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_keys, 2, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_keys, 3, sizeof(float), (void *)&sigma[0]);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_keys, 4, sizeof(float), (void *)&sigma[1]);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_keys, 5, 4 * sizeof(float), (void *)inv_sigma_rgb);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_keys, 6, sizeof(cl_mem), (void *)&dev_keys);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_keys, 7, sizeof(cl_mem), (void *)&dev_weights);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_permutohedral_keys, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_clear, 0, sizeof(cl_mem), (void *)&dev_owners);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_clear, 1, sizeof(cl_mem), (void *)&dev_values);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_clear, 2, sizeof(int), (void *)&capacity);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_permutohedral_clear, table_sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  // splat into the lattice
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_splat, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_splat, 1, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_splat, 2, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_splat, 3, sizeof(cl_mem), (void *)&dev_keys);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_splat, 4, sizeof(cl_mem), (void *)&dev_weights);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_splat, 5, sizeof(cl_mem), (void *)&dev_owners);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_splat, 6, sizeof(cl_mem), (void *)&dev_slots);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_splat, 7, sizeof(cl_mem), (void *)&dev_values);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_splat, 8, sizeof(int), (void *)&capacity);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_splat, 9, sizeof(cl_mem), (void *)&dev_counters);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_permutohedral_splat, key_sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  err = dt_opencl_read_buffer_from_device(devid, counters, dev_counters, 0, sizeof(counters), CL_TRUE);
+  if(err != CL_SUCCESS) goto error;
+  if(counters[1] > 0)
+  {
+    dt_print(DT_DEBUG_OPENCL, "[opencl_bilateral] %d lattice points don't fit in a table of %d\n",
+             counters[0] + counters[1], capacity);
+    err = -999;
+    goto error;
+  }
+
+  // blur the lattice, an even number of passes ends in dev_values
+  for(int axis = 0; axis < vertices; axis++)
+  {
+    cl_mem blur_in = (axis & 1) ? dev_blurred : dev_values;
+    cl_mem blur_out = (axis & 1) ? dev_values : dev_blurred;
+    dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_blur, 0, sizeof(cl_mem), (void *)&dev_keys);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_blur, 1, sizeof(cl_mem), (void *)&dev_owners);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_blur, 2, sizeof(cl_mem), (void *)&blur_in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_blur, 3, sizeof(cl_mem), (void *)&blur_out);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_blur, 4, sizeof(int), (void *)&capacity);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_blur, 5, sizeof(int), (void *)&axis);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_permutohedral_blur, table_sizes);
+    if(err != CL_SUCCESS) goto error;
+  }
+
+  // slice from the lattice
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_slice, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_slice, 1, sizeof(cl_mem), (void *)&dev_out);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_slice, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_slice, 3, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_slice, 4, sizeof(cl_mem), (void *)&dev_slots);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_slice, 5, sizeof(cl_mem), (void *)&dev_weights);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_permutohedral_slice, 6, sizeof(cl_mem), (void *)&dev_values);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_permutohedral_slice, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_release_mem_object(dev_keys);
+  dt_opencl_release_mem_object(dev_weights);
+  dt_opencl_release_mem_object(dev_slots);
+  dt_opencl_release_mem_object(dev_owners);
+  dt_opencl_release_mem_object(dev_values);
+  dt_opencl_release_mem_object(dev_blurred);
+  dt_opencl_release_mem_object(dev_counters);
+  return TRUE;
+
+error:
+  dt_opencl_release_mem_object(dev_keys);
+  dt_opencl_release_mem_object(dev_weights);
+  dt_opencl_release_mem_object(dev_slots);
+  dt_opencl_release_mem_object(dev_owners);
+  dt_opencl_release_mem_object(dev_values);
+  dt_opencl_release_mem_object(dev_blurred);
+  dt_opencl_release_mem_object(dev_counters);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_bilateral] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
                    dt_dev_pixelpipe_iop_t *piece)
 {
@@ -266,6 +451,33 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   d->sigma[4] = p->blue;
 }
 
+void init_global(dt_iop_module_so_t *module)
+{
+  const int program = 41; // permutohedral.cl, from programs.conf
+  dt_iop_bilateral_global_data_t *gd
+      = (dt_iop_bilateral_global_data_t *)malloc(sizeof(dt_iop_bilateral_global_data_t));
+  module->data = gd;
+  gd->kernel_permutohedral_keys = dt_opencl_create_kernel(program, "permutohedral_keys");
+  gd->kernel_permutohedral_clear = dt_opencl_create_kernel(program, "permutohedral_clear");
+  gd->kernel_permutohedral_splat = dt_opencl_create_kernel(program, "permutohedral_splat");
+  gd->kernel_permutohedral_blur = dt_opencl_create_kernel(program, "permutohedral_blur");
+  gd->kernel_permutohedral_slice = dt_opencl_create_kernel(program, "permutohedral_slice");
+  gd->kernel_bilateral_naive = dt_opencl_create_kernel(program, "bilateral_naive");
+}
+
+void cleanup_global(dt_iop_module_so_t *module)
+{
+  dt_iop_bilateral_global_data_t *gd = (dt_iop_bilateral_global_data_t *)module->data;
+  dt_opencl_free_kernel(gd->kernel_permutohedral_keys);
+  dt_opencl_free_kernel(gd->kernel_permutohedral_clear);
+  dt_opencl_free_kernel(gd->kernel_permutohedral_splat);
+  dt_opencl_free_kernel(gd->kernel_permutohedral_blur);
+  dt_opencl_free_kernel(gd->kernel_permutohedral_slice);
+  dt_opencl_free_kernel(gd->kernel_bilateral_naive);
+  free(module->data);
+  module->data = NULL;
+}
+
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
   piece->data = malloc(sizeof(dt_iop_bilateral_data_t));
@@ -286,7 +498,12 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
   sigma[0] = data->sigma[0] * roi_in->scale / piece->iscale;
   sigma[1] = data->sigma[1] * roi_in->scale / piece->iscale;
   const int rad = (int)(3.0 * fmaxf(sigma[0], sigma[1]) + 1.0);
-  tiling->factor = 2.0 /*input+output*/ + 80.0/16/*worst-case hashtable*/ + 52.0/16/*replay buffer*/;
+  tiling->factor = 2.0 /*input+output*/ + 80.0/16/*worst-case hashtable*/ + 52.0/16/*replay buffer*/
+                   + 24.0/16/*blur buffers*/;
+  tiling->factor_cl = 2.0 /*input+output*/ + 108.0/16/*keys, weights and slots*/
+                      + 4 * 36.0/16/*hashtable of up to 4 slots per pixel*/;
+  tiling->maxbuf = 1.0f;
+  tiling->maxbuf_cl = 4.0f; // lattice values
   tiling->overhead = 0;
   tiling->overlap = rad;
   tiling->xalign = 1;
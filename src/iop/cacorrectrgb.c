@@ -159,6 +159,17 @@ typedef struct dt_iop_cacorrectrgb_gui_data_t
   GtkWidget *guide_channel, *radius, *strength, *mode, *refine_manifolds;
 } dt_iop_cacorrectrgb_gui_data_t;
 
+typedef struct dt_iop_cacorrectrgb_global_data_t
+{
+  int kernel_cacorrectrgb_manifolds;
+  int kernel_cacorrectrgb_normalize;
+  int kernel_cacorrectrgb_refine;
+  int kernel_cacorrectrgb_apply;
+  int kernel_cacorrectrgb_pack;
+  int kernel_cacorrectrgb_reduce_artifacts;
+  int kernel_interpolate_bilinear;
+} dt_iop_cacorrectrgb_global_data_t;
+
 const char *name()
 {
   return _("chromatic a_berrations");
@@ -705,6 +716,240 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   reduce_chromatic_aberrations(in, width, height, ch, sigma, sigma2, d->guide_channel, d->mode, d->refine_manifolds, safety, out);
 }
 
+#ifdef HAVE_OPENCL
+int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_cacorrectrgb_params_t *d = (dt_iop_cacorrectrgb_params_t *)piece->data;
+  const dt_iop_cacorrectrgb_global_data_t *gd = (dt_iop_cacorrectrgb_global_data_t *)self->global_data;
+
+  const int devid = piece->pipe->devid;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+  const int guide = d->guide_channel;
+  const int mode = d->mode;
+  const int RGBa = TRUE;
+
+  // same sizes and blurs as the CPU path, see process()
+  const float scale = fmaxf(piece->iscale / roi_in->scale, 1.f);
+  const float sigma = fmaxf(d->radius / scale, 1.0f);
+  const float sigma2 = fmaxf(d->radius * d->radius / scale, 1.0f);
+  const float safety = powf(20.0f, 1.0f - d->strength);
+  const float downsize = fminf(3.0f, sigma);
+  const int ds_width = width / downsize;
+  const int ds_height = height / downsize;
+
+  const float max[4] = { INFINITY, INFINITY, INFINITY, INFINITY };
+  const float min[4] = { -INFINITY, -INFINITY, -INFINITY, 0.0f };
+  const float min_artifacts[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+  cl_mem ds_in = NULL;
+  cl_mem ds_blurred = NULL;
+  cl_mem ds_manifolds[4] = { NULL };
+  cl_mem higher = NULL;
+  cl_mem lower = NULL;
+  cl_mem corrected = NULL;
+  dt_gaussian_cl_t *g = NULL;
+  cl_int err = -999;
+
+  size_t sizes[] = { ROUNDUPDWD(width, devid), ROUNDUPDHT(height, devid), 1 };
+  size_t ds_sizes[] = { ROUNDUPDWD(ds_width, devid), ROUNDUPDHT(ds_height, devid), 1 };
+
+  ds_in = dt_opencl_alloc_device(devid, ds_width, ds_height, sizeof(float) * 4);
+  ds_blurred = dt_opencl_alloc_device(devid, ds_width, ds_height, sizeof(float) * 4);
+  if(ds_in == NULL || ds_blurred == NULL) goto error;
+  for(int k = 0; k < 4; k++)
+  {
+    ds_manifolds[k] = dt_opencl_alloc_device(devid, ds_width, ds_height, sizeof(float) * 4);
+    if(ds_manifolds[k] == NULL) goto error;
+  }
+
+  // downsample the image for speed-up
+  dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 1, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 2, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 3, sizeof(cl_mem), (void *)&ds_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 4, sizeof(int), (void *)&ds_width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 5, sizeof(int), (void *)&ds_height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 6, sizeof(int), (void *)&RGBa);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_interpolate_bilinear, ds_sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  // construct the manifolds, starting with a larger blur if we refine them later on
+  g = dt_gaussian_init_cl(devid, ds_width, ds_height, 4, max, min,
+                          (d->refine_manifolds ? sigma2 : sigma) / downsize, 0);
+  if(g == NULL) goto error;
+  err = dt_gaussian_blur_cl(g, ds_in, ds_blurred);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_manifolds, 0, sizeof(cl_mem), (void *)&ds_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_manifolds, 1, sizeof(cl_mem), (void *)&ds_blurred);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_manifolds, 2, sizeof(cl_mem), (void *)&ds_manifolds[0]);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_manifolds, 3, sizeof(cl_mem), (void *)&ds_manifolds[1]);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_manifolds, 4, sizeof(int), (void *)&ds_width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_manifolds, 5, sizeof(int), (void *)&ds_height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_manifolds, 6, sizeof(int), (void *)&guide);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_cacorrectrgb_manifolds, ds_sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  // the manifolds ping-pong between the pairs 0/1 and 2/3 of ds_manifolds
+  int current = 0;
+  for(int pass = 0; pass < (d->refine_manifolds ? 2 : 1); pass++)
+  {
+    if(pass == 1)
+    {
+      // refine the manifolds with a blur of normal size
+      dt_gaussian_free_cl(g);
+      g = dt_gaussian_init_cl(devid, ds_width, ds_height, 4, max, min, sigma / downsize, 0);
+      if(g == NULL) goto error;
+      err = dt_gaussian_blur_cl(g, ds_in, ds_blurred);
+      if(err != CL_SUCCESS) goto error;
+
+      dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_refine, 0, sizeof(cl_mem), (void *)&ds_in);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_refine, 1, sizeof(cl_mem), (void *)&ds_blurred);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_refine, 2, sizeof(cl_mem), (void *)&ds_manifolds[current]);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_refine, 3, sizeof(cl_mem), (void *)&ds_manifolds[current + 1]);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_refine, 4, sizeof(cl_mem), (void *)&ds_manifolds[2 - current]);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_refine, 5, sizeof(cl_mem), (void *)&ds_manifolds[3 - current]);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_refine, 6, sizeof(int), (void *)&ds_width);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_refine, 7, sizeof(int), (void *)&ds_height);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_refine, 8, sizeof(int), (void *)&guide);
+      err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_cacorrectrgb_refine, ds_sizes);
+      if(err != CL_SUCCESS) goto error;
+      current = 2 - current;
+    }
+
+    const int other = 2 - current;
+    err = dt_gaussian_blur_cl(g, ds_manifolds[current], ds_manifolds[other]);
+    if(err != CL_SUCCESS) goto error;
+    err = dt_gaussian_blur_cl(g, ds_manifolds[current + 1], ds_manifolds[other + 1]);
+    if(err != CL_SUCCESS) goto error;
+
+    dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_normalize, 0, sizeof(cl_mem), (void *)&ds_blurred);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_normalize, 1, sizeof(cl_mem), (void *)&ds_manifolds[other]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_normalize, 2, sizeof(cl_mem), (void *)&ds_manifolds[other + 1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_normalize, 3, sizeof(cl_mem), (void *)&ds_manifolds[current]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_normalize, 4, sizeof(cl_mem), (void *)&ds_manifolds[current + 1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_normalize, 5, sizeof(int), (void *)&ds_width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_normalize, 6, sizeof(int), (void *)&ds_height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_normalize, 7, sizeof(int), (void *)&guide);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_cacorrectrgb_normalize, ds_sizes);
+    if(err != CL_SUCCESS) goto error;
+  }
+  dt_gaussian_free_cl(g);
+  g = NULL;
+
+  // upscale the manifolds
+  higher = dt_opencl_alloc_device(devid, width, height, sizeof(float) * 4);
+  lower = dt_opencl_alloc_device(devid, width, height, sizeof(float) * 4);
+  corrected = dt_opencl_alloc_device(devid, width, height, sizeof(float) * 4);
+  if(higher == NULL || lower == NULL || corrected == NULL) goto error;
+
+  for(int k = 0; k < 2; k++)
+  {
+    cl_mem manifold = k ? lower : higher;
+    dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 0, sizeof(cl_mem), (void *)&ds_manifolds[current + k]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 1, sizeof(int), (void *)&ds_width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 2, sizeof(int), (void *)&ds_height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 3, sizeof(cl_mem), (void *)&manifold);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 4, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 5, sizeof(int), (void *)&height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 6, sizeof(int), (void *)&RGBa);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_interpolate_bilinear, sizes);
+    if(err != CL_SUCCESS) goto error;
+  }
+
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_apply, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_apply, 1, sizeof(cl_mem), (void *)&higher);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_apply, 2, sizeof(cl_mem), (void *)&lower);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_apply, 3, sizeof(cl_mem), (void *)&corrected);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_apply, 4, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_apply, 5, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_apply, 6, sizeof(int), (void *)&guide);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_apply, 7, sizeof(int), (void *)&mode);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_cacorrectrgb_apply, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  // reduce artifacts, reusing the upscaled manifolds for the packed and blurred guided channels
+  cl_mem in_out = higher;
+  cl_mem blurred_in_out = lower;
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_pack, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_pack, 1, sizeof(cl_mem), (void *)&corrected);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_pack, 2, sizeof(cl_mem), (void *)&in_out);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_pack, 3, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_pack, 4, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_pack, 5, sizeof(int), (void *)&guide);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_cacorrectrgb_pack, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  g = dt_gaussian_init_cl(devid, width, height, 4, max, min_artifacts, sigma, 0);
+  if(g == NULL) goto error;
+  err = dt_gaussian_blur_cl(g, in_out, blurred_in_out);
+  if(err != CL_SUCCESS) goto error;
+  dt_gaussian_free_cl(g);
+  g = NULL;
+
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_reduce_artifacts, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_reduce_artifacts, 1, sizeof(cl_mem), (void *)&corrected);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_reduce_artifacts, 2, sizeof(cl_mem), (void *)&blurred_in_out);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_reduce_artifacts, 3, sizeof(cl_mem), (void *)&dev_out);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_reduce_artifacts, 4, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_reduce_artifacts, 5, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_reduce_artifacts, 6, sizeof(int), (void *)&guide);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_cacorrectrgb_reduce_artifacts, 7, sizeof(float), (void *)&safety);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_cacorrectrgb_reduce_artifacts, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_release_mem_object(ds_in);
+  dt_opencl_release_mem_object(ds_blurred);
+  for(int k = 0; k < 4; k++) dt_opencl_release_mem_object(ds_manifolds[k]);
+  dt_opencl_release_mem_object(higher);
+  dt_opencl_release_mem_object(lower);
+  dt_opencl_release_mem_object(corrected);
+  return TRUE;
+
+error:
+  if(g) dt_gaussian_free_cl(g);
+  dt_opencl_release_mem_object(ds_in);
+  dt_opencl_release_mem_object(ds_blurred);
+  for(int k = 0; k < 4; k++) dt_opencl_release_mem_object(ds_manifolds[k]);
+  dt_opencl_release_mem_object(higher);
+  dt_opencl_release_mem_object(lower);
+  dt_opencl_release_mem_object(corrected);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_cacorrectrgb] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
+void init_global(dt_iop_module_so_t *self)
+{
+  const int program = 40; // cacorrectrgb.cl, from programs.conf
+  const int program_basic = 2; // basic.cl, from programs.conf
+  dt_iop_cacorrectrgb_global_data_t *gd = malloc(sizeof(dt_iop_cacorrectrgb_global_data_t));
+  self->data = gd;
+  gd->kernel_cacorrectrgb_manifolds = dt_opencl_create_kernel(program, "cacorrectrgb_manifolds");
+  gd->kernel_cacorrectrgb_normalize = dt_opencl_create_kernel(program, "cacorrectrgb_normalize");
+  gd->kernel_cacorrectrgb_refine = dt_opencl_create_kernel(program, "cacorrectrgb_refine");
+  gd->kernel_cacorrectrgb_apply = dt_opencl_create_kernel(program, "cacorrectrgb_apply");
+  gd->kernel_cacorrectrgb_pack = dt_opencl_create_kernel(program, "cacorrectrgb_pack");
+  gd->kernel_cacorrectrgb_reduce_artifacts = dt_opencl_create_kernel(program, "cacorrectrgb_reduce_artifacts");
+  gd->kernel_interpolate_bilinear = dt_opencl_create_kernel(program_basic, "interpolate_bilinear");
+}
+
+void cleanup_global(dt_iop_module_so_t *self)
+{
+  dt_iop_cacorrectrgb_global_data_t *gd = (dt_iop_cacorrectrgb_global_data_t *)self->data;
+  dt_opencl_free_kernel(gd->kernel_cacorrectrgb_manifolds);
+  dt_opencl_free_kernel(gd->kernel_cacorrectrgb_normalize);
+  dt_opencl_free_kernel(gd->kernel_cacorrectrgb_refine);
+  dt_opencl_free_kernel(gd->kernel_cacorrectrgb_apply);
+  dt_opencl_free_kernel(gd->kernel_cacorrectrgb_pack);
+  dt_opencl_free_kernel(gd->kernel_cacorrectrgb_reduce_artifacts);
+  dt_opencl_free_kernel(gd->kernel_interpolate_bilinear);
+  free(self->data);
+  self->data = NULL;
+}
+
 void gui_update(dt_iop_module_t *self)
 {
   dt_iop_cacorrectrgb_gui_data_t *g = (dt_iop_cacorrectrgb_gui_data_t *)self->gui_data;
@@ -239,7 +239,8 @@ const char **description(struct dt_iop_module_t *self)
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING
+         | IOP_FLAGS_POINTWISE;
 }
 
 int default_group()
@@ -1303,11 +1304,20 @@ static const extraction_result_t _extract_patches(const float *const restrict in
   if(g->delta_E_in == NULL)
     g->delta_E_in = dt_alloc_sse_ps(g->checker->patches);
 
-  /* Get the average color over each patch */
-  for(size_t k = 0; k < g->checker->patches; k++)
+  const dt_color_checker_t *const checker = g->checker;
+  const size_t num_patches = checker->patches;
+
+  /* Get the average color over each patch. Patches are independent, and the large ones
+   * cost a homography per pixel of their bounding box: split them between threads. */
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, patches, checker, num_patches, width, height, radius_x, radius_y, RGB_to_XYZ) \
+  shared(g) schedule(dynamic)
+#endif
+  for(size_t k = 0; k < num_patches; k++)
   {
     // center of the patch in the ideal reference
-    const point_t center = { g->checker->values[k].x, g->checker->values[k].y };
+    const point_t center = { checker->values[k].x, checker->values[k].y };
 
     // corners of the patch in the ideal reference
     const point_t corners[4] = { {center.x - radius_x, center.y - radius_y},
@@ -1336,7 +1346,7 @@ static const extraction_result_t _extract_patches(const float *const restrict in
     y_max = CLAMP((size_t)ceilf(y_max), 0, height - 1);
 
     // Get the average color on the patch
-    patches[k * 4] = patches[k * 4 + 1] = patches[k * 4 + 2] = patches[k * 4 + 3] = 0.f;
+    dt_aligned_pixel_t sum = { 0.f };
     size_t num_elem = 0;
 
     // Loop through the rectangular bounding box
@@ -1354,7 +1364,7 @@ static const extraction_result_t _extract_patches(const float *const restrict in
         {
           for(size_t c = 0; c < 3; c++)
           {
-            patches[k * 4 + c] += in[(j * width + i) * 4 + c];
+            sum[c] += in[(j * width + i) * 4 + c];
 
             // Debug : inpaint a black square in the preview to ensure the coordanites of
             // overlay drawings and actual pixel processing match
@@ -1364,12 +1374,13 @@ static const extraction_result_t _extract_patches(const float *const restrict in
         }
       }
 
-    for(size_t c = 0; c < 3; c++) patches[k * 4 + c] /= (float)num_elem;
+    for(size_t c = 0; c < 3; c++) sum[c] /= (float)num_elem;
 
     // Convert to XYZ
     dt_aligned_pixel_t XYZ = { 0 };
-    dot_product(patches + k * 4, RGB_to_XYZ, XYZ);
+    dot_product(sum, RGB_to_XYZ, XYZ);
     for(size_t c = 0; c < 3; c++) patches[k * 4 + c] = XYZ[c];
+    patches[k * 4 + 3] = 0.f;
   }
 
   // find reference white patch
@@ -1621,8 +1632,11 @@ void extract_color_checker(const float *const restrict in, float *const restrict
   compute_patches_delta_E(patches, g->checker, g->delta_E_in, &post_wb_delta_E, &post_wb_max_delta_E);
 
   /* Compute the matrix of mix */
+  // Each row of the matrix maps the test LMS to one channel of the reference LMS. The 3 rows are
+  // independent least-squares problems sharing the same matrix of test samples: solve them at once,
+  // factorizing a 3x3 system instead of a block-diagonal 9x9 one.
   double *const restrict Y = dt_alloc_align(g->checker->patches * 3 * sizeof(double));
-  double *const restrict A = dt_alloc_align(g->checker->patches * 3 * 9 * sizeof(double));
+  double *const restrict A = dt_alloc_align(g->checker->patches * 3 * sizeof(double));
 
   for(size_t k = 0; k < g->checker->patches; k++)
   {
@@ -1666,44 +1680,14 @@ void extract_color_checker(const float *const restrict in, float *const restrict
     else if(g->optimization == DT_SOLVE_OPTIMIZE_MAX_DELTA_E)
       w = sqrtf(sqrtf(g->delta_E_in[k]));
 
-    // fill 3 rows of the y column vector
+    // fill one row of the Y matrix, one column per channel of the reference
     for(size_t c = 0; c < 3; c++) Y[k * 3 + c] = w * LMS_ref[c];
 
-    // fill line one of the A matrix
-    A[k * 3 * 9 + 0] = w * LMS_test[0];
-    A[k * 3 * 9 + 1] = w * LMS_test[1];
-    A[k * 3 * 9 + 2] = w * LMS_test[2];
-    A[k * 3 * 9 + 3] = 0.f;
-    A[k * 3 * 9 + 4] = 0.f;
-    A[k * 3 * 9 + 5] = 0.f;
-    A[k * 3 * 9 + 6] = 0.f;
-    A[k * 3 * 9 + 7] = 0.f;
-    A[k * 3 * 9 + 8] = 0.f;
-
-    // fill line two of the A matrix
-    A[k * 3 * 9 + 9 + 0] = 0.f;
-    A[k * 3 * 9 + 9 + 1] = 0.f;
-    A[k * 3 * 9 + 9 + 2] = 0.f;
-    A[k * 3 * 9 + 9 + 3] = w * LMS_test[0];
-    A[k * 3 * 9 + 9 + 4] = w * LMS_test[1];
-    A[k * 3 * 9 + 9 + 5] = w * LMS_test[2];
-    A[k * 3 * 9 + 9 + 6] = 0.f;
-    A[k * 3 * 9 + 9 + 7] = 0.f;
-    A[k * 3 * 9 + 9 + 8] = 0.f;
-
-    // fill line three of the A matrix
-    A[k * 3 * 9 + 18 + 0] = 0.f;
-    A[k * 3 * 9 + 18 + 1] = 0.f;
-    A[k * 3 * 9 + 18 + 2] = 0.f;
-    A[k * 3 * 9 + 18 + 3] = 0.f;
-    A[k * 3 * 9 + 18 + 4] = 0.f;
-    A[k * 3 * 9 + 18 + 5] = 0.f;
-    A[k * 3 * 9 + 18 + 6] = w * LMS_test[0];
-    A[k * 3 * 9 + 18 + 7] = w * LMS_test[1];
-    A[k * 3 * 9 + 18 + 8] = w * LMS_test[2];
+    // fill one row of the A matrix
+    for(size_t c = 0; c < 3; c++) A[k * 3 + c] = w * LMS_test[c];
   }
 
-  pseudo_solve_gaussian(A, Y, g->checker->patches * 3, 9, TRUE);
+  pseudo_solve_gaussian_multi(A, Y, g->checker->patches, 3, 3);
 
   // repack the matrix
   repack_double3x3_to_3xSSE(Y, g->mix);
@@ -36,6 +36,7 @@
 #include <string.h>
 
 #define ROUND_POSISTIVE(f) ((unsigned int)((f)+0.5))
+#define BINS (256) // keep in sync with clahe.cl
 
 DT_MODULE(1)
 
@@ -58,6 +59,13 @@ typedef struct dt_iop_rlce_data_t
   double slope;
 } dt_iop_rlce_data_t;
 
+typedef struct dt_iop_rlce_global_data_t
+{
+  int kernel_clahe_bins;
+  int kernel_clahe_rows;
+  int kernel_clahe_apply;
+} dt_iop_rlce_global_data_t;
+
 
 const char *name()
 {
@@ -90,8 +98,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   dt_iop_rlce_data_t *data = (dt_iop_rlce_data_t *)piece->data;
   const int ch = piece->colors;
 
-  // PASS1: Get a luminance map of image...
-  float *luminance = (float *)malloc(sizeof(float) * ((size_t)roi_out->width * roi_out->height));
+  // PASS1: Get a luminance map of image, already turned into histogram bins
+  int *luminance = (int *)malloc(sizeof(int) * ((size_t)roi_out->width * roi_out->height));
 // double lsmax=0.0,lsmin=1.0;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
@@ -102,12 +110,13 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   for(int j = 0; j < roi_out->height; j++)
   {
     float *in = (float *)ivoid + (size_t)j * roi_out->width * ch;
-    float *lm = luminance + (size_t)j * roi_out->width;
+    int *lm = luminance + (size_t)j * roi_out->width;
     for(int i = 0; i < roi_out->width; i++)
     {
       double pmax = CLIP(fmax(in[0], fmax(in[1], in[2]))); // Max value in RGB set
       double pmin = CLIP(fmin(in[0], fmin(in[1], in[2]))); // Min value in RGB set
-      *lm = (pmax + pmin) / 2.0;                           // Pixel luminocity
+      const float l = (pmax + pmin) / 2.0;                 // Pixel luminocity
+      *lm = ROUND_POSISTIVE(l * (float)BINS);
       in += ch;
       lm++;
     }
@@ -117,8 +126,6 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   // Params
   const int rad = data->radius * roi_in->scale / piece->iscale;
 
-#define BINS (256)
-
   const float slope = data->slope;
 
   size_t destbuf_size;
@@ -150,7 +157,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     memset(hist, 0, sizeof(int) * (BINS + 1));
     for(int yi = yMin; yi < yMax; ++yi)
       for(int xi = xMin0; xi < xMax0; ++xi)
-        ++hist[ROUND_POSISTIVE(luminance[(size_t)yi * roi_in->width + xi] * (float)BINS)];
+        ++hist[luminance[(size_t)yi * roi_in->width + xi]];
 
     // Destination row
     memset(dest, 0, sizeof(float) * roi_out->width);
@@ -159,7 +166,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     for(int i = 0; i < roi_out->width; i++)
     {
 
-      int v = ROUND_POSISTIVE(luminance[(size_t)j * roi_in->width + i] * (float)BINS);
+      int v = luminance[(size_t)j * roi_in->width + i];
 
       int xMin = fmax(0, i - rad);
       int xMax = i + rad + 1;
@@ -173,7 +180,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       {
         int xMin1 = xMin - 1;
         for(int yi = yMin; yi < yMax; ++yi)
-          --hist[ROUND_POSISTIVE(luminance[(size_t)yi * roi_in->width + xMin1] * (float)BINS)];
+          --hist[luminance[(size_t)yi * roi_in->width + xMin1]];
       }
 
       /* add newly included values to histogram */
@@ -181,7 +188,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       {
         int xMax1 = xMax - 1;
         for(int yi = yMin; yi < yMax; ++yi)
-          ++hist[ROUND_POSISTIVE(luminance[(size_t)yi * roi_in->width + xMax1] * (float)BINS)];
+          ++hist[luminance[(size_t)yi * roi_in->width + xMax1]];
       }
 
       /* clip histogram and redistribute clipped entries */
@@ -191,14 +198,12 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       {
         ceb = ce;
         ce = 0;
+        // branchless, so that it vectorizes
         for(int b = 0; b <= BINS; b++)
         {
-          int d = clippedhist[b] - limit;
-          if(d > 0)
-          {
-            ce += d;
-            clippedhist[b] = limit;
-          }
+          const int d = MAX(clippedhist[b] - limit, 0);
+          ce += d;
+          clippedhist[b] -= d;
         }
 
         int d = (ce / (float)(BINS + 1));
@@ -249,8 +254,96 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
   // Cleanup
   free(luminance);
+}
+
+#ifdef HAVE_OPENCL
+int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_rlce_data_t *data = (dt_iop_rlce_data_t *)piece->data;
+  const dt_iop_rlce_global_data_t *gd = (dt_iop_rlce_global_data_t *)self->global_data;
+
+  const int devid = piece->pipe->devid;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+  const int rad = data->radius * roi_in->scale / piece->iscale;
+  const float slope = data->slope;
+  const size_t npixels = (size_t)width * height;
+  const size_t histsize = sizeof(int) * (BINS + 1) * height;
+
+  cl_mem dev_bins = NULL;
+  cl_mem dev_dest = NULL;
+  cl_mem dev_hist = NULL;
+  cl_mem dev_clipped = NULL;
+  cl_int err = -999;
+
+  dev_bins = dt_opencl_alloc_device_buffer(devid, sizeof(int) * npixels);
+  if(dev_bins == NULL) goto error;
+  dev_dest = dt_opencl_alloc_device_buffer(devid, sizeof(float) * npixels);
+  if(dev_dest == NULL) goto error;
+  dev_hist = dt_opencl_alloc_device_buffer(devid, histsize);
+  if(dev_hist == NULL) goto error;
+  dev_clipped = dt_opencl_alloc_device_buffer(devid, histsize);
+  if(dev_clipped == NULL) goto error;
+
+  size_t sizes[] = { ROUNDUPDWD(width, devid), ROUNDUPDHT(height, devid), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_bins, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_bins, 1, sizeof(cl_mem), (void *)&dev_bins);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_bins, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_bins, 3, sizeof(int), (void *)&height);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_clahe_bins, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  // the sliding histogram is sequential along the rows, one work item per row
+  size_t rsizes[] = { ROUNDUPDWD(height, devid), 1, 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_rows, 0, sizeof(cl_mem), (void *)&dev_bins);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_rows, 1, sizeof(cl_mem), (void *)&dev_dest);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_rows, 2, sizeof(cl_mem), (void *)&dev_hist);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_rows, 3, sizeof(cl_mem), (void *)&dev_clipped);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_rows, 4, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_rows, 5, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_rows, 6, sizeof(int), (void *)&rad);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_rows, 7, sizeof(float), (void *)&slope);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_clahe_rows, rsizes);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 1, sizeof(cl_mem), (void *)&dev_out);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 2, sizeof(cl_mem), (void *)&dev_dest);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 3, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 4, sizeof(int), (void *)&height);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_clahe_apply, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_release_mem_object(dev_bins);
+  dt_opencl_release_mem_object(dev_dest);
+  dt_opencl_release_mem_object(dev_hist);
+  dt_opencl_release_mem_object(dev_clipped);
+  return TRUE;
+
+error:
+  dt_opencl_release_mem_object(dev_bins);
+  dt_opencl_release_mem_object(dev_dest);
+  dt_opencl_release_mem_object(dev_hist);
+  dt_opencl_release_mem_object(dev_clipped);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_clahe] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
 
-#undef BINS
+void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                     const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out, struct dt_develop_tiling_t *tiling)
+{
+  const dt_iop_rlce_data_t *data = (dt_iop_rlce_data_t *)piece->data;
+  const int rad = data->radius * roi_in->scale / piece->iscale;
+
+  tiling->factor = 2.25f;    // in + out + bins
+  tiling->factor_cl = 2.5f;  // in + out + bins + dest, the histograms are one per row
+  tiling->maxbuf = 1.0f;
+  tiling->overhead = 0;
+  tiling->overlap = rad;
+  tiling->xalign = 1;
+  tiling->yalign = 1;
 }
 
 static void radius_callback(GtkWidget *slider, gpointer user_data)
@@ -313,6 +406,26 @@ void init(dt_iop_module_t *module)
   *((dt_iop_rlce_params_t *)module->default_params) = (dt_iop_rlce_params_t){ 64, 1.25 };
 }
 
+void init_global(dt_iop_module_so_t *module)
+{
+  const int program = 43; // clahe.cl, from programs.conf
+  dt_iop_rlce_global_data_t *gd = malloc(sizeof(dt_iop_rlce_global_data_t));
+  module->data = gd;
+  gd->kernel_clahe_bins = dt_opencl_create_kernel(program, "clahe_bins");
+  gd->kernel_clahe_rows = dt_opencl_create_kernel(program, "clahe_rows");
+  gd->kernel_clahe_apply = dt_opencl_create_kernel(program, "clahe_apply");
+}
+
+void cleanup_global(dt_iop_module_so_t *module)
+{
+  dt_iop_rlce_global_data_t *gd = (dt_iop_rlce_global_data_t *)module->data;
+  dt_opencl_free_kernel(gd->kernel_clahe_bins);
+  dt_opencl_free_kernel(gd->kernel_clahe_rows);
+  dt_opencl_free_kernel(gd->kernel_clahe_apply);
+  free(module->data);
+  module->data = NULL;
+}
+
 void cleanup(dt_iop_module_t *module)
 {
   free(module->params);
@@ -100,6 +100,7 @@ typedef struct dt_iop_colorin_global_data_t
 {
   int kernel_colorin_unbound;
   int kernel_colorin_clipping;
+  int kernel_colorin_clut;
 } dt_iop_colorin_global_data_t;
 
 typedef struct dt_iop_colorin_data_t
@@ -110,6 +111,7 @@ typedef struct dt_iop_colorin_data_t
   cmsHTRANSFORM *xform_cam_Lab;
   cmsHTRANSFORM *xform_cam_nrgb;
   cmsHTRANSFORM *xform_nrgb_Lab;
+  float *clut; // the transforms above sampled in a 3D LUT, shared, see dt_colorspaces_get_clut()
   float lut[3][LUT_SAMPLES];
   dt_colormatrix_t cmatrix;
   dt_colormatrix_t nmatrix;
@@ -146,7 +148,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_POINTWISE;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -440,6 +442,7 @@ void init_global(dt_iop_module_so_t *module)
   module->data = gd;
   gd->kernel_colorin_unbound = dt_opencl_create_kernel(program, "colorin_unbound");
   gd->kernel_colorin_clipping = dt_opencl_create_kernel(program, "colorin_clipping");
+  gd->kernel_colorin_clut = dt_opencl_create_kernel(28, "lut3d_tetrahedral"); // lut3d.cl, from programs.conf
 }
 
 void cleanup_global(dt_iop_module_so_t *module)
@@ -447,6 +450,7 @@ void cleanup_global(dt_iop_module_so_t *module)
   dt_iop_colorin_global_data_t *gd = (dt_iop_colorin_global_data_t *)module->data;
   dt_opencl_free_kernel(gd->kernel_colorin_unbound);
   dt_opencl_free_kernel(gd->kernel_colorin_clipping);
+  dt_opencl_free_kernel(gd->kernel_colorin_clut);
   free(module->data);
   module->data = NULL;
 }
@@ -594,6 +598,25 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     return TRUE;
   }
 
+  if(d->clut)
+  {
+    // lcms2 transforms, only without blue mapping, see commit_params()
+    const int level = DT_COLORSPACES_CLUT_LEVEL;
+    dev_m = dt_opencl_copy_host_to_device_constant(devid, sizeof(float) * 3 * level * level * level, d->clut);
+    if(dev_m == NULL) goto error;
+    size_t sizes[] = { ROUNDUPDWD(width, devid), ROUNDUPDHT(height, devid), 1 };
+    dt_opencl_set_kernel_arg(devid, gd->kernel_colorin_clut, 0, sizeof(cl_mem), (void *)&dev_in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_colorin_clut, 1, sizeof(cl_mem), (void *)&dev_out);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_colorin_clut, 2, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_colorin_clut, 3, sizeof(int), (void *)&height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_colorin_clut, 4, sizeof(cl_mem), (void *)&dev_m);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_colorin_clut, 5, sizeof(int), (void *)&level);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_colorin_clut, sizes);
+    if(err != CL_SUCCESS) goto error;
+    dt_opencl_release_mem_object(dev_m);
+    return TRUE;
+  }
+
   size_t sizes[] = { ROUNDUPDWD(width, devid), ROUNDUPDHT(height, devid), 1 };
   dev_m = dt_opencl_copy_host_to_device_constant(devid, sizeof(float) * 9, cmat);
   if(dev_m == NULL) goto error;
@@ -988,6 +1011,28 @@ static void process_lcms2_proper(struct dt_iop_module_t *self, dt_dev_pixelpipe_
   }
 }
 
+// the lcms2 transforms sampled in a 3D LUT
+static void process_clut(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                         void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
+  const int blue_mapping = d->blue_mapping && dt_image_is_matrix_correction_supported(&piece->pipe->image);
+  const size_t npixels = (size_t)roi_out->width * roi_out->height;
+  const float *const restrict in = (const float *)ivoid;
+  float *const restrict out = (float *)ovoid;
+
+  if(blue_mapping)
+  {
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(in, out, npixels) schedule(static)
+#endif
+    for(size_t k = 0; k < npixels; k++) apply_blue_mapping(in + 4 * k, out + 4 * k);
+    dt_colorspaces_clut_apply(d->clut, DT_COLORSPACES_CLUT_LEVEL, out, out, npixels);
+  }
+  else
+    dt_colorspaces_clut_apply(d->clut, DT_COLORSPACES_CLUT_LEVEL, in, out, npixels);
+}
+
 static void process_lcms2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
                           void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -995,7 +1040,11 @@ static void process_lcms2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *
   const int blue_mapping = d->blue_mapping && dt_image_is_matrix_correction_supported(&piece->pipe->image);
 
   // use general lcms2 fallback
-  if(blue_mapping)
+  if(d->clut)
+  {
+    process_clut(self, piece, ivoid, ovoid, roi_in, roi_out);
+  }
+  else if(blue_mapping)
   {
     process_lcms2_bm(self, piece, ivoid, ovoid, roi_in, roi_out);
   }
@@ -1385,7 +1434,11 @@ static void process_sse2_lcms2(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
   const int blue_mapping = d->blue_mapping && dt_image_is_matrix_correction_supported(&piece->pipe->image);
 
   // use general lcms2 fallback
-  if(blue_mapping)
+  if(d->clut)
+  {
+    process_clut(self, piece, ivoid, ovoid, roi_in, roi_out);
+  }
+  else if(blue_mapping)
   {
     process_sse2_lcms2_bm(self, piece, ivoid, ovoid, roi_in, roi_out);
   }
@@ -1458,19 +1511,21 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   if(d->xform_cam_Lab)
   {
-    cmsDeleteTransform(d->xform_cam_Lab);
+    dt_colorspaces_release_transform(d->xform_cam_Lab);
     d->xform_cam_Lab = NULL;
   }
   if(d->xform_cam_nrgb)
   {
-    cmsDeleteTransform(d->xform_cam_nrgb);
+    dt_colorspaces_release_transform(d->xform_cam_nrgb);
     d->xform_cam_nrgb = NULL;
   }
   if(d->xform_nrgb_Lab)
   {
-    cmsDeleteTransform(d->xform_nrgb_Lab);
+    dt_colorspaces_release_transform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
+  dt_colorspaces_release_clut(d->clut);
+  d->clut = NULL;
 
   d->cmatrix[0][0] = d->nmatrix[0][0] = d->lmatrix[0][0] = NAN;
   d->lut[0][0] = -1.0f;
@@ -1610,9 +1665,12 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     {
       piece->process_cl_ready = 0;
       d->cmatrix[0][0] = NAN;
-      d->xform_cam_Lab = cmsCreateTransform(d->input, input_format, Lab, TYPE_LabA_FLT, p->intent, 0);
-      d->xform_cam_nrgb = cmsCreateTransform(d->input, input_format, d->nrgb, TYPE_RGBA_FLT, p->intent, 0);
-      d->xform_nrgb_Lab = cmsCreateTransform(d->nrgb, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT, p->intent, 0);
+      d->xform_cam_Lab = dt_colorspaces_get_transform(d->input, input_format, Lab, TYPE_LabA_FLT,
+                                                      NULL, p->intent, 0, 0);
+      d->xform_cam_nrgb = dt_colorspaces_get_transform(d->input, input_format, d->nrgb, TYPE_RGBA_FLT,
+                                                       NULL, p->intent, 0, 0);
+      d->xform_nrgb_Lab = dt_colorspaces_get_transform(d->nrgb, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT,
+                                                       NULL, p->intent, 0, 0);
     }
     else
     {
@@ -1631,7 +1689,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     {
       piece->process_cl_ready = 0;
       d->cmatrix[0][0] = NAN;
-      d->xform_cam_Lab = cmsCreateTransform(d->input, input_format, Lab, TYPE_LabA_FLT, p->intent, 0);
+      d->xform_cam_Lab = dt_colorspaces_get_transform(d->input, input_format, Lab, TYPE_LabA_FLT,
+                                                      NULL, p->intent, 0, 0);
     }
   }
 
@@ -1640,12 +1699,12 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   {
     if(d->xform_cam_nrgb)
     {
-      cmsDeleteTransform(d->xform_cam_nrgb);
+      dt_colorspaces_release_transform(d->xform_cam_nrgb);
       d->xform_cam_nrgb = NULL;
     }
     if(d->xform_nrgb_Lab)
     {
-      cmsDeleteTransform(d->xform_nrgb_Lab);
+      dt_colorspaces_release_transform(d->xform_nrgb_Lab);
       d->xform_nrgb_Lab = NULL;
     }
     d->nrgb = NULL;
@@ -1668,10 +1727,19 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     {
       piece->process_cl_ready = 0;
       d->cmatrix[0][0] = NAN;
-      d->xform_cam_Lab = cmsCreateTransform(d->input, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT, p->intent, 0);
+      d->xform_cam_Lab = dt_colorspaces_get_transform(d->input, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT,
+                                                      NULL, p->intent, 0, 0);
     }
   }
 
+  // lcms2 is then run once per node of a 3D LUT rather than once per pixel, on CPU and OpenCL
+  if(isnan(d->cmatrix[0][0]) && d->xform_cam_Lab && input_format == TYPE_RGBA_FLT)
+  {
+    const cmsHTRANSFORM xforms[2] = { d->nrgb ? d->xform_cam_nrgb : d->xform_cam_Lab, d->xform_nrgb_Lab };
+    d->clut = dt_colorspaces_get_clut(xforms, d->nrgb ? 2 : 1, DT_COLORSPACES_CLUT_LEVEL);
+    piece->process_cl_ready = d->clut && !(d->blue_mapping && dt_image_is_matrix_correction_supported(&pipe->image));
+  }
+
   d->nonlinearlut = 0;
 
   // now try to initialize unbounded mode:
@@ -1709,6 +1777,7 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   d->xform_cam_Lab = NULL;
   d->xform_cam_nrgb = NULL;
   d->xform_nrgb_Lab = NULL;
+  d->clut = NULL;
 }
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -1717,19 +1786,21 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
   if(d->input && d->clear_input) dt_colorspaces_cleanup_profile(d->input);
   if(d->xform_cam_Lab)
   {
-    cmsDeleteTransform(d->xform_cam_Lab);
+    dt_colorspaces_release_transform(d->xform_cam_Lab);
     d->xform_cam_Lab = NULL;
   }
   if(d->xform_cam_nrgb)
   {
-    cmsDeleteTransform(d->xform_cam_nrgb);
+    dt_colorspaces_release_transform(d->xform_cam_nrgb);
     d->xform_cam_nrgb = NULL;
   }
   if(d->xform_nrgb_Lab)
   {
-    cmsDeleteTransform(d->xform_nrgb_Lab);
+    dt_colorspaces_release_transform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
+  dt_colorspaces_release_clut(d->clut);
+  d->clut = NULL;
 
   free(piece->data);
   piece->data = NULL;
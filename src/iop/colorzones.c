@@ -2519,6 +2519,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   else
     piece->request_histogram &= ~(DT_REQUEST_ON);
 
+  // only drawn in the gui
+  piece->histogram_params.for_display = TRUE;
+
 #if 0 // print new preset
   printf("p.channel = %d;\n", p->channel);
   for(int k=0; k<3; k++) for(int i=0; i<DT_IOP_COLORZONES_MAXNODES; i++)
@@ -57,12 +57,13 @@ typedef struct dt_iop_defringe_gui_data_t
   GtkWidget *thresh_scale;
 } dt_iop_defringe_gui_data_t;
 
-// would be nice to be able to precompute this only once for an image
-// typedef struct dt_iop_defringe_global_data_t
-//{
-//  float avg_edge_chroma;
-//}
-// dt_iop_defringe_global_data_t;
+typedef struct dt_iop_defringe_global_data_t
+{
+  int kernel_defringe_edges;
+  int kernel_defringe_reduce_first;
+  int kernel_defringe_reduce_second;
+  int kernel_defringe_apply;
+} dt_iop_defringe_global_data_t;
 
 
 const char *name()
@@ -105,30 +106,31 @@ int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_p
   return IOP_CS_LAB;
 }
 
-// Verify before actually using this
-/*
-void tiling_callback  (dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi_in,
-const dt_iop_roi_t *roi_out, dt_develop_tiling_t *tiling)
+void tiling_callback(struct dt_iop_module_t *module, struct dt_dev_pixelpipe_iop_t *piece,
+                     const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out, struct dt_develop_tiling_t *tiling)
 {
-  dt_iop_defringe_data_t *p = (dt_iop_defringe_data_t *)piece->data;
+  const dt_iop_defringe_data_t *p = (dt_iop_defringe_data_t *)piece->data;
 
   const int width = roi_in->width;
   const int height = roi_in->height;
-  const int channels = piece->colors;
-  const size_t basebuffer = width*height*channels*sizeof(float);
+  const int channels = 4;
+  const size_t basebuffer = sizeof(float) * channels * width * height;
+  const float sigma = fmax(0.1f, fabs(p->radius)) * roi_in->scale / piece->iscale;
+  const int radius = ceil(2.0 * ceilf(sigma));
 
-  tiling->factor = 2.0f + (float)dt_gaussian_memory_use(width, height, channels)/basebuffer;
+  tiling->factor = 2.0f + (float)dt_gaussian_memory_use(width, height, channels) / basebuffer;
 #ifdef HAVE_OPENCL
-  tiling->factor_cl = 2.0f + (float)dt_gaussian_memory_use_cl(width, height, channels)/basebuffer;
+  // + blurred image + edges
+  tiling->factor_cl = 3.25f + (float)dt_gaussian_memory_use_cl(width, height, channels) / basebuffer;
 #endif
-  tiling->maxbuf = fmax(1.0f, (float)dt_gaussian_singlebuffer_size(width, height, channels)/basebuffer);
+  tiling->maxbuf = fmax(1.0f, (float)dt_gaussian_singlebuffer_size(width, height, channels) / basebuffer);
+  tiling->maxbuf_cl = tiling->maxbuf;
   tiling->overhead = 0;
-  tiling->overlap = p->window;
+  // the lattice of the local average reaches the farthest
+  tiling->overlap = 24 + radius * 4;
   tiling->xalign = 1;
   tiling->yalign = 1;
-  return;
 }
-*/
 
 // fibonacci lattice to select surrounding pixels for different cases
 static const float fib[] = { 0, 1, 1, 2, 3, 5, 8, 13, 21, 34, 55, 89, 144, 233 };
@@ -151,7 +153,44 @@ static inline void fib_latt(int *const x, int *const y, float radius, int step,
   *y = round(dy - radius / 2.0);
 }
 
-#define MAGIC_THRESHOLD_COEFF 33.0
+#define MAGIC_THRESHOLD_COEFF 33.0 // keep in sync with defringe.cl
+#define REDUCESIZE 64
+
+// index in fib[] of the number of samples of the lattice for the local average
+static int _sample_index(const int radius)
+{
+  const int samples_wish = radius * radius;
+  // select samples by fibonacci number
+  if(samples_wish > 89)
+  {
+    return 12; // 144 samples
+  }
+  else if(samples_wish > 55)
+  {
+    return 11; // 89 samples
+  }
+  else if(samples_wish > 34)
+  {
+    return 10; // ..you get the idea
+  }
+  else if(samples_wish > 21)
+  {
+    return 9;
+  }
+  else if(samples_wish > 13)
+  {
+    return 8;
+  }
+  else
+  { // don't use less than 13 samples
+    return 7;
+  }
+}
+
+static void _lattice(int *const xy, const int samples, const float radius, const int idx)
+{
+  for(int u = 0; u < samples; u++) fib_latt(&xy[2 * u], &xy[2 * u + 1], radius, u, idx);
+}
 
 // the basis of how the following algorithm works comes from rawtherapee (http://rawtherapee.com/)
 // defringe -- thanks to Emil Martinec <ejmartin@uchicago.edu> for that
@@ -203,33 +242,7 @@ void process(struct dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, cons
   dt_gaussian_blur_4c(gauss, in, out);
   dt_gaussian_free(gauss);
 
-  const int samples_wish = radius * radius;
-  int sampleidx_avg;
-  // select samples by fibonacci number
-  if(samples_wish > 89)
-  {
-    sampleidx_avg = 12; // 144 samples
-  }
-  else if(samples_wish > 55)
-  {
-    sampleidx_avg = 11; // 89 samples
-  }
-  else if(samples_wish > 34)
-  {
-    sampleidx_avg = 10; // ..you get the idea
-  }
-  else if(samples_wish > 21)
-  {
-    sampleidx_avg = 9;
-  }
-  else if(samples_wish > 13)
-  {
-    sampleidx_avg = 8;
-  }
-  else
-  { // don't use less than 13 samples
-    sampleidx_avg = 7;
-  }
+  const int sampleidx_avg = _sample_index(radius);
   const int sampleidx_small = sampleidx_avg - 1;
 
   const int small_radius = MAX(radius, 3);
@@ -249,20 +262,8 @@ void process(struct dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, cons
   }
 
   // precompute all required fibonacci lattices:
-  for(int u = 0; u < samples_avg; u++)
-  {
-    int dx, dy;
-    fib_latt(&dx, &dy, avg_radius, u, sampleidx_avg);
-    xy_avg[2*u] = dx;
-    xy_avg[2*u+1] = dy;
-  }
-  for(int u = 0; u < samples_small; u++)
-  {
-    int dx, dy;
-    fib_latt(&dx, &dy, small_radius, u, sampleidx_small);
-    xy_small[2*u] = dx;
-    xy_small[2*u+1] = dy;
-  }
+  _lattice(xy_avg, samples_avg, avg_radius, sampleidx_avg);
+  _lattice(xy_small, samples_small, small_radius, sampleidx_small);
 
   const float use_global_average = MODE_GLOBAL_AVERAGE == d->op_mode;
 #ifdef _OPENMP
@@ -408,6 +409,211 @@ FINISH_PROCESS:
   free(xy_avg);
 }
 
+#ifdef HAVE_OPENCL
+int process_cl(struct dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_defringe_data_t *const d = (dt_iop_defringe_data_t *)piece->data;
+  const dt_iop_defringe_global_data_t *gd = (dt_iop_defringe_global_data_t *)module->global_data;
+
+  const int devid = piece->pipe->devid;
+  const int width = roi_in->width;
+  const int height = roi_in->height;
+
+  const int order = 1; // 0,1,2
+  const float sigma = fmax(0.1f, fabs(d->radius)) * roi_in->scale / piece->iscale;
+  const float Labmax[] = { 100.0f, 128.0f, 128.0f, 1.0f };
+  const float Labmin[] = { 0.0f, -128.0f, -128.0f, 0.0f };
+  const int radius = ceil(2.0 * ceilf(sigma));
+
+  const int sampleidx_avg = _sample_index(radius);
+  const int sampleidx_small = sampleidx_avg - 1;
+  const int small_radius = MAX(radius, 3);
+  const int avg_radius = 24 + radius * 4;
+  const int samples_small = fib[sampleidx_small];
+  const int samples_avg = fib[sampleidx_avg];
+  int xy_avg[2 * 144];
+  int xy_small[2 * 144];
+
+  dt_gaussian_cl_t *g = NULL;
+  cl_mem dev_blurred = NULL;
+  cl_mem dev_edges = NULL;
+  cl_mem dev_m = NULL;
+  cl_mem dev_r = NULL;
+  cl_mem dev_xy_avg = NULL;
+  cl_mem dev_xy_small = NULL;
+  float *sums = NULL;
+  cl_int err = -999;
+
+  if(roi_out->width < 2 * radius + 1 || roi_out->height < 2 * radius + 1)
+  {
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { width, height, 1 };
+    err = dt_opencl_enqueue_copy_image(devid, dev_in, dev_out, origin, origin, region);
+    if(err != CL_SUCCESS) goto error;
+    return TRUE;
+  }
+
+  dev_blurred = dt_opencl_alloc_device(devid, width, height, sizeof(float) * 4);
+  if(dev_blurred == NULL) goto error;
+  dev_edges = dt_opencl_alloc_device_buffer(devid, sizeof(float) * width * height);
+  if(dev_edges == NULL) goto error;
+
+  g = dt_gaussian_init_cl(devid, width, height, 4, Labmax, Labmin, sigma, order);
+  if(g == NULL) goto error;
+  err = dt_gaussian_blur_cl(g, dev_in, dev_blurred);
+  if(err != CL_SUCCESS) goto error;
+  dt_gaussian_free_cl(g);
+  g = NULL;
+
+  size_t sizes[] = { ROUNDUPDWD(width, devid), ROUNDUPDHT(height, devid), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_edges, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_edges, 1, sizeof(cl_mem), (void *)&dev_blurred);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_edges, 2, sizeof(cl_mem), (void *)&dev_edges);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_edges, 3, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_edges, 4, sizeof(int), (void *)&height);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_defringe_edges, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  float avg_edge_chroma;
+  float thresh;
+  if(MODE_GLOBAL_AVERAGE == d->op_mode)
+  {
+    // the average chroma of the edge-layer in the roi, reduced on the device
+    err = -999;
+    dt_opencl_local_buffer_t flocopt
+      = (dt_opencl_local_buffer_t){ .xoffset = 0, .xfactor = 1, .yoffset = 0, .yfactor = 1,
+                                    .cellsize = sizeof(float), .overhead = 0,
+                                    .sizex = 1u << 4, .sizey = 1u << 4 };
+    if(!dt_opencl_local_buffer_opt(devid, gd->kernel_defringe_reduce_first, &flocopt)) goto error;
+
+    const size_t bwidth = ROUNDUP(width, flocopt.sizex);
+    const size_t bheight = ROUNDUP(height, flocopt.sizey);
+    const int bufsize = (bwidth / flocopt.sizex) * (bheight / flocopt.sizey);
+
+    dt_opencl_local_buffer_t slocopt
+      = (dt_opencl_local_buffer_t){ .xoffset = 0, .xfactor = 1, .yoffset = 0, .yfactor = 1,
+                                    .cellsize = sizeof(float), .overhead = 0,
+                                    .sizex = 1u << 16, .sizey = 1 };
+    if(!dt_opencl_local_buffer_opt(devid, gd->kernel_defringe_reduce_second, &slocopt)) goto error;
+
+    const int reducesize = MIN(REDUCESIZE, ROUNDUP(bufsize, slocopt.sizex) / slocopt.sizex);
+
+    dev_m = dt_opencl_alloc_device_buffer(devid, sizeof(float) * bufsize);
+    if(dev_m == NULL) goto error;
+    dev_r = dt_opencl_alloc_device_buffer(devid, sizeof(float) * reducesize);
+    if(dev_r == NULL) goto error;
+    sums = dt_alloc_align_float(reducesize);
+    if(sums == NULL) goto error;
+
+    size_t fsizes[] = { bwidth, bheight, 1 };
+    size_t flocal[] = { flocopt.sizex, flocopt.sizey, 1 };
+    dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_reduce_first, 0, sizeof(cl_mem), (void *)&dev_edges);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_reduce_first, 1, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_reduce_first, 2, sizeof(int), (void *)&height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_reduce_first, 3, sizeof(cl_mem), (void *)&dev_m);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_reduce_first, 4,
+                             sizeof(float) * flocopt.sizex * flocopt.sizey, NULL);
+    err = dt_opencl_enqueue_kernel_2d_with_local(devid, gd->kernel_defringe_reduce_first, fsizes, flocal);
+    if(err != CL_SUCCESS) goto error;
+
+    size_t ssizes[] = { (size_t)reducesize * slocopt.sizex, 1, 1 };
+    size_t slocal[] = { slocopt.sizex, 1, 1 };
+    dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_reduce_second, 0, sizeof(cl_mem), (void *)&dev_m);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_reduce_second, 1, sizeof(cl_mem), (void *)&dev_r);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_reduce_second, 2, sizeof(int), (void *)&bufsize);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_reduce_second, 3, sizeof(float) * slocopt.sizex, NULL);
+    err = dt_opencl_enqueue_kernel_2d_with_local(devid, gd->kernel_defringe_reduce_second, ssizes, slocal);
+    if(err != CL_SUCCESS) goto error;
+
+    err = dt_opencl_read_buffer_from_device(devid, (void *)sums, dev_r, 0, sizeof(float) * reducesize, CL_TRUE);
+    if(err != CL_SUCCESS) goto error;
+
+    avg_edge_chroma = 0.0f;
+    for(int k = 0; k < reducesize; k++) avg_edge_chroma += sums[k];
+    avg_edge_chroma = avg_edge_chroma / (width * height) + 10.0 * FLT_EPSILON;
+    thresh = fmax(0.1f, 4.0 * d->thresh * avg_edge_chroma / MAGIC_THRESHOLD_COEFF);
+  }
+  else
+  {
+    // this fixed value will later be changed when doing local averaging, or kept as-is in "static" mode
+    avg_edge_chroma = MAGIC_THRESHOLD_COEFF;
+    thresh = fmax(0.1f, d->thresh);
+  }
+
+  _lattice(xy_avg, samples_avg, avg_radius, sampleidx_avg);
+  _lattice(xy_small, samples_small, small_radius, sampleidx_small);
+  err = -999;
+  dev_xy_avg = dt_opencl_copy_host_to_device_constant(devid, sizeof(int) * 2 * samples_avg, xy_avg);
+  if(dev_xy_avg == NULL) goto error;
+  dev_xy_small = dt_opencl_copy_host_to_device_constant(devid, sizeof(int) * 2 * samples_small, xy_small);
+  if(dev_xy_small == NULL) goto error;
+
+  const int local_average = MODE_LOCAL_AVERAGE == d->op_mode;
+  const float user_thresh = d->thresh;
+  const int mask_display = (piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) != 0;
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 1, sizeof(cl_mem), (void *)&dev_out);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 2, sizeof(cl_mem), (void *)&dev_edges);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 3, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 4, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 5, sizeof(cl_mem), (void *)&dev_xy_avg);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 6, sizeof(int), (void *)&samples_avg);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 7, sizeof(cl_mem), (void *)&dev_xy_small);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 8, sizeof(int), (void *)&samples_small);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 9, sizeof(float), (void *)&thresh);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 10, sizeof(float), (void *)&avg_edge_chroma);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 11, sizeof(int), (void *)&local_average);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 12, sizeof(float), (void *)&user_thresh);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_defringe_apply, 13, sizeof(int), (void *)&mask_display);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_defringe_apply, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_release_mem_object(dev_blurred);
+  dt_opencl_release_mem_object(dev_edges);
+  dt_opencl_release_mem_object(dev_m);
+  dt_opencl_release_mem_object(dev_r);
+  dt_opencl_release_mem_object(dev_xy_avg);
+  dt_opencl_release_mem_object(dev_xy_small);
+  dt_free_align(sums);
+  return TRUE;
+
+error:
+  if(g) dt_gaussian_free_cl(g);
+  dt_opencl_release_mem_object(dev_blurred);
+  dt_opencl_release_mem_object(dev_edges);
+  dt_opencl_release_mem_object(dev_m);
+  dt_opencl_release_mem_object(dev_r);
+  dt_opencl_release_mem_object(dev_xy_avg);
+  dt_opencl_release_mem_object(dev_xy_small);
+  dt_free_align(sums);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_defringe] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
+void init_global(dt_iop_module_so_t *module)
+{
+  const int program = 45; // defringe.cl, from programs.conf
+  dt_iop_defringe_global_data_t *gd = malloc(sizeof(dt_iop_defringe_global_data_t));
+  module->data = gd;
+  gd->kernel_defringe_edges = dt_opencl_create_kernel(program, "defringe_edges");
+  gd->kernel_defringe_reduce_first = dt_opencl_create_kernel(program, "defringe_reduce_first");
+  gd->kernel_defringe_reduce_second = dt_opencl_create_kernel(program, "defringe_reduce_second");
+  gd->kernel_defringe_apply = dt_opencl_create_kernel(program, "defringe_apply");
+}
+
+void cleanup_global(dt_iop_module_so_t *module)
+{
+  dt_iop_defringe_global_data_t *gd = (dt_iop_defringe_global_data_t *)module->data;
+  dt_opencl_free_kernel(gd->kernel_defringe_edges);
+  dt_opencl_free_kernel(gd->kernel_defringe_reduce_first);
+  dt_opencl_free_kernel(gd->kernel_defringe_reduce_second);
+  dt_opencl_free_kernel(gd->kernel_defringe_apply);
+  free(module->data);
+  module->data = NULL;
+}
+
 void gui_init(dt_iop_module_t *self)
 {
   dt_iop_defringe_gui_data_t *g = IOP_GUI_ALLOC(defringe);
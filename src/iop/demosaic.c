@@ -20,6 +20,7 @@
 #include "config.h"
 #endif
 
+#include "common/box_filters.h"
 #include "common/darktable.h"
 #include "common/imagebuf.h"
 #include "common/image_cache.h"
@@ -240,7 +241,26 @@ static int demosaic_qual_flags(const dt_dev_pixelpipe_iop_t *const piece,
                                const dt_image_t *const img,
                                const dt_iop_roi_t *const roi_out)
 {
-  return DEMOSAIC_FULL_SCALE | DEMOSAIC_XTRANS_FULL;
+  const int full = DEMOSAIC_FULL_SCALE | DEMOSAIC_XTRANS_FULL;
+
+  // the main darkroom and export pipes get what the user asked for, except for drafts
+  if(!piece->pipe->draft
+     && (!(piece->pipe->type & (DT_DEV_PIXELPIPE_PREVIEW | DT_DEV_PIXELPIPE_THUMBNAIL))
+         || !dt_conf_get_bool("plugins/darkroom/demosaic/preview_to_scale")))
+    return full;
+
+  // the half and third size paths don't convert CYGM to RGB
+  if(img->flags & DT_IMAGE_4BAYER) return full;
+
+  // The half and third size paths sample whole CFA blocks, Bayer 2x2 or X-Trans 3x3, straight
+  // at the output scale. Once an output pixel covers at least one block, they don't lose detail
+  // against a full demosaic followed by a downscale, and their cost follows the output size.
+  const float block_scale = (piece->pipe->dsc.filters == 9u) ? 1.0f / 3.0f : 0.5f;
+  if(roi_out->scale <= block_scale + 1e-4f) return 0;
+
+  // Between one block and one photosite per output pixel, we still need to demosaic first,
+  // but the downscale hides the difference between methods, so use the fast one.
+  return full | DEMOSAIC_MEDIUM_QUAL;
 }
 
 // Implemented on amaze_demosaic_RT.cc
@@ -542,7 +562,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       else if(demosaicing_method >= DT_IOP_DEMOSAIC_MARKESTEIJN && (qual_flags & DEMOSAIC_XTRANS_FULL))
         xtrans_markesteijn_interpolate(tmp, pixels, &roo, &roi, xtrans, passes);
       else
-        vng_interpolate(tmp, pixels, &roo, &roi, piece->pipe->dsc.filters, xtrans, qual_flags & DEMOSAIC_ONLY_VNG_LINEAR);
+        vng_interpolate(tmp, pixels, &roo, &roi, piece->pipe->dsc.filters, xtrans, qual_flags & DEMOSAIC_ONLY_VNG_LINEAR,
+                        NULL);
     }
     else
     {
@@ -575,7 +596,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
       if(demosaicing_method == DT_IOP_DEMOSAIC_VNG4 || (img->flags & DT_IMAGE_4BAYER))
       {
-        vng_interpolate(tmp, in, &roo, &roi, piece->pipe->dsc.filters, xtrans, qual_flags & DEMOSAIC_ONLY_VNG_LINEAR);
+        vng_interpolate(tmp, in, &roo, &roi, piece->pipe->dsc.filters, xtrans, qual_flags & DEMOSAIC_ONLY_VNG_LINEAR,
+                        NULL);
         if(img->flags & DT_IMAGE_4BAYER)
         {
           dt_colorspaces_cygm_to_rgb(tmp, roo.width*roo.height, data->CAM_to_RGB);
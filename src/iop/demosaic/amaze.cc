@@ -405,8 +405,13 @@ void amaze_demosaic_RT(dt_dev_pixelpipe_iop_t *piece, const float *const in,
     float v;
   } s_hv;
 
+  // each thread allocates its tile buffers up front, don't start more threads than there are tiles: small
+  // images like thumbnails only have a few of them
+  const int tiles = ((height + 16 + ts - 33) / (ts - 32)) * ((width + 16 + ts - 33) / (ts - 32));
+  const int nthreads = MAX(1, MIN(dt_omp_threads(), tiles));
+
 #ifdef _OPENMP
-#pragma omp parallel
+#pragma omp parallel num_threads(nthreads)
 #endif
   {
     //     int progresscounter = 0;
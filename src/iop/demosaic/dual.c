@@ -25,6 +25,9 @@
 */
 
 
+// above this weight of the high-frequency demosaic, the contribution of VNG is invisible and not computed
+#define DUAL_BLEND_SATURATED (1.0f - 1.0f / 1024.0f)
+
 static float slider2contrast(float slider)
 {
   return 0.005f * powf(slider, 1.1f);
@@ -42,8 +45,9 @@ static void dual_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict r
 
   float *blend = dt_alloc_align_float((size_t) width * height);
   float *tmp = dt_alloc_align_float((size_t) width * height);
-  float *vng_image = dt_alloc_align_float((size_t) 4 * width * height);
-  if(!blend || !tmp || !vng_image)
+  // showing the mask doesn't need the VNG image
+  float *vng_image = dual_mask ? NULL : dt_alloc_align_float((size_t) 4 * width * height);
+  if(!blend || !tmp || (!dual_mask && !vng_image))
   {
     if(tmp) dt_free_align(tmp);
     if(blend) dt_free_align(blend);
@@ -53,14 +57,12 @@ static void dual_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict r
   }
   const gboolean info = ((darktable.unmuted & (DT_DEBUG_DEMOSAIC | DT_DEBUG_PERF)) && (piece->pipe->type == DT_DEV_PIXELPIPE_FULL));
 
-  vng_interpolate(vng_image, raw_data, roi_out, roi_in, filters, xtrans, FALSE);
-  color_smoothing(vng_image, roi_out, 2);
-
   dt_times_t start_blend = { 0 }, end_blend = { 0 };
   if(info) dt_get_times(&start_blend);
 
   const float contrastf = slider2contrast(dual_threshold);
 
+  // the mask only depends on the high-frequency demosaic, compute it first to know where VNG is needed
   dt_masks_calc_rawdetail_mask(rgb_data, blend, tmp, width, height, piece->pipe->dsc.temperature.coeffs);
   dt_masks_calc_detail_mask(blend, blend, tmp, width, height, contrastf, TRUE);
 
@@ -80,16 +82,38 @@ static void dual_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict r
   }
   else
   {
+    // VNG is needed where it gets blended in, and around that within the reach of the two 3x3 passes of
+    // color_smoothing(). Detailed areas, where the mask saturates, are left alone.
+    int blended = 0;
 #ifdef _OPENMP
   #pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(blend, rgb_data, vng_image, width, height) \
-  schedule(simd:static) aligned(blend, vng_image, rgb_data : 64)
+  dt_omp_firstprivate(blend, tmp, width, height) \
+  schedule(simd:static) aligned(blend, tmp : 64) reduction(|| : blended)
 #endif
     for(int idx = 0; idx < width * height; idx++)
     {
-      const int oidx = 4 * idx;
-      for(int c = 0; c < 4; c++)
-        rgb_data[oidx + c] = intp(blend[idx], rgb_data[oidx + c], vng_image[oidx + c]);
+      tmp[idx] = (blend[idx] < DUAL_BLEND_SATURATED) ? 1.0f : 0.0f;
+      blended = blended || (blend[idx] < DUAL_BLEND_SATURATED);
+    }
+
+    if(blended)
+    {
+      dt_box_max(tmp, height, width, 1, 2);
+      vng_interpolate(vng_image, raw_data, roi_out, roi_in, filters, xtrans, FALSE, tmp);
+      color_smoothing(vng_image, roi_out, 2);
+
+#ifdef _OPENMP
+  #pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(blend, rgb_data, vng_image, width, height) \
+  schedule(simd:static) aligned(blend, vng_image, rgb_data : 64)
+#endif
+      for(int idx = 0; idx < width * height; idx++)
+      {
+        if(blend[idx] >= DUAL_BLEND_SATURATED) continue;
+        const int oidx = 4 * idx;
+        for(int c = 0; c < 4; c++)
+          rgb_data[oidx + c] = intp(blend[idx], rgb_data[oidx + c], vng_image[oidx + c]);
+      }
     }
   }
   if(info)
@@ -99,7 +123,7 @@ static void dual_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict r
   }
   dt_free_align(tmp);
   dt_free_align(blend);
-  dt_free_align(vng_image);
+  if(vng_image) dt_free_align(vng_image);
 }
 
 #ifdef HAVE_OPENCL
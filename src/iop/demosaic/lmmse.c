@@ -165,9 +165,11 @@ static void lmmse_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict
 
   const int num_vertical =   1 + (height - 2 * LMMSE_OVERLAP -1) / LMMSE_TILEVALID;
   const int num_horizontal = 1 + (width  - 2 * LMMSE_OVERLAP -1) / LMMSE_TILEVALID;
+  // each thread allocates and clears its tile buffer, don't start more threads than there are tiles
+  const int nthreads = MAX(1, MIN(dt_omp_threads(), num_vertical * num_horizontal));
 #ifdef _OPENMP
   #pragma omp parallel \
-  dt_omp_firstprivate(width, height, out, in, scaler, revscaler, filters)
+  dt_omp_firstprivate(width, height, out, in, scaler, revscaler, filters) num_threads(nthreads)
 #endif
   {
     float *qix[6];
@@ -83,37 +83,43 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
 
   // extra passes propagates out errors at edges, hence need more padding
   const int pad_tile = (passes == 1) ? 12 : 17;
+  // tiles start every tile_step pixels from -pad_tile, in both directions
+  const int tile_step = TS - 2 * pad_tile;
+  const int num_vertical = (height + tile_step - 1) / tile_step;
+  const int num_horizontal = (width + tile_step - 1) / tile_step;
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(all_buffers, padded_buffer_size, dir, height, in, ndir, pad_tile, passes, roi_in, width, xtrans) \
+#pragma omp parallel for collapse(2) default(none) \
+  dt_omp_firstprivate(num_vertical, num_horizontal, tile_step, all_buffers, padded_buffer_size, dir, height, in, ndir, pad_tile, passes, roi_in, width, xtrans) \
   shared(sgrow, sgcol, allhex, out) \
-  schedule(static)
+  schedule(dynamic)
 #endif
   // step through TSxTS cells of image, each tile overlapping the
   // prior as interpolation needs a substantial border
-  for(int top = -pad_tile; top < height - pad_tile; top += TS - (pad_tile*2))
+  for(int tile_vertical = 0; tile_vertical < num_vertical; tile_vertical++)
   {
-    char *const buffer = dt_get_perthread(all_buffers, padded_buffer_size);
-    // rgb points to ndir TSxTS tiles of 3 channels (R, G, and B)
-    float(*rgb)[TS][TS][3] = (float(*)[TS][TS][3])buffer;
-    // yuv points to 3 channel (Y, u, and v) TSxTS tiles
-    // note that channels come before tiles to allow for a
-    // vectorization optimization when building drv[] from yuv[]
-    float (*const yuv)[TS][TS] = (float(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
-    // drv points to ndir TSxTS tiles, each a single channel of derivatives
-    float (*const drv)[TS][TS] = (float(*)[TS][TS])(buffer + TS * TS * (ndir * 3 + 3) * sizeof(float));
-    // gmin and gmax reuse memory which is used later by yuv buffer;
-    // each points to a TSxTS tile of single channel data
-    float (*const gmin)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
-    float (*const gmax)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3 + 1) * sizeof(float));
-    // homo and homosum reuse memory which is used earlier in the
-    // loop; each points to ndir single-channel TSxTS tiles
-    uint8_t (*const homo)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
-    uint8_t (*const homosum)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float)
-                                                            + TS * TS * ndir * sizeof(uint8_t));
-
-    for(int left = -pad_tile; left < width - pad_tile; left += TS - (pad_tile*2))
+    for(int tile_horizontal = 0; tile_horizontal < num_horizontal; tile_horizontal++)
     {
+      const int top = -pad_tile + tile_vertical * tile_step;
+      const int left = -pad_tile + tile_horizontal * tile_step;
+      char *const buffer = dt_get_perthread(all_buffers, padded_buffer_size);
+      // rgb points to ndir TSxTS tiles of 3 channels (R, G, and B)
+      float(*rgb)[TS][TS][3] = (float(*)[TS][TS][3])buffer;
+      // yuv points to 3 channel (Y, u, and v) TSxTS tiles
+      // note that channels come before tiles to allow for a
+      // vectorization optimization when building drv[] from yuv[]
+      float (*const yuv)[TS][TS] = (float(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
+      // drv points to ndir TSxTS tiles, each a single channel of derivatives
+      float (*const drv)[TS][TS] = (float(*)[TS][TS])(buffer + TS * TS * (ndir * 3 + 3) * sizeof(float));
+      // gmin and gmax reuse memory which is used later by yuv buffer;
+      // each points to a TSxTS tile of single channel data
+      float (*const gmin)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
+      float (*const gmax)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3 + 1) * sizeof(float));
+      // homo and homosum reuse memory which is used earlier in the
+      // loop; each points to ndir single-channel TSxTS tiles
+      uint8_t (*const homo)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
+      uint8_t (*const homosum)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float)
+                                                              + TS * TS * ndir * sizeof(uint8_t));
+
       int mrow = MIN(top + TS, height + pad_tile);
       int mcol = MIN(left + TS, width + pad_tile);
 
@@ -1120,44 +1126,50 @@ static void xtrans_fdc_interpolate(struct dt_iop_module_t *self, float *out, con
     hybrid_fdc[1] = 1.0f;
   }
 
+  // tiles start every tile_step pixels from -pad_tile, in both directions
+  const int tile_step = TS - 2 * pad_tile;
+  const int num_vertical = (height + tile_step - 1) / tile_step;
+  const int num_horizontal = (width + tile_step - 1) / tile_step;
 #ifdef _OPENMP
-#pragma omp parallel for default(none)                                                                            \
+#pragma omp parallel for collapse(2) default(none)                                                                \
     dt_omp_firstprivate(ndir, all_buffers, dir, directionality, harr, height, in, Minv, modarr, roi_in, width,    \
-                        xtrans, pad_tile, padded_buffer_size)                                                     \
-        shared(sgrow, sgcol, allhex, out, rowoffset, coloffset, hybrid_fdc) schedule(static)
+                        xtrans, pad_tile, padded_buffer_size, num_vertical, num_horizontal, tile_step)            \
+        shared(sgrow, sgcol, allhex, out, rowoffset, coloffset, hybrid_fdc) schedule(dynamic)
 #endif
   // step through TSxTS cells of image, each tile overlapping the
   // prior as interpolation needs a substantial border
-  for(int top = -pad_tile; top < height - pad_tile; top += TS - (pad_tile * 2))
+  for(int tile_vertical = 0; tile_vertical < num_vertical; tile_vertical++)
   {
-    char *const buffer = dt_get_perthread(all_buffers, padded_buffer_size);
-    // rgb points to ndir TSxTS tiles of 3 channels (R, G, and B)
-    float(*rgb)[TS][TS][3] = (float(*)[TS][TS][3])buffer;
-    // yuv points to 3 channel (Y, u, and v) TSxTS tiles
-    // note that channels come before tiles to allow for a
-    // vectorization optimization when building drv[] from yuv[]
-    float (*const yuv)[TS][TS] = (float(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
-    // drv points to ndir TSxTS tiles, each a single channel of derivatives
-    float (*const drv)[TS][TS] = (float(*)[TS][TS])(buffer + TS * TS * (ndir * 3 + 3) * sizeof(float));
-    // gmin and gmax reuse memory which is used later by yuv buffer;
-    // each points to a TSxTS tile of single channel data
-    float (*const gmin)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
-    float (*const gmax)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3 + 1) * sizeof(float));
-    // homo and homosum reuse memory which is used earlier in the
-    // loop; each points to ndir single-channel TSxTS tiles
-    uint8_t (*const homo)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
-    uint8_t (*const homosum)[TS][TS]
-        = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float) + TS * TS * ndir * sizeof(uint8_t));
-    // append all fdc related buffers
-    float complex *fdc_buf_start = (float complex *)(buffer + TS * TS * (ndir * 4 + 3) * sizeof(float));
-    const int fdc_buf_size = TS * TS;
-    float(*const i_src) = (float *)fdc_buf_start;
-    float complex(*const o_src) = fdc_buf_start + fdc_buf_size;
-    // by the time the chroma values are calculated, o_src can be overwritten.
-    float(*const fdc_chroma) = (float *)o_src;
-
-    for(int left = -pad_tile; left < width - pad_tile; left += TS - (pad_tile * 2))
+    for(int tile_horizontal = 0; tile_horizontal < num_horizontal; tile_horizontal++)
     {
+      const int top = -pad_tile + tile_vertical * tile_step;
+      const int left = -pad_tile + tile_horizontal * tile_step;
+      char *const buffer = dt_get_perthread(all_buffers, padded_buffer_size);
+      // rgb points to ndir TSxTS tiles of 3 channels (R, G, and B)
+      float(*rgb)[TS][TS][3] = (float(*)[TS][TS][3])buffer;
+      // yuv points to 3 channel (Y, u, and v) TSxTS tiles
+      // note that channels come before tiles to allow for a
+      // vectorization optimization when building drv[] from yuv[]
+      float (*const yuv)[TS][TS] = (float(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
+      // drv points to ndir TSxTS tiles, each a single channel of derivatives
+      float (*const drv)[TS][TS] = (float(*)[TS][TS])(buffer + TS * TS * (ndir * 3 + 3) * sizeof(float));
+      // gmin and gmax reuse memory which is used later by yuv buffer;
+      // each points to a TSxTS tile of single channel data
+      float (*const gmin)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
+      float (*const gmax)[TS] = (float(*)[TS])(buffer + TS * TS * (ndir * 3 + 1) * sizeof(float));
+      // homo and homosum reuse memory which is used earlier in the
+      // loop; each points to ndir single-channel TSxTS tiles
+      uint8_t (*const homo)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float));
+      uint8_t (*const homosum)[TS][TS]
+          = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float) + TS * TS * ndir * sizeof(uint8_t));
+      // append all fdc related buffers
+      float complex *fdc_buf_start = (float complex *)(buffer + TS * TS * (ndir * 4 + 3) * sizeof(float));
+      const int fdc_buf_size = TS * TS;
+      float(*const i_src) = (float *)fdc_buf_start;
+      float complex(*const o_src) = fdc_buf_start + fdc_buf_size;
+      // by the time the chroma values are calculated, o_src can be overwritten.
+      float(*const fdc_chroma) = (float *)o_src;
+
       int mrow = MIN(top + TS, height + pad_tile);
       int mcol = MIN(left + TS, width + pad_tile);
 
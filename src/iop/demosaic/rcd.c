@@ -299,20 +299,32 @@ static void rcd_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict ou
   const int num_vertical = 1 + (height - 2 * RCD_BORDER -1) / RCD_TILEVALID;
   const int num_horizontal = 1 + (width - 2 * RCD_BORDER -1) / RCD_TILEVALID;
 
+  // All the planes of a tile live in one scratch arena per thread, about 330 kB so it stays in L2 cache.
+  // With the default tile size, half planes are a whole number of cache lines, so every plane starts aligned.
+  const size_t tile_size = (size_t)RCD_TILESIZE * RCD_TILESIZE;
+  size_t padded_arena_size;
+  float *const arenas = dt_alloc_perthread_float(13 * tile_size / 2, &padded_arena_size);
+  if(!arenas)
+  {
+    fprintf(stderr, "[rcd_demosaic] not able to allocate RCD buffers\n");
+    return;
+  }
+
 #ifdef _OPENMP
   #pragma omp parallel \
-  dt_omp_firstprivate(width, height, filters, out, in, scaler, revscaler)
+  dt_omp_firstprivate(width, height, filters, out, in, scaler, revscaler, arenas, padded_arena_size, tile_size)
 #endif
   {
-    float *const VH_Dir = dt_alloc_align_float((size_t) RCD_TILESIZE * RCD_TILESIZE);
+    float *const arena = dt_get_perthread(arenas, padded_arena_size);
+    float *const VH_Dir = arena;
     // ensure that border elements which are read but never actually set below are zeroed out
     memset(VH_Dir, 0, sizeof(*VH_Dir) * RCD_TILESIZE * RCD_TILESIZE);
-    float *const PQ_Dir = dt_alloc_align_float((size_t) RCD_TILESIZE * RCD_TILESIZE / 2);
-    float *const cfa =    dt_alloc_align_float((size_t) RCD_TILESIZE * RCD_TILESIZE);
-    float *const P_CDiff_Hpf = dt_alloc_align_float((size_t) RCD_TILESIZE * RCD_TILESIZE / 2);
-    float *const Q_CDiff_Hpf = dt_alloc_align_float((size_t) RCD_TILESIZE * RCD_TILESIZE / 2);
+    float *const PQ_Dir = VH_Dir + tile_size;
+    float *const cfa =    PQ_Dir + tile_size / 2;
+    float *const P_CDiff_Hpf = cfa + tile_size;
+    float *const Q_CDiff_Hpf = P_CDiff_Hpf + tile_size / 2;
 
-    float (*const rgb)[RCD_TILESIZE * RCD_TILESIZE] = (void *)dt_alloc_align_float((size_t)3 * RCD_TILESIZE * RCD_TILESIZE);
+    float (*const rgb)[RCD_TILESIZE * RCD_TILESIZE] = (void *)(Q_CDiff_Hpf + tile_size / 2);
 
     // No overlapping use so re-use same buffer
     float *const lpf = PQ_Dir;
@@ -558,13 +570,8 @@ static void rcd_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict ou
         }
       }
     }
-    dt_free_align(cfa);
-    dt_free_align(rgb);
-    dt_free_align(VH_Dir);
-    dt_free_align(PQ_Dir);
-    dt_free_align(P_CDiff_Hpf);
-    dt_free_align(Q_CDiff_Hpf);
   }
+  dt_free_align(arenas);
 }
 
 #ifdef HAVE_OPENCL
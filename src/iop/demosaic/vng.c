@@ -12,9 +12,12 @@
    I've extended the basic idea to work with non-Bayer filter arrays.
    Gradients are numbered clockwise from NW=0 to W=7.
  */
+// if mask is not NULL, the VNG gradients are only computed where it's not zero, the other pixels keep the
+// linear interpolation
 static void vng_interpolate(float *out, const float *const in,
                             const dt_iop_roi_t *const roi_out, const dt_iop_roi_t *const roi_in,
-                            const uint32_t filters, const uint8_t (*const xtrans)[6], const int only_vng_linear)
+                            const uint32_t filters, const uint8_t (*const xtrans)[6], const int only_vng_linear,
+                            const float *const mask)
 {
   static const signed char terms[]
       = { -2, -2, +0, -1, 1, 0x01, -2, -2, +0, +0, 2, 0x01, -2, -1, -1, +0, 1, 0x01, -2, -1, +0, -1, 1, 0x02,
@@ -112,7 +115,7 @@ static void vng_interpolate(float *out, const float *const in,
   {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-    dt_omp_firstprivate(colors, pcol, prow, roi_in, width, xtrans) \
+    dt_omp_firstprivate(colors, pcol, prow, roi_in, width, xtrans, mask) \
     shared(row, code, brow, out, filters4) \
     private(ip) \
     schedule(static)
@@ -122,6 +125,11 @@ static void vng_interpolate(float *out, const float *const in,
       int g;
       float gval[8] = { 0.0f };
       float *pix = out + 4 * (row * width + col);
+      if(mask && mask[(size_t)row * width + col] == 0.0f)
+      {
+        memcpy(brow[2][col], pix, sizeof(*out) * 4);
+        continue;
+      }
       ip = code[(row + roi_in->y) % prow][(col + roi_in->x) % pcol];
       while((g = ip[0]) != INT_MAX) /* Calculate gradients */
       {
@@ -340,6 +340,7 @@ typedef struct dt_iop_denoiseprofile_global_data_t
   int kernel_denoiseprofile_backtransform_Y0U0V0;
   int kernel_denoiseprofile_decompose;
   int kernel_denoiseprofile_synthesize;
+  int kernel_denoiseprofile_accumulate;
   int kernel_denoiseprofile_reduce_first;
   int kernel_denoiseprofile_reduce_second;
 } dt_iop_denoiseprofile_global_data_t;
@@ -790,7 +791,7 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
     const int max_filter_radius = (1u << max_scale); // 2 * 2^max_scale
 
     tiling->factor = 5.0f; // in + out + precond + tmp + reducebuffer
-    tiling->factor_cl = 3.5f + max_scale; // in + out + tmp + reducebuffer + scale buffers
+    tiling->factor_cl = 3.5f + MIN(max_scale, 2); // in + out + tmp + reducebuffer + detail + accumulator
     tiling->maxbuf = 1.0f;
     tiling->maxbuf_cl = 1.0f;
     tiling->overhead = 0;
@@ -1413,9 +1414,9 @@ static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
     backtransform_Y0U0V0(out, width, height, d->a[1] * compensate_p, p, d->b[1], d->bias - 0.5 * logf(in_scale), wb, toRGB);
   }
 
-  dt_free_align(buf);
-  dt_free_align(tmp);
-  dt_free_align(precond);
+  dt_iop_free_image_buffer(buf);
+  dt_iop_free_image_buffer(tmp);
+  dt_iop_free_image_buffer(precond);
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, width, height);
 
@@ -1617,7 +1618,7 @@ static void process_nlmeans_cpu(dt_dev_pixelpipe_iop_t *piece,
                                       .norm = norm2 };
   denoiser(in,ovoid,roi_in,roi_out,&params);
 
-  dt_free_align(in);
+  dt_iop_free_image_buffer(in);
   nlmeans_backtransform(d,ovoid,roi_in,scale,compensate_p,wb,aa,bb,p);
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK)
@@ -1755,6 +1756,7 @@ static void process_variance(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
   g->variance_G = var[1];
   g->variance_B = var[2];
 
+  dt_iop_free_image_buffer(in);
   memcpy(ovoid, ivoid, sizeof(float) * 4 * npixels);
 }
 
@@ -2070,7 +2072,7 @@ static int process_nlmeans_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop
       dt_opencl_finish_sync_pipe(devid, piece->pipe->type);
 
       // indirectly give gpu some air to breathe (and to do display related stuff)
-      dt_iop_nap(dt_opencl_micro_nap(devid));
+      dt_opencl_nap(devid);
     }
   }
 
@@ -2124,6 +2126,17 @@ error:
 }
 
 
+// buffers of the streamed wavelet decomposition on the device
+#define DENOISE_CL_POOL 4
+
+// first buffer of the pool that is not one of the given ones, -1 for none
+static inline int _pool_unused(const int a, const int b, const int c)
+{
+  for(int k = 0; k < DENOISE_CL_POOL; k++)
+    if(k != a && k != b && k != c) return k;
+  return -1;
+}
+
 static int process_wavelets_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in,
                                cl_mem dev_out, const dt_iop_roi_t *const roi_in,
                                const dt_iop_roi_t *const roi_out)
@@ -2158,12 +2171,11 @@ static int process_wavelets_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
   const size_t npixels = (size_t)width * height;
 
   cl_mem dev_tmp = NULL;
-  cl_mem dev_buf1 = NULL;
-  cl_mem dev_buf2 = NULL;
   cl_mem dev_m = NULL;
   cl_mem dev_r = NULL;
   cl_mem dev_filter = NULL;
-  cl_mem *dev_detail = calloc(max_max_scale, sizeof(cl_mem));
+  // dev_out, dev_tmp, then our own buffers
+  cl_mem dev_pool[DENOISE_CL_POOL] = { NULL };
   float *sumsum = NULL;
 
   // corner case of extremely small image. this is not really likely to happen but would cause issues later
@@ -2175,7 +2187,6 @@ static int process_wavelets_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
     size_t region[] = { width, height, 1 };
     err = dt_opencl_enqueue_copy_image(devid, dev_in, dev_out, origin, origin, region);
     if(err != CL_SUCCESS) goto error;
-    free(dev_detail);
     return TRUE;
   }
 
@@ -2222,10 +2233,13 @@ static int process_wavelets_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
   dev_filter = dt_opencl_copy_host_to_device_constant(devid, sizeof(float) * 25, mm);
   if(dev_filter == NULL) goto error;
 
-  for(int k = 0; k < max_scale; k++)
+  dev_pool[0] = dev_out;
+  dev_pool[1] = dev_tmp;
+  // a single scale needs no accumulator
+  for(int k = 2; k < MIN(max_scale + 2, DENOISE_CL_POOL); k++)
   {
-    dev_detail[k] = dt_opencl_alloc_device(devid, width, height, sizeof(float) * 4);
-    if(dev_detail[k] == NULL) goto error;
+    dev_pool[k] = dt_opencl_alloc_device(devid, width, height, sizeof(float) * 4);
+    if(dev_pool[k] == NULL) goto error;
   }
 
   dt_aligned_pixel_t wb;  // the "unused" fourth element enables vectorization
@@ -2330,21 +2344,24 @@ static int process_wavelets_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
     }
   }
 
-  dev_buf1 = dev_out;
-  dev_buf2 = dev_tmp;
-
-  /* decompose image into detail scales and coarse */
+  /* decompose image into detail scales and coarse. The decomposition is streamed: each detail scale is
+     thresholded and accumulated as soon as it is computed, so only the current coarse scale, the next one,
+     one detail scale and the accumulator are resident, whatever the number of scales. */
+  int coarse = 0;
+  int accu = -1;
   for(int s = 0; s < max_scale; s++)
   {
     const float sigma = 1.0f;
     const float varf = sqrtf(2.0f + 2.0f * 4.0f * 4.0f + 6.0f * 6.0f) / 16.0f; // about 0.5
     const float sigma_band = powf(varf, s) * sigma;
     const float inv_sigma2 = 1.0f / (sigma_band * sigma_band);
+    const int next = _pool_unused(coarse, accu, -1);
+    const int detail = _pool_unused(coarse, accu, next);
 
-    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_decompose, 0, sizeof(cl_mem), (void *)&dev_buf1);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_decompose, 1, sizeof(cl_mem), (void *)&dev_buf2);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_decompose, 0, sizeof(cl_mem), (void *)&dev_pool[coarse]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_decompose, 1, sizeof(cl_mem), (void *)&dev_pool[next]);
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_decompose, 2, sizeof(cl_mem),
-                             (void *)&dev_detail[s]);
+                             (void *)&dev_pool[detail]);
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_decompose, 3, sizeof(int), (void *)&width);
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_decompose, 4, sizeof(int), (void *)&height);
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_decompose, 5, sizeof(unsigned int),
@@ -2356,24 +2373,6 @@ static int process_wavelets_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
     err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_denoiseprofile_decompose, sizes);
     if(err != CL_SUCCESS) goto error;
 
-    // indirectly give gpu some air to breathe (and to do display related stuff)
-    dt_iop_nap(dt_opencl_micro_nap(devid));
-
-    // swap buffers
-    cl_mem dev_buf3 = dev_buf2;
-    dev_buf2 = dev_buf1;
-    dev_buf1 = dev_buf3;
-  }
-
-  /* now synthesize again */
-  for(int s = max_scale - 1; s >= 0; s--)
-  {
-    // variance stabilizing transform maps sigma to unity.
-    const float sigma = 1.0f;
-    // it is then transformed by wavelet scales via the 5 tap a-trous filter:
-    const float varf = sqrtf(2.0f + 2.0f * 4.0f * 4.0f + 6.0f * 6.0f) / 16.0f; // about 0.5
-    const float sigma_band = powf(varf, s) * sigma;
-
     // determine thrs as bayesshrink
     dt_aligned_pixel_t sum_y2 = { 0.0f };
 
@@ -2387,7 +2386,7 @@ static int process_wavelets_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
     llocal[1] = flocopt.sizey;
     llocal[2] = 1;
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_reduce_first, 0, sizeof(cl_mem),
-                             &(dev_detail[s]));
+                             &dev_pool[detail]);
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_reduce_first, 1, sizeof(int), &width);
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_reduce_first, 2, sizeof(int), &height);
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_reduce_first, 3, sizeof(cl_mem), &dev_m);
@@ -2480,22 +2479,51 @@ static int process_wavelets_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
 
     const dt_aligned_pixel_t thrs = { adjt[0] * sb2 / std_x[0], adjt[1] * sb2 / std_x[1],
                                       adjt[2] * sb2 / std_x[2], 0.0f };
-    // fprintf(stderr, "scale %d thrs %f %f %f\n", s, thrs[0], thrs[1], thrs[2]);
+    // the first scale starts the accumulator, the input of the decomposition is not needed anymore
+    const int first = (accu < 0);
+    cl_mem dev_accu = first ? dev_pool[detail] : dev_pool[accu];
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_accumulate, 0, sizeof(cl_mem), (void *)&dev_accu);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_accumulate, 1, sizeof(cl_mem),
+                             (void *)&dev_pool[detail]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_accumulate, 2, sizeof(cl_mem),
+                             (void *)&dev_pool[coarse]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_accumulate, 3, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_accumulate, 4, sizeof(int), (void *)&height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_accumulate, 5, sizeof(int), (void *)&first);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_accumulate, 6, sizeof(float), (void *)&thrs[0]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_accumulate, 7, sizeof(float), (void *)&thrs[1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_accumulate, 8, sizeof(float), (void *)&thrs[2]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_accumulate, 9, sizeof(float), (void *)&thrs[3]);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_denoiseprofile_accumulate, sizes);
+    if(err != CL_SUCCESS) goto error;
+
+    // indirectly give gpu some air to breathe (and to do display related stuff)
+    dt_opencl_nap(devid);
+
+    accu = coarse;
+    coarse = next;
+  }
 
+  // add in the final residue
+  int result = coarse;
+  if(accu >= 0)
+  {
+    result = _pool_unused(coarse, accu, -1);
+    const dt_aligned_pixel_t none = { 0.0f, 0.0f, 0.0f, 0.0f };
     const dt_aligned_pixel_t boost = { 1.0f, 1.0f, 1.0f, 1.0f };
 
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 0, sizeof(cl_mem),
-                             (void *)&dev_buf1);
+                             (void *)&dev_pool[coarse]);
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 1, sizeof(cl_mem),
-                             (void *)&dev_detail[s]);
+                             (void *)&dev_pool[accu]);
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 2, sizeof(cl_mem),
-                             (void *)&dev_buf2);
+                             (void *)&dev_pool[result]);
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 3, sizeof(int), (void *)&width);
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 4, sizeof(int), (void *)&height);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 5, sizeof(float), (void *)&thrs[0]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 6, sizeof(float), (void *)&thrs[1]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 7, sizeof(float), (void *)&thrs[2]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 8, sizeof(float), (void *)&thrs[3]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 5, sizeof(float), (void *)&none[0]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 6, sizeof(float), (void *)&none[1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 7, sizeof(float), (void *)&none[2]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 8, sizeof(float), (void *)&none[3]);
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 9, sizeof(float), (void *)&boost[0]);
     dt_opencl_set_kernel_arg(devid, gd->kernel_denoiseprofile_synthesize, 10, sizeof(float),
                              (void *)&boost[1]);
@@ -2505,23 +2533,14 @@ static int process_wavelets_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
                              (void *)&boost[3]);
     err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_denoiseprofile_synthesize, sizes);
     if(err != CL_SUCCESS) goto error;
-
-    // indirectly give gpu some air to breathe (and to do display related stuff)
-    dt_iop_nap(dt_opencl_micro_nap(devid));
-
-    // swap buffers
-    cl_mem dev_buf3 = dev_buf2;
-    dev_buf2 = dev_buf1;
-    dev_buf1 = dev_buf3;
   }
 
-  // copy output of last run of synthesize kernel to dev_tmp (if not already there)
-  // note: we need to take swap of buffers into account, so current output lies in dev_buf1
-  if(dev_buf1 != dev_tmp)
+  // copy the result to dev_tmp (if not already there)
+  if(dev_pool[result] != dev_tmp)
   {
     size_t origin[] = { 0, 0, 0 };
     size_t region[] = { width, height, 1 };
-    err = dt_opencl_enqueue_copy_image(devid, dev_buf1, dev_tmp, origin, origin, region);
+    err = dt_opencl_enqueue_copy_image(devid, dev_pool[result], dev_tmp, origin, origin, region);
     if(err != CL_SUCCESS) goto error;
   }
 
@@ -2585,9 +2604,8 @@ static int process_wavelets_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
   dt_opencl_release_mem_object(dev_m);
   dt_opencl_release_mem_object(dev_tmp);
   dt_opencl_release_mem_object(dev_filter);
-  for(int k = 0; k < max_scale; k++)
-    dt_opencl_release_mem_object(dev_detail[k]);
-  free(dev_detail);
+  for(int k = 2; k < DENOISE_CL_POOL; k++)
+    dt_opencl_release_mem_object(dev_pool[k]);
   dt_free_align(sumsum);
   return TRUE;
 
@@ -2596,9 +2614,8 @@ error:
   dt_opencl_release_mem_object(dev_m);
   dt_opencl_release_mem_object(dev_tmp);
   dt_opencl_release_mem_object(dev_filter);
-  for(int k = 0; k < max_scale; k++)
-    dt_opencl_release_mem_object(dev_detail[k]);
-  free(dev_detail);
+  for(int k = 2; k < DENOISE_CL_POOL; k++)
+    dt_opencl_release_mem_object(dev_pool[k]);
   dt_free_align(sumsum);
   dt_print(DT_DEBUG_OPENCL, "[opencl_denoiseprofile] couldn't enqueue kernel! %d, devid %d\n", err, devid);
   return FALSE;
@@ -2778,6 +2795,7 @@ void init_global(dt_iop_module_so_t *module)
   gd->kernel_denoiseprofile_backtransform_Y0U0V0 = dt_opencl_create_kernel(program, "denoiseprofile_backtransform_Y0U0V0");
   gd->kernel_denoiseprofile_decompose = dt_opencl_create_kernel(program, "denoiseprofile_decompose");
   gd->kernel_denoiseprofile_synthesize = dt_opencl_create_kernel(program, "denoiseprofile_synthesize");
+  gd->kernel_denoiseprofile_accumulate = dt_opencl_create_kernel(program, "denoiseprofile_accumulate");
   gd->kernel_denoiseprofile_reduce_first = dt_opencl_create_kernel(program, "denoiseprofile_reduce_first");
   gd->kernel_denoiseprofile_reduce_second = dt_opencl_create_kernel(program, "denoiseprofile_reduce_second");
 }
@@ -2798,6 +2816,7 @@ void cleanup_global(dt_iop_module_so_t *module)
   dt_opencl_free_kernel(gd->kernel_denoiseprofile_backtransform_v2);
   dt_opencl_free_kernel(gd->kernel_denoiseprofile_decompose);
   dt_opencl_free_kernel(gd->kernel_denoiseprofile_synthesize);
+  dt_opencl_free_kernel(gd->kernel_denoiseprofile_accumulate);
   dt_opencl_free_kernel(gd->kernel_denoiseprofile_reduce_first);
   dt_opencl_free_kernel(gd->kernel_denoiseprofile_reduce_second);
   free(module->data);
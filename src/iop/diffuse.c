@@ -49,7 +49,7 @@
 // Set to one to output intermediate image steps as PFM in /tmp
 #define DEBUG_DUMP_PFM 0
 
-DT_MODULE_INTROSPECTION(2, dt_iop_diffuse_params_t)
+DT_MODULE_INTROSPECTION(3, dt_iop_diffuse_params_t)
 
 #define MAX_NUM_SCALES 10
 typedef struct dt_iop_diffuse_params_t
@@ -76,6 +76,9 @@ typedef struct dt_iop_diffuse_params_t
   // v2
   int radius_center;        // $MIN: 0    $MAX: 1024 $DEFAULT: 0  $DESCRIPTION: "central radius"
 
+  // v3
+  float convergence;        // $MIN: 0.   $MAX: 0.1  $DEFAULT: 0. $DESCRIPTION: "early stop"
+
   // new versions add params mandatorily at the end, so we can memcpy old parameters at the beginning
 
 } dt_iop_diffuse_params_t;
@@ -83,7 +86,7 @@ typedef struct dt_iop_diffuse_params_t
 
 typedef struct dt_iop_diffuse_gui_data_t
 {
-  GtkWidget *iterations, *fourth, *third, *second, *radius, *radius_center, *sharpness, *threshold, *regularization, *first,
+  GtkWidget *iterations, *convergence, *fourth, *third, *second, *radius, *radius_center, *sharpness, *threshold, *regularization, *first,
       *anisotropy_first, *anisotropy_second, *anisotropy_third, *anisotropy_fourth, *regularization_first, *variance_threshold;
 } dt_iop_diffuse_gui_data_t;
 
@@ -96,6 +99,7 @@ typedef struct dt_iop_diffuse_global_data_t
   int kernel_diffuse_build_mask;
   int kernel_diffuse_inpaint_mask;
   int kernel_diffuse_pde;
+  int kernel_diffuse_update_norm;
 } dt_iop_diffuse_global_data_t;
 
 
@@ -168,7 +172,7 @@ int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_p
 int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version, void *new_params,
                   const int new_version)
 {
-  if(old_version == 1 && new_version == 2)
+  if(old_version == 1 && new_version == 3)
   {
     typedef struct dt_iop_diffuse_params_v1_t
     {
@@ -203,6 +207,19 @@ int legacy_params(dt_iop_module_t *self, const void *const old_params, const int
 
     // init only new parameters
     n->radius_center = 0;
+    n->convergence = 0.f;
+
+    return 0;
+  }
+  if(old_version == 2 && new_version == 3)
+  {
+    // v3 only appends convergence, v2 is everything before it
+    dt_iop_diffuse_params_t *n = (dt_iop_diffuse_params_t *)new_params;
+    dt_iop_diffuse_params_t *d = (dt_iop_diffuse_params_t *)self->default_params;
+
+    *n = *d; // start with a fresh copy of default parameters
+    memcpy(n, old_params, offsetof(dt_iop_diffuse_params_t, convergence));
+    n->convergence = 0.f;
 
     return 0;
   }
@@ -1008,6 +1025,40 @@ static inline gint wavelets_process(const float *const restrict in, float *const
 }
 
 
+// relative norm of the change brought by the last iteration, over RGB
+static float update_norm(const float *const restrict previous, const float *const restrict current,
+                         const size_t width, const size_t height)
+{
+  double update = 0.;
+  double reference = 0.;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(previous, current, width, height) \
+    reduction(+: update, reference) \
+    schedule(static)
+#endif
+  for(size_t k = 0; k < width * height * 4; k += 4)
+    for(size_t c = 0; c < 3; c++)
+    {
+      const float delta = current[k + c] - previous[k + c];
+      update += delta * delta;
+      reference += previous[k + c] * previous[k + c];
+    }
+
+  return (reference > 0.) ? sqrt(update / reference) : 0.f;
+}
+
+// Tiles would stop after different numbers of iterations and show seams, so only
+// whole images stop early
+static inline float early_stop_threshold(const dt_iop_diffuse_data_t *const data,
+                                         const dt_dev_pixelpipe_iop_t *const piece,
+                                         const dt_iop_roi_t *const roi_in)
+{
+  const gboolean tiled = roi_in->width != piece->planned_roi_in.width
+                         || roi_in->height != piece->planned_roi_in.height;
+  return tiled ? 0.f : data->convergence;
+}
+
 static inline void build_mask(const float *const restrict input, uint8_t *const restrict mask,
                               const float threshold, const size_t width, const size_t height)
 {
@@ -1079,6 +1130,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
   const float final_radius = (data->radius + data->radius_center) * 2.f / scale;
 
   const int iterations = MAX(ceilf((float)data->iterations), 1);
+  const float convergence = early_stop_threshold(data, piece, roi_in);
   const int diffusion_scales = num_steps_to_reach_equivalent_sigma(B_SPLINE_SIGMA, final_radius);
   const int scales = CLAMP(diffusion_scales, 1, MAX_NUM_SCALES);
 
@@ -1142,6 +1194,14 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
     wavelets_process(temp_in, temp_out, mask,
                      roi_out->width, roi_out->height,
                      data, final_radius, scale, scales, has_mask, HF, LF_odd, LF_even);
+
+    // the diffusion has settled, further iterations would not show
+    if(convergence > 0.f && it < iterations - 1 && update_norm(temp_in, temp_out, width, height) < convergence)
+    {
+      dt_print(DT_DEBUG_PERF, "[diffuse] converged after %i of %i iterations\n", it + 1, iterations);
+      dt_iop_image_copy_by_size(out, temp_out, width, height, 4);
+      break;
+    }
   }
 
 error:
@@ -1344,9 +1404,20 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   const float final_radius = (data->radius + data->radius_center) * 2.f / scale;
 
   const int iterations = MAX(ceilf((float)data->iterations), 1);
+  const float convergence = early_stop_threshold(data, piece, roi_in);
   const int diffusion_scales = num_steps_to_reach_equivalent_sigma(B_SPLINE_SIGMA, final_radius);
   const int scales = CLAMP(diffusion_scales, 1, MAX_NUM_SCALES);
 
+  // per-row norms of the updates, only these come back to the host
+  cl_mem norms = NULL;
+  float *host_norms = NULL;
+  if(convergence > 0.f)
+  {
+    norms = dt_opencl_alloc_device_buffer(devid, sizeof(float) * 2 * height);
+    host_norms = dt_alloc_align_float((size_t)2 * height);
+    if(!norms || !host_norms) out_of_memory = TRUE;
+  }
+
   // wavelets scales buffers
   cl_mem HF[MAX_NUM_SCALES];
   for(int s = 0; s < scales; s++)
@@ -1415,9 +1486,44 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     if(it == (int)iterations - 1) temp_out = dev_out;
     err = wavelets_process_cl(devid, temp_in, temp_out, mask, sizes, width, height, data, gd, final_radius, scale, scales, has_mask, HF, LF_odd, LF_even);
     if(err != CL_SUCCESS) goto error;
+
+    if(convergence > 0.f && it < iterations - 1)
+    {
+      const size_t rows[] = { ROUNDUPDWD(height, devid), 1, 1 };
+      dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_update_norm, 0, sizeof(cl_mem), (void *)&temp_in);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_update_norm, 1, sizeof(cl_mem), (void *)&temp_out);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_update_norm, 2, sizeof(cl_mem), (void *)&norms);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_update_norm, 3, sizeof(int), (void *)&width);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_update_norm, 4, sizeof(int), (void *)&height);
+      err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_diffuse_update_norm, rows);
+      if(err != CL_SUCCESS) goto error;
+      err = dt_opencl_read_buffer_from_device(devid, host_norms, norms, 0, sizeof(float) * 2 * height, CL_TRUE);
+      if(err != CL_SUCCESS) goto error;
+
+      double update = 0.;
+      double reference = 0.;
+      for(int y = 0; y < height; y++)
+      {
+        update += host_norms[2 * y];
+        reference += host_norms[2 * y + 1];
+      }
+
+      // the diffusion has settled, further iterations would not show
+      if(reference > 0. && sqrt(update / reference) < convergence)
+      {
+        dt_print(DT_DEBUG_PERF, "[diffuse] converged after %i of %i iterations\n", it + 1, iterations);
+        size_t origin[] = { 0, 0, 0 };
+        size_t region[] = { width, height, 1 };
+        err = dt_opencl_enqueue_copy_image(devid, temp_out, dev_out, origin, origin, region);
+        if(err != CL_SUCCESS) goto error;
+        break;
+      }
+    }
   }
 
   // cleanup and exit on success
+  dt_opencl_release_mem_object(norms);
+  dt_free_align(host_norms);
   dt_opencl_release_mem_object(mask);
   dt_opencl_release_mem_object(temp1);
   dt_opencl_release_mem_object(temp2);
@@ -1427,6 +1533,8 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   return TRUE;
 
 error:
+  if(norms) dt_opencl_release_mem_object(norms);
+  if(host_norms) dt_free_align(host_norms);
   if(temp1) dt_opencl_release_mem_object(temp1);
   if(temp2) dt_opencl_release_mem_object(temp2);
   if(mask) dt_opencl_release_mem_object(mask);
@@ -1447,6 +1555,7 @@ void init_global(dt_iop_module_so_t *module)
   gd->kernel_diffuse_build_mask = dt_opencl_create_kernel(program, "build_mask");
   gd->kernel_diffuse_inpaint_mask = dt_opencl_create_kernel(program, "inpaint_mask");
   gd->kernel_diffuse_pde = dt_opencl_create_kernel(program, "diffuse_pde");
+  gd->kernel_diffuse_update_norm = dt_opencl_create_kernel(program, "diffuse_update_norm");
 
   const int wavelets = 35; // bspline.cl, from programs.conf
   gd->kernel_filmic_bspline_horizontal = dt_opencl_create_kernel(wavelets, "blur_2D_Bspline_horizontal");
@@ -1461,6 +1570,7 @@ void cleanup_global(dt_iop_module_so_t *module)
   dt_opencl_free_kernel(gd->kernel_diffuse_build_mask);
   dt_opencl_free_kernel(gd->kernel_diffuse_inpaint_mask);
   dt_opencl_free_kernel(gd->kernel_diffuse_pde);
+  dt_opencl_free_kernel(gd->kernel_diffuse_update_norm);
 
   dt_opencl_free_kernel(gd->kernel_filmic_bspline_vertical);
   dt_opencl_free_kernel(gd->kernel_filmic_bspline_horizontal);
@@ -1486,6 +1596,15 @@ void gui_init(struct dt_iop_module_t *self)
                                 "if you plan on sharpening or inpainting, \n"
                                 "more iterations help reconstruction."));
 
+  g->convergence = dt_bauhaus_slider_from_params(self, "convergence");
+  dt_bauhaus_slider_set_digits(g->convergence, 3);
+  dt_bauhaus_slider_set_format(g->convergence, "%");
+  gtk_widget_set_tooltip_text(g->convergence,
+                              _("stop before the set number of iterations when they barely change the image anymore.\n"
+                                "this is the relative change of the last iteration below which processing stops.\n"
+                                "higher values are faster, 0 always runs all the iterations.\n"
+                                "images processed in tiles always run all the iterations."));
+
   g->radius_center = dt_bauhaus_slider_from_params(self, "radius_center");
   dt_bauhaus_slider_set_soft_range(g->radius_center, 0., 512.);
   dt_bauhaus_slider_set_format(g->radius_center, " px");
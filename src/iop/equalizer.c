@@ -83,6 +83,13 @@ typedef struct dt_iop_equalizer_data_t
   int num_levels;
 } dt_iop_equalizer_data_t;
 
+typedef struct dt_iop_equalizer_global_data_t
+{
+  int kernel_equalizer_weights;
+  int kernel_equalizer_lift;
+  int kernel_equalizer_scale;
+} dt_iop_equalizer_global_data_t;
+
 
 const char *name()
 {
@@ -224,6 +231,136 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 #endif
 }
 
+#ifdef HAVE_OPENCL
+static cl_int _equalizer_lift_cl(const int devid, const dt_iop_equalizer_global_data_t *gd, cl_mem dev_buf,
+                                 cl_mem dev_weights, const int width, const int height, const int l,
+                                 const int vertical, const int update, const float sign)
+{
+  const int wd = (int)(1 + (width >> (l - 1)));
+  // one work item per sample lifted in this step
+  const int samples = ((vertical ? height : width) >> l) + 1;
+  size_t sizes[] = { ROUNDUPDWD(vertical ? width : samples, devid), ROUNDUPDHT(vertical ? samples : height, devid),
+                     1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_lift, 0, sizeof(cl_mem), (void *)&dev_buf);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_lift, 1, sizeof(cl_mem), (void *)&dev_weights);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_lift, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_lift, 3, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_lift, 4, sizeof(int), (void *)&l);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_lift, 5, sizeof(int), (void *)&wd);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_lift, 6, sizeof(int), (void *)&vertical);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_lift, 7, sizeof(int), (void *)&update);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_lift, 8, sizeof(float), (void *)&sign);
+  return dt_opencl_enqueue_kernel_2d(devid, gd->kernel_equalizer_lift, sizes);
+}
+
+int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_equalizer_data_t *d = (dt_iop_equalizer_data_t *)piece->data;
+  const dt_iop_equalizer_global_data_t *gd = (dt_iop_equalizer_global_data_t *)self->global_data;
+
+  const int devid = piece->pipe->devid;
+  const int width = roi_in->width, height = roi_in->height;
+  const float scale = roi_in->scale;
+
+  // same levels as the CPU version
+  const float l1 = 1.0f + dt_log2f(piece->iscale / scale); // finest level
+  float lm = 0;
+  for(int k = MIN(width, height) * piece->iscale / scale; k; k >>= 1) lm++; // coarsest level
+  lm = MIN(DT_IOP_EQUALIZER_MAX_LEVEL, l1 + lm);
+  int numl = 0;
+  for(int k = MIN(width, height); k; k >>= 1) numl++;
+  const int numl_cap = MIN(DT_IOP_EQUALIZER_MAX_LEVEL - l1 + 1.5, numl);
+
+  cl_mem dev_buf = NULL;
+  cl_mem *dev_weights = calloc(MAX(numl_cap, 1), sizeof(cl_mem));
+  cl_int err = -999;
+  if(dev_weights == NULL) goto error;
+
+  size_t origin[] = { 0, 0, 0 };
+  size_t region[] = { width, height, 1 };
+  dev_buf = dt_opencl_alloc_device_buffer(devid, sizeof(float) * 4 * width * height);
+  if(dev_buf == NULL) goto error;
+  err = dt_opencl_enqueue_copy_image_to_buffer(devid, dev_in, dev_buf, origin, region, 0);
+  if(err != CL_SUCCESS) goto error;
+
+  for(int l = 1; l < numl_cap; l++)
+  {
+    const int wd = (int)(1 + (width >> (l - 1))), ht = (int)(1 + (height >> (l - 1)));
+    err = -999;
+    dev_weights[l] = dt_opencl_alloc_device_buffer(devid, sizeof(float) * wd * ht);
+    if(dev_weights[l] == NULL) goto error;
+
+    size_t sizes[] = { ROUNDUPDWD(wd, devid), ROUNDUPDHT(ht, devid), 1 };
+    dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_weights, 0, sizeof(cl_mem), (void *)&dev_buf);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_weights, 1, sizeof(cl_mem), (void *)&dev_weights[l]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_weights, 2, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_weights, 3, sizeof(int), (void *)&l);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_weights, 4, sizeof(int), (void *)&wd);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_weights, 5, sizeof(int), (void *)&ht);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_equalizer_weights, sizes);
+    if(err != CL_SUCCESS) goto error;
+
+    // rows then columns, predict then update, as dt_iop_equalizer_wtf()
+    err = _equalizer_lift_cl(devid, gd, dev_buf, dev_weights[l], width, height, l, FALSE, FALSE, -1.0f);
+    if(err != CL_SUCCESS) goto error;
+    err = _equalizer_lift_cl(devid, gd, dev_buf, dev_weights[l], width, height, l, FALSE, TRUE, 1.0f);
+    if(err != CL_SUCCESS) goto error;
+    err = _equalizer_lift_cl(devid, gd, dev_buf, dev_weights[l], width, height, l, TRUE, FALSE, -1.0f);
+    if(err != CL_SUCCESS) goto error;
+    err = _equalizer_lift_cl(devid, gd, dev_buf, dev_weights[l], width, height, l, TRUE, TRUE, 1.0f);
+    if(err != CL_SUCCESS) goto error;
+  }
+
+  for(int l = 1; l < numl_cap; l++)
+  {
+    const float lv = (lm - l1) * (l - 1) / (float)(numl_cap - 1) + l1; // appr level in real image.
+    const float band = CLAMP((1.0 - lv / d->num_levels), 0, 1.0);
+    // coefficients in range [0, 2], 1 being neutral.
+    const float cab = 2 * dt_draw_curve_calc_value(d->curve[1], band);
+    const float coeff[4] = { 2 * dt_draw_curve_calc_value(d->curve[0], band), cab, cab, 1.0f };
+
+    size_t sizes[] = { ROUNDUPDWD(width, devid), ROUNDUPDHT(height, devid), 1 };
+    dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_scale, 0, sizeof(cl_mem), (void *)&dev_buf);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_scale, 1, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_scale, 2, sizeof(int), (void *)&height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_scale, 3, sizeof(int), (void *)&l);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_equalizer_scale, 4, 4 * sizeof(float), (void *)&coeff);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_equalizer_scale, sizes);
+    if(err != CL_SUCCESS) goto error;
+  }
+
+  for(int l = numl_cap - 1; l > 0; l--)
+  {
+    // columns then rows, update then predict, as dt_iop_equalizer_iwtf()
+    err = _equalizer_lift_cl(devid, gd, dev_buf, dev_weights[l], width, height, l, TRUE, TRUE, -1.0f);
+    if(err != CL_SUCCESS) goto error;
+    err = _equalizer_lift_cl(devid, gd, dev_buf, dev_weights[l], width, height, l, TRUE, FALSE, 1.0f);
+    if(err != CL_SUCCESS) goto error;
+    err = _equalizer_lift_cl(devid, gd, dev_buf, dev_weights[l], width, height, l, FALSE, TRUE, -1.0f);
+    if(err != CL_SUCCESS) goto error;
+    err = _equalizer_lift_cl(devid, gd, dev_buf, dev_weights[l], width, height, l, FALSE, FALSE, 1.0f);
+    if(err != CL_SUCCESS) goto error;
+  }
+
+  err = dt_opencl_enqueue_copy_buffer_to_image(devid, dev_buf, dev_out, 0, origin, region);
+  if(err != CL_SUCCESS) goto error;
+
+  for(int k = 1; k < numl_cap; k++) dt_opencl_release_mem_object(dev_weights[k]);
+  free(dev_weights);
+  dt_opencl_release_mem_object(dev_buf);
+  return TRUE;
+
+error:
+  if(dev_weights)
+    for(int k = 1; k < numl_cap; k++) dt_opencl_release_mem_object(dev_weights[k]);
+  free(dev_weights);
+  dt_opencl_release_mem_object(dev_buf);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_equalizer] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
                    dt_dev_pixelpipe_iop_t *piece)
 {
@@ -289,6 +426,26 @@ void init(dt_iop_module_t *module)
   }
 }
 
+void init_global(dt_iop_module_so_t *module)
+{
+  const int program = 44; // equalizer.cl, from programs.conf
+  dt_iop_equalizer_global_data_t *gd = malloc(sizeof(dt_iop_equalizer_global_data_t));
+  module->data = gd;
+  gd->kernel_equalizer_weights = dt_opencl_create_kernel(program, "equalizer_weights");
+  gd->kernel_equalizer_lift = dt_opencl_create_kernel(program, "equalizer_lift");
+  gd->kernel_equalizer_scale = dt_opencl_create_kernel(program, "equalizer_scale");
+}
+
+void cleanup_global(dt_iop_module_so_t *module)
+{
+  dt_iop_equalizer_global_data_t *gd = (dt_iop_equalizer_global_data_t *)module->data;
+  dt_opencl_free_kernel(gd->kernel_equalizer_weights);
+  dt_opencl_free_kernel(gd->kernel_equalizer_lift);
+  dt_opencl_free_kernel(gd->kernel_equalizer_scale);
+  free(module->data);
+  module->data = NULL;
+}
+
 #if 0
 void init_presets (dt_iop_module_so_t *self)
 {
@@ -293,6 +293,15 @@ typedef struct dt_iop_filmicrgb_gui_data_t
   GtkStyleContext *context;
 } dt_iop_filmicrgb_gui_data_t;
 
+struct dt_iop_filmicrgb_data_t;
+
+typedef void (*dt_iop_filmicrgb_chroma_func_t)(const float *const restrict in, float *const restrict out,
+                                               const dt_iop_order_iccprofile_info_t *const work_profile,
+                                               const dt_iop_order_iccprofile_info_t *const export_profile,
+                                               const struct dt_iop_filmicrgb_data_t *const data,
+                                               const size_t width, const size_t height, const size_t ch,
+                                               const float display_black, const float display_white);
+
 typedef struct dt_iop_filmicrgb_data_t
 {
   float max_grad;
@@ -317,6 +326,7 @@ typedef struct dt_iop_filmicrgb_data_t
   int high_quality_reconstruction;
   struct dt_iop_filmic_rgb_spline_t spline DT_ALIGNED_ARRAY;
   dt_noise_distribution_t noise_distribution;
+  dt_iop_filmicrgb_chroma_func_t chroma; // specialized chroma preservation loop, NULL to use the generic ones
 } dt_iop_filmicrgb_data_t;
 
 
@@ -1422,80 +1432,84 @@ static inline void filmic_chroma_v1(const float *const restrict in, float *const
 }
 
 
-static inline void filmic_chroma_v2_v3(const float *const restrict in, float *const restrict out,
-                                       const dt_iop_order_iccprofile_info_t *const work_profile,
-                                       const dt_iop_filmicrgb_data_t *const data,
-                                       const dt_iop_filmic_rgb_spline_t spline, const int variant,
-                                       const size_t width, const size_t height, const size_t ch,
-                                       const dt_iop_filmicrgb_colorscience_type_t colorscience_version)
+static inline void filmic_chroma_v2_v3_pixel(const float *const restrict pix_in, float *const restrict pix_out,
+                                             const dt_iop_order_iccprofile_info_t *const work_profile,
+                                             const dt_iop_filmicrgb_data_t *const data,
+                                             const dt_iop_filmic_rgb_spline_t *const spline, const int variant,
+                                             const dt_iop_filmicrgb_colorscience_type_t colorscience_version)
 {
+  float norm = fmaxf(get_pixel_norm(pix_in, variant, work_profile), NORM_MIN);
 
-#ifdef _OPENMP
-#pragma omp parallel for default(none)                                                                       \
-    dt_omp_firstprivate(width, height, ch, data, in, out, work_profile, variant, spline, colorscience_version)    \
-    schedule(simd :static)
-#endif
-  for(size_t k = 0; k < height * width * ch; k += ch)
-  {
-    const float *const restrict pix_in = in + k;
-    float *const restrict pix_out = out + k;
+  // Save the ratios
+  dt_aligned_pixel_t ratios = { 0.0f };
 
-    float norm = fmaxf(get_pixel_norm(pix_in, variant, work_profile), NORM_MIN);
+  for_each_channel(c,aligned(pix_in))
+    ratios[c] = pix_in[c] / norm;
 
-    // Save the ratios
-    dt_aligned_pixel_t ratios = { 0.0f };
+  // Sanitize the ratios
+  const float min_ratios = fminf(fminf(ratios[0], ratios[1]), ratios[2]);
+  const int sanitize = (min_ratios < 0.0f);
 
-    for_each_channel(c,aligned(pix_in))
-      ratios[c] = pix_in[c] / norm;
+  if(sanitize)
+    for_each_channel(c)
+      ratios[c] -= min_ratios;
 
-    // Sanitize the ratios
-    const float min_ratios = fminf(fminf(ratios[0], ratios[1]), ratios[2]);
-    const int sanitize = (min_ratios < 0.0f);
+  // Log tone-mapping
+  norm = log_tonemapping(norm, data->grey_source, data->black_source, data->dynamic_range);
 
-    if(sanitize)
-      for_each_channel(c)
-        ratios[c] -= min_ratios;
+  // Get the desaturation value based on the log value
+  const float desaturation = filmic_desaturate_v2(norm, data->sigma_toe, data->sigma_shoulder, data->saturation);
 
-    // Log tone-mapping
-    norm = log_tonemapping(norm, data->grey_source, data->black_source, data->dynamic_range);
+  // Filmic S curve on the max RGB
+  // Apply the transfer function of the display
+  norm = powf(CLAMPF(filmic_spline(norm, spline->M1, spline->M2, spline->M3, spline->M4, spline->M5,
+                                   spline->latitude_min, spline->latitude_max, spline->type),
+                     spline->y[0], spline->y[4]),
+              data->output_power);
 
-    // Get the desaturation value based on the log value
-    const float desaturation = filmic_desaturate_v2(norm, data->sigma_toe, data->sigma_shoulder, data->saturation);
+  // Re-apply ratios with saturation change
+  for(int c = 0; c < 3; c++) ratios[c] = fmaxf(ratios[c] + (1.0f - ratios[c]) * (1.0f - desaturation), 0.0f);
 
-    // Filmic S curve on the max RGB
-    // Apply the transfer function of the display
-    norm = powf(CLAMPF(filmic_spline(norm, spline.M1, spline.M2, spline.M3, spline.M4, spline.M5,
-                                         spline.latitude_min, spline.latitude_max, spline.type),
-                       spline.y[0], spline.y[4]),
-                data->output_power);
+  // color science v3: normalize again after desaturation - the norm might have changed by the desaturation
+  // operation.
+  if(colorscience_version == DT_FILMIC_COLORSCIENCE_V3)
+    norm /= fmaxf(get_pixel_norm(ratios, variant, work_profile), NORM_MIN);
 
-    // Re-apply ratios with saturation change
-    for(int c = 0; c < 3; c++) ratios[c] = fmaxf(ratios[c] + (1.0f - ratios[c]) * (1.0f - desaturation), 0.0f);
+  for_each_channel(c,aligned(pix_out))
+    pix_out[c] = ratios[c] * norm;
 
-    // color science v3: normalize again after desaturation - the norm might have changed by the desaturation
-    // operation.
-    if(colorscience_version == DT_FILMIC_COLORSCIENCE_V3)
-      norm /= fmaxf(get_pixel_norm(ratios, variant, work_profile), NORM_MIN);
+  // Gamut mapping
+  const float max_pix = fmaxf(fmaxf(pix_out[0], pix_out[1]), pix_out[2]);
+  const int penalize = (max_pix > 1.0f);
 
+  // Penalize the ratios by the amount of clipping
+  if(penalize)
+  {
     for_each_channel(c,aligned(pix_out))
-      pix_out[c] = ratios[c] * norm;
-
-    // Gamut mapping
-    const float max_pix = fmaxf(fmaxf(pix_out[0], pix_out[1]), pix_out[2]);
-    const int penalize = (max_pix > 1.0f);
-
-    // Penalize the ratios by the amount of clipping
-    if(penalize)
     {
-      for_each_channel(c,aligned(pix_out))
-      {
-        ratios[c] = fmaxf(ratios[c] + (1.0f - max_pix), 0.0f);
-        pix_out[c] = ratios[c] * norm;
-      }
+      ratios[c] = fmaxf(ratios[c] + (1.0f - max_pix), 0.0f);
+      pix_out[c] = ratios[c] * norm;
     }
   }
 }
 
+static inline void filmic_chroma_v2_v3(const float *const restrict in, float *const restrict out,
+                                       const dt_iop_order_iccprofile_info_t *const work_profile,
+                                       const dt_iop_filmicrgb_data_t *const data,
+                                       const dt_iop_filmic_rgb_spline_t spline, const int variant,
+                                       const size_t width, const size_t height, const size_t ch,
+                                       const dt_iop_filmicrgb_colorscience_type_t colorscience_version)
+{
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none)                                                                       \
+    dt_omp_firstprivate(width, height, ch, data, in, out, work_profile, variant, spline, colorscience_version)    \
+    schedule(simd :static)
+#endif
+  for(size_t k = 0; k < height * width * ch; k += ch)
+    filmic_chroma_v2_v3_pixel(in + k, out + k, work_profile, data, &spline, variant, colorscience_version);
+}
+
 
 #ifdef _OPENMP
 #pragma omp declare simd uniform(matrix) aligned(in, out:16) aligned(matrix:64)
@@ -1846,6 +1860,31 @@ static inline void RGB_tone_mapping_v4(const dt_aligned_pixel_t pix_in, dt_align
   }
 }
 
+static inline void filmic_chroma_v4_pixel(const float *const restrict pix_in, float *const restrict pix_out,
+                                          const dt_iop_order_iccprofile_info_t *const work_profile,
+                                          const dt_iop_filmicrgb_data_t *const data,
+                                          const dt_iop_filmic_rgb_spline_t spline, const int variant,
+                                          const float norm_min, const float norm_max,
+                                          const dt_colormatrix_t input_matrix, const dt_colormatrix_t output_matrix,
+                                          const dt_colormatrix_t export_input_matrix,
+                                          const dt_colormatrix_t export_output_matrix,
+                                          const int use_output_profile,
+                                          const float display_black, const float display_white)
+{
+  norm_tone_mapping_v4(pix_in, pix_out, variant, work_profile, data, spline, norm_min, norm_max, display_black, display_white);
+
+  // Save Ych in Kirk/Filmlight Yrg
+  dt_aligned_pixel_t Ych_original = { 0.f };
+  pipe_RGB_to_Ych(pix_in, input_matrix, Ych_original);
+
+  // Get final Ych in Kirk/Filmlight Yrg
+  dt_aligned_pixel_t Ych_final = { 0.f };
+  pipe_RGB_to_Ych(pix_out, input_matrix, Ych_final);
+
+  gamut_mapping(Ych_final, Ych_original, pix_out, input_matrix, output_matrix, export_input_matrix,
+                export_output_matrix, display_black, display_white, data->saturation, use_output_profile);
+}
+
 static inline void filmic_chroma_v4(const float *const restrict in, float *const restrict out,
                                     const dt_iop_order_iccprofile_info_t *const work_profile,
                                     const dt_iop_order_iccprofile_info_t *const export_profile,
@@ -1875,23 +1914,9 @@ static inline void filmic_chroma_v4(const float *const restrict in, float *const
     schedule(simd :static)
 #endif
   for(size_t k = 0; k < height * width * ch; k += ch)
-  {
-    const float *const restrict pix_in = in + k;
-    float *const restrict pix_out = out + k;
-
-    norm_tone_mapping_v4(pix_in, pix_out, variant, work_profile, data, spline, norm_min, norm_max, display_black, display_white);
-
-    // Save Ych in Kirk/Filmlight Yrg
-    dt_aligned_pixel_t Ych_original = { 0.f };
-    pipe_RGB_to_Ych(pix_in, input_matrix, Ych_original);
-
-    // Get final Ych in Kirk/Filmlight Yrg
-    dt_aligned_pixel_t Ych_final = { 0.f };
-    pipe_RGB_to_Ych(pix_out, input_matrix, Ych_final);
-
-    gamut_mapping(Ych_final, Ych_original, pix_out, input_matrix, output_matrix, export_input_matrix,
-                  export_output_matrix, display_black, display_white, data->saturation, use_output_profile);
-  }
+    filmic_chroma_v4_pixel(in + k, out + k, work_profile, data, spline, variant, norm_min, norm_max, input_matrix,
+                           output_matrix, export_input_matrix, export_output_matrix, use_output_profile,
+                           display_black, display_white);
 }
 
 static inline void filmic_split_v4(const float *const restrict in, float *const restrict out,
@@ -1942,6 +1967,99 @@ static inline void filmic_split_v4(const float *const restrict in, float *const
 }
 
 
+/* Chroma preservation loops specialized for each norm, and for the color science of v2 to v4.
+  The pixel functions get the norm and the version as literals inside each parallel loop, so the
+  compiler drops the per-pixel switch of get_pixel_norm(). They are picked once in commit_params(),
+  the generic loops above still run everything else. */
+#ifdef _OPENMP
+#define FILMIC_OMP(...) _Pragma(#__VA_ARGS__)
+#else
+#define FILMIC_OMP(...)
+#endif
+
+#define FILMIC_CHROMA_V2_V3_SPECIALIZE(norm, version)                                                             \
+  static void filmic_chroma_##version##_##norm(const float *const restrict in, float *const restrict out,        \
+                                               const dt_iop_order_iccprofile_info_t *const work_profile,         \
+                                               const dt_iop_order_iccprofile_info_t *const export_profile,       \
+                                               const dt_iop_filmicrgb_data_t *const data, const size_t width,    \
+                                               const size_t height, const size_t ch, const float display_black,  \
+                                               const float display_white)                                        \
+  {                                                                                                               \
+    const dt_iop_filmic_rgb_spline_t *const spline = &data->spline;                                               \
+    FILMIC_OMP(omp parallel for default(none) firstprivate(width, height, ch, data, in, out, work_profile, spline)  \
+               schedule(simd:static))                                                                             \
+    for(size_t k = 0; k < height * width * ch; k += ch)                                                           \
+      filmic_chroma_v2_v3_pixel(in + k, out + k, work_profile, data, spline, DT_FILMIC_METHOD_##norm,             \
+                                DT_FILMIC_COLORSCIENCE_##version);                                                \
+  }
+
+#define FILMIC_CHROMA_V4_SPECIALIZE(norm)                                                                         \
+  static void filmic_chroma_V4_##norm(const float *const restrict in, float *const restrict out,                 \
+                                      const dt_iop_order_iccprofile_info_t *const work_profile,                  \
+                                      const dt_iop_order_iccprofile_info_t *const export_profile,                \
+                                      const dt_iop_filmicrgb_data_t *const data, const size_t width,             \
+                                      const size_t height, const size_t ch, const float display_black,           \
+                                      const float display_white)                                                 \
+  {                                                                                                               \
+    dt_colormatrix_t input_matrix, output_matrix, export_input_matrix, export_output_matrix;                      \
+    const int use_output_profile = filmic_v4_prepare_matrices(input_matrix, output_matrix, export_input_matrix,   \
+                                                              export_output_matrix, work_profile, export_profile); \
+    const float norm_min = exp_tonemapping_v2(0.f, data->grey_source, data->black_source, data->dynamic_range);   \
+    const float norm_max = exp_tonemapping_v2(1.f, data->grey_source, data->black_source, data->dynamic_range);   \
+    const dt_iop_filmic_rgb_spline_t spline = data->spline;                                                       \
+    FILMIC_OMP(omp parallel for default(none) firstprivate(width, height, ch, data, in, out, work_profile,        \
+               input_matrix, output_matrix, spline, display_white, display_black, export_input_matrix,            \
+               export_output_matrix, use_output_profile, norm_min, norm_max) schedule(simd:static))               \
+    for(size_t k = 0; k < height * width * ch; k += ch)                                                           \
+      filmic_chroma_v4_pixel(in + k, out + k, work_profile, data, spline, DT_FILMIC_METHOD_##norm, norm_min,      \
+                             norm_max, input_matrix, output_matrix, export_input_matrix, export_output_matrix,    \
+                             use_output_profile, display_black, display_white);                                   \
+  }
+
+#define FILMIC_CHROMA_SPECIALIZE(norm)                                                                            \
+  FILMIC_CHROMA_V2_V3_SPECIALIZE(norm, V2)                                                                        \
+  FILMIC_CHROMA_V2_V3_SPECIALIZE(norm, V3)                                                                        \
+  FILMIC_CHROMA_V4_SPECIALIZE(norm)
+
+FILMIC_CHROMA_SPECIALIZE(MAX_RGB)
+FILMIC_CHROMA_SPECIALIZE(LUMINANCE)
+FILMIC_CHROMA_SPECIALIZE(POWER_NORM)
+FILMIC_CHROMA_SPECIALIZE(EUCLIDEAN_NORM_V1)
+FILMIC_CHROMA_SPECIALIZE(EUCLIDEAN_NORM_V2)
+
+#undef FILMIC_CHROMA_SPECIALIZE
+#undef FILMIC_CHROMA_V4_SPECIALIZE
+#undef FILMIC_CHROMA_V2_V3_SPECIALIZE
+#undef FILMIC_OMP
+
+#define FILMIC_CHROMA_CASE(norm)                                                                                  \
+  case DT_FILMIC_METHOD_##norm:                                                                                   \
+    return (version == DT_FILMIC_COLORSCIENCE_V2)   ? filmic_chroma_V2_##norm                                     \
+           : (version == DT_FILMIC_COLORSCIENCE_V3) ? filmic_chroma_V3_##norm                                     \
+                                                    : filmic_chroma_V4_##norm;
+
+// NULL when the combination has no specialized loop
+static dt_iop_filmicrgb_chroma_func_t filmic_chroma_specialized(const dt_iop_filmicrgb_colorscience_type_t version,
+                                                                const dt_iop_filmicrgb_methods_type_t norm)
+{
+  if(version != DT_FILMIC_COLORSCIENCE_V2 && version != DT_FILMIC_COLORSCIENCE_V3
+     && version != DT_FILMIC_COLORSCIENCE_V4)
+    return NULL;
+
+  switch(norm)
+  {
+    FILMIC_CHROMA_CASE(MAX_RGB)
+    FILMIC_CHROMA_CASE(LUMINANCE)
+    FILMIC_CHROMA_CASE(POWER_NORM)
+    FILMIC_CHROMA_CASE(EUCLIDEAN_NORM_V1)
+    FILMIC_CHROMA_CASE(EUCLIDEAN_NORM_V2)
+    default:
+      return NULL;
+  }
+}
+
+#undef FILMIC_CHROMA_CASE
+
 static inline void filmic_v5(const float *const restrict in, float *const restrict out,
                                     const dt_iop_order_iccprofile_info_t *const work_profile,
                                     const dt_iop_order_iccprofile_info_t *const export_profile,
@@ -2180,6 +2298,12 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
         filmic_split_v4(in, out, work_profile, export_profile, data, data->spline, data->preserve_color, roi_out->width,
                         roi_out->height, ch, data->version, black_display, white_display);
     }
+    else if(data->chroma)
+    {
+      // chroma preservation, specialized for the norm
+      data->chroma(in, out, work_profile, export_profile, data, roi_out->width, roi_out->height, ch,
+                   black_display, white_display);
+    }
     else
     {
       // chroma preservation
@@ -3172,6 +3296,7 @@ void commit_params(dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_
   d->version = p->version;
   d->spline_version = p->spline_version;
   d->preserve_color = p->preserve_color;
+  d->chroma = filmic_chroma_specialized(p->version, p->preserve_color);
   d->high_quality_reconstruction = p->high_quality_reconstruction;
   d->noise_level = p->noise_level;
   d->noise_distribution = (dt_noise_distribution_t)p->noise_distribution;
@@ -110,15 +110,16 @@ static inline int transpose_dot_matrix(double *const restrict A, // input
                                        const size_t m, const size_t n)
 {
   // Construct the square symmetrical definite positive matrix A' A,
+  // only the upper half is computed and mirrored
 
   for(size_t i = 0; i < n; ++i)
-    for(size_t j = 0; j < n; ++j)
+    for(size_t j = i; j < n; ++j)
     {
       double sum = 0.0;
       for(size_t k = 0; k < m; ++k)
         sum += A[k * n + i] * A[k * n + j];
 
-      A_square[i * n + j] = sum;
+      A_square[i * n + j] = A_square[j * n + i] = sum;
     }
 
   return 1;
@@ -192,6 +193,51 @@ static inline int pseudo_solve_gaussian(double *const restrict A,
 
   return valid;
 }
+
+
+static inline int pseudo_solve_gaussian_multi(double *const restrict A,
+                                              double *const restrict Y,
+                                              const size_t m, const size_t n, const size_t nrhs)
+{
+  // Same as above for the nrhs right-hand sides stored in the columns of the m x nrhs matrix Y,
+  // that share the same matrix A. A' A is factorized once for all of them.
+  // The solution for the right-hand side c is written in Y[c * n] to Y[c * n + n - 1].
+  if(m < n)
+  {
+    fprintf(stderr, "pseudo solve: cannot cast %zu \303\227 %zu matrix\n", m, n);
+    return 0;
+  }
+
+  double *const restrict A_square = dt_alloc_align(n * n * sizeof(double));
+  double *const restrict y_square = dt_alloc_align(n * nrhs * sizeof(double));
+  int *const restrict p = malloc(n * sizeof(int));
+
+  transpose_dot_matrix(A, A_square, m, n);
+
+  // A' Y, one column per right-hand side
+  for(size_t c = 0; c < nrhs; c++)
+    for(size_t i = 0; i < n; ++i)
+    {
+      double sum = 0.0;
+      for(size_t k = 0; k < m; ++k)
+        sum += A[k * n + i] * Y[k * nrhs + c];
+      y_square[c * n + i] = sum;
+    }
+
+  const int valid = gauss_make_triangular(A_square, p, n);
+  if(valid)
+    for(size_t c = 0; c < nrhs; c++)
+    {
+      gauss_solve_triangular(A_square, p, y_square + c * n, n);
+      for(size_t k = 0; k < n; k++) Y[c * n + k] = y_square[c * n + k];
+    }
+
+  free(p);
+  dt_free_align(y_square);
+  dt_free_align(A_square);
+
+  return valid;
+}
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -75,6 +75,11 @@ typedef struct dt_iop_grain_gui_data_t
   GtkWidget *scale, *strength, *midtones_bias; // scale, strength, midtones_bias
 } dt_iop_grain_gui_data_t;
 
+typedef struct dt_iop_grain_global_data_t
+{
+  int kernel_grain;
+} dt_iop_grain_global_data_t;
+
 typedef struct dt_iop_grain_data_t
 {
   _dt_iop_grain_channel_t channel;
@@ -111,18 +116,19 @@ int legacy_params(dt_iop_module_t *self, const void *const old_params, const int
 }
 
 
-static int grad3[12][3] = { { 1, 1, 0 },
-                            { -1, 1, 0 },
-                            { 1, -1, 0 },
-                            { -1, -1, 0 },
-                            { 1, 0, 1 },
-                            { -1, 0, 1 },
-                            { 1, 0, -1 },
-                            { -1, 0, -1 },
-                            { 0, 1, 1 },
-                            { 0, -1, 1 },
-                            { 0, 1, -1 },
-                            { 0, -1, -1 } };
+// gradients as doubles, to save the conversions in the inner loop of the noise
+static const double grad3[12][3] = { { 1, 1, 0 },
+                                     { -1, 1, 0 },
+                                     { 1, -1, 0 },
+                                     { -1, -1, 0 },
+                                     { 1, 0, 1 },
+                                     { -1, 0, 1 },
+                                     { 1, 0, -1 },
+                                     { -1, 0, -1 },
+                                     { 0, 1, 1 },
+                                     { 0, -1, 1 },
+                                     { 0, 1, -1 },
+                                     { 0, -1, -1 } };
 
 static int permutation[]
     = { 151, 160, 137, 91,  90,  15,  131, 13,  201, 95,  96,  53,  194, 233, 7,   225, 140, 36,  103, 30,
@@ -140,21 +146,31 @@ static int permutation[]
         222, 114, 67,  29,  24,  72,  243, 141, 128, 195, 78,  66,  215, 61,  156, 180 };
 
 static int perm[512];
+// perm[i] % 12, the index of the gradient of a lattice point
+static int perm_mod12[512];
 static void _simplex_noise_init()
 {
-  for(int i = 0; i < 512; i++) perm[i] = permutation[i & 255];
-}
-static double dot(int g[], double x, double y, double z)
-{
-  return g[0] * x + g[1] * y + g[2] * z;
+  for(int i = 0; i < 512; i++)
+  {
+    perm[i] = permutation[i & 255];
+    perm_mod12[i] = perm[i] % 12;
+  }
 }
 
 #define FASTFLOOR(x) (x > 0 ? (int)(x) : (int)(x)-1)
 
-static double _simplex_noise(double xin, double yin, double zin)
+// contribution of one corner of the simplex, zero out of its radius of influence
+static inline double _corner(const int gi, const double x, const double y, const double z)
 {
-  double n0, n1, n2, n3; // Noise contributions from the four corners
-                         // Skew the input space to determine which simplex cell we're in
+  double t = 0.6 - x * x - y * y - z * z;
+  t = t < 0.0 ? 0.0 : t;
+  t *= t;
+  return t * t * (grad3[gi][0] * x + grad3[gi][1] * y + grad3[gi][2] * z);
+}
+
+static inline double _simplex_noise(double xin, double yin, double zin)
+{
+  // Skew the input space to determine which simplex cell we're in
   const double F3 = 1.0 / 3.0;
   const double s = (xin + yin + zin) * F3; // Very nice and simple skew factor for 3D
   const int i = FASTFLOOR(xin + s);
@@ -169,69 +185,15 @@ static double _simplex_noise(double xin, double yin, double zin)
   const double y0 = yin - Y0;
   const double z0 = zin - Z0;
   // For the 3D case, the simplex shape is a slightly irregular tetrahedron.
-  // Determine which simplex we are in.
-  int i1, j1, k1; // Offsets for second corner of simplex in (i,j,k) coords
-  int i2, j2, k2; // Offsets for third corner of simplex in (i,j,k) coords
-  if(x0 >= y0)
-  {
-    if(y0 >= z0)
-    {
-      i1 = 1; // X Y Z order
-      j1 = 0;
-      k1 = 0;
-      i2 = 1;
-      j2 = 1;
-      k2 = 0;
-    }
-    else if(x0 >= z0)
-    {
-      i1 = 1; // X Z Y order
-      j1 = 0;
-      k1 = 0;
-      i2 = 1;
-      j2 = 0;
-      k2 = 1;
-    }
-    else
-    {
-      i1 = 0; // Z X Y order
-      j1 = 0;
-      k1 = 1;
-      i2 = 1;
-      j2 = 0;
-      k2 = 1;
-    }
-  }
-  else // x0<y0
-  {
-    if(y0 < z0)
-    {
-      i1 = 0; // Z Y X order
-      j1 = 0;
-      k1 = 1;
-      i2 = 0;
-      j2 = 1;
-      k2 = 1;
-    }
-    else if(x0 < z0)
-    {
-      i1 = 0; // Y Z X order
-      j1 = 1;
-      k1 = 0;
-      i2 = 0;
-      j2 = 1;
-      k2 = 1;
-    }
-    else
-    {
-      i1 = 0; // Y X Z order
-      j1 = 1;
-      k1 = 0;
-      i2 = 1;
-      j2 = 1;
-      k2 = 0;
-    }
-  }
+  // Determine which simplex we are in from the order of x0, y0, z0, without branches:
+  // (i1, j1, k1) are the offsets for the second corner in (i,j,k) coords, (i2, j2, k2) for the third.
+  const int xy = x0 >= y0, yz = y0 >= z0, xz = x0 >= z0;
+  const int i1 = xy & xz;
+  const int j1 = !xy & yz;
+  const int k1 = !yz & !(xy & xz);
+  const int i2 = xy | (yz & xz);
+  const int j2 = !xy | yz;
+  const int k2 = !yz | (!xy & !xz);
   //  A step of (1,0,0) in (i,j,k) means a step of (1-c,-c,-c) in (x,y,z),
   //  a step of (0,1,0) in (i,j,k) means a step of (-c,1-c,-c) in (x,y,z), and
   //  a step of (0,0,1) in (i,j,k) means a step of (-c,-c,1-c) in (x,y,z), where
@@ -249,46 +211,14 @@ static double _simplex_noise(double xin, double yin, double zin)
   const int ii = i & 255;
   const int jj = j & 255;
   const int kk = k & 255;
-  const int gi0 = perm[ii + perm[jj + perm[kk]]] % 12;
-  const int gi1 = perm[ii + i1 + perm[jj + j1 + perm[kk + k1]]] % 12;
-  const int gi2 = perm[ii + i2 + perm[jj + j2 + perm[kk + k2]]] % 12;
-  const int gi3 = perm[ii + 1 + perm[jj + 1 + perm[kk + 1]]] % 12;
-  // Calculate the contribution from the four corners
-  double t0 = 0.6 - x0 * x0 - y0 * y0 - z0 * z0;
-  if(t0 < 0)
-    n0 = 0.0;
-  else
-  {
-    t0 *= t0;
-    n0 = t0 * t0 * dot(grad3[gi0], x0, y0, z0);
-  }
-  double t1 = 0.6 - x1 * x1 - y1 * y1 - z1 * z1;
-  if(t1 < 0)
-    n1 = 0.0;
-  else
-  {
-    t1 *= t1;
-    n1 = t1 * t1 * dot(grad3[gi1], x1, y1, z1);
-  }
-  double t2 = 0.6 - x2 * x2 - y2 * y2 - z2 * z2;
-  if(t2 < 0)
-    n2 = 0.0;
-  else
-  {
-    t2 *= t2;
-    n2 = t2 * t2 * dot(grad3[gi2], x2, y2, z2);
-  }
-  double t3 = 0.6 - x3 * x3 - y3 * y3 - z3 * z3;
-  if(t3 < 0)
-    n3 = 0.0;
-  else
-  {
-    t3 *= t3;
-    n3 = t3 * t3 * dot(grad3[gi3], x3, y3, z3);
-  }
+  const int gi0 = perm_mod12[ii + perm[jj + perm[kk]]];
+  const int gi1 = perm_mod12[ii + i1 + perm[jj + j1 + perm[kk + k1]]];
+  const int gi2 = perm_mod12[ii + i2 + perm[jj + j2 + perm[kk + k2]]];
+  const int gi3 = perm_mod12[ii + 1 + perm[jj + 1 + perm[kk + 1]]];
   // Add contributions from each corner to get the final noise value.
   // The result is scaled to stay just inside [-1,1]
-  return 32.0 * (n0 + n1 + n2 + n3);
+  return 32.0 * (_corner(gi0, x0, y0, z0) + _corner(gi1, x1, y1, z1) + _corner(gi2, x2, y2, z2)
+                 + _corner(gi3, x3, y3, z3));
 }
 
 #define PRIME_LEVELS 4
@@ -347,17 +277,17 @@ static double _perlin_2d_noise(double x,double y,uint32_t octaves,double persist
   return total;
 }*/
 
+// parametrization of octaves to match power spectrum of real grain scans, keep in sync with grain.cl
+static const double _octave_f[] = {0.4910, 0.9441, 1.7280};
+static const double _octave_a[] = {0.2340, 0.7850, 1.2150};
+
 static double _simplex_2d_noise(double x, double y, uint32_t octaves, double persistance, double z)
 {
   double total = 0;
 
-  // parametrization of octaves to match power spectrum of real grain scans
-  static double f[] = {0.4910, 0.9441, 1.7280};
-  static double a[] = {0.2340, 0.7850, 1.2150};
-
   for(uint32_t o = 0; o < octaves; o++)
   {
-    total += (_simplex_noise(x * f[o] / z, y * f[o] / z, o) * a[o]);
+    total += (_simplex_noise(x * _octave_f[o] / z, y * _octave_f[o] / z, o) * _octave_a[o]);
   }
   return total;
 }
@@ -474,12 +404,22 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const float fib1 = 34.0, fib2 = 21.0;
   const float fib1div2 = fib1 / fib2;
 
+  // the rank-1 lattice only depends on the zoom level, offsets are the same for all pixels
+  float lattice[21][2];
+  for(int l = 0; l < fib2; l++)
+  {
+    float px = l / fib2, py = l * fib1div2;
+    py -= (int)py;
+    lattice[l][0] = px * filtermul;
+    lattice[l][1] = py * filtermul;
+  }
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ch, filter, filtermul, ivoid, ovoid, roi_out, strength, \
-                      wd, zoom, octaves, fib2, fib1div2) \
-  shared(data, hash)
+  dt_omp_firstprivate(ch, filter, ivoid, ovoid, roi_out, strength, \
+                      wd, zoom, octaves, fib2) \
+  shared(data, hash, lattice) \
+  schedule(static)
 #endif
   for(int j = 0; j < roi_out->height; j++)
   {
@@ -502,12 +442,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       {
         // if zoomed out a lot, use rank-1 lattice downsampling
         for(int l = 0; l < fib2; l++)
-        {
-          float px = l / fib2, py = l * fib1div2;
-          py -= (int)py;
-          float dx = px * filtermul, dy = py * filtermul;
-          noise += (1.0 / fib2) * _simplex_2d_noise(x + dx + hash, y + dy, octaves, 1.0, zoom);
-        }
+          noise += (1.0 / fib2) * _simplex_2d_noise(x + lattice[l][0] + hash, y + lattice[l][1], octaves, 1.0, zoom);
       }
       else
       {
@@ -525,6 +460,65 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
 }
 
+#ifdef HAVE_OPENCL
+int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_grain_data_t *data = (dt_iop_grain_data_t *)piece->data;
+  const dt_iop_grain_global_data_t *gd = (dt_iop_grain_global_data_t *)self->global_data;
+
+  const int devid = piece->pipe->devid;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+
+  const unsigned int hash = _hash_string(piece->pipe->image.filename) % (int)fmax(roi_out->width * 0.3, 1.0);
+  const float strength = data->strength / 100.0;
+  const float wd = fminf(piece->buf_in.width, piece->buf_in.height);
+  const double zoom = (1.0 + 8 * data->scale / 100) / 800.0;
+  const int filter = fabsf(roi_out->scale - 1.0f) > 0.01f;
+  const float filtermul = piece->iscale / (roi_out->scale * wd);
+  const float zoomf = zoom;
+
+  // the noise of each octave repeats every 768 along x, the offset by the hash of the filename is folded
+  // into that period here in double precision so that the kernel can work with small floats
+  float offset[4] = { 0.0f };
+  for(int o = 0; o < 3; o++) offset[o] = fmod(hash * _octave_f[o] / zoom, 768.0);
+
+  cl_mem dev_lut = NULL;
+  cl_int err = -999;
+
+  dev_lut = dt_opencl_copy_host_to_device_constant(devid, sizeof(float) * GRAIN_LUT_SIZE * GRAIN_LUT_SIZE,
+                                                   (void *)data->grain_lut);
+  if(dev_lut == NULL) goto error;
+
+  size_t sizes[] = { ROUNDUPDWD(width, devid), ROUNDUPDHT(height, devid), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 1, sizeof(cl_mem), (void *)&dev_out);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 3, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 4, sizeof(int), (void *)&roi_out->x);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 5, sizeof(int), (void *)&roi_out->y);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 6, sizeof(float), (void *)&roi_out->scale);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 7, sizeof(float), (void *)&wd);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 8, sizeof(float), (void *)&zoomf);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 9, sizeof(float), (void *)&strength);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 10, sizeof(int), (void *)&filter);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 11, sizeof(float), (void *)&filtermul);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 12, 4 * sizeof(float), (void *)&offset);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 13, sizeof(cl_mem), (void *)&dev_lut);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_grain, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_release_mem_object(dev_lut);
+  return TRUE;
+
+error:
+  dt_opencl_release_mem_object(dev_lut);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_grain] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
                    dt_dev_pixelpipe_iop_t *piece)
 {
@@ -554,6 +548,19 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
 void init_global(struct dt_iop_module_so_t *self)
 {
   _simplex_noise_init();
+
+  const int program = 42; // grain.cl, from programs.conf
+  dt_iop_grain_global_data_t *gd = malloc(sizeof(dt_iop_grain_global_data_t));
+  self->data = gd;
+  gd->kernel_grain = dt_opencl_create_kernel(program, "grain");
+}
+
+void cleanup_global(struct dt_iop_module_so_t *self)
+{
+  dt_iop_grain_global_data_t *gd = (dt_iop_grain_global_data_t *)self->data;
+  dt_opencl_free_kernel(gd->kernel_grain);
+  free(self->data);
+  self->data = NULL;
 }
 
 void gui_init(struct dt_iop_module_t *self)
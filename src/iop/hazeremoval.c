@@ -38,11 +38,13 @@
 #include "bauhaus/bauhaus.h"
 #include "common/box_filters.h"
 #include "common/darktable.h"
+#include "common/fast_guided_filter.h"
 #include "common/guided_filter.h"
 #include "control/control.h"
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
 #include "develop/imageop_gui.h"
+#include "develop/pixelpipe_stats.h"
 #include "gui/gtk.h"
 
 #include "develop/tiling.h"
@@ -80,10 +82,14 @@ typedef struct dt_iop_hazeremoval_gui_data_t
 {
   GtkWidget *strength;
   GtkWidget *distance;
+} dt_iop_hazeremoval_gui_data_t;
+
+// global statistics of the module input, see develop/pixelpipe_stats.h
+typedef struct dt_iop_hazeremoval_stats_t
+{
   rgb_pixel A0;
   float distance_max;
-  uint64_t hash;
-} dt_iop_hazeremoval_gui_data_t;
+} dt_iop_hazeremoval_stats_t;
 
 typedef struct dt_iop_hazeremoval_global_data_t
 {
@@ -118,7 +124,7 @@ const char **description(struct dt_iop_module_t *self)
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_GLOBAL_STATS;
 }
 
 
@@ -176,30 +182,10 @@ void cleanup_global(dt_iop_module_so_t *self)
 }
 
 
-void gui_update(struct dt_iop_module_t *self)
-{
-  dt_iop_hazeremoval_gui_data_t *g = (dt_iop_hazeremoval_gui_data_t *)self->gui_data;
-
-  dt_iop_gui_enter_critical_section(self);
-  g->distance_max = NAN;
-  g->A0[0] = NAN;
-  g->A0[1] = NAN;
-  g->A0[2] = NAN;
-  g->hash = 0;
-  dt_iop_gui_leave_critical_section(self);
-}
-
-
 void gui_init(dt_iop_module_t *self)
 {
   dt_iop_hazeremoval_gui_data_t *g = IOP_GUI_ALLOC(hazeremoval);
 
-  g->distance_max = NAN;
-  g->A0[0] = NAN;
-  g->A0[1] = NAN;
-  g->A0[2] = NAN;
-  g->hash = 0;
-
   g->strength = dt_bauhaus_slider_from_params(self, N_("strength"));
   gtk_widget_set_tooltip_text(g->strength, _("amount of haze reduction"));
 
@@ -421,10 +407,40 @@ static float ambient_light(const const_rgb_image img, int w1, rgb_pixel *pA0)
 }
 
 
+// The transition map is smooth by construction (box filters followed by a guided filter), so we estimate
+// it on the next pyramid level and upsample the coefficients of the guided filter, as in the fast guided
+// filter of K. He and J. Sun, 2015 (https://arxiv.org/abs/1505.00996), with windows scaled to match.
+// Small images are processed at full resolution, the windows would cover too much of them.
+static inline int _downscaling(const int width, const int height, const int w)
+{
+  return (MIN(width, height) >= 16 * w) ? 2 : 1;
+}
+
+static inline int _downscaled_window(const int w, const int ds)
+{
+  return MAX((w + ds / 2) / ds, 1);
+}
+
+// downscale the input by ds, returns it as it is when ds == 1. Release with _free_downscaled()
+static const_rgb_image _downscale(const const_rgb_image img, const int ds)
+{
+  if(ds == 1) return img;
+
+  const int width = img.width / ds;
+  const int height = img.height / ds;
+  float *const data = dt_alloc_align_float((size_t)width * height * img.stride);
+  if(data) interpolate_bilinear(img.data, img.width, img.height, data, width, height, img.stride);
+  return (const_rgb_image){ data, width, height, img.stride };
+}
+
+static void _free_downscaled(const const_rgb_image img, const const_rgb_image full)
+{
+  if(img.data != full.data) dt_free_align((float *)img.data);
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  dt_iop_hazeremoval_gui_data_t *const g = (dt_iop_hazeremoval_gui_data_t*)self->gui_data;
   dt_iop_hazeremoval_params_t *d = piece->data;
 
   const int ch = piece->colors;
@@ -442,92 +458,80 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const const_rgb_image img_in = (const_rgb_image){ ivoid, width, height, ch };
   const rgb_image img_out = (rgb_image){ ovoid, width, height, ch };
 
-  // estimate diffusive ambient light and image depth
-  rgb_pixel A0;
-  A0[0] = NAN;
-  A0[1] = NAN;
-  A0[2] = NAN;
-  float distance_max = NAN;
-
-  // hazeremoval module needs the color and the haziness (which yields
-  // distance_max) of the most hazy region of the image.  In pixelpipe
-  // FULL we can not reliably get this value as the pixelpipe might
-  // only see part of the image (region of interest).  Therefore, we
-  // try to get A0 and distance_max from the PREVIEW pixelpipe which
-  // luckily stores it for us.
-  if(self->dev->gui_attached && g && (piece->pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL)
+  // everything but the final dehazing runs on the downscaled image
+  const int ds = _downscaling(width, height, w2);
+  const int ds_w1 = _downscaled_window(w1, ds);
+  const int ds_w2 = _downscaled_window(w2, ds);
+  const const_rgb_image ds_in = _downscale(img_in, ds);
+  if(!ds_in.data)
   {
-    dt_iop_gui_enter_critical_section(self);
-    const uint64_t hash = g->hash;
-    dt_iop_gui_leave_critical_section(self);
-    // Note that the case 'hash == 0' on first invocation in a session
-    // implies that g->distance_max is NAN, which initiates special
-    // handling below to avoid inconsistent results.  In all other
-    // cases we make sure that the preview pipe has left us with
-    // proper readings for distance_max and A0.  If data are not yet
-    // there we need to wait (with timeout).
-    if(hash != 0
-       && !dt_dev_sync_pixelpipe_hash(self->dev, piece->pipe, self->iop_order, DT_DEV_TRANSFORM_DIR_BACK_INCL,
-                                      &self->gui_lock, &g->hash))
-      dt_control_log(_("inconsistent output"));
-    dt_iop_gui_enter_critical_section(self);
-    A0[0] = g->A0[0];
-    A0[1] = g->A0[1];
-    A0[2] = g->A0[2];
-    distance_max = g->distance_max;
-    dt_iop_gui_leave_critical_section(self);
+    dt_control_log(_("haze removal failed to allocate memory, check your RAM settings"));
+    dt_iop_image_copy_by_size(ovoid, ivoid, width, height, ch);
+    return;
   }
-  // In all other cases we calculate distance_max and A0 here.
-  if(isnan(distance_max)) distance_max = ambient_light(img_in, w1, &A0);
-  // PREVIEW pixelpipe stores values.
-  if(self->dev->gui_attached && g && (piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW)
+
+  // estimate diffusive ambient light and image depth
+  // hazeremoval module needs the color and the haziness (which yields
+  // distance_max) of the most hazy region of the image.  When the
+  // pixelpipe only sees part of the image (region of interest), they
+  // are taken from a pipe that sees all of it, usually the PREVIEW
+  // one.  Otherwise we calculate them here and share them.
+  dt_iop_hazeremoval_stats_t stats;
+  if(!dt_dev_pixelpipe_stats_get(piece, roi_in, &stats, sizeof(stats)))
   {
-    uint64_t hash = dt_dev_hash(self->dev, piece->pipe);
-    dt_iop_gui_enter_critical_section(self);
-    g->A0[0] = A0[0];
-    g->A0[1] = A0[1];
-    g->A0[2] = A0[2];
-    g->distance_max = distance_max;
-    g->hash = hash;
-    dt_iop_gui_leave_critical_section(self);
+    stats.distance_max = ambient_light(ds_in, ds_w1, &stats.A0);
+    dt_dev_pixelpipe_stats_put(piece, roi_in, &stats, sizeof(stats));
   }
+  const float *const A0 = stats.A0;
+  const float distance_max = stats.distance_max;
 
   // calculate the transition map
-  gray_image trans_map = new_gray_image(width, height);
-  transition_map(img_in, trans_map, w1, A0, strength);
+  gray_image trans_map = new_gray_image(ds_in.width, ds_in.height);
+  transition_map(ds_in, trans_map, ds_w1, A0, strength);
 
   // refine the transition map
-  dt_box_min(trans_map.data, trans_map.height, trans_map.width, 1, w1);
-  gray_image trans_map_filtered = new_gray_image(width, height);
-  // apply guided filter with no clipping
-  guided_filter(img_in.data, trans_map.data, trans_map_filtered.data, width, height, ch, w2, eps, 1.f, -FLT_MAX,
-                FLT_MAX);
+  dt_box_min(trans_map.data, trans_map.height, trans_map.width, 1, ds_w1);
+  // fit the guided filter with no clipping, then bring its coefficients back to full resolution
+  float *const ds_ab = dt_alloc_align_float((size_t)ds_in.width * ds_in.height * 4);
+  float *const ab = (ds == 1) ? ds_ab : dt_alloc_align_float((size_t)width * height * 4);
+  if(!ds_ab || !ab)
+  {
+    dt_control_log(_("haze removal failed to allocate memory, check your RAM settings"));
+    dt_iop_image_copy_by_size(ovoid, ivoid, width, height, ch);
+    goto cleanup;
+  }
+  guided_filter_coefficients(ds_in.data, trans_map.data, ds_ab, ds_in.width, ds_in.height, ch, ds_w2, eps, 1.f);
+  if(ds != 1) interpolate_bilinear(ds_ab, ds_in.width, ds_in.height, ab, width, height, 4);
 
   // finally, calculate the haze-free image
   const float t_min
       = fminf(fmaxf(expf(-distance * distance_max), 1.f / 1024), 1.f); // minimum allowed value for transition map
   const float *const c_A0 = A0;
-  const gray_image c_trans_map_filtered = trans_map_filtered;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(c_A0, c_trans_map_filtered, img_in, img_out, size, t_min) \
+  dt_omp_firstprivate(c_A0, ab, img_in, img_out, size, t_min) \
   schedule(static)
 #endif
   for(size_t i = 0; i < size; i++)
   {
-    float t = fmaxf(c_trans_map_filtered.data[i], t_min);
     const float *pixel_in = img_in.data + i * img_in.stride;
     float *pixel_out = img_out.data + i * img_out.stride;
+    const float *px_ab = ab + 4 * i;
+    const float t_filtered = px_ab[0] * pixel_in[0] + px_ab[1] * pixel_in[1] + px_ab[2] * pixel_in[2] + px_ab[3];
+    const float t = fmaxf(t_filtered, t_min);
     pixel_out[0] = (pixel_in[0] - c_A0[0]) / t + c_A0[0];
     pixel_out[1] = (pixel_in[1] - c_A0[1]) / t + c_A0[1];
     pixel_out[2] = (pixel_in[2] - c_A0[2]) / t + c_A0[2];
   }
 
-  free_gray_image(&trans_map);
-  free_gray_image(&trans_map_filtered);
-
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK)
     dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
+
+cleanup:
+  if(ab != ds_ab) dt_free_align(ab);
+  dt_free_align(ds_ab);
+  free_gray_image(&trans_map);
+  _free_downscaled(ds_in, img_in);
 }
 
 #ifdef HAVE_OPENCL
@@ -537,8 +541,9 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 // characteristic haze depth, i.e., the distance over which object light is
 // reduced by the factor exp(-1)
 // some parts of the calculation are not suitable for a parallel implementation,
-// thus we copy data to host memory fall back to a cpu routine
-static float ambient_light_cl(struct dt_iop_module_t *self, int devid, cl_mem img, int w1, rgb_pixel *pA0)
+// thus we copy data to host memory fall back to a cpu routine, on the same
+// downscaled image as the cpu path
+static float ambient_light_cl(struct dt_iop_module_t *self, int devid, cl_mem img, int w1, int w2, rgb_pixel *pA0)
 {
   const int width = dt_opencl_get_image_width(img);
   const int height = dt_opencl_get_image_height(img);
@@ -547,7 +552,11 @@ static float ambient_light_cl(struct dt_iop_module_t *self, int devid, cl_mem im
   int err = dt_opencl_read_host_from_device(devid, in, img, width, height, element_size);
   if(err != CL_SUCCESS) goto error;
   const const_rgb_image img_in = (const_rgb_image){ in, width, height, element_size / sizeof(float) };
-  const float max_depth = ambient_light(img_in, w1, pA0);
+  const int ds = _downscaling(width, height, w2);
+  const const_rgb_image ds_in = _downscale(img_in, ds);
+  if(!ds_in.data) goto error;
+  const float max_depth = ambient_light(ds_in, _downscaled_window(w1, ds), pA0);
+  _free_downscaled(ds_in, img_in);
   dt_free_align(in);
   return max_depth;
 error:
@@ -679,7 +688,7 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
                      const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out,
                      struct dt_develop_tiling_t *tiling)
 {
-  tiling->factor = 2.5f;  // in + out + two single-channel temp buffers
+  tiling->factor = 3.5f;  // in + out + full-resolution coefficients + downscaled buffers
   tiling->factor_cl = 5.0f;
   tiling->maxbuf = 1.0f;
   tiling->maxbuf_cl = 1.0f;
@@ -692,7 +701,6 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem img_in, cl_mem img_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  dt_iop_hazeremoval_gui_data_t *const g = (dt_iop_hazeremoval_gui_data_t*)self->gui_data;
   dt_iop_hazeremoval_params_t *d = piece->data;
 
   const int ch = piece->colors;
@@ -708,54 +716,19 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   const float eps = sqrtf(0.025f);    // regularization parameter for guided filter
 
   // estimate diffusive ambient light and image depth
-  rgb_pixel A0;
-  A0[0] = NAN;
-  A0[1] = NAN;
-  A0[2] = NAN;
-  float distance_max = NAN;
-
   // hazeremoval module needs the color and the haziness (which yields
-  // distance_max) of the most hazy region of the image.  In pixelpipe
-  // FULL we can not reliably get this value as the pixelpipe might
-  // only see part of the image (region of interest).  Therefore, we
-  // try to get A0 and distance_max from the PREVIEW pixelpipe which
-  // luckily stores it for us.
-  if(self->dev->gui_attached && g && (piece->pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL)
-  {
-    dt_iop_gui_enter_critical_section(self);
-    const uint64_t hash = g->hash;
-    dt_iop_gui_leave_critical_section(self);
-    // Note that the case 'hash == 0' on first invocation in a session
-    // implies that g->distance_max is NAN, which initiates special
-    // handling below to avoid inconsistent results.  In all other
-    // cases we make sure that the preview pipe has left us with
-    // proper readings for distance_max and A0.  If data are not yet
-    // there we need to wait (with timeout).
-    if(hash != 0
-       && !dt_dev_sync_pixelpipe_hash(self->dev, piece->pipe, self->iop_order, DT_DEV_TRANSFORM_DIR_BACK_INCL,
-                                      &self->gui_lock, &g->hash))
-      dt_control_log(_("inconsistent output"));
-    dt_iop_gui_enter_critical_section(self);
-    A0[0] = g->A0[0];
-    A0[1] = g->A0[1];
-    A0[2] = g->A0[2];
-    distance_max = g->distance_max;
-    dt_iop_gui_leave_critical_section(self);
-  }
-  // In all other cases we calculate distance_max and A0 here.
-  if(isnan(distance_max)) distance_max = ambient_light_cl(self, devid, img_in, w1, &A0);
-  // PREVIEW pixelpipe stores values.
-  if(self->dev->gui_attached && g && (piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW)
+  // distance_max) of the most hazy region of the image.  When the
+  // pixelpipe only sees part of the image (region of interest), they
+  // are taken from a pipe that sees all of it, usually the PREVIEW
+  // one.  Otherwise we calculate them here and share them.
+  dt_iop_hazeremoval_stats_t stats;
+  if(!dt_dev_pixelpipe_stats_get(piece, roi_in, &stats, sizeof(stats)))
   {
-    uint64_t hash = dt_dev_hash(self->dev, piece->pipe);
-    dt_iop_gui_enter_critical_section(self);
-    g->A0[0] = A0[0];
-    g->A0[1] = A0[1];
-    g->A0[2] = A0[2];
-    g->distance_max = distance_max;
-    g->hash = hash;
-    dt_iop_gui_leave_critical_section(self);
+    stats.distance_max = ambient_light_cl(self, devid, img_in, w1, w2, &stats.A0);
+    dt_dev_pixelpipe_stats_put(piece, roi_in, &stats, sizeof(stats));
   }
+  const float *const A0 = stats.A0;
+  const float distance_max = stats.distance_max;
 
   // calculate the transition map
   void *trans_map = dt_opencl_alloc_device(devid, width, height, (int)sizeof(float));
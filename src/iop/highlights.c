@@ -134,6 +134,7 @@ typedef struct dt_iop_highlights_global_data_t
   int kernel_highlights_diffuse_color;
   int kernel_highlights_box_blur;
   int kernel_highlights_false_color;
+  int kernel_highlights_bounding_box;
 
   int kernel_filmic_bspline_vertical;
   int kernel_filmic_bspline_horizontal;
@@ -733,6 +734,69 @@ static inline void interpolate_color(const void *const ivoid, void *const ovoid,
   }
 }
 
+// Flag the rows and columns holding at least one pixel that interpolate_color() and
+// interpolate_color_xtrans() will reconstruct, that is an inner pixel at its clipping threshold.
+// The passes along the other lines only write the input back, so they can be skipped.
+// Return FALSE if nothing is clipped.
+static gboolean _inpaint_clipped_lines(const float *const restrict in,
+                                       const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                                       const float *const clips, const uint32_t filters,
+                                       const uint8_t (*const xtrans)[6],
+                                       uint8_t *const restrict rows, uint8_t *const restrict cols)
+{
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+  int clipped = 0;
+
+  memset(rows, 0, sizeof(uint8_t) * height);
+  memset(cols, 0, sizeof(uint8_t) * width);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, roi_in, width, height, clips, filters, xtrans, rows) \
+  reduction(+ : clipped) \
+  schedule(static)
+#endif
+  for(int j = 1; j < height - 1; j++)
+  {
+    const float *const restrict row = in + (size_t)j * roi_in->width;
+    for(int i = 1; i < width - 1; i++)
+    {
+      const int c = (filters == 9u) ? FCxtrans(j, i, roi_in, xtrans) : FC(j, i, filters);
+      if(row[i] >= clips[c] - 1e-5f)
+      {
+        rows[j] = 1;
+        clipped++;
+        break;
+      }
+    }
+  }
+
+  if(!clipped) return FALSE;
+
+  // second pass on the flagged rows only, so each thread owns its columns
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, roi_in, width, height, clips, filters, xtrans, rows, cols) \
+  schedule(static)
+#endif
+  for(int i = 1; i < width - 1; i++)
+  {
+    for(int j = 1; j < height - 1; j++)
+    {
+      if(!rows[j]) continue;
+      const int c = (filters == 9u) ? FCxtrans(j, i, roi_in, xtrans) : FC(j, i, filters);
+      if(in[(size_t)j * roi_in->width + i] >= clips[c] - 1e-5f)
+      {
+        cols[i] = 1;
+        break;
+      }
+    }
+  }
+
+  return TRUE;
+}
+
 /*
  * these 2 constants were computed using following Sage code:
  *
@@ -1176,7 +1240,8 @@ static inline void guide_laplacians(const float *const restrict high_freq, const
                                     float *const restrict output,
                                     const size_t width, const size_t height, const int mult,
                                     const float noise_level, const int salt,
-                                    const uint8_t scale, const float radius_sq)
+                                    const uint8_t scale, const float radius_sq,
+                                    const int x_offset, const int y_offset)
 {
   float *const restrict out = DT_IS_ALIGNED(output);
   const float *const restrict LF = DT_IS_ALIGNED(low_freq);
@@ -1184,7 +1249,8 @@ static inline void guide_laplacians(const float *const restrict high_freq, const
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none)                                                                            \
-    dt_omp_firstprivate(out, clipping_mask, HF, LF, height, width, mult, noise_level, salt, scale, radius_sq) \
+    dt_omp_firstprivate(out, clipping_mask, HF, LF, height, width, mult, noise_level, salt, scale, radius_sq, \
+                        x_offset, y_offset) \
     schedule(static)
 #endif
   for(size_t row = 0; row < height; ++row)
@@ -1310,8 +1376,10 @@ static inline void guide_laplacians(const float *const restrict high_freq, const
       // Last step of RGB reconstruct : add noise
       if((scale & LAST_SCALE) && salt && alpha > 0.f)
       {
-        // Init random number generator
-        uint32_t DT_ALIGNED_ARRAY state[4] = { splitmix32(j + 1), splitmix32((j + 1) * (i + 3)), splitmix32(1337), splitmix32(666) };
+        // Init random number generator, seeded from the coordinates in the whole image
+        const int x = j + x_offset;
+        const int y = i + y_offset;
+        uint32_t DT_ALIGNED_ARRAY state[4] = { splitmix32(x + 1), splitmix32((x + 1) * (y + 3)), splitmix32(1337), splitmix32(666) };
         xoshiro128plus(state);
         xoshiro128plus(state);
         xoshiro128plus(state);
@@ -1488,7 +1556,8 @@ static inline gint wavelets_process(const float *const restrict in, float
                                     float *const restrict LF_even,
                                     const diffuse_reconstruct_variant_t variant,
                                     const float noise_level,
-                                    const int salt, const float first_order_factor)
+                                    const int salt, const float first_order_factor,
+                                    const int x_offset, const int y_offset)
 {
   gint success = TRUE;
 
@@ -1529,7 +1598,8 @@ static inline gint wavelets_process(const float *const restrict in, float
     const float radius = sqf(equivalent_sigma_at_step(B_SPLINE_SIGMA, s * DS_FACTOR));
 
     if(variant == DIFFUSE_RECONSTRUCT_RGB)
-      guide_laplacians(HF, buffer_out, clipping_mask, reconstructed, width, height, mult, noise_level, salt, current_scale_type, radius);
+      guide_laplacians(HF, buffer_out, clipping_mask, reconstructed, width, height, mult, noise_level, salt,
+                       current_scale_type, radius, x_offset, y_offset);
     else
       heat_PDE_diffusion(HF, buffer_out, clipping_mask, reconstructed, width, height, mult, current_scale_type, first_order_factor);
 
@@ -1548,6 +1618,81 @@ static inline gint wavelets_process(const float *const restrict in, float
 }
 
 
+// The reconstruction only changes the pixels where the dilated clipping mask is not zero:
+// everywhere else, the wavelets layers sum back to their input. So it is enough to run it
+// on the bounding box of those pixels, padded by the support of the wavelets decomposition
+// so the reconstructed pixels see the same neighbourhood as on the whole image.
+// Return FALSE if nothing is clipped.
+static gboolean _clipped_bounding_box(const float *const restrict clipping_mask,
+                                      const int width, const int height, const int padding,
+                                      dt_iop_roi_t *const box)
+{
+  int x_min = width, y_min = height;
+  int x_max = -1, y_max = -1;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(clipping_mask, width, height) \
+  reduction(min : x_min, y_min) reduction(max : x_max, y_max) \
+  schedule(static)
+#endif
+  for(int i = 0; i < height; i++)
+  {
+    const float *const restrict row = clipping_mask + (size_t)i * width * 4;
+    for(int j = 0; j < width; j++)
+    {
+      if(row[j * 4 + ALPHA] > 0.f)
+      {
+        x_min = MIN(x_min, j);
+        x_max = MAX(x_max, j);
+        y_min = MIN(y_min, i);
+        y_max = MAX(y_max, i);
+      }
+    }
+  }
+
+  if(x_max < 0) return FALSE;
+
+  box->x = MAX(x_min - padding, 0);
+  box->y = MAX(y_min - padding, 0);
+  box->width = MIN(x_max + padding + 1, width) - box->x;
+  box->height = MIN(y_max + padding + 1, height) - box->y;
+  return TRUE;
+}
+
+// radius of the neighbourhood read by one wavelets_process() on the last scale,
+// see guide_laplacians() and heat_PDE_diffusion()
+static inline int _wavelets_support(const int scales)
+{
+  return 3 << scales;
+}
+
+static void _crop_4c(const float *const restrict in, const size_t width, const dt_iop_roi_t *const box,
+                     float *const restrict out)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, width, box, out) \
+  schedule(static)
+#endif
+  for(int i = 0; i < box->height; i++)
+    memcpy(out + (size_t)i * box->width * 4, in + (((size_t)(i + box->y) * width) + box->x) * 4,
+           sizeof(float) * box->width * 4);
+}
+
+static void _paste_4c(const float *const restrict in, const dt_iop_roi_t *const box, float *const restrict out,
+                      const size_t width)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, width, box, out) \
+  schedule(static)
+#endif
+  for(int i = 0; i < box->height; i++)
+    memcpy(out + (((size_t)(i + box->y) * width) + box->x) * 4, in + (size_t)i * box->width * 4,
+           sizeof(float) * box->width * 4);
+}
+
 static void process_laplacian_bayer(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
                                     const void *const restrict ivoid, void *const restrict ovoid,
                                     const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
@@ -1572,13 +1717,24 @@ static void process_laplacian_bayer(struct dt_iop_module_t *self, dt_dev_pixelpi
   const size_t ds_width = width / DS_FACTOR;
   const size_t ds_size = ds_height * ds_width;
 
+  const float *const restrict input = (const float *const restrict)ivoid;
+  float *const restrict output = (float *const restrict)ovoid;
+
   float *const restrict interpolated = dt_alloc_align_float(size * 4);  // [R, G, B, norm] for each pixel
   float *const restrict clipping_mask = dt_alloc_align_float(size * 4); // [R, G, B, norm] for each pixel
 
-  // temp buffer for blurs. We will need to cycle between them for memory efficiency
-  float *const restrict LF_odd = dt_alloc_align_float(ds_size * 4);
-  float *const restrict LF_even = dt_alloc_align_float(ds_size * 4);
-  float *const restrict temp = dt_alloc_align_float(ds_size * 4);
+  _interpolate_and_mask(input, interpolated, clipping_mask, clips, wb, filters, width, height);
+  dt_box_mean(clipping_mask, height, width, 4, 2, 1);
+
+  dt_iop_roi_t box;
+  if(!_clipped_bounding_box(clipping_mask, width, height, 0, &box))
+  {
+    // nothing to reconstruct, the output is the input
+    dt_iop_image_copy_by_size(output, input, width, height, 1);
+    dt_free_align(interpolated);
+    dt_free_align(clipping_mask);
+    return;
+  }
 
   const float scale = fmaxf(DS_FACTOR * piece->iscale / (roi_in->scale), 1.f);
   const float final_radius = (float)((int)(1 << data->scales)) / scale;
@@ -1586,28 +1742,48 @@ static void process_laplacian_bayer(struct dt_iop_module_t *self, dt_dev_pixelpi
 
   const float noise_level = data->noise_level / scale;
 
-  // wavelets scales buffers
-  float *restrict HF = dt_alloc_align_float(ds_size * 4);
   float *restrict ds_interpolated = dt_alloc_align_float(ds_size * 4);
   float *restrict ds_clipping_mask = dt_alloc_align_float(ds_size * 4);
 
-  const float *const restrict input = (const float *const restrict)ivoid;
-  float *const restrict output = (float *const restrict)ovoid;
-
-  _interpolate_and_mask(input, interpolated, clipping_mask, clips, wb, filters, width, height);
-  dt_box_mean(clipping_mask, height, width, 4, 2, 1);
-
   // Downsample
   interpolate_bilinear(clipping_mask, width, height, ds_clipping_mask, ds_width, ds_height, 4);
   interpolate_bilinear(interpolated, width, height, ds_interpolated, ds_width, ds_height, 4);
 
-  for(int i = 0; i < data->iterations; i++)
+  // the clipped spots can be too small to survive the downsampling
+  if(_clipped_bounding_box(ds_clipping_mask, ds_width, ds_height, _wavelets_support(scales), &box))
   {
-    const int salt = (i == data->iterations - 1); // add noise on the last iteration only
-    wavelets_process(ds_interpolated, temp, ds_clipping_mask, ds_width, ds_height, scales, HF, LF_odd,
-                     LF_even, DIFFUSE_RECONSTRUCT_RGB, noise_level, salt, data->solid_color);
-    wavelets_process(temp, ds_interpolated, ds_clipping_mask, ds_width, ds_height, scales, HF, LF_odd,
-                     LF_even, DIFFUSE_RECONSTRUCT_CHROMA, noise_level, salt, data->solid_color);
+    const size_t box_size = (size_t)box.width * box.height;
+
+    // temp buffer for blurs. We will need to cycle between them for memory efficiency
+    float *const restrict LF_odd = dt_alloc_align_float(box_size * 4);
+    float *const restrict LF_even = dt_alloc_align_float(box_size * 4);
+    float *const restrict temp = dt_alloc_align_float(box_size * 4);
+
+    // wavelets scales buffers
+    float *restrict HF = dt_alloc_align_float(box_size * 4);
+    float *restrict box_interpolated = dt_alloc_align_float(box_size * 4);
+    float *restrict box_clipping_mask = dt_alloc_align_float(box_size * 4);
+
+    _crop_4c(ds_interpolated, ds_width, &box, box_interpolated);
+    _crop_4c(ds_clipping_mask, ds_width, &box, box_clipping_mask);
+
+    for(int i = 0; i < data->iterations; i++)
+    {
+      const int salt = (i == data->iterations - 1); // add noise on the last iteration only
+      wavelets_process(box_interpolated, temp, box_clipping_mask, box.width, box.height, scales, HF, LF_odd,
+                       LF_even, DIFFUSE_RECONSTRUCT_RGB, noise_level, salt, data->solid_color, box.x, box.y);
+      wavelets_process(temp, box_interpolated, box_clipping_mask, box.width, box.height, scales, HF, LF_odd,
+                       LF_even, DIFFUSE_RECONSTRUCT_CHROMA, noise_level, salt, data->solid_color, box.x, box.y);
+    }
+
+    _paste_4c(box_interpolated, &box, ds_interpolated, ds_width);
+
+    dt_free_align(temp);
+    dt_free_align(LF_even);
+    dt_free_align(LF_odd);
+    dt_free_align(HF);
+    dt_free_align(box_interpolated);
+    dt_free_align(box_clipping_mask);
   }
 
   // Upsample
@@ -1621,10 +1797,6 @@ static void process_laplacian_bayer(struct dt_iop_module_t *self, dt_dev_pixelpi
 
   dt_free_align(interpolated);
   dt_free_align(clipping_mask);
-  dt_free_align(temp);
-  dt_free_align(LF_even);
-  dt_free_align(LF_odd);
-  dt_free_align(HF);
   dt_free_align(ds_interpolated);
   dt_free_align(ds_clipping_mask);
 }
@@ -1641,7 +1813,8 @@ static inline cl_int wavelets_process_cl(const int devid,
                                          cl_mem LF_even,
                                          const diffuse_reconstruct_variant_t variant,
                                          const float noise_level,
-                                         const int salt, const float solid_color)
+                                         const int salt, const float solid_color,
+                                         const int x_offset, const int y_offset)
 {
   cl_int err = DT_OPENCL_DEFAULT_ERROR;
 
@@ -1720,6 +1893,8 @@ static inline cl_int wavelets_process_cl(const int devid,
       dt_opencl_set_kernel_arg(devid, gd->kernel_highlights_guide_laplacians, 9, sizeof(int), (void *)&salt);
       dt_opencl_set_kernel_arg(devid, gd->kernel_highlights_guide_laplacians, 10, sizeof(uint8_t), (void *)&current_scale_type);
       dt_opencl_set_kernel_arg(devid, gd->kernel_highlights_guide_laplacians, 11, sizeof(float), (void *)&radius);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_highlights_guide_laplacians, 12, sizeof(int), (void *)&x_offset);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_highlights_guide_laplacians, 13, sizeof(int), (void *)&y_offset);
       err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_highlights_guide_laplacians, sizes);
       if(err != CL_SUCCESS) return err;
     }
@@ -1743,6 +1918,43 @@ static inline cl_int wavelets_process_cl(const int devid,
   return err;
 }
 
+// OpenCL counterpart of _clipped_bounding_box(), found is set to FALSE if nothing is clipped
+static cl_int _clipped_bounding_box_cl(const int devid, dt_iop_highlights_global_data_t *const gd,
+                                       cl_mem clipping_mask, const int width, const int height,
+                                       const int padding, dt_iop_roi_t *const box, gboolean *const found)
+{
+  int bounds[4] = { width, height, -1, -1 };
+  cl_mem dev_bounds = dt_opencl_alloc_device_buffer(devid, sizeof(bounds));
+  if(dev_bounds == NULL) return DT_OPENCL_DEFAULT_ERROR;
+
+  cl_int err = dt_opencl_write_buffer_to_device(devid, bounds, dev_bounds, 0, sizeof(bounds), CL_TRUE);
+  if(err != CL_SUCCESS) goto cleanup;
+
+  size_t sizes[] = { ROUNDUPDWD(width, devid), ROUNDUPDHT(height, devid), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_highlights_bounding_box, 0, sizeof(cl_mem), (void *)&clipping_mask);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_highlights_bounding_box, 1, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_highlights_bounding_box, 2, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_highlights_bounding_box, 3, sizeof(cl_mem), (void *)&dev_bounds);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_highlights_bounding_box, sizes);
+  if(err != CL_SUCCESS) goto cleanup;
+
+  err = dt_opencl_read_buffer_from_device(devid, bounds, dev_bounds, 0, sizeof(bounds), CL_TRUE);
+  if(err != CL_SUCCESS) goto cleanup;
+
+  *found = (bounds[2] >= 0);
+  if(*found)
+  {
+    box->x = MAX(bounds[0] - padding, 0);
+    box->y = MAX(bounds[1] - padding, 0);
+    box->width = MIN(bounds[2] + padding + 1, width) - box->x;
+    box->height = MIN(bounds[3] + padding + 1, height) - box->y;
+  }
+
+cleanup:
+  dt_opencl_release_mem_object(dev_bounds);
+  return err;
+}
+
 static cl_int process_laplacian_bayer_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
                                          cl_mem dev_in, cl_mem dev_out,
                                          const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
@@ -1792,6 +2004,10 @@ static cl_int process_laplacian_bayer_cl(struct dt_iop_module_t *self, dt_dev_pi
   cl_mem ds_interpolated = dt_opencl_alloc_device(devid, ds_sizes[0], ds_sizes[1], sizeof(float) * 4);
   cl_mem ds_clipping_mask = dt_opencl_alloc_device(devid, ds_sizes[0], ds_sizes[1], sizeof(float) * 4);
 
+  // the downsampled image and mask cropped to the pixels to reconstruct
+  cl_mem box_interpolated = NULL;
+  cl_mem box_clipping_mask = NULL;
+
   cl_mem clips_cl = dt_opencl_copy_host_to_device_constant(devid, 4 * sizeof(float), (float*)clips);
   cl_mem wb_cl = dt_opencl_copy_host_to_device_constant(devid, 4 * sizeof(float), (float*)wb);
 
@@ -1815,6 +2031,21 @@ static cl_int process_laplacian_bayer_cl(struct dt_iop_module_t *self, dt_dev_pi
   err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_highlights_box_blur, sizes);
   if(err != CL_SUCCESS) goto error;
 
+  dt_iop_roi_t box;
+  gboolean clipped = FALSE;
+  err = _clipped_bounding_box_cl(devid, gd, clipping_mask, width, height, 0, &box, &clipped);
+  if(err != CL_SUCCESS) goto error;
+
+  if(!clipped)
+  {
+    // nothing to reconstruct, the output is the input
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { width, height, 1 };
+    err = dt_opencl_enqueue_copy_image(devid, dev_in, dev_out, origin, origin, region);
+    if(err != CL_SUCCESS) goto error;
+    goto cleanup;
+  }
+
   // Downsample
   const int RGBa = TRUE;
   dt_opencl_set_kernel_arg(devid, gd->kernel_interpolate_bilinear, 0, sizeof(cl_mem), (void *)&clipping_mask);
@@ -1837,15 +2068,43 @@ static cl_int process_laplacian_bayer_cl(struct dt_iop_module_t *self, dt_dev_pi
   err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_interpolate_bilinear, ds_sizes);
   if(err != CL_SUCCESS) goto error;
 
-  for(int i = 0; i < data->iterations; i++)
+  // the clipped spots can be too small to survive the downsampling
+  err = _clipped_bounding_box_cl(devid, gd, ds_clipping_mask, ds_width, ds_height, _wavelets_support(scales), &box,
+                                 &clipped);
+  if(err != CL_SUCCESS) goto error;
+
+  if(clipped)
   {
-    const int salt = (i == data->iterations - 1); // add noise on the last iteration only
-    err = wavelets_process_cl(devid, ds_interpolated, temp, ds_clipping_mask, ds_sizes, ds_width, ds_height, gd, scales, HF,
-                              LF_odd, LF_even, DIFFUSE_RECONSTRUCT_RGB, noise_level, salt, data->solid_color);
+    // the wavelets buffers are at least as large as the box, only its size is processed
+    size_t box_sizes[] = { ROUNDUPDWD(box.width, devid), ROUNDUPDHT(box.height, devid), 1 };
+    size_t origin[] = { 0, 0, 0 };
+    size_t box_origin[] = { box.x, box.y, 0 };
+    size_t region[] = { box.width, box.height, 1 };
+
+    box_interpolated = dt_opencl_alloc_device(devid, box.width, box.height, sizeof(float) * 4);
+    box_clipping_mask = dt_opencl_alloc_device(devid, box.width, box.height, sizeof(float) * 4);
+    if(box_interpolated == NULL || box_clipping_mask == NULL) goto error;
+
+    err = dt_opencl_enqueue_copy_image(devid, ds_interpolated, box_interpolated, box_origin, origin, region);
     if(err != CL_SUCCESS) goto error;
+    err = dt_opencl_enqueue_copy_image(devid, ds_clipping_mask, box_clipping_mask, box_origin, origin, region);
+    if(err != CL_SUCCESS) goto error;
+
+    for(int i = 0; i < data->iterations; i++)
+    {
+      const int salt = (i == data->iterations - 1); // add noise on the last iteration only
+      err = wavelets_process_cl(devid, box_interpolated, temp, box_clipping_mask, box_sizes, box.width, box.height,
+                                gd, scales, HF, LF_odd, LF_even, DIFFUSE_RECONSTRUCT_RGB, noise_level, salt,
+                                data->solid_color, box.x, box.y);
+      if(err != CL_SUCCESS) goto error;
+
+      err = wavelets_process_cl(devid, temp, box_interpolated, box_clipping_mask, box_sizes, box.width, box.height,
+                                gd, scales, HF, LF_odd, LF_even, DIFFUSE_RECONSTRUCT_CHROMA, noise_level, salt,
+                                data->solid_color, box.x, box.y);
+      if(err != CL_SUCCESS) goto error;
+    }
 
-    err = wavelets_process_cl(devid, temp, ds_interpolated, ds_clipping_mask, ds_sizes, ds_width, ds_height, gd, scales, HF,
-                              LF_odd, LF_even, DIFFUSE_RECONSTRUCT_CHROMA, noise_level, salt, data->solid_color);
+    err = dt_opencl_enqueue_copy_image(devid, box_interpolated, ds_interpolated, origin, box_origin, region);
     if(err != CL_SUCCESS) goto error;
   }
 
@@ -1871,6 +2130,7 @@ static cl_int process_laplacian_bayer_cl(struct dt_iop_module_t *self, dt_dev_pi
   err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_highlights_remosaic_and_replace, sizes);
   if(err != CL_SUCCESS) goto error;
 
+cleanup:
   // cleanup and exit on success
   if(wb_cl) dt_opencl_release_mem_object(wb_cl);
   if(interpolated) dt_opencl_release_mem_object(interpolated);
@@ -1881,6 +2141,8 @@ static cl_int process_laplacian_bayer_cl(struct dt_iop_module_t *self, dt_dev_pi
   if(HF) dt_opencl_release_mem_object(HF);
   dt_opencl_release_mem_object(ds_clipping_mask);
   dt_opencl_release_mem_object(ds_interpolated);
+  dt_opencl_release_mem_object(box_clipping_mask);
+  dt_opencl_release_mem_object(box_interpolated);
   return err;
 
 error:
@@ -1891,6 +2153,10 @@ error:
   if(LF_even) dt_opencl_release_mem_object(LF_even);
   if(LF_odd) dt_opencl_release_mem_object(LF_odd);
   if(HF) dt_opencl_release_mem_object(HF);
+  dt_opencl_release_mem_object(ds_clipping_mask);
+  dt_opencl_release_mem_object(ds_interpolated);
+  dt_opencl_release_mem_object(box_clipping_mask);
+  dt_opencl_release_mem_object(box_interpolated);
 
   dt_print(DT_DEBUG_OPENCL, "[opencl_highlights] couldn't enqueue kernel! %s\n", cl_errstr(err));
   return err;
@@ -2001,28 +2267,63 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
                                0.987 * data->clip * piece->pipe->dsc.processed_maximum[1],
                                0.987 * data->clip * piece->pipe->dsc.processed_maximum[2], clip };
 
+      const uint8_t(*const xtrans)[6] = (const uint8_t(*const)[6])piece->pipe->dsc.xtrans;
+
+      // start from the input: this is what the passes write everywhere but on clipped pixels
+      dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, 1);
+
+      if(filters == 9u)
+      {
+        // the last pass clamps the frame borders too
+        const float clip_max = fmaxf(fmaxf(clips[0], clips[1]), clips[2]);
+        float *const out = (float *)ovoid;
+        const size_t last_row = (size_t)(roi_out->height - 1) * roi_out->width;
+        for(int i = 0; i < roi_out->width; i++)
+        {
+          out[i] = fminf(clip_max, out[i]);
+          out[last_row + i] = fminf(clip_max, out[last_row + i]);
+        }
+        for(int j = 1; j < roi_out->height - 1; j++)
+        {
+          const size_t row = (size_t)j * roi_out->width;
+          out[row] = fminf(clip_max, out[row]);
+          out[row + roi_out->width - 1] = fminf(clip_max, out[row + roi_out->width - 1]);
+        }
+      }
+
+      uint8_t *const restrict rows = dt_alloc_align(sizeof(uint8_t) * roi_out->height);
+      uint8_t *const restrict cols = dt_alloc_align(sizeof(uint8_t) * roi_out->width);
+
+      if(!_inpaint_clipped_lines((const float *)ivoid, roi_in, roi_out, clips, filters, xtrans, rows, cols))
+      {
+        dt_free_align(rows);
+        dt_free_align(cols);
+        break;
+      }
+
       if(filters == 9u)
       {
-        const uint8_t(*const xtrans)[6] = (const uint8_t(*const)[6])piece->pipe->dsc.xtrans;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
         dt_omp_firstprivate(clips, filters, ivoid, ovoid, roi_in, roi_out, \
-                            xtrans) \
-        schedule(static)
+                            xtrans, rows) \
+        schedule(dynamic)
 #endif
         for(int j = 0; j < roi_out->height; j++)
         {
+          if(!rows[j]) continue;
           interpolate_color_xtrans(ivoid, ovoid, roi_in, roi_out, 0, 1, j, clips, xtrans, 0);
           interpolate_color_xtrans(ivoid, ovoid, roi_in, roi_out, 0, -1, j, clips, xtrans, 1);
         }
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
         dt_omp_firstprivate(clips, filters, ivoid, ovoid, roi_in, roi_out, \
-                            xtrans) \
-        schedule(static)
+                            xtrans, cols) \
+        schedule(dynamic)
 #endif
         for(int i = 0; i < roi_out->width; i++)
         {
+          if(!cols[i]) continue;
           interpolate_color_xtrans(ivoid, ovoid, roi_in, roi_out, 1, 1, i, clips, xtrans, 2);
           interpolate_color_xtrans(ivoid, ovoid, roi_in, roi_out, 1, -1, i, clips, xtrans, 3);
         }
@@ -2031,12 +2332,13 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-        dt_omp_firstprivate(clips, filters, ivoid, ovoid, roi_out) \
+        dt_omp_firstprivate(clips, filters, ivoid, ovoid, roi_out, rows) \
         shared(data, piece) \
-        schedule(static)
+        schedule(dynamic)
 #endif
         for(int j = 0; j < roi_out->height; j++)
         {
+          if(!rows[j]) continue;
           interpolate_color(ivoid, ovoid, roi_out, 0, 1, j, clips, filters, 0);
           interpolate_color(ivoid, ovoid, roi_out, 0, -1, j, clips, filters, 1);
         }
@@ -2044,16 +2346,20 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 // up/down directions
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-        dt_omp_firstprivate(clips, filters, ivoid, ovoid, roi_out) \
+        dt_omp_firstprivate(clips, filters, ivoid, ovoid, roi_out, cols) \
         shared(data, piece) \
-        schedule(static)
+        schedule(dynamic)
 #endif
         for(int i = 0; i < roi_out->width; i++)
         {
+          if(!cols[i]) continue;
           interpolate_color(ivoid, ovoid, roi_out, 1, 1, i, clips, filters, 2);
           interpolate_color(ivoid, ovoid, roi_out, 1, -1, i, clips, filters, 3);
         }
       }
+
+      dt_free_align(rows);
+      dt_free_align(cols);
       break;
     }
     case DT_IOP_HIGHLIGHTS_LCH:
@@ -2117,6 +2423,7 @@ void init_global(dt_iop_module_so_t *module)
   gd->kernel_highlights_guide_laplacians = dt_opencl_create_kernel(program, "guide_laplacians");
   gd->kernel_highlights_diffuse_color = dt_opencl_create_kernel(program, "diffuse_color");
   gd->kernel_highlights_false_color = dt_opencl_create_kernel(program, "highlights_false_color");
+  gd->kernel_highlights_bounding_box = dt_opencl_create_kernel(program, "clipped_bounding_box");
   gd->kernel_interpolate_bilinear = dt_opencl_create_kernel(program, "interpolate_bilinear");
 
   const int wavelets = 35; // bspline.cl, from programs.conf
@@ -2139,6 +2446,7 @@ void cleanup_global(dt_iop_module_so_t *module)
   dt_opencl_free_kernel(gd->kernel_highlights_guide_laplacians);
   dt_opencl_free_kernel(gd->kernel_highlights_diffuse_color);
   dt_opencl_free_kernel(gd->kernel_highlights_false_color);
+  dt_opencl_free_kernel(gd->kernel_highlights_bounding_box);
 
   dt_opencl_free_kernel(gd->kernel_filmic_bspline_vertical);
   dt_opencl_free_kernel(gd->kernel_filmic_bspline_horizontal);
@@ -61,6 +61,12 @@ typedef struct dt_iop_hotpixels_data_t
   gboolean markfixed;
 } dt_iop_hotpixels_data_t;
 
+typedef struct dt_iop_hotpixels_global_data_t
+{
+  int kernel_hotpixels_bayer;
+  int kernel_hotpixels_xtrans;
+} dt_iop_hotpixels_global_data_t;
+
 
 const char *name()
 {
@@ -160,14 +166,11 @@ static int process_bayer(const dt_iop_hotpixels_data_t *data,
   return fixed;
 }
 
-/* X-Trans sensor equivalent of process_bayer(). */
-static int process_xtrans(const dt_iop_hotpixels_data_t *data,
-                          const void *const ivoid, void *const ovoid,
-                          const dt_iop_roi_t *const roi_out, const uint8_t (*const xtrans)[6])
+/* for each cell of the X-Trans sensor array, list the x/y offsets of the
+ * four radially nearest pixels of the same color */
+static void _xtrans_offsets(int offsets[6][6][4][2], const dt_iop_roi_t *const roi_out,
+                            const uint8_t (*const xtrans)[6])
 {
-  // for each cell of sensor array, pre-calculate, a list of the x/y
-  // offsets of the four radially nearest pixels of the same color
-  int offsets[6][6][4][2];
   // increasing offsets from pixel to find nearest like-colored pixels
   const int search[20][2] = { { -1, 0 },
                               { 1, 0 },
@@ -205,6 +208,15 @@ static int process_xtrans(const dt_iop_hotpixels_data_t *data,
       }
     }
   }
+}
+
+/* X-Trans sensor equivalent of process_bayer(). */
+static int process_xtrans(const dt_iop_hotpixels_data_t *data,
+                          const void *const ivoid, void *const ovoid,
+                          const dt_iop_roi_t *const roi_out, const uint8_t (*const xtrans)[6])
+{
+  int offsets[6][6][4][2];
+  _xtrans_offsets(offsets, roi_out, xtrans);
 
   const float threshold = data->threshold;
   const float multiplier = data->multiplier;
@@ -299,6 +311,101 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
 }
 
+#ifdef HAVE_OPENCL
+int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_hotpixels_gui_data_t *g = (dt_iop_hotpixels_gui_data_t *)self->gui_data;
+  const dt_iop_hotpixels_data_t *d = (dt_iop_hotpixels_data_t *)piece->data;
+  const dt_iop_hotpixels_global_data_t *gd = (dt_iop_hotpixels_global_data_t *)self->global_data;
+
+  const int devid = piece->pipe->devid;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+  const int min_neighbours = d->permissive ? 3 : 4;
+  const int markfixed = d->markfixed;
+  const gboolean is_xtrans = (piece->pipe->dsc.filters == 9u);
+  const int kernel = is_xtrans ? gd->kernel_hotpixels_xtrans : gd->kernel_hotpixels_bayer;
+
+  cl_mem dev_fixed = NULL;
+  cl_mem dev_xtrans = NULL;
+  cl_mem dev_offsets = NULL;
+  cl_int err = -999;
+
+  uint32_t fixed = 0;
+  dev_fixed = dt_opencl_alloc_device_buffer(devid, sizeof(uint32_t));
+  if(dev_fixed == NULL) goto error;
+  err = dt_opencl_write_buffer_to_device(devid, &fixed, dev_fixed, 0, sizeof(uint32_t), CL_TRUE);
+  if(err != CL_SUCCESS) goto error;
+
+  size_t sizes[] = { ROUNDUPDWD(width, devid), ROUNDUPDHT(height, devid), 1 };
+  dt_opencl_set_kernel_arg(devid, kernel, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, kernel, 1, sizeof(cl_mem), (void *)&dev_out);
+  dt_opencl_set_kernel_arg(devid, kernel, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, kernel, 3, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, kernel, 4, sizeof(float), (void *)&d->threshold);
+  dt_opencl_set_kernel_arg(devid, kernel, 5, sizeof(float), (void *)&d->multiplier);
+  dt_opencl_set_kernel_arg(devid, kernel, 6, sizeof(int), (void *)&min_neighbours);
+  dt_opencl_set_kernel_arg(devid, kernel, 7, sizeof(int), (void *)&markfixed);
+  dt_opencl_set_kernel_arg(devid, kernel, 8, sizeof(cl_mem), (void *)&dev_fixed);
+  if(is_xtrans)
+  {
+    int offsets[6][6][4][2];
+    _xtrans_offsets(offsets, roi_out, (const uint8_t(*const)[6])piece->pipe->dsc.xtrans);
+
+    dev_xtrans
+        = dt_opencl_copy_host_to_device_constant(devid, sizeof(piece->pipe->dsc.xtrans), piece->pipe->dsc.xtrans);
+    if(dev_xtrans == NULL) goto error;
+    dev_offsets = dt_opencl_copy_host_to_device_constant(devid, sizeof(offsets), offsets);
+    if(dev_offsets == NULL) goto error;
+
+    dt_opencl_set_kernel_arg(devid, kernel, 9, sizeof(int), (void *)&roi_out->x);
+    dt_opencl_set_kernel_arg(devid, kernel, 10, sizeof(int), (void *)&roi_out->y);
+    dt_opencl_set_kernel_arg(devid, kernel, 11, sizeof(cl_mem), (void *)&dev_xtrans);
+    dt_opencl_set_kernel_arg(devid, kernel, 12, sizeof(cl_mem), (void *)&dev_offsets);
+  }
+  err = dt_opencl_enqueue_kernel_2d(devid, kernel, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  if(g != NULL && self->dev->gui_attached && (piece->pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL)
+  {
+    err = dt_opencl_read_buffer_from_device(devid, &fixed, dev_fixed, 0, sizeof(uint32_t), CL_TRUE);
+    if(err != CL_SUCCESS) goto error;
+    g->pixels_fixed = fixed;
+  }
+
+  dt_opencl_release_mem_object(dev_fixed);
+  dt_opencl_release_mem_object(dev_xtrans);
+  dt_opencl_release_mem_object(dev_offsets);
+  return TRUE;
+
+error:
+  dt_opencl_release_mem_object(dev_fixed);
+  dt_opencl_release_mem_object(dev_xtrans);
+  dt_opencl_release_mem_object(dev_offsets);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_hotpixels] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
+void init_global(dt_iop_module_so_t *self)
+{
+  const int program = 38; // hotpixels.cl, from programs.conf
+  dt_iop_hotpixels_global_data_t *gd = malloc(sizeof(dt_iop_hotpixels_global_data_t));
+  self->data = gd;
+  gd->kernel_hotpixels_bayer = dt_opencl_create_kernel(program, "hotpixels_bayer");
+  gd->kernel_hotpixels_xtrans = dt_opencl_create_kernel(program, "hotpixels_xtrans");
+}
+
+void cleanup_global(dt_iop_module_so_t *self)
+{
+  dt_iop_hotpixels_global_data_t *gd = (dt_iop_hotpixels_global_data_t *)self->data;
+  dt_opencl_free_kernel(gd->kernel_hotpixels_bayer);
+  dt_opencl_free_kernel(gd->kernel_hotpixels_xtrans);
+  free(self->data);
+  self->data = NULL;
+}
+
 void reload_defaults(dt_iop_module_t *module)
 {
   const dt_image_t *img = &module->dev->image_storage;
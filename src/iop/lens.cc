@@ -124,8 +124,24 @@ typedef struct dt_iop_lensfun_global_data_t
   int kernel_lens_distort_lanczos2;
   int kernel_lens_distort_lanczos3;
   int kernel_lens_vignette;
+  int kernel_lens_map_expand;
+  int kernel_lens_map_expand_distortion; // built for 6 channels
+  int kernel_lens_map_expand_vignetting; // built for 4 channels
 } dt_iop_lensfun_global_data_t;
 
+// Distortion coordinates and vignetting are smooth over the image: lensfun samples them every LENS_MAP_STEP
+// pixels over the whole image, they are interpolated bilinearly in between. The maps are kept in the piece
+// until the lens settings or the scale change, so panning, zooming back and tiles don't call lensfun again.
+#define LENS_MAP_STEP 8
+
+typedef struct dt_iop_lensfun_map_t
+{
+  float *data;        // `channels` floats per node, rows of `width` nodes
+  int width, height;  // in nodes
+  int channels;       // 6 coordinates for the distortion, the pixel channels for the vignetting
+  uint64_t hash;      // lensfun settings the map was sampled for, 0 if none
+} dt_iop_lensfun_map_t;
+
 typedef struct dt_iop_lensfun_data_t
 {
   lfLens *lens;
@@ -140,6 +156,9 @@ typedef struct dt_iop_lensfun_data_t
   gboolean do_nan_checks;
   gboolean tca_override;
   lfLensCalibTCA custom_tca;
+  dt_iop_lensfun_map_t distortion;
+  dt_iop_lensfun_map_t vignetting;  // what lensfun makes of a 0.5 grey, as the lens_vignette kernel expects
+  dt_pthread_mutex_t maps_lock;     // tiles of one piece may run on several devices at once
 } dt_iop_lensfun_data_t;
 
 
@@ -367,6 +386,135 @@ static lfModifier * get_modifier(int *mods_done, int w, int h, const dt_iop_lens
   return mod;
 }
 
+// everything get_modifier() uses, and what it's asked for
+static uint64_t _map_hash(const dt_iop_lensfun_data_t *const d, const float orig_w, const float orig_h,
+                          const int mods_filter, const int kind)
+{
+  uint64_t hash = dt_hash(5381, (const char *)&kind, sizeof(int));
+  hash = dt_hash(hash, (const char *)&orig_w, sizeof(float));
+  hash = dt_hash(hash, (const char *)&orig_h, sizeof(float));
+  hash = dt_hash(hash, (const char *)&mods_filter, sizeof(int));
+  hash = dt_hash(hash, (const char *)&d->modify_flags, sizeof(int));
+  hash = dt_hash(hash, (const char *)&d->inverse, sizeof(int));
+  hash = dt_hash(hash, (const char *)&d->scale, sizeof(float));
+  hash = dt_hash(hash, (const char *)&d->crop, sizeof(float));
+  hash = dt_hash(hash, (const char *)&d->focal, sizeof(float));
+  hash = dt_hash(hash, (const char *)&d->aperture, sizeof(float));
+  hash = dt_hash(hash, (const char *)&d->distance, sizeof(float));
+  hash = dt_hash(hash, (const char *)&d->target_geom, sizeof(lfLensType));
+  hash = dt_hash(hash, (const char *)&d->tca_override, sizeof(gboolean));
+  if(d->tca_override) hash = dt_hash(hash, (const char *)d->custom_tca.Terms, sizeof(d->custom_tca.Terms));
+  if(d->lens->Maker) hash = dt_hash(hash, d->lens->Maker, strlen(d->lens->Maker));
+  if(d->lens->Model) hash = dt_hash(hash, d->lens->Model, strlen(d->lens->Model));
+  return MAX(hash, 1);
+}
+
+// sample the distortion (`pixelformat` 0) or the vignetting of `modifier` over the image, unless it's done already.
+// Call with d->maps_lock held.
+static const dt_iop_lensfun_map_t *_get_map(dt_iop_lensfun_map_t *const map, const lfModifier *const modifier,
+                                            const uint64_t hash, const unsigned int pixelformat, const int channels,
+                                            const float orig_w, const float orig_h)
+{
+  if(map->data && map->hash == hash) return map;
+
+  dt_free_align(map->data);
+  map->hash = 0;
+  map->width = (int)ceilf(orig_w / LENS_MAP_STEP) + 2;
+  map->height = (int)ceilf(orig_h / LENS_MAP_STEP) + 2;
+  map->channels = channels;
+  map->data = dt_alloc_align_float((size_t)map->width * map->height * channels);
+  if(map->data == NULL) return NULL;
+
+  float *const data = map->data;
+  const int width = map->width;
+  const int height = map->height;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(channels, data, height, pixelformat, width) \
+  shared(modifier) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+    for(int i = 0; i < width; i++)
+    {
+      float *const node = data + ((size_t)j * width + i) * channels;
+      if(pixelformat)
+      {
+        for(int c = 0; c < channels; c++) node[c] = 0.5f;
+        modifier->ApplyColorModification(node, i * LENS_MAP_STEP, j * LENS_MAP_STEP, 1, 1, pixelformat, channels);
+      }
+      else
+        modifier->ApplySubpixelGeometryDistortion(i * LENS_MAP_STEP, j * LENS_MAP_STEP, 1, 1, node);
+    }
+
+  map->hash = hash;
+  return map;
+}
+
+// bilinear interpolation of the map at the pixel (x, y) of the full image
+static inline void _map_sample(const dt_iop_lensfun_map_t *const map, const int x, const int y, float *const out)
+{
+  const float fx = MAX(x, 0) / (float)LENS_MAP_STEP;
+  const float fy = MAX(y, 0) / (float)LENS_MAP_STEP;
+  const int i = MIN((int)fx, map->width - 2);
+  const int j = MIN((int)fy, map->height - 2);
+  const float wx = fx - i;
+  const float wy = fy - j;
+  const int ch = map->channels;
+  const float *const n0 = map->data + ((size_t)j * map->width + i) * ch;
+  const float *const n1 = n0 + (size_t)map->width * ch;
+  for(int c = 0; c < ch; c++)
+    out[c] = (1.0f - wy) * ((1.0f - wx) * n0[c] + wx * n0[ch + c]) + wy * ((1.0f - wx) * n1[c] + wx * n1[ch + c]);
+}
+
+// distorted coordinates of the pixels x0 … x0 + width - 1 of row y, like ApplySubpixelGeometryDistortion()
+static inline void _map_row(const dt_iop_lensfun_map_t *const map, const int x0, const int y, const int width,
+                            float *const out)
+{
+  for(int x = 0; x < width; x++) _map_sample(map, x0 + x, y, out + (size_t)x * map->channels);
+}
+
+// like ApplyColorModification() on `rows` rows of the region starting at (x0, y0)
+static void _apply_vignetting(const dt_iop_lensfun_map_t *const map, float *const buf, const int x0, const int y0,
+                              const int width, const int rows)
+{
+  const int ch = map->channels;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, ch, map, rows, width, x0, y0) \
+  schedule(static)
+#endif
+  for(int y = 0; y < rows; y++)
+  {
+    float *px = buf + (size_t)y * width * ch;
+    for(int x = 0; x < width; x++, px += ch)
+    {
+      float gain[4];
+      _map_sample(map, x0 + x, y0 + y, gain);
+      for(int c = 0; c < 3; c++) px[c] *= 2.0f * gain[c];
+    }
+  }
+}
+
+// the maps `modflags` needs, NULL if they can't be allocated
+static void _get_maps(dt_iop_lensfun_data_t *const d, const lfModifier *const modifier, const int modflags,
+                      const int mods_filter, const int ch, const float orig_w, const float orig_h,
+                      const dt_iop_lensfun_map_t **distortion, const dt_iop_lensfun_map_t **vignetting)
+{
+  const unsigned int pixelformat = ch == 3 ? LF_CR_3(RED, GREEN, BLUE) : LF_CR_4(RED, GREEN, BLUE, UNKNOWN);
+
+  dt_pthread_mutex_lock(&d->maps_lock);
+  *distortion = (modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
+                    ? _get_map(&d->distortion, modifier, _map_hash(d, orig_w, orig_h, mods_filter, 0), 0, 6,
+                               orig_w, orig_h)
+                    : NULL;
+  *vignetting = (modflags & LF_MODIFY_VIGNETTING)
+                    ? _get_map(&d->vignetting, modifier, _map_hash(d, orig_w, orig_h, mods_filter, ch),
+                               pixelformat, ch, orig_w, orig_h)
+                    : NULL;
+  dt_pthread_mutex_unlock(&d->maps_lock);
+}
+
 /* Why do we care about being a monochrome image or not?
  The lensfun library does not have an algorithm for distortion or tca correction specialized for monochrome images,
    the builtin correction works with subtle differences for the color channels leading to some colorizing of the images.
@@ -381,15 +529,13 @@ static lfModifier * get_modifier(int *mods_done, int w, int h, const dt_iop_lens
 void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid, void *const ovoid,
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  const dt_iop_lensfun_data_t *const d = (dt_iop_lensfun_data_t *)piece->data;
+  dt_iop_lensfun_data_t *const d = (dt_iop_lensfun_data_t *)piece->data;
   dt_iop_lensfun_gui_data_t *g = (dt_iop_lensfun_gui_data_t *)self->gui_data;
 
   const int ch = piece->colors;
   const int ch_width = ch * roi_in->width;
   const int mask_display = piece->pipe->mask_display;
 
-  const unsigned int pixelformat = ch == 3 ? LF_CR_3(RED, GREEN, BLUE) : LF_CR_4(RED, GREEN, BLUE, UNKNOWN);
-
   if(!d->lens || !d->lens->Maker || d->crop <= 0.0f)
   {
     dt_iop_image_copy_by_size((float*)ovoid, (float*)ivoid, roi_out->width, roi_out->height, ch);
@@ -408,6 +554,18 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
   dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
 
+  const dt_iop_lensfun_map_t *distortion, *vignetting;
+  _get_maps(d, modifier, modflags, used_lf_mask, ch, orig_w, orig_h, &distortion, &vignetting);
+  delete modifier;
+
+  if((!distortion && (modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE)))
+     || (!vignetting && (modflags & LF_MODIFY_VIGNETTING)))
+  {
+    // out of memory, pass the image through
+    dt_iop_image_copy_by_size((float*)ovoid, (float*)ivoid, roi_out->width, roi_out->height, ch);
+    return;
+  }
+
   const struct dt_interpolation *const interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF_WARP);
 
   if(d->inverse)
@@ -423,15 +581,14 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(padded_bufsize, ch, ch_width, d, interpolation, ivoid, mask_display, ovoid, roi_in, roi_out)	\
+      dt_omp_firstprivate(padded_bufsize, ch, ch_width, d, distortion, interpolation, ivoid, mask_display, ovoid, roi_in, roi_out)	\
       dt_omp_sharedconst(buf, raw_monochrome) \
-      shared(modifier) \
       schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
         float *bufptr = (float*)dt_get_perthread(buf, padded_bufsize);
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, bufptr);
+        _map_row(distortion, roi_out->x, roi_out->y + y, roi_out->width, bufptr);
 
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
@@ -480,20 +637,8 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
     if(modflags & LF_MODIFY_VIGNETTING)
     {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ch, pixelformat, roi_out, ovoid) \
-      shared(modifier) \
-      schedule(static)
-#endif
-      for(int y = 0; y < roi_out->height; y++)
-      {
-        /* Colour correction: vignetting */
-        // actually this way row stride does not matter.
-        float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
-        modifier->ApplyColorModification(out, roi_out->x, roi_out->y + y, roi_out->width, 1,
-                                         pixelformat, ch * roi_out->width);
-      }
+      /* Colour correction: vignetting */
+      _apply_vignetting(vignetting, (float *)ovoid, roi_out->x, roi_out->y, roi_out->width, roi_out->height);
     }
   }
   else // correct distortions:
@@ -505,20 +650,8 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
     if(modflags & LF_MODIFY_VIGNETTING)
     {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ch, pixelformat, roi_in) \
-      shared(buf, modifier) \
-      schedule(static)
-#endif
-      for(int y = 0; y < roi_in->height; y++)
-      {
-        /* Colour correction: vignetting */
-        // actually this way row stride does not matter.
-        float *bufptr = ((float *)buf) + (size_t)ch * roi_in->width * y;
-        modifier->ApplyColorModification(bufptr, roi_in->x, roi_in->y + y, roi_in->width, 1,
-                                         pixelformat, ch * roi_in->width);
-      }
+      /* Colour correction: vignetting */
+      _apply_vignetting(vignetting, (float *)buf, roi_in->x, roi_in->y, roi_in->width, roi_in->height);
     }
 
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
@@ -530,16 +663,15 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(padded_buf2size, ch, ch_width, d, interpolation, mask_display, ovoid, roi_in, roi_out) \
+      dt_omp_firstprivate(padded_buf2size, ch, ch_width, d, distortion, interpolation, mask_display, ovoid, roi_in, roi_out) \
       dt_omp_sharedconst(buf2, raw_monochrome) \
-      shared(buf, modifier) \
+      shared(buf) \
       schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
         float *buf2ptr = (float*)dt_get_perthread(buf2, padded_buf2size);
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width,
-                                                  1, buf2ptr);
+        _map_row(distortion, roi_out->x, roi_out->y + y, roi_out->width, buf2ptr);
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
         for(int x = 0; x < roi_out->width; x++, buf2ptr += 6, out += ch)
@@ -584,7 +716,6 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
     }
     dt_free_align(buf);
   }
-  delete modifier;
 
   if(self->dev->gui_attached && g && (piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW)
   {
@@ -595,6 +726,39 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 }
 
 #ifdef HAVE_OPENCL
+// like _map_row() on the rows of a region, the map is uploaded as it is and interpolated on the device
+static cl_int _map_expand_cl(const int devid, const dt_iop_lensfun_global_data_t *const gd,
+                             const dt_iop_lensfun_map_t *const map, cl_mem dev_buf, const int x0, const int y0,
+                             const int width, const int height)
+{
+  // the variants built with a constant number of channels, when one matches
+  int kernel = gd->kernel_lens_map_expand;
+  if(map->channels == 6 && gd->kernel_lens_map_expand_distortion >= 0)
+    kernel = gd->kernel_lens_map_expand_distortion;
+  else if(map->channels == 4 && gd->kernel_lens_map_expand_vignetting >= 0)
+    kernel = gd->kernel_lens_map_expand_vignetting;
+
+  cl_mem dev_map = dt_opencl_copy_host_to_device_constant(
+      devid, sizeof(float) * map->width * map->height * map->channels, map->data);
+  if(dev_map == NULL) return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+
+  const int step = LENS_MAP_STEP;
+  size_t sizes[] = { (size_t)ROUNDUPDWD(width, devid), (size_t)ROUNDUPDHT(height, devid), 1 };
+  dt_opencl_set_kernel_arg(devid, kernel, 0, sizeof(cl_mem), (void *)&dev_map);
+  dt_opencl_set_kernel_arg(devid, kernel, 1, sizeof(cl_mem), (void *)&dev_buf);
+  dt_opencl_set_kernel_arg(devid, kernel, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, kernel, 3, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, kernel, 4, sizeof(int), (void *)&x0);
+  dt_opencl_set_kernel_arg(devid, kernel, 5, sizeof(int), (void *)&y0);
+  dt_opencl_set_kernel_arg(devid, kernel, 6, sizeof(int), (void *)&map->width);
+  dt_opencl_set_kernel_arg(devid, kernel, 7, sizeof(int), (void *)&map->height);
+  dt_opencl_set_kernel_arg(devid, kernel, 8, sizeof(int), (void *)&map->channels);
+  dt_opencl_set_kernel_arg(devid, kernel, 9, sizeof(int), (void *)&step);
+  const cl_int err = dt_opencl_enqueue_kernel_2d(devid, kernel, sizes);
+  dt_opencl_release_mem_object(dev_map);
+  return err;
+}
+
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -609,8 +773,8 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   cl_mem dev_tmp = NULL;
   cl_int err = -999;
 
-  float *tmpbuf = NULL;
   lfModifier *modifier = NULL;
+  const dt_iop_lensfun_map_t *distortion = NULL, *vignetting = NULL;
 
   const int devid = piece->pipe->devid;
   const int iwidth = roi_in->width;
@@ -622,11 +786,9 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   const int width = MAX(iwidth, owidth);
   const int height = MAX(iheight, oheight);
   const int ch = piece->colors;
-  const int tmpbufwidth = owidth * 2 * 3;
   const size_t tmpbuflen = d->inverse ? (size_t)oheight * owidth * 2 * 3 * sizeof(float)
                                       : MAX((size_t)oheight * owidth * 2 * 3, (size_t)iheight * iwidth * ch)
                                         * sizeof(float);
-  const unsigned int pixelformat = ch == 3 ? LF_CR_3(RED, GREEN, BLUE) : LF_CR_4(RED, GREEN, BLUE, UNKNOWN);
 
   const float orig_w = roi_in->scale * piece->buf_in.width, orig_h = roi_in->scale * piece->buf_in.height;
 
@@ -665,9 +827,6 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
       return FALSE;
   }
 
-  tmpbuf = (float *)dt_alloc_align(tmpbuflen);
-  if(tmpbuf == NULL) goto error;
-
   dev_tmp = (cl_mem)dt_opencl_alloc_device(devid, width, height, sizeof(float) * 4);
   if(dev_tmp == NULL) goto error;
 
@@ -678,27 +837,18 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   modifier = get_modifier(&modflags, orig_w, orig_h, d, used_lf_mask, FALSE);
   dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
 
+  _get_maps(d, modifier, modflags, used_lf_mask, ch, orig_w, orig_h, &distortion, &vignetting);
+  if((!distortion && (modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE)))
+     || (!vignetting && (modflags & LF_MODIFY_VIGNETTING)))
+    goto error;
+
   if(d->inverse)
   {
     // reverse direction (useful for renderings)
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(tmpbufwidth, roi_out) \
-      dt_omp_sharedconst(raw_monochrome) \
-      shared(tmpbuf, d, modifier) \
-      schedule(static)
-#endif
-      for(int y = 0; y < roi_out->height; y++)
-      {
-        float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, pi);
-      }
-
-      /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
-      err = dt_opencl_write_buffer_to_device(devid, tmpbuf, dev_tmpbuf, 0,
-                                             (size_t)owidth * oheight * 2 * 3 * sizeof(float), CL_TRUE);
+      err = _map_expand_cl(devid, gd, distortion, dev_tmpbuf, roi_out->x, roi_out->y,
+                           owidth, oheight);
       if(err != CL_SUCCESS) goto error;
 
       dt_opencl_set_kernel_arg(devid, ldkernel, 0, sizeof(cl_mem), (void *)&dev_in);
@@ -723,26 +873,9 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
     if(modflags & LF_MODIFY_VIGNETTING)
     {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ch, pixelformat, roi_out) \
-      shared(tmpbuf, modifier, d) \
-      schedule(static)
-#endif
-      for(int y = 0; y < roi_out->height; y++)
-      {
-        /* Colour correction: vignetting */
-        // actually this way row stride does not matter.
-        float *buf = tmpbuf + (size_t)y * ch * roi_out->width;
-        for(int k = 0; k < ch * roi_out->width; k++) buf[k] = 0.5f;
-        modifier->ApplyColorModification(buf, roi_out->x, roi_out->y + y, roi_out->width, 1,
-                                         pixelformat, ch * roi_out->width);
-      }
-
-      /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
-      err = dt_opencl_write_buffer_to_device(devid, tmpbuf, dev_tmpbuf, 0,
-                                             (size_t)ch * roi_out->width * roi_out->height * sizeof(float),
-                                             CL_TRUE);
+      /* Colour correction: vignetting */
+      err = _map_expand_cl(devid, gd, vignetting, dev_tmpbuf, roi_out->x, roi_out->y,
+                           owidth, oheight);
       if(err != CL_SUCCESS) goto error;
 
       dt_opencl_set_kernel_arg(devid, gd->kernel_lens_vignette, 0, sizeof(cl_mem), (void *)&dev_tmp);
@@ -765,25 +898,9 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
     if(modflags & LF_MODIFY_VIGNETTING)
     {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ch, pixelformat, roi_in) \
-      shared(tmpbuf, modifier, d) \
-      schedule(static)
-#endif
-      for(int y = 0; y < roi_in->height; y++)
-      {
-        /* Colour correction: vignetting */
-        // actually this way row stride does not matter.
-        float *buf = tmpbuf + (size_t)y * ch * roi_in->width;
-        for(int k = 0; k < ch * roi_in->width; k++) buf[k] = 0.5f;
-        modifier->ApplyColorModification(buf, roi_in->x, roi_in->y + y, roi_in->width, 1,
-                                         pixelformat, ch * roi_in->width);
-      }
-
-      /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
-      err = dt_opencl_write_buffer_to_device(
-          devid, tmpbuf, dev_tmpbuf, 0, (size_t)ch * roi_in->width * roi_in->height * sizeof(float), CL_TRUE);
+      /* Colour correction: vignetting */
+      err = _map_expand_cl(devid, gd, vignetting, dev_tmpbuf, roi_in->x, roi_in->y,
+                           iwidth, iheight);
       if(err != CL_SUCCESS) goto error;
 
       dt_opencl_set_kernel_arg(devid, gd->kernel_lens_vignette, 0, sizeof(cl_mem), (void *)&dev_in);
@@ -802,22 +919,8 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(tmpbufwidth, roi_out) \
-      dt_omp_sharedconst(raw_monochrome) \
-      shared(tmpbuf, d, modifier) \
-      schedule(static)
-#endif
-      for(int y = 0; y < roi_out->height; y++)
-      {
-        float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, pi);
-      }
-
-      /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
-      err = dt_opencl_write_buffer_to_device(devid, tmpbuf, dev_tmpbuf, 0,
-                                             (size_t)owidth * oheight * 2 * 3 * sizeof(float), CL_TRUE);
+      err = _map_expand_cl(devid, gd, distortion, dev_tmpbuf, roi_out->x, roi_out->y,
+                           owidth, oheight);
       if(err != CL_SUCCESS) goto error;
 
       dt_opencl_set_kernel_arg(devid, ldkernel, 0, sizeof(cl_mem), (void *)&dev_tmp);
@@ -850,14 +953,12 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
   dt_opencl_release_mem_object(dev_tmpbuf);
   dt_opencl_release_mem_object(dev_tmp);
-  if(tmpbuf != NULL) dt_free_align(tmpbuf);
   if(modifier != NULL) delete modifier;
   return TRUE;
 
 error:
   dt_opencl_release_mem_object(dev_tmp);
   dt_opencl_release_mem_object(dev_tmpbuf);
-  if(tmpbuf != NULL) dt_free_align(tmpbuf);
   if(modifier != NULL) delete modifier;
   dt_print(DT_DEBUG_OPENCL, "[opencl_lens] couldn't enqueue kernel! %d\n", err);
   return FALSE;
@@ -947,7 +1048,7 @@ int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
 void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                   float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  const dt_iop_lensfun_data_t *const d = (dt_iop_lensfun_data_t *)piece->data;
+  dt_iop_lensfun_data_t *const d = (dt_iop_lensfun_data_t *)piece->data;
 
   if(!d->lens || !d->lens->Maker || d->crop <= 0.0f)
   {
@@ -955,17 +1056,25 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
     return;
   }
 
+  // masks follow the green channel, which TCA doesn't move: share the map of process()
+  const gboolean raw_monochrome = dt_image_is_monochrome(&self->dev->image_storage);
+  const int used_lf_mask = (raw_monochrome) ? LF_MODIFY_ALL & ~LF_MODIFY_TCA : LF_MODIFY_ALL;
+
   const float orig_w = roi_in->scale * piece->buf_in.width, orig_h = roi_in->scale * piece->buf_in.height;
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   int modflags;
-  const lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, /*LF_MODIFY_TCA |*/ LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE, FALSE);
+  const lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, used_lf_mask, FALSE);
 
   dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
 
-  if(!(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE)))
+  const dt_iop_lensfun_map_t *distortion, *vignetting;
+  _get_maps(d, modifier, modflags & ~LF_MODIFY_VIGNETTING, used_lf_mask, piece->colors, orig_w, orig_h,
+            &distortion, &vignetting);
+  delete modifier;
+
+  if(!distortion)
   {
     dt_iop_image_copy_by_size(out, in, roi_out->width, roi_out->height, 1);
-    delete modifier;
     return;
   }
 
@@ -978,15 +1087,14 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(padded_bufsize, d, in, interpolation, out, roi_in, roi_out) \
+  dt_omp_firstprivate(padded_bufsize, d, distortion, in, interpolation, out, roi_in, roi_out) \
   dt_omp_sharedconst(buf) \
-  shared(modifier) \
   schedule(static)
 #endif
   for(int y = 0; y < roi_out->height; y++)
   {
     float *bufptr = (float*)dt_get_perthread(buf, padded_bufsize);
-    modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, bufptr);
+    _map_row(distortion, roi_out->x, roi_out->y + y, roi_out->width, bufptr);
 
     // reverse transform the global coords from lf to our buffer
     float *_out = out + (size_t)y * roi_out->width;
@@ -1006,7 +1114,6 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
     }
   }
   dt_free_align(buf);
-  delete modifier;
 }
 
 void modify_roi_out(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, dt_iop_roi_t *roi_out,
@@ -1235,6 +1342,8 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
 {
   piece->data = calloc(1, sizeof(dt_iop_lensfun_data_t));
   piece->data_size = sizeof(dt_iop_lensfun_data_t);
+  dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)piece->data;
+  dt_pthread_mutex_init(&d->maps_lock, NULL);
 }
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -1246,6 +1355,9 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     delete d->lens;
     d->lens = NULL;
   }
+  dt_free_align(d->distortion.data);
+  dt_free_align(d->vignetting.data);
+  dt_pthread_mutex_destroy(&d->maps_lock);
   free(piece->data);
   piece->data = NULL;
 }
@@ -1261,6 +1373,12 @@ void init_global(dt_iop_module_so_t *module)
   gd->kernel_lens_distort_lanczos2 = dt_opencl_create_kernel(program, "lens_distort_lanczos2");
   gd->kernel_lens_distort_lanczos3 = dt_opencl_create_kernel(program, "lens_distort_lanczos3");
   gd->kernel_lens_vignette = dt_opencl_create_kernel(program, "lens_vignette");
+  const int program_map = 46;              // lens.cl, from programs.conf
+  const int program_map_distortion = 47;   // lens.cl, -DLENS_MAP_CHANNELS=6
+  const int program_map_vignetting = 48;   // lens.cl, -DLENS_MAP_CHANNELS=4
+  gd->kernel_lens_map_expand = dt_opencl_create_kernel(program_map, "lens_map_expand");
+  gd->kernel_lens_map_expand_distortion = dt_opencl_create_kernel(program_map_distortion, "lens_map_expand");
+  gd->kernel_lens_map_expand_vignetting = dt_opencl_create_kernel(program_map_vignetting, "lens_map_expand");
 
   lfDatabase *dt_iop_lensfun_db = new lfDatabase;
   gd->db = (lfDatabase *)dt_iop_lensfun_db;
@@ -1442,6 +1560,9 @@ void cleanup_global(dt_iop_module_so_t *module)
   dt_opencl_free_kernel(gd->kernel_lens_distort_lanczos2);
   dt_opencl_free_kernel(gd->kernel_lens_distort_lanczos3);
   dt_opencl_free_kernel(gd->kernel_lens_vignette);
+  dt_opencl_free_kernel(gd->kernel_lens_map_expand);
+  dt_opencl_free_kernel(gd->kernel_lens_map_expand_distortion);
+  dt_opencl_free_kernel(gd->kernel_lens_map_expand_vignetting);
   free(module->data);
   module->data = NULL;
 }
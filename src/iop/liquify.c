@@ -261,6 +261,27 @@ typedef struct
   int warp_kernel;
 } dt_iop_liquify_global_data_t;
 
+// The distortion map is sparse: it only covers the union of the stamp extents, clipped to roi_out.
+// That area is split by cairo in disjoint rectangles, each of them gets a dense map.
+
+typedef struct
+{
+  int count;                       ///< number of rectangles
+  cairo_rectangle_int_t *extents;  ///< the rectangles, in roi_out coordinates before the crop
+  int *offsets;                    ///< start of the displacements of each rectangle in map
+  float complex *map;              ///< the displacements of all rectangles, one after the other
+} dt_liquify_map_t;
+
+typedef struct
+{
+  dt_iop_liquify_params_t params;
+
+  // Not part of piece->data_size: the distortion map of the last run, kept while
+  // only the modules downstream change.
+  uint64_t map_hash;               ///< 0 if no map
+  dt_liquify_map_t *map;
+} dt_iop_liquify_data_t;
+
 typedef struct
 {
   dt_iop_liquify_params_t params;
@@ -1206,26 +1227,127 @@ static float complex *create_global_distortion_map(const cairo_rectangle_int_t *
   return map;
 }
 
-static float complex *build_global_distortion_map(struct dt_iop_module_t *module,
-                                                   const dt_dev_pixelpipe_iop_t *piece,
-                                                   const dt_iop_roi_t *roi_in,
-                                                   const dt_iop_roi_t *roi_out,
-                                                   cairo_rectangle_int_t *map_extent)
+static void free_sparse_distortion_map(dt_liquify_map_t *map)
+{
+  if(map == NULL) return;
+  free(map->extents);
+  free(map->offsets);
+  dt_free_align(map->map);
+  free(map);
+}
+
+static inline gboolean rectangles_overlap(const cairo_rectangle_int_t *const a, const cairo_rectangle_int_t *const b)
+{
+  return a->x < b->x + b->width && b->x < a->x + a->width
+      && a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+/*
+  Builds the distortion map of the warps in @a interpolated only where
+  their stamps fall inside @a roi_out. Returns NULL if nothing is warped
+  there.
+*/
+
+static dt_liquify_map_t *create_sparse_distortion_map(const dt_iop_roi_t *roi_out, const GList *interpolated)
 {
+  const cairo_rectangle_int_t roi_out_rect = { roi_out->x, roi_out->y, roi_out->width, roi_out->height };
+  cairo_region_t *map_region = cairo_region_create();
+  GSList *in_roi = NULL;
+
+  for(const GList *i = interpolated; i; i = g_list_next(i))
+  {
+    const dt_liquify_warp_t *warp = ((dt_liquify_warp_t *) i->data);
+    cairo_rectangle_int_t r;
+    compute_round_stamp_extent(&r, warp);
+    if(rectangles_overlap(&r, &roi_out_rect))
+    {
+      cairo_region_union_rectangle(map_region, &r);
+      in_roi = g_slist_prepend(in_roi, i->data);
+    }
+  }
+  in_roi = g_slist_reverse(in_roi);
+  cairo_region_intersect_rectangle(map_region, &roi_out_rect);
+
+  dt_liquify_map_t *map = NULL;
+  const int count = cairo_region_num_rectangles(map_region);
+  if(count > 0)
+  {
+    map = calloc(1, sizeof(dt_liquify_map_t));
+    map->count = count;
+    map->extents = malloc(sizeof(cairo_rectangle_int_t) * count);
+    map->offsets = malloc(sizeof(int) * count);
+    size_t mapsize = 0;
+    for(int k = 0; k < count; k++)
+    {
+      cairo_region_get_rectangle(map_region, k, &map->extents[k]);
+      map->offsets[k] = mapsize;
+      mapsize += (size_t)map->extents[k].width * map->extents[k].height;
+    }
+    map->map = dt_alloc_align(sizeof(float complex) * mapsize);
+    memset(map->map, 0, sizeof(float complex) * mapsize);
+
+    // build map, each stamp is added to all the rectangles it overlaps
+    for(const GSList *i = in_roi; i; i = g_slist_next(i))
+    {
+      const dt_liquify_warp_t *warp = ((dt_liquify_warp_t *) i->data);
+      float complex *stamp = NULL;
+      cairo_rectangle_int_t r;
+      build_round_stamp(&stamp, &r, warp);
+      cairo_rectangle_int_t placed = r;
+      placed.x += (int) round(crealf(warp->point));
+      placed.y += (int) round(cimagf(warp->point));
+      for(int k = 0; k < count; k++)
+        if(rectangles_overlap(&placed, &map->extents[k]))
+          add_to_global_distortion_map(map->map + map->offsets[k], &map->extents[k], warp, stamp, &r);
+      free((void *) stamp);
+    }
+  }
+
+  g_slist_free(in_roi);
+  cairo_region_destroy(map_region);
+  return map;
+}
+
+/*
+  Returns the distortion map of the piece for these rois, or NULL if
+  nothing is warped. The map belongs to the piece: it is rebuilt only
+  when the params, the upstream distortions, the scale or roi_out
+  change.
+*/
+
+static const dt_liquify_map_t *get_distortion_map(struct dt_iop_module_t *module,
+                                                  dt_dev_pixelpipe_iop_t *piece,
+                                                  const dt_iop_roi_t *roi_in,
+                                                  const dt_iop_roi_t *roi_out)
+{
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+
+  uint64_t hash = dt_hash(5381, (const char *)&d->params, sizeof(dt_iop_liquify_params_t));
+  hash = dt_hash(hash, (const char *)&piece->distort_hash, sizeof(uint64_t));
+  hash = dt_hash(hash, (const char *)&roi_in->scale, sizeof(float));
+  hash = dt_hash(hash, (const char *)&roi_out->x, sizeof(int));
+  hash = dt_hash(hash, (const char *)&roi_out->y, sizeof(int));
+  hash = dt_hash(hash, (const char *)&roi_out->width, sizeof(int));
+  hash = dt_hash(hash, (const char *)&roi_out->height, sizeof(int));
+  hash = MAX(hash, 1);
+  if(d->map_hash == hash) return d->map;
+
+  free_sparse_distortion_map(d->map);
+  d->map = NULL;
+  d->map_hash = 0;
+
   // copy params
   dt_iop_liquify_params_t copy_params;
-  memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
+  memcpy(&copy_params, &d->params, sizeof(dt_iop_liquify_params_t));
 
   distort_paths_raw_to_piece(module, piece->pipe, roi_in->scale, &copy_params, FALSE);
 
   GList *interpolated = interpolate_paths(&copy_params);
-  GSList *interpolated_in_roi = _get_map_extent(roi_out, interpolated, map_extent);
+  d->map = create_sparse_distortion_map(roi_out, interpolated);
+  d->map_hash = hash;
 
-  float complex *map = create_global_distortion_map(map_extent, interpolated_in_roi, FALSE);
-
-  g_slist_free(interpolated_in_roi);
   g_list_free_full(interpolated, free);
-  return map;
+  return d->map;
 }
 
 // 1st pass: how large would the output be, given this input roi?
@@ -1426,23 +1548,18 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
 
   // 2. build the distortion map
 
-  cairo_rectangle_int_t map_extent;
-  float complex *map = build_global_distortion_map(self, piece, roi_in, roi_out, &map_extent);
+  const dt_liquify_map_t *map = get_distortion_map(self, piece, roi_in, roi_out);
   if(map == NULL)
     return;
 
   // 3. apply the map
 
-  if(map_extent.width != 0 && map_extent.height != 0)
-  {
-    int ch = piece->colors;
-    piece->colors = 1;
-    apply_global_distortion_map(self, piece, in, out, roi_in, roi_out, map, &map_extent);
-    piece->colors = ch;
-  }
-
-  dt_free_align((void *) map);
-
+  int ch = piece->colors;
+  piece->colors = 1;
+  for(int k = 0; k < map->count; k++)
+    apply_global_distortion_map(self, piece, in, out, roi_in, roi_out, map->map + map->offsets[k],
+                                &map->extents[k]);
+  piece->colors = ch;
 }
 
 void process(struct dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, const void *const in,
@@ -1472,17 +1589,15 @@ void process(struct dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, cons
 
   // 2. build the distortion map
 
-  cairo_rectangle_int_t map_extent;
-  float complex *map = build_global_distortion_map(module, piece, roi_in, roi_out, &map_extent);
+  const dt_liquify_map_t *map = get_distortion_map(module, piece, roi_in, roi_out);
   if(map == NULL)
     return;
 
   // 3. apply the map
 
-  if(map_extent.width != 0 && map_extent.height != 0)
-    apply_global_distortion_map(module, piece, in, out, roi_in, roi_out, map, &map_extent);
-
-  dt_free_align((void *)map);
+  for(int k = 0; k < map->count; k++)
+    apply_global_distortion_map(module, piece, in, out, roi_in, roi_out, map->map + map->offsets[k],
+                                &map->extents[k]);
 }
 
 #ifdef HAVE_OPENCL
@@ -1522,8 +1637,7 @@ static cl_int_t apply_global_distortion_map_cl(struct dt_iop_module_t *module,
                                                 const cl_mem_t dev_out,
                                                 const dt_iop_roi_t *roi_in,
                                                 const dt_iop_roi_t *roi_out,
-                                                const float complex *map,
-                                                const cairo_rectangle_int_t *map_extent)
+                                                const dt_liquify_map_t *map)
 {
   cl_int_t err = CL_MEM_OBJECT_ALLOCATION_FAILURE;
 
@@ -1571,11 +1685,14 @@ static cl_int_t apply_global_distortion_map_cl(struct dt_iop_module_t *module,
   cl_mem_t dev_roi_out = dt_opencl_copy_host_to_device_constant
     (devid, sizeof(dt_iop_roi_t), (void *) roi_out);
 
+  const int last = map->count - 1;
+  const size_t mapsize = map->offsets[last] + (size_t)map->extents[last].width * map->extents[last].height;
+
   cl_mem_t dev_map = dt_opencl_copy_host_to_device_constant
-    (devid, sizeof(float complex) * map_extent->width * map_extent->height, (void *) map);
+    (devid, sizeof(float complex) * mapsize, (void *) map->map);
 
   cl_mem_t dev_map_extent = dt_opencl_copy_host_to_device_constant
-    (devid, sizeof(cairo_rectangle_int_t), (void *) map_extent);
+    (devid, sizeof(cairo_rectangle_int_t) * map->count, (void *) map->extents);
 
   cl_mem_t dev_kdesc = dt_opencl_copy_host_to_device_constant
     (devid, sizeof(dt_liquify_kernel_descriptor_t), (void *) &kdesc);
@@ -1597,8 +1714,16 @@ static cl_int_t apply_global_distortion_map_cl(struct dt_iop_module_t *module,
   dt_opencl_set_kernel_arg(devid, gd->warp_kernel, 6, sizeof(cl_mem), &dev_kdesc);
   dt_opencl_set_kernel_arg(devid, gd->warp_kernel, 7, sizeof(cl_mem), &dev_kernel);
 
-  const size_t sizes[] = { ROUNDUPDWD(map_extent->width, devid), ROUNDUPDHT(map_extent->height, devid) };
-  err = dt_opencl_enqueue_kernel_2d(devid, gd->warp_kernel, sizes);
+  // one run per rectangle of the warped area
+  for(int rect = 0; rect < map->count; rect++)
+  {
+    const cairo_rectangle_int_t *const map_extent = &map->extents[rect];
+    dt_opencl_set_kernel_arg(devid, gd->warp_kernel, 8, sizeof(int), &rect);
+    dt_opencl_set_kernel_arg(devid, gd->warp_kernel, 9, sizeof(int), &map->offsets[rect]);
+    const size_t sizes[] = { ROUNDUPDWD(map_extent->width, devid), ROUNDUPDHT(map_extent->height, devid) };
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->warp_kernel, sizes);
+    if(err != CL_SUCCESS) break;
+  }
 
 error:
 
@@ -1635,15 +1760,12 @@ int process_cl(struct dt_iop_module_t *module,
   }
 
   // 2. build the distortion map
-  cairo_rectangle_int_t map_extent;
-  const float complex *map = build_global_distortion_map(module, piece, roi_in, roi_out, &map_extent);
+  const dt_liquify_map_t *map = get_distortion_map(module, piece, roi_in, roi_out);
   if(map == NULL)
     return TRUE;
 
   // 3. apply the map
-  if(map_extent.width != 0 && map_extent.height != 0)
-    err = apply_global_distortion_map_cl(module, piece, dev_in, dev_out, roi_in, roi_out, map, &map_extent);
-  dt_free_align((void *) map);
+  err = apply_global_distortion_map_cl(module, piece, dev_in, dev_out, roi_in, roi_out, map);
   if(err != CL_SUCCESS) goto error;
 
   return TRUE;
@@ -1687,12 +1809,15 @@ void init(dt_iop_module_t *module)
 
 void init_pipe(struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = malloc(module->params_size);
+  piece->data = calloc(1, sizeof(dt_iop_liquify_data_t));
+  // the map cache comes after the params
   piece->data_size = module->params_size;
 }
 
 void cleanup_pipe(struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  free_sparse_distortion_map(d->map);
   free(piece->data);
   piece->data = NULL;
 }
@@ -1704,7 +1829,8 @@ void commit_params(struct dt_iop_module_t *module,
                     dt_dev_pixelpipe_t *pipe,
                     dt_dev_pixelpipe_iop_t *piece)
 {
-  memcpy(piece->data, params, module->params_size);
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  memcpy(&d->params, params, module->params_size);
 }
 
 // calculate the dot product of 2 vectors.
@@ -26,6 +26,7 @@
 #include "common/colorspaces_inline_conversions.h"
 #include "common/file_location.h"
 #include "common/iop_profile.h"
+#include "common/lut3d.h"
 #include "control/control.h"
 #include "develop/imageop.h"
 #include "develop/imageop_gui.h"
@@ -34,6 +35,7 @@
 
 #include "iop/iop_api.h"
 
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <libgen.h>
 #include <png.h>
@@ -102,10 +104,22 @@ typedef enum dt_lut3d_cols_t
 
 const char invalid_filepath_prefix[] = "INVALID >> ";
 
+typedef struct dt_iop_lut3d_clut_t
+{
+  uint64_t hash;   // see _clut_hash()
+  float *clut;     // cube lut, read-only once decoded
+  uint16_t level;  // cube_size
+  int users;       // pipe nodes using it
+  void **dev_clut; // cl_mem per OpenCL device, NULL until uploaded there
+} dt_iop_lut3d_clut_t;
+
 typedef struct dt_iop_lut3d_data_t
 {
   dt_iop_lut3d_params_t params;
-  float *clut;  // cube lut pointer
+  uint64_t clut_hash; // identity of the lut file, 0 if none
+  // pointers last, they are not part of the integrity hash
+  dt_iop_lut3d_clut_t *lut; // shared with the other pipes, or NULL
+  float *clut;  // cube lut pointer, owned by lut
   uint16_t level; // cube_size
 } dt_iop_lut3d_data_t;
 
@@ -115,6 +129,8 @@ typedef struct dt_iop_lut3d_global_data_t
   int kernel_lut3d_trilinear;
   int kernel_lut3d_pyramid;
   int kernel_lut3d_none;
+  GMutex lock;  // protects the list and the device copies of the luts
+  GList *luts;  // dt_iop_lut3d_clut_t, most recently used first
 } dt_iop_lut3d_global_data_t;
 
 #ifdef HAVE_GMIC
@@ -279,94 +295,6 @@ void correct_pixel_trilinear(const float *const in, float *const out,
  }
 }
 
-// from OpenColorIO
-// https://github.com/imageworks/OpenColorIO/blob/master/src/OpenColorIO/ops/Lut3D/Lut3DOp.cpp
-void correct_pixel_tetrahedral(const float *const in, float *const out,
-                               const size_t pixel_nb, const float *const restrict clut, const uint16_t level)
-{
-  const int level2 = level * level;
-#ifdef _OPENMP
-#pragma omp parallel for SIMD() default(none) \
-  dt_omp_firstprivate(clut, in, level, level2, out, pixel_nb) \
-  schedule(static)
-#endif
-  for(size_t k = 0; k < (size_t)(pixel_nb * 4); k+=4)
-  {
-    float *const input = ((float *const)in) + k;
-    float *const output = ((float *const)out) + k;
-
-    int rgbi[3];
-    dt_aligned_pixel_t rgbd;
-    for(int c = 0; c < 3; ++c) input[c] = fminf(fmaxf(input[c], 0.0f), 1.0f);
-
-    rgbd[0] = input[0] * (float)(level - 1);
-    rgbd[1] = input[1] * (float)(level - 1);
-    rgbd[2] = input[2] * (float)(level - 1);
-
-    rgbi[0] = CLAMP((int)rgbd[0], 0, level - 2);
-    rgbi[1] = CLAMP((int)rgbd[1], 0, level - 2);
-    rgbi[2] = CLAMP((int)rgbd[2], 0, level - 2);
-
-    rgbd[0] = rgbd[0] - rgbi[0]; // delta red
-    rgbd[1] = rgbd[1] - rgbi[1]; // delta green
-    rgbd[2] = rgbd[2] - rgbi[2]; // delta blue
-
-  // indexes of P000 to P111 in clut
-    const int color = rgbi[0] + rgbi[1] * level + rgbi[2] * level * level;
-    const int i000 = color * 3;                     // P000
-    const int i100 = i000 + 3;                      // P100
-    const int i010 = (color + level) * 3;           // P010
-    const int i110 = i010 + 3;                      // P110
-    const int i001 = (color + level2) * 3;          // P001
-    const int i101 = i001 + 3;                      // P101
-    const int i011 = (color + level + level2) * 3;  // P011
-    const int i111 = i011 + 3;                      // P111
-
-    if (rgbd[0] > rgbd[1])
-    {
-      if (rgbd[1] > rgbd[2])
-      {
-        output[0] = (1-rgbd[0])*clut[i000] + (rgbd[0]-rgbd[1])*clut[i100] + (rgbd[1]-rgbd[2])*clut[i110] + rgbd[2]*clut[i111];
-        output[1] = (1-rgbd[0])*clut[i000+1] + (rgbd[0]-rgbd[1])*clut[i100+1] + (rgbd[1]-rgbd[2])*clut[i110+1] + rgbd[2]*clut[i111+1];
-        output[2] = (1-rgbd[0])*clut[i000+2] + (rgbd[0]-rgbd[1])*clut[i100+2] + (rgbd[1]-rgbd[2])*clut[i110+2] + rgbd[2]*clut[i111+2];
-      }
-      else if (rgbd[0] > rgbd[2])
-      {
-        output[0] = (1-rgbd[0])*clut[i000] + (rgbd[0]-rgbd[2])*clut[i100] + (rgbd[2]-rgbd[1])*clut[i101] + rgbd[1]*clut[i111];
-        output[1] = (1-rgbd[0])*clut[i000+1] + (rgbd[0]-rgbd[2])*clut[i100+1] + (rgbd[2]-rgbd[1])*clut[i101+1] + rgbd[1]*clut[i111+1];
-        output[2] = (1-rgbd[0])*clut[i000+2] + (rgbd[0]-rgbd[2])*clut[i100+2] + (rgbd[2]-rgbd[1])*clut[i101+2] + rgbd[1]*clut[i111+2];
-      }
-      else
-      {
-        output[0] = (1-rgbd[2])*clut[i000] + (rgbd[2]-rgbd[0])*clut[i001] + (rgbd[0]-rgbd[1])*clut[i101] + rgbd[1]*clut[i111];
-        output[1] = (1-rgbd[2])*clut[i000+1] + (rgbd[2]-rgbd[0])*clut[i001+1] + (rgbd[0]-rgbd[1])*clut[i101+1] + rgbd[1]*clut[i111+1];
-        output[2] = (1-rgbd[2])*clut[i000+2] + (rgbd[2]-rgbd[0])*clut[i001+2] + (rgbd[0]-rgbd[1])*clut[i101+2] + rgbd[1]*clut[i111+2];
-      }
-    }
-    else
-    {
-      if (rgbd[2] > rgbd[1])
-      {
-        output[0] = (1-rgbd[2])*clut[i000] + (rgbd[2]-rgbd[1])*clut[i001] + (rgbd[1]-rgbd[0])*clut[i011] + rgbd[0]*clut[i111];
-        output[1] = (1-rgbd[2])*clut[i000+1] + (rgbd[2]-rgbd[1])*clut[i001+1] + (rgbd[1]-rgbd[0])*clut[i011+1] + rgbd[0]*clut[i111+1];
-        output[2] = (1-rgbd[2])*clut[i000+2] + (rgbd[2]-rgbd[1])*clut[i001+2] + (rgbd[1]-rgbd[0])*clut[i011+2] + rgbd[0]*clut[i111+2];
-      }
-      else if (rgbd[2] > rgbd[0])
-      {
-        output[0] = (1-rgbd[1])*clut[i000] + (rgbd[1]-rgbd[2])*clut[i010] + (rgbd[2]-rgbd[0])*clut[i011] + rgbd[0]*clut[i111];
-        output[1] = (1-rgbd[1])*clut[i000+1] + (rgbd[1]-rgbd[2])*clut[i010+1] + (rgbd[2]-rgbd[0])*clut[i011+1] + rgbd[0]*clut[i111+1];
-        output[2] = (1-rgbd[1])*clut[i000+2] + (rgbd[1]-rgbd[2])*clut[i010+2] + (rgbd[2]-rgbd[0])*clut[i011+2] + rgbd[0]*clut[i111+2];
-      }
-      else
-      {
-        output[0] = (1-rgbd[1])*clut[i000] + (rgbd[1]-rgbd[0])*clut[i010] + (rgbd[0]-rgbd[2])*clut[i110] + rgbd[2]*clut[i111];
-        output[1] = (1-rgbd[1])*clut[i000+1] + (rgbd[1]-rgbd[0])*clut[i010+1] + (rgbd[0]-rgbd[2])*clut[i110+1] + rgbd[2]*clut[i111+1];
-        output[2] = (1-rgbd[1])*clut[i000+2] + (rgbd[1]-rgbd[0])*clut[i010+2] + (rgbd[0]-rgbd[2])*clut[i110+2] + rgbd[2]*clut[i111+2];
-      }
-    }
-  }
-}
-
 // from Study on the 3D Interpolation Models Used in Color Conversion
 // http://ijetch.org/papers/318-T860.pdf
 void correct_pixel_pyramid(const float *const in, float *const out,
@@ -968,6 +896,167 @@ uint16_t calculate_clut_3dl(const char *const filepath, float **clut)
   return level;
 }
 
+static int calculate_clut(dt_iop_lut3d_params_t *const p, float **clut);
+
+/* Decoded LUTs are shared by all the pipes through the global data of the module, so a LUT file is
+   parsed or a G'MIC LUT decompressed once, and not again when switching back to a LUT used recently.
+   Entries are keyed by the file path, modification time and size, or by the compressed G'MIC LUT. */
+
+// number of LUTs kept while no pipe uses them
+#define DT_IOP_LUT3D_CACHE_MAX 8
+
+static gboolean _clut_hash(const dt_iop_lut3d_params_t *const p, uint64_t *hash)
+{
+  const char *filepath = p->filepath;
+  if(!filepath[0]) return FALSE;
+
+  *hash = dt_hash(5381, filepath, strlen(filepath));
+#ifdef HAVE_GMIC
+  if(p->nb_keypoints)
+  {
+    // the compressed lut is in the params
+    const int level = DT_IOP_LUT3D_CLUT_LEVEL;
+    *hash = dt_hash(*hash, p->lutname, strlen(p->lutname));
+    *hash = dt_hash(*hash, (const char *)&p->nb_keypoints, sizeof(p->nb_keypoints));
+    *hash = dt_hash(*hash, p->c_clut, MIN(sizeof(p->c_clut), (size_t)p->nb_keypoints * 2 * 3));
+    *hash = dt_hash(*hash, (const char *)&level, sizeof(level));
+    return TRUE;
+  }
+#endif // HAVE_GMIC
+
+  gchar *lutfolder = dt_conf_get_string("plugins/darkroom/lut3d/def_path");
+  gboolean valid = FALSE;
+  if(lutfolder[0])
+  {
+    char *fullpath = g_build_filename(lutfolder, filepath, NULL);
+    GStatBuf st;
+    if(!g_stat(fullpath, &st))
+    {
+      const int64_t stamp[2] = { (int64_t)st.st_mtime, (int64_t)st.st_size };
+      *hash = dt_hash(*hash, fullpath, strlen(fullpath));
+      *hash = dt_hash(*hash, (const char *)stamp, sizeof(stamp));
+      valid = TRUE;
+    }
+    g_free(fullpath);
+  }
+  g_free(lutfolder);
+  return valid;
+}
+
+static void _clut_free(dt_iop_lut3d_clut_t *lut)
+{
+#ifdef HAVE_OPENCL
+  if(lut->dev_clut)
+  {
+    for(int devid = 0; devid < darktable.opencl->num_devs; devid++)
+      if(lut->dev_clut[devid]) dt_opencl_release_mem_object(lut->dev_clut[devid]);
+    free(lut->dev_clut);
+  }
+#endif
+  dt_free_align(lut->clut);
+  free(lut);
+}
+
+// drop the least recently used LUTs nobody uses beyond the cache size. Called with the lock held.
+static void _clut_evict(dt_iop_lut3d_global_data_t *gd)
+{
+  guint unused = 0;
+  for(GList *l = gd->luts; l; l = g_list_next(l))
+    if(((dt_iop_lut3d_clut_t *)l->data)->users == 0) unused++;
+
+  GList *l = g_list_last(gd->luts);
+  while(l && unused > DT_IOP_LUT3D_CACHE_MAX)
+  {
+    GList *prev = g_list_previous(l);
+    dt_iop_lut3d_clut_t *lut = (dt_iop_lut3d_clut_t *)l->data;
+    if(lut->users == 0)
+    {
+      gd->luts = g_list_delete_link(gd->luts, l);
+      _clut_free(lut);
+      unused--;
+    }
+    l = prev;
+  }
+}
+
+static dt_iop_lut3d_clut_t *_clut_lookup(dt_iop_lut3d_global_data_t *gd, const uint64_t hash)
+{
+  for(GList *l = gd->luts; l; l = g_list_next(l))
+  {
+    dt_iop_lut3d_clut_t *lut = (dt_iop_lut3d_clut_t *)l->data;
+    if(lut->hash == hash)
+    {
+      // most recently used first
+      gd->luts = g_list_remove_link(gd->luts, l);
+      gd->luts = g_list_concat(l, gd->luts);
+      lut->users++;
+      return lut;
+    }
+  }
+  return NULL;
+}
+
+static dt_iop_lut3d_clut_t *_clut_acquire(dt_iop_lut3d_global_data_t *gd, dt_iop_lut3d_params_t *const p,
+                                          const uint64_t hash)
+{
+  g_mutex_lock(&gd->lock);
+  dt_iop_lut3d_clut_t *lut = _clut_lookup(gd, hash);
+  g_mutex_unlock(&gd->lock);
+  if(lut) return lut;
+
+  // decode out of the lock, it is the slow part
+  float *clut = NULL;
+  const uint16_t level = calculate_clut(p, &clut);
+  if(!level || !clut)
+  {
+    // don't keep failures, the file may be fixed
+    if(clut) dt_free_align(clut);
+    return NULL;
+  }
+
+  g_mutex_lock(&gd->lock);
+  // another pipe may have decoded it meanwhile
+  lut = _clut_lookup(gd, hash);
+  if(lut)
+    dt_free_align(clut);
+  else
+  {
+    lut = calloc(1, sizeof(dt_iop_lut3d_clut_t));
+    lut->hash = hash;
+    lut->clut = clut;
+    lut->level = level;
+    lut->users = 1;
+    gd->luts = g_list_prepend(gd->luts, lut);
+    _clut_evict(gd);
+  }
+  g_mutex_unlock(&gd->lock);
+  return lut;
+}
+
+static void _clut_release(dt_iop_lut3d_global_data_t *gd, dt_iop_lut3d_clut_t *lut)
+{
+  if(!lut) return;
+  g_mutex_lock(&gd->lock);
+  lut->users--;
+  _clut_evict(gd);
+  g_mutex_unlock(&gd->lock);
+}
+
+#ifdef HAVE_OPENCL
+// the LUT is uploaded once per device and kept with it
+static cl_mem _clut_device(dt_iop_lut3d_global_data_t *gd, dt_iop_lut3d_clut_t *lut, const int devid)
+{
+  g_mutex_lock(&gd->lock);
+  if(!lut->dev_clut) lut->dev_clut = calloc(darktable.opencl->num_devs, sizeof(void *));
+  if(lut->dev_clut && !lut->dev_clut[devid])
+    lut->dev_clut[devid] = dt_opencl_copy_host_to_device_constant(
+        devid, sizeof(float) * 3 * lut->level * lut->level * lut->level, (void *)lut->clut);
+  cl_mem clut_cl = lut->dev_clut ? (cl_mem)lut->dev_clut[devid] : NULL;
+  g_mutex_unlock(&gd->lock);
+  return clut_cl;
+}
+#endif
+
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -1000,7 +1089,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
   if (clut && level)
   {
-    clut_cl = dt_opencl_copy_host_to_device_constant(devid, sizeof(float) * 3 * level * level * level, (void *)clut);
+    clut_cl = _clut_device(gd, d->lut, devid);
     if(clut_cl == NULL)
     {
       fprintf(stderr, "[lut3d process_cl] error allocating memory\n");
@@ -1043,7 +1132,6 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   }
 
 cleanup:
-  if(clut_cl) dt_opencl_release_mem_object(clut_cl);
 
   if(err != CL_SUCCESS) dt_print(DT_DEBUG_OPENCL, "[opencl_lut3d] couldn't enqueue kernel! %d\n", err);
   return (err == CL_SUCCESS) ? TRUE : FALSE;
@@ -1079,7 +1167,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       dt_ioppr_transform_image_colorspace_rgb(ibuf, obuf, width, height,
         work_profile, lut_profile, "work profile to LUT profile");
       if (interpolation == DT_IOP_TETRAHEDRAL)
-        correct_pixel_tetrahedral(obuf, obuf, (size_t)width * height, clut, level);
+        dt_lut3d_tetrahedral(obuf, obuf, (size_t)width * height, clut, level);
       else if (interpolation == DT_IOP_TRILINEAR)
         correct_pixel_trilinear(obuf, obuf, (size_t)width * height, clut, level);
       else
@@ -1090,7 +1178,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     else
     {
       if (interpolation == DT_IOP_TETRAHEDRAL)
-        correct_pixel_tetrahedral(ibuf, obuf, (size_t)width * height, clut, level);
+        dt_lut3d_tetrahedral(ibuf, obuf, (size_t)width * height, clut, level);
       else if (interpolation == DT_IOP_TRILINEAR)
         correct_pixel_trilinear(ibuf, obuf, (size_t)width * height, clut, level);
       else
@@ -1120,6 +1208,8 @@ void init_global(dt_iop_module_so_t *module)
   gd->kernel_lut3d_trilinear = dt_opencl_create_kernel(program, "lut3d_trilinear");
   gd->kernel_lut3d_pyramid = dt_opencl_create_kernel(program, "lut3d_pyramid");
   gd->kernel_lut3d_none = dt_opencl_create_kernel(program, "lut3d_none");
+  g_mutex_init(&gd->lock);
+  gd->luts = NULL;
 
 #ifdef HAVE_GMIC
   // make sure the cache dir exists
@@ -1137,6 +1227,8 @@ void cleanup_global(dt_iop_module_so_t *module)
   dt_opencl_free_kernel(gd->kernel_lut3d_trilinear);
   dt_opencl_free_kernel(gd->kernel_lut3d_pyramid);
   dt_opencl_free_kernel(gd->kernel_lut3d_none);
+  g_list_free_full(gd->luts, (GDestroyNotify)_clut_free);
+  g_mutex_clear(&gd->lock);
   free(module->data);
   module->data = NULL;
 }
@@ -1349,16 +1441,18 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 {
   dt_iop_lut3d_params_t *p = (dt_iop_lut3d_params_t *)p1;
   dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
+  dt_iop_lut3d_global_data_t *gd = (dt_iop_lut3d_global_data_t *)self->global_data;
 
-  if (strcmp(p->filepath, d->params.filepath) != 0 || strcmp(p->lutname, d->params.lutname) != 0 )
-  { // new clut file
-    if (d->clut)
-    { // reset current clut if any
-      dt_free_align(d->clut);
-      d->clut = NULL;
-      d->level = 0;
-    }
-    d->level = calculate_clut(p, &d->clut);
+  uint64_t hash = 0;
+  if(!_clut_hash(p, &hash)) hash = 0;
+
+  if(hash != d->clut_hash)
+  { // new clut file, or the file changed on disk
+    _clut_release(gd, d->lut);
+    d->lut = hash ? _clut_acquire(gd, p, hash) : NULL;
+    d->clut = d->lut ? d->lut->clut : NULL;
+    d->level = d->lut ? d->lut->level : 0;
+    d->clut_hash = hash;
   }
   memcpy(&d->params, p, sizeof(dt_iop_lut3d_params_t));
 }
@@ -1366,9 +1460,11 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
   piece->data = malloc(sizeof(dt_iop_lut3d_data_t));
-  piece->data_size = sizeof(dt_iop_lut3d_data_t);
+  piece->data_size = offsetof(dt_iop_lut3d_data_t, lut);
   dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
   memcpy(&d->params, self->default_params, sizeof(dt_iop_lut3d_params_t));
+  d->clut_hash = 0;
+  d->lut = NULL;
   d->clut = NULL;
   d->level = 0;
   d->params.filepath[0] = '\0';
@@ -1376,9 +1472,9 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;;
-  if (d->clut)
-    dt_free_align(d->clut);
+  dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
+  _clut_release((dt_iop_lut3d_global_data_t *)self->global_data, d->lut);
+  d->lut = NULL;
   d->clut = NULL;
   d->level = 0;
   free(piece->data);
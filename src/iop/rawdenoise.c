@@ -88,6 +88,10 @@ typedef struct dt_iop_rawdenoise_data_t
 
 typedef struct dt_iop_rawdenoise_global_data_t
 {
+  int kernel_rawdenoise_extract;
+  int kernel_rawdenoise_vert;
+  int kernel_rawdenoise_horiz;
+  int kernel_rawdenoise_insert;
 } dt_iop_rawdenoise_global_data_t;
 
 int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version, void *new_params,
@@ -331,7 +335,7 @@ static void wavelet_denoise_xtrans(const float *const restrict in, float *const
       fimg[col] = 0.5f;
       fimg[(size_t)(height-1)*width + col] = 0.5f;
     }
-    const size_t nthreads = darktable.num_openmp_threads; // go direct, darktable.num_openmp_threads always returns numprocs
+    const size_t nthreads = dt_omp_threads(); // the share of this pipe in the thread budget
     const size_t chunksize = (height + nthreads - 1) / nthreads;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
@@ -523,6 +527,111 @@ void reload_defaults(dt_iop_module_t *module)
   module->default_enabled = 0;
 }
 
+#ifdef HAVE_OPENCL
+int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_rawdenoise_data_t *const d = (dt_iop_rawdenoise_data_t *)piece->data;
+  const dt_iop_rawdenoise_global_data_t *const gd = (dt_iop_rawdenoise_global_data_t *)self->global_data;
+
+  const int devid = piece->pipe->devid;
+  const int width = roi_in->width;
+  const int height = roi_in->height;
+  const uint32_t filters = piece->pipe->dsc.filters;
+
+  cl_mem dev_plane = NULL;
+  cl_mem dev_interm = NULL;
+  cl_mem dev_accum = NULL;
+  cl_int err = -999;
+
+  if(!(d->threshold > 0.0f))
+  {
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { width, height, 1 };
+    err = dt_opencl_enqueue_copy_image(devid, dev_in, dev_out, origin, origin, region);
+    if(err != CL_SUCCESS) goto error;
+    return TRUE;
+  }
+
+  // one CFA site at half resolution, the vertical pass and the accumulated details
+  const size_t size = sizeof(float) * (width / 2 + 1) * (height / 2 + 1);
+  dev_plane = dt_opencl_alloc_device_buffer(devid, size);
+  if(dev_plane == NULL) goto error;
+  dev_interm = dt_opencl_alloc_device_buffer(devid, size);
+  if(dev_interm == NULL) goto error;
+  dev_accum = dt_opencl_alloc_device_buffer(devid, size);
+  if(dev_accum == NULL) goto error;
+
+  for(int c = 0; c < 4; c++) /* denoise R,G1,B,G3 individually */
+  {
+    const int color = FC(c % 2, c / 2, filters);
+    float noise[DT_IOP_RAWDENOISE_BANDS];
+    compute_channel_noise(noise, color, d);
+
+    // adjust for odd width and height
+    const int halfwidth = width / 2 + (width & (~(c >> 1)) & 1);
+    const int halfheight = height / 2 + (height & (~c) & 1);
+    size_t sizes[] = { ROUNDUPDWD(halfwidth, devid), ROUNDUPDHT(halfheight, devid), 1 };
+
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_extract, 0, sizeof(cl_mem), (void *)&dev_in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_extract, 1, sizeof(cl_mem), (void *)&dev_plane);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_extract, 2, sizeof(int), (void *)&halfwidth);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_extract, 3, sizeof(int), (void *)&halfheight);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_extract, 4, sizeof(int), (void *)&c);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_rawdenoise_extract, sizes);
+    if(err != CL_SUCCESS) goto error;
+
+    for(int lev = 0; lev < DT_IOP_RAWDENOISE_BANDS; lev++)
+    {
+      const int vscale = MIN(1 << lev, halfheight);
+      const int hscale = MIN(1 << lev, halfwidth);
+      const int first = (lev == 0);
+      const int last = (lev + 1) == DT_IOP_RAWDENOISE_BANDS;
+
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_vert, 0, sizeof(cl_mem), (void *)&dev_plane);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_vert, 1, sizeof(cl_mem), (void *)&dev_interm);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_vert, 2, sizeof(int), (void *)&halfwidth);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_vert, 3, sizeof(int), (void *)&halfheight);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_vert, 4, sizeof(int), (void *)&vscale);
+      err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_rawdenoise_vert, sizes);
+      if(err != CL_SUCCESS) goto error;
+
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_horiz, 0, sizeof(cl_mem), (void *)&dev_interm);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_horiz, 1, sizeof(cl_mem), (void *)&dev_plane);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_horiz, 2, sizeof(cl_mem), (void *)&dev_accum);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_horiz, 3, sizeof(int), (void *)&halfwidth);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_horiz, 4, sizeof(int), (void *)&halfheight);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_horiz, 5, sizeof(int), (void *)&hscale);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_horiz, 6, sizeof(float), (void *)&noise[lev]);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_horiz, 7, sizeof(int), (void *)&first);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_horiz, 8, sizeof(int), (void *)&last);
+      err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_rawdenoise_horiz, sizes);
+      if(err != CL_SUCCESS) goto error;
+    }
+
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_insert, 0, sizeof(cl_mem), (void *)&dev_plane);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_insert, 1, sizeof(cl_mem), (void *)&dev_out);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_insert, 2, sizeof(int), (void *)&halfwidth);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_insert, 3, sizeof(int), (void *)&halfheight);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_insert, 4, sizeof(int), (void *)&c);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_rawdenoise_insert, sizes);
+    if(err != CL_SUCCESS) goto error;
+  }
+
+  dt_opencl_release_mem_object(dev_plane);
+  dt_opencl_release_mem_object(dev_interm);
+  dt_opencl_release_mem_object(dev_accum);
+  return TRUE;
+
+error:
+  dt_opencl_release_mem_object(dev_plane);
+  dt_opencl_release_mem_object(dev_interm);
+  dt_opencl_release_mem_object(dev_accum);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_rawdenoise] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *params, dt_dev_pixelpipe_t *pipe,
                    dt_dev_pixelpipe_iop_t *piece)
 {
@@ -543,6 +652,31 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *params, dt_dev
 
   if (!(dt_image_is_raw(&pipe->image)))
     piece->enabled = 0;
+
+  // the X-Trans variant walks the CFA pattern sequentially, only the Bayer one runs on OpenCL
+  if(pipe->dsc.filters == 9u) piece->process_cl_ready = 0;
+}
+
+void init_global(dt_iop_module_so_t *self)
+{
+  const int program = 39; // rawdenoise.cl, from programs.conf
+  dt_iop_rawdenoise_global_data_t *gd = malloc(sizeof(dt_iop_rawdenoise_global_data_t));
+  self->data = gd;
+  gd->kernel_rawdenoise_extract = dt_opencl_create_kernel(program, "rawdenoise_extract");
+  gd->kernel_rawdenoise_vert = dt_opencl_create_kernel(program, "rawdenoise_vert");
+  gd->kernel_rawdenoise_horiz = dt_opencl_create_kernel(program, "rawdenoise_horiz");
+  gd->kernel_rawdenoise_insert = dt_opencl_create_kernel(program, "rawdenoise_insert");
+}
+
+void cleanup_global(dt_iop_module_so_t *self)
+{
+  dt_iop_rawdenoise_global_data_t *gd = (dt_iop_rawdenoise_global_data_t *)self->data;
+  dt_opencl_free_kernel(gd->kernel_rawdenoise_extract);
+  dt_opencl_free_kernel(gd->kernel_rawdenoise_vert);
+  dt_opencl_free_kernel(gd->kernel_rawdenoise_horiz);
+  dt_opencl_free_kernel(gd->kernel_rawdenoise_insert);
+  free(self->data);
+  self->data = NULL;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
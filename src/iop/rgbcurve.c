@@ -1606,6 +1606,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   else
     piece->request_histogram &= ~(DT_REQUEST_ON);
 
+  // only drawn in the gui
+  piece->histogram_params.for_display = TRUE;
+
   for(int ch = 0; ch < DT_IOP_RGBCURVE_MAX_CHANNELS; ch++)
     d->curve_changed[ch]
         = (d->params.curve_type[ch] != p->curve_type[ch] || d->params.curve_nodes[ch] != p->curve_nodes[ch]);
@@ -842,6 +842,9 @@ void commit_params(dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_
   else
     piece->request_histogram &= ~(DT_REQUEST_ON);
 
+  // only drawn in the gui
+  piece->histogram_params.for_display = TRUE;
+
   memcpy(&(d->params), p, sizeof(dt_iop_rgblevels_params_t));
 
   for(int i = 0; i < DT_IOP_RGBLEVELS_MAX_CHANNELS; i++)
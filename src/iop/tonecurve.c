@@ -665,6 +665,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   else
     piece->request_histogram &= ~(DT_REQUEST_ON);
 
+  // only drawn in the gui
+  piece->histogram_params.for_display = TRUE;
+
   for(int ch = 0; ch < ch_max; ch++)
   {
     // take care of possible change of curve type or number of nodes (not yet implemented in UI)
@@ -95,6 +95,7 @@
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
 #include "develop/imageop_gui.h"
+#include "develop/pixelpipe_aux.h"
 #include "dtgtk/drawingarea.h"
 #include "dtgtk/expander.h"
 
@@ -214,9 +215,7 @@ typedef struct dt_iop_toneequalizer_gui_data_t
   int pipe_order;
 
   // 6 uint64 to pack - contiguous-ish memory
-  uint64_t ui_preview_hash;
   uint64_t thumb_preview_hash;
-  size_t full_preview_buf_width, full_preview_buf_height;
   size_t thumb_preview_buf_width, thumb_preview_buf_height;
 
   // Misc stuff, contiguity, length and alignment unknown
@@ -228,7 +227,6 @@ typedef struct dt_iop_toneequalizer_gui_data_t
 
   // Heap arrays, 64 bits-aligned, unknown length
   float *thumb_preview_buf;
-  float *full_preview_buf;
 
   // GTK garbage, nobody cares, no SIMD here
   GtkWidget *noise, *ultra_deep_blacks, *deep_blacks, *blacks, *shadows, *midtones, *highlights, *whites, *speculars;
@@ -555,7 +553,6 @@ static void invalidate_luminance_cache(dt_iop_module_t *const self)
   //g->luminance_valid = 0;
   g->histogram_valid = 0;
   g->thumb_preview_hash = 0;
-  g->ui_preview_hash = 0;
   dt_iop_gui_leave_critical_section(self);
   dt_iop_refresh_preview(self);
 }
@@ -902,6 +899,35 @@ static inline void display_luminance_mask(const float *const restrict in,
 }
 
 
+static uint64_t luminance_mask_hash(const dt_dev_pixelpipe_iop_t *const piece, const dt_iop_roi_t *const roi_in,
+                                   const dt_iop_toneequalizer_data_t *const d)
+{
+  // The mask only depends on the input of the module and on the mask params, not on the
+  // exposure corrections.
+  uint64_t hash = dt_dev_pixelpipe_input_hash(piece);
+
+  // Don't collide with the output of that module
+  hash = dt_hash(hash, "toneequal", 9);
+  hash = dt_hash(hash, (const char *)roi_in, sizeof(dt_iop_roi_t));
+  hash = dt_hash(hash, (const char *)&d->method, sizeof(dt_iop_luminance_mask_method_t));
+  hash = dt_hash(hash, (const char *)&d->details, sizeof(dt_iop_toneequalizer_filter_t));
+  hash = dt_hash(hash, (const char *)&d->exposure_boost, sizeof(float));
+  hash = dt_hash(hash, (const char *)&d->contrast_boost, sizeof(float));
+  hash = dt_hash(hash, (const char *)&d->feathering, sizeof(float));
+  hash = dt_hash(hash, (const char *)&d->quantization, sizeof(float));
+  hash = dt_hash(hash, (const char *)&d->scale, sizeof(float));
+  hash = dt_hash(hash, (const char *)&d->radius, sizeof(int));
+  return dt_hash(hash, (const char *)&d->iterations, sizeof(int));
+}
+
+
+static void compute_luminance_mask_plane(const float *const input, float *const plane, const size_t width,
+                                        const size_t height, const void *const data)
+{
+  compute_luminance_mask(input, plane, width, height, 4, (const dt_iop_toneequalizer_data_t *)data);
+}
+
+
 __DT_CLONE_TARGETS__
 static
 void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
@@ -928,9 +954,9 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   const size_t num_elem = width * height;
   const size_t ch = 4;
 
-  // Get the hash of the upstream pipe to track changes
+  // Get the hash of the upstream pipe and of the mask params to track changes
   const int position = self->iop_order;
-  uint64_t hash = piece->global_hash;
+  const uint64_t hash = luminance_mask_hash(piece, roi_in, d);
 
   // Sanity checks
   if(width < 1 || height < 1) return;
@@ -946,6 +972,8 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
 
   // Init the luminance masks buffers
   gboolean cached = FALSE;
+  const gboolean gui_preview = self->dev->gui_attached
+                               && (piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW;
 
   if(self->dev->gui_attached)
   {
@@ -953,65 +981,43 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
     if(g->pipe_order != position)
     {
       dt_iop_gui_enter_critical_section(self);
-      g->ui_preview_hash = 0;
       g->thumb_preview_hash = 0;
       g->pipe_order = position;
       g->luminance_valid = FALSE;
       g->histogram_valid = FALSE;
       dt_iop_gui_leave_critical_section(self);
     }
+  }
 
-    if((piece->pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL)
-    {
-      // For DT_DEV_PIXELPIPE_FULL, we cache the luminance mask for performance
-      // but it's not accessed from GUI
-      // no need for threads lock since no other function is writing/reading that buffer
-
-      // Re-allocate a new buffer if the full preview size has changed
-      if(g->full_preview_buf_width != width || g->full_preview_buf_height != height)
-      {
-        if(g->full_preview_buf) dt_free_align(g->full_preview_buf);
-        g->full_preview_buf = dt_alloc_sse_ps(num_elem);
-        g->full_preview_buf_width = width;
-        g->full_preview_buf_height = height;
-      }
-
-      luminance = g->full_preview_buf;
-      cached = TRUE;
-    }
-
-    else if((piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW)
-    {
-      // For DT_DEV_PIXELPIPE_PREVIEW, we need to cache is too to compute the full image stats
-      // upon user request in GUI
-      // threads locks are required since GUI reads and writes on that buffer.
-
-      // Re-allocate a new buffer if the thumb preview size has changed
-      dt_iop_gui_enter_critical_section(self);
-      if(g->thumb_preview_buf_width != width || g->thumb_preview_buf_height != height)
-      {
-        if(g->thumb_preview_buf) dt_free_align(g->thumb_preview_buf);
-        g->thumb_preview_buf = dt_alloc_sse_ps(num_elem);
-        g->thumb_preview_buf_width = width;
-        g->thumb_preview_buf_height = height;
-        g->luminance_valid = FALSE;
-      }
-
-      luminance = g->thumb_preview_buf;
-      cached = TRUE;
+  if(gui_preview)
+  {
+    // For DT_DEV_PIXELPIPE_PREVIEW, we keep a private copy to compute the full image stats
+    // upon user request in GUI
+    // threads locks are required since GUI reads and writes on that buffer.
 
-      dt_iop_gui_leave_critical_section(self);
-    }
-    else // just to please GCC
+    // Re-allocate a new buffer if the thumb preview size has changed
+    dt_iop_gui_enter_critical_section(self);
+    if(g->thumb_preview_buf_width != width || g->thumb_preview_buf_height != height)
     {
-      luminance = dt_alloc_sse_ps(num_elem);
+      if(g->thumb_preview_buf) dt_free_align(g->thumb_preview_buf);
+      g->thumb_preview_buf = dt_alloc_sse_ps(num_elem);
+      g->thumb_preview_buf_width = width;
+      g->thumb_preview_buf_height = height;
+      g->luminance_valid = FALSE;
     }
 
+    luminance = g->thumb_preview_buf;
+    cached = TRUE;
+
+    dt_iop_gui_leave_critical_section(self);
   }
   else
   {
-    // no interactive editing/caching : just allocate a local temp buffer
-    luminance = dt_alloc_sse_ps(num_elem);
+    // Other pipes share the mask as an auxiliary plane of the input. It survives the edits of the
+    // tone curve, and pipes fed with the same input (exports, thumbnails) don't recompute it.
+    // The hash of the mask params is enough to tell masks apart.
+    luminance = dt_dev_pixelpipe_aux_plane_get(piece, in, roi_in, piece->dsc_in.cst, "toneequal_mask", &hash,
+                                               sizeof(hash), compute_luminance_mask_plane, d, &cached);
   }
 
   // Check if the luminance buffer exists
@@ -1022,56 +1028,26 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   }
 
   // Compute the luminance mask
-  if(cached)
+  if(gui_preview)
   {
-    // caching path : store the luminance mask for GUI access
+    uint64_t saved_hash;
+    hash_set_get(&g->thumb_preview_hash, &saved_hash, &self->gui_lock);
 
-    if((piece->pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL)
-    {
-      uint64_t saved_hash;
-      hash_set_get(&g->ui_preview_hash, &saved_hash, &self->gui_lock);
-
-      dt_iop_gui_enter_critical_section(self);
-      const int luminance_valid = g->luminance_valid;
-      dt_iop_gui_leave_critical_section(self);
+    dt_iop_gui_enter_critical_section(self);
+    const int luminance_valid = g->luminance_valid;
+    dt_iop_gui_leave_critical_section(self);
 
-      if(hash != saved_hash || !luminance_valid)
-      {
-        /* compute only if upstream pipe state has changed */
-        compute_luminance_mask(in, luminance, width, height, ch, d);
-        hash_set_get(&hash, &g->ui_preview_hash, &self->gui_lock);
-      }
-    }
-    else if((piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW)
+    if(saved_hash != hash || !luminance_valid)
     {
-      uint64_t saved_hash;
-      hash_set_get(&g->thumb_preview_hash, &saved_hash, &self->gui_lock);
-
+      /* compute only if upstream pipe state or mask params have changed */
       dt_iop_gui_enter_critical_section(self);
-      const int luminance_valid = g->luminance_valid;
-      dt_iop_gui_leave_critical_section(self);
-
-      if(saved_hash != hash || !luminance_valid)
-      {
-        /* compute only if upstream pipe state has changed */
-        dt_iop_gui_enter_critical_section(self);
-        g->thumb_preview_hash = hash;
-        g->histogram_valid = FALSE;
-        compute_luminance_mask(in, luminance, width, height, ch, d);
-        g->luminance_valid = TRUE;
-        dt_iop_gui_leave_critical_section(self);
-      }
-    }
-    else // make it dummy-proof
-    {
+      g->thumb_preview_hash = hash;
+      g->histogram_valid = FALSE;
       compute_luminance_mask(in, luminance, width, height, ch, d);
+      g->luminance_valid = TRUE;
+      dt_iop_gui_leave_critical_section(self);
     }
   }
-  else
-  {
-    // no caching path : compute no matter what
-    compute_luminance_mask(in, luminance, width, height, ch, d);
-  }
 
   // Display output
   if(self->dev->gui_attached && (piece->pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL)
@@ -1090,7 +1066,7 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
     apply_toneequalizer(in, luminance, out, roi_in, roi_out, ch, d);
   }
 
-  if(!cached) dt_free_align(luminance);
+  dt_dev_pixelpipe_aux_release(luminance, cached);
 }
 
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
@@ -1277,7 +1253,6 @@ static void gui_cache_init(struct dt_iop_module_t *self)
   if(g == NULL) return;
 
   dt_iop_gui_enter_critical_section(self);
-  g->ui_preview_hash = 0;
   g->thumb_preview_hash = 0;
   g->max_histogram = 1;
   g->scale = 1.0f;
@@ -1299,10 +1274,6 @@ static void gui_cache_init(struct dt_iop_module_t *self)
   g->cursor_valid = FALSE;         // TRUE if mouse cursor is over the preview image
   g->has_focus = FALSE;            // TRUE if module has focus from GTK
 
-  g->full_preview_buf = NULL;
-  g->full_preview_buf_width = 0;
-  g->full_preview_buf_height = 0;
-
   g->thumb_preview_buf = NULL;
   g->thumb_preview_buf_width = 0;
   g->thumb_preview_buf_height = 0;
@@ -3206,7 +3177,6 @@ void gui_cleanup(struct dt_iop_module_t *self)
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_develop_preview_pipe_finished_callback), self);
 
   if(g->thumb_preview_buf) dt_free_align(g->thumb_preview_buf);
-  if(g->full_preview_buf) dt_free_align(g->full_preview_buf);
   if(g->desc) pango_font_description_free(g->desc);
   if(g->layout) g_object_unref(g->layout);
   if(g->cr) cairo_destroy(g->cr);
@@ -120,6 +120,40 @@ typedef struct dt_iop_watermark_gui_data_t
   GtkWidget *color_picker_button;
 } dt_iop_watermark_gui_data_t;
 
+// everything the overlay raster depends on, besides the watermark document itself
+typedef struct dt_iop_watermark_geometry_t
+{
+  int roi_x, roi_y, width, height;
+  float roi_scale;
+  float buf_width, buf_height;
+  float scale, xoffset, yoffset, rotate;
+  int alignment;
+  dt_iop_watermark_base_scale_t sizeto;
+} dt_iop_watermark_geometry_t;
+
+/* rendering the watermark is the expensive part of the module, and exporting a batch
+   with the same watermark and output size renders the same raster for every image.
+   So the last few rasters are kept for all the pipes, and looked up by the checksum
+   of the watermark file, after the substitution of the variables, and the geometry. */
+#define DT_WATERMARK_CACHE_ENTRIES 3
+
+typedef struct dt_iop_watermark_overlay_t
+{
+  gchar *checksum;
+  dt_iop_watermark_geometry_t geometry;
+  guint8 *image;    // premultiplied ARGB32 of roi_out size, stride 4 * width
+  dt_iop_roi_t box; // of the non transparent pixels, empty if there is none
+  int users;        // pipes compositing it right now, it can't be freed meanwhile
+  uint64_t last_used;
+} dt_iop_watermark_overlay_t;
+
+typedef struct dt_iop_watermark_global_data_t
+{
+  dt_pthread_mutex_t lock;
+  uint64_t clock;
+  dt_iop_watermark_overlay_t overlays[DT_WATERMARK_CACHE_ENTRIES];
+} dt_iop_watermark_global_data_t;
+
 int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version,
                   void *new_params, const int new_version)
 {
@@ -444,75 +478,62 @@ static gchar *_watermark_get_svgdoc(dt_iop_module_t *self, dt_iop_watermark_data
   return svgdata;
 }
 
-void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
-             void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+static void _overlay_free(dt_iop_watermark_overlay_t *overlay)
 {
-  dt_iop_watermark_data_t *data = (dt_iop_watermark_data_t *)piece->data;
-  float *in = (float *)ivoid;
-  float *out = (float *)ovoid;
-  const int ch = piece->colors;
-  const float angle = (M_PI / 180) * (-data->rotate);
-
-  gchar configdir[PATH_MAX] = { 0 };
-  gchar datadir[PATH_MAX] = { 0 };
-  gchar *filename;
-  dt_loc_get_datadir(datadir, sizeof(datadir));
-  dt_loc_get_user_config_dir(configdir, sizeof(configdir));
-  g_strlcat(datadir, "/watermarks/", sizeof(datadir));
-  g_strlcat(configdir, "/watermarks/", sizeof(configdir));
-  g_strlcat(datadir, data->filename, sizeof(datadir));
-  g_strlcat(configdir, data->filename, sizeof(configdir));
-
-  if(g_file_test(configdir, G_FILE_TEST_EXISTS))
-    filename = configdir;
-  else if(g_file_test(datadir, G_FILE_TEST_EXISTS))
-    filename = datadir;
-  else
-  {
-    dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
-    return;
-  }
+  g_free(overlay->checksum);
+  g_free(overlay->image);
+  overlay->checksum = NULL;
+  overlay->image = NULL;
+}
 
-  // find out the watermark type
-  dt_iop_watermark_type_t type;
-  const gchar *extension = strrchr(data->filename, '.');
-  if(extension)
+// bounding box of the pixels covered by the watermark, the premultiplied color is zero where alpha is
+static void _overlay_bounding_box(const guint8 *const image, const int width, const int height,
+                                  dt_iop_roi_t *box)
+{
+  int x_min = width, y_min = height;
+  int x_max = -1, y_max = -1;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(image, width, height) \
+  reduction(min : x_min, y_min) reduction(max : x_max, y_max) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
   {
-    if(!g_ascii_strcasecmp(extension, ".svg"))
-      type = DT_WTM_SVG;
-    else if(!g_ascii_strcasecmp(extension, ".png"))
-      type = DT_WTM_PNG;
-    else // this should not happen
+    const guint8 *const row = image + (size_t)4 * width * j;
+    for(int i = 0; i < width; i++)
     {
-      dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
-      return;
+      if(row[4 * i + 3])
+      {
+        x_min = MIN(x_min, i);
+        x_max = MAX(x_max, i);
+        y_min = MIN(y_min, j);
+        y_max = MAX(y_max, j);
+      }
     }
   }
-  else
-  {
-    dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
-    return;
-  }
 
-  /* Load svg if not loaded */
-  gchar *svgdoc = NULL;
-  if(type == DT_WTM_SVG)
-  {
-    svgdoc = _watermark_get_svgdoc(self, data, &piece->pipe->image, filename);
-    if(!svgdoc)
-    {
-      dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
-      return;
-    }
-  }
+  box->x = x_min;
+  box->y = y_min;
+  box->width = MAX(x_max - x_min + 1, 0);
+  box->height = MAX(y_max - y_min + 1, 0);
+  box->scale = 1.0f;
+}
+
+/* render the watermark in a premultiplied ARGB32 raster of the size of roi_out.
+   Returns NULL on error. svgdoc is only used for svg watermarks. */
+static guint8 *_render_overlay(dt_iop_watermark_data_t *data, dt_dev_pixelpipe_iop_t *piece,
+                               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                               const dt_iop_watermark_type_t type, const gchar *filename, const gchar *svgdoc)
+{
+  const float angle = (M_PI / 180) * (-data->rotate);
 
   /* setup stride for performance */
   const int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, roi_out->width);
   if(stride == -1)
   {
     fprintf(stderr, "[watermark] cairo stride error\n");
-    dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
-    return;
+    return NULL;
   }
 
   /* create a cairo memory surface that is later used for reading watermark overlay data */
@@ -524,8 +545,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     fprintf(stderr, "[watermark] cairo surface error: %s\n",
             cairo_status_to_string(cairo_surface_status(surface)));
     g_free(image);
-    dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
-    return;
+    return NULL;
   }
 
   // rsvg (or some part of cairo which is used underneath) isn't thread safe, for example when handling fonts
@@ -537,16 +557,14 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     /* create the rsvghandle from parsed svg data */
     GError *error = NULL;
     svg = rsvg_handle_new_from_data((const guint8 *)svgdoc, strlen(svgdoc), &error);
-    g_free(svgdoc);
     if(!svg || error)
     {
       cairo_surface_destroy(surface);
       g_free(image);
-      dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
       dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
       fprintf(stderr, "[watermark] error processing svg file: %s\n", error->message);
       g_error_free(error);
-      return;
+      return NULL;
     }
   }
 
@@ -570,9 +588,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
                 cairo_status_to_string(cairo_surface_status(surface_two)));
         cairo_surface_destroy(surface);
         g_free(image);
-        dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
         dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
-        return;
+        return NULL;
       }
       dimension.width = cairo_image_surface_get_width(surface_two);
       dimension.height = cairo_image_surface_get_height(surface_two);
@@ -686,9 +703,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       g_object_unref(svg);
       g_free(image);
       g_free(image_two);
-      dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
       dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
-      return;
+      return NULL;
     }
   }
 
@@ -766,37 +782,236 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   /* ensure that all operations on surface finishing up */
   cairo_surface_flush(surface);
 
-  /* render surface on output */
-  guint8 *sd = image;
-  const float opacity = data->opacity / 100.0f;
+  /* clean up */
+  cairo_surface_destroy(surface);
+  cairo_surface_destroy(surface_two);
+  if(type == DT_WTM_SVG)
+  {
+    g_free(image_two);
+    g_object_unref(svg);
+  }
+
+  return image;
+}
+
+static gchar *_watermark_checksum(dt_iop_watermark_type_t type, const gchar *filename, const gchar *svgdoc)
+{
+  if(type == DT_WTM_SVG) return g_compute_checksum_for_string(G_CHECKSUM_MD5, svgdoc, -1);
+
+  gchar *contents = NULL;
+  gsize length = 0;
+  if(!g_file_get_contents(filename, &contents, &length, NULL)) return NULL;
+  gchar *checksum = g_compute_checksum_for_data(G_CHECKSUM_MD5, (const guchar *)contents, length);
+  g_free(contents);
+  return checksum;
+}
+
+// find the raster in the cache and mark it used, or NULL
+static dt_iop_watermark_overlay_t *_overlay_acquire(dt_iop_watermark_global_data_t *gd, const gchar *checksum,
+                                                    const dt_iop_watermark_geometry_t *geometry)
+{
+  dt_iop_watermark_overlay_t *found = NULL;
+  dt_pthread_mutex_lock(&gd->lock);
+  for(int k = 0; k < DT_WATERMARK_CACHE_ENTRIES; k++)
+  {
+    dt_iop_watermark_overlay_t *overlay = gd->overlays + k;
+    if(overlay->image && !strcmp(overlay->checksum, checksum)
+       && !memcmp(&overlay->geometry, geometry, sizeof(dt_iop_watermark_geometry_t)))
+    {
+      overlay->users++;
+      overlay->last_used = ++gd->clock;
+      found = overlay;
+      break;
+    }
+  }
+  dt_pthread_mutex_unlock(&gd->lock);
+  return found;
+}
+
+/* store a new raster in place of the least recently used unused one, and mark it used.
+   Returns NULL if none is free, then the caller keeps the raster. */
+static dt_iop_watermark_overlay_t *_overlay_insert(dt_iop_watermark_global_data_t *gd, gchar *checksum,
+                                                   const dt_iop_watermark_geometry_t *geometry, guint8 *image,
+                                                   const dt_iop_roi_t *box)
+{
+  dt_iop_watermark_overlay_t *victim = NULL;
+  dt_pthread_mutex_lock(&gd->lock);
+  for(int k = 0; k < DT_WATERMARK_CACHE_ENTRIES; k++)
+  {
+    dt_iop_watermark_overlay_t *overlay = gd->overlays + k;
+    if(overlay->users) continue;
+    if(!victim || !overlay->image || (victim->image && overlay->last_used < victim->last_used))
+      victim = overlay;
+  }
+  if(victim)
+  {
+    _overlay_free(victim);
+    victim->checksum = checksum;
+    victim->geometry = *geometry;
+    victim->image = image;
+    victim->box = *box;
+    victim->users = 1;
+    victim->last_used = ++gd->clock;
+  }
+  dt_pthread_mutex_unlock(&gd->lock);
+  return victim;
+}
+
+static void _overlay_release(dt_iop_watermark_global_data_t *gd, dt_iop_watermark_overlay_t *overlay)
+{
+  dt_pthread_mutex_lock(&gd->lock);
+  overlay->users--;
+  dt_pthread_mutex_unlock(&gd->lock);
+}
+
+static void _composite(const float *const restrict in, float *const restrict out, const guint8 *const overlay,
+                       const dt_iop_roi_t *const roi_out, const dt_iop_roi_t *const box, const int ch,
+                       const float opacity)
+{
+  dt_iop_image_copy_by_size(out, in, roi_out->width, roi_out->height, ch);
+
+  const int width = roi_out->width;
+  // the raster is 8 bits, opacity and normalization go together
+  const float factor = opacity / 255.0f;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(roi_out, in, out, sd, opacity, ch)   \
+  dt_omp_firstprivate(in, out, overlay, box, width, ch, factor) \
   schedule(static)
 #endif
-  for(int j = 0; j < roi_out->height * roi_out->width; j++)
+  for(int j = box->y; j < box->y + box->height; j++)
   {
-    float *const i = in + ch*j;
-    float *const o = out + ch*j;
-    guint8 *const s = sd + 4*j;
-    const float alpha = (s[3] / 255.0f) * opacity;
-    /* svg uses a premultiplied alpha, so only use opacity for the blending */
-    o[0] = ((1.0f - alpha) * i[0]) + (opacity * (s[2] / 255.0f));
-    o[1] = ((1.0f - alpha) * i[1]) + (opacity * (s[1] / 255.0f));
-    o[2] = ((1.0f - alpha) * i[2]) + (opacity * (s[0] / 255.0f));
-    o[3] = in[3];
+    const size_t row = (size_t)j * width + box->x;
+    const float *const restrict i = in + ch * row;
+    float *const restrict o = out + ch * row;
+    const guint8 *const restrict s = overlay + 4 * row;
+    for(int k = 0; k < box->width; k++)
+    {
+      /* svg uses a premultiplied alpha, so only use opacity for the blending */
+      const float alpha = s[4 * k + 3] * factor;
+      const dt_aligned_pixel_t color = { s[4 * k + 2], s[4 * k + 1], s[4 * k + 0], 0.0f };
+      dt_aligned_pixel_t blended;
+      for_four_channels(c, aligned(color, blended))
+        blended[c] = (1.0f - alpha) * i[ch * k + c] + factor * color[c];
+      blended[3] = i[ch * k + 3];
+      copy_pixel(o + ch * k, blended);
     }
+  }
+}
 
-  /* clean up */
-  cairo_surface_destroy(surface);
-  cairo_surface_destroy(surface_two);
-  g_free(image);
+void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+             void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_watermark_data_t *data = (dt_iop_watermark_data_t *)piece->data;
+  dt_iop_watermark_global_data_t *gd = (dt_iop_watermark_global_data_t *)self->global_data;
+  const int ch = piece->colors;
+
+  gchar configdir[PATH_MAX] = { 0 };
+  gchar datadir[PATH_MAX] = { 0 };
+  gchar *filename;
+  dt_loc_get_datadir(datadir, sizeof(datadir));
+  dt_loc_get_user_config_dir(configdir, sizeof(configdir));
+  g_strlcat(datadir, "/watermarks/", sizeof(datadir));
+  g_strlcat(configdir, "/watermarks/", sizeof(configdir));
+  g_strlcat(datadir, data->filename, sizeof(datadir));
+  g_strlcat(configdir, data->filename, sizeof(configdir));
+
+  if(g_file_test(configdir, G_FILE_TEST_EXISTS))
+    filename = configdir;
+  else if(g_file_test(datadir, G_FILE_TEST_EXISTS))
+    filename = datadir;
+  else
+  {
+    dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
+    return;
+  }
+
+  // find out the watermark type
+  dt_iop_watermark_type_t type;
+  const gchar *extension = strrchr(data->filename, '.');
+  if(extension)
+  {
+    if(!g_ascii_strcasecmp(extension, ".svg"))
+      type = DT_WTM_SVG;
+    else if(!g_ascii_strcasecmp(extension, ".png"))
+      type = DT_WTM_PNG;
+    else // this should not happen
+    {
+      dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
+      return;
+    }
+  }
+  else
+  {
+    dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
+    return;
+  }
+
+  /* Load svg if not loaded */
+  gchar *svgdoc = NULL;
   if(type == DT_WTM_SVG)
   {
-    g_free(image_two);
-    g_object_unref(svg);
+    svgdoc = _watermark_get_svgdoc(self, data, &piece->pipe->image, filename);
+    if(!svgdoc)
+    {
+      dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
+      return;
+    }
+  }
+
+  dt_iop_watermark_geometry_t geometry;
+  memset(&geometry, 0, sizeof(geometry));
+  geometry.roi_x = roi_in->x;
+  geometry.roi_y = roi_in->y;
+  geometry.width = roi_out->width;
+  geometry.height = roi_out->height;
+  geometry.roi_scale = roi_out->scale;
+  geometry.buf_width = piece->buf_in.width;
+  geometry.buf_height = piece->buf_in.height;
+  geometry.scale = data->scale;
+  geometry.xoffset = data->xoffset;
+  geometry.yoffset = data->yoffset;
+  geometry.rotate = data->rotate;
+  geometry.alignment = data->alignment;
+  geometry.sizeto = data->sizeto;
+
+  gchar *checksum = _watermark_checksum(type, filename, svgdoc);
+  dt_iop_watermark_overlay_t *overlay = checksum ? _overlay_acquire(gd, checksum, &geometry) : NULL;
+
+  guint8 *image = NULL;
+  dt_iop_roi_t box;
+  if(overlay)
+  {
+    g_free(checksum);
+    checksum = NULL;
+    image = overlay->image;
+    box = overlay->box;
+  }
+  else
+  {
+    image = _render_overlay(data, piece, roi_in, roi_out, type, filename, svgdoc);
+    if(image == NULL)
+    {
+      g_free(checksum);
+      g_free(svgdoc);
+      dt_iop_image_copy_by_size(ovoid, ivoid, roi_out->width, roi_out->height, ch);
+      return;
+    }
+    _overlay_bounding_box(image, roi_out->width, roi_out->height, &box);
+    // the cache owns the checksum and the raster on success
+    if(checksum) overlay = _overlay_insert(gd, checksum, &geometry, image, &box);
   }
+  g_free(svgdoc);
 
+  /* render surface on output */
+  _composite((const float *)ivoid, (float *)ovoid, image, roi_out, &box, ch, data->opacity / 100.0f);
+
+  if(overlay)
+    _overlay_release(gd, overlay);
+  else
+  {
+    g_free(checksum);
+    g_free(image);
+  }
 }
 
 static void watermark_callback(GtkWidget *tb, gpointer user_data)
@@ -1006,6 +1221,23 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 // fprintf(stderr, "Commit params: %s...\n",d->filename);
 }
 
+void init_global(dt_iop_module_so_t *module)
+{
+  dt_iop_watermark_global_data_t *gd
+      = (dt_iop_watermark_global_data_t *)calloc(1, sizeof(dt_iop_watermark_global_data_t));
+  dt_pthread_mutex_init(&gd->lock, NULL);
+  module->data = gd;
+}
+
+void cleanup_global(dt_iop_module_so_t *module)
+{
+  dt_iop_watermark_global_data_t *gd = (dt_iop_watermark_global_data_t *)module->data;
+  for(int k = 0; k < DT_WATERMARK_CACHE_ENTRIES; k++) _overlay_free(gd->overlays + k);
+  dt_pthread_mutex_destroy(&gd->lock);
+  free(module->data);
+  module->data = NULL;
+}
+
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
   piece->data = malloc(sizeof(dt_iop_watermark_data_t));
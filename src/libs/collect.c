@@ -1318,35 +1318,52 @@ static void tree_view(dt_lib_collect_rule_t *dr)
 
     /* query construction */
     gchar *where_ext = dt_collection_get_extended_where(darktable.collection, dr->num);
+    // when no other rule narrows the collection, the counts kept up to date by the database are the right ones
+    const gboolean unfiltered = !g_strcmp0(where_ext, "(1=1)");
     gchar *query = 0;
     switch (property)
     {
       case DT_COLLECTION_PROP_FOLDERS:
         // clang-format off
-        query = g_strdup_printf("SELECT folder, film_rolls_id, COUNT(*) AS count, status"
-                                " FROM main.images AS mi"
-                                " JOIN (SELECT fr.id AS film_rolls_id, folder, status"
-                                "       FROM main.film_rolls AS fr"
-                                "       JOIN memory.film_folder AS ff"
-                                "       ON fr.id = ff.id)"
-                                "   ON film_id = film_rolls_id "
-                                " WHERE %s"
-                                " GROUP BY folder, film_rolls_id", where_ext);
+        if(unfiltered)
+          query = g_strdup("SELECT folder, film_rolls_id, fc.count AS count, status"
+                           " FROM main.film_counts AS fc"
+                           " JOIN (SELECT fr.id AS film_rolls_id, folder, status"
+                           "       FROM main.film_rolls AS fr"
+                           "       JOIN memory.film_folder AS ff"
+                           "       ON fr.id = ff.id)"
+                           "   ON fc.film_id = film_rolls_id"
+                           " WHERE fc.count > 0"
+                           " ORDER BY folder, film_rolls_id");
+        else
+          query = g_strdup_printf("SELECT folder, film_rolls_id, COUNT(*) AS count, status"
+                                  " FROM main.images AS mi"
+                                  " JOIN (SELECT fr.id AS film_rolls_id, folder, status"
+                                  "       FROM main.film_rolls AS fr"
+                                  "       JOIN memory.film_folder AS ff"
+                                  "       ON fr.id = ff.id)"
+                                  "   ON film_id = film_rolls_id "
+                                  " WHERE %s"
+                                  " GROUP BY folder, film_rolls_id", where_ext);
           // clang-format on
         break;
       case DT_COLLECTION_PROP_TAG:
       {
         // clang-format off
+        gchar *counts = unfiltered
+          ? g_strdup("SELECT tagid, count FROM main.tag_counts WHERE count > 0")
+          : g_strdup_printf("SELECT tagid, COUNT(*) as count"
+                            "   FROM main.images AS mi"
+                            "   JOIN main.tagged_images"
+                            "     ON id = imgid "
+                            "   WHERE %s"
+                            "   GROUP BY tagid", where_ext);
         query = g_strdup_printf("SELECT name, 1 AS tagid, SUM(count) AS count"
-                                " FROM (SELECT tagid, COUNT(*) as count"
-                                "   FROM main.images AS mi"
-                                "   JOIN main.tagged_images"
-                                "     ON id = imgid "
-                                "   WHERE %s"
-                                "   GROUP BY tagid)"
+                                " FROM (%s)"
                                 " JOIN (SELECT LOWER(name) AS name, id AS tag_id FROM data.tags)"
                                 "   ON tagid = tag_id"
-                                "   GROUP BY name", where_ext);
+                                "   GROUP BY name", counts);
+        g_free(counts);
 
         query = dt_util_dstrcat(query, " UNION ALL "
                                        "SELECT '%s' AS name, 0 as id, COUNT(*) AS count "
@@ -331,9 +331,13 @@ static void _export_button_clicked(GtkWidget *widget, dt_lib_export_t *d)
   gchar *icc_filename = dt_conf_get_string(CONFIG_PREFIX "iccprofile");
   const dt_iop_color_intent_t icc_intent = dt_conf_get_int(CONFIG_PREFIX "iccintent");
 
+  // more sizes and formats to export from the same pipe output
+  GList *variants = dt_control_export_variants_from_string(dt_conf_get_string_const(CONFIG_PREFIX "variants"),
+                                                           format_index);
+
   GList *list = dt_act_on_get_images();
   dt_control_export(list, max_width, max_height, format_index, storage_index, TRUE, export_masks,
-                    style, icc_type, icc_filename, icc_intent, d->metadata_export);
+                    style, icc_type, icc_filename, icc_intent, d->metadata_export, variants);
 
   g_free(icc_filename);
 
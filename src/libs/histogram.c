@@ -43,8 +43,9 @@
 #include "osx/osx.h"
 #endif
 
-#define HISTOGRAM_BINS 256
-#define TONES 128
+// the device bins the same scopes, see dt_scopes_process_cl()
+#define HISTOGRAM_BINS DT_SCOPES_BINS
+#define TONES DT_SCOPES_TONES
 #define GAMMA 1.f / 1.5f
 
 DT_MODULE(1)
@@ -167,7 +168,7 @@ static gboolean _is_backbuf_ready(dt_lib_histogram_t *d)
 {
   return (darktable.develop->preview_pipe->status == DT_DEV_PIXELPIPE_VALID) &&
          (d->backbuf->hash != (uint64_t)-1) &&
-         (d->backbuf->buffer != NULL);
+         (d->backbuf->buffer != NULL || d->backbuf->scopes != NULL);
 }
 
 static void _redraw_scopes(dt_lib_histogram_t *d)
@@ -194,8 +195,17 @@ static void _process_histogram(dt_backbuf_t *backbuf, cairo_t *cr, const int wid
   histogram_params.roi = &roi;
   histogram_params.bins_count = HISTOGRAM_BINS;
   histogram_params.mul = histogram_params.bins_count - 1;
+  histogram_params.for_display = TRUE;
 
-  dt_histogram_helper(&histogram_params, &histogram_stats, cst, IOP_CS_NONE, backbuf->buffer, &bins, FALSE, NULL);
+  if(backbuf->scopes)
+  {
+    // already binned on the device
+    const dt_scopes_t scopes = dt_scopes_map(backbuf->scopes, backbuf->width, backbuf->height);
+    memcpy(bins, scopes.histogram, 4 * HISTOGRAM_BINS * sizeof(uint32_t));
+    histogram_stats.pixels = backbuf->width * backbuf->height;
+  }
+  else
+    dt_histogram_helper(&histogram_params, &histogram_stats, cst, IOP_CS_NONE, backbuf->buffer, &bins, FALSE, NULL);
   dt_histogram_max_helper(&histogram_stats, cst, IOP_CS_NONE, &bins, histogram_max);
   uint32_t overall_histogram_max = MAX(MAX(histogram_max[0], histogram_max[1]), histogram_max[2]);
 
@@ -386,8 +396,18 @@ static void _process_waveform(dt_backbuf_t *backbuf, cairo_t *cr, const int widt
   const size_t binning_size = (vertical) ? 4 * TONES * backbuf->height : 4 * TONES * backbuf->width;
 
   // 1. Pixel binning along columns/rows, aka compute a column/row-wise histogram
-  uint32_t *const restrict bins = dt_alloc_align(binning_size * sizeof(uint32_t));
-  _bin_pixels_waveform(backbuf->buffer, bins, backbuf->width, backbuf->height, binning_size, vertical);
+  uint32_t *bins = NULL;
+  if(backbuf->scopes)
+  {
+    // already binned on the device
+    const dt_scopes_t scopes = dt_scopes_map(backbuf->scopes, backbuf->width, backbuf->height);
+    bins = (vertical) ? scopes.waveform_v : scopes.waveform_h;
+  }
+  else
+  {
+    bins = dt_alloc_align(binning_size * sizeof(uint32_t));
+    _bin_pixels_waveform(backbuf->buffer, bins, backbuf->width, backbuf->height, binning_size, vertical);
+  }
 
   // 2. Paint image.
   // In a 1D histogram, pixel frequencies are shown as height (y axis) for each RGB quantum (x axis).
@@ -398,7 +418,7 @@ static void _process_waveform(dt_backbuf_t *backbuf, cairo_t *cr, const int widt
   const size_t img_height = (vertical) ? backbuf->height : TONES;
   const uint32_t overall_max_hist = _find_max_histogram(bins, binning_size);
   _create_waveform_image(bins, image, overall_max_hist, img_width, img_height);
-  dt_free_align(bins);
+  if(!backbuf->scopes) dt_free_align(bins);
 
   // 3. Send everything to GUI buffer.
   if(overall_max_hist > 0)
@@ -482,6 +502,26 @@ static void _bin_pixels_vectorscope(const float *const restrict image, uint32_t
   }
 }
 
+static void _zoom_vectorscope(const uint32_t *const restrict in, uint32_t *const restrict out, const float from,
+                              const float to)
+{
+  // The device binned the vectorscope at the zoom of the last pipe run.
+  // Until the next one, show it resampled at the current zoom.
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+        dt_omp_firstprivate(in, out, from, to) \
+        schedule(static) collapse(2)
+#endif
+  for(size_t i = 0; i < HISTOGRAM_BINS; i++)
+    for(size_t j = 0; j < HISTOGRAM_BINS; j++)
+    {
+      const float x = roundf(_Luv_to_vectorscope_coord_zoom(_vectorscope_coord_zoom_to_Luv(j, to), from));
+      const float y = roundf(_Luv_to_vectorscope_coord_zoom(_vectorscope_coord_zoom_to_Luv(i, to), from));
+      const gboolean inside = x >= 0.f && x < HISTOGRAM_BINS && y >= 0.f && y < HISTOGRAM_BINS;
+      out[i * HISTOGRAM_BINS + j] = (inside) ? in[(size_t)y * HISTOGRAM_BINS + (size_t)x] : 0;
+    }
+}
+
 static void _create_vectorscope_image(const uint32_t *const restrict vectorscope, uint8_t *const restrict image,
                                       dt_iop_order_iccprofile_info_t *profile,
                                       const float max_hist, const float zoom)
@@ -528,7 +568,17 @@ static void _process_vectorscope(dt_backbuf_t *backbuf, cairo_t *cr, const int w
 
   // 1. Process data
   uint32_t *const restrict vectorscope = dt_alloc_align(HISTOGRAM_BINS * HISTOGRAM_BINS * sizeof(uint32_t));
-  _bin_pixels_vectorscope(backbuf->buffer, vectorscope, profile, backbuf->width * backbuf->height, zoom);
+  if(backbuf->scopes)
+  {
+    // already binned on the device
+    const dt_scopes_t scopes = dt_scopes_map(backbuf->scopes, backbuf->width, backbuf->height);
+    if(backbuf->scopes_zoom == zoom)
+      memcpy(vectorscope, scopes.vectorscope, HISTOGRAM_BINS * HISTOGRAM_BINS * sizeof(uint32_t));
+    else
+      _zoom_vectorscope(scopes.vectorscope, vectorscope, backbuf->scopes_zoom, zoom);
+  }
+  else
+    _bin_pixels_vectorscope(backbuf->buffer, vectorscope, profile, backbuf->width * backbuf->height, zoom);
 
   const uint32_t max_hist = _find_max_histogram(vectorscope, HISTOGRAM_BINS * HISTOGRAM_BINS);
   uint8_t *const restrict image = dt_alloc_align(4 * HISTOGRAM_BINS * HISTOGRAM_BINS * sizeof(uint8_t));
@@ -857,6 +907,11 @@ static void _resize_callback(GtkWidget *widget, GdkRectangle *allocation, dt_lib
 {
   _reset_cache(d);
   _trigger_recompute(d);
+
+  // scopes are computed from the preview pipe output, ask for enough pixels
+  if(darktable.develop)
+    dt_dev_request_preview_size(darktable.develop, DT_DEV_PREVIEW_CLIENT_HISTOGRAM,
+                                allocation->width * darktable.gui->ppd, allocation->height * darktable.gui->ppd);
   // Don't start a redraw from here, Gtk does it automatically on resize event
 }
 
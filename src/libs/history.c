@@ -41,13 +41,142 @@ DT_MODULE(1)
 
 typedef struct dt_undo_history_t
 {
-  GList *before_snapshot, *after_snapshot;
+  GList *before_snapshot, *after_snapshot; // of dt_undo_history_ref_t
   int before_end, after_end;
   GList *before_iop_order_list, *after_iop_order_list;
   dt_masks_edit_mode_t mask_edit_mode;
   dt_dev_pixelpipe_display_mask_t request_mask_display;
 } dt_undo_history_t;
 
+/* Undo snapshots don't copy the history items they have in common with the previous
+   snapshot, they share them. Each record then only holds the items that changed. */
+typedef struct dt_undo_history_ref_t
+{
+  dt_dev_history_item_t *item;
+  int refs;
+} dt_undo_history_ref_t;
+
+static dt_undo_history_ref_t *_history_ref(dt_undo_history_ref_t *ref)
+{
+  g_atomic_int_inc(&ref->refs);
+  return ref;
+}
+
+static void _history_unref(gpointer data)
+{
+  dt_undo_history_ref_t *ref = (dt_undo_history_ref_t *)data;
+  if(g_atomic_int_dec_and_test(&ref->refs))
+  {
+    dt_dev_free_history_item(ref->item);
+    free(ref);
+  }
+}
+
+static size_t _history_item_params_size(const dt_dev_history_item_t *item)
+{
+  if(item->module) return item->module->params_size;
+  const dt_iop_module_t *base = dt_iop_get_module(item->op_name);
+  return base ? base->params_size : 0;
+}
+
+static size_t _form_point_size(const dt_masks_form_t *form)
+{
+  if(form->type & DT_MASKS_GROUP) return sizeof(dt_masks_point_group_t);
+  return form->functions ? form->functions->point_struct_size : 0;
+}
+
+static size_t _history_item_size(const dt_dev_history_item_t *item)
+{
+  size_t size = sizeof(dt_dev_history_item_t) + _history_item_params_size(item) + sizeof(dt_develop_blend_params_t);
+  for(const GList *f = item->forms; f; f = g_list_next(f))
+  {
+    const dt_masks_form_t *form = (dt_masks_form_t *)f->data;
+    size += sizeof(dt_masks_form_t) + g_list_length(form->points) * _form_point_size(form);
+  }
+  return size;
+}
+
+static gboolean _forms_equal(const GList *a, const GList *b)
+{
+  for(; a && b; a = g_list_next(a), b = g_list_next(b))
+  {
+    const dt_masks_form_t *fa = (dt_masks_form_t *)a->data;
+    const dt_masks_form_t *fb = (dt_masks_form_t *)b->data;
+    if(fa->type != fb->type || fa->formid != fb->formid || fa->version != fb->version
+       || fa->source[0] != fb->source[0] || fa->source[1] != fb->source[1] || strcmp(fa->name, fb->name))
+      return FALSE;
+
+    const size_t point_size = _form_point_size(fa);
+    const GList *pa = fa->points, *pb = fb->points;
+    for(; pa && pb; pa = g_list_next(pa), pb = g_list_next(pb))
+      if(memcmp(pa->data, pb->data, point_size)) return FALSE;
+    if(pa || pb) return FALSE;
+  }
+  return !a && !b;
+}
+
+// a is an item of an undo snapshot, b an item of the current history
+static gboolean _history_item_equal(const dt_dev_history_item_t *a, const dt_dev_history_item_t *b)
+{
+  if(a->module != b->module || a->enabled != b->enabled || a->iop_order != b->iop_order
+     || a->multi_priority != b->multi_priority || a->num != b->num || a->hash != b->hash
+     || strcmp(a->op_name, b->op_name) || strcmp(a->multi_name, b->multi_name))
+    return FALSE;
+
+  // b is the live item, its module is valid
+  const size_t params_size = _history_item_params_size(b);
+  const dt_iop_module_so_t *so = b->module ? b->module->so : NULL;
+  if(params_size && (!a->params || !b->params || !dt_iop_params_equal(so, a->params, b->params, params_size)))
+    return FALSE;
+
+  if(!a->blend_params != !b->blend_params) return FALSE;
+  if(a->blend_params && memcmp(a->blend_params, b->blend_params, sizeof(dt_develop_blend_params_t)))
+    return FALSE;
+
+  return _forms_equal(a->forms, b->forms);
+}
+
+static dt_undo_history_ref_t *_history_share(const GList *refs, const dt_dev_history_item_t *item)
+{
+  dt_undo_history_ref_t *ref = refs ? (dt_undo_history_ref_t *)refs->data : NULL;
+  return (ref && _history_item_equal(ref->item, item)) ? ref : NULL;
+}
+
+// snapshot history for the undo, reusing the items found at the same place in one of the
+// previous snapshots. size is increased by the memory of the items that had to be copied.
+static GList *_history_snapshot(GList *history, GList *previous, GList *other, size_t *size)
+{
+  GList *result = NULL;
+  for(const GList *h = history; h;
+      h = g_list_next(h), previous = g_list_next(previous), other = g_list_next(other))
+  {
+    const dt_dev_history_item_t *item = (dt_dev_history_item_t *)h->data;
+    dt_undo_history_ref_t *ref = _history_share(previous, item);
+    if(!ref) ref = _history_share(other, item);
+
+    if(ref)
+      _history_ref(ref);
+    else
+    {
+      ref = malloc(sizeof(dt_undo_history_ref_t));
+      ref->item = dt_history_duplicate_item(item);
+      ref->refs = 1;
+      *size += _history_item_size(item);
+    }
+    result = g_list_prepend(result, ref);
+  }
+  return g_list_reverse(result);
+}
+
+// the history items of a snapshot, still owned by the snapshot
+static GList *_history_snapshot_items(GList *refs)
+{
+  GList *items = NULL;
+  for(const GList *r = refs; r; r = g_list_next(r))
+    items = g_list_prepend(items, ((dt_undo_history_ref_t *)r->data)->item);
+  return g_list_reverse(items);
+}
+
 typedef struct dt_lib_history_t
 {
   /* vbox with managed history items */
@@ -62,6 +191,8 @@ typedef struct dt_lib_history_t
   GList *previous_snapshot;
   int previous_history_end;
   GList *previous_iop_order_list;
+  // after snapshot of the last undo record, the next one shares its unchanged items
+  GList *last_snapshot;
 } dt_lib_history_t;
 
 /* 3 widgets in each history line */
@@ -112,6 +243,7 @@ void gui_init(dt_lib_module_t *self)
   d->previous_snapshot = NULL;
   d->previous_history_end = 0;
   d->previous_iop_order_list = NULL;
+  d->last_snapshot = NULL;
 
   self->widget = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
   gtk_widget_set_name(self->widget, "history-ui");
@@ -157,6 +289,8 @@ void gui_cleanup(dt_lib_module_t *self)
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_lib_history_change_callback), self);
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_lib_history_will_change_callback), self);
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_lib_history_module_remove_callback), self);
+  dt_lib_history_t *d = (dt_lib_history_t *)self->data;
+  g_list_free_full(d->last_snapshot, _history_unref);
   g_free(self->data);
   self->data = NULL;
 }
@@ -255,14 +389,18 @@ static void _undo_items_cb(gpointer user_data, dt_undo_type_t type, dt_undo_data
 {
   struct _cb_data *udata = (struct _cb_data *)user_data;
   dt_undo_history_t *hdata = (dt_undo_history_t *)data;
-  _reset_module_instance(hdata->after_snapshot, udata->module, udata->multi_priority);
+  GList *items = _history_snapshot_items(hdata->after_snapshot);
+  _reset_module_instance(items, udata->module, udata->multi_priority);
+  g_list_free(items);
 }
 
 static void _history_invalidate_cb(gpointer user_data, dt_undo_type_t type, dt_undo_data_t item)
 {
   dt_iop_module_t *module = (dt_iop_module_t *)user_data;
   dt_undo_history_t *hist = (dt_undo_history_t *)item;
-  dt_dev_invalidate_history_module(hist->after_snapshot, module);
+  GList *items = _history_snapshot_items(hist->after_snapshot);
+  dt_dev_invalidate_history_module(items, module);
+  g_list_free(items);
   dt_dev_refresh_ui_images(darktable.develop);
 }
 
@@ -383,7 +521,7 @@ static int _check_deleted_instances(dt_develop_t *dev, GList **_iop_list, GList
 
         // this is copied from dt_iop_gui_delete_callback(), not sure why the above sentence...
         dt_iop_gui_cleanup_module(mod);
-        gtk_widget_destroy(mod->widget);
+        if(mod->widget) gtk_widget_destroy(mod->widget);
       }
 
       iop_list = g_list_remove_link(iop_list, modules);
@@ -529,18 +667,18 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
 
     // we will work on a copy of history and modules
     // when we're done we'll replace dev->history and dev->iop
-    GList *history_temp = NULL;
+    GList *items = _history_snapshot_items(action == DT_ACTION_UNDO ? hist->before_snapshot : hist->after_snapshot);
+    GList *history_temp = dt_history_duplicate(items);
+    g_list_free(items);
     int hist_end = 0;
 
     if(action == DT_ACTION_UNDO)
     {
-      history_temp = dt_history_duplicate(hist->before_snapshot);
       hist_end = hist->before_end;
       dev->iop_order_list = dt_ioppr_iop_order_copy_deep(hist->before_iop_order_list);
     }
     else
     {
-      history_temp = dt_history_duplicate(hist->after_snapshot);
       hist_end = hist->after_end;
       dev->iop_order_list = dt_ioppr_iop_order_copy_deep(hist->after_iop_order_list);
     }
@@ -619,8 +757,8 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
 static void _history_undo_data_free(gpointer data)
 {
   dt_undo_history_t *hist = (dt_undo_history_t *)data;
-  g_list_free_full(hist->before_snapshot, dt_dev_free_history_item);
-  g_list_free_full(hist->after_snapshot, dt_dev_free_history_item);
+  g_list_free_full(hist->before_snapshot, _history_unref);
+  g_list_free_full(hist->after_snapshot, _history_unref);
   g_list_free_full(hist->before_iop_order_list, free);
   g_list_free_full(hist->after_iop_order_list, free);
   free(data);
@@ -1055,14 +1193,23 @@ static void _lib_history_change_callback(gpointer instance, gpointer user_data)
   {
     /* record undo/redo history snapshot */
     dt_undo_history_t *hist = malloc(sizeof(dt_undo_history_t));
-    hist->before_snapshot = dt_history_duplicate(d->previous_snapshot);
-    hist->before_end = d->previous_history_end;
-    hist->before_iop_order_list = dt_ioppr_iop_order_copy_deep(d->previous_iop_order_list);
+    size_t size = sizeof(dt_undo_history_t);
 
-    hist->after_snapshot = dt_history_duplicate(darktable.develop->history);
+    hist->after_snapshot = _history_snapshot(darktable.develop->history, d->last_snapshot, NULL, &size);
     hist->after_end = dt_dev_get_history_end(darktable.develop);
     hist->after_iop_order_list = dt_ioppr_iop_order_copy_deep(darktable.develop->iop_order_list);
 
+    // the history before the change is most often the one after the previous change
+    hist->before_snapshot = _history_snapshot(d->previous_snapshot, d->last_snapshot, hist->after_snapshot, &size);
+    hist->before_end = d->previous_history_end;
+    hist->before_iop_order_list = dt_ioppr_iop_order_copy_deep(d->previous_iop_order_list);
+
+    size += (g_list_length(hist->before_iop_order_list) + g_list_length(hist->after_iop_order_list))
+            * sizeof(dt_iop_order_entry_t);
+
+    g_list_free_full(d->last_snapshot, _history_unref);
+    d->last_snapshot = g_list_copy_deep(hist->after_snapshot, (GCopyFunc)_history_ref, NULL);
+
     if(darktable.develop->gui_module)
     {
       hist->mask_edit_mode = dt_masks_get_edit_mode(darktable.develop->gui_module);
@@ -1074,8 +1221,8 @@ static void _lib_history_change_callback(gpointer instance, gpointer user_data)
       hist->request_mask_display = DT_DEV_PIXELPIPE_DISPLAY_NONE;
     }
 
-    dt_undo_record(darktable.undo, self, DT_UNDO_HISTORY, (dt_undo_data_t)hist,
-                   _pop_undo, _history_undo_data_free);
+    dt_undo_record_ext(darktable.undo, self, DT_UNDO_HISTORY, (dt_undo_data_t)hist, size,
+                       _pop_undo, _history_undo_data_free);
   }
   else
     d->record_undo = TRUE;
@@ -18,6 +18,7 @@
 #include "libs/lib.h"
 #include "common/debug.h"
 #include "common/module.h"
+#include "common/presets.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "dtgtk/button.h"
@@ -782,7 +783,12 @@ void dt_lib_init_presets(dt_lib_module_t *module)
 static void dt_lib_init_module(void *m)
 {
   dt_lib_module_t *module = (dt_lib_module_t *)m;
-  dt_lib_init_presets(module);
+  // nothing changed since the last startup, the presets are up to date
+  if(dt_presets_stamp_changed(module->plugin_name, module->module, module->version()))
+  {
+    dt_lib_init_presets(module);
+    dt_presets_stamp_set(module->plugin_name, module->module, module->version());
+  }
 
   if(darktable.gui)
   {
@@ -1046,8 +1052,11 @@ void dt_lib_init(dt_lib_t *lib)
 {
   // Setting everything to null initially
   memset(lib, 0, sizeof(dt_lib_t));
+  // the presets of all the modules are written at once
+  dt_database_start_transaction(darktable.db);
   darktable.lib->plugins = dt_module_load_modules("/plugins/lighttable", sizeof(dt_lib_module_t),
                                                   dt_lib_load_module, dt_lib_init_module, dt_lib_sort_plugins);
+  dt_database_release_transaction(darktable.db);
 }
 
 void dt_lib_cleanup(dt_lib_t *lib)
@@ -53,6 +53,9 @@ static gboolean _lib_navigation_button_release_callback(GtkWidget *widget, GdkEv
 /* leave notify callback */
 static gboolean _lib_navigation_leave_notify_callback(GtkWidget *widget, GdkEventCrossing *event,
                                                       gpointer user_data);
+/* size allocate callback */
+static void _lib_navigation_size_allocate_callback(GtkWidget *widget, GdkRectangle *allocation,
+                                                   gpointer user_data);
 
 /* helper function for position set */
 static void _lib_navigation_set_position(struct dt_lib_module_t *self, double x, double y, int wd, int ht);
@@ -114,6 +117,8 @@ void gui_init(dt_lib_module_t *self)
                    G_CALLBACK(_lib_navigation_motion_notify_callback), self);
   g_signal_connect(G_OBJECT(self->widget), "leave-notify-event",
                    G_CALLBACK(_lib_navigation_leave_notify_callback), self);
+  g_signal_connect(G_OBJECT(self->widget), "size-allocate",
+                   G_CALLBACK(_lib_navigation_size_allocate_callback), self);
 
   /* set size of navigation draw area */
   gtk_widget_set_size_request(self->widget, -1, 175);
@@ -368,6 +373,15 @@ void _lib_navigation_set_position(dt_lib_module_t *self, double x, double y, int
   }
 }
 
+static void _lib_navigation_size_allocate_callback(GtkWidget *widget, GdkRectangle *allocation,
+                                                   gpointer user_data)
+{
+  // the thumbnail is drawn from the preview pipe output, ask for enough pixels
+  if(darktable.develop)
+    dt_dev_request_preview_size(darktable.develop, DT_DEV_PREVIEW_CLIENT_NAVIGATION,
+                                allocation->width * darktable.gui->ppd, allocation->height * darktable.gui->ppd);
+}
+
 static gboolean _lib_navigation_motion_notify_callback(GtkWidget *widget, GdkEventMotion *event,
                                                        gpointer user_data)
 {
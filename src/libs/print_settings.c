@@ -23,6 +23,7 @@
 #include "common/colorspaces.h"
 #include "common/cups_print.h"
 #include "common/file_location.h"
+#include "common/history.h"
 #include "common/image_cache.h"
 #include "common/metadata.h"
 #include "common/pdf.h"
@@ -130,7 +131,6 @@ typedef struct dt_lib_print_job_t
   gchar *buf_icc_profile, *p_icc_profile;
   dt_iop_color_intent_t buf_icc_intent, p_icc_intent;
   dt_images_box imgs;
-  uint16_t *buf; // ??? should be removed
   dt_pdf_page_t *pdf_page;
   char pdf_filename[PATH_MAX];
 } dt_lib_print_job_t;
@@ -250,13 +250,120 @@ static inline float _percent_unit_of(dt_lib_print_settings_t *ps, float ref, flo
   return value * ref * units[ps->unit];
 }
 
+// the printer-ready buffers of the last prints, so that printing the same images again, or the same
+// images in another layout, does not render them again
+
+#define PRINT_CACHE_SIZE ((size_t)512 << 20) // in bytes
+#define PRINT_RENDER_THREADS 3               // images of a page rendered at the same time
+
+typedef struct dt_print_cache_entry_t
+{
+  gchar *key;
+  uint8_t *buf; // 8 bit RGB
+  int32_t width, height;
+} dt_print_cache_entry_t;
+
+static GMutex _print_cache_lock;
+static GQueue _print_cache = G_QUEUE_INIT; // most recently used first
+static size_t _print_cache_bytes = 0;
+
+static inline size_t _print_cache_entry_size(const dt_print_cache_entry_t *e)
+{
+  return (size_t)3 * e->width * e->height;
+}
+
+static void _print_cache_entry_free(gpointer data)
+{
+  dt_print_cache_entry_t *e = (dt_print_cache_entry_t *)data;
+  g_free(e->key);
+  g_free(e->buf);
+  g_free(e);
+}
+
+// all that makes the printed pixels of a box: the edit of the image and the export and print settings
+static gchar *_print_cache_key(const dt_lib_print_job_t *params, const dt_image_box *img)
+{
+  dt_history_hash_values_t hash;
+  dt_history_hash_read(img->imgid, &hash);
+  gchar *history = hash.current ? g_compute_checksum_for_data(G_CHECKSUM_MD5, hash.current, hash.current_len)
+                                : NULL;
+  free(hash.basic);
+  free(hash.auto_apply);
+  free(hash.current);
+
+  gchar *key = g_strdup_printf("%d|%s|%dx%d|%s|%d|%s|%d|%d|%s|%d|%d", img->imgid, history ? history : "",
+                               img->max_width, img->max_height, params->style ? params->style : "",
+                               params->buf_icc_type, params->buf_icc_profile ? params->buf_icc_profile : "",
+                               params->buf_icc_intent, params->p_icc_type,
+                               params->p_icc_profile ? params->p_icc_profile : "", params->p_icc_intent,
+                               params->black_point_compensation);
+  g_free(history);
+  return key;
+}
+
+// on a hit, fills img with a copy of the cached buffer
+static gboolean _print_cache_get(const gchar *key, dt_image_box *img)
+{
+  gboolean found = FALSE;
+  g_mutex_lock(&_print_cache_lock);
+  for(GList *l = _print_cache.head; l; l = g_list_next(l))
+  {
+    dt_print_cache_entry_t *e = (dt_print_cache_entry_t *)l->data;
+    if(strcmp(e->key, key)) continue;
+    img->buf = g_memdup2(e->buf, _print_cache_entry_size(e));
+    img->exp_width = e->width;
+    img->exp_height = e->height;
+    g_queue_unlink(&_print_cache, l);
+    g_queue_push_head_link(&_print_cache, l);
+    found = TRUE;
+    break;
+  }
+  g_mutex_unlock(&_print_cache_lock);
+  return found;
+}
+
+static void _print_cache_put(const gchar *key, const dt_image_box *img)
+{
+  dt_print_cache_entry_t *e = g_malloc(sizeof(dt_print_cache_entry_t));
+  e->key = g_strdup(key);
+  e->width = img->exp_width;
+  e->height = img->exp_height;
+  const size_t size = _print_cache_entry_size(e);
+  if(size > PRINT_CACHE_SIZE)
+  {
+    g_free(e->key);
+    g_free(e);
+    return;
+  }
+  e->buf = g_memdup2(img->buf, size);
+
+  g_mutex_lock(&_print_cache_lock);
+  g_queue_push_head(&_print_cache, e);
+  _print_cache_bytes += size;
+  while(_print_cache_bytes > PRINT_CACHE_SIZE)
+  {
+    dt_print_cache_entry_t *old = (dt_print_cache_entry_t *)g_queue_pop_tail(&_print_cache);
+    _print_cache_bytes -= _print_cache_entry_size(old);
+    _print_cache_entry_free(old);
+  }
+  g_mutex_unlock(&_print_cache_lock);
+}
+
+static void _print_cache_clear()
+{
+  g_mutex_lock(&_print_cache_lock);
+  g_queue_clear_full(&_print_cache, _print_cache_entry_free);
+  _print_cache_bytes = 0;
+  g_mutex_unlock(&_print_cache_lock);
+}
+
 // callbacks for in-memory export
 
 typedef struct dt_print_format_t
 {
   dt_imageio_module_data_t head;
   int bpp;
-  dt_lib_print_job_t *params;
+  uint16_t *buf;
 } dt_print_format_t;
 
 static int bpp(dt_imageio_module_data_t *data)
@@ -283,12 +390,12 @@ static int write_image(dt_imageio_module_data_t *data, const char *filename, con
 {
   dt_print_format_t *d = (dt_print_format_t *)data;
 
-  d->params->buf = (uint16_t *)malloc((size_t)3 * (d->bpp == 8?1:2) * d->head.width * d->head.height);
+  d->buf = (uint16_t *)malloc((size_t)3 * (d->bpp == 8?1:2) * d->head.width * d->head.height);
 
   if(d->bpp == 8)
   {
     const uint8_t *in_ptr = (const uint8_t *)in;
-    uint8_t *out_ptr = (uint8_t *)d->params->buf;
+    uint8_t *out_ptr = (uint8_t *)d->buf;
     for(int y = 0; y < d->head.height; y++)
     {
       for(int x = 0; x < d->head.width; x++, in_ptr += 4, out_ptr += 3)
@@ -298,7 +405,7 @@ static int write_image(dt_imageio_module_data_t *data, const char *filename, con
   else
   {
     const uint16_t *in_ptr = (const uint16_t *)in;
-    uint16_t *out_ptr = (uint16_t *)d->params->buf;
+    uint16_t *out_ptr = (uint16_t *)d->buf;
     for(int y = 0; y < d->head.height; y++)
     {
       for(int x = 0; x < d->head.width; x++, in_ptr += 4, out_ptr += 3)
@@ -310,11 +417,19 @@ static int write_image(dt_imageio_module_data_t *data, const char *filename, con
 }
 
 // export image imgid with given max_width & max_height, set iwidth & iheight with the
-// final image size as exported.
+// final image size as exported. called from several threads at once for the boxes of a page.
 static int _export_image(dt_job_t *job, dt_image_box *img)
 {
   dt_lib_print_job_t *params = dt_control_job_get_params(job);
 
+  gchar *key = _print_cache_key(params, img);
+  if(_print_cache_get(key, img))
+  {
+    dt_print(DT_DEBUG_PRINT, "[print] image %d from the cache\n", img->imgid);
+    g_free(key);
+    return 0;
+  }
+
   dt_imageio_module_format_t buf;
   buf.mime = mime;
   buf.levels = levels;
@@ -326,14 +441,10 @@ static int _export_image(dt_job_t *job, dt_image_box *img)
   dat.head.max_height = img->max_height;
   dat.head.style[0] = '\0';
   dat.bpp = *params->p_icc_profile ? 16 : 8; // set to 16bit when a profile is to be applied
-  dat.params = params;
+  dat.buf = NULL;
 
   if(params->style) g_strlcpy(dat.head.style, params->style, sizeof(dat.head.style));
 
-  // let the user know something is happening
-  dt_control_job_set_progress(job, 0.05);
-  dt_control_log(_("processing `%s' for `%s'"), params->job_title, params->prt.printer.name);
-
   const gboolean export_masks = FALSE;
   const gboolean is_scaling = FALSE;
 
@@ -361,6 +472,8 @@ static int _export_image(dt_job_t *job, dt_image_box *img)
       dt_control_log(_("cannot open printer profile `%s'"), params->p_icc_profile);
       fprintf(stderr, "cannot open printer profile `%s'\n", params->p_icc_profile);
       dt_control_queue_redraw();
+      free(dat.buf);
+      g_free(key);
       return 1;
     }
     else
@@ -370,26 +483,45 @@ static int _export_image(dt_job_t *job, dt_image_box *img)
         dt_control_log(_("error getting output profile for image %d"), img->imgid);
         fprintf(stderr, "error getting output profile for image %d\n", img->imgid);
         dt_control_queue_redraw();
+        free(dat.buf);
+        g_free(key);
         return 1;
       }
       if(dt_apply_printer_profile
-         ((void **)&(params->buf), dat.head.width, dat.head.height, dat.bpp, buf_profile->profile,
+         ((void **)&(dat.buf), dat.head.width, dat.head.height, dat.bpp, buf_profile->profile,
           pprof->profile, params->p_icc_intent, params->black_point_compensation))
       {
         dt_control_log(_("cannot apply printer profile `%s'"), params->p_icc_profile);
         fprintf(stderr, "cannot apply printer profile `%s'\n", params->p_icc_profile);
         dt_control_queue_redraw();
+        free(dat.buf);
+        g_free(key);
         return 1;
       }
     }
   }
 
-  img->buf = params->buf;
-  params->buf = NULL;
+  img->buf = dat.buf;
+  if(img->buf) _print_cache_put(key, img);
+  g_free(key);
 
   return 0;
 }
 
+static void _export_image_run(gpointer data, gpointer user_data)
+{
+  dt_job_t *job = (dt_job_t *)user_data;
+  const dt_lib_print_job_t *params = dt_control_job_get_params(job);
+  dt_image_box *img = (dt_image_box *)data;
+  if(dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED) return;
+
+  dt_print(DT_DEBUG_PRINT, "[print] max image size %d x %d (at resolution %d)\n",
+           img->max_width, img->max_height, params->prt.printer.resolution);
+
+  // on errors the box is left without a buffer
+  _export_image(job, img);
+}
+
 static void _create_pdf(dt_job_t *job, dt_images_box imgs, const float width, const float height)
 {
   dt_lib_print_job_t *params = dt_control_job_get_params(job);
@@ -480,26 +612,6 @@ void _fill_box_values(dt_lib_print_settings_t *ps)
   --darktable.gui->reset;
 }
 
-static int _export_and_setup_pos(dt_job_t *job, dt_image_box *img, const int32_t idx)
-{
-  dt_lib_print_job_t *params = dt_control_job_get_params(job);
-
-  float width, height;
-  _get_page_dimension(&params->prt, &width, &height);
-
-  dt_printing_setup_page(&params->imgs, width, height, params->prt.printer.resolution);
-
-  dt_print(DT_DEBUG_PRINT, "[print] max image size %d x %d (at resolution %d)\n",
-           img->max_width, img->max_height, params->prt.printer.resolution);
-
-  if(_export_image(job, img)) return 1;
-
-  dt_printing_setup_image(&params->imgs, idx,
-                          img->imgid, img->exp_width, img->exp_height, img->alignment);
-
-  return 0;
-}
-
 static int _print_job_run(dt_job_t *job)
 {
   dt_lib_print_job_t *params = dt_control_job_get_params(job);
@@ -510,17 +622,39 @@ static int _print_job_run(dt_job_t *job)
 
   // compute the needed size for picture for the given printer resolution
 
+  float width, height;
+  _get_page_dimension(&params->prt, &width, &height);
+  dt_printing_setup_page(&params->imgs, width, height, params->prt.printer.resolution);
+
+  // let the user know something is happening
+  dt_control_job_set_progress(job, 0.05);
+  dt_control_log(_("processing `%s' for `%s'"), params->job_title, params->prt.printer.name);
+
+  // the pipes of the boxes are independent, render them side by side
+  GThreadPool *pool = g_thread_pool_new(_export_image_run, job, MIN(params->imgs.count, PRINT_RENDER_THREADS),
+                                        FALSE, NULL);
   for(int k=0; k<params->imgs.count; k++)
   {
     if(params->imgs.box[k].imgid > -1)
     {
       if(imgid == -1) imgid = params->imgs.box[k].imgid;
-      if(_export_and_setup_pos(job, &params->imgs.box[k], k))
-        return 1;
+      g_thread_pool_push(pool, &params->imgs.box[k], NULL);
     }
   }
+  g_thread_pool_free(pool, FALSE, TRUE);
 
   if(dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED) return 0;
+
+  for(int k=0; k<params->imgs.count; k++)
+  {
+    dt_image_box *img = &params->imgs.box[k];
+    if(img->imgid > -1)
+    {
+      if(!img->buf) return 1;
+      dt_printing_setup_image(&params->imgs, k, img->imgid, img->exp_width, img->exp_height, img->alignment);
+    }
+  }
+
   dt_control_job_set_progress(job, 0.9);
 
   dt_loc_get_tmp_dir(params->pdf_filename, sizeof(params->pdf_filename));
@@ -535,9 +669,6 @@ static int _print_job_run(dt_job_t *job)
   }
   close(fd);
 
-  float width, height;
-  _get_page_dimension(&params->prt, &width, &height);
-
   _create_pdf(job, params->imgs, width, height);
 
   if(dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED) return 0;
@@ -634,7 +765,8 @@ static void _print_job_cleanup(void *p)
   dt_lib_print_job_t *params = p;
   if(params->pdf_filename[0]) g_unlink(params->pdf_filename);
   free(params->pdf_page);
-  free(params->buf);
+  // left by a failed or cancelled job, _create_pdf() takes the others
+  for(int k = 0; k < params->imgs.count; k++) g_free(params->imgs.box[k].buf);
   g_free(params->style);
   g_free(params->buf_icc_profile);
   g_free(params->p_icc_profile);
@@ -3161,6 +3293,7 @@ void gui_cleanup(dt_lib_module_t *self)
   g_signal_handlers_disconnect_by_func(G_OBJECT(ps->b_left), G_CALLBACK(_left_border_callback), self);
   g_signal_handlers_disconnect_by_func(G_OBJECT(ps->b_right), G_CALLBACK(_right_border_callback), self);
 
+  _print_cache_clear();
   g_list_free_full(ps->profiles, g_free);
   g_list_free_full(ps->paper_list, free);
   g_list_free_full(ps->media_list, free);
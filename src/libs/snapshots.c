@@ -35,12 +35,20 @@ DT_MODULE(1)
 
 #define HANDLE_SIZE 0.02
 
-/* a snapshot */
+/* a copy of a pipe backbuffer, and the part of the image it shows, relative to the image size */
+typedef struct dt_lib_snapshot_layer_t
+{
+  cairo_surface_t *surface;
+  float x, y, w, h;
+} dt_lib_snapshot_layer_t;
+
+/* a snapshot: the full-resolution view it was taken from and the whole image at preview size,
+   for the parts not in view at that time */
 typedef struct dt_lib_snapshot_t
 {
   GtkWidget *button;
-  float zoom_x, zoom_y, zoom_scale;
-  int32_t zoom, closeup;
+  dt_lib_snapshot_layer_t image, preview;
+  gboolean saved;
   char filename[512];
 } dt_lib_snapshot_t;
 
@@ -60,8 +68,9 @@ typedef struct dt_lib_snapshots_t
   /* snapshots */
   dt_lib_snapshot_t *snapshot;
 
-  /* snapshot cairo surface */
-  cairo_surface_t *snapshot_image;
+  /* snapshot displayed, holding its own references to the surfaces */
+  dt_lib_snapshot_layer_t shown_image, shown_preview;
+  gboolean shown;
 
 
   /* change snapshot overlay controls */
@@ -97,6 +106,124 @@ int position()
   return 800;
 }
 
+static void _layer_clear(dt_lib_snapshot_layer_t *layer)
+{
+  if(layer->surface) cairo_surface_destroy(layer->surface);
+  layer->surface = NULL;
+}
+
+static void _layer_copy(dt_lib_snapshot_layer_t *dst, const dt_lib_snapshot_layer_t *src)
+{
+  _layer_clear(dst);
+  *dst = *src;
+  if(dst->surface) cairo_surface_reference(dst->surface);
+}
+
+/* copy the last output of the pipe, if it is one of the current image */
+static gboolean _layer_take(dt_lib_snapshot_layer_t *layer, dt_dev_pixelpipe_t *pipe, const int32_t imgid,
+                            const gboolean preview)
+{
+  gboolean taken = FALSE;
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  const int wd = pipe->output_backbuf_width;
+  const int ht = pipe->output_backbuf_height;
+  if(pipe->output_backbuf && pipe->output_imgid == imgid && wd > 0 && ht > 0
+     && pipe->processed_width > 0 && pipe->processed_height > 0)
+  {
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, wd, ht);
+    if(cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS)
+    {
+      // the backbuffer rows are packed as in the cairo surfaces the darkroom makes of it
+      const size_t src_stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, wd);
+      const size_t dst_stride = cairo_image_surface_get_stride(surface);
+      cairo_surface_flush(surface);
+      uint8_t *const data = cairo_image_surface_get_data(surface);
+      for(int j = 0; j < ht; j++)
+        memcpy(data + j * dst_stride, pipe->output_backbuf + j * src_stride, 4 * wd);
+      cairo_surface_mark_dirty(surface);
+
+      _layer_clear(layer);
+      layer->surface = surface;
+      if(preview)
+      {
+        // the preview pipe always renders the whole image
+        layer->x = layer->y = 0.f;
+        layer->w = layer->h = 1.f;
+      }
+      else
+      {
+        // same region of interest as dt_dev_process_image_job()
+        const float pw = pipe->processed_width * pipe->backbuf_scale;
+        const float ph = pipe->processed_height * pipe->backbuf_scale;
+        layer->x = MAX(0, (int)(pw * (.5f + pipe->backbuf_zoom_x) - wd / 2)) / pw;
+        layer->y = MAX(0, (int)(ph * (.5f + pipe->backbuf_zoom_y) - ht / 2)) / ph;
+        layer->w = wd / pw;
+        layer->h = ht / ph;
+      }
+      taken = TRUE;
+    }
+    else
+      cairo_surface_destroy(surface);
+  }
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+  return taken;
+}
+
+/* paint a layer at the place of the image where it comes from, given the position on screen of the
+   image origin and the size of the whole image */
+static void _layer_draw(cairo_t *cr, const dt_lib_snapshot_layer_t *layer, const double ox, const double oy,
+                        const double iw, const double ih)
+{
+  if(!layer->surface) return;
+  const int wd = cairo_image_surface_get_width(layer->surface);
+  const int ht = cairo_image_surface_get_height(layer->surface);
+
+  cairo_save(cr);
+  cairo_translate(cr, ox + layer->x * iw, oy + layer->y * ih);
+  cairo_scale(cr, layer->w * iw / wd, layer->h * ih / ht);
+  cairo_rectangle(cr, 0, 0, wd, ht);
+  cairo_set_source_surface(cr, layer->surface, 0, 0);
+  cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+  cairo_fill(cr);
+  cairo_restore(cr);
+}
+
+/* where the current view puts the image on screen, following the region of interest of
+   dt_dev_process_image_job() and the centering of the darkroom expose */
+static gboolean _view_geometry(dt_develop_t *dev, const int32_t width, const int32_t height,
+                               double *ox, double *oy, double *iw, double *ih)
+{
+  if(dev->pipe->processed_width <= 0 || dev->pipe->processed_height <= 0) return FALSE;
+
+  const float zoom_x = dt_control_get_dev_zoom_x();
+  const float zoom_y = dt_control_get_dev_zoom_y();
+  const dt_dev_zoom_t zoom = dt_control_get_dev_zoom();
+  const int closeup = dt_control_get_dev_closeup();
+  const float ppd = darktable.gui->ppd;
+  const float scale = dt_dev_get_zoom_scale(dev, zoom, 1.0f, 0) * ppd;
+
+  int window_width = dev->width * ppd;
+  int window_height = dev->height * ppd;
+  if(closeup)
+  {
+    window_width /= 1 << closeup;
+    window_height /= 1 << closeup;
+  }
+  const float pw = dev->pipe->processed_width * scale;
+  const float ph = dev->pipe->processed_height * scale;
+  const int wd = MIN(window_width, pw);
+  const int ht = MIN(window_height, ph);
+  const int x = MAX(0, pw * (.5f + zoom_x) - wd / 2);
+  const int y = MAX(0, ph * (.5f + zoom_y) - ht / 2);
+
+  const double factor = (1 << closeup) / ppd;
+  *iw = pw * factor;
+  *ih = ph * factor;
+  *ox = .5 * width - (x + .5 * wd) * factor;
+  *oy = .5 * height - (y + .5 * ht) * factor;
+  return TRUE;
+}
+
 // draw snapshot sign
 static void _draw_sym(cairo_t *cr, float x, float y, gboolean vertical, gboolean inverted)
 {
@@ -129,7 +256,7 @@ void gui_post_expose(dt_lib_module_t *self, cairo_t *cri, int32_t width, int32_t
   dt_lib_snapshots_t *d = (dt_lib_snapshots_t *)self->data;
   dt_develop_t *dev = darktable.develop;
 
-  if(d->snapshot_image)
+  if(d->shown)
   {
     const dt_dev_zoom_t zoom = dt_control_get_dev_zoom();
     const int closeup = dt_control_get_dev_closeup();
@@ -158,9 +285,17 @@ void gui_post_expose(dt_lib_module_t *self, cairo_t *cri, int32_t width, int32_t
 
     const double size = DT_PIXEL_APPLY_DPI(d->inverted ? -15 : 15);
 
-    cairo_set_source_surface(cri, d->snapshot_image, 0, 0);
-    cairo_rectangle(cri, x, y, w, h);
-    cairo_fill(cri);
+    // resample the snapshot for the current zoom and pan, the preview fills what was out of view
+    double ox, oy, iw, ih;
+    if(_view_geometry(dev, width, height, &ox, &oy, &iw, &ih))
+    {
+      cairo_save(cri);
+      cairo_rectangle(cri, x, y, w, h);
+      cairo_clip(cri);
+      _layer_draw(cri, &d->shown_preview, ox, oy, iw, ih);
+      _layer_draw(cri, &d->shown_image, ox, oy, iw, ih);
+      cairo_restore(cri);
+    }
 
     // draw the split line using the selected overlay color
     dt_draw_set_color_overlay(cri, TRUE, 0.7);
@@ -240,7 +375,7 @@ void gui_post_expose(dt_lib_module_t *self, cairo_t *cri, int32_t width, int32_t
 int button_released(struct dt_lib_module_t *self, double x, double y, int which, uint32_t state)
 {
   dt_lib_snapshots_t *d = (dt_lib_snapshots_t *)self->data;
-  if(d->snapshot_image)
+  if(d->shown)
   {
     d->dragging = FALSE;
     return 1;
@@ -255,7 +390,7 @@ int button_pressed(struct dt_lib_module_t *self, double x, double y, double pres
 {
   dt_lib_snapshots_t *d = (dt_lib_snapshots_t *)self->data;
 
-  if(d->snapshot_image)
+  if(d->shown)
   {
     if(d->on_going) return 1;
 
@@ -304,7 +439,7 @@ int mouse_moved(dt_lib_module_t *self, double x, double y, double pressure, int
 {
   dt_lib_snapshots_t *d = (dt_lib_snapshots_t *)self->data;
 
-  if(d->snapshot_image)
+  if(d->shown)
   {
     const double xp = x / d->vp_width;
     const double yp = y / d->vp_height;
@@ -326,12 +461,16 @@ void gui_reset(dt_lib_module_t *self)
 {
   dt_lib_snapshots_t *d = (dt_lib_snapshots_t *)self->data;
   d->num_snapshots = 0;
-  d->snapshot_image = NULL;
+  d->shown = FALSE;
+  _layer_clear(&d->shown_image);
+  _layer_clear(&d->shown_preview);
 
   for(uint32_t k = 0; k < d->size; k++)
   {
     gtk_widget_hide(d->snapshot[k].button);
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(d->snapshot[k].button), FALSE);
+    _layer_clear(&d->snapshot[k].image);
+    _layer_clear(&d->snapshot[k].preview);
   }
 
   dt_control_queue_redraw_center();
@@ -405,6 +544,13 @@ void gui_cleanup(dt_lib_module_t *self)
 {
   dt_lib_snapshots_t *d = (dt_lib_snapshots_t *)self->data;
 
+  _layer_clear(&d->shown_image);
+  _layer_clear(&d->shown_preview);
+  for(uint32_t k = 0; k < d->size; k++)
+  {
+    _layer_clear(&d->snapshot[k].image);
+    _layer_clear(&d->snapshot[k].preview);
+  }
   g_free(d->snapshot);
 
   g_free(self->data);
@@ -415,9 +561,22 @@ static void _lib_snapshots_add_button_clicked_callback(GtkWidget *widget, gpoint
 {
   dt_lib_module_t *self = (dt_lib_module_t *)user_data;
   dt_lib_snapshots_t *d = (dt_lib_snapshots_t *)self->data;
+  dt_develop_t *dev = darktable.develop;
+
+  /* copy what the pipes last rendered, the slot is reused only if we got something */
+  dt_lib_snapshot_t s = { 0 };
+  const gboolean has_image = _layer_take(&s.image, dev->pipe, dev->image_storage.id, FALSE);
+  const gboolean has_preview = _layer_take(&s.preview, dev->preview_pipe, dev->image_storage.id, TRUE);
+  if(!has_image && !has_preview)
+  {
+    dt_control_log(_("the image is not processed yet, can't take a snapshot"));
+    return;
+  }
 
   /* backup last snapshot slot */
   dt_lib_snapshot_t last = d->snapshot[d->size - 1];
+  _layer_clear(&last.image);
+  _layer_clear(&last.preview);
 
   /* rotate slots down to make room for new one on top */
   for(int k = d->size - 1; k > 0; k--)
@@ -447,21 +606,15 @@ static void _lib_snapshots_add_button_clicked_callback(GtkWidget *widget, gpoint
   g_snprintf(label, sizeof(label), "%s (%d)", name, dt_dev_get_history_end(darktable.develop));
   gtk_label_set_text(GTK_LABEL(gtk_bin_get_child(GTK_BIN(d->snapshot[0].button))), label);
 
-  dt_lib_snapshot_t *s = d->snapshot + 0;
-  s->zoom_y = dt_control_get_dev_zoom_y();
-  s->zoom_x = dt_control_get_dev_zoom_x();
-  s->zoom = dt_control_get_dev_zoom();
-  s->closeup = dt_control_get_dev_closeup();
-  s->zoom_scale = dt_control_get_dev_zoom_scale();
+  d->snapshot[0].image = s.image;
+  d->snapshot[0].preview = s.preview;
+  d->snapshot[0].saved = FALSE;
 
   /* update slots used */
   if(d->num_snapshots != d->size) d->num_snapshots++;
 
   /* show active snapshot slots */
   for(uint32_t k = 0; k < d->num_snapshots; k++) gtk_widget_show(d->snapshot[k].button);
-
-  /* request a new snapshot for top slot */
-  dt_dev_snapshot_request(darktable.develop, (const char *)&d->snapshot[0].filename);
 }
 
 static void _lib_snapshots_toggled_callback(GtkToggleButton *widget, gpointer user_data)
@@ -471,12 +624,10 @@ static void _lib_snapshots_toggled_callback(GtkToggleButton *widget, gpointer us
   /* get current snapshot index */
   int which = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(widget), "snapshot"));
 
-  /* free current snapshot image if exists */
-  if(d->snapshot_image)
-  {
-    cairo_surface_destroy(d->snapshot_image);
-    d->snapshot_image = NULL;
-  }
+  /* release current snapshot image if exists */
+  d->shown = FALSE;
+  _layer_clear(&d->shown_image);
+  _layer_clear(&d->shown_preview);
 
   /* check if snapshot is activated */
   if(gtk_toggle_button_get_active(widget))
@@ -487,18 +638,12 @@ static void _lib_snapshots_toggled_callback(GtkToggleButton *widget, gpointer us
         gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(d->snapshot[k].button), FALSE);
 
     /* setup snapshot */
+    /* the snapshot is resampled to the current zoom and pan when drawn */
     d->selected = which;
-    dt_lib_snapshot_t *s = d->snapshot + (which - 1);
-    dt_control_set_dev_zoom_y(s->zoom_y);
-    dt_control_set_dev_zoom_x(s->zoom_x);
-    dt_control_set_dev_zoom(s->zoom);
-    dt_control_set_dev_closeup(s->closeup);
-    dt_control_set_dev_zoom_scale(s->zoom_scale);
-
-    dt_dev_invalidate(darktable.develop);
-    dt_dev_refresh_ui_images(darktable.develop);
-
-    d->snapshot_image = dt_cairo_image_surface_create_from_png(s->filename);
+    const dt_lib_snapshot_t *s = d->snapshot + (which - 1);
+    _layer_copy(&d->shown_image, &s->image);
+    _layer_copy(&d->shown_preview, &s->preview);
+    d->shown = TRUE;
   }
 
   /* redraw center view */
@@ -695,7 +840,14 @@ static int filename_member(lua_State *L)
   {
     return luaL_error(L, "Accessing a non-existent snapshot");
   }
-  lua_pushstring(L, d->snapshot[index].filename);
+  /* snapshots are kept in memory, write the file only for scripts asking for it */
+  dt_lib_snapshot_t *s = d->snapshot + index;
+  if(!s->saved)
+  {
+    cairo_surface_t *surface = s->image.surface ? s->image.surface : s->preview.surface;
+    s->saved = surface && cairo_surface_write_to_png(surface, s->filename) == CAIRO_STATUS_SUCCESS;
+  }
+  lua_pushstring(L, s->filename);
   return 1;
 }
 static int name_member(lua_State *L)
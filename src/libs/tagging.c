@@ -43,6 +43,7 @@ DT_MODULE(1)
 typedef struct dt_lib_tagging_t
 {
   char keyword[1024];
+  GHashTable *matches; // tags and nodes matching keyword, see dt_tag_index_match()
   GtkEntry *entry;
   GtkWidget *clear_button;
   GtkTreeView *attached_view, *dictionary_view;
@@ -165,30 +166,29 @@ static void _propagate_sel_to_parents(GtkTreeModel *model, GtkTreeIter *iter)
 static gboolean _set_matching_tag_visibility(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, dt_lib_module_t *self)
 {
   dt_lib_tagging_t *d = (dt_lib_tagging_t *)self->data;
-  gboolean visible;
-  gchar *tagname = NULL;
-  gchar *synonyms = NULL;
-  gtk_tree_model_get(model, iter, DT_LIB_TAGGING_COL_PATH, &tagname, DT_LIB_TAGGING_COL_SYNONYM, &synonyms, -1);
-  if(!d->keyword[0])
-    visible = TRUE;
-  else
+  gboolean visible = TRUE;
+  if(d->keyword[0] && d->matches)
   {
-    if(synonyms && synonyms[0]) tagname = dt_util_dstrcat(tagname, ", %s", synonyms);
-    gchar *haystack = g_utf8_strdown(tagname, -1);
-    gchar *needle = g_utf8_strdown(d->keyword, -1);
-    visible = (g_strrstr(haystack, needle) != NULL);
-    g_free(haystack);
-    g_free(needle);
+    gchar *tagname = NULL;
+    gtk_tree_model_get(model, iter, DT_LIB_TAGGING_COL_PATH, &tagname, -1);
+    visible = g_hash_table_contains(d->matches, tagname);
+    g_free(tagname);
   }
   if(d->tree_flag)
     gtk_tree_store_set(GTK_TREE_STORE(model), iter, DT_LIB_TAGGING_COL_VISIBLE, visible, -1);
   else
     gtk_list_store_set(GTK_LIST_STORE(model), iter, DT_LIB_TAGGING_COL_VISIBLE, visible, -1);
-  g_free(tagname);
-  g_free(synonyms);
   return FALSE;
 }
 
+// the matches are taken from the tag dictionary in memory rather than from each row of the view
+static void _update_matching_tags(dt_lib_module_t *self)
+{
+  dt_lib_tagging_t *d = (dt_lib_tagging_t *)self->data;
+  if(d->matches) g_hash_table_destroy(d->matches);
+  d->matches = d->keyword[0] ? dt_tag_index_match(d->keyword) : NULL;
+}
+
 static gboolean _tree_reveal_func(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, gpointer data)
 {
   gboolean state;
@@ -467,6 +467,7 @@ static void _init_treeview(dt_lib_module_t *self, const int which)
     }
     if(d->keyword[0])
     {
+      _update_matching_tags(self);
       gtk_tree_model_foreach(store, (GtkTreeModelForeachFunc)_set_matching_tag_visibility, self);
       gtk_tree_model_foreach(store, (GtkTreeModelForeachFunc)_tree_reveal_func, NULL);
       gtk_tree_view_set_model(GTK_TREE_VIEW(view), model);
@@ -498,6 +499,7 @@ static void _init_treeview(dt_lib_module_t *self, const int which)
     }
     if(which && d->keyword[0])
     {
+      _update_matching_tags(self);
       gtk_tree_model_foreach(store, (GtkTreeModelForeachFunc)_set_matching_tag_visibility, self);
     }
     gtk_tree_view_set_model(GTK_TREE_VIEW(view), model);
@@ -585,6 +587,8 @@ static void _tree_select_show(GtkTreeViewColumn *col, GtkCellRenderer *renderer,
 
 static void _lib_tagging_tags_changed_callback(gpointer instance, dt_lib_module_t *self)
 {
+  // tags may have been changed directly in the database
+  dt_tag_index_invalidate();
   _init_treeview(self, 0);
   _init_treeview(self, 1);
 }
@@ -1406,6 +1410,7 @@ static void _tag_name_changed(GtkEntry *entry, dt_lib_module_t *self)
 {
   dt_lib_tagging_t *d = (dt_lib_tagging_t *)self->data;
   _set_keyword(self);
+  _update_matching_tags(self);
   GtkTreeModel *model = gtk_tree_view_get_model(d->dictionary_view);
   GtkTreeModel *store = gtk_tree_model_filter_get_model(GTK_TREE_MODEL_FILTER(model));
   gtk_tree_model_foreach(store, (GtkTreeModelForeachFunc)_set_matching_tag_visibility, self);
@@ -3260,6 +3265,7 @@ void gui_cleanup(dt_lib_module_t *self)
   g_free(d->collection);
   if(d->drag.tagname) g_free(d->drag.tagname);
   if(d->drag.path) gtk_tree_path_free(d->drag.path);
+  if(d->matches) g_hash_table_destroy(d->matches);
   free(self->data);
   self->data = NULL;
 }
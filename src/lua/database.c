@@ -22,10 +22,18 @@
 #include "common/film.h"
 #include "common/grealpath.h"
 #include "common/image.h"
+#include "common/metadata.h"
+#include "common/ratings.h"
+#include "common/styles.h"
+#include "common/tags.h"
 #include "control/control.h"
+#include "control/jobs.h"
+#include "views/view.h"
 #include "lua/events.h"
 #include "lua/film.h"
 #include "lua/image.h"
+#include "lua/styles.h"
+#include "lua/tags.h"
 #include "lua/types.h"
 #include <errno.h>
 
@@ -169,6 +177,180 @@ static int import_images(lua_State *L)
   return 1;
 }
 
+/***********************************************************************
+  Batched operations, run in a background job
+ **********************************************************************/
+
+typedef enum dt_lua_batch_op_t
+{
+  DT_LUA_BATCH_ATTACH_TAG,
+  DT_LUA_BATCH_DETACH_TAG,
+  DT_LUA_BATCH_RATING,
+  DT_LUA_BATCH_METADATA,
+  DT_LUA_BATCH_STYLE
+} dt_lua_batch_op_t;
+
+typedef struct dt_lua_batch_t
+{
+  dt_lua_batch_op_t op;
+  GList *imgs;
+  int value;    // tag id or rating
+  gchar *key;   // metadata key or style name
+  gchar *text;  // metadata value
+  dt_progress_t *progress;
+} dt_lua_batch_t;
+
+static void _batch_free(void *data)
+{
+  dt_lua_batch_t *batch = (dt_lua_batch_t *)data;
+  g_list_free(batch->imgs);
+  g_free(batch->key);
+  g_free(batch->text);
+  free(batch);
+}
+
+// the handle given to lua can be invalidated from there, which destroys the progress
+static gboolean _batch_progress_valid(dt_progress_t *progress)
+{
+  if(!progress) return FALSE;
+  dt_pthread_mutex_lock(&darktable.control->progress_system.mutex);
+  const gboolean valid = g_list_find(darktable.control->progress_system.list, progress) != NULL;
+  dt_pthread_mutex_unlock(&darktable.control->progress_system.mutex);
+  return valid;
+}
+
+static int32_t _batch_job_run(dt_job_t *job)
+{
+  dt_lua_batch_t *batch = dt_control_job_get_params(job);
+  switch(batch->op)
+  {
+    case DT_LUA_BATCH_ATTACH_TAG:
+      if(dt_tag_attach_images(batch->value, batch->imgs, FALSE))
+        DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
+      break;
+    case DT_LUA_BATCH_DETACH_TAG:
+      if(dt_tag_detach_images(batch->value, batch->imgs, FALSE))
+        DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
+      break;
+    case DT_LUA_BATCH_RATING:
+      dt_ratings_apply_on_list(batch->imgs, batch->value, FALSE);
+      break;
+    case DT_LUA_BATCH_METADATA:
+    {
+      GList *key_value = g_list_append(NULL, batch->key);
+      key_value = g_list_append(key_value, batch->text);
+      dt_metadata_set_list(batch->imgs, key_value, FALSE);
+      g_list_free(key_value);
+      DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_METADATA_CHANGED, DT_METADATA_SIGNAL_NEW_VALUE);
+      break;
+    }
+    case DT_LUA_BATCH_STYLE:
+    {
+      // the only slow one, so the only one with a progress and a way out
+      const guint total = g_list_length(batch->imgs);
+      guint done = 0;
+      for(GList *img = batch->imgs; img; img = g_list_next(img))
+      {
+        if(dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED) break;
+        if(batch->progress && !_batch_progress_valid(batch->progress)) break;
+        dt_styles_apply_to_image(batch->key, FALSE, GPOINTER_TO_INT(img->data));
+        if(batch->progress)
+          dt_control_progress_set_progress(darktable.control, batch->progress, (double)++done / total);
+      }
+      DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
+      break;
+    }
+  }
+  dt_image_synch_xmps(batch->imgs);
+
+  if(_batch_progress_valid(batch->progress)) dt_control_progress_destroy(darktable.control, batch->progress);
+  return 0;
+}
+
+/* queue the batch and return a background job handle to lua, valid until the job is done.
+   without the gui there are no job handles and nil is returned */
+static int _batch_queue(lua_State *L, dt_lua_batch_t *batch, const char *message)
+{
+  dt_job_t *job = dt_control_job_create(&_batch_job_run, "lua %s", message);
+  if(!job)
+  {
+    _batch_free(batch);
+    return luaL_error(L, "could not create the job");
+  }
+  dt_control_job_set_params(job, batch, _batch_free);
+
+  if(darktable.gui)
+  {
+    batch->progress = dt_control_progress_create(darktable.control, batch->op == DT_LUA_BATCH_STYLE, message);
+    dt_control_progress_attach_job(darktable.control, batch->progress, job);
+    luaA_push_type(L, luaA_type_find(L, "dt_lua_backgroundjob_t"), &batch->progress);
+  }
+  else
+    lua_pushnil(L);
+
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, job);
+  return 1;
+}
+
+static dt_lua_batch_t *_batch_new(lua_State *L, const dt_lua_batch_op_t op)
+{
+  dt_lua_batch_t *batch = calloc(1, sizeof(dt_lua_batch_t));
+  batch->op = op;
+  batch->imgs = dt_lua_image_table_to_list(L, 1);
+  return batch;
+}
+
+static int database_attach_tag(lua_State *L)
+{
+  dt_lua_tag_t tagid;
+  luaA_to(L, dt_lua_tag_t, &tagid, 2);
+  dt_lua_batch_t *batch = _batch_new(L, DT_LUA_BATCH_ATTACH_TAG);
+  batch->value = tagid;
+  return _batch_queue(L, batch, _("attaching tag"));
+}
+
+static int database_detach_tag(lua_State *L)
+{
+  dt_lua_tag_t tagid;
+  luaA_to(L, dt_lua_tag_t, &tagid, 2);
+  dt_lua_batch_t *batch = _batch_new(L, DT_LUA_BATCH_DETACH_TAG);
+  batch->value = tagid;
+  return _batch_queue(L, batch, _("detaching tag"));
+}
+
+static int database_set_rating(lua_State *L)
+{
+  const int rating = luaL_checkinteger(L, 2);
+  if(rating < -1 || rating > 5) return luaL_argerror(L, 2, "the rating must be between -1 and 5");
+  dt_lua_batch_t *batch = _batch_new(L, DT_LUA_BATCH_RATING);
+  // -1 is rejected, as in dt_lua_image_t.rating
+  batch->value = rating == -1 ? DT_VIEW_REJECT : rating;
+  return _batch_queue(L, batch, _("setting rating"));
+}
+
+static int database_set_metadata(lua_State *L)
+{
+  const char *name = luaL_checkstring(L, 2);
+  const char *value = luaL_optstring(L, 3, "");
+  // accepts the lua names of dt_lua_image_t ("title") as well as the xmp keys
+  const char *key = dt_metadata_get_key_by_subkey(name);
+  if(!key) key = name;
+  if(dt_metadata_get_keyid(key) == -1) return luaL_argerror(L, 2, "unknown metadata");
+  dt_lua_batch_t *batch = _batch_new(L, DT_LUA_BATCH_METADATA);
+  batch->key = g_strdup(key);
+  batch->text = g_strdup(value);
+  return _batch_queue(L, batch, _("setting metadata"));
+}
+
+static int database_apply_style(lua_State *L)
+{
+  dt_style_t style;
+  luaA_to(L, dt_style_t, &style, 2);
+  dt_lua_batch_t *batch = _batch_new(L, DT_LUA_BATCH_STYLE);
+  batch->key = g_strdup(style.name);
+  return _batch_queue(L, batch, _("applying style"));
+}
+
 static int database_len(lua_State *L)
 {
   sqlite3_stmt *stmt = NULL;
@@ -292,6 +474,21 @@ int dt_lua_init_database(lua_State *L)
   lua_pushcfunction(L, database_get_image);
   lua_pushcclosure(L, dt_lua_type_member_common, 1);
   dt_lua_type_register_const_type(L, type_id, "get_image");
+  lua_pushcfunction(L, database_attach_tag);
+  lua_pushcclosure(L, dt_lua_type_member_common, 1);
+  dt_lua_type_register_const_type(L, type_id, "attach_tag");
+  lua_pushcfunction(L, database_detach_tag);
+  lua_pushcclosure(L, dt_lua_type_member_common, 1);
+  dt_lua_type_register_const_type(L, type_id, "detach_tag");
+  lua_pushcfunction(L, database_set_rating);
+  lua_pushcclosure(L, dt_lua_type_member_common, 1);
+  dt_lua_type_register_const_type(L, type_id, "set_rating");
+  lua_pushcfunction(L, database_set_metadata);
+  lua_pushcclosure(L, dt_lua_type_member_common, 1);
+  dt_lua_type_register_const_type(L, type_id, "set_metadata");
+  lua_pushcfunction(L, database_apply_style);
+  lua_pushcclosure(L, dt_lua_type_member_common, 1);
+  dt_lua_type_register_const_type(L, type_id, "apply_style");
 
   /* database type */
   dt_lua_push_darktable_lib(L);
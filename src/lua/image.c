@@ -493,6 +493,22 @@ static int image_luaautoc_member(lua_State *L)
   }
 }
 
+GList *dt_lua_image_table_to_list(lua_State *L, int index)
+{
+  luaL_checktype(L, index, LUA_TTABLE);
+  GList *result = NULL;
+  lua_pushnil(L); /* first key */
+  while(lua_next(L, index) != 0)
+  {
+    /* uses 'key' (at index -2) and 'value' (at index -1) */
+    dt_lua_image_t imgid;
+    luaA_to(L, dt_lua_image_t, &imgid, -1);
+    result = g_list_prepend(result, GINT_TO_POINTER(imgid));
+    lua_pop(L, 1);
+  }
+  return g_list_reverse(result);
+}
+
 int dt_lua_init_image(lua_State *L)
 {
   luaA_struct(L, dt_image_t);
@@ -23,6 +23,9 @@
 
 typedef int dt_lua_image_t; // wrapper for dt_image_t id
 
+// ids of the table of images at index, as GINT_TO_POINTER. free with g_list_free()
+GList *dt_lua_image_table_to_list(lua_State *L, int index);
+
 int dt_lua_init_image(lua_State *L);
 
 // clang-format off
@@ -35,6 +35,7 @@
 #include "lua/lua.h"
 #include "lua/lualib.h"
 #include "lua/luastorage.h"
+#include "lua/memory.h"
 #include "lua/modules.h"
 #include "lua/password.h"
 #include "lua/preferences.h"
@@ -138,7 +139,7 @@ static lua_CFunction init_funcs[]
         dt_lua_init_luastorages,   dt_lua_init_tags,        dt_lua_init_film,     dt_lua_init_call,
         dt_lua_init_view,          dt_lua_init_events,      dt_lua_init_init,     dt_lua_init_widget,
         dt_lua_init_lualib,        dt_lua_init_gettext,     dt_lua_init_guides,   dt_lua_init_cairo,
-        dt_lua_init_password,      NULL };
+        dt_lua_init_password,      dt_lua_init_memory,      NULL };
 
 
 void dt_lua_init(lua_State *L, const char *lua_command)
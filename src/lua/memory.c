@@ -0,0 +1,97 @@
+/*
+   This file is part of Ansel.
+   Copyright (C) 2026 Ansel developers.
+
+   Ansel is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Ansel is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lua/memory.h"
+#include "common/memstat.h"
+#include "lua/lua.h"
+
+static void _push_stats(lua_State *L, const dt_memstat_t *stats)
+{
+  lua_newtable(L);
+  lua_pushinteger(L, stats->host_peak);
+  lua_setfield(L, -2, "host_peak");
+  lua_pushinteger(L, stats->device_peak);
+  lua_setfield(L, -2, "device_peak");
+  lua_pushinteger(L, stats->bytes[DT_MEMSTAT_CACHE]);
+  lua_setfield(L, -2, "cache");
+  lua_pushinteger(L, stats->bytes[DT_MEMSTAT_TILING]);
+  lua_setfield(L, -2, "tiling");
+  lua_pushinteger(L, stats->bytes[DT_MEMSTAT_SCRATCH]);
+  lua_setfield(L, -2, "scratch");
+  lua_pushinteger(L, stats->bytes[DT_MEMSTAT_DEVICE]);
+  lua_setfield(L, -2, "device");
+}
+
+// the result table is on top of the stack
+static void _add_record(const char *pipe, const char *module, const dt_memstat_t *stats, void *user_data)
+{
+  lua_State *L = (lua_State *)user_data;
+  if(!module)
+  {
+    _push_stats(L, stats);
+    lua_newtable(L);
+    lua_setfield(L, -2, "modules");
+    lua_setfield(L, -2, pipe);
+    return;
+  }
+
+  // runs come first, a module without a completed run of its pipe is skipped
+  lua_getfield(L, -1, pipe);
+  if(lua_istable(L, -1))
+  {
+    lua_getfield(L, -1, "modules");
+    _push_stats(L, stats);
+    lua_setfield(L, -2, module);
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+}
+
+/* darktable.memory.stats() returns the highest values seen in the session, in bytes:
+   { export = { host_peak, device_peak, cache, tiling, scratch, device, modules = { exposure = { ... } } }, ... } */
+static int _stats(lua_State *L)
+{
+  lua_newtable(L);
+  dt_memstat_foreach(_add_record, L);
+  return 1;
+}
+
+static int _reset(lua_State *L)
+{
+  dt_memstat_cleanup();
+  return 0;
+}
+
+int dt_lua_init_memory(lua_State *L)
+{
+  dt_lua_push_darktable_lib(L);
+  dt_lua_goto_subtable(L, "memory");
+
+  lua_pushcfunction(L, _stats);
+  lua_setfield(L, -2, "stats");
+
+  lua_pushcfunction(L, _reset);
+  lua_setfield(L, -2, "reset");
+
+  lua_pop(L, 1);
+  return 0;
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
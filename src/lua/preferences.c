@@ -282,9 +282,7 @@ static int destroy_pref(lua_State *L)
 
   char pref_name[1024];
   get_pref_name(pref_name, sizeof(pref_name), script, name);
-  dt_pthread_mutex_lock(&darktable.conf->mutex);
-  result = g_hash_table_remove(darktable.conf->table, pref_name);
-  dt_pthread_mutex_unlock(&darktable.conf->mutex);
+  result = dt_conf_remove_key(pref_name);
   lua_pushboolean(L, result);
   return 1;
 }
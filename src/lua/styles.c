@@ -249,6 +249,16 @@ int dt_lua_style_apply(lua_State *L)
 {
   dt_lua_image_t imgid = UNKNOWN_IMAGE;
   dt_style_t style;
+  if(lua_istable(L, 1) || lua_istable(L, 2))
+  {
+    // a table of images goes to a background job, see dt_styles_apply_to_list()
+    const int images_index = lua_istable(L, 1) ? 1 : 2;
+    luaA_to(L, dt_style_t, &style, 3 - images_index);
+    GList *imgs = dt_lua_image_table_to_list(L, images_index);
+    if(imgs) dt_styles_apply_to_list(style.name, imgs, FALSE);
+    g_list_free(imgs);
+    return 0;
+  }
   if(luaL_testudata(L, 1, "dt_lua_image_t"))
   {
     luaA_to(L, dt_lua_image_t, &imgid, 1);
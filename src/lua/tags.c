@@ -174,10 +174,31 @@ static int tag_delete(lua_State *L)
 }
 
 
+// the images can be a table, then they are all done at once
+static gboolean _tag_images(lua_State *L, dt_lua_tag_t *tagid, GList **imgs)
+{
+  const int images_index = lua_istable(L, 1) ? 1 : 2;
+  if(!lua_istable(L, images_index)) return FALSE;
+  luaA_to(L, dt_lua_tag_t, tagid, 3 - images_index);
+  *imgs = dt_lua_image_table_to_list(L, images_index);
+  return TRUE;
+}
+
 int dt_lua_tag_attach(lua_State *L)
 {
   dt_lua_image_t imgid = UNKNOWN_IMAGE;
   dt_lua_tag_t tagid = 0;
+  GList *imgs = NULL;
+  if(_tag_images(L, &tagid, &imgs))
+  {
+    if(imgs && dt_tag_attach_images(tagid, imgs, TRUE))
+    {
+      DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
+      dt_image_synch_xmps(imgs);
+    }
+    g_list_free(imgs);
+    return 0;
+  }
   if(luaL_testudata(L, 1, "dt_lua_image_t"))
   {
     luaA_to(L, dt_lua_image_t, &imgid, 1);
@@ -200,6 +221,17 @@ int dt_lua_tag_detach(lua_State *L)
 {
   dt_lua_image_t imgid;
   dt_lua_tag_t tagid;
+  GList *imgs = NULL;
+  if(_tag_images(L, &tagid, &imgs))
+  {
+    if(imgs && dt_tag_detach_images(tagid, imgs, TRUE))
+    {
+      dt_image_synch_xmps(imgs);
+      DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
+    }
+    g_list_free(imgs);
+    return 0;
+  }
   if(luaL_testudata(L, 1, "dt_lua_image_t"))
   {
     luaA_to(L, dt_lua_image_t, &imgid, 1);
@@ -0,0 +1,469 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Micro-benchmarks of the filters of src/common, on CPU with several thread counts and on the OpenCL device
+ * the export pipe would use. Each kernel runs on a synthetic image of each requested size.
+ *
+ * Reported: the median time of the repeats, the throughput in Mpix/s of the image size, and the bandwidth
+ * in GB/s, counting the input read once and the output written once. The scratch traffic of the filters
+ * is not counted, so this is a lower bound of the memory bandwidth they need.
+ *
+ * usage: ansel-bench-kernels [--sizes WxH,...] [--threads N,...] [--reps N] [--filter name] [--cpu-only]
+ */
+
+#include "common/darktable.h"
+#include "common/bilateral.h"
+#include "common/bilateralcl.h"
+#include "common/dwt.h"
+#include "common/eaw.h"
+#include "common/fast_guided_filter.h"
+#include "common/gaussian.h"
+#include "common/guided_filter.h"
+#include "common/interpolation.h"
+#include "common/locallaplacian.h"
+#include "common/locallaplaciancl.h"
+#include "common/opencl.h"
+#include "develop/pixelpipe.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+#define MAX_SIZES 8
+#define MAX_THREADS 8
+
+typedef struct bench_size_t
+{
+  int width, height;
+} bench_size_t;
+
+typedef struct bench_kernel_t
+{
+  const char *name;
+  int ch_in, ch_out; // channels of the input and output buffers
+  float scale_out;   // output size relative to the input
+  void (*process)(const float *const in, float *const out, const int width, const int height);
+#ifdef HAVE_OPENCL
+  cl_int (*process_cl)(const int devid, cl_mem in, cl_mem out, const int width, const int height);
+#endif
+} bench_kernel_t;
+
+/*
+ * CPU KERNELS
+ */
+
+static void _gaussian_sigma(const float *const in, float *const out, const int width, const int height,
+                            const float sigma)
+{
+  const float max[4] = { 1.0f, 1.0f, 1.0f, 1.0f }, min[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  dt_gaussian_t *g = dt_gaussian_init(width, height, 4, max, min, sigma, 0);
+  if(!g) return;
+  dt_gaussian_blur_4c(g, in, out);
+  dt_gaussian_free(g);
+}
+
+static void _gaussian(const float *const in, float *const out, const int width, const int height)
+{
+  _gaussian_sigma(in, out, width, height, 8.0f);
+}
+
+// on both sides of the switch from the direct convolution to the recursive filter
+static void _gaussian_fir(const float *const in, float *const out, const int width, const int height)
+{
+  _gaussian_sigma(in, out, width, height, 2.0f);
+}
+
+static void _gaussian_iir(const float *const in, float *const out, const int width, const int height)
+{
+  _gaussian_sigma(in, out, width, height, 2.5f);
+}
+
+static void _bilateral(const float *const in, float *const out, const int width, const int height)
+{
+  dt_bilateral_t *b = dt_bilateral_init(width, height, 16.0f, 20.0f);
+  if(!b) return;
+  dt_bilateral_splat(b, in);
+  dt_bilateral_blur(b);
+  dt_bilateral_slice(b, in, out, 1.0f);
+  dt_bilateral_free(b);
+}
+
+static void _local_laplacian(const float *const in, float *const out, const int width, const int height)
+{
+  local_laplacian(in, out, width, height, 0.2f, 0.5f, 0.5f, 0.2f, NULL);
+}
+
+static void _local_laplacian_fast(const float *const in, float *const out, const int width, const int height)
+{
+  local_laplacian_fast(in, out, width, height, 0.2f, 0.5f, 0.5f, 0.2f, dt_get_available_mem());
+}
+
+static void _eaw(const float *const in, float *const out, const int width, const int height)
+{
+  float *const detail = dt_alloc_align_float((size_t)4 * width * height);
+  if(!detail) return;
+  for(int scale = 0; scale < 4; scale++) eaw_decompose(out, in, detail, scale, 0.1f, width, height);
+  dt_free_align(detail);
+}
+
+static void _dwt_layer(float *layer, dwt_params_t *const p, const int scale)
+{
+}
+
+static void _dwt(const float *const in, float *const out, const int width, const int height)
+{
+  // decomposes in place
+  memcpy(out, in, sizeof(float) * 4 * width * height);
+  dwt_params_t *p = dt_dwt_init(out, width, height, 4, 5, 0, 0, NULL, 1.0f, 0);
+  if(!p) return;
+  dwt_decompose(p, _dwt_layer);
+  dt_dwt_free(p);
+}
+
+static void _resample(const float *const in, float *const out, const int width, const int height)
+{
+  const dt_iop_roi_t roi_in = { 0, 0, width, height, 1.0f };
+  const dt_iop_roi_t roi_out = { 0, 0, width / 2, height / 2, 0.5f };
+  dt_interpolation_resample(dt_interpolation_new(DT_INTERPOLATION_LANCZOS3), out, &roi_out, in, &roi_in);
+}
+
+static void _guided_filter(const float *const in, float *const out, const int width, const int height)
+{
+  guided_filter(in, in, out, width, height, 4, 8, 0.1f, 1.0f, 0.0f, 1.0f);
+}
+
+static void _fast_guided_filter(const float *const in, float *const out, const int width, const int height)
+{
+  // works in place on a grey image
+  memcpy(out, in, sizeof(float) * width * height);
+  fast_surface_blur(out, width, height, 32, 1e-2f, 1, DT_GF_BLENDING_LINEAR, 1.0f, 0.0f, exp2f(-8.0f), 1.0f);
+}
+
+/*
+ * OPENCL KERNELS
+ */
+
+#ifdef HAVE_OPENCL
+static cl_int _gaussian_cl(const int devid, cl_mem in, cl_mem out, const int width, const int height)
+{
+  const float max[4] = { 1.0f, 1.0f, 1.0f, 1.0f }, min[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  dt_gaussian_cl_t *g = dt_gaussian_init_cl(devid, width, height, 4, max, min, 8.0f, 0);
+  if(!g) return DT_OPENCL_DEFAULT_ERROR;
+  const cl_int err = dt_gaussian_blur_cl(g, in, out);
+  dt_gaussian_free_cl(g);
+  return err;
+}
+
+static cl_int _bilateral_cl(const int devid, cl_mem in, cl_mem out, const int width, const int height)
+{
+  dt_bilateral_cl_t *b = dt_bilateral_init_cl(devid, width, height, 16.0f, 20.0f);
+  if(!b) return DT_OPENCL_DEFAULT_ERROR;
+  cl_int err = dt_bilateral_splat_cl(b, in);
+  if(err == CL_SUCCESS) err = dt_bilateral_blur_cl(b);
+  if(err == CL_SUCCESS) err = dt_bilateral_slice_cl(b, in, out, 1.0f);
+  dt_bilateral_free_cl(b);
+  return err;
+}
+
+static cl_int _local_laplacian_cl(const int devid, cl_mem in, cl_mem out, const int width, const int height)
+{
+  dt_local_laplacian_cl_t *g = dt_local_laplacian_init_cl(devid, width, height, 0.2f, 0.5f, 0.5f, 0.2f);
+  if(!g) return DT_OPENCL_DEFAULT_ERROR;
+  const cl_int err = dt_local_laplacian_cl(g, in, out);
+  dt_local_laplacian_free_cl(g);
+  return err;
+}
+
+static cl_int _local_laplacian_fast_cl(const int devid, cl_mem in, cl_mem out, const int width, const int height)
+{
+  dt_local_laplacian_cl_t *g = dt_local_laplacian_fast_init_cl(devid, width, height, 0.2f, 0.5f, 0.5f, 0.2f);
+  if(!g) return DT_OPENCL_DEFAULT_ERROR;
+  const cl_int err = dt_local_laplacian_cl(g, in, out);
+  dt_local_laplacian_free_cl(g);
+  return err;
+}
+
+static cl_int _dwt_layer_cl(cl_mem layer, dwt_params_cl_t *const p, const int scale)
+{
+  return CL_SUCCESS;
+}
+
+static cl_int _dwt_cl(const int devid, cl_mem in, cl_mem out, const int width, const int height)
+{
+  size_t origin[] = { 0, 0, 0 };
+  size_t region[] = { width, height, 1 };
+  cl_int err = dt_opencl_enqueue_copy_image(devid, in, out, origin, origin, region);
+  if(err != CL_SUCCESS) return err;
+  dwt_params_cl_t *p = dt_dwt_init_cl(devid, out, width, height, 5, 0, 0, NULL, 1.0f);
+  if(!p) return DT_OPENCL_DEFAULT_ERROR;
+  err = dwt_decompose_cl(p, _dwt_layer_cl);
+  dt_dwt_free_cl(p);
+  return err;
+}
+
+static cl_int _resample_cl(const int devid, cl_mem in, cl_mem out, const int width, const int height)
+{
+  const dt_iop_roi_t roi_in = { 0, 0, width, height, 1.0f };
+  const dt_iop_roi_t roi_out = { 0, 0, width / 2, height / 2, 0.5f };
+  return dt_interpolation_resample_cl(dt_interpolation_new(DT_INTERPOLATION_LANCZOS3), devid, out, &roi_out, in,
+                                      &roi_in);
+}
+
+static cl_int _guided_filter_cl(const int devid, cl_mem in, cl_mem out, const int width, const int height)
+{
+  guided_filter_cl(devid, in, in, out, width, height, 4, 8, 0.1f, 1.0f, 0.0f, 1.0f);
+  return CL_SUCCESS;
+}
+#define CL_KERNEL(f) , f
+#else
+#define CL_KERNEL(f)
+#endif
+
+static const bench_kernel_t _kernels[] = {
+  { "gaussian_4c", 4, 4, 1.0f, _gaussian CL_KERNEL(_gaussian_cl) },
+  { "gaussian_4c_fir", 4, 4, 1.0f, _gaussian_fir CL_KERNEL(NULL) },
+  { "gaussian_4c_iir", 4, 4, 1.0f, _gaussian_iir CL_KERNEL(NULL) },
+  { "bilateral", 4, 4, 1.0f, _bilateral CL_KERNEL(_bilateral_cl) },
+  { "local_laplacian", 4, 4, 1.0f, _local_laplacian CL_KERNEL(_local_laplacian_cl) },
+  { "local_laplacian_fast", 4, 4, 1.0f, _local_laplacian_fast CL_KERNEL(_local_laplacian_fast_cl) },
+  { "eaw_decompose", 4, 4, 1.0f, _eaw CL_KERNEL(NULL) },
+  { "dwt_decompose", 4, 4, 1.0f, _dwt CL_KERNEL(_dwt_cl) },
+  { "resample_lanczos3", 4, 4, 0.5f, _resample CL_KERNEL(_resample_cl) },
+  { "guided_filter", 4, 4, 1.0f, _guided_filter CL_KERNEL(_guided_filter_cl) },
+  { "fast_guided_filter", 1, 1, 1.0f, _fast_guided_filter CL_KERNEL(NULL) },
+};
+
+/*
+ * HARNESS
+ */
+
+// Lab-like values: L in [0; 100] for the filters working on the first channel, smooth areas and edges
+static float *_synthetic(const int width, const int height, const int ch)
+{
+  float *const buf = dt_alloc_align_float((size_t)ch * width * height);
+  if(!buf) return NULL;
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++)
+    {
+      float *const px = buf + (size_t)ch * ((size_t)y * width + x);
+      const float edge = ((x / 64 + y / 64) & 1) ? 0.8f : 0.2f;
+      const float v = 0.5f * edge + 0.25f * (1.0f + sinf(0.05f * x) * cosf(0.03f * y)) * 0.5f + 0.1f * x / width;
+      px[0] = (ch == 4) ? 100.0f * v : v;
+      for(int c = 1; c < ch; c++) px[c] = (c == 3) ? 1.0f : v * (0.5f + 0.2f * c);
+    }
+  return buf;
+}
+
+static int _compare_double(const void *a, const void *b)
+{
+  const double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+static double _median(double *times, const int n)
+{
+  qsort(times, n, sizeof(double), _compare_double);
+  return (n & 1) ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+}
+
+static void _report(const bench_kernel_t *k, const char *device, const int threads, const bench_size_t *size,
+                    const double seconds)
+{
+  const double pixels = (double)size->width * size->height;
+  const double bytes = sizeof(float) * pixels * (k->ch_in + k->ch_out * k->scale_out * k->scale_out);
+  char where[32];
+  if(threads > 0)
+    snprintf(where, sizeof(where), "%s %2d threads", device, threads);
+  else
+    snprintf(where, sizeof(where), "%s", device);
+  printf("%-20s %-16s %5dx%-5d %10.3f ms %9.1f Mpix/s %7.2f GB/s\n", k->name, where, size->width, size->height,
+         1e3 * seconds, pixels / seconds * 1e-6, bytes / seconds * 1e-9);
+  fflush(stdout);
+}
+
+static void _bench_cpu(const bench_kernel_t *k, const bench_size_t *size, const int threads, const int reps)
+{
+  float *const in = _synthetic(size->width, size->height, k->ch_in);
+  float *const out = dt_alloc_align_float((size_t)k->ch_out * size->width * size->height);
+  double *const times = malloc(sizeof(double) * reps);
+  if(!in || !out || !times) goto cleanup;
+
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+  darktable.num_openmp_threads = threads;
+
+  // warm-up: page faults of the buffers, caches of the interpolators
+  k->process(in, out, size->width, size->height);
+  for(int r = 0; r < reps; r++)
+  {
+    const double start = dt_get_wtime();
+    k->process(in, out, size->width, size->height);
+    times[r] = dt_get_wtime() - start;
+  }
+  _report(k, "CPU", threads, size, _median(times, reps));
+
+cleanup:
+  dt_free_align(in);
+  dt_free_align(out);
+  free(times);
+}
+
+#ifdef HAVE_OPENCL
+static void _bench_cl(const bench_kernel_t *k, const bench_size_t *size, const int devid, const int reps)
+{
+  if(!k->process_cl) return;
+  const int width_out = size->width * k->scale_out, height_out = size->height * k->scale_out;
+  float *const in = _synthetic(size->width, size->height, k->ch_in);
+  double *const times = malloc(sizeof(double) * reps);
+  cl_mem dev_in = NULL, dev_out = NULL;
+  if(!in || !times) goto cleanup;
+
+  dev_in = dt_opencl_copy_host_to_device(devid, in, size->width, size->height, sizeof(float) * k->ch_in);
+  dev_out = dt_opencl_alloc_device(devid, width_out, height_out, sizeof(float) * k->ch_out);
+  if(!dev_in || !dev_out)
+  {
+    printf("%-20s %-16s %5dx%-5d could not allocate the buffers on device %d\n", k->name, "GPU", size->width,
+           size->height, devid);
+    goto cleanup;
+  }
+
+  // the first run builds and caches the kernels
+  cl_int err = k->process_cl(devid, dev_in, dev_out, size->width, size->height);
+  if(err == CL_SUCCESS && !dt_opencl_finish(devid)) err = DT_OPENCL_DEFAULT_ERROR;
+  for(int r = 0; r < reps && err == CL_SUCCESS; r++)
+  {
+    const double start = dt_get_wtime();
+    err = k->process_cl(devid, dev_in, dev_out, size->width, size->height);
+    if(err == CL_SUCCESS && !dt_opencl_finish(devid)) err = DT_OPENCL_DEFAULT_ERROR;
+    times[r] = dt_get_wtime() - start;
+  }
+  if(err == CL_SUCCESS)
+    _report(k, "GPU", 0, size, _median(times, reps));
+  else
+    printf("%-20s %-16s %5dx%-5d failed on device %d: %s\n", k->name, "GPU", size->width, size->height, devid,
+           cl_errstr(err));
+
+cleanup:
+  dt_opencl_release_mem_object(dev_in);
+  dt_opencl_release_mem_object(dev_out);
+  dt_free_align(in);
+  free(times);
+}
+#endif
+
+static int _parse_sizes(const char *arg, bench_size_t *sizes)
+{
+  int n = 0;
+  gchar **tokens = g_strsplit(arg, ",", MAX_SIZES);
+  for(gchar **t = tokens; *t && n < MAX_SIZES; t++)
+    if(sscanf(*t, "%dx%d", &sizes[n].width, &sizes[n].height) == 2 && sizes[n].width >= 16
+       && sizes[n].height >= 16)
+      n++;
+  g_strfreev(tokens);
+  return n;
+}
+
+static int _parse_threads(const char *arg, int *threads)
+{
+  int n = 0;
+  gchar **tokens = g_strsplit(arg, ",", MAX_THREADS);
+  for(gchar **t = tokens; *t && n < MAX_THREADS; t++)
+    if((threads[n] = atoi(*t)) > 0) n++;
+  g_strfreev(tokens);
+  return n;
+}
+
+static int _usage(const char *argv0)
+{
+  printf("usage: %s [--sizes WxH,...] [--threads N,...] [--reps N] [--filter name] [--cpu-only]\n", argv0);
+  printf("\nkernels:");
+  for(int k = 0; k < sizeof(_kernels) / sizeof(_kernels[0]); k++) printf(" %s", _kernels[k].name);
+  printf("\n");
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  bench_size_t sizes[MAX_SIZES] = { { 1024, 768 }, { 4096, 3072 } };
+  int nsizes = 2;
+  int threads[MAX_THREADS] = { 1 };
+  int nthreads = 1;
+#ifdef _OPENMP
+  threads[nthreads++] = omp_get_num_procs();
+#endif
+  int reps = 5;
+  const char *filter = NULL;
+  gboolean cpu_only = FALSE;
+
+  for(int k = 1; k < argc; k++)
+  {
+    if(!strcmp(argv[k], "--sizes") && k + 1 < argc)
+      nsizes = _parse_sizes(argv[++k], sizes);
+    else if(!strcmp(argv[k], "--threads") && k + 1 < argc)
+      nthreads = _parse_threads(argv[++k], threads);
+    else if(!strcmp(argv[k], "--reps") && k + 1 < argc)
+      reps = CLAMP(atoi(argv[++k]), 1, 1000);
+    else if(!strcmp(argv[k], "--filter") && k + 1 < argc)
+      filter = argv[++k];
+    else if(!strcmp(argv[k], "--cpu-only"))
+      cpu_only = TRUE;
+    else
+      return _usage(argv[0]);
+  }
+  if(nsizes == 0 || nthreads == 0) return _usage(argv[0]);
+
+  char *argv_override[] = { "ansel-bench-kernels", "--library", ":memory:", "--conf", "write_sidecar_files=never",
+                            cpu_only ? "--disable-opencl" : NULL, NULL };
+  int argc_override = sizeof(argv_override) / sizeof(*argv_override) - (cpu_only ? 1 : 2);
+
+  // init dt without gui and without data.db, the OpenCL kernels are built as usual
+  if(dt_init(argc_override, argv_override, FALSE, FALSE, NULL)) exit(1);
+
+  const int devid = cpu_only ? -1 : dt_opencl_lock_device(DT_DEV_PIXELPIPE_EXPORT);
+
+  for(int k = 0; k < sizeof(_kernels) / sizeof(_kernels[0]); k++)
+  {
+    const bench_kernel_t *kernel = &_kernels[k];
+    if(filter && !strstr(kernel->name, filter)) continue;
+    for(int s = 0; s < nsizes; s++)
+    {
+      for(int t = 0; t < nthreads; t++) _bench_cpu(kernel, &sizes[s], threads[t], reps);
+#ifdef HAVE_OPENCL
+      if(devid >= 0) _bench_cl(kernel, &sizes[s], devid, reps);
+#endif
+    }
+  }
+
+  if(devid >= 0) dt_opencl_unlock_device(devid);
+  dt_cleanup();
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
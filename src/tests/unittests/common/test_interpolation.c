@@ -0,0 +1,190 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the resampling of common/interpolation.c
+ *
+ * The separable resampler is checked against the plain one, and both are timed
+ * on a 24 Mpx buffer: run ./src/tests/unittests/test_interpolation to get the figures.
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "common/interpolation.c"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+// epsilon for floating point comparison, the sums are done in the same order
+// but the compiler may contract them differently in both versions
+#define E 1e-5f
+
+#define BENCH_WIDTH 6000
+#define BENCH_HEIGHT 4000
+#define BENCH_RUNS 3
+
+static float *_test_image(const int width, const int height)
+{
+  float *const buf = dt_alloc_align_float((size_t)width * height * 4);
+  assert_non_null(buf);
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++)
+    {
+      float *const px = buf + ((size_t)y * width + x) * 4;
+      px[0] = 0.5f + 0.5f * sinf(0.05f * x) * cosf(0.03f * y);
+      px[1] = (float)((x ^ y) & 0xff) / 255.f;
+      px[2] = (x / 7 + y / 5) % 2 ? 0.9f : 0.1f;
+      px[3] = 1.0f;
+    }
+  return buf;
+}
+
+static void _compare(const enum dt_interpolation_type type, const int width, const int height, const float scale)
+{
+  const struct dt_interpolation *itor = dt_interpolation_new(type);
+  const dt_iop_roi_t roi_in = { 0, 0, width, height, 1.0f };
+  const dt_iop_roi_t roi_out = { 0, 0, (int)(width * scale), (int)(height * scale), scale };
+  const size_t out_size = (size_t)roi_out.width * roi_out.height * 4;
+
+  float *const in = _test_image(width, height);
+  float *const ref = dt_alloc_align_float(out_size);
+  float *const out = dt_alloc_align_float(out_size);
+  assert_non_null(ref);
+  assert_non_null(out);
+
+  _interpolation_resample_plain(itor, ref, &roi_out, in, &roi_in);
+  assert_int_equal(_interpolation_resample_separable(itor, out, &roi_out, in, &roi_in), 0);
+
+  TR_STEP("%s, %dx%d, scale %.3f", itor->name, width, height, scale);
+  for(size_t k = 0; k < out_size; k++)
+    assert_float_equal(out[k], ref[k], E);
+
+  dt_free_align(in);
+  dt_free_align(ref);
+  dt_free_align(out);
+}
+
+static void _bench(const enum dt_interpolation_type type, const float scale)
+{
+  const struct dt_interpolation *itor = dt_interpolation_new(type);
+  const dt_iop_roi_t roi_in = { 0, 0, BENCH_WIDTH, BENCH_HEIGHT, 1.0f };
+  const dt_iop_roi_t roi_out = { 0, 0, (int)(BENCH_WIDTH * scale), (int)(BENCH_HEIGHT * scale), scale };
+
+  float *const in = _test_image(BENCH_WIDTH, BENCH_HEIGHT);
+  float *const out = dt_alloc_align_float((size_t)roi_out.width * roi_out.height * 4);
+  assert_non_null(out);
+
+  double plain = 0.0, separable = 0.0;
+  for(int run = 0; run < BENCH_RUNS; run++)
+  {
+    double start = dt_get_wtime();
+    _interpolation_resample_plain(itor, out, &roi_out, in, &roi_in);
+    plain += dt_get_wtime() - start;
+
+    start = dt_get_wtime();
+    assert_int_equal(_interpolation_resample_separable(itor, out, &roi_out, in, &roi_in), 0);
+    separable += dt_get_wtime() - start;
+  }
+
+  TR_NOTE("%s, scale %.3f: plain %.3f s, separable %.3f s (x%.2f)", itor->name, scale, plain / BENCH_RUNS,
+          separable / BENCH_RUNS, plain / separable);
+
+  dt_free_align(in);
+  dt_free_align(out);
+}
+
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_resample_lanczos3(void **state)
+{
+  _compare(DT_INTERPOLATION_LANCZOS3, 317, 211, 0.37f);
+  _compare(DT_INTERPOLATION_LANCZOS3, 317, 211, 0.5f);
+  _compare(DT_INTERPOLATION_LANCZOS3, 131, 97, 1.7f);
+  _compare(DT_INTERPOLATION_LANCZOS3, 131, 97, 3.0f);
+}
+
+static void test_resample_bicubic(void **state)
+{
+  _compare(DT_INTERPOLATION_BICUBIC, 317, 211, 0.37f);
+  _compare(DT_INTERPOLATION_BICUBIC, 131, 97, 2.3f);
+}
+
+static void test_resample_narrow(void **state)
+{
+  // fewer output pixels than taps, and lines wider than a block of the vertical pass
+  _compare(DT_INTERPOLATION_LANCZOS3, 9, 7, 0.25f);
+  _compare(DT_INTERPOLATION_BICUBIC, 700, 3, 0.8f);
+}
+
+static void test_benchmark(void **state)
+{
+  _bench(DT_INTERPOLATION_LANCZOS3, 0.25f);
+  _bench(DT_INTERPOLATION_LANCZOS3, 0.5f);
+  _bench(DT_INTERPOLATION_LANCZOS3, 1.5f);
+  _bench(DT_INTERPOLATION_BICUBIC, 0.25f);
+  _bench(DT_INTERPOLATION_BICUBIC, 0.5f);
+  _bench(DT_INTERPOLATION_BICUBIC, 1.5f);
+}
+
+static int setup(void **state)
+{
+  // the per-thread buffers of the resampler are sized from this
+#ifdef _OPENMP
+  darktable.num_openmp_threads = omp_get_max_threads();
+#else
+  darktable.num_openmp_threads = 1;
+#endif
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_resample_lanczos3),
+    cmocka_unit_test(test_resample_bicubic),
+    cmocka_unit_test(test_resample_narrow),
+    cmocka_unit_test(test_benchmark)
+  };
+
+  TR_DEBUG("epsilon = %e", E);
+
+  return cmocka_run_group_tests(tests, setup, NULL);
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,100 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the 8-bit downsampling of develop/imageop_math.c, used to derive mipmaps
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "develop/imageop_math.h"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+#define WIDTH 120
+#define HEIGHT 90
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_downsample_8(void **state)
+{
+  uint8_t *const in = malloc((size_t)4 * WIDTH * HEIGHT);
+  uint8_t *const out = malloc((size_t)4 * WIDTH * HEIGHT);
+  assert_non_null(in);
+  assert_non_null(out);
+  uint32_t width = 0, height = 0;
+
+  TR_STEP("a checkerboard averages to mid-gray, with the aspect ratio kept");
+  for(int y = 0; y < HEIGHT; y++)
+    for(int x = 0; x < WIDTH; x++)
+      for(int k = 0; k < 4; k++) in[4 * (y * WIDTH + x) + k] = ((x + y) % 2) ? 255 : 0;
+  dt_iop_downsample_8(in, WIDTH, HEIGHT, out, 60, 60, &width, &height);
+  assert_int_equal(width, 60);
+  assert_int_equal(height, 45);
+  for(uint32_t k = 0; k < 4 * width * height; k++) assert_in_range(out[k], 127, 128);
+
+  TR_STEP("a fractional scale keeps a flat image flat");
+  memset(in, 77, (size_t)4 * WIDTH * HEIGHT);
+  dt_iop_downsample_8(in, WIDTH, HEIGHT, out, 48, 48, &width, &height);
+  assert_int_equal(width, 48);
+  assert_int_equal(height, 36);
+  for(uint32_t k = 0; k < 4 * width * height; k++) assert_int_equal(out[k], 77);
+
+  TR_STEP("no upscaling");
+  dt_iop_downsample_8(in, WIDTH, HEIGHT, out, 2 * WIDTH, 2 * HEIGHT, &width, &height);
+  assert_int_equal(width, WIDTH);
+  assert_int_equal(height, HEIGHT);
+  assert_memory_equal(out, in, (size_t)4 * WIDTH * HEIGHT);
+
+  free(in);
+  free(out);
+}
+
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_downsample_8)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,171 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the scanline rasterizers of develop/masks/rasterize.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "develop/masks/rasterize.c"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+#define WIDTH 100
+#define HEIGHT 80
+
+// the outline of the circle is a polygon of that many sides, its area is a bit smaller
+#define CIRCLE_POINTS 360
+
+static double _sum(const float *const buf)
+{
+  double sum = 0.0;
+  for(int k = 0; k < WIDTH * HEIGHT; k++) sum += buf[k];
+  return sum;
+}
+
+static void _circle(float *const points, const int count, const float cx, const float cy, const float r)
+{
+  for(int k = 0; k < count; k++)
+  {
+    const float a = 2.0f * M_PI * k / (count - 1);
+    points[2 * k] = cx + r * cosf(a);
+    points[2 * k + 1] = cy + r * sinf(a);
+  }
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_polygon_area(void **state)
+{
+  float *const buf = dt_alloc_align_float((size_t)WIDTH * HEIGHT);
+  assert_non_null(buf);
+
+  TR_STEP("the coverage of a rectangle sums to its area");
+  memset(buf, 0, sizeof(float) * WIDTH * HEIGHT);
+  const float rect[] = { 10.3f, 10.0f, 60.7f, 10.0f, 60.7f, 50.25f, 10.3f, 50.25f };
+  assert_int_equal(dt_masks_rasterize_polygon(buf, WIDTH, HEIGHT, rect, 4), 1);
+  assert_float_equal(_sum(buf), 50.4 * 40.25, 1e-2);
+  // inside and outside
+  assert_float_equal(buf[30 * WIDTH + 30], 1.0f, 1e-6);
+  assert_float_equal(buf[5 * WIDTH + 30], 0.0f, 1e-6);
+  // anti-aliased edge: 0.3 of the pixel around x = 10 is left of the edge at 10.3
+  assert_float_equal(buf[30 * WIDTH + 10], 0.2f, 1e-5);
+
+  TR_STEP("the coverage of a circle sums to its area");
+  memset(buf, 0, sizeof(float) * WIDTH * HEIGHT);
+  float circle[2 * CIRCLE_POINTS];
+  _circle(circle, CIRCLE_POINTS, 50.0f, 40.0f, 30.0f);
+  assert_int_equal(dt_masks_rasterize_polygon(buf, WIDTH, HEIGHT, circle, CIRCLE_POINTS), 1);
+  assert_float_equal(_sum(buf), M_PI * 30.0 * 30.0, 1.0);
+
+  TR_STEP("a polygon larger than the buffer is clipped");
+  memset(buf, 0, sizeof(float) * WIDTH * HEIGHT);
+  const float large[] = { -1000.0f, -500.0f, 1000.0f, -500.0f, 1000.0f, 500.0f, -1000.0f, 500.0f };
+  assert_int_equal(dt_masks_rasterize_polygon(buf, WIDTH, HEIGHT, large, 4), 1);
+  assert_float_equal(_sum(buf), WIDTH * HEIGHT, 1e-2);
+
+  dt_free_align(buf);
+}
+
+static void test_falloff(void **state)
+{
+  float *const buf = dt_alloc_align_float((size_t)WIDTH * HEIGHT);
+  assert_non_null(buf);
+  float inner[2 * CIRCLE_POINTS], outer[2 * CIRCLE_POINTS], payload[2 * CIRCLE_POINTS];
+  _circle(inner, CIRCLE_POINTS, 50.0f, 40.0f, 20.0f);
+  _circle(outer, CIRCLE_POINTS, 50.0f, 40.0f, 30.0f);
+
+  TR_STEP("linear falloff between two concentric circles");
+  memset(buf, 0, sizeof(float) * WIDTH * HEIGHT);
+  assert_int_equal(dt_masks_rasterize_falloff(buf, WIDTH, HEIGHT, inner, outer, NULL, CIRCLE_POINTS, 4.0f), 1);
+  for(int y = 0; y < HEIGHT; y++)
+    for(int x = 0; x < WIDTH; x++)
+    {
+      const float r = hypotf(x - 50.0f, y - 40.0f);
+      // away from the polygonal outlines
+      if(r > 20.5f && r < 29.5f)
+        assert_float_equal(buf[y * WIDTH + x], 1.0f - (r - 20.0f) / 10.0f, 2e-2);
+      else if(r > 30.5f || r < 19.5f)
+        assert_float_equal(buf[y * WIDTH + x], 0.0f, 1e-6);
+    }
+
+  TR_STEP("hardness and density");
+  for(int k = 0; k < CIRCLE_POINTS; k++)
+  {
+    payload[2 * k] = 0.5f;     // hardness
+    payload[2 * k + 1] = 0.8f; // density
+  }
+  memset(buf, 0, sizeof(float) * WIDTH * HEIGHT);
+  assert_int_equal(dt_masks_rasterize_falloff(buf, WIDTH, HEIGHT, inner, outer, payload, CIRCLE_POINTS, 4.0f), 1);
+  assert_float_equal(buf[40 * WIDTH + 72], 0.8f, 1e-2);        // r = 22, solid part
+  assert_float_equal(buf[40 * WIDTH + 77], 0.8f * 0.6f, 2e-2); // r = 27, 3/5 of the way from 30 to 25
+
+  TR_STEP("pairs further apart than the gap are not joined");
+  const float a[] = { 10.0f, 10.0f, 80.0f, 10.0f };
+  const float b[] = { 10.0f, 20.0f, 80.0f, 20.0f };
+  memset(buf, 0, sizeof(float) * WIDTH * HEIGHT);
+  assert_int_equal(dt_masks_rasterize_falloff(buf, WIDTH, HEIGHT, a, b, NULL, 2, 4.0f), 1);
+  assert_float_equal(_sum(buf), 0.0, 1e-6);
+
+  dt_free_align(buf);
+}
+
+static int setup(void **state)
+{
+  // the per-thread buffers of the polygon fill are sized from this
+#ifdef _OPENMP
+  darktable.num_openmp_threads = omp_get_max_threads();
+#else
+  darktable.num_openmp_threads = 1;
+#endif
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_polygon_area),
+    cmocka_unit_test(test_falloff)
+  };
+
+  return cmocka_run_group_tests(tests, setup, NULL);
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,224 @@
+/*
+    This file is part of Ansel.
+    Copyright (C) 2026 Ansel developers.
+
+    Ansel is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Ansel is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Ansel.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the tiled CPU demosaicers of iop/demosaic.c (RCD and Markesteijn)
+ *
+ * The output must not depend on the number of threads, nor on where the tiles fall.
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "iop/demosaic.c"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+// epsilon for the comparison of crops: tiles fall at other positions,
+// the compiler may vectorize the same pixel differently
+#define E 1e-5f
+
+#define WIDTH 420
+#define HEIGHT 300
+
+// crop, a multiple of the CFA size so the pattern stays in phase
+#define CROP_X 48
+#define CROP_Y 36
+#define CROP_WIDTH 250
+#define CROP_HEIGHT 190
+
+static const uint32_t bayer_rggb = 0x94949494;
+
+static const uint8_t xtrans_pattern[6][6] = { { 1, 2, 1, 1, 0, 1 },
+                                              { 0, 1, 0, 2, 1, 2 },
+                                              { 1, 2, 1, 1, 0, 1 },
+                                              { 1, 0, 1, 1, 2, 1 },
+                                              { 2, 1, 2, 0, 1, 0 },
+                                              { 1, 0, 1, 1, 2, 1 } };
+
+/*
+ * MOCKED FUNCTIONS
+ */
+
+// amaze is built as a separate C++ unit of the module
+void amaze_demosaic_RT(dt_dev_pixelpipe_iop_t *piece, const float *const in, float *out,
+                       const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out, const uint32_t filters)
+{
+}
+
+/*
+ * HELPERS
+ */
+
+// smooth gradients with a few sharp edges, sampled through the CFA
+static float *_mosaic(const int xtrans)
+{
+  float *const buf = dt_alloc_align_float((size_t)WIDTH * HEIGHT);
+  assert_non_null(buf);
+  for(int y = 0; y < HEIGHT; y++)
+    for(int x = 0; x < WIDTH; x++)
+    {
+      const float edge = ((x + 2 * y) / 37) % 2 ? 0.8f : 0.2f;
+      const dt_aligned_pixel_t rgb = { 0.2f + 0.6f * x / WIDTH, 0.5f + 0.4f * sinf(0.07f * x) * cosf(0.05f * y),
+                                       edge, 0.0f };
+      const int c = xtrans ? FCxtrans(y, x, NULL, xtrans_pattern) : FC(y, x, bayer_rggb);
+      buf[(size_t)y * WIDTH + x] = rgb[c];
+    }
+  return buf;
+}
+
+static float *_crop(const float *const in)
+{
+  float *const buf = dt_alloc_align_float((size_t)CROP_WIDTH * CROP_HEIGHT);
+  assert_non_null(buf);
+  for(int y = 0; y < CROP_HEIGHT; y++)
+    memcpy(buf + (size_t)y * CROP_WIDTH, in + (size_t)(y + CROP_Y) * WIDTH + CROP_X, sizeof(float) * CROP_WIDTH);
+  return buf;
+}
+
+static float *_demosaic(const float *const in, const int width, const int height, const int xtrans,
+                        const int passes)
+{
+  dt_dev_pixelpipe_t pipe = { 0 };
+  for(int c = 0; c < 3; c++) pipe.dsc.processed_maximum[c] = 1.0f;
+  dt_dev_pixelpipe_iop_t piece = { 0 };
+  piece.pipe = &pipe;
+
+  dt_iop_roi_t roi = { 0, 0, width, height, 1.0f };
+  float *const out = dt_alloc_align_float((size_t)4 * width * height);
+  assert_non_null(out);
+  memset(out, 0, sizeof(float) * 4 * width * height);
+
+  if(xtrans)
+    xtrans_markesteijn_interpolate(out, in, &roi, &roi, xtrans_pattern, passes);
+  else
+    rcd_demosaic(&piece, out, in, &roi, &roi, bayer_rggb);
+  return out;
+}
+
+static void _check_threads(const int xtrans, const int passes)
+{
+  float *const in = _mosaic(xtrans);
+
+  float *const ref = _demosaic(in, WIDTH, HEIGHT, xtrans, passes);
+#ifdef _OPENMP
+  const int threads = omp_get_max_threads();
+  omp_set_num_threads(1);
+#endif
+  float *const out = _demosaic(in, WIDTH, HEIGHT, xtrans, passes);
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+
+  TR_STEP("%s: same output with 1 thread", xtrans ? "markesteijn" : "rcd");
+  assert_memory_equal(out, ref, sizeof(float) * 4 * WIDTH * HEIGHT);
+
+  dt_free_align(in);
+  dt_free_align(ref);
+  dt_free_align(out);
+}
+
+static void _check_crop(const int xtrans, const int passes, const int margin)
+{
+  float *const in = _mosaic(xtrans);
+  float *const cropped = _crop(in);
+
+  float *const full = _demosaic(in, WIDTH, HEIGHT, xtrans, passes);
+  float *const out = _demosaic(cropped, CROP_WIDTH, CROP_HEIGHT, xtrans, passes);
+
+  TR_STEP("%s: same output on a crop, %d px away from its edges", xtrans ? "markesteijn" : "rcd", margin);
+  for(int y = margin; y < CROP_HEIGHT - margin; y++)
+    for(int x = margin; x < CROP_WIDTH - margin; x++)
+      for(int c = 0; c < 3; c++)
+      {
+        const float a = out[4 * ((size_t)y * CROP_WIDTH + x) + c];
+        const float b = full[4 * ((size_t)(y + CROP_Y) * WIDTH + x + CROP_X) + c];
+        assert_float_equal(a, b, E);
+      }
+
+  dt_free_align(in);
+  dt_free_align(cropped);
+  dt_free_align(full);
+  dt_free_align(out);
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_rcd(void **state)
+{
+  _check_threads(FALSE, 1);
+  _check_crop(FALSE, 1, 12); // RCD needs 9 px around a tile
+}
+
+static void test_markesteijn_1pass(void **state)
+{
+  _check_threads(TRUE, 1);
+  _check_crop(TRUE, 1, 24);
+}
+
+static void test_markesteijn_3pass(void **state)
+{
+  _check_threads(TRUE, 3);
+  _check_crop(TRUE, 3, 30);
+}
+
+static int setup(void **state)
+{
+  // the per-thread scratch arenas are sized from this
+#ifdef _OPENMP
+  darktable.num_openmp_threads = omp_get_max_threads();
+#else
+  darktable.num_openmp_threads = 1;
+#endif
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_rcd),
+    cmocka_unit_test(test_markesteijn_1pass),
+    cmocka_unit_test(test_markesteijn_3pass)
+  };
+
+  TR_DEBUG("epsilon = %e", E);
+
+  return cmocka_run_group_tests(tests, setup, NULL);
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -127,15 +127,6 @@ void cleanup(dt_view_t *self)
   free(dev);
 }
 
-static cairo_status_t _write_snapshot_data(void *closure, const unsigned char *data, unsigned int length)
-{
-  const int fd = GPOINTER_TO_INT(closure);
-  ssize_t res = write(fd, data, length);
-  if(res != length)
-    return CAIRO_STATUS_WRITE_ERROR;
-  return CAIRO_STATUS_SUCCESS;
-}
-
 static dt_darkroom_layout_t _lib_darkroom_get_layout(dt_view_t *self)
 {
   return DT_DARKROOM_LAYOUT_EDITING;
@@ -310,6 +301,57 @@ void _colormanage_ui_color(const float L, const float a, const float b, dt_align
 }
 
 
+static void _perf_overlay_print(GString *text, const char *title, dt_dev_pixelpipe_t *pipe)
+{
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  const dt_dev_pixelpipe_perf_t perf = pipe->perf_last;
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+
+  const int lookups = perf.cache_hits + perf.cache_misses;
+  g_string_append_printf(text, _("%s: %.1f ms, %d modules on GPU, %d tiled\n"), title, perf.runtime * 1000.,
+                         perf.gpu, perf.tiled);
+  g_string_append_printf(text, _("  cache hits: %d / %d (%.0f%%)\n"), perf.cache_hits, lookups,
+                         lookups ? 100. * perf.cache_hits / lookups : 0.);
+  for(int k = 0; k < perf.n_modules; k++)
+  {
+    const dt_dev_pixelpipe_perf_module_t *m = &perf.modules[k];
+    g_string_append_printf(text, "  %7.1f ms  %s  %s%s\n", m->time * 1000., m->gpu ? "GPU" : "CPU", m->name,
+                           m->tiling ? _(" (tiled)") : "");
+  }
+}
+
+// timings of the last pipe runs over the top-left corner of the center view, see _print_perf_debug()
+static void _perf_overlay_draw(dt_develop_t *dev, cairo_t *cr)
+{
+  GString *text = g_string_new(NULL);
+  _perf_overlay_print(text, _("full pipeline"), dev->pipe);
+  _perf_overlay_print(text, _("preview pipeline"), dev->preview_pipe);
+  // drop the last line break
+  g_string_truncate(text, text->len - 1);
+
+  PangoFontDescription *desc = pango_font_description_from_string("monospace");
+  pango_font_description_set_absolute_size(desc, DT_PIXEL_APPLY_DPI(11) * PANGO_SCALE);
+  PangoLayout *layout = pango_cairo_create_layout(cr);
+  pango_layout_set_font_description(layout, desc);
+  pango_layout_set_text(layout, text->str, -1);
+  PangoRectangle ink;
+  pango_layout_get_pixel_extents(layout, NULL, &ink);
+
+  const double margin = DT_PIXEL_APPLY_DPI(8);
+  cairo_save(cr);
+  cairo_rectangle(cr, margin, margin, ink.width + 2. * margin, ink.height + 2. * margin);
+  dt_gui_gtk_set_source_rgba(cr, DT_GUI_COLOR_LOG_BG, 0.8);
+  cairo_fill(cr);
+  cairo_move_to(cr, 2. * margin, 2. * margin);
+  dt_gui_gtk_set_source_rgb(cr, DT_GUI_COLOR_LOG_FG);
+  pango_cairo_show_layout(cr, layout);
+  cairo_restore(cr);
+
+  pango_font_description_free(desc);
+  g_object_unref(layout);
+  g_string_free(text, TRUE);
+}
+
 void expose(
     dt_view_t *self,
     cairo_t *cri,
@@ -355,55 +397,85 @@ void expose(
   if(dev->iso_12646.enabled)
     _colormanage_ui_color(50., 0., 0., bg_color);
   else
-    _colormanage_ui_color((float)dt_conf_get_int("display/brightness"), 0., 0., bg_color);
+  {
+    static dt_conf_key_t *brightness = NULL;
+    _colormanage_ui_color((float)dt_conf_key_get_int(dt_conf_key_once(&brightness, "display/brightness")), 0., 0.,
+                          bg_color);
+  }
 
   // Paint background color
   cairo_set_source_rgb(cr, bg_color[0], bg_color[1], bg_color[2]);
   cairo_paint(cr);
 
-  if(dev->pipe->output_backbuf && // do we have an image?
+  if(!dev->mask_preview && // masks being drawn are seen on the preview
+    dev->pipe->output_backbuf && // do we have an image?
     dev->pipe->output_imgid == dev->image_storage.id && // is the right image?
-    dev->pipe->backbuf_scale == backbuf_scale && // is this the zoom scale we want to display?
+    // is this the zoom scale we want to display? Drafts are rendered smaller and stretched
+    (dev->pipe->backbuf_draft ? dev->pipe->backbuf_scale == backbuf_scale * DT_DEV_DRAFT_SCALE
+                              : dev->pipe->backbuf_scale == backbuf_scale) &&
     dev->pipe->backbuf_zoom_x == zoom_x && dev->pipe->backbuf_zoom_y == zoom_y)
   {
     // draw image
     mutex = &dev->pipe->backbuf_mutex;
     dt_pthread_mutex_lock(mutex);
+    const gboolean draft = dev->pipe->backbuf_draft;
+    const double stretch = draft ? 1. / DT_DEV_DRAFT_SCALE : 1.;
     float wd = dev->pipe->output_backbuf_width;
     float ht = dev->pipe->output_backbuf_height;
     stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, wd);
     surface = dt_cairo_image_surface_create_for_data(dev->pipe->output_backbuf, CAIRO_FORMAT_RGB24, wd, ht, stride);
     wd /= darktable.gui->ppd;
     ht /= darktable.gui->ppd;
+    // size of the picture on screen
+    const float screen_wd = wd * stretch;
+    const float screen_ht = ht * stretch;
 
-    cairo_translate(cr, ceilf(.5f * (width - wd)), ceilf(.5f * (height - ht)));
+    cairo_translate(cr, ceilf(.5f * (width - screen_wd)), ceilf(.5f * (height - screen_ht)));
     if(closeup)
     {
       const double scale = 1<<closeup;
       cairo_scale(cr, scale, scale);
-      cairo_translate(cr, -(.5 - 0.5/scale) * wd, -(.5 - 0.5/scale) * ht);
+      cairo_translate(cr, -(.5 - 0.5/scale) * screen_wd, -(.5 - 0.5/scale) * screen_ht);
     }
 
     if(dev->iso_12646.enabled)
     {
       // draw the white frame around picture
-      cairo_rectangle(cr, -tb / 2, -tb / 2., wd + tb, ht + tb);
+      cairo_rectangle(cr, -tb / 2, -tb / 2., screen_wd + tb, screen_ht + tb);
       cairo_set_source_rgb(cr, 1., 1., 1.);
       cairo_fill(cr);
     }
 
+    cairo_save(cr);
+    cairo_scale(cr, stretch, stretch);
     cairo_rectangle(cr, 0, 0, wd, ht);
     cairo_set_source_surface(cr, surface, 0, 0);
-    cairo_pattern_set_filter(cairo_get_source(cr), _get_filtering_level(dev, zoom, closeup));
+    cairo_pattern_set_filter(cairo_get_source(cr), draft ? CAIRO_FILTER_BILINEAR
+                                                         : _get_filtering_level(dev, zoom, closeup));
     cairo_paint(cr);
+    cairo_restore(cr);
 
-    if(darktable.gui->show_focus_peaking)
+    // no focus peaking on drafts, it would pick the blur of the upscaling
+    if(darktable.gui->show_focus_peaking && !draft)
     {
+      // the overlay only depends on the pipe output: keep it across redraws
+      // (guides, masks, toggling the overlay) until the pipe outputs something else
+      static uint8_t *focus_peaking = NULL;
+      static uint64_t focus_peaking_hash = 0;
+      const int buf_wd = cairo_image_surface_get_width(surface);
+      const int buf_ht = cairo_image_surface_get_height(surface);
+      const uint64_t hash = dt_hash(dev->pipe->output_backbuf_hash, (const char *)&dev->image_storage.id,
+                                    sizeof(dev->image_storage.id));
+      if(focus_peaking == NULL || focus_peaking_hash != hash)
+      {
+        dt_free_align(focus_peaking);
+        focus_peaking = dt_focuspeaking_compute(cairo_image_surface_get_data(surface), buf_wd, buf_ht);
+        focus_peaking_hash = hash;
+      }
+
       cairo_save(cr);
       cairo_scale(cr, 1./ darktable.gui->ppd, 1. / darktable.gui->ppd);
-      dt_focuspeaking(cr, wd, ht, cairo_image_surface_get_data(surface),
-                                  cairo_image_surface_get_width(surface),
-                                  cairo_image_surface_get_height(surface));
+      dt_focuspeaking_paint(cr, focus_peaking, buf_wd, buf_ht);
       cairo_restore(cr);
     }
 
@@ -519,23 +591,6 @@ void expose(
     cairo_paint(cri);
   }
 
-  /* check if we should create a snapshot of view */
-  if(darktable.develop->proxy.snapshot.request)
-  {
-    /* reset the request */
-    darktable.develop->proxy.snapshot.request = FALSE;
-
-    /* validation of snapshot filename */
-    g_assert(darktable.develop->proxy.snapshot.filename != NULL);
-
-    /* Store current image surface to snapshot file.
-       FIXME: add checks so that we don't make snapshots of preview pipe image surface.
-    */
-    const int fd = g_open(darktable.develop->proxy.snapshot.filename, O_CREAT | O_WRONLY | O_BINARY, 0600);
-    cairo_surface_write_to_png_stream(image_surface, _write_snapshot_data, GINT_TO_POINTER(fd));
-    close(fd);
-  }
-
   // Displaying sample areas if enabled
   if(darktable.lib->proxy.colorpicker.live_samples
      && (darktable.lib->proxy.colorpicker.display_samples
@@ -547,6 +602,10 @@ void expose(
       darktable.lib->proxy.colorpicker.live_samples, FALSE);
   }
 
+  static dt_conf_key_t *performance_overlay = NULL;
+  if(dt_conf_key_get_bool(dt_conf_key_once(&performance_overlay, "darkroom/ui/performance_overlay")))
+    _perf_overlay_draw(dev, cri);
+
   // draw guide lines if needed
   if(!dev->gui_module || !(dev->gui_module->flags() & IOP_FLAGS_GUIDES_SPECIAL_DRAW))
   {
@@ -730,6 +789,13 @@ static void zoom_out_callback(dt_action_t *action)
 
 static void _darkroom_ui_pipe_finish_signal_callback(gpointer instance, gpointer data)
 {
+  dt_view_t *self = (dt_view_t *)data;
+  dt_develop_t *dev = (dt_develop_t *)self->data;
+
+  // the masks edited are committed, unless a new edit started meanwhile
+  if(dev->mask_preview && !dev->drawing_timeout && !darktable.control->button_down)
+    dev->mask_preview = FALSE;
+
   dt_control_queue_redraw_center();
 }
 
@@ -1248,6 +1314,14 @@ gboolean _switch_to_next_picture(GtkAccelGroup *accel_group, GObject *accelerabl
   return TRUE;
 }
 
+static gboolean _toggle_performance_overlay(GtkAccelGroup *accel_group, GObject *accelerable, guint keyval,
+                                           GdkModifierType modifier, gpointer data)
+{
+  dt_conf_set_bool("darkroom/ui/performance_overlay", !dt_conf_get_bool("darkroom/ui/performance_overlay"));
+  dt_control_queue_redraw_center();
+  return TRUE;
+}
+
 gboolean _switch_to_prev_picture(GtkAccelGroup *accel_group, GObject *accelerable, guint keyval,
                                  GdkModifierType modifier, gpointer data)
 {
@@ -1278,6 +1352,8 @@ void gui_init(dt_view_t *self)
                                 N_("switch to the next picture"), GDK_KEY_Right, GDK_MOD1_MASK);
   dt_accels_new_darkroom_action(_switch_to_prev_picture, self, N_("Darkroom/Actions"),
                                 N_("switch to the previous picture"), GDK_KEY_Left, GDK_MOD1_MASK);
+  dt_accels_new_darkroom_action(_toggle_performance_overlay, self, N_("Darkroom/Actions"),
+                                N_("show pipeline performance"), 0, 0);
   /*
    * Add view specific tool buttons
    */
@@ -1924,6 +2000,22 @@ gboolean _scroll_on_focus(GdkEventScroll event, void *data)
 }
 
 
+// load the images around the current one in the collection in the background,
+// the user is likely to move to them next. The next one first.
+static void _prefetch_neighbours(const int32_t imgid)
+{
+  int32_t neighbours[2] = { -1, -1 };
+  GList *current_collection = dt_collection_get_all(darktable.collection, -1);
+  GList *current_item = g_list_find(current_collection, GINT_TO_POINTER(imgid));
+  if(current_item)
+  {
+    if(current_item->next) neighbours[0] = GPOINTER_TO_INT(current_item->next->data);
+    if(current_item->prev) neighbours[1] = GPOINTER_TO_INT(current_item->prev->data);
+  }
+  g_list_free(current_collection);
+  dt_image_prefetch_request(neighbours, 2);
+}
+
 void enter(dt_view_t *self)
 {
   // Reset focus to center view
@@ -1944,6 +2036,18 @@ void enter(dt_view_t *self)
 
   dev->exit = 0;
 
+  // first darkroom of the session: prime the OpenCL device of the main pipe while its input is decoded
+  static gboolean warmed_up = FALSE;
+  if(!warmed_up)
+  {
+    GtkWidget *center = dt_ui_center(darktable.gui->ui);
+    const int width = MAX(gtk_widget_get_allocated_width(center), 32) * darktable.gui->ppd;
+    const int height = MAX(gtk_widget_get_allocated_height(center), 32) * darktable.gui->ppd;
+    dt_job_t *job = dt_dev_warmup_job_create(dev->image_storage.id, width, height);
+    if(job) dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+    warmed_up = TRUE;
+  }
+
   // Make sure we don't start computing pipes until we have a proper history
   dt_pthread_mutex_lock(&dev->history_mutex);
 
@@ -1973,18 +2077,22 @@ void enter(dt_view_t *self)
     /* initialize gui if iop have one defined */
     if(!dt_iop_is_hidden(module))
     {
-      dt_iop_gui_init(module);
-
-      /* add module to right panel */
-      dt_iop_gui_set_expander(module);
-
       if(module->multi_priority == 0)
       {
         snprintf(option, sizeof(option), "plugins/darkroom/%s/expanded", module->op);
         module->expanded = dt_conf_get_bool(option);
-        dt_iop_gui_update_expanded(module);
       }
 
+      // Building the widgets of ~90 modules is slow: only do it for the ones shown expanded.
+      // The others get a header only, until they are expanded, focused or switched on
+      // (dt_dev_pop_history_items() below takes care of those enabled in history).
+      if(module->expanded) dt_iop_gui_init(module);
+
+      /* add module to right panel */
+      dt_iop_gui_set_expander(module);
+
+      if(module->multi_priority == 0) dt_iop_gui_update_expanded(module);
+
       dt_iop_reload_defaults(module);
     }
   }
@@ -2059,6 +2167,8 @@ void enter(dt_view_t *self)
   dt_view_active_images_add(dev->image_storage.id, TRUE);
   dt_selection_clear(darktable.selection);
 
+  _prefetch_neighbours(dev->image_storage.id);
+
   dt_thumbtable_set_parent(dt_ui_thumbtable(darktable.gui->ui), DT_THUMBTABLE_MODE_FILMSTRIP);
 
   /* connect signal for filmstrip image activate */
@@ -2086,6 +2196,10 @@ void leave(dt_view_t *self)
   dev->exit = 1;
   dt_atomic_set_int(&dev->pipe->shutdown, TRUE);
   dt_atomic_set_int(&dev->preview_pipe->shutdown, TRUE);
+  dev->mask_preview = FALSE;
+
+  // the neighbours of the image we leave are not wanted anymore
+  dt_image_prefetch_cancel();
 
   dt_iop_color_picker_cleanup();
   if(darktable.lib->proxy.colorpicker.picker_proxy)
@@ -2287,6 +2401,12 @@ static int _delayed_history_commit(gpointer data)
 
   if(dev->forms_changed)
     dt_dev_add_history_item(dev, dev->gui_module, FALSE);
+  else if(dev->mask_preview)
+  {
+    // nothing for the main pipe to catch up with
+    dev->mask_preview = FALSE;
+    dt_control_queue_redraw_center();
+  }
 
   return G_SOURCE_REMOVE;
 }
@@ -2367,7 +2487,12 @@ void mouse_moved(dt_view_t *self, double x, double y, double pressure, int which
   if(dev->form_visible && dt_masks_events_mouse_moved(dev->gui_module, x, y, pressure, which))
   {
     dt_control_queue_redraw_center();
-    _do_delayed_history_commit(dev);
+    // While dragging, only the preview pipe follows the shapes, history is committed on release.
+    // Strokes being drawn are not shapes yet.
+    if(ctl->button_down && !(dev->form_gui && dev->form_gui->creation))
+      dt_dev_masks_preview(dev);
+    else if(!ctl->button_down)
+      _do_delayed_history_commit(dev);
     return;
   }
 
@@ -84,6 +84,7 @@ typedef struct dt_map_t
   int timeout_event_source;
   int thumbnail;
   dt_map_image_t *last_hovered_entry;
+  GHashTable *markers; // rendered marker pixbufs, see _draw_image()
   struct
   {
     dt_location_draw_t main;
@@ -115,6 +116,22 @@ typedef enum dt_map_thumb_t
   DT_MAP_THUMB_NONE
 } dt_map_thumb_t;
 
+// panning and zooming redraw the same markers over and over: keep the scaled and framed thumbnails around
+typedef struct dt_map_marker_t
+{
+  GdkPixbuf *pixbuf;
+  int width, height;
+} dt_map_marker_t;
+
+#define MAX_CACHED_MARKERS 1024
+
+static void _marker_free(gpointer data)
+{
+  dt_map_marker_t *marker = (dt_map_marker_t *)data;
+  g_object_unref(marker->pixbuf);
+  g_free(marker);
+}
+
 /* proxy function to center map view on location at a zoom level */
 static void _view_map_center_on_location(const dt_view_t *view, gdouble lon, gdouble lat, gdouble zoom);
 /* proxy function to center map view on a bounding box */
@@ -708,6 +725,8 @@ void init(dt_view_t *self)
                      self);
   }
 
+  lib->markers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, _marker_free);
+
   /* build the query string */
   lib->main_query = NULL;
   _view_map_build_main_query(lib);
@@ -769,6 +788,7 @@ void cleanup(dt_view_t *self)
       g_slist_free_full(lib->images, g_free);
       lib->images = NULL;
     }
+    g_hash_table_destroy(lib->markers);
     if(lib->loc.main.id)
     {
       _view_map_remove_location(lib, &lib->loc.main);
@@ -1125,6 +1145,19 @@ static GdkPixbuf *_draw_image(const int32_t imgid, int *width, int *height,
   const float _thumb_border = DT_PIXEL_APPLY_DPI(thumb_border);
   const float _pin_size = DT_PIXEL_APPLY_DPI(image_pin_size);
 
+  gchar *key = g_strdup_printf("%d:%d:%d:%u:%d", imgid, group_count, group_same_loc, frame, thumbnail);
+  dt_map_marker_t *marker = (dt_map_marker_t *)g_hash_table_lookup(lib->markers, key);
+  if(marker)
+  {
+    g_free(key);
+    if(width) *width = marker->width;
+    if(height) *height = marker->height;
+    return g_object_ref(marker->pixbuf);
+  }
+  // don't keep the markers drawn from a smaller thumbnail while the right one is not ready
+  gboolean complete = FALSE;
+  int out_width = 0, out_height = 0;
+
   if(thumbnail == DT_MAP_THUMB_THUMB)
   {
     dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, _thumb_size, _thumb_size);
@@ -1134,6 +1167,7 @@ static GdkPixbuf *_draw_image(const int32_t imgid, int *width, int *height,
 
     if(buf.buf && buf.width > 0)
     {
+      complete = (buf.size == mip);
       for(int i = 3; i < (size_t)4 * buf.width * buf.height; i += 4) buf.buf[i] = UINT8_MAX;
 
       int w = _thumb_size, h = _thumb_size;
@@ -1170,8 +1204,8 @@ static GdkPixbuf *_draw_image(const int32_t imgid, int *width, int *height,
                             _thumb_border, h - count_height + _thumb_border);
 
       }
-      if(width) *width = w;
-      if(height) *height = h;
+      out_width = w;
+      out_height = h;
     }
   }
   else if(thumbnail == DT_MAP_THUMB_COUNT)
@@ -1189,10 +1223,27 @@ static GdkPixbuf *_draw_image(const int32_t imgid, int *width, int *height,
                        _thumb_border, _thumb_border);
     gdk_pixbuf_copy_area(lib->image_pin, 0, 0, w, _pin_size, thumb,
                        0, count_height + 2 * _thumb_border);
-    if(width) *width = count_width;
-    if(height) *height = count_height;
+    out_width = count_width;
+    out_height = count_height;
+    complete = TRUE;
+  }
+  if(thumb)
+  {
+    if(width) *width = out_width;
+    if(height) *height = out_height;
+    if(complete)
+    {
+      if(g_hash_table_size(lib->markers) >= MAX_CACHED_MARKERS) g_hash_table_remove_all(lib->markers);
+      marker = g_new(dt_map_marker_t, 1);
+      marker->pixbuf = g_object_ref(thumb);
+      marker->width = out_width;
+      marker->height = out_height;
+      g_hash_table_insert(lib->markers, key, marker);
+      key = NULL;
+    }
   }
 map_changed_failure:
+  g_free(key);
   if(source) g_object_unref(source);
   if(count) g_object_unref(count);
   return thumb;
@@ -1317,34 +1368,31 @@ static void _view_map_changed_callback_delayed(gpointer user_data)
     DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->main_query, 3, lib->bbox.lat1);
     DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->main_query, 4, lib->bbox.lat2);
 
-    // count the images
+    /* make the image list in a single pass, growing the array as needed */
+    if(lib->points)
+      g_free(lib->points);
+    lib->points = NULL;
     int img_count = 0;
+    int allocated = 0;
+    dt_geo_position_t *p = NULL;
     while(sqlite3_step(lib->main_query) == SQLITE_ROW)
     {
+      if(img_count == allocated)
+      {
+        allocated = MAX(256, 2 * allocated);
+        p = g_renew(dt_geo_position_t, p, allocated);
+      }
+      p[img_count].imgid = sqlite3_column_int(lib->main_query, 0);
+      p[img_count].x = sqlite3_column_double(lib->main_query, 1) * M_PI / 180;
+      p[img_count].y = sqlite3_column_double(lib->main_query, 2) * M_PI / 180;
+      p[img_count].cluster_id = UNCLASSIFIED;
       img_count++;
     }
-
-    if(lib->points)
-      g_free(lib->points);
-    lib->points = NULL;
+    lib->points = p;
     lib->nb_points = img_count;
-    if(img_count > 0)
-      lib->points = (dt_geo_position_t *)calloc(img_count, sizeof(dt_geo_position_t));
-    dt_geo_position_t *p = lib->points;
+
     if(p)
     {
-      DT_DEBUG_SQLITE3_RESET(lib->main_query);
-      /* make the image list */
-      int i = 0;
-      while(sqlite3_step(lib->main_query) == SQLITE_ROW && all_good && i < img_count)
-      {
-        p[i].imgid = sqlite3_column_int(lib->main_query, 0);
-        p[i].x = sqlite3_column_double(lib->main_query, 1) * M_PI / 180;
-        p[i].y = sqlite3_column_double(lib->main_query, 2) * M_PI / 180;
-        p[i].cluster_id = UNCLASSIFIED;
-        i++;
-      }
-
       const float epsilon_factor = dt_conf_get_int("plugins/map/epsilon_factor");
       const int min_images = dt_conf_get_int("plugins/map/min_images_per_group");
       // zoom varies from 0 (156412 m/pixel) to 20 (0.149 m/pixel)
@@ -1360,61 +1408,66 @@ static void _view_map_changed_callback_delayed(gpointer user_data)
       _dbscan(p, img_count, epsilon, min_images);
       dt_show_times(&start, "[map] dbscan calculation");
 
-      // set the clusters
+      // set the clusters in one pass over the points: the clusters are numbered from 0 by _dbscan()
       GList *sel_imgs = dt_act_on_get_images();
-      int group = -1;
-      for(i = 0; i< img_count; i++)
+      GHashTable *selected = g_hash_table_new(NULL, NULL);
+      for(GList *s = sel_imgs; s; s = g_list_next(s))
+        g_hash_table_add(selected, s->data);
+      g_list_free(sel_imgs);
+
+      int nb_clusters = 0;
+      for(int i = 0; i < img_count; i++)
+        nb_clusters = MAX(nb_clusters, p[i].cluster_id + 1);
+      dt_map_image_t **clusters = nb_clusters ? g_new0(dt_map_image_t *, nb_clusters) : NULL;
+      int *first = nb_clusters ? g_new(int, nb_clusters) : NULL;
+
+      for(int i = 0; i < img_count; i++)
       {
-        if(p[i].cluster_id == NOISE)
+        const gboolean is_selected = g_hash_table_contains(selected, GINT_TO_POINTER(p[i].imgid));
+        if(p[i].cluster_id < 0)
         {
           dt_map_image_t *entry = (dt_map_image_t *)calloc(1, sizeof(dt_map_image_t));
           entry->imgid = p[i].imgid;
-          entry->group = p[i].cluster_id;
+          entry->group = NOISE;
           entry->group_count = 1;
           entry->longitude = p[i].x * 180 / M_PI;
           entry->latitude = p[i].y * 180 / M_PI;
           entry->group_same_loc = TRUE;
-          if(sel_imgs)
-            entry->selected_in_group = g_list_find((GList *)sel_imgs,
-                                                   GINT_TO_POINTER(entry->imgid))
-                                       ? TRUE : FALSE;
+          entry->selected_in_group = is_selected;
           lib->images = g_slist_prepend(lib->images, entry);
+          continue;
         }
-        else if(p[i].cluster_id > group)
+
+        const int group = p[i].cluster_id;
+        dt_map_image_t *entry = clusters[group];
+        if(!entry)
         {
-          group = p[i].cluster_id;
-          dt_map_image_t *entry = (dt_map_image_t *)calloc(1, sizeof(dt_map_image_t));
+          // the first image of the group in the query order represents it
+          entry = clusters[group] = (dt_map_image_t *)calloc(1, sizeof(dt_map_image_t));
           entry->imgid = p[i].imgid;
-          entry->group = p[i].cluster_id;
+          entry->group = group;
           entry->group_same_loc = TRUE;
-          entry->selected_in_group = (sel_imgs && g_list_find((GList *)sel_imgs,
-                                                               GINT_TO_POINTER(p[i].imgid)))
-                                     ? TRUE : FALSE;
-          const double lon = p[i].x, lat = p[i].y;
-          for(int j = 0; j < img_count; j++)
-          {
-            if(p[j].cluster_id == group)
-            {
-              entry->group_count++;
-              entry->longitude += p[j].x;
-              entry->latitude += p[j].y;
-              if(entry->group_same_loc && (p[j].x != lon || p[j].y != lat))
-              {
-                entry->group_same_loc = FALSE;
-              }
-              if(sel_imgs && !entry->selected_in_group)
-              {
-                if(g_list_find((GList *)sel_imgs, GINT_TO_POINTER(p[j].imgid)))
-                  entry->selected_in_group = TRUE;
-              }
-            }
-          }
-          entry->latitude = entry->latitude  * 180 / M_PI / entry->group_count;
-          entry->longitude = entry->longitude * 180 / M_PI / entry->group_count;
+          first[group] = i;
           lib->images = g_slist_prepend(lib->images, entry);
         }
+        entry->group_count++;
+        entry->longitude += p[i].x;
+        entry->latitude += p[i].y;
+        if(entry->group_same_loc && (p[i].x != p[first[group]].x || p[i].y != p[first[group]].y))
+          entry->group_same_loc = FALSE;
+        entry->selected_in_group |= is_selected;
       }
-      g_list_free(sel_imgs);
+
+      for(int group = 0; group < nb_clusters; group++)
+      {
+        dt_map_image_t *entry = clusters[group];
+        if(!entry) continue;
+        entry->latitude = entry->latitude  * 180 / M_PI / entry->group_count;
+        entry->longitude = entry->longitude * 180 / M_PI / entry->group_count;
+      }
+      g_free(clusters);
+      g_free(first);
+      g_hash_table_destroy(selected);
     }
 
     needs_redraw = _view_map_draw_images(self);
@@ -2050,6 +2103,9 @@ void leave(dt_view_t *self)
   dt_map_t *lib = (dt_map_t *)self->data;
   lib->drop_filmstrip_activated = FALSE;
 
+  // the thumbnails may be edited in other views
+  g_hash_table_remove_all(lib->markers);
+
   if(lib->selected_images)
   {
     g_list_free(lib->selected_images);
@@ -2476,6 +2532,7 @@ static void _view_map_collection_changed(gpointer instance, dt_collection_change
 {
   dt_view_t *self = (dt_view_t *)user_data;
   dt_map_t *lib = (dt_map_t *)self->data;
+  g_hash_table_remove_all(lib->markers);
   // avoid to centre the map on collection while a location is active
   if(darktable.view_manager->proxy.map.view && !lib->loc.main.id)
   {
@@ -2761,6 +2818,16 @@ typedef struct epsilon_neighbours_t
   unsigned int index[];
 } epsilon_neighbours_t;
 
+/* The points are binned on a grid of epsilon-wide cells, so the neighbours of a point are found in the 3x3
+   cells around it instead of scanning the band of points at the same longitude. Each cell keeps the points
+   not yet in a cluster first: the points that joined one are swapped out, as the neighbour search skips them
+   anyway. Clustering then costs about the number of points, however dense they are. */
+typedef struct dt_dbscan_cell_t
+{
+  unsigned int start; // first point of the cell in dt_dbscan_t::order
+  unsigned int alive; // number of points of the cell not in a cluster yet
+} dt_dbscan_cell_t;
+
 typedef struct dt_dbscan_t
 {
   dt_geo_position_t *points;
@@ -2769,46 +2836,129 @@ typedef struct dt_dbscan_t
   unsigned int minpts;
   epsilon_neighbours_t *seeds;
   epsilon_neighbours_t *spreads;
-  unsigned int index;
   unsigned int cluster_id;
+  GHashTable *grid;         // cell coordinates -> index in cells + 1
+  dt_dbscan_cell_t *cells;
+  unsigned int *order;      // point indices, grouped by cell
+  unsigned int *position;   // position of each point in order
+  unsigned int *cell;       // cell of each point
 } dt_dbscan_t;
 
 static dt_dbscan_t db;
 
-static void _get_epsilon_neighbours(epsilon_neighbours_t *en, unsigned int index)
+static inline gint64 _cell_key(const gint64 cx, const gint64 cy)
+{
+  return (gint64)(((guint64)cx << 32) ^ (guint32)cy);
+}
+
+static inline void _point_cell(const unsigned int index, gint64 *cx, gint64 *cy)
+{
+  *cx = (gint64)floor(db.points[index].x / db.epsilon);
+  *cy = (gint64)floor(db.points[index].y / db.epsilon);
+}
+
+static gboolean _dbscan_grid_init(void)
 {
-  // points are ordered by longitude
-  // limit the exploration to epsilon east and west
-  // west
-  for(int i = index; i < db.num_points; ++i)
+  const unsigned int n = db.num_points;
+  db.order = malloc(sizeof(unsigned int) * n);
+  db.position = malloc(sizeof(unsigned int) * n);
+  db.cell = malloc(sizeof(unsigned int) * n);
+  db.cells = malloc(sizeof(dt_dbscan_cell_t) * n);
+  db.grid = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+  if(!db.order || !db.position || !db.cell || !db.cells) return FALSE;
+
+  // count the points per cell
+  unsigned int num_cells = 0;
+  for(unsigned int i = 0; i < n; i++)
   {
-    if(i == index || db.points[i].cluster_id >= 0)
-      continue;
-    if((db.points[i].x - db.points[index].x) > db.epsilon)
-      break;
-    if(fabs(db.points[i].y - db.points[index].y) > db.epsilon)
-      continue;
-    else
+    gint64 cx, cy;
+    _point_cell(i, &cx, &cy);
+    const gint64 key = _cell_key(cx, cy);
+    unsigned int c = GPOINTER_TO_UINT(g_hash_table_lookup(db.grid, &key));
+    if(!c)
     {
-      en->index[en->num_members] = i;
-      en->num_members++;
+      gint64 *k = g_new(gint64, 1);
+      *k = key;
+      c = ++num_cells;
+      g_hash_table_insert(db.grid, k, GUINT_TO_POINTER(c));
+      db.cells[c - 1].alive = 0;
     }
+    db.cell[i] = c - 1;
+    db.cells[c - 1].alive++;
   }
-  // east
-  for(int i = index; i >= 0; --i)
+
+  // group the point indices by cell, keeping the order of the points within cells
+  unsigned int start = 0;
+  for(unsigned int c = 0; c < num_cells; c++)
   {
-    if(i == (int)index || db.points[i].cluster_id >= 0)
-      continue;
-    if((db.points[index].x - db.points[i].x) > db.epsilon)
-      break;
-    if(fabs(db.points[index].y - db.points[i].y) > db.epsilon)
-      continue;
-    else
+    db.cells[c].start = start;
+    start += db.cells[c].alive;
+    db.cells[c].alive = 0;
+  }
+  for(unsigned int i = 0; i < n; i++)
+  {
+    dt_dbscan_cell_t *cell = &db.cells[db.cell[i]];
+    db.position[i] = cell->start + cell->alive;
+    db.order[db.position[i]] = i;
+    cell->alive++;
+  }
+  return TRUE;
+}
+
+static void _dbscan_grid_cleanup(void)
+{
+  free(db.order);
+  free(db.position);
+  free(db.cell);
+  free(db.cells);
+  if(db.grid) g_hash_table_destroy(db.grid);
+  db.order = db.position = db.cell = NULL;
+  db.cells = NULL;
+  db.grid = NULL;
+}
+
+// the point joins the current cluster: take it out of the neighbour searches
+static void _dbscan_assign(const unsigned int index)
+{
+  dt_geo_position_t *d = &db.points[index];
+  const gboolean alive = d->cluster_id < 0;
+  d->cluster_id = db.cluster_id;
+  if(!alive) return;
+
+  dt_dbscan_cell_t *cell = &db.cells[db.cell[index]];
+  const unsigned int last = cell->start + cell->alive - 1;
+  const unsigned int pos = db.position[index];
+  const unsigned int other = db.order[last];
+  db.order[pos] = other;
+  db.position[other] = pos;
+  db.order[last] = index;
+  db.position[index] = last;
+  cell->alive--;
+}
+
+static void _get_epsilon_neighbours(epsilon_neighbours_t *en, unsigned int index)
+{
+  const dt_geo_position_t *const p = &db.points[index];
+  gint64 cx, cy;
+  _point_cell(index, &cx, &cy);
+
+  for(gint64 x = cx - 1; x <= cx + 1; x++)
+    for(gint64 y = cy - 1; y <= cy + 1; y++)
     {
-      en->index[en->num_members] = i;
-      en->num_members++;
+      const gint64 key = _cell_key(x, y);
+      const unsigned int c = GPOINTER_TO_UINT(g_hash_table_lookup(db.grid, &key));
+      if(!c) continue;
+
+      const dt_dbscan_cell_t *const cell = &db.cells[c - 1];
+      for(unsigned int k = cell->start; k < cell->start + cell->alive; k++)
+      {
+        const unsigned int i = db.order[k];
+        if(i == index) continue;
+        if(fabs(db.points[i].x - p->x) > db.epsilon || fabs(db.points[i].y - p->y) > db.epsilon) continue;
+        en->index[en->num_members] = i;
+        en->num_members++;
+      }
     }
-  }
 }
 
 static void _dbscan_spread(unsigned int index)
@@ -2816,15 +2966,12 @@ static void _dbscan_spread(unsigned int index)
   db.spreads->num_members = 0;
   _get_epsilon_neighbours(db.spreads, index);
 
+  // only the points not in a cluster yet are found
   for(unsigned int i = 0; i < db.spreads->num_members; i++)
   {
-    dt_geo_position_t *d = &db.points[db.spreads->index[i]];
-    if(d->cluster_id == NOISE || d->cluster_id == UNCLASSIFIED)
-    {
-      db.seeds->index[db.seeds->num_members] = db.spreads->index[i];
-      db.seeds->num_members++;
-      d->cluster_id = db.cluster_id;
-    }
+    db.seeds->index[db.seeds->num_members] = db.spreads->index[i];
+    db.seeds->num_members++;
+    _dbscan_assign(db.spreads->index[i]);
   }
 }
 
@@ -2838,10 +2985,10 @@ static int _dbscan_expand(unsigned int index)
     db.points[index].cluster_id = NOISE;
   else
   {
-    db.points[index].cluster_id = db.cluster_id;
+    _dbscan_assign(index);
     for(int i = 0; i < db.seeds->num_members; i++)
     {
-      db.points[db.seeds->index[i]].cluster_id = db.cluster_id;
+      _dbscan_assign(db.seeds->index[i]);
     }
 
     for(int i = 0; i < db.seeds->num_members; i++)
@@ -2867,7 +3014,7 @@ static void _dbscan(dt_geo_position_t *points, unsigned int num_points,
   db.spreads = (epsilon_neighbours_t *)malloc(sizeof(db.spreads->num_members)
       + num_points * sizeof(db.spreads->index[0]));
 
-  if(db.seeds && db.spreads)
+  if(db.seeds && db.spreads && epsilon > 0.0 && _dbscan_grid_init())
   {
     for(unsigned int i = 0; i < db.num_points; ++i)
     {
@@ -2879,9 +3026,10 @@ static void _dbscan(dt_geo_position_t *points, unsigned int num_points,
         }
       }
     }
-  g_free(db.seeds);
-  g_free(db.spreads);
   }
+  _dbscan_grid_cleanup();
+  free(db.seeds);
+  free(db.spreads);
 }
 
 // clang-format off
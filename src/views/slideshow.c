@@ -23,6 +23,7 @@
 #include "common/dtpthread.h"
 #include "common/imageio.h"
 #include "common/imageio_module.h"
+#include "common/mipmap_cache.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "dtgtk/thumbtable.h"
@@ -32,6 +33,7 @@
 #include "views/view_api.h"
 
 #include <gdk/gdkkeysyms.h>
+#include <math.h>
 #include <stdint.h>
 
 DT_MODULE(1)
@@ -42,13 +44,9 @@ typedef enum dt_slideshow_event_t
   S_REQUEST_STEP_BACK,
 } dt_slideshow_event_t;
 
-typedef enum dt_slideshow_slot_t
-{
-  S_LEFT      = 0,
-  S_CURRENT   = 1,
-  S_RIGHT     = 2,
-  S_SLOT_LAST = 3
-} dt_slideshow_slot_t;
+// images prerendered on each side of the current one, see the slideshow/prerender preference
+#define S_MAX_DEPTH 8
+#define S_MAX_SLOTS (2 * S_MAX_DEPTH + 1)
 
 typedef struct _slideshow_buf_t
 {
@@ -57,6 +55,7 @@ typedef struct _slideshow_buf_t
   uint32_t height;
   int32_t rank;
   gboolean invalidated;
+  gboolean rendering; // a job is filling the slot
 } dt_slideshow_buf_t;
 
 typedef struct dt_slideshow_t
@@ -64,15 +63,20 @@ typedef struct dt_slideshow_t
   int32_t col_count;
   uint32_t width, height;
 
-  // buffers
-  dt_slideshow_buf_t buf[S_SLOT_LAST];
+  // ring of buffers centered on the current image, see _slot()
+  dt_slideshow_buf_t buf[S_MAX_SLOTS];
+  int depth;
+  int current;
+  int direction; // of the last step, +1 or -1, the images ahead are rendered first
   gboolean init_phase;
 
   // state machine stuff for image transitions:
   dt_pthread_mutex_t lock;
 
   gboolean auto_advance;
-  int exporting;
+  int jobs;     // render jobs queued or running
+  int max_jobs; // render jobs allowed to run in parallel
+  gboolean leaving;
   int delay;
 
   // some magic to hide the mouse pointer
@@ -121,43 +125,51 @@ static int write_image(dt_imageio_module_data_t *datai, const char *filename, co
   return 0;
 }
 
-static void shift_left(dt_slideshow_t *d)
+static inline int _nb_slots(const dt_slideshow_t *d)
 {
-  uint32_t *tmp_buf = d->buf[S_LEFT].buf;
+  return 2 * d->depth + 1;
+}
 
-  for(int k=S_LEFT; k<S_RIGHT; k++)
-  {
-    d->buf[k].buf         = d->buf[k+1].buf;
-    d->buf[k].rank        = d->buf[k+1].rank;
-    d->buf[k].width       = d->buf[k+1].width;
-    d->buf[k].height      = d->buf[k+1].height;
-    d->buf[k].invalidated = d->buf[k+1].invalidated;
-  }
-  d->buf[S_RIGHT].invalidated = TRUE;
-  d->buf[S_RIGHT].rank = d->buf[S_CURRENT].rank + 1;
-  d->buf[S_RIGHT].buf = tmp_buf;
+// the slot at offset images from the current one, offset in [-depth, depth]
+static inline dt_slideshow_buf_t *_slot(dt_slideshow_t *d, const int offset)
+{
+  const int nb = _nb_slots(d);
+  return &d->buf[(d->current + offset + nb) % nb];
 }
 
-static void shift_right(dt_slideshow_t *d)
+static inline gboolean _needs_render(const dt_slideshow_t *d, const dt_slideshow_buf_t *slot)
 {
-  uint32_t *tmp_buf = d->buf[S_RIGHT].buf;
+  return slot->invalidated && !slot->rendering && slot->rank >= 0 && slot->rank < d->col_count;
+}
 
-  for(int k=S_RIGHT; k>S_LEFT; k--)
-  {
-    d->buf[k].buf         = d->buf[k-1].buf;
-    d->buf[k].rank        = d->buf[k-1].rank;
-    d->buf[k].width       = d->buf[k-1].width;
-    d->buf[k].height      = d->buf[k-1].height;
-    d->buf[k].invalidated = d->buf[k-1].invalidated;
-  }
-  d->buf[S_LEFT].invalidated = TRUE;
-  d->buf[S_LEFT].rank = d->buf[S_CURRENT].rank - 1;
-  d->buf[S_LEFT].buf = tmp_buf;
+// move the ring by one image. The slot leaving on one side is recycled for the new image on the other side.
+// A render still running for it is not stopped but its result is dropped, as the rank of the slot changed.
+static void _shift(dt_slideshow_t *d, const int direction)
+{
+  const int nb = _nb_slots(d);
+  d->current = (d->current + direction + nb) % nb;
+  d->direction = direction;
+  dt_slideshow_buf_t *slot = _slot(d, direction * d->depth);
+  slot->rank = _slot(d, 0)->rank + direction * d->depth;
+  slot->invalidated = TRUE;
 }
 
-static void requeue_job(dt_slideshow_t *d)
+// queue as many render jobs as there are slots to fill, up to max_jobs. Called with the lock held.
+// The jobs pick their slot only when they start, so the ones queued before a change of direction
+// render the images that are needed then.
+static void _schedule_jobs(dt_slideshow_t *d)
 {
-  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, process_job_create(d));
+  int pending = 0;
+  for(int k = 0; k < _nb_slots(d); k++)
+    if(_needs_render(d, &d->buf[k])) pending++;
+
+  while(!d->leaving && d->jobs < d->max_jobs && d->jobs < pending)
+  {
+    dt_job_t *job = process_job_create(d);
+    if(!job) break;
+    d->jobs++;
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, job);
+  }
 }
 
 /*
@@ -167,36 +179,95 @@ static void _set_delay(dt_slideshow_t *d, int value)
   dt_conf_set_int("slideshow_delay", d->delay);
 } */
 
-static int process_image(dt_slideshow_t *d, dt_slideshow_slot_t slot)
+// a cached thumbnail covering the screen is scaled down instead of running the export pipe
+static gboolean _process_mipmap(const int32_t imgid, dt_slideshow_format_t *dat)
 {
-  dt_imageio_module_format_t buf;
-  buf.mime = mime;
-  buf.levels = levels;
-  buf.bpp = bpp;
-  buf.write_image = write_image;
+  dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  const int width = dat->head.width;
+  const int height = dat->head.height;
 
-  // lock to copy the information to process the image
-  dt_pthread_mutex_lock(&d->lock);
-  dt_slideshow_format_t dat;
-  dat.head.width = dat.head.max_width = d->width;
-  dat.head.height = dat.head.max_height = d->height;
-  dat.head.style[0] = '\0';
-  dat.rank = d->buf[slot].rank;
-  dat.buf.buf = dt_alloc_align(sizeof(uint32_t) * d->width * d->height);
+  dt_mipmap_buffer_t buf = { .size = DT_MIPMAP_NONE };
+  for(dt_mipmap_size_t k = dt_mipmap_cache_get_matching_size(cache, width, height); k < DT_MIPMAP_F; k++)
+  {
+    dt_mipmap_cache_get(cache, &buf, imgid, k, DT_MIPMAP_TESTLOCK, 'r');
+    if(!buf.buf) continue;
+    // same fit as the export: no upscaling
+    if(buf.width >= width || buf.height >= height) break;
+    dt_mipmap_cache_release(cache, &buf);
+  }
+  if(!buf.buf) return FALSE;
 
-  d->exporting++;
+  const float scale = fminf(width / (float)buf.width, height / (float)buf.height);
+  const int out_width = MIN(width, (int)roundf(buf.width * scale));
+  const int out_height = MIN(height, (int)roundf(buf.height * scale));
 
-  const int32_t rank = dat.rank;
-  const gchar *query = dt_collection_get_query(darktable.collection);
+  uint8_t *rgbbuf = dt_alloc_align((size_t)buf.width * buf.height * 4);
+  if(!rgbbuf)
+  {
+    dt_mipmap_cache_release(cache, &buf);
+    return FALSE;
+  }
+
+  // same color management as dt_view_image_get_surface()
+  pthread_rwlock_rdlock(&darktable.color_profiles->xprofile_lock);
+  cmsHTRANSFORM transform = NULL;
+  if(buf.color_space == DT_COLORSPACE_SRGB)
+    transform = darktable.color_profiles->transform_srgb_to_display;
+  else if(buf.color_space == DT_COLORSPACE_ADOBERGB)
+    transform = darktable.color_profiles->transform_adobe_rgb_to_display;
 
-  if(rank<0 || rank>=d->col_count || !query)
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) default(none) dt_omp_firstprivate(buf, rgbbuf, transform)
+#endif
+  for(int i = 0; i < buf.height; i++)
   {
-    d->exporting--;
-    dt_pthread_mutex_unlock(&d->lock);
-    goto error;
+    const uint8_t *const restrict in = buf.buf + (size_t)i * buf.width * 4;
+    uint8_t *const restrict out = rgbbuf + (size_t)i * buf.width * 4;
+    if(transform)
+      cmsDoTransform(transform, in, out, buf.width);
+    else
+      for(int j = 0; j < buf.width; j++)
+      {
+        out[4 * j + 0] = in[4 * j + 2];
+        out[4 * j + 1] = in[4 * j + 1];
+        out[4 * j + 2] = in[4 * j + 0];
+      }
   }
+  pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
+
+  cairo_surface_t *source = cairo_image_surface_create_for_data(
+      rgbbuf, CAIRO_FORMAT_RGB24, buf.width, buf.height, cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, buf.width));
+  cairo_surface_t *target = cairo_image_surface_create_for_data(
+      (uint8_t *)dat->buf.buf, CAIRO_FORMAT_RGB24, out_width, out_height,
+      cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, out_width));
+  cairo_t *cr = cairo_create(target);
+  cairo_scale(cr, out_width / (double)buf.width, out_height / (double)buf.height);
+  cairo_set_source_surface(cr, source, 0, 0);
+  cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+  cairo_surface_flush(target);
+  cairo_surface_destroy(target);
+  cairo_surface_destroy(source);
 
-  dt_pthread_mutex_unlock(&d->lock);
+  dt_mipmap_cache_release(cache, &buf);
+  dt_free_align(rgbbuf);
+
+  dat->buf.width = out_width;
+  dat->buf.height = out_height;
+  return TRUE;
+}
+
+static int process_image(dt_slideshow_format_t *dat, const int32_t rank)
+{
+  dt_imageio_module_format_t buf;
+  buf.mime = mime;
+  buf.levels = levels;
+  buf.bpp = bpp;
+  buf.write_image = write_image;
+
+  const gchar *query = dt_collection_get_query(darktable.collection);
+  if(!query) return 1;
 
   // get random image id from sql
   int32_t id = 0;
@@ -208,73 +279,101 @@ static int process_image(dt_slideshow_t *d, dt_slideshow_slot_t slot)
   if(sqlite3_step(stmt) == SQLITE_ROW) id = sqlite3_column_int(stmt, 0);
   sqlite3_finalize(stmt);
 
-  if(id)
-  {
-    // the flags are: ignore exif, display byteorder, high quality, upscale, thumbnail
-    dt_imageio_export_with_flags(id, "unused", &buf, (dt_imageio_module_data_t *)&dat, TRUE, TRUE,
-                                 FALSE, FALSE, FALSE, NULL, FALSE, FALSE, DT_COLORSPACE_DISPLAY,
-                                 NULL, DT_INTENT_LAST, NULL, NULL, 1, 1, NULL);
+  if(!id) return 1;
+  if(_process_mipmap(id, dat)) return 0;
 
-    // lock to copy back into the slot the rendered buffer, not that this is done only if
-    // the slot rank is still the same as the local buffer rank. This can be false if the
-    // buffers have been shifted to advance to next image.
-    dt_pthread_mutex_lock(&d->lock);
-    if(dat.rank == d->buf[slot].rank)
-    {
-      memcpy(d->buf[slot].buf, dat.buf.buf, sizeof(uint32_t) * dat.buf.width * dat.buf.height);
-      d->buf[slot].width = dat.buf.width;
-      d->buf[slot].height = dat.buf.height;
-      d->buf[slot].invalidated = FALSE;
-    }
-    d->exporting--;
-    dt_pthread_mutex_unlock(&d->lock);
-  }
-
-  dt_free_align(dat.buf.buf);
-  return 0;
-
- error:
-  dt_free_align(dat.buf.buf);
-  return 1;
+  // the flags are: ignore exif, display byteorder, high quality, upscale, thumbnail
+  dat->buf.width = dat->buf.height = 0;
+  dt_imageio_export_with_flags(id, "unused", &buf, (dt_imageio_module_data_t *)dat, TRUE, TRUE,
+                               FALSE, FALSE, FALSE, NULL, FALSE, FALSE, DT_COLORSPACE_DISPLAY,
+                               NULL, DT_INTENT_LAST, NULL, NULL, 1, 1, NULL);
+  return dat->buf.width == 0;
 }
 
 static gboolean _is_idle(dt_slideshow_t *d)
 {
-  return !((d->buf[S_LEFT].invalidated && d->buf[S_LEFT].rank <= d->col_count)
-           || (d->buf[S_CURRENT].invalidated && d->buf[S_CURRENT].rank <= d->col_count)
-           || (d->buf[S_RIGHT].invalidated && d->buf[S_RIGHT].rank <= d->col_count));
+  for(int k = 0; k < _nb_slots(d); k++)
+  {
+    const dt_slideshow_buf_t *slot = &d->buf[k];
+    if(slot->invalidated && slot->rank >= 0 && slot->rank < d->col_count) return FALSE;
+  }
+  return TRUE;
 }
 
 static gboolean auto_advance(gpointer user_data)
 {
   dt_slideshow_t *d = (dt_slideshow_t *)user_data;
   if(!d->auto_advance) return FALSE;
-  if(!_is_idle(d)) return TRUE; // never try to advance if still exporting, but call me back again
+  // never try to advance if the next image is not ready, but call me back again
+  if(_slot(d, 1)->invalidated && _slot(d, 1)->rank < d->col_count) return TRUE;
   _step_state(d, S_REQUEST_STEP);
   return FALSE;
 }
 
+// the current image first, then the ones ahead in the direction of the last step, then the ones behind
+static dt_slideshow_buf_t *_next_slot(dt_slideshow_t *d)
+{
+  if(_needs_render(d, _slot(d, 0))) return _slot(d, 0);
+  for(int side = 1; side >= -1; side -= 2)
+    for(int k = 1; k <= d->depth; k++)
+    {
+      dt_slideshow_buf_t *slot = _slot(d, side * d->direction * k);
+      if(_needs_render(d, slot)) return slot;
+    }
+  return NULL;
+}
+
 static int32_t process_job_run(dt_job_t *job)
 {
   dt_slideshow_t *d = dt_control_job_get_params(job);
 
-  if(d->buf[S_CURRENT].invalidated && d->buf[S_CURRENT].rank <= d->col_count)
-  {
-    process_image(d, S_CURRENT);
-    dt_control_queue_redraw_center();
-  }
-  else if(d->buf[S_RIGHT].invalidated && d->buf[S_RIGHT].rank <= d->col_count)
+  // lock to copy the information to process the image
+  dt_pthread_mutex_lock(&d->lock);
+  dt_slideshow_buf_t *slot = d->leaving ? NULL : _next_slot(d);
+  dt_slideshow_format_t dat;
+  if(slot)
   {
-    process_image(d, S_RIGHT);
+    slot->rendering = TRUE;
+    dat.head.width = dat.head.max_width = d->width;
+    dat.head.height = dat.head.max_height = d->height;
+    dat.head.style[0] = '\0';
+    dat.rank = slot->rank;
   }
-  else if(d->buf[S_LEFT].invalidated && d->buf[S_LEFT].rank >= 0)
+  dt_pthread_mutex_unlock(&d->lock);
+
+  if(slot)
   {
-    process_image(d, S_LEFT);
+    dat.buf.buf = dt_alloc_align(sizeof(uint32_t) * dat.head.width * dat.head.height);
+    const int failed = !dat.buf.buf || process_image(&dat, dat.rank);
+
+    // lock to copy back into the slot the rendered buffer, not that this is done only if
+    // the slot rank is still the same as the local buffer rank. This can be false if the
+    // buffers have been shifted to advance to next image.
+    dt_pthread_mutex_lock(&d->lock);
+    if(!failed && dat.rank == slot->rank && slot->buf)
+    {
+      memcpy(slot->buf, dat.buf.buf, sizeof(uint32_t) * dat.buf.width * dat.buf.height);
+      slot->width = dat.buf.width;
+      slot->height = dat.buf.height;
+      slot->invalidated = FALSE;
+      if(slot == _slot(d, 0)) dt_control_queue_redraw_center();
+    }
+    else if(failed && dat.rank == slot->rank)
+    {
+      // don't try again and again, leave the slot empty
+      slot->width = slot->height = 0;
+      slot->invalidated = FALSE;
+    }
+    slot->rendering = FALSE;
+    dt_pthread_mutex_unlock(&d->lock);
+    dt_free_align(dat.buf.buf);
   }
 
   // any other slot to fill?
-  if(!_is_idle(d))
-    requeue_job(d);
+  dt_pthread_mutex_lock(&d->lock);
+  d->jobs--;
+  _schedule_jobs(d);
+  dt_pthread_mutex_unlock(&d->lock);
 
   return 0;
 }
@@ -289,7 +388,7 @@ static dt_job_t *process_job_create(dt_slideshow_t *d)
 
 static void _refresh_display(dt_slideshow_t *d)
 {
-  if(!d->buf[S_CURRENT].invalidated && d->buf[S_CURRENT].rank >= 0)
+  if(!_slot(d, 0)->invalidated && _slot(d, 0)->rank >= 0)
     dt_control_queue_redraw_center();
 }
 
@@ -300,13 +399,11 @@ static void _step_state(dt_slideshow_t *d, dt_slideshow_event_t event)
 
   if(event == S_REQUEST_STEP)
   {
-    if(d->buf[S_CURRENT].rank < d->col_count - 1)
+    if(_slot(d, 0)->rank < d->col_count - 1)
     {
-      shift_left(d);
-      d->buf[S_RIGHT].rank = d->buf[S_CURRENT].rank + 1;
-      d->buf[S_RIGHT].invalidated = d->buf[S_RIGHT].rank < d->col_count;
+      _shift(d, 1);
       _refresh_display(d);
-      requeue_job(d);
+      _schedule_jobs(d);
     }
     else
     {
@@ -316,13 +413,11 @@ static void _step_state(dt_slideshow_t *d, dt_slideshow_event_t event)
   }
   else if(event == S_REQUEST_STEP_BACK)
   {
-    if(d->buf[S_CURRENT].rank > 0)
+    if(_slot(d, 0)->rank > 0)
     {
-      shift_right(d);
-      d->buf[S_LEFT].rank = d->buf[S_CURRENT].rank - 1;
-      d->buf[S_LEFT].invalidated = d->buf[S_LEFT].rank >= 0;
+      _shift(d, -1);
       _refresh_display(d);
-      requeue_job(d);
+      _schedule_jobs(d);
     }
     else
     {
@@ -383,7 +478,8 @@ void enter(dt_view_t *self)
 
   dt_control_change_cursor(GDK_BLANK_CURSOR);
   d->mouse_timeout = 0;
-  d->exporting = 0;
+  d->jobs = 0;
+  d->leaving = FALSE;
 
   dt_ui_panel_show(darktable.gui->ui, DT_UI_PANEL_LEFT, FALSE, TRUE);
   dt_ui_panel_show(darktable.gui->ui, DT_UI_PANEL_RIGHT, FALSE, TRUE);
@@ -408,12 +504,19 @@ void enter(dt_view_t *self)
   d->width = rect.width * darktable.gui->ppd;
   d->height = rect.height * darktable.gui->ppd;
 
-  for(int k=S_LEFT; k<S_SLOT_LAST; k++)
+  d->depth = CLAMP(dt_conf_get_int("slideshow/prerender"), 1, S_MAX_DEPTH);
+  // keep a worker for the other jobs
+  d->max_jobs = CLAMP(darktable.control->num_threads - 1, 1, 2 * d->depth + 1);
+  d->current = d->depth;
+  d->direction = 1;
+
+  for(int k = 0; k < _nb_slots(d); k++)
   {
     d->buf[k].buf = dt_alloc_align(sizeof(uint32_t) * d->width * d->height);
     d->buf[k].width =  d->width;
     d->buf[k].height = d->height;
     d->buf[k].invalidated = TRUE;
+    d->buf[k].rendering = FALSE;
   }
 
   // if one selected start with it, otherwise start at the current lighttable offset
@@ -433,21 +536,20 @@ void enter(dt_view_t *self)
     sqlite3_finalize(stmt);
   }
 
-  d->buf[S_CURRENT].rank = selrank;
-  d->buf[S_LEFT].rank = d->buf[S_CURRENT].rank - 1;
-  d->buf[S_RIGHT].rank = d->buf[S_CURRENT].rank + 1;
+  for(int k = -d->depth; k <= d->depth; k++)
+    _slot(d, k)->rank = selrank + k;
 
   d->col_count = dt_collection_get_count(darktable.collection);
 
   d->auto_advance = FALSE;
   d->delay = dt_conf_get_int("slideshow_delay");
   // restart from beginning, will first increment counter by step and then prefetch
+  // start first jobs
+  _schedule_jobs(d);
   dt_pthread_mutex_unlock(&d->lock);
 
   gtk_widget_grab_focus(dt_ui_center(darktable.gui->ui));
 
-  // start first job
-  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, process_job_create(d));
   dt_control_log(_("waiting to start slideshow"));
 }
 
@@ -461,12 +563,15 @@ void leave(dt_view_t *self)
   d->auto_advance = FALSE;
 
   // exporting could be in action, just wait for the last to finish
-  // otherwise we will crash releasing lock and memory.
-  while(d->exporting > 0) sleep(1);
+  // otherwise we will crash releasing lock and memory. The queued jobs return right away.
+  dt_pthread_mutex_lock(&d->lock);
+  d->leaving = TRUE;
+  dt_pthread_mutex_unlock(&d->lock);
+  while(g_atomic_int_get(&d->jobs) > 0) g_usleep(10000);
 
   dt_pthread_mutex_lock(&d->lock);
 
-  for(int k=S_LEFT; k<S_SLOT_LAST; k++)
+  for(int k = 0; k < _nb_slots(d); k++)
   {
     dt_free_align(d->buf[k].buf);
     d->buf[k].buf = NULL;
@@ -482,9 +587,9 @@ void expose(dt_view_t *self, cairo_t *cr, int32_t width, int32_t height, int32_t
   dt_pthread_mutex_lock(&d->lock);
   cairo_paint(cr);
 
-  const dt_slideshow_buf_t *slot = &(d->buf[S_CURRENT]);
+  const dt_slideshow_buf_t *slot = _slot(d, 0);
 
-  if(slot->buf && slot->rank >= 0 && !slot->invalidated)
+  if(slot->buf && slot->rank >= 0 && !slot->invalidated && slot->width > 0)
   {
     // cope with possible resize of the window
     const float tr_width = d->width < slot->width ? 0.f : (d->width - slot->width) * .5f / darktable.gui->ppd;
@@ -628,35 +628,14 @@ void dt_view_manager_scrollbar_changed(dt_view_manager_t *vm, double x, double y
     vm->current_view->scrollbar_changed(vm->current_view, x, y);
 }
 
-dt_view_surface_value_t dt_view_image_get_surface(int32_t imgid, int width, int height, cairo_surface_t **surface,
-                                                  const gboolean quality)
+dt_view_surface_value_t dt_view_image_surface_from_buffer(const dt_mipmap_buffer_t *buf, const dt_mipmap_size_t mip,
+                                                          int width, int height, cairo_surface_t **surface)
 {
-  double tt = 0;
-  if((darktable.unmuted & (DT_DEBUG_LIGHTTABLE | DT_DEBUG_PERF)) == (DT_DEBUG_LIGHTTABLE | DT_DEBUG_PERF))
-    tt = dt_get_wtime();
-
   dt_view_surface_value_t ret = DT_VIEW_SURFACE_KO;
-  // if surface not null, clean it up
-  if(*surface
-     && cairo_surface_get_reference_count(*surface) > 0) cairo_surface_destroy(*surface);
-  *surface = NULL;
-
-  // get mipmap cache image
-  dt_mipmap_cache_t *cache = darktable.mipmap_cache;
-  dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(cache, ceilf(width * darktable.gui->ppd), ceilf(height * darktable.gui->ppd));
-
-  // if needed, we load the mimap buffer
-  dt_mipmap_buffer_t buf;
-  dt_mipmap_cache_get(cache, &buf, imgid, mip, DT_MIPMAP_BEST_EFFORT, 'r');
-  const int buf_wd = buf.width;
-  const int buf_ht = buf.height;
-
-  // if we don't get buffer, no image is awailable at the moment
-  if(!buf.buf)
-  {
-    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
-    return ret;
-  }
+  const uint8_t *const pixels = buf->buf;
+  const int buf_wd = buf->width;
+  const int buf_ht = buf->height;
+  if(!pixels || buf_wd <= 0 || buf_ht <= 0) return ret;
 
   // so we create a new image surface to return
   float scale = fminf(width / (float)buf_wd, height / (float)buf_ht) * darktable.gui->ppd;
@@ -668,59 +647,55 @@ dt_view_surface_value_t dt_view_image_get_surface(int32_t imgid, int width, int
 
   // we transfer cached image on a cairo_surface (with colorspace transform if needed)
   uint8_t *rgbbuf = (uint8_t *)calloc((size_t)buf_wd * buf_ht * 4, sizeof(uint8_t));
-  if(!rgbbuf)
-  {
-    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
-    return ret;
-  }
+  if(!rgbbuf) return ret;
 
   cmsHTRANSFORM transform = NULL;
   pthread_rwlock_rdlock(&darktable.color_profiles->xprofile_lock);
 
   // we only color manage when a thumbnail is sRGB or AdobeRGB. everything else just gets dumped to the
   // screen
-  if(buf.color_space == DT_COLORSPACE_SRGB
+  if(buf->color_space == DT_COLORSPACE_SRGB
       && darktable.color_profiles->transform_srgb_to_display)
   {
     transform = darktable.color_profiles->transform_srgb_to_display;
   }
-  else if(buf.color_space == DT_COLORSPACE_ADOBERGB
+  else if(buf->color_space == DT_COLORSPACE_ADOBERGB
           && darktable.color_profiles->transform_adobe_rgb_to_display)
   {
     transform = darktable.color_profiles->transform_adobe_rgb_to_display;
   }
-  // else if(buf.color_space == DT_COLORSPACE_DISPLAY)
+  // else if(buf->color_space == DT_COLORSPACE_DISPLAY)
   // no-op, buffer is already in display space, pass pixels through
   // which happens because transform = NULL
   else
   {
-    if(buf.color_space == DT_COLORSPACE_NONE)
+    if(buf->color_space == DT_COLORSPACE_NONE)
     {
       fprintf(stderr, "oops, there seems to be a code path not setting the color space of thumbnails!\n");
     }
-    else if(buf.color_space != DT_COLORSPACE_DISPLAY)
+    else if(buf->color_space != DT_COLORSPACE_DISPLAY)
     {
       fprintf(stderr,
               "oops, there seems to be a code path setting an unhandled color space of thumbnails (%s)!\n",
-              dt_colorspaces_get_name(buf.color_space, "from file"));
+              dt_colorspaces_get_name(buf->color_space, "from file"));
     }
   }
 
 #ifdef _OPENMP
-#pragma omp parallel for schedule(static) default(none) dt_omp_firstprivate(buf, rgbbuf, transform)
+#pragma omp parallel for schedule(static) default(none) dt_omp_firstprivate(pixels, buf_wd, buf_ht, rgbbuf, transform)
 #endif
-  for(int i = 0; i < buf.height; i++)
+  for(int i = 0; i < buf_ht; i++)
   {
-    const uint8_t *const restrict in = buf.buf + i * buf.width * 4;
-    uint8_t *const restrict out = rgbbuf + i * buf.width * 4;
+    const uint8_t *const restrict in = pixels + (size_t)i * buf_wd * 4;
+    uint8_t *const restrict out = rgbbuf + (size_t)i * buf_wd * 4;
 
     if(transform)
     {
-      cmsDoTransform(transform, in, out, buf.width);
+      cmsDoTransform(transform, in, out, buf_wd);
     }
     else
     {
-      for(int j = 0; j < buf.width; j++)
+      for(int j = 0; j < buf_wd; j++)
       {
         out[4 * j + 0] = in[4 * j + 2];
         out[4 * j + 1] = in[4 * j + 1];
@@ -734,7 +709,6 @@ dt_view_surface_value_t dt_view_image_get_surface(int32_t imgid, int width, int
   cairo_surface_t *tmp_surface = cairo_image_surface_create_for_data(rgbbuf, CAIRO_FORMAT_RGB24, buf_wd, buf_ht, stride);
   if(!tmp_surface)
   {
-    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
     free(rgbbuf);
     return ret;
   }
@@ -762,22 +736,59 @@ dt_view_surface_value_t dt_view_image_get_surface(int32_t imgid, int width, int
       The current implementation assumes the data at image is organized as a rectangle without a stride,
       So we pass the raw data to be processed, this is more data but correct.
   */
-  if(darktable.gui->show_focus_peaking && mip == buf.size)
+  if(darktable.gui->show_focus_peaking && mip == buf->size)
     dt_focuspeaking(cr, img_width, img_height, rgbbuf, buf_wd, buf_ht);
 
   cairo_surface_destroy(tmp_surface);
   cairo_destroy(cr);
 
+  free(rgbbuf);
+
   // we consider skull as ok as the image hasn't to be reload
   if(buf_wd <= 8 && buf_ht <= 8)
     ret = DT_VIEW_SURFACE_OK;
-  else if(mip != buf.size)
+  else if(mip != buf->size)
     ret = DT_VIEW_SURFACE_SMALLER;
   else
     ret = DT_VIEW_SURFACE_OK;
 
+  return ret;
+}
+
+dt_view_surface_value_t dt_view_image_get_surface(int32_t imgid, int width, int height, cairo_surface_t **surface,
+                                                  const gboolean quality)
+{
+  double tt = 0;
+  if((darktable.unmuted & (DT_DEBUG_LIGHTTABLE | DT_DEBUG_PERF)) == (DT_DEBUG_LIGHTTABLE | DT_DEBUG_PERF))
+    tt = dt_get_wtime();
+
+  dt_view_surface_value_t ret = DT_VIEW_SURFACE_KO;
+  // if surface not null, clean it up
+  if(*surface
+     && cairo_surface_get_reference_count(*surface) > 0) cairo_surface_destroy(*surface);
+  *surface = NULL;
+
+  // get mipmap cache image
+  dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(cache, ceilf(width * darktable.gui->ppd), ceilf(height * darktable.gui->ppd));
+
+  // if needed, we load the mimap buffer
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(cache, &buf, imgid, mip, DT_MIPMAP_BEST_EFFORT, 'r');
+
+  // if we don't get buffer, no image is awailable at the moment
+  if(!buf.buf)
+  {
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    return ret;
+  }
+
+  ret = dt_view_image_surface_from_buffer(&buf, mip, width, height, surface);
+  const int buf_wd = buf.width;
+  const int buf_ht = buf.height;
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
-  if(rgbbuf) free(rgbbuf);
+  const int img_width = *surface ? cairo_image_surface_get_width(*surface) : 0;
+  const int img_height = *surface ? cairo_image_surface_get_height(*surface) : 0;
 
   // logs
   if((darktable.unmuted & (DT_DEBUG_LIGHTTABLE | DT_DEBUG_PERF)) == (DT_DEBUG_LIGHTTABLE | DT_DEBUG_PERF))
@@ -792,7 +803,6 @@ dt_view_surface_value_t dt_view_image_get_surface(int32_t imgid, int width, int
              width, height, buf_wd, buf_ht, img_width, img_height);
   }
 
-  // we consider skull as ok as the image hasn't to be reload
   return ret;
 }
 
@@ -22,6 +22,7 @@
 
 #include "common/history.h"
 #include "common/image.h"
+#include "common/mipmap_cache.h"
 #ifdef HAVE_PRINT
 #include "common/cups_print.h"
 #include "common/printing.h"
@@ -151,6 +152,9 @@ char* dt_view_extend_modes_str(const char * name, const gboolean is_hdr, const g
 /** expose an image and return a cair0_surface. */
 dt_view_surface_value_t dt_view_image_get_surface(int32_t imgid, int width, int height, cairo_surface_t **surface,
                                                   const gboolean quality);
+/** same from a mipmap buffer already read locked, fetched for the requested size mip */
+dt_view_surface_value_t dt_view_image_surface_from_buffer(const dt_mipmap_buffer_t *buf, const dt_mipmap_size_t mip,
+                                                          int width, int height, cairo_surface_t **surface);
 
 
 /**